@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "esp_sleep.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "ulp_lp_core.h"
+#include "ulp_lp_core_lp_adc_shared.h"
+#include "lp_core_main.h"
+#include "battery_lp_shared.h"
+
+static const char *TAG = "battery_lp";
+
+#define V_C_MAX                     (2500)
+#define V_C_MIN                     (2250)
+
+extern const uint8_t lp_core_main_bin_start[] asm("_binary_lp_core_main_bin_start");
+extern const uint8_t lp_core_main_bin_end[]   asm("_binary_lp_core_main_bin_end");
+
+static void lp_core_start(void)
+{
+    // The LP ADC stays powered in deep sleep, it is set up once on the first boot
+    ESP_ERROR_CHECK(lp_core_lp_adc_init(BATTERY_LP_ADC_UNIT));
+    const lp_core_lp_adc_chan_cfg_t chan_config = {
+        .atten = BATTERY_LP_ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    ESP_ERROR_CHECK(lp_core_lp_adc_config_channel(BATTERY_LP_ADC_UNIT, BATTERY_LP_ADC_CHANNEL, &chan_config));
+
+    ESP_ERROR_CHECK(ulp_lp_core_load_binary(lp_core_main_bin_start, (lp_core_main_bin_end - lp_core_main_bin_start)));
+
+    ulp_low_mv = CONFIG_BATTERY_LP_LOW_MV;
+    ulp_low_hysteresis_mv = CONFIG_BATTERY_LP_LOW_HYSTERESIS_MV;
+    ulp_step_mv = CONFIG_BATTERY_LP_STEP_MV;
+    ulp_report_wakeups = (CONFIG_BATTERY_LP_REPORT_INTERVAL_S * 1000 + CONFIG_BATTERY_LP_SAMPLE_PERIOD_MS - 1) /
+                         CONFIG_BATTERY_LP_SAMPLE_PERIOD_MS;
+
+    const ulp_lp_core_cfg_t cfg = {
+        .wakeup_source = ULP_LP_CORE_WAKEUP_SOURCE_LP_TIMER,
+        .lp_timer_sleep_duration_us = CONFIG_BATTERY_LP_SAMPLE_PERIOD_MS * 1000,
+    };
+    ESP_ERROR_CHECK(ulp_lp_core_run(&cfg));
+
+    ESP_LOGI(TAG, "LP core samples the battery every %d ms, reports every %d s", CONFIG_BATTERY_LP_SAMPLE_PERIOD_MS,
+             CONFIG_BATTERY_LP_REPORT_INTERVAL_S);
+}
+
+static void battery_report(void)
+{
+    const int voltage = ulp_battery_mv;
+    const uint32_t reason = ulp_wake_reason;
+
+    int voltage_per = (voltage - V_C_MIN) * 100 / (V_C_MAX - V_C_MIN);
+    voltage_per = (voltage_per < 0) ? 0 : ((voltage_per > 100) ? 100 : voltage_per);
+
+    ESP_LOGI(TAG, "ADC%d Channel[%d] Voltage: %d mV, %"PRIu32" LP samples", BATTERY_LP_ADC_UNIT + 1,
+             BATTERY_LP_ADC_CHANNEL, voltage, ulp_samples);
+    ESP_LOGI(TAG, "Battery charge: %d %%%s%s%s", voltage_per,
+             (reason & BATTERY_LP_WAKE_LOW) ? ", low battery" : "",
+             (reason & BATTERY_LP_WAKE_STEP) ? ", step" : "",
+             (reason & BATTERY_LP_WAKE_REPORT) ? ", report" : "");
+}
+
+void app_main(void)
+{
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_ULP) {
+        battery_report();
+    } else {
+        lp_core_start();
+    }
+
+    // Nothing runs on the HP cores until the LP core wakes them up, on a threshold or at the reporting interval
+    ESP_ERROR_CHECK(esp_sleep_enable_ulp_wakeup());
+    esp_deep_sleep_start();
+}
@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+// Shared by the HP core app and the LP core app
+
+#define BATTERY_LP_ADC_UNIT         ADC_UNIT_2
+#define BATTERY_LP_ADC_CHANNEL      ADC_CHANNEL_4
+#define BATTERY_LP_ADC_ATTEN        ADC_ATTEN_DB_12
+
+#define BATTERY_LP_SAMPLES          (8)         // Conversions averaged per LP wakeup
+#define BATTERY_LP_FILTER_SHIFT     (2)         // IIR coefficient of 1/4 per LP wakeup
+
+// Why the LP core woke up the HP cores, a bit mask
+#define BATTERY_LP_WAKE_REPORT      (1 << 0)    // Reporting interval elapsed
+#define BATTERY_LP_WAKE_LOW         (1 << 1)    // Crossed below the low threshold
+#define BATTERY_LP_WAKE_STEP        (1 << 2)    // Moved by the step threshold since the last report, e.g. the charger
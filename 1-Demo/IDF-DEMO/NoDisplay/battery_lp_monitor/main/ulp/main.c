@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ulp_lp_core_utils.h"
+#include "ulp_lp_core_lp_adc_shared.h"
+#include "../battery_lp_shared.h"
+
+/* Set by the HP core before starting the LP core */
+uint32_t low_mv;
+uint32_t low_hysteresis_mv;
+uint32_t step_mv;
+uint32_t report_wakeups;
+
+/* Read by the HP core when it wakes up */
+uint32_t battery_mv;
+uint32_t wake_reason;
+uint32_t samples;
+
+/* Kept across the LP timer wakeups */
+static uint32_t filter_acc;
+static uint32_t reported_mv;
+static uint32_t wakeups;
+static bool primed;
+static bool low;
+
+int main(void)
+{
+    int sum = 0;
+    int num = 0;
+    for (int i = 0; i < BATTERY_LP_SAMPLES; i++) {
+        int mv = 0;
+        if (lp_core_lp_adc_read_channel_converted(BATTERY_LP_ADC_UNIT, BATTERY_LP_ADC_CHANNEL, &mv) == ESP_OK) {
+            sum += mv;
+            num++;
+        }
+    }
+    if (num == 0) {
+        return 0;
+    }
+    samples++;
+
+    const uint32_t mv = sum / num;
+    if (!primed) {
+        filter_acc = mv << BATTERY_LP_FILTER_SHIFT;
+        reported_mv = mv;
+        primed = true;
+    } else {
+        filter_acc += mv - (filter_acc >> BATTERY_LP_FILTER_SHIFT);
+    }
+    const uint32_t filtered_mv = filter_acc >> BATTERY_LP_FILTER_SHIFT;
+
+    uint32_t reason = 0;
+    if (++wakeups >= report_wakeups) {
+        reason |= BATTERY_LP_WAKE_REPORT;
+    }
+    // Only the crossing wakes the HP cores, not every sample below the threshold
+    if (!low && (filtered_mv < low_mv)) {
+        low = true;
+        reason |= BATTERY_LP_WAKE_LOW;
+    } else if (low && (filtered_mv >= low_mv + low_hysteresis_mv)) {
+        low = false;
+    }
+    if ((filtered_mv >= reported_mv + step_mv) || (filtered_mv + step_mv <= reported_mv)) {
+        reason |= BATTERY_LP_WAKE_STEP;
+    }
+
+    if (reason) {
+        battery_mv = filtered_mv;
+        wake_reason = reason;
+        reported_mv = filtered_mv;
+        wakeups = 0;
+        ulp_lp_core_wakeup_main_processor();
+    }
+
+    /* ulp_lp_core_halt() is called automatically when main exits, the LP timer starts the next run */
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "hal/adc_types.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct battery_monitor_t *battery_monitor_handle_t;
+
+/**
+ * @brief A filtered battery reading
+ */
+typedef struct {
+    int raw;                            /*!< Filtered raw ADC value */
+    int voltage_mv;                     /*!< Calibrated voltage at the ADC pin, 0 without calibration */
+    int percent;                        /*!< Charge between empty_mv and full_mv, 0 to 100 */
+    bool calibrated;                    /*!< The eFuse calibration is available, voltage_mv is valid */
+} battery_monitor_reading_t;
+
+/**
+ * @brief Called from the monitor task with a new reading, once per publish period
+ */
+typedef void (*battery_monitor_reading_cb_t)(battery_monitor_handle_t monitor,
+                                             const battery_monitor_reading_t *reading, void *user_ctx);
+
+/**
+ * @brief Configuration of a battery monitor
+ */
+typedef struct {
+    adc_unit_t unit;                    /*!< ADC unit of the battery divider */
+    adc_channel_t channel;              /*!< ADC channel of the battery divider */
+    adc_atten_t atten;                  /*!< Attenuation of the channel */
+    uint32_t sample_freq_hz;            /*!< Conversions per second, the DMA stores them without the CPU */
+    uint32_t frame_samples;             /*!< Conversions per DMA frame, each frame is averaged into one filter input */
+    uint8_t filter_shift;               /*!< IIR coefficient of 1/2^filter_shift, the time constant is this many frames */
+    uint32_t publish_period_ms;         /*!< Period of the readings */
+    int empty_mv;                       /*!< Voltage of an empty battery, 0 % */
+    int full_mv;                        /*!< Voltage of a full battery, 100 % */
+    battery_monitor_reading_cb_t on_reading; /*!< Reading callback, can be NULL to poll battery_monitor_get_reading() */
+    void *user_ctx;                     /*!< User context of the callback */
+    uint32_t task_stack;                /*!< Stack size of the monitor task, in bytes, the callback runs on it */
+    UBaseType_t task_priority;          /*!< Priority of the monitor task */
+    BaseType_t task_core;               /*!< Core of the monitor task, tskNO_AFFINITY for any */
+} battery_monitor_config_t;
+
+#define BATTERY_MONITOR_DEFAULT_CONFIG(adc_unit, adc_channel)  \
+    {                                                       \
+        .unit = adc_unit,                                   \
+        .channel = adc_channel,                             \
+        .atten = ADC_ATTEN_DB_12,                           \
+        .sample_freq_hz = 1000,                             \
+        .frame_samples = 100,                               \
+        .filter_shift = 3,                                  \
+        .publish_period_ms = 1000,                          \
+        .empty_mv = 0,                                      \
+        .full_mv = 0,                                       \
+        .on_reading = NULL,                                 \
+        .user_ctx = NULL,                                   \
+        .task_stack = 3072,                                 \
+        .task_priority = 4,                                 \
+        .task_core = tskNO_AFFINITY,                        \
+    }
+
+/**
+ * @brief Start sampling the battery with the continuous ADC driver
+ *
+ * The DMA fills a frame of `frame_samples` conversions at `sample_freq_hz`, and the monitor task only wakes up once a
+ * frame is complete. Each frame is averaged, which decimates it to one value, and the values go through a first order
+ * IIR filter. The filtered value is calibrated into a voltage and published every `publish_period_ms`.
+ *
+ * @param[in] config Configuration
+ * @param[out] ret_monitor Returned monitor handle
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: No memory for the monitor, the buffers or the task
+ *      - Others: Failed to set up the ADC
+ */
+esp_err_t battery_monitor_new(const battery_monitor_config_t *config, battery_monitor_handle_t *ret_monitor);
+
+/**
+ * @brief Get the latest reading
+ *
+ * @param[in] monitor Monitor handle
+ * @param[out] ret_reading Latest reading, all zero before the first publish period ends
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t battery_monitor_get_reading(battery_monitor_handle_t monitor, battery_monitor_reading_t *ret_reading);
+
+/**
+ * @brief Change the voltages of an empty and a full battery, e.g. while charging
+ *
+ * It applies from the next reading on, and can be called from the reading callback.
+ *
+ * @param[in] monitor Monitor handle
+ * @param[in] empty_mv Voltage of an empty battery, 0 %
+ * @param[in] full_mv Voltage of a full battery, 100 %
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t battery_monitor_set_range(battery_monitor_handle_t monitor, int empty_mv, int full_mv);
+
+/**
+ * @brief Stop sampling and free the monitor
+ *
+ * @note Don't call it from the reading callback
+ *
+ * @param[in] monitor Monitor handle
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t battery_monitor_del(battery_monitor_handle_t monitor);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct battery_soc_t *battery_soc_handle_t;
+
+/**
+ * @brief A point of the open circuit voltage curve of a cell
+ */
+typedef struct {
+    int16_t cell_mv;                    /*!< Open circuit voltage of the cell */
+    int16_t permille;                   /*!< State of charge at that voltage, in 0.1 % */
+} battery_soc_point_t;
+
+/**
+ * @brief Discharge curve of a typical Li-ion cell, from empty to full
+ */
+extern const battery_soc_point_t battery_soc_liion_curve[];
+extern const size_t battery_soc_liion_curve_len;
+
+/**
+ * @brief Configuration of a state of charge estimator
+ */
+typedef struct {
+    const battery_soc_point_t *curve;   /*!< Open circuit voltage curve, in ascending voltage */
+    size_t curve_len;                   /*!< Points of the curve, at least 2 */
+    uint16_t divider_num;               /*!< Cell voltage is the ADC pin voltage * divider_num / divider_den */
+    uint16_t divider_den;               /*!< See divider_num */
+    uint16_t internal_resistance_mohm;  /*!< Internal resistance of the cell, the load drops the voltage across it */
+    uint16_t charge_offset_mv;          /*!< Cell voltage the charger adds above the open circuit voltage */
+    uint16_t charge_enter_mv;           /*!< Rise above the voltage trend detecting that the charger is plugged in */
+    uint16_t charge_exit_mv;            /*!< Drop below the voltage trend detecting that the charger is unplugged */
+    uint8_t trend_shift;                /*!< The voltage trend follows with 1/2^trend_shift per update */
+    uint8_t hysteresis_permille;        /*!< Change of the estimate needed to move the published percentage */
+} battery_soc_config_t;
+
+#define BATTERY_SOC_DEFAULT_CONFIG()                        \
+    {                                                       \
+        .curve = battery_soc_liion_curve,                   \
+        .curve_len = battery_soc_liion_curve_len,           \
+        .divider_num = 2,                                   \
+        .divider_den = 1,                                   \
+        .internal_resistance_mohm = 150,                    \
+        .charge_offset_mv = 150,                            \
+        .charge_enter_mv = 60,                              \
+        .charge_exit_mv = 100,                              \
+        .trend_shift = 5,                                   \
+        .hysteresis_permille = 8,                           \
+    }
+
+/**
+ * @brief An estimated state of charge
+ */
+typedef struct {
+    int percent;                        /*!< Published state of charge, 0 to 100 */
+    int permille;                       /*!< Unfiltered estimate, in 0.1 % */
+    int ocv_mv;                         /*!< Estimated open circuit voltage of the cell */
+    bool charging;                      /*!< The charger is plugged in */
+} battery_soc_state_t;
+
+/**
+ * @brief Create a state of charge estimator
+ *
+ * Every update converts the ADC pin voltage into the cell voltage and compensates it for the load, or for the charger,
+ * into the open circuit voltage, which is looked up in the curve. The charger is detected by the step it causes in the
+ * voltage relative to its slow trend, with a larger step needed for the unplugging, so noise can't toggle the state.
+ * All the math is integer, it is meant to run at the rate of the battery readings, about once a second.
+ *
+ * @param[in] config Configuration, the curve must stay valid
+ * @param[out] ret_soc Returned estimator handle
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: No memory for the estimator
+ */
+esp_err_t battery_soc_new(const battery_soc_config_t *config, battery_soc_handle_t *ret_soc);
+
+/**
+ * @brief Update the estimate with a battery reading
+ *
+ * The published percentage only moves by more than `hysteresis_permille`, and only down while discharging or up while
+ * charging, so a display bound to it isn't redrawn for noise.
+ *
+ * @param[in] soc Estimator handle
+ * @param[in] pin_mv Calibrated voltage at the ADC pin, e.g. battery_monitor_reading_t::voltage_mv
+ * @param[out] ret_state Estimated state, can be NULL
+ * @return true if the published percentage or the charging state changed
+ */
+bool battery_soc_update(battery_soc_handle_t soc, int pin_mv, battery_soc_state_t *ret_state);
+
+/**
+ * @brief Set the current drawn from the battery, for the load compensation
+ *
+ * @param[in] soc Estimator handle
+ * @param[in] load_ma Current of the load, e.g. more with the backlight on
+ */
+void battery_soc_set_load(battery_soc_handle_t soc, int load_ma);
+
+/**
+ * @brief Free an estimator
+ *
+ * @param[in] soc Estimator handle
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t battery_soc_del(battery_soc_handle_t soc);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,315 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "battery_monitor.h"
+
+#define TAG "battery_monitor"
+
+#define BATTERY_MONITOR_POOL_FRAMES     (4)         // Frames the driver stores while the task is busy
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define BATTERY_MONITOR_OUTPUT_TYPE     ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define BATTERY_MONITOR_GET_CHANNEL(p)  ((p)->type1.channel)
+#define BATTERY_MONITOR_GET_DATA(p)     ((p)->type1.data)
+#else
+#define BATTERY_MONITOR_OUTPUT_TYPE     ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define BATTERY_MONITOR_GET_CHANNEL(p)  ((p)->type2.channel)
+#define BATTERY_MONITOR_GET_DATA(p)     ((p)->type2.data)
+#endif
+
+struct battery_monitor_t {
+    adc_continuous_handle_t adc;
+    adc_cali_handle_t cali;
+    adc_channel_t channel;
+    TaskHandle_t task;
+    TaskHandle_t deleter;
+    volatile bool stop;
+    uint8_t *frame;
+    uint32_t frame_size;
+    uint8_t filter_shift;
+    uint32_t filter_acc;                // Filtered raw value, scaled by 2^filter_shift
+    bool filter_primed;
+    TickType_t publish_period;
+    battery_monitor_reading_cb_t on_reading;
+    void *user_ctx;
+    portMUX_TYPE lock;                  // Protects the fields below
+    int empty_mv;
+    int full_mv;
+    battery_monitor_reading_t reading;
+};
+
+static bool battery_monitor_cali_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten,
+                                      adc_cali_handle_t *ret_handle)
+{
+    esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    const adc_cali_curve_fitting_config_t curve_config = {
+        .unit_id = unit,
+        .chan = channel,
+        .atten = atten,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    ret = adc_cali_create_scheme_curve_fitting(&curve_config, ret_handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    const adc_cali_line_fitting_config_t line_config = {
+        .unit_id = unit,
+        .atten = atten,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    ret = adc_cali_create_scheme_line_fitting(&line_config, ret_handle);
+#endif
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "eFuse not burnt, skip software calibration");
+        *ret_handle = NULL;
+    }
+    return (ret == ESP_OK);
+}
+
+static void battery_monitor_cali_deinit(adc_cali_handle_t handle)
+{
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_delete_scheme_curve_fitting(handle);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_delete_scheme_line_fitting(handle);
+#endif
+}
+
+static bool IRAM_ATTR battery_monitor_conv_done(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata,
+                                                void *user_data)
+{
+    struct battery_monitor_t *monitor = user_data;
+    BaseType_t task_woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(monitor->task, &task_woken);
+    return (task_woken == pdTRUE);
+}
+
+static void battery_monitor_filter(struct battery_monitor_t *monitor, const uint8_t *frame, uint32_t len)
+{
+    uint32_t sum = 0;
+    uint32_t num = 0;
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&frame[i];
+        if (BATTERY_MONITOR_GET_CHANNEL(p) == monitor->channel) {
+            sum += BATTERY_MONITOR_GET_DATA(p);
+            num++;
+        }
+    }
+    if (num == 0) {
+        return;
+    }
+
+    // Decimate the frame to its average, then y += (x - y) / 2^shift, in fixed point so no precision is lost
+    const uint32_t avg = sum / num;
+    if (!monitor->filter_primed) {
+        // Start from the first average instead of ramping up from 0
+        monitor->filter_acc = avg << monitor->filter_shift;
+        monitor->filter_primed = true;
+    } else {
+        monitor->filter_acc += avg - (monitor->filter_acc >> monitor->filter_shift);
+    }
+}
+
+static void battery_monitor_publish(struct battery_monitor_t *monitor)
+{
+    battery_monitor_reading_t reading = {
+        .raw = (monitor->filter_acc + (1U << monitor->filter_shift >> 1)) >> monitor->filter_shift,
+        .calibrated = (monitor->cali != NULL),
+    };
+    if (reading.calibrated && (adc_cali_raw_to_voltage(monitor->cali, reading.raw, &reading.voltage_mv) != ESP_OK)) {
+        reading.voltage_mv = 0;
+    }
+
+    portENTER_CRITICAL(&monitor->lock);
+    const int empty_mv = monitor->empty_mv;
+    const int full_mv = monitor->full_mv;
+    portEXIT_CRITICAL(&monitor->lock);
+
+    if (full_mv > empty_mv) {
+        reading.percent = (reading.voltage_mv - empty_mv) * 100 / (full_mv - empty_mv);
+        reading.percent = (reading.percent < 0) ? 0 : ((reading.percent > 100) ? 100 : reading.percent);
+    }
+
+    portENTER_CRITICAL(&monitor->lock);
+    monitor->reading = reading;
+    portEXIT_CRITICAL(&monitor->lock);
+
+    if (monitor->on_reading) {
+        monitor->on_reading(monitor, &reading, monitor->user_ctx);
+    }
+}
+
+static void battery_monitor_task(void *arg)
+{
+    struct battery_monitor_t *monitor = arg;
+    TickType_t last_publish = xTaskGetTickCount();
+
+    while (!monitor->stop) {
+        // Woken once per DMA frame, the conversions themselves don't involve the CPU
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t len = 0;
+        while (!monitor->stop &&
+                (adc_continuous_read(monitor->adc, monitor->frame, monitor->frame_size, &len, 0) == ESP_OK)) {
+            battery_monitor_filter(monitor, monitor->frame, len);
+        }
+
+        if (monitor->filter_primed && (xTaskGetTickCount() - last_publish >= monitor->publish_period)) {
+            last_publish += monitor->publish_period;
+            battery_monitor_publish(monitor);
+        }
+    }
+
+    xTaskNotifyGive(monitor->deleter);
+    vTaskDelete(NULL);
+}
+
+esp_err_t battery_monitor_new(const battery_monitor_config_t *config, battery_monitor_handle_t *ret_monitor)
+{
+    esp_err_t ret = ESP_OK;
+    struct battery_monitor_t *monitor = NULL;
+
+    ESP_RETURN_ON_FALSE(config && ret_monitor && (config->frame_samples > 0) && (config->filter_shift < 16) &&
+                        (config->publish_period_ms > 0), ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE((config->sample_freq_hz >= SOC_ADC_SAMPLE_FREQ_THRES_LOW) &&
+                        (config->sample_freq_hz <= SOC_ADC_SAMPLE_FREQ_THRES_HIGH), ESP_ERR_INVALID_ARG, TAG,
+                        "Sample frequency out of %d..%d Hz", SOC_ADC_SAMPLE_FREQ_THRES_LOW,
+                        SOC_ADC_SAMPLE_FREQ_THRES_HIGH);
+
+    monitor = calloc(1, sizeof(struct battery_monitor_t));
+    ESP_RETURN_ON_FALSE(monitor, ESP_ERR_NO_MEM, TAG, "No memory for the monitor");
+    monitor->channel = config->channel;
+    monitor->frame_size = config->frame_samples * SOC_ADC_DIGI_RESULT_BYTES;
+    monitor->filter_shift = config->filter_shift;
+    monitor->publish_period = pdMS_TO_TICKS(config->publish_period_ms);
+    monitor->on_reading = config->on_reading;
+    monitor->user_ctx = config->user_ctx;
+    monitor->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    monitor->empty_mv = config->empty_mv;
+    monitor->full_mv = config->full_mv;
+    monitor->frame = malloc(monitor->frame_size);
+    ESP_GOTO_ON_FALSE(monitor->frame, ESP_ERR_NO_MEM, err, TAG, "No memory for the frame");
+
+    const adc_continuous_handle_cfg_t adc_config = {
+        .max_store_buf_size = monitor->frame_size * BATTERY_MONITOR_POOL_FRAMES,
+        .conv_frame_size = monitor->frame_size,
+        .flags = {
+            // Drop the oldest conversions instead of stopping, if the task falls behind
+            .flush_pool = true,
+        },
+    };
+    ESP_GOTO_ON_ERROR(adc_continuous_new_handle(&adc_config, &monitor->adc), err, TAG, "Create ADC handle failed");
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = config->atten,
+        .channel = config->channel,
+        .unit = config->unit,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    const adc_continuous_config_t dig_config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = config->sample_freq_hz,
+        .conv_mode = (config->unit == ADC_UNIT_1) ? ADC_CONV_SINGLE_UNIT_1 : ADC_CONV_SINGLE_UNIT_2,
+        .format = BATTERY_MONITOR_OUTPUT_TYPE,
+    };
+    ESP_GOTO_ON_ERROR(adc_continuous_config(monitor->adc, &dig_config), err, TAG, "Configure ADC failed");
+
+    battery_monitor_cali_init(config->unit, config->channel, config->atten, &monitor->cali);
+
+    const adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = battery_monitor_conv_done,
+    };
+    ESP_GOTO_ON_ERROR(adc_continuous_register_event_callbacks(monitor->adc, &cbs, monitor), err, TAG,
+                      "Register ADC callbacks failed");
+
+    // Created before the ADC starts, the first frame notifies it
+    BaseType_t res = xTaskCreatePinnedToCore(battery_monitor_task, "battery_monitor", config->task_stack, monitor,
+                                             config->task_priority, &monitor->task, config->task_core);
+    ESP_GOTO_ON_FALSE(res == pdPASS, ESP_ERR_NO_MEM, err, TAG, "Create monitor task failed");
+
+    ret = adc_continuous_start(monitor->adc);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Start ADC failed");
+        battery_monitor_del(monitor);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Battery on ADC%d channel %d, %"PRIu32" Hz in frames of %"PRIu32", published every %"PRIu32" ms",
+             config->unit + 1, config->channel, config->sample_freq_hz, config->frame_samples,
+             config->publish_period_ms);
+    *ret_monitor = monitor;
+
+    return ESP_OK;
+
+err:
+    if (monitor->cali) {
+        battery_monitor_cali_deinit(monitor->cali);
+    }
+    if (monitor->adc) {
+        adc_continuous_deinit(monitor->adc);
+    }
+    free(monitor->frame);
+    free(monitor);
+    return ret;
+}
+
+esp_err_t battery_monitor_get_reading(battery_monitor_handle_t monitor, battery_monitor_reading_t *ret_reading)
+{
+    ESP_RETURN_ON_FALSE(monitor && ret_reading, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    portENTER_CRITICAL(&monitor->lock);
+    *ret_reading = monitor->reading;
+    portEXIT_CRITICAL(&monitor->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t battery_monitor_set_range(battery_monitor_handle_t monitor, int empty_mv, int full_mv)
+{
+    ESP_RETURN_ON_FALSE(monitor && (full_mv > empty_mv), ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    portENTER_CRITICAL(&monitor->lock);
+    monitor->empty_mv = empty_mv;
+    monitor->full_mv = full_mv;
+    portEXIT_CRITICAL(&monitor->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t battery_monitor_del(battery_monitor_handle_t monitor)
+{
+    ESP_RETURN_ON_FALSE(monitor, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    // Stopping the ADC first, a frame completing meanwhile would notify a deleted task
+    adc_continuous_stop(monitor->adc);
+    monitor->deleter = xTaskGetCurrentTaskHandle();
+    monitor->stop = true;
+    xTaskNotifyGive(monitor->task);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    adc_continuous_deinit(monitor->adc);
+    if (monitor->cali) {
+        battery_monitor_cali_deinit(monitor->cali);
+    }
+    free(monitor->frame);
+    free(monitor);
+
+    return ESP_OK;
+}
@@ -0,0 +1,153 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_check.h"
+#include "battery_soc.h"
+
+#define TAG "battery_soc"
+
+const battery_soc_point_t battery_soc_liion_curve[] = {
+    { 3270,    0 },
+    { 3610,   50 },
+    { 3690,  100 },
+    { 3710,  150 },
+    { 3730,  200 },
+    { 3750,  250 },
+    { 3770,  300 },
+    { 3790,  350 },
+    { 3800,  400 },
+    { 3820,  450 },
+    { 3840,  500 },
+    { 3850,  550 },
+    { 3870,  600 },
+    { 3910,  650 },
+    { 3950,  700 },
+    { 3980,  750 },
+    { 4020,  800 },
+    { 4080,  850 },
+    { 4110,  900 },
+    { 4150,  950 },
+    { 4200, 1000 },
+};
+const size_t battery_soc_liion_curve_len = sizeof(battery_soc_liion_curve) / sizeof(battery_soc_liion_curve[0]);
+
+struct battery_soc_t {
+    battery_soc_config_t config;
+    atomic_int load_ma;
+    int32_t trend_acc;                  // Voltage trend of the cell, scaled by 2^trend_shift
+    bool primed;
+    bool charging;
+    int percent;
+};
+
+static int battery_soc_lookup(const battery_soc_config_t *config, int ocv_mv)
+{
+    const battery_soc_point_t *curve = config->curve;
+
+    if (ocv_mv <= curve[0].cell_mv) {
+        return curve[0].permille;
+    }
+    for (size_t i = 1; i < config->curve_len; i++) {
+        if (ocv_mv < curve[i].cell_mv) {
+            // Linear between the two points around the voltage
+            const int dv = curve[i].cell_mv - curve[i - 1].cell_mv;
+            const int dp = curve[i].permille - curve[i - 1].permille;
+            return curve[i - 1].permille + (ocv_mv - curve[i - 1].cell_mv) * dp / dv;
+        }
+    }
+    return curve[config->curve_len - 1].permille;
+}
+
+esp_err_t battery_soc_new(const battery_soc_config_t *config, battery_soc_handle_t *ret_soc)
+{
+    ESP_RETURN_ON_FALSE(config && ret_soc && config->curve && (config->curve_len >= 2) && config->divider_num &&
+                        config->divider_den && (config->trend_shift < 16), ESP_ERR_INVALID_ARG, TAG,
+                        "Invalid argument");
+    for (size_t i = 1; i < config->curve_len; i++) {
+        ESP_RETURN_ON_FALSE(config->curve[i].cell_mv > config->curve[i - 1].cell_mv, ESP_ERR_INVALID_ARG, TAG,
+                            "Curve not in ascending voltage at point %d", (int)i);
+    }
+
+    struct battery_soc_t *soc = calloc(1, sizeof(struct battery_soc_t));
+    ESP_RETURN_ON_FALSE(soc, ESP_ERR_NO_MEM, TAG, "No memory for the estimator");
+    soc->config = *config;
+    atomic_init(&soc->load_ma, 0);
+    *ret_soc = soc;
+
+    return ESP_OK;
+}
+
+bool battery_soc_update(battery_soc_handle_t soc, int pin_mv, battery_soc_state_t *ret_state)
+{
+    const battery_soc_config_t *config = &soc->config;
+    const int cell_mv = pin_mv * config->divider_num / config->divider_den;
+    const bool was_charging = soc->charging;
+    const int last_percent = soc->percent;
+
+    if (!soc->primed) {
+        soc->trend_acc = cell_mv << config->trend_shift;
+        // Full or more is only reached with the charger
+        soc->charging = (cell_mv > config->curve[config->curve_len - 1].cell_mv + config->charge_enter_mv);
+    } else {
+        // The charger makes a step against the slow trend, the hysteresis between the two thresholds keeps noise and
+        // load changes from toggling the state
+        const int trend_mv = soc->trend_acc >> config->trend_shift;
+        const bool step_up = (cell_mv - trend_mv >= config->charge_enter_mv);
+        const bool step_down = (trend_mv - cell_mv >= config->charge_exit_mv);
+        if ((!soc->charging && step_up) || (soc->charging && step_down)) {
+            soc->charging = !soc->charging;
+            // Follow the step at once, the trend would otherwise see it again for a while
+            soc->trend_acc = cell_mv << config->trend_shift;
+        } else {
+            soc->trend_acc += cell_mv - trend_mv;
+        }
+    }
+
+    // Open circuit voltage: the load drops the voltage across the internal resistance, the charger raises it
+    int ocv_mv = cell_mv;
+    if (soc->charging) {
+        ocv_mv -= config->charge_offset_mv;
+    } else {
+        ocv_mv += atomic_load_explicit(&soc->load_ma, memory_order_relaxed) * config->internal_resistance_mohm / 1000;
+    }
+    const int permille = battery_soc_lookup(config, ocv_mv);
+
+    // Round to the nearest percent, but only move it past the hysteresis and in the direction of the current
+    const int rounded = (permille + 5) / 10;
+    const int delta = permille - soc->percent * 10;
+    if (!soc->primed || (soc->charging != was_charging)) {
+        soc->percent = rounded;
+    } else if (soc->charging ? (delta >= config->hysteresis_permille) : (-delta >= config->hysteresis_permille)) {
+        soc->percent = rounded;
+    }
+    const bool changed = !soc->primed || (soc->percent != last_percent) || (soc->charging != was_charging);
+    soc->primed = true;
+
+    if (ret_state) {
+        ret_state->percent = soc->percent;
+        ret_state->permille = permille;
+        ret_state->ocv_mv = ocv_mv;
+        ret_state->charging = soc->charging;
+    }
+    return changed;
+}
+
+void battery_soc_set_load(battery_soc_handle_t soc, int load_ma)
+{
+    atomic_store_explicit(&soc->load_ma, load_ma, memory_order_relaxed);
+}
+
+esp_err_t battery_soc_del(battery_soc_handle_t soc)
+{
+    ESP_RETURN_ON_FALSE(soc, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    free(soc);
+
+    return ESP_OK;
+}
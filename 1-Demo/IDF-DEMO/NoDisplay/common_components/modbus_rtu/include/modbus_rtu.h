@@ -0,0 +1,247 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "rs485_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MODBUS_RTU_MAX_ADU                  (256)       // Longest RTU frame, address and CRC included
+#define MODBUS_RTU_MAX_READ_REGS            (125)
+#define MODBUS_RTU_MAX_WRITE_REGS           (123)
+#define MODBUS_RTU_MAX_READ_BITS            (2000)
+#define MODBUS_RTU_MAX_WRITE_BITS           (1968)
+#define MODBUS_RTU_BROADCAST                (0)
+
+/**
+ * @brief Function codes
+ */
+typedef enum {
+    MODBUS_RTU_READ_COILS = 0x01,
+    MODBUS_RTU_READ_DISCRETE_INPUTS = 0x02,
+    MODBUS_RTU_READ_HOLDING_REGISTERS = 0x03,
+    MODBUS_RTU_READ_INPUT_REGISTERS = 0x04,
+    MODBUS_RTU_WRITE_SINGLE_COIL = 0x05,
+    MODBUS_RTU_WRITE_SINGLE_REGISTER = 0x06,
+    MODBUS_RTU_WRITE_MULTIPLE_COILS = 0x0F,
+    MODBUS_RTU_WRITE_MULTIPLE_REGISTERS = 0x10,
+} modbus_rtu_function_t;
+
+/**
+ * @brief Exception codes
+ */
+typedef enum {
+    MODBUS_RTU_EX_NONE = 0x00,
+    MODBUS_RTU_EX_ILLEGAL_FUNCTION = 0x01,
+    MODBUS_RTU_EX_ILLEGAL_DATA_ADDRESS = 0x02,
+    MODBUS_RTU_EX_ILLEGAL_DATA_VALUE = 0x03,
+} modbus_rtu_exception_t;
+
+/**
+ * @brief CRC16 of a frame, the CRC is sent low byte first
+ *
+ * @param[in] data: The frame without its CRC
+ * @param[in] len: Length of the frame
+ *
+ * @return The CRC
+ */
+uint16_t modbus_rtu_crc16(const uint8_t *data, size_t len);
+
+/**************************************************************************************************
+ * Master
+ **************************************************************************************************/
+typedef struct modbus_rtu_master_t *modbus_rtu_master_handle_t;
+
+/**
+ * @brief A request of the poll cycle
+ *
+ * Registers are host order `uint16_t`, coils and discrete inputs are packed 8 per byte, LSB first, as on the bus.
+ * The master reads into `data` and writes from it, in the task of the bus or of esp_timer. Read it, or change what
+ * is written, from the cycle callback to see a consistent cycle.
+ */
+typedef struct {
+    uint8_t slave;                      /*!< Slave address, MODBUS_RTU_BROADCAST for a write to all slaves */
+    modbus_rtu_function_t function;     /*!< Function code */
+    uint16_t address;                   /*!< First register or coil */
+    uint16_t count;                     /*!< Registers or coils, 1 for the single writes */
+    void *data;                         /*!< Registers or packed coils */
+    /* Results, updated every cycle */
+    esp_err_t status;                   /*!< ESP_OK, ESP_ERR_TIMEOUT, ESP_ERR_INVALID_CRC or ESP_ERR_INVALID_RESPONSE */
+    modbus_rtu_exception_t exception;   /*!< Exception of the slave, with ESP_ERR_INVALID_RESPONSE */
+    uint32_t errors;                    /*!< Requests which didn't succeed */
+} modbus_rtu_poll_t;
+
+/**
+ * @brief Called at the end of every poll cycle, from the task of the bus or of esp_timer
+ *
+ * @param[in] cycle_us: Time of the cycle
+ */
+typedef void (*modbus_rtu_cycle_cb_t)(modbus_rtu_master_handle_t master, uint32_t cycle_us, void *user_ctx);
+
+/**
+ * @brief Configuration of a master
+ */
+typedef struct {
+    modbus_rtu_poll_t *polls;           /*!< Requests of one cycle, must stay valid */
+    size_t poll_num;                    /*!< Number of requests */
+    uint32_t response_timeout_ms;       /*!< Time a slave has to answer, from the end of the request */
+    uint32_t turnaround_ms;             /*!< Time the slaves have to process a broadcast */
+    modbus_rtu_cycle_cb_t on_cycle;     /*!< Cycle callback */
+    void *user_ctx;                     /*!< User context of the callback */
+} modbus_rtu_master_config_t;
+
+#define MODBUS_RTU_MASTER_DEFAULT_CONFIG()          \
+    {                                               \
+        .polls = NULL,                              \
+        .poll_num = 0,                              \
+        .response_timeout_ms = 20,                  \
+        .turnaround_ms = 5,                         \
+        .on_cycle = NULL,                           \
+        .user_ctx = NULL,                           \
+    }
+
+/**
+ * @brief Counters of a master
+ */
+typedef struct {
+    uint32_t cycles;                    /*!< Completed cycles */
+    uint32_t last_cycle_us;             /*!< Time of the last cycle */
+    uint32_t min_cycle_us;              /*!< Shortest cycle */
+    uint32_t max_cycle_us;              /*!< Longest cycle */
+    uint32_t timeouts;                  /*!< Requests without a response */
+    uint32_t bad_responses;             /*!< CRC errors, exceptions and malformed responses */
+    uint32_t unexpected;                /*!< Frames received while no response was due, or from another slave */
+} modbus_rtu_master_stats_t;
+
+/**
+ * @brief Create a master on a new RS485 bus and start the poll cycle
+ *
+ * The bus ends a frame on the hardware RX timeout, `idle_symbols` of the bus config sets the t3.5 gap. The next
+ * request goes out from the frame callback as soon as a response is checked, without a task switch or a timer.
+ *
+ * @param[in] bus_config: Configuration of the bus, its callback is set by the master
+ * @param[in] config: Configuration of the master
+ * @param[out] ret_master: The master
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument, or a request out of the Modbus limits
+ *      - ESP_ERR_NO_MEM: No memory for the master
+ *      - Others: Failed to create the bus
+ */
+esp_err_t modbus_rtu_master_new(const rs485_bus_config_t *bus_config, const modbus_rtu_master_config_t *config,
+                                modbus_rtu_master_handle_t *ret_master);
+
+/**
+ * @brief Get the counters of a master
+ *
+ * @param[in] master: The master
+ * @param[out] ret_stats: The counters
+ */
+void modbus_rtu_master_get_stats(modbus_rtu_master_handle_t master, modbus_rtu_master_stats_t *ret_stats);
+
+/**
+ * @brief Stop the poll cycle after the request in progress and delete the master and its bus
+ *
+ * @note Don't call it from the cycle callback
+ *
+ * @param[in] master: The master
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t modbus_rtu_master_del(modbus_rtu_master_handle_t master);
+
+/**************************************************************************************************
+ * Slave
+ **************************************************************************************************/
+typedef struct modbus_rtu_slave_t *modbus_rtu_slave_handle_t;
+
+/**
+ * @brief Called from the bus task after the master wrote registers or coils, before the response is sent
+ *
+ * @param[in] function: MODBUS_RTU_WRITE_*
+ * @param[in] address: First register or coil written
+ * @param[in] count: Registers or coils written
+ */
+typedef void (*modbus_rtu_write_cb_t)(modbus_rtu_slave_handle_t slave, modbus_rtu_function_t function,
+                                      uint16_t address, uint16_t count, void *user_ctx);
+
+/**
+ * @brief Configuration of a slave
+ *
+ * The tables are read and written by the bus task. A table without entries answers ILLEGAL_FUNCTION.
+ */
+typedef struct {
+    uint8_t address;                    /*!< Slave address, 1 to 247 */
+    uint16_t *holding_regs;             /*!< Holding registers, from address 0 */
+    uint16_t holding_reg_num;
+    uint16_t *input_regs;               /*!< Input registers, from address 0 */
+    uint16_t input_reg_num;
+    uint8_t *coils;                     /*!< Coils packed 8 per byte, LSB first, from address 0 */
+    uint16_t coil_num;
+    uint8_t *discrete_inputs;           /*!< Discrete inputs packed 8 per byte, LSB first, from address 0 */
+    uint16_t discrete_input_num;
+    modbus_rtu_write_cb_t on_write;     /*!< Write callback, can be NULL */
+    void *user_ctx;                     /*!< User context of the callback */
+} modbus_rtu_slave_config_t;
+
+/**
+ * @brief Counters of a slave
+ */
+typedef struct {
+    uint32_t requests;                  /*!< Requests to this slave, broadcasts included */
+    uint32_t exceptions;                /*!< Exception responses */
+    uint32_t crc_errors;                /*!< Frames with a bad CRC */
+} modbus_rtu_slave_stats_t;
+
+/**
+ * @brief Create a slave on a new RS485 bus
+ *
+ * A request is answered from the frame callback, right after the t3.5 gap which ended it.
+ *
+ * @param[in] bus_config: Configuration of the bus, its callback is set by the slave
+ * @param[in] config: Configuration of the slave, the tables must stay valid
+ * @param[out] ret_slave: The slave
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: No memory for the slave
+ *      - Others: Failed to create the bus
+ */
+esp_err_t modbus_rtu_slave_new(const rs485_bus_config_t *bus_config, const modbus_rtu_slave_config_t *config,
+                               modbus_rtu_slave_handle_t *ret_slave);
+
+/**
+ * @brief Get the counters of a slave
+ *
+ * @param[in] slave: The slave
+ * @param[out] ret_stats: The counters
+ */
+void modbus_rtu_slave_get_stats(modbus_rtu_slave_handle_t slave, modbus_rtu_slave_stats_t *ret_stats);
+
+/**
+ * @brief Delete a slave and its bus
+ *
+ * @param[in] slave: The slave
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t modbus_rtu_slave_del(modbus_rtu_slave_handle_t slave);
+
+#ifdef __cplusplus
+}
+#endif
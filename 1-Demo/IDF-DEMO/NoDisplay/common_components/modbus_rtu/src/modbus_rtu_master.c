@@ -0,0 +1,365 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include <stdlib.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "modbus_rtu_priv.h"
+
+#define TAG "modbus_master"
+
+#define MODBUS_RTU_TIMER_SLACK_US   (50)
+
+struct modbus_rtu_master_t {
+    rs485_bus_handle_t bus;
+    modbus_rtu_poll_t *polls;
+    size_t poll_num;
+    size_t index;                       // Request in progress
+    bool awaiting;                      // The request in progress isn't resolved yet, under the lock
+    int64_t deadline_us;                // Its timeout, under the lock
+    volatile bool running;
+    portMUX_TYPE lock;
+    esp_timer_handle_t timer;           // Response timeout, or broadcast turnaround
+    SemaphoreHandle_t stopped;
+    uint32_t symbol_us_x10;             // Time of 10 symbols, in us
+    uint32_t response_timeout_us;
+    uint32_t turnaround_us;
+    int64_t cycle_start_us;
+    modbus_rtu_cycle_cb_t on_cycle;
+    void *user_ctx;
+    size_t tx_len;
+    uint8_t tx[MODBUS_RTU_MAX_ADU];
+    modbus_rtu_master_stats_t stats;
+};
+
+static esp_err_t modbus_rtu_check_poll(const modbus_rtu_poll_t *poll)
+{
+    ESP_RETURN_ON_FALSE(poll->slave <= 247, ESP_ERR_INVALID_ARG, TAG, "Invalid slave %d", poll->slave);
+
+    uint16_t max_count = 1;
+    bool is_write = true;
+    switch (poll->function) {
+    case MODBUS_RTU_READ_COILS:
+    case MODBUS_RTU_READ_DISCRETE_INPUTS:
+        max_count = MODBUS_RTU_MAX_READ_BITS;
+        is_write = false;
+        break;
+    case MODBUS_RTU_READ_HOLDING_REGISTERS:
+    case MODBUS_RTU_READ_INPUT_REGISTERS:
+        max_count = MODBUS_RTU_MAX_READ_REGS;
+        is_write = false;
+        break;
+    case MODBUS_RTU_WRITE_SINGLE_COIL:
+    case MODBUS_RTU_WRITE_SINGLE_REGISTER:
+        break;
+    case MODBUS_RTU_WRITE_MULTIPLE_COILS:
+        max_count = MODBUS_RTU_MAX_WRITE_BITS;
+        break;
+    case MODBUS_RTU_WRITE_MULTIPLE_REGISTERS:
+        max_count = MODBUS_RTU_MAX_WRITE_REGS;
+        break;
+    default:
+        ESP_LOGE(TAG, "Unsupported function 0x%02x", poll->function);
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_RETURN_ON_FALSE(poll->data && (poll->count > 0) && (poll->count <= max_count), ESP_ERR_INVALID_ARG, TAG,
+                        "Invalid count %d of slave %d", poll->count, poll->slave);
+    ESP_RETURN_ON_FALSE(is_write || (poll->slave != MODBUS_RTU_BROADCAST), ESP_ERR_INVALID_ARG, TAG,
+                        "A read can't be broadcast");
+
+    return ESP_OK;
+}
+
+static size_t modbus_rtu_build_request(const modbus_rtu_poll_t *poll, uint8_t *frame)
+{
+    size_t len = 6;
+
+    frame[0] = poll->slave;
+    frame[1] = poll->function;
+    modbus_rtu_put_u16(&frame[2], poll->address);
+    switch (poll->function) {
+    case MODBUS_RTU_WRITE_SINGLE_COIL:
+        modbus_rtu_put_u16(&frame[4], (((const uint8_t *)poll->data)[0] & 0x01) ? 0xFF00 : 0x0000);
+        break;
+    case MODBUS_RTU_WRITE_SINGLE_REGISTER:
+        modbus_rtu_put_u16(&frame[4], ((const uint16_t *)poll->data)[0]);
+        break;
+    case MODBUS_RTU_WRITE_MULTIPLE_COILS:
+        modbus_rtu_put_u16(&frame[4], poll->count);
+        frame[6] = (poll->count + 7) / 8;
+        memcpy(&frame[7], poll->data, frame[6]);
+        len = 7 + frame[6];
+        break;
+    case MODBUS_RTU_WRITE_MULTIPLE_REGISTERS:
+        modbus_rtu_put_u16(&frame[4], poll->count);
+        frame[6] = poll->count * 2;
+        for (int i = 0; i < poll->count; i++) {
+            modbus_rtu_put_u16(&frame[7 + i * 2], ((const uint16_t *)poll->data)[i]);
+        }
+        len = 7 + frame[6];
+        break;
+    default:
+        modbus_rtu_put_u16(&frame[4], poll->count);
+        break;
+    }
+
+    return modbus_rtu_put_crc(frame, len);
+}
+
+static esp_err_t modbus_rtu_parse_response(struct modbus_rtu_master_t *master, modbus_rtu_poll_t *poll,
+                                           const uint8_t *frame, size_t len)
+{
+    poll->exception = MODBUS_RTU_EX_NONE;
+    if ((len < MODBUS_RTU_MIN_ADU + 1) || !modbus_rtu_crc_ok(frame, len)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    if ((frame[1] == (poll->function | MODBUS_RTU_EXCEPTION_FLAG)) && (len == 5)) {
+        poll->exception = frame[2];
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (frame[1] != poll->function) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    switch (poll->function) {
+    case MODBUS_RTU_READ_COILS:
+    case MODBUS_RTU_READ_DISCRETE_INPUTS: {
+        const size_t bytes = (poll->count + 7) / 8;
+        if ((frame[2] != bytes) || (len != 5 + bytes)) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        memcpy(poll->data, &frame[3], bytes);
+        break;
+    }
+    case MODBUS_RTU_READ_HOLDING_REGISTERS:
+    case MODBUS_RTU_READ_INPUT_REGISTERS: {
+        const size_t bytes = poll->count * 2;
+        if ((frame[2] != bytes) || (len != 5 + bytes)) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        uint16_t *regs = (uint16_t *)poll->data;
+        for (int i = 0; i < poll->count; i++) {
+            regs[i] = modbus_rtu_get_u16(&frame[3 + i * 2]);
+        }
+        break;
+    }
+    case MODBUS_RTU_WRITE_SINGLE_COIL:
+    case MODBUS_RTU_WRITE_SINGLE_REGISTER:
+        // Echo of the request
+        if ((len != 8) || (memcmp(frame, master->tx, 6) != 0)) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        break;
+    default:
+        // Address and count of the request
+        if ((len != 8) || (memcmp(frame, master->tx, 6) != 0)) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        break;
+    }
+
+    return ESP_OK;
+}
+
+static void modbus_rtu_master_send(struct modbus_rtu_master_t *master)
+{
+    const modbus_rtu_poll_t *poll = &master->polls[master->index];
+
+    master->tx_len = modbus_rtu_build_request(poll, master->tx);
+    const uint32_t tx_us = master->tx_len * master->symbol_us_x10 / 10;
+    const uint32_t wait_us = (poll->slave == MODBUS_RTU_BROADCAST) ? master->turnaround_us :
+                             master->response_timeout_us;
+
+    portENTER_CRITICAL(&master->lock);
+    master->awaiting = true;
+    master->deadline_us = esp_timer_get_time() + tx_us + wait_us;
+    portEXIT_CRITICAL(&master->lock);
+
+    // Armed before sending, so even a failed send resolves the request and the cycle goes on
+    esp_timer_stop(master->timer);
+    esp_timer_start_once(master->timer, tx_us + wait_us);
+    rs485_bus_send(master->bus, master->tx, master->tx_len);
+}
+
+// Only the task which resolved the request in progress calls it
+static void modbus_rtu_master_next(struct modbus_rtu_master_t *master, esp_err_t status)
+{
+    modbus_rtu_poll_t *poll = &master->polls[master->index];
+
+    poll->status = status;
+    if (status != ESP_OK) {
+        poll->errors++;
+    }
+
+    if (++master->index == master->poll_num) {
+        const int64_t now_us = esp_timer_get_time();
+        const uint32_t cycle_us = now_us - master->cycle_start_us;
+        master->cycle_start_us = now_us;
+        master->index = 0;
+        master->stats.cycles++;
+        master->stats.last_cycle_us = cycle_us;
+        master->stats.min_cycle_us = MIN(master->stats.min_cycle_us, cycle_us);
+        master->stats.max_cycle_us = MAX(master->stats.max_cycle_us, cycle_us);
+        if (master->on_cycle) {
+            master->on_cycle(master, cycle_us, master->user_ctx);
+        }
+    }
+
+    if (!master->running) {
+        // Nothing may touch the master after this, it's being deleted
+        xSemaphoreGive(master->stopped);
+        return;
+    }
+    modbus_rtu_master_send(master);
+}
+
+/**
+ * Resolve the request in progress, so only one of the response and the timeout handles it. A response only does
+ * when it comes from the slave of the request in progress, and the timeout only once its deadline has passed: a
+ * late response of a timed out slave, or a timer which fired just before being stopped, belongs to a previous one.
+ */
+static bool modbus_rtu_master_claim(struct modbus_rtu_master_t *master, int slave)
+{
+    bool claimed = false;
+
+    portENTER_CRITICAL(&master->lock);
+    if (master->awaiting) {
+        if (slave < 0) {
+            claimed = esp_timer_get_time() + MODBUS_RTU_TIMER_SLACK_US >= master->deadline_us;
+        } else {
+            const uint8_t poll_slave = master->polls[master->index].slave;
+            claimed = (poll_slave != MODBUS_RTU_BROADCAST) && (poll_slave == slave);
+        }
+        master->awaiting = !claimed;
+    }
+    portEXIT_CRITICAL(&master->lock);
+
+    return claimed;
+}
+
+static void modbus_rtu_master_timer_cb(void *arg)
+{
+    struct modbus_rtu_master_t *master = (struct modbus_rtu_master_t *)arg;
+
+    if (!modbus_rtu_master_claim(master, -1)) {
+        return;
+    }
+    // A broadcast has no response, its turnaround is over
+    if (master->polls[master->index].slave == MODBUS_RTU_BROADCAST) {
+        modbus_rtu_master_next(master, ESP_OK);
+        return;
+    }
+    ESP_LOGD(TAG, "Slave %d timed out", master->polls[master->index].slave);
+    master->stats.timeouts++;
+    modbus_rtu_master_next(master, ESP_ERR_TIMEOUT);
+}
+
+static void modbus_rtu_master_frame_cb(rs485_bus_handle_t bus, const uint8_t *frame, size_t len, void *user_ctx)
+{
+    struct modbus_rtu_master_t *master = (struct modbus_rtu_master_t *)user_ctx;
+
+    if (!modbus_rtu_master_claim(master, frame[0])) {
+        master->stats.unexpected++;
+        return;
+    }
+    esp_timer_stop(master->timer);
+
+    modbus_rtu_poll_t *poll = &master->polls[master->index];
+    const esp_err_t status = modbus_rtu_parse_response(master, poll, frame, len);
+    if (status != ESP_OK) {
+        master->stats.bad_responses++;
+    }
+    // The next request goes out from here, right after the t3.5 gap which ended this response
+    modbus_rtu_master_next(master, status);
+}
+
+esp_err_t modbus_rtu_master_new(const rs485_bus_config_t *bus_config, const modbus_rtu_master_config_t *config,
+                                modbus_rtu_master_handle_t *ret_master)
+{
+    esp_err_t ret = ESP_OK;
+    struct modbus_rtu_master_t *master = NULL;
+
+    ESP_RETURN_ON_FALSE(bus_config && config && ret_master && config->polls && (config->poll_num > 0) &&
+                        (bus_config->baud_rate > 0), ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    for (size_t i = 0; i < config->poll_num; i++) {
+        ESP_RETURN_ON_ERROR(modbus_rtu_check_poll(&config->polls[i]), TAG, "Invalid request %d", (int)i);
+    }
+
+    master = calloc(1, sizeof(struct modbus_rtu_master_t));
+    ESP_RETURN_ON_FALSE(master, ESP_ERR_NO_MEM, TAG, "No memory for the master");
+    master->polls = config->polls;
+    master->poll_num = config->poll_num;
+    master->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    master->symbol_us_x10 = 10 * 10 * 1000000ULL / bus_config->baud_rate;
+    master->response_timeout_us = config->response_timeout_ms * 1000;
+    master->turnaround_us = config->turnaround_ms * 1000;
+    master->on_cycle = config->on_cycle;
+    master->user_ctx = config->user_ctx;
+    master->stats.min_cycle_us = UINT32_MAX;
+    master->running = true;
+
+    master->stopped = xSemaphoreCreateBinary();
+    ESP_GOTO_ON_FALSE(master->stopped, ESP_ERR_NO_MEM, err, TAG, "No memory for the semaphore");
+    const esp_timer_create_args_t timer_args = {
+        .callback = modbus_rtu_master_timer_cb,
+        .arg = master,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "modbus_master",
+    };
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &master->timer), err, TAG, "Create timer failed");
+
+    rs485_bus_config_t modbus_bus_config = *bus_config;
+    modbus_bus_config.max_frame_size = MODBUS_RTU_MAX_ADU;
+    modbus_bus_config.on_frame = modbus_rtu_master_frame_cb;
+    modbus_bus_config.user_ctx = master;
+    ESP_GOTO_ON_ERROR(rs485_bus_new(&modbus_bus_config, &master->bus), err, TAG, "Create bus failed");
+
+    ESP_LOGI(TAG, "Polling %d requests, response timeout %"PRIu32" ms", (int)master->poll_num,
+             config->response_timeout_ms);
+    *ret_master = master;
+    master->cycle_start_us = esp_timer_get_time();
+    modbus_rtu_master_send(master);
+
+    return ESP_OK;
+
+err:
+    if (master->timer) {
+        esp_timer_delete(master->timer);
+    }
+    if (master->stopped) {
+        vSemaphoreDelete(master->stopped);
+    }
+    free(master);
+    return ret;
+}
+
+void modbus_rtu_master_get_stats(modbus_rtu_master_handle_t master, modbus_rtu_master_stats_t *ret_stats)
+{
+    *ret_stats = master->stats;
+}
+
+esp_err_t modbus_rtu_master_del(modbus_rtu_master_handle_t master)
+{
+    ESP_RETURN_ON_FALSE(master, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    // The request in progress is always resolved, by its response or by the timer
+    master->running = false;
+    xSemaphoreTake(master->stopped, portMAX_DELAY);
+
+    rs485_bus_del(master->bus);
+    esp_timer_stop(master->timer);
+    esp_timer_delete(master->timer);
+    vSemaphoreDelete(master->stopped);
+    free(master);
+
+    return ESP_OK;
+}
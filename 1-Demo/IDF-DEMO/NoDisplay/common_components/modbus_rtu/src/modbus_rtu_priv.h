@@ -0,0 +1,41 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "modbus_rtu.h"
+
+#define MODBUS_RTU_EXCEPTION_FLAG   (0x80)
+#define MODBUS_RTU_MIN_ADU          (4)         // Address, function and CRC
+
+static inline uint16_t modbus_rtu_get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void modbus_rtu_put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+// Append the CRC to the frame of `len` bytes, and return the length with it
+static inline size_t modbus_rtu_put_crc(uint8_t *frame, size_t len)
+{
+    const uint16_t crc = modbus_rtu_crc16(frame, len);
+    frame[len] = crc & 0xFF;
+    frame[len + 1] = crc >> 8;
+    return len + 2;
+}
+
+static inline bool modbus_rtu_crc_ok(const uint8_t *frame, size_t len)
+{
+    const uint16_t crc = modbus_rtu_crc16(frame, len - 2);
+    return (frame[len - 2] == (crc & 0xFF)) && (frame[len - 1] == (crc >> 8));
+}
@@ -0,0 +1,242 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "modbus_rtu_priv.h"
+
+#define TAG "modbus_slave"
+
+struct modbus_rtu_slave_t {
+    rs485_bus_handle_t bus;
+    modbus_rtu_slave_config_t config;
+    uint8_t tx[MODBUS_RTU_MAX_ADU];
+    modbus_rtu_slave_stats_t stats;
+};
+
+static inline bool modbus_rtu_get_bit(const uint8_t *bits, uint32_t index)
+{
+    return bits[index / 8] & (1 << (index % 8));
+}
+
+static inline void modbus_rtu_set_bit(uint8_t *bits, uint32_t index, bool value)
+{
+    if (value) {
+        bits[index / 8] |= 1 << (index % 8);
+    } else {
+        bits[index / 8] &= ~(1 << (index % 8));
+    }
+}
+
+static modbus_rtu_exception_t modbus_rtu_check_range(uint16_t table_num, uint16_t address, uint16_t count,
+                                                     uint16_t max_count)
+{
+    if (table_num == 0) {
+        return MODBUS_RTU_EX_ILLEGAL_FUNCTION;
+    }
+    if ((count == 0) || (count > max_count)) {
+        return MODBUS_RTU_EX_ILLEGAL_DATA_VALUE;
+    }
+    if ((uint32_t)address + count > table_num) {
+        return MODBUS_RTU_EX_ILLEGAL_DATA_ADDRESS;
+    }
+    return MODBUS_RTU_EX_NONE;
+}
+
+/**
+ * Handle a request into `tx` and return the length of the response without its CRC, or an exception.
+ * `frame` is the request without its CRC.
+ */
+static modbus_rtu_exception_t modbus_rtu_slave_handle(struct modbus_rtu_slave_t *slave, const uint8_t *frame,
+                                                      size_t len, size_t *ret_len)
+{
+    const modbus_rtu_slave_config_t *config = &slave->config;
+    uint8_t *tx = slave->tx;
+    modbus_rtu_exception_t ex = MODBUS_RTU_EX_NONE;
+
+    if (len < 6) {
+        return MODBUS_RTU_EX_ILLEGAL_DATA_VALUE;
+    }
+    const modbus_rtu_function_t function = frame[1];
+    const uint16_t address = modbus_rtu_get_u16(&frame[2]);
+    const uint16_t count = modbus_rtu_get_u16(&frame[4]);
+
+    switch (function) {
+    case MODBUS_RTU_READ_COILS:
+    case MODBUS_RTU_READ_DISCRETE_INPUTS: {
+        const bool coils = (function == MODBUS_RTU_READ_COILS);
+        const uint8_t *bits = coils ? config->coils : config->discrete_inputs;
+        ex = modbus_rtu_check_range(coils ? config->coil_num : config->discrete_input_num, address, count,
+                                    MODBUS_RTU_MAX_READ_BITS);
+        if (ex != MODBUS_RTU_EX_NONE) {
+            return ex;
+        }
+        tx[2] = (count + 7) / 8;
+        memset(&tx[3], 0, tx[2]);
+        for (int i = 0; i < count; i++) {
+            modbus_rtu_set_bit(&tx[3], i, modbus_rtu_get_bit(bits, address + i));
+        }
+        *ret_len = 3 + tx[2];
+        break;
+    }
+    case MODBUS_RTU_READ_HOLDING_REGISTERS:
+    case MODBUS_RTU_READ_INPUT_REGISTERS: {
+        const bool holding = (function == MODBUS_RTU_READ_HOLDING_REGISTERS);
+        const uint16_t *regs = holding ? config->holding_regs : config->input_regs;
+        ex = modbus_rtu_check_range(holding ? config->holding_reg_num : config->input_reg_num, address, count,
+                                    MODBUS_RTU_MAX_READ_REGS);
+        if (ex != MODBUS_RTU_EX_NONE) {
+            return ex;
+        }
+        tx[2] = count * 2;
+        for (int i = 0; i < count; i++) {
+            modbus_rtu_put_u16(&tx[3 + i * 2], regs[address + i]);
+        }
+        *ret_len = 3 + tx[2];
+        break;
+    }
+    case MODBUS_RTU_WRITE_SINGLE_COIL:
+        ex = modbus_rtu_check_range(config->coil_num, address, 1, 1);
+        if ((ex == MODBUS_RTU_EX_NONE) && (count != 0xFF00) && (count != 0x0000)) {
+            ex = MODBUS_RTU_EX_ILLEGAL_DATA_VALUE;
+        }
+        if (ex != MODBUS_RTU_EX_NONE) {
+            return ex;
+        }
+        modbus_rtu_set_bit(config->coils, address, count == 0xFF00);
+        memcpy(&tx[2], &frame[2], 4);
+        *ret_len = 6;
+        break;
+    case MODBUS_RTU_WRITE_SINGLE_REGISTER:
+        ex = modbus_rtu_check_range(config->holding_reg_num, address, 1, 1);
+        if (ex != MODBUS_RTU_EX_NONE) {
+            return ex;
+        }
+        config->holding_regs[address] = count;
+        memcpy(&tx[2], &frame[2], 4);
+        *ret_len = 6;
+        break;
+    case MODBUS_RTU_WRITE_MULTIPLE_COILS:
+        ex = modbus_rtu_check_range(config->coil_num, address, count, MODBUS_RTU_MAX_WRITE_BITS);
+        if ((ex == MODBUS_RTU_EX_NONE) && ((len < 7) || (frame[6] != (count + 7) / 8) || (len != 7 + frame[6]))) {
+            ex = MODBUS_RTU_EX_ILLEGAL_DATA_VALUE;
+        }
+        if (ex != MODBUS_RTU_EX_NONE) {
+            return ex;
+        }
+        for (int i = 0; i < count; i++) {
+            modbus_rtu_set_bit(config->coils, address + i, modbus_rtu_get_bit(&frame[7], i));
+        }
+        memcpy(&tx[2], &frame[2], 4);
+        *ret_len = 6;
+        break;
+    case MODBUS_RTU_WRITE_MULTIPLE_REGISTERS:
+        ex = modbus_rtu_check_range(config->holding_reg_num, address, count, MODBUS_RTU_MAX_WRITE_REGS);
+        if ((ex == MODBUS_RTU_EX_NONE) && ((len < 7) || (frame[6] != count * 2) || (len != 7 + frame[6]))) {
+            ex = MODBUS_RTU_EX_ILLEGAL_DATA_VALUE;
+        }
+        if (ex != MODBUS_RTU_EX_NONE) {
+            return ex;
+        }
+        for (int i = 0; i < count; i++) {
+            config->holding_regs[address + i] = modbus_rtu_get_u16(&frame[7 + i * 2]);
+        }
+        memcpy(&tx[2], &frame[2], 4);
+        *ret_len = 6;
+        break;
+    default:
+        return MODBUS_RTU_EX_ILLEGAL_FUNCTION;
+    }
+
+    if (config->on_write && (function >= MODBUS_RTU_WRITE_SINGLE_COIL)) {
+        config->on_write(slave, function, address, (function <= MODBUS_RTU_WRITE_SINGLE_REGISTER) ? 1 : count,
+                         config->user_ctx);
+    }
+
+    return MODBUS_RTU_EX_NONE;
+}
+
+static void modbus_rtu_slave_frame_cb(rs485_bus_handle_t bus, const uint8_t *frame, size_t len, void *user_ctx)
+{
+    struct modbus_rtu_slave_t *slave = (struct modbus_rtu_slave_t *)user_ctx;
+    const bool broadcast = (frame[0] == MODBUS_RTU_BROADCAST);
+
+    if ((!broadcast && (frame[0] != slave->config.address)) || (len < MODBUS_RTU_MIN_ADU)) {
+        return;
+    }
+    if (!modbus_rtu_crc_ok(frame, len)) {
+        slave->stats.crc_errors++;
+        return;
+    }
+    slave->stats.requests++;
+
+    size_t tx_len = 0;
+    slave->tx[0] = slave->config.address;
+    slave->tx[1] = frame[1];
+    const modbus_rtu_exception_t ex = modbus_rtu_slave_handle(slave, frame, len - 2, &tx_len);
+    // A broadcast is never answered, not even with an exception
+    if (broadcast) {
+        return;
+    }
+    if (ex != MODBUS_RTU_EX_NONE) {
+        slave->stats.exceptions++;
+        slave->tx[1] = frame[1] | MODBUS_RTU_EXCEPTION_FLAG;
+        slave->tx[2] = ex;
+        tx_len = 3;
+    }
+    rs485_bus_send(slave->bus, slave->tx, modbus_rtu_put_crc(slave->tx, tx_len));
+}
+
+esp_err_t modbus_rtu_slave_new(const rs485_bus_config_t *bus_config, const modbus_rtu_slave_config_t *config,
+                               modbus_rtu_slave_handle_t *ret_slave)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(bus_config && config && ret_slave, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE((config->address >= 1) && (config->address <= 247), ESP_ERR_INVALID_ARG, TAG,
+                        "Invalid address %d", config->address);
+    ESP_RETURN_ON_FALSE((config->holding_regs || !config->holding_reg_num) &&
+                        (config->input_regs || !config->input_reg_num) && (config->coils || !config->coil_num) &&
+                        (config->discrete_inputs || !config->discrete_input_num), ESP_ERR_INVALID_ARG, TAG,
+                        "A table without memory");
+
+    struct modbus_rtu_slave_t *slave = calloc(1, sizeof(struct modbus_rtu_slave_t));
+    ESP_RETURN_ON_FALSE(slave, ESP_ERR_NO_MEM, TAG, "No memory for the slave");
+    slave->config = *config;
+
+    rs485_bus_config_t modbus_bus_config = *bus_config;
+    modbus_bus_config.max_frame_size = MODBUS_RTU_MAX_ADU;
+    modbus_bus_config.on_frame = modbus_rtu_slave_frame_cb;
+    modbus_bus_config.user_ctx = slave;
+    ESP_GOTO_ON_ERROR(rs485_bus_new(&modbus_bus_config, &slave->bus), err, TAG, "Create bus failed");
+
+    ESP_LOGI(TAG, "Slave %d: %d holding, %d input registers, %d coils, %d discrete inputs", config->address,
+             config->holding_reg_num, config->input_reg_num, config->coil_num, config->discrete_input_num);
+    *ret_slave = slave;
+
+    return ESP_OK;
+
+err:
+    free(slave);
+    return ret;
+}
+
+void modbus_rtu_slave_get_stats(modbus_rtu_slave_handle_t slave, modbus_rtu_slave_stats_t *ret_stats)
+{
+    *ret_stats = slave->stats;
+}
+
+esp_err_t modbus_rtu_slave_del(modbus_rtu_slave_handle_t slave)
+{
+    ESP_RETURN_ON_FALSE(slave, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    rs485_bus_del(slave->bus);
+    free(slave);
+
+    return ESP_OK;
+}
@@ -0,0 +1,145 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rs485_bus_t *rs485_bus_handle_t;
+
+/**
+ * @brief Called from the bus task with every complete frame
+ *
+ * The frame is only valid during the call. Replying with `rs485_bus_send()` from here gives the shortest turnaround.
+ */
+typedef void (*rs485_bus_frame_cb_t)(rs485_bus_handle_t bus, const uint8_t *frame, size_t len, void *user_ctx);
+
+/**
+ * @brief Configuration of an RS485 bus
+ */
+typedef struct {
+    uart_port_t uart_num;               /*!< UART port of the bus */
+    int baud_rate;                      /*!< Baud rate, 8N1 */
+    int tx_pin;                         /*!< GPIO of TXD, to DI of the transceiver */
+    int rx_pin;                         /*!< GPIO of RXD, to RO of the transceiver */
+    int rts_pin;                        /*!< GPIO of RTS, to DE/~RE of the transceiver, -1 for an auto direction one */
+    size_t max_frame_size;              /*!< Longest frame, longer ones are dropped */
+    uint8_t idle_symbols;               /*!< Idle time ending a frame, in symbols (3 is about the Modbus 3.5T) */
+    int pattern_chr;                    /*!< Character ending a frame instead of the idle time, e.g. '\n', -1 for none */
+    rs485_bus_frame_cb_t on_frame;      /*!< Frame callback */
+    void *user_ctx;                     /*!< User context of the callback */
+    uint32_t task_stack;                /*!< Stack size of the bus task, in bytes, the callback runs on it */
+    UBaseType_t task_priority;          /*!< Priority of the bus task */
+    BaseType_t task_core;               /*!< Core of the bus task, tskNO_AFFINITY for any */
+} rs485_bus_config_t;
+
+#define RS485_BUS_DEFAULT_CONFIG()                  \
+    {                                               \
+        .uart_num = UART_NUM_1,                     \
+        .baud_rate = 921600,                        \
+        .tx_pin = -1,                               \
+        .rx_pin = -1,                               \
+        .rts_pin = -1,                              \
+        .max_frame_size = 256,                      \
+        .idle_symbols = 3,                          \
+        .pattern_chr = -1,                          \
+        .on_frame = NULL,                           \
+        .user_ctx = NULL,                           \
+        .task_stack = 3072,                         \
+        .task_priority = 10,                        \
+        .task_core = tskNO_AFFINITY,                \
+    }
+
+/**
+ * @brief Counters of a bus
+ */
+typedef struct {
+    uint32_t frames;                    /*!< Frames passed to the callback */
+    uint32_t bad_frames;                /*!< Frames dropped for a framing or parity error */
+    uint32_t long_frames;               /*!< Frames dropped for being longer than max_frame_size */
+    uint32_t overflows;                 /*!< RX FIFO or buffer overflows, the frame in progress is dropped */
+    uint32_t breaks;                    /*!< Breaks on the line, the frame in progress is dropped */
+} rs485_bus_stats_t;
+
+/**
+ * @brief Install the UART driver in RS485 half duplex mode and start the bus task
+ *
+ * A frame ends when the line stays idle for `idle_symbols`, or with `pattern_chr`. The UART interrupt moves the RX
+ * FIFO into the driver buffer, and the bus task sleeps on the UART events until the end of a frame, so nothing polls
+ * the line. A break drops the frame in progress, as the next frame starts after it.
+ *
+ * @param[in] config: Configuration of the bus
+ * @param[out] ret_bus: The bus
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: No memory for the bus
+ *      - Others: Failed to set up the UART
+ */
+esp_err_t rs485_bus_new(const rs485_bus_config_t *config, rs485_bus_handle_t *ret_bus);
+
+/**
+ * @brief Send a whole frame
+ *
+ * The frame goes straight into the TX FIFO in one write, and RTS drives the transceiver until its last stop bit.
+ * It returns once the frame is in the FIFO, frames of several tasks don't interleave.
+ *
+ * @param[in] bus: The bus
+ * @param[in] frame: The frame
+ * @param[in] len: Length of the frame
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_FAIL: The UART didn't take the frame
+ */
+esp_err_t rs485_bus_send(rs485_bus_handle_t bus, const uint8_t *frame, size_t len);
+
+/**
+ * @brief Wait until the frames sent are on the line and the bus is released
+ *
+ * @param[in] bus: The bus
+ * @param[in] timeout: Ticks to wait
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_TIMEOUT: Still sending
+ */
+esp_err_t rs485_bus_wait_tx_done(rs485_bus_handle_t bus, TickType_t timeout);
+
+/**
+ * @brief Get the counters of a bus
+ *
+ * @param[in] bus: The bus
+ * @param[out] ret_stats: The counters
+ */
+void rs485_bus_get_stats(rs485_bus_handle_t bus, rs485_bus_stats_t *ret_stats);
+
+/**
+ * @brief Stop the bus task and delete the UART driver
+ *
+ * @note Don't call it from the frame callback
+ *
+ * @param[in] bus: The bus
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t rs485_bus_del(rs485_bus_handle_t bus);
+
+#ifdef __cplusplus
+}
+#endif
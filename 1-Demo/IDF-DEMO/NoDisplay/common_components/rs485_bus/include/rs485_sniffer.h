@@ -0,0 +1,138 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "rs485_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RS485_SNIFFER_HIST_BINS             (16)
+#define RS485_SNIFFER_HIST_BIN0_US          (32)        // Bin 0 is below 32 us, bin i below 32 << i, the last one open
+
+/**
+ * @brief Record of a frame in the capture
+ *
+ * Records follow each other in the capture, each is this header, the frame, and padding to a multiple of 4 bytes.
+ * `tools/rs485_capture.py` decodes a capture.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;                     /*!< RS485_SNIFFER_RECORD_MAGIC */
+    uint64_t end_us;                    /*!< End of the last stop bit, esp_timer time */
+    uint16_t len;                       /*!< Length of the frame */
+    uint16_t flags;                     /*!< RS485_SNIFFER_FLAG_* */
+} rs485_sniffer_record_t;
+
+#define RS485_SNIFFER_RECORD_MAGIC          (0x35385352)    // "RS85"
+#define RS485_SNIFFER_FLAG_RESPONSE         (1 << 0)        // Answers the previous frame, same address byte
+#define RS485_SNIFFER_FLAG_LOST_BEFORE      (1 << 1)        // Frames were dropped before this one, the ring was full
+
+typedef struct rs485_sniffer_t *rs485_sniffer_handle_t;
+
+/**
+ * @brief Configuration of a sniffer
+ */
+typedef struct {
+    FILE *out;                          /*!< Capture output, e.g. a file on the SD card, NULL for histograms only */
+    size_t ring_size;                   /*!< Bytes of the capture ring, a power of 2, in PSRAM when there is some */
+    size_t block_size;                  /*!< Bytes written to `out` at once */
+    uint32_t flush_ms;                  /*!< Write less than a block after this long */
+    uint32_t response_window_us;        /*!< Longest gap between a request and its response */
+    uint32_t task_stack;                /*!< Stack size of the writer task, in bytes */
+    UBaseType_t task_priority;          /*!< Priority of the writer task, below the application */
+    BaseType_t task_core;               /*!< Core of the writer task, tskNO_AFFINITY for any */
+} rs485_sniffer_config_t;
+
+#define RS485_SNIFFER_DEFAULT_CONFIG()              \
+    {                                               \
+        .out = NULL,                                \
+        .ring_size = 256 * 1024,                    \
+        .block_size = 16 * 1024,                    \
+        .flush_ms = 1000,                           \
+        .response_window_us = 500000,               \
+        .task_stack = 3072,                         \
+        .task_priority = 2,                         \
+        .task_core = tskNO_AFFINITY,                \
+    }
+
+/**
+ * @brief Counters of a sniffer
+ */
+typedef struct {
+    uint32_t frames;                    /*!< Frames seen */
+    uint32_t dropped;                   /*!< Frames not captured, the ring was full */
+    uint64_t written;                   /*!< Bytes written to the output */
+} rs485_sniffer_stats_t;
+
+/**
+ * @brief Listen to a bus without ever sending, and capture every frame
+ *
+ * The bus task timestamps every frame and copies it into a lock-free ring, without blocking. A low priority task
+ * writes the ring to the output in blocks. A frame with the address byte of the frame before it is taken as the
+ * response to it, and the gap between them goes into the histogram of that address.
+ *
+ * The timestamp is taken when the bus task gets the RX timeout of the frame, minus the idle time, so it lags the
+ * line by the interrupt and task switch latency, a few microseconds.
+ *
+ * @param[in] bus_config: Configuration of the bus, its callback is set by the sniffer
+ * @param[in] config: Configuration of the sniffer
+ * @param[out] ret_sniffer: The sniffer
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: No memory for the ring or the histograms
+ *      - Others: Failed to create the bus
+ */
+esp_err_t rs485_sniffer_new(const rs485_bus_config_t *bus_config, const rs485_sniffer_config_t *config,
+                            rs485_sniffer_handle_t *ret_sniffer);
+
+/**
+ * @brief Get the counters of a sniffer
+ *
+ * @param[in] sniffer: The sniffer
+ * @param[out] ret_stats: The counters
+ */
+void rs485_sniffer_get_stats(rs485_sniffer_handle_t sniffer, rs485_sniffer_stats_t *ret_stats);
+
+/**
+ * @brief Get the response time histogram of an address
+ *
+ * @param[in] sniffer: The sniffer
+ * @param[in] address: Address byte of the frames
+ * @param[out] bins: Responses per bin, see RS485_SNIFFER_HIST_BIN0_US
+ */
+void rs485_sniffer_get_histogram(rs485_sniffer_handle_t sniffer, uint8_t address,
+                                 uint32_t bins[RS485_SNIFFER_HIST_BINS]);
+
+/**
+ * @brief Log the histogram of every address which answered
+ *
+ * @param[in] sniffer: The sniffer
+ */
+void rs485_sniffer_print_histograms(rs485_sniffer_handle_t sniffer);
+
+/**
+ * @brief Delete the bus, write what is left in the ring and delete the sniffer
+ *
+ * @note `out` isn't closed
+ *
+ * @param[in] sniffer: The sniffer
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t rs485_sniffer_del(rs485_sniffer_handle_t sniffer);
+
+#ifdef __cplusplus
+}
+#endif
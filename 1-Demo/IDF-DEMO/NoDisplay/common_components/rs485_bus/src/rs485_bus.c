@@ -0,0 +1,260 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "rs485_bus.h"
+
+#define TAG "rs485_bus"
+
+#define RS485_BUS_EVENT_QUEUE_LEN   (20)
+#define RS485_BUS_RX_BUFFERED       (4)         // Frames the driver buffers while the callback runs
+#define RS485_BUS_EVENT_STOP        (UART_EVENT_MAX)
+#define RS485_BUS_PATTERN_QUEUE_LEN (RS485_BUS_RX_BUFFERED * 2)
+#define RS485_BUS_PATTERN_CHR_TOUT  (9)         // Baud cycles between two pattern characters, the minimum
+
+struct rs485_bus_t {
+    uart_port_t uart_num;
+    QueueHandle_t uart_queue;
+    TaskHandle_t task;
+    TaskHandle_t deleter;
+    rs485_bus_frame_cb_t on_frame;
+    void *user_ctx;
+    uint8_t *frame;
+    size_t frame_len;
+    size_t max_frame_size;
+    bool frame_bad;
+    bool frame_long;
+    bool pattern;
+    rs485_bus_stats_t stats;
+};
+
+static void rs485_bus_drop_frame(struct rs485_bus_t *bus)
+{
+    bus->frame_len = 0;
+    bus->frame_bad = false;
+    bus->frame_long = false;
+}
+
+static void rs485_bus_read(struct rs485_bus_t *bus, size_t size)
+{
+    while (size > 0) {
+        if (bus->frame_len == bus->max_frame_size) {
+            // Too long for a frame, keep draining it and drop it once the line is idle
+            bus->frame_long = true;
+            bus->frame_len = 0;
+        }
+        const size_t chunk = MIN(size, bus->max_frame_size - bus->frame_len);
+        const int len = uart_read_bytes(bus->uart_num, bus->frame + bus->frame_len, chunk, 0);
+        if (len <= 0) {
+            break;
+        }
+        bus->frame_len += len;
+        size -= len;
+    }
+}
+
+static void rs485_bus_end_frame(struct rs485_bus_t *bus)
+{
+    if (bus->frame_long) {
+        bus->stats.long_frames++;
+    } else if (bus->frame_bad) {
+        bus->stats.bad_frames++;
+    } else if (bus->frame_len > 0) {
+        bus->stats.frames++;
+        if (bus->on_frame) {
+            bus->on_frame(bus, bus->frame, bus->frame_len, bus->user_ctx);
+        }
+    }
+    rs485_bus_drop_frame(bus);
+}
+
+static void rs485_bus_task(void *arg)
+{
+    struct rs485_bus_t *bus = (struct rs485_bus_t *)arg;
+    uart_event_t event;
+
+    while (1) {
+        if (xQueueReceive(bus->uart_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (event.type == RS485_BUS_EVENT_STOP) {
+            break;
+        }
+
+        switch (event.type) {
+        case UART_DATA:
+            // With a pattern, the data stays in the driver buffer until the pattern shows where the frame ends
+            if (bus->pattern) {
+                break;
+            }
+            rs485_bus_read(bus, event.size);
+            // The driver flags the data read on the RX timeout, which is the idle line after a frame
+            if (event.timeout_flag) {
+                rs485_bus_end_frame(bus);
+            }
+            break;
+        case UART_PATTERN_DET: {
+            const int pos = uart_pattern_pop_pos(bus->uart_num);
+            if (pos < 0) {
+                // More patterns than the position queue holds, the frame boundaries are lost
+                bus->stats.overflows++;
+                uart_flush_input(bus->uart_num);
+                uart_pattern_queue_reset(bus->uart_num, RS485_BUS_PATTERN_QUEUE_LEN);
+                rs485_bus_drop_frame(bus);
+                break;
+            }
+            // The frame is the data up to the pattern character, included
+            rs485_bus_read(bus, pos + 1);
+            rs485_bus_end_frame(bus);
+            break;
+        }
+        case UART_BREAK:
+            bus->stats.breaks++;
+            rs485_bus_drop_frame(bus);
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "RX overflow, frame dropped");
+            bus->stats.overflows++;
+            uart_flush_input(bus->uart_num);
+            xQueueReset(bus->uart_queue);
+            if (bus->pattern) {
+                uart_pattern_queue_reset(bus->uart_num, RS485_BUS_PATTERN_QUEUE_LEN);
+            }
+            rs485_bus_drop_frame(bus);
+            break;
+        case UART_FRAME_ERR:
+        case UART_PARITY_ERR:
+            bus->frame_bad = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    xTaskNotifyGive(bus->deleter);
+    vTaskDelete(NULL);
+}
+
+esp_err_t rs485_bus_new(const rs485_bus_config_t *config, rs485_bus_handle_t *ret_bus)
+{
+    esp_err_t ret = ESP_OK;
+    struct rs485_bus_t *bus = NULL;
+    bool driver_installed = false;
+
+    ESP_RETURN_ON_FALSE(config && ret_bus && (config->max_frame_size > 0), ESP_ERR_INVALID_ARG, TAG,
+                        "Invalid argument");
+
+    bus = calloc(1, sizeof(struct rs485_bus_t));
+    ESP_RETURN_ON_FALSE(bus, ESP_ERR_NO_MEM, TAG, "No memory for the bus");
+    bus->uart_num = config->uart_num;
+    bus->on_frame = config->on_frame;
+    bus->user_ctx = config->user_ctx;
+    bus->max_frame_size = config->max_frame_size;
+    bus->pattern = (config->pattern_chr >= 0);
+    bus->frame = malloc(config->max_frame_size);
+    ESP_GOTO_ON_FALSE(bus->frame, ESP_ERR_NO_MEM, err, TAG, "No memory for the frame");
+
+    const uart_config_t uart_config = {
+        .baud_rate = config->baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    // No TX buffer, a frame is written straight into the FIFO instead of being copied into a ring buffer first
+    const int rx_buffer_size = MAX(config->max_frame_size * RS485_BUS_RX_BUFFERED, UART_HW_FIFO_LEN(config->uart_num) * 2);
+    ESP_GOTO_ON_ERROR(uart_driver_install(config->uart_num, rx_buffer_size, 0, RS485_BUS_EVENT_QUEUE_LEN,
+                                          &bus->uart_queue, 0), err, TAG, "Install UART driver failed");
+    driver_installed = true;
+    ESP_GOTO_ON_ERROR(uart_param_config(config->uart_num, &uart_config), err, TAG, "Configure UART failed");
+    ESP_GOTO_ON_ERROR(uart_set_pin(config->uart_num, config->tx_pin, config->rx_pin,
+                                   (config->rts_pin < 0) ? UART_PIN_NO_CHANGE : config->rts_pin, UART_PIN_NO_CHANGE),
+                      err, TAG, "Set UART pins failed");
+    // The hardware asserts RTS while sending and releases it after the last stop bit, no software turnaround
+    ESP_GOTO_ON_ERROR(uart_set_mode(config->uart_num, UART_MODE_RS485_HALF_DUPLEX), err, TAG, "Set RS485 mode failed");
+    ESP_GOTO_ON_ERROR(uart_set_rx_timeout(config->uart_num, config->idle_symbols), err, TAG, "Set RX timeout failed");
+    // Also time out when a frame is a multiple of the RX FIFO threshold and the FIFO is already empty at its end
+    ESP_GOTO_ON_ERROR(uart_set_always_rx_timeout(config->uart_num, true), err, TAG, "Set RX timeout failed");
+    if (bus->pattern) {
+        ESP_GOTO_ON_ERROR(uart_enable_pattern_det_baud_intr(config->uart_num, config->pattern_chr, 1,
+                                                            RS485_BUS_PATTERN_CHR_TOUT, 0, 0),
+                          err, TAG, "Enable pattern detection failed");
+        ESP_GOTO_ON_ERROR(uart_pattern_queue_reset(config->uart_num, RS485_BUS_PATTERN_QUEUE_LEN), err, TAG,
+                          "Reset pattern queue failed");
+    }
+
+    BaseType_t res = xTaskCreatePinnedToCore(rs485_bus_task, "rs485_bus", config->task_stack, bus,
+                                             config->task_priority, &bus->task, config->task_core);
+    ESP_GOTO_ON_FALSE(res == pdPASS, ESP_ERR_NO_MEM, err, TAG, "Create bus task failed");
+
+    if (bus->pattern) {
+        ESP_LOGI(TAG, "RS485 bus on UART%d, %d baud, frames end with 0x%02x", config->uart_num, config->baud_rate,
+                 config->pattern_chr);
+    } else {
+        ESP_LOGI(TAG, "RS485 bus on UART%d, %d baud, frames end after %d idle symbols", config->uart_num,
+                 config->baud_rate, config->idle_symbols);
+    }
+    *ret_bus = bus;
+
+    return ESP_OK;
+
+err:
+    if (driver_installed) {
+        uart_driver_delete(config->uart_num);
+    }
+    free(bus->frame);
+    free(bus);
+    return ret;
+}
+
+esp_err_t rs485_bus_send(rs485_bus_handle_t bus, const uint8_t *frame, size_t len)
+{
+    ESP_RETURN_ON_FALSE(bus && frame && (len > 0), ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    const int written = uart_write_bytes(bus->uart_num, frame, len);
+    ESP_RETURN_ON_FALSE(written == (int)len, ESP_FAIL, TAG, "Sent %d of %d bytes", written, (int)len);
+
+    return ESP_OK;
+}
+
+esp_err_t rs485_bus_wait_tx_done(rs485_bus_handle_t bus, TickType_t timeout)
+{
+    ESP_RETURN_ON_FALSE(bus, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    return uart_wait_tx_done(bus->uart_num, timeout);
+}
+
+void rs485_bus_get_stats(rs485_bus_handle_t bus, rs485_bus_stats_t *ret_stats)
+{
+    *ret_stats = bus->stats;
+}
+
+esp_err_t rs485_bus_del(rs485_bus_handle_t bus)
+{
+    ESP_RETURN_ON_FALSE(bus, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    const uart_event_t stop = {
+        .type = RS485_BUS_EVENT_STOP,
+    };
+    bus->deleter = xTaskGetCurrentTaskHandle();
+    xQueueSendToFront(bus->uart_queue, &stop, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uart_driver_delete(bus->uart_num);
+    free(bus->frame);
+    free(bus);
+
+    return ESP_OK;
+}
@@ -0,0 +1,271 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rs485_sniffer.h"
+
+#define TAG "rs485_sniffer"
+
+#define RS485_SNIFFER_ALIGN(x)      (((x) + 3) & ~3)
+
+struct rs485_sniffer_t {
+    rs485_bus_handle_t bus;
+    FILE *out;
+    /* Ring, the bus task is the only producer and the writer task the only consumer */
+    uint8_t *ring;
+    size_t ring_mask;
+    atomic_size_t head;
+    atomic_size_t tail;
+    size_t block_size;
+    uint32_t flush_ms;
+    TaskHandle_t task;
+    TaskHandle_t deleter;
+    volatile bool stopping;
+    /* Only touched by the bus task */
+    uint32_t symbol_ns;
+    uint32_t idle_us;
+    uint32_t response_window_us;
+    bool lost;
+    bool request_pending;
+    uint8_t request_address;
+    int64_t request_end_us;
+    uint32_t (*hist)[RS485_SNIFFER_HIST_BINS];
+    rs485_sniffer_stats_t stats;
+};
+
+static void rs485_sniffer_ring_put(struct rs485_sniffer_t *sniffer, size_t pos, const void *src, size_t len)
+{
+    const size_t offset = pos & sniffer->ring_mask;
+    const size_t first = MIN(len, sniffer->ring_mask + 1 - offset);
+
+    memcpy(sniffer->ring + offset, src, first);
+    memcpy(sniffer->ring, (const uint8_t *)src + first, len - first);
+}
+
+static int rs485_sniffer_bin(int64_t gap_us)
+{
+    if (gap_us < RS485_SNIFFER_HIST_BIN0_US) {
+        return 0;
+    }
+    const int bin = 32 - __builtin_clz((uint32_t)MIN(gap_us / RS485_SNIFFER_HIST_BIN0_US, UINT32_MAX));
+    return MIN(bin, RS485_SNIFFER_HIST_BINS - 1);
+}
+
+static void rs485_sniffer_frame_cb(rs485_bus_handle_t bus, const uint8_t *frame, size_t len, void *user_ctx)
+{
+    struct rs485_sniffer_t *sniffer = (struct rs485_sniffer_t *)user_ctx;
+    const int64_t end_us = esp_timer_get_time() - sniffer->idle_us;
+    const int64_t start_us = end_us - (int64_t)len * sniffer->symbol_ns / 1000;
+    rs485_sniffer_record_t record = {
+        .magic = RS485_SNIFFER_RECORD_MAGIC,
+        .end_us = end_us,
+        .len = len,
+    };
+
+    sniffer->stats.frames++;
+
+    // A frame with the address of the request before it answers it, anything else is a new request
+    if (sniffer->request_pending && (frame[0] == sniffer->request_address) &&
+            (start_us - sniffer->request_end_us <= sniffer->response_window_us)) {
+        sniffer->hist[frame[0]][rs485_sniffer_bin(start_us - sniffer->request_end_us)]++;
+        sniffer->request_pending = false;
+        record.flags |= RS485_SNIFFER_FLAG_RESPONSE;
+    } else {
+        sniffer->request_pending = true;
+        sniffer->request_address = frame[0];
+        sniffer->request_end_us = end_us;
+    }
+
+    if (!sniffer->out) {
+        return;
+    }
+
+    // Never wait for the writer, a full ring drops the frame
+    const size_t head = atomic_load_explicit(&sniffer->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&sniffer->tail, memory_order_acquire);
+    const size_t record_size = RS485_SNIFFER_ALIGN(sizeof(record) + len);
+    if (sniffer->ring_mask + 1 - (head - tail) < record_size) {
+        sniffer->stats.dropped++;
+        sniffer->lost = true;
+        return;
+    }
+    if (sniffer->lost) {
+        record.flags |= RS485_SNIFFER_FLAG_LOST_BEFORE;
+        sniffer->lost = false;
+    }
+
+    static const uint8_t padding[3] = { 0 };
+    rs485_sniffer_ring_put(sniffer, head, &record, sizeof(record));
+    rs485_sniffer_ring_put(sniffer, head + sizeof(record), frame, len);
+    rs485_sniffer_ring_put(sniffer, head + sizeof(record) + len, padding, record_size - sizeof(record) - len);
+    atomic_store_explicit(&sniffer->head, head + record_size, memory_order_release);
+
+    // Wake the writer once per block, not per frame
+    if (((head - tail) < sniffer->block_size) && ((head + record_size - tail) >= sniffer->block_size)) {
+        xTaskNotifyGive(sniffer->task);
+    }
+}
+
+static size_t rs485_sniffer_write(struct rs485_sniffer_t *sniffer, size_t tail, size_t len)
+{
+    const size_t offset = tail & sniffer->ring_mask;
+    const size_t first = MIN(len, sniffer->ring_mask + 1 - offset);
+    size_t written = fwrite(sniffer->ring + offset, 1, first, sniffer->out);
+
+    if ((written == first) && (len > first)) {
+        written += fwrite(sniffer->ring, 1, len - first, sniffer->out);
+    }
+    return written;
+}
+
+static void rs485_sniffer_task(void *arg)
+{
+    struct rs485_sniffer_t *sniffer = (struct rs485_sniffer_t *)arg;
+
+    while (1) {
+        const bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sniffer->flush_ms)) > 0;
+        const bool stopping = sniffer->stopping;
+
+        // Blocks while the bus is busy, and whatever there is at the flush period or when stopping
+        while (1) {
+            const size_t tail = atomic_load_explicit(&sniffer->tail, memory_order_relaxed);
+            const size_t avail = atomic_load_explicit(&sniffer->head, memory_order_acquire) - tail;
+            if ((avail == 0) || ((avail < sniffer->block_size) && woken && !stopping)) {
+                break;
+            }
+            const size_t len = MIN(avail, sniffer->block_size);
+            const size_t written = rs485_sniffer_write(sniffer, tail, len);
+            sniffer->stats.written += written;
+            atomic_store_explicit(&sniffer->tail, tail + len, memory_order_release);
+            if (written != len) {
+                ESP_LOGW(TAG, "Wrote %d of %d bytes", (int)written, (int)len);
+            }
+        }
+        if (!woken || stopping) {
+            fflush(sniffer->out);
+        }
+        if (stopping) {
+            break;
+        }
+    }
+
+    xTaskNotifyGive(sniffer->deleter);
+    vTaskDelete(NULL);
+}
+
+esp_err_t rs485_sniffer_new(const rs485_bus_config_t *bus_config, const rs485_sniffer_config_t *config,
+                            rs485_sniffer_handle_t *ret_sniffer)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(bus_config && config && ret_sniffer && (bus_config->baud_rate > 0), ESP_ERR_INVALID_ARG,
+                        TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE(!config->out || ((config->ring_size >= 2 * config->block_size) &&
+                                         !(config->ring_size & (config->ring_size - 1)) && (config->block_size > 0)),
+                        ESP_ERR_INVALID_ARG, TAG, "The ring must be a power of 2, of two blocks at least");
+
+    struct rs485_sniffer_t *sniffer = calloc(1, sizeof(struct rs485_sniffer_t));
+    ESP_RETURN_ON_FALSE(sniffer, ESP_ERR_NO_MEM, TAG, "No memory for the sniffer");
+    sniffer->out = config->out;
+    sniffer->block_size = config->block_size;
+    sniffer->flush_ms = config->flush_ms;
+    sniffer->symbol_ns = 10 * 1000000000ULL / bus_config->baud_rate;
+    sniffer->idle_us = (bus_config->pattern_chr >= 0) ? 0 : bus_config->idle_symbols * sniffer->symbol_ns / 1000;
+    sniffer->response_window_us = config->response_window_us;
+    atomic_init(&sniffer->head, 0);
+    atomic_init(&sniffer->tail, 0);
+
+    // Many MB of captures fit in PSRAM, the internal RAM is kept for the application
+    sniffer->hist = heap_caps_calloc_prefer(256, sizeof(sniffer->hist[0]), 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    ESP_GOTO_ON_FALSE(sniffer->hist, ESP_ERR_NO_MEM, err, TAG, "No memory for the histograms");
+    if (config->out) {
+        sniffer->ring = heap_caps_malloc_prefer(config->ring_size, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+        ESP_GOTO_ON_FALSE(sniffer->ring, ESP_ERR_NO_MEM, err, TAG, "No memory for the ring");
+        sniffer->ring_mask = config->ring_size - 1;
+
+        BaseType_t res = xTaskCreatePinnedToCore(rs485_sniffer_task, "rs485_sniffer", config->task_stack, sniffer,
+                                                 config->task_priority, &sniffer->task, config->task_core);
+        ESP_GOTO_ON_FALSE(res == pdPASS, ESP_ERR_NO_MEM, err, TAG, "Create writer task failed");
+    }
+
+    rs485_bus_config_t sniffer_bus_config = *bus_config;
+    sniffer_bus_config.on_frame = rs485_sniffer_frame_cb;
+    sniffer_bus_config.user_ctx = sniffer;
+    ESP_GOTO_ON_ERROR(rs485_bus_new(&sniffer_bus_config, &sniffer->bus), err, TAG, "Create bus failed");
+
+    *ret_sniffer = sniffer;
+
+    return ESP_OK;
+
+err:
+    if (sniffer->task) {
+        sniffer->deleter = xTaskGetCurrentTaskHandle();
+        sniffer->stopping = true;
+        xTaskNotifyGive(sniffer->task);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    free(sniffer->ring);
+    free(sniffer->hist);
+    free(sniffer);
+    return ret;
+}
+
+void rs485_sniffer_get_stats(rs485_sniffer_handle_t sniffer, rs485_sniffer_stats_t *ret_stats)
+{
+    *ret_stats = sniffer->stats;
+}
+
+void rs485_sniffer_get_histogram(rs485_sniffer_handle_t sniffer, uint8_t address,
+                                 uint32_t bins[RS485_SNIFFER_HIST_BINS])
+{
+    memcpy(bins, sniffer->hist[address], sizeof(sniffer->hist[address]));
+}
+
+void rs485_sniffer_print_histograms(rs485_sniffer_handle_t sniffer)
+{
+    char line[RS485_SNIFFER_HIST_BINS * 11 + 1];
+
+    ESP_LOGI(TAG, "Response times, bin 0 below %d us and every bin twice as wide", RS485_SNIFFER_HIST_BIN0_US);
+    for (int address = 0; address < 256; address++) {
+        uint32_t total = 0;
+        int used = 0;
+        for (int i = 0; i < RS485_SNIFFER_HIST_BINS; i++) {
+            total += sniffer->hist[address][i];
+            used += snprintf(line + used, sizeof(line) - used, " %"PRIu32, sniffer->hist[address][i]);
+        }
+        if (total > 0) {
+            ESP_LOGI(TAG, "%3d: %"PRIu32" |%s", address, total, line);
+        }
+    }
+}
+
+esp_err_t rs485_sniffer_del(rs485_sniffer_handle_t sniffer)
+{
+    ESP_RETURN_ON_FALSE(sniffer, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    rs485_bus_del(sniffer->bus);
+    if (sniffer->task) {
+        sniffer->deleter = xTaskGetCurrentTaskHandle();
+        sniffer->stopping = true;
+        xTaskNotifyGive(sniffer->task);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    free(sniffer->ring);
+    free(sniffer->hist);
+    free(sniffer);
+
+    return ESP_OK;
+}
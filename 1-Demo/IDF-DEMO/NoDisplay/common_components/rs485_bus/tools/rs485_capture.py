@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""
+Decode an RS485 capture of rs485_sniffer (see include/rs485_sniffer.h) as CSV.
+
+Every row is a frame: the end of its last stop bit, the idle time before it,
+its length and flags, and its bytes in hex. A row flagged `lost` follows
+frames which were dropped because the capture ring was full.
+
+    rs485_capture.py /sdcard/RS485.BIN > capture.csv
+    rs485_capture.py --address 5 RS485.BIN
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+MAGIC = 0x35385352
+HEADER = struct.Struct('<IQHH')
+FLAG_RESPONSE = 1 << 0
+FLAG_LOST_BEFORE = 1 << 1
+
+
+def records(data):
+    """Yield (end_us, flags, frame) for every record, resynchronizing on the magic after garbage"""
+    pos = 0
+    while pos + HEADER.size <= len(data):
+        magic, end_us, length, flags = HEADER.unpack_from(data, pos)
+        if magic != MAGIC or pos + HEADER.size + length > len(data):
+            print('skipping garbage at offset %d' % pos, file=sys.stderr)
+            pos += 4
+            continue
+        frame = data[pos + HEADER.size:pos + HEADER.size + length]
+        yield end_us, flags, frame
+        pos += (HEADER.size + length + 3) & ~3
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', help='capture file written by the sniffer')
+    parser.add_argument('--address', type=int, help='only the frames with this address byte')
+    parser.add_argument('--baud', type=int, default=921600, help='baud rate, for the idle times (default 921600)')
+    args = parser.parse_args()
+
+    with open(args.capture, 'rb') as capture:
+        data = capture.read()
+
+    symbol_us = 10e6 / args.baud
+    writer = csv.writer(sys.stdout)
+    writer.writerow(['end_us', 'idle_us', 'len', 'response', 'lost', 'data'])
+    prev_end_us = None
+    for end_us, flags, frame in records(data):
+        start_us = end_us - len(frame) * symbol_us
+        idle_us = '' if prev_end_us is None else '%.1f' % (start_us - prev_end_us)
+        prev_end_us = end_us
+        if args.address is not None and (not frame or frame[0] != args.address):
+            continue
+        writer.writerow([end_us, idle_us, len(frame), int(bool(flags & FLAG_RESPONSE)),
+                         int(bool(flags & FLAG_LOST_BEFORE)), frame.hex(' ')])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,204 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UART_SERVICE_MAX_PORTS              (UART_NUM_MAX)
+
+typedef struct uart_service_t *uart_service_handle_t;
+typedef struct uart_service_port_t *uart_service_port_handle_t;
+
+/**
+ * @brief A received frame, in a buffer of the pool of the service
+ */
+typedef struct {
+    uart_service_port_handle_t port;    /*!< Port which received it */
+    uint8_t *data;                      /*!< The frame */
+    size_t len;                         /*!< Length of the frame */
+} uart_service_frame_t;
+
+/**
+ * @brief Protocol handler of a port, called from the service task with every complete frame
+ *
+ * @return
+ *      - false: The frame goes back to the pool when the handler returns
+ *      - true: The handler keeps the frame, e.g. queued to another task, and releases it with
+ *              `uart_service_frame_release()`
+ */
+typedef bool (*uart_service_frame_cb_t)(uart_service_frame_t *frame, void *user_ctx);
+
+/**
+ * @brief Configuration of a service
+ */
+typedef struct {
+    size_t frame_size;                  /*!< Bytes of a pool buffer, the longest frame */
+    size_t frame_num;                   /*!< Pool buffers, shared by all the ports */
+    uint32_t task_stack;                /*!< Stack size of the service task, in bytes, the handlers run on it */
+    UBaseType_t task_priority;          /*!< Priority of the service task */
+    BaseType_t task_core;               /*!< Core of the service task, tskNO_AFFINITY for any */
+} uart_service_config_t;
+
+#define UART_SERVICE_DEFAULT_CONFIG()               \
+    {                                               \
+        .frame_size = 256,                          \
+        .frame_num = 8,                             \
+        .task_stack = 4096,                         \
+        .task_priority = 10,                        \
+        .task_core = tskNO_AFFINITY,                \
+    }
+
+/**
+ * @brief Configuration of a port
+ */
+typedef struct {
+    uart_port_t uart_num;               /*!< UART of the port */
+    uart_mode_t mode;                   /*!< UART_MODE_UART for RS232, UART_MODE_RS485_HALF_DUPLEX for RS485 */
+    int baud_rate;                      /*!< Baud rate */
+    uart_parity_t parity;               /*!< Parity, 8 data bits and 1 stop bit */
+    int tx_pin;                         /*!< GPIO of TXD */
+    int rx_pin;                         /*!< GPIO of RXD */
+    int rts_pin;                        /*!< GPIO of RTS, DE/~RE of an RS485 transceiver, -1 for none */
+    uint8_t idle_symbols;               /*!< Idle time ending a frame, in symbols */
+    int pattern_chr;                    /*!< Character ending a frame instead, -1 for none */
+    int tx_buffer_size;                 /*!< 0 to send straight into the FIFO, blocking, or a buffer to return at once */
+    uart_service_frame_cb_t on_frame;   /*!< Protocol handler */
+    void *user_ctx;                     /*!< User context of the handler */
+} uart_service_port_config_t;
+
+#define UART_SERVICE_PORT_DEFAULT_CONFIG()          \
+    {                                               \
+        .uart_num = UART_NUM_1,                     \
+        .mode = UART_MODE_RS485_HALF_DUPLEX,        \
+        .baud_rate = 115200,                        \
+        .parity = UART_PARITY_DISABLE,              \
+        .tx_pin = -1,                               \
+        .rx_pin = -1,                               \
+        .rts_pin = -1,                              \
+        .idle_symbols = 3,                          \
+        .pattern_chr = -1,                          \
+        .tx_buffer_size = 0,                        \
+        .on_frame = NULL,                           \
+        .user_ctx = NULL,                           \
+    }
+
+/**
+ * @brief Counters of a port
+ */
+typedef struct {
+    uint64_t rx_bytes;                  /*!< Bytes received */
+    uint64_t tx_bytes;                  /*!< Bytes sent */
+    uint32_t frames;                    /*!< Frames passed to the handler */
+    uint32_t errors;                    /*!< Frames dropped for a framing or parity error */
+    uint32_t overflows;                 /*!< RX overflows and frames longer than a pool buffer */
+    uint32_t no_buffer;                 /*!< Frames dropped because the pool was empty */
+    uint32_t breaks;                    /*!< Breaks on the line */
+} uart_service_stats_t;
+
+/**
+ * @brief Create a service and its task
+ *
+ * One task serves all the ports of the service: it sleeps on a queue set of their UART event queues, so a port
+ * costs its driver buffers but no task or stack. Create a service per core to spread the ports over the cores.
+ *
+ * @param[in] config: Configuration of the service
+ * @param[out] ret_service: The service
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: No memory for the service
+ */
+esp_err_t uart_service_new(const uart_service_config_t *config, uart_service_handle_t *ret_service);
+
+/**
+ * @brief Install the UART driver of a port and serve it
+ *
+ * @param[in] service: The service
+ * @param[in] config: Configuration of the port
+ * @param[out] ret_port: The port
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: The service already has UART_SERVICE_MAX_PORTS ports
+ *      - ESP_ERR_NO_MEM: No memory for the port
+ *      - Others: Failed to set up the UART
+ */
+esp_err_t uart_service_add_port(uart_service_handle_t service, const uart_service_port_config_t *config,
+                                uart_service_port_handle_t *ret_port);
+
+/**
+ * @brief Send a whole frame on a port, any task can call it
+ *
+ * @param[in] port: The port
+ * @param[in] data: The frame
+ * @param[in] len: Length of the frame
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_FAIL: The UART didn't take the frame
+ */
+esp_err_t uart_service_send(uart_service_port_handle_t port, const uint8_t *data, size_t len);
+
+/**
+ * @brief Give a frame kept by a handler back to the pool, any task can call it
+ *
+ * @param[in] frame: The frame
+ */
+void uart_service_frame_release(uart_service_frame_t *frame);
+
+/**
+ * @brief Get the UART of a port
+ *
+ * @param[in] port: The port
+ *
+ * @return The UART
+ */
+uart_port_t uart_service_port_get_uart(uart_service_port_handle_t port);
+
+/**
+ * @brief Get the counters of a port
+ *
+ * @param[in] port: The port
+ * @param[out] ret_stats: The counters
+ */
+void uart_service_get_stats(uart_service_port_handle_t port, uart_service_stats_t *ret_stats);
+
+/**
+ * @brief Log the throughput and the counters of every port, the throughput since the previous call
+ *
+ * @param[in] service: The service
+ */
+void uart_service_log_stats(uart_service_handle_t service);
+
+/**
+ * @brief Stop the service task and delete the UART drivers of all its ports
+ *
+ * @note The frames kept by handlers must be released before
+ *
+ * @param[in] service: The service
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t uart_service_del(uart_service_handle_t service);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,402 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "uart_service.h"
+
+#define TAG "uart_service"
+
+#define UART_SERVICE_EVENT_QUEUE_LEN    (16)
+#define UART_SERVICE_PATTERN_QUEUE_LEN  (8)
+#define UART_SERVICE_RX_BUFFERED        (4)         // Frames a driver buffers while the handlers run
+#define UART_SERVICE_SCRATCH_SIZE       (64)
+
+struct uart_service_port_t {
+    struct uart_service_t *service;
+    uart_port_t uart_num;
+    QueueHandle_t uart_queue;
+    uart_service_frame_cb_t on_frame;
+    void *user_ctx;
+    bool pattern;
+    /* Frame in progress, only touched by the service task */
+    uart_service_frame_t *frame;
+    bool frame_bad;
+    bool frame_long;
+    bool frame_no_buffer;
+    portMUX_TYPE lock;                  // tx_bytes, sent from any task
+    uart_service_stats_t stats;
+    /* Last uart_service_log_stats() */
+    uint64_t logged_rx_bytes;
+    uint64_t logged_tx_bytes;
+};
+
+struct uart_service_t {
+    QueueSetHandle_t queue_set;
+    QueueHandle_t stop_queue;
+    QueueHandle_t pool;                 // Free frames
+    uart_service_frame_t *frames;
+    uint8_t *frame_data;
+    size_t frame_size;
+    TaskHandle_t task;
+    TaskHandle_t deleter;
+    struct uart_service_port_t ports[UART_SERVICE_MAX_PORTS];
+    atomic_int port_num;
+    int64_t logged_us;
+    uint8_t scratch[UART_SERVICE_SCRATCH_SIZE];
+};
+
+static void uart_service_discard(struct uart_service_t *service, uart_port_t uart_num, size_t size)
+{
+    while (size > 0) {
+        const int len = uart_read_bytes(uart_num, service->scratch, MIN(size, sizeof(service->scratch)), 0);
+        if (len <= 0) {
+            break;
+        }
+        size -= len;
+    }
+}
+
+static void uart_service_read(struct uart_service_port_t *port, size_t size)
+{
+    struct uart_service_t *service = port->service;
+
+    port->stats.rx_bytes += size;
+    if (!port->frame && !port->frame_no_buffer && !port->frame_long) {
+        if (xQueueReceive(service->pool, &port->frame, 0) != pdTRUE) {
+            port->frame = NULL;
+            port->frame_no_buffer = true;
+        } else {
+            port->frame->port = port;
+            port->frame->len = 0;
+        }
+    }
+
+    while (port->frame && (size > 0)) {
+        uart_service_frame_t *frame = port->frame;
+        if (frame->len == service->frame_size) {
+            // Too long for a pool buffer, drained and dropped at its end
+            port->frame_long = true;
+            xQueueSend(service->pool, &port->frame, 0);
+            port->frame = NULL;
+            break;
+        }
+        const int len = uart_read_bytes(port->uart_num, frame->data + frame->len,
+                                        MIN(size, service->frame_size - frame->len), 0);
+        if (len <= 0) {
+            return;
+        }
+        frame->len += len;
+        size -= len;
+    }
+    uart_service_discard(service, port->uart_num, size);
+}
+
+static void uart_service_drop_frame(struct uart_service_port_t *port)
+{
+    if (port->frame) {
+        xQueueSend(port->service->pool, &port->frame, 0);
+        port->frame = NULL;
+    }
+    port->frame_bad = false;
+    port->frame_long = false;
+    port->frame_no_buffer = false;
+}
+
+static void uart_service_end_frame(struct uart_service_port_t *port)
+{
+    if (port->frame_long) {
+        port->stats.overflows++;
+    } else if (port->frame_no_buffer) {
+        port->stats.no_buffer++;
+    } else if (port->frame_bad) {
+        port->stats.errors++;
+    } else if (port->frame && (port->frame->len > 0)) {
+        uart_service_frame_t *frame = port->frame;
+        port->stats.frames++;
+        port->frame = NULL;
+        if (!port->on_frame || !port->on_frame(frame, port->user_ctx)) {
+            xQueueSend(port->service->pool, &frame, 0);
+        }
+    }
+    uart_service_drop_frame(port);
+}
+
+static void uart_service_handle_event(struct uart_service_port_t *port, const uart_event_t *event)
+{
+    switch (event->type) {
+    case UART_DATA:
+        // With a pattern, the data stays in the driver buffer until the pattern shows where the frame ends
+        if (port->pattern) {
+            break;
+        }
+        uart_service_read(port, event->size);
+        // Set on the RX timeout, the line is idle after a frame
+        if (event->timeout_flag) {
+            uart_service_end_frame(port);
+        }
+        break;
+    case UART_PATTERN_DET: {
+        const int pos = uart_pattern_pop_pos(port->uart_num);
+        if (pos < 0) {
+            port->stats.overflows++;
+            uart_flush_input(port->uart_num);
+            uart_pattern_queue_reset(port->uart_num, UART_SERVICE_PATTERN_QUEUE_LEN);
+            uart_service_drop_frame(port);
+            break;
+        }
+        uart_service_read(port, pos + 1);
+        uart_service_end_frame(port);
+        break;
+    }
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+        port->stats.overflows++;
+        // The events left in the queue describe flushed data, the ones of the set are skipped as they come
+        uart_flush_input(port->uart_num);
+        if (port->pattern) {
+            uart_pattern_queue_reset(port->uart_num, UART_SERVICE_PATTERN_QUEUE_LEN);
+        }
+        uart_service_drop_frame(port);
+        break;
+    case UART_BREAK:
+        port->stats.breaks++;
+        uart_service_drop_frame(port);
+        break;
+    case UART_FRAME_ERR:
+    case UART_PARITY_ERR:
+        port->frame_bad = true;
+        break;
+    default:
+        break;
+    }
+}
+
+static void uart_service_task(void *arg)
+{
+    struct uart_service_t *service = (struct uart_service_t *)arg;
+    uart_event_t event;
+
+    while (1) {
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(service->queue_set, portMAX_DELAY);
+        if (member == service->stop_queue) {
+            break;
+        }
+
+        const int port_num = atomic_load_explicit(&service->port_num, memory_order_acquire);
+        for (int i = 0; i < port_num; i++) {
+            struct uart_service_port_t *port = &service->ports[i];
+            if (port->uart_queue == member) {
+                if (xQueueReceive(member, &event, 0) == pdTRUE) {
+                    uart_service_handle_event(port, &event);
+                }
+                break;
+            }
+        }
+    }
+
+    xTaskNotifyGive(service->deleter);
+    vTaskDelete(NULL);
+}
+
+esp_err_t uart_service_new(const uart_service_config_t *config, uart_service_handle_t *ret_service)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(config && ret_service && (config->frame_size > 0) && (config->frame_num > 0),
+                        ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    struct uart_service_t *service = calloc(1, sizeof(struct uart_service_t));
+    ESP_RETURN_ON_FALSE(service, ESP_ERR_NO_MEM, TAG, "No memory for the service");
+    service->frame_size = config->frame_size;
+    atomic_init(&service->port_num, 0);
+
+    // One pool for all the ports instead of a frame buffer per port and task
+    service->frames = calloc(config->frame_num, sizeof(uart_service_frame_t));
+    service->frame_data = malloc(config->frame_num * config->frame_size);
+    service->pool = xQueueCreate(config->frame_num, sizeof(uart_service_frame_t *));
+    ESP_GOTO_ON_FALSE(service->frames && service->frame_data && service->pool, ESP_ERR_NO_MEM, err, TAG,
+                      "No memory for the frame pool");
+    for (size_t i = 0; i < config->frame_num; i++) {
+        uart_service_frame_t *frame = &service->frames[i];
+        frame->data = service->frame_data + i * config->frame_size;
+        xQueueSend(service->pool, &frame, 0);
+    }
+
+    service->queue_set = xQueueCreateSet(UART_SERVICE_MAX_PORTS * UART_SERVICE_EVENT_QUEUE_LEN + 1);
+    service->stop_queue = xQueueCreate(1, sizeof(uint8_t));
+    ESP_GOTO_ON_FALSE(service->queue_set && service->stop_queue, ESP_ERR_NO_MEM, err, TAG, "No memory for the queues");
+    xQueueAddToSet(service->stop_queue, service->queue_set);
+
+    BaseType_t res = xTaskCreatePinnedToCore(uart_service_task, "uart_service", config->task_stack, service,
+                                             config->task_priority, &service->task, config->task_core);
+    ESP_GOTO_ON_FALSE(res == pdPASS, ESP_ERR_NO_MEM, err, TAG, "Create service task failed");
+
+    service->logged_us = esp_timer_get_time();
+    *ret_service = service;
+
+    return ESP_OK;
+
+err:
+    if (service->stop_queue) {
+        vQueueDelete(service->stop_queue);
+    }
+    if (service->queue_set) {
+        vQueueDelete(service->queue_set);
+    }
+    if (service->pool) {
+        vQueueDelete(service->pool);
+    }
+    free(service->frame_data);
+    free(service->frames);
+    free(service);
+    return ret;
+}
+
+esp_err_t uart_service_add_port(uart_service_handle_t service, const uart_service_port_config_t *config,
+                                uart_service_port_handle_t *ret_port)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(service && config && ret_port, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    const int index = atomic_load(&service->port_num);
+    ESP_RETURN_ON_FALSE(index < UART_SERVICE_MAX_PORTS, ESP_ERR_INVALID_STATE, TAG, "Too many ports");
+
+    struct uart_service_port_t *port = &service->ports[index];
+    memset(port, 0, sizeof(*port));
+    port->service = service;
+    port->uart_num = config->uart_num;
+    port->on_frame = config->on_frame;
+    port->user_ctx = config->user_ctx;
+    port->pattern = (config->pattern_chr >= 0);
+    port->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
+    const uart_config_t uart_config = {
+        .baud_rate = config->baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = config->parity,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    const int rx_buffer_size = MAX(service->frame_size * UART_SERVICE_RX_BUFFERED,
+                                   UART_HW_FIFO_LEN(config->uart_num) * 2);
+    ESP_RETURN_ON_ERROR(uart_driver_install(config->uart_num, rx_buffer_size, config->tx_buffer_size,
+                                            UART_SERVICE_EVENT_QUEUE_LEN, &port->uart_queue, 0),
+                        TAG, "Install UART%d driver failed", config->uart_num);
+    // Still empty, the RX pin isn't routed yet
+    ESP_GOTO_ON_FALSE(xQueueAddToSet(port->uart_queue, service->queue_set) == pdPASS, ESP_ERR_INVALID_STATE, err,
+                      TAG, "Add UART%d to the queue set failed", config->uart_num);
+    ESP_GOTO_ON_ERROR(uart_param_config(config->uart_num, &uart_config), err, TAG, "Configure UART failed");
+    ESP_GOTO_ON_ERROR(uart_set_pin(config->uart_num, config->tx_pin, config->rx_pin,
+                                   (config->rts_pin < 0) ? UART_PIN_NO_CHANGE : config->rts_pin, UART_PIN_NO_CHANGE),
+                      err, TAG, "Set UART pins failed");
+    ESP_GOTO_ON_ERROR(uart_set_mode(config->uart_num, config->mode), err, TAG, "Set UART mode failed");
+    ESP_GOTO_ON_ERROR(uart_set_rx_timeout(config->uart_num, config->idle_symbols), err, TAG, "Set RX timeout failed");
+    ESP_GOTO_ON_ERROR(uart_set_always_rx_timeout(config->uart_num, true), err, TAG, "Set RX timeout failed");
+    if (port->pattern) {
+        ESP_GOTO_ON_ERROR(uart_enable_pattern_det_baud_intr(config->uart_num, config->pattern_chr, 1, 9, 0, 0),
+                          err, TAG, "Enable pattern detection failed");
+        ESP_GOTO_ON_ERROR(uart_pattern_queue_reset(config->uart_num, UART_SERVICE_PATTERN_QUEUE_LEN), err, TAG,
+                          "Reset pattern queue failed");
+    }
+
+    // Published last, the service task only looks at complete ports
+    atomic_store_explicit(&service->port_num, index + 1, memory_order_release);
+    ESP_LOGI(TAG, "UART%d: %s, %d baud", config->uart_num,
+             (config->mode == UART_MODE_UART) ? "RS232" : "RS485", config->baud_rate);
+    *ret_port = port;
+
+    return ESP_OK;
+
+err:
+    uart_driver_delete(config->uart_num);
+    return ret;
+}
+
+esp_err_t uart_service_send(uart_service_port_handle_t port, const uint8_t *data, size_t len)
+{
+    ESP_RETURN_ON_FALSE(port && data && (len > 0), ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    const int written = uart_write_bytes(port->uart_num, data, len);
+    ESP_RETURN_ON_FALSE(written == (int)len, ESP_FAIL, TAG, "Sent %d of %d bytes", written, (int)len);
+    portENTER_CRITICAL(&port->lock);
+    port->stats.tx_bytes += len;
+    portEXIT_CRITICAL(&port->lock);
+
+    return ESP_OK;
+}
+
+void uart_service_frame_release(uart_service_frame_t *frame)
+{
+    xQueueSend(frame->port->service->pool, &frame, 0);
+}
+
+uart_port_t uart_service_port_get_uart(uart_service_port_handle_t port)
+{
+    return port->uart_num;
+}
+
+void uart_service_get_stats(uart_service_port_handle_t port, uart_service_stats_t *ret_stats)
+{
+    portENTER_CRITICAL(&port->lock);
+    *ret_stats = port->stats;
+    portEXIT_CRITICAL(&port->lock);
+}
+
+void uart_service_log_stats(uart_service_handle_t service)
+{
+    const int64_t now_us = esp_timer_get_time();
+    const int64_t elapsed_us = MAX(now_us - service->logged_us, 1);
+    const int port_num = atomic_load(&service->port_num);
+
+    service->logged_us = now_us;
+    for (int i = 0; i < port_num; i++) {
+        struct uart_service_port_t *port = &service->ports[i];
+        uart_service_stats_t stats;
+        uart_service_get_stats(port, &stats);
+        const uint32_t rx_bps = (stats.rx_bytes - port->logged_rx_bytes) * 1000000 / elapsed_us;
+        const uint32_t tx_bps = (stats.tx_bytes - port->logged_tx_bytes) * 1000000 / elapsed_us;
+        port->logged_rx_bytes = stats.rx_bytes;
+        port->logged_tx_bytes = stats.tx_bytes;
+        ESP_LOGI(TAG, "UART%d: RX %"PRIu32" B/s, TX %"PRIu32" B/s, %"PRIu32" frames, %"PRIu32" errors, "
+                 "%"PRIu32" overflows, %"PRIu32" no buffer, %"PRIu32" breaks", port->uart_num, rx_bps, tx_bps,
+                 stats.frames, stats.errors, stats.overflows, stats.no_buffer, stats.breaks);
+    }
+}
+
+esp_err_t uart_service_del(uart_service_handle_t service)
+{
+    ESP_RETURN_ON_FALSE(service, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    const uint8_t stop = 0;
+    service->deleter = xTaskGetCurrentTaskHandle();
+    xQueueSend(service->stop_queue, &stop, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    const int port_num = atomic_load(&service->port_num);
+    // The drivers delete their event queues, the set is only read by the stopped task
+    for (int i = 0; i < port_num; i++) {
+        uart_driver_delete(service->ports[i].uart_num);
+    }
+    vQueueDelete(service->stop_queue);
+    vQueueDelete(service->queue_set);
+    vQueueDelete(service->pool);
+    free(service->frame_data);
+    free(service->frames);
+    free(service);
+
+    return ESP_OK;
+}
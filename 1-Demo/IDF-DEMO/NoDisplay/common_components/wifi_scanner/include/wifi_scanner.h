@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WIFI_SCANNER_MAX_APS        (32)            // APs kept in the cache, the weakest make room for stronger ones
+
+ESP_EVENT_DECLARE_BASE(WIFI_SCANNER_EVENT);
+
+/**
+ * @brief Events posted to the default event loop
+ */
+typedef enum {
+    WIFI_SCANNER_EVENT_AP_FOUND,        /*!< An AP entered the cache, data is a `wifi_scanner_ap_t` */
+    WIFI_SCANNER_EVENT_AP_LOST,         /*!< An AP aged out of the cache, data is a `wifi_scanner_ap_t` */
+    WIFI_SCANNER_EVENT_CHANNEL_DONE,    /*!< A channel was scanned, data is a `wifi_scanner_update_t` */
+    WIFI_SCANNER_EVENT_SWEEP_DONE,      /*!< All channels were scanned once more, data is a `wifi_scanner_update_t` */
+} wifi_scanner_event_t;
+
+/**
+ * @brief A cached AP
+ */
+typedef struct {
+    uint8_t bssid[6];
+    char ssid[33];
+    uint8_t channel;
+    int8_t rssi;                        /*!< Of the latest scan it was seen in */
+    wifi_auth_mode_t authmode;
+    uint32_t age_ms;                    /*!< Since it was last seen */
+} wifi_scanner_ap_t;
+
+/**
+ * @brief Data of WIFI_SCANNER_EVENT_CHANNEL_DONE and WIFI_SCANNER_EVENT_SWEEP_DONE
+ */
+typedef struct {
+    uint8_t channel;                    /*!< Channel just scanned */
+    int ap_num;                         /*!< APs in the cache */
+} wifi_scanner_update_t;
+
+/**
+ * @brief Configuration of the background scanner
+ */
+typedef struct {
+    uint8_t first_channel;
+    uint8_t last_channel;
+    uint32_t dwell_ms;                  /*!< Passive listen time per channel */
+    uint32_t channel_interval_ms;       /*!< Pause between two channels, sets the duty cycle of the radio */
+    uint32_t max_age_ms;                /*!< APs not seen for this long leave the cache */
+} wifi_scanner_config_t;
+
+#define WIFI_SCANNER_DEFAULT_CONFIG()           \
+    {                                           \
+        .first_channel = 1,                     \
+        .last_channel = 13,                     \
+        .dwell_ms = 120,                        \
+        .channel_interval_ms = 500,             \
+        .max_age_ms = 30 * 1000,                \
+    }
+
+/**
+ * @brief Start scanning in the background
+ *
+ * One channel is scanned passively at a time, with a pause after each, so the radio stays available for the
+ * traffic in between and no call blocks. Every scan updates the AP cache and posts WIFI_SCANNER_EVENT events.
+ *
+ * @note Wi-Fi must be started in station or station+AP mode
+ *
+ * @param[in] config: Configuration, NULL for WIFI_SCANNER_DEFAULT_CONFIG()
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Already started
+ *      - ESP_ERR_INVALID_ARG: Invalid channels
+ *      - ESP_ERR_NO_MEM: No memory for the timer or the lock
+ */
+esp_err_t wifi_scanner_start(const wifi_scanner_config_t *config);
+
+/**
+ * @brief Stop scanning, the cache keeps its APs
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Not started
+ */
+esp_err_t wifi_scanner_stop(void);
+
+/**
+ * @brief Copy the strongest cached APs, strongest first, without scanning
+ *
+ * @param[out] aps: The APs, NULL to only count them
+ * @param[in] max_num: Room in `aps`
+ *
+ * @return Number of APs copied, or of cached APs if `aps` is NULL
+ */
+int wifi_scanner_get_aps(wifi_scanner_ap_t *aps, int max_num);
+
+#ifdef __cplusplus
+}
+#endif
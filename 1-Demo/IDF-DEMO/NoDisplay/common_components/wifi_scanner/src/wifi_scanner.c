@@ -0,0 +1,250 @@
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "wifi_scanner.h"
+
+#define TAG "wifi_scanner"
+
+ESP_EVENT_DEFINE_BASE(WIFI_SCANNER_EVENT);
+
+typedef struct {
+    wifi_scanner_ap_t ap;
+    int64_t last_seen_us;
+    bool used;
+} scanner_entry_t;
+
+static wifi_scanner_config_t scanner_config;
+static scanner_entry_t scanner_cache[WIFI_SCANNER_MAX_APS];
+static wifi_ap_record_t scanner_records[WIFI_SCANNER_MAX_APS];
+static SemaphoreHandle_t scanner_lock = NULL;
+static esp_timer_handle_t scanner_timer = NULL;
+static uint8_t scanner_channel;
+static bool scanner_running = false;
+static bool scanner_scanning = false;           // A scan of ours is in progress
+
+static void scanner_post(int32_t event_id, const void *data, size_t size)
+{
+    // Never blocks the Wi-Fi event handler or the timer, a full event queue drops the event
+    if (esp_event_post(WIFI_SCANNER_EVENT, event_id, data, size, 0) != ESP_OK) {
+        ESP_LOGD(TAG, "Event %" PRIi32 " dropped", event_id);
+    }
+}
+
+static void scanner_next(void *arg)
+{
+    if (!scanner_running) {
+        return;
+    }
+    const wifi_scan_config_t scan_config = {
+        .channel = scanner_channel,
+        .show_hidden = true,
+        .scan_type = WIFI_SCAN_TYPE_PASSIVE,
+        .scan_time.passive = scanner_config.dwell_ms,
+    };
+    scanner_scanning = true;
+    if (esp_wifi_scan_start(&scan_config, false) != ESP_OK) {
+        // Wi-Fi is busy, e.g. connecting or scanning for somebody else, try again later
+        scanner_scanning = false;
+        esp_timer_start_once(scanner_timer, scanner_config.channel_interval_ms * 1000);
+    }
+}
+
+// The index of the AP with this BSSID, else of a free entry, else of the weakest AP if it's weaker than `rssi`
+static int scanner_find_slot(const uint8_t *bssid, int8_t rssi)
+{
+    int free_slot = -1;
+    int weakest = -1;
+
+    for (int i = 0; i < WIFI_SCANNER_MAX_APS; i++) {
+        if (!scanner_cache[i].used) {
+            free_slot = (free_slot < 0) ? i : free_slot;
+        } else if (!memcmp(scanner_cache[i].ap.bssid, bssid, sizeof(scanner_cache[i].ap.bssid))) {
+            return i;
+        } else if ((weakest < 0) || (scanner_cache[i].ap.rssi < scanner_cache[weakest].ap.rssi)) {
+            weakest = i;
+        }
+    }
+    if (free_slot >= 0) {
+        return free_slot;
+    }
+    return (scanner_cache[weakest].ap.rssi < rssi) ? weakest : -1;
+}
+
+static void scanner_merge(uint16_t record_num, int64_t now_us)
+{
+    // Static, the event loop task that calls it has a small stack
+    static wifi_scanner_ap_t lost[WIFI_SCANNER_MAX_APS];
+    static wifi_scanner_ap_t found[WIFI_SCANNER_MAX_APS];
+    int lost_num = 0;
+    int found_num = 0;
+
+    xSemaphoreTake(scanner_lock, portMAX_DELAY);
+    for (int i = 0; i < record_num; i++) {
+        const wifi_ap_record_t *record = &scanner_records[i];
+        const int slot = scanner_find_slot(record->bssid, record->rssi);
+        if (slot < 0) {
+            continue;
+        }
+        scanner_entry_t *entry = &scanner_cache[slot];
+        const bool is_new = !entry->used || memcmp(entry->ap.bssid, record->bssid, sizeof(entry->ap.bssid));
+        if (is_new && entry->used) {
+            lost[lost_num++] = entry->ap;
+        }
+        memcpy(entry->ap.bssid, record->bssid, sizeof(entry->ap.bssid));
+        strlcpy(entry->ap.ssid, (const char *)record->ssid, sizeof(entry->ap.ssid));
+        entry->ap.channel = record->primary;
+        entry->ap.rssi = record->rssi;
+        entry->ap.authmode = record->authmode;
+        entry->last_seen_us = now_us;
+        entry->used = true;
+        if (is_new && found_num < WIFI_SCANNER_MAX_APS) {
+            found[found_num++] = entry->ap;
+        }
+    }
+
+    // Age out the APs that weren't seen for a while
+    for (int i = 0; i < WIFI_SCANNER_MAX_APS; i++) {
+        scanner_entry_t *entry = &scanner_cache[i];
+        if (entry->used && (now_us - entry->last_seen_us > (int64_t)scanner_config.max_age_ms * 1000)) {
+            entry->used = false;
+            if (lost_num < WIFI_SCANNER_MAX_APS) {
+                lost[lost_num++] = entry->ap;
+            }
+        }
+    }
+    xSemaphoreGive(scanner_lock);
+
+    // Posted without the lock, so subscribers can query the cache right away
+    for (int i = 0; i < lost_num; i++) {
+        scanner_post(WIFI_SCANNER_EVENT_AP_LOST, &lost[i], sizeof(lost[i]));
+    }
+    for (int i = 0; i < found_num; i++) {
+        scanner_post(WIFI_SCANNER_EVENT_AP_FOUND, &found[i], sizeof(found[i]));
+    }
+}
+
+static void scanner_scan_done_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (!scanner_scanning) {
+        return;                 // Somebody else's scan
+    }
+    scanner_scanning = false;
+
+    uint16_t record_num = WIFI_SCANNER_MAX_APS;
+    if (esp_wifi_scan_get_ap_records(&record_num, scanner_records) != ESP_OK) {
+        record_num = 0;
+    }
+    // Records that didn't fit are freed too
+    esp_wifi_clear_ap_list();
+    scanner_merge(record_num, esp_timer_get_time());
+
+    wifi_scanner_update_t update = {
+        .channel = scanner_channel,
+        .ap_num = wifi_scanner_get_aps(NULL, 0),
+    };
+    scanner_post(WIFI_SCANNER_EVENT_CHANNEL_DONE, &update, sizeof(update));
+    if (scanner_channel >= scanner_config.last_channel) {
+        scanner_channel = scanner_config.first_channel;
+        scanner_post(WIFI_SCANNER_EVENT_SWEEP_DONE, &update, sizeof(update));
+    } else {
+        scanner_channel++;
+    }
+
+    if (scanner_running) {
+        esp_timer_start_once(scanner_timer, scanner_config.channel_interval_ms * 1000);
+    }
+}
+
+esp_err_t wifi_scanner_start(const wifi_scanner_config_t *config)
+{
+    const wifi_scanner_config_t default_config = WIFI_SCANNER_DEFAULT_CONFIG();
+
+    ESP_RETURN_ON_FALSE(!scanner_running, ESP_ERR_INVALID_STATE, TAG, "Already started");
+    if (config == NULL) {
+        config = &default_config;
+    }
+    ESP_RETURN_ON_FALSE(config->first_channel >= 1 && config->first_channel <= config->last_channel &&
+                        config->last_channel <= 14, ESP_ERR_INVALID_ARG, TAG, "Invalid channels");
+
+    if (scanner_lock == NULL) {
+        scanner_lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(scanner_lock, ESP_ERR_NO_MEM, TAG, "No memory for the lock");
+    }
+    if (scanner_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = scanner_next,
+            .name = "wifi_scanner",
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &scanner_timer), TAG, "Create the timer failed");
+    }
+    ESP_RETURN_ON_ERROR(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, scanner_scan_done_handler, NULL),
+                        TAG, "Register the scan done handler failed");
+
+    scanner_config = *config;
+    scanner_channel = config->first_channel;
+    scanner_running = true;
+    ESP_RETURN_ON_ERROR(esp_timer_start_once(scanner_timer, 0), TAG, "Start the timer failed");
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_scanner_stop(void)
+{
+    ESP_RETURN_ON_FALSE(scanner_running, ESP_ERR_INVALID_STATE, TAG, "Not started");
+
+    scanner_running = false;
+    esp_timer_stop(scanner_timer);
+    if (scanner_scanning) {
+        esp_wifi_scan_stop();
+    }
+    esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, scanner_scan_done_handler);
+    scanner_scanning = false;
+
+    return ESP_OK;
+}
+
+int wifi_scanner_get_aps(wifi_scanner_ap_t *aps, int max_num)
+{
+    const int64_t now_us = esp_timer_get_time();
+    int total = 0;
+    int filled = 0;
+
+    if (scanner_lock == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(scanner_lock, portMAX_DELAY);
+    for (int i = 0; i < WIFI_SCANNER_MAX_APS; i++) {
+        if (!scanner_cache[i].used) {
+            continue;
+        }
+        total++;
+        if ((aps == NULL) || (max_num <= 0)) {
+            continue;
+        }
+
+        // Insertion by RSSI, the cache holds at most WIFI_SCANNER_MAX_APS
+        wifi_scanner_ap_t ap = scanner_cache[i].ap;
+        ap.age_ms = (now_us - scanner_cache[i].last_seen_us) / 1000;
+        int pos;
+        if (filled < max_num) {
+            pos = filled++;
+        } else if (aps[max_num - 1].rssi < ap.rssi) {
+            pos = max_num - 1;
+        } else {
+            continue;
+        }
+        while ((pos > 0) && (aps[pos - 1].rssi < ap.rssi)) {
+            aps[pos] = aps[pos - 1];
+            pos--;
+        }
+        aps[pos] = ap;
+    }
+    xSemaphoreGive(scanner_lock);
+
+    return (aps == NULL) ? total : filled;
+}
@@ -0,0 +1,511 @@
+/* Ethernet iperf Example
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+#include "eth_iperf.h"
+
+#define IPERF_UDP_LEN               (1470)          // Fills a 1500 byte MTU, the iperf default
+#define IPERF_TCP_LEN               (16 * 1024)
+#define IPERF_RECV_TIMEOUT_MS       (100)           // Keeps the reports going and the task stoppable
+#define IPERF_FIN_TIMEOUT_MS        (250)
+#define IPERF_FIN_RETRIES           (10)
+#define IPERF_HEADER_VERSION1       (0x80000000)
+#define IPERF_TASK_STACK            (4096)
+
+static const char *TAG = "eth_iperf";
+
+// iperf 2 header of a UDP datagram, in network byte order
+typedef struct {
+    int32_t id;                     // Negative on the last datagram of a run
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+} iperf_udp_hdr_t;
+
+// iperf 2 server report, the answer to the last datagram of a run
+typedef struct {
+    int32_t flags;
+    int32_t total_len1;
+    int32_t total_len2;
+    int32_t stop_sec;
+    int32_t stop_usec;
+    int32_t error_cnt;
+    int32_t outorder_cnt;
+    int32_t datagrams;
+    int32_t jitter1;
+    int32_t jitter2;
+} iperf_server_hdr_t;
+
+typedef struct {
+    int64_t start_us;
+    int64_t interval_start_us;
+    uint64_t bytes;
+    uint64_t interval_bytes;
+    // UDP server only
+    int32_t last_id;
+    uint32_t datagrams;
+    uint32_t interval_datagrams;
+    uint32_t lost;
+    uint32_t interval_lost;
+    uint32_t out_of_order;
+    float jitter_us;
+    int64_t last_transit_us;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE idle_start[configNUMBER_OF_CORES];
+    configRUN_TIME_COUNTER_TYPE idle_interval_start[configNUMBER_OF_CORES];
+#endif
+} iperf_stats_t;
+
+static eth_iperf_config_t iperf_config;
+static uint8_t *iperf_buf = NULL;
+static atomic_bool iperf_running = false;
+static atomic_bool iperf_stop_request = false;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// Run time of the idle task of every core, the load of a core is the rest
+static void iperf_idle_get(configRUN_TIME_COUNTER_TYPE *idle)
+{
+    for (int i = 0; i < configNUMBER_OF_CORES; i++) {
+        idle[i] = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(i));
+    }
+}
+#endif
+
+static void iperf_stats_start(iperf_stats_t *stats)
+{
+    memset(stats, 0, sizeof(iperf_stats_t));
+    stats->start_us = esp_timer_get_time();
+    stats->interval_start_us = stats->start_us;
+    stats->last_id = -1;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    iperf_idle_get(stats->idle_start);
+    memcpy(stats->idle_interval_start, stats->idle_start, sizeof(stats->idle_start));
+#endif
+}
+
+// One iperf report line, from the interval start, or from the run start for the final one, with the load of each
+// core over the same time appended
+static void iperf_report(iperf_stats_t *stats, int64_t now_us, bool final)
+{
+    const int64_t from_us = final ? stats->start_us : stats->interval_start_us;
+    const uint64_t bytes = final ? stats->bytes : stats->interval_bytes;
+    const double secs = (now_us - from_us) / 1e6;
+
+    printf("[  3] %4.1f-%4.1f sec  %6.2f MBytes  %6.2f Mbits/sec", (from_us - stats->start_us) / 1e6,
+           (now_us - stats->start_us) / 1e6, bytes / (1024.0 * 1024.0), secs > 0 ? bytes * 8 / secs / 1e6 : 0);
+    if (iperf_config.server && iperf_config.udp) {
+        const uint32_t lost = final ? stats->lost : stats->interval_lost;
+        const uint32_t total = lost + (final ? stats->datagrams : stats->interval_datagrams);
+        printf("  %6.3f ms %4" PRIu32 "/%5" PRIu32 " (%.2g%%)", stats->jitter_us / 1000.0f, lost, total,
+               total ? 100.0 * lost / total : 0);
+    }
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE idle[configNUMBER_OF_CORES];
+    iperf_idle_get(idle);
+    printf("  CPU");
+    for (int i = 0; i < configNUMBER_OF_CORES; i++) {
+        const configRUN_TIME_COUNTER_TYPE idle_us = idle[i] - (final ? stats->idle_start[i] : stats->idle_interval_start[i]);
+        const double load = (now_us > from_us) ? 100.0 - 100.0 * idle_us / (now_us - from_us) : 0;
+        printf(" %d:%3.0f%%", i, load < 0 ? 0 : load);
+    }
+    memcpy(stats->idle_interval_start, idle, sizeof(idle));
+#endif
+    printf("\n");
+
+    stats->interval_start_us = now_us;
+    stats->interval_bytes = 0;
+    stats->interval_datagrams = 0;
+    stats->interval_lost = 0;
+}
+
+static void iperf_tick(iperf_stats_t *stats, int64_t now_us)
+{
+    if (now_us - stats->interval_start_us >= (int64_t)iperf_config.interval_s * 1000000) {
+        iperf_report(stats, now_us, false);
+    }
+}
+
+static int iperf_socket(int type, bool bind_port)
+{
+    const int sock = socket(AF_INET, type, (type == SOCK_DGRAM) ? IPPROTO_UDP : IPPROTO_TCP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Create socket failed, errno %d", errno);
+        return -1;
+    }
+
+    const struct timeval timeout = {
+        .tv_sec = 0,
+        .tv_usec = IPERF_RECV_TIMEOUT_MS * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (bind_port) {
+        const int reuse = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(iperf_config.port),
+            .sin_addr.s_addr = htonl(INADDR_ANY),
+        };
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            ESP_LOGE(TAG, "Bind port %d failed, errno %d", iperf_config.port, errno);
+            close(sock);
+            return -1;
+        }
+    }
+    return sock;
+}
+
+static void iperf_udp_count(iperf_stats_t *stats, const iperf_udp_hdr_t *hdr, int64_t now_us)
+{
+    int32_t id = ntohl(hdr->id);
+    if (id < 0) {
+        id = -id;
+    }
+    if (id > stats->last_id + 1) {
+        const uint32_t lost = id - stats->last_id - 1;
+        stats->lost += lost;
+        stats->interval_lost += lost;
+    } else if (id <= stats->last_id) {
+        // A late datagram was counted as lost
+        stats->out_of_order++;
+        if (stats->lost) {
+            stats->lost--;
+        }
+        if (stats->interval_lost) {
+            stats->interval_lost--;
+        }
+    }
+    stats->last_id = MAX(stats->last_id, id);
+
+    // RFC 1889 jitter, the clock offset between the ends cancels out
+    const int64_t sent_us = (int64_t)ntohl(hdr->tv_sec) * 1000000 + ntohl(hdr->tv_usec);
+    const int64_t transit_us = now_us - sent_us;
+    if (stats->datagrams) {
+        const float d = llabs(transit_us - stats->last_transit_us);
+        stats->jitter_us += (d - stats->jitter_us) / 16.0f;
+    }
+    stats->last_transit_us = transit_us;
+    stats->datagrams++;
+    stats->interval_datagrams++;
+}
+
+static void iperf_udp_server(void)
+{
+    const int sock = iperf_socket(SOCK_DGRAM, true);
+    if (sock < 0) {
+        return;
+    }
+    printf("Server listening on UDP port %d\n", iperf_config.port);
+
+    iperf_stats_t stats;
+    bool connected = false;
+    uint8_t report[sizeof(iperf_udp_hdr_t) + sizeof(iperf_server_hdr_t)];
+    bool report_valid = false;
+
+    while (!atomic_load(&iperf_stop_request)) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        const int len = recvfrom(sock, iperf_buf, iperf_config.len, 0, (struct sockaddr *)&from, &from_len);
+        const int64_t now_us = esp_timer_get_time();
+
+        if (len >= (int)sizeof(iperf_udp_hdr_t)) {
+            const iperf_udp_hdr_t *hdr = (const iperf_udp_hdr_t *)iperf_buf;
+            const bool fin = (int32_t)ntohl(hdr->id) < 0;
+            if (!connected) {
+                if (fin) {
+                    // The client repeats its last datagram until it gets the report
+                    if (report_valid) {
+                        sendto(sock, report, sizeof(report), 0, (struct sockaddr *)&from, from_len);
+                    }
+                    continue;
+                }
+                iperf_stats_start(&stats);
+                connected = true;
+                printf("[  3] local port %d connected with %s port %d\n", iperf_config.port,
+                       inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+            }
+            stats.bytes += len;
+            stats.interval_bytes += len;
+            iperf_udp_count(&stats, hdr, now_us);
+
+            if (fin) {
+                iperf_report(&stats, now_us, true);
+                connected = false;
+
+                const int64_t elapsed_us = now_us - stats.start_us;
+                iperf_server_hdr_t server_hdr = {
+                    .flags = htonl(IPERF_HEADER_VERSION1),
+                    .total_len1 = htonl((uint32_t)(stats.bytes >> 32)),
+                    .total_len2 = htonl((uint32_t)stats.bytes),
+                    .stop_sec = htonl(elapsed_us / 1000000),
+                    .stop_usec = htonl(elapsed_us % 1000000),
+                    .error_cnt = htonl(stats.lost),
+                    .outorder_cnt = htonl(stats.out_of_order),
+                    .datagrams = htonl(stats.last_id),
+                    .jitter1 = htonl((int32_t)(stats.jitter_us / 1000000)),
+                    .jitter2 = htonl((int32_t)stats.jitter_us % 1000000),
+                };
+                memcpy(report, hdr, sizeof(iperf_udp_hdr_t));
+                memcpy(report + sizeof(iperf_udp_hdr_t), &server_hdr, sizeof(server_hdr));
+                report_valid = true;
+                sendto(sock, report, sizeof(report), 0, (struct sockaddr *)&from, from_len);
+                continue;
+            }
+        }
+        if (connected) {
+            iperf_tick(&stats, now_us);
+        }
+    }
+    close(sock);
+}
+
+static void iperf_udp_client_fin(int sock, const struct sockaddr_in *dest, int32_t id)
+{
+    iperf_udp_hdr_t *hdr = (iperf_udp_hdr_t *)iperf_buf;
+    const struct timeval timeout = {
+        .tv_sec = 0,
+        .tv_usec = IPERF_FIN_TIMEOUT_MS * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (int i = 0; i < IPERF_FIN_RETRIES; i++) {
+        const int64_t now_us = esp_timer_get_time();
+        hdr->id = htonl(-id);
+        hdr->tv_sec = htonl(now_us / 1000000);
+        hdr->tv_usec = htonl(now_us % 1000000);
+        sendto(sock, iperf_buf, iperf_config.len, 0, (const struct sockaddr *)dest, sizeof(*dest));
+
+        const int len = recv(sock, iperf_buf, iperf_config.len, 0);
+        if (len >= (int)(sizeof(iperf_udp_hdr_t) + sizeof(iperf_server_hdr_t))) {
+            iperf_server_hdr_t server_hdr;
+            memcpy(&server_hdr, iperf_buf + sizeof(iperf_udp_hdr_t), sizeof(server_hdr));
+            const uint64_t bytes = ((uint64_t)ntohl(server_hdr.total_len1) << 32) | ntohl(server_hdr.total_len2);
+            const double secs = ntohl(server_hdr.stop_sec) + ntohl(server_hdr.stop_usec) / 1e6;
+            const uint32_t lost = ntohl(server_hdr.error_cnt);
+            const uint32_t total = ntohl(server_hdr.datagrams);
+            const double jitter_ms = ntohl(server_hdr.jitter1) * 1000.0 + ntohl(server_hdr.jitter2) / 1000.0;
+            printf("[  3] Server Report:\n");
+            printf("[  3]  0.0-%4.1f sec  %6.2f MBytes  %6.2f Mbits/sec  %6.3f ms %4" PRIu32 "/%5" PRIu32 " (%.2g%%)\n",
+                   secs, bytes / (1024.0 * 1024.0), secs > 0 ? bytes * 8 / secs / 1e6 : 0, jitter_ms, lost, total,
+                   total ? 100.0 * lost / total : 0);
+            return;
+        }
+    }
+    printf("[  3] WARNING: did not receive ack of last datagram after %d tries.\n", IPERF_FIN_RETRIES);
+}
+
+static void iperf_udp_client(void)
+{
+    const int sock = iperf_socket(SOCK_DGRAM, false);
+    if (sock < 0) {
+        return;
+    }
+    const struct sockaddr_in dest = {
+        .sin_family = AF_INET,
+        .sin_port = htons(iperf_config.port),
+        .sin_addr.s_addr = iperf_config.dest_ip,
+    };
+    printf("Client connecting to %s, UDP port %d\n", inet_ntoa(dest.sin_addr), iperf_config.port);
+
+    // Datagram period at the requested rate, Mbit/s are bits per microsecond
+    const int64_t period_us = iperf_config.bandwidth_mbps ? (iperf_config.len * 8) / iperf_config.bandwidth_mbps : 0;
+    iperf_stats_t stats;
+    iperf_stats_start(&stats);
+    const int64_t end_us = stats.start_us + (int64_t)iperf_config.time_s * 1000000;
+    int64_t next_us = stats.start_us;
+    int32_t id = 0;
+    iperf_udp_hdr_t *hdr = (iperf_udp_hdr_t *)iperf_buf;
+
+    while (!atomic_load(&iperf_stop_request)) {
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= end_us) {
+            break;
+        }
+        if (period_us) {
+            if (next_us - now_us > portTICK_PERIOD_MS * 1000) {
+                vTaskDelay(1);
+                continue;
+            }
+            // Don't burst to catch up after a long stall
+            next_us = MAX(next_us + period_us, now_us - 100 * 1000);
+        }
+
+        hdr->id = htonl(id);
+        hdr->tv_sec = htonl(now_us / 1000000);
+        hdr->tv_usec = htonl(now_us % 1000000);
+        const int len = sendto(sock, iperf_buf, iperf_config.len, 0, (const struct sockaddr *)&dest, sizeof(dest));
+        if (len > 0) {
+            id++;
+            stats.bytes += len;
+            stats.interval_bytes += len;
+        } else if (errno == ENOMEM) {
+            // lwIP or the EMAC ran out of TX buffers, let them drain
+            vTaskDelay(1);
+        } else {
+            ESP_LOGE(TAG, "Send failed, errno %d", errno);
+            break;
+        }
+        iperf_tick(&stats, esp_timer_get_time());
+    }
+    iperf_report(&stats, esp_timer_get_time(), true);
+    iperf_udp_client_fin(sock, &dest, id);
+    close(sock);
+}
+
+static void iperf_tcp_receive(int sock, const struct sockaddr_in *from)
+{
+    iperf_stats_t stats;
+    iperf_stats_start(&stats);
+    printf("[  3] local port %d connected with %s port %d\n", iperf_config.port, inet_ntoa(from->sin_addr),
+           ntohs(from->sin_port));
+
+    while (!atomic_load(&iperf_stop_request)) {
+        const int len = recv(sock, iperf_buf, iperf_config.len, 0);
+        if (len == 0 || (len < 0 && errno != EAGAIN)) {
+            break;
+        }
+        if (len > 0) {
+            stats.bytes += len;
+            stats.interval_bytes += len;
+        }
+        iperf_tick(&stats, esp_timer_get_time());
+    }
+    iperf_report(&stats, esp_timer_get_time(), true);
+}
+
+static void iperf_tcp_server(void)
+{
+    const int listen_sock = iperf_socket(SOCK_STREAM, true);
+    if (listen_sock < 0) {
+        return;
+    }
+    if (listen(listen_sock, 1) != 0) {
+        ESP_LOGE(TAG, "Listen failed, errno %d", errno);
+        close(listen_sock);
+        return;
+    }
+    printf("Server listening on TCP port %d\n", iperf_config.port);
+
+    while (!atomic_load(&iperf_stop_request)) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        const int sock = accept(listen_sock, (struct sockaddr *)&from, &from_len);
+        if (sock < 0) {
+            continue;           // Timed out, check for a stop request
+        }
+        const struct timeval timeout = {
+            .tv_sec = 0,
+            .tv_usec = IPERF_RECV_TIMEOUT_MS * 1000,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        iperf_tcp_receive(sock, &from);
+        close(sock);
+    }
+    close(listen_sock);
+}
+
+static void iperf_tcp_client(void)
+{
+    const int sock = iperf_socket(SOCK_STREAM, false);
+    if (sock < 0) {
+        return;
+    }
+    const struct sockaddr_in dest = {
+        .sin_family = AF_INET,
+        .sin_port = htons(iperf_config.port),
+        .sin_addr.s_addr = iperf_config.dest_ip,
+    };
+    printf("Client connecting to %s, TCP port %d\n", inet_ntoa(dest.sin_addr), iperf_config.port);
+    if (connect(sock, (const struct sockaddr *)&dest, sizeof(dest)) != 0) {
+        ESP_LOGE(TAG, "Connect failed, errno %d", errno);
+        close(sock);
+        return;
+    }
+
+    iperf_stats_t stats;
+    iperf_stats_start(&stats);
+    const int64_t end_us = stats.start_us + (int64_t)iperf_config.time_s * 1000000;
+    while (!atomic_load(&iperf_stop_request) && (esp_timer_get_time() < end_us)) {
+        const int len = send(sock, iperf_buf, iperf_config.len, 0);
+        if (len < 0) {
+            ESP_LOGE(TAG, "Send failed, errno %d", errno);
+            break;
+        }
+        stats.bytes += len;
+        stats.interval_bytes += len;
+        iperf_tick(&stats, esp_timer_get_time());
+    }
+    iperf_report(&stats, esp_timer_get_time(), true);
+    close(sock);
+}
+
+static void iperf_task(void *arg)
+{
+    if (iperf_config.server && iperf_config.udp) {
+        iperf_udp_server();
+    } else if (iperf_config.server) {
+        iperf_tcp_server();
+    } else if (iperf_config.udp) {
+        iperf_udp_client();
+    } else {
+        iperf_tcp_client();
+    }
+
+    free(iperf_buf);
+    iperf_buf = NULL;
+    atomic_store(&iperf_running, false);
+    vTaskDelete(NULL);
+}
+
+esp_err_t eth_iperf_start(const eth_iperf_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE(config->server || config->dest_ip, ESP_ERR_INVALID_ARG, TAG, "No server to send to");
+    ESP_RETURN_ON_FALSE(config->interval_s, ESP_ERR_INVALID_ARG, TAG, "Interval must be at least 1 s");
+    ESP_RETURN_ON_FALSE(!atomic_exchange(&iperf_running, true), ESP_ERR_INVALID_STATE, TAG, "A run is in progress");
+
+    iperf_config = *config;
+    if (iperf_config.len == 0) {
+        iperf_config.len = iperf_config.udp ? IPERF_UDP_LEN : IPERF_TCP_LEN;
+    }
+    iperf_config.len = MAX(iperf_config.len, sizeof(iperf_udp_hdr_t) + sizeof(iperf_server_hdr_t));
+    atomic_store(&iperf_stop_request, false);
+
+    esp_err_t ret = ESP_OK;
+    iperf_buf = calloc(1, iperf_config.len);
+    ESP_GOTO_ON_FALSE(iperf_buf, ESP_ERR_NO_MEM, err, TAG, "No memory for the buffer");
+
+    const BaseType_t core_id = (CONFIG_EXAMPLE_IPERF_TASK_CORE < 0) ? tskNO_AFFINITY : CONFIG_EXAMPLE_IPERF_TASK_CORE;
+    BaseType_t res = xTaskCreatePinnedToCore(iperf_task, "iperf", IPERF_TASK_STACK, NULL,
+                                             CONFIG_EXAMPLE_IPERF_TASK_PRIORITY, NULL, core_id);
+    ESP_GOTO_ON_FALSE(res == pdPASS, ESP_ERR_NO_MEM, err, TAG, "Create the iperf task failed");
+
+    return ESP_OK;
+
+err:
+    free(iperf_buf);
+    iperf_buf = NULL;
+    atomic_store(&iperf_running, false);
+    return ret;
+}
+
+void eth_iperf_stop(void)
+{
+    atomic_store(&iperf_stop_request, true);
+}
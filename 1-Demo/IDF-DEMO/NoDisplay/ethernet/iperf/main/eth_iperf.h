@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configuration of a test run
+ */
+typedef struct {
+    bool server;                /*!< Receive instead of send */
+    bool udp;                   /*!< UDP instead of TCP */
+    uint32_t dest_ip;           /*!< Server to send to, in network byte order, client only */
+    uint16_t port;              /*!< Port to listen on or to send to */
+    uint32_t time_s;            /*!< Length of a client run, a server runs until the client stops */
+    uint32_t interval_s;        /*!< Seconds between reports */
+    uint32_t bandwidth_mbps;    /*!< Rate of a UDP client, 0 for as fast as possible */
+    uint32_t len;               /*!< Bytes per send or receive, the datagram size of UDP */
+} eth_iperf_config_t;
+
+#define ETH_IPERF_DEFAULT_PORT      (5001)
+
+#define ETH_IPERF_DEFAULT_CONFIG()              \
+    {                                           \
+        .server = false,                        \
+        .udp = false,                           \
+        .dest_ip = 0,                           \
+        .port = ETH_IPERF_DEFAULT_PORT,         \
+        .time_s = 10,                           \
+        .interval_s = 1,                        \
+        .bandwidth_mbps = 0,                    \
+        .len = 0,                               \
+    }
+
+/**
+ * @brief Start a test run on the iperf task
+ *
+ * The traffic is iperf 2 compatible, so the other end is `iperf -s [-u]` or `iperf -c <ip> [-u] [-b 100M]` on a
+ * PC. Every interval prints the iperf report line, followed by the load of each core. A UDP server also counts
+ * the lost datagrams, and answers the client with the iperf server report.
+ *
+ * @param config: Configuration of the run, `len` 0 picks 1470 bytes for UDP and 16 KB for TCP
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: A run is in progress
+ *      - ESP_ERR_INVALID_ARG: Invalid configuration
+ *      - ESP_ERR_NO_MEM: No memory for the buffer or the task
+ */
+esp_err_t eth_iperf_start(const eth_iperf_config_t *config);
+
+/**
+ * @brief Ask the run in progress to stop, it ends at the next report or receive timeout
+ */
+void eth_iperf_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
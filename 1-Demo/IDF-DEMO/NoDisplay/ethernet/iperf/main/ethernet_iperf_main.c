@@ -0,0 +1,209 @@
+/* Ethernet iperf Example
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_netif.h"
+#include "esp_eth.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "lwip/inet.h"
+#include "ethernet_init.h"
+#include "eth_iperf.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "eth_iperf_example";
+
+static struct {
+    struct arg_str *client;
+    struct arg_lit *server;
+    struct arg_lit *udp;
+    struct arg_int *port;
+    struct arg_int *time;
+    struct arg_int *interval;
+    struct arg_int *bandwidth;
+    struct arg_int *len;
+    struct arg_lit *abort;
+    struct arg_end *end;
+} iperf_args;
+
+/** Event handler for Ethernet events */
+static void eth_event_handler(void *arg, esp_event_base_t event_base,
+                              int32_t event_id, void *event_data)
+{
+    uint8_t mac_addr[6] = {0};
+    /* we can get the ethernet driver handle from event data */
+    esp_eth_handle_t eth_handle = *(esp_eth_handle_t *)event_data;
+    eth_speed_t speed = ETH_SPEED_10M;
+    eth_duplex_t duplex = ETH_DUPLEX_HALF;
+
+    switch (event_id) {
+    case ETHERNET_EVENT_CONNECTED:
+        esp_eth_ioctl(eth_handle, ETH_CMD_G_MAC_ADDR, mac_addr);
+        esp_eth_ioctl(eth_handle, ETH_CMD_G_SPEED, &speed);
+        esp_eth_ioctl(eth_handle, ETH_CMD_G_DUPLEX_MODE, &duplex);
+        ESP_LOGI(TAG, "Ethernet Link Up, %s %s duplex", speed == ETH_SPEED_100M ? "100 Mbps" : "10 Mbps",
+                 duplex == ETH_DUPLEX_FULL ? "full" : "half");
+        ESP_LOGI(TAG, "Ethernet HW Addr %02x:%02x:%02x:%02x:%02x:%02x",
+                 mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+        break;
+    case ETHERNET_EVENT_DISCONNECTED:
+        ESP_LOGI(TAG, "Ethernet Link Down");
+        break;
+    case ETHERNET_EVENT_START:
+        ESP_LOGI(TAG, "Ethernet Started");
+        break;
+    case ETHERNET_EVENT_STOP:
+        ESP_LOGI(TAG, "Ethernet Stopped");
+        break;
+    default:
+        break;
+    }
+}
+
+/** Event handler for IP_EVENT_ETH_GOT_IP */
+static void got_ip_event_handler(void *arg, esp_event_base_t event_base,
+                                 int32_t event_id, void *event_data)
+{
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+
+    ESP_LOGI(TAG, "Ethernet Got IP Address " IPSTR ", run `iperf -s` or `iperf -c <host>`", IP2STR(&event->ip_info.ip));
+}
+
+/** Log the tuning the firmware was built with, so results of different builds can be told apart */
+static void log_net_config(void)
+{
+#if CONFIG_EXAMPLE_USE_INTERNAL_ETHERNET
+    ESP_LOGI(TAG, "NET_CONFIG eth_rx_desc=%d eth_tx_desc=%d eth_buf=%d eth_rx_prio=%d",
+             CONFIG_ETH_DMA_RX_BUFFER_NUM, CONFIG_ETH_DMA_TX_BUFFER_NUM, CONFIG_ETH_DMA_BUFFER_SIZE,
+             CONFIG_EXAMPLE_ETH_RX_TASK_PRIO);
+#endif
+    ESP_LOGI(TAG, "NET_CONFIG tcp_wnd=%d tcp_snd_buf=%d tcpip_mbox=%d tcp_mbox=%d udp_mbox=%d tcpip_core=%d iperf_core=%d",
+             CONFIG_LWIP_TCP_WND_DEFAULT, CONFIG_LWIP_TCP_SND_BUF_DEFAULT, CONFIG_LWIP_TCPIP_RECVMBOX_SIZE,
+             CONFIG_LWIP_TCP_RECVMBOX_SIZE, CONFIG_LWIP_UDP_RECVMBOX_SIZE,
+#if CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU0
+             0,
+#elif CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU1
+             1,
+#else
+             -1,
+#endif
+             CONFIG_EXAMPLE_IPERF_TASK_CORE);
+}
+
+static int iperf_cmd(int argc, char **argv)
+{
+    if (arg_parse(argc, argv, (void **)&iperf_args) != 0) {
+        arg_print_errors(stderr, iperf_args.end, argv[0]);
+        return 1;
+    }
+    if (iperf_args.abort->count) {
+        eth_iperf_stop();
+        return 0;
+    }
+    if ((iperf_args.client->count == 0) == (iperf_args.server->count == 0)) {
+        printf("Either -c <host> or -s\n");
+        return 1;
+    }
+
+    eth_iperf_config_t config = ETH_IPERF_DEFAULT_CONFIG();
+    config.server = iperf_args.server->count;
+    config.udp = iperf_args.udp->count;
+    if (iperf_args.client->count) {
+        config.dest_ip = inet_addr(iperf_args.client->sval[0]);
+    }
+    if (iperf_args.port->count) {
+        config.port = iperf_args.port->ival[0];
+    }
+    if (iperf_args.time->count) {
+        config.time_s = iperf_args.time->ival[0];
+    }
+    if (iperf_args.interval->count) {
+        config.interval_s = iperf_args.interval->ival[0];
+    }
+    if (iperf_args.bandwidth->count) {
+        config.bandwidth_mbps = iperf_args.bandwidth->ival[0];
+    }
+    if (iperf_args.len->count) {
+        config.len = iperf_args.len->ival[0];
+    }
+
+    return (eth_iperf_start(&config) == ESP_OK) ? 0 : 1;
+}
+
+static void register_iperf_cmd(void)
+{
+    iperf_args.client = arg_str0("c", "client", "<host>", "run as a client, sending to the iperf server at <host>");
+    iperf_args.server = arg_lit0("s", "server", "run as a server, receiving from an iperf client");
+    iperf_args.udp = arg_lit0("u", "udp", "use UDP rather than TCP");
+    iperf_args.port = arg_int0("p", "port", "<port>", "server port to listen on or connect to (default 5001)");
+    iperf_args.time = arg_int0("t", "time", "<seconds>", "time to transmit for (default 10)");
+    iperf_args.interval = arg_int0("i", "interval", "<seconds>", "seconds between reports (default 1)");
+    iperf_args.bandwidth = arg_int0("b", "bandwidth", "<Mbps>", "UDP client rate (default unlimited)");
+    iperf_args.len = arg_int0("l", "len", "<bytes>", "bytes per read or write (default 16384, 1470 for UDP)");
+    iperf_args.abort = arg_lit0("a", "abort", "stop the run in progress");
+    iperf_args.end = arg_end(1);
+
+    const esp_console_cmd_t cmd = {
+        .command = "iperf",
+        .help = "iperf 2 compatible TCP/UDP throughput test, with the load of each core",
+        .hint = NULL,
+        .func = &iperf_cmd,
+        .argtable = &iperf_args,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
+void app_main(void)
+{
+    // Initialize Ethernet driver
+    uint8_t eth_port_cnt = 0;
+    esp_eth_handle_t *eth_handles;
+    ESP_ERROR_CHECK(example_eth_init(&eth_handles, &eth_port_cnt));
+
+    // Initialize TCP/IP network interface aka the esp-netif (should be called only once in application)
+    ESP_ERROR_CHECK(esp_netif_init());
+    // Create default event loop that running in background
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    // The test uses the first Ethernet interface
+    if (eth_port_cnt > 1) {
+        ESP_LOGW(TAG, "multiple Ethernet devices detected, the first initialized is to be used!");
+    }
+    esp_netif_config_t cfg = ESP_NETIF_DEFAULT_ETH();
+    esp_netif_t *eth_netif = esp_netif_new(&cfg);
+    ESP_ERROR_CHECK(esp_netif_attach(eth_netif, esp_eth_new_netif_glue(eth_handles[0])));
+
+    // Register user defined event handlers
+    ESP_ERROR_CHECK(esp_event_handler_register(ETH_EVENT, ESP_EVENT_ANY_ID, &eth_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &got_ip_event_handler, NULL));
+
+    // Start Ethernet driver state machine
+    ESP_ERROR_CHECK(esp_eth_start(eth_handles[0]));
+    log_net_config();
+
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "iperf>";
+#if defined(CONFIG_ESP_CONSOLE_UART_DEFAULT) || defined(CONFIG_ESP_CONSOLE_UART_CUSTOM)
+    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &repl));
+#elif defined(CONFIG_ESP_CONSOLE_USB_CDC)
+    esp_console_dev_usb_cdc_config_t hw_config = ESP_CONSOLE_DEV_CDC_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_usb_cdc(&hw_config, &repl_config, &repl));
+#elif defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG)
+    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl));
+#endif
+    register_iperf_cmd();
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
@@ -0,0 +1,150 @@
+/* Modbus RTU Example
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "modbus_rtu.h"
+#include "rs485_sniffer.h"
+#include "bsp/esp-bsp.h"
+
+/**
+ * A Modbus RTU master polling many slaves as fast as the bus allows, or one of these slaves.
+ * Frames end on the UART RX timeout, so the t3.5 gap is measured by the hardware at any baud rate.
+ */
+#define TAG "MODBUS_RTU_APP"
+
+#define MB_TASK_STACK_SIZE      (3072)
+#define MB_TASK_PRIO            (12)
+#define MB_REPORT_PERIOD_MS     (1000)
+#define MB_HISTOGRAM_PERIOD_MS  (10000)
+#define MB_CAPTURE_FILE         BSP_SD_MOUNT_POINT"/RS485.BIN"
+
+static void mb_bus_config(rs485_bus_config_t *bus_config)
+{
+    bus_config->uart_num = CONFIG_MB_UART_PORT_NUM;
+    bus_config->baud_rate = CONFIG_MB_UART_BAUD_RATE;
+    bus_config->tx_pin = CONFIG_MB_UART_TXD;
+    bus_config->rx_pin = CONFIG_MB_UART_RXD;
+    bus_config->rts_pin = CONFIG_MB_UART_RTS;
+    bus_config->idle_symbols = CONFIG_MB_IDLE_SYMBOLS;
+    bus_config->task_stack = MB_TASK_STACK_SIZE;
+    bus_config->task_priority = MB_TASK_PRIO;
+}
+
+#if CONFIG_MB_EXAMPLE_MASTER
+static modbus_rtu_poll_t polls[CONFIG_MB_SLAVE_NUM];
+static uint16_t slave_regs[CONFIG_MB_SLAVE_NUM][CONFIG_MB_REG_NUM];
+
+static void mb_run(void)
+{
+    rs485_bus_config_t bus_config = RS485_BUS_DEFAULT_CONFIG();
+    mb_bus_config(&bus_config);
+
+    for (int i = 0; i < CONFIG_MB_SLAVE_NUM; i++) {
+        polls[i].slave = CONFIG_MB_FIRST_SLAVE + i;
+        polls[i].function = MODBUS_RTU_READ_HOLDING_REGISTERS;
+        polls[i].address = 0;
+        polls[i].count = CONFIG_MB_REG_NUM;
+        polls[i].data = slave_regs[i];
+    }
+
+    modbus_rtu_master_config_t config = MODBUS_RTU_MASTER_DEFAULT_CONFIG();
+    config.polls = polls;
+    config.poll_num = CONFIG_MB_SLAVE_NUM;
+    config.response_timeout_ms = CONFIG_MB_RESPONSE_TIMEOUT_MS;
+
+    modbus_rtu_master_handle_t master = NULL;
+    ESP_ERROR_CHECK(modbus_rtu_master_new(&bus_config, &config, &master));
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(MB_REPORT_PERIOD_MS));
+        modbus_rtu_master_stats_t stats;
+        modbus_rtu_master_get_stats(master, &stats);
+
+        int online = 0;
+        for (int i = 0; i < CONFIG_MB_SLAVE_NUM; i++) {
+            online += (polls[i].status == ESP_OK);
+        }
+        ESP_LOGI(TAG, "%d/%d slaves, cycle %"PRIu32" us (min %"PRIu32", max %"PRIu32"), %"PRIu32" cycles, "
+                 "%"PRIu32" timeouts, %"PRIu32" bad responses", online, CONFIG_MB_SLAVE_NUM, stats.last_cycle_us,
+                 stats.min_cycle_us, stats.max_cycle_us, stats.cycles, stats.timeouts, stats.bad_responses);
+    }
+}
+#elif CONFIG_MB_EXAMPLE_SNIFFER
+static void mb_run(void)
+{
+    rs485_bus_config_t bus_config = RS485_BUS_DEFAULT_CONFIG();
+    mb_bus_config(&bus_config);
+    // Never drives the bus
+    bus_config.rts_pin = -1;
+    bus_config.max_frame_size = MODBUS_RTU_MAX_ADU;
+
+    rs485_sniffer_config_t config = RS485_SNIFFER_DEFAULT_CONFIG();
+#if CONFIG_MB_SNIFFER_CAPTURE
+    ESP_ERROR_CHECK(bsp_sdcard_mount());
+    config.out = fopen(MB_CAPTURE_FILE, "wb");
+    if (config.out == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", MB_CAPTURE_FILE);
+        return;
+    }
+    // The sniffer writes whole blocks, a stdio buffer would only add a copy
+    setvbuf(config.out, NULL, _IONBF, 0);
+#endif
+
+    rs485_sniffer_handle_t sniffer = NULL;
+    ESP_ERROR_CHECK(rs485_sniffer_new(&bus_config, &config, &sniffer));
+
+    for (uint32_t ms = MB_REPORT_PERIOD_MS; ; ms += MB_REPORT_PERIOD_MS) {
+        vTaskDelay(pdMS_TO_TICKS(MB_REPORT_PERIOD_MS));
+        rs485_sniffer_stats_t stats;
+        rs485_sniffer_get_stats(sniffer, &stats);
+        ESP_LOGI(TAG, "%"PRIu32" frames, %"PRIu32" dropped, %"PRIu64" bytes captured", stats.frames, stats.dropped,
+                 stats.written);
+        if ((ms % MB_HISTOGRAM_PERIOD_MS) == 0) {
+            rs485_sniffer_print_histograms(sniffer);
+        }
+    }
+}
+#else
+static uint16_t holding_regs[CONFIG_MB_REG_NUM];
+
+static void mb_run(void)
+{
+    rs485_bus_config_t bus_config = RS485_BUS_DEFAULT_CONFIG();
+    mb_bus_config(&bus_config);
+
+    for (int i = 0; i < CONFIG_MB_REG_NUM; i++) {
+        holding_regs[i] = (CONFIG_MB_SLAVE_ADDRESS << 8) | i;
+    }
+
+    modbus_rtu_slave_config_t config = {
+        .address = CONFIG_MB_SLAVE_ADDRESS,
+        .holding_regs = holding_regs,
+        .holding_reg_num = CONFIG_MB_REG_NUM,
+    };
+    modbus_rtu_slave_handle_t slave = NULL;
+    ESP_ERROR_CHECK(modbus_rtu_slave_new(&bus_config, &config, &slave));
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(MB_REPORT_PERIOD_MS));
+        modbus_rtu_slave_stats_t stats;
+        modbus_rtu_slave_get_stats(slave, &stats);
+        ESP_LOGI(TAG, "%"PRIu32" requests, %"PRIu32" exceptions, %"PRIu32" CRC errors", stats.requests,
+                 stats.exceptions, stats.crc_errors);
+    }
+}
+#endif
+
+void app_main(void)
+{
+    mb_run();
+}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "mp3dec.h"
+#include "bsp_board_extra.h"
+#include "mp3_playlist.h"
+
+#define TAG                     "mp3_playlist"
+
+#define PLAYLIST_BLOCK_SAMPLES  (1152 * 2)      // One stereo MPEG-1 layer 3 frame
+#define PLAYLIST_PATH_MAX       (256)
+
+/* Ring item, one decoded frame */
+typedef struct {
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t reserved;
+    int16_t samples[];
+} playlist_block_t;
+
+static mp3_playlist_config_t playlist_config;
+static RingbufHandle_t playlist_ring = NULL;
+static uint8_t *playlist_read_buf = NULL;
+static playlist_block_t *playlist_block = NULL;
+static HMP3Decoder playlist_decoder = NULL;
+
+static void playlist_push(uint32_t sample_rate, uint16_t channels, size_t sample_num)
+{
+    playlist_block->sample_rate = sample_rate;
+    playlist_block->channels = channels;
+    // Blocks while the ring is full, i.e. the decode is a ring ahead of the playback
+    xRingbufferSend(playlist_ring, playlist_block, sizeof(playlist_block_t) + sample_num * sizeof(int16_t),
+                    portMAX_DELAY);
+}
+
+/* Size of an ID3v2 tag at the start of the file, its artwork may contain false frame syncs */
+static long playlist_id3_size(FILE *fp)
+{
+    uint8_t header[10];
+    if ((fread(header, 1, sizeof(header), fp) != sizeof(header)) || memcmp(header, "ID3", 3)) {
+        return 0;
+    }
+    const long size = ((header[6] & 0x7f) << 21) | ((header[7] & 0x7f) << 14) | ((header[8] & 0x7f) << 7) |
+                      (header[9] & 0x7f);
+    return sizeof(header) + size + ((header[5] & 0x10) ? 10 : 0);
+}
+
+static void playlist_decode_mp3(FILE *fp)
+{
+    fseek(fp, playlist_id3_size(fp), SEEK_SET);
+
+    uint8_t *ptr = playlist_read_buf;
+    int left = 0;
+    bool eof = false;
+
+    while (true) {
+        // Refill with one large read once less than a frame is left
+        if (!eof && (left < MAINBUF_SIZE)) {
+            memmove(playlist_read_buf, ptr, left);
+            const size_t want = playlist_config.read_size - left;
+            const size_t got = fread(playlist_read_buf + left, 1, want, fp);
+            eof = (got < want);
+            left += got;
+            ptr = playlist_read_buf;
+        }
+        if (left <= 0) {
+            break;
+        }
+
+        const int offset = MP3FindSyncWord(ptr, left);
+        if (offset < 0) {
+            left = 0;       // No frame in the buffer, drop it
+            continue;
+        }
+        ptr += offset;
+        left -= offset;
+
+        const int err = MP3Decode(playlist_decoder, &ptr, &left, playlist_block->samples, 0);
+        if (err == ERR_MP3_NONE) {
+            MP3FrameInfo info;
+            MP3GetLastFrameInfo(playlist_decoder, &info);
+            playlist_push(info.samprate, info.nChans, info.outputSamps);
+        } else if (err == ERR_MP3_INDATA_UNDERFLOW) {
+            if (eof) {
+                break;      // Truncated last frame
+            }
+            ptr++;          // A false sync that claimed more than a frame
+            left--;
+        } else if (err != ERR_MP3_MAINDATA_UNDERFLOW) {
+            // Skip the bad sync, the bit reservoir underflow of the first frames only drops them
+            ptr++;
+            left--;
+        }
+    }
+}
+
+static void playlist_decode_wav(FILE *fp)
+{
+    uint8_t header[12];
+    if ((fread(header, 1, sizeof(header), fp) != sizeof(header)) || memcmp(header, "RIFF", 4) ||
+            memcmp(header + 8, "WAVE", 4)) {
+        ESP_LOGW(TAG, "Not a WAV file");
+        return;
+    }
+
+    uint16_t channels = 0;
+    uint16_t bits = 0;
+    uint32_t sample_rate = 0;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), fp) == sizeof(chunk)) {
+        uint32_t size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+        if (!memcmp(chunk, "fmt ", 4) && (size >= 16)) {
+            uint8_t fmt[16];
+            if (fread(fmt, 1, sizeof(fmt), fp) != sizeof(fmt)) {
+                return;
+            }
+            const uint16_t format = fmt[0] | (fmt[1] << 8);
+            channels = fmt[2] | (fmt[3] << 8);
+            sample_rate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24);
+            bits = fmt[14] | (fmt[15] << 8);
+            if ((format != 1) || (bits != 16) || (channels < 1) || (channels > 2)) {
+                ESP_LOGW(TAG, "Only 16 bit PCM WAV, not format %d with %d bits and %d channels", format, bits, channels);
+                return;
+            }
+            size -= sizeof(fmt);
+        } else if (!memcmp(chunk, "data", 4) && bits) {
+            const uint32_t block_size = PLAYLIST_BLOCK_SAMPLES * sizeof(int16_t);
+            while (size > 0) {
+                // Large reads into the read buffer, then handed to the ring a frame at a time
+                const size_t want = (size < playlist_config.read_size) ? size : playlist_config.read_size;
+                const size_t got = fread(playlist_read_buf, 1, want, fp) & ~(2 * channels - 1);
+                for (size_t done = 0; done < got; done += block_size) {
+                    const size_t bytes = ((got - done) < block_size) ? (got - done) : block_size;
+                    memcpy(playlist_block->samples, playlist_read_buf + done, bytes);
+                    playlist_push(sample_rate, channels, bytes / sizeof(int16_t));
+                }
+                if (got < want) {
+                    return;
+                }
+                size -= got;
+            }
+            return;
+        }
+        // Chunks are padded to an even size
+        fseek(fp, size + (size & 1), SEEK_CUR);
+    }
+}
+
+static void playlist_decode_task(void *arg)
+{
+    char path[PLAYLIST_PATH_MAX];
+    size_t index = 0;
+
+    while (true) {
+        const size_t count = file_iterator_get_count(playlist_config.files);
+        if (count == 0) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+        index %= count;
+        if (file_iterator_get_full_path_from_index(playlist_config.files, index, path, sizeof(path)) == 0) {
+            index++;
+            continue;
+        }
+
+        const char *ext = strrchr(path, '.');
+        // Read ahead in large blocks on the stream task, the decoder only waits for a block the card hasn't delivered
+        FILE *fp = NULL;
+        if (bsp_extra_stream_fopen(path, NULL, &fp) != ESP_OK) {
+            ESP_LOGW(TAG, "Unable to open %s", path);
+        } else {
+            ESP_LOGI(TAG, "Decoding %s", path);
+            if (ext && !strcasecmp(ext, ".mp3")) {
+                playlist_decode_mp3(fp);
+            } else if (ext && !strcasecmp(ext, ".wav")) {
+                playlist_decode_wav(fp);
+            } else {
+                ESP_LOGW(TAG, "Skip %s, not MP3 or WAV", path);
+            }
+            fclose(fp);
+        }
+        index++;
+    }
+}
+
+static void playlist_play_task(void *arg)
+{
+    uint32_t sample_rate = 0;
+    uint16_t channels = 0;
+
+    // Start with half a ring decoded, the SD card latency of the first track is covered too
+    while (xRingbufferGetCurFreeSize(playlist_ring) > playlist_config.ring_size / 2) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    while (true) {
+        size_t size = 0;
+        playlist_block_t *block = xRingbufferReceive(playlist_ring, &size, portMAX_DELAY);
+        if (!block) {
+            continue;
+        }
+        if ((block->sample_rate != sample_rate) || (block->channels != channels)) {
+            ESP_LOGI(TAG, "%lu Hz, %d channels", block->sample_rate, block->channels);
+            bsp_extra_codec_set_fs(block->sample_rate, 16, block->channels);
+            sample_rate = block->sample_rate;
+            channels = block->channels;
+        }
+
+        size_t written = 0;
+        bsp_extra_i2s_write(block->samples, size - sizeof(playlist_block_t), &written, portMAX_DELAY);
+        vRingbufferReturnItem(playlist_ring, block);
+    }
+}
+
+esp_err_t mp3_playlist_start(const mp3_playlist_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->files && config->read_size > MAINBUF_SIZE, ESP_ERR_INVALID_ARG, TAG,
+                        "Invalid argument");
+    ESP_RETURN_ON_FALSE(playlist_ring == NULL, ESP_ERR_INVALID_STATE, TAG, "Already started");
+
+    const size_t block_size = sizeof(playlist_block_t) + PLAYLIST_BLOCK_SAMPLES * sizeof(int16_t);
+    ESP_RETURN_ON_FALSE(config->ring_size > 4 * block_size, ESP_ERR_INVALID_ARG, TAG, "Ring too small");
+
+    playlist_config = *config;
+    playlist_read_buf = heap_caps_malloc(playlist_config.read_size, MALLOC_CAP_SPIRAM);
+    playlist_block = heap_caps_malloc(block_size, MALLOC_CAP_INTERNAL);
+    playlist_decoder = MP3InitDecoder();
+    playlist_ring = xRingbufferCreateWithCaps(playlist_config.ring_size, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM);
+    ESP_RETURN_ON_FALSE(playlist_read_buf && playlist_block && playlist_decoder && playlist_ring, ESP_ERR_NO_MEM,
+                        TAG, "No memory for the playlist");
+
+    ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(playlist_decode_task, "mp3_decode", 8192, NULL,
+                                                playlist_config.decode_priority, NULL, playlist_config.core) == pdPASS,
+                        ESP_ERR_NO_MEM, TAG, "Create decode task failed");
+    ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(playlist_play_task, "mp3_play", 4096, NULL,
+                                                playlist_config.play_priority, NULL, playlist_config.core) == pdPASS,
+                        ESP_ERR_NO_MEM, TAG, "Create play task failed");
+
+    return ESP_OK;
+}
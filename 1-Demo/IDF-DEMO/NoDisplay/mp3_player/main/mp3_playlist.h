@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "file_iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configuration of the playlist
+ */
+typedef struct {
+    file_iterator_instance_t *files;    // Played in order, then from the start again
+    size_t ring_size;                   // PSRAM bytes of decoded audio kept ahead of the playback
+    size_t read_size;                   // Bytes per decoder refill from the file stream
+    UBaseType_t decode_priority;        // Below the play task, the ring absorbs the decode and SD card latency
+    UBaseType_t play_priority;
+    BaseType_t core;
+} mp3_playlist_config_t;
+
+#define MP3_PLAYLIST_DEFAULT_CONFIG(_files)     \
+    {                                           \
+        .files = _files,                        \
+        .ring_size = 512 * 1024,                \
+        .read_size = 32 * 1024,                 \
+        .decode_priority = 4,                   \
+        .play_priority = 6,                     \
+        .core = 1,                              \
+    }
+
+/**
+ * @brief Play the MP3 and WAV files of the iterator, gapless
+ *
+ * A decode task reads each file in large sequential reads and decodes it into a PCM ring in PSRAM. It opens the
+ * next file as soon as the previous one is read, so track N+1 is decoded while track N still plays from the ring.
+ * A play task writes the ring to the codec and switches the sample rate between tracks with
+ * bsp_extra_codec_set_fs(), which only changes the I2S clock.
+ *
+ * @note Call bsp_extra_codec_init() first, and don't use the bsp_extra player at the same time
+ *
+ * @param config: Playlist configuration
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: Already started
+ *      - ESP_ERR_NO_MEM: No memory for the ring, the buffers or the tasks
+ */
+esp_err_t mp3_playlist_start(const mp3_playlist_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,17 +9,18 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "nvs_flash.h"
-#include "driver/uart.h"
-#include "freertos/queue.h"
 #include "esp_log.h"
 #include "sdkconfig.h"
+#include "rs485_bus.h"
 
 /**
  * This is a example which echos any data it receives on UART back to the sender using RS485 interface in half duplex mode.
+ * Frames are delimited by the idle line and every reply is sent as one frame.
 */
 #define TAG "RS485_ECHO_APP"
 
@@ -29,16 +30,11 @@
 #define ECHO_TEST_RXD           (CONFIG_ECHO_UART_RXD)
 
 // RTS for RS485 Half-Duplex Mode manages DE/~RE
-#define ECHO_TEST_RTS           (UART_PIN_NO_CHANGE)
-
-// CTS is not used in RS485 Half-Duplex Mode
-#define ECHO_TEST_CTS           (UART_PIN_NO_CHANGE)
+#define ECHO_TEST_RTS           (CONFIG_ECHO_UART_RTS)
 
 #define BUF_SIZE                (127)
 #define BAUD_RATE               (CONFIG_ECHO_UART_BAUD_RATE)
 
-// Read packet timeout
-#define PACKET_READ_TICS        (100 / portTICK_PERIOD_MS)
 #define ECHO_TASK_STACK_SIZE    (CONFIG_ECHO_TASK_STACK_SIZE)
 #define ECHO_TASK_PRIO          (10)
 #define ECHO_UART_PORT          (CONFIG_ECHO_UART_PORT_NUM)
@@ -46,92 +42,72 @@
 // Timeout threshold for UART = number of symbols (~10 tics) with unchanged state on receive pin
 #define ECHO_READ_TOUT          (3) // 3.5T * 8 = 28 ticks, TOUT=3 -> ~24..33 ticks
 
-static void echo_send(const int port, const char* str, uint8_t length)
+#define ECHO_PREFIX             "\r\nRS485 Received: ["
+#define ECHO_SUFFIX             "]\r\n"
+#define ECHO_STATS_PERIOD_MS    (5000)
+
+static void echo_send(rs485_bus_handle_t bus, const uint8_t *frame, size_t length)
 {
-    if (uart_write_bytes(port, str, length) != length) {
+    if (rs485_bus_send(bus, frame, length) != ESP_OK) {
         ESP_LOGE(TAG, "Send data critical failure.");
         // add your code to handle sending failure here
         abort();
     }
 }
 
-// An example of echo test with hardware flow control on UART
-static void echo_task(void *arg)
+// Echo every frame back as a single frame, so the reply is one write and one bus turnaround
+static void echo_frame_cb(rs485_bus_handle_t bus, const uint8_t *frame, size_t len, void *user_ctx)
 {
-    const int uart_num = ECHO_UART_PORT;
-    uart_config_t uart_config = {
-        .baud_rate = BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .rx_flow_ctrl_thresh = 122,
-        .source_clk = UART_SCLK_DEFAULT,
-    };
+    // A '\r' from a paste (Paste tests multibyte receipt/buffer) gets a newline, at most one per byte
+    static uint8_t reply[sizeof(ECHO_PREFIX) - 1 + BUF_SIZE * 2 + sizeof(ECHO_SUFFIX) - 1];
+    size_t reply_len = sizeof(ECHO_PREFIX) - 1;
+
+    memcpy(reply, ECHO_PREFIX, reply_len);
+    for (size_t i = 0; i < len; i++) {
+        reply[reply_len++] = frame[i];
+        if (frame[i] == '\r') {
+            reply[reply_len++] = '\n';
+        }
+    }
+    memcpy(reply + reply_len, ECHO_SUFFIX, sizeof(ECHO_SUFFIX) - 1);
+    reply_len += sizeof(ECHO_SUFFIX) - 1;
+    echo_send(bus, reply, reply_len);
+
+    // Logged after the reply is on its way, the console is much slower than the bus
+    ESP_LOGI(TAG, "Received %u bytes:", (unsigned)len);
+    ESP_LOG_BUFFER_HEX(TAG, frame, len);
+}
+
+void app_main(void)
+{
+    rs485_bus_config_t bus_config = RS485_BUS_DEFAULT_CONFIG();
+    bus_config.uart_num = ECHO_UART_PORT;
+    bus_config.baud_rate = BAUD_RATE;
+    bus_config.tx_pin = ECHO_TEST_TXD;
+    bus_config.rx_pin = ECHO_TEST_RXD;
+    bus_config.rts_pin = ECHO_TEST_RTS;
+    bus_config.max_frame_size = BUF_SIZE;
+    bus_config.idle_symbols = ECHO_READ_TOUT;
+    bus_config.pattern_chr = CONFIG_ECHO_PATTERN_CHR;
+    bus_config.on_frame = echo_frame_cb;
+    bus_config.task_stack = ECHO_TASK_STACK_SIZE;
+    bus_config.task_priority = ECHO_TASK_PRIO;
 
     // Set UART log level
     esp_log_level_set(TAG, ESP_LOG_INFO);
 
     ESP_LOGI(TAG, "Start RS485 application test and configure UART.");
+    rs485_bus_handle_t bus = NULL;
+    ESP_ERROR_CHECK(rs485_bus_new(&bus_config, &bus));
 
-    // Install UART driver (we don't need an event queue here)
-    // In this example we don't even use a buffer for sending data.
-    ESP_ERROR_CHECK(uart_driver_install(uart_num, BUF_SIZE * 2, 0, 0, NULL, 0));
-
-    // Configure UART parameters
-    ESP_ERROR_CHECK(uart_param_config(uart_num, &uart_config));
-
-    ESP_LOGI(TAG, "UART set pins, mode and install driver.");
-
-    // Set UART pins as per KConfig settings
-    ESP_ERROR_CHECK(uart_set_pin(uart_num, ECHO_TEST_TXD, ECHO_TEST_RXD, ECHO_TEST_RTS, ECHO_TEST_CTS));
-
-    // Set RS485 half duplex mode
-    ESP_ERROR_CHECK(uart_set_mode(uart_num, UART_MODE_RS485_HALF_DUPLEX));
-
-    // Set read timeout of UART TOUT feature
-    ESP_ERROR_CHECK(uart_set_rx_timeout(uart_num, ECHO_READ_TOUT));
-
-    // Allocate buffers for UART
-    uint8_t* data = (uint8_t*) malloc(BUF_SIZE);
-    assert(data);
-
-    ESP_LOGI(TAG, "UART start receive loop.\r");
-    echo_send(uart_num, "Start RS485 UART test.\r\n", 24);
+    const char start[] = "Start RS485 UART test.\r\n";
+    echo_send(bus, (const uint8_t *)start, sizeof(start) - 1);
 
     while (1) {
-        //Read data from UART
-        int len = uart_read_bytes(uart_num, data, BUF_SIZE, PACKET_READ_TICS);
-
-        //Write data back to UART
-        if (len > 0) {
-            echo_send(uart_num, "\r\n", 2);
-            char prefix[] = "RS485 Received: [";
-            echo_send(uart_num, prefix, (sizeof(prefix) - 1));
-            ESP_LOGI(TAG, "Received %u bytes:", len);
-            printf("[ ");
-            for (int i = 0; i < len; i++) {
-                printf("0x%.2X ", (uint8_t)data[i]);
-                echo_send(uart_num, (const char*)&data[i], 1);
-                // Add a Newline character if you get a return character from paste (Paste tests multibyte receipt/buffer)
-                if (data[i] == '\r') {
-                    echo_send(uart_num, "\n", 1);
-                }
-            }
-            printf("] \n");
-            echo_send(uart_num, "]\r\n", 3);
-        }
-         else {
-            // Echo a "." to show we are alive while we wait for input
-            echo_send(uart_num, ".", 1);
-            ESP_ERROR_CHECK(uart_wait_tx_done(uart_num, 10));
-        }
+        vTaskDelay(pdMS_TO_TICKS(ECHO_STATS_PERIOD_MS));
+        rs485_bus_stats_t stats;
+        rs485_bus_get_stats(bus, &stats);
+        ESP_LOGI(TAG, "frames %"PRIu32", bad %"PRIu32", too long %"PRIu32", overflows %"PRIu32,
+                 stats.frames, stats.bad_frames, stats.long_frames, stats.overflows);
     }
-    vTaskDelete(NULL);
-}
-
-void app_main(void)
-{
-    //A uart read/write example without event queue;
-    xTaskCreate(echo_task, "uart_echo_task", ECHO_TASK_STACK_SIZE, NULL, ECHO_TASK_PRIO, NULL);
 }
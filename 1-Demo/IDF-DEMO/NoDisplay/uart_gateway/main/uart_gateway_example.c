@@ -0,0 +1,108 @@
+/* UART Gateway Example
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "uart_service.h"
+
+/**
+ * Up to four RS485 or RS232 ports, UART1 to UART4, echoing every frame back, all served by a single task.
+ */
+#define TAG "UART_GATEWAY_APP"
+
+#define GW_STATS_PERIOD_MS      (5000)
+#define GW_SERVICE_CORE         ((CONFIG_GW_SERVICE_CORE < 0) ? tskNO_AFFINITY : CONFIG_GW_SERVICE_CORE)
+
+#if CONFIG_GW_PORT1_RS232
+#define GW_PORT1_RS232         (true)
+#else
+#define GW_PORT1_RS232         (false)
+#endif
+#if CONFIG_GW_PORT2_RS232
+#define GW_PORT2_RS232         (true)
+#else
+#define GW_PORT2_RS232         (false)
+#endif
+#if CONFIG_GW_PORT3_RS232
+#define GW_PORT3_RS232         (true)
+#else
+#define GW_PORT3_RS232         (false)
+#endif
+#if CONFIG_GW_PORT4_RS232
+#define GW_PORT4_RS232         (true)
+#else
+#define GW_PORT4_RS232         (false)
+#endif
+
+#define GW_PORT(n)                                                                              \
+    {                                                                                           \
+        .uart_num = UART_NUM_##n,                                                               \
+        .tx_pin = CONFIG_GW_PORT##n##_TXD,                                                      \
+        .rx_pin = CONFIG_GW_PORT##n##_RXD,                                                      \
+        .rts_pin = CONFIG_GW_PORT##n##_RTS,                                                     \
+        .rs232 = GW_PORT##n##_RS232,                                                            \
+    }
+
+typedef struct {
+    uart_port_t uart_num;
+    int tx_pin;
+    int rx_pin;
+    int rts_pin;
+    bool rs232;
+} gw_port_t;
+
+static const gw_port_t gw_ports[CONFIG_GW_PORT_NUM] = {
+    GW_PORT(1),
+#if CONFIG_GW_PORT_NUM >= 2
+    GW_PORT(2),
+#endif
+#if CONFIG_GW_PORT_NUM >= 3
+    GW_PORT(3),
+#endif
+#if CONFIG_GW_PORT_NUM >= 4
+    GW_PORT(4),
+#endif
+};
+
+// The protocol handler of every port, a real gateway would have one per field bus protocol
+static bool gw_echo_frame(uart_service_frame_t *frame, void *user_ctx)
+{
+    uart_service_send(frame->port, frame->data, frame->len);
+
+    return false;
+}
+
+void app_main(void)
+{
+    uart_service_config_t config = UART_SERVICE_DEFAULT_CONFIG();
+    config.task_core = GW_SERVICE_CORE;
+    uart_service_handle_t service = NULL;
+    ESP_ERROR_CHECK(uart_service_new(&config, &service));
+
+    for (int i = 0; i < CONFIG_GW_PORT_NUM; i++) {
+        uart_service_port_config_t port_config = UART_SERVICE_PORT_DEFAULT_CONFIG();
+        port_config.uart_num = gw_ports[i].uart_num;
+        port_config.mode = gw_ports[i].rs232 ? UART_MODE_UART : UART_MODE_RS485_HALF_DUPLEX;
+        port_config.baud_rate = CONFIG_GW_BAUD_RATE;
+        port_config.tx_pin = gw_ports[i].tx_pin;
+        port_config.rx_pin = gw_ports[i].rx_pin;
+        port_config.rts_pin = gw_ports[i].rs232 ? -1 : gw_ports[i].rts_pin;
+        port_config.on_frame = gw_echo_frame;
+
+        uart_service_port_handle_t port = NULL;
+        ESP_ERROR_CHECK(uart_service_add_port(service, &port_config, &port));
+    }
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(GW_STATS_PERIOD_MS));
+        uart_service_log_stats(service);
+    }
+}
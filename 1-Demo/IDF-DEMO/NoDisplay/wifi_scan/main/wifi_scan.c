@@ -8,11 +8,47 @@
 
 #include "esp_wifi.h"
 #include "esp_wifi_remote.h"
+#include "wifi_scanner.h"
 
 
 #define TAG  "app_main"
 #define SCAN_LIST_SIZE 20
 
+static void print_ap_list(void)
+{
+    // Static, it's printed from the event loop task
+    static wifi_scanner_ap_t ap_info[SCAN_LIST_SIZE];
+    const int ap_count = wifi_scanner_get_aps(ap_info, SCAN_LIST_SIZE);
+
+    ESP_LOGI(TAG,"-------------------------------------------------------");
+    ESP_LOGI(TAG,"|\tSSID\t\t\t\t  RSSI\tCH\tAGE\t|");
+
+     for (int i = 0; i < ap_count; i++) {
+        ESP_LOGI(TAG,"|\t%-*s %d\t%d\t%lus\t|",33,ap_info[i].ssid, ap_info[i].rssi, ap_info[i].channel,
+                 (unsigned long)(ap_info[i].age_ms / 1000));
+     }
+     ESP_LOGI(TAG,"-------------------------------------------------------");
+}
+
+static void scanner_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    const wifi_scanner_ap_t *ap = (const wifi_scanner_ap_t *)event_data;
+
+    switch (event_id) {
+    case WIFI_SCANNER_EVENT_AP_FOUND:
+        ESP_LOGI(TAG, "Found %s on channel %d, %d dBm", ap->ssid, ap->channel, ap->rssi);
+        break;
+    case WIFI_SCANNER_EVENT_AP_LOST:
+        ESP_LOGI(TAG, "Lost %s", ap->ssid);
+        break;
+    case WIFI_SCANNER_EVENT_SWEEP_DONE:
+        print_ap_list();
+        break;
+    default:
+        break;
+    }
+}
+
 void app_main(void)
 {
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -22,21 +58,7 @@ void app_main(void)
     esp_wifi_set_mode(WIFI_MODE_STA);
     esp_wifi_start();
 
-    uint16_t number = SCAN_LIST_SIZE;
-    wifi_ap_record_t ap_info[SCAN_LIST_SIZE];
-    uint16_t ap_count = 0;
-    memset(ap_info, 0, sizeof(ap_info));
-
-    esp_wifi_scan_start(NULL, true);
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_info));
-
-    ESP_LOGI(TAG,"-------------------------------------------------------");
-    ESP_LOGI(TAG,"|\tSSID\t\t\t\t  RSSI\t\t|");
-
-     for (int i = 0; (i < SCAN_LIST_SIZE) && (i < ap_count); i++) {
-        ESP_LOGI(TAG,"|\t%-*s %d\t\t|",33,ap_info[i].ssid, ap_info[i].rssi);
-     }
-     ESP_LOGI(TAG,"-------------------------------------------------------");
-
+    // The scanner works in the background, the AP list is read from its cache at any time without waiting
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_SCANNER_EVENT, ESP_EVENT_ANY_ID, scanner_event_handler, NULL));
+    ESP_ERROR_CHECK(wifi_scanner_start(NULL));
 }
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
@@ -16,9 +17,8 @@
 #include "esp_vfs_fat.h"
 #include "sd_pwr_ctrl_by_on_chip_ldo.h"
 
-#include "esp_adc/adc_oneshot.h"
-#include "esp_adc/adc_cali.h"
-#include "esp_adc/adc_cali_scheme.h"
+#include "battery_monitor.h"
+#include "battery_soc.h"
 
 #include "esp_lcd_jd9365_10_1.h"
 #include "esp_lcd_touch_gt911.h"
@@ -26,6 +26,8 @@
 #include "lvgl.h"
 #include "lv_demos.h"
 #include "esp_lvgl_port.h"
+#include "bound_label.h"
+#include "display_governor.h"
 
 #define TAG                                 "main"
 
@@ -57,17 +59,21 @@
 #define V_MAX                       (2200)  //Maximum battery capacity
 #define V_MIN                       (1800)  //Minimum battery capacity
 
-static int adc_raw;
-static int adc_raw_;
-static int adc_raw_tep;
-static int voltage_;
-static int voltage;
-static int voltage_per;
-static int voltage_per_;
-static int cnt = 0;
-static bool charging_ = false;
-static bool example_adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle);
-static void example_adc_calibration_deinit(adc_cali_handle_t handle);
+// The divider maps V_MAX on a full 4.2 V cell, and the charging range is the charger's offset above it
+#define BATTERY_DIVIDER_NUM         (21)
+#define BATTERY_DIVIDER_DEN         (11)
+#define BATTERY_CHARGE_OFFSET_MV    ((V_C_MAX - V_MAX) * BATTERY_DIVIDER_NUM / BATTERY_DIVIDER_DEN)
+#define BATTERY_INTERNAL_R_MOHM     (150)
+#define BATTERY_LOAD_MA             (250)   // Board and panel, without the backlight
+#define BATTERY_BACKLIGHT_MA        (300)   // Backlight at 100 %
+
+#define EXAMPLE_BRIGHTNESS_ACTIVE   (100)
+#define EXAMPLE_BRIGHTNESS_DIM      (10)
+#define EXAMPLE_DIM_TIMEOUT_MS      (30 * 1000)     // Without touch, the backlight dims
+#define EXAMPLE_OFF_TIMEOUT_MS      (120 * 1000)    // Without touch, the backlight goes off
+#define EXAMPLE_IDLE_REFR_PERIOD_MS (200)           // LVGL refresh period while dimmed, for the battery labels
+
+static battery_soc_handle_t battery_soc = NULL;
 
 static lv_obj_t *obj = NULL;
 static lv_obj_t *label = NULL;
@@ -75,119 +81,34 @@ static lv_obj_t *label2 = NULL;
 static lv_obj_t *label3 = NULL;
 static lv_obj_t *label4 = NULL;
 
-i2c_master_bus_handle_t i2c_handle = NULL; 
-
-static void battery_test(void *arg)
-{
-    adc_oneshot_chan_cfg_t config = {
-        .atten = EXAMPLE_ADC_ATTEN,
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
-    };
-    //-------------ADC2 Init---------------//
-    adc_oneshot_unit_handle_t adc2_handle;
-    adc_oneshot_unit_init_cfg_t init_config2 = {
-        .unit_id = ADC_UNIT_2,
-        .ulp_mode = ADC_ULP_MODE_DISABLE,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config2, &adc2_handle));
-
-    //-------------ADC2 Calibration Init---------------//
-    adc_cali_handle_t adc2_cali_handle = NULL;
-    bool do_calibration2 = example_adc_calibration_init(ADC_UNIT_2, EXAMPLE_ADC2_CHAN0, EXAMPLE_ADC_ATTEN, &adc2_cali_handle);
-
-    //-------------ADC2 Config---------------//
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc2_handle, EXAMPLE_ADC2_CHAN0, &config));
+static bound_label_handle_t raw_data_value = NULL;
+static bound_label_handle_t voltage_value = NULL;
+static bound_label_handle_t charge_value = NULL;
+static bound_label_handle_t charging_value = NULL;
 
-    while (1) {
-        for(int i=0;i<500;i++)
-        {
-            ESP_ERROR_CHECK(adc_oneshot_read(adc2_handle, EXAMPLE_ADC2_CHAN0,&adc_raw));
-            adc_raw_ += adc_raw;
-        }
-        adc_raw_tep = adc_raw_;
-        adc_raw_ = adc_raw_ / 500;
+static const char *const charging_texts[] = {
+    "Charging status : Discharging",
+    "Charging status : Charging",
+};
 
-        if((adc_raw_tep - adc_raw_ > 50) && !charging_)
-        {
-            charging_ = true;
-        }
-
-        if(!charging_)
-        {
-            if(adc_raw_ - adc_raw_tep > 0)
-                cnt++;
-            else
-                cnt = 0;
-
-            if(cnt > 3)
-                charging_ = true;
-        }
-        
-        ESP_LOGI(TAG, "ADC%d Channel[%d] Raw Data: %d", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, adc_raw_);
-
-        if (do_calibration2) {
-            ESP_ERROR_CHECK(adc_cali_raw_to_voltage(adc2_cali_handle, adc_raw_, &voltage));
-            ESP_LOGI(TAG, "ADC%d Channel[%d] Cali Voltage: %d mV", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, voltage);
-        }
-
-        if(voltage > 2300 && !charging_)
-        {
-            charging_ = true;
-        }
-
-        if(charging_)
-        {
-            voltage_ = voltage - V_C_MIN;
-            if(voltage_ < 0)
-                voltage_ = 0;
-            voltage_per_ = voltage_per;
-            voltage_per = voltage_ * 10000 / (V_C_MAX - V_C_MIN) / 100 ;
-            voltage_per = (voltage_per_ + voltage_per) / 2;
-            if(voltage_per > 100)
-                voltage_per = 100;
-        }
-        else
-        {
-            voltage_ = voltage - V_MIN;
-            if(voltage_ < 0)
-                voltage_ = 0;
-            voltage_per_ = voltage_per;
-            voltage_per = voltage_ * 10000 / (V_MAX - V_MIN) / 100 ;
-            voltage_per = (voltage_per_ + voltage_per) / 2;
-            if(voltage_per > 100)
-                voltage_per = 100;
-            if(voltage_per <= 0 )
-                voltage_per = 1;
-        }
-       
-
-        
-            
-        ESP_LOGI(TAG,"Battery charge: %d %%",voltage_per);
-
-        lvgl_port_lock(-1);
-
-        if(charging_)
-            lv_label_set_text(label4,"Charging status : Charging");
-        else
-            lv_label_set_text(label4,"Charging status : Discharging");
-
-        lv_label_set_text_fmt(label,"ADC%d Channel[%d] Raw Data: %d", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, adc_raw_);
-        lv_label_set_text_fmt(label2,"ADC%d Channel[%d] Cali Voltage: %d mV", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, voltage);
-        lv_label_set_text_fmt(label3,"Battery charge: %d %%",voltage_per);
-        lvgl_port_unlock();
+i2c_master_bus_handle_t i2c_handle = NULL; 
 
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
+static void battery_reading_cb(battery_monitor_handle_t monitor, const battery_monitor_reading_t *reading, void *user_ctx)
+{
+    ESP_LOGI(TAG, "ADC%d Channel[%d] Raw Data: %d", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, reading->raw);
+    ESP_LOGI(TAG, "ADC%d Channel[%d] Cali Voltage: %d mV", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, reading->voltage_mv);
 
+    // Lock-free, the LVGL task updates only the labels whose value changed
+    bound_label_publish(raw_data_value, reading->raw);
+    bound_label_publish(voltage_value, reading->voltage_mv);
 
-    //Tear Down
-    ESP_ERROR_CHECK(adc_oneshot_del_unit(adc2_handle));
-    if (do_calibration2) {
-        example_adc_calibration_deinit(adc2_cali_handle);
+    battery_soc_state_t soc;
+    if (!battery_soc_update(battery_soc, reading->voltage_mv, &soc)) {
+        return;
     }
-
-    vTaskDelete(NULL);
+    ESP_LOGI(TAG,"Battery charge: %d %% (%d mV open circuit)%s",soc.percent,soc.ocv_mv,soc.charging ? ", charging" : "");
+    bound_label_publish(charging_value, soc.charging);
+    bound_label_publish(charge_value, soc.percent);
 }
 
 static esp_err_t bsp_display_brightness_set(int brightness_percent)
@@ -199,6 +120,9 @@ static esp_err_t bsp_display_brightness_set(int brightness_percent)
         brightness_percent = 0;
     }
 
+    // The backlight is most of the load on the battery
+    battery_soc_set_load(battery_soc, BATTERY_LOAD_MA + BATTERY_BACKLIGHT_MA * brightness_percent / 100);
+
     uint8_t data = (uint8_t)(255 * brightness_percent * 0.01);
     uint8_t chip_addr = 0x45;
 
@@ -231,6 +155,12 @@ static esp_err_t bsp_display_brightness_set(int brightness_percent)
 
 void app_main(void)
 {
+    battery_soc_config_t soc_cfg = BATTERY_SOC_DEFAULT_CONFIG();
+    soc_cfg.divider_num = BATTERY_DIVIDER_NUM;
+    soc_cfg.divider_den = BATTERY_DIVIDER_DEN;
+    soc_cfg.internal_resistance_mohm = BATTERY_INTERNAL_R_MOHM;
+    soc_cfg.charge_offset_mv = BATTERY_CHARGE_OFFSET_MV;
+    ESP_ERROR_CHECK(battery_soc_new(&soc_cfg, &battery_soc));
 
     i2c_master_bus_config_t i2c_bus_conf = {
         .clk_source = I2C_CLK_SRC_DEFAULT,
@@ -351,96 +281,71 @@ void app_main(void)
 
     lvgl_port_add_touch(&touch_cfg);
 
-    bsp_display_brightness_set(100);
-
     lvgl_port_lock(0);
+
+    // The MIPI-DSI video stream keeps its pixel clock, only the backlight and the rendering slow down
+    const display_governor_config_t governor_cfg = {
+        .disp = disp,
+        .set_brightness = bsp_display_brightness_set,
+        .active_brightness = EXAMPLE_BRIGHTNESS_ACTIVE,
+        .dim_brightness = EXAMPLE_BRIGHTNESS_DIM,
+        .dim_timeout_ms = EXAMPLE_DIM_TIMEOUT_MS,
+        .off_timeout_ms = EXAMPLE_OFF_TIMEOUT_MS,
+        .idle_refr_period_ms = EXAMPLE_IDLE_REFR_PERIOD_MS,
+    };
+    ESP_ERROR_CHECK(display_governor_init(&governor_cfg));
+
     // lv_demo_music();
     // lv_demo_benchmark();
     // lv_demo_widgets();
     obj = lv_obj_create(lv_scr_act());
     lv_obj_set_size(obj,800,1280);
 
+    ESP_ERROR_CHECK(bound_label_init());
+
+    // The ADC unit and channel are fixed, so they are part of the format
+    static char raw_data_fmt[48];
+    static char voltage_fmt[48];
+    snprintf(raw_data_fmt, sizeof(raw_data_fmt), "ADC%d Channel[%d] Raw Data: %%d", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0);
+    snprintf(voltage_fmt, sizeof(voltage_fmt), "ADC%d Channel[%d] Cali Voltage: %%d mV", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0);
+
     label = lv_label_create(obj);
     lv_obj_center(label);
-    lv_label_set_text_fmt(label,"ADC%d Channel[%d] Raw Data: %d", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, adc_raw_);
+    const bound_label_config_t raw_data_cfg = {
+        .fmt = raw_data_fmt,
+    };
+    ESP_ERROR_CHECK(bound_label_create(label, &raw_data_cfg, 0, &raw_data_value));
 
     label2 = lv_label_create(obj);
     lv_obj_align_to(label2,label,LV_ALIGN_OUT_BOTTOM_LEFT,0,5);
-    lv_label_set_text_fmt(label2,"ADC%d Channel[%d] Cali Voltage: %d mV", ADC_UNIT_2 + 1, EXAMPLE_ADC2_CHAN0, voltage);
+    const bound_label_config_t voltage_cfg = {
+        .fmt = voltage_fmt,
+    };
+    ESP_ERROR_CHECK(bound_label_create(label2, &voltage_cfg, 0, &voltage_value));
 
     label3 = lv_label_create(obj);
     lv_obj_align_to(label3,label2,LV_ALIGN_OUT_BOTTOM_LEFT,0,5);
-    lv_label_set_text_fmt(label3,"Battery charge: %d %%",voltage_per);
+    const bound_label_config_t charge_cfg = {
+        .fmt = "Battery charge: %d %%",
+    };
+    ESP_ERROR_CHECK(bound_label_create(label3, &charge_cfg, 0, &charge_value));
 
     label4 = lv_label_create(obj);
     lv_obj_align_to(label4,label,LV_ALIGN_OUT_TOP_LEFT,0,-5);
-    if(charging_)
-        lv_label_set_text(label4,"Charging status : Charging");
-    else
-        lv_label_set_text(label4,"Charging status : Discharging");
+    const bound_label_config_t charging_cfg = {
+        .texts = charging_texts,
+        .text_num = sizeof(charging_texts) / sizeof(charging_texts[0]),
+    };
+    ESP_ERROR_CHECK(bound_label_create(label4, &charging_cfg, 0, &charging_value));
 
     lvgl_port_unlock();
 
-    xTaskCreatePinnedToCore(battery_test,"battery",4096,NULL,4,NULL,1);
-}
-
-static bool example_adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle)
-{
-    adc_cali_handle_t handle = NULL;
-    esp_err_t ret = ESP_FAIL;
-    bool calibrated = false;
-
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(TAG, "calibration scheme version is %s", "Curve Fitting");
-        adc_cali_curve_fitting_config_t cali_config = {
-            .unit_id = unit,
-            .chan = channel,
-            .atten = atten,
-            .bitwidth = ADC_BITWIDTH_DEFAULT,
-        };
-        ret = adc_cali_create_scheme_curve_fitting(&cali_config, &handle);
-        if (ret == ESP_OK) {
-            calibrated = true;
-        }
-    }
-#endif
-
-#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(TAG, "calibration scheme version is %s", "Line Fitting");
-        adc_cali_line_fitting_config_t cali_config = {
-            .unit_id = unit,
-            .atten = atten,
-            .bitwidth = ADC_BITWIDTH_DEFAULT,
-        };
-        ret = adc_cali_create_scheme_line_fitting(&cali_config, &handle);
-        if (ret == ESP_OK) {
-            calibrated = true;
-        }
-    }
-#endif
-
-    *out_handle = handle;
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Calibration Success");
-    } else if (ret == ESP_ERR_NOT_SUPPORTED || !calibrated) {
-        ESP_LOGW(TAG, "eFuse not burnt, skip software calibration");
-    } else {
-        ESP_LOGE(TAG, "Invalid arg or no memory");
-    }
-
-    return calibrated;
-}
-
-static void example_adc_calibration_deinit(adc_cali_handle_t handle)
-{
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    ESP_LOGI(TAG, "deregister %s calibration scheme", "Curve Fitting");
-    ESP_ERROR_CHECK(adc_cali_delete_scheme_curve_fitting(handle));
-
-#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    ESP_LOGI(TAG, "deregister %s calibration scheme", "Line Fitting");
-    ESP_ERROR_CHECK(adc_cali_delete_scheme_line_fitting(handle));
-#endif
+    // The DMA samples the battery in the background, the CPU only filters a frame of samples every 100 ms
+    battery_monitor_config_t battery_cfg = BATTERY_MONITOR_DEFAULT_CONFIG(ADC_UNIT_2, EXAMPLE_ADC2_CHAN0);
+    battery_cfg.atten = EXAMPLE_ADC_ATTEN;
+    battery_cfg.on_reading = battery_reading_cb;
+    battery_cfg.task_priority = 4;
+    battery_cfg.task_core = 1;
+    battery_monitor_handle_t battery_monitor = NULL;
+    ESP_ERROR_CHECK(battery_monitor_new(&battery_cfg, &battery_monitor));
 }
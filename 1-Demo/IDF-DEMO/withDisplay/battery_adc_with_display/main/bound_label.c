@@ -0,0 +1,93 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "bound_label.h"
+
+#define TAG "bound_label"
+
+struct bound_label_t {
+    lv_obj_t *label;
+    bound_label_config_t config;
+    int shown;                      // Value the label shows, only touched by the LVGL task
+    atomic_int value;               // Last published value
+    atomic_bool dirty;              // Published since the last update
+};
+
+static struct bound_label_t bound_labels[BOUND_LABEL_MAX_NUM];
+static int bound_label_num = 0;
+static atomic_bool bound_label_any_dirty = false;
+static lv_timer_t *bound_label_timer = NULL;
+
+static void bound_label_show(struct bound_label_t *bl, int value)
+{
+    if (bl->config.texts) {
+        if ((value < 0) || (value >= bl->config.text_num)) {
+            ESP_LOGW(TAG, "Value %d out of the %d texts", value, bl->config.text_num);
+            return;
+        }
+        // The texts are constant, no copy of them needed
+        lv_label_set_text_static(bl->label, bl->config.texts[value]);
+    } else {
+        lv_label_set_text_fmt(bl->label, bl->config.fmt, value);
+    }
+    bl->shown = value;
+}
+
+static void bound_label_timer_cb(lv_timer_t *timer)
+{
+    if (!atomic_exchange_explicit(&bound_label_any_dirty, false, memory_order_acquire)) {
+        return;
+    }
+
+    for (int i = 0; i < bound_label_num; i++) {
+        struct bound_label_t *bl = &bound_labels[i];
+        if (!atomic_exchange_explicit(&bl->dirty, false, memory_order_acquire)) {
+            continue;
+        }
+        // Only the latest value is formatted, and an unchanged one doesn't reformat or invalidate the label
+        const int value = atomic_load_explicit(&bl->value, memory_order_relaxed);
+        if (value != bl->shown) {
+            bound_label_show(bl, value);
+        }
+    }
+}
+
+esp_err_t bound_label_init(void)
+{
+    ESP_RETURN_ON_FALSE(bound_label_timer == NULL, ESP_ERR_INVALID_STATE, TAG, "Already initialized");
+
+    bound_label_timer = lv_timer_create(bound_label_timer_cb, LV_DISP_DEF_REFR_PERIOD, NULL);
+    ESP_RETURN_ON_FALSE(bound_label_timer, ESP_ERR_NO_MEM, TAG, "No memory for the timer");
+
+    return ESP_OK;
+}
+
+esp_err_t bound_label_create(lv_obj_t *label, const bound_label_config_t *config, int value,
+                             bound_label_handle_t *ret_handle)
+{
+    ESP_RETURN_ON_FALSE(label && config && ret_handle, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE((config->fmt != NULL) != (config->texts != NULL), ESP_ERR_INVALID_ARG, TAG,
+                        "Set either fmt or texts");
+    ESP_RETURN_ON_FALSE(bound_label_num < BOUND_LABEL_MAX_NUM, ESP_ERR_NO_MEM, TAG, "Too many bound labels");
+
+    struct bound_label_t *bl = &bound_labels[bound_label_num];
+    bl->label = label;
+    bl->config = *config;
+    atomic_init(&bl->value, value);
+    atomic_init(&bl->dirty, false);
+    bound_label_show(bl, value);
+    bound_label_num++;
+
+    *ret_handle = bl;
+
+    return ESP_OK;
+}
+
+void bound_label_publish(bound_label_handle_t handle, int value)
+{
+    atomic_store_explicit(&handle->value, value, memory_order_relaxed);
+    atomic_store_explicit(&handle->dirty, true, memory_order_release);
+    atomic_store_explicit(&bound_label_any_dirty, true, memory_order_release);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOUND_LABEL_MAX_NUM     (16)            // Labels that can be bound
+
+typedef struct bound_label_t *bound_label_handle_t;
+
+/**
+ * @brief Text of a bound label
+ *
+ * Set one of the two:
+ *  - `fmt`:   printf format with a single `%d` for the value
+ *  - `texts`: texts indexed by the value, for states such as "Charging" or "Discharging"
+ *
+ */
+typedef struct {
+    const char *fmt;
+    const char *const *texts;
+    int text_num;
+} bound_label_config_t;
+
+/**
+ * @brief Start applying the published values, once per display refresh period
+ *
+ * @note Call it with the LVGL lock held, e.g. between `lvgl_port_lock()` and `lvgl_port_unlock()`
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_STATE: Already initialized
+ *      - ESP_ERR_NO_MEM: No memory for the LVGL timer
+ */
+esp_err_t bound_label_init(void);
+
+/**
+ * @brief Bind a label to a value and show the initial value
+ *
+ * @note Call it with the LVGL lock held
+ *
+ * @param[in] label: The label
+ * @param[in] config: The text of the label, the strings must stay valid
+ * @param[in] value: The initial value
+ * @param[out] ret_handle: The bound label
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: `BOUND_LABEL_MAX_NUM` labels are already bound
+ */
+esp_err_t bound_label_create(lv_obj_t *label, const bound_label_config_t *config, int value,
+                             bound_label_handle_t *ret_handle);
+
+/**
+ * @brief Publish a new value of a bound label
+ *
+ * Lock-free, any task can call it without the LVGL lock. The LVGL task formats the label at the next refresh
+ * period, and only if the value differs from the one shown. Values published in between are dropped.
+ *
+ * @param[in] handle: The bound label
+ * @param[in] value: The new value
+ */
+void bound_label_publish(bound_label_handle_t handle, int value);
+
+#ifdef __cplusplus
+}
+#endif
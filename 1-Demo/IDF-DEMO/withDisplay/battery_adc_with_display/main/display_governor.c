@@ -0,0 +1,96 @@
+#include <stdbool.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "display_governor.h"
+
+#define TAG "display_governor"
+
+// Period of the inactivity check, the latency of restoring the backlight on a touch
+#define DISPLAY_GOVERNOR_CHECK_PERIOD_MS    (50)
+
+typedef enum {
+    DISPLAY_GOVERNOR_ACTIVE,
+    DISPLAY_GOVERNOR_DIM,
+    DISPLAY_GOVERNOR_OFF,
+} display_governor_state_t;
+
+static display_governor_config_t governor_config;
+static display_governor_state_t governor_state = DISPLAY_GOVERNOR_ACTIVE;
+static uint32_t governor_active_refr_period = 0;
+static lv_timer_t *governor_timer = NULL;
+
+static void display_governor_enter(display_governor_state_t state)
+{
+    if (state == governor_state) {
+        return;
+    }
+
+    int brightness = governor_config.active_brightness;
+    if (state == DISPLAY_GOVERNOR_DIM) {
+        brightness = governor_config.dim_brightness;
+    } else if (state == DISPLAY_GOVERNOR_OFF) {
+        brightness = 0;
+    }
+    // A failed write is retried on the next check, the state only changes once it is applied
+    if (governor_config.set_brightness(brightness) != ESP_OK) {
+        ESP_LOGW(TAG, "Set brightness %d%% failed", brightness);
+        return;
+    }
+
+    // Only the refresh timer slows down, the input read keeps its period so a touch is still seen at once
+    lv_timer_t *refr_timer = _lv_disp_get_refr_timer(governor_config.disp);
+    if (refr_timer && governor_config.idle_refr_period_ms) {
+        lv_timer_set_period(refr_timer, (state == DISPLAY_GOVERNOR_ACTIVE) ?
+                            governor_active_refr_period : governor_config.idle_refr_period_ms);
+    }
+
+    ESP_LOGD(TAG, "State %d, brightness %d%%", state, brightness);
+    governor_state = state;
+}
+
+static void display_governor_timer_cb(lv_timer_t *timer)
+{
+    const uint32_t inactive_ms = lv_disp_get_inactive_time(governor_config.disp);
+
+    display_governor_state_t state = DISPLAY_GOVERNOR_ACTIVE;
+    if (governor_config.off_timeout_ms && (inactive_ms >= governor_config.off_timeout_ms)) {
+        state = DISPLAY_GOVERNOR_OFF;
+    } else if (governor_config.dim_timeout_ms && (inactive_ms >= governor_config.dim_timeout_ms)) {
+        state = DISPLAY_GOVERNOR_DIM;
+    }
+    display_governor_enter(state);
+}
+
+esp_err_t display_governor_init(const display_governor_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->set_brightness, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE(governor_timer == NULL, ESP_ERR_INVALID_STATE, TAG, "Already initialized");
+
+    governor_config = *config;
+    if (governor_config.disp == NULL) {
+        governor_config.disp = lv_disp_get_default();
+    }
+    ESP_RETURN_ON_FALSE(governor_config.disp, ESP_ERR_INVALID_ARG, TAG, "No display");
+
+    lv_timer_t *refr_timer = _lv_disp_get_refr_timer(governor_config.disp);
+    governor_active_refr_period = refr_timer ? refr_timer->period : LV_DISP_DEF_REFR_PERIOD;
+
+    ESP_RETURN_ON_ERROR(governor_config.set_brightness(governor_config.active_brightness), TAG,
+                        "Set brightness failed");
+    governor_state = DISPLAY_GOVERNOR_ACTIVE;
+
+    governor_timer = lv_timer_create(display_governor_timer_cb, DISPLAY_GOVERNOR_CHECK_PERIOD_MS, NULL);
+    ESP_RETURN_ON_FALSE(governor_timer, ESP_ERR_NO_MEM, TAG, "No memory for the timer");
+
+    return ESP_OK;
+}
+
+void display_governor_wake(void)
+{
+    if (governor_timer == NULL) {
+        return;
+    }
+    lv_disp_trig_activity(governor_config.disp);
+    display_governor_enter(DISPLAY_GOVERNOR_ACTIVE);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set the backlight, in percent
+ */
+typedef esp_err_t (*display_governor_brightness_cb_t)(int brightness_percent);
+
+/**
+ * @brief Configuration of the display governor
+ *
+ * The timeouts count from the last input, e.g. the last touch. A timeout of 0 disables its stage.
+ *
+ */
+typedef struct {
+    lv_disp_t *disp;                                // The display, NULL for the default one
+    display_governor_brightness_cb_t set_brightness;
+    int active_brightness;                          // Brightness on input, in percent
+    int dim_brightness;                             // Brightness after `dim_timeout_ms`, in percent
+    uint32_t dim_timeout_ms;
+    uint32_t off_timeout_ms;                        // Backlight off after this, from the last input too
+    uint32_t idle_refr_period_ms;                   // LVGL refresh period while dimmed or off, 0 keeps it
+} display_governor_config_t;
+
+/**
+ * @brief Dim the backlight and slow down the LVGL refresh while there is no input, and restore both on input
+ *
+ * The governor sets the active brightness first. An LVGL timer then follows the inactive time of the display.
+ *
+ * @note Call it with the LVGL lock held, after the input devices are added
+ *
+ * @param[in] config: The governor configuration, copied
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: Already initialized
+ *      - ESP_ERR_NO_MEM: No memory for the LVGL timer
+ *      - Others: The active brightness couldn't be set
+ */
+esp_err_t display_governor_init(const display_governor_config_t *config);
+
+/**
+ * @brief Restore the active brightness and refresh period as an input would, e.g. on an alarm
+ *
+ * @note Call it with the LVGL lock held
+ */
+void display_governor_wake(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -8,10 +8,13 @@
 
 #include <sys/cdefs.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "esp_codec_dev.h"
 #include "esp_err.h"
 #include "driver/gpio.h"
 #include "driver/i2s_std.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "audio_player.h"
 #include "file_iterator.h"
 
@@ -29,6 +32,66 @@ extern "C" {
 #define BSP_LCD_BACKLIGHT_BRIGHTNESS_MIN    (0)
 #define LCD_LEDC_CH                         (CONFIG_BSP_DISPLAY_BRIGHTNESS_LEDC_CH)
 
+#define BSP_EXTRA_STREAM_BLOCK_NUM          (2)
+
+/**
+ * @brief Configuration of an SD card stream
+ */
+typedef struct {
+    size_t block_size;                  /*!< Bytes per card read, a multiple of the FAT cluster size */
+    uint32_t task_stack;                /*!< Stack size of the reader task, in bytes */
+    UBaseType_t task_priority;          /*!< Priority of the reader task, above the decoder so it never waits */
+    BaseType_t task_core;               /*!< Core of the reader task, tskNO_AFFINITY for any */
+} bsp_extra_stream_config_t;
+
+#define BSP_EXTRA_STREAM_DEFAULT_CONFIG()           \
+    {                                               \
+        .block_size = 32 * 1024,                    \
+        .task_stack = 3072,                         \
+        .task_priority = 6,                         \
+        .task_core = tskNO_AFFINITY,                \
+    }
+
+/**
+ * @brief Configuration of the audio mixer
+ */
+typedef struct {
+    uint32_t sample_rate;               /*!< Codec rate, every stream is resampled to it */
+    size_t frames;                      /*!< Frames per block written to the codec, 0 for the I2S DMA frame size */
+    uint32_t task_stack;                /*!< Stack size of the mixer task, in bytes */
+    UBaseType_t task_priority;          /*!< Priority of the mixer task, above the sources */
+    BaseType_t task_core;               /*!< Core of the mixer task, tskNO_AFFINITY for any */
+} bsp_extra_mixer_config_t;
+
+#define BSP_EXTRA_MIXER_DEFAULT_CONFIG()            \
+    {                                               \
+        .sample_rate = 44100,                       \
+        .frames = 0,                                \
+        .task_stack = 4096,                         \
+        .task_priority = 7,                         \
+        .task_core = tskNO_AFFINITY,                \
+    }
+
+/**
+ * @brief Configuration of a mixer stream
+ */
+typedef struct {
+    uint32_t sample_rate;               /*!< Rate of the samples written, 8 kHz to 96 kHz */
+    uint8_t channels;                   /*!< 1 or 2, samples are 16 bit and interleaved by channel */
+    size_t buffer_size;                 /*!< Bytes buffered between the source and the mixer */
+    int volume;                         /*!< 0 to 100 */
+} bsp_extra_mixer_stream_config_t;
+
+#define BSP_EXTRA_MIXER_STREAM_DEFAULT_CONFIG()     \
+    {                                               \
+        .sample_rate = CODEC_DEFAULT_SAMPLE_RATE,   \
+        .channels = CODEC_DEFAULT_CHANNEL,          \
+        .buffer_size = 8 * 1024,                    \
+        .volume = 100,                              \
+    }
+
+typedef struct bsp_extra_mixer_stream_s *bsp_extra_mixer_stream_handle_t;
+
 /**************************************************************************************************
  * BSP Extra interface
  * Mainly provided some I2S Codec interfaces.
@@ -85,6 +148,10 @@ esp_err_t bsp_extra_codec_dev_resume(void);
 /**
  * @brief Set I2S format to codec.
  *
+ * An unchanged format returns at once. A change of the sample rate alone only reconfigures the I2S clock and keeps
+ * the codec devices open, so there is no gap between tracks. A change of the channels reopens only the playback
+ * device, the record device follows a change of the rate or of the bit width.
+ *
  * @param rate: Sample rate of sample
  * @param bits_cfg: Bit lengths of one channel data
  * @param ch: Channels of sample
@@ -101,10 +168,12 @@ esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode
  * @param audio_buffer: The pointer of receiving data buffer
  * @param len: Max data buffer length
  * @param bytes_read: Byte number that actually be read, can be NULL if not needed
- * @param timeout_ms: Max block time
+ * @param timeout_ms: Max block time, 0 to only take the data already received
  *
  * @return
- *    - ESP_OK: Success
+ *    - ESP_OK: Success, `len` bytes were read
+ *    - ESP_ERR_TIMEOUT: Timed out, `bytes_read` holds the bytes read until then
+ *    - ESP_ERR_INVALID_STATE: The codec is not initialized
  *    - Others: Fail
  */
 esp_err_t bsp_extra_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read, uint32_t timeout_ms);
@@ -115,10 +184,12 @@ esp_err_t bsp_extra_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read,
  * @param audio_buffer: The pointer of sent data buffer
  * @param len: Max data buffer length
  * @param bytes_written: Byte number that actually be sent, can be NULL if not needed
- * @param timeout_ms: Max block time
+ * @param timeout_ms: Max block time, 0 to only fill the free DMA buffers
  *
  * @return
- *    - ESP_OK: Success
+ *    - ESP_OK: Success, `len` bytes were written
+ *    - ESP_ERR_TIMEOUT: Timed out, `bytes_written` holds the bytes written until then
+ *    - ESP_ERR_INVALID_STATE: The codec is not initialized
  *    - Others: Fail
  */
 esp_err_t bsp_extra_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
@@ -136,7 +207,8 @@ esp_err_t bsp_extra_codec_init();
 /**
  * @brief Initialize audio player task.
  *
- * @param path file path
+ * With the mixer running, the player plays into a mixer stream of its own. Its format changes apply to that stream,
+ * and pausing mutes only it.
  *
  * @return
  *      - ESP_OK: Success
@@ -153,6 +225,110 @@ esp_err_t bsp_extra_player_init(void);
  */
 esp_err_t bsp_extra_player_del(void);
 
+/**
+ * @brief Start the audio mixer
+ *
+ * A dedicated task mixes all streams into one block of `frames` frames at a time and writes it with
+ * bsp_extra_i2s_write(), in the mixer format (`sample_rate`, 16 bit, CODEC_DEFAULT_CHANNEL). Each stream is resampled
+ * with a polyphase filter, scaled by its volume and added in Q15, the sum is saturated. A stream without data for a
+ * block is skipped, silence is written while no stream plays. A player initialized afterwards plays into a stream of
+ * its own.
+ *
+ * @note Call bsp_extra_codec_init() first. Don't use bsp_extra_i2s_write() or bsp_extra_codec_set_fs() while the
+ *       mixer runs.
+ *
+ * @param config: Mixer configuration
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: No configuration, or the rate is out of range
+ *    - ESP_ERR_INVALID_STATE: The codec isn't initialized, or the mixer already runs
+ *    - ESP_ERR_NO_MEM: No memory for the task
+ *    - Others: The codec format can't be set
+ */
+esp_err_t bsp_extra_mixer_start(const bsp_extra_mixer_config_t *config);
+
+/**
+ * @brief Stop the audio mixer, waits for the block in progress
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_STATE: The mixer doesn't run, or streams are left
+ */
+esp_err_t bsp_extra_mixer_stop(void);
+
+/**
+ * @brief Add a stream to the audio mixer
+ *
+ * @param config: Stream configuration
+ * @param ret_stream: The new stream
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument or format
+ *    - ESP_ERR_INVALID_STATE: The mixer doesn't run
+ *    - ESP_ERR_NO_MEM: No memory for the stream
+ */
+esp_err_t bsp_extra_mixer_stream_new(const bsp_extra_mixer_stream_config_t *config,
+                                     bsp_extra_mixer_stream_handle_t *ret_stream);
+
+/**
+ * @brief Remove a stream from the audio mixer, the data not mixed yet is dropped
+ *
+ * @param stream: The stream
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: No stream
+ */
+esp_err_t bsp_extra_mixer_stream_del(bsp_extra_mixer_stream_handle_t stream);
+
+/**
+ * @brief Change the format of the samples written to a stream
+ *
+ * Waits until the data written in the old format is mixed.
+ *
+ * @param stream: The stream
+ * @param sample_rate: Sample rate, 8 kHz to 96 kHz
+ * @param channels: 1 or 2
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument or format
+ *    - ESP_ERR_NO_MEM: No memory for the resampler
+ */
+esp_err_t bsp_extra_mixer_stream_set_format(bsp_extra_mixer_stream_handle_t stream, uint32_t sample_rate,
+                                            uint8_t channels);
+
+/**
+ * @brief Set the volume of a stream
+ *
+ * @param stream: The stream
+ * @param volume: 0 to 100
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: No stream
+ */
+esp_err_t bsp_extra_mixer_stream_set_volume(bsp_extra_mixer_stream_handle_t stream, int volume);
+
+/**
+ * @brief Write samples to a stream
+ *
+ * @param stream: The stream
+ * @param data: Samples in the stream format
+ * @param len: Bytes to write
+ * @param bytes_written: Bytes actually written, can be NULL if not needed
+ * @param timeout_ms: Max block time while the stream buffer is full
+ *
+ * @return
+ *    - ESP_OK: Success, `len` bytes were written
+ *    - ESP_ERR_TIMEOUT: Timed out, `bytes_written` holds the bytes written until then
+ *    - ESP_ERR_INVALID_ARG: Invalid argument
+ */
+esp_err_t bsp_extra_mixer_stream_write(bsp_extra_mixer_stream_handle_t stream, const void *data, size_t len,
+                                       size_t *bytes_written, uint32_t timeout_ms);
+
 /**
  * @brief Initialize a file iterator instance
  *
@@ -164,9 +340,32 @@ esp_err_t bsp_extra_player_del(void);
  */
 esp_err_t bsp_extra_file_instance_init(const char *path, file_iterator_instance_t **ret_instance);
 
+/**
+ * @brief Open a file on the SD card for streaming
+ *
+ * A reader task fills `BSP_EXTRA_STREAM_BLOCK_NUM` blocks of `block_size` bytes ahead of the read position, at
+ * offsets that are multiples of `block_size`. Every card access is then one large cluster-aligned multi-block
+ * transfer, and `fread()` only copies from a block already read unless the decoder outruns the card. Seeks within
+ * the current block are free, others restart the read-ahead. The FILE is read only and unbuffered, `fclose()`
+ * stops the reader task and frees the blocks.
+ *
+ * @param path: Path of the file, e.g. under BSP_SD_MOUNT_POINT
+ * @param config: Configuration, NULL for BSP_EXTRA_STREAM_DEFAULT_CONFIG()
+ * @param ret_fp: The opened FILE
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid argument or block size
+ *    - ESP_ERR_NOT_FOUND: The file can't be opened
+ *    - ESP_ERR_NO_MEM: No memory for the blocks (2 x block_size of internal DMA memory) or the task
+ */
+esp_err_t bsp_extra_stream_fopen(const char *path, const bsp_extra_stream_config_t *config, FILE **ret_fp);
+
 /**
  * @brief Play the audio file at the specified index in the file iterator
  *
+ * The file is read through bsp_extra_stream_fopen() with the default configuration.
+ *
  * @param instance The file iterator instance.
  * @param index The index of the file to play within the iterator.
  * @return
@@ -178,6 +377,8 @@ esp_err_t bsp_extra_player_play_index(file_iterator_instance_t *instance, int in
 /**
  * @brief Play the audio file specified by the file path
  *
+ * The file is read through bsp_extra_stream_fopen() with the default configuration.
+ *
  * @param file_path The path to the audio file to be played.
  * @return
  *     - ESP_OK: Successfully started playing the audio file.
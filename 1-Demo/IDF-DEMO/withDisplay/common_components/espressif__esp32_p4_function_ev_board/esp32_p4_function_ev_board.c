@@ -219,6 +219,21 @@ esp_err_t bsp_audio_init(const i2s_std_config_t *i2s_config)
     return ESP_OK;
 }
 
+esp_err_t bsp_audio_get_i2s_channels(i2s_chan_handle_t *tx_chan, i2s_chan_handle_t *rx_chan)
+{
+    if (!i2s_tx_chan || !i2s_rx_chan) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (tx_chan) {
+        *tx_chan = i2s_tx_chan;
+    }
+    if (rx_chan) {
+        *rx_chan = i2s_rx_chan;
+    }
+    return ESP_OK;
+}
+
 esp_codec_dev_handle_t bsp_audio_codec_speaker_init(void)
 {
     if (i2s_data_if == NULL) {
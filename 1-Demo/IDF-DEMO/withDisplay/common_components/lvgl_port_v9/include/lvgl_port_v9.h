@@ -0,0 +1,448 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+#include "esp_lcd_touch.h"
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief LVGL port interface type
+ *
+ */
+typedef enum {
+    LVGL_V9_PORT_INTERFACE_RGB,
+    LVGL_V9_PORT_INTERFACE_MIPI_DSI_DMA,
+    LVGL_V9_PORT_INTERFACE_MIPI_DSI_NO_DMA,
+    LVGL_V9_PORT_INTERFACE_MAX,
+} lvgl_v9_port_interface_t;
+
+/**
+ * LVGL related parameters, can be adjusted by users
+ *
+ */
+#define LVGL_V9_PORT_H_RES             (800)
+#define LVGL_V9_PORT_V_RES             (1280)
+#define LVGL_V9_PORT_TICK_PERIOD_MS    (CONFIG_EXAMPLE_LVGL_PORT_TICK)
+
+/**
+ * LVGL timer handle task related parameters, can be adjusted by users
+ *
+ */
+#define LVGL_V9_PORT_TASK_MAX_DELAY_MS (CONFIG_EXAMPLE_LVGL_PORT_TASK_MAX_DELAY_MS)    // The maximum delay of the LVGL timer task, in milliseconds
+#define LVGL_V9_PORT_TASK_MIN_DELAY_MS (CONFIG_EXAMPLE_LVGL_PORT_TASK_MIN_DELAY_MS)    // The minimum delay of the LVGL timer task, in milliseconds
+#define LVGL_V9_PORT_TASK_STACK_SIZE   (CONFIG_EXAMPLE_LVGL_PORT_TASK_STACK_SIZE_KB * 1024) // The stack size of the LVGL timer task, in bytes
+#define LVGL_V9_PORT_TASK_PRIORITY     (CONFIG_EXAMPLE_LVGL_PORT_TASK_PRIORITY)        // The priority of the LVGL timer task
+#define LVGL_V9_PORT_TASK_CORE         (CONFIG_EXAMPLE_LVGL_PORT_TASK_CORE)            // The core of the LVGL timer task,
+// `-1` means the don't specify the core
+
+/**
+ * Port profiling overlay, shows the average render, rotate/copy and vsync wait time and dirty pixels per frame
+ *
+ */
+#define LVGL_V9_PORT_PROFILE_OVERLAY   (CONFIG_EXAMPLE_LVGL_PORT_PROFILE_OVERLAY)
+#define LVGL_V9_PORT_PROFILE_PERIOD_MS (CONFIG_EXAMPLE_LVGL_PORT_PROFILE_PERIOD_MS)    // The period the averages are taken over
+
+/**
+ * Image cache preset, can be adjusted by users:
+ *  - Decoded images are allocated in PSRAM
+ *  - The image cache is resized at start-up to a share of the PSRAM left after the display buffers, replacing
+ *    `LV_CACHE_DEF_SIZE` and `LV_IMAGE_HEADER_CACHE_DEF_CNT`
+ *
+ */
+#define LVGL_V9_PORT_IMAGE_CACHE_ENABLE        (CONFIG_EXAMPLE_LVGL_PORT_IMAGE_CACHE)
+#if LVGL_V9_PORT_IMAGE_CACHE_ENABLE
+#define LVGL_V9_PORT_IMAGE_CACHE_PSRAM_PERCENT (CONFIG_EXAMPLE_LVGL_PORT_IMAGE_CACHE_PSRAM_PERCENT)  // Share of the free PSRAM
+#define LVGL_V9_PORT_IMAGE_CACHE_MAX_KB        (CONFIG_EXAMPLE_LVGL_PORT_IMAGE_CACHE_MAX_KB)         // Upper limit of the budget
+#define LVGL_V9_PORT_IMAGE_HEADER_CACHE_CNT    (CONFIG_EXAMPLE_LVGL_PORT_IMAGE_HEADER_CACHE_CNT)     // Image headers cached
+#endif
+
+/**
+ * Set the JPEG decoder:
+ *      - 0: The software decoders selected in the LVGL menu
+ *      - 1: Baseline JPEG images, from files or `lv_image_dsc_t` with `LV_COLOR_FORMAT_RAW`, are decoded by the
+ *           hardware JPEG decoder into the display color format. Progressive images are left to the software
+ *           decoders.
+ *
+ */
+#define LVGL_V9_PORT_HW_JPEG_ENABLE            (CONFIG_EXAMPLE_LVGL_PORT_HW_JPEG)
+
+/**
+ * Set the asset partition support:
+ *      - 0: Disabled
+ *      - 1: `lvgl_v9_port_assets_mount()` maps a partition of pre-converted images and binary blobs into the data
+ *           address space, LVGL draws the images straight from flash
+ *
+ */
+#define LVGL_V9_PORT_ASSETS_ENABLE             (CONFIG_EXAMPLE_LVGL_PORT_ASSETS)
+
+/**
+ * Set the LVGL allocator:
+ *      - 0: The one selected in the LVGL menu
+ *      - 1: Implemented by the port, allocations up to `LVGL_V9_PORT_DUAL_HEAP_SMALL_SIZE` come from a TLSF pool in
+ *           internal RAM and larger ones from PSRAM. LVGL must use `LV_STDLIB_CUSTOM` for malloc.
+ *
+ */
+#define LVGL_V9_PORT_DUAL_HEAP_ENABLE          (CONFIG_EXAMPLE_LVGL_PORT_DUAL_HEAP)
+#if LVGL_V9_PORT_DUAL_HEAP_ENABLE
+#define LVGL_V9_PORT_DUAL_HEAP_INTERNAL_SIZE   (CONFIG_EXAMPLE_LVGL_PORT_DUAL_HEAP_INTERNAL_KB * 1024)  // Internal RAM pool, in bytes
+#define LVGL_V9_PORT_DUAL_HEAP_SMALL_SIZE      (CONFIG_EXAMPLE_LVGL_PORT_DUAL_HEAP_SMALL_SIZE)          // Largest allocation from the pool
+#endif
+
+/**
+ * Set the LVGL output:
+ *      - 0: Flush to the LCD panel
+ *      - 1: Render the whole display into an ARGB8888 overlay, see `lvgl_v9_port_get_overlay()`. The panel is left
+ *           to another pipeline, which composites the overlay over its own frames.
+ *
+ */
+#define LVGL_V9_PORT_OVERLAY_ENABLE    (CONFIG_EXAMPLE_LVGL_PORT_OVERLAY)
+/**
+ *
+ * LVGL buffer related parameters, can be adjusted by users:
+ *  (These parameters will be useless if the avoid tearing function is enabled)
+ *
+ *  - Memory type for buffer allocation:
+ *      - MALLOC_CAP_SPIRAM: Allocate LVGL buffer in PSRAM
+ *      - MALLOC_CAP_INTERNAL: Allocate LVGL buffer in SRAM
+ *      (The SRAM is faster than PSRAM, but the PSRAM has a larger capacity)
+ *
+ */
+#if CONFIG_EXAMPLE_LVGL_PORT_BUF_PSRAM
+#define LVGL_V9_PORT_BUFFER_MALLOC_CAPS    (MALLOC_CAP_SPIRAM)
+#elif CONFIG_EXAMPLE_LVGL_PORT_BUF_INTERNAL
+#define LVGL_V9_PORT_BUFFER_MALLOC_CAPS    (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+#define LVGL_V9_PORT_BUFFER_HEIGHT         (CONFIG_EXAMPLE_LVGL_PORT_BUF_HEIGHT)
+
+/**
+ * Avoid tering related configurations, can be adjusted by users.
+ *
+ */
+#define LVGL_V9_PORT_AVOID_TEAR_ENABLE     (CONFIG_EXAMPLE_LVGL_PORT_AVOID_TEAR_ENABLE) // Set to 1 to enable
+#if LVGL_V9_PORT_AVOID_TEAR_ENABLE
+/**
+ * Set the avoid tearing mode:
+ *      - 0: Disable avoid tearing function
+ *      - 1: LCD double-buffer & LVGL full-refresh
+ *      - 2: LCD triple-buffer & LVGL full-refresh
+ *      - 3: LCD double-buffer & LVGL direct-mode (recommended)
+ *
+ * With rotation, every mode uses three LCD buffers. In direct-mode they are all scanned out and
+ * LVGL renders into a buffer in PSRAM.
+ *
+ */
+#define LVGL_V9_PORT_AVOID_TEAR_MODE       (CONFIG_EXAMPLE_LVGL_PORT_AVOID_TEAR_MODE)
+
+/**
+ * Set the PPA rotation enable:
+ *      - 0: Disable PPA rotation
+ *      - 1: Enable PPA rotation
+ *
+ */
+#define LVGL_V9_PORT_PPA_ROTATION_ENABLE   (CONFIG_EXAMPLE_LVGL_PORT_PPA_ROTATION_ENABLE)
+
+/**
+ * Set how the LVGL buffers are synchronized, only available with the avoid tearing mode 3 and rotation 0:
+ *      - 0: LVGL copies the areas of the last frame with the CPU at the start of the next refresh
+ *      - 1: The PPA copies them in the background once the LCD has switched buffers
+ *
+ */
+#define LVGL_V9_PORT_PPA_SYNC_ENABLE       (CONFIG_EXAMPLE_LVGL_PORT_PPA_SYNC)
+
+/**
+ * Set the LVGL task scheduling:
+ *      - 0: Run `lv_timer_handler()` and sleep for the delay it returns
+ *      - 1: Render once per vsync while something is invalidated or animated, sleep until woken otherwise
+ *
+ */
+#define LVGL_V9_PORT_VSYNC_SCHEDULE        (CONFIG_EXAMPLE_LVGL_PORT_VSYNC_SCHEDULE)
+
+/**
+ * Set the scroll blits, only available with the avoid tearing mode 3:
+ *      - 0: Render a scrolled container as a whole
+ *      - 1: Enable `lvgl_v9_port_scroll_blit_enable()`, the PPA moves the content a registered container has drawn and
+ *           only the strip scrolled into view is rendered
+ *
+ */
+#define LVGL_V9_PORT_SCROLL_BLIT_ENABLE    (CONFIG_EXAMPLE_LVGL_PORT_SCROLL_BLIT)
+
+/**
+ * Set the rotation degree of the LCD panel when the avoid tearing function is enabled:
+ *      - 0: 0 degree
+ *      - 90: 90 degree
+ *      - 180: 180 degree
+ *      - 270: 270 degree
+ *
+ */
+#define EXAMPLE_LVGL_PORT_ROTATION_DEGREE  (CONFIG_EXAMPLE_LVGL_PORT_ROTATION_DEGREE)
+
+/**
+ * Below configurations are automatically set according to the above configurations, users do not need to modify them.
+ *
+ */
+#if LVGL_V9_PORT_AVOID_TEAR_MODE == 1
+#define LVGL_V9_PORT_LCD_BUFFER_NUMS   (2)
+#define LVGL_V9_PORT_FULL_REFRESH          (1)
+#elif LVGL_V9_PORT_AVOID_TEAR_MODE == 2
+#define LVGL_V9_PORT_LCD_BUFFER_NUMS   (3)
+#define LVGL_V9_PORT_FULL_REFRESH          (1)
+#elif LVGL_V9_PORT_AVOID_TEAR_MODE == 3
+#define LVGL_V9_PORT_LCD_BUFFER_NUMS   (2)
+#define LVGL_V9_PORT_DIRECT_MODE           (1)
+#endif /* LVGL_V9_PORT_AVOID_TEAR_MODE */
+
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 0
+#define EXAMPLE_LVGL_PORT_ROTATION_0    (1)
+#else
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 90
+#define EXAMPLE_LVGL_PORT_ROTATION_90   (1)
+#elif EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 180
+#define EXAMPLE_LVGL_PORT_ROTATION_180  (1)
+#elif EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 270
+#define EXAMPLE_LVGL_PORT_ROTATION_270  (1)
+#endif
+#ifdef LVGL_V9_PORT_LCD_BUFFER_NUMS
+#undef LVGL_V9_PORT_LCD_BUFFER_NUMS
+#define LVGL_V9_PORT_LCD_BUFFER_NUMS   (3)
+#endif
+#endif /* EXAMPLE_LVGL_PORT_ROTATION_DEGREE */
+#else
+#define LVGL_V9_PORT_LCD_BUFFER_NUMS   (1)
+#define LVGL_V9_PORT_FULL_REFRESH          (0)
+#define LVGL_V9_PORT_DIRECT_MODE           (0)
+#define LVGL_V9_PORT_VSYNC_SCHEDULE        (0)
+#endif /* LVGL_V9_PORT_AVOID_TEAR_ENABLE */
+
+/**
+ * @brief LVGL overlay, rendered instead of flushing to the panel with `LVGL_V9_PORT_OVERLAY_ENABLE`
+ *
+ */
+typedef struct {
+    const void *buf;    // LVGL_V9_PORT_H_RES x LVGL_V9_PORT_V_RES ARGB8888 pixels, transparent where no widget is drawn
+    lv_area_t area;     // Bounding box of everything rendered so far, empty (x2 < x1) before the first frame
+} lvgl_v9_port_overlay_t;
+
+/**
+ * @brief Initialize LVGL port
+ *
+ * @param[in] lcd_handle: LCD panel handle
+ * @param[in] tp_handle: Touch panel handle
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - Others: Fail
+ */
+esp_err_t lvgl_v9_port_init(esp_lcd_panel_handle_t lcd_handle, esp_lcd_touch_handle_t tp_handle, lvgl_v9_port_interface_t interface);
+
+/**
+ * @brief Take LVGL mutex
+ *
+ * @note With `LV_USE_OS` enabled, LVGL's own lock (`lv_lock()`) is taken as well
+ *
+ * @param[in] timeout_ms: Timeout in [ms]. 0 will block indefinitely.
+ *
+ * @return
+ *      - true:  Mutex was taken
+ *      - false: Mutex was NOT taken
+ */
+bool lvgl_v9_port_lock(int timeout_ms);
+
+/**
+ * @brief Give LVGL mutex
+ *
+ */
+void lvgl_v9_port_unlock(void);
+
+/**
+ * @brief Notifies the LVGL task when the transmission of the RGB frame buffer is completed.
+ *
+ * @return
+ *      - true:  The tasks need to be re-scheduled
+ *      - false: The tasks don't need to be re-scheduled
+ */
+bool lvgl_v9_port_notify_lcd_vsync(void);
+
+/**
+ * @brief Decode images into the LVGL image cache in the background
+ *
+ * @note The LVGL task decodes one queued image whenever nothing is invalidated or animated, e.g. the assets of the
+ *       next screen while the current one is idle. A source must stay valid until it's decoded, as for
+ *       `lv_image_set_src()`. Call with `lvgl_v9_port_lock()` held.
+ *
+ * @param[in] srcs: Image sources, `lv_image_dsc_t` pointers or file paths
+ * @param[in] count: Number of sources
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NO_MEM: The queue is full, the remaining sources are not queued
+ *      - ESP_ERR_NOT_SUPPORTED: `LVGL_V9_PORT_IMAGE_CACHE_ENABLE` is disabled
+ */
+esp_err_t lvgl_v9_port_image_prefetch(const void *const srcs[], size_t count);
+
+/**
+ * @brief Map an asset partition written by `tools/pack_assets.py`
+ *
+ * @note The images are RGB565, or RGB565A8 with alpha, and are drawn from the mapped flash without a copy to RAM.
+ *       Only their descriptors, 24 bytes each, are kept in internal RAM. The PPA draw unit can't read flash, so these
+ *       images are blended by the CPU. Call once, the partition stays mapped.
+ *
+ * @param[in] partition_label: Label of a data partition
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: Already mounted
+ *      - ESP_ERR_NOT_FOUND: No data partition with this label
+ *      - ESP_ERR_INVALID_VERSION: The partition holds no asset image of this version
+ *      - ESP_ERR_INVALID_SIZE: The asset image is truncated or has an invalid entry
+ *      - ESP_ERR_NO_MEM: No memory for the image descriptors
+ *      - ESP_ERR_NOT_SUPPORTED: `LVGL_V9_PORT_ASSETS_ENABLE` is disabled
+ */
+esp_err_t lvgl_v9_port_assets_mount(const char *partition_label);
+
+/**
+ * @brief Get an image of the mounted asset partition
+ *
+ * @param[in] name: Asset name, as given to `pack_assets.py`
+ *
+ * @return
+ *      - Image descriptor for `lv_image_set_src()`, valid as long as the application runs
+ *      - NULL: No image with this name, or no partition mounted
+ */
+const lv_image_dsc_t *lvgl_v9_port_assets_get_image(const char *name);
+
+/**
+ * @brief Get a binary blob of the mounted asset partition, e.g. a font from `lv_font_conv --format bin`
+ *
+ * @note A font blob can be loaded with `lv_binfont_create_from_buffer()` (`LV_USE_FS_MEMFS`), which reads the glyphs
+ *       into RAM, only images are drawn from flash
+ *
+ * @param[in] name: Asset name, as given to `pack_assets.py`
+ * @param[out] size: Size of the blob in bytes, may be NULL
+ *
+ * @return
+ *      - Mapped address of the blob, read only
+ *      - NULL: No blob with this name, or no partition mounted
+ */
+const void *lvgl_v9_port_assets_get_blob(const char *name, size_t *size);
+
+/**
+ * @brief Draw a container with a static subtree from a cached snapshot
+ *
+ * @note The container and its children are rendered once into a PSRAM snapshot, which every later refresh blits
+ *       instead of drawing them, so shadows, gradients and the like are paid once. Live widgets should be siblings
+ *       drawn above the container, not its children. The snapshot is retaken when the container is resized,
+ *       restyled, scrolled or gets children added or removed; call `lvgl_v9_port_layer_cache_update()` after changing
+ *       a child. An opaque container without radius and shadow is snapshotted in the display color format,
+ *       otherwise in ARGB8888. Call with `lvgl_v9_port_lock()` held.
+ *
+ * @param[in] obj: The container
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: Already cached, or the container has no size
+ *      - ESP_ERR_NO_MEM: No PSRAM for the snapshot
+ *      - ESP_ERR_NOT_SUPPORTED: `LV_USE_SNAPSHOT` is disabled
+ */
+esp_err_t lvgl_v9_port_layer_cache_enable(lv_obj_t *obj);
+
+/**
+ * @brief Retake the snapshot of a cached container after its subtree changed
+ *
+ * @note Call with `lvgl_v9_port_lock()` held
+ *
+ * @param[in] obj: The container
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: The container isn't cached
+ *      - ESP_ERR_NO_MEM: No PSRAM for the snapshot, the old one is kept
+ *      - ESP_ERR_NOT_SUPPORTED: `LV_USE_SNAPSHOT` is disabled
+ */
+esp_err_t lvgl_v9_port_layer_cache_update(lv_obj_t *obj);
+
+/**
+ * @brief Draw a cached container normally again and free its snapshot
+ *
+ * @note Deleting the container frees the snapshot as well. Call with `lvgl_v9_port_lock()` held.
+ *
+ * @param[in] obj: The container
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: The container isn't cached
+ *      - ESP_ERR_NOT_SUPPORTED: `LV_USE_SNAPSHOT` is disabled
+ */
+esp_err_t lvgl_v9_port_layer_cache_disable(lv_obj_t *obj);
+
+/**
+ * @brief Move the content of a scrolled container in the LVGL buffer instead of rendering it again
+ *
+ * @note Before a refresh after the container scrolled along one axis, the PPA moves what it drew in the last frame by
+ *       the scroll distance, and only the strip scrolled into view is rendered. Scrollbars, the border, floating
+ *       children and widgets drawn above the container are rendered at their old and new place. The container needs
+ *       an opaque background without gradient or image, and neither it nor its ancestors may be transformed or
+ *       semi-transparent, otherwise it is rendered as usual. Registered containers shouldn't overlap each other. Call
+ *       with `lvgl_v9_port_lock()` held.
+ *
+ * @param[in] obj: The container
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: Already registered, or the container has a layer cache
+ *      - ESP_ERR_NO_MEM: Four containers are registered already
+ *      - ESP_ERR_NOT_SUPPORTED: `LVGL_V9_PORT_SCROLL_BLIT_ENABLE` is disabled
+ *      - Others: The PPA client couldn't be registered
+ */
+esp_err_t lvgl_v9_port_scroll_blit_enable(lv_obj_t *obj);
+
+/**
+ * @brief Render a scrolled container as a whole again
+ *
+ * @note Deleting the container unregisters it as well. Call with `lvgl_v9_port_lock()` held.
+ *
+ * @param[in] obj: The container
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: The container isn't registered
+ *      - ESP_ERR_NOT_SUPPORTED: `LVGL_V9_PORT_SCROLL_BLIT_ENABLE` is disabled
+ */
+esp_err_t lvgl_v9_port_scroll_blit_disable(lv_obj_t *obj);
+
+/**
+ * @brief Get the LVGL overlay
+ *
+ * @note LVGL renders into the overlay in place, it's only stable while `lvgl_v9_port_lock()` is held
+ *
+ * @param[out] overlay: The overlay buffer and the area to composite
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_NOT_SUPPORTED: `LVGL_V9_PORT_OVERLAY_ENABLE` is disabled
+ */
+esp_err_t lvgl_v9_port_get_overlay(lvgl_v9_port_overlay_t *overlay);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,2760 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "soc/soc_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_lcd_panel_ops.h"
+#if SOC_LCDCAM_RGB_LCD_SUPPORTED
+#include "esp_lcd_panel_rgb.h"
+#endif
+#if SOC_MIPI_DSI_SUPPORTED
+#include "esp_lcd_mipi_dsi.h"
+#endif
+#include "esp_lcd_touch.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "multi_heap.h"
+#if CONFIG_IDF_TARGET_ESP32P4
+#include "esp_private/esp_cache_private.h"
+#include "esp_cache.h"
+#include "driver/ppa.h"
+#endif
+#if LVGL_V9_PORT_HW_JPEG_ENABLE
+#include "driver/jpeg_decode.h"
+#endif
+#if LVGL_V9_PORT_ASSETS_ENABLE
+#include <string.h>
+#include <inttypes.h>
+#include "esp_check.h"
+#include "esp_partition.h"
+#endif
+#include "lvgl.h"
+#include "lvgl_private.h"
+#include "lvgl_port_v9.h"
+
+#define ALIGN_UP_BY(num, align)    (((num) + ((align) - 1)) & ~((align) - 1))
+#define BLOCK_SIZE_SMALL           (32)
+#define BLOCK_SIZE_LARGE           (256)
+
+static const char *TAG = "lv_port";
+
+typedef struct {
+    esp_lcd_panel_handle_t lcd_handle;
+    esp_lcd_touch_handle_t tp_handle;
+    bool is_init;
+} lvgl_v9_port_task_param_t;
+
+typedef esp_err_t (*get_lcd_frame_buffer_cb_t)(esp_lcd_panel_handle_t panel, uint32_t fb_num, void **fb0, ...);
+
+#if LVGL_V9_PORT_PPA_ROTATION_ENABLE
+static ppa_client_handle_t ppa_srm_handle = NULL;
+static size_t data_cache_line_size = 0;
+static SemaphoreHandle_t ppa_srm_done_sem = NULL;   // Given by every finished rotation
+static int ppa_srm_pending = 0;                     // Rotations queued and not yet waited for
+#endif
+
+static SemaphoreHandle_t lvgl_mux;                  // LVGL mutex
+static TaskHandle_t lvgl_task_handle = NULL;
+#if LVGL_V9_PORT_VSYNC_SCHEDULE
+static volatile uint32_t lvgl_vsync_count = 0;      // Incremented by every vsync
+static volatile bool lvgl_vsync_waiting = false;    // The LVGL task waits for the next vsync
+#endif
+static lvgl_v9_port_interface_t lvgl_v9_port_interface = LVGL_V9_PORT_INTERFACE_RGB;
+
+#if LVGL_V9_PORT_AVOID_TEAR_ENABLE
+static get_lcd_frame_buffer_cb_t lvgl_get_lcd_frame_buffer = NULL;
+#endif
+#if LVGL_V9_PORT_IMAGE_CACHE_ENABLE
+#define IMAGE_PREFETCH_QUEUE_LEN    (32)
+static const void *image_prefetch_queue[IMAGE_PREFETCH_QUEUE_LEN];  // Image sources waiting to be decoded
+static int image_prefetch_head = 0;
+static int image_prefetch_count = 0;
+static lv_timer_t *image_prefetch_timer = NULL;
+#endif
+#if LVGL_V9_PORT_DUAL_HEAP_ENABLE
+static multi_heap_handle_t dual_heap_internal = NULL;   // TLSF pool in internal RAM for the small allocations
+static uint8_t *dual_heap_internal_start = NULL;
+static uint8_t *dual_heap_internal_end = NULL;
+static lv_mutex_t dual_heap_mutex;
+static size_t dual_heap_max_used = 0;
+#endif
+#if LV_USE_SNAPSHOT
+typedef struct {
+    lv_draw_buf_t snapshot;     // The container and its children, including shadows and outlines around it
+    void *snapshot_mem;         // PSRAM behind the snapshot
+    size_t snapshot_mem_size;
+    int32_t ext_size;           // Extra draw size of the container when the snapshot was taken
+    bool taking;                // The container draws itself into the snapshot
+} layer_cache_t;
+
+static lv_style_t layer_cache_hidden_style;         // Makes `refr_obj()` skip the children of a cached container
+static bool layer_cache_style_inited = false;
+#endif
+#if LVGL_V9_PORT_SCROLL_BLIT_ENABLE
+#define SCROLL_BLIT_MAX_OBJS        (4)
+#define SCROLL_BLIT_PIXEL_SIZE      (LV_COLOR_DEPTH / 8)
+
+typedef struct {
+    lv_area_t area;             // Invalidated part of the container
+    int32_t dx;                 // How far the content had moved since the last refresh by then
+    int32_t dy;
+} scroll_blit_change_t;
+
+typedef struct {
+    lv_obj_t *obj;              // NULL for a free slot
+    bool drawn;                 // The last refresh left the container in the LVGL buffer at `coords`
+    lv_area_t coords;           // Coordinates of the container at the last refresh
+    int32_t scroll_x;           // Scroll position at the last refresh
+    int32_t scroll_y;
+    int32_t dx;                 // The content moved by this much since the last refresh
+    int32_t dy;
+    lv_area_t area;             // Part the content is moved in, inside the border and the rounded ends
+    lv_area_t strip;            // Part of `area` scrolled into view
+    bool armed;                 // The next invalidation is the container's own, reduce it to `strip`
+    bool fallback;              // The container is rendered as usual in this refresh
+    bool blit;                  // Move the content before rendering
+    scroll_blit_change_t changes[LV_INV_BUF_SIZE];  // Invalidated since the last refresh
+    int change_cnt;
+} scroll_blit_t;
+
+static scroll_blit_t scroll_blits[SCROLL_BLIT_MAX_OBJS];
+static bool scroll_blit_deciding = false;           // Invalidating for `scroll_blit_refr_start()`
+static ppa_client_handle_t scroll_blit_ppa = NULL;
+static size_t scroll_blit_cache_line = 0;
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
+static void *scroll_blit_scratch = NULL;            // LVGL's single buffer is moved through here
+static size_t scroll_blit_scratch_size = 0;
+#endif
+#endif
+#if LVGL_V9_PORT_OVERLAY_ENABLE
+static void *lvgl_overlay_buf = NULL;                // ARGB8888 buffer LVGL renders the whole display into
+static lv_area_t lvgl_overlay_area;                  // Bounding box of everything rendered so far
+static bool lvgl_overlay_area_valid = false;
+#endif
+
+/*
+ * Port trace points. They feed `lv_profiler_builtin` when `LV_USE_PROFILER` is enabled, and with the
+ * profiling overlay they also add their duration to the statistics of the current period.
+ */
+#if LVGL_V9_PORT_PROFILE_OVERLAY
+typedef struct {
+    uint32_t frames;                // Frames that rendered something
+    uint64_t dirty_px;              // Pixels of the areas those frames rendered
+    int64_t refr_start_us;          // Start of the refresh in progress
+    bool refr_rendered;             // The refresh in progress rendered something
+    int64_t refr_us;                // LV_EVENT_REFR_START to LV_EVENT_REFR_READY of the rendered frames
+    int64_t flush_us;               // Inside `flush_callback()`
+    int64_t copy_us;                // Rotating or copying into the LCD frame buffers
+    int64_t vsync_us;               // Waiting for a vsync
+    lv_obj_t *label;
+} lvgl_v9_port_profile_t;
+
+static lvgl_v9_port_profile_t port_profile;
+
+#define PORT_TRACE_BEGIN(tag, stat) \
+    LV_PROFILER_BEGIN_TAG(tag); \
+    const int64_t stat##_trace_start_us = esp_timer_get_time()
+#define PORT_TRACE_END(tag, stat) \
+    port_profile.stat##_us += esp_timer_get_time() - stat##_trace_start_us; \
+    LV_PROFILER_END_TAG(tag)
+#else
+#define PORT_TRACE_BEGIN(tag, stat) LV_PROFILER_BEGIN_TAG(tag)
+#define PORT_TRACE_END(tag, stat)   LV_PROFILER_END_TAG(tag)
+#endif
+
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
+#if !LVGL_V9_PORT_DIRECT_MODE
+static void *get_next_frame_buffer(esp_lcd_panel_handle_t panel_handle)
+{
+    static void *next_fb = NULL;
+    static void *fb[2] = { NULL };
+    if (next_fb == NULL) {
+        ESP_ERROR_CHECK(lvgl_get_lcd_frame_buffer(panel_handle, 2, &fb[0], &fb[1]));
+        next_fb = fb[1];
+    } else {
+        next_fb = (next_fb == fb[0]) ? fb[1] : fb[0];
+    }
+    return next_fb;
+}
+#endif
+
+#if !LVGL_V9_PORT_PPA_ROTATION_ENABLE
+typedef struct {
+    uint8_t c[3];
+} rotate_pixel24_t;
+
+/* Pixel pair word, may alias the uint16_t frame buffers */
+typedef uint32_t __attribute__((__may_alias__)) rotate_word_t;
+
+/* Index in dst of the src pixel at (row, col), rotation is a constant in every kernel so this folds */
+#define ROTATE_DST_INDEX(rotation, width, height, row, col) \
+    ((rotation) == 90 ? (col) * (height) + (height) - 1 - (row) : \
+     (rotation) == 270 ? ((width) - 1 - (col)) * (height) + (row) : \
+     ((height) - 1 - (row)) * (width) + (width) - 1 - (col))
+
+/* Walk the area in blocks, one src row segment of a block maps to a run of dst pixels dst_step apart */
+#define ROTATE_FOR_EACH_BLOCK(rotation, x_start, y_start, x_end, y_end, BODY) \
+    do { \
+        const int _block_w = (rotation) == 180 ? BLOCK_SIZE_LARGE : BLOCK_SIZE_SMALL; \
+        const int _block_h = (rotation) == 180 ? BLOCK_SIZE_SMALL : BLOCK_SIZE_LARGE; \
+        for (int i = (y_start); i <= (y_end); i += _block_h) { \
+            int max_height = i + _block_h > (y_end) + 1 ? (y_end) + 1 : i + _block_h; \
+            for (int j = (x_start); j <= (x_end); j += _block_w) { \
+                int max_width = j + _block_w > (x_end) + 1 ? (x_end) + 1 : j + _block_w; \
+                BODY \
+            } \
+        } \
+    } while (0)
+
+/*
+ * Per pixel kernel for one (rotation, pixel type), the dst address is computed once per row
+ * segment and then stepped, no multiplies or branches in the inner loop.
+ */
+#define DEFINE_ROTATE_KERNEL(name, pixel_t, rotation) \
+static void name(const pixel_t *src, pixel_t *dst, int width, int height, \
+                 int x_start, int y_start, int x_end, int y_end) \
+{ \
+    const int dst_step = (rotation) == 90 ? height : (rotation) == 270 ? -height : -1; \
+    ROTATE_FOR_EACH_BLOCK(rotation, x_start, y_start, x_end, y_end, { \
+        for (int row = i; row < max_height; row++) { \
+            const pixel_t *s = src + row * width + j; \
+            pixel_t *d = dst + ROTATE_DST_INDEX(rotation, width, height, row, j); \
+            for (int col = j; col < max_width; col++) { \
+                *d = *s++; \
+                d += dst_step; \
+            } \
+        } \
+    }); \
+}
+
+DEFINE_ROTATE_KERNEL(rotate_rgb565_90_px, uint16_t, 90)
+DEFINE_ROTATE_KERNEL(rotate_rgb565_180_px, uint16_t, 180)
+DEFINE_ROTATE_KERNEL(rotate_rgb565_270_px, uint16_t, 270)
+DEFINE_ROTATE_KERNEL(rotate_rgb888_90, rotate_pixel24_t, 90)
+DEFINE_ROTATE_KERNEL(rotate_rgb888_180, rotate_pixel24_t, 180)
+DEFINE_ROTATE_KERNEL(rotate_rgb888_270, rotate_pixel24_t, 270)
+
+/*
+ * RGB565 kernel with 2x2 register tiles, two 32-bit loads from two src rows give two 32-bit
+ * stores into two dst rows (one pixel pair for 180). The word accesses need the tile on even
+ * rows and columns of an even sized screen, the odd edges of the area go to the per pixel kernel.
+ */
+#define DEFINE_ROTATE_KERNEL_RGB565_TILED(name, rotation, edge_kernel) \
+static void name(const uint16_t *src, uint16_t *dst, int width, int height, \
+                 int x_start, int y_start, int x_end, int y_end) \
+{ \
+    const int tile_h = (rotation) == 180 ? 1 : 2; \
+    const int x0 = (x_start + 1) & ~1; \
+    const int xe = (x_end + 1) & ~1; \
+    const int y0 = (rotation) == 180 ? y_start : (y_start + 1) & ~1; \
+    const int ye = (rotation) == 180 ? y_end + 1 : (y_end + 1) & ~1; \
+    if (((width | height) & 1) || x0 >= xe || y0 >= ye) { \
+        edge_kernel(src, dst, width, height, x_start, y_start, x_end, y_end); \
+        return; \
+    } \
+    if (y_start < y0) { \
+        edge_kernel(src, dst, width, height, x_start, y_start, x_end, y_start); \
+    } \
+    if (ye <= y_end) { \
+        edge_kernel(src, dst, width, height, x_start, y_end, x_end, y_end); \
+    } \
+    if (x_start < x0) { \
+        edge_kernel(src, dst, width, height, x_start, y0, x_start, ye - 1); \
+    } \
+    if (xe <= x_end) { \
+        edge_kernel(src, dst, width, height, x_end, y0, x_end, ye - 1); \
+    } \
+    ROTATE_FOR_EACH_BLOCK(rotation, x0, y0, xe - 1, ye - 1, { \
+        for (int row = i; row < max_height; row += tile_h) { \
+            const rotate_word_t *s0 = (const rotate_word_t *)(src + row * width + j); \
+            const rotate_word_t *s1 = (const rotate_word_t *)(src + (row + tile_h - 1) * width + j); \
+            for (int col = j; col < max_width; col += 2) { \
+                uint32_t a = *s0++; \
+                uint32_t b = *s1++; \
+                if ((rotation) == 90) { \
+                    rotate_word_t *d = (rotate_word_t *)(dst + ROTATE_DST_INDEX(90, width, height, row + 1, col)); \
+                    d[0] = (b & 0xffff) | (a << 16); \
+                    d[height / 2] = (b >> 16) | (a & 0xffff0000); \
+                } else if ((rotation) == 270) { \
+                    rotate_word_t *d = (rotate_word_t *)(dst + ROTATE_DST_INDEX(270, width, height, row, col)); \
+                    d[0] = (a & 0xffff) | (b << 16); \
+                    d[-height / 2] = (a >> 16) | (b & 0xffff0000); \
+                } else { \
+                    rotate_word_t *d = (rotate_word_t *)(dst + ROTATE_DST_INDEX(180, width, height, row, col + 1)); \
+                    d[0] = (a >> 16) | (a << 16); \
+                } \
+            } \
+        } \
+    }); \
+}
+
+DEFINE_ROTATE_KERNEL_RGB565_TILED(rotate_rgb565_90, 90, rotate_rgb565_90_px)
+DEFINE_ROTATE_KERNEL_RGB565_TILED(rotate_rgb565_180, 180, rotate_rgb565_180_px)
+DEFINE_ROTATE_KERNEL_RGB565_TILED(rotate_rgb565_270, 270, rotate_rgb565_270_px)
+
+/*
+ * Rotate the area [x_start, x_end] x [y_start, y_end] (inclusive) of the src image into its
+ * rotated position in dst, the pixels outside the area are left untouched in dst.
+ * Callers pass constants for rotation and bpp, so only the matching kernel call remains.
+ */
+static inline void rotate_image(const void *src, void *dst, int width, int height, int x_start, int y_start,
+                                int x_end, int y_end, int rotation, int bpp)
+{
+    if (bpp == 16) {
+        switch (rotation) {
+        case 90:
+            rotate_rgb565_90(src, dst, width, height, x_start, y_start, x_end, y_end);
+            break;
+        case 180:
+            rotate_rgb565_180(src, dst, width, height, x_start, y_start, x_end, y_end);
+            break;
+        case 270:
+            rotate_rgb565_270(src, dst, width, height, x_start, y_start, x_end, y_end);
+            break;
+        default:
+            break;
+        }
+    } else if (bpp == 24) {
+        switch (rotation) {
+        case 90:
+            rotate_rgb888_90(src, dst, width, height, x_start, y_start, x_end, y_end);
+            break;
+        case 180:
+            rotate_rgb888_180(src, dst, width, height, x_start, y_start, x_end, y_end);
+            break;
+        case 270:
+            rotate_rgb888_270(src, dst, width, height, x_start, y_start, x_end, y_end);
+            break;
+        default:
+            break;
+        }
+    }
+}
+#endif
+
+#if LVGL_V9_PORT_PPA_ROTATION_ENABLE
+IRAM_ATTR static bool rotate_copy_done(ppa_client_handle_t ppa_client, ppa_event_data_t *event_data, void *user_data)
+{
+    BaseType_t need_yield = pdFALSE;
+
+    xSemaphoreGiveFromISR(ppa_srm_done_sem, &need_yield);
+
+    return need_yield == pdTRUE;
+}
+
+/**
+ * @brief Wait for the queued rotations
+ *
+ * @note The rotations of all dirty areas run back to back on the PPA, the frame buffer they write
+ *       is only shown, and LVGL's buffer they read only rendered into again, after this returns.
+ *
+ */
+static void rotate_copy_wait(void)
+{
+    PORT_TRACE_BEGIN("lv_port_rotate_wait", copy);
+    while (ppa_srm_pending > 0) {
+        xSemaphoreTake(ppa_srm_done_sem, portMAX_DELAY);
+        ppa_srm_pending--;
+    }
+    PORT_TRACE_END("lv_port_rotate_wait", copy);
+}
+#endif
+
+IRAM_ATTR static void rotate_copy_pixel(const uint16_t *from, uint16_t *to, uint16_t x_start, uint16_t y_start, uint16_t x_end, uint16_t y_end, uint16_t w, uint16_t h, uint16_t rotation)
+{
+    PORT_TRACE_BEGIN("lv_port_rotate", copy);
+#if LVGL_V9_PORT_PPA_ROTATION_ENABLE
+    ppa_srm_rotation_angle_t ppa_rotation;
+    int x_offset = 0, y_offset = 0;
+
+    // Determine rotation settings once and reuse
+    switch (rotation) {
+    case 90:
+        ppa_rotation = PPA_SRM_ROTATION_ANGLE_270;
+        x_offset = h - y_end - 1;
+        y_offset = x_start;
+        break;
+    case 180:
+        ppa_rotation = PPA_SRM_ROTATION_ANGLE_180;
+        x_offset = w - x_end - 1;
+        y_offset = h - y_end - 1;
+        break;
+    case 270:
+        ppa_rotation = PPA_SRM_ROTATION_ANGLE_90;
+        x_offset = y_start;
+        y_offset = w - x_end - 1;
+        break;
+    default:
+        ppa_rotation = PPA_SRM_ROTATION_ANGLE_0;
+        break;
+    }
+
+    // Fill operation config for PPA rotation, without recalculating each time
+    ppa_srm_oper_config_t oper_config = {
+        .in.buffer = from,
+        .in.pic_w = w,
+        .in.pic_h = h,
+        .in.block_w = x_end - x_start + 1,
+        .in.block_h = y_end - y_start + 1,
+        .in.block_offset_x = x_start,
+        .in.block_offset_y = y_start,
+        .in.srm_cm = (LV_COLOR_DEPTH == 24) ? PPA_SRM_COLOR_MODE_RGB888 : PPA_SRM_COLOR_MODE_RGB565,
+
+           .out.buffer = to,
+           .out.buffer_size = ALIGN_UP_BY(sizeof(lv_color_t) * w * h, data_cache_line_size),
+           .out.pic_w = (ppa_rotation == PPA_SRM_ROTATION_ANGLE_90 || ppa_rotation == PPA_SRM_ROTATION_ANGLE_270) ? h : w,
+           .out.pic_h = (ppa_rotation == PPA_SRM_ROTATION_ANGLE_90 || ppa_rotation == PPA_SRM_ROTATION_ANGLE_270) ? w : h,
+           .out.block_offset_x = x_offset,
+           .out.block_offset_y = y_offset,
+           .out.srm_cm = (LV_COLOR_DEPTH == 24) ? PPA_SRM_COLOR_MODE_RGB888 : PPA_SRM_COLOR_MODE_RGB565,
+
+           .rotation_angle = ppa_rotation,
+           .scale_x = 1.0,
+           .scale_y = 1.0,
+           .rgb_swap = 0,
+           .byte_swap = 0,
+           .mode = PPA_TRANS_MODE_NON_BLOCKING,
+    };
+
+    // Queue the rotation, `rotate_copy_wait()` collects it before the frame buffer is used
+    ESP_ERROR_CHECK(ppa_do_scale_rotate_mirror(ppa_srm_handle, &oper_config));
+    ppa_srm_pending++;
+
+#else
+    // Fallback: optimized transpose for non-PPA systems, limited to the dirty area
+    rotate_image(from, to, w, h, x_start, y_start, x_end, y_end, rotation, LV_COLOR_DEPTH);
+#endif
+    PORT_TRACE_END("lv_port_rotate", copy);
+}
+
+#endif /* EXAMPLE_LVGL_PORT_ROTATION_DEGREE */
+
+#if LVGL_V9_PORT_AVOID_TEAR_ENABLE
+
+/**
+ * @brief Wait for the current LCD frame buffer to complete transmission
+ *
+ */
+static void flush_wait_vsync(void)
+{
+    PORT_TRACE_BEGIN("lv_port_vsync_wait", vsync);
+    ulTaskNotifyValueClear(NULL, ULONG_MAX);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    PORT_TRACE_END("lv_port_vsync_wait", vsync);
+}
+
+static void switch_lcd_frame_buffer_to(esp_lcd_panel_handle_t panel_handle, void *fb)
+{
+#if (EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0) && LVGL_V9_PORT_PPA_ROTATION_ENABLE
+    rotate_copy_wait();
+#endif
+    esp_lcd_panel_draw_bitmap(panel_handle, 0, 0, LVGL_V9_PORT_H_RES, LVGL_V9_PORT_V_RES, fb);
+}
+
+#if LVGL_V9_PORT_DIRECT_MODE
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
+typedef struct {
+    uint16_t num;
+    bool full;                              // More areas than fit, the whole screen is stale
+    lv_area_t areas[LV_INV_BUF_SIZE];
+} lv_port_dirty_area_t;
+
+/*
+ * All LCD frame buffers are scanned out in turn, LVGL renders into its own buffer. Each frame
+ * buffer keeps the areas that changed since it was last written, so a frame only copies what
+ * that buffer misses. `lcd_fb_front` is being scanned out and `lcd_fb_requested` was last passed
+ * to the LCD, any other buffer can be written without waiting.
+ */
+static void *lcd_fbs[LVGL_V9_PORT_LCD_BUFFER_NUMS];
+static lv_port_dirty_area_t lcd_fb_dirty[LVGL_V9_PORT_LCD_BUFFER_NUMS];
+static volatile int lcd_fb_front = 0;
+static volatile int lcd_fb_requested = 0;
+
+static void flush_dirty_add(lv_port_dirty_area_t *dirty_area, const lv_area_t *area)
+{
+    if (dirty_area->full) {
+        return;
+    }
+
+    for (int i = 0; i < dirty_area->num; i++) {
+        /* Already covered, or covers an area the list has */
+        if (lv_area_is_in(area, &dirty_area->areas[i], 0)) {
+            return;
+        }
+        if (lv_area_is_in(&dirty_area->areas[i], area, 0)) {
+            dirty_area->areas[i] = *area;
+            return;
+        }
+    }
+
+    if (dirty_area->num == LV_INV_BUF_SIZE) {
+        dirty_area->full = true;
+        return;
+    }
+    dirty_area->areas[dirty_area->num++] = *area;
+}
+
+/**
+ * @brief Pick a frame buffer that is neither being scanned out nor about to be
+ *
+ * @note With three frame buffers there is always one, so the LVGL task only waits for the vsync
+ *       with fewer buffers.
+ *
+ */
+static int flush_get_free_buf(void)
+{
+    while (1) {
+        int front = lcd_fb_front;
+        int requested = lcd_fb_requested;
+
+        for (int i = 0; i < LVGL_V9_PORT_LCD_BUFFER_NUMS; i++) {
+            if (i != front && i != requested) {
+                return i;
+            }
+        }
+
+        /* Every buffer is in flight, wait for the current frame buffer to complete transmission */
+        flush_wait_vsync();
+    }
+}
+
+/**
+ * @brief Copy dirty area
+ *
+ * @note This function is used to avoid tearing effect, and only work with LVGL direct-mode.
+ *
+ */
+static void flush_dirty_copy(void *dst, void *src, lv_port_dirty_area_t *dirty_area)
+{
+    if (dirty_area->full) {
+        rotate_copy_pixel(src, dst, 0, 0, LV_HOR_RES - 1, LV_VER_RES - 1, LV_HOR_RES, LV_VER_RES,
+                          EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
+    } else {
+        for (int i = 0; i < dirty_area->num; i++) {
+            rotate_copy_pixel(src, dst, dirty_area->areas[i].x1, dirty_area->areas[i].y1, dirty_area->areas[i].x2,
+                              dirty_area->areas[i].y2, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
+        }
+    }
+    dirty_area->num = 0;
+    dirty_area->full = false;
+}
+
+static void flush_callback(lv_display_t *disp, const lv_area_t *area, uint8_t  *color_map)
+{
+    esp_lcd_panel_handle_t panel_handle = (esp_lcd_panel_handle_t)lv_display_get_user_data(disp);
+
+    /* Action after last area refresh */
+    if (lv_disp_flush_is_last(disp)) {
+        lv_disp_t *disp_refr = lv_refr_get_disp_refreshing();
+        int next = flush_get_free_buf();
+
+        /* Every frame buffer misses the areas of this frame until it is written */
+        for (int i = 0; i < disp_refr->inv_p; i++) {
+            if (disp_refr->inv_area_joined[i] == 0) {
+                for (int fb = 0; fb < LVGL_V9_PORT_LCD_BUFFER_NUMS; fb++) {
+                    flush_dirty_add(&lcd_fb_dirty[fb], &disp_refr->inv_areas[i]);
+                }
+            }
+        }
+
+        /* Rotate and copy everything `next` misses from LVGL's buffer */
+        flush_dirty_copy(lcd_fbs[next], color_map, &lcd_fb_dirty[next]);
+
+        /* Switch the current LCD frame buffer to `next`, the vsync makes it the front buffer */
+        switch_lcd_frame_buffer_to(panel_handle, lcd_fbs[next]);
+        lcd_fb_requested = next;
+    }
+
+    lv_disp_flush_ready(disp);
+}
+
+#else
+
+#if LVGL_V9_PORT_PPA_SYNC_ENABLE
+/*
+ * LVGL copies what the last frame rendered into the other buffer at the start of the next refresh, with the CPU.
+ * Here the PPA copies it as soon as that buffer is no longer scanned out, and the next refresh only waits for the
+ * copies before rendering into it.
+ */
+static ppa_client_handle_t buf_sync_ppa = NULL;
+static size_t buf_sync_cache_line = 0;
+static SemaphoreHandle_t buf_sync_done_sem = NULL;  // Given by every finished copy
+static int buf_sync_pending = 0;                    // Copies queued and not yet waited for
+static bool buf_sync_started = false;               // The areas of the refresh in progress are copied
+
+IRAM_ATTR static bool buf_sync_done(ppa_client_handle_t ppa_client, ppa_event_data_t *event_data, void *user_data)
+{
+    BaseType_t need_yield = pdFALSE;
+
+    xSemaphoreGiveFromISR(buf_sync_done_sem, &need_yield);
+
+    return need_yield == pdTRUE;
+}
+
+static void buf_sync_wait(void)
+{
+    PORT_TRACE_BEGIN("lv_port_sync_wait", copy);
+    while (buf_sync_pending > 0) {
+        xSemaphoreTake(buf_sync_done_sem, portMAX_DELAY);
+        buf_sync_pending--;
+    }
+    PORT_TRACE_END("lv_port_sync_wait", copy);
+}
+
+static void buf_sync_copy(const void *src, void *dst, const lv_area_t *area)
+{
+    if (buf_sync_pending == LV_INV_BUF_SIZE) {
+        xSemaphoreTake(buf_sync_done_sem, portMAX_DELAY);
+        buf_sync_pending--;
+    }
+
+    // The PPA invalidates the rows it writes, what the CPU left in them must reach the memory first
+    const size_t row_size = LVGL_V9_PORT_H_RES * sizeof(lv_color_t);
+    ESP_ERROR_CHECK(esp_cache_msync((uint8_t *)dst + area->y1 * row_size, lv_area_get_height(area) * row_size,
+                                    ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED));
+
+    ppa_srm_oper_config_t oper_config = {
+        .in.buffer = src,
+        .in.pic_w = LVGL_V9_PORT_H_RES,
+        .in.pic_h = LVGL_V9_PORT_V_RES,
+        .in.block_w = lv_area_get_width(area),
+        .in.block_h = lv_area_get_height(area),
+        .in.block_offset_x = area->x1,
+        .in.block_offset_y = area->y1,
+        .in.srm_cm = (LV_COLOR_DEPTH == 24) ? PPA_SRM_COLOR_MODE_RGB888 : PPA_SRM_COLOR_MODE_RGB565,
+
+        .out.buffer = dst,
+        .out.buffer_size = ALIGN_UP_BY(row_size * LVGL_V9_PORT_V_RES, buf_sync_cache_line),
+        .out.pic_w = LVGL_V9_PORT_H_RES,
+        .out.pic_h = LVGL_V9_PORT_V_RES,
+        .out.block_offset_x = area->x1,
+        .out.block_offset_y = area->y1,
+        .out.srm_cm = (LV_COLOR_DEPTH == 24) ? PPA_SRM_COLOR_MODE_RGB888 : PPA_SRM_COLOR_MODE_RGB565,
+
+        .rotation_angle = PPA_SRM_ROTATION_ANGLE_0,
+        .scale_x = 1.0,
+        .scale_y = 1.0,
+        .mode = PPA_TRANS_MODE_NON_BLOCKING,
+    };
+    ESP_ERROR_CHECK(ppa_do_scale_rotate_mirror(buf_sync_ppa, &oper_config));
+    buf_sync_pending++;
+}
+
+/* Queue the copies of everything this frame changed in `src` to `dst`, the buffer the next frame is rendered into */
+static void buf_sync_start(lv_display_t *disp, const void *src, void *dst)
+{
+    PORT_TRACE_BEGIN("lv_port_sync", copy);
+    // Areas LVGL got before rendering, such as those of the scroll blits
+    lv_area_t *area;
+    LV_LL_READ(&disp->sync_areas, area) {
+        buf_sync_copy(src, dst, area);
+    }
+    for (int i = 0; i < disp->inv_p; i++) {
+        if (disp->inv_area_joined[i] == 0) {
+            buf_sync_copy(src, dst, &disp->inv_areas[i]);
+        }
+    }
+    buf_sync_started = true;
+    PORT_TRACE_END("lv_port_sync", copy);
+}
+
+static void buf_sync_event_cb(lv_event_t *e)
+{
+    lv_display_t *disp = lv_event_get_target(e);
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_RENDER_START:
+        // Rendering and the scroll blits write the buffer the copies go to
+        buf_sync_wait();
+        break;
+    case LV_EVENT_REFR_READY:
+        // LVGL has added the areas of this frame to copy them at the start of the next refresh
+        if (buf_sync_started) {
+            lv_ll_clear(&disp->sync_areas);
+            buf_sync_started = false;
+        }
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+static void flush_callback(lv_display_t *disp, const lv_area_t *area, uint8_t  *color_map)
+{
+    esp_lcd_panel_handle_t panel_handle = (esp_lcd_panel_handle_t)lv_display_get_user_data(disp);
+
+    /* Action after last area refresh */
+    if (lv_disp_flush_is_last(disp)) {
+        /* Switch the current LCD frame buffer to `color_map` */
+        switch_lcd_frame_buffer_to(panel_handle, color_map);
+
+        /* Waiting for the last frame buffer to complete transmission */
+        flush_wait_vsync();
+
+#if LVGL_V9_PORT_PPA_SYNC_ENABLE
+        /* The buffer scanned out until now is rendered into next, bring it up to date in the meantime */
+        buf_sync_start(disp, color_map, color_map == disp->buf_1->data ? disp->buf_2->data : disp->buf_1->data);
+#endif
+    }
+
+    lv_disp_flush_ready(disp);
+}
+#endif /* EXAMPLE_LVGL_PORT_ROTATION_DEGREE */
+
+#elif LVGL_V9_PORT_FULL_REFRESH && LVGL_V9_PORT_LCD_BUFFER_NUMS == 2
+
+static void flush_callback(lv_display_t *disp, const lv_area_t *area, uint8_t  *color_map)
+{
+    esp_lcd_panel_handle_t panel_handle = (esp_lcd_panel_handle_t)lv_display_get_user_data(disp);
+
+    /* Switch the current LCD frame buffer to `color_map` */
+    switch_lcd_frame_buffer_to(panel_handle, color_map);
+
+    /* Waiting for the last frame buffer to complete transmission */
+    flush_wait_vsync();
+
+    lv_disp_flush_ready(disp);
+}
+
+#elif LVGL_V9_PORT_FULL_REFRESH && LVGL_V9_PORT_LCD_BUFFER_NUMS == 3
+
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 0
+static void *lvgl_v9_port_rgb_last_buf = NULL;
+static void *lvgl_v9_port_rgb_next_buf = NULL;
+static void *lvgl_v9_port_flush_next_buf = NULL;
+#endif
+
+void flush_callback(lv_display_t *disp, const lv_area_t *area, uint8_t  *color_map)
+{
+    esp_lcd_panel_handle_t panel_handle = (esp_lcd_panel_handle_t)lv_display_get_user_data(disp);
+
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
+    const int offsetx1 = area->x1;
+    const int offsetx2 = area->x2;
+    const int offsety1 = area->y1;
+    const int offsety2 = area->y2;
+    void *next_fb = get_next_frame_buffer(panel_handle);
+
+    /* Rotate and copy dirty area from the current LVGL's buffer to the next LCD frame buffer */
+    rotate_copy_pixel((uint16_t *)color_map, next_fb, offsetx1, offsety1, offsetx2, offsety2, LV_HOR_RES, LV_VER_RES, EXAMPLE_LVGL_PORT_ROTATION_DEGREE);
+
+    /* Switch the current LCD frame buffer to `next_fb` */
+    switch_lcd_frame_buffer_to(panel_handle, next_fb);
+#else
+    if (disp->buf_act == disp->buf_1) {
+        disp->buf_2->data = lvgl_v9_port_flush_next_buf;
+    } else {
+        disp->buf_1->data = lvgl_v9_port_flush_next_buf;
+    }
+    lvgl_v9_port_flush_next_buf = color_map;
+
+    /* Switch the current LCD frame buffer to `color_map` */
+    switch_lcd_frame_buffer_to(panel_handle, color_map);
+
+    lvgl_v9_port_rgb_next_buf = color_map;
+#endif
+
+    lv_disp_flush_ready(disp);
+}
+#endif
+
+#elif LVGL_V9_PORT_OVERLAY_ENABLE
+
+static void flush_callback(lv_display_t *disp, const lv_area_t *area, uint8_t  *color_map)
+{
+    // Direct mode renders in place, only remember where there is content for the compositor
+    if (lvgl_overlay_area_valid) {
+        lv_area_join(&lvgl_overlay_area, &lvgl_overlay_area, area);
+    } else {
+        lvgl_overlay_area = *area;
+        lvgl_overlay_area_valid = true;
+    }
+
+    lv_disp_flush_ready(disp);
+}
+
+#else
+
+void flush_callback(lv_display_t *disp, const lv_area_t *area, uint8_t  *color_map)
+{
+    esp_lcd_panel_handle_t panel_handle = (esp_lcd_panel_handle_t)lv_display_get_user_data(disp);
+    const int offsetx1 = area->x1;
+    const int offsetx2 = area->x2;
+    const int offsety1 = area->y1;
+    const int offsety2 = area->y2;
+
+    /* Just copy data from the color map to the LCD frame buffer */
+    esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, color_map);
+
+    if (lvgl_v9_port_interface != LVGL_V9_PORT_INTERFACE_MIPI_DSI_DMA) {
+        lv_disp_flush_ready(disp);
+    }
+}
+
+#endif /* LVGL_V9_PORT_AVOID_TEAR_ENABLE */
+
+static void flush_callback_traced(lv_display_t *disp, const lv_area_t *area, uint8_t *color_map)
+{
+    PORT_TRACE_BEGIN("lv_port_flush", flush);
+    flush_callback(disp, area, color_map);
+    PORT_TRACE_END("lv_port_flush", flush);
+}
+
+static lv_display_t  *display_init(esp_lcd_panel_handle_t panel_handle)
+{
+#if LVGL_V9_PORT_PPA_ROTATION_ENABLE
+    // Initialize the PPA
+    // Every dirty area of a flush can be queued before the first one is waited for
+    ppa_client_config_t ppa_srm_config = {
+        .oper_type = PPA_OPERATION_SRM,
+        .max_pending_trans_num = LV_INV_BUF_SIZE,
+    };
+    ESP_ERROR_CHECK(ppa_register_client(&ppa_srm_config, &ppa_srm_handle));
+    ppa_event_callbacks_t ppa_srm_cbs = {
+        .on_trans_done = rotate_copy_done,
+    };
+    ESP_ERROR_CHECK(ppa_client_register_event_callbacks(ppa_srm_handle, &ppa_srm_cbs));
+    ppa_srm_done_sem = xSemaphoreCreateCounting(LV_INV_BUF_SIZE, 0);
+    assert(ppa_srm_done_sem);
+    ESP_ERROR_CHECK(esp_cache_get_alignment(MALLOC_CAP_DMA|MALLOC_CAP_SPIRAM, &data_cache_line_size));
+#endif
+
+    assert(panel_handle);
+
+    // alloc draw buffers used by LVGL
+    void *buf1 = NULL;
+    void *buf2 = NULL;
+    int buffer_size = 0;
+    int pixel_size = sizeof(lv_color_t);
+
+    ESP_LOGD(TAG, "Malloc memory for LVGL buffer");
+#if LVGL_V9_PORT_AVOID_TEAR_ENABLE
+    // To avoid the tearing effect, we should use at least two frame buffers: one for LVGL rendering and another for RGB output
+    buffer_size = LVGL_V9_PORT_H_RES * LVGL_V9_PORT_V_RES;
+#if (LVGL_V9_PORT_LCD_BUFFER_NUMS == 3) && (EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 0) && LVGL_V9_PORT_FULL_REFRESH
+    // With the usage of three buffers and full-refresh, we always have one buffer available for rendering, eliminating the need to wait for the RGB's sync signal
+    ESP_ERROR_CHECK(lvgl_get_lcd_frame_buffer(panel_handle, 3, &lvgl_v9_port_rgb_last_buf, &buf1, &buf2));
+    lvgl_v9_port_rgb_next_buf = lvgl_v9_port_rgb_last_buf;
+    lvgl_v9_port_flush_next_buf = buf2;
+#elif (LVGL_V9_PORT_LCD_BUFFER_NUMS == 3) && (EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0) && LVGL_V9_PORT_DIRECT_MODE
+    // Here all three frame buffers are used for rotated output, LVGL renders into a buffer of its own
+    ESP_ERROR_CHECK(lvgl_get_lcd_frame_buffer(panel_handle, 3, &lcd_fbs[0], &lcd_fbs[1], &lcd_fbs[2]));
+    buf1 = heap_caps_aligned_calloc(LV_DRAW_BUF_ALIGN, 1, buffer_size * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+    assert(buf1);
+#elif (LVGL_V9_PORT_LCD_BUFFER_NUMS == 3) && (EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0)
+    // Here we are using three frame buffers, one for LVGL rendering, and the other two for RGB driver (one of them is used for rotation)
+    void *fbs[3];
+    ESP_ERROR_CHECK(lvgl_get_lcd_frame_buffer(panel_handle, 3, &fbs[0], &fbs[1], &fbs[2]));
+    buf1 = fbs[2];
+#else
+    ESP_ERROR_CHECK(lvgl_get_lcd_frame_buffer(panel_handle, 2, &buf1, &buf2));
+#endif
+#elif LVGL_V9_PORT_OVERLAY_ENABLE
+    // The whole display is rendered in place with alpha, the panel is left to the compositor
+    size_t cache_line_size = 0;
+    ESP_ERROR_CHECK(esp_cache_get_alignment(MALLOC_CAP_SPIRAM, &cache_line_size));
+    buffer_size = LVGL_V9_PORT_H_RES * LVGL_V9_PORT_V_RES;
+    pixel_size = lv_color_format_get_size(LV_COLOR_FORMAT_ARGB8888);
+    buf1 = heap_caps_aligned_calloc(LV_MAX(cache_line_size, LV_DRAW_BUF_ALIGN), 1, buffer_size * pixel_size, MALLOC_CAP_SPIRAM);
+    assert(buf1);
+    lvgl_overlay_buf = buf1;
+    ESP_LOGI(TAG, "LVGL overlay buffer size: %dKB", buffer_size * pixel_size / 1024);
+#else
+    // Normmaly, for RGB LCD, we just use one buffer for LVGL rendering
+    buffer_size = LVGL_V9_PORT_H_RES * LVGL_V9_PORT_BUFFER_HEIGHT;
+    buf1 = heap_caps_malloc(buffer_size * sizeof(lv_color_t), LVGL_V9_PORT_BUFFER_MALLOC_CAPS);
+    // buffer_size = LVGL_V9_PORT_H_RES * LVGL_V9_PORT_BUFFER_HEIGHT;
+    // buf1 = heap_caps_malloc(buffer_size * sizeof(lv_color_t), MALLOC_CAP_DMA);
+    assert(buf1);
+    ESP_LOGI(TAG, "LVGL buffer size: %dKB", buffer_size * sizeof(lv_color_t) / 1024);
+#endif /* LVGL_V9_PORT_AVOID_TEAR_ENABLE */
+
+    ESP_LOGD(TAG, "Register display driver to LVGL");
+    lv_display_t *display = lv_display_create(
+#if (EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 90) && (EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 270)
+                                LVGL_V9_PORT_H_RES, LVGL_V9_PORT_V_RES
+#else
+                                LVGL_V9_PORT_V_RES, LVGL_V9_PORT_H_RES
+#endif
+                            );
+
+#if LVGL_V9_PORT_OVERLAY_ENABLE
+    // Set before the buffers, their stride follows the color format
+    lv_display_set_color_format(display, LV_COLOR_FORMAT_ARGB8888);
+#endif
+
+    lv_display_set_buffers(
+        display, buf1, buf2, buffer_size * pixel_size,
+#if LVGL_V9_PORT_FULL_REFRESH
+        LV_DISPLAY_RENDER_MODE_FULL
+#elif LVGL_V9_PORT_DIRECT_MODE || LVGL_V9_PORT_OVERLAY_ENABLE
+        LV_DISPLAY_RENDER_MODE_DIRECT
+#else
+        LV_DISPLAY_RENDER_MODE_PARTIAL
+#endif
+    );
+    lv_display_set_flush_cb(display, flush_callback_traced);
+    lv_display_set_user_data(display, panel_handle);
+#if LVGL_V9_PORT_PPA_SYNC_ENABLE
+    // Every area of a frame can be queued before the first one is waited for
+    ppa_client_config_t ppa_sync_config = {
+        .oper_type = PPA_OPERATION_SRM,
+        .max_pending_trans_num = LV_INV_BUF_SIZE,
+    };
+    ESP_ERROR_CHECK(ppa_register_client(&ppa_sync_config, &buf_sync_ppa));
+    ppa_event_callbacks_t ppa_sync_cbs = {
+        .on_trans_done = buf_sync_done,
+    };
+    ESP_ERROR_CHECK(ppa_client_register_event_callbacks(buf_sync_ppa, &ppa_sync_cbs));
+    buf_sync_done_sem = xSemaphoreCreateCounting(LV_INV_BUF_SIZE, 0);
+    assert(buf_sync_done_sem);
+    ESP_ERROR_CHECK(esp_cache_get_alignment(MALLOC_CAP_DMA | MALLOC_CAP_SPIRAM, &buf_sync_cache_line));
+    // Ahead of the scroll blits, which move content into the buffer the copies go to
+    lv_display_add_event_cb(display, buf_sync_event_cb, LV_EVENT_ALL, NULL);
+#endif
+#if LVGL_V9_PORT_OVERLAY_ENABLE
+    // Where the screen is not covered by widgets the compositor's frame shows through
+    lv_obj_set_style_bg_opa(lv_display_get_screen_active(display), LV_OPA_TRANSP, 0);
+#endif
+
+    return display;
+}
+
+static void touchpad_read(lv_indev_t *indev_drv, lv_indev_data_t *data)
+{
+    esp_lcd_touch_handle_t tp = (esp_lcd_touch_handle_t)lv_indev_get_user_data(indev_drv);
+    assert(tp);
+
+    uint16_t touchpad_x;
+    uint16_t touchpad_y;
+    uint8_t touchpad_cnt = 0;
+    /* Read data from touch controller into memory */
+    esp_lcd_touch_read_data(tp);
+
+    /* Read data from touch controller */
+    bool touchpad_pressed = esp_lcd_touch_get_coordinates(tp, &touchpad_x, &touchpad_y, NULL, &touchpad_cnt, 1);
+    if (touchpad_pressed && touchpad_cnt > 0) {
+        data->point.x = touchpad_x;
+        data->point.y = touchpad_y;
+        data->state = LV_INDEV_STATE_PRESSED;
+        
+        ESP_LOGD(TAG, "Touch position: %d,%d", touchpad_x, touchpad_y);
+    } else {
+        data->state = LV_INDEV_STATE_RELEASED;
+    }
+}
+
+static lv_indev_t *indev_init(esp_lcd_touch_handle_t tp)
+{
+    assert(tp);
+
+    lv_indev_t *indev = lv_indev_create();
+    lv_indev_set_type(indev, LV_INDEV_TYPE_POINTER);   /*See below.*/
+    lv_indev_set_user_data(indev, tp);
+    lv_indev_set_read_cb(indev, touchpad_read);  /*See below.*/
+
+    return indev;
+}
+
+static void tick_increment(void *arg)
+{
+    /* Tell LVGL how many milliseconds have elapsed */
+    lv_tick_inc(LVGL_V9_PORT_TICK_PERIOD_MS);
+}
+
+static esp_err_t tick_init(void)
+{
+    // Tick interface for LVGL (using esp_timer to generate 2ms periodic event)
+    const esp_timer_create_args_t lvgl_tick_timer_args = {
+        .callback = &tick_increment,
+        .name = "LVGL tick"
+    };
+    esp_timer_handle_t lvgl_tick_timer = NULL;
+    ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer));
+    return esp_timer_start_periodic(lvgl_tick_timer, LVGL_V9_PORT_TICK_PERIOD_MS * 1000);
+}
+
+#if LVGL_V9_PORT_VSYNC_SCHEDULE
+/**
+ * @brief Block the LVGL task until the vsync count moves past `last_count`
+ *
+ * @note Other tasks wake the LVGL task when they release the lock, so the count is checked after every wake-up.
+ *       If the panel stops sending vsyncs, the wait gives up after `LVGL_V9_PORT_TASK_MAX_DELAY_MS`.
+ */
+static void wait_for_vsync(uint32_t last_count)
+{
+    PORT_TRACE_BEGIN("lv_port_vsync_wait", vsync);
+    lvgl_vsync_waiting = true;
+    while (lvgl_vsync_count == last_count) {
+        if ((ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LVGL_V9_PORT_TASK_MAX_DELAY_MS)) == 0) &&
+                (lvgl_vsync_count == last_count)) {
+            break;
+        }
+    }
+    lvgl_vsync_waiting = false;
+    PORT_TRACE_END("lv_port_vsync_wait", vsync);
+}
+#endif
+
+#if LVGL_V9_PORT_IMAGE_CACHE_ENABLE
+static void *image_cache_buf_malloc(size_t size, lv_color_format_t color_format)
+{
+    LV_UNUSED(color_format);
+
+    // Aligned by the default `align_pointer_cb` like every draw buffer
+    return heap_caps_malloc(size + LV_DRAW_BUF_ALIGN - 1, MALLOC_CAP_SPIRAM);
+}
+
+static void image_cache_buf_free(void *buf)
+{
+    heap_caps_free(buf);
+}
+
+static void image_prefetch_timer_cb(lv_timer_t *timer)
+{
+    if (image_prefetch_count == 0) {
+        lv_timer_pause(timer);
+        return;
+    }
+
+    // Decode only while nothing waits to be rendered, one image per run
+    lv_display_t *disp = lv_display_get_default();
+    if ((disp && (disp->inv_p > 0)) || (lv_anim_count_running() > 0)) {
+        return;
+    }
+
+    const void *src = image_prefetch_queue[image_prefetch_head];
+    image_prefetch_head = (image_prefetch_head + 1) % IMAGE_PREFETCH_QUEUE_LEN;
+    image_prefetch_count--;
+
+    lv_image_decoder_dsc_t dsc;
+    if (lv_image_decoder_open(&dsc, src, NULL) == LV_RESULT_OK) {
+        // The decoded image stays in the cache after the close
+        lv_image_decoder_close(&dsc);
+    } else {
+        ESP_LOGW(TAG, "Failed to prefetch image");
+    }
+}
+
+/**
+ * @brief Move the decoded images to PSRAM and size the image cache from the PSRAM that is still free
+ *
+ * @note Called after `display_init()`, so the frame and draw buffers are not part of the budget.
+ *
+ */
+static void image_cache_init(void)
+{
+    lv_draw_buf_handlers_t *handlers = lv_draw_buf_get_image_handlers();
+    handlers->buf_malloc_cb = image_cache_buf_malloc;
+    handlers->buf_free_cb = image_cache_buf_free;
+
+    const size_t psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    const uint32_t budget = LV_MIN(psram_free / 100 * LVGL_V9_PORT_IMAGE_CACHE_PSRAM_PERCENT,
+                                   LVGL_V9_PORT_IMAGE_CACHE_MAX_KB * 1024);
+    lv_image_cache_resize(budget, false);
+    lv_image_header_cache_resize(LVGL_V9_PORT_IMAGE_HEADER_CACHE_CNT, false);
+    ESP_LOGI(TAG, "Image cache: %dKB of %dKB free PSRAM, %d headers", (int)(budget / 1024), (int)(psram_free / 1024),
+             LVGL_V9_PORT_IMAGE_HEADER_CACHE_CNT);
+
+    image_prefetch_timer = lv_timer_create(image_prefetch_timer_cb, LVGL_V9_PORT_TASK_MIN_DELAY_MS, NULL);
+    assert(image_prefetch_timer);
+    lv_timer_pause(image_prefetch_timer);
+}
+#endif
+
+#if LVGL_V9_PORT_ASSETS_ENABLE
+/*
+ * Asset partition, written by `tools/pack_assets.py` of the examples. All fields are little endian:
+ *  - Header: magic "LVA1", version, entry count, bytes used by the partition image
+ *  - Entry table right after the header
+ *  - Asset data, each at a multiple of `ASSETS_ALIGN` from the partition start
+ */
+#define ASSETS_MAGIC                (0x3141564C)    // "LVA1"
+#define ASSETS_VERSION              (1)
+#define ASSETS_ALIGN                (64)
+#define ASSETS_NAME_LEN             (32)
+#define ASSETS_TYPE_IMAGE           (0)
+#define ASSETS_TYPE_BLOB            (1)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;
+    uint32_t reserved;
+} __attribute__((packed)) assets_header_t;
+
+typedef struct {
+    char name[ASSETS_NAME_LEN];     // NUL terminated
+    uint32_t offset;                // From the partition start
+    uint32_t size;
+    uint8_t type;
+    uint8_t cf;                     // `lv_color_format_t` of an image
+    uint16_t w;
+    uint16_t h;
+    uint16_t stride;
+} __attribute__((packed)) assets_entry_t;
+
+_Static_assert(sizeof(assets_header_t) == 16, "Asset header layout differs from pack_assets.py");
+_Static_assert(sizeof(assets_entry_t) == 48, "Asset entry layout differs from pack_assets.py");
+
+static const uint8_t *assets_base = NULL;               // Partition mapped into the data address space
+static esp_partition_mmap_handle_t assets_mmap_handle;
+static const assets_entry_t *assets_table = NULL;       // Mapped as well, only the image descriptors are in RAM
+static lv_image_dsc_t *assets_images = NULL;            // One per entry, pointing at the mapped pixels
+static uint16_t assets_count = 0;
+
+static int assets_find(const char *name, uint8_t type)
+{
+    for (int i = 0; i < assets_count; i++) {
+        if ((assets_table[i].type == type) && (strncmp(assets_table[i].name, name, ASSETS_NAME_LEN) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Color formats the software renderer draws straight from the source, without a decoder copy
+static bool assets_image_valid(const assets_entry_t *entry)
+{
+    uint32_t min_size = (uint32_t)entry->stride * entry->h;
+
+    switch (entry->cf) {
+    case LV_COLOR_FORMAT_RGB565:
+        break;
+    case LV_COLOR_FORMAT_RGB565A8:
+        // Alpha plane after the color plane, LVGL reads it with half the color stride
+        min_size += (uint32_t)entry->stride / 2 * entry->h;
+        break;
+    default:
+        return false;
+    }
+
+    return (entry->w > 0) && (entry->h > 0) && (entry->stride >= entry->w * 2) && (entry->size >= min_size);
+}
+#endif
+
+#if LVGL_V9_PORT_HW_JPEG_ENABLE
+/*
+ * Hardware JPEG decoder, registered after `lv_init()` so LVGL tries it before the software decoders. It only
+ * accepts baseline JPEGs with a sampling the hardware knows, the info callback leaves everything else to them.
+ * The decoder writes whole MCUs, so the draw buffer is padded to the MCU size: the stride covers the padded
+ * width and the padded rows below the image are never drawn.
+ */
+#define HW_JPEG_DECODER_NAME        "HW_JPEG"
+#define HW_JPEG_TIMEOUT_MS          (100)
+#define HW_JPEG_HEADER_SCAN_MAX     (64 * 1024)     // EXIF thumbnails can put the frame header this far in
+
+#if LV_COLOR_DEPTH == 16
+#define HW_JPEG_COLOR_FORMAT        LV_COLOR_FORMAT_RGB565
+#define HW_JPEG_OUTPUT_FORMAT       JPEG_DECODE_OUT_FORMAT_RGB565
+#else
+#define HW_JPEG_COLOR_FORMAT        LV_COLOR_FORMAT_RGB888
+#define HW_JPEG_OUTPUT_FORMAT       JPEG_DECODE_OUT_FORMAT_RGB888
+#endif
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint8_t mcu_width;
+    uint8_t mcu_height;
+    bool gray;
+} hw_jpeg_header_t;
+
+static jpeg_decoder_handle_t hw_jpeg_engine = NULL;
+static lv_draw_buf_handlers_t hw_jpeg_buf_handlers;    // Decoded images, in PSRAM the decoder DMA can write
+static size_t hw_jpeg_align = 0;                        // Cache line, the output buffer and its size must be aligned
+
+static void *hw_jpeg_buf_malloc(size_t size, lv_color_format_t color_format)
+{
+    LV_UNUSED(color_format);
+
+    return heap_caps_aligned_calloc(hw_jpeg_align, 1, ALIGN_UP_BY(size, hw_jpeg_align),
+                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+}
+
+static void hw_jpeg_buf_free(void *buf)
+{
+    heap_caps_free(buf);
+}
+
+// Read from the JPEG source, the file is only open in the info callback
+static bool hw_jpeg_read(lv_image_decoder_dsc_t *dsc, uint32_t offset, void *buf, uint32_t len)
+{
+    if (dsc->src_type == LV_IMAGE_SRC_VARIABLE) {
+        const lv_image_dsc_t *img_dsc = dsc->src;
+        if ((offset > img_dsc->data_size) || (len > img_dsc->data_size - offset)) {
+            return false;
+        }
+        lv_memcpy(buf, img_dsc->data + offset, len);
+        return true;
+    }
+
+    uint32_t rn = 0;
+    return (lv_fs_seek(&dsc->file, offset, LV_FS_SEEK_SET) == LV_FS_RES_OK) &&
+           (lv_fs_read(&dsc->file, buf, len, &rn) == LV_FS_RES_OK) && (rn == len);
+}
+
+/**
+ * @brief Walk the markers up to the frame header
+ *
+ * @return false if the image is no JPEG or the hardware can't decode it: progressive, lossless, arithmetic coded or
+ *         with a chroma sampling other than 4:4:4, 4:2:2 and 4:2:0
+ *
+ */
+static bool hw_jpeg_parse_header(lv_image_decoder_dsc_t *dsc, hw_jpeg_header_t *header)
+{
+    uint8_t seg[10];
+
+    if (!hw_jpeg_read(dsc, 0, seg, 3) || (seg[0] != 0xFF) || (seg[1] != 0xD8) || (seg[2] != 0xFF)) {
+        return false;
+    }
+
+    uint32_t offset = 2;
+    while (offset < HW_JPEG_HEADER_SCAN_MAX) {
+        if (!hw_jpeg_read(dsc, offset, seg, 4) || (seg[0] != 0xFF)) {
+            return false;
+        }
+        const uint8_t marker = seg[1];
+        if (marker == 0xFF) {
+            // Fill byte before a marker
+            offset++;
+            continue;
+        }
+        if ((marker == 0xDA) || (marker == 0xD9)) {
+            // Scan or end of image without a frame header
+            return false;
+        }
+        if (marker == 0xC0) {
+            // Baseline frame header: length, precision, height, width, components, then id and sampling of each
+            if (!hw_jpeg_read(dsc, offset + 4, seg, 8) || (seg[0] != 8)) {
+                return false;
+            }
+            header->height = (seg[1] << 8) | seg[2];
+            header->width = (seg[3] << 8) | seg[4];
+            if ((header->width == 0) || (header->height == 0)) {
+                return false;
+            }
+            if (seg[5] == 1) {
+                header->gray = true;
+                header->mcu_width = 8;
+                header->mcu_height = 8;
+                return true;
+            }
+            if (seg[5] != 3) {
+                return false;
+            }
+            const uint8_t h = seg[7] >> 4;
+            const uint8_t v = seg[7] & 0x0F;
+            if (!((h == 1 && v == 1) || (h == 2 && v == 1) || (h == 2 && v == 2))) {
+                return false;
+            }
+            header->gray = false;
+            header->mcu_width = 8 * h;
+            header->mcu_height = 8 * v;
+            return true;
+        }
+        if ((marker >= 0xC1) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC)) {
+            // Another frame type, not for the hardware
+            return false;
+        }
+        offset += 2 + ((seg[2] << 8) | seg[3]);
+    }
+
+    return false;
+}
+
+static lv_result_t hw_jpeg_info(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc, lv_image_header_t *header)
+{
+    LV_UNUSED(decoder);
+
+    if (dsc->src_type == LV_IMAGE_SRC_VARIABLE) {
+        const lv_image_dsc_t *img_dsc = dsc->src;
+        if ((img_dsc->header.cf != LV_COLOR_FORMAT_RAW) && (img_dsc->header.cf != LV_COLOR_FORMAT_RAW_ALPHA)) {
+            return LV_RESULT_INVALID;
+        }
+    } else if (dsc->src_type != LV_IMAGE_SRC_FILE) {
+        return LV_RESULT_INVALID;
+    }
+
+    hw_jpeg_header_t jpeg;
+    if (!hw_jpeg_parse_header(dsc, &jpeg)) {
+        return LV_RESULT_INVALID;
+    }
+
+    const lv_color_format_t cf = jpeg.gray ? LV_COLOR_FORMAT_L8 : HW_JPEG_COLOR_FORMAT;
+    header->cf = cf;
+    header->w = jpeg.width;
+    header->h = jpeg.height;
+    header->stride = ALIGN_UP_BY(jpeg.width, jpeg.mcu_width) * lv_color_format_get_size(cf);
+
+    return LV_RESULT_OK;
+}
+
+// The whole bit stream in a buffer the decoder DMA can read, C arrays are usually in flash
+static uint8_t *hw_jpeg_load(lv_image_decoder_dsc_t *dsc, uint32_t *size)
+{
+    jpeg_decode_memory_alloc_cfg_t mem_cfg = {
+        .buffer_direction = JPEG_DEC_ALLOC_INPUT_BUFFER,
+    };
+    size_t allocated = 0;
+    uint8_t *buf = NULL;
+
+    if (dsc->src_type == LV_IMAGE_SRC_VARIABLE) {
+        const lv_image_dsc_t *img_dsc = dsc->src;
+        buf = jpeg_alloc_decoder_mem(img_dsc->data_size, &mem_cfg, &allocated);
+        if (buf) {
+            lv_memcpy(buf, img_dsc->data, img_dsc->data_size);
+            *size = img_dsc->data_size;
+        }
+        return buf;
+    }
+
+    lv_fs_file_t file;
+    uint32_t file_size = 0;
+    uint32_t rn = 0;
+    if (lv_fs_open(&file, dsc->src, LV_FS_MODE_RD) != LV_FS_RES_OK) {
+        return NULL;
+    }
+    if ((lv_fs_seek(&file, 0, LV_FS_SEEK_END) == LV_FS_RES_OK) && (lv_fs_tell(&file, &file_size) == LV_FS_RES_OK) &&
+            (lv_fs_seek(&file, 0, LV_FS_SEEK_SET) == LV_FS_RES_OK) && (file_size > 0)) {
+        buf = jpeg_alloc_decoder_mem(file_size, &mem_cfg, &allocated);
+    }
+    if (buf && ((lv_fs_read(&file, buf, file_size, &rn) != LV_FS_RES_OK) || (rn != file_size))) {
+        heap_caps_free(buf);
+        buf = NULL;
+    }
+    lv_fs_close(&file);
+    *size = file_size;
+
+    return buf;
+}
+
+static lv_result_t hw_jpeg_open(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc)
+{
+    const lv_image_header_t *header = &dsc->header;
+    const uint32_t padded_h = ALIGN_UP_BY(header->h, 16);
+
+    uint32_t in_size = 0;
+    uint8_t *in_buf = hw_jpeg_load(dsc, &in_size);
+    if (in_buf == NULL) {
+        ESP_LOGW(TAG, "Failed to load JPEG image");
+        return LV_RESULT_INVALID;
+    }
+
+    // Rows for the tallest MCU of any sampling, the header keeps the image height
+    lv_draw_buf_t *decoded = lv_draw_buf_create_ex(&hw_jpeg_buf_handlers, header->w, padded_h, header->cf,
+                                                   header->stride);
+    if (decoded == NULL) {
+        heap_caps_free(in_buf);
+        ESP_LOGW(TAG, "No memory for a %dx%d JPEG image", (int)header->w, (int)header->h);
+        return LV_RESULT_INVALID;
+    }
+    decoded->header.h = header->h;
+
+    jpeg_decode_cfg_t decode_cfg = {
+        .output_format = (header->cf == LV_COLOR_FORMAT_L8) ? JPEG_DECODE_OUT_FORMAT_GRAY : HW_JPEG_OUTPUT_FORMAT,
+        .rgb_order = JPEG_DEC_RGB_ELEMENT_ORDER_BGR,    // LVGL keeps the blue channel in the low bits
+        .conv_std = JPEG_YUV_RGB_CONV_STD_BT601,
+    };
+    uint32_t out_size = 0;
+    LV_PROFILER_BEGIN_TAG("lv_port_jpeg_decode");
+    // The driver invalidates the output from the cache, the CPU reads what the DMA wrote
+    esp_err_t ret = jpeg_decoder_process(hw_jpeg_engine, &decode_cfg, in_buf, in_size, decoded->data,
+                                         ALIGN_UP_BY(decoded->data_size, hw_jpeg_align), &out_size);
+    LV_PROFILER_END_TAG("lv_port_jpeg_decode");
+    heap_caps_free(in_buf);
+    if (ret != ESP_OK) {
+        lv_draw_buf_destroy(decoded);
+        ESP_LOGW(TAG, "Hardware JPEG decode failed: %s", esp_err_to_name(ret));
+        return LV_RESULT_INVALID;
+    }
+
+    dsc->decoded = decoded;
+    if (dsc->args.no_cache || !lv_image_cache_is_enabled()) {
+        return LV_RESULT_OK;
+    }
+
+    // Reused by every later open of the source until the cache evicts it
+    lv_image_cache_data_t search_key = {
+        .src_type = dsc->src_type,
+        .src = dsc->src,
+        .slot.size = decoded->data_size,
+    };
+    lv_cache_entry_t *entry = lv_image_decoder_add_to_cache(decoder, &search_key, decoded, NULL);
+    if (entry == NULL) {
+        lv_draw_buf_destroy(decoded);
+        dsc->decoded = NULL;
+        return LV_RESULT_INVALID;
+    }
+    dsc->cache_entry = entry;
+
+    return LV_RESULT_OK;
+}
+
+static void hw_jpeg_close(lv_image_decoder_t *decoder, lv_image_decoder_dsc_t *dsc)
+{
+    LV_UNUSED(decoder);
+
+    // A cached image is freed by the cache
+    if (dsc->args.no_cache || !lv_image_cache_is_enabled()) {
+        lv_draw_buf_destroy((lv_draw_buf_t *)dsc->decoded);
+    }
+}
+
+static void hw_jpeg_init(void)
+{
+    jpeg_decode_engine_cfg_t engine_cfg = {
+        .intr_priority = 0,
+        .timeout_ms = HW_JPEG_TIMEOUT_MS,
+    };
+    ESP_ERROR_CHECK(jpeg_new_decoder_engine(&engine_cfg, &hw_jpeg_engine));
+    ESP_ERROR_CHECK(esp_cache_get_alignment(MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA, &hw_jpeg_align));
+    hw_jpeg_align = LV_MAX(hw_jpeg_align, LV_DRAW_BUF_ALIGN);
+
+    lv_draw_buf_handlers_t *image_handlers = lv_draw_buf_get_image_handlers();
+    lv_draw_buf_handlers_init(&hw_jpeg_buf_handlers, hw_jpeg_buf_malloc, hw_jpeg_buf_free,
+                              image_handlers->align_pointer_cb, image_handlers->invalidate_cache_cb,
+                              image_handlers->flush_cache_cb, image_handlers->width_to_stride_cb);
+
+    lv_image_decoder_t *decoder = lv_image_decoder_create();
+    assert(decoder);
+    lv_image_decoder_set_info_cb(decoder, hw_jpeg_info);
+    lv_image_decoder_set_open_cb(decoder, hw_jpeg_open);
+    lv_image_decoder_set_close_cb(decoder, hw_jpeg_close);
+    decoder->name = HW_JPEG_DECODER_NAME;
+    ESP_LOGI(TAG, "Hardware JPEG decoder registered");
+}
+#endif
+
+#if LV_USE_SNAPSHOT
+/*
+ * Cached layers. A container with a static subtree is drawn once into a PSRAM snapshot, then every refresh blits
+ * the snapshot in `LV_EVENT_DRAW_MAIN` instead of drawing the container, and its children are skipped by a zero
+ * layered opacity. The children keep their place in the layout, so hit-testing and scrolling are unchanged.
+ */
+static void layer_cache_event_cb(lv_event_t *e);
+
+static layer_cache_t *layer_cache_get(lv_obj_t *obj)
+{
+    const uint32_t count = lv_obj_get_event_count(obj);
+    for (uint32_t i = 0; i < count; i++) {
+        lv_event_dsc_t *dsc = lv_obj_get_event_dsc(obj, i);
+        if (lv_event_dsc_get_cb(dsc) == layer_cache_event_cb) {
+            return lv_event_dsc_get_user_data(dsc);
+        }
+    }
+    return NULL;
+}
+
+static void layer_cache_hide_children(lv_obj_t *obj, bool hide)
+{
+    const uint32_t count = lv_obj_get_child_count(obj);
+    for (uint32_t i = 0; i < count; i++) {
+        lv_obj_t *child = lv_obj_get_child(obj, i);
+        lv_obj_remove_style(child, &layer_cache_hidden_style, LV_PART_MAIN);
+        if (hide) {
+            lv_obj_add_style(child, &layer_cache_hidden_style, LV_PART_MAIN);
+        }
+    }
+}
+
+/* A container covering its whole snapshot is blitted as a plain copy, otherwise blended from ARGB8888 */
+static bool layer_cache_is_opaque(lv_obj_t *obj, int32_t ext_size)
+{
+    return (ext_size == 0) && (lv_obj_get_style_radius(obj, LV_PART_MAIN) == 0) &&
+           (lv_obj_get_style_bg_opa(obj, LV_PART_MAIN) >= LV_OPA_MAX) &&
+           (lv_obj_get_style_opa(obj, LV_PART_MAIN) >= LV_OPA_MAX);
+}
+
+static esp_err_t layer_cache_take(lv_obj_t *obj, layer_cache_t *cache)
+{
+    lv_obj_update_layout(obj);
+    const int32_t ext_size = lv_obj_get_ext_draw_size(obj);
+    const int32_t w = lv_obj_get_width(obj) + ext_size * 2;
+    const int32_t h = lv_obj_get_height(obj) + ext_size * 2;
+    if ((w <= 0) || (h <= 0)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const lv_color_format_t cf = layer_cache_is_opaque(obj, ext_size) ?
+                                 lv_display_get_color_format(lv_obj_get_display(obj)) : LV_COLOR_FORMAT_ARGB8888;
+    const uint32_t stride = lv_draw_buf_width_to_stride(w, cf);
+    const size_t size = (size_t)stride * h;
+    if (size > cache->snapshot_mem_size) {
+        // The old snapshot stays drawn if the larger one doesn't fit
+        void *mem = heap_caps_aligned_calloc(LV_DRAW_BUF_ALIGN, 1, size, MALLOC_CAP_SPIRAM);
+        if (!mem) {
+            ESP_LOGE(TAG, "No memory for a %dx%d layer cache", (int)w, (int)h);
+            return ESP_ERR_NO_MEM;
+        }
+        lv_image_cache_drop(&cache->snapshot);
+        heap_caps_free(cache->snapshot_mem);
+        cache->snapshot_mem = mem;
+        cache->snapshot_mem_size = size;
+    }
+    if (lv_draw_buf_init(&cache->snapshot, w, h, cf, stride, cache->snapshot_mem, cache->snapshot_mem_size) !=
+            LV_RESULT_OK) {
+        return ESP_FAIL;
+    }
+    // The snapshot is an image source, a stale decoded copy of it must not be drawn
+    lv_image_cache_drop(&cache->snapshot);
+
+    layer_cache_hide_children(obj, false);
+    cache->taking = true;
+    const lv_result_t res = lv_snapshot_take_to_draw_buf(obj, cf, &cache->snapshot);
+    cache->taking = false;
+    layer_cache_hide_children(obj, true);
+    cache->ext_size = ext_size;
+
+    lv_obj_invalidate(obj);
+    return (res == LV_RESULT_OK) ? ESP_OK : ESP_FAIL;
+}
+
+static void layer_cache_async_update(void *obj)
+{
+    if (lvgl_v9_port_layer_cache_update(obj) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to update a layer cache");
+    }
+}
+
+static void layer_cache_free(lv_obj_t *obj, layer_cache_t *cache)
+{
+    lv_async_call_cancel(layer_cache_async_update, obj);
+    lv_image_cache_drop(&cache->snapshot);
+    heap_caps_free(cache->snapshot_mem);
+    heap_caps_free(cache);
+}
+
+static void layer_cache_event_cb(lv_event_t *e)
+{
+    lv_obj_t *obj = lv_event_get_current_target(e);
+    layer_cache_t *cache = lv_event_get_user_data(e);
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_DRAW_MAIN: {
+        if (cache->taking) {
+            break;
+        }
+        lv_area_t area;
+        lv_obj_get_coords(obj, &area);
+        area.x1 -= cache->ext_size;
+        area.y1 -= cache->ext_size;
+        area.x2 = area.x1 + cache->snapshot.header.w - 1;
+        area.y2 = area.y1 + cache->snapshot.header.h - 1;
+
+        lv_draw_image_dsc_t dsc;
+        lv_draw_image_dsc_init(&dsc);
+        dsc.src = &cache->snapshot;
+        lv_draw_image(lv_event_get_layer(e), &dsc, &area);
+        lv_event_stop_processing(e);
+        break;
+    }
+    case LV_EVENT_DRAW_POST:
+        // Scrollbars and other post drawing are part of the snapshot
+        if (!cache->taking) {
+            lv_event_stop_processing(e);
+        }
+        break;
+    case LV_EVENT_SIZE_CHANGED:
+    case LV_EVENT_STYLE_CHANGED:
+    case LV_EVENT_CHILD_CHANGED:
+    case LV_EVENT_CHILD_CREATED:
+    case LV_EVENT_CHILD_DELETED:
+    case LV_EVENT_SCROLL:
+        // Retaken once the change is laid out, outside of the refresh
+        if (!cache->taking) {
+            lv_async_call_cancel(layer_cache_async_update, obj);
+            lv_async_call(layer_cache_async_update, obj);
+        }
+        break;
+    case LV_EVENT_DELETE:
+        layer_cache_free(obj, cache);
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+#if LVGL_V9_PORT_SCROLL_BLIT_ENABLE
+/*
+ * Scroll blits. When a registered container scrolls, the content it has drawn is already in the LVGL buffer, only
+ * at the old scroll position. The PPA moves it before the rendering starts and the container's invalidation is
+ * reduced to the strip scrolled into view. Whatever doesn't move with the content, such as scrollbars, the border
+ * and widgets drawn above, is invalidated at both positions in `scroll_blit_refr_start()`.
+ */
+static scroll_blit_t *scroll_blit_get(const lv_obj_t *obj)
+{
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        if (scroll_blits[i].obj == obj) {
+            return &scroll_blits[i];
+        }
+    }
+    return NULL;
+}
+
+/* The container must look the same wherever its content doesn't cover it, and reach the screen untransformed */
+static bool scroll_blit_is_plain(lv_obj_t *obj)
+{
+    if ((lv_obj_get_style_bg_opa(obj, LV_PART_MAIN) < LV_OPA_MAX) ||
+            (lv_obj_get_style_bg_grad_dir(obj, LV_PART_MAIN) != LV_GRAD_DIR_NONE) ||
+            (lv_obj_get_style_bg_image_src(obj, LV_PART_MAIN) != NULL)) {
+        return false;
+    }
+    for (lv_obj_t *o = obj; o; o = lv_obj_get_parent(o)) {
+        if ((lv_obj_get_style_opa(o, LV_PART_MAIN) < LV_OPA_MAX) ||
+                (lv_obj_get_style_opa_layered(o, LV_PART_MAIN) < LV_OPA_MAX) ||
+                (lv_obj_get_style_blend_mode(o, LV_PART_MAIN) != LV_BLEND_MODE_NORMAL) ||
+                (lv_obj_get_style_transform_rotation(o, LV_PART_MAIN) != 0) ||
+                (lv_obj_get_style_transform_scale_x(o, LV_PART_MAIN) != LV_SCALE_NONE) ||
+                (lv_obj_get_style_transform_scale_y(o, LV_PART_MAIN) != LV_SCALE_NONE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool scroll_blit_clip_visible(lv_obj_t *obj, lv_area_t *area)
+{
+    lv_display_t *disp = lv_obj_get_display(obj);
+    const lv_area_t scr_area = {
+        0, 0, lv_display_get_horizontal_resolution(disp) - 1, lv_display_get_vertical_resolution(disp) - 1
+    };
+    return lv_obj_area_is_visible(obj, area) && lv_area_intersect(area, area, &scr_area);
+}
+
+/* Visible part of the container inside the border, and along the scroll axis inside the rounded corners */
+static bool scroll_blit_get_area(lv_obj_t *obj, bool vertical, lv_area_t *area)
+{
+    lv_obj_get_coords(obj, area);
+    const int32_t border = lv_obj_get_style_border_width(obj, LV_PART_MAIN);
+    const int32_t radius = LV_MIN(lv_obj_get_style_radius(obj, LV_PART_MAIN),
+                                  LV_MIN(lv_area_get_width(area), lv_area_get_height(area)) / 2);
+    const int32_t end = LV_MAX(border, radius);
+    lv_area_increase(area, vertical ? -border : -end, vertical ? -end : -border);
+
+    return (lv_area_get_width(area) > 0) && (lv_area_get_height(area) > 0) && scroll_blit_clip_visible(obj, area);
+}
+
+/* `area` without the rows or columns the content is moved out of, or the part a move by (dx, dy) writes */
+static void scroll_blit_get_moved(const lv_area_t *area, int32_t dx, int32_t dy, lv_area_t *moved)
+{
+    *moved = *area;
+    if (dx > 0) {
+        moved->x1 += dx;
+    } else {
+        moved->x2 += dx;
+    }
+    if (dy > 0) {
+        moved->y1 += dy;
+    } else {
+        moved->y2 += dy;
+    }
+}
+
+/* Invalidate what the move takes `area` of this frame to, the content from there comes from `area` */
+static void scroll_blit_invalidate_moved(lv_display_t *disp, const scroll_blit_t *s, const lv_area_t *area)
+{
+    lv_area_t moved = *area;
+    lv_area_move(&moved, s->dx, s->dy);
+    if (lv_area_intersect(&moved, &moved, &s->area)) {
+        lv_inv_area(disp, &moved);
+    }
+}
+
+/* Something drawn at `area` in both frames, the move leaves a copy of it next to it */
+static void scroll_blit_invalidate_fixed(lv_display_t *disp, const scroll_blit_t *s, const lv_area_t *area)
+{
+    lv_area_t fixed;
+    if (lv_area_intersect(&fixed, area, &s->area)) {
+        lv_inv_area(disp, &fixed);
+        scroll_blit_invalidate_moved(disp, s, &fixed);
+    }
+}
+
+static void scroll_blit_invalidate_obj_fixed(lv_display_t *disp, const scroll_blit_t *s, lv_obj_t *obj)
+{
+    if (lv_obj_has_flag(obj, LV_OBJ_FLAG_HIDDEN)) {
+        return;
+    }
+    lv_area_t area;
+    lv_obj_get_coords(obj, &area);
+    const int32_t ext_size = lv_obj_get_ext_draw_size(obj);
+    lv_area_increase(&area, ext_size, ext_size);
+    scroll_blit_invalidate_fixed(disp, s, &area);
+}
+
+static void scroll_blit_invalidate_above(lv_display_t *disp, const scroll_blit_t *s)
+{
+    lv_obj_t *obj = s->obj;
+    const bool vertical = (s->dx == 0);
+    lv_area_t hor;
+    lv_area_t ver;
+
+    // A scrollbar moves along its own column or row, the one across the scroll direction stays
+    lv_obj_get_scrollbar_area(obj, &hor, &ver);
+    if (vertical) {
+        ver.y1 = s->area.y1;
+        ver.y2 = s->area.y2;
+    } else {
+        hor.x1 = s->area.x1;
+        hor.x2 = s->area.x2;
+    }
+    scroll_blit_invalidate_fixed(disp, s, &hor);
+    scroll_blit_invalidate_fixed(disp, s, &ver);
+
+    const uint32_t child_cnt = lv_obj_get_child_count(obj);
+    for (uint32_t i = 0; i < child_cnt; i++) {
+        lv_obj_t *child = lv_obj_get_child(obj, i);
+        if (lv_obj_has_flag(child, LV_OBJ_FLAG_FLOATING)) {
+            scroll_blit_invalidate_obj_fixed(disp, s, child);
+        }
+    }
+
+    // Later siblings of the container and of its ancestors, and the scrollbars of the ancestors
+    for (lv_obj_t *o = obj, *parent = lv_obj_get_parent(o); parent; o = parent, parent = lv_obj_get_parent(o)) {
+        const uint32_t cnt = lv_obj_get_child_count(parent);
+        for (uint32_t i = lv_obj_get_index(o) + 1; i < cnt; i++) {
+            scroll_blit_invalidate_obj_fixed(disp, s, lv_obj_get_child(parent, i));
+        }
+        lv_obj_get_scrollbar_area(parent, &hor, &ver);
+        scroll_blit_invalidate_fixed(disp, s, &hor);
+        scroll_blit_invalidate_fixed(disp, s, &ver);
+    }
+
+    // The layers above the container's screen
+    lv_obj_t *layers[] = { lv_display_get_layer_top(disp), lv_display_get_layer_sys(disp) };
+    const lv_obj_t *scr = lv_obj_get_screen(obj);
+    for (int l = (scr == layers[1]) ? 2 : (scr == layers[0]) ? 1 : 0; l < 2; l++) {
+        const uint32_t cnt = lv_obj_get_child_count(layers[l]);
+        for (uint32_t i = 0; i < cnt; i++) {
+            scroll_blit_invalidate_obj_fixed(disp, s, lv_obj_get_child(layers[l], i));
+        }
+    }
+}
+
+/* Decide whether the move pays off in this refresh, anything invalidated from here on is rendered */
+static void scroll_blit_refr_start(lv_display_t *disp)
+{
+    bool moved = false;
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        moved |= scroll_blits[i].obj && (scroll_blits[i].dx || scroll_blits[i].dy);
+    }
+    if (!moved) {
+        return;
+    }
+
+    // Lay out now instead of right after this event, so what the layout moves is handled below as well
+    lv_obj_update_layout(disp->act_scr);
+    lv_obj_update_layout(disp->top_layer);
+    lv_obj_update_layout(disp->sys_layer);
+
+    scroll_blit_deciding = true;
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        scroll_blit_t *s = &scroll_blits[i];
+        if (!s->obj || (!s->dx && !s->dy)) {
+            continue;
+        }
+
+        lv_area_t coords;
+        lv_obj_get_coords(s->obj, &coords);
+        if (s->fallback || !lv_area_is_equal(&coords, &s->coords)) {
+            // The scrolls before the fallback may have invalidated their strips only
+            s->fallback = true;
+            lv_obj_invalidate(s->obj);
+            continue;
+        }
+
+        /*
+         * The change is rendered where the content it was made to is now, and where the move takes what was at its
+         * place in the last frame, in case it doesn't scroll with the content
+         */
+        for (int j = 0; j < s->change_cnt; j++) {
+            lv_area_t area = s->changes[j].area;
+            lv_area_move(&area, -s->changes[j].dx, -s->changes[j].dy);
+            scroll_blit_invalidate_moved(disp, s, &area);
+            scroll_blit_invalidate_moved(disp, s, &s->changes[j].area);
+        }
+        scroll_blit_invalidate_above(disp, s);
+
+        // The border and rounded ends are rendered, the content may be drawn over them
+        lv_area_t visible = coords;
+        lv_area_t frame[4];
+        if (scroll_blit_clip_visible(s->obj, &visible)) {
+            const int8_t frame_cnt = lv_area_diff(frame, &visible, &s->area);
+            for (int8_t j = 0; j < frame_cnt; j++) {
+                lv_inv_area(disp, &frame[j]);
+            }
+        }
+
+        // Nothing to save if the whole part is rendered anyway, e.g. after the invalidated areas ran out
+        s->blit = true;
+        for (uint32_t j = 0; j < disp->inv_p; j++) {
+            if (lv_area_is_in(&s->area, &disp->inv_areas[j], 0)) {
+                s->blit = false;
+                break;
+            }
+        }
+
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0
+        const size_t scratch_size = ALIGN_UP_BY((size_t)lv_area_get_size(&s->area) * SCROLL_BLIT_PIXEL_SIZE,
+                                                scroll_blit_cache_line);
+        if (s->blit && (scratch_size > scroll_blit_scratch_size)) {
+            heap_caps_free(scroll_blit_scratch);
+            scroll_blit_scratch = heap_caps_aligned_calloc(scroll_blit_cache_line, 1, scratch_size,
+                                                           MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+            scroll_blit_scratch_size = scroll_blit_scratch ? scratch_size : 0;
+            if (!scroll_blit_scratch) {
+                ESP_LOGW(TAG, "No memory to move a scrolled container, rendering it");
+                s->blit = false;
+                s->fallback = true;
+                lv_obj_invalidate(s->obj);
+            }
+        }
+#else
+        // The blit and the rendering write all of the part, LVGL needn't copy into it from the other buffer
+        if (s->blit) {
+            lv_area_t *sync_area = lv_ll_get_head(&disp->sync_areas);
+            while (sync_area) {
+                lv_area_t *next_area = lv_ll_get_next(&disp->sync_areas, sync_area);
+                if (lv_area_is_in(sync_area, &s->area, 0)) {
+                    lv_ll_remove(&disp->sync_areas, sync_area);
+                    lv_free(sync_area);
+                }
+                sync_area = next_area;
+            }
+        }
+#endif
+    }
+    scroll_blit_deciding = false;
+}
+
+/* Copy `block` of `in` to (out_x, out_y) of `out`, both in the display color format */
+static void scroll_blit_copy(const void *in, int32_t in_w, int32_t in_h, const lv_area_t *block,
+                             void *out, int32_t out_w, int32_t out_h, int32_t out_x, int32_t out_y)
+{
+    // The PPA invalidates the rows it writes, what the CPU left in them must reach the memory first
+    const size_t row_size = (size_t)out_w * SCROLL_BLIT_PIXEL_SIZE;
+    ESP_ERROR_CHECK(esp_cache_msync((uint8_t *)out + out_y * row_size, lv_area_get_height(block) * row_size,
+                                    ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED));
+
+    ppa_srm_oper_config_t oper_config = {
+        .in.buffer = in,
+        .in.pic_w = in_w,
+        .in.pic_h = in_h,
+        .in.block_w = lv_area_get_width(block),
+        .in.block_h = lv_area_get_height(block),
+        .in.block_offset_x = block->x1,
+        .in.block_offset_y = block->y1,
+        .in.srm_cm = (LV_COLOR_DEPTH == 24) ? PPA_SRM_COLOR_MODE_RGB888 : PPA_SRM_COLOR_MODE_RGB565,
+
+        .out.buffer = out,
+        .out.buffer_size = ALIGN_UP_BY(row_size * out_h, scroll_blit_cache_line),
+        .out.pic_w = out_w,
+        .out.pic_h = out_h,
+        .out.block_offset_x = out_x,
+        .out.block_offset_y = out_y,
+        .out.srm_cm = (LV_COLOR_DEPTH == 24) ? PPA_SRM_COLOR_MODE_RGB888 : PPA_SRM_COLOR_MODE_RGB565,
+
+        .rotation_angle = PPA_SRM_ROTATION_ANGLE_0,
+        .scale_x = 1.0,
+        .scale_y = 1.0,
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+    ESP_ERROR_CHECK(ppa_do_scale_rotate_mirror(scroll_blit_ppa, &oper_config));
+}
+
+static void scroll_blit_render_start(lv_display_t *disp)
+{
+    const int32_t hor_res = lv_display_get_horizontal_resolution(disp);
+    const int32_t ver_res = lv_display_get_vertical_resolution(disp);
+
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        scroll_blit_t *s = &scroll_blits[i];
+        if (!s->obj || !s->blit) {
+            continue;
+        }
+
+        PORT_TRACE_BEGIN("lv_port_scroll_blit", copy);
+        lv_area_t dst;
+        lv_area_t src;
+        scroll_blit_get_moved(&s->area, s->dx, s->dy, &dst);
+        src = dst;
+        lv_area_move(&src, -s->dx, -s->dy);
+#if EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 0
+        // The buffers are already swapped, the one on screen has the last frame
+        lv_draw_buf_t *on_screen = (disp->buf_act == disp->buf_1) ? disp->buf_2 : disp->buf_1;
+        scroll_blit_copy(on_screen->data, hor_res, ver_res, &src, disp->buf_act->data, hor_res, ver_res,
+                         dst.x1, dst.y1);
+
+        // The next refresh copies the part to the other buffer, unless it moves it again
+        lv_area_t *sync_area = lv_ll_ins_tail(&disp->sync_areas);
+        assert(sync_area);
+        *sync_area = s->area;
+#else
+        // The PPA can't move within a buffer, the block goes through the scratch buffer
+        const int32_t w = lv_area_get_width(&src);
+        const int32_t h = lv_area_get_height(&src);
+        const lv_area_t scratch_area = { 0, 0, w - 1, h - 1 };
+        scroll_blit_copy(disp->buf_act->data, hor_res, ver_res, &src, scroll_blit_scratch, w, h, 0, 0);
+        scroll_blit_copy(scroll_blit_scratch, w, h, &scratch_area, disp->buf_act->data, hor_res, ver_res,
+                         dst.x1, dst.y1);
+
+        // Every LCD frame buffer misses the moved content
+        for (int fb = 0; fb < LVGL_V9_PORT_LCD_BUFFER_NUMS; fb++) {
+            flush_dirty_add(&lcd_fb_dirty[fb], &dst);
+        }
+#endif
+        PORT_TRACE_END("lv_port_scroll_blit", copy);
+    }
+}
+
+static void scroll_blit_refr_ready(lv_display_t *disp)
+{
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        scroll_blit_t *s = &scroll_blits[i];
+        if (!s->obj) {
+            continue;
+        }
+
+        // Rendering leaves every visible widget in the buffer as it is now
+        lv_area_t visible;
+        lv_obj_get_coords(s->obj, &s->coords);
+        visible = s->coords;
+        s->drawn = !disp->prev_scr && scroll_blit_clip_visible(s->obj, &visible);
+        s->scroll_x = lv_obj_get_scroll_x(s->obj);
+        s->scroll_y = lv_obj_get_scroll_y(s->obj);
+        s->dx = 0;
+        s->dy = 0;
+        s->armed = false;
+        s->fallback = false;
+        s->blit = false;
+        s->change_cnt = 0;
+    }
+}
+
+static void scroll_blit_invalidate_area(lv_area_t *area)
+{
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        scroll_blit_t *s = &scroll_blits[i];
+        if (s->obj && s->armed && lv_area_is_in(&s->area, area, 0)) {
+            *area = s->strip;
+            s->armed = false;
+            return;
+        }
+    }
+    if (scroll_blit_deciding) {
+        return;
+    }
+
+    // Where the content under a change comes from in the last frame depends on the scroll position of the change
+    for (int i = 0; i < SCROLL_BLIT_MAX_OBJS; i++) {
+        scroll_blit_t *s = &scroll_blits[i];
+        lv_area_t changed;
+        if (!s->obj || !s->drawn || s->fallback || !lv_area_intersect(&changed, area, &s->coords)) {
+            continue;
+        }
+        if (s->change_cnt == LV_INV_BUF_SIZE) {
+            s->fallback = true;
+            continue;
+        }
+        s->changes[s->change_cnt++] = (scroll_blit_change_t) {
+            changed, s->dx, s->dy
+        };
+    }
+}
+
+static void scroll_blit_display_event_cb(lv_event_t *e)
+{
+    lv_display_t *disp = lv_event_get_target(e);
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_INVALIDATE_AREA:
+        scroll_blit_invalidate_area(lv_event_get_param(e));
+        break;
+    case LV_EVENT_REFR_START:
+        scroll_blit_refr_start(disp);
+        break;
+    case LV_EVENT_RENDER_START:
+        scroll_blit_render_start(disp);
+        break;
+    case LV_EVENT_REFR_READY:
+        scroll_blit_refr_ready(disp);
+        break;
+    default:
+        break;
+    }
+}
+
+static void scroll_blit_event_cb(lv_event_t *e)
+{
+    lv_obj_t *obj = lv_event_get_current_target(e);
+    scroll_blit_t *s = lv_event_get_user_data(e);
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_SCROLL: {
+        // `lv_obj_scroll_by_raw()` invalidates the container right after this event
+        s->dx = s->scroll_x - lv_obj_get_scroll_x(obj);
+        s->dy = s->scroll_y - lv_obj_get_scroll_y(obj);
+        s->armed = false;
+        if (s->fallback || (!s->dx && !s->dy)) {
+            break;
+        }
+
+        const bool vertical = (s->dx == 0);
+        lv_area_t coords;
+        lv_obj_get_coords(obj, &coords);
+        if (!s->drawn || (s->dx && s->dy) || !lv_area_is_equal(&coords, &s->coords) ||
+                lv_obj_get_display(obj)->prev_scr || !scroll_blit_is_plain(obj) ||
+                !scroll_blit_get_area(obj, vertical, &s->area) ||
+                (LV_ABS(s->dx) >= lv_area_get_width(&s->area)) || (LV_ABS(s->dy) >= lv_area_get_height(&s->area))) {
+            // Diagonal, farther than the container is large, or nothing to move from
+            s->fallback = true;
+            break;
+        }
+
+        lv_area_t moved;
+        scroll_blit_get_moved(&s->area, s->dx, s->dy, &moved);
+        s->strip = s->area;
+        if (s->dx > 0) {
+            s->strip.x2 = moved.x1 - 1;
+        } else if (s->dx < 0) {
+            s->strip.x1 = moved.x2 + 1;
+        } else if (s->dy > 0) {
+            s->strip.y2 = moved.y1 - 1;
+        } else {
+            s->strip.y1 = moved.y2 + 1;
+        }
+        s->armed = true;
+        break;
+    }
+    case LV_EVENT_DELETE:
+        *s = (scroll_blit_t) {
+            0
+        };
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+#if LVGL_V9_PORT_DUAL_HEAP_ENABLE
+/*
+ * LVGL allocator (`LV_STDLIB_CUSTOM`). Objects, style properties, draw tasks and timers are small and walked on
+ * every refresh, so they live in a TLSF pool in internal RAM. Draw buffers, layers and decoded images are large and
+ * streamed, so they go to PSRAM.
+ */
+static inline bool dual_heap_is_internal(const void *p)
+{
+    return ((const uint8_t *)p >= dual_heap_internal_start) && ((const uint8_t *)p < dual_heap_internal_end);
+}
+
+static void dual_heap_update_max_used(void)
+{
+    const size_t used = (dual_heap_internal_end - dual_heap_internal_start) - multi_heap_free_size(dual_heap_internal);
+    dual_heap_max_used = LV_MAX(dual_heap_max_used, used);
+}
+
+static void *dual_heap_malloc(size_t size)
+{
+    void *p = NULL;
+
+    if (size <= LVGL_V9_PORT_DUAL_HEAP_SMALL_SIZE) {
+        lv_mutex_lock(&dual_heap_mutex);
+        p = multi_heap_malloc(dual_heap_internal, size);
+        if (p) {
+            dual_heap_update_max_used();
+        }
+        lv_mutex_unlock(&dual_heap_mutex);
+    }
+    if (p == NULL) {
+        // Large allocations, and small ones once the pool is full
+        p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+
+    return p;
+}
+
+void lv_mem_init(void)
+{
+    lv_mutex_init(&dual_heap_mutex);
+
+    dual_heap_internal_start = heap_caps_malloc(LVGL_V9_PORT_DUAL_HEAP_INTERNAL_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(dual_heap_internal_start);
+    dual_heap_internal_end = dual_heap_internal_start + LVGL_V9_PORT_DUAL_HEAP_INTERNAL_SIZE;
+    dual_heap_internal = multi_heap_register(dual_heap_internal_start, LVGL_V9_PORT_DUAL_HEAP_INTERNAL_SIZE);
+    assert(dual_heap_internal);
+    ESP_LOGI(TAG, "LVGL heap: %dKB internal pool for allocations up to %d bytes, PSRAM for the rest",
+             LVGL_V9_PORT_DUAL_HEAP_INTERNAL_SIZE / 1024, LVGL_V9_PORT_DUAL_HEAP_SMALL_SIZE);
+}
+
+void lv_mem_deinit(void)
+{
+    heap_caps_free(dual_heap_internal_start);
+    dual_heap_internal = NULL;
+    dual_heap_internal_start = NULL;
+    dual_heap_internal_end = NULL;
+    lv_mutex_delete(&dual_heap_mutex);
+}
+
+lv_mem_pool_t lv_mem_add_pool(void *mem, size_t bytes)
+{
+    /*Not supported*/
+    LV_UNUSED(mem);
+    LV_UNUSED(bytes);
+    return NULL;
+}
+
+void lv_mem_remove_pool(lv_mem_pool_t pool)
+{
+    /*Not supported*/
+    LV_UNUSED(pool);
+}
+
+void *lv_malloc_core(size_t size)
+{
+    return dual_heap_malloc(size);
+}
+
+void *lv_realloc_core(void *p, size_t new_size)
+{
+    if (!dual_heap_is_internal(p)) {
+        // Buffers that grow stay in PSRAM, only a new allocation moves back to the pool
+        return heap_caps_realloc(p, new_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+
+    void *p_new = NULL;
+    lv_mutex_lock(&dual_heap_mutex);
+    const size_t old_size = multi_heap_get_allocated_size(dual_heap_internal, p);
+    if (new_size <= LVGL_V9_PORT_DUAL_HEAP_SMALL_SIZE) {
+        p_new = multi_heap_realloc(dual_heap_internal, p, new_size);
+        if (p_new) {
+            dual_heap_update_max_used();
+        }
+    }
+    lv_mutex_unlock(&dual_heap_mutex);
+    if (p_new) {
+        return p_new;
+    }
+
+    // Grown past the small size or the pool is full, move it to PSRAM
+    p_new = heap_caps_malloc(new_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p_new) {
+        lv_memcpy(p_new, p, LV_MIN(old_size, new_size));
+        lv_free_core(p);
+    }
+
+    return p_new;
+}
+
+void lv_free_core(void *p)
+{
+    if (dual_heap_is_internal(p)) {
+        lv_mutex_lock(&dual_heap_mutex);
+        multi_heap_free(dual_heap_internal, p);
+        lv_mutex_unlock(&dual_heap_mutex);
+    } else {
+        heap_caps_free(p);
+    }
+}
+
+void lv_mem_monitor_core(lv_mem_monitor_t *mon_p)
+{
+    // Only the internal pool, PSRAM is shared with the rest of the application, see `heap_caps_print_heap_info()`
+    multi_heap_info_t info;
+    lv_mutex_lock(&dual_heap_mutex);
+    multi_heap_get_info(dual_heap_internal, &info);
+    mon_p->max_used = dual_heap_max_used;
+    lv_mutex_unlock(&dual_heap_mutex);
+
+    mon_p->total_size = LVGL_V9_PORT_DUAL_HEAP_INTERNAL_SIZE;
+    mon_p->free_cnt = info.free_blocks;
+    mon_p->free_size = info.total_free_bytes;
+    mon_p->free_biggest_size = info.largest_free_block;
+    mon_p->used_cnt = info.allocated_blocks;
+    mon_p->used_pct = 100 - (uint64_t)100U * mon_p->free_size / mon_p->total_size;
+    mon_p->frag_pct = (mon_p->free_size > 0) ? (100 - (uint64_t)mon_p->free_biggest_size * 100U / mon_p->free_size) : 0;
+}
+
+lv_result_t lv_mem_test_core(void)
+{
+    lv_mutex_lock(&dual_heap_mutex);
+    const bool ok = multi_heap_check(dual_heap_internal, true);
+    lv_mutex_unlock(&dual_heap_mutex);
+
+    return ok ? LV_RESULT_OK : LV_RESULT_INVALID;
+}
+#endif
+
+#if LVGL_V9_PORT_PROFILE_OVERLAY
+static void profile_refr_event_cb(lv_event_t *e)
+{
+    lv_display_t *disp = lv_event_get_target(e);
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        port_profile.refr_start_us = esp_timer_get_time();
+        port_profile.refr_rendered = false;
+        break;
+    case LV_EVENT_RENDER_READY:
+        // The invalidated areas are still there, joined ones are part of another area
+        for (int i = 0; i < disp->inv_p; i++) {
+            if (disp->inv_area_joined[i] == 0) {
+                port_profile.dirty_px += lv_area_get_size(&disp->inv_areas[i]);
+            }
+        }
+        port_profile.refr_rendered = true;
+        break;
+    case LV_EVENT_REFR_READY:
+        if (port_profile.refr_rendered) {
+            port_profile.refr_us += esp_timer_get_time() - port_profile.refr_start_us;
+            port_profile.frames++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void profile_overlay_timer_cb(lv_timer_t *timer)
+{
+    lvgl_v9_port_profile_t *p = &port_profile;
+
+    if (p->frames > 0) {
+        // Rendering is what the refresh spent outside the flush callback, including layout
+        const uint32_t render_us = (p->refr_us - p->flush_us) / p->frames;
+        const uint32_t copy_us = p->copy_us / p->frames;
+        const uint32_t vsync_us = p->vsync_us / p->frames;
+        lv_label_set_text_fmt(p->label, "render %u.%u ms\ncopy   %u.%u ms\nvsync  %u.%u ms\ndirty  %u px\n%u frames",
+                              (unsigned)(render_us / 1000), (unsigned)(render_us % 1000 / 100),
+                              (unsigned)(copy_us / 1000), (unsigned)(copy_us % 1000 / 100),
+                              (unsigned)(vsync_us / 1000), (unsigned)(vsync_us % 1000 / 100),
+                              (unsigned)(p->dirty_px / p->frames), (unsigned)p->frames);
+    }
+
+    p->frames = 0;
+    p->dirty_px = 0;
+    p->refr_us = 0;
+    p->flush_us = 0;
+    p->copy_us = 0;
+    p->vsync_us = 0;
+}
+
+/**
+ * @brief Show the per-frame averages of the port trace points on the system layer
+ *
+ * @note The label redraws once per period, that frame is part of the next period's statistics.
+ *
+ */
+static void profile_overlay_init(lv_display_t *disp)
+{
+    lv_display_add_event_cb(disp, profile_refr_event_cb, LV_EVENT_ALL, NULL);
+
+    port_profile.label = lv_label_create(lv_display_get_layer_sys(disp));
+    lv_obj_set_style_bg_color(port_profile.label, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(port_profile.label, LV_OPA_70, 0);
+    lv_obj_set_style_text_color(port_profile.label, lv_color_white(), 0);
+    lv_obj_set_style_pad_all(port_profile.label, 4, 0);
+    lv_obj_align(port_profile.label, LV_ALIGN_TOP_LEFT, 0, 0);
+    lv_label_set_text(port_profile.label, "");
+
+    lv_timer_create(profile_overlay_timer_cb, LVGL_V9_PORT_PROFILE_PERIOD_MS, NULL);
+}
+#endif
+
+static void lvgl_v9_port_task(void *arg)
+{
+    ESP_LOGD(TAG, "Starting LVGL task");
+
+    lvgl_v9_port_task_param_t *param = (lvgl_v9_port_task_param_t *)arg;
+
+    lv_init();
+    ESP_ERROR_CHECK(tick_init());
+
+    lv_display_t *disp = display_init(param->lcd_handle);
+    assert(disp);
+#if LVGL_V9_PORT_IMAGE_CACHE_ENABLE
+    image_cache_init();
+#endif
+#if LVGL_V9_PORT_HW_JPEG_ENABLE
+    hw_jpeg_init();
+#endif
+#if LVGL_V9_PORT_PROFILE_OVERLAY
+    profile_overlay_init(disp);
+#endif
+
+    if (param->tp_handle) {
+        lv_indev_t *indev = indev_init(param->tp_handle);
+        assert(indev);
+
+#if EXAMPLE_LVGL_PORT_ROTATION_90
+        esp_lcd_touch_set_swap_xy(param->tp_handle, true);
+        esp_lcd_touch_set_mirror_x(param->tp_handle, true);
+#elif EXAMPLE_LVGL_PORT_ROTATION_180
+        esp_lcd_touch_set_mirror_x(param->tp_handle, false);
+        esp_lcd_touch_set_mirror_y(param->tp_handle, false);
+#elif EXAMPLE_LVGL_PORT_ROTATION_270
+        esp_lcd_touch_set_swap_xy(param->tp_handle, true);
+        esp_lcd_touch_set_mirror_y(param->tp_handle, false);
+#endif
+    }
+
+#if LVGL_V9_PORT_VSYNC_SCHEDULE
+    // The refresh timer never expires, the loop below renders through `lv_refr_now()`
+    lv_timer_set_period(disp->refr_timer, UINT32_MAX);
+#endif
+
+    param->is_init = true;
+
+#if LVGL_V9_PORT_VSYNC_SCHEDULE
+    uint32_t rendered_vsync = lvgl_vsync_count;
+    while (1) {
+        uint32_t task_delay_ms = LVGL_V9_PORT_TASK_MAX_DELAY_MS;
+        bool render = false;
+        if (lvgl_v9_port_lock(-1)) {
+            task_delay_ms = lv_timer_handler();
+            render = (disp->inv_p > 0) || (lv_anim_count_running() > 0);
+            lvgl_v9_port_unlock();
+        }
+        if (render) {
+            // If a vsync passed while rendering the last frame, this one is late and starts now
+            if (lvgl_vsync_count == rendered_vsync) {
+                wait_for_vsync(rendered_vsync);
+            }
+            rendered_vsync = lvgl_vsync_count;
+            if (lvgl_v9_port_lock(-1)) {
+                lv_refr_now(disp);
+                lvgl_v9_port_unlock();
+            }
+            continue;
+        }
+
+        // Nothing to render, sleep until a timer is due or another task changes the UI
+        TickType_t sleep_ticks = portMAX_DELAY;
+        if (task_delay_ms != LV_NO_TIMER_READY) {
+            sleep_ticks = pdMS_TO_TICKS(LV_MAX(task_delay_ms, LVGL_V9_PORT_TASK_MIN_DELAY_MS));
+        }
+        ulTaskNotifyTake(pdTRUE, sleep_ticks);
+    }
+#else
+    uint32_t task_delay_ms = LVGL_V9_PORT_TASK_MAX_DELAY_MS;
+    while (1) {
+        if (lvgl_v9_port_lock(-1)) {
+            task_delay_ms = lv_timer_handler();
+            lvgl_v9_port_unlock();
+        }
+        if (task_delay_ms > LVGL_V9_PORT_TASK_MAX_DELAY_MS) {
+            task_delay_ms = LVGL_V9_PORT_TASK_MAX_DELAY_MS;
+        } else if (task_delay_ms < LVGL_V9_PORT_TASK_MIN_DELAY_MS) {
+            task_delay_ms = LVGL_V9_PORT_TASK_MIN_DELAY_MS;
+        }
+        vTaskDelay(pdMS_TO_TICKS(task_delay_ms));
+    }
+#endif
+}
+
+esp_err_t lvgl_v9_port_init(esp_lcd_panel_handle_t lcd_handle, esp_lcd_touch_handle_t tp_handle, lvgl_v9_port_interface_t interface)
+{
+    lvgl_v9_port_task_param_t lvgl_task_param = {
+        .lcd_handle = lcd_handle,
+        .tp_handle = tp_handle,
+        .is_init = false
+    };
+
+    lvgl_v9_port_interface = interface;
+#if LVGL_V9_PORT_AVOID_TEAR_ENABLE
+    switch (interface) {
+#if SOC_LCDCAM_RGB_LCD_SUPPORTED
+    case LVGL_V9_PORT_INTERFACE_RGB:
+        lvgl_get_lcd_frame_buffer = esp_lcd_rgb_panel_get_frame_buffer;
+        break;
+#endif
+
+#if SOC_MIPI_DSI_SUPPORTED
+    case LVGL_V9_PORT_INTERFACE_MIPI_DSI_DMA:
+    case LVGL_V9_PORT_INTERFACE_MIPI_DSI_NO_DMA:
+        lvgl_get_lcd_frame_buffer = esp_lcd_dpi_panel_get_frame_buffer;
+        break;
+#endif
+
+    default:
+        ESP_LOGE(TAG, "Invalid interface type");
+        return ESP_ERR_INVALID_ARG;
+    }
+#endif
+
+    lvgl_mux = xSemaphoreCreateRecursiveMutex();
+    assert(lvgl_mux);
+
+    ESP_LOGI(TAG, "Create LVGL task");
+    BaseType_t core_id = (LVGL_V9_PORT_TASK_CORE < 0) ? tskNO_AFFINITY : LVGL_V9_PORT_TASK_CORE;
+    BaseType_t ret = xTaskCreatePinnedToCore(lvgl_v9_port_task, "lvgl", LVGL_V9_PORT_TASK_STACK_SIZE, &lvgl_task_param,
+                                             LVGL_V9_PORT_TASK_PRIORITY, &lvgl_task_handle, core_id);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create LVGL task");
+        return ESP_FAIL;
+    }
+
+    while (!lvgl_task_param.is_init) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    return ESP_OK;
+}
+
+bool lvgl_v9_port_lock(int timeout_ms)
+{
+    assert(lvgl_mux && "lvgl_v9_port_init must be called first");
+
+    const TickType_t timeout_ticks = (timeout_ms < 0) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    if (xSemaphoreTakeRecursive(lvgl_mux, timeout_ticks) != pdTRUE) {
+        return false;
+    }
+#if LV_USE_OS != LV_OS_NONE
+    // LVGL has its own lock with an OS, always taken after `lvgl_mux` so the two can't deadlock
+    lv_lock();
+#endif
+    return true;
+}
+
+void lvgl_v9_port_unlock(void)
+{
+    assert(lvgl_mux && "lvgl_v9_port_init must be called first");
+#if LVGL_V9_PORT_VSYNC_SCHEDULE
+    // Wake the sleeping LVGL task for what this task changed. Notifying while still holding the lock
+    // ensures the LVGL task is not inside a flush, whose vsync waits share the notification.
+    if (lvgl_task_handle && (xTaskGetCurrentTaskHandle() != lvgl_task_handle)) {
+        xTaskNotifyGive(lvgl_task_handle);
+    }
+#endif
+#if LV_USE_OS != LV_OS_NONE
+    lv_unlock();
+#endif
+    xSemaphoreGiveRecursive(lvgl_mux);
+}
+
+bool lvgl_v9_port_notify_lcd_vsync(void)
+{
+    BaseType_t need_yield = pdFALSE;
+#if LVGL_V9_PORT_VSYNC_SCHEDULE
+    lvgl_vsync_count++;
+    if (lvgl_vsync_waiting && lvgl_task_handle) {
+        lvgl_vsync_waiting = false;
+        vTaskNotifyGiveFromISR(lvgl_task_handle, &need_yield);
+    }
+#endif
+#if LVGL_V9_PORT_FULL_REFRESH && (LVGL_V9_PORT_LCD_RGB_BUFFER_NUMS == 3) && (EXAMPLE_LVGL_PORT_ROTATION_DEGREE == 0)
+    if (lvgl_v9_port_rgb_next_buf != lvgl_v9_port_rgb_last_buf) {
+        lvgl_v9_port_flush_next_buf = lvgl_v9_port_rgb_last_buf;
+        lvgl_v9_port_rgb_last_buf = lvgl_v9_port_rgb_next_buf;
+    }
+#elif LVGL_V9_PORT_AVOID_TEAR_ENABLE
+#if LVGL_V9_PORT_DIRECT_MODE && (EXAMPLE_LVGL_PORT_ROTATION_DEGREE != 0)
+    // The last requested frame buffer is scanned out from now on, the previous front one is free
+    lcd_fb_front = lcd_fb_requested;
+#endif
+    // Notify that the current LCD frame buffer has been transmitted
+    if (lvgl_task_handle) {
+        xTaskNotifyFromISR(lvgl_task_handle, ULONG_MAX, eNoAction, &need_yield);
+    }
+#elif !LVGL_V9_PORT_OVERLAY_ENABLE
+    if (lvgl_v9_port_interface == LVGL_V9_PORT_INTERFACE_MIPI_DSI_DMA) {
+        lv_display_t *disp = lv_disp_get_default();
+        lv_disp_flush_ready(disp);
+    }
+#endif
+    return (need_yield == pdTRUE);
+}
+
+esp_err_t lvgl_v9_port_get_overlay(lvgl_v9_port_overlay_t *overlay)
+{
+#if LVGL_V9_PORT_OVERLAY_ENABLE
+    if (!overlay) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    overlay->buf = lvgl_overlay_buf;
+    overlay->area = lvgl_overlay_area;
+    if (!lvgl_overlay_area_valid) {
+        // Nothing rendered yet
+        overlay->area.x1 = 0;
+        overlay->area.y1 = 0;
+        overlay->area.x2 = -1;
+        overlay->area.y2 = -1;
+    }
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t lvgl_v9_port_image_prefetch(const void *const srcs[], size_t count)
+{
+#if LVGL_V9_PORT_IMAGE_CACHE_ENABLE
+    if (!srcs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (image_prefetch_count == IMAGE_PREFETCH_QUEUE_LEN) {
+            return ESP_ERR_NO_MEM;
+        }
+        image_prefetch_queue[(image_prefetch_head + image_prefetch_count) % IMAGE_PREFETCH_QUEUE_LEN] = srcs[i];
+        image_prefetch_count++;
+    }
+    lv_timer_resume(image_prefetch_timer);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t lvgl_v9_port_assets_mount(const char *partition_label)
+{
+#if LVGL_V9_PORT_ASSETS_ENABLE
+    if (!partition_label) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (assets_base) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           partition_label);
+    if (!part) {
+        ESP_LOGE(TAG, "No asset partition '%s'", partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    assets_header_t header;
+    ESP_RETURN_ON_ERROR(esp_partition_read(part, 0, &header, sizeof(header)), TAG, "Failed to read asset header");
+    if ((header.magic != ASSETS_MAGIC) || (header.version != ASSETS_VERSION)) {
+        ESP_LOGE(TAG, "Partition '%s' holds no assets", partition_label);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if ((header.size > part->size) || (sizeof(header) + header.count * sizeof(assets_entry_t) > header.size)) {
+        ESP_LOGE(TAG, "Asset image of %" PRIu32 " bytes doesn't fit partition '%s'", header.size, partition_label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Only the used part takes MMU pages of the data address space
+    const void *base = NULL;
+    ESP_RETURN_ON_ERROR(esp_partition_mmap(part, 0, header.size, ESP_PARTITION_MMAP_DATA, &base, &assets_mmap_handle),
+                        TAG, "Failed to map asset partition");
+    const assets_entry_t *table = (const assets_entry_t *)((const uint8_t *)base + sizeof(header));
+
+    lv_image_dsc_t *images = heap_caps_calloc(LV_MAX(header.count, 1), sizeof(lv_image_dsc_t),
+                                              MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!images) {
+        esp_partition_munmap(assets_mmap_handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < header.count; i++) {
+        const assets_entry_t *entry = &table[i];
+        bool valid = (entry->offset % ASSETS_ALIGN == 0) && (entry->offset <= header.size) &&
+                     (entry->size <= header.size - entry->offset);
+        if (valid && (entry->type == ASSETS_TYPE_IMAGE)) {
+            valid = assets_image_valid(entry);
+        }
+        if (!valid) {
+            ESP_LOGE(TAG, "Invalid asset %d '%.*s'", i, ASSETS_NAME_LEN, entry->name);
+            heap_caps_free(images);
+            esp_partition_munmap(assets_mmap_handle);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (entry->type != ASSETS_TYPE_IMAGE) {
+            continue;
+        }
+
+        // Not allocated and not modifiable, LVGL draws from the mapped flash and never frees it
+        images[i].header.magic = LV_IMAGE_HEADER_MAGIC;
+        images[i].header.cf = entry->cf;
+        images[i].header.w = entry->w;
+        images[i].header.h = entry->h;
+        images[i].header.stride = entry->stride;
+        images[i].data = (const uint8_t *)base + entry->offset;
+        images[i].data_size = entry->size;
+    }
+
+    assets_base = base;
+    assets_table = table;
+    assets_images = images;
+    assets_count = header.count;
+    ESP_LOGI(TAG, "%d assets mapped from '%s', %" PRIu32 "KB", assets_count, partition_label, header.size / 1024);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+const lv_image_dsc_t *lvgl_v9_port_assets_get_image(const char *name)
+{
+#if LVGL_V9_PORT_ASSETS_ENABLE
+    if (!name) {
+        return NULL;
+    }
+    int index = assets_find(name, ASSETS_TYPE_IMAGE);
+    return (index < 0) ? NULL : &assets_images[index];
+#else
+    return NULL;
+#endif
+}
+
+const void *lvgl_v9_port_assets_get_blob(const char *name, size_t *size)
+{
+#if LVGL_V9_PORT_ASSETS_ENABLE
+    if (!name) {
+        return NULL;
+    }
+    int index = assets_find(name, ASSETS_TYPE_BLOB);
+    if (index < 0) {
+        return NULL;
+    }
+    if (size) {
+        *size = assets_table[index].size;
+    }
+    return assets_base + assets_table[index].offset;
+#else
+    return NULL;
+#endif
+}
+
+esp_err_t lvgl_v9_port_layer_cache_enable(lv_obj_t *obj)
+{
+#if LV_USE_SNAPSHOT
+    if (!obj) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (layer_cache_get(obj)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!layer_cache_style_inited) {
+        lv_style_init(&layer_cache_hidden_style);
+        lv_style_set_opa_layered(&layer_cache_hidden_style, LV_OPA_TRANSP);
+        layer_cache_style_inited = true;
+    }
+
+    layer_cache_t *cache = heap_caps_calloc(1, sizeof(layer_cache_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!cache) {
+        return ESP_ERR_NO_MEM;
+    }
+    lv_obj_add_event_cb(obj, layer_cache_event_cb, LV_EVENT_ALL | LV_EVENT_PREPROCESS, cache);
+
+    esp_err_t ret = layer_cache_take(obj, cache);
+    if (ret != ESP_OK) {
+        lvgl_v9_port_layer_cache_disable(obj);
+    }
+    return ret;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t lvgl_v9_port_layer_cache_update(lv_obj_t *obj)
+{
+#if LV_USE_SNAPSHOT
+    if (!obj) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    layer_cache_t *cache = layer_cache_get(obj);
+    if (!cache) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return layer_cache_take(obj, cache);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t lvgl_v9_port_layer_cache_disable(lv_obj_t *obj)
+{
+#if LV_USE_SNAPSHOT
+    if (!obj) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    layer_cache_t *cache = layer_cache_get(obj);
+    if (!cache) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    lv_obj_remove_event_cb_with_user_data(obj, layer_cache_event_cb, cache);
+    layer_cache_hide_children(obj, false);
+    layer_cache_free(obj, cache);
+    lv_obj_invalidate(obj);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t lvgl_v9_port_scroll_blit_enable(lv_obj_t *obj)
+{
+#if LVGL_V9_PORT_SCROLL_BLIT_ENABLE
+    if (!obj) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if LV_USE_SNAPSHOT
+    if (layer_cache_get(obj)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#endif
+    if (scroll_blit_get(obj)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    scroll_blit_t *s = scroll_blit_get(NULL);
+    if (!s) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (!scroll_blit_ppa) {
+        ppa_client_config_t ppa_srm_config = {
+            .oper_type = PPA_OPERATION_SRM,
+            .max_pending_trans_num = 1,
+        };
+        esp_err_t ret = ppa_register_client(&ppa_srm_config, &scroll_blit_ppa);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        ESP_ERROR_CHECK(esp_cache_get_alignment(MALLOC_CAP_DMA | MALLOC_CAP_SPIRAM, &scroll_blit_cache_line));
+        lv_display_add_event_cb(lv_obj_get_display(obj), scroll_blit_display_event_cb, LV_EVENT_ALL, NULL);
+    }
+
+    // Moved from the next refresh on, once that one has drawn the container
+    s->obj = obj;
+    lv_obj_add_event_cb(obj, scroll_blit_event_cb, LV_EVENT_ALL | LV_EVENT_PREPROCESS, s);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t lvgl_v9_port_scroll_blit_disable(lv_obj_t *obj)
+{
+#if LVGL_V9_PORT_SCROLL_BLIT_ENABLE
+    if (!obj) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    scroll_blit_t *s = scroll_blit_get(obj);
+    if (!s) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    lv_obj_remove_event_cb_with_user_data(obj, scroll_blit_event_cb, s);
+    // A scroll since the last refresh may have invalidated the strip only
+    if (s->dx || s->dy) {
+        lv_obj_invalidate(obj);
+    }
+    *s = (scroll_blit_t) {
+        0
+    };
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
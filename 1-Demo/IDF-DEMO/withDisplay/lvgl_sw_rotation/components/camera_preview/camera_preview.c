@@ -0,0 +1,345 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_mipi_dsi.h"
+#include "driver/ppa.h"
+#include "linux/videodev2.h"
+#include "camera_preview.h"
+
+#define CAMERA_BUFFER_NUMS          (2)     // Capture buffers of the copy path, the PPA reads them into the LCD
+#define CAMERA_PREVIEW_STACK_SIZE   (4 * 1024)
+
+static const char *TAG = "cam_preview";
+
+typedef struct {
+    camera_preview_config_t config;
+    int fd;
+    bool zero_copy;                                     // The ISP writes straight into the LCD frame buffers
+    uint32_t memory;                                    // V4L2_MEMORY_USERPTR or V4L2_MEMORY_MMAP
+    void *lcd_fbs[CAMERA_PREVIEW_LCD_BUFFER_NUMS];
+    size_t lcd_fb_size;
+    uint8_t *cam_bufs[CAMERA_BUFFER_NUMS];              // Copy path only
+    ppa_client_handle_t ppa_srm;
+    ppa_client_handle_t ppa_blend;
+    ppa_srm_oper_config_t srm_config;                   // Scale and rotation of every frame, only the buffers change
+    TaskHandle_t task;
+    volatile uint32_t frame_count;
+} camera_preview_t;
+
+static camera_preview_t *preview = NULL;
+
+static esp_err_t queue_lcd_fb(camera_preview_t *p, int index)
+{
+    struct v4l2_buffer buf = {
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .memory = V4L2_MEMORY_USERPTR,
+        .index = index,
+        .m.userptr = (unsigned long)p->lcd_fbs[index],
+        .length = p->lcd_fb_size,
+    };
+
+    return (ioctl(p->fd, VIDIOC_QBUF, &buf) == 0) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t setup_zero_copy(camera_preview_t *p)
+{
+    struct v4l2_requestbuffers req = {
+        .count = CAMERA_PREVIEW_LCD_BUFFER_NUMS,
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .memory = V4L2_MEMORY_USERPTR,
+    };
+    ESP_RETURN_ON_FALSE(ioctl(p->fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, TAG, "failed to require buffer");
+
+    // The first frame buffer is scanned out, the ISP fills the others
+    for (int i = 1; i < CAMERA_PREVIEW_LCD_BUFFER_NUMS; i++) {
+        ESP_RETURN_ON_ERROR(queue_lcd_fb(p, i), TAG, "failed to queue LCD frame buffer");
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t setup_copy(camera_preview_t *p, uint32_t cam_w, uint32_t cam_h)
+{
+    struct v4l2_requestbuffers req = {
+        .count = CAMERA_BUFFER_NUMS,
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .memory = V4L2_MEMORY_MMAP,
+    };
+    ESP_RETURN_ON_FALSE(ioctl(p->fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, TAG, "failed to require buffer");
+
+    for (int i = 0; i < CAMERA_BUFFER_NUMS; i++) {
+        struct v4l2_buffer buf = {
+            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .memory = V4L2_MEMORY_MMAP,
+            .index = i,
+        };
+        ESP_RETURN_ON_FALSE(ioctl(p->fd, VIDIOC_QUERYBUF, &buf) == 0, ESP_FAIL, TAG, "failed to query buffer");
+        p->cam_bufs[i] = (uint8_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, buf.m.offset);
+        ESP_RETURN_ON_FALSE(p->cam_bufs[i], ESP_FAIL, TAG, "failed to map buffer");
+        ESP_RETURN_ON_FALSE(ioctl(p->fd, VIDIOC_QBUF, &buf) == 0, ESP_FAIL, TAG, "failed to queue video frame");
+    }
+
+    ppa_client_config_t srm_client = {
+        .oper_type = PPA_OPERATION_SRM,
+    };
+    ESP_RETURN_ON_ERROR(ppa_register_client(&srm_client, &p->ppa_srm), TAG, "failed to register PPA SRM client");
+
+    // The PPA rotates counterclockwise
+    ppa_srm_rotation_angle_t angle;
+    switch (p->config.rotation) {
+    case 90:
+        angle = PPA_SRM_ROTATION_ANGLE_270;
+        break;
+    case 180:
+        angle = PPA_SRM_ROTATION_ANGLE_180;
+        break;
+    case 270:
+        angle = PPA_SRM_ROTATION_ANGLE_90;
+        break;
+    default:
+        angle = PPA_SRM_ROTATION_ANGLE_0;
+        break;
+    }
+
+    // Fit the rotated image into the LCD with its aspect ratio, in the 1/16 steps of the PPA scaler
+    const bool swap_xy = (angle == PPA_SRM_ROTATION_ANGLE_90) || (angle == PPA_SRM_ROTATION_ANGLE_270);
+    const uint32_t rot_w = swap_xy ? cam_h : cam_w;
+    const uint32_t rot_h = swap_xy ? cam_w : cam_h;
+    const uint32_t scale_16 = MIN(p->config.h_res * 16 / rot_w, p->config.v_res * 16 / rot_h);
+    ESP_RETURN_ON_FALSE(scale_16 > 0 && scale_16 <= 16 * 16, ESP_ERR_NOT_SUPPORTED, TAG,
+                        "can't scale %" PRIu32 "x%" PRIu32 " to the LCD", cam_w, cam_h);
+
+    p->srm_config = (ppa_srm_oper_config_t) {
+        .in.pic_w = cam_w,
+        .in.pic_h = cam_h,
+        .in.block_w = cam_w,
+        .in.block_h = cam_h,
+        .in.srm_cm = PPA_SRM_COLOR_MODE_RGB565,
+        .out.buffer_size = p->lcd_fb_size,
+        .out.pic_w = p->config.h_res,
+        .out.pic_h = p->config.v_res,
+        .out.block_offset_x = (p->config.h_res - rot_w * scale_16 / 16) / 2,
+        .out.block_offset_y = (p->config.v_res - rot_h * scale_16 / 16) / 2,
+        .out.srm_cm = PPA_SRM_COLOR_MODE_RGB565,
+        .rotation_angle = angle,
+        .scale_x = scale_16 / 16.0f,
+        .scale_y = scale_16 / 16.0f,
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    return ESP_OK;
+}
+
+static void blend_overlay(camera_preview_t *p, void *fb)
+{
+    camera_preview_overlay_t overlay = { 0 };
+
+    if (!p->config.overlay_lock(&overlay, p->config.overlay_user_ctx)) {
+        return;
+    }
+
+    if ((overlay.w > 0) && (overlay.h > 0)) {
+        // Only the area the overlay covers is read and written, in place
+        ppa_blend_oper_config_t oper_config = {
+            .in_bg.buffer = fb,
+            .in_bg.pic_w = p->config.h_res,
+            .in_bg.pic_h = p->config.v_res,
+            .in_bg.block_w = overlay.w,
+            .in_bg.block_h = overlay.h,
+            .in_bg.block_offset_x = overlay.x,
+            .in_bg.block_offset_y = overlay.y,
+            .in_bg.blend_cm = PPA_BLEND_COLOR_MODE_RGB565,
+
+            .in_fg.buffer = overlay.buf,
+            .in_fg.pic_w = p->config.h_res,
+            .in_fg.pic_h = p->config.v_res,
+            .in_fg.block_w = overlay.w,
+            .in_fg.block_h = overlay.h,
+            .in_fg.block_offset_x = overlay.x,
+            .in_fg.block_offset_y = overlay.y,
+            .in_fg.blend_cm = PPA_BLEND_COLOR_MODE_ARGB8888,
+
+            .out.buffer = fb,
+            .out.buffer_size = p->lcd_fb_size,
+            .out.pic_w = p->config.h_res,
+            .out.pic_h = p->config.v_res,
+            .out.block_offset_x = overlay.x,
+            .out.block_offset_y = overlay.y,
+            .out.blend_cm = PPA_BLEND_COLOR_MODE_RGB565,
+
+            .bg_alpha_update_mode = PPA_ALPHA_NO_CHANGE,
+            .fg_alpha_update_mode = PPA_ALPHA_NO_CHANGE,
+            .mode = PPA_TRANS_MODE_BLOCKING,
+        };
+        if (ppa_do_blend(p->ppa_blend, &oper_config) != ESP_OK) {
+            ESP_LOGW(TAG, "failed to blend overlay");
+        }
+    }
+
+    p->config.overlay_unlock(p->config.overlay_user_ctx);
+}
+
+static void camera_preview_task(void *arg)
+{
+    camera_preview_t *p = (camera_preview_t *)arg;
+    int front = 0;  // LCD frame buffer scanned out
+
+    while (1) {
+        struct v4l2_buffer buf = {
+            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .memory = p->memory,
+        };
+        if (ioctl(p->fd, VIDIOC_DQBUF, &buf) != 0) {
+            ESP_LOGE(TAG, "failed to receive video frame");
+            break;
+        }
+
+        int back;
+        if (p->zero_copy) {
+            // The ISP wrote this LCD frame buffer
+            back = buf.index;
+        } else {
+            // Only the front buffer is in use, every switch below waits for the vsync
+            back = (front + 1) % CAMERA_PREVIEW_LCD_BUFFER_NUMS;
+            p->srm_config.in.buffer = p->cam_bufs[buf.index];
+            p->srm_config.out.buffer = p->lcd_fbs[back];
+            if (ppa_do_scale_rotate_mirror(p->ppa_srm, &p->srm_config) != ESP_OK) {
+                ESP_LOGW(TAG, "failed to scale video frame");
+            }
+            if (ioctl(p->fd, VIDIOC_QBUF, &buf) != 0) {
+                ESP_LOGE(TAG, "failed to queue video frame");
+                break;
+            }
+        }
+
+        if (p->ppa_blend) {
+            blend_overlay(p, p->lcd_fbs[back]);
+        }
+
+        // The frame buffer is scanned out from the next frame on, the previous one is free after the vsync
+        ulTaskNotifyValueClear(NULL, ULONG_MAX);
+        esp_lcd_panel_draw_bitmap(p->config.panel, 0, 0, p->config.h_res, p->config.v_res, p->lcd_fbs[back]);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (p->zero_copy && (queue_lcd_fb(p, front) != ESP_OK)) {
+            ESP_LOGE(TAG, "failed to queue LCD frame buffer");
+            break;
+        }
+        front = back;
+        p->frame_count++;
+    }
+
+    ESP_LOGE(TAG, "Preview stopped");
+    vTaskDelete(NULL);
+}
+
+esp_err_t camera_preview_start(const camera_preview_config_t *config)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(config && config->dev_name && config->panel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(!config->overlay_lock == !config->overlay_unlock, ESP_ERR_INVALID_ARG, TAG,
+                        "overlay lock and unlock go together");
+    ESP_RETURN_ON_FALSE(!preview, ESP_ERR_INVALID_STATE, TAG, "already started");
+
+    camera_preview_t *p = heap_caps_calloc(1, sizeof(camera_preview_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(p, ESP_ERR_NO_MEM, TAG, "no memory for preview");
+    p->config = *config;
+    p->lcd_fb_size = config->h_res * config->v_res * sizeof(uint16_t);
+
+    p->fd = open(config->dev_name, O_RDONLY);
+    ESP_GOTO_ON_FALSE(p->fd >= 0, ESP_FAIL, err_open, TAG, "failed to open %s", config->dev_name);
+
+    ESP_GOTO_ON_ERROR(esp_lcd_dpi_panel_get_frame_buffer(config->panel, CAMERA_PREVIEW_LCD_BUFFER_NUMS,
+                      &p->lcd_fbs[0], &p->lcd_fbs[1], &p->lcd_fbs[2]), err, TAG, "failed to get LCD frame buffers");
+
+    // The ISP converts to the LCD color format at the sensor resolution
+    struct v4l2_format format = {
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+    };
+    ESP_GOTO_ON_FALSE(ioctl(p->fd, VIDIOC_G_FMT, &format) == 0, ESP_FAIL, err, TAG, "failed to get format");
+    const uint32_t cam_w = format.fmt.pix.width;
+    const uint32_t cam_h = format.fmt.pix.height;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB565;
+    ESP_GOTO_ON_FALSE(ioctl(p->fd, VIDIOC_S_FMT, &format) == 0, ESP_FAIL, err, TAG, "failed to set RGB565 format");
+
+    p->zero_copy = (cam_w == config->h_res) && (cam_h == config->v_res) && (config->rotation == 0);
+    if (p->zero_copy) {
+        p->memory = V4L2_MEMORY_USERPTR;
+        ESP_GOTO_ON_ERROR(setup_zero_copy(p), err, TAG, "failed to set up zero-copy capture");
+    } else {
+        p->memory = V4L2_MEMORY_MMAP;
+        ESP_GOTO_ON_ERROR(setup_copy(p, cam_w, cam_h), err, TAG, "failed to set up PPA capture");
+    }
+
+    if (config->overlay_lock) {
+        ppa_client_config_t blend_client = {
+            .oper_type = PPA_OPERATION_BLEND,
+        };
+        ESP_GOTO_ON_ERROR(ppa_register_client(&blend_client, &p->ppa_blend), err, TAG, "failed to register PPA blend client");
+    }
+
+    const int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ESP_GOTO_ON_FALSE(ioctl(p->fd, VIDIOC_STREAMON, &type) == 0, ESP_FAIL, err, TAG, "failed to start stream");
+
+    ESP_LOGI(TAG, "Camera %" PRIu32 "x%" PRIu32 " to LCD %" PRIu32 "x%" PRIu32 ", %s", cam_w, cam_h,
+             config->h_res, config->v_res, p->zero_copy ? "zero-copy" : "PPA scaled");
+
+    preview = p;
+    BaseType_t core_id = (config->task_core < 0) ? tskNO_AFFINITY : config->task_core;
+    if (xTaskCreatePinnedToCore(camera_preview_task, "cam_preview", CAMERA_PREVIEW_STACK_SIZE, p,
+                                config->task_priority, &p->task, core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create preview task");
+        ioctl(p->fd, VIDIOC_STREAMOFF, &type);
+        preview = NULL;
+        ret = ESP_FAIL;
+        goto err;
+    }
+
+    return ESP_OK;
+
+err:
+    if (p->ppa_blend) {
+        ppa_unregister_client(p->ppa_blend);
+    }
+    if (p->ppa_srm) {
+        ppa_unregister_client(p->ppa_srm);
+    }
+    close(p->fd);
+err_open:
+    free(p);
+    return ret;
+}
+
+IRAM_ATTR bool camera_preview_notify_lcd_vsync(void)
+{
+    BaseType_t need_yield = pdFALSE;
+
+    if (preview && preview->task) {
+        vTaskNotifyGiveFromISR(preview->task, &need_yield);
+    }
+
+    return (need_yield == pdTRUE);
+}
+
+uint32_t camera_preview_get_frame_count(void)
+{
+    return preview ? preview->frame_count : 0;
+}
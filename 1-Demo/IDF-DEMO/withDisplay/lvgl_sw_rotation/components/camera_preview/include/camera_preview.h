@@ -0,0 +1,107 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_lcd_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of LCD frame buffers the preview needs: one scanned out and two owned by the camera or the PPA.
+ * Set `num_fbs` of the DPI panel to this.
+ *
+ */
+#define CAMERA_PREVIEW_LCD_BUFFER_NUMS  (3)
+
+/**
+ * @brief Overlay blended over every preview frame
+ *
+ */
+typedef struct {
+    const void *buf;        // ARGB8888 pixels of the whole LCD, stride `h_res * 4`
+    int x;                  // Area to blend, in LCD pixels
+    int y;
+    int w;
+    int h;
+} camera_preview_overlay_t;
+
+/**
+ * @brief Lock the overlay and fill in the area to blend
+ *
+ * @param[out] overlay: The overlay, `w` or `h` of 0 skips the blend
+ * @param[in] user_ctx: `overlay_user_ctx` of the configuration
+ *
+ * @return
+ *      - true:  The overlay is locked, `camera_preview_overlay_unlock_cb_t` is called after the blend
+ *      - false: No overlay for this frame
+ */
+typedef bool (*camera_preview_overlay_lock_cb_t)(camera_preview_overlay_t *overlay, void *user_ctx);
+
+/**
+ * @brief Unlock the overlay after it was blended
+ *
+ */
+typedef void (*camera_preview_overlay_unlock_cb_t)(void *user_ctx);
+
+/**
+ * @brief Camera preview configuration
+ *
+ */
+typedef struct {
+    const char *dev_name;                               // Video capture device, initialized by `esp_video_init()`
+    esp_lcd_panel_handle_t panel;                       // MIPI DSI panel with `CAMERA_PREVIEW_LCD_BUFFER_NUMS` frame buffers
+    uint32_t h_res;                                     // LCD resolution
+    uint32_t v_res;
+    int rotation;                                       // Rotation of the camera image on the LCD: 0, 90, 180 or 270
+    camera_preview_overlay_lock_cb_t overlay_lock;      // Optional, locks the overlay blended over every frame
+    camera_preview_overlay_unlock_cb_t overlay_unlock;
+    void *overlay_user_ctx;
+    int task_priority;                                  // Priority of the preview task
+    int task_core;                                      // Core of the preview task, `-1` means no affinity
+} camera_preview_config_t;
+
+/**
+ * @brief Start the camera preview
+ *
+ * The ISP outputs RGB565. When the camera resolution equals the LCD resolution and there's no rotation, it writes
+ * straight into the LCD frame buffers. Otherwise the PPA scales and rotates every frame into them. The overlay is
+ * blended over the frame in the LCD frame buffer by the PPA.
+ *
+ * @param[in] config: Preview configuration
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: Invalid argument
+ *      - ESP_ERR_INVALID_STATE: Already started
+ *      - Others: Fail
+ */
+esp_err_t camera_preview_start(const camera_preview_config_t *config);
+
+/**
+ * @brief Notify the preview task of a vsync, call from the `on_refresh_done` callback of the DPI panel
+ *
+ * @return
+ *      - true:  The tasks need to be re-scheduled
+ *      - false: The tasks don't need to be re-scheduled
+ */
+bool camera_preview_notify_lcd_vsync(void);
+
+/**
+ * @brief Number of camera frames shown since the preview started
+ *
+ */
+uint32_t camera_preview_get_frame_count(void);
+
+#ifdef __cplusplus
+}
+#endif
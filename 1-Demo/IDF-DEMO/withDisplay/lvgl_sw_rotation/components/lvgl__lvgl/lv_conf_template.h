@@ -102,6 +102,10 @@
 	 * RTOS task notifications can only be used when there is only one task that can be the recipient of the event.
 	 */
 	#define LV_USE_FREERTOS_TASK_NOTIFY 1
+	/*
+	 * Pin the threads created by LVGL to the cores in turn, starting from core 0 (ESP-IDF only).
+	 */
+	#define LV_FREERTOS_PIN_THREADS 0
 #endif
 
 /*========================
@@ -179,6 +183,12 @@
         * radius * 4 bytes are used per circle (the most often used radiuses are saved)
         * 0: to disable caching */
         #define LV_DRAW_SW_CIRCLE_CACHE_SIZE 4
+
+        /* Set number of maximally cached corner tiles.
+        * The AA coverage of the 4 corners of a radius is saved for plain rounded rectangles
+        * 4 * radius^2 bytes are used per tile, up to radius 64 (the most often used radiuses are saved)
+        * 0: to disable caching */
+        #define LV_DRAW_SW_CORNER_TILE_CACHE_SIZE 0
     #endif
 
     #define  LV_USE_DRAW_SW_ASM     LV_DRAW_SW_ASM_NONE
@@ -231,6 +241,14 @@
     #define LV_USE_PXP_ASSERT 0
 #endif
 
+/* Use Espressif's PPA on ESP32-P4 for fills, blends and image blits. */
+#define LV_USE_PPA 0
+
+#if LV_USE_PPA
+    /* Smaller areas (in pixels) are drawn by SW, the PPA setup costs more than it saves there. */
+    #define LV_PPA_MIN_AREA 4096
+#endif
+
 /* Use Renesas Dave2D on RA  platforms. */
 #define LV_USE_DRAW_DAVE2D 0
 
@@ -529,6 +547,10 @@
 /*Enables/disables support for compressed fonts.*/
 #define LV_USE_FONT_COMPRESSED 0
 
+/*Size of the cache, in bytes, that keeps the unpacked A8 glyph bitmaps of the built-in format fonts.
+ *0: to disable caching*/
+#define LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE 0
+
 /*Enable drawing placeholders when glyph dsc is not found*/
 #define LV_USE_FONT_PLACEHOLDER 1
 
@@ -127,6 +127,10 @@ typedef struct lv_global_t {
 #endif
 #if LV_DRAW_SW_COMPLEX
     lv_draw_sw_mask_radius_circle_dsc_arr_t sw_circle_cache;
+#if LV_DRAW_SW_CORNER_TILE_CACHE_SIZE > 0
+    lv_draw_sw_mask_corner_tile_arr_t sw_corner_tile_cache;
+    uint32_t sw_corner_tile_life;
+#endif
 #endif
 
 #if LV_USE_LOG
@@ -189,6 +193,10 @@ typedef struct lv_global_t {
     lv_font_fmt_rle_t font_fmt_rle;
 #endif
 
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+    lv_cache_t * font_fmt_txt_glyph_cache;
+#endif
+
 #if LV_USE_SPAN != 0
     struct _snippet_stack * span_snippet_stack;
 #endif
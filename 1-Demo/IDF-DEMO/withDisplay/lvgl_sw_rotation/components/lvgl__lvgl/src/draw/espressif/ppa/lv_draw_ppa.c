@@ -0,0 +1,300 @@
+/**
+ * @file lv_draw_ppa.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "lv_draw_ppa.h"
+
+#if LV_USE_PPA
+#include "esp_cache.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define DRAW_UNIT_ID_PPA 5
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+/*
+ * Evaluate a task and set the score and preferred PPA unit.
+ * Return 1 if task is preferred, 0 otherwise (task is not supported).
+ */
+static int32_t _ppa_evaluate(lv_draw_unit_t * draw_unit, lv_draw_task_t * task);
+
+/*
+ * Dispatch a task to the PPA unit.
+ * Return 1 if task was dispatched, 0 otherwise (task not supported).
+ */
+static int32_t _ppa_dispatch(lv_draw_unit_t * draw_unit, lv_layer_t * layer);
+
+/*
+ * Delete the PPA draw unit.
+ */
+static int32_t _ppa_delete(lv_draw_unit_t * draw_unit);
+
+static void _ppa_execute_drawing(lv_draw_ppa_unit_t * u);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lv_draw_ppa_init(void)
+{
+    lv_draw_ppa_unit_t * draw_ppa_unit = lv_draw_create_unit(sizeof(lv_draw_ppa_unit_t));
+    draw_ppa_unit->base_unit.evaluate_cb = _ppa_evaluate;
+    draw_ppa_unit->base_unit.dispatch_cb = _ppa_dispatch;
+    draw_ppa_unit->base_unit.delete_cb = _ppa_delete;
+
+    ppa_client_config_t srm_config = { .oper_type = PPA_OPERATION_SRM };
+    ppa_client_config_t blend_config = { .oper_type = PPA_OPERATION_BLEND };
+    ppa_client_config_t fill_config = { .oper_type = PPA_OPERATION_FILL };
+
+    bool ok = ppa_register_client(&srm_config, &draw_ppa_unit->srm_client) == ESP_OK &&
+              ppa_register_client(&blend_config, &draw_ppa_unit->blend_client) == ESP_OK &&
+              ppa_register_client(&fill_config, &draw_ppa_unit->fill_client) == ESP_OK &&
+              esp_cache_get_alignment(MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA, &draw_ppa_unit->buf_align) == ESP_OK;
+    LV_ASSERT_MSG(ok, "Failed to set up the PPA");
+
+    if(draw_ppa_unit->buf_align == 0)
+        draw_ppa_unit->buf_align = 1;
+}
+
+void lv_draw_ppa_deinit(void)
+{
+    /*The clients are released by the delete callback*/
+}
+
+bool lv_ppa_dest_buf_supported(const lv_draw_ppa_unit_t * u, const lv_draw_buf_t * draw_buf,
+                               const lv_area_t * area)
+{
+    if(draw_buf == NULL || draw_buf->data == NULL)
+        return false;
+
+    const uint8_t * data = draw_buf->data;
+    if(!esp_ptr_dma_capable(data) && !esp_ptr_dma_ext_capable(data))
+        return false;
+
+    if((uintptr_t)data % u->buf_align)
+        return false;
+
+    uint32_t px_size = lv_color_format_get_size(draw_buf->header.cf);
+    if(draw_buf->header.stride % px_size)
+        return false;
+
+    /*The last byte written has to be inside the whole cache lines given to the PPA*/
+    uint32_t end = draw_buf->header.stride * area->y2 + px_size * (area->x2 + 1);
+    return end <= lv_ppa_dest_buf_size(u, draw_buf);
+}
+
+uint32_t lv_ppa_dest_buf_size(const lv_draw_ppa_unit_t * u, const lv_draw_buf_t * draw_buf)
+{
+    return draw_buf->data_size - draw_buf->data_size % u->buf_align;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static inline bool _ppa_dest_cf_supported(lv_color_format_t cf)
+{
+    return cf == LV_COLOR_FORMAT_RGB565 || cf == LV_COLOR_FORMAT_RGB888;
+}
+
+static inline bool _ppa_src_cf_supported(lv_color_format_t cf)
+{
+    return cf == LV_COLOR_FORMAT_RGB565 || cf == LV_COLOR_FORMAT_RGB888 || cf == LV_COLOR_FORMAT_ARGB8888;
+}
+
+static bool _ppa_area_large_enough(const lv_draw_task_t * t)
+{
+    lv_area_t draw_area;
+    if(!lv_area_intersect(&draw_area, &t->_real_area, &t->clip_area))
+        return false;
+
+    return lv_area_get_size(&draw_area) >= LV_PPA_MIN_AREA;
+}
+
+static bool _ppa_draw_img_supported(const lv_draw_image_dsc_t * draw_dsc)
+{
+    if(lv_image_src_get_type(draw_dsc->src) != LV_IMAGE_SRC_VARIABLE)
+        return false;
+
+    const lv_image_dsc_t * img_dsc = draw_dsc->src;
+
+    if(!_ppa_src_cf_supported(img_dsc->header.cf))
+        return false;
+
+    if(img_dsc->header.flags & LV_IMAGE_FLAGS_COMPRESSED)
+        return false;
+
+    /*The 2D-DMA reads internal RAM and PSRAM, not the flash*/
+    if(!esp_ptr_dma_capable(img_dsc->data) && !esp_ptr_dma_ext_capable(img_dsc->data))
+        return false;
+
+    if(img_dsc->header.stride % lv_color_format_get_size(img_dsc->header.cf))
+        return false;
+
+    if(draw_dsc->tile || draw_dsc->recolor_opa > LV_OPA_MIN || draw_dsc->clip_radius ||
+       draw_dsc->bitmap_mask_src || draw_dsc->blend_mode != LV_BLEND_MODE_NORMAL ||
+       draw_dsc->skew_x || draw_dsc->skew_y)
+        return false;
+
+    /*The SRM engine rotates by multiples of 90 degree only, other angles are left to SW*/
+    if(draw_dsc->rotation != 0 && draw_dsc->rotation != 900 && draw_dsc->rotation != 1800 &&
+       draw_dsc->rotation != 2700)
+        return false;
+
+    /*The SRM engine steps in 1/16, other factors are left to SW to match its result*/
+    bool has_scale = (draw_dsc->scale_x != LV_SCALE_NONE || draw_dsc->scale_y != LV_SCALE_NONE);
+    if(has_scale) {
+        if(draw_dsc->scale_x % 16 || draw_dsc->scale_y % 16 || draw_dsc->scale_x <= 0 || draw_dsc->scale_y <= 0)
+            return false;
+    }
+
+    return true;
+}
+
+static int32_t _ppa_evaluate(lv_draw_unit_t * u, lv_draw_task_t * t)
+{
+    lv_draw_ppa_unit_t * draw_ppa_unit = (lv_draw_ppa_unit_t *) u;
+    const lv_draw_dsc_base_t * draw_dsc_base = (lv_draw_dsc_base_t *) t->draw_dsc;
+    lv_layer_t * layer = draw_dsc_base->layer;
+
+    if(!_ppa_dest_cf_supported(layer->color_format))
+        return 0;
+
+    /*Setting up a transaction costs more than drawing a small area with the CPU*/
+    if(!_ppa_area_large_enough(t))
+        return 0;
+
+    /*The buffer of a display layer is known already, other layers are checked when drawn*/
+    if(layer->draw_buf) {
+        lv_area_t rel_area;
+        if(!lv_area_intersect(&rel_area, &t->_real_area, &t->clip_area))
+            return 0;
+        lv_area_move(&rel_area, -layer->buf_area.x1, -layer->buf_area.y1);
+        if(!lv_ppa_dest_buf_supported(draw_ppa_unit, layer->draw_buf, &rel_area))
+            return 0;
+    }
+
+    switch(t->type) {
+        case LV_DRAW_TASK_TYPE_FILL: {
+                const lv_draw_fill_dsc_t * draw_dsc = (lv_draw_fill_dsc_t *) t->draw_dsc;
+
+                /* Most simple case: just a plain rectangle (no radius, no gradient). */
+                if((draw_dsc->radius != 0) || (draw_dsc->grad.dir != (lv_grad_dir_t)LV_GRAD_DIR_NONE))
+                    return 0;
+
+                break;
+            }
+
+        case LV_DRAW_TASK_TYPE_IMAGE: {
+                const lv_draw_image_dsc_t * draw_dsc = (lv_draw_image_dsc_t *) t->draw_dsc;
+
+                if(!_ppa_draw_img_supported(draw_dsc))
+                    return 0;
+
+                break;
+            }
+        default:
+            return 0;
+    }
+
+    if(t->preference_score > 70) {
+        t->preference_score = 70;
+        t->preferred_draw_unit_id = DRAW_UNIT_ID_PPA;
+    }
+    return 1;
+}
+
+static int32_t _ppa_dispatch(lv_draw_unit_t * draw_unit, lv_layer_t * layer)
+{
+    lv_draw_ppa_unit_t * draw_ppa_unit = (lv_draw_ppa_unit_t *) draw_unit;
+
+    /* Return immediately if it's busy with draw task. */
+    if(draw_ppa_unit->task_act)
+        return 0;
+
+    /* Try to get an ready to draw. */
+    lv_draw_task_t * t = lv_draw_get_next_available_task(layer, NULL, DRAW_UNIT_ID_PPA);
+
+    if(t == NULL || t->preferred_draw_unit_id != DRAW_UNIT_ID_PPA)
+        return LV_DRAW_UNIT_IDLE;
+
+    if(lv_draw_layer_alloc_buf(layer) == NULL)
+        return LV_DRAW_UNIT_IDLE;
+
+    t->state = LV_DRAW_TASK_STATE_IN_PROGRESS;
+    draw_ppa_unit->base_unit.target_layer = layer;
+    draw_ppa_unit->base_unit.clip_area = &t->clip_area;
+    draw_ppa_unit->task_act = t;
+
+    _ppa_execute_drawing(draw_ppa_unit);
+
+    draw_ppa_unit->task_act->state = LV_DRAW_TASK_STATE_READY;
+    draw_ppa_unit->task_act = NULL;
+
+    /* The draw unit is free now. Request a new dispatching as it can get a new task. */
+    lv_draw_dispatch_request();
+
+    return 1;
+}
+
+static int32_t _ppa_delete(lv_draw_unit_t * draw_unit)
+{
+    lv_draw_ppa_unit_t * draw_ppa_unit = (lv_draw_ppa_unit_t *) draw_unit;
+
+    if(draw_ppa_unit->srm_client)
+        ppa_unregister_client(draw_ppa_unit->srm_client);
+    if(draw_ppa_unit->blend_client)
+        ppa_unregister_client(draw_ppa_unit->blend_client);
+    if(draw_ppa_unit->fill_client)
+        ppa_unregister_client(draw_ppa_unit->fill_client);
+
+    heap_caps_free(draw_ppa_unit->scratch_buf);
+    draw_ppa_unit->scratch_buf = NULL;
+    draw_ppa_unit->scratch_size = 0;
+
+    return 0;
+}
+
+static void _ppa_execute_drawing(lv_draw_ppa_unit_t * u)
+{
+    lv_draw_task_t * t = u->task_act;
+    lv_draw_unit_t * draw_unit = (lv_draw_unit_t *)u;
+
+    /*The PPA driver syncs the cache of the buffers it reads and writes itself*/
+    switch(t->type) {
+        case LV_DRAW_TASK_TYPE_FILL:
+            lv_draw_ppa_fill(draw_unit, t->draw_dsc, &t->area);
+            break;
+        case LV_DRAW_TASK_TYPE_IMAGE:
+            lv_draw_ppa_img(draw_unit, t->draw_dsc, &t->area);
+            break;
+        default:
+            break;
+    }
+}
+
+#endif /*LV_USE_PPA*/
@@ -0,0 +1,93 @@
+/**
+ * @file lv_draw_ppa.h
+ *
+ */
+
+#ifndef LV_DRAW_PPA_H
+#define LV_DRAW_PPA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "../../../lv_conf_internal.h"
+
+#if LV_USE_PPA
+#include "../../lv_draw_private.h"
+#include "../../lv_draw_rect.h"
+#include "../../lv_draw_image_private.h"
+#include "../../lv_draw_buf_private.h"
+#include "../../../misc/lv_area_private.h"
+#include "driver/ppa.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    lv_draw_unit_t base_unit;
+    lv_draw_task_t * task_act;
+
+    ppa_client_handle_t srm_client;
+    ppa_client_handle_t blend_client;
+    ppa_client_handle_t fill_client;
+
+    /*Output buffers are synced by cache line, so they must start and end on one*/
+    size_t buf_align;
+
+    /*Transformed images are written here first if they have to be blended or clipped*/
+    void * scratch_buf;
+    size_t scratch_size;
+} lv_draw_ppa_unit_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void lv_draw_ppa_init(void);
+
+void lv_draw_ppa_deinit(void);
+
+void lv_draw_ppa_fill(lv_draw_unit_t * draw_unit, const lv_draw_fill_dsc_t * dsc,
+                      const lv_area_t * coords);
+
+void lv_draw_ppa_img(lv_draw_unit_t * draw_unit, const lv_draw_image_dsc_t * dsc,
+                     const lv_area_t * coords);
+
+/**
+ * Check that the PPA can write `area` (relative to the buffer) of a draw buffer.
+ * @param u         the PPA draw unit
+ * @param draw_buf  the destination buffer
+ * @param area      the area to write, relative to the buffer
+ * @return          true if the buffer is DMA capable, cache line aligned and holds the area
+ */
+bool lv_ppa_dest_buf_supported(const lv_draw_ppa_unit_t * u, const lv_draw_buf_t * draw_buf,
+                               const lv_area_t * area);
+
+/**
+ * The output buffer size passed to the PPA, the whole cache lines of a draw buffer.
+ * @param u         the PPA draw unit
+ * @param draw_buf  the destination buffer
+ * @return          the size in bytes
+ */
+uint32_t lv_ppa_dest_buf_size(const lv_draw_ppa_unit_t * u, const lv_draw_buf_t * draw_buf);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#endif /*LV_USE_PPA*/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_DRAW_PPA_H*/
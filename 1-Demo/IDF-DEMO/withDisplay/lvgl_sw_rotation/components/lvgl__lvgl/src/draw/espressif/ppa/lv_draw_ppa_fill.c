@@ -0,0 +1,170 @@
+/**
+ * @file lv_draw_ppa_fill.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "lv_draw_ppa.h"
+
+#if LV_USE_PPA
+#include "../../sw/lv_draw_sw.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static esp_err_t _ppa_fill(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                           const lv_draw_fill_dsc_t * dsc);
+
+static esp_err_t _ppa_fill_opa(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                               const lv_draw_fill_dsc_t * dsc);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lv_draw_ppa_fill(lv_draw_unit_t * draw_unit, const lv_draw_fill_dsc_t * dsc,
+                      const lv_area_t * coords)
+{
+    if(dsc->opa <= (lv_opa_t)LV_OPA_MIN)
+        return;
+
+    lv_draw_ppa_unit_t * u = (lv_draw_ppa_unit_t *) draw_unit;
+    lv_layer_t * layer = draw_unit->target_layer;
+    lv_draw_buf_t * draw_buf = layer->draw_buf;
+
+    lv_area_t rel_coords;
+    lv_area_copy(&rel_coords, coords);
+    lv_area_move(&rel_coords, -layer->buf_area.x1, -layer->buf_area.y1);
+
+    lv_area_t rel_clip_area;
+    lv_area_copy(&rel_clip_area, draw_unit->clip_area);
+    lv_area_move(&rel_clip_area, -layer->buf_area.x1, -layer->buf_area.y1);
+
+    lv_area_t blend_area;
+    if(!lv_area_intersect(&blend_area, &rel_coords, &rel_clip_area))
+        return; /*Fully clipped, nothing to do*/
+
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+    if(lv_ppa_dest_buf_supported(u, draw_buf, &blend_area)) {
+        if(dsc->opa >= (lv_opa_t)LV_OPA_MAX)
+            err = _ppa_fill(u, draw_buf, &blend_area, dsc);
+        else
+            err = _ppa_fill_opa(u, draw_buf, &blend_area, dsc);
+    }
+
+    /*A layer buffer the PPA can't write, or a failed transaction, is drawn by SW*/
+    if(err != ESP_OK)
+        lv_draw_sw_fill(draw_unit, (lv_draw_fill_dsc_t *)dsc, coords);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static esp_err_t _ppa_fill(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                           const lv_draw_fill_dsc_t * dsc)
+{
+    lv_color_format_t dest_cf = draw_buf->header.cf;
+    uint32_t px_size = lv_color_format_get_size(dest_cf);
+
+    ppa_fill_oper_config_t fill_config = {
+        .out = {
+            .buffer = draw_buf->data,
+            .buffer_size = lv_ppa_dest_buf_size(u, draw_buf),
+            .pic_w = draw_buf->header.stride / px_size,
+            .pic_h = draw_buf->header.h,
+            .block_offset_x = dest_area->x1,
+            .block_offset_y = dest_area->y1,
+            .fill_cm = (dest_cf == LV_COLOR_FORMAT_RGB565) ? PPA_FILL_COLOR_MODE_RGB565 : PPA_FILL_COLOR_MODE_RGB888,
+        },
+        .fill_block_w = lv_area_get_width(dest_area),
+        .fill_block_h = lv_area_get_height(dest_area),
+        .fill_argb_color = {
+            .val = lv_color_to_u32(dsc->color),
+        },
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    return ppa_do_fill(u->fill_client, &fill_config);
+}
+
+static esp_err_t _ppa_fill_opa(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                               const lv_draw_fill_dsc_t * dsc)
+{
+    lv_color_format_t dest_cf = draw_buf->header.cf;
+    uint32_t px_size = lv_color_format_get_size(dest_cf);
+    ppa_blend_color_mode_t cm = (dest_cf == LV_COLOR_FORMAT_RGB565) ? PPA_BLEND_COLOR_MODE_RGB565 :
+                                PPA_BLEND_COLOR_MODE_RGB888;
+    uint32_t w = lv_area_get_width(dest_area);
+    uint32_t h = lv_area_get_height(dest_area);
+
+    /*
+     * The blend engine has no color generator, so the foreground is an A8 block in the fill
+     * color whose alpha is replaced by the fill opacity. Its bytes are never used, so the
+     * start of the destination buffer, which holds at least w * h bytes, serves as its source.
+     */
+    ppa_blend_oper_config_t blend_config = {
+        .in_bg = {
+            .buffer = draw_buf->data,
+            .pic_w = draw_buf->header.stride / px_size,
+            .pic_h = draw_buf->header.h,
+            .block_w = w,
+            .block_h = h,
+            .block_offset_x = dest_area->x1,
+            .block_offset_y = dest_area->y1,
+            .blend_cm = cm,
+        },
+        .in_fg = {
+            .buffer = draw_buf->data,
+            .pic_w = w,
+            .pic_h = h,
+            .block_w = w,
+            .block_h = h,
+            .block_offset_x = 0,
+            .block_offset_y = 0,
+            .blend_cm = PPA_BLEND_COLOR_MODE_A8,
+        },
+        .out = {
+            .buffer = draw_buf->data,
+            .buffer_size = lv_ppa_dest_buf_size(u, draw_buf),
+            .pic_w = draw_buf->header.stride / px_size,
+            .pic_h = draw_buf->header.h,
+            .block_offset_x = dest_area->x1,
+            .block_offset_y = dest_area->y1,
+            .blend_cm = cm,
+        },
+        .bg_alpha_update_mode = PPA_ALPHA_NO_CHANGE,
+        .fg_alpha_update_mode = PPA_ALPHA_FIX_VALUE,
+        .fg_alpha_fix_val = dsc->opa,
+        .fg_fix_rgb_val = {
+            .b = dsc->color.blue,
+            .g = dsc->color.green,
+            .r = dsc->color.red,
+        },
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    return ppa_do_blend(u->blend_client, &blend_config);
+}
+
+#endif /*LV_USE_PPA*/
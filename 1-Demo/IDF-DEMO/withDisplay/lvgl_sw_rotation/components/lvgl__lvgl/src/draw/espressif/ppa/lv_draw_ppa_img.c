@@ -0,0 +1,378 @@
+/**
+ * @file lv_draw_ppa_img.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "lv_draw_ppa.h"
+
+#if LV_USE_PPA
+#include "../../sw/lv_draw_sw.h"
+#include "esp_heap_caps.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+/* Copy, scale or rotate with the SRM engine, for images w/o opa and alpha channel */
+static esp_err_t _ppa_blit_srm(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                               const lv_image_dsc_t * img_dsc, uint32_t src_stride, const lv_area_t * src_area,
+                               const lv_draw_image_dsc_t * dsc);
+
+/* Scale and rotate the whole image into the scratch buffer, then blend the visible part of it */
+static esp_err_t _ppa_blit_transformed(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * trans_area,
+                                       const lv_area_t * blend_area, const lv_image_dsc_t * img_dsc, uint32_t src_stride,
+                                       const lv_draw_image_dsc_t * dsc);
+
+/* Area of the scaled and rotated image, relative to the image */
+static void _ppa_transformed_area(const lv_draw_image_dsc_t * dsc, int32_t img_w, int32_t img_h, lv_area_t * res);
+
+static void * _ppa_scratch_get(lv_draw_ppa_unit_t * u, size_t size);
+
+static ppa_srm_color_mode_t _ppa_srm_cm(lv_color_format_t cf);
+
+/* Blend with the blend engine, for images w/ opa or alpha channel */
+static esp_err_t _ppa_blit_blend(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                                 const lv_image_dsc_t * img_dsc, uint32_t src_stride, const lv_area_t * src_area,
+                                 lv_opa_t opa);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**********************
+ *      MACROS
+ **********************/
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void lv_draw_ppa_img(lv_draw_unit_t * draw_unit, const lv_draw_image_dsc_t * dsc,
+                     const lv_area_t * coords)
+{
+    if(dsc->opa <= (lv_opa_t)LV_OPA_MIN)
+        return;
+
+    lv_draw_ppa_unit_t * u = (lv_draw_ppa_unit_t *) draw_unit;
+    lv_layer_t * layer = draw_unit->target_layer;
+    lv_draw_buf_t * draw_buf = layer->draw_buf;
+    const lv_image_dsc_t * img_dsc = dsc->src;
+    int32_t img_w = img_dsc->header.w;
+    int32_t img_h = img_dsc->header.h;
+
+    uint32_t src_stride = img_dsc->header.stride;
+    if(src_stride == 0)
+        src_stride = lv_draw_buf_width_to_stride(img_w, img_dsc->header.cf);
+
+    lv_area_t rel_clip_area;
+    lv_area_copy(&rel_clip_area, draw_unit->clip_area);
+    lv_area_move(&rel_clip_area, -layer->buf_area.x1, -layer->buf_area.y1);
+
+    lv_area_t blend_area;
+    lv_area_t src_area;
+    bool has_scale = (dsc->scale_x != LV_SCALE_NONE || dsc->scale_y != LV_SCALE_NONE);
+    bool src_has_alpha = (img_dsc->header.cf == LV_COLOR_FORMAT_ARGB8888);
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+
+    if(lv_area_get_width(coords) != img_w || lv_area_get_height(coords) != img_h) {
+        /*Stretched or cropped image areas are left to SW*/
+    }
+    else if(has_scale || dsc->rotation) {
+        /*
+         * The SRM engine scales and rotates the whole image around the pivot. It has no blending
+         * and its output can't be clipped, so it writes straight into the layer only for an opaque
+         * image that is fully visible. Otherwise it goes through the scratch buffer.
+         */
+        lv_area_t trans_area;
+        _ppa_transformed_area(dsc, img_w, img_h, &trans_area);
+        lv_area_move(&trans_area, coords->x1 - layer->buf_area.x1, coords->y1 - layer->buf_area.y1);
+
+        if(lv_area_get_width(&trans_area) <= 0 || lv_area_get_height(&trans_area) <= 0) {
+            /*Scaled down to nothing, left to SW*/
+        }
+        else if(!lv_area_intersect(&blend_area, &trans_area, &rel_clip_area)) {
+            return; /*Fully clipped, nothing to do*/
+        }
+        else if(!lv_ppa_dest_buf_supported(u, draw_buf, &blend_area)) {
+            /*Left to SW*/
+        }
+        else if(!src_has_alpha && dsc->opa >= (lv_opa_t)LV_OPA_MAX && lv_area_is_in(&trans_area, &rel_clip_area, 0)) {
+            lv_area_set(&src_area, 0, 0, img_w - 1, img_h - 1);
+            err = _ppa_blit_srm(u, draw_buf, &trans_area, img_dsc, src_stride, &src_area, dsc);
+        }
+        else {
+            err = _ppa_blit_transformed(u, draw_buf, &trans_area, &blend_area, img_dsc, src_stride, dsc);
+        }
+    }
+    else {
+        lv_area_t rel_coords;
+        lv_area_copy(&rel_coords, coords);
+        lv_area_move(&rel_coords, -layer->buf_area.x1, -layer->buf_area.y1);
+
+        if(!lv_area_intersect(&blend_area, &rel_coords, &rel_clip_area))
+            return; /*Fully clipped, nothing to do*/
+
+        src_area.x1 = blend_area.x1 - rel_coords.x1;
+        src_area.y1 = blend_area.y1 - rel_coords.y1;
+        src_area.x2 = src_area.x1 + lv_area_get_width(&blend_area) - 1;
+        src_area.y2 = src_area.y1 + lv_area_get_height(&blend_area) - 1;
+
+        if(lv_ppa_dest_buf_supported(u, draw_buf, &blend_area)) {
+            if(src_has_alpha || dsc->opa < (lv_opa_t)LV_OPA_MAX)
+                err = _ppa_blit_blend(u, draw_buf, &blend_area, img_dsc, src_stride, &src_area, dsc->opa);
+            else
+                err = _ppa_blit_srm(u, draw_buf, &blend_area, img_dsc, src_stride, &src_area, dsc);
+        }
+    }
+
+    /*A layer buffer the PPA can't write, or a failed transaction, is drawn by SW*/
+    if(err != ESP_OK)
+        lv_draw_sw_image(draw_unit, dsc, coords);
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static esp_err_t _ppa_blit_srm(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                               const lv_image_dsc_t * img_dsc, uint32_t src_stride, const lv_area_t * src_area,
+                               const lv_draw_image_dsc_t * dsc)
+{
+    lv_color_format_t src_cf = img_dsc->header.cf;
+    lv_color_format_t dest_cf = draw_buf->header.cf;
+
+    /*LVGL rotates clockwise, the SRM engine counterclockwise*/
+    ppa_srm_rotation_angle_t rotation_angle;
+    switch(dsc->rotation) {
+        case 900:
+            rotation_angle = PPA_SRM_ROTATION_ANGLE_270;
+            break;
+        case 1800:
+            rotation_angle = PPA_SRM_ROTATION_ANGLE_180;
+            break;
+        case 2700:
+            rotation_angle = PPA_SRM_ROTATION_ANGLE_90;
+            break;
+        default:
+            rotation_angle = PPA_SRM_ROTATION_ANGLE_0;
+            break;
+    }
+
+    ppa_srm_oper_config_t srm_config = {
+        .in = {
+            .buffer = img_dsc->data,
+            .pic_w = src_stride / lv_color_format_get_size(src_cf),
+            .pic_h = img_dsc->header.h,
+            .block_w = lv_area_get_width(src_area),
+            .block_h = lv_area_get_height(src_area),
+            .block_offset_x = src_area->x1,
+            .block_offset_y = src_area->y1,
+            .srm_cm = _ppa_srm_cm(src_cf),
+        },
+        .out = {
+            .buffer = draw_buf->data,
+            .buffer_size = lv_ppa_dest_buf_size(u, draw_buf),
+            .pic_w = draw_buf->header.stride / lv_color_format_get_size(dest_cf),
+            .pic_h = draw_buf->header.h,
+            .block_offset_x = dest_area->x1,
+            .block_offset_y = dest_area->y1,
+            .srm_cm = _ppa_srm_cm(dest_cf),
+        },
+        .rotation_angle = rotation_angle,
+        .scale_x = (float)dsc->scale_x / LV_SCALE_NONE,
+        .scale_y = (float)dsc->scale_y / LV_SCALE_NONE,
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    return ppa_do_scale_rotate_mirror(u->srm_client, &srm_config);
+}
+
+static esp_err_t _ppa_blit_transformed(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * trans_area,
+                                       const lv_area_t * blend_area, const lv_image_dsc_t * img_dsc, uint32_t src_stride,
+                                       const lv_draw_image_dsc_t * dsc)
+{
+    /*The scratch keeps the format and alpha channel of the image, so translucent pixels are blended afterwards*/
+    lv_color_format_t scratch_cf = img_dsc->header.cf;
+    int32_t trans_w = lv_area_get_width(trans_area);
+    int32_t trans_h = lv_area_get_height(trans_area);
+    uint32_t scratch_stride = trans_w * lv_color_format_get_size(scratch_cf);
+    size_t scratch_size = LV_ALIGN_UP((size_t)scratch_stride * trans_h, u->buf_align);
+
+    void * scratch = _ppa_scratch_get(u, scratch_size);
+    if(scratch == NULL)
+        return ESP_ERR_NO_MEM;
+
+    lv_draw_buf_t scratch_buf = {
+        .header = {
+            .cf = scratch_cf,
+            .w = trans_w,
+            .h = trans_h,
+            .stride = scratch_stride,
+        },
+        .data = scratch,
+        .data_size = scratch_size,
+    };
+    lv_area_t scratch_area;
+    lv_area_set(&scratch_area, 0, 0, trans_w - 1, trans_h - 1);
+    lv_area_t src_area;
+    lv_area_set(&src_area, 0, 0, img_dsc->header.w - 1, img_dsc->header.h - 1);
+
+    esp_err_t err = _ppa_blit_srm(u, &scratch_buf, &scratch_area, img_dsc, src_stride, &src_area, dsc);
+    if(err != ESP_OK)
+        return err;
+
+    lv_image_dsc_t scratch_dsc = {
+        .header = scratch_buf.header,
+        .data_size = scratch_size,
+        .data = scratch,
+    };
+    lv_area_t visible_area;
+    lv_area_copy(&visible_area, blend_area);
+    lv_area_move(&visible_area, -trans_area->x1, -trans_area->y1);
+
+    return _ppa_blit_blend(u, draw_buf, blend_area, &scratch_dsc, scratch_stride, &visible_area, dsc->opa);
+}
+
+static void _ppa_transformed_area(const lv_draw_image_dsc_t * dsc, int32_t img_w, int32_t img_h, lv_area_t * res)
+{
+    int32_t px = dsc->pivot.x;
+    int32_t py = dsc->pivot.y;
+
+    /*Scale around the pivot first, the same way as the SRM engine sizes its output*/
+    lv_area_t s;
+    s.x1 = px + ((-px * dsc->scale_x) >> 8);
+    s.y1 = py + ((-py * dsc->scale_y) >> 8);
+    s.x2 = s.x1 + ((img_w * dsc->scale_x) >> 8) - 1;
+    s.y2 = s.y1 + ((img_h * dsc->scale_y) >> 8) - 1;
+
+    /*Then rotate it clockwise around the pivot*/
+    switch(dsc->rotation) {
+        case 900:
+            lv_area_set(res, px + py - s.y2, py - px + s.x1, px + py - s.y1, py - px + s.x2);
+            break;
+        case 1800:
+            lv_area_set(res, 2 * px - s.x2, 2 * py - s.y2, 2 * px - s.x1, 2 * py - s.y1);
+            break;
+        case 2700:
+            lv_area_set(res, px - py + s.y1, px + py - s.x2, px - py + s.y2, px + py - s.x1);
+            break;
+        default:
+            lv_area_copy(res, &s);
+            break;
+    }
+}
+
+static void * _ppa_scratch_get(lv_draw_ppa_unit_t * u, size_t size)
+{
+    if(u->scratch_size >= size)
+        return u->scratch_buf;
+
+    /*Grown to the largest transformed image so far, and kept for the next ones*/
+    heap_caps_free(u->scratch_buf);
+    u->scratch_buf = heap_caps_aligned_calloc(u->buf_align, 1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+    u->scratch_size = u->scratch_buf ? size : 0;
+
+    return u->scratch_buf;
+}
+
+static ppa_srm_color_mode_t _ppa_srm_cm(lv_color_format_t cf)
+{
+    switch(cf) {
+        case LV_COLOR_FORMAT_RGB565:
+            return PPA_SRM_COLOR_MODE_RGB565;
+        case LV_COLOR_FORMAT_ARGB8888:
+            return PPA_SRM_COLOR_MODE_ARGB8888;
+        default:
+            return PPA_SRM_COLOR_MODE_RGB888;
+    }
+}
+
+static esp_err_t _ppa_blit_blend(lv_draw_ppa_unit_t * u, lv_draw_buf_t * draw_buf, const lv_area_t * dest_area,
+                                 const lv_image_dsc_t * img_dsc, uint32_t src_stride, const lv_area_t * src_area,
+                                 lv_opa_t opa)
+{
+    lv_color_format_t src_cf = img_dsc->header.cf;
+    lv_color_format_t dest_cf = draw_buf->header.cf;
+    uint32_t dest_px_size = lv_color_format_get_size(dest_cf);
+    ppa_blend_color_mode_t dest_cm = (dest_cf == LV_COLOR_FORMAT_RGB565) ? PPA_BLEND_COLOR_MODE_RGB565 :
+                                     PPA_BLEND_COLOR_MODE_RGB888;
+    ppa_blend_color_mode_t src_cm;
+    switch(src_cf) {
+        case LV_COLOR_FORMAT_RGB565:
+            src_cm = PPA_BLEND_COLOR_MODE_RGB565;
+            break;
+        case LV_COLOR_FORMAT_RGB888:
+            src_cm = PPA_BLEND_COLOR_MODE_RGB888;
+            break;
+        default:
+            src_cm = PPA_BLEND_COLOR_MODE_ARGB8888;
+            break;
+    }
+    uint32_t w = lv_area_get_width(dest_area);
+    uint32_t h = lv_area_get_height(dest_area);
+
+    ppa_blend_oper_config_t blend_config = {
+        .in_bg = {
+            .buffer = draw_buf->data,
+            .pic_w = draw_buf->header.stride / dest_px_size,
+            .pic_h = draw_buf->header.h,
+            .block_w = w,
+            .block_h = h,
+            .block_offset_x = dest_area->x1,
+            .block_offset_y = dest_area->y1,
+            .blend_cm = dest_cm,
+        },
+        .in_fg = {
+            .buffer = img_dsc->data,
+            .pic_w = src_stride / lv_color_format_get_size(src_cf),
+            .pic_h = img_dsc->header.h,
+            .block_w = w,
+            .block_h = h,
+            .block_offset_x = src_area->x1,
+            .block_offset_y = src_area->y1,
+            .blend_cm = src_cm,
+        },
+        .out = {
+            .buffer = draw_buf->data,
+            .buffer_size = lv_ppa_dest_buf_size(u, draw_buf),
+            .pic_w = draw_buf->header.stride / dest_px_size,
+            .pic_h = draw_buf->header.h,
+            .block_offset_x = dest_area->x1,
+            .block_offset_y = dest_area->y1,
+            .blend_cm = dest_cm,
+        },
+        .bg_alpha_update_mode = PPA_ALPHA_NO_CHANGE,
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    /*The image opacity scales the alpha channel, or is the alpha of an image without one*/
+    if(opa < (lv_opa_t)LV_OPA_MAX) {
+        if(src_cm == PPA_BLEND_COLOR_MODE_ARGB8888) {
+            blend_config.fg_alpha_update_mode = PPA_ALPHA_SCALE;
+            blend_config.fg_alpha_scale_ratio = (float)opa / LV_OPA_COVER;
+        }
+        else {
+            blend_config.fg_alpha_update_mode = PPA_ALPHA_FIX_VALUE;
+            blend_config.fg_alpha_fix_val = opa;
+        }
+    }
+    else {
+        blend_config.fg_alpha_update_mode = PPA_ALPHA_NO_CHANGE;
+    }
+
+    return ppa_do_blend(u->blend_client, &blend_config);
+}
+
+#endif /*LV_USE_PPA*/
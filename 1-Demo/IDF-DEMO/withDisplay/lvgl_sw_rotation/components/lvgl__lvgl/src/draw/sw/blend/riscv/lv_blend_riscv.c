@@ -0,0 +1,282 @@
+/**
+ * @file lv_blend_riscv.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "lv_blend_riscv.h"
+
+#if LV_USE_DRAW_SW && LV_USE_DRAW_SW_ASM == LV_DRAW_SW_ASM_RISCV && defined(__riscv) && __riscv_xlen == 32
+
+#include "../../../../misc/lv_color.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*Green in the upper half of the word, red and blue in the lower half, with room for a 5 bit product*/
+#define RGB565_SPREAD_MASK  0x07E0F81FU
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static inline uint32_t LV_ATTRIBUTE_FAST_MEM rgb565_spread(uint16_t c);
+
+static inline uint16_t LV_ATTRIBUTE_FAST_MEM rgb565_mix(uint32_t fg_spread, uint16_t bg, uint32_t mix_5bit);
+
+static inline uint16_t LV_ATTRIBUTE_FAST_MEM argb8888_mix(const uint8_t * src, uint16_t dest, uint32_t mix);
+
+static inline void * LV_ATTRIBUTE_FAST_MEM drawbuf_next_row(const void * buf, uint32_t stride);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+lv_result_t LV_ATTRIBUTE_FAST_MEM lv_color_blend_to_rgb565_riscv(lv_draw_sw_blend_fill_dsc_t * dsc)
+{
+    int32_t w = dsc->dest_w;
+    int32_t h = dsc->dest_h;
+    int32_t dest_stride = dsc->dest_stride;
+    uint16_t * dest_buf_u16 = dsc->dest_buf;
+    uint16_t color16 = lv_color_to_u16(dsc->color);
+    uint32_t c32 = (uint32_t)color16 | ((uint32_t)color16 << 16);
+
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        uint16_t * dest = dest_buf_u16;
+        int32_t x = w;
+        if(x > 0 && ((lv_uintptr_t)dest & 0x3)) {
+            *dest++ = color16;
+            x--;
+        }
+
+        uint32_t * dest32 = (uint32_t *)dest;
+        for(; x >= 16; x -= 16) {
+            dest32[0] = c32;
+            dest32[1] = c32;
+            dest32[2] = c32;
+            dest32[3] = c32;
+            dest32[4] = c32;
+            dest32[5] = c32;
+            dest32[6] = c32;
+            dest32[7] = c32;
+            dest32 += 8;
+        }
+        for(; x >= 2; x -= 2) {
+            *dest32++ = c32;
+        }
+
+        if(x) *(uint16_t *)dest32 = color16;
+
+        dest_buf_u16 = drawbuf_next_row(dest_buf_u16, dest_stride);
+    }
+
+    return LV_RESULT_OK;
+}
+
+lv_result_t LV_ATTRIBUTE_FAST_MEM lv_color_blend_to_rgb565_with_opa_riscv(lv_draw_sw_blend_fill_dsc_t * dsc)
+{
+    int32_t w = dsc->dest_w;
+    int32_t h = dsc->dest_h;
+    int32_t dest_stride = dsc->dest_stride;
+    uint16_t * dest_buf_u16 = dsc->dest_buf;
+    uint32_t fg = rgb565_spread(lv_color_to_u16(dsc->color));
+    uint32_t mix = ((uint32_t)dsc->opa + 4) >> 3;
+
+    /*Fills mostly cover flat backgrounds, so remember the last pixel pair and its result*/
+    uint32_t last_dest32 = 0;
+    uint32_t last_res32 = (uint32_t)rgb565_mix(fg, 0, mix) * 0x10001U;
+
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        uint16_t * dest = dest_buf_u16;
+        int32_t x = w;
+        if(x > 0 && ((lv_uintptr_t)dest & 0x3)) {
+            *dest = rgb565_mix(fg, *dest, mix);
+            dest++;
+            x--;
+        }
+
+        uint32_t * dest32 = (uint32_t *)dest;
+        for(; x >= 2; x -= 2) {
+            uint32_t d32 = *dest32;
+            if(d32 != last_dest32) {
+                uint16_t lo = rgb565_mix(fg, (uint16_t)d32, mix);
+                uint16_t hi = (d32 >> 16) == (d32 & 0xFFFF) ? lo : rgb565_mix(fg, (uint16_t)(d32 >> 16), mix);
+                last_dest32 = d32;
+                last_res32 = (uint32_t)lo | ((uint32_t)hi << 16);
+            }
+            *dest32++ = last_res32;
+        }
+
+        if(x) {
+            dest = (uint16_t *)dest32;
+            *dest = rgb565_mix(fg, *dest, mix);
+        }
+
+        dest_buf_u16 = drawbuf_next_row(dest_buf_u16, dest_stride);
+    }
+
+    return LV_RESULT_OK;
+}
+
+lv_result_t LV_ATTRIBUTE_FAST_MEM lv_rgb565_blend_normal_to_rgb565_with_opa_riscv(lv_draw_sw_blend_image_dsc_t * dsc)
+{
+    int32_t w = dsc->dest_w;
+    int32_t h = dsc->dest_h;
+    int32_t dest_stride = dsc->dest_stride;
+    uint16_t * dest_buf_u16 = dsc->dest_buf;
+    const uint16_t * src_buf_u16 = dsc->src_buf;
+    int32_t src_stride = dsc->src_stride;
+    uint32_t mix = ((uint32_t)dsc->opa + 4) >> 3;
+
+    int32_t x;
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        for(x = 0; x < w; x++) {
+            uint16_t src = src_buf_u16[x];
+            uint16_t dest = dest_buf_u16[x];
+            if(src != dest) dest_buf_u16[x] = rgb565_mix(rgb565_spread(src), dest, mix);
+        }
+        dest_buf_u16 = drawbuf_next_row(dest_buf_u16, dest_stride);
+        src_buf_u16 = drawbuf_next_row(src_buf_u16, src_stride);
+    }
+
+    return LV_RESULT_OK;
+}
+
+lv_result_t LV_ATTRIBUTE_FAST_MEM lv_argb8888_blend_normal_to_rgb565_riscv(lv_draw_sw_blend_image_dsc_t * dsc)
+{
+    int32_t w = dsc->dest_w;
+    int32_t h = dsc->dest_h;
+    int32_t dest_stride = dsc->dest_stride;
+    uint16_t * dest_buf_u16 = dsc->dest_buf;
+    const uint8_t * src_buf_u8 = dsc->src_buf;
+    int32_t src_stride = dsc->src_stride;
+
+    int32_t x;
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        const uint8_t * src = src_buf_u8;
+        for(x = 0; x < w; x++, src += 4) {
+            uint8_t a = src[3];
+            if(a == LV_OPA_TRANSP) continue;
+            if(a == LV_OPA_COVER) {
+                dest_buf_u16[x] = ((src[2] & 0xF8) << 8) | ((src[1] & 0xFC) << 3) | (src[0] >> 3);
+            }
+            else {
+                dest_buf_u16[x] = argb8888_mix(src, dest_buf_u16[x], a);
+            }
+        }
+        dest_buf_u16 = drawbuf_next_row(dest_buf_u16, dest_stride);
+        src_buf_u8 += src_stride;
+    }
+
+    return LV_RESULT_OK;
+}
+
+lv_result_t LV_ATTRIBUTE_FAST_MEM lv_argb8888_blend_normal_to_rgb565_with_opa_riscv(lv_draw_sw_blend_image_dsc_t * dsc)
+{
+    int32_t w = dsc->dest_w;
+    int32_t h = dsc->dest_h;
+    int32_t dest_stride = dsc->dest_stride;
+    uint16_t * dest_buf_u16 = dsc->dest_buf;
+    const uint8_t * src_buf_u8 = dsc->src_buf;
+    int32_t src_stride = dsc->src_stride;
+    lv_opa_t opa = dsc->opa;
+
+    int32_t x;
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        const uint8_t * src = src_buf_u8;
+        for(x = 0; x < w; x++, src += 4) {
+            uint32_t mix = LV_OPA_MIX2(src[3], opa);
+            if(mix != LV_OPA_TRANSP) dest_buf_u16[x] = argb8888_mix(src, dest_buf_u16[x], mix);
+        }
+        dest_buf_u16 = drawbuf_next_row(dest_buf_u16, dest_stride);
+        src_buf_u8 += src_stride;
+    }
+
+    return LV_RESULT_OK;
+}
+
+lv_result_t LV_ATTRIBUTE_FAST_MEM lv_argb8888_blend_normal_to_rgb565_with_mask_riscv(lv_draw_sw_blend_image_dsc_t * dsc)
+{
+    int32_t w = dsc->dest_w;
+    int32_t h = dsc->dest_h;
+    int32_t dest_stride = dsc->dest_stride;
+    uint16_t * dest_buf_u16 = dsc->dest_buf;
+    const uint8_t * src_buf_u8 = dsc->src_buf;
+    int32_t src_stride = dsc->src_stride;
+    const lv_opa_t * mask_buf = dsc->mask_buf;
+    int32_t mask_stride = dsc->mask_stride;
+
+    int32_t x;
+    int32_t y;
+    for(y = 0; y < h; y++) {
+        const uint8_t * src = src_buf_u8;
+        for(x = 0; x < w; x++, src += 4) {
+            if(mask_buf[x] == LV_OPA_TRANSP) continue;
+            uint32_t mix = LV_OPA_MIX2(src[3], mask_buf[x]);
+            if(mix != LV_OPA_TRANSP) dest_buf_u16[x] = argb8888_mix(src, dest_buf_u16[x], mix);
+        }
+        dest_buf_u16 = drawbuf_next_row(dest_buf_u16, dest_stride);
+        src_buf_u8 += src_stride;
+        mask_buf += mask_stride;
+    }
+
+    return LV_RESULT_OK;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static inline uint32_t LV_ATTRIBUTE_FAST_MEM rgb565_spread(uint16_t c)
+{
+    return ((uint32_t)c | ((uint32_t)c << 16)) & RGB565_SPREAD_MASK;
+}
+
+/**
+ * Same result as `lv_color_16_16_mix()` for a mix below 255, without the call
+ * @param fg_spread     the foreground color, spread with `rgb565_spread()`
+ * @param bg            the background color
+ * @param mix_5bit      the mix ratio, `(mix + 4) >> 3`
+ * @return              the mixed color
+ */
+static inline uint16_t LV_ATTRIBUTE_FAST_MEM rgb565_mix(uint32_t fg_spread, uint16_t bg, uint32_t mix_5bit)
+{
+    uint32_t bg_spread = rgb565_spread(bg);
+    uint32_t res = ((((fg_spread - bg_spread) * mix_5bit) >> 5) + bg_spread) & RGB565_SPREAD_MASK;
+    return (uint16_t)((res >> 16) | res);
+}
+
+/**
+ * Same result as `lv_color_24_16_mix()` for a mix below 255.
+ * Red and blue are mixed in the two halves of one word, neither sum exceeds 16 bits.
+ * @param src       the ARGB8888 source pixel
+ * @param dest      the RGB565 destination pixel
+ * @param mix       the opacity of the source pixel
+ * @return          the mixed color
+ */
+static inline uint16_t LV_ATTRIBUTE_FAST_MEM argb8888_mix(const uint8_t * src, uint16_t dest, uint32_t mix)
+{
+    uint32_t mix_inv = 255 - mix;
+    uint32_t rb_src = ((uint32_t)(src[2] >> 3) << 16) | (src[0] >> 3);
+    uint32_t rb_dest = ((uint32_t)(dest >> 11) << 16) | (dest & 0x1F);
+    uint32_t rb = rb_src * mix + rb_dest * mix_inv;
+    uint32_t g = (uint32_t)(src[1] >> 2) * mix + ((dest >> 5) & 0x3F) * mix_inv;
+
+    return (uint16_t)(((rb >> 13) & 0xF800) | ((g >> 3) & 0x07E0) | ((rb & 0xFFFF) >> 8));
+}
+
+static inline void * LV_ATTRIBUTE_FAST_MEM drawbuf_next_row(const void * buf, uint32_t stride)
+{
+    return (void *)((uint8_t *)buf + stride);
+}
+
+#endif /*LV_USE_DRAW_SW_ASM == LV_DRAW_SW_ASM_RISCV*/
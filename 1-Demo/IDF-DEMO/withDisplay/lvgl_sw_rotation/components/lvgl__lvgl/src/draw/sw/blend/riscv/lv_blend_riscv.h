@@ -0,0 +1,121 @@
+/**
+ * @file lv_blend_riscv.h
+ *
+ */
+
+#ifndef LV_BLEND_RISCV_H
+#define LV_BLEND_RISCV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "../../../../lv_conf_internal.h"
+
+#if defined(__riscv) && __riscv_xlen == 32
+
+#ifdef LV_DRAW_SW_RISCV_CUSTOM_INCLUDE
+#include LV_DRAW_SW_RISCV_CUSTOM_INCLUDE
+#endif
+
+#include "../lv_draw_sw_blend_private.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#ifndef LV_DRAW_SW_COLOR_BLEND_TO_RGB565
+#define LV_DRAW_SW_COLOR_BLEND_TO_RGB565(dsc) \
+    lv_color_blend_to_rgb565_riscv(dsc)
+#endif
+
+#ifndef LV_DRAW_SW_COLOR_BLEND_TO_RGB565_WITH_OPA
+#define LV_DRAW_SW_COLOR_BLEND_TO_RGB565_WITH_OPA(dsc) \
+    lv_color_blend_to_rgb565_with_opa_riscv(dsc)
+#endif
+
+#ifndef LV_DRAW_SW_RGB565_BLEND_NORMAL_TO_RGB565_WITH_OPA
+#define LV_DRAW_SW_RGB565_BLEND_NORMAL_TO_RGB565_WITH_OPA(dsc)  \
+    lv_rgb565_blend_normal_to_rgb565_with_opa_riscv(dsc)
+#endif
+
+#ifndef LV_DRAW_SW_ARGB8888_BLEND_NORMAL_TO_RGB565
+#define LV_DRAW_SW_ARGB8888_BLEND_NORMAL_TO_RGB565(dsc)  \
+    lv_argb8888_blend_normal_to_rgb565_riscv(dsc)
+#endif
+
+#ifndef LV_DRAW_SW_ARGB8888_BLEND_NORMAL_TO_RGB565_WITH_OPA
+#define LV_DRAW_SW_ARGB8888_BLEND_NORMAL_TO_RGB565_WITH_OPA(dsc)  \
+    lv_argb8888_blend_normal_to_rgb565_with_opa_riscv(dsc)
+#endif
+
+#ifndef LV_DRAW_SW_ARGB8888_BLEND_NORMAL_TO_RGB565_WITH_MASK
+#define LV_DRAW_SW_ARGB8888_BLEND_NORMAL_TO_RGB565_WITH_MASK(dsc)  \
+    lv_argb8888_blend_normal_to_rgb565_with_mask_riscv(dsc)
+#endif
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * Fill an RGB565 area with a color. The rows are written two pixels per word,
+ * with the unaligned first and last pixel stored separately.
+ * @param dsc   the fill descriptor
+ * @return      LV_RESULT_OK
+ */
+lv_result_t lv_color_blend_to_rgb565_riscv(lv_draw_sw_blend_fill_dsc_t * dsc);
+
+/**
+ * Mix a color into an RGB565 area with `dsc->opa`.
+ * The pixels are mixed inline with the rounding of `lv_color_16_16_mix()`,
+ * and the result of the last pixel pair is reused for runs of equal pairs.
+ * @param dsc   the fill descriptor
+ * @return      LV_RESULT_OK
+ */
+lv_result_t lv_color_blend_to_rgb565_with_opa_riscv(lv_draw_sw_blend_fill_dsc_t * dsc);
+
+/**
+ * Mix an RGB565 image into an RGB565 area with `dsc->opa`, inline like the color fill.
+ * @param dsc   the image descriptor
+ * @return      LV_RESULT_OK
+ */
+lv_result_t lv_rgb565_blend_normal_to_rgb565_with_opa_riscv(lv_draw_sw_blend_image_dsc_t * dsc);
+
+/**
+ * Blend an ARGB8888 image into an RGB565 area.
+ * Transparent and opaque pixels skip the mixing, the others mix red and blue in one multiply.
+ * @param dsc   the image descriptor
+ * @return      LV_RESULT_OK
+ */
+lv_result_t lv_argb8888_blend_normal_to_rgb565_riscv(lv_draw_sw_blend_image_dsc_t * dsc);
+
+/**
+ * Blend an ARGB8888 image into an RGB565 area with `dsc->opa`.
+ * @param dsc   the image descriptor
+ * @return      LV_RESULT_OK
+ */
+lv_result_t lv_argb8888_blend_normal_to_rgb565_with_opa_riscv(lv_draw_sw_blend_image_dsc_t * dsc);
+
+/**
+ * Blend an ARGB8888 image into an RGB565 area through `dsc->mask_buf`.
+ * @param dsc   the image descriptor
+ * @return      LV_RESULT_OK
+ */
+lv_result_t lv_argb8888_blend_normal_to_rgb565_with_mask_riscv(lv_draw_sw_blend_image_dsc_t * dsc);
+
+#endif /* defined(__riscv) && __riscv_xlen == 32 */
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_BLEND_RISCV_H*/
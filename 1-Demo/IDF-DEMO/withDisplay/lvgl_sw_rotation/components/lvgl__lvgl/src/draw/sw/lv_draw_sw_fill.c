@@ -32,6 +32,10 @@
 /**********************
  *  STATIC PROTOTYPES
  **********************/
+#if LV_DRAW_SW_COMPLEX
+static void fill_with_corner_tile(lv_draw_unit_t * draw_unit, lv_draw_sw_blend_dsc_t * blend_dsc,
+                                  const lv_area_t * coords, int32_t radius, lv_opa_t opa, const lv_opa_t * tile);
+#endif
 
 /**********************
  *  STATIC VARIABLES
@@ -81,6 +85,16 @@ void lv_draw_sw_fill(lv_draw_unit_t * draw_unit, lv_draw_fill_dsc_t * dsc, const
     int32_t short_side = LV_MIN(coords_bg_w, coords_bg_h);
     int32_t rout = LV_MIN(dsc->radius, short_side >> 1);
 
+    /*Plain color: only the corners need a mask, blend them with the cached corner tile*/
+    if(grad_dir == LV_GRAD_DIR_NONE && rout > 0) {
+        lv_draw_sw_mask_corner_tile_t * tile = lv_draw_sw_mask_corner_tile_acquire(rout);
+        if(tile) {
+            fill_with_corner_tile(draw_unit, &blend_dsc, &bg_coords, rout, opa, tile->opa);
+            lv_draw_sw_mask_corner_tile_release(tile);
+            return;
+        }
+    }
+
     /*Add a radius mask if there is a radius*/
     int32_t clipped_w = lv_area_get_width(&clipped_coords);
     lv_opa_t * mask_buf = NULL;
@@ -339,4 +353,77 @@ void lv_draw_sw_fill(lv_draw_unit_t * draw_unit, lv_draw_fill_dsc_t * dsc, const
 #endif
 }
 
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+#if LV_DRAW_SW_COMPLEX
+/**
+ * Fill a rounded rectangle of a plain color. The straight parts are blended without a mask,
+ * the corners with the quarters of `tile`, the same coverage the radius mask gives them.
+ */
+static void fill_with_corner_tile(lv_draw_unit_t * draw_unit, lv_draw_sw_blend_dsc_t * blend_dsc,
+                                  const lv_area_t * coords, int32_t radius, lv_opa_t opa, const lv_opa_t * tile)
+{
+    lv_area_t blend_area;
+    blend_dsc->blend_area = &blend_area;
+    blend_dsc->opa = opa;
+
+    /*The center, full width, and the straight parts of the top and bottom edges*/
+    blend_area.x1 = coords->x1;
+    blend_area.x2 = coords->x2;
+    blend_area.y1 = coords->y1 + radius;
+    blend_area.y2 = coords->y2 - radius;
+    lv_draw_sw_blend(draw_unit, blend_dsc);
+
+    blend_area.x1 = coords->x1 + radius;
+    blend_area.x2 = coords->x2 - radius;
+    blend_area.y1 = coords->y1;
+    blend_area.y2 = coords->y1 + radius - 1;
+    lv_draw_sw_blend(draw_unit, blend_dsc);
+
+    blend_area.y1 = coords->y2 - radius + 1;
+    blend_area.y2 = coords->y2;
+    lv_draw_sw_blend(draw_unit, blend_dsc);
+
+    /*Mix the opacity into the coverage the same way the radius mask does on a buffer set to `opa`*/
+    int32_t size = radius * 2;
+    lv_opa_t * mask_mixed = NULL;
+    if(opa < LV_OPA_MAX) {
+        mask_mixed = lv_malloc(size * size);
+        LV_ASSERT_MALLOC(mask_mixed);
+        if(mask_mixed == NULL) return;
+
+        int32_t i;
+        for(i = 0; i < size * size; i++) mask_mixed[i] = LV_UDIV255(tile[i] * opa);
+        tile = mask_mixed;
+    }
+
+    /*Align the tile with each corner of the rectangle and blend only that quarter of it*/
+    lv_area_t tile_area;
+    blend_dsc->opa = LV_OPA_COVER;
+    blend_dsc->mask_buf = tile;
+    blend_dsc->mask_area = &tile_area;
+    blend_dsc->mask_res = LV_DRAW_SW_MASK_RES_CHANGED;
+
+    uint32_t corner;
+    for(corner = 0; corner < 4; corner++) {
+        bool right = corner & 1;
+        bool bottom = corner & 2;
+        tile_area.x1 = right ? coords->x2 - size + 1 : coords->x1;
+        tile_area.y1 = bottom ? coords->y2 - size + 1 : coords->y1;
+        tile_area.x2 = tile_area.x1 + size - 1;
+        tile_area.y2 = tile_area.y1 + size - 1;
+
+        blend_area.x1 = right ? coords->x2 - radius + 1 : coords->x1;
+        blend_area.y1 = bottom ? coords->y2 - radius + 1 : coords->y1;
+        blend_area.x2 = blend_area.x1 + radius - 1;
+        blend_area.y2 = blend_area.y1 + radius - 1;
+        lv_draw_sw_blend(draw_unit, blend_dsc);
+    }
+
+    lv_free(mask_mixed);
+}
+#endif
+
 #endif /*LV_USE_DRAW_SW*/
@@ -25,6 +25,11 @@
 #define CIRCLE_CACHE_AGING(life, r)     life = LV_MIN(life + (r < 16 ? 1 : (r >> 4)), 1000)
 #define circle_cache_mutex              LV_GLOBAL_DEFAULT()->draw_info.circle_cache_mutex
 #define _circle_cache                   LV_GLOBAL_DEFAULT()->sw_circle_cache
+#define _corner_tile_cache              LV_GLOBAL_DEFAULT()->sw_corner_tile_cache
+#define _corner_tile_life               LV_GLOBAL_DEFAULT()->sw_corner_tile_life
+
+/*A tile is 4 * radius^2 bytes, larger radiuses are drawn line by line*/
+#define CORNER_TILE_RADIUS_MAX          64
 
 /**********************
  *      TYPEDEFS
@@ -85,6 +90,13 @@ void lv_draw_sw_mask_init(void)
 
 void lv_draw_sw_mask_deinit(void)
 {
+#if LV_DRAW_SW_CORNER_TILE_CACHE_SIZE > 0
+    uint32_t i;
+    for(i = 0; i < LV_DRAW_SW_CORNER_TILE_CACHE_SIZE; i++) {
+        lv_free(_corner_tile_cache[i].opa);
+        lv_memzero(&(_corner_tile_cache[i]), sizeof(_corner_tile_cache[i]));
+    }
+#endif
     lv_mutex_delete(&circle_cache_mutex);
 }
 
@@ -138,6 +150,89 @@ void lv_draw_sw_mask_cleanup(void)
     }
 }
 
+lv_draw_sw_mask_corner_tile_t * lv_draw_sw_mask_corner_tile_acquire(int32_t radius)
+{
+#if LV_DRAW_SW_CORNER_TILE_CACHE_SIZE > 0
+    if(radius <= 0 || radius > CORNER_TILE_RADIUS_MAX) return NULL;
+
+    lv_mutex_lock(&circle_cache_mutex);
+
+    uint32_t i;
+    lv_draw_sw_mask_corner_tile_t * entry = NULL;
+    for(i = 0; i < LV_DRAW_SW_CORNER_TILE_CACHE_SIZE; i++) {
+        if(_corner_tile_cache[i].radius == radius) {
+            entry = &(_corner_tile_cache[i]);
+            entry->used_cnt++;
+            entry->life = ++_corner_tile_life;
+            lv_mutex_unlock(&circle_cache_mutex);
+            return entry;
+        }
+    }
+
+    /*If not cached use the free entry used the longest time ago*/
+    for(i = 0; i < LV_DRAW_SW_CORNER_TILE_CACHE_SIZE; i++) {
+        if(_corner_tile_cache[i].used_cnt == 0) {
+            if(!entry || _corner_tile_cache[i].life < entry->life) entry = &(_corner_tile_cache[i]);
+        }
+    }
+
+    /*All tiles are drawn now, the caller falls back to the radius mask*/
+    if(!entry) {
+        lv_mutex_unlock(&circle_cache_mutex);
+        return NULL;
+    }
+
+    /*Take the entry out of the lookup while it's calculated, the radius mask below locks the mutex too*/
+    entry->used_cnt = 1;
+    entry->radius = 0;
+    lv_free(entry->opa);
+    entry->opa = NULL;
+    lv_mutex_unlock(&circle_cache_mutex);
+
+    /*Apply the radius mask on a rectangle of only the 4 corners.
+     *It gives the same coverage as on the corners of any larger rectangle*/
+    int32_t size = radius * 2;
+    lv_opa_t * opa = lv_malloc(size * size);
+    if(opa) {
+        lv_area_t rect = {0, 0, size - 1, size - 1};
+        lv_draw_sw_mask_radius_param_t param;
+        lv_draw_sw_mask_radius_init(&param, &rect, radius, false);
+
+        int32_t y;
+        for(y = 0; y < size; y++) {
+            lv_opa_t * line = &opa[y * size];
+            lv_memset(line, 0xff, size);
+            lv_draw_mask_radius(line, 0, y, size, &param);
+        }
+        lv_draw_sw_mask_free_param(&param);
+    }
+
+    lv_mutex_lock(&circle_cache_mutex);
+    if(opa) {
+        entry->opa = opa;
+        entry->radius = radius;
+        entry->life = ++_corner_tile_life;
+    }
+    else {
+        entry->used_cnt = 0;
+        entry = NULL;
+    }
+    lv_mutex_unlock(&circle_cache_mutex);
+
+    return entry;
+#else
+    LV_UNUSED(radius);
+    return NULL;
+#endif
+}
+
+void lv_draw_sw_mask_corner_tile_release(lv_draw_sw_mask_corner_tile_t * tile)
+{
+    lv_mutex_lock(&circle_cache_mutex);
+    tile->used_cnt--;
+    lv_mutex_unlock(&circle_cache_mutex);
+}
+
 void lv_draw_sw_mask_line_points_init(lv_draw_sw_mask_line_param_t * param, int32_t p1x, int32_t p1y,
                                       int32_t p2x,
                                       int32_t p2y, lv_draw_sw_mask_line_side_t side)
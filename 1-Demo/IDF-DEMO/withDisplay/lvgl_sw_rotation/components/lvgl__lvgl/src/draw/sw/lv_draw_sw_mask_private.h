@@ -36,6 +36,13 @@ typedef struct  {
     int32_t radius;             /**< The radius of the entry */
 } lv_draw_sw_mask_radius_circle_dsc_t;
 
+typedef struct  {
+    lv_opa_t * opa;             /**< Coverage of a (2 * radius) x (2 * radius) area, the 4 corners of the radius*/
+    uint32_t life;              /**< When the entry was used the last time */
+    uint32_t used_cnt;          /**< Like a semaphore to count the users of the tile */
+    int32_t radius;             /**< The radius of the entry */
+} lv_draw_sw_mask_corner_tile_t;
+
 struct lv_draw_sw_mask_common_dsc_t {
     lv_draw_sw_mask_xcb_t cb;
     lv_draw_sw_mask_type_t type;
@@ -134,6 +141,10 @@ struct lv_draw_sw_mask_map_param_t {
 
 typedef lv_draw_sw_mask_radius_circle_dsc_t lv_draw_sw_mask_radius_circle_dsc_arr_t[LV_DRAW_SW_CIRCLE_CACHE_SIZE];
 
+#if LV_DRAW_SW_CORNER_TILE_CACHE_SIZE > 0
+typedef lv_draw_sw_mask_corner_tile_t lv_draw_sw_mask_corner_tile_arr_t[LV_DRAW_SW_CORNER_TILE_CACHE_SIZE];
+#endif
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
@@ -144,6 +155,23 @@ typedef lv_draw_sw_mask_radius_circle_dsc_t lv_draw_sw_mask_radius_circle_dsc_ar
  */
 void lv_draw_sw_mask_cleanup(void);
 
+/**
+ * Get the cached coverage of the 4 anti-aliased corners of a radius, as kept by a
+ * not inverted radius mask. The tile is calculated if it's not cached yet.
+ * Row `y` column `x` of `opa` is the coverage of the pixel at (x, y) of a
+ * (2 * radius) x (2 * radius) rounded rectangle.
+ * @param radius        the radius
+ * @return              the tile or NULL if the radius can't be cached or all entries are in use.
+ *                      Release it with `lv_draw_sw_mask_corner_tile_release()`
+ */
+lv_draw_sw_mask_corner_tile_t * lv_draw_sw_mask_corner_tile_acquire(int32_t radius);
+
+/**
+ * Release a tile got from `lv_draw_sw_mask_corner_tile_acquire()`
+ * @param tile          the tile
+ */
+void lv_draw_sw_mask_corner_tile_release(lv_draw_sw_mask_corner_tile_t * tile);
+
 /**********************
  *      MACROS
  **********************/
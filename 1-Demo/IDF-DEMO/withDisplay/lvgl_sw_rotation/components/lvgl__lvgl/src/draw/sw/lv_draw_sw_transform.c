@@ -51,38 +51,49 @@ typedef struct {
 static void transform_point_upscaled(point_transform_dsc_t * t, int32_t xin, int32_t yin, int32_t * xout,
                                      int32_t * yout);
 
+/**
+ * Narrow a row to the columns whose sample can be in the image. The other columns are fully out
+ * of it, so they can be cleared at once instead of being checked one by one.
+ * @param ups       upscaled start coordinate of the row, in X or Y of the image
+ * @param step      step of the coordinate per column, upscaled by 256
+ * @param size      width or height of the image
+ * @param x_start   first column, narrowed in place
+ * @param x_end     column after the last, narrowed in place
+ */
+static void limit_row_to_image(int32_t ups, int32_t step, int32_t size, int32_t * x_start, int32_t * x_end);
+
 #if LV_DRAW_SW_SUPPORT_RGB888
 static void transform_rgb888(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                              int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                             int32_t x_end, uint8_t * dest_buf, bool aa, uint32_t px_size);
+                             int32_t x_start, int32_t x_end, uint8_t * dest_buf, bool aa, uint32_t px_size);
 #endif
 
 #if LV_DRAW_SW_SUPPORT_ARGB8888
 static void transform_argb8888(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                               int32_t x_end, uint8_t * dest_buf, bool aa);
+                               int32_t x_start, int32_t x_end, uint8_t * dest_buf, bool aa);
 #endif
 
 #if LV_DRAW_SW_SUPPORT_RGB565A8
 static void transform_rgb565a8(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                               int32_t x_end, uint16_t * cbuf, uint8_t * abuf, bool src_has_a8, bool aa);
+                               int32_t x_start, int32_t x_end, uint16_t * cbuf, uint8_t * abuf, bool src_has_a8, bool aa);
 #endif
 
 #if LV_DRAW_SW_SUPPORT_A8
 static void transform_a8(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                          int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                         int32_t x_end, uint8_t * abuf, bool aa);
+                         int32_t x_start, int32_t x_end, uint8_t * abuf, bool aa);
 #endif
 
 #if LV_DRAW_SW_SUPPORT_L8
 static void transform_l8_to_al88(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                  int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                                 int32_t x_end, uint8_t * abuf, bool aa);
+                                 int32_t x_start, int32_t x_end, uint8_t * abuf, bool aa);
 
 static void transform_l8_to_argb8888(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                      int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                                     int32_t x_end, uint8_t * abuf, bool aa);
+                                     int32_t x_start, int32_t x_end, uint8_t * abuf, bool aa);
 #endif
 
 /**********************
@@ -231,39 +242,55 @@ void lv_draw_sw_transform(lv_draw_unit_t * draw_unit, const lv_area_t * dest_are
             ys_ups = ys1_ups + 0x80;
         }
 
+        /*Clear the columns outside of the image, e.g. the corners of a rotated image, at once*/
+        int32_t x_start = 0;
+        int32_t x_end = dest_w;
+        limit_row_to_image(xs_ups, xs_step_256, src_w, &x_start, &x_end);
+        limit_row_to_image(ys_ups, ys_step_256, src_h, &x_start, &x_end);
+        if(x_end < x_start) x_end = x_start;
+        if(alpha_buf) {
+            lv_memzero(alpha_buf, x_start);
+            lv_memzero(alpha_buf + x_end, dest_w - x_end);
+        }
+        else {
+            int32_t px_size = dest_stride / dest_w;
+            lv_memzero(dest_buf, x_start * px_size);
+            lv_memzero((uint8_t *)dest_buf + x_end * px_size, (dest_w - x_end) * px_size);
+        }
+
         switch(src_cf) {
 #if LV_DRAW_SW_SUPPORT_XRGB8888
             case LV_COLOR_FORMAT_XRGB8888:
-                transform_rgb888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf, aa,
+                transform_rgb888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf, aa,
                                  4);
                 break;
 #endif
 #if LV_DRAW_SW_SUPPORT_RGB888
             case LV_COLOR_FORMAT_RGB888:
-                transform_rgb888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf, aa,
+                transform_rgb888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf, aa,
                                  3);
                 break;
 #endif
 #if LV_DRAW_SW_SUPPORT_A8
             case LV_COLOR_FORMAT_A8:
-                transform_a8(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf, aa);
+                transform_a8(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf, aa);
                 break;
 #endif
 #if LV_DRAW_SW_SUPPORT_ARGB8888
             case LV_COLOR_FORMAT_ARGB8888:
-                transform_argb8888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf,
+                transform_argb8888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf,
                                    aa);
                 break;
 #endif
 #if LV_DRAW_SW_SUPPORT_RGB565 && LV_DRAW_SW_SUPPORT_RGB565A8
             case LV_COLOR_FORMAT_RGB565:
-                transform_rgb565a8(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf,
+                transform_rgb565a8(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf,
                                    alpha_buf, false, aa);
                 break;
 #endif
 #if LV_DRAW_SW_SUPPORT_RGB565A8
             case LV_COLOR_FORMAT_RGB565A8:
-                transform_rgb565a8(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w,
+                transform_rgb565a8(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end,
                                    (uint16_t *)dest_buf,
                                    alpha_buf, true, aa);
                 break;
@@ -271,10 +298,10 @@ void lv_draw_sw_transform(lv_draw_unit_t * draw_unit, const lv_area_t * dest_are
 #if LV_DRAW_SW_SUPPORT_L8
             case LV_COLOR_FORMAT_L8:
                 if(draw_dsc->recolor_opa >= LV_OPA_MIN)
-                    transform_l8_to_argb8888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf,
+                    transform_l8_to_argb8888(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf,
                                              aa);
                 else
-                    transform_l8_to_al88(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, dest_w, dest_buf, aa);
+                    transform_l8_to_al88(src_buf, src_w, src_h, src_stride, xs_ups, ys_ups, xs_step_256, ys_step_256, x_start, x_end, dest_buf, aa);
                 break;
 #endif
             default:
@@ -294,14 +321,14 @@ void lv_draw_sw_transform(lv_draw_unit_t * draw_unit, const lv_area_t * dest_are
 
 static void transform_rgb888(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                              int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                             int32_t x_end, uint8_t * dest_buf, bool aa, uint32_t px_size)
+                             int32_t x_start, int32_t x_end, uint8_t * dest_buf, bool aa, uint32_t px_size)
 {
     int32_t xs_ups_start = xs_ups;
     int32_t ys_ups_start = ys_ups;
     lv_color32_t * dest_c32 = (lv_color32_t *) dest_buf;
 
     int32_t x;
-    for(x = 0; x < x_end; x++) {
+    for(x = x_start; x < x_end; x++) {
         xs_ups = xs_ups_start + ((xs_step * x) >> 8);
         ys_ups = ys_ups_start + ((ys_step * x) >> 8);
 
@@ -394,14 +421,14 @@ static void transform_rgb888(const uint8_t * src, int32_t src_w, int32_t src_h,
 
 static void transform_argb8888(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                               int32_t x_end, uint8_t * dest_buf, bool aa)
+                               int32_t x_start, int32_t x_end, uint8_t * dest_buf, bool aa)
 {
     int32_t xs_ups_start = xs_ups;
     int32_t ys_ups_start = ys_ups;
     lv_color32_t * dest_c32 = (lv_color32_t *) dest_buf;
 
     int32_t x;
-    for(x = 0; x < x_end; x++) {
+    for(x = x_start; x < x_end; x++) {
         xs_ups = xs_ups_start + ((xs_step * x) >> 8);
         ys_ups = ys_ups_start + ((ys_step * x) >> 8);
 
@@ -487,7 +514,7 @@ static void transform_argb8888(const uint8_t * src, int32_t src_w, int32_t src_h
 
 static void transform_rgb565a8(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                               int32_t x_end, uint16_t * cbuf, uint8_t * abuf, bool src_has_a8, bool aa)
+                               int32_t x_start, int32_t x_end, uint16_t * cbuf, uint8_t * abuf, bool src_has_a8, bool aa)
 {
     int32_t xs_ups_start = xs_ups;
     int32_t ys_ups_start = ys_ups;
@@ -498,7 +525,7 @@ static void transform_rgb565a8(const uint8_t * src, int32_t src_w, int32_t src_h
     int32_t alpha_stride = src_stride / 2; /*alpha map stride is always half of RGB map stride*/
 
     int32_t x;
-    for(x = 0; x < x_end; x++) {
+    for(x = x_start; x < x_end; x++) {
         xs_ups = xs_ups_start + ((xs_step * x) >> 8);
         ys_ups = ys_ups_start + ((ys_step * x) >> 8);
 
@@ -602,13 +629,13 @@ static void transform_rgb565a8(const uint8_t * src, int32_t src_w, int32_t src_h
 
 static void transform_a8(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                          int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                         int32_t x_end, uint8_t * abuf, bool aa)
+                         int32_t x_start, int32_t x_end, uint8_t * abuf, bool aa)
 {
     int32_t xs_ups_start = xs_ups;
     int32_t ys_ups_start = ys_ups;
 
     int32_t x;
-    for(x = 0; x < x_end; x++) {
+    for(x = x_start; x < x_end; x++) {
         xs_ups = xs_ups_start + ((xs_step * x) >> 8);
         ys_ups = ys_ups_start + ((ys_step * x) >> 8);
 
@@ -683,14 +710,14 @@ static void transform_a8(const uint8_t * src, int32_t src_w, int32_t src_h, int3
 /* L8 will be transformed into an AL88 buffer, because it will not be recolored */
 static void transform_l8_to_al88(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                  int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                                 int32_t x_end, uint8_t * dest_buf, bool aa)
+                                 int32_t x_start, int32_t x_end, uint8_t * dest_buf, bool aa)
 {
     int32_t xs_ups_start = xs_ups;
     int32_t ys_ups_start = ys_ups;
     lv_color16a_t * dest_al88 = (lv_color16a_t *)dest_buf;
 
     int32_t x;
-    for(x = 0; x < x_end; x++) {
+    for(x = x_start; x < x_end; x++) {
         xs_ups = xs_ups_start + ((xs_step * x) >> 8);
         ys_ups = ys_ups_start + ((ys_step * x) >> 8);
 
@@ -764,14 +791,14 @@ static void transform_l8_to_al88(const uint8_t * src, int32_t src_w, int32_t src
 /* L8 has to be transformed into an ARGB8888 buffer, because it will be recolored as well */
 static void transform_l8_to_argb8888(const uint8_t * src, int32_t src_w, int32_t src_h, int32_t src_stride,
                                      int32_t xs_ups, int32_t ys_ups, int32_t xs_step, int32_t ys_step,
-                                     int32_t x_end, uint8_t * dest_buf, bool aa)
+                                     int32_t x_start, int32_t x_end, uint8_t * dest_buf, bool aa)
 {
     int32_t xs_ups_start = xs_ups;
     int32_t ys_ups_start = ys_ups;
     lv_color32_t * dest_c32 = (lv_color32_t *)dest_buf;
 
     int32_t x;
-    for(x = 0; x < x_end; x++) {
+    for(x = x_start; x < x_end; x++) {
         xs_ups = xs_ups_start + ((xs_step * x) >> 8);
         ys_ups = ys_ups_start + ((ys_step * x) >> 8);
 
@@ -867,4 +894,31 @@ static void transform_point_upscaled(point_transform_dsc_t * t, int32_t xin, int
     }
 }
 
+static void limit_row_to_image(int32_t ups, int32_t step, int32_t size, int32_t * x_start, int32_t * x_end)
+{
+    /*Keep a pixel around the image, the edge columns are anti-aliased by the per pixel checks*/
+    int64_t lo = ((int64_t) -256 - ups) * 256;
+    int64_t hi = ((int64_t)(size + 1) * 256 - ups) * 256;
+
+    if(step == 0) {
+        if(lo > 0 || hi <= 0) *x_end = *x_start;
+        return;
+    }
+
+    /*The columns where `step * x` is in [lo, hi), with a margin for the rounding of the division*/
+    int64_t x1;
+    int64_t x2;
+    if(step > 0) {
+        x1 = lo / step - 2;
+        x2 = hi / step + 2;
+    }
+    else {
+        x1 = hi / step - 2;
+        x2 = lo / step + 2;
+    }
+
+    if(x1 > *x_start) *x_start = x1 > *x_end ? *x_end : (int32_t)x1;
+    if(x2 + 1 < *x_end) *x_end = x2 + 1 < *x_start ? *x_start : (int32_t)(x2 + 1);
+}
+
 #endif /*LV_USE_DRAW_SW*/
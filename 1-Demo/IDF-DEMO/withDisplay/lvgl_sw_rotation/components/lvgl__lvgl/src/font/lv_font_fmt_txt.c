@@ -14,6 +14,8 @@
 #include "../misc/lv_log.h"
 #include "../misc/lv_utils.h"
 #include "../stdlib/lv_mem.h"
+#include "../misc/cache/lv_cache.h"
+#include "../misc/cache/lv_cache_private.h"
 
 /*********************
  *      DEFINES
@@ -22,6 +24,12 @@
     #define font_rle LV_GLOBAL_DEFAULT()->font_fmt_rle
 #endif /*LV_USE_FONT_COMPRESSED*/
 
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+    #define glyph_cache LV_GLOBAL_DEFAULT()->font_fmt_txt_glyph_cache
+    #define font_draw_buf_handlers &(LV_GLOBAL_DEFAULT()->font_draw_buf_handlers)
+    #define GLYPH_CACHE_NAME "FONT_FMT_TXT_GLYPH"
+#endif
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -30,6 +38,16 @@ typedef struct {
     uint32_t gid_right;
 } kern_pair_ref_t;
 
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+typedef struct {
+    lv_cache_slot_size_t slot;  /*Must be the first, the size of the bitmap*/
+    const lv_font_fmt_txt_dsc_t * fdsc;
+    uint32_t gid;
+
+    lv_draw_buf_t * draw_buf;
+} glyph_cache_data_t;
+#endif
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
@@ -38,6 +56,13 @@ static int8_t get_kern_value(const lv_font_t * font, uint32_t gid_left, uint32_t
 static int unicode_list_compare(const void * ref, const void * element);
 static int kern_pair_8_compare(const void * ref, const void * element);
 static int kern_pair_16_compare(const void * ref, const void * element);
+static const void * get_bitmap(lv_font_glyph_dsc_t * g_dsc, lv_draw_buf_t * draw_buf);
+
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+    static bool glyph_cache_create_cb(glyph_cache_data_t * data, void * user_data);
+    static void glyph_cache_free_cb(glyph_cache_data_t * data, void * user_data);
+    static lv_cache_compare_res_t glyph_cache_compare_cb(const glyph_cache_data_t * lhs, const glyph_cache_data_t * rhs);
+#endif
 
 #if LV_USE_FONT_COMPRESSED
     static void decompress(const uint8_t * in, uint8_t * out, int32_t w, int32_t h, uint8_t bpp, bool prefilter);
@@ -76,6 +101,121 @@ static const uint8_t opa2_table[4] = {0, 85, 170, 255};
  **********************/
 
 const void * lv_font_get_bitmap_fmt_txt(lv_font_glyph_dsc_t * g_dsc, lv_draw_buf_t * draw_buf)
+{
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+    lv_font_fmt_txt_dsc_t * fdsc = (lv_font_fmt_txt_dsc_t *)g_dsc->resolved_font->dsc;
+    uint32_t gid = g_dsc->gid.index;
+    if(!gid) return NULL;
+
+    const lv_font_fmt_txt_glyph_dsc_t * gdsc = &fdsc->glyph_dsc[gid];
+    if(gdsc->box_w == 0 || gdsc->box_h == 0) return NULL;
+
+    glyph_cache_data_t search_key = {
+        .slot.size = lv_draw_buf_width_to_stride(gdsc->box_w, LV_COLOR_FORMAT_A8) * gdsc->box_h,
+        .fdsc = fdsc,
+        .gid = gid,
+    };
+
+    lv_cache_entry_t * entry = lv_cache_acquire_or_create(glyph_cache, &search_key, g_dsc);
+    if(entry != NULL) {
+        /*Released by `lv_font_glyph_release_draw_data()` after the glyph is drawn*/
+        g_dsc->entry = entry;
+        glyph_cache_data_t * data = lv_cache_entry_get_data(entry);
+        return data->draw_buf;
+    }
+
+    /*The bitmap is larger than the cache or it's disabled*/
+#endif
+
+    return get_bitmap(g_dsc, draw_buf);
+}
+
+bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out, uint32_t unicode_letter,
+                                   uint32_t unicode_letter_next)
+{
+    /*It fixes a strange compiler optimization issue: https://github.com/lvgl/lvgl/issues/4370*/
+    bool is_tab = unicode_letter == '\t';
+    if(is_tab) {
+        unicode_letter = ' ';
+    }
+    lv_font_fmt_txt_dsc_t * fdsc = (lv_font_fmt_txt_dsc_t *)font->dsc;
+    uint32_t gid = get_glyph_dsc_id(font, unicode_letter);
+    if(!gid) return false;
+
+    int8_t kvalue = 0;
+    if(fdsc->kern_dsc) {
+        uint32_t gid_next = get_glyph_dsc_id(font, unicode_letter_next);
+        if(gid_next) {
+            kvalue = get_kern_value(font, gid, gid_next);
+        }
+    }
+
+    /*Put together a glyph dsc*/
+    const lv_font_fmt_txt_glyph_dsc_t * gdsc = &fdsc->glyph_dsc[gid];
+
+    int32_t kv = ((int32_t)((int32_t)kvalue * fdsc->kern_scale) >> 4);
+
+    uint32_t adv_w = gdsc->adv_w;
+    if(is_tab) adv_w *= 2;
+
+    adv_w += kv;
+    adv_w  = (adv_w + (1 << 3)) >> 4;
+
+    dsc_out->adv_w = adv_w;
+    dsc_out->box_h = gdsc->box_h;
+    dsc_out->box_w = gdsc->box_w;
+    dsc_out->ofs_x = gdsc->ofs_x;
+    dsc_out->ofs_y = gdsc->ofs_y;
+    dsc_out->format = (uint8_t)fdsc->bpp;
+    dsc_out->is_placeholder = false;
+    dsc_out->gid.index = gid;
+    dsc_out->entry = NULL;
+
+    if(is_tab) dsc_out->box_w = dsc_out->box_w * 2;
+
+    return true;
+}
+
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+void lv_font_fmt_txt_glyph_cache_init(void)
+{
+    lv_cache_ops_t ops = {
+        .compare_cb = (lv_cache_compare_cb_t)glyph_cache_compare_cb,
+        .create_cb = (lv_cache_create_cb_t)glyph_cache_create_cb,
+        .free_cb = (lv_cache_free_cb_t)glyph_cache_free_cb,
+    };
+
+    glyph_cache = lv_cache_create(&lv_cache_class_lru_rb_size, sizeof(glyph_cache_data_t),
+                                  LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE, ops);
+    lv_cache_set_name(glyph_cache, GLYPH_CACHE_NAME);
+}
+
+void lv_font_fmt_txt_glyph_cache_deinit(void)
+{
+    lv_cache_destroy(glyph_cache, NULL);
+    glyph_cache = NULL;
+}
+
+void lv_font_fmt_txt_glyph_release(lv_font_glyph_dsc_t * g_dsc)
+{
+    if(g_dsc->entry == NULL) return;
+
+    lv_cache_release(glyph_cache, g_dsc->entry, NULL);
+    g_dsc->entry = NULL;
+}
+#endif
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Unpack or decompress the bitmap of a glyph to A8
+ * @param g_dsc     the glyph descriptor
+ * @param draw_buf  an A8 draw buffer of at least the size of the glyph
+ * @return          `draw_buf` or NULL if the glyph has no bitmap
+ */
+static const void * get_bitmap(lv_font_glyph_dsc_t * g_dsc, lv_draw_buf_t * draw_buf)
 {
     const lv_font_t * font = g_dsc->resolved_font;
     uint8_t * bitmap_out = draw_buf->data;
@@ -165,54 +305,42 @@ const void * lv_font_get_bitmap_fmt_txt(lv_font_glyph_dsc_t * g_dsc, lv_draw_buf
     return NULL;
 }
 
-bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out, uint32_t unicode_letter,
-                                   uint32_t unicode_letter_next)
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+static bool glyph_cache_create_cb(glyph_cache_data_t * data, void * user_data)
 {
-    /*It fixes a strange compiler optimization issue: https://github.com/lvgl/lvgl/issues/4370*/
-    bool is_tab = unicode_letter == '\t';
-    if(is_tab) {
-        unicode_letter = ' ';
-    }
-    lv_font_fmt_txt_dsc_t * fdsc = (lv_font_fmt_txt_dsc_t *)font->dsc;
-    uint32_t gid = get_glyph_dsc_id(font, unicode_letter);
-    if(!gid) return false;
-
-    int8_t kvalue = 0;
-    if(fdsc->kern_dsc) {
-        uint32_t gid_next = get_glyph_dsc_id(font, unicode_letter_next);
-        if(gid_next) {
-            kvalue = get_kern_value(font, gid, gid_next);
-        }
-    }
+    lv_font_glyph_dsc_t * g_dsc = user_data;
+    const lv_font_fmt_txt_glyph_dsc_t * gdsc = &data->fdsc->glyph_dsc[data->gid];
 
-    /*Put together a glyph dsc*/
-    const lv_font_fmt_txt_glyph_dsc_t * gdsc = &fdsc->glyph_dsc[gid];
+    data->draw_buf = lv_draw_buf_create_ex(font_draw_buf_handlers, gdsc->box_w, gdsc->box_h, LV_COLOR_FORMAT_A8,
+                                           LV_STRIDE_AUTO);
+    if(data->draw_buf == NULL) return false;
 
-    int32_t kv = ((int32_t)((int32_t)kvalue * fdsc->kern_scale) >> 4);
-
-    uint32_t adv_w = gdsc->adv_w;
-    if(is_tab) adv_w *= 2;
-
-    adv_w += kv;
-    adv_w  = (adv_w + (1 << 3)) >> 4;
-
-    dsc_out->adv_w = adv_w;
-    dsc_out->box_h = gdsc->box_h;
-    dsc_out->box_w = gdsc->box_w;
-    dsc_out->ofs_x = gdsc->ofs_x;
-    dsc_out->ofs_y = gdsc->ofs_y;
-    dsc_out->format = (uint8_t)fdsc->bpp;
-    dsc_out->is_placeholder = false;
-    dsc_out->gid.index = gid;
-
-    if(is_tab) dsc_out->box_w = dsc_out->box_w * 2;
+    if(get_bitmap(g_dsc, data->draw_buf) == NULL) {
+        lv_draw_buf_destroy(data->draw_buf);
+        data->draw_buf = NULL;
+        return false;
+    }
 
     return true;
 }
 
-/**********************
- *   STATIC FUNCTIONS
- **********************/
+static void glyph_cache_free_cb(glyph_cache_data_t * data, void * user_data)
+{
+    LV_UNUSED(user_data);
+    lv_draw_buf_destroy(data->draw_buf);
+}
+
+static lv_cache_compare_res_t glyph_cache_compare_cb(const glyph_cache_data_t * lhs, const glyph_cache_data_t * rhs)
+{
+    if(lhs->fdsc != rhs->fdsc) {
+        return lhs->fdsc > rhs->fdsc ? 1 : -1;
+    }
+    if(lhs->gid != rhs->gid) {
+        return lhs->gid > rhs->gid ? 1 : -1;
+    }
+    return 0;
+}
+#endif
 
 static uint32_t get_glyph_dsc_id(const lv_font_t * font, uint32_t letter)
 {
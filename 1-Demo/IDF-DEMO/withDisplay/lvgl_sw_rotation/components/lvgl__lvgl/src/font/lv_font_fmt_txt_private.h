@@ -45,6 +45,24 @@ typedef struct {
  * GLOBAL PROTOTYPES
  **********************/
 
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+/**
+ * Create the glyph cache of the built-in format fonts, called from `lv_init()`
+ */
+void lv_font_fmt_txt_glyph_cache_init(void);
+
+/**
+ * Delete the glyph cache and free the cached bitmaps, called from `lv_deinit()`
+ */
+void lv_font_fmt_txt_glyph_cache_deinit(void);
+
+/**
+ * Release the cache entry acquired by `lv_font_get_bitmap_fmt_txt()`
+ * @param g_dsc     the glyph descriptor the bitmap was got with
+ */
+void lv_font_fmt_txt_glyph_release(lv_font_glyph_dsc_t * g_dsc);
+#endif
+
 /**********************
  *      MACROS
  **********************/
@@ -27,6 +27,7 @@
 #define LV_DRAW_SW_ASM_NONE         0
 #define LV_DRAW_SW_ASM_NEON         1
 #define LV_DRAW_SW_ASM_HELIUM       2
+#define LV_DRAW_SW_ASM_RISCV        3
 #define LV_DRAW_SW_ASM_CUSTOM       255
 
 /* Handle special Kconfig options */
@@ -283,6 +284,16 @@
 	        #define LV_USE_FREERTOS_TASK_NOTIFY 1
 	    #endif
 	#endif
+	/*
+	 * Pin the threads created by LVGL to the cores in turn, starting from core 0 (ESP-IDF only).
+	 */
+	#ifndef LV_FREERTOS_PIN_THREADS
+	    #ifdef CONFIG_LV_FREERTOS_PIN_THREADS
+	        #define LV_FREERTOS_PIN_THREADS CONFIG_LV_FREERTOS_PIN_THREADS
+	    #else
+	        #define LV_FREERTOS_PIN_THREADS 0
+	    #endif
+	#endif
 #endif
 
 /*========================
@@ -538,6 +549,18 @@
                 #define LV_DRAW_SW_CIRCLE_CACHE_SIZE 4
             #endif
         #endif
+
+        /* Set number of maximally cached corner tiles.
+        * The AA coverage of the 4 corners of a radius is saved for plain rounded rectangles
+        * 4 * radius^2 bytes are used per tile, up to radius 64 (the most often used radiuses are saved)
+        * 0: to disable caching */
+        #ifndef LV_DRAW_SW_CORNER_TILE_CACHE_SIZE
+            #ifdef CONFIG_LV_DRAW_SW_CORNER_TILE_CACHE_SIZE
+                #define LV_DRAW_SW_CORNER_TILE_CACHE_SIZE CONFIG_LV_DRAW_SW_CORNER_TILE_CACHE_SIZE
+            #else
+                #define LV_DRAW_SW_CORNER_TILE_CACHE_SIZE 0
+            #endif
+        #endif
     #endif
 
     #ifndef LV_USE_DRAW_SW_ASM
@@ -684,6 +707,26 @@
     #endif
 #endif
 
+/* Use Espressif's PPA on ESP32-P4 for fills, blends and image blits. */
+#ifndef LV_USE_PPA
+    #ifdef CONFIG_LV_USE_PPA
+        #define LV_USE_PPA CONFIG_LV_USE_PPA
+    #else
+        #define LV_USE_PPA 0
+    #endif
+#endif
+
+#if LV_USE_PPA
+    /* Smaller areas (in pixels) are drawn by SW, the PPA setup costs more than it saves there. */
+    #ifndef LV_PPA_MIN_AREA
+        #ifdef CONFIG_LV_PPA_MIN_AREA
+            #define LV_PPA_MIN_AREA CONFIG_LV_PPA_MIN_AREA
+        #else
+            #define LV_PPA_MIN_AREA 4096
+        #endif
+    #endif
+#endif
+
 /* Use Renesas Dave2D on RA  platforms. */
 #ifndef LV_USE_DRAW_DAVE2D
     #ifdef CONFIG_LV_USE_DRAW_DAVE2D
@@ -1636,6 +1679,16 @@
     #endif
 #endif
 
+/*Size of the cache, in bytes, that keeps the unpacked A8 glyph bitmaps of the built-in format fonts.
+ *0: to disable caching*/
+#ifndef LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE
+    #ifdef CONFIG_LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE
+        #define LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE CONFIG_LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE
+    #else
+        #define LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE 0
+    #endif
+#endif
+
 /*Enable drawing placeholders when glyph dsc is not found*/
 #ifndef LV_USE_FONT_PLACEHOLDER
     #ifdef LV_KCONFIG_PRESENT
@@ -38,6 +38,7 @@
 #include "widgets/span/lv_span.h"
 #include "themes/simple/lv_theme_simple.h"
 #include "misc/lv_fs.h"
+#include "font/lv_font_fmt_txt_private.h"
 #include "osal/lv_os_private.h"
 
 #if LV_USE_DRAW_VGLITE
@@ -48,6 +49,9 @@
         #include "draw/nxp/pxp/lv_draw_pxp.h"
     #endif
 #endif
+#if LV_USE_PPA
+    #include "draw/espressif/ppa/lv_draw_ppa.h"
+#endif
 #if LV_USE_DRAW_DAVE2D
     #include "draw/renesas/dave2d/lv_draw_dave2d.h"
 #endif
@@ -206,6 +210,10 @@ void lv_init(void)
 #endif
 #endif
 
+#if LV_USE_PPA
+    lv_draw_ppa_init();
+#endif
+
 #if LV_USE_DRAW_DAVE2D
     lv_draw_dave2d_init();
 #endif
@@ -230,6 +238,10 @@ void lv_init(void)
     lv_image_decoder_init(LV_CACHE_DEF_SIZE, LV_IMAGE_HEADER_CACHE_DEF_CNT);
     lv_bin_decoder_init();  /*LVGL built-in binary image decoder*/
 
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+    lv_font_fmt_txt_glyph_cache_init();
+#endif
+
 #if LV_USE_DRAW_VG_LITE
     lv_draw_vg_lite_init();
 #endif
@@ -385,6 +397,10 @@ void lv_deinit(void)
 
     lv_image_decoder_deinit();
 
+#if LV_FONT_FMT_TXT_GLYPH_CACHE_SIZE > 0
+    lv_font_fmt_txt_glyph_cache_deinit();
+#endif
+
     lv_refr_deinit();
 
     lv_obj_style_deinit();
@@ -395,6 +411,10 @@ void lv_deinit(void)
 #endif
 #endif
 
+#if LV_USE_PPA
+    lv_draw_ppa_deinit();
+#endif
+
 #if LV_USE_DRAW_VGLITE
     lv_draw_vglite_deinit();
 #endif
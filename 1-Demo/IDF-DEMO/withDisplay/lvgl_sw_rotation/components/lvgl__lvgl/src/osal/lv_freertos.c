@@ -92,6 +92,20 @@ lv_result_t lv_thread_init(lv_thread_t * pxThread, lv_thread_prio_t xSchedPriori
     pxThread->pTaskArg = xAttr;
     pxThread->pvStartRoutine = pvStartRoutine;
 
+#if (ESP_PLATFORM) && LV_FREERTOS_PIN_THREADS && !CONFIG_FREERTOS_UNICORE
+    /* Threads are created by lv_init() on one task, the next core needs no lock */
+    static BaseType_t xNextCore = 0;
+
+    BaseType_t xTaskCreateStatus = xTaskCreatePinnedToCore(
+                                       prvRunThread,
+                                       pcTASK_NAME,
+                                       (configSTACK_DEPTH_TYPE)(usStackSize / sizeof(StackType_t)),
+                                       (void *)pxThread,
+                                       tskIDLE_PRIORITY + xSchedPriority,
+                                       &pxThread->xTaskHandle,
+                                       xNextCore);
+    xNextCore = (xNextCore + 1) % portNUM_PROCESSORS;
+#else
     BaseType_t xTaskCreateStatus = xTaskCreate(
                                        prvRunThread,
                                        pcTASK_NAME,
@@ -99,6 +113,7 @@ lv_result_t lv_thread_init(lv_thread_t * pxThread, lv_thread_prio_t xSchedPriori
                                        (void *)pxThread,
                                        tskIDLE_PRIORITY + xSchedPriority,
                                        &pxThread->xTaskHandle);
+#endif
 
     /* Ensure that the FreeRTOS task was successfully created. */
     if(xTaskCreateStatus != pdPASS) {
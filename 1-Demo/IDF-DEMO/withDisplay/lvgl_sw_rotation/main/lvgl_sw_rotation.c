@@ -18,6 +18,11 @@
 #include "lvgl_port_v9.h"
 #include "lv_demos.h"
 #include "driver/ppa.h"
+#if CONFIG_EXAMPLE_CAMERA_PREVIEW
+#include "esp_video_init.h"
+#include "esp_video_device.h"
+#include "camera_preview.h"
+#endif
 
 #define TAG                                 "main"
 
@@ -44,9 +49,121 @@ i2c_master_bus_handle_t i2c_handle = NULL;
 
 IRAM_ATTR static bool mipi_dsi_lcd_on_vsync_event(esp_lcd_panel_handle_t panel, esp_lcd_dpi_panel_event_data_t *edata, void *user_ctx)
 {
-    return lvgl_port_notify_lcd_vsync();
+#if CONFIG_EXAMPLE_CAMERA_PREVIEW
+    // LVGL renders into its overlay, the panel only shows camera frames
+    return camera_preview_notify_lcd_vsync();
+#else
+    return lvgl_v9_port_notify_lcd_vsync();
+#endif
+}
+
+#if CONFIG_EXAMPLE_CAMERA_PREVIEW
+static bool camera_preview_overlay_lock(camera_preview_overlay_t *overlay, void *user_ctx)
+{
+    lvgl_v9_port_overlay_t lvgl_overlay;
+
+    if (!lvgl_v9_port_lock(-1)) {
+        return false;
+    }
+    lvgl_v9_port_get_overlay(&lvgl_overlay);
+    overlay->buf = lvgl_overlay.buf;
+    overlay->x = lvgl_overlay.area.x1;
+    overlay->y = lvgl_overlay.area.y1;
+    overlay->w = lv_area_get_width(&lvgl_overlay.area);
+    overlay->h = lv_area_get_height(&lvgl_overlay.area);
+
+    return true;
+}
+
+static void camera_preview_overlay_unlock(void *user_ctx)
+{
+    lvgl_v9_port_unlock();
 }
 
+static void camera_preview_fps_update(lv_timer_t *timer)
+{
+    static uint32_t last_frame_count = 0;
+    uint32_t frame_count = camera_preview_get_frame_count();
+
+    lv_label_set_text_fmt((lv_obj_t *)lv_timer_get_user_data(timer), "Camera %" PRIu32 " fps", frame_count - last_frame_count);
+    last_frame_count = frame_count;
+}
+
+static void camera_preview_ui_create(void)
+{
+    lv_obj_t *label = lv_label_create(lv_screen_active());
+    lv_obj_set_style_bg_color(label, lv_color_black(), 0);
+    lv_obj_set_style_bg_opa(label, LV_OPA_50, 0);
+    lv_obj_set_style_text_color(label, lv_color_white(), 0);
+    lv_obj_set_style_pad_all(label, 8, 0);
+    lv_obj_align(label, LV_ALIGN_TOP_RIGHT, -16, 16);
+    lv_label_set_text(label, "Camera");
+
+    lv_timer_create(camera_preview_fps_update, 1000, label);
+}
+
+static esp_err_t camera_preview_init(esp_lcd_panel_handle_t panel)
+{
+    // The camera's SCCB is on the I2C bus of the touch controller
+    static esp_video_init_csi_config_t csi_config = {
+        .sccb_config = {
+            .init_sccb = false,
+            .freq = CONFIG_EXAMPLE_CAMERA_PREVIEW_SCCB_I2C_FREQ,
+        },
+        .reset_pin = CONFIG_EXAMPLE_CAMERA_PREVIEW_SENSOR_RESET_PIN,
+        .pwdn_pin  = CONFIG_EXAMPLE_CAMERA_PREVIEW_SENSOR_PWDN_PIN,
+    };
+    csi_config.sccb_config.i2c_handle = i2c_handle;
+    const esp_video_init_config_t cam_config = {
+        .csi = &csi_config,
+    };
+    esp_err_t ret = esp_video_init(&cam_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Camera init failed with error 0x%x", ret);
+        return ret;
+    }
+
+    const camera_preview_config_t preview_config = {
+        .dev_name = ESP_VIDEO_MIPI_CSI_DEVICE_NAME,
+        .panel = panel,
+        .h_res = BSP_LCD_H_RES,
+        .v_res = BSP_LCD_V_RES,
+        .rotation = CONFIG_EXAMPLE_CAMERA_PREVIEW_ROTATION_DEGREE,
+        .overlay_lock = camera_preview_overlay_lock,
+        .overlay_unlock = camera_preview_overlay_unlock,
+        .task_priority = CONFIG_EXAMPLE_CAMERA_PREVIEW_TASK_PRIORITY,
+        .task_core = CONFIG_EXAMPLE_CAMERA_PREVIEW_TASK_CORE,
+    };
+    return camera_preview_start(&preview_config);
+}
+#endif
+
+#if CONFIG_EXAMPLE_LVGL_BENCHMARK
+/* Parsed by `tools/benchmark_sweep.py`, which tags every result row with it */
+static void benchmark_print_config(void)
+{
+#if LVGL_V9_PORT_AVOID_TEAR_ENABLE
+    const int rotation = EXAMPLE_LVGL_PORT_ROTATION_DEGREE;
+    const char *refresh = (LVGL_V9_PORT_AVOID_TEAR_MODE == 3) ? "direct" : "full";
+#else
+    const int rotation = 0;
+    const char *refresh = "partial";
+#endif
+#if CONFIG_EXAMPLE_LVGL_PORT_PPA_ROTATION_ENABLE
+    const char *rotate = "ppa";
+#else
+    const char *rotate = (rotation == 0) ? "none" : "sw";
+#endif
+#if CONFIG_EXAMPLE_LVGL_PORT_BUF_INTERNAL
+    const char *buffer = "internal";
+#else
+    const char *buffer = "psram";
+#endif
+
+    printf("BENCH_CONFIG rotation=%d refresh=%s lcd_buffers=%d rotate=%s buffer=%s\n", rotation, refresh,
+           LVGL_V9_PORT_LCD_BUFFER_NUMS, rotate, buffer);
+}
+#endif
 
 static esp_err_t bsp_display_brightness_set(int brightness_percent)
 {
@@ -120,7 +237,11 @@ void app_main(void)
     esp_lcd_panel_handle_t disp_panel = NULL;
     esp_lcd_dpi_panel_config_t dpi_config = JD9365_800_1280_PANEL_60HZ_DPI_CONFIG(LCD_COLOR_PIXEL_FORMAT_RGB565);
 
-     dpi_config.num_fbs = LVGL_PORT_LCD_BUFFER_NUMS;
+#if CONFIG_EXAMPLE_CAMERA_PREVIEW
+    dpi_config.num_fbs = CAMERA_PREVIEW_LCD_BUFFER_NUMS;
+#else
+     dpi_config.num_fbs = LVGL_V9_PORT_LCD_BUFFER_NUMS;
+#endif
 
     jd9365_vendor_config_t vendor_config = {
         .flags = {
@@ -143,7 +264,7 @@ void app_main(void)
     esp_lcd_panel_init(disp_panel);
 
     esp_lcd_dpi_panel_event_callbacks_t cbs = {
-#if LVGL_PORT_AVOID_TEAR_MODE
+#if LVGL_V9_PORT_AVOID_TEAR_MODE || CONFIG_EXAMPLE_CAMERA_PREVIEW
         .on_refresh_done = mipi_dsi_lcd_on_vsync_event,
 #else
         .on_color_trans_done = mipi_dsi_lcd_on_vsync_event,
@@ -173,18 +294,29 @@ void app_main(void)
     
     esp_lcd_touch_new_i2c_gt911(tp_io_handle, &tp_cfg, &tp_handle);
 
-    lvgl_port_interface_t interface = (dpi_config.flags.use_dma2d) ? LVGL_PORT_INTERFACE_MIPI_DSI_DMA : LVGL_PORT_INTERFACE_MIPI_DSI_NO_DMA;
+    lvgl_v9_port_interface_t interface = (dpi_config.flags.use_dma2d) ? LVGL_V9_PORT_INTERFACE_MIPI_DSI_DMA : LVGL_V9_PORT_INTERFACE_MIPI_DSI_NO_DMA;
     ESP_LOGI(TAG,"interface is %d",interface);
-    ESP_ERROR_CHECK(lvgl_port_init(disp_panel, tp_handle, interface));
+    ESP_ERROR_CHECK(lvgl_v9_port_init(disp_panel, tp_handle, interface));
 
      bsp_display_brightness_set(100);
 
-    if(lvgl_port_lock(-1))
+#if CONFIG_EXAMPLE_CAMERA_PREVIEW
+    ESP_ERROR_CHECK(camera_preview_init(disp_panel));
+#endif
+
+    if(lvgl_v9_port_lock(-1))
     {
+#if CONFIG_EXAMPLE_CAMERA_PREVIEW
+        camera_preview_ui_create();
+#elif CONFIG_EXAMPLE_LVGL_BENCHMARK
+        benchmark_print_config();
+        lv_demo_benchmark();
+#else
         // lv_demo_music();
         // lv_demo_benchmark();
         lv_demo_widgets();
+#endif
 
-        lvgl_port_unlock();
+        lvgl_v9_port_unlock();
     }
 }
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+Run the LVGL benchmark (CONFIG_EXAMPLE_LVGL_BENCHMARK) in every port mode and
+collect the results as CSV.
+
+Each port mode is built into its own build directory from sdkconfig.defaults,
+sdkconfig.ci.benchmark and a generated fragment, then flashed. The console is
+read until the benchmark summary ends. Every summary row is tagged with the
+BENCH_CONFIG line of the firmware, so rows from different modes can be
+compared directly. Needs ESP-IDF in the environment and pyserial.
+
+    benchmark_sweep.py --list
+    benchmark_sweep.py -p /dev/ttyUSB0 --out results.csv
+    benchmark_sweep.py -p /dev/ttyUSB0 --only mode3_ --out direct.csv
+    benchmark_sweep.py --file console.log --out results.csv
+"""
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+import time
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CONFIG_PREFIX = 'BENCH_CONFIG '
+SUMMARY = 'Benchmark Summary'
+SUMMARY_END = 'All scenes avg.'
+FIELDS = ['mode', 'rotation', 'refresh', 'lcd_buffers', 'rotate', 'buffer',
+          'scene', 'cpu_pct', 'fps', 'time_ms', 'render_ms', 'flush_ms']
+
+
+def port_modes():
+    """Yield (name, sdkconfig lines) for every port mode"""
+    # Without tear avoidance LVGL renders partially into one buffer, in PSRAM or internal RAM
+    yield 'partial_psram', ['CONFIG_EXAMPLE_LVGL_PORT_BUF_PSRAM=y']
+    yield 'partial_internal', ['CONFIG_EXAMPLE_LVGL_PORT_BUF_INTERNAL=y']
+
+    # Mode 1: 2 LCD buffers, full refresh. Mode 2: 3 LCD buffers, full refresh. Mode 3: direct mode.
+    for mode in (1, 2, 3):
+        for rotation in (0, 90, 180, 270):
+            for ppa in ((False, True) if rotation else (False,)):
+                name = 'mode%d_rot%d%s' % (mode, rotation, '_ppa' if ppa else ('_sw' if rotation else ''))
+                yield name, [
+                    'CONFIG_EXAMPLE_LVGL_PORT_AVOID_TEAR_ENABLE=y',
+                    'CONFIG_EXAMPLE_LVGL_PORT_AVOID_TEAR_MODE_%d=y' % mode,
+                    'CONFIG_EXAMPLE_LVGL_PORT_ROTATION_%d=y' % rotation,
+                    'CONFIG_EXAMPLE_LVGL_PORT_PPA_ROTATION_ENABLE=%s' % ('y' if ppa else 'n'),
+                ]
+
+
+def build_and_flash(name, lines, port):
+    build_dir = os.path.join(PROJECT_DIR, 'build_bench', name)
+    os.makedirs(build_dir, exist_ok=True)
+    fragment = os.path.join(build_dir, 'sdkconfig.bench')
+    with open(fragment, 'w') as out:
+        out.write('\n'.join(lines) + '\n')
+
+    # A fresh sdkconfig per mode, so a fragment never inherits the choices of the previous one
+    sdkconfig = os.path.join(build_dir, 'sdkconfig')
+    if os.path.exists(sdkconfig):
+        os.remove(sdkconfig)
+
+    cmd = ['idf.py', '-C', PROJECT_DIR, '-B', build_dir,
+           '-D', 'SDKCONFIG=%s' % sdkconfig,
+           '-D', 'SDKCONFIG_DEFAULTS=sdkconfig.defaults;sdkconfig.ci.benchmark;%s' % fragment,
+           'build']
+    if port:
+        cmd += ['-p', port, 'flash']
+    print('>>> %s' % ' '.join(cmd), file=sys.stderr)
+    return subprocess.call(cmd) == 0
+
+
+def serial_lines(port, timeout):
+    import serial
+    with serial.Serial(port, 115200, timeout=1) as link:
+        # Reset the chip through RTS, as esptool does, so the BENCH_CONFIG line of the boot isn't missed
+        link.dtr = False
+        link.rts = True
+        time.sleep(0.1)
+        link.rts = False
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            line = link.readline()
+            if line:
+                yield line.decode('utf-8', 'replace')
+    print('timed out waiting for the benchmark summary', file=sys.stderr)
+
+
+def parse_config(line):
+    start = line.find(CONFIG_PREFIX)
+    fields = line[start + len(CONFIG_PREFIX):].split()
+    return dict(field.split('=', 1) for field in fields if '=' in field)
+
+
+def results(lines, mode):
+    """Yield a CSV row per summary line, until the summary ends"""
+    config = {}
+    in_summary = False
+    for line in lines:
+        line = line.strip()
+        if CONFIG_PREFIX in line:
+            config = parse_config(line)
+            continue
+        if SUMMARY in line:
+            in_summary = True
+            continue
+        if not in_summary or line.startswith('Name,'):
+            continue
+
+        # "<scene>, <cpu>%, <fps>, <time>, <render>, <flush>", scene names have no commas
+        values = [value.strip() for value in line.rsplit(',', 5)]
+        if len(values) != 6:
+            print('skipping garbled line: %s' % line, file=sys.stderr)
+            continue
+        row = dict(config, mode=mode, scene=values[0], cpu_pct=values[1].rstrip('%'), fps=values[2],
+                   time_ms=values[3], render_ms=values[4], flush_ms=values[5])
+        yield row
+        if values[0] == SUMMARY_END:
+            return
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-p', '--port', help='serial port of the board')
+    parser.add_argument('--out', help='CSV file to write, stdout by default')
+    parser.add_argument('--only', action='append', default=[],
+                        help='run only the modes whose name contains this, can be repeated')
+    parser.add_argument('--list', action='store_true', help='list the port modes and exit')
+    parser.add_argument('--build-only', action='store_true', help='only build every mode, e.g. in CI')
+    parser.add_argument('--file', help='parse a captured console log of one run instead')
+    parser.add_argument('--timeout', type=float, default=240, help='seconds to wait for a summary (default 240)')
+    args = parser.parse_args()
+
+    modes = [(name, lines) for name, lines in port_modes()
+             if not args.only or any(only in name for only in args.only)]
+    if args.list:
+        for name, lines in modes:
+            print('%-20s %s' % (name, ' '.join(lines)))
+        return 0
+
+    rows = []
+    failed = []
+    if args.file:
+        with open(args.file, errors='replace') as log:
+            rows = list(results(log, os.path.basename(args.file)))
+    elif args.build_only:
+        failed = [name for name, lines in modes if not build_and_flash(name, lines, None)]
+    elif args.port:
+        for name, lines in modes:
+            if not build_and_flash(name, lines, args.port):
+                failed.append(name)
+                continue
+            mode_rows = list(results(serial_lines(args.port, args.timeout), name))
+            if not mode_rows:
+                failed.append(name)
+            rows += mode_rows
+    else:
+        parser.error('a port, --build-only or --file is required')
+
+    if rows:
+        out = open(args.out, 'w', newline='') if args.out else sys.stdout
+        writer = csv.DictWriter(out, fieldnames=FIELDS, extrasaction='ignore')
+        writer.writeheader()
+        writer.writerows(rows)
+        if args.out:
+            out.close()
+
+    if failed:
+        print('failed: %s' % ' '.join(failed), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Pack UI assets into an asset partition image for lvgl_v9_port_assets_mount()
+(CONFIG_EXAMPLE_LVGL_PORT_ASSETS).
+
+Images are converted to the LVGL RGB565 layout the display draws natively,
+or to RGB565A8 when they have transparent pixels, so LVGL draws them straight
+from the mapped flash. Other files, e.g. fonts from `lv_font_conv --format
+bin`, are stored as they are and found with lvgl_v9_port_assets_get_blob().
+Names default to the file name without extension, `name=path` sets one.
+Needs Pillow for the images.
+
+    pack_assets.py -o assets.bin img/background.png img/icon_*.png --blob fonts/roboto_28.bin
+    pack_assets.py -o assets.bin bg=img/background_800x1280.jpg --partition-size 0x200000
+    parttool.py write_partition --partition-name assets --input assets.bin
+
+The image starts with a 16 byte header (magic "LVA1", version, entry count,
+bytes used), then one 48 byte entry per asset (name, offset, size, type,
+color format, width, height, stride), all little endian. Asset data starts
+at multiples of 64 bytes.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = 0x3141564C
+VERSION = 1
+ALIGN = 64
+NAME_LEN = 32
+HEADER = struct.Struct('<IHHII')
+ENTRY = struct.Struct('<%dsIIBBHHH' % NAME_LEN)
+TYPE_IMAGE = 0
+TYPE_BLOB = 1
+
+# lv_color_format_t
+LV_COLOR_FORMAT_RGB565 = 0x12
+LV_COLOR_FORMAT_RGB565A8 = 0x14
+
+
+def split_name(arg):
+    """Return (name, path) of a `name=path` or `path` argument"""
+    if '=' in arg:
+        name, path = arg.split('=', 1)
+    else:
+        path = arg
+        name = os.path.splitext(os.path.basename(path))[0]
+    if not name or len(name.encode()) >= NAME_LEN:
+        sys.exit('Asset name "%s" must have 1 to %d bytes' % (name, NAME_LEN - 1))
+    return name, path
+
+
+def round_up(value, align):
+    return (value + align - 1) // align * align
+
+
+def convert_image(path, stride_align, no_alpha):
+    """Return (color format, width, height, stride, data) of an image file"""
+    try:
+        from PIL import Image
+    except ImportError:
+        sys.exit('Converting images needs Pillow: pip install pillow')
+
+    img = Image.open(path)
+    img = img.convert('RGBA')
+    width, height = img.size
+    pixels = img.tobytes()
+    alpha = pixels[3::4]
+    has_alpha = not no_alpha and any(a != 0xFF for a in alpha)
+
+    rgb = bytearray()
+    for i in range(0, len(pixels), 4):
+        r, g, b = pixels[i], pixels[i + 1], pixels[i + 2]
+        rgb += struct.pack('<H', ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3))
+
+    if has_alpha:
+        # LVGL takes half the color stride as the alpha stride, so the rows are not padded
+        return LV_COLOR_FORMAT_RGB565A8, width, height, width * 2, bytes(rgb) + bytes(alpha)
+
+    stride = round_up(width * 2, stride_align)
+    if stride == width * 2:
+        return LV_COLOR_FORMAT_RGB565, width, height, stride, bytes(rgb)
+    data = bytearray()
+    for y in range(height):
+        row = rgb[y * width * 2:(y + 1) * width * 2]
+        data += row + bytes(stride - len(row))
+    return LV_COLOR_FORMAT_RGB565, width, height, stride, bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('images', nargs='*', help='Image files, `name=path` sets the asset name')
+    parser.add_argument('--blob', action='append', default=[], help='File stored as it is, `name=path` sets the name')
+    parser.add_argument('-o', '--out', required=True, help='Partition image to write')
+    parser.add_argument('--stride-align', type=int, default=1,
+                        help='CONFIG_LV_DRAW_BUF_STRIDE_ALIGN of the firmware (default 1)')
+    parser.add_argument('--no-alpha', action='store_true', help='Drop the alpha channel of every image')
+    parser.add_argument('--partition-size', type=lambda v: int(v, 0), help='Fail if the image is larger')
+    args = parser.parse_args()
+
+    assets = []
+    for arg in args.images:
+        name, path = split_name(arg)
+        cf, width, height, stride, data = convert_image(path, args.stride_align, args.no_alpha)
+        if width > 0xFFFF or height > 0xFFFF or stride > 0xFFFF:
+            sys.exit('%s is too large' % path)
+        assets.append((name, TYPE_IMAGE, cf, width, height, stride, data))
+        print('%-31s %4dx%-4d %s %7d bytes' % (name, width, height,
+                                               'RGB565A8' if cf == LV_COLOR_FORMAT_RGB565A8 else 'RGB565  ', len(data)))
+    for arg in args.blob:
+        name, path = split_name(arg)
+        with open(path, 'rb') as f:
+            data = f.read()
+        assets.append((name, TYPE_BLOB, 0, 0, 0, 0, data))
+        print('%-31s blob               %7d bytes' % (name, len(data)))
+
+    names = [a[0] for a in assets]
+    if len(set(names)) != len(names):
+        sys.exit('Asset names must be unique')
+    if len(assets) > 0xFFFF:
+        sys.exit('Too many assets')
+
+    offset = round_up(HEADER.size + ENTRY.size * len(assets), ALIGN)
+    table = b''
+    body = b''
+    for name, type_, cf, width, height, stride, data in assets:
+        table += ENTRY.pack(name.encode(), offset, len(data), type_, cf, width, height, stride)
+        padded = data + bytes(round_up(len(data), ALIGN) - len(data))
+        body += padded
+        offset += len(padded)
+
+    head = HEADER.pack(MAGIC, VERSION, len(assets), offset, 0) + table
+    image = head + bytes(round_up(len(head), ALIGN) - len(head)) + body
+    if args.partition_size is not None and len(image) > args.partition_size:
+        sys.exit('%d bytes of assets do not fit the %d byte partition' % (len(image), args.partition_size))
+
+    with open(args.out, 'wb') as f:
+        f.write(image)
+    print('%d assets, %d bytes written to %s' % (len(assets), len(image), args.out))
+
+
+if __name__ == '__main__':
+    main()
@@ -4,9 +4,19 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#define _GNU_SOURCE             // fopencookie()
+
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_codec_dev_defaults.h"
@@ -17,6 +27,12 @@
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
 
 #include "bsp/esp-bsp.h"
 #include "bsp_board_extra.h"
@@ -25,6 +41,9 @@ static const char *TAG = "bsp_extra_board";
 
 static esp_codec_dev_handle_t play_dev_handle;
 static esp_codec_dev_handle_t record_dev_handle;
+static i2s_chan_handle_t i2s_tx_chan = NULL;
+static i2s_chan_handle_t i2s_rx_chan = NULL;
+static esp_codec_dev_sample_info_t codec_fs = {0};  // Format the codec devices are open with
 
 static bool _is_audio_init = false;
 static bool _is_player_init = false;
@@ -34,6 +53,10 @@ static audio_player_cb_t audio_idle_callback = NULL;
 static void *audio_idle_cb_user_data = NULL;
 static char audio_file_path[128];
 
+static bsp_extra_duplex_config_t duplex_config;
+static TaskHandle_t duplex_task_handle = NULL;
+static volatile bool duplex_stop_request = false;
+
 /**************************************************************************************************
  *
  * Extra Board Function
@@ -65,17 +88,119 @@ static void audio_callback(audio_player_cb_ctx_t *ctx)
 
 esp_err_t bsp_extra_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read, uint32_t timeout_ms)
 {
-    esp_err_t ret = ESP_OK;
-    ret = esp_codec_dev_read(record_dev_handle, audio_buffer, len);
-    *bytes_read = len;
+    size_t bytes = 0;
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    // Straight from the I2S channel, which honours the timeout and counts a partial read
+    if (i2s_rx_chan) {
+        ret = i2s_channel_read(i2s_rx_chan, audio_buffer, len, &bytes, timeout_ms);
+    }
+    if (bytes_read) {
+        *bytes_read = bytes;
+    }
     return ret;
 }
 
 esp_err_t bsp_extra_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
 {
+    size_t bytes = 0;
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    if (i2s_tx_chan) {
+        ret = i2s_channel_write(i2s_tx_chan, audio_buffer, len, &bytes, timeout_ms);
+    }
+    if (bytes_written) {
+        *bytes_written = bytes;
+    }
+    return ret;
+}
+
+static void duplex_task(void *arg)
+{
+    const size_t frames = duplex_config.frames;
+    const size_t block_size = frames * CODEC_DEFAULT_CHANNEL * sizeof(int16_t);
+
+    // Both blocks stay allocated for the whole run, nothing is cleared per block
+    int16_t *in = heap_caps_malloc(block_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *out = heap_caps_calloc(1, block_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!in || !out) {
+        ESP_LOGE(TAG, "No memory for the duplex blocks");
+        goto exit;
+    }
+
+    ESP_LOGI(TAG, "Duplex start, %d frames per block", frames);
+
+    // One block of silence ahead of the first capture, so a late block doesn't underrun the TX ring
+    esp_codec_dev_write(play_dev_handle, out, block_size);
+
+    while (!duplex_stop_request) {
+        if (esp_codec_dev_read(record_dev_handle, in, block_size) != ESP_CODEC_DEV_OK) {
+            ESP_LOGW(TAG, "Duplex read failed");
+            continue;
+        }
+        duplex_config.process_cb(in, out, frames, duplex_config.user_ctx);
+        if (esp_codec_dev_write(play_dev_handle, out, block_size) != ESP_CODEC_DEV_OK) {
+            ESP_LOGW(TAG, "Duplex write failed");
+        }
+    }
+
+exit:
+    free(in);
+    free(out);
+    duplex_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t bsp_extra_duplex_start(const bsp_extra_duplex_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->process_cb, ESP_ERR_INVALID_ARG, TAG, "No process callback");
+    ESP_RETURN_ON_FALSE(_is_audio_init, ESP_ERR_INVALID_STATE, TAG, "Codec not initialized");
+    ESP_RETURN_ON_FALSE(duplex_task_handle == NULL, ESP_ERR_INVALID_STATE, TAG, "Duplex already started");
+
+    duplex_config = *config;
+    if (duplex_config.frames == 0) {
+        duplex_config.frames = CONFIG_BSP_I2S_DMA_FRAME_NUM;
+    }
+    duplex_stop_request = false;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(duplex_task, "duplex", duplex_config.task_stack, NULL,
+                                             duplex_config.task_priority, &duplex_task_handle, duplex_config.task_core);
+    ESP_RETURN_ON_FALSE(ret == pdPASS, ESP_ERR_NO_MEM, TAG, "Create duplex task failed");
+
+    return ESP_OK;
+}
+
+esp_err_t bsp_extra_duplex_stop(void)
+{
+    ESP_RETURN_ON_FALSE(duplex_task_handle, ESP_ERR_INVALID_STATE, TAG, "Duplex not started");
+
+    duplex_stop_request = true;
+    // The task only blocks in the codec read, which returns within one block
+    while (duplex_task_handle) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    return ESP_OK;
+}
+
+/*
+ * Change only the sample rate, on the I2S clock shared by both directions. The codec keeps running off
+ * MCLK = 256 * fs, so its dividers don't depend on the rate and the codec devices stay open.
+ */
+static esp_err_t codec_set_rate(uint32_t rate)
+{
+    const i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rate);
     esp_err_t ret = ESP_OK;
-    ret = esp_codec_dev_write(play_dev_handle, audio_buffer, len);
-    *bytes_written = len;
+
+    ESP_RETURN_ON_ERROR(i2s_channel_disable(i2s_tx_chan), TAG, "Disable I2S TX failed");
+    ESP_RETURN_ON_ERROR(i2s_channel_disable(i2s_rx_chan), TAG, "Disable I2S RX failed");
+    ret = i2s_channel_reconfig_std_clock(i2s_tx_chan, &clk_cfg);
+    if (ret == ESP_OK) {
+        ret = i2s_channel_reconfig_std_clock(i2s_rx_chan, &clk_cfg);
+    }
+    ESP_RETURN_ON_ERROR(i2s_channel_enable(i2s_tx_chan), TAG, "Enable I2S TX failed");
+    ESP_RETURN_ON_ERROR(i2s_channel_enable(i2s_rx_chan), TAG, "Enable I2S RX failed");
+
     return ret;
 }
 
@@ -89,10 +214,29 @@ esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode
         .bits_per_sample = bits_cfg,
     };
 
+    const bool same_bits = (fs.bits_per_sample == codec_fs.bits_per_sample);
+    const bool same_channel = (fs.channel == codec_fs.channel);
+    if (same_bits && same_channel && (fs.sample_rate == codec_fs.sample_rate)) {
+        return ESP_OK;
+    }
+    // 24 bit needs an MCLK multiple of 384, which changes the codec dividers
+    if (same_bits && same_channel && (bits_cfg != 24) && i2s_tx_chan && i2s_rx_chan) {
+        ret = codec_set_rate(rate);
+        if (ret == ESP_OK) {
+            codec_fs.sample_rate = rate;
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Fast sample rate change failed, reopen the codec");
+    }
+
+    // The record path shares the bit clock, it only has to follow a change of the rate or of the bit width
+    const bool reopen_record = !same_bits || (fs.sample_rate != codec_fs.sample_rate) || (ret != ESP_OK);
+    ret = ESP_OK;
+
     if (play_dev_handle) {
         ret = esp_codec_dev_close(play_dev_handle);
     }
-    if (record_dev_handle) {
+    if (record_dev_handle && reopen_record) {
         ret |= esp_codec_dev_close(record_dev_handle);
         ret |= esp_codec_dev_set_in_gain(record_dev_handle, CODEC_DEFAULT_ADC_VOLUME);
     }
@@ -100,9 +244,12 @@ esp_err_t bsp_extra_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode
     if (play_dev_handle) {
         ret |= esp_codec_dev_open(play_dev_handle, &fs);
     }
-    if (record_dev_handle) {
+    if (record_dev_handle && reopen_record) {
         ret |= esp_codec_dev_open(record_dev_handle, &fs);
     }
+
+    // A failed open is retried in full on the next call
+    codec_fs = (ret == ESP_OK) ? fs : (esp_codec_dev_sample_info_t) {0};
     return ret;
 }
 
@@ -139,6 +286,8 @@ esp_err_t bsp_extra_codec_dev_stop(void)
     if (record_dev_handle) {
         ret = esp_codec_dev_close(record_dev_handle);
     }
+    // Closed, the next format is applied in full
+    codec_fs = (esp_codec_dev_sample_info_t) {0};
     return ret;
 }
 
@@ -159,6 +308,8 @@ esp_err_t bsp_extra_codec_init()
     record_dev_handle = bsp_audio_codec_microphone_init();
     assert((record_dev_handle) && "record_dev_handle not initialized");
 
+    ESP_RETURN_ON_ERROR(bsp_audio_get_i2s_channels(&i2s_tx_chan, &i2s_rx_chan), TAG, "Get I2S channels failed");
+
     bsp_extra_codec_set_fs(CODEC_DEFAULT_SAMPLE_RATE, CODEC_DEFAULT_BIT_WIDTH, CODEC_DEFAULT_CHANNEL);
 
     _is_audio_init = true;
@@ -166,6 +317,366 @@ esp_err_t bsp_extra_codec_init()
     return ESP_OK;
 }
 
+/**************************************************************************************************
+ *
+ * Audio Mixer Function
+ *
+ **************************************************************************************************/
+
+#define MIXER_DMA_FRAME_NUM         (CONFIG_BSP_I2S_DMA_FRAME_NUM)
+#define MIXER_TAPS                  (16)        // Taps per phase of the resampling filter
+#define MIXER_PHASE_BITS            (6)
+#define MIXER_PHASES                (1 << MIXER_PHASE_BITS)
+#define MIXER_HISTORY               (MIXER_TAPS / 2 - 1)    // Input frames the filter needs before the output one
+#define MIXER_RATE_MIN              (8000)
+#define MIXER_RATE_MAX              (96000)
+
+struct bsp_extra_mixer_stream_s {
+    StreamBufferHandle_t buffer;    // Written by the source, read by the mixer task
+    uint32_t sample_rate;
+    uint8_t channels;
+    volatile int32_t gain;          // Q15
+    uint64_t step;                  // Input frames per output frame, Q32
+    uint64_t pos;                   // Position of the next output frame in `in`, Q32
+    int16_t *coeffs;                // MIXER_PHASES sets of MIXER_TAPS taps, Q15, NULL at the mixer rate
+    int16_t *in;                    // Input frames from MIXER_HISTORY frames before `pos` on
+    size_t in_cap;                  // Frames `in` holds, enough for one block
+    size_t in_bytes;                // Bytes received into `in`
+    struct bsp_extra_mixer_stream_s *next;
+};
+
+static bsp_extra_mixer_config_t mixer_config;
+static TaskHandle_t mixer_task_handle = NULL;
+static volatile bool mixer_stop_request = false;
+static SemaphoreHandle_t mixer_lock = NULL;         // Guards the stream list and the stream formats
+static bsp_extra_mixer_stream_handle_t mixer_streams = NULL;
+
+/*
+ * Windowed sinc low pass below the lower Nyquist rate of both sides, one set of taps per fractional position of the
+ * output frame between two input frames. Every set is normalized to unity gain at DC.
+ */
+static void mixer_gen_coeffs(int16_t *coeffs, uint32_t in_rate, uint32_t out_rate)
+{
+    const float fc = 0.45f * MIN(1.0f, (float)out_rate / in_rate);
+    float taps[MIXER_TAPS];
+
+    for (int p = 0; p < MIXER_PHASES; p++) {
+        const float frac = (float)p / MIXER_PHASES;
+        float sum = 0;
+        for (int k = 0; k < MIXER_TAPS; k++) {
+            const float t = k - MIXER_HISTORY - frac;
+            const float x = 2.0f * fc * t;
+            const float u = t / (MIXER_TAPS / 2);
+            const float sinc = (fabsf(x) < 1e-6f) ? 1.0f : sinf((float)M_PI * x) / ((float)M_PI * x);
+            taps[k] = sinc * (0.42f + 0.5f * cosf((float)M_PI * u) + 0.08f * cosf(2.0f * (float)M_PI * u));
+            sum += taps[k];
+        }
+        for (int k = 0; k < MIXER_TAPS; k++) {
+            coeffs[p * MIXER_TAPS + k] = (int16_t)MIN(lrintf(taps[k] / sum * 32768.0f), INT16_MAX);
+        }
+    }
+}
+
+/* One output sample of the channel `x` points at, `stride` samples between two frames */
+static inline int32_t mixer_fir(const int16_t *x, const int16_t *c, int stride)
+{
+    int32_t sum = 1 << 14;
+
+    for (int k = 0; k < MIXER_TAPS; k++) {
+        sum += x[k * stride] * c[k];
+    }
+    return sum >> 15;
+}
+
+/* Add one block of `stream`, resampled to the mixer rate and scaled by its gain, to `acc` */
+static void mixer_stream_render(bsp_extra_mixer_stream_handle_t stream, int32_t *acc, size_t frames)
+{
+    const int ch = stream->channels;
+    const size_t frame_size = ch * sizeof(int16_t);
+    const int32_t gain = stream->gain;
+
+    // Top up the input for this block without waiting, a source that falls behind leaves a gap
+    size_t need = (size_t)((stream->pos + (uint64_t)(frames - 1) * stream->step) >> 32) + MIXER_TAPS / 2 + 1;
+    need = MIN(need, stream->in_cap) * frame_size;
+    if (stream->in_bytes < need) {
+        stream->in_bytes += xStreamBufferReceive(stream->buffer, (uint8_t *)stream->in + stream->in_bytes,
+                                                 need - stream->in_bytes, 0);
+    }
+    const size_t avail = stream->in_bytes / frame_size;
+
+    for (size_t n = 0; n < frames; n++) {
+        const size_t i = stream->pos >> 32;
+        if (i + MIXER_TAPS / 2 >= avail) {
+            break;
+        }
+        int32_t l;
+        int32_t r;
+        if (stream->coeffs) {
+            const int16_t *c = stream->coeffs + ((uint32_t)stream->pos >> (32 - MIXER_PHASE_BITS)) * MIXER_TAPS;
+            const int16_t *x = stream->in + (i - MIXER_HISTORY) * ch;
+            l = mixer_fir(x, c, ch);
+            r = (ch == 2) ? mixer_fir(x + 1, c, ch) : l;
+        } else {
+            l = stream->in[i * ch];
+            r = stream->in[i * ch + ch - 1];
+        }
+        acc[2 * n] += (l * gain) >> 15;
+        acc[2 * n + 1] += (r * gain) >> 15;
+        stream->pos += stream->step;
+    }
+
+    // Drop the frames no later output reaches, the filter history stays
+    const size_t drop = MIN((size_t)(stream->pos >> 32) - MIXER_HISTORY, avail);
+    if (drop) {
+        stream->in_bytes -= drop * frame_size;
+        memmove(stream->in, (uint8_t *)stream->in + drop * frame_size, stream->in_bytes);
+        stream->pos -= (uint64_t)drop << 32;
+    }
+}
+
+static void mixer_task(void *arg)
+{
+    const size_t frames = mixer_config.frames;
+    const size_t samples = frames * CODEC_DEFAULT_CHANNEL;
+
+    // Sums of all streams, saturated to Q15 once per block
+    int32_t *acc = heap_caps_malloc(samples * sizeof(int32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *out = heap_caps_malloc(samples * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!acc || !out) {
+        ESP_LOGE(TAG, "No memory for the mixer blocks");
+        goto exit;
+    }
+
+    ESP_LOGI(TAG, "Mixer start, %d Hz, %d frames per block", (int)mixer_config.sample_rate, (int)frames);
+
+    while (!mixer_stop_request) {
+        memset(acc, 0, samples * sizeof(int32_t));
+        xSemaphoreTake(mixer_lock, portMAX_DELAY);
+        for (bsp_extra_mixer_stream_handle_t stream = mixer_streams; stream; stream = stream->next) {
+            mixer_stream_render(stream, acc, frames);
+        }
+        xSemaphoreGive(mixer_lock);
+
+        for (size_t i = 0; i < samples; i++) {
+            out[i] = (int16_t)MAX(MIN(acc[i], INT16_MAX), INT16_MIN);
+        }
+        // The full TX ring paces the loop, blocks of silence keep the latency constant while nothing plays
+        if (bsp_extra_i2s_write(out, samples * sizeof(int16_t), NULL, portMAX_DELAY) != ESP_OK) {
+            ESP_LOGW(TAG, "Mixer write failed");
+        }
+    }
+
+exit:
+    free(acc);
+    free(out);
+    mixer_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+/* Switch `stream` to a new input format, the input not mixed yet is dropped */
+static esp_err_t mixer_stream_setup(bsp_extra_mixer_stream_handle_t stream, uint32_t rate, uint8_t channels)
+{
+    ESP_RETURN_ON_FALSE((rate >= MIXER_RATE_MIN) && (rate <= MIXER_RATE_MAX) && (channels == 1 || channels == 2),
+                        ESP_ERR_INVALID_ARG, TAG, "Unsupported stream format");
+
+    const uint64_t step = ((uint64_t)rate << 32) / mixer_config.sample_rate;
+    const size_t in_cap = MIXER_TAPS + (size_t)(((uint64_t)mixer_config.frames * step) >> 32) + 2;
+    int16_t *in = heap_caps_malloc(in_cap * channels * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *coeffs = NULL;
+    if (rate != mixer_config.sample_rate) {
+        coeffs = heap_caps_malloc(MIXER_PHASES * MIXER_TAPS * sizeof(int16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!in || (!coeffs && rate != mixer_config.sample_rate)) {
+        free(in);
+        free(coeffs);
+        ESP_LOGE(TAG, "No memory for the stream format");
+        return ESP_ERR_NO_MEM;
+    }
+    if (coeffs) {
+        mixer_gen_coeffs(coeffs, rate, mixer_config.sample_rate);
+    }
+    memset(in, 0, MIXER_HISTORY * channels * sizeof(int16_t));
+
+    xSemaphoreTake(mixer_lock, portMAX_DELAY);
+    int16_t *old_in = stream->in;
+    int16_t *old_coeffs = stream->coeffs;
+    stream->sample_rate = rate;
+    stream->channels = channels;
+    stream->step = step;
+    stream->pos = (uint64_t)MIXER_HISTORY << 32;
+    stream->coeffs = coeffs;
+    stream->in = in;
+    stream->in_cap = in_cap;
+    stream->in_bytes = MIXER_HISTORY * channels * sizeof(int16_t);
+    xSemaphoreGive(mixer_lock);
+
+    free(old_in);
+    free(old_coeffs);
+    return ESP_OK;
+}
+
+esp_err_t bsp_extra_mixer_start(const bsp_extra_mixer_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->sample_rate >= MIXER_RATE_MIN && config->sample_rate <= MIXER_RATE_MAX,
+                        ESP_ERR_INVALID_ARG, TAG, "Invalid mixer configuration");
+    ESP_RETURN_ON_FALSE(_is_audio_init, ESP_ERR_INVALID_STATE, TAG, "Codec not initialized");
+    ESP_RETURN_ON_FALSE(mixer_task_handle == NULL, ESP_ERR_INVALID_STATE, TAG, "Mixer already started");
+
+    if (mixer_lock == NULL) {
+        mixer_lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(mixer_lock, ESP_ERR_NO_MEM, TAG, "No memory for the mixer lock");
+    }
+    mixer_config = *config;
+    if (mixer_config.frames == 0) {
+        mixer_config.frames = MIXER_DMA_FRAME_NUM;
+    }
+    ESP_RETURN_ON_ERROR(bsp_extra_codec_set_fs(mixer_config.sample_rate, CODEC_DEFAULT_BIT_WIDTH, CODEC_DEFAULT_CHANNEL),
+                        TAG, "Set the mixer format failed");
+    mixer_stop_request = false;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(mixer_task, "mixer", mixer_config.task_stack, NULL,
+                                             mixer_config.task_priority, &mixer_task_handle, mixer_config.task_core);
+    ESP_RETURN_ON_FALSE(ret == pdPASS, ESP_ERR_NO_MEM, TAG, "Create mixer task failed");
+
+    return ESP_OK;
+}
+
+esp_err_t bsp_extra_mixer_stop(void)
+{
+    ESP_RETURN_ON_FALSE(mixer_task_handle, ESP_ERR_INVALID_STATE, TAG, "Mixer not started");
+    ESP_RETURN_ON_FALSE(mixer_streams == NULL, ESP_ERR_INVALID_STATE, TAG, "Delete the mixer streams first");
+
+    mixer_stop_request = true;
+    // The task only blocks in the I2S write, which returns within one block
+    while (mixer_task_handle) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t bsp_extra_mixer_stream_new(const bsp_extra_mixer_stream_config_t *config,
+                                     bsp_extra_mixer_stream_handle_t *ret_stream)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(config && ret_stream && config->buffer_size, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    ESP_RETURN_ON_FALSE(mixer_task_handle, ESP_ERR_INVALID_STATE, TAG, "Mixer not started");
+
+    bsp_extra_mixer_stream_handle_t stream = calloc(1, sizeof(struct bsp_extra_mixer_stream_s));
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_NO_MEM, TAG, "No memory for the stream");
+    stream->buffer = xStreamBufferCreate(config->buffer_size, 1);
+    ESP_GOTO_ON_FALSE(stream->buffer, ESP_ERR_NO_MEM, err, TAG, "No memory for the stream buffer");
+    ESP_GOTO_ON_ERROR(mixer_stream_setup(stream, config->sample_rate, config->channels), err, TAG,
+                      "Set the stream format failed");
+    stream->gain = MIN(MAX(config->volume, 0), 100) * INT16_MAX / 100;
+
+    xSemaphoreTake(mixer_lock, portMAX_DELAY);
+    stream->next = mixer_streams;
+    mixer_streams = stream;
+    xSemaphoreGive(mixer_lock);
+
+    *ret_stream = stream;
+    return ESP_OK;
+
+err:
+    if (stream->buffer) {
+        vStreamBufferDelete(stream->buffer);
+    }
+    free(stream->in);
+    free(stream->coeffs);
+    free(stream);
+    return ret;
+}
+
+esp_err_t bsp_extra_mixer_stream_del(bsp_extra_mixer_stream_handle_t stream)
+{
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    xSemaphoreTake(mixer_lock, portMAX_DELAY);
+    for (bsp_extra_mixer_stream_handle_t *p = &mixer_streams; *p; p = &(*p)->next) {
+        if (*p == stream) {
+            *p = stream->next;
+            break;
+        }
+    }
+    xSemaphoreGive(mixer_lock);
+
+    vStreamBufferDelete(stream->buffer);
+    free(stream->in);
+    free(stream->coeffs);
+    free(stream);
+    return ESP_OK;
+}
+
+esp_err_t bsp_extra_mixer_stream_set_format(bsp_extra_mixer_stream_handle_t stream, uint32_t sample_rate,
+                                            uint8_t channels)
+{
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    if ((sample_rate == stream->sample_rate) && (channels == stream->channels)) {
+        return ESP_OK;
+    }
+    // What was written in the old format is mixed in it
+    while (!xStreamBufferIsEmpty(stream->buffer)) {
+        vTaskDelay(1);
+    }
+    return mixer_stream_setup(stream, sample_rate, channels);
+}
+
+esp_err_t bsp_extra_mixer_stream_set_volume(bsp_extra_mixer_stream_handle_t stream, int volume)
+{
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    stream->gain = MIN(MAX(volume, 0), 100) * INT16_MAX / 100;
+    return ESP_OK;
+}
+
+esp_err_t bsp_extra_mixer_stream_write(bsp_extra_mixer_stream_handle_t stream, const void *data, size_t len,
+                                       size_t *bytes_written, uint32_t timeout_ms)
+{
+    size_t done = 0;
+    TickType_t ticks = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    TimeOut_t timeout;
+
+    ESP_RETURN_ON_FALSE(stream && (data || !len), ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+
+    // A write larger than the buffer goes in as the mixer makes room
+    vTaskSetTimeOutState(&timeout);
+    while (done < len) {
+        done += xStreamBufferSend(stream->buffer, (const uint8_t *)data + done, len - done, ticks);
+        if ((done < len) && (xTaskCheckForTimeOut(&timeout, &ticks) == pdTRUE)) {
+            break;
+        }
+    }
+    if (bytes_written) {
+        *bytes_written = done;
+    }
+    return (done == len) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/*
+ * With the mixer running, the player is one of its streams. It keeps the codec format and mutes its own stream only,
+ * so the other streams go on while the player is paused.
+ */
+static bsp_extra_mixer_stream_handle_t player_stream = NULL;
+
+static esp_err_t player_mixer_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    return bsp_extra_mixer_stream_write(player_stream, audio_buffer, len, bytes_written, timeout_ms);
+}
+
+static esp_err_t player_mixer_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    ESP_RETURN_ON_FALSE(bits_cfg == 16, ESP_ERR_NOT_SUPPORTED, TAG, "The mixer takes 16 bit samples only");
+    return bsp_extra_mixer_stream_set_format(player_stream, rate, (ch == I2S_SLOT_MODE_MONO) ? 1 : 2);
+}
+
+static esp_err_t player_mixer_mute(AUDIO_PLAYER_MUTE_SETTING setting)
+{
+    return bsp_extra_mixer_stream_set_volume(player_stream, (setting == AUDIO_PLAYER_MUTE) ? 0 : 100);
+}
+
 esp_err_t bsp_extra_player_init(void)
 {
     if (_is_player_init) {
@@ -177,6 +688,14 @@ esp_err_t bsp_extra_player_init(void)
                                      .clk_set_fn = bsp_extra_codec_set_fs,
                                      .priority = 5
                                    };
+    if (mixer_task_handle) {
+        bsp_extra_mixer_stream_config_t stream_config = BSP_EXTRA_MIXER_STREAM_DEFAULT_CONFIG();
+        ESP_RETURN_ON_ERROR(bsp_extra_mixer_stream_new(&stream_config, &player_stream), TAG,
+                            "Create the player stream failed");
+        config.mute_fn = player_mixer_mute;
+        config.write_fn = player_mixer_write;
+        config.clk_set_fn = player_mixer_set_fs;
+    }
     ESP_RETURN_ON_ERROR(audio_player_new(config), TAG, "audio_player_init failed");
     audio_player_callback_register(audio_callback, NULL);
 
@@ -190,8 +709,277 @@ esp_err_t bsp_extra_player_del(void)
     _is_player_init = false;
 
     ESP_RETURN_ON_ERROR(audio_player_delete(), TAG, "audio_player_delete failed");
+    if (player_stream) {
+        bsp_extra_mixer_stream_del(player_stream);
+        player_stream = NULL;
+    }
+
+    return ESP_OK;
+}
+
+/**************************************************************************************************
+ *
+ * SD Card Stream Function
+ *
+ **************************************************************************************************/
+
+typedef struct {
+    int index;                      // Block buffer, -1 stops the reader task
+    off_t offset;                   // File offset of the block
+    ssize_t len;                    // Bytes read, negative on a read error
+} stream_block_t;
+
+typedef struct {
+    int fd;
+    off_t size;                     // File size, blocks are only requested below it
+    size_t block_size;
+    uint8_t *blocks[BSP_EXTRA_STREAM_BLOCK_NUM];
+    QueueHandle_t request_queue;    // Blocks for the reader task to fill
+    QueueHandle_t done_queue;       // Filled blocks, in request order
+    TaskHandle_t task;
+    int in_flight;                  // Blocks requested and not received yet
+    off_t next_offset;              // File offset of the next block to request
+    off_t pos;                      // Read position of the FILE
+    stream_block_t cur;             // Block being consumed, `cur.index` is -1 if none
+} stream_t;
+
+static void stream_task(void *arg)
+{
+    stream_t *stream = (stream_t *)arg;
+    stream_block_t block;
+
+    while (xQueueReceive(stream->request_queue, &block, portMAX_DELAY) == pdTRUE) {
+        if (block.index < 0) {
+            break;
+        }
+        // A whole block per read, FATFS reads the clusters in it with multi-block SDMMC transfers
+        if (lseek(stream->fd, block.offset, SEEK_SET) != block.offset) {
+            block.len = -1;
+        } else {
+            block.len = read(stream->fd, stream->blocks[block.index], stream->block_size);
+        }
+        xQueueSend(stream->done_queue, &block, portMAX_DELAY);
+    }
+
+    // Tell the closing task the reader is gone
+    xQueueSend(stream->done_queue, &block, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void stream_request(stream_t *stream, int index)
+{
+    if (stream->next_offset >= stream->size) {
+        return;
+    }
+    stream_block_t block = {
+        .index = index,
+        .offset = stream->next_offset,
+        .len = 0,
+    };
+    xQueueSend(stream->request_queue, &block, portMAX_DELAY);
+    stream->next_offset += stream->block_size;
+    stream->in_flight++;
+}
+
+static void stream_drain(stream_t *stream)
+{
+    stream_block_t block;
+
+    while (stream->in_flight > 0) {
+        xQueueReceive(stream->done_queue, &block, portMAX_DELAY);
+        stream->in_flight--;
+    }
+    stream->cur.index = -1;
+}
+
+static void stream_restart(stream_t *stream, off_t pos)
+{
+    stream_drain(stream);
+    stream->pos = pos;
+    stream->next_offset = pos - (pos % stream->block_size);
+    for (int i = 0; i < BSP_EXTRA_STREAM_BLOCK_NUM; i++) {
+        stream_request(stream, i);
+    }
+}
+
+static ssize_t stream_read(void *cookie, char *buf, size_t size)
+{
+    stream_t *stream = (stream_t *)cookie;
+    size_t done = 0;
+
+    while (done < size) {
+        if (stream->cur.index < 0) {
+            if (stream->in_flight == 0) {
+                break;                  // End of file
+            }
+            xQueueReceive(stream->done_queue, &stream->cur, portMAX_DELAY);
+            stream->in_flight--;
+            if (stream->cur.len < 0) {
+                ESP_LOGE(TAG, "Read at %ld failed", (long)stream->cur.offset);
+                stream->cur.index = -1;
+                stream_drain(stream);
+                stream->next_offset = stream->size;
+                errno = EIO;
+                return done ? done : -1;
+            }
+        }
+
+        const off_t end = stream->cur.offset + stream->cur.len;
+        if (stream->pos < end) {
+            const size_t len = MIN(size - done, (size_t)(end - stream->pos));
+            memcpy(buf + done, stream->blocks[stream->cur.index] + (stream->pos - stream->cur.offset), len);
+            done += len;
+            stream->pos += len;
+        }
+        if (stream->pos >= end) {
+            // Refill the consumed block with the one after the block still queued
+            const int index = stream->cur.index;
+            stream->cur.index = -1;
+            stream_request(stream, index);
+        }
+    }
+
+    return done;
+}
+
+static ssize_t stream_write(void *cookie, const char *buf, size_t size)
+{
+    errno = EBADF;
+    return -1;
+}
+
+static int stream_seek(void *cookie, off_t *offset, int whence)
+{
+    stream_t *stream = (stream_t *)cookie;
+    off_t pos;
+
+    switch (whence) {
+    case SEEK_SET:
+        pos = *offset;
+        break;
+    case SEEK_CUR:
+        pos = stream->pos + *offset;
+        break;
+    case SEEK_END:
+        pos = stream->size + *offset;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    if (pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pos == stream->pos) {
+        *offset = pos;          // ftell()
+        return 0;
+    }
+
+    // A seek inside the block being consumed keeps the read-ahead going
+    if ((stream->cur.index < 0) || (pos < stream->cur.offset) || (pos >= stream->cur.offset + stream->cur.len)) {
+        stream_restart(stream, pos);
+    } else {
+        stream->pos = pos;
+    }
+    *offset = pos;
+
+    return 0;
+}
+
+static void stream_free(stream_t *stream)
+{
+    for (int i = 0; i < BSP_EXTRA_STREAM_BLOCK_NUM; i++) {
+        heap_caps_free(stream->blocks[i]);
+    }
+    if (stream->request_queue) {
+        vQueueDelete(stream->request_queue);
+    }
+    if (stream->done_queue) {
+        vQueueDelete(stream->done_queue);
+    }
+    if (stream->fd >= 0) {
+        close(stream->fd);
+    }
+    free(stream);
+}
+
+static int stream_close(void *cookie)
+{
+    stream_t *stream = (stream_t *)cookie;
+    stream_block_t block = {
+        .index = -1,
+    };
+
+    stream_drain(stream);
+    xQueueSend(stream->request_queue, &block, portMAX_DELAY);
+    xQueueReceive(stream->done_queue, &block, portMAX_DELAY);
+    stream_free(stream);
+
+    return 0;
+}
+
+esp_err_t bsp_extra_stream_fopen(const char *path, const bsp_extra_stream_config_t *config, FILE **ret_fp)
+{
+    esp_err_t ret = ESP_OK;
+    const bsp_extra_stream_config_t default_config = BSP_EXTRA_STREAM_DEFAULT_CONFIG();
+    struct stat st;
+
+    ESP_RETURN_ON_FALSE(path && ret_fp, ESP_ERR_INVALID_ARG, TAG, "Invalid argument");
+    if (config == NULL) {
+        config = &default_config;
+    }
+    ESP_RETURN_ON_FALSE(config->block_size && (config->block_size % 512 == 0), ESP_ERR_INVALID_ARG, TAG,
+                        "Block size must be a multiple of the sector size");
+
+    stream_t *stream = calloc(1, sizeof(stream_t));
+    ESP_RETURN_ON_FALSE(stream, ESP_ERR_NO_MEM, TAG, "No memory for the stream");
+    stream->block_size = config->block_size;
+    stream->cur.index = -1;
+
+    stream->fd = open(path, O_RDONLY);
+    ESP_GOTO_ON_FALSE(stream->fd >= 0, ESP_ERR_NOT_FOUND, err, TAG, "Open %s failed", path);
+    ESP_GOTO_ON_FALSE(fstat(stream->fd, &st) == 0, ESP_FAIL, err, TAG, "Stat %s failed", path);
+    stream->size = st.st_size;
+
+    // The SDMMC host transfers straight into DMA capable, cache line aligned buffers, others go through a bounce
+    // buffer one sector at a time
+    for (int i = 0; i < BSP_EXTRA_STREAM_BLOCK_NUM; i++) {
+        stream->blocks[i] = heap_caps_aligned_alloc(128, config->block_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        ESP_GOTO_ON_FALSE(stream->blocks[i], ESP_ERR_NO_MEM, err, TAG, "No memory for the stream blocks");
+    }
+    stream->request_queue = xQueueCreate(BSP_EXTRA_STREAM_BLOCK_NUM + 1, sizeof(stream_block_t));
+    stream->done_queue = xQueueCreate(BSP_EXTRA_STREAM_BLOCK_NUM + 1, sizeof(stream_block_t));
+    ESP_GOTO_ON_FALSE(stream->request_queue && stream->done_queue, ESP_ERR_NO_MEM, err, TAG,
+                      "No memory for the stream queues");
+
+    BaseType_t res = xTaskCreatePinnedToCore(stream_task, "sd_stream", config->task_stack, stream,
+                                             config->task_priority, &stream->task, config->task_core);
+    ESP_GOTO_ON_FALSE(res == pdPASS, ESP_ERR_NO_MEM, err, TAG, "Create the stream task failed");
+
+    cookie_io_functions_t io = {
+        .read = stream_read,
+        .write = stream_write,
+        .seek = stream_seek,
+        .close = stream_close,
+    };
+    FILE *fp = fopencookie(stream, "rb", io);
+    if (fp == NULL) {
+        stream_close(stream);
+        ESP_LOGE(TAG, "No memory for the FILE");
+        return ESP_ERR_NO_MEM;
+    }
+    // The blocks already buffer the file, a stdio buffer would only add a copy
+    setvbuf(fp, NULL, _IONBF, 0);
+
+    stream_restart(stream, 0);
+    *ret_fp = fp;
 
     return ESP_OK;
+
+err:
+    stream_free(stream);
+    return ret;
 }
 
 esp_err_t bsp_extra_file_instance_init(const char *path, file_iterator_instance_t **ret_instance)
@@ -217,8 +1005,8 @@ esp_err_t bsp_extra_player_play_index(file_iterator_instance_t *instance, int in
     ESP_RETURN_ON_FALSE(retval != 0, ESP_FAIL, TAG, "file_iterator_get_full_path_from_index failed");
 
     ESP_LOGI(TAG, "opening file '%s'", filename);
-    FILE *fp = fopen(filename, "rb");
-    ESP_RETURN_ON_FALSE(fp, ESP_FAIL, TAG, "unable to open file");
+    FILE *fp = NULL;
+    ESP_RETURN_ON_ERROR(bsp_extra_stream_fopen(filename, NULL, &fp), TAG, "unable to open file");
 
     ESP_LOGI(TAG, "Playing '%s'", filename);
     ESP_RETURN_ON_ERROR(audio_player_play(fp), TAG, "audio_player_play failed");
@@ -231,8 +1019,8 @@ esp_err_t bsp_extra_player_play_index(file_iterator_instance_t *instance, int in
 esp_err_t bsp_extra_player_play_file(const char *file_path)
 {
     ESP_LOGI(TAG, "opening file '%s'", file_path);
-    FILE *fp = fopen(file_path, "rb");
-    ESP_RETURN_ON_FALSE(fp, ESP_FAIL, TAG, "unable to open file");
+    FILE *fp = NULL;
+    ESP_RETURN_ON_ERROR(bsp_extra_stream_fopen(file_path, NULL, &fp), TAG, "unable to open file");
 
     ESP_LOGI(TAG, "Playing '%s'", file_path);
     ESP_RETURN_ON_ERROR(audio_player_play(fp), TAG, "audio_player_play failed");
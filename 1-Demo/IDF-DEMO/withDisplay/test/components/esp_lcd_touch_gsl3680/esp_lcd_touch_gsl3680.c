@@ -2,6 +2,7 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_err.h"
 #include "esp_log.h"
@@ -21,6 +22,13 @@
 /* gsl3680 support key num */
 #define ESP_gsl3680_TOUCH_MAX_BUTTONS         (9)
 
+/* Point report: finger count, 3 reserved bytes, then 4 bytes per finger */
+#define ESP_LCD_TOUCH_GSL3680_REPORT_MAX_FINGERS  (10)
+#define ESP_LCD_TOUCH_GSL3680_REPORT_LEN          ((ESP_LCD_TOUCH_GSL3680_REPORT_MAX_FINGERS + 1) * 4)
+
+/* Samples read on the interrupt and not yet taken by esp_lcd_touch_read_data() */
+#define ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN     (4)
+
 
 
 unsigned int gsl_config_data_id[] =
@@ -134,6 +142,22 @@ static uint16_t x_new = 0;
 static uint16_t y_new = 0;
 static uint16_t x_start = 0 , y_start = 0;
 
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+typedef struct {
+    XY_DATA_T points[MAX_FINGER_NUM];
+    uint8_t num;
+} gsl3680_sample_t;
+
+static gsl3680_sample_t sample_ring[ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN];
+static uint32_t sample_head = 0;                // Samples written by the read task
+static uint32_t sample_tail = 0;                // Samples taken by esp_lcd_touch_read_data()
+static bool sample_pressed = false;             // The last sample taken had points
+static TaskHandle_t read_task_handle = NULL;
+static SemaphoreHandle_t read_task_done = NULL; // Given by the read task when it stops
+static volatile bool read_task_stop = false;
+static esp_lcd_touch_interrupt_callback_t user_interrupt_callback = NULL;
+#endif
+
 
 static esp_err_t esp_lcd_touch_gsl3680_read_data(esp_lcd_touch_handle_t tp);
 static bool esp_lcd_touch_gsl3680_get_xy(esp_lcd_touch_handle_t tp, uint16_t *x, uint16_t *y, uint16_t *strength, uint8_t *point_num, uint8_t max_point_num);
@@ -159,6 +183,12 @@ static esp_err_t esp_lcd_touch_gsl3680_read_ram_fw(esp_lcd_touch_handle_t tp);
 static esp_err_t esp_lcd_touch_gsl3680_load_fw(esp_lcd_touch_handle_t tp);
 static esp_err_t esp_lcd_touch_gsl3680_clear_reg(esp_lcd_touch_handle_t tp);
 static esp_err_t esp_lcd_touch_gsl3680_init(esp_lcd_touch_handle_t tp);
+static esp_err_t touch_gsl3680_read_points(esp_lcd_touch_handle_t tp, XY_DATA_T *points, uint8_t *point_num);
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+static esp_err_t touch_gsl3680_read_task_start(esp_lcd_touch_handle_t tp);
+static void touch_gsl3680_read_task_stop(void);
+static void touch_gsl3680_take_sample(esp_lcd_touch_handle_t tp);
+#endif
 static TP_STATE_E _Get_Cal_msg(void);
 
 esp_err_t esp_lcd_touch_new_i2c_gsl3680(esp_lcd_panel_io_handle_t io, const esp_lcd_touch_config_t *config, esp_lcd_touch_handle_t *out_touch)
@@ -259,11 +289,22 @@ esp_err_t esp_lcd_touch_new_i2c_gsl3680(esp_lcd_panel_io_handle_t io, const esp_
         ret = gpio_config(&int_gpio_config);
         ESP_GOTO_ON_ERROR(ret, err, TAG, "GPIO config failed");
 
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+        /* The read task is woken by the interrupt, the user callback is chained after it */
+        ret = touch_gsl3680_read_task_start(esp_lcd_touch_gsl3680);
+        ESP_GOTO_ON_ERROR(ret, err, TAG, "Interrupt read start failed");
+#else
         /* Register interrupt callback */
         if (esp_lcd_touch_gsl3680->config.interrupt_callback) {
             esp_lcd_touch_register_interrupt_callback(esp_lcd_touch_gsl3680, esp_lcd_touch_gsl3680->config.interrupt_callback);
         }
+#endif
+    }
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+    else {
+        ESP_LOGW(TAG, "No INT pin, the points are polled");
     }
+#endif
  
 err:
     if (ret != ESP_OK) {
@@ -303,27 +344,54 @@ static esp_err_t esp_lcd_touch_gsl3680_exit_sleep(esp_lcd_touch_handle_t tp)
 
 static esp_err_t esp_lcd_touch_gsl3680_read_data(esp_lcd_touch_handle_t tp)
 {
-    esp_err_t err;
-    uint8_t touch_data[24];
-    uint8_t touch_cnt = 0;
-    uint16_t x_poit, y_poit, x2_poit, y2_poit;
+    XY_DATA_T points[MAX_FINGER_NUM];
+    uint8_t point_num = 0;
 
     assert(tp != NULL);
 
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+    if (read_task_handle) {
+        /* Read by the task already, no I2C here */
+        touch_gsl3680_take_sample(tp);
+        return ESP_OK;
+    }
+#endif
+
+    esp_err_t err = touch_gsl3680_read_points(tp, points, &point_num);
+
+    portENTER_CRITICAL(&tp->data.lock);
+    memcpy(XY_Coordinate, points, sizeof(XY_Coordinate));
+    Finger_num = point_num;
+    portEXIT_CRITICAL(&tp->data.lock);
+
+    return err;
+}
+
+/* Read one point report and run it through the point id algorithm, which keeps state, so only from one task */
+static esp_err_t touch_gsl3680_read_points(esp_lcd_touch_handle_t tp, XY_DATA_T *points, uint8_t *point_num)
+{
+    esp_err_t err;
+    uint8_t touch_data[ESP_LCD_TOUCH_GSL3680_REPORT_LEN];
+    uint16_t x_poit, y_poit, x2_poit, y2_poit;
+
 // #ifdef USE_GSL_NOID_VERSION
     struct gsl_touch_info cinfo = {0};
     unsigned int tmp1 = 0;
     uint8_t buf[4] = {0};
 // #endif
 
-    memset(XY_Coordinate,0,sizeof(XY_Coordinate));
+    memset(points, 0, sizeof(XY_DATA_T) * MAX_FINGER_NUM);
+    *point_num = 0;
 
-    err = touch_gsl3680_i2c_read(tp, ESP_LCD_TOUCH_GSL3680_READ_XY_REG, touch_data, 44);
-    Finger_num = touch_data[0];
+    err = touch_gsl3680_i2c_read(tp, ESP_LCD_TOUCH_GSL3680_READ_XY_REG, touch_data, sizeof(touch_data));
+    if (err != ESP_OK) {
+        return err;
+    }
     // ESP_LOGI(TAG,"0x80 = %d",touch_data[0]);
 
-    cinfo.finger_num = Finger_num;	
-    for(int j=0;j<Finger_num;j++)
+    cinfo.finger_num = (touch_data[0] > ESP_LCD_TOUCH_GSL3680_REPORT_MAX_FINGERS) ?
+                       ESP_LCD_TOUCH_GSL3680_REPORT_MAX_FINGERS : touch_data[0];
+    for(int j=0;j<cinfo.finger_num;j++)
     {
         x_poit = touch_data[(j+1)*4+3] & 0x0f;
         x2_poit = touch_data[(j+1)*4+2];
@@ -350,27 +418,121 @@ static esp_err_t esp_lcd_touch_gsl3680_read_data(esp_lcd_touch_handle_t tp)
 		
 		touch_gsl3680_i2c_write(tp,addr, buf, 4);
 	}
-	Finger_num = cinfo.finger_num;	
+	*point_num = (cinfo.finger_num > MAX_FINGER_NUM) ? MAX_FINGER_NUM : cinfo.finger_num;
 
-    for(int j=0;j<Finger_num;j++)
+    for(int j=0;j<*point_num;j++)
     {
-        XY_Coordinate[j].x_position =  cinfo.x[j];
-        XY_Coordinate[j].y_position =  cinfo.y[j];
-        XY_Coordinate[j].finger_id = cinfo.id[j];
+        points[j].x_position =  cinfo.x[j];
+        points[j].y_position =  cinfo.y[j];
+        points[j].finger_id = cinfo.id[j];
     }
-			
-    // if(Finger_num >0)
-    // int i=0
-    // printf("%s: %d[i], %d[x_position], %d[y_position], %d[finger_id], %d[finger_num]\n",
-    //       __func__, i, XY_Coordinate[i].x_position, XY_Coordinate[i].y_position, XY_Coordinate[i].finger_id,Finger_num);
-    // i=1;
-    // printf("%s: %d[i], %d[x_position], %d[y_position], %d[finger_id], %d[finger_num]\n",
-    //       __func__, i, XY_Coordinate[i].x_position, XY_Coordinate[i].y_position, XY_Coordinate[i].finger_id,Finger_num);
-    
-    
-    return err;
+
+    return ESP_OK;
 }
 
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+static void IRAM_ATTR touch_gsl3680_isr(esp_lcd_touch_handle_t tp)
+{
+    BaseType_t need_yield = pdFALSE;
+
+    vTaskNotifyGiveFromISR(read_task_handle, &need_yield);
+    if (user_interrupt_callback) {
+        user_interrupt_callback(tp);
+    }
+    if (need_yield) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void touch_gsl3680_read_task(void *arg)
+{
+    esp_lcd_touch_handle_t tp = (esp_lcd_touch_handle_t)arg;
+    gsl3680_sample_t sample;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (read_task_stop) {
+            break;
+        }
+        if (touch_gsl3680_read_points(tp, sample.points, &sample.num) != ESP_OK) {
+            continue;
+        }
+
+        /* A full ring drops the oldest sample */
+        portENTER_CRITICAL(&tp->data.lock);
+        sample_ring[sample_head % ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN] = sample;
+        sample_head++;
+        if (sample_head - sample_tail > ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN) {
+            sample_tail = sample_head - ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN;
+        }
+        portEXIT_CRITICAL(&tp->data.lock);
+    }
+
+    xSemaphoreGive(read_task_done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t touch_gsl3680_read_task_start(esp_lcd_touch_handle_t tp)
+{
+    read_task_done = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(read_task_done, ESP_ERR_NO_MEM, TAG, "no mem for semaphore");
+
+    sample_head = 0;
+    sample_tail = 0;
+    sample_pressed = false;
+    read_task_stop = false;
+    user_interrupt_callback = tp->config.interrupt_callback;
+    if (xTaskCreate(touch_gsl3680_read_task, "gsl3680", CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ_TASK_STACK_SIZE, tp,
+                    CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ_TASK_PRIORITY, &read_task_handle) != pdPASS) {
+        vSemaphoreDelete(read_task_done);
+        read_task_done = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = esp_lcd_touch_register_interrupt_callback(tp, touch_gsl3680_isr);
+    if (ret != ESP_OK) {
+        touch_gsl3680_read_task_stop();
+    }
+    return ret;
+}
+
+/* Called with the interrupt removed, lets a read in progress finish so the I2C bus isn't left locked */
+static void touch_gsl3680_read_task_stop(void)
+{
+    read_task_stop = true;
+    xTaskNotifyGive(read_task_handle);
+    xSemaphoreTake(read_task_done, portMAX_DELAY);
+    vSemaphoreDelete(read_task_done);
+    read_task_done = NULL;
+    read_task_handle = NULL;
+}
+
+static void touch_gsl3680_take_sample(esp_lcd_touch_handle_t tp)
+{
+    portENTER_CRITICAL(&tp->data.lock);
+    if (sample_head != sample_tail) {
+        uint32_t take = sample_head - 1;
+
+        /* The latest sample, unless it releases a tap that was never reported pressed. The release stays queued. */
+        if (!sample_pressed && (sample_ring[take % ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN].num == 0)) {
+            for (uint32_t i = sample_head - 1; i != sample_tail; i--) {
+                if (sample_ring[(i - 1) % ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN].num > 0) {
+                    take = i - 1;
+                    break;
+                }
+            }
+        }
+
+        const gsl3680_sample_t *sample = &sample_ring[take % ESP_LCD_TOUCH_GSL3680_SAMPLE_RING_LEN];
+        memcpy(XY_Coordinate, sample->points, sizeof(XY_Coordinate));
+        Finger_num = sample->num;
+        sample_pressed = (sample->num > 0);
+        sample_tail = take + 1;
+    }
+    portEXIT_CRITICAL(&tp->data.lock);
+}
+#endif
+
 static bool esp_lcd_touch_gsl3680_get_xy(esp_lcd_touch_handle_t tp, uint16_t *x, uint16_t *y, uint16_t *strength, uint8_t *point_num, uint8_t max_point_num)
 {
     assert(tp != NULL);
@@ -434,6 +596,12 @@ static esp_err_t esp_lcd_touch_gsl3680_del(esp_lcd_touch_handle_t tp)
         }
     }
 
+#if CONFIG_ESP_LCD_TOUCH_GSL3680_INTR_READ
+    if (read_task_handle) {
+        touch_gsl3680_read_task_stop();
+    }
+#endif
+
     /* Reset GPIO pin settings */
     if (tp->config.rst_gpio_num != GPIO_NUM_NC) {
         gpio_reset_pin(tp->config.rst_gpio_num);
@@ -201,6 +201,8 @@ esp_err_t bsp_audio_init(const i2s_std_config_t *i2s_config)
     /* Setup I2S peripheral */
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(CONFIG_BSP_I2S_NUM, I2S_ROLE_MASTER);
     chan_cfg.auto_clear = true; // Auto clear the legacy data in the DMA buffer
+    chan_cfg.dma_desc_num = CONFIG_BSP_I2S_DMA_DESC_NUM;
+    chan_cfg.dma_frame_num = CONFIG_BSP_I2S_DMA_FRAME_NUM;
     ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &i2s_tx_chan, &i2s_rx_chan));
 
     /* Setup I2S channels */
@@ -230,6 +232,21 @@ esp_err_t bsp_audio_init(const i2s_std_config_t *i2s_config)
     return ESP_OK;
 }
 
+esp_err_t bsp_audio_get_i2s_channels(i2s_chan_handle_t *tx_chan, i2s_chan_handle_t *rx_chan)
+{
+    if (!i2s_tx_chan || !i2s_rx_chan) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (tx_chan) {
+        *tx_chan = i2s_tx_chan;
+    }
+    if (rx_chan) {
+        *rx_chan = i2s_rx_chan;
+    }
+    return ESP_OK;
+}
+
 esp_codec_dev_handle_t bsp_audio_codec_speaker_init(void)
 {
     if (i2s_data_if == NULL) {
@@ -135,6 +135,18 @@ i2c_master_bus_handle_t bsp_i2c_get_handle(void);
  */
 esp_err_t bsp_audio_init(const i2s_std_config_t *i2s_config);
 
+/**
+ * @brief Get the I2S channels of the audio codec
+ *
+ * @note Audio must be initialized by bsp_audio_init() or a codec init function first
+ * @param[out] tx_chan I2S TX channel, can be NULL if not needed
+ * @param[out] rx_chan I2S RX channel, can be NULL if not needed
+ * @return
+ *      - ESP_OK                On success
+ *      - ESP_ERR_INVALID_STATE Audio is not initialized
+ */
+esp_err_t bsp_audio_get_i2s_channels(i2s_chan_handle_t *tx_chan, i2s_chan_handle_t *rx_chan);
+
 /**
  * @brief Initialize speaker codec device
  *
@@ -0,0 +1,177 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_dsp.h"
+#include "bsp_board_extra.h"
+#include "app_audio_dsp.h"
+
+#define DSP_FRAMES          (CONFIG_BSP_I2S_DMA_FRAME_NUM)
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+#define DSP_AEC_TAPS        (CONFIG_EXAMPLE_AUDIO_DSP_AEC_TAPS)
+#define DSP_AEC_DELAY       (CONFIG_EXAMPLE_AUDIO_DSP_AEC_DELAY)
+#define DSP_AEC_REF_LEN     (DSP_AEC_DELAY + DSP_AEC_TAPS - 1)
+#endif
+#define DSP_AEC_MU          (0.1f)                  // NLMS step size
+#define DSP_AEC_EPS         (1e-3f)                 // Keeps the NLMS step bounded while nothing is played
+#define DSP_HPF_HZ          (100.0f)                // Removes the DC and the rumble before the AEC
+#define DSP_NS_THRESHOLD    (4.0f)                  // Blocks this many times above the noise floor pass the gate
+#define DSP_NS_FLOOR_RISE   (1.0005f)               // Noise floor rise per block, under 1 dB/s at 2 ms blocks
+#define DSP_NS_ATTEN        (0.1f)                  // Gain of the gated noise, -20 dB
+#define DSP_AGC_ATTACK      (0.5f)                  // Envelope smoothing of a louder block
+#define DSP_AGC_RELEASE     (0.02f)                 // Envelope smoothing of a quieter block
+#define DSP_LOAD_LOG_US     (5 * 1000 * 1000)
+
+static const char *TAG = "app_audio_dsp";
+
+// esp-dsp vector kernels are fastest on 16 byte aligned floats
+static float dsp_mic[DSP_FRAMES] __attribute__((aligned(16)));
+static float dsp_out[DSP_FRAMES] __attribute__((aligned(16)));
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+static float aec_weights[DSP_AEC_TAPS] __attribute__((aligned(16)));
+static float aec_update[DSP_AEC_TAPS] __attribute__((aligned(16)));
+static float aec_ref[DSP_AEC_REF_LEN] __attribute__((aligned(16)));  // Played samples, newest last
+#endif
+static float hpf_coeffs[5];
+static float hpf_state[2];
+static float ns_floor = 1e-6f;
+static float ns_gain = 1.0f;
+static float agc_env = 0.0f;
+static float agc_gain = 1.0f;
+#if CONFIG_EXAMPLE_AUDIO_DSP_AGC
+static float agc_target;
+static float agc_max_gain;
+#endif
+static int64_t dsp_busy_us = 0;
+static int64_t dsp_log_start_us = 0;
+
+esp_err_t app_audio_dsp_init(uint32_t sample_rate)
+{
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+    // The echo of a block is heard at the earliest a block later, its reference must be in the history already
+    ESP_RETURN_ON_FALSE(DSP_AEC_DELAY >= DSP_FRAMES, ESP_ERR_INVALID_ARG, TAG,
+                        "AEC delay %d shorter than a block of %d frames", DSP_AEC_DELAY, DSP_FRAMES);
+    memset(aec_weights, 0, sizeof(aec_weights));
+    memset(aec_ref, 0, sizeof(aec_ref));
+#endif
+    dsps_biquad_gen_hpf_f32(hpf_coeffs, DSP_HPF_HZ / sample_rate, 0.707f);
+    memset(hpf_state, 0, sizeof(hpf_state));
+
+#if CONFIG_EXAMPLE_AUDIO_DSP_AGC
+    agc_target = powf(10.0f, CONFIG_EXAMPLE_AUDIO_DSP_AGC_TARGET_DBFS / 20.0f);
+    agc_max_gain = powf(10.0f, CONFIG_EXAMPLE_AUDIO_DSP_AGC_MAX_GAIN_DB / 20.0f);
+#endif
+    dsp_log_start_us = esp_timer_get_time();
+
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+    ESP_LOGI(TAG, "%d frames per block, AEC %d taps after %d samples", DSP_FRAMES, DSP_AEC_TAPS, DSP_AEC_DELAY);
+#endif
+
+    return ESP_OK;
+}
+
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+static void dsp_aec(float *mic, size_t frames)
+{
+    // Window of mic sample i: the DSP_AEC_TAPS samples played up to DSP_AEC_DELAY samples before it. The last
+    // window ends on the newest sample when the delay is exactly a block.
+    const float *x = aec_ref;
+    float energy;
+
+    dsps_dotprod_f32(x, x, &energy, DSP_AEC_TAPS);
+    for (size_t i = 0; i < frames; i++, x++) {
+        if (i > 0) {
+            // Slide the window energy instead of recomputing it, it's recomputed every block so it can't drift
+            energy += x[DSP_AEC_TAPS - 1] * x[DSP_AEC_TAPS - 1] - x[-1] * x[-1];
+        }
+        float echo;
+        dsps_dotprod_f32(x, aec_weights, &echo, DSP_AEC_TAPS);
+        const float err = mic[i] - echo;
+        dsps_mulc_f32(x, aec_update, DSP_AEC_TAPS, DSP_AEC_MU * err / (energy + DSP_AEC_EPS), 1, 1);
+        dsps_add_f32(aec_weights, aec_update, aec_weights, DSP_AEC_TAPS, 1, 1, 1);
+        mic[i] = err;
+    }
+}
+
+static void dsp_aec_push(const float *out, size_t frames)
+{
+    memmove(aec_ref, aec_ref + frames, (DSP_AEC_REF_LEN - frames) * sizeof(float));
+    memcpy(aec_ref + DSP_AEC_REF_LEN - frames, out, frames * sizeof(float));
+}
+#endif
+
+static float dsp_gain(const float *samples, size_t frames)
+{
+    float power;
+    dsps_dotprod_f32(samples, samples, &power, frames);
+    power /= frames;
+
+    // Block gains of the gate and the AGC, the caller ramps to them over the block
+    bool speech = true;
+#if CONFIG_EXAMPLE_AUDIO_DSP_NS
+    // Minimum tracking: the floor follows the quiet blocks at once and rises slowly through speech
+    ns_floor = (power < ns_floor) ? fmaxf(power, 1e-10f) : ns_floor * DSP_NS_FLOOR_RISE;
+    speech = power > ns_floor * DSP_NS_THRESHOLD;
+    ns_gain = speech ? 1.0f : DSP_NS_ATTEN;
+#endif
+
+#if CONFIG_EXAMPLE_AUDIO_DSP_AGC
+    // The level only follows speech, so the AGC doesn't pull the noise up in the pauses
+    if (speech) {
+        const float rms = sqrtf(power);
+        agc_env += (rms - agc_env) * ((rms > agc_env) ? DSP_AGC_ATTACK : DSP_AGC_RELEASE);
+    }
+    if (agc_env > 0.0f) {
+        agc_gain = fminf(agc_target / agc_env, agc_max_gain);
+    }
+#endif
+
+    return ns_gain * agc_gain;
+}
+
+void app_audio_dsp_process(const int16_t *in, int16_t *out, size_t frames, void *user_ctx)
+{
+    static float gain = 1.0f;
+    const int64_t start_us = esp_timer_get_time();
+
+    if (frames != DSP_FRAMES) {
+        memcpy(out, in, frames * CODEC_DEFAULT_CHANNEL * sizeof(int16_t));
+        return;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        dsp_mic[i] = in[i * CODEC_DEFAULT_CHANNEL] * (1.0f / 32768.0f);
+    }
+    dsps_biquad_f32(dsp_mic, dsp_mic, frames, hpf_coeffs, hpf_state);
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+    dsp_aec(dsp_mic, frames);
+#endif
+
+    // Ramp from the gain of the last block, a step would click
+    const float target = dsp_gain(dsp_mic, frames);
+    const float step = (target - gain) / frames;
+    for (size_t i = 0; i < frames; i++) {
+        gain += step;
+        dsp_out[i] = fmaxf(-1.0f, fminf(dsp_mic[i] * gain, 32767.0f / 32768.0f));
+        const int16_t sample = (int16_t)(dsp_out[i] * 32768.0f);
+        for (int ch = 0; ch < CODEC_DEFAULT_CHANNEL; ch++) {
+            out[i * CODEC_DEFAULT_CHANNEL + ch] = sample;
+        }
+    }
+    gain = target;
+#if CONFIG_EXAMPLE_AUDIO_DSP_AEC
+    dsp_aec_push(dsp_out, frames);
+#endif
+
+    // Time of the DSP against the time the block lasts
+    const int64_t end_us = esp_timer_get_time();
+    dsp_busy_us += end_us - start_us;
+    if (end_us - dsp_log_start_us >= DSP_LOAD_LOG_US) {
+        ESP_LOGI(TAG, "DSP load %.1f%% of a core, AGC gain %.1f dB", 100.0 * dsp_busy_us / (end_us - dsp_log_start_us),
+                 20.0f * log10f(agc_gain));
+        dsp_busy_us = 0;
+        dsp_log_start_us = end_us;
+    }
+}
@@ -20,10 +20,11 @@
  #include "app_camera.h"
  
  #define MEMORY_TYPE V4L2_MEMORY_MMAP
- #define BUFFER_COUNT 2
+ #define BUFFER_COUNT_MAX 8      /* Upper bound of the runtime capture buffer depth */
  #define CAPTURE_SECONDS 3
  
  static i2c_master_bus_handle_t i2c_handle = NULL;
+ static uint32_t s_buffer_count = CONFIG_EXAMPLE_CAPTURE_BUFFER_COUNT;
 
  static const char *TAG = "example";
  
@@ -85,7 +86,7 @@
      uint32_t frame_size;
      uint32_t frame_count;
      struct v4l2_buffer buf;
-     uint8_t *buffer[BUFFER_COUNT];
+     uint8_t *buffer[BUFFER_COUNT_MAX];
      struct v4l2_format init_format;
      struct v4l2_requestbuffers req;
      struct v4l2_capability capability;
@@ -167,7 +168,7 @@
      ESP_LOGI(TAG, "Capture %s format frames for %d seconds:", (char *)fmtdesc.description, CAPTURE_SECONDS);
  
      memset(&req, 0, sizeof(req));
-     req.count  = BUFFER_COUNT;
+     req.count  = s_buffer_count;
      req.type   = type;
      req.memory = MEMORY_TYPE;
      if (ioctl(fd, VIDIOC_REQBUFS, &req) != 0) {
@@ -176,7 +177,9 @@
          goto exit_0;
      }
  
-     for (int i = 0; i < BUFFER_COUNT; i++) {
+     /* The driver may grant fewer buffers than requested */
+     ESP_LOGI(TAG, "%" PRIu32 " capture buffers", req.count);
+     for (int i = 0; i < MIN(req.count, BUFFER_COUNT_MAX); i++) {
          struct v4l2_buffer buf;
  
          memset(&buf, 0, sizeof(buf));
@@ -255,6 +258,17 @@
      return ret;
  }
  
+ esp_err_t app_camera_set_buffer_count(uint32_t count)
+ {
+     if (count < 2 || count > BUFFER_COUNT_MAX) {
+         ESP_LOGE(TAG, "capture buffer count %" PRIu32 " out of range [2, %d]", count, BUFFER_COUNT_MAX);
+         return ESP_ERR_INVALID_ARG;
+     }
+
+     s_buffer_count = count;
+     return ESP_OK;
+ }
+
  void app_camera(void)
  {
      esp_err_t ret = ESP_OK;
@@ -13,6 +13,7 @@
 */
 #include <string.h>
 #include <stdlib.h>
+#include <sys/param.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -20,12 +21,14 @@
 #include "freertos/event_groups.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_eth_driver.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "esp_private/wifi.h"
 #include "ethernet_init.h"
 #include "app_enthernet.h"
+#include "wifi_scanner.h"
 
 static void wifi_scan_init(void);
 
@@ -33,6 +36,10 @@ static void wifi_scan_init(void);
 static const char *TAG = "eth2ap_example";
 static esp_eth_handle_t s_eth_handle = NULL;
 static QueueHandle_t flow_control_queue = NULL;
+static QueueHandle_t flow_control_priority_queue = NULL;
+static QueueHandle_t wifi2eth_queue = NULL;
+static TaskHandle_t eth2wifi_task_handle = NULL;
+static esp_timer_handle_t eth2wifi_backoff_timer = NULL;
 static EventGroupHandle_t Btn_event_group = NULL;
 static bool s_sta_is_connected = false;
 static bool s_ethernet_is_connected = false;
@@ -42,13 +49,16 @@ static uint8_t s_eth_mac[6];
 static bool enthernet_connect = false;
 static bool wifi_connect = false;
 
-#define FLOW_CONTROL_QUEUE_TIMEOUT_MS (100)
-#define FLOW_CONTROL_QUEUE_LENGTH (40)
 #define FLOW_CONTROL_WIFI_SEND_TIMEOUT_MS (100)
+#define FLOW_CONTROL_TX_BACKOFF_MIN_US (500)
+#define FLOW_CONTROL_TX_BACKOFF_MAX_US (8000)
 
+// A bridged packet, passed by reference from the RX path to the bridge task that transmits it
 typedef struct {
     void *packet;
+    void *eb;                   // Wi-Fi RX buffer that holds `packet`, NULL for an Ethernet packet
     uint16_t length;
+    int64_t deadline_us;        // Drop time once the packet found the TX path full, 0 before its first try
 } flow_control_msg_t;
 
 typedef enum{
@@ -57,61 +67,180 @@ typedef enum{
 }event_id_t;
 
 // Forward packets from Wi-Fi to Ethernet
+// The Wi-Fi RX callback only queues the RX buffer, the bridge task transmits and frees it,
+// so the Wi-Fi driver is never held up by the Ethernet MAC.
 static esp_err_t pkt_wifi2eth(void *buffer, uint16_t len, void *eb)
 {
-    if (s_ethernet_is_connected) {
-        if (esp_eth_transmit(s_eth_handle, buffer, len) != ESP_OK) {
-            ESP_LOGE(TAG, "Ethernet send packet failed");
-        }
+    flow_control_msg_t msg = {
+        .packet = buffer,
+        .eb = eb,
+        .length = len
+    };
+    if (!s_ethernet_is_connected || xQueueSend(wifi2eth_queue, &msg, 0) != pdTRUE) {
+        esp_wifi_internal_free_rx_buffer(eb);
     }
-    esp_wifi_internal_free_rx_buffer(eb);
     return ESP_OK;
 }
 
+// Control traffic (ARP, and IP packets with a DSCP of at least CONFIG_EXAMPLE_BRIDGE_PRIORITY_DSCP)
+// takes the priority queue, so it never waits behind bulk traffic
+static bool pkt_is_priority(const uint8_t *buffer, uint32_t len)
+{
+    uint32_t offset = 12;
+    if (len < offset + 2) {
+        return false;
+    }
+    uint16_t type = (buffer[offset] << 8) | buffer[offset + 1];
+    if (type == 0x8100 && len >= offset + 6) {
+        // Skip the VLAN tag
+        offset += 4;
+        type = (buffer[offset] << 8) | buffer[offset + 1];
+    }
+    const uint8_t *payload = buffer + offset + 2;
+    const uint32_t payload_len = len - offset - 2;
+    switch (type) {
+    case 0x0806:            // ARP
+        return true;
+    case 0x0800:            // IPv4, DSCP in the TOS byte
+        return payload_len >= 2 && (payload[1] >> 2) >= CONFIG_EXAMPLE_BRIDGE_PRIORITY_DSCP;
+    case 0x86DD:            // IPv6, DSCP in the traffic class
+        return payload_len >= 2 && ((((payload[0] & 0x0F) << 4) | (payload[1] >> 4)) >> 2) >= CONFIG_EXAMPLE_BRIDGE_PRIORITY_DSCP;
+    default:
+        return false;
+    }
+}
+
 // Forward packets from Ethernet to Wi-Fi
 // Note that, Ethernet works faster than Wi-Fi on ESP32,
 // so we need to add an extra queue to balance their speed difference.
+// A full queue drops its oldest packet: the newest data is the one still worth sending,
+// and the Ethernet RX task doesn't wait for Wi-Fi.
 static esp_err_t pkt_eth2wifi(esp_eth_handle_t eth_handle, uint8_t *buffer, uint32_t len, void *priv)
 {
-    esp_err_t ret = ESP_OK;
     flow_control_msg_t msg = {
         .packet = buffer,
+        .eb = NULL,
         .length = len
     };
-    if (xQueueSend(flow_control_queue, &msg, pdMS_TO_TICKS(FLOW_CONTROL_QUEUE_TIMEOUT_MS)) != pdTRUE) {
-        ESP_LOGE(TAG, "send flow control message failed or timeout");
-        free(buffer);
-        ret = ESP_FAIL;
+    QueueHandle_t queue = pkt_is_priority(buffer, len) ? flow_control_priority_queue : flow_control_queue;
+    while (xQueueSend(queue, &msg, 0) != pdTRUE) {
+        flow_control_msg_t oldest;
+        if (xQueueReceive(queue, &oldest, 0) == pdTRUE) {
+            free(oldest.packet);
+        }
     }
-    return ret;
+    xTaskNotifyGive(eth2wifi_task_handle);
+    return ESP_OK;
+}
+
+// Only a full TX path is worth a retry, other errors fail the same way again
+static bool wifi_tx_retryable(esp_err_t res)
+{
+    return res == ESP_ERR_NO_MEM || res == ESP_FAIL;
+}
+
+// Ends a TX back-off, the bridge task tries the queues again
+static void eth2wifi_backoff_done(void *arg)
+{
+    xTaskNotifyGive(eth2wifi_task_handle);
 }
 
 // This task will fetch the packet from the queue, and then send out through Wi-Fi.
-// Wi-Fi handles packets slower than Ethernet, we might add some delay between each transmitting.
+// Wi-Fi handles packets slower than Ethernet. On the P4 the Wi-Fi runs on the co-processor
+// through esp_wifi_remote, which reports no TX done, so the return code of esp_wifi_internal_tx()
+// is the only sign of a full TX path. The packet then goes back to the front of its queue and the
+// bridge backs off on an esp_timer, from FLOW_CONTROL_TX_BACKOFF_MIN_US doubling up to
+// FLOW_CONTROL_TX_BACKOFF_MAX_US, the FreeRTOS tick is too coarse for that. After the back-off the
+// priority queue is served first again, so a bulk packet never holds up control traffic. A packet
+// still not sent FLOW_CONTROL_WIFI_SEND_TIMEOUT_MS after its first try is dropped, the packets
+// behind it are newer. A sent packet ends the back-off.
 static void eth2wifi_flow_control_task(void *args)
 {
     flow_control_msg_t msg;
     int res = 0;
-    uint32_t timeout = 0;
+    int64_t backoff_us = 0;
+    int64_t resume_us = 0;
     while (1) {
-        if (xQueueReceive(flow_control_queue, &msg, pdMS_TO_TICKS(FLOW_CONTROL_QUEUE_TIMEOUT_MS)) == pdTRUE) {
-            timeout = 0;
-            if (s_sta_is_connected && msg.length) {
-                do {
-                    vTaskDelay(pdMS_TO_TICKS(timeout));
-                    timeout += 2;
-                    res = esp_wifi_internal_tx(WIFI_IF_AP, msg.packet, msg.length);
-                } while (res && timeout < FLOW_CONTROL_WIFI_SEND_TIMEOUT_MS);
-                if (res != ESP_OK) {
-                    ESP_LOGE(TAG, "WiFi send packet failed: %d", res);
-                }
+        // Packets arriving during a back-off wake the task up early, they wait for the timer
+        if (esp_timer_get_time() < resume_us) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        QueueHandle_t queue = flow_control_priority_queue;
+        if (xQueueReceive(queue, &msg, 0) != pdTRUE) {
+            queue = flow_control_queue;
+            if (xQueueReceive(queue, &msg, 0) != pdTRUE) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
             }
+        }
+        if (!s_sta_is_connected || !msg.length) {
+            free(msg.packet);
+            continue;
+        }
+        const int64_t now = esp_timer_get_time();
+        if (msg.deadline_us && now >= msg.deadline_us) {
+            ESP_LOGE(TAG, "WiFi send packet timed out");
+            free(msg.packet);
+            continue;
+        }
+        res = esp_wifi_internal_tx(WIFI_IF_AP, msg.packet, msg.length);
+        if (res == ESP_OK) {
+            backoff_us = 0;
+            free(msg.packet);
+            continue;
+        }
+        if (!wifi_tx_retryable(res)) {
+            ESP_LOGE(TAG, "WiFi send packet failed: %d", res);
+            free(msg.packet);
+            continue;
+        }
+        // The TX path is full, give it time to drain and keep the packet for later
+        if (!msg.deadline_us) {
+            msg.deadline_us = now + FLOW_CONTROL_WIFI_SEND_TIMEOUT_MS * 1000;
+        }
+        backoff_us = backoff_us ? MIN(backoff_us * 2, FLOW_CONTROL_TX_BACKOFF_MAX_US) : FLOW_CONTROL_TX_BACKOFF_MIN_US;
+        resume_us = now + backoff_us;
+        esp_timer_start_once(eth2wifi_backoff_timer, backoff_us);
+        // The RX path filled the queue meanwhile, this packet is the oldest one and goes
+        if (xQueueSendToFront(queue, &msg, 0) != pdTRUE) {
             free(msg.packet);
         }
     }
     vTaskDelete(NULL);
 }
 
+// Take the next packet and up to CONFIG_EXAMPLE_BRIDGE_BATCH - 1 more already queued, so a burst
+// is sent back to back in one wake-up of the task
+static int flow_control_receive_batch(QueueHandle_t queue, flow_control_msg_t *batch)
+{
+    int num = 0;
+
+    if (xQueueReceive(queue, &batch[num], portMAX_DELAY) == pdTRUE) {
+        num++;
+        while ((num < CONFIG_EXAMPLE_BRIDGE_BATCH) && (xQueueReceive(queue, &batch[num], 0) == pdTRUE)) {
+            num++;
+        }
+    }
+    return num;
+}
+
+// This task sends the Wi-Fi packets out through Ethernet, and hands their RX buffers back to the Wi-Fi driver.
+static void wifi2eth_flow_control_task(void *args)
+{
+    flow_control_msg_t batch[CONFIG_EXAMPLE_BRIDGE_BATCH];
+    while (1) {
+        const int num = flow_control_receive_batch(wifi2eth_queue, batch);
+        for (int i = 0; i < num; i++) {
+            if (s_ethernet_is_connected && esp_eth_transmit(s_eth_handle, batch[i].packet, batch[i].length) != ESP_OK) {
+                ESP_LOGE(TAG, "Ethernet send packet failed");
+            }
+            esp_wifi_internal_free_rx_buffer(batch[i].eb);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
 // Event handler for Ethernet
 static void eth_event_handler(void *arg, esp_event_base_t event_base,
                               int32_t event_id, void *event_data)
@@ -240,34 +369,40 @@ static void initialize_wifi(void)
     wifi_scan_init();
 }
 
-static void wifi_scan_init(void)
+static void wifi_scan_done_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-    uint16_t ap_number;
-    uint16_t ap_num=25;
-    esp_err_t ret;
-    ret = esp_wifi_scan_start(NULL,true);
-    ESP_LOGI(TAG,"wifi scan = 0x%x",ret);
-    esp_wifi_scan_get_ap_num(&ap_number);
-    ESP_LOGI(TAG,"ap_number = %d",ap_number);
-    // ap_num = 10;
-
-    wifi_ap_record_t ap_info;
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_record(&ap_info));
-    // vTaskDelay(pdMS_TO_TICKS(1000));
-    ESP_LOGI(TAG,"ret_wiff= 0x%x",ret);
-    if(ret == ESP_OK)
+    const wifi_scanner_update_t *update = (const wifi_scanner_update_t *)event_data;
+    wifi_scanner_ap_t ap_info;
+
+    // One sweep is enough to show the Wi-Fi works, scanning on would take the radio off the AP channel
+    wifi_scanner_stop();
+    esp_event_handler_unregister(WIFI_SCANNER_EVENT, WIFI_SCANNER_EVENT_SWEEP_DONE, wifi_scan_done_handler);
+
+    ESP_LOGI(TAG,"ap_number = %d",update->ap_num);
+    bsp_display_lock(0);
+    if(wifi_scanner_get_aps(&ap_info, 1) > 0)
     {
         ESP_LOGI(TAG,"ssid = %s,riss = %d db",ap_info.ssid,ap_info.rssi);
-        vTaskDelay(pdMS_TO_TICKS(1));
-        bsp_display_lock(0);
-        //  lv_label_ins_text(label,LV_LABEL_POS_LAST,"Enthernet initial success\n");
         lv_label_ins_text(label,LV_LABEL_POS_LAST,"WIFI initial #00ff00 Success#\n");
-        bsp_display_unlock();
     }
     else
     {
+        lv_label_ins_text(label,LV_LABEL_POS_LAST,"WIFI initial #ff0000 Failed#\n");
+    }
+    bsp_display_unlock();
+}
+
+static void wifi_scan_init(void)
+{
+    // The scan runs channel by channel in the background instead of blocking the bridge start up
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_SCANNER_EVENT, WIFI_SCANNER_EVENT_SWEEP_DONE,
+                                               wifi_scan_done_handler, NULL));
+    esp_err_t ret = wifi_scanner_start(NULL);
+    ESP_LOGI(TAG,"wifi scan = 0x%x",ret);
+    if(ret != ESP_OK)
+    {
+        esp_event_handler_unregister(WIFI_SCANNER_EVENT, WIFI_SCANNER_EVENT_SWEEP_DONE, wifi_scan_done_handler);
         bsp_display_lock(0);
-        //  lv_label_ins_text(label,LV_LABEL_POS_LAST,"Enthernet initial success\n");
         lv_label_ins_text(label,LV_LABEL_POS_LAST,"WIFI initial #ff0000 Failed#\n");
         bsp_display_unlock();
     }
@@ -275,12 +410,31 @@ static void wifi_scan_init(void)
 
 static esp_err_t initialize_flow_control(void)
 {
-    flow_control_queue = xQueueCreate(FLOW_CONTROL_QUEUE_LENGTH, sizeof(flow_control_msg_t));
-    if (!flow_control_queue) {
+    flow_control_queue = xQueueCreate(CONFIG_EXAMPLE_BRIDGE_QUEUE_LENGTH, sizeof(flow_control_msg_t));
+    flow_control_priority_queue = xQueueCreate(CONFIG_EXAMPLE_BRIDGE_QUEUE_LENGTH, sizeof(flow_control_msg_t));
+    wifi2eth_queue = xQueueCreate(CONFIG_EXAMPLE_BRIDGE_QUEUE_LENGTH, sizeof(flow_control_msg_t));
+    if (!flow_control_queue || !flow_control_priority_queue || !wifi2eth_queue) {
         ESP_LOGE(TAG, "create flow control queue failed");
         return ESP_FAIL;
     }
-    BaseType_t ret = xTaskCreate(eth2wifi_flow_control_task, "flow_ctl", 2048, NULL, (tskIDLE_PRIORITY + 2), NULL);
+    const esp_timer_create_args_t backoff_timer_args = {
+        .callback = eth2wifi_backoff_done,
+        .name = "flow_ctl_backoff",
+    };
+    if (esp_timer_create(&backoff_timer_args, &eth2wifi_backoff_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "create flow control timer failed");
+        return ESP_FAIL;
+    }
+    // Both directions run on the bridge core, away from the Wi-Fi and Ethernet driver tasks
+    BaseType_t core_id = (CONFIG_EXAMPLE_BRIDGE_TASK_CORE < 0) ? tskNO_AFFINITY : CONFIG_EXAMPLE_BRIDGE_TASK_CORE;
+    BaseType_t ret = xTaskCreatePinnedToCore(eth2wifi_flow_control_task, "flow_ctl", 3072, NULL,
+                                             CONFIG_EXAMPLE_BRIDGE_TASK_PRIORITY, &eth2wifi_task_handle, core_id);
+    if (ret != pdTRUE) {
+        ESP_LOGE(TAG, "create flow control task failed");
+        return ESP_FAIL;
+    }
+    ret = xTaskCreatePinnedToCore(wifi2eth_flow_control_task, "flow_ctl_rx", 3072, NULL,
+                                  CONFIG_EXAMPLE_BRIDGE_TASK_PRIORITY, NULL, core_id);
     if (ret != pdTRUE) {
         ESP_LOGE(TAG, "create flow control task failed");
         return ESP_FAIL;
@@ -0,0 +1,43 @@
+#ifndef _APP_AUDIO_DSP_H
+#define _APP_AUDIO_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Prepare the DSP stage of the microphone to earphone loop
+ *
+ * All state is static and sized at build time for blocks of CONFIG_BSP_I2S_DMA_FRAME_NUM frames, nothing is
+ * allocated or cleared per block.
+ *
+ * @param sample_rate: Sample rate of the loop, e.g. CODEC_DEFAULT_SAMPLE_RATE
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: The AEC delay is shorter than a block
+ */
+esp_err_t app_audio_dsp_init(uint32_t sample_rate);
+
+/**
+ * @brief Process one block, a `bsp_extra_duplex_cb_t` for `bsp_extra_duplex_start()`
+ *
+ * The left microphone channel goes through a high-pass filter, the echo canceller (an NLMS adaptive FIR on what was
+ * played), the noise gate and the AGC, and is played on both channels. Stages are enabled in menuconfig.
+ *
+ * @param in: Captured samples, CODEC_DEFAULT_CHANNEL interleaved
+ * @param out: Samples to play, same layout
+ * @param frames: Frames per block, must be CONFIG_BSP_I2S_DMA_FRAME_NUM
+ * @param user_ctx: Unused
+ */
+void app_audio_dsp_process(const int16_t *in, int16_t *out, size_t frames, void *user_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
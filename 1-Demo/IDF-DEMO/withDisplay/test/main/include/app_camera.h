@@ -3,6 +3,7 @@
 
 
 #include <stdint.h>
+#include "esp_err.h"
 #include "esp_cam_sensor_types.h"
 #include "ov5647_types.h"
 #include "bsp/esp-bsp.h"
@@ -13,6 +14,9 @@ extern lv_obj_t *label;
 
 void app_camera(void);
 
+/* Capture buffer depth of the next app_camera() run, 2 to 8, CONFIG_EXAMPLE_CAPTURE_BUFFER_COUNT by default */
+esp_err_t app_camera_set_buffer_count(uint32_t count);
+
 #define OV5647_IDI_CLOCK_RATE_800x800_50FPS        (100000000ULL)
 #define OV5647_8BIT_MODE                           (0x18)
 #define OV5647_REG_END              0xffff
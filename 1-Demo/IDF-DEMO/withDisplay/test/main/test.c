@@ -1,5 +1,7 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_event.h"
@@ -16,8 +18,7 @@
 #include "bsp_board_extra.h"
 #include "bsp/esp-bsp.h"
 #include "app_camera.h"
-
-#define EXAMPLE_RECV_BUF_SIZE (2400)
+#include "app_audio_dsp.h"
 
 #define ECHO_TEST_TXD           (GPIO_NUM_26)
 #define ECHO_TEST_RXD           (GPIO_NUM_27)
@@ -31,18 +32,16 @@
 #define BUF_SIZE                (127)
 #define BAUD_RATE               (115200)
 
-#define PACKET_READ_TICS        (100 / portTICK_PERIOD_MS)
+#define ECHO_EVENT_QUEUE_LEN    (20)
 #define ECHO_TASK_STACK_SIZE    (3072)
 #define ECHO_TASK_PRIO          (10)
 #define ECHO_UART_PORT          (1)
 
 #define ECHO_READ_TOUT          (3) 
 
-const int uart_num = ECHO_UART_PORT;
+#define RS485_TEST_MSG          "RS485 TEST"
 
-static const char err_reason[][30] = {"input param is invalid",
-    "operation timeout"
-   };
+const int uart_num = ECHO_UART_PORT;
 
 static const char *TAG = "MAIN";
 static lv_obj_t *obj = NULL;
@@ -51,39 +50,13 @@ static lv_obj_t *btn = NULL;
 
 static bool RS485_test_bool = false;
 
-static void i2s_echo(void *args)
+#if !CONFIG_EXAMPLE_AUDIO_DSP
+static void i2s_echo(const int16_t *in, int16_t *out, size_t frames, void *user_ctx)
 {
-    uint8_t *mic_data = malloc(EXAMPLE_RECV_BUF_SIZE);
-    if (!mic_data) {
-        ESP_LOGE(TAG, "[echo] No memory for read data buffer");
-        abort();
-    }
-    esp_err_t ret = ESP_OK;
-    size_t bytes_read = 0;
-    size_t bytes_write = 0;
-    ESP_LOGI(TAG, "[echo] Echo start");
-
-    while (1) {
-        // ESP_LOGI(TAG,"i2s read");
-        memset(mic_data, 0, EXAMPLE_RECV_BUF_SIZE);
-        /* Read sample data from mic */
-        ret = bsp_extra_i2s_read(mic_data, EXAMPLE_RECV_BUF_SIZE, &bytes_read, 1000);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "[echo] i2s read failed, %s", err_reason[ret == ESP_ERR_TIMEOUT]);
-            abort();
-        }
-        /* Write sample data to earphone */
-        ret = bsp_extra_i2s_write(mic_data, EXAMPLE_RECV_BUF_SIZE, &bytes_write, 1000);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "[echo] i2s write failed, %s", err_reason[ret == ESP_ERR_TIMEOUT]);
-            abort();
-        }
-        if (bytes_read != bytes_write) {
-            ESP_LOGW(TAG, "[echo] %d bytes read but only %d bytes are written", bytes_read, bytes_write);
-        }
-    }
-    vTaskDelete(NULL);
+    /* Microphone straight to the earphone */
+    memcpy(out, in, frames * CODEC_DEFAULT_CHANNEL * sizeof(int16_t));
 }
+#endif
 
 static void echo_send(const int port, const char* str, uint8_t length)
 {
@@ -99,11 +72,26 @@ static void echo_send(const int port, const char* str, uint8_t length)
 static void RS485_test_callback(lv_event_t *e)
 {
     // echo_send(uart_num, "\r\n", 2);
-    char prefix[] = "RS485 TEST";
+    char prefix[] = RS485_TEST_MSG;
     echo_send(uart_num,prefix,sizeof(prefix));
     ESP_ERROR_CHECK(uart_wait_tx_done(uart_num, 10));
 }
 
+static void rs485_frame_received(const uint8_t *data, int len)
+{
+    ESP_LOGI(TAG, "Received %d bytes:", len);
+    ESP_LOG_BUFFER_HEX(TAG, data, len);
+
+    if (memmem(data, len, RS485_TEST_MSG, sizeof(RS485_TEST_MSG) - 1) == NULL) {
+        ESP_LOGI(TAG,"NOT send data");
+    } else if (!RS485_test_bool) {
+        RS485_test_bool = true;
+        lvgl_port_lock(-1);
+        lv_label_ins_text(label,LV_LABEL_POS_LAST,"RS485 initial #00ff00 Success#\n");
+        lvgl_port_unlock();
+    }
+}
+
 static void echo_task(void *arg)
 {
     
@@ -116,15 +104,13 @@ static void echo_task(void *arg)
         .rx_flow_ctrl_thresh = 122,
         .source_clk = UART_SCLK_DEFAULT,
     };
-
-    // // Set UART log level
-    // esp_log_level_set(TAG, ESP_LOG_INFO);
+    QueueHandle_t uart_queue = NULL;
 
     ESP_LOGI(TAG, "Start RS485 application test and configure UART.");
 
-    // Install UART driver (we don't need an event queue here)
+    // Install UART driver with an event queue, the task sleeps on it until data arrives
     // In this example we don't even use a buffer for sending data.
-    ESP_ERROR_CHECK(uart_driver_install(uart_num, BUF_SIZE * 2, 0, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_driver_install(uart_num, BUF_SIZE * 2, 0, ECHO_EVENT_QUEUE_LEN, &uart_queue, 0));
 
     // Configure UART parameters
     ESP_ERROR_CHECK(uart_param_config(uart_num, &uart_config));
@@ -137,61 +123,58 @@ static void echo_task(void *arg)
     // Set RS485 half duplex mode
     ESP_ERROR_CHECK(uart_set_mode(uart_num, UART_MODE_RS485_HALF_DUPLEX));
 
-    // Set read timeout of UART TOUT feature
+    // Set read timeout of UART TOUT feature, its interrupt marks the end of a frame
     ESP_ERROR_CHECK(uart_set_rx_timeout(uart_num, ECHO_READ_TOUT));
+    ESP_ERROR_CHECK(uart_set_always_rx_timeout(uart_num, true));
 
     // Allocate buffers for UART
     uint8_t* data = (uint8_t*) malloc(BUF_SIZE);
+    assert(data);
+    int len = 0;
+    uart_event_t event;
 
     ESP_LOGI(TAG, "UART start receive loop.\r");
-    // echo_send(uart_num, "Start RS485 UART test.\r\n", 24);
 
     while (1) {
-        //Read data from UART
-        int len = uart_read_bytes(uart_num, data, BUF_SIZE, PACKET_READ_TICS);
-
-        //Write data back to UART
-        if (len > 0) {
-            // echo_send(uart_num, "\r\n", 2);
-            // char prefix[] = "RS485 Received: [";
-            // echo_send(uart_num, prefix, (sizeof(prefix) - 1));
-            ESP_LOGI(TAG, "Received %u bytes:", len);
-            printf("[ ");
-            for (int i = 0; i < len; i++) {
-                printf("0x%.2x ", data[i]);
-                // echo_send(uart_num, (const char*)&data[i], 1);
-                // Add a Newline character if you get a return character from paste (Paste tests multibyte receipt/buffer)
-                // if (data[i] == '\r') {
-                //     echo_send(uart_num, "\n", 1);
-                // }
-            }
-            printf("] \n");
-            // echo_send(uart_num, "]\r\n", 3);
-
-            char *re = strstr((char *)data,"RS485 TEST");
-            if(re == NULL)
-            {
-                ESP_LOGI(TAG,"NOT send data");
-            }
-            else
-            {
-                if(!RS485_test_bool)
-                {
-                    RS485_test_bool = true;
-                    lvgl_port_lock(-1);
-                    lv_label_ins_text(label,LV_LABEL_POS_LAST,"RS485 initial #00ff00 Success#\n");
-                    lvgl_port_unlock();
-                    // break;
+        if (xQueueReceive(uart_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        switch (event.type) {
+        case UART_DATA: {
+            size_t remaining = event.size;
+            while (remaining > 0) {
+                const int read = uart_read_bytes(uart_num, data + len, MIN(remaining, BUF_SIZE - len), 0);
+                if (read <= 0) {
+                    break;
+                }
+                len += read;
+                remaining -= read;
+                // A frame longer than the buffer is handled in pieces
+                if (len == BUF_SIZE) {
+                    rs485_frame_received(data, len);
+                    len = 0;
                 }
             }
-
-            
+            // Set on the RX timeout interrupt, the line is idle after a frame
+            if (event.timeout_flag && (len > 0)) {
+                rs485_frame_received(data, len);
+                len = 0;
+            }
+            break;
+        }
+        case UART_BREAK:
+            len = 0;
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            ESP_LOGW(TAG, "RS485 RX overflow");
+            uart_flush_input(uart_num);
+            xQueueReset(uart_queue);
+            len = 0;
+            break;
+        default:
+            break;
         }
-        // } else {
-        //     // Echo a "." to show we are alive while we wait for input
-        //     echo_send(uart_num, ".", 1);
-        //     ESP_ERROR_CHECK(uart_wait_tx_done(uart_num, 10));
-        // }
     }
     vTaskDelete(NULL);
 }
@@ -277,7 +260,13 @@ void app_main(void)
 
     app_camera();
 
-    xTaskCreate(i2s_echo, "i2s_echo", 8192, NULL, 4, NULL);
+#if CONFIG_EXAMPLE_AUDIO_DSP
+    ESP_ERROR_CHECK(app_audio_dsp_init(CODEC_DEFAULT_SAMPLE_RATE));
+    const bsp_extra_duplex_config_t duplex_cfg = BSP_EXTRA_DUPLEX_DEFAULT_CONFIG(app_audio_dsp_process, NULL);
+#else
+    const bsp_extra_duplex_config_t duplex_cfg = BSP_EXTRA_DUPLEX_DEFAULT_CONFIG(i2s_echo, NULL);
+#endif
+    ESP_ERROR_CHECK(bsp_extra_duplex_start(&duplex_cfg));
     xTaskCreate(echo_task, "uart_echo_task", ECHO_TASK_STACK_SIZE, NULL, 3, NULL);
    
 }
@@ -5,17 +5,81 @@
 #include "camera_debug.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "memstat.h"
+#include "sdkconfig.h"
+#include "linux/videodev2.h"
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 static const char *TAG = "cam_debug";
 
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+#define CAPTURE_SLOT_COUNT      CONFIG_CAMERA_DEBUG_CAPTURE_SLOTS
+#define CAPTURE_SLOT_SIZE       CONFIG_CAMERA_DEBUG_CAPTURE_SLOT_SIZE
+#define CAPTURE_INTERVAL        CONFIG_CAMERA_DEBUG_CAPTURE_INTERVAL
+#define CAPTURE_PATH_MAX        64
+
+/* One captured frame */
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    uint32_t frame_num;
+    int64_t timestamp;
+} capture_slot_t;
+
+/*
+ * Single producer (the task calling camera_debug_process_frame) and single
+ * consumer (camera_debug_capture_flush), head and tail only ever grow
+ */
+typedef struct {
+    capture_slot_t slots[CAPTURE_SLOT_COUNT];
+    uint32_t head;
+    uint32_t tail;
+    bool trigger;
+    uint32_t skipped;               // Frames not captured, ring full or frame too large
+    char path[CAPTURE_PATH_MAX];
+} capture_ring_t;
+#endif
+
+/* Sliding windows are built from buckets of this length */
+#define WINDOW_BUCKET_US        100000
+#define WINDOW_BUCKET_COUNT     100     // Covers the longest window
+#define WINDOW_SHORT_BUCKETS    10
+#define WINDOW_LONG_BUCKETS     WINDOW_BUCKET_COUNT
+
+/* Frames which arrived within one bucket */
+typedef struct {
+    uint32_t index;                 // Absolute bucket number, stale buckets are skipped on read
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t gaps;
+    uint64_t gap_sum;
+    uint64_t gap_sq_sum;
+    uint32_t gap_max;
+} window_bucket_t;
+
 /* Module state */
 static struct {
     uint32_t debug_level;
     camera_stats_t stats;
     bool initialized;
     int64_t start_time;
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+    capture_ring_t capture;
+#endif
+    struct {
+        bool started;               // An IDR was seen, frames before it belong to no GOP
+        uint32_t frames;
+        uint32_t bytes;
+        uint32_t i_size;
+        uint32_t p_bytes;
+        uint32_t p_max;
+    } gop;                          // GOP in progress
+    uint32_t h264_bitrate;
+    uint32_t h264_fps;
+    window_bucket_t window[WINDOW_BUCKET_COUNT];
 } s_debug_ctx = {0};
 
 /* JPEG markers */
@@ -44,11 +108,20 @@ static struct {
 
 /* Forward declarations */
 static void update_statistics(size_t frame_size, int64_t timestamp);
+static void update_window(size_t frame_size, int64_t timestamp, uint32_t gap);
+static void compute_window(int64_t now, uint32_t buckets, camera_window_stats_t *out);
 static bool is_jpeg_format(const uint8_t *data, size_t len);
 static bool is_h264_format(const uint8_t *data, size_t len);
 static esp_err_t analyze_jpeg_header(const uint8_t *data, size_t len, image_header_info_t *info);
 static esp_err_t analyze_h264_header(const uint8_t *data, size_t len, image_header_info_t *info);
 static const char *get_h264_nal_type_name(uint8_t nal_type);
+static void update_gop_statistics(size_t frame_size, bool keyframe);
+static void print_header_info(uint32_t frame_num, size_t len, const image_header_info_t *info);
+static size_t find_nal_unit(const uint8_t *data, size_t len, size_t pos);
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+static esp_err_t capture_init(void);
+static void capture_frame(const uint8_t *data, size_t len, int64_t timestamp);
+#endif
 
 /* ========== Public API Implementation ========== */
 
@@ -63,6 +136,16 @@ esp_err_t camera_debug_init(uint32_t debug_level)
     s_debug_ctx.debug_level = debug_level;
     s_debug_ctx.start_time = esp_timer_get_time();
     s_debug_ctx.stats.min_size = UINT32_MAX;
+
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+    if (DEBUG_ENABLED(CAM_DEBUG_CAPTURE)) {
+        esp_err_t ret = capture_init();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+#endif
+
     s_debug_ctx.initialized = true;
 
     ESP_LOGI(TAG, "Camera debug initialized with level: 0x%02lX", debug_level);
@@ -81,8 +164,10 @@ uint32_t camera_debug_get_level(void)
     return s_debug_ctx.debug_level;
 }
 
-esp_err_t camera_debug_process_frame(const uint8_t *data, size_t len, int64_t timestamp)
+esp_err_t camera_debug_process_frame(const uint8_t *data, size_t len, int64_t timestamp, uint32_t flags)
 {
+    uint32_t frame_type = flags & (V4L2_BUF_FLAG_KEYFRAME | V4L2_BUF_FLAG_PFRAME | V4L2_BUF_FLAG_BFRAME);
+
     if (!s_debug_ctx.initialized) {
         return ESP_ERR_INVALID_STATE;
     }
@@ -101,11 +186,21 @@ esp_err_t camera_debug_process_frame(const uint8_t *data, size_t len, int64_t ti
                  s_debug_ctx.stats.fps, s_debug_ctx.stats.bitrate_kbps);
     }
 
-    // Analyze format if enabled
-    if (DEBUG_ENABLED(CAM_DEBUG_HEADER)) {
+    // The encoder already told the frame type, the header is parsed only to log it
+    if (DEBUG_ENABLED(CAM_DEBUG_STATS) && frame_type && is_h264_format(data, len)) {
+        update_gop_statistics(len, frame_type & V4L2_BUF_FLAG_KEYFRAME);
+    }
+
+    // One header pass serves the GOP statistics and the header log
+    if (DEBUG_ENABLED(CAM_DEBUG_HEADER) || (DEBUG_ENABLED(CAM_DEBUG_STATS) && !frame_type)) {
         image_header_info_t info;
         if (camera_debug_analyze_format(data, len, &info) == ESP_OK) {
-            camera_debug_print_frame_info(s_debug_ctx.stats.frame_count, data, len);
+            if (DEBUG_ENABLED(CAM_DEBUG_STATS) && !frame_type && info.format == IMG_FORMAT_H264) {
+                update_gop_statistics(len, info.is_keyframe);
+            }
+            if (DEBUG_ENABLED(CAM_DEBUG_HEADER)) {
+                print_header_info(s_debug_ctx.stats.frame_count, len, &info);
+            }
         }
     }
 
@@ -117,12 +212,12 @@ esp_err_t camera_debug_process_frame(const uint8_t *data, size_t len, int64_t ti
         camera_debug_hex_dump(data, dump_size, 16);
     }
 
-    // Full hex dump (use with caution!)
-    if (DEBUG_ENABLED(CAM_DEBUG_HEX_FULL)) {
-        ESP_LOGW(TAG, "=== Frame #%lu Full Hex Dump (%zu bytes) ===",
-                 s_debug_ctx.stats.frame_count, len);
-        camera_debug_hex_dump(data, len, 16);
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+    // Sampled copy, dumped later by camera_debug_capture_flush()
+    if (DEBUG_ENABLED(CAM_DEBUG_CAPTURE)) {
+        capture_frame(data, len, timestamp);
     }
+#endif
 
     // Timing information
     if (DEBUG_ENABLED(CAM_DEBUG_TIMING)) {
@@ -207,12 +302,16 @@ esp_err_t camera_debug_get_stats(camera_stats_t *stats)
     }
 
     memcpy(stats, &s_debug_ctx.stats, sizeof(camera_stats_t));
+    compute_window(esp_timer_get_time(), WINDOW_SHORT_BUCKETS, &stats->window_1s);
+    compute_window(esp_timer_get_time(), WINDOW_LONG_BUCKETS, &stats->window_10s);
     return ESP_OK;
 }
 
 void camera_debug_reset_stats(void)
 {
     memset(&s_debug_ctx.stats, 0, sizeof(camera_stats_t));
+    memset(&s_debug_ctx.gop, 0, sizeof(s_debug_ctx.gop));
+    memset(s_debug_ctx.window, 0, sizeof(s_debug_ctx.window));
     s_debug_ctx.stats.min_size = UINT32_MAX;
     s_debug_ctx.start_time = esp_timer_get_time();
     ESP_LOGI(TAG, "Statistics reset");
@@ -220,7 +319,10 @@ void camera_debug_reset_stats(void)
 
 void camera_debug_print_stats(void)
 {
-    camera_stats_t *s = &s_debug_ctx.stats;
+    camera_stats_t stats;
+    camera_stats_t *s = &stats;
+
+    camera_debug_get_stats(s);
 
     ESP_LOGI(TAG, "========== Camera Statistics ==========");
     ESP_LOGI(TAG, "Total frames:   %lu", s->frame_count);
@@ -230,6 +332,22 @@ void camera_debug_print_stats(void)
              s->min_size, s->max_size, s->avg_size);
     ESP_LOGI(TAG, "FPS:            %.2f", s->fps);
     ESP_LOGI(TAG, "Bitrate:        %.2f kbps", s->bitrate_kbps);
+    ESP_LOGI(TAG, "Last 1s:        %.2f fps, %.2f kbps, gap avg=%lu jitter=%lu max=%lu us",
+             s->window_1s.fps, s->window_1s.bitrate_kbps, s->window_1s.gap_avg_us,
+             s->window_1s.gap_stddev_us, s->window_1s.gap_max_us);
+    ESP_LOGI(TAG, "Last 10s:       %.2f fps, %.2f kbps, gap avg=%lu jitter=%lu max=%lu us",
+             s->window_10s.fps, s->window_10s.bitrate_kbps, s->window_10s.gap_avg_us,
+             s->window_10s.gap_stddev_us, s->window_10s.gap_max_us);
+    ESP_LOGI(TAG, "Stalls:         %lu, longest %lu us at %lld ms",
+             s->stall_count, s->longest_stall_us, s->longest_stall_time / 1000);
+    if (s->h264.gop_count) {
+        ESP_LOGI(TAG, "H.264 frames:   %lu I, %lu P, %lu GOPs", s->h264.i_frames, s->h264.p_frames, s->h264.gop_count);
+        ESP_LOGI(TAG, "Last GOP:       %lu frames, I=%lu, P avg=%lu max=%lu bytes",
+                 s->h264.idr_interval, s->h264.i_size, s->h264.avg_p_size, s->h264.max_p_size);
+        ESP_LOGI(TAG, "Bits/frame:     %lu, target %lu, overshoot %ld%% (worst %ld%%)",
+                 s->h264.bits_per_frame, s->h264.target_bits_per_frame,
+                 s->h264.overshoot_pct, s->h264.max_overshoot_pct);
+    }
     ESP_LOGI(TAG, "=======================================");
 }
 
@@ -241,37 +359,83 @@ void camera_debug_print_frame_info(uint32_t frame_num, const uint8_t *data, size
         return;
     }
 
-    ESP_LOGI(TAG, "=== Frame #%lu Info ===", frame_num);
-    ESP_LOGI(TAG, "Size: %zu bytes", len);
+    print_header_info(frame_num, len, &info);
+}
 
-    switch (info.format) {
-        case IMG_FORMAT_JPEG:
-            ESP_LOGI(TAG, "Format: JPEG");
-            ESP_LOGI(TAG, "Dimensions: %dx%d", info.width, info.height);
-            ESP_LOGI(TAG, "Has SOI: %s, Has EOI: %s",
-                     info.has_soi ? "Yes" : "No",
-                     info.has_eoi ? "Yes" : "No");
-            break;
+void camera_debug_set_h264_target(uint32_t bitrate, uint32_t fps)
+{
+    if (bitrate) {
+        s_debug_ctx.h264_bitrate = bitrate;
+    }
+    if (fps) {
+        s_debug_ctx.h264_fps = fps;
+    }
+}
 
-        case IMG_FORMAT_H264:
-            ESP_LOGI(TAG, "Format: H.264");
-            ESP_LOGI(TAG, "Keyframe: %s", info.is_keyframe ? "Yes" : "No");
-            ESP_LOGI(TAG, "Has SPS: %s, Has PPS: %s",
-                     info.has_sps ? "Yes" : "No",
-                     info.has_pps ? "Yes" : "No");
-            if (info.width > 0 && info.height > 0) {
-                ESP_LOGI(TAG, "Dimensions: %dx%d", info.width, info.height);
+esp_err_t camera_debug_capture_trigger(void)
+{
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+    if (!s_debug_ctx.capture.slots[0].data) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    __atomic_store_n(&s_debug_ctx.capture.trigger, true, __ATOMIC_RELAXED);
+    return ESP_OK;
+#else
+    return ESP_ERR_INVALID_STATE;
+#endif
+}
+
+void camera_debug_capture_set_path(const char *dir)
+{
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+    /* Only read by the flush, call it from the same task */
+    snprintf(s_debug_ctx.capture.path, sizeof(s_debug_ctx.capture.path), "%s", dir ? dir : "");
+#endif
+}
+
+void camera_debug_capture_flush(void)
+{
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+    capture_ring_t *ring = &s_debug_ctx.capture;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    image_header_info_t info;
+    char name[CAPTURE_PATH_MAX + 32];
+    FILE *file;
+
+    while (ring->tail != head) {
+        capture_slot_t *slot = &ring->slots[ring->tail % CAPTURE_SLOT_COUNT];
+
+        if (ring->path[0]) {
+            camera_debug_analyze_format(slot->data, slot->len, &info);
+            snprintf(name, sizeof(name), "%s/frame_%06lu.%s", ring->path, slot->frame_num,
+                     info.format == IMG_FORMAT_JPEG ? "jpg" : info.format == IMG_FORMAT_H264 ? "h264" : "bin");
+            file = fopen(name, "wb");
+            if (file) {
+                if (fwrite(slot->data, 1, slot->len, file) != slot->len) {
+                    ESP_LOGW(TAG, "Short write to %s", name);
+                }
+                fclose(file);
+                ESP_LOGI(TAG, "Frame #%lu saved to %s (%zu bytes)", slot->frame_num, name, slot->len);
+            } else {
+                ESP_LOGW(TAG, "Failed to open %s", name);
             }
-            break;
+        } else {
+            ESP_LOGW(TAG, "=== Frame #%lu Captured Hex Dump (%zu bytes, ts=%lld us) ===",
+                     slot->frame_num, slot->len, slot->timestamp);
+            camera_debug_hex_dump(slot->data, slot->len, 16);
+        }
 
-        case IMG_FORMAT_RAW:
-            ESP_LOGI(TAG, "Format: RAW/Unknown");
-            break;
+        /* Hand the slot back to the producer */
+        __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    }
 
-        default:
-            ESP_LOGI(TAG, "Format: Unknown");
-            break;
+    if (ring->skipped) {
+        ESP_LOGW(TAG, "%lu frames not captured, ring full or frame larger than %d bytes",
+                 ring->skipped, CAPTURE_SLOT_SIZE);
+        ring->skipped = 0;
     }
+#endif
 }
 
 /* ========== Private Helper Functions ========== */
@@ -287,9 +451,21 @@ static void update_statistics(size_t frame_size, int64_t timestamp)
     s->avg_size = s->total_bytes / s->frame_count;
 
     // Calculate FPS
+    uint32_t gap = 0;
     if (s->last_frame_time > 0) {
         int64_t delta = timestamp - s->last_frame_time;
         if (delta > 0) {
+            gap = MIN(delta, UINT32_MAX);
+
+            // A stall is judged against the period before it, so check ahead of the average
+            if (s->fps > 0 && gap > 2 * 1000000.0 / s->fps) {
+                s->stall_count++;
+            }
+            if (gap > s->longest_stall_us) {
+                s->longest_stall_us = gap;
+                s->longest_stall_time = timestamp;
+            }
+
             float instant_fps = 1000000.0 / delta;  // Convert us to fps
             // Exponential moving average
             s->fps = s->fps * 0.9 + instant_fps * 0.1;
@@ -297,6 +473,8 @@ static void update_statistics(size_t frame_size, int64_t timestamp)
     }
     s->last_frame_time = timestamp;
 
+    update_window(frame_size, timestamp, gap);
+
     // Calculate bitrate
     int64_t elapsed_time = timestamp - s_debug_ctx.start_time;
     if (elapsed_time > 0) {
@@ -304,6 +482,65 @@ static void update_statistics(size_t frame_size, int64_t timestamp)
     }
 }
 
+/* Account the frame in the bucket of its timestamp, gap is 0 for the first frame */
+static void update_window(size_t frame_size, int64_t timestamp, uint32_t gap)
+{
+    uint32_t index = timestamp / WINDOW_BUCKET_US;
+    window_bucket_t *b = &s_debug_ctx.window[index % WINDOW_BUCKET_COUNT];
+
+    if (b->index != index) {
+        memset(b, 0, sizeof(*b));
+        b->index = index;
+    }
+
+    b->frames++;
+    b->bytes += frame_size;
+    if (gap) {
+        b->gaps++;
+        b->gap_sum += gap;
+        b->gap_sq_sum += (uint64_t)gap * gap;
+        b->gap_max = MAX(b->gap_max, gap);
+    }
+}
+
+/* Sum the last buckets up to now, buckets the producer has not reached are stale and skipped */
+static void compute_window(int64_t now, uint32_t buckets, camera_window_stats_t *out)
+{
+    uint32_t index = now / WINDOW_BUCKET_US;
+    uint32_t frames = 0, gaps = 0, gap_max = 0;
+    uint64_t bytes = 0, gap_sum = 0, gap_sq_sum = 0;
+    int64_t span = (int64_t)(buckets - 1) * WINDOW_BUCKET_US + now % WINDOW_BUCKET_US;
+
+    memset(out, 0, sizeof(*out));
+
+    for (uint32_t i = 0; i < buckets; i++) {
+        const window_bucket_t *b = &s_debug_ctx.window[(index - i) % WINDOW_BUCKET_COUNT];
+        if (b->index != index - i) {
+            continue;
+        }
+        frames += b->frames;
+        bytes += b->bytes;
+        gaps += b->gaps;
+        gap_sum += b->gap_sum;
+        gap_sq_sum += b->gap_sq_sum;
+        gap_max = MAX(gap_max, b->gap_max);
+    }
+
+    // Window is shorter right after a reset
+    span = MIN(span, now - s_debug_ctx.start_time);
+    if (span > 0) {
+        out->fps = frames * 1000000.0f / span;
+        out->bitrate_kbps = bytes * 8000.0f / span;
+    }
+    if (gaps) {
+        double mean = (double)gap_sum / gaps;
+        double var = (double)gap_sq_sum / gaps - mean * mean;
+        out->gap_avg_us = mean;
+        out->gap_stddev_us = var > 0 ? sqrt(var) : 0;
+        out->gap_max_us = gap_max;
+    }
+}
+
 static bool is_jpeg_format(const uint8_t *data, size_t len)
 {
     if (len < 2) return false;
@@ -363,32 +600,65 @@ static esp_err_t analyze_jpeg_header(const uint8_t *data, size_t len, image_head
     return ESP_OK;
 }
 
-static esp_err_t analyze_h264_header(const uint8_t *data, size_t len, image_header_info_t *info)
+static void print_header_info(uint32_t frame_num, size_t len, const image_header_info_t *info)
 {
-    info->format = IMG_FORMAT_H264;
+    ESP_LOGI(TAG, "=== Frame #%lu Info ===", frame_num);
+    ESP_LOGI(TAG, "Size: %zu bytes", len);
 
-    size_t pos = 0;
+    switch (info->format) {
+        case IMG_FORMAT_JPEG:
+            ESP_LOGI(TAG, "Format: JPEG");
+            ESP_LOGI(TAG, "Dimensions: %dx%d", info->width, info->height);
+            ESP_LOGI(TAG, "Has SOI: %s, Has EOI: %s",
+                     info->has_soi ? "Yes" : "No",
+                     info->has_eoi ? "Yes" : "No");
+            break;
 
-    // Parse NAL units
-    while (pos < len) {
-        // Find start code
-        size_t start_code_len = 0;
-        if (pos + 3 < len && data[pos] == 0x00 && data[pos+1] == 0x00 && data[pos+2] == 0x00 && data[pos+3] == 0x01) {
-            start_code_len = 4;
-        } else if (pos + 2 < len && data[pos] == 0x00 && data[pos+1] == 0x00 && data[pos+2] == 0x01) {
-            start_code_len = 3;
-        } else {
-            pos++;
+        case IMG_FORMAT_H264:
+            ESP_LOGI(TAG, "Format: H.264");
+            ESP_LOGI(TAG, "Keyframe: %s", info->is_keyframe ? "Yes" : "No");
+            ESP_LOGI(TAG, "Has SPS: %s, Has PPS: %s",
+                     info->has_sps ? "Yes" : "No",
+                     info->has_pps ? "Yes" : "No");
+            if (info->width > 0 && info->height > 0) {
+                ESP_LOGI(TAG, "Dimensions: %dx%d", info->width, info->height);
+            }
+            break;
+
+        case IMG_FORMAT_RAW:
+            ESP_LOGI(TAG, "Format: RAW/Unknown");
+            break;
+
+        default:
+            ESP_LOGI(TAG, "Format: Unknown");
+            break;
+    }
+}
+
+/* NAL header following the next start code at or after pos, len if there is none */
+static size_t find_nal_unit(const uint8_t *data, size_t len, size_t pos)
+{
+    for (; pos + 2 < len; pos++) {
+        if (data[pos + 2] > 0x01) {
+            pos += 2;   // No start code can end in the next two bytes either
             continue;
         }
+        // A 4-byte start code matches here one byte later
+        if (data[pos] == 0x00 && data[pos + 1] == 0x00 && data[pos + 2] == 0x01) {
+            return pos + 3;
+        }
+    }
 
-        pos += start_code_len;
+    return len;
+}
 
-        if (pos >= len) break;
+static esp_err_t analyze_h264_header(const uint8_t *data, size_t len, image_header_info_t *info)
+{
+    info->format = IMG_FORMAT_H264;
 
-        // Parse NAL unit header
-        uint8_t nal_byte = data[pos];
-        uint8_t nal_type = nal_byte & 0x1F;
+    // Single forward pass, parameter sets and AUD/SEI precede the first slice
+    for (size_t pos = find_nal_unit(data, len, 0); pos < len; pos = find_nal_unit(data, len, pos + 1)) {
+        uint8_t nal_type = data[pos] & 0x1F;
 
         ESP_LOGD(TAG, "NAL unit type: %s (%d)", get_h264_nal_type_name(nal_type), nal_type);
 
@@ -404,18 +674,65 @@ static esp_err_t analyze_h264_header(const uint8_t *data, size_t len, image_head
 
             case H264_NAL_IDR_SLICE:
                 info->is_keyframe = true;
-                break;
+                return ESP_OK;
+
+            case H264_NAL_SLICE:
+            case H264_NAL_DPA:
+                // Slice data is never scanned, the frame type is known here
+                return ESP_OK;
 
             default:
                 break;
         }
-
-        pos++;
     }
 
     return ESP_OK;
 }
 
+/* Accumulate the GOP in progress, an IDR closes the previous one */
+static void update_gop_statistics(size_t frame_size, bool keyframe)
+{
+    h264_gop_stats_t *g = &s_debug_ctx.stats.h264;
+
+    if (keyframe) {
+        if (s_debug_ctx.gop.started && s_debug_ctx.gop.frames) {
+            uint32_t p_frames = s_debug_ctx.gop.frames - 1;
+
+            g->gop_count++;
+            g->idr_interval = s_debug_ctx.gop.frames;
+            g->i_size = s_debug_ctx.gop.i_size;
+            g->avg_p_size = p_frames ? s_debug_ctx.gop.p_bytes / p_frames : 0;
+            g->max_p_size = s_debug_ctx.gop.p_max;
+            g->bits_per_frame = (uint32_t)((uint64_t)s_debug_ctx.gop.bytes * 8 / s_debug_ctx.gop.frames);
+            g->target_bits_per_frame = s_debug_ctx.h264_fps ? s_debug_ctx.h264_bitrate / s_debug_ctx.h264_fps : 0;
+            if (g->target_bits_per_frame) {
+                g->overshoot_pct = (int32_t)(((int64_t)g->bits_per_frame - g->target_bits_per_frame) * 100 /
+                                             g->target_bits_per_frame);
+                if (g->gop_count == 1 || g->overshoot_pct > g->max_overshoot_pct) {
+                    g->max_overshoot_pct = g->overshoot_pct;
+                }
+            }
+        }
+
+        memset(&s_debug_ctx.gop, 0, sizeof(s_debug_ctx.gop));
+        s_debug_ctx.gop.started = true;
+        s_debug_ctx.gop.i_size = frame_size;
+        g->i_frames++;
+    } else {
+        g->p_frames++;
+        if (!s_debug_ctx.gop.started) {
+            return;
+        }
+        s_debug_ctx.gop.p_bytes += frame_size;
+        if (frame_size > s_debug_ctx.gop.p_max) {
+            s_debug_ctx.gop.p_max = frame_size;
+        }
+    }
+
+    s_debug_ctx.gop.frames++;
+    s_debug_ctx.gop.bytes += frame_size;
+}
+
 static const char *get_h264_nal_type_name(uint8_t nal_type)
 {
     switch (nal_type) {
@@ -431,3 +748,54 @@ static const char *get_h264_nal_type_name(uint8_t nal_type)
         default:                  return "UNKNOWN";
     }
 }
+
+#if CONFIG_CAMERA_DEBUG_CAPTURE
+/* Slots are carved out of one PSRAM block, kept for the lifetime of the module */
+static esp_err_t capture_init(void)
+{
+    capture_ring_t *ring = &s_debug_ctx.capture;
+    uint8_t *block;
+
+    block = memstat_malloc(MEMSTAT_DEBUG, (size_t)CAPTURE_SLOT_COUNT * CAPTURE_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+    if (!block) {
+        ESP_LOGE(TAG, "Failed to allocate %d capture slots of %d bytes", CAPTURE_SLOT_COUNT, CAPTURE_SLOT_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < CAPTURE_SLOT_COUNT; i++) {
+        ring->slots[i].data = block + (size_t)i * CAPTURE_SLOT_SIZE;
+    }
+    camera_debug_capture_set_path(CONFIG_CAMERA_DEBUG_CAPTURE_PATH);
+
+    ESP_LOGI(TAG, "Frame capture: every %d frames, %d slots of %d bytes", CAPTURE_INTERVAL,
+             CAPTURE_SLOT_COUNT, CAPTURE_SLOT_SIZE);
+    return ESP_OK;
+}
+
+/* Runs on the streaming path, costs one memcpy for a sampled frame and nothing otherwise */
+static void capture_frame(const uint8_t *data, size_t len, int64_t timestamp)
+{
+    capture_ring_t *ring = &s_debug_ctx.capture;
+    capture_slot_t *slot;
+    bool sampled = CAPTURE_INTERVAL && s_debug_ctx.stats.frame_count % CAPTURE_INTERVAL == 0;
+
+    if (!sampled && !__atomic_exchange_n(&ring->trigger, false, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    if (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= CAPTURE_SLOT_COUNT ||
+            len > CAPTURE_SLOT_SIZE) {
+        ring->skipped++;
+        return;
+    }
+
+    slot = &ring->slots[ring->head % CAPTURE_SLOT_COUNT];
+    memcpy(slot->data, data, len);
+    slot->len = len;
+    slot->frame_num = s_debug_ctx.stats.frame_count;
+    slot->timestamp = timestamp;
+
+    /* Publish the slot to the flush */
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+#endif
@@ -3,6 +3,7 @@
  *
  * Provides debugging utilities for camera data analysis including:
  * - Hex dump of raw frame data
+ * - Sampled frame capture into a PSRAM ring, dumped off the streaming path
  * - Image format analysis (JPEG/H264 headers)
  * - Frame statistics (FPS, bitrate, size)
  * - Performance monitoring
@@ -25,11 +26,35 @@ typedef enum {
     CAM_DEBUG_STATS       = 0x01,  // Show frame statistics
     CAM_DEBUG_HEADER      = 0x02,  // Show image format headers
     CAM_DEBUG_HEX_HEADER  = 0x04,  // Hex dump of first bytes
-    CAM_DEBUG_HEX_FULL    = 0x08,  // Full hex dump (memory intensive!)
+    CAM_DEBUG_CAPTURE     = 0x08,  // Copy sampled frames to the capture ring
     CAM_DEBUG_TIMING      = 0x10,  // Show timing information
     CAM_DEBUG_ALL         = 0xFF
 } camera_debug_level_t;
 
+/* H.264 statistics, GOP fields describe the last completed GOP (IDR to IDR) */
+typedef struct {
+    uint32_t i_frames;              // IDR frames since reset
+    uint32_t p_frames;              // Non-IDR frames since reset
+    uint32_t gop_count;             // Completed GOPs since reset
+    uint32_t idr_interval;          // Frames in the last GOP
+    uint32_t i_size;                // IDR frame size in bytes
+    uint32_t avg_p_size;            // Mean non-IDR frame size in bytes
+    uint32_t max_p_size;
+    uint32_t bits_per_frame;        // Mean over the GOP
+    uint32_t target_bits_per_frame; // Configured bitrate / frame rate, 0 if not set
+    int32_t overshoot_pct;          // bits_per_frame above target in percent, negative if below
+    int32_t max_overshoot_pct;      // Worst GOP since reset
+} h264_gop_stats_t;
+
+/* Frame pacing over a sliding window, the gaps are between frame timestamps */
+typedef struct {
+    float fps;
+    float bitrate_kbps;
+    uint32_t gap_avg_us;
+    uint32_t gap_stddev_us;         // Jitter
+    uint32_t gap_max_us;
+} camera_window_stats_t;
+
 /* Frame statistics */
 typedef struct {
     uint32_t frame_count;
@@ -41,6 +66,12 @@ typedef struct {
     float bitrate_kbps;
     int64_t last_frame_time;
     uint32_t dropped_frames;
+    camera_window_stats_t window_1s;    // Filled by camera_debug_get_stats()
+    camera_window_stats_t window_10s;
+    uint32_t longest_stall_us;      // Largest frame gap since reset
+    int64_t longest_stall_time;     // Timestamp of the frame which ended it
+    uint32_t stall_count;           // Gaps above twice the average frame period
+    h264_gop_stats_t h264;
 } camera_stats_t;
 
 /* Image format types */
@@ -92,9 +123,10 @@ uint32_t camera_debug_get_level(void);
  * @param data Frame data buffer
  * @param len Frame data length
  * @param timestamp Frame timestamp (microseconds)
+ * @param flags V4L2_BUF_FLAG_KEYFRAME/PFRAME/BFRAME from DQBUF, 0 to classify the frame from its header
  * @return ESP_OK on success
  */
-esp_err_t camera_debug_process_frame(const uint8_t *data, size_t len, int64_t timestamp);
+esp_err_t camera_debug_process_frame(const uint8_t *data, size_t len, int64_t timestamp, uint32_t flags);
 
 /**
  * @brief Print hex dump of data
@@ -133,6 +165,37 @@ void camera_debug_reset_stats(void);
  */
 void camera_debug_print_stats(void);
 
+/**
+ * @brief Set the H.264 rate control target the GOP statistics are compared with
+ *
+ * @param bitrate Encoder bitrate in bits per second, 0 keeps the current value
+ * @param fps Stream frame rate, 0 keeps the current value
+ */
+void camera_debug_set_h264_target(uint32_t bitrate, uint32_t fps);
+
+/**
+ * @brief Capture the next processed frame, whatever the capture interval
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if capture is not enabled
+ */
+esp_err_t camera_debug_capture_trigger(void);
+
+/**
+ * @brief Set the directory captured frames are written to
+ *
+ * @param dir Mounted VFS directory, e.g. an SD card, NULL or "" to hex dump to the log instead
+ */
+void camera_debug_capture_set_path(const char *dir);
+
+/**
+ * @brief Write out and release all captured frames
+ *
+ * Slow, it dumps whole frames, so call it from a low priority task.
+ */
+void camera_debug_capture_flush(void);
+
 /**
  * @brief Print detailed frame information
  *
@@ -0,0 +1,220 @@
+/*
+ * Deferred Log - Per-core record rings and the drain task
+ *
+ * Each core writes only its own ring and the drain task is the only reader,
+ * so a ring is single producer, single consumer. The producer masks the
+ * interrupts of its core while it fills a slot, that keeps tasks and ISRs of
+ * the same core from interleaving and the task from migrating. head and tail
+ * run free, the slot is index % DLOG_RING_RECORDS.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "dlog.h"
+
+#define DLOG_RING_RECORDS       CONFIG_DLOG_RING_RECORDS
+#define DLOG_DRAIN_PERIOD_MS    CONFIG_DLOG_DRAIN_PERIOD_MS
+#define DLOG_LINE_MAX           256
+#define DLOG_SPEC_MAX           16
+
+_Static_assert((DLOG_RING_RECORDS & (DLOG_RING_RECORDS - 1)) == 0, "Ring size must be a power of 2");
+
+typedef struct {
+    const char *tag;
+    const char *fmt;
+    int64_t time;                       // esp_timer time of the call
+    uint8_t level;
+    uint8_t nargs;
+    uint64_t args[DLOG_MAX_ARGS];
+} dlog_entry_st;
+
+typedef struct {
+    uint32_t head;                      // Written by the producer core only
+    uint32_t tail;                      // Written by the drain task only
+    uint32_t dropped;                   // Written by the producer core only
+    dlog_entry_st entries[DLOG_RING_RECORDS];
+} dlog_ring_st;
+
+static const char *TAG = "dlog";
+
+esp_log_level_t g_dlog_level = CONFIG_LOG_MAXIMUM_LEVEL;
+
+static dlog_ring_st s_dlog_rings[portNUM_PROCESSORS];
+static uint32_t s_dlog_records;
+
+void dlog_record(esp_log_level_t level, const char *tag, const char *fmt, uint32_t nargs, const uint64_t *args)
+{
+    int64_t now = esp_timer_get_time();
+    UBaseType_t state;
+    dlog_ring_st *ring;
+    dlog_entry_st *entry;
+
+    state = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    ring = &s_dlog_rings[esp_cpu_get_core_id()];
+    if (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= DLOG_RING_RECORDS) {
+        ring->dropped++;
+    } else {
+        entry = &ring->entries[ring->head % DLOG_RING_RECORDS];
+        entry->tag = tag;
+        entry->fmt = fmt;
+        entry->time = now;
+        entry->level = level;
+        entry->nargs = nargs;
+        for (uint32_t i = 0; i < nargs; i++) {
+            entry->args[i] = args[i];
+        }
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+void dlog_set_level(esp_log_level_t level)
+{
+    g_dlog_level = level;
+}
+
+void dlog_get_stats(dlog_stats_st *ret_stats)
+{
+    ret_stats->records = s_dlog_records;
+    ret_stats->dropped = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        ret_stats->dropped += s_dlog_rings[core].dropped;
+    }
+}
+
+/* Append one conversion, spec is a complete printf conversion of a single argument */
+static int dlog_format_arg(char *out, size_t size, const char *spec, char conv, int length, uint64_t arg)
+{
+    double d;
+
+    switch (conv) {
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        memcpy(&d, &arg, sizeof(d));
+        return snprintf(out, size, spec, d);
+    case 's':
+        return snprintf(out, size, spec, arg ? (const char *)(uintptr_t)arg : "(null)");
+    case 'p':
+        return snprintf(out, size, spec, (void *)(uintptr_t)arg);
+    default:
+        /* Integer conversions, 'l' and 'z' are long sized, 'll' and 'j' 64-bit */
+        if (length == 2) {
+            return snprintf(out, size, spec, (long long)arg);
+        } else if (length == 1) {
+            return snprintf(out, size, spec, (long)arg);
+        }
+        return snprintf(out, size, spec, (int)arg);
+    }
+}
+
+/* printf of a record, the format is walked one conversion at a time with its argument slot */
+static void dlog_format(char *out, size_t size, const dlog_entry_st *entry)
+{
+    const char *p = entry->fmt;
+    char spec[DLOG_SPEC_MAX];
+    size_t len = 0;
+    uint32_t arg = 0;
+    int length;
+    int n;
+
+    while (*p && len < size - 1) {
+        const char *start = p;
+
+        if (*p != '%' || p[1] == '%') {
+            out[len++] = *p;
+            p += *p == '%' ? 2 : 1;
+            continue;
+        }
+
+        p++;
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789.");
+        length = 0;
+        while (*p && strchr("hlLqjzt", *p)) {
+            length = (*p == 'j' || *p == 'q' || (*p == 'l' && length == 1)) ? 2 :
+                     (*p == 'l' || *p == 'z' || *p == 't') ? MAX(length, 1) : length;
+            p++;
+        }
+        if (!*p || (size_t)(p - start + 1) >= sizeof(spec) || arg >= entry->nargs) {
+            /* Bad conversion or missing argument, printed as is */
+            n = snprintf(out + len, size - len, "%.*s", (int)(p - start + (*p ? 1 : 0)), start);
+        } else {
+            memcpy(spec, start, p - start + 1);
+            spec[p - start + 1] = '\0';
+            n = dlog_format_arg(out + len, size - len, spec, *p, length, entry->args[arg++]);
+        }
+        if (*p) {
+            p++;
+        }
+        if (n > 0) {
+            len = MIN(len + n, size - 1);
+        }
+    }
+    out[len] = '\0';
+}
+
+static const char dlog_letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+
+static void dlog_print(const dlog_entry_st *entry)
+{
+    static char line[DLOG_LINE_MAX];
+
+    dlog_format(line, sizeof(line), entry);
+    esp_log_write(entry->level, entry->tag, "%c (%lld) %s: %s\n", dlog_letters[MIN(entry->level, ESP_LOG_VERBOSE)],
+                  entry->time / 1000, entry->tag, line);
+    s_dlog_records++;
+}
+
+/* Ring with the oldest pending record, -1 if all are empty */
+static int dlog_oldest(void)
+{
+    int oldest = -1;
+    int64_t time = INT64_MAX;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        dlog_ring_st *ring = &s_dlog_rings[core];
+
+        if (ring->tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) &&
+                ring->entries[ring->tail % DLOG_RING_RECORDS].time < time) {
+            time = ring->entries[ring->tail % DLOG_RING_RECORDS].time;
+            oldest = core;
+        }
+    }
+
+    return oldest;
+}
+
+void dlog_drain_task(void *arg)
+{
+    dlog_entry_st entry;
+    uint32_t dropped = 0;
+    dlog_stats_st stats;
+    int core;
+
+    ESP_LOGI(TAG, "Deferred log drain started on core %d", xPortGetCoreID());
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_PERIOD_MS));
+
+        /* Both cores log into their own ring, merged in time order */
+        while ((core = dlog_oldest()) >= 0) {
+            dlog_ring_st *ring = &s_dlog_rings[core];
+
+            entry = ring->entries[ring->tail % DLOG_RING_RECORDS];
+            __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+            dlog_print(&entry);
+        }
+
+        dlog_get_stats(&stats);
+        if (stats.dropped != dropped) {
+            ESP_LOGW(TAG, "%lu records dropped, raise CONFIG_DLOG_RING_RECORDS", stats.dropped - dropped);
+            dropped = stats.dropped;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * Deferred Log - Logging for hot paths, formatted off the calling task
+ *
+ * DLOGE/W/I/D/V take the arguments of ESP_LOGx. With CONFIG_DLOG_ENABLE a
+ * call only stores the format pointer, the tag, a timestamp and the raw
+ * arguments in a ring of the calling core, with the interrupts of that core
+ * masked for the copy. No lock is shared between cores. The drain task formats
+ * the records of both cores in time order and writes them with esp_log_write(),
+ * so per-tag log levels still apply. Without CONFIG_DLOG_ENABLE the macros are
+ * ESP_LOGx.
+ *
+ * Rules for the arguments, they are read when the record is printed:
+ * - at most DLOG_MAX_ARGS, no '*' width or precision
+ * - %s strings must outlive the record, e.g. literals, never stack buffers
+ * - %p pointers are passed as void *
+ * A full ring drops new records, the drain task reports how many.
+ */
+
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DLOG_MAX_ARGS   6
+
+#if CONFIG_DLOG_ENABLE
+
+/* Records below this level are not stored, LOG_LOCAL_LEVEL and the tag level still apply */
+extern esp_log_level_t g_dlog_level;
+
+/* Counters since boot */
+typedef struct {
+    uint32_t records;                   // Records printed
+    uint32_t dropped;                   // Records lost to a full ring
+} dlog_stats_st;
+
+void dlog_record(esp_log_level_t level, const char *tag, const char *fmt, uint32_t nargs, const uint64_t *args);
+
+/* Set the lowest level stored, e.g. ESP_LOG_INFO to make DLOGD free at runtime */
+void dlog_set_level(esp_log_level_t level);
+
+void dlog_get_stats(dlog_stats_st *ret_stats);
+
+/* Drain task entry, created from the OS task table */
+void dlog_drain_task(void *arg);
+
+/* Arguments are kept as 64-bit slots, floating point as double bits */
+static inline uint64_t dlog_arg_double(double v)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static inline uint64_t dlog_arg_u64(unsigned long long v)
+{
+    return v;
+}
+
+static inline uint64_t dlog_arg_ptr(const void *v)
+{
+    return (uintptr_t)v;
+}
+
+static inline uint64_t dlog_arg_word(uintptr_t v)
+{
+    return v;
+}
+
+#define DLOG_ARG(x) _Generic((x),                                   \
+    float: dlog_arg_double, double: dlog_arg_double,                \
+    long long: dlog_arg_u64, unsigned long long: dlog_arg_u64,      \
+    char *: dlog_arg_ptr, const char *: dlog_arg_ptr,               \
+    void *: dlog_arg_ptr, const void *: dlog_arg_ptr,               \
+    default: dlog_arg_word)(x)
+
+#define DLOG_NARGS(...)     DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...)     n
+
+#define DLOG_CAT(a, b)      DLOG_CAT_(a, b)
+#define DLOG_CAT_(a, b)     a##b
+#define DLOG_MAP0(...)
+#define DLOG_MAP1(a)        DLOG_ARG(a)
+#define DLOG_MAP2(a, ...)   DLOG_ARG(a), DLOG_MAP1(__VA_ARGS__)
+#define DLOG_MAP3(a, ...)   DLOG_ARG(a), DLOG_MAP2(__VA_ARGS__)
+#define DLOG_MAP4(a, ...)   DLOG_ARG(a), DLOG_MAP3(__VA_ARGS__)
+#define DLOG_MAP5(a, ...)   DLOG_ARG(a), DLOG_MAP4(__VA_ARGS__)
+#define DLOG_MAP6(a, ...)   DLOG_ARG(a), DLOG_MAP5(__VA_ARGS__)
+
+/* Slot 0 keeps the array non-empty without arguments */
+#define DLOG_LEVEL(level, tag, format, ...) do {                                                    \
+        if (LOG_LOCAL_LEVEL >= (level) && g_dlog_level >= (level)) {                            \
+            const uint64_t dlog_args_[] = {                                                     \
+                0, DLOG_CAT(DLOG_MAP, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)                     \
+            };                                                                                  \
+            dlog_record((level), (tag), (format), DLOG_NARGS(__VA_ARGS__), dlog_args_ + 1);     \
+        }                                                                                       \
+    } while (0)
+
+#define DLOGE(tag, format, ...)     DLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...)     DLOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...)     DLOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...)     DLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...)     DLOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#else
+
+#define DLOGE(tag, format, ...)     ESP_LOGE(tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...)     ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...)     ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...)     ESP_LOGD(tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...)     ESP_LOGV(tag, format, ##__VA_ARGS__)
+
+#endif /* CONFIG_DLOG_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DLOG_H */
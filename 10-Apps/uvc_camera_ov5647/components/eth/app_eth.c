@@ -0,0 +1,85 @@
+/*
+ * App Ethernet
+ *
+ * Brings up the on-chip Ethernet MAC with its IP101 PHY for the network
+ * sinks, see app_eth.h.
+ */
+
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_eth.h"
+#include "esp_event.h"
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "app_eth.h"
+
+#define ETH_TAG     "eth"
+
+static struct {
+    bool started;
+    esp_err_t result;       /* Of the first start, returned to every caller */
+    esp_eth_handle_t eth;
+    esp_netif_t *netif;
+} s_eth_ctx;
+
+static esp_err_t eth_init(void)
+{
+    esp_err_t ret;
+    esp_eth_mac_t *mac;
+    esp_eth_phy_t *phy;
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    eth_esp32_emac_config_t emac_config = ETH_ESP32_EMAC_DEFAULT_CONFIG();
+    esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_ETH();
+
+    phy_config.phy_addr = CONFIG_EXAMPLE_ETH_PHY_ADDR;
+    phy_config.reset_gpio_num = CONFIG_EXAMPLE_ETH_PHY_RST_GPIO;
+    emac_config.smi_gpio.mdc_num = CONFIG_EXAMPLE_ETH_MDC_GPIO;
+    emac_config.smi_gpio.mdio_num = CONFIG_EXAMPLE_ETH_MDIO_GPIO;
+
+    mac = esp_eth_mac_new_esp32(&emac_config, &mac_config);
+    phy = esp_eth_phy_new_ip101(&phy_config);
+    APP_RETURN_ON_FALSE(mac && phy, ESP_FAIL, ETH_TAG, "Failed to create Ethernet MAC or PHY");
+
+    esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(mac, phy);
+    APP_RETURN_ON_ERROR(esp_eth_driver_install(&eth_config, &s_eth_ctx.eth), ETH_TAG,
+                        "Failed to install Ethernet driver");
+
+    APP_RETURN_ON_ERROR(esp_netif_init(), ETH_TAG, "Failed to initialize esp-netif");
+    ret = esp_event_loop_create_default();
+    APP_RETURN_ON_FALSE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE, ret, ETH_TAG,
+                        "Failed to create the default event loop");
+
+    s_eth_ctx.netif = esp_netif_new(&netif_config);
+    APP_RETURN_ON_FALSE(s_eth_ctx.netif, ESP_ERR_NO_MEM, ETH_TAG, "Failed to create Ethernet netif");
+    APP_RETURN_ON_ERROR(esp_netif_attach(s_eth_ctx.netif, esp_eth_new_netif_glue(s_eth_ctx.eth)), ETH_TAG,
+                        "Failed to attach Ethernet to netif");
+
+    return esp_eth_start(s_eth_ctx.eth);
+}
+
+esp_err_t app_eth_start(void)
+{
+    memstat_snap_st snap;
+
+    if (s_eth_ctx.started) {
+        return s_eth_ctx.result;
+    }
+    s_eth_ctx.started = true;
+
+    /* The driver and lwIP allocate on their own, their footprint is what the init took */
+    memstat_snapshot(&snap);
+    s_eth_ctx.result = eth_init();
+    memstat_claim(MEMSTAT_NET, &snap);
+
+    if (s_eth_ctx.result == ESP_OK) {
+        ESP_LOGI(ETH_TAG, "Ethernet started, waiting for DHCP");
+    }
+
+    return s_eth_ctx.result;
+}
+
+esp_eth_handle_t app_eth_get_handle(void)
+{
+    return s_eth_ctx.started && s_eth_ctx.result == ESP_OK ? s_eth_ctx.eth : NULL;
+}
@@ -0,0 +1,43 @@
+/*
+ * App Ethernet - On-chip Ethernet MAC with its IP101 PHY
+ *
+ * The network sinks (RTSP, MJPEG over HTTP) and PTP share one Ethernet
+ * interface.
+ * The first of them to start it installs the driver and the netif, the
+ * others get the result of that start. The address comes from DHCP, each
+ * sink logs its URL with an IP_EVENT_ETH_GOT_IP handler of its own.
+ */
+
+#ifndef APP_ETH_H
+#define APP_ETH_H
+
+#include "esp_err.h"
+#include "esp_eth_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start the Ethernet interface, once
+ *
+ * Called from the init phases, which run one after the other.
+ *
+ * @return
+ *      - ESP_OK once the interface is started
+ *      - Others if the driver or the netif can't be set up, every call returns it
+ */
+esp_err_t app_eth_start(void);
+
+/**
+ * @brief Driver handle of the started interface, e.g. for its MAC clock
+ *
+ * @return The handle, NULL unless app_eth_start() succeeded
+ */
+esp_eth_handle_t app_eth_get_handle(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_ETH_H */
@@ -0,0 +1,136 @@
+/*
+ * Memory Stat - Heap usage per subsystem
+ *
+ * The major allocators of the project allocate through memstat_*() with the
+ * subsystem the memory belongs to. With CONFIG_MEMSTAT_ENABLE each subsystem
+ * counts its current and peak bytes, split by where the block landed,
+ * internal RAM or PSRAM. Sizes are the heap block sizes, alignment padding
+ * included. Without CONFIG_MEMSTAT_ENABLE the calls are heap_caps_*().
+ *
+ * Components allocating inside their own library, TinyUSB and lwIP, are
+ * measured as the heap their init took, see memstat_claim().
+ *
+ * A block must be freed with the subsystem it was allocated with.
+ */
+
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_heap_caps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    MEMSTAT_VIDEO_BUF = 0,              // V4L2 buffer queues of the video devices
+    MEMSTAT_VIDEO_DEV,                  // Working memory of the video devices
+    MEMSTAT_FRAME,                      // Application frame buffers
+    MEMSTAT_UVC,                        // UVC transfer and still capture buffers
+    MEMSTAT_PROC,                       // OSD, TNR, motion, scan and inference buffers
+    MEMSTAT_RECORDER,                   // SD card write ring
+    MEMSTAT_DEBUG,                      // Camera debug capture slots
+    MEMSTAT_USB,                        // TinyUSB and the UVC device, measured at init
+    MEMSTAT_NET,                        // Ethernet and lwIP, measured at init
+    MEMSTAT_MAX,
+} memstat_sys_t;
+
+typedef enum {
+    MEMSTAT_CLASS_INTERNAL = 0,
+    MEMSTAT_CLASS_PSRAM,
+    MEMSTAT_CLASS_MAX,
+} memstat_class_t;
+
+/* Bytes of one subsystem */
+typedef struct {
+    uint32_t current[MEMSTAT_CLASS_MAX];
+    uint32_t peak[MEMSTAT_CLASS_MAX];
+} memstat_usage_st;
+
+/* Free heap at a point in time, see memstat_claim() */
+typedef struct {
+    uint32_t free[MEMSTAT_CLASS_MAX];
+} memstat_snap_st;
+
+#if CONFIG_MEMSTAT_ENABLE
+
+void *memstat_malloc(memstat_sys_t sys, size_t size, uint32_t caps);
+
+void *memstat_calloc(memstat_sys_t sys, size_t n, size_t size, uint32_t caps);
+
+void *memstat_aligned_alloc(memstat_sys_t sys, size_t align, size_t size, uint32_t caps);
+
+void *memstat_aligned_calloc(memstat_sys_t sys, size_t align, size_t n, size_t size, uint32_t caps);
+
+void *memstat_realloc(memstat_sys_t sys, void *ptr, size_t size, uint32_t caps);
+
+/* NULL is ignored */
+void memstat_free(memstat_sys_t sys, void *ptr);
+
+void memstat_snapshot(memstat_snap_st *ret_snap);
+
+/*
+ * Charge the heap taken since the snapshot to sys for good, around the init
+ * of a library which allocates on its own. Allocations of other tasks
+ * meanwhile are charged too, so take both sides in a quiet part of the boot.
+ */
+void memstat_claim(memstat_sys_t sys, const memstat_snap_st *snap);
+
+void memstat_get(memstat_sys_t sys, memstat_usage_st *ret_usage);
+
+/* Usage per subsystem, then free, largest free block and low water mark of the internal, PSRAM and DMA heaps */
+void memstat_dump(const char *tag);
+
+#else
+
+static inline void *memstat_malloc(memstat_sys_t sys, size_t size, uint32_t caps)
+{
+    return heap_caps_malloc(size, caps);
+}
+
+static inline void *memstat_calloc(memstat_sys_t sys, size_t n, size_t size, uint32_t caps)
+{
+    return heap_caps_calloc(n, size, caps);
+}
+
+static inline void *memstat_aligned_alloc(memstat_sys_t sys, size_t align, size_t size, uint32_t caps)
+{
+    return heap_caps_aligned_alloc(align, size, caps);
+}
+
+static inline void *memstat_aligned_calloc(memstat_sys_t sys, size_t align, size_t n, size_t size, uint32_t caps)
+{
+    return heap_caps_aligned_calloc(align, n, size, caps);
+}
+
+static inline void *memstat_realloc(memstat_sys_t sys, void *ptr, size_t size, uint32_t caps)
+{
+    return heap_caps_realloc(ptr, size, caps);
+}
+
+static inline void memstat_free(memstat_sys_t sys, void *ptr)
+{
+    heap_caps_free(ptr);
+}
+
+static inline void memstat_snapshot(memstat_snap_st *ret_snap)
+{
+}
+
+static inline void memstat_claim(memstat_sys_t sys, const memstat_snap_st *snap)
+{
+}
+
+static inline void memstat_dump(const char *tag)
+{
+}
+
+#endif /* CONFIG_MEMSTAT_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMSTAT_H */
@@ -0,0 +1,189 @@
+/*
+ * Memory Stat - Counters per subsystem and the heap report
+ *
+ * The counters are updated in a short critical section next to the heap call,
+ * which takes a lock of its own anyway. None of the tagged allocators is on
+ * the per-frame path.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_memory_utils.h"
+#endif
+#include "memstat.h"
+
+static const char *s_memstat_names[MEMSTAT_MAX] = {
+    [MEMSTAT_VIDEO_BUF] = "video_buf",
+    [MEMSTAT_VIDEO_DEV] = "video_dev",
+    [MEMSTAT_FRAME]     = "frame",
+    [MEMSTAT_UVC]       = "uvc",
+    [MEMSTAT_PROC]      = "proc",
+    [MEMSTAT_RECORDER]  = "recorder",
+    [MEMSTAT_DEBUG]     = "debug",
+    [MEMSTAT_USB]       = "usb",
+    [MEMSTAT_NET]       = "net",
+};
+
+static portMUX_TYPE s_memstat_lock = portMUX_INITIALIZER_UNLOCKED;
+static memstat_usage_st s_memstat[MEMSTAT_MAX];
+
+static memstat_class_t memstat_class(const void *ptr)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    /* The host heap, see the linux target of the video component */
+    return MEMSTAT_CLASS_INTERNAL;
+#else
+    return esp_ptr_external_ram(ptr) ? MEMSTAT_CLASS_PSRAM : MEMSTAT_CLASS_INTERNAL;
+#endif
+}
+
+static void memstat_add(memstat_sys_t sys, memstat_class_t cls, uint32_t size)
+{
+    memstat_usage_st *usage = &s_memstat[sys];
+
+    portENTER_CRITICAL(&s_memstat_lock);
+    usage->current[cls] += size;
+    usage->peak[cls] = MAX(usage->peak[cls], usage->current[cls]);
+    portEXIT_CRITICAL(&s_memstat_lock);
+}
+
+static void *memstat_track(memstat_sys_t sys, void *ptr)
+{
+    if (ptr && sys < MEMSTAT_MAX) {
+        memstat_add(sys, memstat_class(ptr), heap_caps_get_allocated_size(ptr));
+    }
+
+    return ptr;
+}
+
+void *memstat_malloc(memstat_sys_t sys, size_t size, uint32_t caps)
+{
+    return memstat_track(sys, heap_caps_malloc(size, caps));
+}
+
+void *memstat_calloc(memstat_sys_t sys, size_t n, size_t size, uint32_t caps)
+{
+    return memstat_track(sys, heap_caps_calloc(n, size, caps));
+}
+
+void *memstat_aligned_alloc(memstat_sys_t sys, size_t align, size_t size, uint32_t caps)
+{
+    return memstat_track(sys, heap_caps_aligned_alloc(align, size, caps));
+}
+
+void *memstat_aligned_calloc(memstat_sys_t sys, size_t align, size_t n, size_t size, uint32_t caps)
+{
+    return memstat_track(sys, heap_caps_aligned_calloc(align, n, size, caps));
+}
+
+static void memstat_untrack(memstat_sys_t sys, void *ptr)
+{
+    memstat_class_t cls;
+    uint32_t size;
+
+    if (!ptr || sys >= MEMSTAT_MAX) {
+        return;
+    }
+
+    cls = memstat_class(ptr);
+    size = heap_caps_get_allocated_size(ptr);
+
+    portENTER_CRITICAL(&s_memstat_lock);
+    s_memstat[sys].current[cls] -= MIN(size, s_memstat[sys].current[cls]);
+    portEXIT_CRITICAL(&s_memstat_lock);
+}
+
+void *memstat_realloc(memstat_sys_t sys, void *ptr, size_t size, uint32_t caps)
+{
+    void *new_ptr;
+
+    /* Counted as a free and an allocation, so the peak may miss a moment with both blocks */
+    memstat_untrack(sys, ptr);
+    new_ptr = heap_caps_realloc(ptr, size, caps);
+    if (!new_ptr && size) {
+        /* The old block is still allocated */
+        memstat_track(sys, ptr);
+        return NULL;
+    }
+
+    return memstat_track(sys, new_ptr);
+}
+
+void memstat_free(memstat_sys_t sys, void *ptr)
+{
+    memstat_untrack(sys, ptr);
+    heap_caps_free(ptr);
+}
+
+void memstat_snapshot(memstat_snap_st *ret_snap)
+{
+    ret_snap->free[MEMSTAT_CLASS_INTERNAL] = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    ret_snap->free[MEMSTAT_CLASS_PSRAM] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+void memstat_claim(memstat_sys_t sys, const memstat_snap_st *snap)
+{
+    memstat_snap_st now;
+
+    if (sys >= MEMSTAT_MAX) {
+        return;
+    }
+
+    memstat_snapshot(&now);
+    for (int cls = 0; cls < MEMSTAT_CLASS_MAX; cls++) {
+        if (snap->free[cls] > now.free[cls]) {
+            memstat_add(sys, cls, snap->free[cls] - now.free[cls]);
+        }
+    }
+}
+
+void memstat_get(memstat_sys_t sys, memstat_usage_st *ret_usage)
+{
+    if (sys >= MEMSTAT_MAX) {
+        memset(ret_usage, 0, sizeof(*ret_usage));
+        return;
+    }
+
+    portENTER_CRITICAL(&s_memstat_lock);
+    *ret_usage = s_memstat[sys];
+    portEXIT_CRITICAL(&s_memstat_lock);
+}
+
+/* Free memory outside the largest block, what a big allocation can't use */
+static void memstat_dump_heap(const char *tag, const char *name, uint32_t caps)
+{
+    multi_heap_info_t info;
+
+    heap_caps_get_info(&info, caps);
+    if (!info.total_free_bytes && !info.total_allocated_bytes) {
+        return;
+    }
+
+    ESP_LOGI(tag, "  %-9s free %8u  largest %8u  min %8u  frag %5.1f%%", name,
+             info.total_free_bytes, info.largest_free_block, info.minimum_free_bytes,
+             info.total_free_bytes ? 100.0 - info.largest_free_block * 100.0 / info.total_free_bytes : 0.0);
+}
+
+void memstat_dump(const char *tag)
+{
+    memstat_usage_st usage;
+
+    ESP_LOGI(tag, "Memory by subsystem, KB now/peak:");
+    for (int sys = 0; sys < MEMSTAT_MAX; sys++) {
+        memstat_get(sys, &usage);
+        if (!usage.peak[MEMSTAT_CLASS_INTERNAL] && !usage.peak[MEMSTAT_CLASS_PSRAM]) {
+            continue;
+        }
+        ESP_LOGI(tag, "  %-9s internal %7.1f/%7.1f  psram %8.1f/%8.1f", s_memstat_names[sys],
+                 usage.current[MEMSTAT_CLASS_INTERNAL] / 1024.0, usage.peak[MEMSTAT_CLASS_INTERNAL] / 1024.0,
+                 usage.current[MEMSTAT_CLASS_PSRAM] / 1024.0, usage.peak[MEMSTAT_CLASS_PSRAM] / 1024.0);
+    }
+
+    ESP_LOGI(tag, "Heap map, bytes:");
+    memstat_dump_heap(tag, "internal", MALLOC_CAP_INTERNAL);
+    memstat_dump_heap(tag, "psram", MALLOC_CAP_SPIRAM);
+    memstat_dump_heap(tag, "dma", MALLOC_CAP_DMA);
+}
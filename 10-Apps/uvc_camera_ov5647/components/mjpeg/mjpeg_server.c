@@ -0,0 +1,531 @@
+/*
+ * MJPEG Server Task
+ *
+ * Responsibilities:
+ * - Start the shared Ethernet interface, see app_eth.h
+ * - Receive the primary encoder output as a drop-oldest sink and keep the
+ *   newest frame
+ * - Accept HTTP clients on CONFIG_EXAMPLE_MJPEG_PORT and hand each one to a
+ *   client task, which serves /stream, /snapshot.jpg or the index page
+ *
+ * The server holds one reference to the newest frame. A client task takes a
+ * reference of its own to the frame it sends and sends the part header, the
+ * JPEG and the part trailer with one sendmsg() straight from the encoder
+ * buffer. lwIP copies the data into its TCP segments once, the frame is never
+ * copied before and all clients send the one encode. Once a client is done
+ * with a frame it goes on with the newest one, the frames encoded meanwhile
+ * are skipped for that client only.
+ *
+ * Halting the pipeline waits for its frames to be released. The server drops
+ * the newest frame as soon as the pipeline stops, a client finishes the frame
+ * it is sending or is dropped after CONFIG_EXAMPLE_MJPEG_SEND_TIMEOUT_MS.
+ *
+ * With CONFIG_EXAMPLE_PTP each JPEG is sent with the network time of its
+ * capture in an X-Timestamp header (seconds.nanoseconds, PTP timescale) while
+ * the board is synchronized to a master.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "lwip/sockets.h"
+#include "uvc_app_common.h"
+#include "os_interface.h"
+#include "app_eth.h"
+#include "app_ptp.h"
+
+#define MJPEG_TAG                   "mjpeg"
+#define MJPEG_REQUEST_MAX           512
+#define MJPEG_HEADER_MAX            192
+#define MJPEG_POLL_MS               100     /* Frame and accept wait, shutdown is seen within it */
+#define MJPEG_REQUEST_TIMEOUT_MS    2000
+#define MJPEG_SNAPSHOT_WAIT_MS      3000    /* First frame of a camera started for the snapshot */
+#define MJPEG_CLIENT_STACK          (3 * 1024)
+#define MJPEG_BOUNDARY              "frame"
+
+static const char MJPEG_STREAM_HEAD[] =
+    "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY "\r\n"
+    "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+
+static const char MJPEG_INDEX[] =
+    "<!DOCTYPE html><html><head><title>UVC camera</title></head>"
+    "<body style=\"margin:0;background:#000\"><img src=\"/stream\" style=\"width:100%\"></body></html>";
+
+/* One client task, it waits for the main task to assign a connection */
+typedef struct {
+    int index;
+    int fd;                         /* -1 while no client is assigned, changed under the lock */
+    TaskHandle_t task;
+    uint32_t seq;                   /* Sequence of the last frame taken, 0 for none */
+    uint32_t frames_sent;
+    uint32_t frames_skipped;        /* Frames encoded while the client sent an older one */
+    char request[MJPEG_REQUEST_MAX];
+} mjpeg_client_t;
+
+/* Task context */
+typedef struct {
+    bool net_up;
+    int listen_fd;
+    QueueHandle_t queue;
+    SemaphoreHandle_t lock;         /* Guards the newest frame and the client connections */
+    frame_buffer_t *latest;         /* Newest frame with a reference, NULL while the pipeline is stopped */
+    uint32_t latest_seq;            /* Frames received, the newest one has this sequence */
+    mjpeg_client_t clients[CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS];
+} mjpeg_task_ctx_t;
+
+static mjpeg_task_ctx_t s_mjpeg_ctx = {
+    .listen_fd = -1,
+};
+
+static bool mjpeg_shutdown(void)
+{
+    return xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN;
+}
+
+/* ========== Newest Frame ========== */
+
+/* Replace the newest frame, takes over the reference of the sink queue */
+static void mjpeg_publish(frame_buffer_t *frame)
+{
+    frame_buffer_t *old;
+
+    xSemaphoreTake(s_mjpeg_ctx.lock, portMAX_DELAY);
+    old = s_mjpeg_ctx.latest;
+    s_mjpeg_ctx.latest = frame;
+    s_mjpeg_ctx.latest_seq++;
+    for (int i = 0; i < CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS; i++) {
+        if (s_mjpeg_ctx.clients[i].fd >= 0) {
+            xTaskNotifyGive(s_mjpeg_ctx.clients[i].task);
+        }
+    }
+    xSemaphoreGive(s_mjpeg_ctx.lock);
+
+    if (old) {
+        frame_buffer_release(old);
+    }
+}
+
+static void mjpeg_drop_latest(void)
+{
+    frame_buffer_t *old;
+
+    xSemaphoreTake(s_mjpeg_ctx.lock, portMAX_DELAY);
+    old = s_mjpeg_ctx.latest;
+    s_mjpeg_ctx.latest = NULL;
+    xSemaphoreGive(s_mjpeg_ctx.lock);
+
+    if (old) {
+        frame_buffer_release(old);
+    }
+}
+
+/* A reference to a frame newer than the last one the client took, NULL if none came within wait */
+static frame_buffer_t *mjpeg_next_frame(mjpeg_client_t *client, TickType_t wait)
+{
+    frame_buffer_t *frame = NULL;
+    TimeOut_t timeout;
+
+    vTaskSetTimeOutState(&timeout);
+    while (1) {
+        xSemaphoreTake(s_mjpeg_ctx.lock, portMAX_DELAY);
+        if (s_mjpeg_ctx.latest && s_mjpeg_ctx.latest_seq != client->seq) {
+            frame = frame_buffer_ref(s_mjpeg_ctx.latest);
+            if (client->seq) {
+                client->frames_skipped += s_mjpeg_ctx.latest_seq - client->seq - 1;
+            }
+            client->seq = s_mjpeg_ctx.latest_seq;
+        }
+        xSemaphoreGive(s_mjpeg_ctx.lock);
+
+        if (frame || mjpeg_shutdown() || xTaskCheckForTimeOut(&timeout, &wait) == pdTRUE) {
+            return frame;
+        }
+        ulTaskNotifyTake(pdTRUE, MIN(wait, pdMS_TO_TICKS(MJPEG_POLL_MS)));
+    }
+}
+
+/* ========== HTTP ========== */
+
+static bool mjpeg_send_all(int fd, const char *data, size_t len)
+{
+    return send(fd, data, len, 0) == (ssize_t)len;
+}
+
+static void mjpeg_reply(int fd, const char *status, const char *type, const char *body)
+{
+    char header[MJPEG_HEADER_MAX];
+    size_t body_len = body ? strlen(body) : 0;
+    int len;
+
+    len = snprintf(header, sizeof(header),
+                   "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                   status, type, (unsigned)body_len);
+    if (mjpeg_send_all(fd, header, len) && body_len) {
+        mjpeg_send_all(fd, body, body_len);
+    }
+}
+
+/* X-Timestamp header line of a frame, empty while not synchronized */
+static const char *mjpeg_timestamp(const frame_buffer_t *frame, char *buf, size_t size)
+{
+    int64_t network_ns;
+
+    buf[0] = '\0';
+    if (app_ptp_to_network(frame->timestamp, &network_ns) == ESP_OK) {
+        snprintf(buf, size, "X-Timestamp: %lld.%09lld\r\n",
+                 network_ns / 1000000000LL, network_ns % 1000000000LL);
+    }
+
+    return buf;
+}
+
+/* Send a header, the frame and a trailer from the encoder buffer in one call */
+static bool mjpeg_send_frame(int fd, const char *header, size_t header_len, const frame_buffer_t *frame,
+                             const char *trailer)
+{
+    size_t trailer_len = strlen(trailer);
+    struct iovec iov[3] = {
+        { .iov_base = (void *)header, .iov_len = header_len },
+        { .iov_base = frame->data, .iov_len = frame->size },
+        { .iov_base = (void *)trailer, .iov_len = trailer_len },
+    };
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = trailer_len ? 3 : 2,
+    };
+
+    /* A blocking send returns early only when SO_SNDTIMEO expires */
+    return sendmsg(fd, &msg, 0) == (ssize_t)(header_len + frame->size + trailer_len);
+}
+
+/* Whether the peer closed its end, without waiting */
+static bool mjpeg_peer_closed(int fd)
+{
+    char c;
+    int len = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    return len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+/* Read the request head, false if the client sent none */
+static bool mjpeg_read_request(mjpeg_client_t *client)
+{
+    size_t len = 0;
+    int ret;
+
+    while (len < sizeof(client->request) - 1) {
+        ret = recv(client->fd, client->request + len, sizeof(client->request) - 1 - len, 0);
+        if (ret <= 0) {
+            return false;
+        }
+        len += ret;
+        client->request[len] = '\0';
+        if (strstr(client->request, "\r\n\r\n")) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void mjpeg_serve_stream(mjpeg_client_t *client)
+{
+    char header[MJPEG_HEADER_MAX];
+    char timestamp[48];
+    frame_buffer_t *frame;
+    bool sent;
+    int len;
+
+    if (!mjpeg_send_all(client->fd, MJPEG_STREAM_HEAD, sizeof(MJPEG_STREAM_HEAD) - 1)) {
+        return;
+    }
+
+    while (!mjpeg_shutdown()) {
+        frame = mjpeg_next_frame(client, pdMS_TO_TICKS(MJPEG_POLL_MS));
+        if (!frame) {
+            if (mjpeg_peer_closed(client->fd)) {
+                break;
+            }
+            continue;
+        }
+
+        len = snprintf(header, sizeof(header),
+                       "--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n%s\r\n",
+                       (unsigned)frame->size, mjpeg_timestamp(frame, timestamp, sizeof(timestamp)));
+        sent = mjpeg_send_frame(client->fd, header, len, frame, "\r\n");
+        frame_buffer_release(frame);
+        if (!sent) {
+            break;
+        }
+        client->frames_sent++;
+    }
+}
+
+static void mjpeg_serve_snapshot(mjpeg_client_t *client)
+{
+    char header[MJPEG_HEADER_MAX];
+    char timestamp[48];
+    frame_buffer_t *frame;
+    int len;
+
+    frame = mjpeg_next_frame(client, pdMS_TO_TICKS(MJPEG_SNAPSHOT_WAIT_MS));
+    if (!frame) {
+        mjpeg_reply(client->fd, "503 Service Unavailable", "text/plain", "No frame\n");
+        return;
+    }
+
+    len = snprintf(header, sizeof(header),
+                   "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n%s"
+                   "Cache-Control: no-cache\r\nConnection: close\r\n\r\n", (unsigned)frame->size,
+                   mjpeg_timestamp(frame, timestamp, sizeof(timestamp)));
+    if (mjpeg_send_frame(client->fd, header, len, frame, "")) {
+        client->frames_sent++;
+    }
+    frame_buffer_release(frame);
+}
+
+static void mjpeg_serve_client(mjpeg_client_t *client)
+{
+    char method[8];
+    char path[64];
+    char *query;
+    bool stream;
+    esp_err_t ret;
+
+    if (!mjpeg_read_request(client) || sscanf(client->request, "%7s %63s", method, path) != 2) {
+        return;
+    }
+    query = strchr(path, '?');
+    if (query) {
+        *query = '\0';
+    }
+    ESP_LOGD(MJPEG_TAG, "Client %d: %s %s", client->index, method, path);
+
+    if (strcmp(method, "GET")) {
+        mjpeg_reply(client->fd, "405 Method Not Allowed", "text/plain", "GET only\n");
+        return;
+    }
+    if (!strcmp(path, "/") || !strcmp(path, "/index.html")) {
+        mjpeg_reply(client->fd, "200 OK", "text/html", MJPEG_INDEX);
+        return;
+    }
+    stream = !strcmp(path, "/stream");
+    if (!stream && strcmp(path, "/snapshot.jpg")) {
+        mjpeg_reply(client->fd, "404 Not Found", "text/plain", "Not found\n");
+        return;
+    }
+
+    /* Every viewer is a local session user, a USB host streaming already feeds the sink */
+    ret = uvc_app_stream_start_local(CONFIG_UVC_CAM1_FRAMESIZE_WIDTH, CONFIG_UVC_CAM1_FRAMESIZE_HEIGT,
+                                     CONFIG_UVC_CAM1_FRAMERATE);
+    if (ret != ESP_OK) {
+        ESP_LOGE(MJPEG_TAG, "Failed to start the camera (%s)", esp_err_to_name(ret));
+        mjpeg_reply(client->fd, "503 Service Unavailable", "text/plain", "Camera not available\n");
+        return;
+    }
+
+    if (stream) {
+        mjpeg_serve_stream(client);
+    } else {
+        mjpeg_serve_snapshot(client);
+    }
+
+    uvc_app_stream_stop_local();
+}
+
+static void mjpeg_client_task(void *arg)
+{
+    mjpeg_client_t *client = (mjpeg_client_t *)arg;
+    int fd;
+
+    while (!mjpeg_shutdown()) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MJPEG_POLL_MS));
+        if (client->fd < 0) {
+            continue;
+        }
+
+        client->seq = 0;
+        client->frames_sent = 0;
+        client->frames_skipped = 0;
+        mjpeg_serve_client(client);
+
+        xSemaphoreTake(s_mjpeg_ctx.lock, portMAX_DELAY);
+        fd = client->fd;
+        client->fd = -1;
+        xSemaphoreGive(s_mjpeg_ctx.lock);
+        close(fd);
+        ESP_LOGI(MJPEG_TAG, "Client %d disconnected, %lu frames sent, %lu skipped",
+                 client->index, client->frames_sent, client->frames_skipped);
+    }
+
+    vTaskDelete(NULL);
+}
+
+/* Hand a new connection to an idle client task */
+static void mjpeg_accept(void)
+{
+    struct timeval send_timeout = {
+        .tv_sec = CONFIG_EXAMPLE_MJPEG_SEND_TIMEOUT_MS / 1000,
+        .tv_usec = (CONFIG_EXAMPLE_MJPEG_SEND_TIMEOUT_MS % 1000) * 1000,
+    };
+    struct timeval recv_timeout = {
+        .tv_sec = MJPEG_REQUEST_TIMEOUT_MS / 1000,
+        .tv_usec = (MJPEG_REQUEST_TIMEOUT_MS % 1000) * 1000,
+    };
+    mjpeg_client_t *client = NULL;
+    int nodelay = 1;
+    int fd;
+
+    fd = accept(s_mjpeg_ctx.listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    /* The listening socket doesn't block, its connections do, bounded by the timeouts */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    xSemaphoreTake(s_mjpeg_ctx.lock, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS && !client; i++) {
+        if (s_mjpeg_ctx.clients[i].task && s_mjpeg_ctx.clients[i].fd < 0) {
+            client = &s_mjpeg_ctx.clients[i];
+            client->fd = fd;
+        }
+    }
+    xSemaphoreGive(s_mjpeg_ctx.lock);
+
+    if (!client) {
+        ESP_LOGW(MJPEG_TAG, "%d clients connected, refusing another one", CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS);
+        mjpeg_reply(fd, "503 Service Unavailable", "text/plain", "Too many clients\n");
+        close(fd);
+        return;
+    }
+
+    ESP_LOGI(MJPEG_TAG, "Client %d connected", client->index);
+    xTaskNotifyGive(client->task);
+}
+
+/* ========== Network ========== */
+
+static void mjpeg_got_ip_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+
+    ESP_LOGI(MJPEG_TAG, "Stream at http://" IPSTR ":%d/stream", IP2STR(&event->ip_info.ip),
+             CONFIG_EXAMPLE_MJPEG_PORT);
+}
+
+static esp_err_t mjpeg_open_socket(void)
+{
+    int reuse = 1;
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(CONFIG_EXAMPLE_MJPEG_PORT),
+    };
+
+    s_mjpeg_ctx.listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    APP_RETURN_ON_FALSE(s_mjpeg_ctx.listen_fd >= 0, ESP_FAIL, MJPEG_TAG, "Failed to create HTTP socket (errno=%d)",
+                        errno);
+    setsockopt(s_mjpeg_ctx.listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    fcntl(s_mjpeg_ctx.listen_fd, F_SETFL, O_NONBLOCK);
+    APP_RETURN_ON_FALSE(bind(s_mjpeg_ctx.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+                        listen(s_mjpeg_ctx.listen_fd, CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS) == 0, ESP_FAIL, MJPEG_TAG,
+                        "Failed to listen on port %d (errno=%d)", CONFIG_EXAMPLE_MJPEG_PORT, errno);
+
+    return ESP_OK;
+}
+
+/* ========== Init Phase ========== */
+void initMjpegTask(void *arg)
+{
+    ESP_LOGI(MJPEG_TAG, "Initializing MJPEG server task...");
+
+    s_mjpeg_ctx.lock = xSemaphoreCreateMutex();
+    assert(s_mjpeg_ctx.lock);
+    for (int i = 0; i < CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS; i++) {
+        s_mjpeg_ctx.clients[i].index = i;
+        s_mjpeg_ctx.clients[i].fd = -1;
+    }
+
+    if (app_eth_start() != ESP_OK) {
+        ESP_LOGE(MJPEG_TAG, "Ethernet not available, MJPEG server disabled");
+        return;
+    }
+    APP_LOG_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, mjpeg_got_ip_handler, NULL),
+                     MJPEG_TAG, "Failed to register IP event handler");
+    s_mjpeg_ctx.net_up = true;
+
+    ESP_LOGI(MJPEG_TAG, "MJPEG server task initialized");
+}
+
+/* ========== Main Loop ========== */
+void mainMjpegTask(void *arg)
+{
+    frame_buffer_t *frame;
+
+    ESP_LOGI(MJPEG_TAG, "MJPEG server task started on core %d", xPortGetCoreID());
+
+    if (!s_mjpeg_ctx.net_up || mjpeg_open_socket() != ESP_OK) {
+        goto exit;
+    }
+
+    /* A frame arriving while the newest one is taken replaces the queued one, the queue holds one */
+    s_mjpeg_ctx.queue = os_getQueueHandler(QUEUE_MJPEG);
+    if (!s_mjpeg_ctx.queue || uvc_encode_add_sink(s_mjpeg_ctx.queue, SINK_POLICY_DROP_OLDEST, 0) != ESP_OK) {
+        ESP_LOGE(MJPEG_TAG, "Failed to register MJPEG frame queue");
+        goto exit;
+    }
+
+    /* Client tasks run beside this one, at its priority */
+    for (int i = 0; i < CONFIG_EXAMPLE_MJPEG_MAX_CLIENTS; i++) {
+        if (xTaskCreatePinnedToCore(mjpeg_client_task, "mjpeg_client", MJPEG_CLIENT_STACK, &s_mjpeg_ctx.clients[i],
+                                    uxTaskPriorityGet(NULL), &s_mjpeg_ctx.clients[i].task,
+                                    xPortGetCoreID()) != pdPASS) {
+            ESP_LOGE(MJPEG_TAG, "Failed to create client task %d", i);
+            s_mjpeg_ctx.clients[i].task = NULL;
+        }
+    }
+
+    while (!mjpeg_shutdown()) {
+        if (xQueueReceive(s_mjpeg_ctx.queue, &frame, pdMS_TO_TICKS(MJPEG_POLL_MS)) == pdTRUE) {
+            mjpeg_publish(frame);
+        }
+        /* The halt waits for every encoded frame, the frames it drained may have been taken before */
+        if (!(xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN)) {
+            mjpeg_drop_latest();
+        }
+        mjpeg_accept();
+    }
+    ESP_LOGI(MJPEG_TAG, "Shutdown requested");
+
+exit:
+    ESP_LOGI(MJPEG_TAG, "MJPEG server task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terMjpegTask(void *arg)
+{
+    ESP_LOGI(MJPEG_TAG, "Terminating MJPEG server task...");
+
+    if (s_mjpeg_ctx.lock) {
+        mjpeg_drop_latest();
+    }
+    if (s_mjpeg_ctx.listen_fd >= 0) {
+        close(s_mjpeg_ctx.listen_fd);
+        s_mjpeg_ctx.listen_fd = -1;
+    }
+
+    ESP_LOGI(MJPEG_TAG, "MJPEG server task terminated, %lu frames received", s_mjpeg_ctx.latest_seq);
+}
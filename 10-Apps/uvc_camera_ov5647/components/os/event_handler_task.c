@@ -12,12 +12,47 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "uvc_app_common.h"
+#include "uvc_latency.h"
 #include "os_interface.h"
+#include "os_boot.h"
+#include "linux/videodev2.h"
 
 #ifdef CONFIG_CAMERA_DEBUG_ENABLE
 #include "camera_debug.h"
 #endif
 
+#if CONFIG_EXAMPLE_MOTION || CONFIG_EXAMPLE_STALL_WATCHDOG || CONFIG_TRACE_ENABLE
+#include <string.h>
+#endif
+
+#if CONFIG_EXAMPLE_MOTION
+#include "uvc_motion.h"
+#endif
+
+#if CONFIG_EXAMPLE_STALL_WATCHDOG
+#include "uvc_watchdog.h"
+#endif
+
+#if CONFIG_EXAMPLE_AUX_CAMERA
+#include "uvc_aux_camera.h"
+#endif
+
+#if CONFIG_EXAMPLE_UVC_SUB_STREAM
+#include "uvc_sub_stream.h"
+#endif
+
+#if CONFIG_EXAMPLE_UVC_PU_BRIDGE
+#include "uvc_pu_bridge.h"
+#endif
+
+#if CONFIG_TRACE_ENABLE
+#include "trace.h"
+#endif
+
+#if CONFIG_PROF_ENABLE
+#include "prof.h"
+#endif
+
 /* Task context */
 typedef struct {
     uint32_t events_processed;
@@ -55,15 +90,14 @@ void mainEventHandlerTask(void *arg)
 
     /* Main loop */
     while (1) {
-        /* Check for shutdown */
-        if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN) {
-            ESP_LOGI(EVT_TAG, "Shutdown requested");
-            break;
+        /* Wait for events, app_request_shutdown() posts SYS_EVENT_SHUTDOWN to wake us */
+        if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
         }
 
-        /* Wait for events */
-        if (xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)) != pdTRUE) {
-            continue;
+        if (event.type == SYS_EVENT_SHUTDOWN) {
+            ESP_LOGI(EVT_TAG, "Shutdown requested");
+            break;
         }
 
         ESP_LOGI(EVT_TAG, "Processing event type: %d", event.type);
@@ -90,6 +124,22 @@ void mainEventHandlerTask(void *arg)
                 g_app_ctx.total_frames_encoded = 0;
                 g_app_ctx.total_frames_streamed = 0;
                 g_app_ctx.frames_dropped = 0;
+                g_app_ctx.frames_static = 0;
+                g_app_ctx.frames_paced = 0;
+                g_app_ctx.frames_sink_dropped = 0;
+                uvc_latency_reset();
+#if CONFIG_EXAMPLE_AUX_CAMERA
+                uvc_aux_camera_reset_stats();
+#endif
+#if CONFIG_EXAMPLE_UVC_SUB_STREAM
+                uvc_sub_stream_reset_stats();
+#endif
+#if CONFIG_EXAMPLE_UVC_PU_BRIDGE
+                uvc_pu_bridge_reset_stats();
+#endif
+#if CONFIG_PROF_ENABLE
+                prof_reset();
+#endif
 
 #ifdef CONFIG_CAMERA_DEBUG_ENABLE
                 camera_debug_reset_stats();
@@ -98,27 +148,88 @@ void mainEventHandlerTask(void *arg)
                 break;
 
             case SYS_EVENT_CHANGE_FORMAT:
-                ESP_LOGI(EVT_TAG, "Format change requested");
-                ESP_LOGW(EVT_TAG, "Format change not implemented yet");
-                // TODO: Implement format change logic
-                // 1. Stop streaming
-                // 2. Reconfigure encoder
-                // 3. Restart streaming
+                /* UVC exposes a single encoded format, selected at build time */
+                ESP_LOGW(EVT_TAG, "Format change not supported, output is %s",
+                         g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG ? "MJPEG" : "H.264");
                 break;
 
             case SYS_EVENT_CHANGE_RESOLUTION:
-                ESP_LOGI(EVT_TAG, "Resolution change requested");
-                ESP_LOGW(EVT_TAG, "Resolution change not implemented yet");
-                // TODO: Implement resolution change logic
-                // 1. Stop streaming
-                // 2. Reconfigure camera and encoder
-                // 3. Restart streaming
+                /* The host selects a frame by stop/start, video_start_cb already reconfigured the pipeline */
+                ESP_LOGI(EVT_TAG, "Resolution changed to %dx%d @%dfps",
+                         g_app_ctx.stream_width, g_app_ctx.stream_height, g_app_ctx.stream_fps);
+                uvc_latency_reset();
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+                camera_debug_reset_stats();
+#endif
+                break;
+
+            case SYS_EVENT_POWER_DOWN:
+                /* Posted by the idle timer of the UVC stream task, a session may have started since */
+                if (!(xEventGroupGetBits(g_app_ctx.system_events) & EVENT_STREAMING_ACTIVE)) {
+                    uvc_app_power_down();
+                }
+                break;
+
+            case SYS_EVENT_DUMP_LATENCY:
+                /* Debug command, the monitor task prints the same summary periodically */
+                uvc_latency_dump(EVT_TAG);
                 break;
 
+#if CONFIG_TRACE_ENABLE
+            case SYS_EVENT_DUMP_TRACE: {
+                /* Debug command, the payload is a file path, e.g. on the SD card, or empty for the console */
+                char path[SYS_EVENT_DATA_MAX + 1];
+
+                if (event.data_len) {
+                    /* app_post_event() keeps the payload within SYS_EVENT_DATA_MAX */
+                    memcpy(path, event.data, event.data_len);
+                    path[event.data_len] = '\0';
+                    APP_LOG_ON_ERROR(trace_dump_file(path), EVT_TAG, "Failed to dump the trace to %s", path);
+                } else {
+                    APP_LOG_ON_ERROR(trace_dump_console(), EVT_TAG, "Failed to dump the trace");
+                }
+                break;
+            }
+#endif
+
+#if CONFIG_PROF_ENABLE
+            case SYS_EVENT_DUMP_PROFILE:
+                /* Debug command, the PCs are resolved on the host by tools/prof_report.py */
+                APP_LOG_ON_ERROR(prof_dump_console(), EVT_TAG, "Failed to dump the profile");
+                break;
+#endif
+
+#if CONFIG_EXAMPLE_MOTION
+            case SYS_EVENT_MOTION: {
+                /* The payload is a byte array, copy it out before reading the fields */
+                uvc_motion_event_t motion;
+
+                memcpy(&motion, event.data, sizeof(motion));
+                uvc_motion_dispatch(&motion);
+                break;
+            }
+#endif
+
+            case SYS_EVENT_BOOT_DONE:
+                /* Posted by os_boot_done() at the first frame, or by its timeout */
+                os_boot_finish();
+                break;
+
+#if CONFIG_EXAMPLE_STALL_WATCHDOG
+            case SYS_EVENT_STALL: {
+                /* Posted by the stall watchdog, the restart takes the session lock */
+                uvc_stall_event_t stall;
+
+                memcpy(&stall, event.data, sizeof(stall));
+                uvc_app_recover(&stall);
+                break;
+            }
+#endif
+
             case SYS_EVENT_ERROR:
                 ESP_LOGE(EVT_TAG, "System error event received");
-                if (event.data) {
-                    ESP_LOGE(EVT_TAG, "Error data: %s", (char*)event.data);
+                if (event.data_len) {
+                    ESP_LOGE(EVT_TAG, "Error data: %.*s", (int)event.data_len, (char *)event.data);
                 }
                 // TODO: Implement error recovery logic
                 break;
@@ -128,11 +239,6 @@ void mainEventHandlerTask(void *arg)
                 break;
         }
 
-        /* Free event data if allocated */
-        if (event.data && event.data_len > 0) {
-            free(event.data);
-        }
-
         s_evt_ctx.events_processed++;
     }
 
@@ -0,0 +1,47 @@
+/*
+ * OS Boot - Boot timeline, deferred logging and deferred init
+ *
+ * Each boot phase is marked with its esp_timer time, the timeline is printed
+ * once the boot is done: at the first frame handed to the host, or after
+ * CONFIG_EXAMPLE_FAST_BOOT_TIMEOUT_MS without one.
+ *
+ * With CONFIG_EXAMPLE_FAST_BOOT the log output is kept in a RAM buffer until
+ * then instead of going out over the console synchronously, and non-critical
+ * init registered with os_boot_defer() runs only then. Lines past the buffer
+ * are dropped and counted.
+ */
+
+#ifndef OS_BOOT_H
+#define OS_BOOT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OS_BOOT_MAX_MARKS       16
+#define OS_BOOT_MAX_DEFERRED    4
+
+typedef void (*os_boot_fn)(void);
+
+/* Start buffering the log output with CONFIG_EXAMPLE_FAST_BOOT, first thing in app_main() */
+void os_boot_start(void);
+
+/* Record the end of a boot phase, name must stay valid, marks past OS_BOOT_MAX_MARKS are dropped */
+void os_boot_mark(const char *name);
+
+/* Run fn once the boot is done with CONFIG_EXAMPLE_FAST_BOOT, otherwise right away */
+void os_boot_defer(os_boot_fn fn);
+
+/* The first frame reached the host, cheap enough for the streaming path, only the first call counts */
+void os_boot_done(void);
+
+/* Flush the log buffer, print the timeline and run deferred init, posted as SYS_EVENT_BOOT_DONE */
+void os_boot_finish(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OS_BOOT_H */
@@ -5,9 +5,12 @@
 #ifndef OS_INTERFACE_H
 #define OS_INTERFACE_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,8 +19,45 @@ extern "C" {
 /* Task IDs */
 typedef enum {
     TASK_UVC_STREAM,
+    TASK_CAPTURE,
+    TASK_ENCODE,
     TASK_MONITOR,
     TASK_EVENT_HANDLER,
+    TASK_SCHED,
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    TASK_SECONDARY_ENCODE,
+#endif
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    TASK_AUX_CAPTURE,
+#endif
+#if CONFIG_EXAMPLE_TELEMETRY
+    TASK_TELEMETRY,
+#endif
+#if CONFIG_EXAMPLE_PTP
+    TASK_PTP,
+#endif
+#if CONFIG_EXAMPLE_RTSP_SERVER
+    TASK_RTSP,
+#endif
+#if CONFIG_EXAMPLE_MJPEG_SERVER
+    TASK_MJPEG,
+#endif
+#if CONFIG_EXAMPLE_SD_RECORD
+    TASK_RECORD,
+    TASK_RECORD_WRITER,
+#endif
+#if CONFIG_EXAMPLE_MOTION
+    TASK_MOTION,
+#endif
+#if CONFIG_EXAMPLE_INFER
+    TASK_INFER,
+#endif
+#if CONFIG_EXAMPLE_SCAN
+    TASK_SCAN,
+#endif
+#if CONFIG_DLOG_ENABLE
+    TASK_DLOG,
+#endif
     /* Add new tasks above this line */
     NUMOFTASK
 } os_task_id_en;
@@ -26,17 +66,54 @@ typedef enum {
 typedef enum {
     QUEUE_RAW_FRAME,
     QUEUE_ENCODED_FRAME,
+    QUEUE_ENCODED_FREE,
     QUEUE_SYSTEM_EVENT,
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    QUEUE_SECONDARY_RAW,
+#endif
+#if CONFIG_EXAMPLE_SD_RECORD
+    QUEUE_RECORD,
+#endif
+#if CONFIG_EXAMPLE_MJPEG_SERVER
+    QUEUE_MJPEG,
+#endif
+#if CONFIG_EXAMPLE_MOTION
+    QUEUE_MOTION_RAW,
+#endif
+#if CONFIG_EXAMPLE_INFER
+    QUEUE_INFER_RAW,
+#endif
     /* Add new queues above this line */
     NUMOFQUEUE
 } os_queue_id_en;
 
+/* Deadline counters since boot, the worst response since the last os_deadline_get_stats() */
+typedef struct {
+    uint32_t period_us;             // From the task table, 0 for an aperiodic task
+    uint32_t deadline_us;           // Deadline the responses were checked against
+    uint32_t activations;
+    uint32_t misses;
+    uint32_t worst_us;
+    uint32_t worst_ever_us;
+} os_deadline_stats_st;
+
 /* Public API */
 void os_startup(void);
 void os_terminate_stuff(void);
 TaskHandle_t os_getTaskHandler(os_task_id_en task_id);
 QueueHandle_t os_getQueueHandler(os_queue_id_en queue_id);
 
+/*
+ * Account one activation of a periodic task, from its release at release_us
+ * (esp_timer time) to now. Called at the end of the work the release asked
+ * for, from one context per task, a task without a period in the table is
+ * ignored.
+ */
+void os_deadline_record(os_task_id_en task_id, int64_t release_us);
+
+/* Returns false for an aperiodic task */
+bool os_deadline_get_stats(os_task_id_en task_id, os_deadline_stats_st *ret_stats);
+
 #ifdef __cplusplus
 }
 #endif
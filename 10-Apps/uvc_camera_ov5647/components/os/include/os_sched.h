@@ -0,0 +1,48 @@
+/*
+ * OS Sched - Shared scheduler for slow periodic jobs
+ *
+ * Modules register a job with a period and a deadline tolerance instead of
+ * spawning their own polling task. A job never runs before it is due and at
+ * most tolerance_ms after. The worker wakes at the earliest deadline and runs
+ * every job that is due by then, so jobs with overlapping windows share one
+ * wake-up. Jobs run one after the other on the worker task, keep them short
+ * and never block in them.
+ */
+
+#ifndef OS_SCHED_H
+#define OS_SCHED_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OS_SCHED_MAX_JOBS       8
+
+typedef void (*os_sched_job_fn)(void *arg);
+
+typedef int os_sched_job_id;
+
+/* Counters since boot */
+typedef struct {
+    uint32_t wakeups;                   // Times the worker woke up to run jobs
+    uint32_t runs;                      // Jobs run, more runs than wake-ups is what coalescing saved
+    uint32_t late;                      // Runs past their deadline, e.g. a long job held the worker
+} os_sched_stats_st;
+
+/* Register a job, the first run is one period from now, may be called before os_startup() */
+esp_err_t os_sched_register(const char *name, os_sched_job_fn func, void *arg,
+                            uint32_t period_ms, uint32_t tolerance_ms, os_sched_job_id *ret_id);
+
+/* Unregister a job, a run the worker already started still completes */
+esp_err_t os_sched_unregister(os_sched_job_id id);
+
+void os_sched_get_stats(os_sched_stats_st *ret_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OS_SCHED_H */
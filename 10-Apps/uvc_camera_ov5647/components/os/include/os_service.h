@@ -15,6 +15,13 @@
 extern "C" {
 #endif
 
+/* Core affinity policy of a task */
+typedef enum {
+    OS_AFFINITY_PINNED,             // Run on the core given in taskcfg_st.core
+    OS_AFFINITY_ANY,                // Let the scheduler move the task between cores
+    OS_AFFINITY_OPPOSITE,           // Run on the other core than the task whose ID is in taskcfg_st.core
+} os_affinity_en;
+
 /* Task configuration structure */
 typedef struct {
     char*           taskname;
@@ -23,17 +30,31 @@ typedef struct {
     TaskFunction_t  terfunc;        // Terminate/cleanup function
     uint32_t        stacksize;
     uint16_t        priority;
-    int             core;           // CPU core affinity (0 or 1)
+    os_affinity_en  affinity;       // How core is interpreted
+    int             core;           // Core number (PINNED) or task ID (OPPOSITE), unused for ANY
+    StackType_t*    stackbuf;       // Static stack of stacksize bytes, NULL to allocate from heap
+    StaticTask_t*   tcbbuf;         // Static TCB, used together with stackbuf
+    uint32_t        period_us;      // Release period, 0 for an aperiodic task
+    uint32_t        deadline_us;    // Response time limit after a release, 0 for the period
 } taskcfg_st;
 
 /* Task handler storage */
 typedef struct {
     TaskHandle_t    handler;
+    uint32_t        activations;    // Releases served, see os_deadline_record()
+    uint32_t        misses;         // Responses later than the deadline
+    uint32_t        worst_us;       // Longest response since the last os_deadline_get_stats()
+    uint32_t        worst_ever_us;  // Longest response since boot
 } taskhdler_st;
 
-/* Queue configuration */
-#define OS_QUEUE_MAX_ITEMS      10
-#define OS_QUEUE_ITEM_SIZE      sizeof(void*)  // Queue holds pointers
+/* Queue configuration structure */
+typedef struct {
+    char*           queuename;
+    uint32_t        depth;          // Number of items
+    uint32_t        itemsize;       // Bytes copied per item
+    uint8_t*        storagebuf;     // Static storage of depth * itemsize bytes, NULL to allocate from heap
+    StaticQueue_t*  queuebuf;       // Static queue structure, used together with storagebuf
+} queuecfg_st;
 
 #ifdef __cplusplus
 }
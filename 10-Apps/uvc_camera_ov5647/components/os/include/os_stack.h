@@ -0,0 +1,76 @@
+/*
+ * OS Stack - Task stacks fitted to their measured peaks
+ *
+ * A sched job reads the stack high water mark of every task of the table and
+ * saves the peak use per task name to NVS whenever it grew. The next boot
+ * creates tasks whose stack comes from the heap with that peak plus
+ * CONFIG_EXAMPLE_STACK_FIT_MARGIN percent, never more than the table size.
+ * Tasks without a saved peak, and all tasks after a boot that followed a
+ * panic or watchdog reset, get the table size. Peaks saved by another
+ * firmware image are discarded, so the profile always matches the code.
+ *
+ * Stacks placed at link time by CONFIG_EXAMPLE_OS_STATIC_ALLOCATION keep
+ * their size, their peaks are logged so the table can be edited by hand.
+ *
+ * Without CONFIG_EXAMPLE_STACK_FIT the calls do nothing.
+ */
+
+#ifndef OS_STACK_H
+#define OS_STACK_H
+
+#include <stdint.h>
+#include <string.h>
+#include "os_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters since boot */
+typedef struct {
+    uint32_t fitted;        // Tasks created below their table size
+    uint32_t reclaimed;     // Bytes of stack those tasks did not take
+    uint32_t saves;         // Times the grown peaks were written to NVS
+    uint32_t headroom;      // Least free stack of any profiled task, in bytes
+} os_stack_stats_st;
+
+#if CONFIG_EXAMPLE_STACK_FIT
+
+/* Read the saved peaks, in os_startup() before the tasks are created */
+void os_stack_load(void);
+
+/* Stack size to create a task with, stacksize is its table size */
+uint32_t os_stack_size(os_task_id_en task_id, uint32_t stacksize);
+
+/* Start sampling the high water marks, once the tasks are created */
+void os_stack_start(void);
+
+void os_stack_get_stats(os_stack_stats_st *ret_stats);
+
+#else
+
+static inline void os_stack_load(void)
+{
+}
+
+static inline uint32_t os_stack_size(os_task_id_en task_id, uint32_t stacksize)
+{
+    return stacksize;
+}
+
+static inline void os_stack_start(void)
+{
+}
+
+static inline void os_stack_get_stats(os_stack_stats_st *ret_stats)
+{
+    memset(ret_stats, 0, sizeof(*ret_stats));
+}
+
+#endif /* CONFIG_EXAMPLE_STACK_FIT */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OS_STACK_H */
@@ -0,0 +1,99 @@
+/*
+ * OS Telemetry - Binary status records drained over USB Serial/JTAG
+ *
+ * Every record is a header followed by its payload, all little-endian:
+ * - magic (0x4D54, "TM" on the wire), version, type
+ * - payload length and CRC-16/X-25 of the payload (esp_rom_crc16_le)
+ *
+ * The port may also carry console text, so the host resynchronizes on the
+ * magic and drops records whose CRC does not match.
+ * tools/telemetry_decode.py decodes the stream.
+ */
+
+#ifndef OS_TELEMETRY_H
+#define OS_TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_MAGIC         0x4D54
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_CORES         2       /* Fixed in the record, unused cores read 0 */
+#define TELEMETRY_LAT_STAGES    5       /* LAT_STAGE_MAX */
+
+/* Record types */
+typedef enum {
+    TELEMETRY_TYPE_STATUS = 1,          // telemetry_status_t
+    TELEMETRY_TYPE_PACING = 2,          // telemetry_pacing_t, only with the camera debug statistics
+} telemetry_type_en;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t  version;
+    uint8_t  type;
+    uint16_t length;                    // Payload bytes following the header
+    uint16_t crc;                       // CRC of the payload
+} telemetry_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} telemetry_latency_t;
+
+/* Periodic status, counters are totals since the last statistics reset */
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t uptime_ms;
+    uint32_t frames_captured;
+    uint32_t frames_encoded;
+    uint32_t frames_streamed;
+    uint32_t frames_secondary;
+    uint32_t frames_dropped;
+    uint32_t frames_oversize;
+    uint32_t frames_static;
+    uint32_t enc_peak_size;
+    uint32_t uvc_buffer_size;
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+    uint32_t free_psram;
+    uint8_t  streaming;
+    uint8_t  raw_queue;                 // Messages waiting
+    uint8_t  enc_queue;
+    uint8_t  free_pool;
+    uint16_t cpu_load[TELEMETRY_CORES]; // Per mille over the last interval, 0xFFFF if unknown
+    telemetry_latency_t latency[TELEMETRY_LAT_STAGES];
+} telemetry_status_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t fps_x100;
+    uint32_t bitrate_kbps;
+    uint32_t gap_avg_us;
+    uint32_t gap_stddev_us;
+    uint32_t gap_max_us;
+} telemetry_window_t;
+
+/* Frame pacing of the encoded stream, sent along with every status record */
+typedef struct __attribute__((packed)) {
+    uint32_t seq;                       // Matches the status record
+    telemetry_window_t window_1s;
+    telemetry_window_t window_10s;
+    uint32_t longest_stall_us;
+    uint32_t stall_count;
+} telemetry_pacing_t;
+
+/* Queue one record for the drain task, it is dropped if the ring is full */
+esp_err_t os_telemetry_push(telemetry_type_en type, const void *payload, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OS_TELEMETRY_H */
@@ -6,29 +6,91 @@
  * - Track frame statistics
  * - Print periodic reports
  * - Monitor memory usage
+ *
+ * Runs as a job of the sched task, see os_sched.h.
  */
 
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
 #include "uvc_app_common.h"
+#include "uvc_latency.h"
 #include "os_interface.h"
+#include "os_sched.h"
+#include "os_boot.h"
+#include "os_stack.h"
+#include "memstat.h"
+#include "uvc_watchdog.h"
+#include "uvc_qos.h"
+#include "uvc_fsync.h"
+#include "uvc_aux_camera.h"
+#include "uvc_sub_stream.h"
+#include "uvc_pu_bridge.h"
+#include "prof.h"
+
+#if CONFIG_EXAMPLE_TELEMETRY
+#include "esp_timer.h"
+#include "os_telemetry.h"
+
+_Static_assert(TELEMETRY_LAT_STAGES == LAT_STAGE_MAX, "Telemetry record and latency stages differ");
+#endif
 
 #ifdef CONFIG_CAMERA_DEBUG_ENABLE
 #include "camera_debug.h"
 #endif
 
+/* Monitor interval in milliseconds, telemetry records are cheap enough to send more often */
+#if CONFIG_EXAMPLE_TELEMETRY
+#define MONITOR_INTERVAL_MS     CONFIG_EXAMPLE_TELEMETRY_INTERVAL_MS
+#else
+#define MONITOR_INTERVAL_MS     5000
+#endif
+
+/* Reports may be this late, so they share wake-ups with the other jobs */
+#define MONITOR_TOLERANCE_MS    (MONITOR_INTERVAL_MS / 4)
+
+#define MONITOR_CPU_UNKNOWN     0xFFFF
+
+#if CONFIG_EXAMPLE_MONITOR_CPU_LOAD
+#define MONITOR_TASK_MAX        32      /* Tasks beyond this are left out of the CPU report */
+
+/* Run time counters of the previous window */
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t runtime;
+} monitor_task_sample_t;
+#endif
+
 /* Task context */
 typedef struct {
     uint32_t report_count;
     TickType_t last_report_time;
+    os_sched_job_id job;
+#if CONFIG_EXAMPLE_MONITOR_CPU_LOAD
+    TaskStatus_t status[MONITOR_TASK_MAX];
+    monitor_task_sample_t prev[MONITOR_TASK_MAX];
+    uint32_t prev_count;
+    uint32_t prev_total;
+#endif
+    uint16_t cpu_load[portNUM_PROCESSORS];  /* Per mille over the last window */
 } monitor_task_ctx_t;
 
 static monitor_task_ctx_t s_mon_ctx = {0};
 
-/* Monitor interval in milliseconds */
-#define MONITOR_INTERVAL_MS     5000
+static void monitor_job(void *arg);
+
+/* Reports start once the boot is done with CONFIG_EXAMPLE_FAST_BOOT */
+static void monitor_start(void)
+{
+    s_mon_ctx.last_report_time = xTaskGetTickCount();
+
+    if (os_sched_register("monitor", monitor_job, NULL, MONITOR_INTERVAL_MS, MONITOR_TOLERANCE_MS,
+                          &s_mon_ctx.job) != ESP_OK) {
+        ESP_LOGE(MON_TAG, "Failed to register the monitor job");
+    }
+}
 
 /* ========== Init Phase ========== */
 void initMonitorTask(void *arg)
@@ -36,100 +98,369 @@ void initMonitorTask(void *arg)
     ESP_LOGI(MON_TAG, "Initializing monitor task...");
 
     s_mon_ctx.report_count = 0;
-    s_mon_ctx.last_report_time = xTaskGetTickCount();
+    s_mon_ctx.job = -1;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_mon_ctx.cpu_load[core] = MONITOR_CPU_UNKNOWN;
+    }
+
+    os_boot_defer(monitor_start);
 
     ESP_LOGI(MON_TAG, "Monitor task initialized");
 }
 
-/* ========== Main Loop ========== */
-void mainMonitorTask(void *arg)
+#if CONFIG_EXAMPLE_MONITOR_CPU_LOAD
+/* Run time of a task at the start of the window, false for tasks created since then */
+static bool monitor_prev_runtime(TaskHandle_t handle, uint32_t *runtime)
+{
+    for (int i = 0; i < s_mon_ctx.prev_count; i++) {
+        if (s_mon_ctx.prev[i].handle == handle) {
+            *runtime = s_mon_ctx.prev[i].runtime;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Per-core idle and per-task CPU share over the last monitor window, logged if log is set */
+static void monitor_report_cpu_load(bool log)
 {
-    TickType_t last_wake_time;
-    const TickType_t interval = pdMS_TO_TICKS(MONITOR_INTERVAL_MS);
+    UBaseType_t count;
+    configRUN_TIME_COUNTER_TYPE total;
+    uint32_t window;
+    uint32_t delta;
+    uint32_t prev;
+    uint32_t idle[portNUM_PROCESSORS] = {0};
+    bool first = !s_mon_ctx.prev_count;
 
-    ESP_LOGI(MON_TAG, "Monitor task started on core %d", xPortGetCoreID());
+    count = uxTaskGetSystemState(s_mon_ctx.status, MONITOR_TASK_MAX, &total);
+    if (!count) {
+        ESP_LOGW(MON_TAG, "More than %d tasks, CPU load not available", MONITOR_TASK_MAX);
+        return;
+    }
 
-    last_wake_time = xTaskGetTickCount();
+    /* Counters only grow, unsigned differences stay right across a 32-bit wrap */
+    window = (uint32_t)total - s_mon_ctx.prev_total;
 
-    /* Main loop */
-    while (1) {
-        /* Check for shutdown */
-        if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN) {
-            ESP_LOGI(MON_TAG, "Shutdown requested");
-            break;
+    if (!first && window) {
+        if (log) {
+            ESP_LOGI(MON_TAG, "CPU usage over %lu ms:", window / 1000);
         }
+        for (int i = 0; i < count; i++) {
+            const TaskStatus_t *task = &s_mon_ctx.status[i];
 
-        /* Wait for next monitoring interval */
-        vTaskDelayUntil(&last_wake_time, interval);
+            if (!monitor_prev_runtime(task->xHandle, &prev)) {
+                continue;
+            }
+            delta = (uint32_t)task->ulRunTimeCounter - prev;
 
-        /* Print system monitor report */
-        ESP_LOGI(MON_TAG, "========== System Monitor ==========");
-        ESP_LOGI(MON_TAG, "Streaming:  %s", g_app_ctx.is_streaming ? "ACTIVE" : "IDLE");
-        ESP_LOGI(MON_TAG, "Captured:   %lu frames", g_app_ctx.total_frames_captured);
-        ESP_LOGI(MON_TAG, "Encoded:    %lu frames", g_app_ctx.total_frames_encoded);
-        ESP_LOGI(MON_TAG, "Streamed:   %lu frames", g_app_ctx.total_frames_streamed);
-        ESP_LOGI(MON_TAG, "Dropped:    %lu frames", g_app_ctx.frames_dropped);
+            for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                if (task->xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+                    idle[core] = delta;
+                }
+            }
 
-        /* Queue status */
-        QueueHandle_t raw_queue = os_getQueueHandler(QUEUE_RAW_FRAME);
-        QueueHandle_t enc_queue = os_getQueueHandler(QUEUE_ENCODED_FRAME);
+            /* Share of one core, so a task saturating its core reads 100% */
+            if (log && delta) {
+                ESP_LOGI(MON_TAG, "  %-16s core %2d  %5.1f%%", task->pcTaskName,
+                         task->xCoreID == tskNO_AFFINITY ? -1 : (int)task->xCoreID,
+                         delta * 100.0 / window);
+            }
+        }
 
-        if (raw_queue) {
-            UBaseType_t raw_waiting = uxQueueMessagesWaiting(raw_queue);
-            ESP_LOGI(MON_TAG, "Raw queue:  %u/10 messages", raw_waiting);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            s_mon_ctx.cpu_load[core] = 1000 - MIN((uint64_t)idle[core] * 1000 / window, 1000);
+            if (log) {
+                ESP_LOGI(MON_TAG, "CPU%d load:  %5.1f%% (idle %5.1f%%)", core,
+                         100.0 - idle[core] * 100.0 / window, idle[core] * 100.0 / window);
+            }
         }
+    }
+
+    for (int i = 0; i < count; i++) {
+        s_mon_ctx.prev[i].handle = s_mon_ctx.status[i].xHandle;
+        s_mon_ctx.prev[i].runtime = s_mon_ctx.status[i].ulRunTimeCounter;
+    }
+    s_mon_ctx.prev_count = count;
+    s_mon_ctx.prev_total = total;
+}
+#endif
 
-        if (enc_queue) {
-            UBaseType_t enc_waiting = uxQueueMessagesWaiting(enc_queue);
-            ESP_LOGI(MON_TAG, "Enc queue:  %u/10 messages", enc_waiting);
+/* Response times of the periodic tasks, those that saw no release yet are left out */
+static void monitor_report_deadlines(void)
+{
+    os_deadline_stats_st stats;
+    TaskHandle_t task;
+
+    for (int id = 0; id < NUMOFTASK; id++) {
+        if (!os_deadline_get_stats(id, &stats) || !stats.activations) {
+            continue;
         }
+        task = os_getTaskHandler(id);
+        ESP_LOGI(MON_TAG, "Deadline:   %-10s %lu/%lu missed, worst %lu us (ever %lu), limit %lu us",
+                 task ? pcTaskGetName(task) : "?", stats.misses, stats.activations,
+                 stats.worst_us, stats.worst_ever_us, stats.deadline_us);
+    }
+}
+
+/* Text report on the console */
+static void monitor_print_report(void)
+{
+    ESP_LOGI(MON_TAG, "========== System Monitor ==========");
+    ESP_LOGI(MON_TAG, "Streaming:  %s", g_app_ctx.is_streaming ? "ACTIVE" : "IDLE");
+    ESP_LOGI(MON_TAG, "Captured:   %lu frames", g_app_ctx.total_frames_captured);
+    ESP_LOGI(MON_TAG, "Encoded:    %lu frames", g_app_ctx.total_frames_encoded);
+    ESP_LOGI(MON_TAG, "Streamed:   %lu frames", g_app_ctx.total_frames_streamed);
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    ESP_LOGI(MON_TAG, "Secondary:  %lu frames", g_app_ctx.total_frames_secondary);
+#endif
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    uvc_aux_camera_stats_t aux_stats;
+    uvc_aux_camera_get_stats(&aux_stats);
+    ESP_LOGI(MON_TAG, "Aux camera: %lu captured, %lu dropped, %lu lost, %lu errors",
+             aux_stats.captured, aux_stats.dropped, aux_stats.lost, aux_stats.errors);
+#endif
+#if CONFIG_EXAMPLE_UVC_SUB_STREAM
+    uvc_sub_stream_stats_t sub_stats;
+    uvc_sub_stream_get_stats(&sub_stats);
+    ESP_LOGI(MON_TAG, "Sub stream: %lu streamed, %lu dropped, %lu paced",
+             sub_stats.streamed, sub_stats.dropped, sub_stats.paced);
+#endif
+#if CONFIG_EXAMPLE_UVC_PU_BRIDGE
+    uvc_pu_stats_t pu_stats;
+    uvc_pu_bridge_get_stats(&pu_stats);
+    ESP_LOGI(MON_TAG, "PU ctrls:   %lu requests, %lu coalesced, %lu commits, %lu failed",
+             pu_stats.requests, pu_stats.coalesced, pu_stats.commits, pu_stats.failures);
+#endif
+    ESP_LOGI(MON_TAG, "Dropped:    %lu frames (%lu oversize)", g_app_ctx.frames_dropped, g_app_ctx.frames_oversize);
+#if CONFIG_EXAMPLE_SD_RECORD || CONFIG_EXAMPLE_MJPEG_SERVER
+    ESP_LOGI(MON_TAG, "Sinks:      %lu frames dropped", g_app_ctx.frames_sink_dropped);
+#endif
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+    ESP_LOGI(MON_TAG, "Static:     %lu frames not encoded", g_app_ctx.frames_static);
+#endif
+#if CONFIG_EXAMPLE_FRAME_PACING
+    ESP_LOGI(MON_TAG, "Paced:      %lu frames above the session rate", g_app_ctx.frames_paced);
+#endif
+#if CONFIG_EXAMPLE_STALL_WATCHDOG
+    uvc_watchdog_stats_t wdt_stats;
+    uvc_watchdog_get_stats(&wdt_stats);
+    ESP_LOGI(MON_TAG, "Stalls:     %lu capture, %lu encode, %lu restarts (last %lu ms), %lu failed",
+             wdt_stats.stalls[UVC_STAGE_CAPTURE], wdt_stats.stalls[UVC_STAGE_ENCODE], wdt_stats.recoveries,
+             wdt_stats.last_recovery_ms, wdt_stats.failures);
+#endif
+#if CONFIG_EXAMPLE_QOS
+    uvc_qos_stats_t qos_stats;
+    uvc_qos_get_stats(&qos_stats);
+    ESP_LOGI(MON_TAG, "QoS:        rung %lu (lowest %lu), %lu down, %lu up",
+             qos_stats.level, qos_stats.worst_level, qos_stats.steps_down, qos_stats.steps_up);
+#endif
+#if CONFIG_EXAMPLE_FSYNC
+    uvc_fsync_stats_t fsync_stats;
+    uvc_fsync_get_stats(&fsync_stats);
+    ESP_LOGI(MON_TAG, "Frame sync: %lu pulses, frame end +%ld us, jitter %ld us, %lu/%lu slipped",
+             fsync_stats.pulses, fsync_stats.phase_us, fsync_stats.jitter_us, fsync_stats.slipped, fsync_stats.frames);
+#endif
+    if (g_app_ctx.uvc) {
+        ESP_LOGI(MON_TAG, "Peak frame: %lu/%lu bytes", g_app_ctx.uvc->enc_peak_size, g_app_ctx.uvc->uvc_buffer_size);
+    }
+    uvc_latency_dump(MON_TAG);
 
-        /* Memory info */
-        uint32_t free_heap = esp_get_free_heap_size();
-        uint32_t min_free = esp_get_minimum_free_heap_size();
-        uint32_t free_spiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    /* Queue status */
+    QueueHandle_t raw_queue = os_getQueueHandler(QUEUE_RAW_FRAME);
+    QueueHandle_t enc_queue = os_getQueueHandler(QUEUE_ENCODED_FRAME);
 
-        ESP_LOGI(MON_TAG, "Free heap:  %lu bytes (%.2f MB)", free_heap, free_heap / 1048576.0);
-        ESP_LOGI(MON_TAG, "Min free:   %lu bytes (%.2f MB)", min_free, min_free / 1048576.0);
-        ESP_LOGI(MON_TAG, "Free PSRAM: %lu bytes (%.2f MB)", free_spiram, free_spiram / 1048576.0);
+    if (raw_queue) {
+        UBaseType_t raw_waiting = uxQueueMessagesWaiting(raw_queue);
+        ESP_LOGI(MON_TAG, "Raw queue:  %u/%u messages", raw_waiting, raw_waiting + uxQueueSpacesAvailable(raw_queue));
+    }
 
-        /* Task stack high water marks */
-        TaskHandle_t uvc_task = os_getTaskHandler(TASK_UVC_STREAM);
-        TaskHandle_t mon_task = os_getTaskHandler(TASK_MONITOR);
-        TaskHandle_t evt_task = os_getTaskHandler(TASK_EVENT_HANDLER);
+    if (enc_queue) {
+        UBaseType_t enc_waiting = uxQueueMessagesWaiting(enc_queue);
+        ESP_LOGI(MON_TAG, "Enc queue:  %u/%u messages", enc_waiting, enc_waiting + uxQueueSpacesAvailable(enc_queue));
+    }
 
-        if (uvc_task) {
-            UBaseType_t uvc_hwm = uxTaskGetStackHighWaterMark(uvc_task);
-            ESP_LOGI(MON_TAG, "UVC stream stack: %u bytes free", uvc_hwm * sizeof(StackType_t));
-        }
+    QueueHandle_t free_queue = os_getQueueHandler(QUEUE_ENCODED_FREE);
+    if (free_queue) {
+        UBaseType_t free_waiting = uxQueueMessagesWaiting(free_queue);
+        ESP_LOGI(MON_TAG, "Free pool:  %u/%d frames", free_waiting, ENCODED_FRAME_COUNT);
+    }
 
-        if (mon_task) {
-            UBaseType_t mon_hwm = uxTaskGetStackHighWaterMark(mon_task);
-            ESP_LOGI(MON_TAG, "Monitor stack:    %u bytes free", mon_hwm * sizeof(StackType_t));
-        }
+    /* Memory info */
+    uint32_t free_heap = esp_get_free_heap_size();
+    uint32_t min_free = esp_get_minimum_free_heap_size();
+    uint32_t free_spiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
 
-        if (evt_task) {
-            UBaseType_t evt_hwm = uxTaskGetStackHighWaterMark(evt_task);
-            ESP_LOGI(MON_TAG, "Event stack:      %u bytes free", evt_hwm * sizeof(StackType_t));
-        }
+    ESP_LOGI(MON_TAG, "Free heap:  %lu bytes (%.2f MB)", free_heap, free_heap / 1048576.0);
+    ESP_LOGI(MON_TAG, "Min free:   %lu bytes (%.2f MB)", min_free, min_free / 1048576.0);
+    ESP_LOGI(MON_TAG, "Free PSRAM: %lu bytes (%.2f MB)", free_spiram, free_spiram / 1048576.0);
+    memstat_dump(MON_TAG);
+
+    /* Task stack high water marks */
+    TaskHandle_t uvc_task = os_getTaskHandler(TASK_UVC_STREAM);
+    TaskHandle_t cap_task = os_getTaskHandler(TASK_CAPTURE);
+    TaskHandle_t enc_task = os_getTaskHandler(TASK_ENCODE);
+    TaskHandle_t sched_task = os_getTaskHandler(TASK_SCHED);
+    TaskHandle_t evt_task = os_getTaskHandler(TASK_EVENT_HANDLER);
 
-        ESP_LOGI(MON_TAG, "====================================");
+    if (uvc_task) {
+        UBaseType_t uvc_hwm = uxTaskGetStackHighWaterMark(uvc_task);
+        ESP_LOGI(MON_TAG, "UVC stream stack: %u bytes free", uvc_hwm * sizeof(StackType_t));
+    }
+
+    if (cap_task) {
+        UBaseType_t cap_hwm = uxTaskGetStackHighWaterMark(cap_task);
+        ESP_LOGI(MON_TAG, "Capture stack:    %u bytes free", cap_hwm * sizeof(StackType_t));
+    }
+
+    if (enc_task) {
+        UBaseType_t enc_hwm = uxTaskGetStackHighWaterMark(enc_task);
+        ESP_LOGI(MON_TAG, "Encode stack:     %u bytes free", enc_hwm * sizeof(StackType_t));
+    }
+
+    if (sched_task) {
+        UBaseType_t sched_hwm = uxTaskGetStackHighWaterMark(sched_task);
+        ESP_LOGI(MON_TAG, "Sched stack:      %u bytes free", sched_hwm * sizeof(StackType_t));
+    }
 
+    os_sched_stats_st sched_stats;
+    os_sched_get_stats(&sched_stats);
+    ESP_LOGI(MON_TAG, "Sched jobs: %lu runs in %lu wake-ups, %lu late",
+             sched_stats.runs, sched_stats.wakeups, sched_stats.late);
+    monitor_report_deadlines();
+#if CONFIG_EXAMPLE_STACK_FIT
+    os_stack_stats_st stack_stats;
+    os_stack_get_stats(&stack_stats);
+    ESP_LOGI(MON_TAG, "Stack fit:  %lu tasks fitted, %lu bytes reclaimed, %lu saves, least headroom %lu bytes",
+             stack_stats.fitted, stack_stats.reclaimed, stack_stats.saves, stack_stats.headroom);
+#endif
+
+    if (evt_task) {
+        UBaseType_t evt_hwm = uxTaskGetStackHighWaterMark(evt_task);
+        ESP_LOGI(MON_TAG, "Event stack:      %u bytes free", evt_hwm * sizeof(StackType_t));
+    }
+
+#if CONFIG_EXAMPLE_MONITOR_CPU_LOAD
+    monitor_report_cpu_load(true);
+#endif
+#if CONFIG_PROF_ENABLE
+    prof_dump_top(MON_TAG, CONFIG_PROF_TOP_N);
+#endif
+
+    ESP_LOGI(MON_TAG, "====================================");
+
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+    /* Print camera debug statistics if enabled */
+    camera_debug_print_stats();
+#endif
+}
+
+#if CONFIG_EXAMPLE_TELEMETRY
 #ifdef CONFIG_CAMERA_DEBUG_ENABLE
-        /* Print camera debug statistics if enabled */
-        camera_debug_print_stats();
+static void monitor_fill_window(telemetry_window_t *out, const camera_window_stats_t *in)
+{
+    out->fps_x100 = in->fps * 100;
+    out->bitrate_kbps = in->bitrate_kbps;
+    out->gap_avg_us = in->gap_avg_us;
+    out->gap_stddev_us = in->gap_stddev_us;
+    out->gap_max_us = in->gap_max_us;
+}
+
+/* Binary pacing record, see os_telemetry.h */
+static void monitor_push_pacing(void)
+{
+    telemetry_pacing_t pacing = {0};
+    camera_stats_t stats;
+
+    camera_debug_get_stats(&stats);
+
+    pacing.seq = s_mon_ctx.report_count;
+    monitor_fill_window(&pacing.window_1s, &stats.window_1s);
+    monitor_fill_window(&pacing.window_10s, &stats.window_10s);
+    pacing.longest_stall_us = stats.longest_stall_us;
+    pacing.stall_count = stats.stall_count;
+
+    os_telemetry_push(TELEMETRY_TYPE_PACING, &pacing, sizeof(pacing));
+}
 #endif
 
-        s_mon_ctx.report_count++;
+/* Binary status record, see os_telemetry.h */
+static void monitor_push_telemetry(void)
+{
+    telemetry_status_t status = {0};
+    uvc_latency_summary_t summary;
+    QueueHandle_t raw_queue = os_getQueueHandler(QUEUE_RAW_FRAME);
+    QueueHandle_t enc_queue = os_getQueueHandler(QUEUE_ENCODED_FRAME);
+    QueueHandle_t free_queue = os_getQueueHandler(QUEUE_ENCODED_FREE);
+
+    status.seq = s_mon_ctx.report_count;
+    status.uptime_ms = esp_timer_get_time() / 1000;
+    status.frames_captured = g_app_ctx.total_frames_captured;
+    status.frames_encoded = g_app_ctx.total_frames_encoded;
+    status.frames_streamed = g_app_ctx.total_frames_streamed;
+    status.frames_secondary = g_app_ctx.total_frames_secondary;
+    status.frames_dropped = g_app_ctx.frames_dropped;
+    status.frames_oversize = g_app_ctx.frames_oversize;
+    status.frames_static = g_app_ctx.frames_static;
+    if (g_app_ctx.uvc) {
+        status.enc_peak_size = g_app_ctx.uvc->enc_peak_size;
+        status.uvc_buffer_size = g_app_ctx.uvc->uvc_buffer_size;
+    }
+    status.free_heap = esp_get_free_heap_size();
+    status.min_free_heap = esp_get_minimum_free_heap_size();
+    status.free_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    status.streaming = g_app_ctx.is_streaming;
+    status.raw_queue = raw_queue ? uxQueueMessagesWaiting(raw_queue) : 0;
+    status.enc_queue = enc_queue ? uxQueueMessagesWaiting(enc_queue) : 0;
+    status.free_pool = free_queue ? uxQueueMessagesWaiting(free_queue) : 0;
+
+#if CONFIG_EXAMPLE_MONITOR_CPU_LOAD
+    monitor_report_cpu_load(false);
+#endif
+    for (int core = 0; core < TELEMETRY_CORES; core++) {
+        status.cpu_load[core] = core < portNUM_PROCESSORS ? s_mon_ctx.cpu_load[core] : 0;
+    }
+
+    for (int stage = 0; stage < TELEMETRY_LAT_STAGES; stage++) {
+        uvc_latency_get(stage, &summary);
+        status.latency[stage].count = summary.count;
+        status.latency[stage].p50_us = summary.p50_us;
+        status.latency[stage].p95_us = summary.p95_us;
+        status.latency[stage].p99_us = summary.p99_us;
+        status.latency[stage].max_us = summary.max_us;
     }
 
-    ESP_LOGI(MON_TAG, "Monitor task exiting");
-    vTaskDelete(NULL);
+    os_telemetry_push(TELEMETRY_TYPE_STATUS, &status, sizeof(status));
+
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+    monitor_push_pacing();
+#endif
+}
+#endif
+
+/* ========== Periodic Job ========== */
+static void monitor_job(void *arg)
+{
+#if CONFIG_EXAMPLE_TELEMETRY
+    monitor_push_telemetry();
+#else
+    monitor_print_report();
+#endif
+
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+    /* Captured frames are dumped here, away from the streaming path */
+    camera_debug_capture_flush();
+#endif
+
+    s_mon_ctx.report_count++;
 }
 
 /* ========== Terminate Phase ========== */
 void terMonitorTask(void *arg)
 {
     ESP_LOGI(MON_TAG, "Terminating monitor task...");
-    ESP_LOGI(MON_TAG, "Printed %lu monitor reports", s_mon_ctx.report_count);
+    if (s_mon_ctx.job >= 0) {
+        os_sched_unregister(s_mon_ctx.job);
+    }
+    ESP_LOGI(MON_TAG, "Produced %lu monitor reports", s_mon_ctx.report_count);
 }
@@ -0,0 +1,248 @@
+/*
+ * OS Boot - Boot timeline, deferred logging and deferred init
+ *
+ * The log buffer is append only. The flush copies it out a chunk at a time and
+ * prints outside the lock, lines logged meanwhile are appended behind and go
+ * out in order, so no task waits for the console while holding the lock.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uvc_app_common.h"
+#include "os_boot.h"
+
+#define OS_BOOT_FLUSH_CHUNK     256
+
+typedef struct {
+    const char *name;
+    int64_t time;                       // esp_timer time, us since the app started
+} os_boot_mark_st;
+
+/* Boot context */
+typedef struct {
+    portMUX_TYPE lock;                  // Guards the marks, the deferred list and the flags
+    os_boot_mark_st marks[OS_BOOT_MAX_MARKS];
+    uint32_t mark_count;
+    os_boot_fn deferred[OS_BOOT_MAX_DEFERRED];
+    uint32_t deferred_count;
+    bool done;                          // SYS_EVENT_BOOT_DONE posted
+    bool finished;                      // Deferred init ran, later os_boot_defer() calls run at once
+#if CONFIG_EXAMPLE_FAST_BOOT
+    esp_timer_handle_t timer;           // Ends the boot without a host
+    SemaphoreHandle_t log_lock;         // Guards the log buffer, logging tasks may block on it
+    vprintf_like_t console;             // Log output before buffering, restored by the flush
+    bool buffering;
+    uint32_t log_len;
+    uint32_t log_dropped;               // Lines past the buffer
+#endif
+} os_boot_ctx_t;
+
+static const char *TAG = "os_boot";
+
+static os_boot_ctx_t s_boot = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+#if CONFIG_EXAMPLE_FAST_BOOT
+static char s_boot_log[CONFIG_EXAMPLE_FAST_BOOT_LOG_BUFFER_SIZE];
+
+static int os_boot_vprintf(const char *fmt, va_list args)
+{
+    int len;
+    uint32_t room;
+
+    xSemaphoreTake(s_boot.log_lock, portMAX_DELAY);
+
+    if (!s_boot.buffering) {
+        xSemaphoreGive(s_boot.log_lock);
+        return s_boot.console(fmt, args);
+    }
+
+    room = sizeof(s_boot_log) - s_boot.log_len;
+    len = vsnprintf(s_boot_log + s_boot.log_len, room, fmt, args);
+    if (len < 0 || (uint32_t)len >= room) {
+        /* A cut line would run into the next one */
+        s_boot.log_dropped++;
+    } else {
+        s_boot.log_len += len;
+    }
+
+    xSemaphoreGive(s_boot.log_lock);
+
+    return len;
+}
+
+static int os_boot_console(const char *fmt, ...)
+{
+    int ret;
+    va_list args;
+
+    va_start(args, fmt);
+    ret = s_boot.console(fmt, args);
+    va_end(args);
+
+    return ret;
+}
+
+static void os_boot_flush(void)
+{
+    static char chunk[OS_BOOT_FLUSH_CHUNK];
+    uint32_t flushed = 0;
+    uint32_t len;
+
+    while (1) {
+        xSemaphoreTake(s_boot.log_lock, portMAX_DELAY);
+        if (flushed == s_boot.log_len) {
+            s_boot.buffering = false;
+            esp_log_set_vprintf(s_boot.console);
+            xSemaphoreGive(s_boot.log_lock);
+            break;
+        }
+        len = MIN(s_boot.log_len - flushed, sizeof(chunk));
+        memcpy(chunk, s_boot_log + flushed, len);
+        flushed += len;
+        xSemaphoreGive(s_boot.log_lock);
+
+        os_boot_console("%.*s", (int)len, chunk);
+    }
+
+    if (s_boot.log_dropped) {
+        ESP_LOGW(TAG, "%lu boot log lines dropped, raise CONFIG_EXAMPLE_FAST_BOOT_LOG_BUFFER_SIZE",
+                 s_boot.log_dropped);
+    }
+}
+
+static void os_boot_post(const char *mark);
+
+static void os_boot_timer_cb(void *arg)
+{
+    os_boot_post("no_host");
+}
+#endif
+
+void os_boot_start(void)
+{
+    os_boot_mark("app_main");
+
+#if CONFIG_EXAMPLE_FAST_BOOT
+    const esp_timer_create_args_t timer_args = {
+        .callback = os_boot_timer_cb,
+        .name = "os_boot",
+    };
+
+    s_boot.log_lock = xSemaphoreCreateMutex();
+    if (!s_boot.log_lock) {
+        ESP_LOGE(TAG, "Failed to create the log lock, logging to the console");
+        return;
+    }
+
+    if (esp_timer_create(&timer_args, &s_boot.timer) == ESP_OK) {
+        esp_timer_start_once(s_boot.timer, (uint64_t)CONFIG_EXAMPLE_FAST_BOOT_TIMEOUT_MS * 1000);
+    }
+
+    s_boot.buffering = true;
+    s_boot.console = esp_log_set_vprintf(os_boot_vprintf);
+#endif
+}
+
+void os_boot_mark(const char *name)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_boot.lock);
+    if (s_boot.mark_count < OS_BOOT_MAX_MARKS) {
+        s_boot.marks[s_boot.mark_count].name = name;
+        s_boot.marks[s_boot.mark_count].time = now;
+        s_boot.mark_count++;
+    }
+    portEXIT_CRITICAL(&s_boot.lock);
+}
+
+void os_boot_defer(os_boot_fn fn)
+{
+    bool now = true;
+
+#if CONFIG_EXAMPLE_FAST_BOOT
+    portENTER_CRITICAL(&s_boot.lock);
+    if (!s_boot.finished && s_boot.deferred_count < OS_BOOT_MAX_DEFERRED) {
+        s_boot.deferred[s_boot.deferred_count++] = fn;
+        now = false;
+    }
+    portEXIT_CRITICAL(&s_boot.lock);
+#endif
+
+    if (now) {
+        fn();
+    }
+}
+
+static void os_boot_post(const char *mark)
+{
+    bool first;
+
+    portENTER_CRITICAL(&s_boot.lock);
+    first = !s_boot.done;
+    s_boot.done = true;
+    portEXIT_CRITICAL(&s_boot.lock);
+
+    if (!first) {
+        return;
+    }
+
+    os_boot_mark(mark);
+#if CONFIG_EXAMPLE_FAST_BOOT
+    esp_timer_stop(s_boot.timer);
+#endif
+
+    /* The event handler does the slow part, with no queue it runs here */
+    if (app_post_event(SYS_EVENT_BOOT_DONE, NULL, 0) != ESP_OK) {
+        os_boot_finish();
+    }
+}
+
+void os_boot_done(void)
+{
+    /* Read without the lock, a late first call only posts once */
+    if (!s_boot.done) {
+        os_boot_post("first_frame");
+    }
+}
+
+void os_boot_finish(void)
+{
+    uint32_t count;
+    os_boot_fn deferred[OS_BOOT_MAX_DEFERRED];
+
+    portENTER_CRITICAL(&s_boot.lock);
+    if (s_boot.finished) {
+        portEXIT_CRITICAL(&s_boot.lock);
+        return;
+    }
+    s_boot.finished = true;
+    count = s_boot.deferred_count;
+    memcpy(deferred, s_boot.deferred, sizeof(deferred));
+    portEXIT_CRITICAL(&s_boot.lock);
+
+#if CONFIG_EXAMPLE_FAST_BOOT
+    if (s_boot.buffering) {
+        os_boot_flush();
+    }
+#endif
+
+    /* Marks are only appended, the ones recorded so far stay as they are */
+    ESP_LOGI(TAG, "Boot timeline, ms since the app started:");
+    for (uint32_t i = 0; i < s_boot.mark_count; i++) {
+        ESP_LOGI(TAG, "  %-14s %6lld  +%lld", s_boot.marks[i].name, s_boot.marks[i].time / 1000,
+                 (s_boot.marks[i].time - (i ? s_boot.marks[i - 1].time : 0)) / 1000);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        deferred[i]();
+    }
+}
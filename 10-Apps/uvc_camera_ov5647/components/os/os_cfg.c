@@ -7,6 +7,7 @@
 #include "esp_log.h"
 #include "os_service.h"
 #include "os_interface.h"
+#include "os_boot.h"
 #include "uvc_app_common.h"
 
 /* Task entry points - declared in respective task modules */
@@ -14,6 +15,14 @@ extern void initUvcStreamTask(void *arg);
 extern void mainUvcStreamTask(void *arg);
 extern void terUvcStreamTask(void *arg);
 
+extern void initCaptureTask(void *arg);
+extern void mainCaptureTask(void *arg);
+extern void terCaptureTask(void *arg);
+
+extern void initEncodeTask(void *arg);
+extern void mainEncodeTask(void *arg);
+extern void terEncodeTask(void *arg);
+
 extern void initMonitorTask(void *arg);
 extern void mainMonitorTask(void *arg);
 extern void terMonitorTask(void *arg);
@@ -22,24 +31,293 @@ extern void initEventHandlerTask(void *arg);
 extern void mainEventHandlerTask(void *arg);
 extern void terEventHandlerTask(void *arg);
 
+extern void initSchedTask(void *arg);
+extern void mainSchedTask(void *arg);
+extern void terSchedTask(void *arg);
+
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+extern void initSecondaryTask(void *arg);
+extern void mainSecondaryTask(void *arg);
+extern void terSecondaryTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_AUX_CAMERA
+extern void initAuxCaptureTask(void *arg);
+extern void mainAuxCaptureTask(void *arg);
+extern void terAuxCaptureTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_TELEMETRY
+extern void initTelemetryTask(void *arg);
+extern void mainTelemetryTask(void *arg);
+extern void terTelemetryTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_PTP
+extern void initPtpTask(void *arg);
+extern void mainPtpTask(void *arg);
+extern void terPtpTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_RTSP_SERVER
+extern void initRtspTask(void *arg);
+extern void mainRtspTask(void *arg);
+extern void terRtspTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_MJPEG_SERVER
+extern void initMjpegTask(void *arg);
+extern void mainMjpegTask(void *arg);
+extern void terMjpegTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_SD_RECORD
+extern void initRecordTask(void *arg);
+extern void mainRecordTask(void *arg);
+extern void mainRecordWriterTask(void *arg);
+extern void terRecordTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_MOTION
+extern void initMotionTask(void *arg);
+extern void mainMotionTask(void *arg);
+extern void terMotionTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_INFER
+extern void initInferTask(void *arg);
+extern void mainInferTask(void *arg);
+extern void terInferTask(void *arg);
+#endif
+
+#if CONFIG_EXAMPLE_SCAN
+extern void initScanTask(void *arg);
+extern void mainScanTask(void *arg);
+extern void terScanTask(void *arg);
+#endif
+
+#if CONFIG_DLOG_ENABLE
+#include "dlog.h"
+#endif
+
+#if CONFIG_TRACE_ENABLE
+#include "trace.h"
+#endif
+
+#if CONFIG_PROF_ENABLE
+#include "prof.h"
+#endif
+
 static const char *TAG = "os_cfg";
 
 /* Task priority definitions */
-#define TASK_PRIORITY_UVC_STREAM    5  /* Highest: handles camera+encode+stream in callbacks */
+#define TASK_PRIORITY_CAPTURE       6  /* Highest: must never miss a sensor frame */
+#define TASK_PRIORITY_ENCODE        5
+#define TASK_PRIORITY_SECONDARY     5  /* Same as encode, so both encoders are kept busy */
+#define TASK_PRIORITY_AUX_CAPTURE   6  /* Same as capture, the aux camera must not miss frames either */
+#define TASK_PRIORITY_UVC_STREAM    4  /* USB hand-off happens in UVC callbacks */
+#define TASK_PRIORITY_PTP           3  /* Sync and Delay_Req are stamped by the EMAC, its latency doesn't count */
+#define TASK_PRIORITY_RTSP          3  /* Control only, RTP is sent from the secondary task */
+#define TASK_PRIORITY_MJPEG         3  /* Also its client tasks, sending is paced by the network */
+#define TASK_PRIORITY_RECORD        3  /* Below the streaming path, only copies frames into the staging ring */
+#define TASK_PRIORITY_RECORD_WRITER 2  /* Card I/O, its stalls are absorbed by the staging ring */
 #define TASK_PRIORITY_EVENT         2
+#define TASK_PRIORITY_MOTION        2  /* Analyses a frame every CONFIG_EXAMPLE_MOTION_PERIOD_MS, drops the rest */
+#define TASK_PRIORITY_INFER         2  /* Runs the model, below the streaming path which it must not slow down */
+#define TASK_PRIORITY_SCAN          4  /* Owns the camera in scan mode, nothing else streams meanwhile */
 #define TASK_PRIORITY_MONITOR       1
+#define TASK_PRIORITY_SCHED         1  /* Slow periodic jobs, see os_sched.h */
+#define TASK_PRIORITY_TELEMETRY     1
+#define TASK_PRIORITY_DLOG          1  /* Prints what the hot paths logged, whenever nothing else runs */
 
 /* Task stack sizes */
-#define STACK_SIZE_UVC_STREAM       (8 * 1024)  /* Increased: handles camera+encode+stream */
+#define STACK_SIZE_UVC_STREAM       (4 * 1024)
+#define STACK_SIZE_CAPTURE          (4 * 1024)
+#define STACK_SIZE_ENCODE           (4 * 1024)
+#define STACK_SIZE_SECONDARY        (4 * 1024)
+#define STACK_SIZE_AUX_CAPTURE      (3 * 1024)
 #define STACK_SIZE_EVENT            (4 * 1024)
 #define STACK_SIZE_MONITOR          (4 * 1024)
+#define STACK_SIZE_SCHED            (4 * 1024)  /* Shared by all jobs, the monitor report is the deepest */
+#define STACK_SIZE_TELEMETRY        (3 * 1024)
+#define STACK_SIZE_PTP              (3 * 1024)
+#define STACK_SIZE_RTSP             (4 * 1024)
+#define STACK_SIZE_MJPEG            (3 * 1024)
+#define STACK_SIZE_RECORD           (4 * 1024)
+#if CONFIG_EXAMPLE_SD_IPA_REPLAY
+#define STACK_SIZE_RECORD_WRITER    (8 * 1024)  /* The image algorithms run on this stack at boot */
+#else
+#define STACK_SIZE_RECORD_WRITER    (4 * 1024)
+#endif
+#define STACK_SIZE_MOTION           (4 * 1024)
+#define STACK_SIZE_INFER            CONFIG_EXAMPLE_INFER_STACK_SIZE    /* The model runs in the callback */
+#define STACK_SIZE_SCAN             (8 * 1024)  /* The decoder runs on this stack */
+#define STACK_SIZE_DLOG             (3 * 1024)
+
+/*
+ * Core layout
+ *
+ * Capture, encode and the USB hand-off share the streaming core, so frame
+ * descriptors and refcounts stay in one core's cache. TinyUSB is pinned there
+ * by CONFIG_UVC_TINYUSB_TASK_CORE. Housekeeping and the secondary encoder run
+ * on the other core, together with the ISP pipeline task (AE/AWB/AF), see
+ * CONFIG_ESP_VIDEO_ISP_PIPELINE_TASK_CORE.
+ */
+#define CORE_STREAM                 OS_AFFINITY_PINNED, 0
+#if CONFIG_EXAMPLE_TASK_SPLIT_CORES
+#define CORE_HOUSEKEEPING           OS_AFFINITY_OPPOSITE, TASK_ENCODE
+#else
+#define CORE_HOUSEKEEPING           CORE_STREAM
+#endif
+
+/*
+ * Static task buffers
+ *
+ * Streaming path stacks and TCBs live in .bss, which is internal RAM, so they
+ * are reserved at link time and never land in PSRAM. Housekeeping tasks keep
+ * taking their stacks from the heap.
+ */
+#if CONFIG_EXAMPLE_OS_STATIC_ALLOCATION
+#define OS_STATIC_TASK(name, size) \
+    static StackType_t name##_stack[(size) / sizeof(StackType_t)]; \
+    static StaticTask_t name##_tcb;
+#define OS_STATIC_BUFFERS(name)     name##_stack, &name##_tcb
+
+OS_STATIC_TASK(s_uvc_stream, STACK_SIZE_UVC_STREAM)
+OS_STATIC_TASK(s_capture, STACK_SIZE_CAPTURE)
+OS_STATIC_TASK(s_encode, STACK_SIZE_ENCODE)
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+OS_STATIC_TASK(s_secondary, STACK_SIZE_SECONDARY)
+#endif
+#else
+#define OS_STATIC_BUFFERS(name)     NULL, NULL
+#endif
+#define OS_HEAP_BUFFERS             NULL, NULL
+
+/*
+ * Periods and deadlines
+ *
+ * os_startup() hands the priorities of the periodic tasks out again by period,
+ * the shortest period gets the highest of them, tasks with equal periods keep
+ * their order by the priorities above. Aperiodic tasks keep theirs. The frame
+ * tasks run at the nominal UVC frame rate, a session at a lower rate has more
+ * time per frame than their deadline allows, so misses are counted
+ * conservatively.
+ */
+#define PERIOD_FRAME_US             (1000000 / CONFIG_UVC_CAM1_FRAMERATE)
+#define OS_PERIODIC(period, deadline)   (period), (deadline)
+#define OS_APERIODIC                0, 0
 
 /* Task configuration table */
 const taskcfg_st taskcfg_tb[NUMOFTASK] = {
-    /* taskname         initfunc            mainfunc            terfunc             stacksize               priority                core */
-    {"uvc_stream",      initUvcStreamTask,  mainUvcStreamTask,  terUvcStreamTask,   STACK_SIZE_UVC_STREAM,  TASK_PRIORITY_UVC_STREAM, 0},
-    {"monitor",         initMonitorTask,    mainMonitorTask,    terMonitorTask,     STACK_SIZE_MONITOR,     TASK_PRIORITY_MONITOR,  0},
-    {"event",           initEventHandlerTask, mainEventHandlerTask, terEventHandlerTask, STACK_SIZE_EVENT,   TASK_PRIORITY_EVENT,    0},
+    /* taskname         initfunc            mainfunc            terfunc             stacksize               priority                affinity, core      stackbuf, tcbbuf      period, deadline */
+    {"uvc_stream",      initUvcStreamTask,  mainUvcStreamTask,  terUvcStreamTask,   STACK_SIZE_UVC_STREAM,  TASK_PRIORITY_UVC_STREAM, CORE_STREAM,     OS_STATIC_BUFFERS(s_uvc_stream), OS_PERIODIC(PERIOD_FRAME_US, 0)},
+    {"capture",         initCaptureTask,    mainCaptureTask,    terCaptureTask,     STACK_SIZE_CAPTURE,     TASK_PRIORITY_CAPTURE,  CORE_STREAM,        OS_STATIC_BUFFERS(s_capture), OS_PERIODIC(PERIOD_FRAME_US, 0)},
+    {"encode",          initEncodeTask,     mainEncodeTask,     terEncodeTask,      STACK_SIZE_ENCODE,      TASK_PRIORITY_ENCODE,   CORE_STREAM,        OS_STATIC_BUFFERS(s_encode), OS_PERIODIC(PERIOD_FRAME_US, 0)},
+    /* The monitor report is a job of the sched task, no thread of its own */
+    {"monitor",         initMonitorTask,    NULL,               terMonitorTask,     STACK_SIZE_MONITOR,     TASK_PRIORITY_MONITOR,  CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+    {"event",           initEventHandlerTask, mainEventHandlerTask, terEventHandlerTask, STACK_SIZE_EVENT,   TASK_PRIORITY_EVENT,    CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+    {"sched",           initSchedTask,      mainSchedTask,      terSchedTask,       STACK_SIZE_SCHED,       TASK_PRIORITY_SCHED,    CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    {"secondary",       initSecondaryTask,  mainSecondaryTask,  terSecondaryTask,   STACK_SIZE_SECONDARY,   TASK_PRIORITY_SECONDARY, CORE_HOUSEKEEPING, OS_STATIC_BUFFERS(s_secondary), OS_PERIODIC(PERIOD_FRAME_US, 0)},
+#endif
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    /* Next to the secondary encoder it feeds, away from the main pipeline */
+    {"aux_capture",     initAuxCaptureTask, mainAuxCaptureTask, terAuxCaptureTask,  STACK_SIZE_AUX_CAPTURE, TASK_PRIORITY_AUX_CAPTURE, CORE_HOUSEKEEPING, OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_TELEMETRY
+    {"telemetry",       initTelemetryTask,  mainTelemetryTask,  terTelemetryTask,   STACK_SIZE_TELEMETRY,   TASK_PRIORITY_TELEMETRY, CORE_HOUSEKEEPING, OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_PTP
+    {"ptp",             initPtpTask,        mainPtpTask,        terPtpTask,         STACK_SIZE_PTP,         TASK_PRIORITY_PTP,      CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_RTSP_SERVER
+    {"rtsp",            initRtspTask,       mainRtspTask,       terRtspTask,        STACK_SIZE_RTSP,        TASK_PRIORITY_RTSP,     CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_MJPEG_SERVER
+    {"mjpeg",           initMjpegTask,      mainMjpegTask,      terMjpegTask,       STACK_SIZE_MJPEG,       TASK_PRIORITY_MJPEG,    CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_SD_RECORD
+    {"record",          initRecordTask,     mainRecordTask,     terRecordTask,      STACK_SIZE_RECORD,      TASK_PRIORITY_RECORD,   CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+    {"record_wr",       NULL,               mainRecordWriterTask, NULL,             STACK_SIZE_RECORD_WRITER, TASK_PRIORITY_RECORD_WRITER, CORE_HOUSEKEEPING, OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_MOTION
+    {"motion",          initMotionTask,     mainMotionTask,     terMotionTask,      STACK_SIZE_MOTION,      TASK_PRIORITY_MOTION,   CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_PERIODIC(CONFIG_EXAMPLE_MOTION_PERIOD_MS * 1000, 0)},
+#endif
+#if CONFIG_EXAMPLE_INFER
+    {"infer",           initInferTask,      mainInferTask,      terInferTask,       STACK_SIZE_INFER,       TASK_PRIORITY_INFER,    CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_EXAMPLE_SCAN
+    {"scan",            initScanTask,       mainScanTask,       terScanTask,        STACK_SIZE_SCAN,        TASK_PRIORITY_SCAN,     CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+#if CONFIG_DLOG_ENABLE
+    {"dlog",            NULL,               dlog_drain_task,    NULL,               STACK_SIZE_DLOG,        TASK_PRIORITY_DLOG,     CORE_HOUSEKEEPING,  OS_HEAP_BUFFERS, OS_APERIODIC},
+#endif
+};
+
+/* Queue depths, every buffer that can be in flight fits, so a send never has to wait */
+#define QUEUE_DEPTH_RAW_FRAME       BUFFER_COUNT_MAX
+#define QUEUE_DEPTH_ENCODED         ENCODED_FRAME_COUNT
+#define QUEUE_DEPTH_SYSTEM_EVENT    10
+/* Blocking sink, it may hold all but one encoder buffer so the encoder always has one to fill */
+#define QUEUE_DEPTH_RECORD          (ENCODED_FRAME_COUNT > 2 ? ENCODED_FRAME_COUNT - 2 : 1)
+/* Lossy consumer, a frame arriving while the last one is analysed is dropped by the capture fan-out */
+/* Live sink, the server only keeps the newest frame */
+#define QUEUE_DEPTH_MJPEG           1
+#define QUEUE_DEPTH_MOTION_RAW      1
+#define QUEUE_DEPTH_INFER_RAW       1
+
+#if CONFIG_EXAMPLE_OS_STATIC_ALLOCATION
+#define OS_STATIC_QUEUE(name, depth, size) \
+    static uint8_t name##_storage[(depth) * (size)]; \
+    static StaticQueue_t name##_queue;
+#define OS_STATIC_QUEUE_BUFFERS(name)   name##_storage, &name##_queue
+
+OS_STATIC_QUEUE(s_raw_frame, QUEUE_DEPTH_RAW_FRAME, sizeof(frame_buffer_t *))
+OS_STATIC_QUEUE(s_encoded_frame, QUEUE_DEPTH_ENCODED, sizeof(frame_buffer_t *))
+OS_STATIC_QUEUE(s_encoded_free, QUEUE_DEPTH_ENCODED, sizeof(frame_buffer_t *))
+OS_STATIC_QUEUE(s_system_event, QUEUE_DEPTH_SYSTEM_EVENT, sizeof(system_event_t))
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+OS_STATIC_QUEUE(s_secondary_raw, QUEUE_DEPTH_RAW_FRAME, sizeof(frame_buffer_t *))
+#endif
+#if CONFIG_EXAMPLE_SD_RECORD
+OS_STATIC_QUEUE(s_record, QUEUE_DEPTH_RECORD, sizeof(frame_buffer_t *))
+#endif
+#if CONFIG_EXAMPLE_MJPEG_SERVER
+OS_STATIC_QUEUE(s_mjpeg, QUEUE_DEPTH_MJPEG, sizeof(frame_buffer_t *))
+#endif
+#if CONFIG_EXAMPLE_MOTION
+OS_STATIC_QUEUE(s_motion_raw, QUEUE_DEPTH_MOTION_RAW, sizeof(frame_buffer_t *))
+#endif
+#if CONFIG_EXAMPLE_INFER
+OS_STATIC_QUEUE(s_infer_raw, QUEUE_DEPTH_INFER_RAW, sizeof(frame_buffer_t *))
+#endif
+#else
+#define OS_STATIC_QUEUE_BUFFERS(name)   NULL, NULL
+#endif
+
+/* Queue configuration table, frames are shared refcounted descriptors and are passed by pointer */
+const queuecfg_st queuecfg_tb[NUMOFQUEUE] = {
+    /* queuename        depth                       itemsize                    storagebuf, queuebuf */
+    {"raw_frame",       QUEUE_DEPTH_RAW_FRAME,      sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_raw_frame)},
+    {"encoded_frame",   QUEUE_DEPTH_ENCODED,        sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_encoded_frame)},
+    {"encoded_free",    QUEUE_DEPTH_ENCODED,        sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_encoded_free)},
+    {"system_event",    QUEUE_DEPTH_SYSTEM_EVENT,   sizeof(system_event_t),     OS_STATIC_QUEUE_BUFFERS(s_system_event)},
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    {"secondary_raw",   QUEUE_DEPTH_RAW_FRAME,      sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_secondary_raw)},
+#endif
+#if CONFIG_EXAMPLE_SD_RECORD
+    {"record",          QUEUE_DEPTH_RECORD,         sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_record)},
+#endif
+#if CONFIG_EXAMPLE_MJPEG_SERVER
+    {"mjpeg",           QUEUE_DEPTH_MJPEG,          sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_mjpeg)},
+#endif
+#if CONFIG_EXAMPLE_MOTION
+    {"motion_raw",      QUEUE_DEPTH_MOTION_RAW,     sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_motion_raw)},
+#endif
+#if CONFIG_EXAMPLE_INFER
+    {"infer_raw",       QUEUE_DEPTH_INFER_RAW,      sizeof(frame_buffer_t *),   OS_STATIC_QUEUE_BUFFERS(s_infer_raw)},
+#endif
 };
 
 /* Global initialization - called before tasks are created */
@@ -47,12 +325,20 @@ void os_init_stuff(void)
 {
     ESP_LOGI(TAG, "Initializing common subsystems...");
 
-    /* Initialize video hardware */
+    /* Before the video hardware, so its bring-up is on the timeline too */
+#if CONFIG_TRACE_ENABLE
+    APP_LOG_ON_ERROR(trace_start(), TAG, "Pipeline trace not recording");
+#endif
+#if CONFIG_PROF_ENABLE
+    APP_LOG_ON_ERROR(prof_start(), TAG, "Profiler not sampling");
+#endif
+
+    /* Initialize video hardware, in the background with CONFIG_EXAMPLE_PARALLEL_BOOT */
     uvc_app_hw_init();
 
-    /* Initialize debug if enabled */
+    /* Initialize debug if enabled, not needed for the first frame */
 #ifdef CONFIG_CAMERA_DEBUG_ENABLE
-    uvc_app_debug_init();
+    os_boot_defer(uvc_app_debug_init);
 #endif
 
     ESP_LOGI(TAG, "Common subsystems initialized");
@@ -0,0 +1,250 @@
+/*
+ * OS Stack - Task stacks fitted to their measured peaks
+ *
+ * The high water mark of a task is the least free stack since its creation,
+ * so sampling it now and then sees every peak, however short. The peaks only
+ * grow, NVS is written at most once per sample period and only while they do.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_app_desc.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "os_service.h"
+#include "os_interface.h"
+#include "os_sched.h"
+#include "os_stack.h"
+
+#define STACK_NAMESPACE         "os_stack"
+#define STACK_FW_KEY            "fw"
+#define STACK_FW_LEN            17      /* 16 hex digits of the ELF SHA-256 and the terminator */
+#define STACK_SAMPLE_MS         30000
+#define STACK_SAMPLE_TOLERANCE  10000
+#define STACK_MIN_HEADROOM      512     /* Least margin above a peak, whatever the percentage gives */
+#define STACK_ALIGN             16
+
+static const char *TAG = "os_stack";
+
+extern const taskcfg_st taskcfg_tb[];
+
+typedef struct {
+    bool nvs_ready;
+    bool fit;                           // Saved peaks apply to this boot
+    uint32_t size[NUMOFTASK];           // Stack each task was created with
+    uint32_t peak[NUMOFTASK];           // Highest use seen, saved or measured
+    uint32_t saved[NUMOFTASK];          // Peaks as they are in NVS
+    os_sched_job_id job;
+    os_stack_stats_st stats;
+} os_stack_ctx_t;
+
+static os_stack_ctx_t s_stack = {
+    .job = -1,
+};
+
+/* A crash with fitted stacks may have been an overflow, the table sizes are safe */
+static bool stack_reset_was_crash(void)
+{
+    switch (esp_reset_reason()) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void os_stack_load(void)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    char fw[STACK_FW_LEN];
+    char saved[STACK_FW_LEN];
+    size_t len = sizeof(saved);
+    uint16_t idx;
+
+    /* Also done by the video bring-up, which may still be running, NVS allows both */
+    ret = nvs_flash_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "NVS not available (%s), stacks keep their table size", esp_err_to_name(ret));
+        return;
+    }
+    s_stack.nvs_ready = true;
+
+    ret = nvs_open(STACK_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace %s (%s)", STACK_NAMESPACE, esp_err_to_name(ret));
+        s_stack.nvs_ready = false;
+        return;
+    }
+
+    esp_app_get_elf_sha256(fw, sizeof(fw));
+    if (nvs_get_str(handle, STACK_FW_KEY, saved, &len) != ESP_OK || strcmp(saved, fw) != 0) {
+        /* Another image, its peaks say nothing about this code */
+        nvs_erase_all(handle);
+        ret = nvs_set_str(handle, STACK_FW_KEY, fw);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to start the stack profile (%s)", esp_err_to_name(ret));
+            s_stack.nvs_ready = false;
+            return;
+        }
+        ESP_LOGI(TAG, "No stack profile of firmware %s yet, using the table sizes", fw);
+        return;
+    }
+
+    for (idx = 0; idx < NUMOFTASK; idx++) {
+        if (nvs_get_u32(handle, taskcfg_tb[idx].taskname, &s_stack.saved[idx]) == ESP_OK) {
+            s_stack.peak[idx] = s_stack.saved[idx];
+        }
+    }
+    nvs_close(handle);
+
+    s_stack.fit = !stack_reset_was_crash();
+    if (!s_stack.fit) {
+        ESP_LOGW(TAG, "Boot after a crash, using the table stack sizes");
+    }
+}
+
+uint32_t os_stack_size(os_task_id_en task_id, uint32_t stacksize)
+{
+    uint32_t peak = s_stack.peak[task_id];
+    uint32_t size = stacksize;
+
+    if (s_stack.fit && peak && taskcfg_tb[task_id].stackbuf == NULL) {
+        size = peak + MAX(peak * CONFIG_EXAMPLE_STACK_FIT_MARGIN / 100, STACK_MIN_HEADROOM);
+        size = (size + STACK_ALIGN - 1) & ~(STACK_ALIGN - 1);
+        size = MAX(size, configMINIMAL_STACK_SIZE * sizeof(StackType_t));
+        size = MIN(size, stacksize);
+    }
+
+    if (size < stacksize) {
+        s_stack.stats.fitted++;
+        s_stack.stats.reclaimed += stacksize - size;
+        ESP_LOGI(TAG, "Task '%s' stack %lu -> %lu bytes, peak %lu", taskcfg_tb[task_id].taskname,
+                 stacksize, size, peak);
+    }
+
+    s_stack.size[task_id] = size;
+    return size;
+}
+
+static int stack_task_id(TaskHandle_t handle)
+{
+    for (int id = 0; id < NUMOFTASK; id++) {
+        if (os_getTaskHandler(id) == handle) {
+            return id;
+        }
+    }
+
+    return -1;
+}
+
+/* Write the peaks which grew since the last save */
+static void stack_save(void)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    uint16_t idx;
+
+    ret = nvs_open(STACK_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS namespace %s (%s)", STACK_NAMESPACE, esp_err_to_name(ret));
+        return;
+    }
+
+    for (idx = 0; idx < NUMOFTASK && ret == ESP_OK; idx++) {
+        if (s_stack.peak[idx] <= s_stack.saved[idx]) {
+            continue;
+        }
+        ret = nvs_set_u32(handle, taskcfg_tb[idx].taskname, s_stack.peak[idx]);
+        if (ret == ESP_OK) {
+            s_stack.saved[idx] = s_stack.peak[idx];
+            ESP_LOGI(TAG, "Task '%s' stack peak %lu of %lu bytes%s", taskcfg_tb[idx].taskname,
+                     s_stack.peak[idx], s_stack.size[idx],
+                     taskcfg_tb[idx].stackbuf ? ", static, see its STACK_SIZE_" : "");
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save the stack peaks (%s)", esp_err_to_name(ret));
+        return;
+    }
+    s_stack.stats.saves++;
+}
+
+static void stack_sample_job(void *arg)
+{
+    TaskStatus_t *status;
+    UBaseType_t max;
+    UBaseType_t count;
+    uint32_t headroom = UINT32_MAX;
+    uint32_t free_bytes;
+    uint32_t used;
+    bool grown = false;
+    int id;
+
+    /* A few spare entries for tasks created meanwhile */
+    max = uxTaskGetNumberOfTasks() + 4;
+    status = malloc(max * sizeof(TaskStatus_t));
+    if (status == NULL) {
+        return;
+    }
+
+    /* Only live tasks are listed, a table task that has exited is never touched */
+    count = uxTaskGetSystemState(status, max, NULL);
+    for (UBaseType_t i = 0; i < count; i++) {
+        id = stack_task_id(status[i].xHandle);
+        if (id < 0 || !s_stack.size[id]) {
+            continue;
+        }
+
+        free_bytes = status[i].usStackHighWaterMark * sizeof(StackType_t);
+        used = s_stack.size[id] > free_bytes ? s_stack.size[id] - free_bytes : 0;
+        headroom = MIN(headroom, free_bytes);
+        if (used > s_stack.peak[id]) {
+            s_stack.peak[id] = used;
+            grown = true;
+        }
+    }
+    free(status);
+
+    if (headroom != UINT32_MAX) {
+        s_stack.stats.headroom = headroom;
+    }
+    if (grown) {
+        stack_save();
+    }
+}
+
+void os_stack_start(void)
+{
+    if (!s_stack.nvs_ready) {
+        return;
+    }
+
+    if (os_sched_register("os_stack", stack_sample_job, NULL, STACK_SAMPLE_MS, STACK_SAMPLE_TOLERANCE,
+                          &s_stack.job) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register the stack sampling job");
+    }
+}
+
+void os_stack_get_stats(os_stack_stats_st *ret_stats)
+{
+    *ret_stats = s_stack.stats;
+}
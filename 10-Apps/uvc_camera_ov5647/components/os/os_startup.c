@@ -5,29 +5,126 @@
 
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include "os_service.h"
 #include "os_interface.h"
+#include "os_boot.h"
+#include "os_stack.h"
 
 static const char *TAG = "os_startup";
 
 extern const taskcfg_st taskcfg_tb[];
+extern const queuecfg_st queuecfg_tb[];
 extern void os_init_stuff(void);
 
 /* Storage for task handles and queue handles */
 taskhdler_st taskbox[NUMOFTASK] = {0};
 QueueHandle_t queuebox[NUMOFQUEUE] = {0};
 
+/* Resolve the affinity policy of a task to a core number or tskNO_AFFINITY */
+static BaseType_t os_resolve_core(uint16_t idx, uint16_t depth)
+{
+    const taskcfg_st *cfg = &taskcfg_tb[idx];
+    BaseType_t peer;
+
+    switch (cfg->affinity) {
+    case OS_AFFINITY_PINNED:
+        if (cfg->core < 0 || cfg->core >= portNUM_PROCESSORS) {
+            ESP_LOGW(TAG, "Task '%s' pinned to missing core %d, using core 0", cfg->taskname, cfg->core);
+            return 0;
+        }
+        return cfg->core;
+
+    case OS_AFFINITY_OPPOSITE:
+        // A chain of OPPOSITE entries longer than the table is a loop
+        if (cfg->core < 0 || cfg->core >= NUMOFTASK || depth >= NUMOFTASK) {
+            ESP_LOGW(TAG, "Task '%s' has no valid peer task, not pinning it", cfg->taskname);
+            return tskNO_AFFINITY;
+        }
+        peer = os_resolve_core(cfg->core, depth + 1);
+        if (peer == tskNO_AFFINITY) {
+            return tskNO_AFFINITY;
+        }
+        return (peer + 1) % portNUM_PROCESSORS;
+
+    case OS_AFFINITY_ANY:
+    default:
+        return tskNO_AFFINITY;
+    }
+}
+
+static uint32_t os_deadline_us(uint16_t idx)
+{
+    return taskcfg_tb[idx].deadline_us ? taskcfg_tb[idx].deadline_us : taskcfg_tb[idx].period_us;
+}
+
+/*
+ * Rate-monotonic priorities
+ *
+ * The periodic tasks are ordered by period, the shortest first, and get the
+ * priorities they have in the table again in descending order. Equal periods
+ * keep the order of their table priorities, so the table still breaks ties,
+ * e.g. capture above encode above the USB hand-off at the same frame rate.
+ * Aperiodic tasks keep their table priority.
+ */
+static void os_assign_priorities(UBaseType_t *priorities)
+{
+    uint16_t order[NUMOFTASK];
+    UBaseType_t pool[NUMOFTASK];
+    uint16_t count = 0;
+    uint16_t idx;
+    uint16_t i;
+    uint16_t j;
+
+    for (idx = 0; idx < NUMOFTASK; idx++) {
+        priorities[idx] = taskcfg_tb[idx].priority;
+        if (!taskcfg_tb[idx].period_us) {
+            continue;
+        }
+
+        // Insertion sorts, tasks by period then table priority, priorities descending
+        for (i = count; i > 0; i--) {
+            const taskcfg_st *prev = &taskcfg_tb[order[i - 1]];
+            if (prev->period_us < taskcfg_tb[idx].period_us ||
+                (prev->period_us == taskcfg_tb[idx].period_us && prev->priority >= taskcfg_tb[idx].priority)) {
+                break;
+            }
+            order[i] = order[i - 1];
+        }
+        order[i] = idx;
+
+        for (j = count; j > 0 && pool[j - 1] < taskcfg_tb[idx].priority; j--) {
+            pool[j] = pool[j - 1];
+        }
+        pool[j] = taskcfg_tb[idx].priority;
+        count++;
+    }
+
+    for (i = 0; i < count; i++) {
+        idx = order[i];
+        priorities[idx] = pool[i];
+        if (pool[i] != taskcfg_tb[idx].priority) {
+            ESP_LOGI(TAG, "Task '%s' period %lu us, priority %u -> %u", taskcfg_tb[idx].taskname,
+                     taskcfg_tb[idx].period_us, taskcfg_tb[idx].priority, pool[i]);
+        }
+    }
+}
+
 void os_startup(void)
 {
     uint16_t idx;
     BaseType_t ret;
+    BaseType_t core;
+    UBaseType_t priorities[NUMOFTASK];
+    uint32_t stacksize;
     TaskHandle_t taskhdl;
     QueueHandle_t queuehdl;
 
     // Run initialization functions
     ESP_LOGI(TAG, "Application starting up...");
     os_init_stuff();
+    os_boot_mark("init_stuff");
 
     // Call individual task init functions
     for (idx = 0; idx < NUMOFTASK; idx++) {
@@ -36,38 +133,63 @@ void os_startup(void)
             taskcfg_tb[idx].initfunc(NULL);
         }
     }
+    os_boot_mark("task_init");
 
     // Create queues
     ESP_LOGI(TAG, "Creating queues...");
     for (idx = 0; idx < NUMOFQUEUE; idx++) {
-        queuehdl = xQueueCreate(OS_QUEUE_MAX_ITEMS, OS_QUEUE_ITEM_SIZE);
+        if (queuecfg_tb[idx].storagebuf != NULL && queuecfg_tb[idx].queuebuf != NULL) {
+            queuehdl = xQueueCreateStatic(queuecfg_tb[idx].depth, queuecfg_tb[idx].itemsize,
+                                          queuecfg_tb[idx].storagebuf, queuecfg_tb[idx].queuebuf);
+        } else {
+            queuehdl = xQueueCreate(queuecfg_tb[idx].depth, queuecfg_tb[idx].itemsize);
+        }
 
         if (queuehdl != NULL) {
             queuebox[idx] = queuehdl;
-            ESP_LOGI(TAG, "Queue[%d] created successfully", idx);
+            ESP_LOGI(TAG, "Queue '%s' created successfully (%lu x %lu bytes)", queuecfg_tb[idx].queuename,
+                     queuecfg_tb[idx].depth, queuecfg_tb[idx].itemsize);
         } else {
-            ESP_LOGE(TAG, "Failed to create Queue index %d", idx);
+            ESP_LOGE(TAG, "Failed to create queue: %s", queuecfg_tb[idx].queuename);
         }
     }
 
     // Create tasks
     ESP_LOGI(TAG, "Creating tasks...");
+    os_assign_priorities(priorities);
+    os_stack_load();
     for (idx = 0; idx < NUMOFTASK; idx++) {
         if (taskcfg_tb[idx].mainfunc != NULL) {
-            ret = xTaskCreatePinnedToCore(
-                taskcfg_tb[idx].mainfunc,
-                taskcfg_tb[idx].taskname,
-                taskcfg_tb[idx].stacksize,
-                NULL,
-                taskcfg_tb[idx].priority,
-                &taskhdl,
-                taskcfg_tb[idx].core
-            );
+            core = os_resolve_core(idx, 0);
+            stacksize = os_stack_size(idx, taskcfg_tb[idx].stacksize);
+            if (taskcfg_tb[idx].stackbuf != NULL && taskcfg_tb[idx].tcbbuf != NULL) {
+                taskhdl = xTaskCreateStaticPinnedToCore(
+                    taskcfg_tb[idx].mainfunc,
+                    taskcfg_tb[idx].taskname,
+                    stacksize,
+                    NULL,
+                    priorities[idx],
+                    taskcfg_tb[idx].stackbuf,
+                    taskcfg_tb[idx].tcbbuf,
+                    core
+                );
+                ret = taskhdl != NULL ? pdPASS : pdFAIL;
+            } else {
+                ret = xTaskCreatePinnedToCore(
+                    taskcfg_tb[idx].mainfunc,
+                    taskcfg_tb[idx].taskname,
+                    stacksize,
+                    NULL,
+                    priorities[idx],
+                    &taskhdl,
+                    core
+                );
+            }
 
             if (ret == pdPASS) {
                 taskbox[idx].handler = taskhdl;
                 ESP_LOGI(TAG, "Task '%s' created successfully on core %d",
-                         taskcfg_tb[idx].taskname, taskcfg_tb[idx].core);
+                         taskcfg_tb[idx].taskname, core == tskNO_AFFINITY ? -1 : (int)core);
             } else {
                 ESP_LOGE(TAG, "Failed to create task: %s", taskcfg_tb[idx].taskname);
             }
@@ -77,6 +199,8 @@ void os_startup(void)
         }
     }
 
+    os_stack_start();
+    os_boot_mark("tasks");
     ESP_LOGI(TAG, "OS startup complete");
 }
 
@@ -97,3 +221,51 @@ QueueHandle_t os_getQueueHandler(os_queue_id_en queue_id)
     }
     return ret;
 }
+
+void os_deadline_record(os_task_id_en task_id, int64_t release_us)
+{
+    taskhdler_st *box;
+    int64_t response;
+
+    if (task_id >= NUMOFTASK || !taskcfg_tb[task_id].period_us || !release_us) {
+        return;
+    }
+
+    // One writer per task, the monitor reads the counters without a lock
+    box = &taskbox[task_id];
+    response = esp_timer_get_time() - release_us;
+    if (response < 0) {
+        return;
+    }
+    if (response > UINT32_MAX) {
+        response = UINT32_MAX;
+    }
+
+    box->activations++;
+    if (response > os_deadline_us(task_id)) {
+        box->misses++;
+    }
+    if (response > box->worst_us) {
+        box->worst_us = response;
+    }
+    if (response > box->worst_ever_us) {
+        box->worst_ever_us = response;
+    }
+}
+
+bool os_deadline_get_stats(os_task_id_en task_id, os_deadline_stats_st *ret_stats)
+{
+    if (task_id >= NUMOFTASK || !taskcfg_tb[task_id].period_us) {
+        return false;
+    }
+
+    ret_stats->period_us = taskcfg_tb[task_id].period_us;
+    ret_stats->deadline_us = os_deadline_us(task_id);
+    ret_stats->activations = taskbox[task_id].activations;
+    ret_stats->misses = taskbox[task_id].misses;
+    ret_stats->worst_us = taskbox[task_id].worst_us;
+    ret_stats->worst_ever_us = taskbox[task_id].worst_ever_us;
+    taskbox[task_id].worst_us = 0;
+
+    return true;
+}
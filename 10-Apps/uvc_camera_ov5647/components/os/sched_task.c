@@ -0,0 +1,233 @@
+/*
+ * Sched Task
+ *
+ * Responsibilities:
+ * - Run the periodic jobs registered with os_sched_register()
+ * - Coalesce the jobs into as few wake-ups as their tolerances allow
+ * - Pause with the rest of the housekeeping while powered down
+ */
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "uvc_app_common.h"
+#include "os_interface.h"
+#include "os_sched.h"
+
+#define SCHED_TAG               "sched"
+
+/* True if tick a is before tick b, across the tick counter wrapping around */
+#define SCHED_BEFORE(a, b)      ((int32_t)((a) - (b)) < 0)
+
+typedef struct {
+    const char *name;
+    os_sched_job_fn func;
+    void *arg;
+    TickType_t period;
+    TickType_t tolerance;
+    TickType_t due;                     // Earliest tick of the next run, the deadline is due + tolerance
+    bool used;
+} sched_job_t;
+
+/* Task context */
+typedef struct {
+    sched_job_t jobs[OS_SCHED_MAX_JOBS];
+    portMUX_TYPE lock;                  // Protects jobs, taken by the worker and the (un)registering tasks
+    os_sched_stats_st stats;
+} sched_task_ctx_t;
+
+static sched_task_ctx_t s_sched_ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/* Make the worker recompute its wake-up, it isn't running yet before os_startup() */
+static void sched_kick(void)
+{
+    TaskHandle_t task = os_getTaskHandler(TASK_SCHED);
+
+    if (task != NULL && task != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(task);
+    }
+}
+
+esp_err_t os_sched_register(const char *name, os_sched_job_fn func, void *arg,
+                            uint32_t period_ms, uint32_t tolerance_ms, os_sched_job_id *ret_id)
+{
+    os_sched_job_id id = -1;
+
+    ESP_RETURN_ON_FALSE(func && ret_id && pdMS_TO_TICKS(period_ms) > 0, ESP_ERR_INVALID_ARG, SCHED_TAG,
+                        "Invalid argument");
+
+    portENTER_CRITICAL(&s_sched_ctx.lock);
+    for (int i = 0; i < OS_SCHED_MAX_JOBS; i++) {
+        sched_job_t *job = &s_sched_ctx.jobs[i];
+        if (!job->used) {
+            job->name = name;
+            job->func = func;
+            job->arg = arg;
+            job->period = pdMS_TO_TICKS(period_ms);
+            job->tolerance = pdMS_TO_TICKS(tolerance_ms);
+            job->due = xTaskGetTickCount() + job->period;
+            job->used = true;
+            id = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_sched_ctx.lock);
+
+    ESP_RETURN_ON_FALSE(id >= 0, ESP_ERR_NO_MEM, SCHED_TAG, "No free slot for job '%s'", name);
+
+    ESP_LOGI(SCHED_TAG, "Job '%s' every %lu ms, up to %lu ms late", name, period_ms, tolerance_ms);
+    *ret_id = id;
+    sched_kick();
+
+    return ESP_OK;
+}
+
+esp_err_t os_sched_unregister(os_sched_job_id id)
+{
+    ESP_RETURN_ON_FALSE(id >= 0 && id < OS_SCHED_MAX_JOBS, ESP_ERR_INVALID_ARG, SCHED_TAG, "Invalid job %d", id);
+
+    portENTER_CRITICAL(&s_sched_ctx.lock);
+    s_sched_ctx.jobs[id].used = false;
+    portEXIT_CRITICAL(&s_sched_ctx.lock);
+
+    sched_kick();
+
+    return ESP_OK;
+}
+
+void os_sched_get_stats(os_sched_stats_st *ret_stats)
+{
+    portENTER_CRITICAL(&s_sched_ctx.lock);
+    *ret_stats = s_sched_ctx.stats;
+    portEXIT_CRITICAL(&s_sched_ctx.lock);
+}
+
+/* Earliest deadline of all jobs, false if there are none */
+static bool sched_next_deadline(TickType_t *deadline)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_sched_ctx.lock);
+    for (int i = 0; i < OS_SCHED_MAX_JOBS; i++) {
+        const sched_job_t *job = &s_sched_ctx.jobs[i];
+        if (job->used && (!found || SCHED_BEFORE(job->due + job->tolerance, *deadline))) {
+            *deadline = job->due + job->tolerance;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_sched_ctx.lock);
+
+    return found;
+}
+
+/* Run every job due by now, not only the one whose deadline woke the worker */
+static void sched_run_due(TickType_t now)
+{
+    sched_job_t run;
+
+    for (int i = 0; i < OS_SCHED_MAX_JOBS; i++) {
+        bool due = false;
+
+        portENTER_CRITICAL(&s_sched_ctx.lock);
+        sched_job_t *job = &s_sched_ctx.jobs[i];
+        if (job->used && !SCHED_BEFORE(now, job->due)) {
+            if (SCHED_BEFORE(job->due + job->tolerance, now)) {
+                s_sched_ctx.stats.late++;
+            }
+            /* Keep the phase, skip the periods that were missed entirely */
+            do {
+                job->due += job->period;
+            } while (!SCHED_BEFORE(now, job->due));
+            s_sched_ctx.stats.runs++;
+            run = *job;
+            due = true;
+        }
+        portEXIT_CRITICAL(&s_sched_ctx.lock);
+
+        /* Outside the lock, a job may (un)register jobs */
+        if (due) {
+            run.func(run.arg);
+        }
+    }
+}
+
+/* Restart every period from now, after a pause */
+static void sched_rebase(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&s_sched_ctx.lock);
+    for (int i = 0; i < OS_SCHED_MAX_JOBS; i++) {
+        s_sched_ctx.jobs[i].due = now + s_sched_ctx.jobs[i].period;
+    }
+    portEXIT_CRITICAL(&s_sched_ctx.lock);
+}
+
+/* ========== Init Phase ========== */
+void initSchedTask(void *arg)
+{
+    ESP_LOGI(SCHED_TAG, "Initializing sched task...");
+
+    /* The job table is statically initialized, modules register from their own init phase in any order */
+
+    ESP_LOGI(SCHED_TAG, "Sched task initialized");
+}
+
+/* ========== Main Loop ========== */
+void mainSchedTask(void *arg)
+{
+    TickType_t now;
+    TickType_t deadline;
+
+    ESP_LOGI(SCHED_TAG, "Sched task started on core %d", xPortGetCoreID());
+
+    /* Main loop */
+    while (1) {
+        /* Check for shutdown */
+        if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN) {
+            ESP_LOGI(SCHED_TAG, "Shutdown requested");
+            break;
+        }
+
+        /* Nothing changes while powered down, sleep until the next session */
+        if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_POWER_DOWN) {
+            xEventGroupWaitBits(g_app_ctx.system_events, EVENT_STREAMING_ACTIVE | EVENT_SHUTDOWN,
+                                pdFALSE, pdFALSE, portMAX_DELAY);
+            sched_rebase();
+            continue;
+        }
+
+        /* Sleep until the earliest deadline, a (un)registered job wakes us up to recompute it */
+        now = xTaskGetTickCount();
+        if (!sched_next_deadline(&deadline)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (SCHED_BEFORE(now, deadline)) {
+            ulTaskNotifyTake(pdTRUE, deadline - now);
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_sched_ctx.lock);
+        s_sched_ctx.stats.wakeups++;
+        portEXIT_CRITICAL(&s_sched_ctx.lock);
+        sched_run_due(now);
+    }
+
+    ESP_LOGI(SCHED_TAG, "Sched task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terSchedTask(void *arg)
+{
+    os_sched_stats_st stats;
+
+    ESP_LOGI(SCHED_TAG, "Terminating sched task...");
+    os_sched_get_stats(&stats);
+    ESP_LOGI(SCHED_TAG, "Ran %lu jobs in %lu wake-ups, %lu late", stats.runs, stats.wakeups, stats.late);
+}
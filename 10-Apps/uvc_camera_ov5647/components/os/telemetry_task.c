@@ -0,0 +1,123 @@
+/*
+ * Telemetry Task
+ *
+ * Responsibilities:
+ * - Frame binary records pushed by other tasks into a ring buffer
+ * - Drain the ring buffer to the USB Serial/JTAG port, off the streaming path
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "driver/usb_serial_jtag.h"
+#include "uvc_app_common.h"
+#include "os_interface.h"
+#include "os_telemetry.h"
+
+#define TELEMETRY_TAG               "telemetry"
+#define TELEMETRY_RECORD_MAX        256     /* Header and payload of the largest record */
+#define TELEMETRY_WRITE_TIMEOUT_MS  100     /* Records are dropped if no host reads the port */
+
+/* Task context */
+typedef struct {
+    RingbufHandle_t ring;
+    uint32_t records_sent;
+    uint32_t records_dropped;
+} telemetry_task_ctx_t;
+
+static telemetry_task_ctx_t s_tlm_ctx = {0};
+
+/* ========== Init Phase ========== */
+void initTelemetryTask(void *arg)
+{
+    usb_serial_jtag_driver_config_t jtag_cfg = USB_SERIAL_JTAG_DRIVER_CONFIG_DEFAULT();
+    esp_err_t ret;
+
+    ESP_LOGI(TELEMETRY_TAG, "Initializing telemetry task...");
+
+    s_tlm_ctx.ring = xRingbufferCreate(CONFIG_EXAMPLE_TELEMETRY_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (!s_tlm_ctx.ring) {
+        ESP_LOGE(TELEMETRY_TAG, "Failed to create telemetry ring buffer");
+        return;
+    }
+
+    /* The console may have installed it already when it uses this port */
+    if (!usb_serial_jtag_is_driver_installed()) {
+        ret = usb_serial_jtag_driver_install(&jtag_cfg);
+        APP_LOG_ON_ERROR(ret, TELEMETRY_TAG, "Failed to install USB Serial/JTAG driver");
+    }
+
+    ESP_LOGI(TELEMETRY_TAG, "Telemetry task initialized");
+}
+
+esp_err_t os_telemetry_push(telemetry_type_en type, const void *payload, size_t length)
+{
+    uint8_t record[TELEMETRY_RECORD_MAX];
+    telemetry_header_t *header = (telemetry_header_t *)record;
+
+    if (!s_tlm_ctx.ring) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    APP_RETURN_ON_FALSE(length <= sizeof(record) - sizeof(*header), ESP_ERR_INVALID_SIZE, TELEMETRY_TAG,
+                        "Telemetry record of %u bytes is too large", (unsigned)length);
+
+    header->magic = TELEMETRY_MAGIC;
+    header->version = TELEMETRY_VERSION;
+    header->type = type;
+    header->length = length;
+    header->crc = esp_rom_crc16_le(0, payload, length);
+    memcpy(record + sizeof(*header), payload, length);
+
+    if (xRingbufferSend(s_tlm_ctx.ring, record, sizeof(*header) + length, 0) != pdTRUE) {
+        s_tlm_ctx.records_dropped++;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/* ========== Main Loop ========== */
+void mainTelemetryTask(void *arg)
+{
+    size_t size;
+    uint8_t *record;
+
+    ESP_LOGI(TELEMETRY_TAG, "Telemetry task started on core %d", xPortGetCoreID());
+
+    if (!s_tlm_ctx.ring) {
+        goto exit;
+    }
+
+    while (1) {
+        /* The monitor pushes a record every interval, so shutdown is seen within one */
+        record = xRingbufferReceive(s_tlm_ctx.ring, &size, portMAX_DELAY);
+        if (record) {
+            if (usb_serial_jtag_write_bytes(record, size, pdMS_TO_TICKS(TELEMETRY_WRITE_TIMEOUT_MS)) == size) {
+                s_tlm_ctx.records_sent++;
+            } else {
+                s_tlm_ctx.records_dropped++;
+            }
+            vRingbufferReturnItem(s_tlm_ctx.ring, record);
+        }
+
+        if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN) {
+            ESP_LOGI(TELEMETRY_TAG, "Shutdown requested");
+            break;
+        }
+    }
+
+exit:
+    ESP_LOGI(TELEMETRY_TAG, "Telemetry task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terTelemetryTask(void *arg)
+{
+    ESP_LOGI(TELEMETRY_TAG, "Terminating telemetry task...");
+    ESP_LOGI(TELEMETRY_TAG, "Sent %lu telemetry records, dropped %lu",
+             s_tlm_ctx.records_sent, s_tlm_ctx.records_dropped);
+}
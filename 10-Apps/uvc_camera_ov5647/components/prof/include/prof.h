@@ -0,0 +1,77 @@
+/*
+ * Prof - Statistical PC sampling profiler
+ *
+ * With CONFIG_PROF_ENABLE a timer interrupt on every core samples the program
+ * counter the core was interrupted at, CONFIG_PROF_SAMPLE_HZ times a second,
+ * and counts the samples per PC in a fixed-size hash table of the core. The
+ * target has no symbols, the PCs are resolved to functions on the host from
+ * the ELF by tools/prof_report.py. Code running in another ISR or with
+ * interrupts masked isn't sampled, the first is counted apart.
+ * Without CONFIG_PROF_ENABLE the calls do nothing.
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters of a core since the last reset */
+typedef struct {
+    uint32_t samples;               /* Timer interrupts taken */
+    uint32_t isr;                   /* Samples which interrupted another ISR, no PC */
+    uint32_t dropped;               /* Samples of a PC the full table had no slot for */
+} prof_stats_st;
+
+#if CONFIG_PROF_ENABLE
+
+/* Allocate the tables and start the sampling timers on every core */
+esp_err_t prof_start(void);
+
+void prof_stop(void);
+
+/* Drop the samples so far, e.g. to profile one streaming session */
+void prof_reset(void);
+
+void prof_get_stats(int core, prof_stats_st *ret_stats);
+
+/* Log the n PCs with the most samples of all cores, for a glance in the monitor report */
+void prof_dump_top(const char *tag, int n);
+
+/*
+ * Write the tables to the console, one "PROF {sample}" line per PC, one per
+ * core with its counters, and a closing "PROF_DONE", for tools/prof_report.py.
+ * Sampling is paused for the dump.
+ */
+esp_err_t prof_dump_console(void);
+
+#else
+
+static inline esp_err_t prof_start(void)
+{
+    return ESP_OK;
+}
+
+static inline void prof_stop(void)
+{
+}
+
+static inline void prof_reset(void)
+{
+}
+
+static inline void prof_dump_top(const char *tag, int n)
+{
+}
+
+#endif /* CONFIG_PROF_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROF_H */
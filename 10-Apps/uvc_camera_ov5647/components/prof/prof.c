@@ -0,0 +1,389 @@
+/*
+ * Prof - Sampling timers and the per-core PC tables
+ *
+ * Every core has a gptimer whose interrupt is allocated on that core, so each
+ * ISR only writes the table of its own core and takes no lock. The interrupt
+ * entry of the FreeRTOS RISC-V port saves the frame of the interrupted task on
+ * its stack and the stack pointer in the first word of its TCB, its mepc is
+ * the sampled PC. An ISR interrupting another one finds no frame there, only
+ * its count is kept.
+ *
+ * The tables use open addressing with a short probe, a PC which finds no slot
+ * is counted as dropped instead of evicting one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "driver/gptimer.h"
+#include "riscv/rvruntime-frames.h"
+#include "memstat.h"
+#include "prof.h"
+
+#define PROF_SLOTS              CONFIG_PROF_SLOTS
+#define PROF_PROBES             8
+#define PROF_TOP_MAX            32
+#define PROF_TIMER_HZ           1000000
+#define PROF_INTR_PRIORITY      3       /* Above the drivers, so their ISRs are counted rather than delayed */
+#define PROF_SETUP_STACK        3072
+
+_Static_assert((PROF_SLOTS & (PROF_SLOTS - 1)) == 0, "Table size must be a power of 2");
+
+typedef struct {
+    uint32_t pc;                        // 0 is a free slot
+    uint32_t count;
+} prof_slot_st;
+
+/* Per-core sampler, written by the ISR of its core only */
+typedef struct {
+    prof_slot_st *table;
+    gptimer_handle_t timer;
+    prof_stats_st stats;
+} prof_core_st;
+
+/* Setup of the timer of one core, run by a task pinned to it */
+typedef struct {
+    int core;
+    esp_err_t ret;
+    SemaphoreHandle_t done;
+} prof_setup_st;
+
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+} prof_top_st;
+
+/* Interrupt nesting of the FreeRTOS RISC-V port, 1 in an ISR which interrupted a task */
+extern volatile UBaseType_t port_uxInterruptNesting[portNUM_PROCESSORS];
+
+static const char *TAG = "prof";
+
+static prof_core_st s_prof[portNUM_PROCESSORS];
+static volatile bool s_prof_on;
+static bool s_prof_started;
+
+static inline uint32_t prof_hash(uint32_t pc)
+{
+    uint32_t h = (pc >> 1) * 2654435761u;
+
+    return (h ^ (h >> 16)) & (PROF_SLOTS - 1);
+}
+
+static void IRAM_ATTR prof_count(prof_core_st *core, uint32_t pc)
+{
+    uint32_t slot = prof_hash(pc);
+
+    for (int i = 0; i < PROF_PROBES; i++, slot = (slot + 1) & (PROF_SLOTS - 1)) {
+        if (core->table[slot].pc == pc) {
+            core->table[slot].count++;
+            return;
+        }
+        if (!core->table[slot].pc) {
+            core->table[slot].pc = pc;
+            core->table[slot].count = 1;
+            return;
+        }
+    }
+
+    core->stats.dropped++;
+}
+
+static bool IRAM_ATTR prof_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+    prof_core_st *core = arg;
+    const RvExcFrame *frame;
+
+    if (!s_prof_on) {
+        return false;
+    }
+
+    core->stats.samples++;
+    if (port_uxInterruptNesting[xPortGetCoreID()] > 1) {
+        core->stats.isr++;
+        return false;
+    }
+
+    /* pxTopOfStack, the first member of the TCB, points to the frame the interrupt entry saved */
+    frame = *(const RvExcFrame **)xTaskGetCurrentTaskHandle();
+    prof_count(core, frame->mepc);
+
+    return false;
+}
+
+static esp_err_t prof_timer_init(prof_core_st *core)
+{
+    esp_err_t ret;
+    gptimer_config_t config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = PROF_TIMER_HZ,
+        .intr_priority = PROF_INTR_PRIORITY,
+    };
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = PROF_TIMER_HZ / CONFIG_PROF_SAMPLE_HZ,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = prof_on_alarm,
+    };
+
+    ret = gptimer_new_timer(&config, &core->timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* The interrupt is allocated here, on the calling core */
+    ret = gptimer_register_event_callbacks(core->timer, &cbs, core);
+    if (ret == ESP_OK) {
+        ret = gptimer_set_alarm_action(core->timer, &alarm);
+    }
+    if (ret == ESP_OK) {
+        ret = gptimer_enable(core->timer);
+    }
+    if (ret != ESP_OK) {
+        gptimer_del_timer(core->timer);
+        core->timer = NULL;
+    }
+
+    return ret;
+}
+
+static void prof_setup_task(void *arg)
+{
+    prof_setup_st *setup = arg;
+
+    setup->ret = prof_timer_init(&s_prof[setup->core]);
+    xSemaphoreGive(setup->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t prof_start(void)
+{
+    prof_setup_st setup;
+
+    if (s_prof_started) {
+        return ESP_OK;
+    }
+
+    setup.done = xSemaphoreCreateBinary();
+    if (!setup.done) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (!s_prof[core].table) {
+            s_prof[core].table = memstat_calloc(MEMSTAT_DEBUG, PROF_SLOTS, sizeof(prof_slot_st), MALLOC_CAP_INTERNAL);
+            if (!s_prof[core].table) {
+                ESP_LOGE(TAG, "Failed to allocate %d profile slots", PROF_SLOTS);
+                vSemaphoreDelete(setup.done);
+                return ESP_ERR_NO_MEM;
+            }
+        }
+
+        if (!s_prof[core].timer) {
+            setup.core = core;
+            setup.ret = ESP_FAIL;
+            if (xTaskCreatePinnedToCore(prof_setup_task, "prof_setup", PROF_SETUP_STACK, &setup,
+                                        uxTaskPriorityGet(NULL), NULL, core) != pdPASS) {
+                vSemaphoreDelete(setup.done);
+                return ESP_ERR_NO_MEM;
+            }
+            xSemaphoreTake(setup.done, portMAX_DELAY);
+            if (setup.ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to set up the sampling timer of core %d (%s)", core, esp_err_to_name(setup.ret));
+                vSemaphoreDelete(setup.done);
+                return setup.ret;
+            }
+        }
+    }
+    vSemaphoreDelete(setup.done);
+
+    s_prof_on = true;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        gptimer_start(s_prof[core].timer);
+    }
+    s_prof_started = true;
+    ESP_LOGI(TAG, "Sampling %d Hz on %d cores", CONFIG_PROF_SAMPLE_HZ, portNUM_PROCESSORS);
+
+    return ESP_OK;
+}
+
+void prof_stop(void)
+{
+    if (!s_prof_started) {
+        return;
+    }
+
+    s_prof_on = false;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        gptimer_stop(s_prof[core].timer);
+    }
+    s_prof_started = false;
+}
+
+/* Stop counting for a read or a reset of the tables, returns whether sampling was on */
+static bool prof_pause(void)
+{
+    bool on = s_prof_on;
+
+    s_prof_on = false;
+    /* An ISR which passed the check before is done after a tick */
+    vTaskDelay(1);
+
+    return on;
+}
+
+void prof_reset(void)
+{
+    bool on;
+
+    if (!s_prof[0].table) {
+        return;
+    }
+
+    on = prof_pause();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        memset(s_prof[core].table, 0, PROF_SLOTS * sizeof(prof_slot_st));
+        memset(&s_prof[core].stats, 0, sizeof(s_prof[core].stats));
+    }
+    s_prof_on = on;
+}
+
+void prof_get_stats(int core, prof_stats_st *ret_stats)
+{
+    if (core < 0 || core >= portNUM_PROCESSORS) {
+        memset(ret_stats, 0, sizeof(*ret_stats));
+        return;
+    }
+
+    *ret_stats = s_prof[core].stats;
+}
+
+/* Samples of a PC in the table of a core */
+static uint32_t prof_lookup(const prof_core_st *core, uint32_t pc)
+{
+    uint32_t slot = prof_hash(pc);
+
+    for (int i = 0; i < PROF_PROBES; i++, slot = (slot + 1) & (PROF_SLOTS - 1)) {
+        if (core->table[slot].pc == pc) {
+            return core->table[slot].count;
+        }
+        if (!core->table[slot].pc) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* Keep the n largest in top, sorted, returns the entries in use */
+static int prof_top_insert(prof_top_st *top, int used, int n, uint32_t pc, uint32_t count)
+{
+    int i;
+
+    if (used == n && count <= top[n - 1].count) {
+        return used;
+    }
+    if (used < n) {
+        used++;
+    }
+    for (i = used - 1; i > 0 && top[i - 1].count < count; i--) {
+        top[i] = top[i - 1];
+    }
+    top[i].pc = pc;
+    top[i].count = count;
+
+    return used;
+}
+
+void prof_dump_top(const char *tag, int n)
+{
+    prof_top_st top[PROF_TOP_MAX];
+    uint32_t samples = 0;
+    uint32_t isr = 0;
+    uint32_t dropped = 0;
+    int used = 0;
+    bool merged;
+
+    if (!s_prof[0].table || n <= 0) {
+        return;
+    }
+    n = n > PROF_TOP_MAX ? PROF_TOP_MAX : n;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        samples += s_prof[core].stats.samples;
+        isr += s_prof[core].stats.isr;
+        dropped += s_prof[core].stats.dropped;
+    }
+    if (!samples) {
+        return;
+    }
+
+    /* Read while sampling, a count may be one behind */
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        for (int slot = 0; slot < PROF_SLOTS; slot++) {
+            uint32_t pc = s_prof[core].table[slot].pc;
+            uint32_t count = 0;
+
+            if (!pc) {
+                continue;
+            }
+
+            /* A PC sampled on several cores is summed at its first one */
+            merged = false;
+            for (int prev = 0; prev < core && !merged; prev++) {
+                merged = prof_lookup(&s_prof[prev], pc) != 0;
+            }
+            if (merged) {
+                continue;
+            }
+            for (int other = core; other < portNUM_PROCESSORS; other++) {
+                count += other == core ? s_prof[core].table[slot].count : prof_lookup(&s_prof[other], pc);
+            }
+            used = prof_top_insert(top, used, n, pc, count);
+        }
+    }
+
+    ESP_LOGI(tag, "Profile: %lu samples, %.1f%% in ISRs, %lu dropped, top PCs:", samples,
+             isr * 100.0 / samples, dropped);
+    for (int i = 0; i < used; i++) {
+        ESP_LOGI(tag, "  0x%08lx %5.1f%%", top[i].pc, top[i].count * 100.0 / samples);
+    }
+}
+
+esp_err_t prof_dump_console(void)
+{
+    bool on;
+    uint32_t pcs = 0;
+
+    if (!s_prof[0].table) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    on = prof_pause();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const prof_core_st *prof = &s_prof[core];
+
+        printf("PROF {\"core\":%d,\"samples\":%lu,\"isr\":%lu,\"dropped\":%lu,\"hz\":%d}\n", core,
+               prof->stats.samples, prof->stats.isr, prof->stats.dropped, CONFIG_PROF_SAMPLE_HZ);
+        for (int slot = 0; slot < PROF_SLOTS; slot++) {
+            if (prof->table[slot].pc) {
+                printf("PROF {\"core\":%d,\"pc\":%lu,\"n\":%lu}\n", core, prof->table[slot].pc,
+                       prof->table[slot].count);
+                pcs++;
+            }
+        }
+    }
+    printf("PROF_DONE\n");
+    fflush(stdout);
+    s_prof_on = on;
+    ESP_LOGI(TAG, "Dumped %lu sampled PCs to the console", pcs);
+
+    return ESP_OK;
+}
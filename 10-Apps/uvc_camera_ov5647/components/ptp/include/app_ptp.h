@@ -0,0 +1,74 @@
+/*
+ * App PTP - Network time for frame timestamps (IEEE 1588-2008)
+ *
+ * With CONFIG_EXAMPLE_PTP the board follows the best PTP master of
+ * CONFIG_EXAMPLE_PTP_DOMAIN on the Ethernet link as a slave-only ordinary
+ * clock, over IEEE 802.3 with the end-to-end delay mechanism. Sync and
+ * Delay_Req are timestamped by the EMAC, so the offset has no software
+ * latency in it.
+ *
+ * Frame timestamps stay esp_timer microseconds, taken at the CSI frame end.
+ * app_ptp_to_network() bridges them into the PTP timescale of the master.
+ * Boards following the same master stamp the same instant with the same
+ * network time, frames are matched across cameras by their timestamps.
+ *
+ * Without CONFIG_EXAMPLE_PTP the calls report that no network time is known.
+ */
+
+#ifndef APP_PTP_H
+#define APP_PTP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    bool synchronized;          /* The offset to the master is within CONFIG_EXAMPLE_PTP_LOCK_NS */
+    uint8_t grandmaster[8];     /* Clock identity of the grandmaster followed, all 0 for none */
+    uint8_t domain;
+    int64_t offset_ns;          /* Last offset of the servo clock from the master */
+    int64_t path_delay_ns;      /* Mean path delay to the master */
+    int32_t drift_ppb;          /* Rate of the EMAC clock against the master */
+    uint32_t syncs;             /* Sync messages of the master used */
+} app_ptp_status_t;
+
+#if CONFIG_EXAMPLE_PTP
+
+/**
+ * @brief Network time of an esp_timer time, e.g. of frame_buffer_t.timestamp
+ *
+ * @param local_us: esp_timer time in microseconds
+ * @param ret_ns: PTP time of the master in nanoseconds
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE while not synchronized to a master
+ */
+esp_err_t app_ptp_to_network(int64_t local_us, int64_t *ret_ns);
+
+void app_ptp_get_status(app_ptp_status_t *ret_status);
+
+#else
+
+static inline esp_err_t app_ptp_to_network(int64_t local_us, int64_t *ret_ns)
+{
+    return ESP_ERR_INVALID_STATE;
+}
+
+static inline void app_ptp_get_status(app_ptp_status_t *ret_status)
+{
+    memset(ret_status, 0, sizeof(*ret_status));
+}
+
+#endif /* CONFIG_EXAMPLE_PTP */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* APP_PTP_H */
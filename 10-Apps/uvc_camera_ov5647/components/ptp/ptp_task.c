@@ -0,0 +1,736 @@
+/*
+ * PTP Task
+ *
+ * Responsibilities:
+ * - Enable the IEEE 1588 clock of the EMAC and receive PTP frames
+ *   (ethertype 0x88F7) with their hardware timestamps through L2 TAP
+ * - Follow the best master announced in CONFIG_EXAMPLE_PTP_DOMAIN (slave-only
+ *   ordinary clock, end-to-end delay mechanism, one- and two-step masters)
+ * - Bridge esp_timer, which stamps the camera frames, to the master time
+ *
+ * The EMAC clock runs free, it is never stepped or slewed. Two affine maps
+ * are kept instead: the bridge from esp_timer to the EMAC clock, sampled
+ * once a second with back to back reads, and the servo from the EMAC clock
+ * to the master, updated by a PI filter at every Sync. Sync receive and
+ * Delay_Req transmit times come from the EMAC, so the servo sees the wire
+ * times and the bridge error stays within the esp_timer microsecond.
+ *
+ * Master selection compares the announced grandmaster datasets like the
+ * BMCA does, without foreign master qualification. A master that misses
+ * PTP_ANNOUNCE_TIMEOUT announce intervals is dropped.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_eth_driver.h"
+#include "esp_eth_time.h"
+#include "esp_vfs_l2tap.h"
+#include "uvc_app_common.h"
+#include "app_eth.h"
+#include "app_ptp.h"
+
+#define PTP_TAG                 "ptp"
+#define PTP_ETHERTYPE           0x88F7
+#define PTP_ETH_HDR_LEN         14
+#define PTP_FRAME_MAX           128
+#define PTP_HDR_LEN             34
+#define PTP_EVENT_LEN           44      /* Sync, Delay_Req and Follow_Up */
+#define PTP_DELAY_RESP_LEN      54
+#define PTP_ANNOUNCE_LEN        64
+#define PTP_VERSION             2
+#define PTP_FLAG_TWO_STEP       0x02    /* Octet 0 of the flag field */
+#define PTP_CONTROL_DELAY_REQ   0x01
+#define PTP_POLL_MS             100
+#define PTP_BRIDGE_PERIOD_US    (1000 * 1000)
+#define PTP_BRIDGE_TRIES        8       /* Back to back reads per bridge sample, the shortest is kept */
+#define PTP_REPORT_PERIOD_US    (10 * 1000 * 1000)
+#define PTP_ANNOUNCE_TIMEOUT    3       /* Announce intervals without one until the master is dropped */
+#define PTP_STEP_NS             (1000 * 1000)   /* Larger offsets restart the servo at the master time */
+#define PTP_LOCK_COUNT          4       /* Syncs within CONFIG_EXAMPLE_PTP_LOCK_NS until synchronized */
+#define PTP_RATE_MAX            500e-6  /* Crystal tolerance of both ends */
+#define PTP_SERVO_KP            0.7
+#define PTP_SERVO_KI            0.3
+#define PTP_BRIDGE_GAIN         0.3
+#define PTP_DELAY_FILTER        8       /* Path delay average over about this many measurements */
+
+enum {
+    PTP_MSG_SYNC = 0x0,
+    PTP_MSG_DELAY_REQ = 0x1,
+    PTP_MSG_FOLLOW_UP = 0x8,
+    PTP_MSG_DELAY_RESP = 0x9,
+    PTP_MSG_ANNOUNCE = 0xB,
+};
+
+/* Forwarded by bridges, received by every PTP port of the link */
+static const uint8_t PTP_MCAST_MAC[6] = { 0x01, 0x1B, 0x19, 0x00, 0x00, 0x00 };
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    int64_t correction_ns;      /* Nanoseconds of the correction field, the fraction dropped */
+    const uint8_t *port_id;     /* Source port identity, 10 bytes */
+    uint16_t seq;
+    int8_t log_interval;
+} ptp_header_t;
+
+typedef struct {
+    bool valid;
+    uint8_t port_id[10];        /* Port sending Announce and Sync */
+    uint8_t priority1;
+    uint8_t clock_class;
+    uint8_t accuracy;
+    uint16_t variance;
+    uint8_t priority2;
+    uint8_t gm_identity[8];
+    uint16_t steps_removed;
+    int64_t last_announce;      /* esp_timer time */
+    int64_t announce_period;
+} ptp_master_t;
+
+/* to = ref_to + (from - ref_from) * (1 + rate), both in nanoseconds */
+typedef struct {
+    int64_t ref_from;
+    int64_t ref_to;
+    double rate;
+} ptp_map_t;
+
+/* Task context */
+typedef struct {
+    int fd;
+    esp_eth_handle_t eth;
+    uint8_t mac[6];
+    uint8_t port_id[10];        /* EUI-64 of the MAC and port 1 */
+    ptp_master_t master;
+
+    /* Two-step Sync waiting for its Follow_Up */
+    bool sync_pending;
+    uint16_t sync_seq;
+    int64_t sync_rx;
+    int64_t sync_correction;
+
+    /* Last complete Sync */
+    int64_t last_t1;
+    int64_t last_t2;
+    int64_t last_correction;
+
+    /* Delay measurement, t1 and t2 of the Sync before the request */
+    bool delay_pending;
+    bool delay_valid;
+    uint16_t delay_seq;
+    int64_t delay_t1;
+    int64_t delay_t2;
+    int64_t delay_t3;
+    int64_t delay_correction;
+    int64_t delay_period;
+    int64_t next_delay_req;
+    int64_t path_delay;
+
+    uint32_t lock_count;
+    int64_t next_bridge;
+    int64_t next_report;
+
+    /* Read by app_ptp_to_network() under s_ptp_lock */
+    bool bridge_valid;
+    bool servo_valid;
+    ptp_map_t bridge;           /* esp_timer to EMAC clock */
+    ptp_map_t servo;            /* EMAC clock to master */
+    app_ptp_status_t status;
+} ptp_task_ctx_t;
+
+static ptp_task_ctx_t s_ptp_ctx = {
+    .fd = -1,
+};
+static portMUX_TYPE s_ptp_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ========== Helpers ========== */
+
+static uint16_t ptp_get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static void ptp_put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+/* 48-bit seconds and 32-bit nanoseconds */
+static int64_t ptp_get_timestamp(const uint8_t *p)
+{
+    uint64_t seconds = 0;
+    uint32_t nanoseconds = 0;
+
+    for (int i = 0; i < 6; i++) {
+        seconds = (seconds << 8) | p[i];
+    }
+    for (int i = 6; i < 10; i++) {
+        nanoseconds = (nanoseconds << 8) | p[i];
+    }
+
+    return (int64_t)seconds * 1000000000LL + nanoseconds;
+}
+
+static int64_t ptp_interval_us(int8_t log_interval)
+{
+    log_interval = MAX(-7, MIN(6, log_interval));
+
+    return log_interval >= 0 ? 1000000LL << log_interval : 1000000LL >> -log_interval;
+}
+
+static int64_t ptp_map(const ptp_map_t *map, int64_t from)
+{
+    int64_t delta = from - map->ref_from;
+
+    return map->ref_to + delta + (int64_t)(delta * map->rate);
+}
+
+static bool ptp_shutdown(void)
+{
+    return xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN;
+}
+
+/* Dataset comparison of the BMCA, negative if a is the better master */
+static int ptp_compare(const ptp_master_t *a, const ptp_master_t *b)
+{
+    uint8_t key_a[16] = { a->priority1, a->clock_class, a->accuracy, a->variance >> 8, a->variance & 0xFF,
+                          a->priority2
+                        };
+    uint8_t key_b[16] = { b->priority1, b->clock_class, b->accuracy, b->variance >> 8, b->variance & 0xFF,
+                          b->priority2
+                        };
+
+    memcpy(key_a + 6, a->gm_identity, 8);
+    memcpy(key_b + 6, b->gm_identity, 8);
+    ptp_put16(key_a + 14, a->steps_removed);
+    ptp_put16(key_b + 14, b->steps_removed);
+
+    return memcmp(key_a, key_b, sizeof(key_a));
+}
+
+/* ========== Servo ========== */
+
+static void ptp_servo_reset(void)
+{
+    s_ptp_ctx.sync_pending = false;
+    s_ptp_ctx.delay_pending = false;
+    s_ptp_ctx.delay_valid = false;
+    s_ptp_ctx.lock_count = 0;
+    s_ptp_ctx.next_delay_req = 0;
+
+    portENTER_CRITICAL(&s_ptp_lock);
+    s_ptp_ctx.servo_valid = false;
+    s_ptp_ctx.status.synchronized = false;
+    s_ptp_ctx.status.offset_ns = 0;
+    s_ptp_ctx.status.path_delay_ns = 0;
+    s_ptp_ctx.status.drift_ppb = 0;
+    memcpy(s_ptp_ctx.status.grandmaster, s_ptp_ctx.master.gm_identity, sizeof(s_ptp_ctx.status.grandmaster));
+    portEXIT_CRITICAL(&s_ptp_lock);
+}
+
+/* The master time t1 was sent at the EMAC time t2 */
+static void ptp_servo_update(int64_t t1, int64_t t2, int64_t correction)
+{
+    int64_t master = t1 + correction + s_ptp_ctx.path_delay;
+    ptp_map_t servo = s_ptp_ctx.servo;
+    int64_t predicted;
+    int64_t offset = 0;
+    int64_t dt;
+
+    if (!s_ptp_ctx.servo_valid) {
+        servo.ref_from = t2;
+        servo.ref_to = master;
+        servo.rate = 0;
+    } else {
+        predicted = ptp_map(&servo, t2);
+        offset = predicted - master;
+        dt = t2 - servo.ref_from;
+        if (llabs(offset) > PTP_STEP_NS || dt <= 0) {
+            ESP_LOGW(PTP_TAG, "Offset %lld ns, restarting at the master time", offset);
+            servo.ref_to = master;
+            s_ptp_ctx.lock_count = 0;
+        } else {
+            servo.rate = MAX(-PTP_RATE_MAX, MIN(PTP_RATE_MAX, servo.rate - PTP_SERVO_KI * offset / dt));
+            servo.ref_to = predicted - (int64_t)(PTP_SERVO_KP * offset);
+            s_ptp_ctx.lock_count = llabs(offset) <= CONFIG_EXAMPLE_PTP_LOCK_NS ?
+                                   MIN(s_ptp_ctx.lock_count + 1, PTP_LOCK_COUNT) : 0;
+        }
+        servo.ref_from = t2;
+    }
+
+    portENTER_CRITICAL(&s_ptp_lock);
+    s_ptp_ctx.servo = servo;
+    s_ptp_ctx.servo_valid = true;
+    s_ptp_ctx.status.synchronized = s_ptp_ctx.delay_valid && s_ptp_ctx.lock_count >= PTP_LOCK_COUNT;
+    s_ptp_ctx.status.offset_ns = offset;
+    s_ptp_ctx.status.path_delay_ns = s_ptp_ctx.path_delay;
+    s_ptp_ctx.status.drift_ppb = (int32_t)(servo.rate * 1e9);
+    s_ptp_ctx.status.syncs++;
+    portEXIT_CRITICAL(&s_ptp_lock);
+}
+
+/* ========== Bridge ========== */
+
+/* Pair esp_timer with the EMAC clock, the midpoint of the shortest read is the EMAC read time */
+static void ptp_bridge_sample(void)
+{
+    struct timespec ts;
+    int64_t best = INT64_MAX;
+    int64_t local = 0;
+    int64_t emac = 0;
+    int64_t before;
+    int64_t after;
+    ptp_map_t bridge = s_ptp_ctx.bridge;
+    int64_t error;
+    int64_t dt;
+
+    for (int i = 0; i < PTP_BRIDGE_TRIES; i++) {
+        before = esp_timer_get_time();
+        if (clock_gettime(CLOCK_PTP_SYSTEM, &ts) != 0) {
+            return;
+        }
+        after = esp_timer_get_time();
+        if (after - before < best) {
+            best = after - before;
+            local = (before + after) * 500;
+            emac = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        }
+    }
+
+    if (!s_ptp_ctx.bridge_valid) {
+        bridge.ref_to = emac;
+        bridge.rate = 0;
+    } else {
+        error = emac - ptp_map(&bridge, local);
+        dt = local - bridge.ref_from;
+        bridge.rate = MAX(-PTP_RATE_MAX, MIN(PTP_RATE_MAX, bridge.rate + PTP_BRIDGE_GAIN * error / dt));
+        bridge.ref_to = ptp_map(&s_ptp_ctx.bridge, local) + (int64_t)(PTP_BRIDGE_GAIN * error);
+    }
+    bridge.ref_from = local;
+
+    portENTER_CRITICAL(&s_ptp_lock);
+    s_ptp_ctx.bridge = bridge;
+    s_ptp_ctx.bridge_valid = true;
+    portEXIT_CRITICAL(&s_ptp_lock);
+}
+
+/* ========== Messages ========== */
+
+static void ptp_send_delay_req(void)
+{
+    uint8_t frame[PTP_ETH_HDR_LEN + PTP_EVENT_LEN] = {0};
+    uint8_t *msg = frame + PTP_ETH_HDR_LEN;
+    uint8_t control[L2TAP_IREC_SPACE(sizeof(struct timespec))] = {0};
+    struct iovec iov = { .iov_base = frame, .iov_len = sizeof(frame) };
+    struct msghdr hdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    struct timespec ts = {0};
+    l2tap_irec_hdr_t *rec;
+
+    memcpy(frame, PTP_MCAST_MAC, 6);
+    memcpy(frame + 6, s_ptp_ctx.mac, 6);
+    ptp_put16(frame + 12, PTP_ETHERTYPE);
+
+    msg[0] = PTP_MSG_DELAY_REQ;
+    msg[1] = PTP_VERSION;
+    ptp_put16(msg + 2, PTP_EVENT_LEN);
+    msg[4] = CONFIG_EXAMPLE_PTP_DOMAIN;
+    memcpy(msg + 20, s_ptp_ctx.port_id, sizeof(s_ptp_ctx.port_id));
+    ptp_put16(msg + 30, ++s_ptp_ctx.delay_seq);
+    msg[32] = PTP_CONTROL_DELAY_REQ;
+    msg[33] = 0x7F;
+
+    /* The transmit timestamp record is filled once the EMAC sent the frame */
+    s_ptp_ctx.delay_pending = false;
+    if (sendmsg(s_ptp_ctx.fd, &hdr, 0) != sizeof(frame)) {
+        ESP_LOGW(PTP_TAG, "Failed to send Delay_Req (errno=%d)", errno);
+        return;
+    }
+    for (rec = L2TAP_IREC_FIRST(&hdr); rec; rec = L2TAP_IREC_NEXT(&hdr, rec)) {
+        if (rec->type == L2TAP_IREC_TIME_STAMP) {
+            memcpy(&ts, rec->data, sizeof(ts));
+        }
+    }
+    if (!ts.tv_sec && !ts.tv_nsec) {
+        return;
+    }
+
+    s_ptp_ctx.delay_t1 = s_ptp_ctx.last_t1;
+    s_ptp_ctx.delay_t2 = s_ptp_ctx.last_t2;
+    s_ptp_ctx.delay_correction = s_ptp_ctx.last_correction;
+    s_ptp_ctx.delay_t3 = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    s_ptp_ctx.delay_pending = true;
+}
+
+static void ptp_sync_complete(int64_t t1, int64_t t2, int64_t correction)
+{
+    int64_t now = esp_timer_get_time();
+
+    s_ptp_ctx.last_t1 = t1;
+    s_ptp_ctx.last_t2 = t2;
+    s_ptp_ctx.last_correction = correction;
+    ptp_servo_update(t1, t2, correction);
+
+    /* A request without response is given up at the next one */
+    if (now >= s_ptp_ctx.next_delay_req) {
+        s_ptp_ctx.next_delay_req = now + s_ptp_ctx.delay_period;
+        ptp_send_delay_req();
+    }
+}
+
+/* The request of the last complete Sync was received at t4 */
+static void ptp_delay_update(int64_t t4, int64_t correction)
+{
+    int64_t delay = ((s_ptp_ctx.delay_t2 - s_ptp_ctx.delay_t1 - s_ptp_ctx.delay_correction) +
+                     (t4 - s_ptp_ctx.delay_t3 - correction)) / 2;
+
+    s_ptp_ctx.delay_pending = false;
+    if (delay < 0) {
+        ESP_LOGD(PTP_TAG, "Negative path delay %lld ns ignored", delay);
+        return;
+    }
+
+    if (!s_ptp_ctx.delay_valid) {
+        s_ptp_ctx.path_delay = delay;
+        s_ptp_ctx.delay_valid = true;
+    } else {
+        s_ptp_ctx.path_delay += (delay - s_ptp_ctx.path_delay) / PTP_DELAY_FILTER;
+    }
+}
+
+static void ptp_handle_announce(const ptp_header_t *hdr, const uint8_t *msg, size_t len)
+{
+    ptp_master_t *master = &s_ptp_ctx.master;
+    ptp_master_t candidate = {
+        .valid = true,
+    };
+
+    if (len < PTP_ANNOUNCE_LEN || ptp_get16(msg + 61) >= 255) {
+        return;
+    }
+    candidate.priority1 = msg[47];
+    candidate.clock_class = msg[48];
+    candidate.accuracy = msg[49];
+    candidate.variance = ptp_get16(msg + 50);
+    candidate.priority2 = msg[52];
+    candidate.steps_removed = ptp_get16(msg + 61);
+    candidate.last_announce = esp_timer_get_time();
+    candidate.announce_period = ptp_interval_us(hdr->log_interval);
+    memcpy(candidate.port_id, hdr->port_id, sizeof(candidate.port_id));
+    memcpy(candidate.gm_identity, msg + 53, sizeof(candidate.gm_identity));
+
+    if (master->valid && !memcmp(master->port_id, candidate.port_id, sizeof(candidate.port_id))) {
+        /* The master may announce another grandmaster, the servo follows on through it */
+        *master = candidate;
+        portENTER_CRITICAL(&s_ptp_lock);
+        memcpy(s_ptp_ctx.status.grandmaster, master->gm_identity, sizeof(master->gm_identity));
+        portEXIT_CRITICAL(&s_ptp_lock);
+        return;
+    }
+    if (master->valid && ptp_compare(&candidate, master) >= 0) {
+        return;
+    }
+
+    *master = candidate;
+    ESP_LOGI(PTP_TAG, "Following grandmaster %02x%02x%02x.%02x%02x.%02x%02x%02x, priority %u/%u, class %u",
+             master->gm_identity[0], master->gm_identity[1], master->gm_identity[2], master->gm_identity[3],
+             master->gm_identity[4], master->gm_identity[5], master->gm_identity[6], master->gm_identity[7],
+             master->priority1, master->priority2, master->clock_class);
+    ptp_servo_reset();
+}
+
+static void ptp_handle_frame(const uint8_t *frame, size_t len, int64_t rx_time)
+{
+    const uint8_t *msg = frame + PTP_ETH_HDR_LEN;
+    ptp_header_t hdr;
+    bool from_master;
+
+    if (len < PTP_ETH_HDR_LEN + PTP_HDR_LEN) {
+        return;
+    }
+    len -= PTP_ETH_HDR_LEN;
+    if ((msg[1] & 0x0F) != PTP_VERSION || msg[4] != CONFIG_EXAMPLE_PTP_DOMAIN || ptp_get16(msg + 2) > len) {
+        return;
+    }
+
+    hdr.type = msg[0] & 0x0F;
+    hdr.flags = msg[6];
+    hdr.correction_ns = 0;
+    for (int i = 8; i < 14; i++) {
+        hdr.correction_ns = (hdr.correction_ns << 8) | msg[i];
+    }
+    /* The upper 48 bits are nanoseconds, sign extended */
+    hdr.correction_ns = (hdr.correction_ns << 16) >> 16;
+    hdr.port_id = msg + 20;
+    hdr.seq = ptp_get16(msg + 30);
+    hdr.log_interval = (int8_t)msg[33];
+
+    if (hdr.type == PTP_MSG_ANNOUNCE) {
+        ptp_handle_announce(&hdr, msg, len);
+        return;
+    }
+
+    from_master = s_ptp_ctx.master.valid &&
+                  !memcmp(hdr.port_id, s_ptp_ctx.master.port_id, sizeof(s_ptp_ctx.master.port_id));
+    if (!from_master) {
+        return;
+    }
+
+    switch (hdr.type) {
+    case PTP_MSG_SYNC:
+        if (len < PTP_EVENT_LEN || !rx_time) {
+            break;
+        }
+        if (hdr.flags & PTP_FLAG_TWO_STEP) {
+            s_ptp_ctx.sync_pending = true;
+            s_ptp_ctx.sync_seq = hdr.seq;
+            s_ptp_ctx.sync_rx = rx_time;
+            s_ptp_ctx.sync_correction = hdr.correction_ns;
+        } else {
+            s_ptp_ctx.sync_pending = false;
+            ptp_sync_complete(ptp_get_timestamp(msg + 34), rx_time, hdr.correction_ns);
+        }
+        break;
+    case PTP_MSG_FOLLOW_UP:
+        if (len >= PTP_EVENT_LEN && s_ptp_ctx.sync_pending && hdr.seq == s_ptp_ctx.sync_seq) {
+            s_ptp_ctx.sync_pending = false;
+            ptp_sync_complete(ptp_get_timestamp(msg + 34), s_ptp_ctx.sync_rx,
+                              s_ptp_ctx.sync_correction + hdr.correction_ns);
+        }
+        break;
+    case PTP_MSG_DELAY_RESP:
+        if (len >= PTP_DELAY_RESP_LEN && s_ptp_ctx.delay_pending && hdr.seq == s_ptp_ctx.delay_seq &&
+                !memcmp(msg + 44, s_ptp_ctx.port_id, sizeof(s_ptp_ctx.port_id))) {
+            s_ptp_ctx.delay_period = ptp_interval_us(hdr.log_interval);
+            ptp_delay_update(ptp_get_timestamp(msg + 34), hdr.correction_ns);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* One frame with its EMAC receive time, 0 if it came without one. False once none is left. */
+static bool ptp_recv(uint8_t *frame, size_t *len, int64_t *rx_time)
+{
+    uint8_t control[L2TAP_IREC_SPACE(sizeof(struct timespec))] = {0};
+    struct iovec iov = { .iov_base = frame, .iov_len = PTP_FRAME_MAX };
+    struct msghdr hdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    struct timespec ts = {0};
+    l2tap_irec_hdr_t *rec;
+    ssize_t ret;
+
+    ret = recvmsg(s_ptp_ctx.fd, &hdr, 0);
+    if (ret <= 0) {
+        return false;
+    }
+    for (rec = L2TAP_IREC_FIRST(&hdr); rec; rec = L2TAP_IREC_NEXT(&hdr, rec)) {
+        if (rec->type == L2TAP_IREC_TIME_STAMP) {
+            memcpy(&ts, rec->data, sizeof(ts));
+        }
+    }
+
+    *len = ret;
+    *rx_time = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    return true;
+}
+
+static void ptp_check_master(int64_t now)
+{
+    ptp_master_t *master = &s_ptp_ctx.master;
+
+    if (master->valid && now - master->last_announce > PTP_ANNOUNCE_TIMEOUT * master->announce_period) {
+        ESP_LOGW(PTP_TAG, "Master lost, no Announce for %lld ms", (now - master->last_announce) / 1000);
+        memset(master, 0, sizeof(*master));
+        ptp_servo_reset();
+    }
+}
+
+static void ptp_report(void)
+{
+    app_ptp_status_t status;
+
+    app_ptp_get_status(&status);
+    if (!s_ptp_ctx.master.valid) {
+        ESP_LOGI(PTP_TAG, "No master in domain %d", CONFIG_EXAMPLE_PTP_DOMAIN);
+        return;
+    }
+    ESP_LOGI(PTP_TAG, "%s, offset %lld ns, path delay %lld ns, drift %ld ppb, %lu syncs",
+             status.synchronized ? "Synchronized" : "Acquiring", status.offset_ns, status.path_delay_ns,
+             status.drift_ppb, status.syncs);
+}
+
+/* ========== Public API ========== */
+
+esp_err_t app_ptp_to_network(int64_t local_us, int64_t *ret_ns)
+{
+    ptp_map_t bridge;
+    ptp_map_t servo;
+    bool synchronized;
+
+    portENTER_CRITICAL(&s_ptp_lock);
+    bridge = s_ptp_ctx.bridge;
+    servo = s_ptp_ctx.servo;
+    synchronized = s_ptp_ctx.status.synchronized && s_ptp_ctx.bridge_valid;
+    portEXIT_CRITICAL(&s_ptp_lock);
+
+    if (!synchronized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *ret_ns = ptp_map(&servo, ptp_map(&bridge, local_us * 1000));
+
+    return ESP_OK;
+}
+
+void app_ptp_get_status(app_ptp_status_t *ret_status)
+{
+    portENTER_CRITICAL(&s_ptp_lock);
+    *ret_status = s_ptp_ctx.status;
+    portEXIT_CRITICAL(&s_ptp_lock);
+}
+
+/* ========== Network ========== */
+
+static esp_err_t ptp_open(void)
+{
+    esp_err_t ret;
+    uint16_t ethertype = PTP_ETHERTYPE;
+    esp_eth_clock_cfg_t clock_config = {
+        .eth_hndl = s_ptp_ctx.eth,
+    };
+
+    APP_RETURN_ON_ERROR(esp_eth_clock_init(CLOCK_PTP_SYSTEM, &clock_config), PTP_TAG,
+                        "Failed to enable the EMAC clock");
+    APP_RETURN_ON_ERROR(esp_eth_ioctl(s_ptp_ctx.eth, ETH_CMD_G_MAC_ADDR, s_ptp_ctx.mac), PTP_TAG,
+                        "Failed to read the MAC address");
+    APP_RETURN_ON_ERROR(esp_eth_ioctl(s_ptp_ctx.eth, ETH_CMD_ADD_MAC_FILTER, (void *)PTP_MCAST_MAC), PTP_TAG,
+                        "Failed to receive the PTP multicast address");
+
+    ret = esp_vfs_l2tap_intf_register(NULL);
+    APP_RETURN_ON_FALSE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE, ret, PTP_TAG,
+                        "Failed to register L2 TAP");
+    s_ptp_ctx.fd = open("/dev/net/tap", O_NONBLOCK);
+    APP_RETURN_ON_FALSE(s_ptp_ctx.fd >= 0, ESP_FAIL, PTP_TAG, "Failed to open L2 TAP (errno=%d)", errno);
+    APP_RETURN_ON_FALSE(ioctl(s_ptp_ctx.fd, L2TAP_S_INTF_DEVICE, "ETH_DEF") == 0 &&
+                        ioctl(s_ptp_ctx.fd, L2TAP_S_RCV_FILTER, &ethertype) == 0 &&
+                        ioctl(s_ptp_ctx.fd, L2TAP_S_TIMESTAMP_EN) == 0, ESP_FAIL, PTP_TAG,
+                        "Failed to set up L2 TAP (errno=%d)", errno);
+
+    /* Clock identity is the EUI-64 of the MAC address */
+    memcpy(s_ptp_ctx.port_id, s_ptp_ctx.mac, 3);
+    s_ptp_ctx.port_id[3] = 0xFF;
+    s_ptp_ctx.port_id[4] = 0xFE;
+    memcpy(s_ptp_ctx.port_id + 5, s_ptp_ctx.mac + 3, 3);
+    ptp_put16(s_ptp_ctx.port_id + 8, 1);
+
+    return ESP_OK;
+}
+
+/* ========== Init Phase ========== */
+void initPtpTask(void *arg)
+{
+    ESP_LOGI(PTP_TAG, "Initializing PTP task...");
+
+    s_ptp_ctx.delay_period = ptp_interval_us(0);
+    s_ptp_ctx.status.domain = CONFIG_EXAMPLE_PTP_DOMAIN;
+
+    if (app_eth_start() != ESP_OK) {
+        ESP_LOGE(PTP_TAG, "Ethernet not available, PTP disabled");
+        return;
+    }
+    s_ptp_ctx.eth = app_eth_get_handle();
+    if (ptp_open() != ESP_OK) {
+        if (s_ptp_ctx.fd >= 0) {
+            close(s_ptp_ctx.fd);
+            s_ptp_ctx.fd = -1;
+        }
+        ESP_LOGE(PTP_TAG, "PTP disabled");
+        return;
+    }
+
+    ESP_LOGI(PTP_TAG, "PTP task initialized, clock %02x%02x%02x.%02x%02x.%02x%02x%02x, domain %d",
+             s_ptp_ctx.port_id[0], s_ptp_ctx.port_id[1], s_ptp_ctx.port_id[2], s_ptp_ctx.port_id[3],
+             s_ptp_ctx.port_id[4], s_ptp_ctx.port_id[5], s_ptp_ctx.port_id[6], s_ptp_ctx.port_id[7],
+             CONFIG_EXAMPLE_PTP_DOMAIN);
+}
+
+/* ========== Main Loop ========== */
+void mainPtpTask(void *arg)
+{
+    uint8_t frame[PTP_FRAME_MAX];
+    struct timeval timeout;
+    fd_set fds;
+    int64_t now;
+    int64_t rx_time;
+    size_t len;
+
+    ESP_LOGI(PTP_TAG, "PTP task started on core %d", xPortGetCoreID());
+
+    if (s_ptp_ctx.fd < 0) {
+        goto exit;
+    }
+
+    while (!ptp_shutdown()) {
+        now = esp_timer_get_time();
+        if (now >= s_ptp_ctx.next_bridge) {
+            ptp_bridge_sample();
+            s_ptp_ctx.next_bridge = now + PTP_BRIDGE_PERIOD_US;
+        }
+        if (now >= s_ptp_ctx.next_report) {
+            ptp_report();
+            s_ptp_ctx.next_report = now + PTP_REPORT_PERIOD_US;
+        }
+        ptp_check_master(now);
+
+        FD_ZERO(&fds);
+        FD_SET(s_ptp_ctx.fd, &fds);
+        timeout.tv_sec = 0;
+        timeout.tv_usec = MIN(PTP_POLL_MS * 1000, MAX(0, s_ptp_ctx.next_bridge - now));
+        if (select(s_ptp_ctx.fd + 1, &fds, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        while (ptp_recv(frame, &len, &rx_time)) {
+            ptp_handle_frame(frame, len, rx_time);
+        }
+    }
+    ESP_LOGI(PTP_TAG, "Shutdown requested");
+
+exit:
+    ESP_LOGI(PTP_TAG, "PTP task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terPtpTask(void *arg)
+{
+    ESP_LOGI(PTP_TAG, "Terminating PTP task...");
+
+    if (s_ptp_ctx.fd >= 0) {
+        close(s_ptp_ctx.fd);
+        s_ptp_ctx.fd = -1;
+    }
+
+    ESP_LOGI(PTP_TAG, "PTP task terminated, %lu syncs", s_ptp_ctx.status.syncs);
+}
@@ -0,0 +1,34 @@
+/*
+ * Recorder - SD card recording of the UVC stream
+ *
+ * Every session is recorded, or with CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT only
+ * the time around a trigger, including the last
+ * CONFIG_EXAMPLE_SD_RECORD_PRE_SEC before it.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Record the pre-event window and the next CONFIG_EXAMPLE_SD_RECORD_POST_SEC
+ *
+ * The file starts at the key frame before the window, so it plays on its own.
+ * A trigger during a recording extends it. Safe to call from an ISR.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED without CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+ */
+esp_err_t recorder_trigger(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDER_H */
@@ -0,0 +1,1035 @@
+/*
+ * Recorder Tasks
+ *
+ * Responsibilities:
+ * - Mount the SD card of SDMMC slot 0 at RECORD_MOUNT_POINT
+ * - Record task: receive every encoded UVC frame as a blocking sink of the
+ *   encode task (QUEUE_RECORD) and copy it into a PSRAM staging ring
+ * - Writer task: write the ring to raw H.264 (Annex B) or MJPEG files, one file
+ *   per session, a new one once CONFIG_EXAMPLE_SD_RECORD_FILE_MB is reached
+ *
+ * The ring is made of RECORD_BLOCK_SIZE blocks. While the record task fills one,
+ * the writer sends whole blocks to the card, several in one write when it fell
+ * behind. Every file starts at a block boundary, so each write is block aligned
+ * in the file as well, only the last one of a file is short. Files are
+ * preallocated as one contiguous cluster chain and truncated when closed, so the
+ * card never has to search the FAT while recording.
+ *
+ * The encoder buffer is released as soon as the frame is copied, a card stall is
+ * absorbed by the ring and never reaches the encoder. When the ring is full the
+ * recording misses frames up to the next key frame, so it stays decodable.
+ *
+ * Every CONFIG_EXAMPLE_SD_RECORD_FLUSH_SEC the writer syncs the data file and
+ * appends the key frames seen so far to rec_NNNN.idx, a list of
+ * record_index_entry_t. Entries only point at data already on the card, after a
+ * power loss playback can resume from the last one.
+ *
+ * With CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT the ring also keeps the last
+ * CONFIG_EXAMPLE_SD_RECORD_PRE_SEC of the stream while nothing is recorded. Seek
+ * points, key frames at least a second apart, start at a block boundary, the gap
+ * before them is zero filled. The window is trimmed one seek point at a time, so
+ * recorder_trigger() can start a file at the newest seek point before the window
+ * from the encoded frames already in the ring. The live stream is not touched.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
+#include "driver/sdmmc_host.h"
+#if CONFIG_EXAMPLE_SD_LDO_CHAN >= 0
+#include "sd_pwr_ctrl_by_on_chip_ldo.h"
+#endif
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "os_interface.h"
+#include "linux/videodev2.h"
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT && CONFIG_EXAMPLE_SD_RECORD_TRIGGER_GPIO >= 0
+#define RECORD_TRIGGER_GPIO     CONFIG_EXAMPLE_SD_RECORD_TRIGGER_GPIO
+#include "driver/gpio.h"
+#endif
+#if CONFIG_EXAMPLE_SD_RECORD_IPA
+#include "esp_video_init.h"
+#endif
+#if CONFIG_EXAMPLE_SD_IPA_REPLAY
+#include "esp_video_ipa_replay.h"
+#endif
+#include "recorder.h"
+
+#define REC_TAG                 "recorder"
+#define RECORD_MOUNT_POINT      "/sdcard"
+#define RECORD_FILE_MAX         ((uint64_t)CONFIG_EXAMPLE_SD_RECORD_FILE_MB * 1024 * 1024)
+#define RECORD_INDEX_MAX        10000
+#define RECORD_ALLOC_UNIT       (64 * 1024)     /* Large clusters keep FAT updates rare */
+
+/* Staging ring */
+#define RECORD_BLOCK_SIZE       (32 * 1024)     /* Card writes are whole blocks at block aligned file offsets */
+#define RECORD_RING_BLOCKS      (CONFIG_EXAMPLE_SD_RECORD_RING_KB * 1024 / RECORD_BLOCK_SIZE)
+#define RECORD_RING_SIZE        ((size_t)RECORD_RING_BLOCKS * RECORD_BLOCK_SIZE)
+#define RECORD_WRITE_MAX        (8 * RECORD_BLOCK_SIZE)     /* Longest single write of a writer catching up */
+#define RECORD_RING_ALIGN       64              /* Cache line, the SDMMC DMA reads the ring in place */
+
+/* Pre-event window */
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+#define RECORD_SEEK_MAX         (CONFIG_EXAMPLE_SD_RECORD_PRE_SEC + 4)
+#define RECORD_PRE_US           ((int64_t)CONFIG_EXAMPLE_SD_RECORD_PRE_SEC * 1000000)
+#define RECORD_POST_US          ((int64_t)CONFIG_EXAMPLE_SD_RECORD_POST_SEC * 1000000)
+#else
+#define RECORD_SEEK_MAX         0
+#endif
+
+/* Writer */
+#define RECORD_CMD_DEPTH        (16 + RECORD_SEEK_MAX)      /* A trigger indexes the whole window at once */
+#define RECORD_CMD_WAIT_MS      100
+#define RECORD_POLL_MS          100
+#define RECORD_FLUSH_US         ((int64_t)CONFIG_EXAMPLE_SD_RECORD_FLUSH_SEC * 1000000)
+#define RECORD_INDEX_PENDING    32
+#define RECORD_SEEK_INTERVAL_US 1000000         /* Key frames closer than this to the last indexed one are skipped */
+
+/* Index file entry, little endian */
+typedef struct {
+    uint64_t offset;        /* Key frame position in the data file */
+    int64_t timestamp;      /* Camera frame end time in us */
+} record_index_entry_t;
+
+/* Record task -> writer, a ring position counts the bytes put into the ring since boot */
+typedef enum {
+    RECORD_CMD_OPEN,        /* Start a file at pos, which is block aligned */
+    RECORD_CMD_KEY,         /* A key frame starts at pos */
+    RECORD_CMD_CLOSE,       /* The file ends at pos */
+} record_cmd_type_t;
+
+typedef struct {
+    record_cmd_type_t type;
+    uint32_t format;        /* OPEN: V4L2_PIX_FMT_* of the stream */
+    uint32_t seq;           /* OPEN: number of the file since boot */
+    uint64_t pos;
+    int64_t timestamp;      /* KEY: camera frame end time */
+} record_cmd_t;
+
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+typedef struct {
+    uint64_t pos;           /* Ring position of the key frame, block aligned */
+    int64_t timestamp;
+} record_seek_t;
+#endif
+
+/* Task context */
+typedef struct {
+    sdmmc_card_t *card;
+    QueueHandle_t cmd_queue;
+    uint8_t *ring;
+    uint64_t head;                  /* Ring position of the next byte the record task puts */
+    uint64_t tail;                  /* Ring position of the next byte the writer sends to the card */
+    uint32_t writer_seq;            /* Last file the writer opened */
+    volatile bool write_failed;     /* Writer lost the current file, set until the next one opens */
+
+    /* Record task */
+    bool recording;                 /* A file is open from the record task's side */
+    bool session_failed;            /* Nothing more is recorded this session */
+    bool resync;                    /* Frames were missed, wait for a key frame */
+    bool key_requested;
+    uint32_t open_seq;              /* Last file opened */
+    uint64_t open_pos;              /* Ring position the last file started at */
+    uint64_t closed_at;             /* Ring position the last file ended at */
+    uint64_t file_size;
+    int64_t last_seek;              /* Timestamp of the last seek point */
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+    record_seek_t seeks[RECORD_SEEK_MAX];
+    uint32_t seek_first;
+    uint32_t seek_count;
+    volatile bool triggered;
+    int64_t record_until;           /* Frames up to this timestamp are recorded */
+#endif
+    uint32_t frames_written;
+    uint32_t frames_missed;
+
+    /* Writer task */
+    bool writing;                   /* Between OPEN and CLOSE, also when the file was lost */
+    FILE *file;
+    FILE *index;
+    char name[32];
+    uint32_t file_index;            /* Next file name candidate */
+    uint64_t file_start;            /* Ring position of the first byte of the file */
+    uint64_t file_written;          /* Bytes of the file on the card */
+    int64_t last_flush;
+    record_index_entry_t pending[RECORD_INDEX_PENDING];
+    uint32_t pending_count;
+    uint32_t files_written;
+#if CONFIG_EXAMPLE_SD_RECORD_IPA
+    bool ipa_recording;             /* The ISP task records the image algorithm input of the file */
+#endif
+} record_task_ctx_t;
+
+static record_task_ctx_t s_rec_ctx = {0};
+
+/* Ring positions are 64 bit and shared by both tasks */
+static portMUX_TYPE s_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_err_t record_mount(void)
+{
+    esp_err_t ret;
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    sdmmc_slot_config_t slot = SDMMC_SLOT_CONFIG_DEFAULT();
+    esp_vfs_fat_sdmmc_mount_config_t mount = {
+        .format_if_mount_failed = false,
+        .max_files = 2,
+        .allocation_unit_size = RECORD_ALLOC_UNIT,
+    };
+
+    host.slot = SDMMC_HOST_SLOT_0;
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    slot.width = 4;
+
+#if CONFIG_EXAMPLE_SD_LDO_CHAN >= 0
+    /* The slot is powered by an on-chip LDO on the ESP32-P4 boards */
+    sd_pwr_ctrl_ldo_config_t ldo_config = {
+        .ldo_chan_id = CONFIG_EXAMPLE_SD_LDO_CHAN,
+    };
+    sd_pwr_ctrl_handle_t pwr_ctrl;
+
+    APP_RETURN_ON_ERROR(sd_pwr_ctrl_new_on_chip_ldo(&ldo_config, &pwr_ctrl), REC_TAG,
+                        "Failed to power the SD card slot");
+    host.pwr_ctrl_handle = pwr_ctrl;
+#endif
+
+    ret = esp_vfs_fat_sdmmc_mount(RECORD_MOUNT_POINT, &host, &slot, &mount, &s_rec_ctx.card);
+    APP_RETURN_ON_ERROR(ret, REC_TAG, "Failed to mount the SD card (%s)", esp_err_to_name(ret));
+
+    sdmmc_card_print_info(stdout, s_rec_ctx.card);
+
+    return ESP_OK;
+}
+
+/* ========== Staging Ring ========== */
+
+static void ring_positions(uint64_t *head, uint64_t *tail)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    *head = s_rec_ctx.head;
+    *tail = s_rec_ctx.tail;
+    portEXIT_CRITICAL(&s_ring_lock);
+}
+
+/* Positions and the last file the writer opened, consistent with each other */
+static void ring_state(uint64_t *head, uint64_t *tail, uint32_t *writer_seq)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    *head = s_rec_ctx.head;
+    *tail = s_rec_ctx.tail;
+    *writer_seq = s_rec_ctx.writer_seq;
+    portEXIT_CRITICAL(&s_ring_lock);
+}
+
+static void ring_set_head(uint64_t head)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    s_rec_ctx.head = head;
+    portEXIT_CRITICAL(&s_ring_lock);
+}
+
+static void ring_set_tail(uint64_t tail)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    s_rec_ctx.tail = tail;
+    portEXIT_CRITICAL(&s_ring_lock);
+}
+
+/* Copy behind the head, the caller checked the free space */
+static void ring_put(const uint8_t *data, size_t len)
+{
+    uint64_t head, tail;
+    size_t offset, first;
+
+    ring_positions(&head, &tail);
+    offset = head % RECORD_RING_SIZE;
+    first = MIN(len, RECORD_RING_SIZE - offset);
+    memcpy(s_rec_ctx.ring + offset, data, first);
+    memcpy(s_rec_ctx.ring, data + first, len - first);
+    ring_set_head(head + len);
+}
+
+/* Zero fill behind the head */
+static void ring_pad(size_t len)
+{
+    uint64_t head, tail;
+    size_t offset, first;
+
+    ring_positions(&head, &tail);
+    offset = head % RECORD_RING_SIZE;
+    first = MIN(len, RECORD_RING_SIZE - offset);
+    memset(s_rec_ctx.ring + offset, 0, first);
+    memset(s_rec_ctx.ring, 0, len - first);
+    ring_set_head(head + len);
+}
+
+static void writer_wake(void)
+{
+    TaskHandle_t writer = os_getTaskHandler(TASK_RECORD_WRITER);
+
+    if (writer) {
+        xTaskNotifyGive(writer);
+    }
+}
+
+/* ========== Record Task Side ========== */
+
+static bool record_send(const record_cmd_t *cmd, TickType_t wait)
+{
+    if (xQueueSend(s_rec_ctx.cmd_queue, cmd, wait) != pdTRUE) {
+        return false;
+    }
+    writer_wake();
+
+    return true;
+}
+
+/* An index entry is not worth waiting for */
+static void record_send_key(uint64_t pos, int64_t timestamp)
+{
+    record_cmd_t cmd = {
+        .type = RECORD_CMD_KEY,
+        .pos = pos,
+        .timestamp = timestamp,
+    };
+
+    record_send(&cmd, 0);
+}
+
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+static record_seek_t *seek_at(uint32_t n)
+{
+    return &s_rec_ctx.seeks[(s_rec_ctx.seek_first + n) % RECORD_SEEK_MAX];
+}
+
+static void seek_drop(void)
+{
+    s_rec_ctx.seek_first = (s_rec_ctx.seek_first + 1) % RECORD_SEEK_MAX;
+    s_rec_ctx.seek_count--;
+}
+
+/* Keep the newest seek point at or before the start of the window and all after it */
+static void seek_push(uint64_t pos, int64_t timestamp)
+{
+    if (s_rec_ctx.seek_count == RECORD_SEEK_MAX) {
+        seek_drop();
+    }
+    seek_at(s_rec_ctx.seek_count)->pos = pos;
+    seek_at(s_rec_ctx.seek_count)->timestamp = timestamp;
+    s_rec_ctx.seek_count++;
+
+    while (s_rec_ctx.seek_count > 1 && seek_at(1)->timestamp <= timestamp - RECORD_PRE_US) {
+        seek_drop();
+    }
+}
+#endif
+
+/* Oldest ring position still needed, by the writer or by the pre-event window */
+static uint64_t record_low(void)
+{
+    uint64_t head, tail, low;
+    uint32_t writer_seq;
+
+    ring_state(&head, &tail, &writer_seq);
+    if (writer_seq != s_rec_ctx.open_seq) {
+        /* The writer is still on the last file, it reads from open_pos next */
+        low = MIN(tail, s_rec_ctx.open_pos);
+    } else if (s_rec_ctx.recording || tail < s_rec_ctx.closed_at) {
+        low = tail;
+    } else {
+        low = head;
+    }
+
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+    if (s_rec_ctx.seek_count) {
+        low = MIN(low, seek_at(0)->pos);
+    }
+#endif
+
+    return low;
+}
+
+static bool record_reserve(size_t len)
+{
+    uint64_t head, tail;
+
+    ring_positions(&head, &tail);
+    while (head + len - record_low() > RECORD_RING_SIZE) {
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+        /* The window gets shorter before the recording misses frames */
+        if (s_rec_ctx.seek_count) {
+            seek_drop();
+            continue;
+        }
+#endif
+        return false;
+    }
+
+    return true;
+}
+
+/* Open the next file at pos, which is block aligned */
+static bool record_start(uint32_t format, uint64_t pos)
+{
+    uint64_t head, tail;
+    record_cmd_t cmd = {
+        .type = RECORD_CMD_OPEN,
+        .format = format,
+        .seq = s_rec_ctx.open_seq + 1,
+        .pos = pos,
+    };
+
+    if (!record_send(&cmd, pdMS_TO_TICKS(RECORD_CMD_WAIT_MS))) {
+        ESP_LOGE(REC_TAG, "Writer not responding, recording stopped");
+        s_rec_ctx.session_failed = true;
+        return false;
+    }
+
+    ring_positions(&head, &tail);
+    s_rec_ctx.open_seq = cmd.seq;
+    s_rec_ctx.open_pos = pos;
+    s_rec_ctx.recording = true;
+    s_rec_ctx.file_size = head - pos;
+
+    return true;
+}
+
+static void record_stop(void)
+{
+    uint64_t head, tail;
+    record_cmd_t cmd = {
+        .type = RECORD_CMD_CLOSE,
+    };
+
+    if (!s_rec_ctx.recording) {
+        return;
+    }
+
+    ring_positions(&head, &tail);
+    cmd.pos = head;
+    if (!record_send(&cmd, pdMS_TO_TICKS(RECORD_CMD_WAIT_MS))) {
+        ESP_LOGE(REC_TAG, "Writer not responding, file not closed");
+    }
+    s_rec_ctx.closed_at = head;
+    s_rec_ctx.recording = false;
+}
+
+/* Frames are missed up to the next key frame, so the file stays decodable */
+static void record_miss(void)
+{
+    s_rec_ctx.frames_missed++;
+    s_rec_ctx.resync = true;
+    if (!s_rec_ctx.key_requested) {
+        s_rec_ctx.key_requested = uvc_app_h264_request_keyframe() == ESP_OK;
+    }
+}
+
+/* Whether the frame belongs to a recording, every frame does without pre-event recording */
+static bool record_wanted(const frame_buffer_t *frame)
+{
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+    if (s_rec_ctx.triggered) {
+        s_rec_ctx.triggered = false;
+        if (frame->timestamp >= s_rec_ctx.record_until) {
+            ESP_LOGI(REC_TAG, "Triggered, recording the last %d s", CONFIG_EXAMPLE_SD_RECORD_PRE_SEC);
+        }
+        s_rec_ctx.record_until = frame->timestamp + RECORD_POST_US;
+    }
+
+    return frame->timestamp < s_rec_ctx.record_until;
+#else
+    return true;
+#endif
+}
+
+static bool record_has_window(void)
+{
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+    return s_rec_ctx.seek_count > 0;
+#else
+    return false;
+#endif
+}
+
+static void record_frame(const frame_buffer_t *frame)
+{
+    /* Flags are unknown for a stream which didn't report them, every frame is a key frame then */
+    bool key = (frame->flags & V4L2_BUF_FLAG_KEYFRAME) || !frame->flags;
+    bool wanted = record_wanted(frame);
+    bool seek;
+    bool rotate = false;
+    uint64_t head, tail, start;
+    size_t pad = 0;
+
+    if (s_rec_ctx.write_failed && s_rec_ctx.recording) {
+        s_rec_ctx.session_failed = true;
+        record_stop();
+    }
+    if (s_rec_ctx.session_failed) {
+        return;
+    }
+
+    /* Start the next file at a key frame, so each one plays on its own */
+    if (s_rec_ctx.recording && key && s_rec_ctx.file_size >= RECORD_FILE_MAX) {
+        record_stop();
+        rotate = true;
+    }
+    if (s_rec_ctx.recording && !wanted) {
+        record_stop();
+    }
+
+    if (s_rec_ctx.resync && !key) {
+        return;
+    }
+    if (!s_rec_ctx.recording && !key && !record_has_window()) {
+        if (wanted) {
+            record_miss();
+        }
+        return;
+    }
+
+    /* A file starting here needs a seek point as well */
+    seek = key && (frame->timestamp - s_rec_ctx.last_seek >= RECORD_SEEK_INTERVAL_US ||
+                   (!s_rec_ctx.recording && wanted));
+
+    /*
+     * Files start at a block boundary. Without a window the writer skips the rest
+     * of the block the last file ended in. Seek points of the window are in the
+     * middle of a recording, there the gap is zero filled, which H.264
+     * (trailing_zero_8bits) and JPEG decoders skip between frames.
+     */
+    ring_positions(&head, &tail);
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+    if (seek) {
+        pad = (RECORD_BLOCK_SIZE - head % RECORD_BLOCK_SIZE) % RECORD_BLOCK_SIZE;
+    }
+#else
+    if (!s_rec_ctx.recording) {
+        pad = (RECORD_BLOCK_SIZE - head % RECORD_BLOCK_SIZE) % RECORD_BLOCK_SIZE;
+    }
+#endif
+
+    if (!record_reserve(frame->size + pad)) {
+        if (s_rec_ctx.recording || wanted) {
+            record_miss();
+        } else {
+            s_rec_ctx.resync = true;
+        }
+        return;
+    }
+
+    ring_pad(pad);
+    ring_positions(&head, &tail);
+    if (seek) {
+        s_rec_ctx.last_seek = frame->timestamp;
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+        seek_push(head, frame->timestamp);
+#endif
+    }
+
+    if (!s_rec_ctx.recording && wanted) {
+        /* The window may be gone if the ring was full */
+        if (!key && !record_has_window()) {
+            record_miss();
+            return;
+        }
+
+        /* A trigger starts with the window, the next file of a recording with this frame */
+        start = head;
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+        if (!rotate) {
+            start = seek_at(0)->pos;
+        }
+#endif
+        if (!record_start(frame->format, start)) {
+            return;
+        }
+
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+        for (uint32_t i = 0; i < s_rec_ctx.seek_count; i++) {
+            if (seek_at(i)->pos >= start) {
+                record_send_key(seek_at(i)->pos, seek_at(i)->timestamp);
+            }
+        }
+#else
+        (void)rotate;
+        record_send_key(head, frame->timestamp);
+#endif
+    } else if (s_rec_ctx.recording && seek) {
+        record_send_key(head, frame->timestamp);
+    }
+
+    ring_put(frame->data, frame->size);
+    if (key) {
+        s_rec_ctx.resync = false;
+        s_rec_ctx.key_requested = false;
+    }
+    if (s_rec_ctx.recording) {
+        writer_wake();
+        s_rec_ctx.file_size += frame->size;
+        s_rec_ctx.frames_written++;
+    }
+}
+
+/* ========== Writer Task Side ========== */
+
+#if CONFIG_EXAMPLE_SD_RECORD_IPA
+/* ipa_NNNN.bin next to the file, for esp_video_ipa_replay() */
+static void writer_ipa_start(void)
+{
+    char name[sizeof(s_rec_ctx.name)];
+
+    snprintf(name, sizeof(name), RECORD_MOUNT_POINT "/ipa_%04lu.bin", s_rec_ctx.file_index - 1);
+    s_rec_ctx.ipa_recording = esp_video_isp_pipeline_record_start(name) == ESP_OK;
+    if (!s_rec_ctx.ipa_recording) {
+        ESP_LOGW(REC_TAG, "Image algorithm input of %s not recorded", s_rec_ctx.name);
+    }
+}
+
+static void writer_ipa_stop(void)
+{
+    uint32_t runs = 0;
+
+    if (!s_rec_ctx.ipa_recording) {
+        return;
+    }
+    s_rec_ctx.ipa_recording = false;
+    if (esp_video_isp_pipeline_record_stop(&runs) == ESP_OK) {
+        ESP_LOGI(REC_TAG, "Recorded %lu image algorithm runs with %s", runs, s_rec_ctx.name);
+    }
+}
+#endif
+
+static void writer_fail(const char *what)
+{
+    ESP_LOGE(REC_TAG, "Failed to %s %s (errno=%d), recording stopped", what, s_rec_ctx.name, errno);
+    s_rec_ctx.write_failed = true;
+#if CONFIG_EXAMPLE_SD_RECORD_IPA
+    writer_ipa_stop();
+#endif
+    if (s_rec_ctx.index) {
+        fclose(s_rec_ctx.index);
+        s_rec_ctx.index = NULL;
+    }
+    if (s_rec_ctx.file) {
+        fclose(s_rec_ctx.file);
+        s_rec_ctx.file = NULL;
+    }
+}
+
+static FILE *writer_create(const char *name, uint64_t prealloc)
+{
+    FILE *file;
+
+    /* One contiguous cluster chain, so appending never walks the FAT for space */
+    if (prealloc && esp_vfs_fat_create_contiguous_file(RECORD_MOUNT_POINT, name, prealloc, true) == ESP_OK) {
+        file = fopen(name, "r+b");
+    } else {
+        if (prealloc) {
+            ESP_LOGW(REC_TAG, "No contiguous %llu MB for %s, recording into a fragmented file",
+                     prealloc / (1024 * 1024), name);
+        }
+        file = fopen(name, "wb");
+    }
+
+    /* Writes are whole blocks from the ring, buffering would only add a copy */
+    if (file) {
+        setvbuf(file, NULL, _IONBF, 0);
+    }
+
+    return file;
+}
+
+static void writer_open(const record_cmd_t *cmd)
+{
+    struct stat st;
+    char index_name[sizeof(s_rec_ctx.name)];
+    const char *ext = cmd->format == V4L2_PIX_FMT_H264 ? "264" : "mjp";
+
+    /* 8.3 names work without FATFS long file name support, continue after the recordings on the card */
+    do {
+        snprintf(s_rec_ctx.name, sizeof(s_rec_ctx.name), RECORD_MOUNT_POINT "/rec_%04lu.%s",
+                 s_rec_ctx.file_index, ext);
+        s_rec_ctx.file_index++;
+    } while (stat(s_rec_ctx.name, &st) == 0 && s_rec_ctx.file_index < RECORD_INDEX_MAX);
+    snprintf(index_name, sizeof(index_name), RECORD_MOUNT_POINT "/rec_%04lu.idx", s_rec_ctx.file_index - 1);
+
+    portENTER_CRITICAL(&s_ring_lock);
+    s_rec_ctx.tail = cmd->pos;
+    s_rec_ctx.writer_seq = cmd->seq;
+    portEXIT_CRITICAL(&s_ring_lock);
+    s_rec_ctx.writing = true;
+    s_rec_ctx.file_start = cmd->pos;
+    s_rec_ctx.file_written = 0;
+    s_rec_ctx.pending_count = 0;
+    s_rec_ctx.last_flush = esp_timer_get_time();
+
+    s_rec_ctx.file = writer_create(s_rec_ctx.name, RECORD_FILE_MAX);
+    if (!s_rec_ctx.file) {
+        writer_fail("create");
+        return;
+    }
+    s_rec_ctx.index = writer_create(index_name, 0);
+    if (!s_rec_ctx.index) {
+        writer_fail("create the index of");
+        return;
+    }
+    s_rec_ctx.write_failed = false;
+#if CONFIG_EXAMPLE_SD_RECORD_IPA
+    writer_ipa_start();
+#endif
+
+    ESP_LOGI(REC_TAG, "Recording to %s", s_rec_ctx.name);
+}
+
+/* Send the ring up to 'end' to the card, a partial last block only when the file ends there */
+static void writer_write_to(uint64_t end, bool partial)
+{
+    uint64_t head, tail;
+    size_t offset, len;
+
+    ring_positions(&head, &tail);
+    while (tail < end) {
+        offset = tail % RECORD_RING_SIZE;
+        len = MIN(end - tail, RECORD_WRITE_MAX);
+        len = MIN(len, RECORD_RING_SIZE - offset);
+        if (len >= RECORD_BLOCK_SIZE) {
+            len -= len % RECORD_BLOCK_SIZE;
+        } else if (!partial) {
+            break;
+        }
+
+        /* Data of a lost file is dropped, so the ring keeps draining */
+        if (s_rec_ctx.file) {
+            if (fwrite(s_rec_ctx.ring + offset, 1, len, s_rec_ctx.file) == len) {
+                s_rec_ctx.file_written += len;
+            } else {
+                writer_fail("write");
+            }
+        }
+
+        tail += len;
+        ring_set_tail(tail);
+    }
+}
+
+/* Sync the data written so far, then append the index entries pointing into it */
+static void writer_flush(void)
+{
+    uint32_t count = 0;
+
+    s_rec_ctx.last_flush = esp_timer_get_time();
+    if (!s_rec_ctx.file || fsync(fileno(s_rec_ctx.file)) != 0) {
+        return;
+    }
+
+    while (count < s_rec_ctx.pending_count && s_rec_ctx.pending[count].offset < s_rec_ctx.file_written) {
+        count++;
+    }
+    if (!count) {
+        return;
+    }
+
+    if (fwrite(s_rec_ctx.pending, sizeof(record_index_entry_t), count, s_rec_ctx.index) != count ||
+            fsync(fileno(s_rec_ctx.index)) != 0) {
+        ESP_LOGW(REC_TAG, "Failed to update the index of %s (errno=%d)", s_rec_ctx.name, errno);
+    }
+    s_rec_ctx.pending_count -= count;
+    memmove(s_rec_ctx.pending, s_rec_ctx.pending + count, s_rec_ctx.pending_count * sizeof(record_index_entry_t));
+}
+
+static void writer_key(const record_cmd_t *cmd)
+{
+    if (!s_rec_ctx.file) {
+        return;
+    }
+
+    /* Entries wait for their data to reach the card, make room by flushing early */
+    if (s_rec_ctx.pending_count == RECORD_INDEX_PENDING) {
+        writer_flush();
+    }
+    if (s_rec_ctx.pending_count < RECORD_INDEX_PENDING) {
+        s_rec_ctx.pending[s_rec_ctx.pending_count].offset = cmd->pos - s_rec_ctx.file_start;
+        s_rec_ctx.pending[s_rec_ctx.pending_count].timestamp = cmd->timestamp;
+        s_rec_ctx.pending_count++;
+    }
+}
+
+static void writer_close(const record_cmd_t *cmd)
+{
+    writer_write_to(cmd->pos, true);
+    s_rec_ctx.writing = false;
+    if (!s_rec_ctx.file) {
+        return;
+    }
+
+    writer_flush();
+
+    /* Give back the preallocated clusters past the end */
+    if (ftruncate(fileno(s_rec_ctx.file), s_rec_ctx.file_written) != 0) {
+        ESP_LOGW(REC_TAG, "Failed to truncate %s (errno=%d)", s_rec_ctx.name, errno);
+    }
+    if (fclose(s_rec_ctx.file) != 0) {
+        ESP_LOGW(REC_TAG, "Failed to close %s (errno=%d)", s_rec_ctx.name, errno);
+    }
+    s_rec_ctx.file = NULL;
+    fclose(s_rec_ctx.index);
+    s_rec_ctx.index = NULL;
+    s_rec_ctx.files_written++;
+#if CONFIG_EXAMPLE_SD_RECORD_IPA
+    writer_ipa_stop();
+#endif
+
+    ESP_LOGI(REC_TAG, "Closed %s, %llu bytes", s_rec_ctx.name, s_rec_ctx.file_written);
+}
+
+#if CONFIG_EXAMPLE_SD_IPA_REPLAY
+/* Same input as on the target it was recorded on, the result shows what a new tuning changed */
+static void writer_ipa_replay(void)
+{
+    esp_err_t ret;
+    FILE *out;
+    esp_video_ipa_replay_result_t result;
+
+    out = fopen(RECORD_MOUNT_POINT "/replay.csv", "w");
+    if (!out) {
+        ESP_LOGW(REC_TAG, "Failed to create replay.csv (errno=%d), replaying without it", errno);
+    }
+
+    ret = esp_video_ipa_replay(RECORD_MOUNT_POINT "/" CONFIG_EXAMPLE_SD_IPA_REPLAY_FILE, out, &result);
+    if (out) {
+        fclose(out);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(REC_TAG, "Failed to replay %s (%s)", CONFIG_EXAMPLE_SD_IPA_REPLAY_FILE, esp_err_to_name(ret));
+    }
+}
+#endif
+
+static void writer_handle(const record_cmd_t *cmd)
+{
+    switch (cmd->type) {
+    case RECORD_CMD_OPEN:
+        writer_open(cmd);
+        break;
+    case RECORD_CMD_KEY:
+        writer_key(cmd);
+        break;
+    case RECORD_CMD_CLOSE:
+        writer_close(cmd);
+        break;
+    }
+}
+
+/* ========== Trigger ========== */
+
+esp_err_t recorder_trigger(void)
+{
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+    /* Picked up with the next frame, so it stays safe from an ISR */
+    s_rec_ctx.triggered = true;
+
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+#ifdef RECORD_TRIGGER_GPIO
+static void record_trigger_isr(void *arg)
+{
+    recorder_trigger();
+}
+
+static esp_err_t record_trigger_init(void)
+{
+    esp_err_t ret;
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << RECORD_TRIGGER_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+
+    APP_RETURN_ON_ERROR(gpio_config(&io_conf), REC_TAG, "Failed to configure trigger GPIO");
+
+    /* The service may be installed by another driver already */
+    ret = gpio_install_isr_service(0);
+    APP_RETURN_ON_FALSE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE, ret, REC_TAG,
+                        "Failed to install GPIO ISR service");
+
+    return gpio_isr_handler_add(RECORD_TRIGGER_GPIO, record_trigger_isr, NULL);
+}
+#endif
+
+/* ========== Init Phase ========== */
+void initRecordTask(void *arg)
+{
+    ESP_LOGI(REC_TAG, "Initializing recorder task...");
+
+    s_rec_ctx.file = NULL;
+    s_rec_ctx.index = NULL;
+    s_rec_ctx.file_index = 0;
+
+    /* The SDMMC DMA reads the ring in place, fall back to a bounce buffer if PSRAM can't do DMA */
+    s_rec_ctx.ring = memstat_aligned_alloc(MEMSTAT_RECORDER, RECORD_RING_ALIGN, RECORD_RING_SIZE,
+                                           MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+    if (!s_rec_ctx.ring) {
+        s_rec_ctx.ring = memstat_aligned_alloc(MEMSTAT_RECORDER, RECORD_RING_ALIGN, RECORD_RING_SIZE, MALLOC_CAP_SPIRAM);
+    }
+    s_rec_ctx.cmd_queue = xQueueCreate(RECORD_CMD_DEPTH, sizeof(record_cmd_t));
+    if (!s_rec_ctx.ring || !s_rec_ctx.cmd_queue) {
+        ESP_LOGE(REC_TAG, "Failed to allocate the %u KB staging ring, recording disabled",
+                 (unsigned)(RECORD_RING_SIZE / 1024));
+        return;
+    }
+
+    if (record_mount() != ESP_OK) {
+        ESP_LOGE(REC_TAG, "SD card not available, recording disabled");
+        return;
+    }
+
+#ifdef RECORD_TRIGGER_GPIO
+    APP_LOG_ON_ERROR(record_trigger_init(), REC_TAG, "Trigger button not available");
+#endif
+
+    ESP_LOGI(REC_TAG, "Recorder task initialized, %d x %d KB staging ring",
+             RECORD_RING_BLOCKS, RECORD_BLOCK_SIZE / 1024);
+}
+
+/* ========== Main Loop ========== */
+void mainRecordTask(void *arg)
+{
+    EventBits_t bits;
+    frame_buffer_t *frame;
+    QueueHandle_t queue;
+
+    ESP_LOGI(REC_TAG, "Recorder task started on core %d", xPortGetCoreID());
+
+    if (!s_rec_ctx.card) {
+        goto exit;
+    }
+
+    queue = os_getQueueHandler(QUEUE_RECORD);
+    if (!queue || uvc_encode_add_sink(queue, SINK_POLICY_BLOCK, CONFIG_EXAMPLE_SD_RECORD_WAIT_MS) != ESP_OK) {
+        ESP_LOGE(REC_TAG, "Failed to register recorder frame queue");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(REC_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        /* A new session may have a new card or free space */
+        s_rec_ctx.session_failed = false;
+        s_rec_ctx.resync = false;
+        s_rec_ctx.key_requested = false;
+        s_rec_ctx.last_seek = -RECORD_SEEK_INTERVAL_US;
+#if CONFIG_EXAMPLE_SD_RECORD_PRE_EVENT
+        /* The window of the last session may have another format */
+        s_rec_ctx.seek_count = 0;
+        s_rec_ctx.triggered = false;
+        s_rec_ctx.record_until = 0;
+#endif
+
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            if (xQueueReceive(queue, &frame, pdMS_TO_TICKS(100)) != pdTRUE) {
+                continue;
+            }
+
+            record_frame(frame);
+            frame_buffer_release(frame);
+        }
+
+        /* Frames still queued are released by uvc_pipeline_halt() */
+        record_stop();
+    }
+
+exit:
+    ESP_LOGI(REC_TAG, "Recorder task exiting");
+    vTaskDelete(NULL);
+}
+
+void mainRecordWriterTask(void *arg)
+{
+    uint64_t head, tail;
+    record_cmd_t cmd;
+
+    ESP_LOGI(REC_TAG, "Recorder writer task started on core %d", xPortGetCoreID());
+
+    if (!s_rec_ctx.card) {
+        goto exit;
+    }
+
+#if CONFIG_EXAMPLE_SD_IPA_REPLAY
+    writer_ipa_replay();
+#endif
+
+    while (!(xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN)) {
+        /* Commands for everything up to this head are already queued */
+        ring_positions(&head, &tail);
+        while (xQueueReceive(s_rec_ctx.cmd_queue, &cmd, 0) == pdTRUE) {
+            writer_handle(&cmd);
+        }
+        if (s_rec_ctx.writing) {
+            writer_write_to(head, false);
+        }
+
+        if (s_rec_ctx.file && esp_timer_get_time() - s_rec_ctx.last_flush >= RECORD_FLUSH_US) {
+            writer_flush();
+        }
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RECORD_POLL_MS));
+    }
+    ESP_LOGI(REC_TAG, "Shutdown requested");
+
+exit:
+    ESP_LOGI(REC_TAG, "Recorder writer task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terRecordTask(void *arg)
+{
+    uint64_t head, tail;
+    record_cmd_t cmd;
+
+    ESP_LOGI(REC_TAG, "Terminating recorder task...");
+
+    /* The writer may be gone, finish what is left in the ring here without waking it */
+    if (s_rec_ctx.card) {
+        while (xQueueReceive(s_rec_ctx.cmd_queue, &cmd, 0) == pdTRUE) {
+            writer_handle(&cmd);
+        }
+        if (s_rec_ctx.recording) {
+            ring_positions(&head, &tail);
+            cmd.type = RECORD_CMD_CLOSE;
+            cmd.pos = head;
+            writer_handle(&cmd);
+            s_rec_ctx.recording = false;
+        }
+        esp_vfs_fat_sdcard_unmount(RECORD_MOUNT_POINT, s_rec_ctx.card);
+        s_rec_ctx.card = NULL;
+    }
+
+    ESP_LOGI(REC_TAG, "Recorder task terminated, wrote %lu frames to %lu files, missed %lu",
+             s_rec_ctx.frames_written, s_rec_ctx.files_written, s_rec_ctx.frames_missed);
+}
@@ -0,0 +1,56 @@
+/*
+ * RTP Packetizer - H.264 (RFC 6184) and JPEG (RFC 2435) payload formats
+ *
+ * A frame is cut into packets without copying it. Every packet is handed to the
+ * send callback as a header, built in a small buffer of the packetizer, and a
+ * slice of the frame, so the transport can gather both into one datagram.
+ */
+
+#ifndef RTP_PACKETIZER_H
+#define RTP_PACKETIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_PAYLOAD_TYPE_JPEG   26      /* Static payload type of RFC 3551 */
+#define RTP_PAYLOAD_TYPE_H264   96      /* Dynamic, announced in the SDP */
+#define RTP_CLOCK_RATE          90000
+
+/* Sends one packet, hdr and payload are only valid until it returns */
+typedef esp_err_t (*rtp_send_t)(const uint8_t *hdr, size_t hdr_len,
+                                const uint8_t *payload, size_t payload_len, void *ctx);
+
+typedef struct {
+    uint8_t payload_type;       /* RTP_PAYLOAD_TYPE_* */
+    uint16_t sequence;
+    uint32_t ssrc;
+    size_t mtu;                 /* Largest packet, headers included */
+    rtp_send_t send;
+    void *send_ctx;
+} rtp_packetizer_t;
+
+/**
+ * @brief Packetize one encoded frame
+ *
+ * @param rtp       Packetizer, the sequence number continues across frames
+ * @param data      Annex B H.264 access unit or baseline JPEG image
+ * @param len       Frame size in bytes
+ * @param timestamp Capture time in microseconds
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the frame can't be carried by the payload format
+ *      - Others if sending failed, the rest of the frame is skipped
+ */
+esp_err_t rtp_packetize_frame(rtp_packetizer_t *rtp, const uint8_t *data, size_t len, int64_t timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTP_PACKETIZER_H */
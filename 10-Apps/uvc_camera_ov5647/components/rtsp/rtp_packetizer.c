@@ -0,0 +1,312 @@
+/*
+ * RTP Packetizer
+ *
+ * Responsibilities:
+ * - Split Annex B H.264 access units into single NAL unit and FU-A packets (RFC 6184,
+ *   packetization-mode=1)
+ * - Turn baseline JPEG images into RFC 2435 packets, with the quantization tables
+ *   in-band (Q = 255) and restart markers when the encoder uses restart intervals
+ *
+ * RFC 2435 receivers rebuild the JPEG headers themselves and assume the Huffman
+ * tables of JPEG Annex K, which is what the hardware JPEG encoder uses.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#include "rtp_packetizer.h"
+
+#define RTP_VERSION             0x80
+#define RTP_MARKER              0x80
+#define RTP_HEADER_SIZE         12
+
+#define H264_NAL_TYPE_MASK      0x1F
+#define H264_NAL_FU_A           28
+#define H264_FU_START           0x80
+#define H264_FU_END             0x40
+#define H264_FU_HEADER_SIZE     2
+
+#define JPEG_HEADER_SIZE        8
+#define JPEG_RESTART_HEADER_SIZE 4
+#define JPEG_QT_HEADER_SIZE     4
+#define JPEG_QT_SIZE            64          /* 8-bit precision table */
+#define JPEG_QT_MAX             2           /* Luma and chroma */
+#define JPEG_Q_IN_BAND          255         /* Tables follow in the first packet of the frame */
+#define JPEG_TYPE_422           0
+#define JPEG_TYPE_420           1
+#define JPEG_TYPE_RESTART       64
+#define JPEG_RESTART_COUNT_ANY  0xFFFF      /* F = L = 1, count 0x3FFF: intervals aren't aligned to packets */
+#define JPEG_MAX_DIMENSION      2040        /* 8 pixel units in one byte */
+
+#define JPEG_MARKER_SOF0        0xC0
+#define JPEG_MARKER_DHT         0xC4
+#define JPEG_MARKER_SOI         0xD8
+#define JPEG_MARKER_EOI         0xD9
+#define JPEG_MARKER_SOS         0xDA
+#define JPEG_MARKER_DQT         0xDB
+#define JPEG_MARKER_DRI         0xDD
+
+/* What RFC 2435 needs from the JPEG headers */
+typedef struct {
+    uint8_t type;
+    uint16_t width;
+    uint16_t height;
+    uint16_t restart_interval;
+    const uint8_t *qtables[JPEG_QT_MAX];
+    const uint8_t *scan;            /* Entropy coded data, EOI excluded */
+    size_t scan_len;
+} jpeg_layout_t;
+
+static size_t rtp_header(rtp_packetizer_t *rtp, uint8_t *hdr, uint32_t timestamp, bool marker)
+{
+    hdr[0] = RTP_VERSION;
+    hdr[1] = (marker ? RTP_MARKER : 0) | rtp->payload_type;
+    hdr[2] = rtp->sequence >> 8;
+    hdr[3] = rtp->sequence & 0xFF;
+    hdr[4] = timestamp >> 24;
+    hdr[5] = (timestamp >> 16) & 0xFF;
+    hdr[6] = (timestamp >> 8) & 0xFF;
+    hdr[7] = timestamp & 0xFF;
+    hdr[8] = rtp->ssrc >> 24;
+    hdr[9] = (rtp->ssrc >> 16) & 0xFF;
+    hdr[10] = (rtp->ssrc >> 8) & 0xFF;
+    hdr[11] = rtp->ssrc & 0xFF;
+    rtp->sequence++;
+
+    return RTP_HEADER_SIZE;
+}
+
+/* ========== H.264 (RFC 6184) ========== */
+
+/* Offset right after the next 00 00 01 start code at or after pos, len if there is none */
+static size_t h264_find_nal(const uint8_t *data, size_t len, size_t pos)
+{
+    for (size_t i = pos; i + 2 < len; i++) {
+        if (data[i + 2] > 1) {
+            i += 2;
+        } else if (!data[i] && !data[i + 1] && data[i + 2] == 1) {
+            return i + 3;
+        }
+    }
+
+    return len;
+}
+
+static esp_err_t h264_send_nal(rtp_packetizer_t *rtp, const uint8_t *nal, size_t size, uint32_t timestamp, bool last)
+{
+    esp_err_t ret;
+    uint8_t hdr[RTP_HEADER_SIZE + H264_FU_HEADER_SIZE];
+    size_t max_payload = rtp->mtu - RTP_HEADER_SIZE;
+    uint8_t nal_header = nal[0];
+    bool start = true;
+
+    if (size <= max_payload) {
+        return rtp->send(hdr, rtp_header(rtp, hdr, timestamp, last), nal, size, rtp->send_ctx);
+    }
+
+    /* FU-A, the NAL header is carried by the FU indicator and header of every fragment */
+    max_payload -= H264_FU_HEADER_SIZE;
+    nal++;
+    size--;
+    while (size) {
+        size_t chunk = MIN(size, max_payload);
+        bool end = chunk == size;
+        size_t hdr_len = rtp_header(rtp, hdr, timestamp, last && end);
+
+        hdr[hdr_len++] = (nal_header & ~H264_NAL_TYPE_MASK) | H264_NAL_FU_A;
+        hdr[hdr_len++] = (start ? H264_FU_START : 0) | (end ? H264_FU_END : 0) | (nal_header & H264_NAL_TYPE_MASK);
+        ret = rtp->send(hdr, hdr_len, nal, chunk, rtp->send_ctx);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        nal += chunk;
+        size -= chunk;
+        start = false;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t h264_packetize(rtp_packetizer_t *rtp, const uint8_t *data, size_t len, uint32_t timestamp)
+{
+    size_t nal = h264_find_nal(data, len, 0);
+
+    if (nal >= len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (nal < len) {
+        size_t next = h264_find_nal(data, len, nal);
+        size_t end = next < len ? next - 3 : len;
+        esp_err_t ret;
+
+        /* NAL units never end in a zero byte, those belong to the next start code */
+        while (end > nal && !data[end - 1]) {
+            end--;
+        }
+        if (end > nal) {
+            ret = h264_send_nal(rtp, data + nal, end - nal, timestamp, next >= len);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        nal = next;
+    }
+
+    return ESP_OK;
+}
+
+/* ========== JPEG (RFC 2435) ========== */
+
+static esp_err_t jpeg_parse(const uint8_t *data, size_t len, jpeg_layout_t *jpeg)
+{
+    size_t pos = 2;
+
+    memset(jpeg, 0, sizeof(jpeg_layout_t));
+    if (len < 4 || data[0] != 0xFF || data[1] != JPEG_MARKER_SOI) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (!jpeg->scan && pos + 4 <= len) {
+        uint8_t marker = data[pos + 1];
+        size_t seg_len = (data[pos + 2] << 8) | data[pos + 3];
+        const uint8_t *body = data + pos + 4;
+
+        if (data[pos] != 0xFF || seg_len < 2 || pos + 2 + seg_len > len) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        switch (marker) {
+        case JPEG_MARKER_DQT:
+            for (size_t i = 0; i + 1 + JPEG_QT_SIZE <= seg_len - 2; i += 1 + JPEG_QT_SIZE) {
+                /* Only 8-bit tables, 16-bit precision would change the table length */
+                if (body[i] >> 4) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                if ((body[i] & 0x0F) < JPEG_QT_MAX) {
+                    jpeg->qtables[body[i] & 0x0F] = body + i + 1;
+                }
+            }
+            break;
+        case JPEG_MARKER_SOF0:
+            /* YCbCr with 2x1 or 2x2 luma and 1x1 chroma sampling, the only layouts of types 0 and 1 */
+            if (seg_len < 17 || body[5] != 3 || body[10] != 0x11 || body[13] != 0x11) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            jpeg->height = (body[1] << 8) | body[2];
+            jpeg->width = (body[3] << 8) | body[4];
+            if (body[7] == 0x21) {
+                jpeg->type = JPEG_TYPE_422;
+            } else if (body[7] == 0x22) {
+                jpeg->type = JPEG_TYPE_420;
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+            break;
+        case JPEG_MARKER_DRI:
+            if (seg_len < 4) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            jpeg->restart_interval = (body[0] << 8) | body[1];
+            break;
+        case JPEG_MARKER_SOS:
+            jpeg->scan = data + pos + 2 + seg_len;
+            jpeg->scan_len = len - (pos + 2 + seg_len);
+            break;
+        default:
+            /* Progressive and other frame types can't be described by RFC 2435 */
+            if (marker > JPEG_MARKER_SOF0 && marker <= 0xCF && marker != JPEG_MARKER_DHT) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            break;
+        }
+        pos += 2 + seg_len;
+    }
+
+    if (!jpeg->scan || !jpeg->width || !jpeg->qtables[0] || !jpeg->qtables[1] ||
+            jpeg->width > JPEG_MAX_DIMENSION || jpeg->height > JPEG_MAX_DIMENSION) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (jpeg->scan_len >= 2 && jpeg->scan[jpeg->scan_len - 2] == 0xFF &&
+            jpeg->scan[jpeg->scan_len - 1] == JPEG_MARKER_EOI) {
+        jpeg->scan_len -= 2;
+    }
+    if (jpeg->restart_interval) {
+        jpeg->type |= JPEG_TYPE_RESTART;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_packetize(rtp_packetizer_t *rtp, const uint8_t *data, size_t len, uint32_t timestamp)
+{
+    esp_err_t ret;
+    jpeg_layout_t jpeg;
+    uint8_t hdr[RTP_HEADER_SIZE + JPEG_HEADER_SIZE + JPEG_RESTART_HEADER_SIZE +
+                JPEG_QT_HEADER_SIZE + JPEG_QT_MAX * JPEG_QT_SIZE];
+    size_t offset = 0;
+
+    ret = jpeg_parse(data, len, &jpeg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    while (offset < jpeg.scan_len) {
+        size_t hdr_len = RTP_HEADER_SIZE + JPEG_HEADER_SIZE +
+                         (jpeg.restart_interval ? JPEG_RESTART_HEADER_SIZE : 0) +
+                         (offset ? 0 : JPEG_QT_HEADER_SIZE + JPEG_QT_MAX * JPEG_QT_SIZE);
+        size_t chunk = MIN(jpeg.scan_len - offset, rtp->mtu - hdr_len);
+        size_t pos = rtp_header(rtp, hdr, timestamp, offset + chunk == jpeg.scan_len);
+
+        hdr[pos++] = 0;                         /* Type-specific, progressive frame */
+        hdr[pos++] = (offset >> 16) & 0xFF;
+        hdr[pos++] = (offset >> 8) & 0xFF;
+        hdr[pos++] = offset & 0xFF;
+        hdr[pos++] = jpeg.type;
+        hdr[pos++] = JPEG_Q_IN_BAND;
+        hdr[pos++] = (jpeg.width + 7) / 8;
+        hdr[pos++] = (jpeg.height + 7) / 8;
+        if (jpeg.restart_interval) {
+            hdr[pos++] = jpeg.restart_interval >> 8;
+            hdr[pos++] = jpeg.restart_interval & 0xFF;
+            hdr[pos++] = JPEG_RESTART_COUNT_ANY >> 8;
+            hdr[pos++] = JPEG_RESTART_COUNT_ANY & 0xFF;
+        }
+        if (!offset) {
+            hdr[pos++] = 0;                     /* MBZ */
+            hdr[pos++] = 0;                     /* 8-bit precision for both tables */
+            hdr[pos++] = 0;
+            hdr[pos++] = JPEG_QT_MAX * JPEG_QT_SIZE;
+            for (int i = 0; i < JPEG_QT_MAX; i++) {
+                memcpy(hdr + pos, jpeg.qtables[i], JPEG_QT_SIZE);
+                pos += JPEG_QT_SIZE;
+            }
+        }
+
+        ret = rtp->send(hdr, pos, jpeg.scan + offset, chunk, rtp->send_ctx);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        offset += chunk;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t rtp_packetize_frame(rtp_packetizer_t *rtp, const uint8_t *data, size_t len, int64_t timestamp)
+{
+    /* 90 kHz media clock, wrapping is expected */
+    uint32_t rtp_timestamp = (uint32_t)((uint64_t)timestamp * (RTP_CLOCK_RATE / 1000) / 1000);
+
+    if (!rtp || !data || !len || rtp->mtu <= RTP_HEADER_SIZE + JPEG_HEADER_SIZE + JPEG_RESTART_HEADER_SIZE +
+            JPEG_QT_HEADER_SIZE + JPEG_QT_MAX * JPEG_QT_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (rtp->payload_type == RTP_PAYLOAD_TYPE_JPEG) {
+        return jpeg_packetize(rtp, data, len, rtp_timestamp);
+    }
+
+    return h264_packetize(rtp, data, len, rtp_timestamp);
+}
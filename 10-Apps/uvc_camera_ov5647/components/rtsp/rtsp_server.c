@@ -0,0 +1,501 @@
+/*
+ * RTSP Server Task
+ *
+ * Responsibilities:
+ * - Start the shared Ethernet interface, see app_eth.h
+ * - Serve one RTSP client at a time (OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN)
+ *   on CONFIG_EXAMPLE_RTSP_PORT, RTP is sent over UDP only
+ * - Receive every secondary encoder frame as its sink and send it as RTP
+ *
+ * Frames are packetized in the secondary encode task while it holds the encoder
+ * buffer, each packet is gathered from a small header and a slice of that buffer
+ * with sendmsg(). lwIP copies the datagram into its own pbuf once, the frame is
+ * never copied before. PLAY starts the camera with the default UVC frame when no
+ * USB host streams. RTCP is not sent, clients keep the session alive with
+ * GET_PARAMETER or by reconnecting.
+ *
+ * With CONFIG_EXAMPLE_PTP a DESCRIBE while synchronized names the PTP master
+ * in the SDP (RFC 7273) and the session stamps RTP with the network time, so
+ * clients can line up the streams of several cameras.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "lwip/sockets.h"
+#include "uvc_app_common.h"
+#include "os_interface.h"
+#include "app_eth.h"
+#include "app_ptp.h"
+#include "rtp_packetizer.h"
+
+#define RTSP_TAG                "rtsp"
+#define RTSP_REQUEST_MAX        1024
+#define RTSP_RESPONSE_MAX       1024
+#define RTSP_SDP_MAX            640
+#define RTSP_RTP_PORT           6970        /* RTCP would be the next port, it is not served */
+#define RTSP_SESSION_TIMEOUT_S  60
+#define RTSP_POLL_MS            1000        /* Socket timeout, shutdown is seen within it */
+#define RTSP_SEND_RETRY_MS      2           /* lwIP ran out of pbufs, let the MAC drain */
+
+/* The secondary encoder outputs the other format of the UVC stream */
+#if CONFIG_FORMAT_MJPEG_CAM1
+#define RTSP_PAYLOAD_TYPE       RTP_PAYLOAD_TYPE_H264
+#define RTSP_SDP_MEDIA          "a=rtpmap:96 H264/90000\r\na=fmtp:96 packetization-mode=1\r\n"
+#else
+#define RTSP_PAYLOAD_TYPE       RTP_PAYLOAD_TYPE_JPEG
+#define RTSP_SDP_MEDIA          "a=rtpmap:26 JPEG/90000\r\n"
+#endif
+
+/* Task context */
+typedef struct {
+    bool net_up;
+    int listen_fd;
+    int client_fd;
+    int rtp_fd;
+    struct sockaddr_in rtp_dest;    /* Client RTP port, valid after SETUP */
+    uint16_t client_ports[2];
+    uint32_t session;
+    bool setup;
+    bool playing;                   /* Checked by the sink without the lock first */
+    bool local_session;             /* PLAY started the pipeline without a USB host */
+    bool ptp_clock;                 /* The SDP announced PTP timestamps */
+    SemaphoreHandle_t lock;         /* Serializes the sink with session changes */
+    rtp_packetizer_t rtp;
+
+    uint32_t frames_sent;
+    uint32_t frames_failed;
+
+    char request[RTSP_REQUEST_MAX];
+    size_t request_len;
+} rtsp_task_ctx_t;
+
+static rtsp_task_ctx_t s_rtsp_ctx = {
+    .listen_fd = -1,
+    .client_fd = -1,
+    .rtp_fd = -1,
+};
+
+/* ========== RTP Sink ========== */
+
+static esp_err_t rtsp_rtp_send(const uint8_t *hdr, size_t hdr_len, const uint8_t *payload, size_t payload_len, void *ctx)
+{
+    struct iovec iov[2] = {
+        { .iov_base = (void *)hdr, .iov_len = hdr_len },
+        { .iov_base = (void *)payload, .iov_len = payload_len },
+    };
+    struct msghdr msg = {
+        .msg_name = &s_rtsp_ctx.rtp_dest,
+        .msg_namelen = sizeof(s_rtsp_ctx.rtp_dest),
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+    };
+
+    if (sendmsg(s_rtsp_ctx.rtp_fd, &msg, 0) >= 0) {
+        return ESP_OK;
+    }
+
+    /* A large I-frame can outrun the MAC, give it one chance before dropping the rest of the frame */
+    if (errno == ENOMEM) {
+        vTaskDelay(pdMS_TO_TICKS(RTSP_SEND_RETRY_MS));
+        if (sendmsg(s_rtsp_ctx.rtp_fd, &msg, 0) >= 0) {
+            return ESP_OK;
+        }
+    }
+
+    return ESP_FAIL;
+}
+
+/* Secondary encoder sink, the frame data is only valid until this returns */
+static void rtsp_sink(const frame_buffer_t *frame, void *ctx)
+{
+    int64_t timestamp = frame->timestamp;
+    int64_t network_ns;
+
+    if (!s_rtsp_ctx.playing) {
+        return;
+    }
+
+    /* Synchronization lost meanwhile falls back to the local clock */
+    if (s_rtsp_ctx.ptp_clock && app_ptp_to_network(frame->timestamp, &network_ns) == ESP_OK) {
+        timestamp = network_ns / 1000;
+    }
+
+    xSemaphoreTake(s_rtsp_ctx.lock, portMAX_DELAY);
+    if (s_rtsp_ctx.playing) {
+        if (rtp_packetize_frame(&s_rtsp_ctx.rtp, frame->data, frame->size, timestamp) == ESP_OK) {
+            s_rtsp_ctx.frames_sent++;
+        } else {
+            s_rtsp_ctx.frames_failed++;
+        }
+    }
+    xSemaphoreGive(s_rtsp_ctx.lock);
+}
+
+/* ========== Session ========== */
+
+static void rtsp_session_stop(void)
+{
+    xSemaphoreTake(s_rtsp_ctx.lock, portMAX_DELAY);
+    s_rtsp_ctx.playing = false;
+    s_rtsp_ctx.setup = false;
+    xSemaphoreGive(s_rtsp_ctx.lock);
+
+    if (s_rtsp_ctx.local_session) {
+        uvc_app_stream_stop_local();
+        s_rtsp_ctx.local_session = false;
+    }
+}
+
+/* Value of a request header, NULL if missing, the value ends at the line end */
+static const char *rtsp_header(const char *request, const char *name)
+{
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+
+    while (line && line[2] != '\r') {
+        line += 2;
+        if (!strncasecmp(line, name, name_len) && line[name_len] == ':') {
+            line += name_len + 1;
+            while (*line == ' ') {
+                line++;
+            }
+            return line;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return NULL;
+}
+
+static void rtsp_reply(int cseq, const char *status, const char *headers, const char *body)
+{
+    char response[RTSP_RESPONSE_MAX];
+    int len;
+
+    len = snprintf(response, sizeof(response), "RTSP/1.0 %s\r\nCSeq: %d\r\n%s", status, cseq, headers ? headers : "");
+    if (len < sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len, "Content-Length: %u\r\n\r\n%s",
+                        body ? (unsigned)strlen(body) : 0, body ? body : "");
+    }
+    if (len >= sizeof(response)) {
+        ESP_LOGE(RTSP_TAG, "Response of %d bytes truncated", len);
+        len = sizeof(response) - 1;
+    }
+
+    if (send(s_rtsp_ctx.client_fd, response, len, 0) != len) {
+        ESP_LOGW(RTSP_TAG, "Failed to send response (errno=%d)", errno);
+    }
+}
+
+static void rtsp_describe(int cseq)
+{
+    char sdp[RTSP_SDP_MAX];
+    char headers[160];
+    struct sockaddr_in local;
+    socklen_t addr_len = sizeof(local);
+    char ip[16] = "0.0.0.0";
+    char refclk[96] = "";
+    app_ptp_status_t ptp;
+
+    if (getsockname(s_rtsp_ctx.client_fd, (struct sockaddr *)&local, &addr_len) == 0) {
+        inet_ntoa_r(local.sin_addr, ip, sizeof(ip));
+    }
+
+    /* RTP timestamps are the network time at 90 kHz, without offset */
+    app_ptp_get_status(&ptp);
+    s_rtsp_ctx.ptp_clock = ptp.synchronized;
+    if (ptp.synchronized) {
+        snprintf(refclk, sizeof(refclk),
+                 "a=ts-refclk:ptp=IEEE1588-2008:%02X-%02X-%02X-%02X-%02X-%02X-%02X-%02X:%d\r\n"
+                 "a=mediaclk:direct=0\r\n",
+                 ptp.grandmaster[0], ptp.grandmaster[1], ptp.grandmaster[2], ptp.grandmaster[3],
+                 ptp.grandmaster[4], ptp.grandmaster[5], ptp.grandmaster[6], ptp.grandmaster[7], ptp.domain);
+    }
+
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\n"
+             "o=- %lu 1 IN IP4 %s\r\n"
+             "s=ESP32-P4 camera\r\n"
+             "c=IN IP4 0.0.0.0\r\n"
+             "t=0 0\r\n"
+             "m=video 0 RTP/AVP %d\r\n"
+             RTSP_SDP_MEDIA
+             "%s"
+             "a=control:track0\r\n",
+             esp_random(), ip, RTSP_PAYLOAD_TYPE, refclk);
+    snprintf(headers, sizeof(headers),
+             "Content-Base: rtsp://%s:%d/\r\nContent-Type: application/sdp\r\n", ip, CONFIG_EXAMPLE_RTSP_PORT);
+    rtsp_reply(cseq, "200 OK", headers, sdp);
+}
+
+static void rtsp_setup(int cseq, const char *transport)
+{
+    char headers[192];
+    struct sockaddr_in peer;
+    socklen_t addr_len = sizeof(peer);
+    const char *ports = transport ? strstr(transport, "client_port=") : NULL;
+    unsigned int rtp_port;
+    unsigned int rtcp_port;
+
+    /* Interleaved RTP/AVP/TCP and multicast are not served */
+    if (!ports || strstr(transport, "RTP/AVP/TCP") || strstr(transport, "multicast") ||
+            sscanf(ports, "client_port=%u-%u", &rtp_port, &rtcp_port) != 2 ||
+            !rtp_port || rtp_port > UINT16_MAX || rtcp_port > UINT16_MAX) {
+        rtsp_reply(cseq, "461 Unsupported Transport", NULL, NULL);
+        return;
+    }
+    if (getpeername(s_rtsp_ctx.client_fd, (struct sockaddr *)&peer, &addr_len) != 0) {
+        rtsp_reply(cseq, "500 Internal Server Error", NULL, NULL);
+        return;
+    }
+
+    xSemaphoreTake(s_rtsp_ctx.lock, portMAX_DELAY);
+    s_rtsp_ctx.rtp_dest = peer;
+    s_rtsp_ctx.rtp_dest.sin_port = htons(rtp_port);
+    s_rtsp_ctx.client_ports[0] = rtp_port;
+    s_rtsp_ctx.client_ports[1] = rtcp_port;
+    if (!s_rtsp_ctx.setup) {
+        s_rtsp_ctx.session = esp_random();
+        s_rtsp_ctx.setup = true;
+    }
+    xSemaphoreGive(s_rtsp_ctx.lock);
+
+    snprintf(headers, sizeof(headers),
+             "Transport: RTP/AVP;unicast;client_port=%u-%u;server_port=%d-%d;ssrc=%08lX\r\n"
+             "Session: %08lX;timeout=%d\r\n",
+             rtp_port, rtcp_port, RTSP_RTP_PORT, RTSP_RTP_PORT + 1, s_rtsp_ctx.rtp.ssrc,
+             s_rtsp_ctx.session, RTSP_SESSION_TIMEOUT_S);
+    rtsp_reply(cseq, "200 OK", headers, NULL);
+}
+
+static void rtsp_play(int cseq)
+{
+    char headers[96];
+    esp_err_t ret;
+
+    if (!s_rtsp_ctx.setup) {
+        rtsp_reply(cseq, "455 Method Not Valid in This State", NULL, NULL);
+        return;
+    }
+
+    /* Nothing is started if a USB host already streams, the session then follows the host's frame */
+    if (!s_rtsp_ctx.local_session) {
+        ret = uvc_app_stream_start_local(CONFIG_UVC_CAM1_FRAMESIZE_WIDTH, CONFIG_UVC_CAM1_FRAMESIZE_HEIGT,
+                                         CONFIG_UVC_CAM1_FRAMERATE);
+        if (ret != ESP_OK) {
+            ESP_LOGE(RTSP_TAG, "Failed to start the camera (%s)", esp_err_to_name(ret));
+            rtsp_reply(cseq, "503 Service Unavailable", NULL, NULL);
+            return;
+        }
+        s_rtsp_ctx.local_session = true;
+    }
+
+#if CONFIG_FORMAT_MJPEG_CAM1
+    /* A running secondary encoder is in the middle of its GOP, the client starts at the next frame */
+    APP_LOG_ON_ERROR(uvc_app_h264_request_keyframe(), RTSP_TAG, "Failed to request a key frame");
+#endif
+
+    xSemaphoreTake(s_rtsp_ctx.lock, portMAX_DELAY);
+    s_rtsp_ctx.playing = true;
+    xSemaphoreGive(s_rtsp_ctx.lock);
+
+    snprintf(headers, sizeof(headers), "Session: %08lX\r\nRange: npt=0.000-\r\n", s_rtsp_ctx.session);
+    rtsp_reply(cseq, "200 OK", headers, NULL);
+    ESP_LOGI(RTSP_TAG, "Streaming to " IPSTR ":%u", IP2STR((esp_ip4_addr_t *)&s_rtsp_ctx.rtp_dest.sin_addr),
+             s_rtsp_ctx.client_ports[0]);
+}
+
+static void rtsp_handle_request(const char *request)
+{
+    char method[16];
+    const char *cseq_value = rtsp_header(request, "CSeq");
+    int cseq = cseq_value ? atoi(cseq_value) : 0;
+
+    if (sscanf(request, "%15s", method) != 1) {
+        rtsp_reply(cseq, "400 Bad Request", NULL, NULL);
+        return;
+    }
+    ESP_LOGD(RTSP_TAG, "%s, CSeq %d", method, cseq);
+
+    if (!strcmp(method, "OPTIONS")) {
+        rtsp_reply(cseq, "200 OK", "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+    } else if (!strcmp(method, "DESCRIBE")) {
+        rtsp_describe(cseq);
+    } else if (!strcmp(method, "SETUP")) {
+        rtsp_setup(cseq, rtsp_header(request, "Transport"));
+    } else if (!strcmp(method, "PLAY")) {
+        rtsp_play(cseq);
+    } else if (!strcmp(method, "TEARDOWN")) {
+        rtsp_session_stop();
+        rtsp_reply(cseq, "200 OK", NULL, NULL);
+    } else if (!strcmp(method, "GET_PARAMETER")) {
+        /* Keep-alive */
+        rtsp_reply(cseq, "200 OK", NULL, NULL);
+    } else {
+        rtsp_reply(cseq, "501 Not Implemented", NULL, NULL);
+    }
+}
+
+/* Handle the requests of one client until it disconnects or shutdown is requested */
+static void rtsp_serve_client(void)
+{
+    struct timeval timeout = { .tv_sec = RTSP_POLL_MS / 1000, .tv_usec = (RTSP_POLL_MS % 1000) * 1000 };
+    char *end;
+    int len;
+
+    setsockopt(s_rtsp_ctx.client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    s_rtsp_ctx.request_len = 0;
+
+    while (!(xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN)) {
+        len = recv(s_rtsp_ctx.client_fd, s_rtsp_ctx.request + s_rtsp_ctx.request_len,
+                   sizeof(s_rtsp_ctx.request) - 1 - s_rtsp_ctx.request_len, 0);
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (len <= 0) {
+            break;
+        }
+        s_rtsp_ctx.request_len += len;
+        s_rtsp_ctx.request[s_rtsp_ctx.request_len] = '\0';
+
+        /* Requests carry no body, several may arrive in one read */
+        while ((end = strstr(s_rtsp_ctx.request, "\r\n\r\n")) != NULL) {
+            size_t request_len = end + 4 - s_rtsp_ctx.request;
+
+            end[2] = '\0';
+            rtsp_handle_request(s_rtsp_ctx.request);
+            s_rtsp_ctx.request_len -= request_len;
+            memmove(s_rtsp_ctx.request, s_rtsp_ctx.request + request_len, s_rtsp_ctx.request_len + 1);
+        }
+        if (s_rtsp_ctx.request_len >= sizeof(s_rtsp_ctx.request) - 1) {
+            ESP_LOGW(RTSP_TAG, "Request too long, dropping the client");
+            break;
+        }
+    }
+
+    rtsp_session_stop();
+}
+
+/* ========== Network ========== */
+
+static void rtsp_got_ip_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+
+    ESP_LOGI(RTSP_TAG, "Stream at rtsp://" IPSTR ":%d/", IP2STR(&event->ip_info.ip), CONFIG_EXAMPLE_RTSP_PORT);
+}
+
+static esp_err_t rtsp_open_sockets(void)
+{
+    int reuse = 1;
+    struct timeval timeout = { .tv_sec = RTSP_POLL_MS / 1000, .tv_usec = (RTSP_POLL_MS % 1000) * 1000 };
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    s_rtsp_ctx.listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    APP_RETURN_ON_FALSE(s_rtsp_ctx.listen_fd >= 0, ESP_FAIL, RTSP_TAG, "Failed to create RTSP socket (errno=%d)", errno);
+    setsockopt(s_rtsp_ctx.listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(s_rtsp_ctx.listen_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    addr.sin_port = htons(CONFIG_EXAMPLE_RTSP_PORT);
+    APP_RETURN_ON_FALSE(bind(s_rtsp_ctx.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+                        listen(s_rtsp_ctx.listen_fd, 1) == 0, ESP_FAIL, RTSP_TAG,
+                        "Failed to listen on port %d (errno=%d)", CONFIG_EXAMPLE_RTSP_PORT, errno);
+
+    s_rtsp_ctx.rtp_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    APP_RETURN_ON_FALSE(s_rtsp_ctx.rtp_fd >= 0, ESP_FAIL, RTSP_TAG, "Failed to create RTP socket (errno=%d)", errno);
+    addr.sin_port = htons(RTSP_RTP_PORT);
+    APP_RETURN_ON_FALSE(bind(s_rtsp_ctx.rtp_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0, ESP_FAIL, RTSP_TAG,
+                        "Failed to bind RTP port %d (errno=%d)", RTSP_RTP_PORT, errno);
+
+    return ESP_OK;
+}
+
+/* ========== Init Phase ========== */
+void initRtspTask(void *arg)
+{
+    ESP_LOGI(RTSP_TAG, "Initializing RTSP server task...");
+
+    s_rtsp_ctx.lock = xSemaphoreCreateMutex();
+    assert(s_rtsp_ctx.lock);
+
+    s_rtsp_ctx.rtp.payload_type = RTSP_PAYLOAD_TYPE;
+    s_rtsp_ctx.rtp.sequence = esp_random() & 0xFFFF;
+    s_rtsp_ctx.rtp.ssrc = esp_random();
+    s_rtsp_ctx.rtp.mtu = CONFIG_EXAMPLE_RTSP_MTU;
+    s_rtsp_ctx.rtp.send = rtsp_rtp_send;
+    s_rtsp_ctx.rtp.send_ctx = NULL;
+
+    if (app_eth_start() != ESP_OK) {
+        ESP_LOGE(RTSP_TAG, "Ethernet not available, RTSP server disabled");
+        return;
+    }
+    APP_LOG_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, rtsp_got_ip_handler, NULL),
+                     RTSP_TAG, "Failed to register IP event handler");
+    s_rtsp_ctx.net_up = true;
+
+    APP_LOG_ON_ERROR(uvc_secondary_set_sink(rtsp_sink, NULL), RTSP_TAG, "Failed to set the secondary sink");
+
+    ESP_LOGI(RTSP_TAG, "RTSP server task initialized");
+}
+
+/* ========== Main Loop ========== */
+void mainRtspTask(void *arg)
+{
+    ESP_LOGI(RTSP_TAG, "RTSP server task started on core %d", xPortGetCoreID());
+
+    if (!s_rtsp_ctx.net_up || rtsp_open_sockets() != ESP_OK) {
+        goto exit;
+    }
+
+    while (!(xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN)) {
+        int fd = accept(s_rtsp_ctx.listen_fd, NULL, NULL);
+
+        if (fd < 0) {
+            continue;
+        }
+        ESP_LOGI(RTSP_TAG, "Client connected");
+        s_rtsp_ctx.client_fd = fd;
+        rtsp_serve_client();
+        s_rtsp_ctx.client_fd = -1;
+        close(fd);
+        ESP_LOGI(RTSP_TAG, "Client disconnected, %lu frames sent, %lu failed",
+                 s_rtsp_ctx.frames_sent, s_rtsp_ctx.frames_failed);
+    }
+    ESP_LOGI(RTSP_TAG, "Shutdown requested");
+
+exit:
+    ESP_LOGI(RTSP_TAG, "RTSP server task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terRtspTask(void *arg)
+{
+    ESP_LOGI(RTSP_TAG, "Terminating RTSP server task...");
+
+    if (s_rtsp_ctx.lock) {
+        rtsp_session_stop();
+    }
+    if (s_rtsp_ctx.listen_fd >= 0) {
+        close(s_rtsp_ctx.listen_fd);
+        s_rtsp_ctx.listen_fd = -1;
+    }
+    if (s_rtsp_ctx.rtp_fd >= 0) {
+        close(s_rtsp_ctx.rtp_fd);
+        s_rtsp_ctx.rtp_fd = -1;
+    }
+
+    ESP_LOGI(RTSP_TAG, "RTSP server task terminated, sent %lu frames", s_rtsp_ctx.frames_sent);
+}
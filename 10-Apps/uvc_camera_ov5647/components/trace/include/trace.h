@@ -0,0 +1,75 @@
+/*
+ * Trace - Timeline of the camera pipeline in a PSRAM ring
+ *
+ * With CONFIG_TRACE_ENABLE the pipeline records spans and instants of its
+ * stages, each with the core, the task (none in an ISR), an esp_timer
+ * timestamp and one argument, e.g. the frame sequence. The ring keeps the last
+ * CONFIG_TRACE_RING_EVENTS events, recording takes no lock and may be called
+ * from an ISR. A dump writes them as Chrome trace JSON, which Perfetto and
+ * chrome://tracing open, with one process per core and one thread per task.
+ * Without CONFIG_TRACE_ENABLE the macros compile to nothing.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TRACE_CSI_EOF = 0,                  // Instant, MIPI-CSI frame done ISR, arg is the frame size
+    TRACE_ISP_STATS,                    // Instant, ISP statistics of a frame done, arg is the frame sequence
+    TRACE_IPA,                          // Span, isp_task() running the IPA algorithms, arg is the stats index
+    TRACE_CAP_DQBUF,                    // Span, capture task DQBUF, arg is the V4L2 sequence
+    TRACE_ENC,                          // Span, encoder QBUF/DQBUF batch of a frame, arg is the encoded size
+    TRACE_UVC_FB_GET,                   // Span, UVC fb_get callback, arg is the frame size handed out
+    TRACE_UVC_FB_RETURN,                // Instant, UVC fb_return callback, arg is the frame size
+    TRACE_EVENT_MAX,
+} trace_event_t;
+
+#if CONFIG_TRACE_ENABLE
+
+/* Allocate the ring on the first call and record, events of an earlier run are dropped */
+esp_err_t trace_start(void);
+
+/* Stop recording, the ring keeps its events for a dump */
+void trace_stop(void);
+
+void trace_instant(trace_event_t event, uint32_t arg);
+
+/* Span from start, an esp_timer time, until now */
+void trace_span(trace_event_t event, int64_t start, uint32_t arg);
+
+int64_t trace_now(void);
+
+/*
+ * Write the ring to the console, one "TRACE {event}" line per event and a
+ * closing "TRACE_DONE", for tools/trace_extract.py. Recording is stopped for
+ * the dump and resumed after it.
+ */
+esp_err_t trace_dump_console(void);
+
+/* Write the ring as a Chrome trace JSON file, e.g. on the SD card */
+esp_err_t trace_dump_file(const char *path);
+
+#define TRACE_BEGIN(var)                int64_t var = trace_now()
+#define TRACE_END(event, var, arg)      trace_span((event), (var), (arg))
+#define TRACE_INSTANT(event, arg)       trace_instant((event), (arg))
+
+#else
+
+#define TRACE_BEGIN(var)
+#define TRACE_END(event, var, arg)      do {} while (0)
+#define TRACE_INSTANT(event, arg)       do {} while (0)
+
+#endif /* CONFIG_TRACE_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
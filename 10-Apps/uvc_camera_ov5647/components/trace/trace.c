@@ -0,0 +1,275 @@
+/*
+ * Trace - Event ring and the Chrome trace writer
+ *
+ * Producers claim a slot with an atomic increment of the head and fill it, so
+ * tasks and ISRs of both cores record without a lock. The ring overwrites its
+ * oldest events. A dump stops the producers first and waits a tick for the
+ * ones already filling a slot.
+ *
+ * Tasks are named at dump time from the task list. A task which was deleted
+ * since it recorded keeps its handle as name.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "memstat.h"
+#include "trace.h"
+
+#define TRACE_RING_EVENTS       CONFIG_TRACE_RING_EVENTS
+#define TRACE_TASK_MAX          32      /* Tasks beyond this share one unnamed thread */
+#define TRACE_FLAG_INSTANT      0x01
+
+_Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "Ring size must be a power of 2");
+
+typedef struct {
+    int64_t time;                       // esp_timer time, the start of a span
+    void *task;                         // NULL in an ISR
+    uint32_t dur;                       // us, 0 for instants
+    uint32_t arg;
+    uint8_t event;
+    uint8_t core;
+    uint8_t flags;
+} trace_record_st;
+
+/* Dump context, static to keep the event handler stack small */
+typedef struct {
+    TaskStatus_t status[TRACE_TASK_MAX];
+    UBaseType_t status_count;
+    void *tasks[TRACE_TASK_MAX];        // Thread ids are the index + 1, 0 is the ISRs
+    uint32_t task_count;
+} trace_dump_ctx_t;
+
+static const char *TAG = "trace";
+
+static const char *s_trace_names[TRACE_EVENT_MAX] = {
+    [TRACE_CSI_EOF]       = "csi_eof",
+    [TRACE_ISP_STATS]     = "isp_stats",
+    [TRACE_IPA]           = "ipa",
+    [TRACE_CAP_DQBUF]     = "cap_dqbuf",
+    [TRACE_ENC]           = "encode",
+    [TRACE_UVC_FB_GET]    = "uvc_fb_get",
+    [TRACE_UVC_FB_RETURN] = "uvc_fb_return",
+};
+
+static trace_record_st *s_trace_ring;
+static uint32_t s_trace_head;
+static volatile bool s_trace_on;
+static trace_dump_ctx_t s_trace_dump;
+
+esp_err_t trace_start(void)
+{
+    if (!s_trace_ring) {
+        s_trace_ring = memstat_calloc(MEMSTAT_DEBUG, TRACE_RING_EVENTS, sizeof(trace_record_st), MALLOC_CAP_SPIRAM);
+        if (!s_trace_ring) {
+            ESP_LOGE(TAG, "Failed to allocate %d trace events", TRACE_RING_EVENTS);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_trace_head = 0;
+    s_trace_on = true;
+
+    return ESP_OK;
+}
+
+void trace_stop(void)
+{
+    s_trace_on = false;
+}
+
+int64_t trace_now(void)
+{
+    return esp_timer_get_time();
+}
+
+static void trace_record(trace_event_t event, int64_t time, uint32_t dur, uint32_t arg, uint8_t flags)
+{
+    trace_record_st *rec;
+
+    if (!s_trace_on) {
+        return;
+    }
+
+    rec = &s_trace_ring[__atomic_fetch_add(&s_trace_head, 1, __ATOMIC_RELAXED) % TRACE_RING_EVENTS];
+    rec->time = time;
+    rec->task = xPortInIsrContext() ? NULL : xTaskGetCurrentTaskHandle();
+    rec->dur = dur;
+    rec->arg = arg;
+    rec->event = event;
+    rec->core = esp_cpu_get_core_id();
+    rec->flags = flags;
+}
+
+void trace_instant(trace_event_t event, uint32_t arg)
+{
+    trace_record(event, esp_timer_get_time(), 0, arg, TRACE_FLAG_INSTANT);
+}
+
+void trace_span(trace_event_t event, int64_t start, uint32_t arg)
+{
+    trace_record(event, start, esp_timer_get_time() - start, arg, 0);
+}
+
+/* Thread id of a recorded task, registered on first sight */
+static uint32_t trace_tid(void *task)
+{
+    if (!task) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < s_trace_dump.task_count; i++) {
+        if (s_trace_dump.tasks[i] == task) {
+            return i + 1;
+        }
+    }
+    if (s_trace_dump.task_count == TRACE_TASK_MAX) {
+        return TRACE_TASK_MAX + 1;
+    }
+    s_trace_dump.tasks[s_trace_dump.task_count++] = task;
+
+    return s_trace_dump.task_count;
+}
+
+static const char *trace_task_name(void *task)
+{
+    for (UBaseType_t i = 0; i < s_trace_dump.status_count; i++) {
+        if (s_trace_dump.status[i].xHandle == task) {
+            return s_trace_dump.status[i].pcTaskName;
+        }
+    }
+
+    return NULL;
+}
+
+/* One JSON event per call, prefix and separator make the console lines or the file array */
+static void trace_write(FILE *out, const char *prefix, const char *sep, uint32_t *count, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+
+static void trace_write(FILE *out, const char *prefix, const char *sep, uint32_t *count, const char *fmt, ...)
+{
+    va_list args;
+
+    fprintf(out, "%s%s", *count ? sep : "", prefix);
+    va_start(args, fmt);
+    vfprintf(out, fmt, args);
+    va_end(args);
+    (*count)++;
+}
+
+static uint32_t trace_write_all(FILE *out, const char *prefix, const char *sep)
+{
+    uint32_t head = s_trace_head;
+    uint32_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    uint32_t count = 0;
+    char name[24];
+
+    s_trace_dump.task_count = 0;
+    s_trace_dump.status_count = uxTaskGetSystemState(s_trace_dump.status, TRACE_TASK_MAX, NULL);
+
+    for (uint32_t i = first; i < head; i++) {
+        const trace_record_st *rec = &s_trace_ring[i % TRACE_RING_EVENTS];
+
+        if (rec->flags & TRACE_FLAG_INSTANT) {
+            trace_write(out, prefix, sep, &count,
+                        "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%u,\"tid\":%lu,"
+                        "\"args\":{\"arg\":%lu}}", s_trace_names[rec->event], rec->time, rec->core,
+                        trace_tid(rec->task), rec->arg);
+        } else {
+            trace_write(out, prefix, sep, &count,
+                        "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lu,\"pid\":%u,\"tid\":%lu,"
+                        "\"args\":{\"arg\":%lu}}", s_trace_names[rec->event], rec->time, rec->dur, rec->core,
+                        trace_tid(rec->task), rec->arg);
+        }
+    }
+
+    /* Names of the tracks, every task on every core as it may have migrated */
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_write(out, prefix, sep, &count,
+                    "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"core %d\"}}",
+                    core, core);
+        trace_write(out, prefix, sep, &count,
+                    "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"ISR\"}}",
+                    core);
+        for (uint32_t i = 0; i < s_trace_dump.task_count; i++) {
+            const char *task_name = trace_task_name(s_trace_dump.tasks[i]);
+
+            if (!task_name) {
+                snprintf(name, sizeof(name), "task %p", s_trace_dump.tasks[i]);
+                task_name = name;
+            }
+            trace_write(out, prefix, sep, &count,
+                        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                        core, i + 1, task_name);
+        }
+    }
+
+    return head - first;
+}
+
+/* Stop the producers for a dump, returns whether recording was on */
+static bool trace_pause(void)
+{
+    bool on = s_trace_on;
+
+    s_trace_on = false;
+    /* Producers which passed the check before are done after a tick */
+    vTaskDelay(1);
+
+    return on;
+}
+
+esp_err_t trace_dump_console(void)
+{
+    bool on;
+    uint32_t events;
+
+    if (!s_trace_ring) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    on = trace_pause();
+    events = trace_write_all(stdout, "TRACE ", "\n");
+    printf("\nTRACE_DONE\n");
+    fflush(stdout);
+    s_trace_on = on;
+    ESP_LOGI(TAG, "Dumped %lu trace events to the console", events);
+
+    return ESP_OK;
+}
+
+esp_err_t trace_dump_file(const char *path)
+{
+    bool on;
+    uint32_t events;
+    FILE *out;
+
+    if (!s_trace_ring) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    out = fopen(path, "w");
+    if (!out) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+
+    on = trace_pause();
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    events = trace_write_all(out, "", ",\n");
+    fprintf(out, "\n]}\n");
+    s_trace_on = on;
+
+    if (fclose(out) != 0) {
+        ESP_LOGE(TAG, "Failed to write %s", path);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Dumped %lu trace events to %s", events, path);
+
+    return ESP_OK;
+}
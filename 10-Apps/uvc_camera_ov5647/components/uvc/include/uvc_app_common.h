@@ -15,6 +15,8 @@
 #include "freertos/event_groups.h"
 #include "freertos/semphr.h"
 #include "usb_device_uvc.h"
+#include "esp_video_ioctl.h"
+#include "esp_video_direct.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,20 +35,36 @@ extern "C" {
 #define EVENT_ENCODER_READY     BIT1
 #define EVENT_UVC_READY         BIT2
 #define EVENT_STREAMING_ACTIVE  BIT3
+#define EVENT_PIPELINE_RUN      BIT4    /* Capture/encode stages may process frames */
+#define EVENT_CAPTURE_IDLE      BIT5    /* Capture stage has no camera buffer in flight */
+#define EVENT_ENCODE_IDLE       BIT6    /* Encode stage has no encoder buffer in flight */
 #define EVENT_SHUTDOWN          BIT7
+#define EVENT_SECONDARY_IDLE    BIT8    /* Secondary encode stage has no camera buffer in flight */
+#define EVENT_POWER_DOWN        BIT9    /* No session for CONFIG_EXAMPLE_IDLE_POWER_DOWN_MS, housekeeping paused */
+#define EVENT_MOTION_IDLE       BIT10   /* Motion stage has no camera buffer in flight */
+#define EVENT_INFER_IDLE        BIT11   /* Inference stage has no camera buffer in flight, the model may still run */
+#define EVENT_SCAN_RUN          BIT12   /* Scan mode owns the camera, the scan task may dequeue frames */
+#define EVENT_SCAN_IDLE         BIT13   /* Scan task has no camera buffer in flight */
+#define EVENT_AUX_CAPTURE_IDLE  BIT14   /* Aux capture stage has no aux camera buffer in flight */
 
 /* ========= FRAME BUFFER STRUCTURE ========= */
 typedef struct {
     uint8_t *data;
     size_t size;
     size_t capacity;
-    int64_t timestamp;
+    int64_t timestamp;     // Camera frame end time in us (esp_timer), kept through encoding
+    int64_t dequeue_time;  // Time the producing stage dequeued this frame, for latency stats
     uint32_t frame_number;
     uint32_t format;  // V4L2_PIX_FMT_*
+    uint32_t flags;   // V4L2_BUF_FLAG_KEYFRAME/PFRAME of encoded frames, 0 if unknown
 
     /* For zero-copy: reference to camera buffer instead of PSRAM copy */
     int camera_buf_index;  // -1 if using PSRAM, >=0 if using camera mmap buffer
     bool is_camera_buffer; // true if data points to camera mmap buffer
+    int enc_buf_index;     // -1 if using PSRAM, >=0 if using encoder capture mmap buffer
+    uint32_t refcount;     // Holders of a camera buffer, it is re-queued to the camera at 0
+    esp_video_direct_t *camera_dev; // Camera the buffer is re-queued to, NULL for the main camera
+    QueueHandle_t pool;    // Free queue the descriptor goes back to at refcount 0, NULL if none
 } frame_buffer_t;
 
 /* ========= SYSTEM EVENT TYPES ========= */
@@ -56,27 +74,74 @@ typedef enum {
     SYS_EVENT_RESET_STATS,
     SYS_EVENT_CHANGE_FORMAT,
     SYS_EVENT_CHANGE_RESOLUTION,
+    SYS_EVENT_DUMP_LATENCY,
+    SYS_EVENT_DUMP_TRACE,
+    SYS_EVENT_DUMP_PROFILE,
+    SYS_EVENT_POWER_DOWN,
+    SYS_EVENT_SHUTDOWN,
+    SYS_EVENT_MOTION,
+    SYS_EVENT_BOOT_DONE,
+    SYS_EVENT_STALL,
     SYS_EVENT_ERROR
 } system_event_type_t;
 
+#define SYS_EVENT_DATA_MAX  32  /* Inline payload, events are copied into the queue by value */
+
 typedef struct {
     system_event_type_t type;
-    void *data;
-    size_t data_len;
+    uint32_t data_len;
+    uint8_t data[SYS_EVENT_DATA_MAX];
 } system_event_t;
 
+/* ========= CAPTURE CAPABILITY SNAPSHOT ========= */
+#define CAP_FORMAT_MAX  10
+#define CAP_CTRL_MAX    8
+
+typedef struct {
+    uint32_t id;            // V4L2_CID_*
+    int64_t minimum;
+    int64_t maximum;
+    int64_t default_value;
+} uvc_ctrl_info_t;
+
+/* Probed once at init, stream start reuses it instead of enumerating the driver */
+typedef struct {
+    uint32_t formats[CAP_FORMAT_MAX];   // V4L2_PIX_FMT_* the camera can output
+    uint8_t format_count;
+    uint32_t native_width;              // Sensor format after init
+    uint32_t native_height;
+    uint32_t capture_fmt;               // Camera format fed to the encoder, 0 if none fits
+    uvc_ctrl_info_t ctrls[CAP_CTRL_MAX];
+    uint8_t ctrl_count;
+} uvc_capture_caps_t;
+
 /* ========= UVC CONTEXT STRUCTURE ========= */
-#define BUFFER_COUNT 2
+#define BUFFER_COUNT CONFIG_EXAMPLE_CAPTURE_BUFFER_COUNT             /* Default camera buffer depth */
+#define BUFFER_COUNT_MAX 8                                          /* Upper bound of runtime camera buffer depth */
+#define ENCODED_FRAME_COUNT CONFIG_EXAMPLE_ENCODER_BUFFER_COUNT   /* Encoder capture buffer ring depth */
 
 typedef struct uvc {
     int cap_fd;
+    esp_video_direct_t *cap_dev;    /* Camera handle for the per-frame buffer calls, which skip VFS */
     uint32_t format;
-    uint8_t *cap_buffer[BUFFER_COUNT];
+    uint8_t *cap_buffer[BUFFER_COUNT_MAX];
+    int cap_dmabuf[BUFFER_COUNT_MAX];   /* Camera buffers exported to the encoder, VIDIOC_EXPBUF handles */
+    uint32_t cap_buffer_count;      /* Camera buffers requested at the next stream start */
+    uint32_t cap_hot_count;         /* Camera buffers placed in internal RAM, the others stay in PSRAM */
+    uvc_capture_caps_t cap_caps;    /* Camera capability snapshot */
 
     int m2m_fd;
-    uint8_t *m2m_cap_buffer;
-    uint8_t *m2m_out_buffer;        /* DMA-capable buffer for encoder input */
-    size_t m2m_out_buffer_size;
+    esp_video_direct_t *m2m_dev;    /* Encoder handle for the per-frame buffer calls, which skip VFS */
+    uint8_t *m2m_cap_buffer[ENCODED_FRAME_COUNT];   /* Encoder capture buffer ring, indexed by V4L2 index */
+    uint32_t m2m_cap_buffer_len;                    /* Length of each encoder capture buffer */
+
+    int sec_fd;                     /* Secondary encoder, -1 if dual encoding is off */
+    uint32_t sec_format;            /* V4L2_PIX_FMT_* of the secondary encoder */
+    uint8_t *sec_cap_buffer;        /* Secondary encoder capture buffer */
+    uint32_t sec_cap_buffer_len;
+
+    uint32_t uvc_buffer_size;       /* UVC transfer buffer, encoded frames larger than this are dropped */
+    uint32_t enc_peak_size;         /* Largest encoded frame of the last size window */
 
     uvc_fb_t fb;
 } uvc_t;
@@ -91,12 +156,22 @@ typedef struct {
     /* Shared resources */
     uvc_t *uvc;
 
+    /* Frame selected by the host for the current session */
+    int stream_width;
+    int stream_height;
+    int stream_fps;
+
     /* Statistics */
     bool is_streaming;
     uint32_t total_frames_captured;
     uint32_t total_frames_encoded;
     uint32_t total_frames_streamed;
+    uint32_t total_frames_secondary;    /* Frames encoded by the secondary encoder */
     uint32_t frames_dropped;
+    uint32_t frames_oversize;       /* Encoded frames dropped for not fitting the UVC transfer buffer */
+    uint32_t frames_static;         /* Camera frames not encoded because the scene didn't change */
+    uint32_t frames_paced;          /* Camera frames dropped to pace a faster sensor to the session rate */
+    uint32_t frames_sink_dropped;   /* Encoded frames a sink missed because its queue was full */
 
 } app_context_t;
 
@@ -106,15 +181,109 @@ extern app_context_t g_app_ctx;
 /* ========= FRAME BUFFER MANAGEMENT ========= */
 frame_buffer_t *frame_buffer_alloc(size_t capacity);
 void frame_buffer_free(frame_buffer_t *frame);
-esp_err_t frame_buffer_resize(frame_buffer_t *frame, size_t new_capacity);
+frame_buffer_t *frame_buffer_ref(frame_buffer_t *frame);
+void frame_buffer_release(frame_buffer_t *frame);
+uint32_t frame_buffer_camera_held(void);
+uint32_t frame_buffer_pooled_held(void);
+
+/* ========= CAPTURE FAN-OUT ========= */
+#define CAPTURE_CONSUMER_MAX    3   /* Extra raw frame consumers besides the encoder, e.g. secondary, motion, inference */
+
+/* Consumers receive frame_buffer_t * and must call frame_buffer_release() when done */
+esp_err_t uvc_capture_add_consumer(QueueHandle_t queue);
+
+/* ========= ENCODED FAN-OUT ========= */
+#define ENCODED_SINK_MAX    2   /* Encoded frame consumers besides UVC */
+
+/* What the encoder does with a new frame when a sink's queue is full */
+typedef enum {
+    SINK_POLICY_DROP_OLDEST,    /* Live sinks, the oldest queued frame makes room */
+    SINK_POLICY_BLOCK,          /* Recorders, the encoder waits up to the sink timeout for room */
+} sink_policy_t;
+
+/* Consumers receive frame_buffer_t * and must call frame_buffer_release() when done.
+ * Queued frames hold encoder buffers, which are shared with UVC and the other sinks. */
+esp_err_t uvc_encode_add_sink(QueueHandle_t queue, sink_policy_t policy, uint32_t timeout_ms);
+void uvc_encode_drain_sinks(void);
+
+/* ========= SECONDARY ENCODER ========= */
+/* Called in the secondary encode task for every frame, data is only valid until it returns */
+typedef void (*uvc_secondary_sink_t)(const frame_buffer_t *frame, void *ctx);
+
+esp_err_t uvc_secondary_set_sink(uvc_secondary_sink_t sink, void *ctx);
+esp_err_t uvc_secondary_start(int width, int height, uint32_t capture_fmt, bool reformat);
+void uvc_secondary_stop(void);
+void uvc_secondary_get_frame(int *width, int *height);
+
+/* Whether an encoder reads the format on its INPUT queue */
+bool uvc_app_codec_accepts_input(int fd, uint32_t pixelformat);
 
 /* ========= EVENT POSTING ========= */
-esp_err_t app_post_event(system_event_type_t type, void *data, size_t data_len);
+/* data is copied into the event, so it may live on the caller's stack */
+esp_err_t app_post_event(system_event_type_t type, const void *data, size_t data_len);
+
+/* Set EVENT_SHUTDOWN and wake the tasks blocked on it or on the event queue */
+void app_request_shutdown(void);
+
+/* ========= PIPELINE CONTROL ========= */
+void uvc_pipeline_run(void);
+esp_err_t uvc_pipeline_halt(void);
+
+/* Run the pipeline without a USB host, e.g. for a network sink. A host session takes
+ * over with its own frame and the local one is resumed when the host stops. Every
+ * successful start must be paired with a stop, the session runs while any user is
+ * left, at the frame of the first one. */
+esp_err_t uvc_app_stream_start_local(int width, int height, int rate);
+void uvc_app_stream_stop_local(void);
+
+/* Enter power-down unless a session started meanwhile, posted by the idle timer as SYS_EVENT_POWER_DOWN */
+void uvc_app_power_down(void);
+
+/* ========= STILL CAPTURE ========= */
+/* Called once with the JPEG still, data is only valid until it returns */
+typedef void (*uvc_still_cb_t)(const frame_buffer_t *frame, void *ctx);
+
+/* Capture one CONFIG_EXAMPLE_STILL_WIDTH x CONFIG_EXAMPLE_STILL_HEIGHT JPEG, a running
+ * session is paused for it and resumed at its own frame. ESP_ERR_NOT_SUPPORTED without
+ * CONFIG_EXAMPLE_STILL_CAPTURE. */
+esp_err_t uvc_app_capture_still(uvc_still_cb_t cb, void *ctx);
+
+/* ========= SCAN MODE ========= */
+/* Run the camera at CONFIG_EXAMPLE_SCAN_WIDTH x CONFIG_EXAMPLE_SCAN_HEIGHT for code scanning,
+ * see uvc_scan.h. A local session is paused meanwhile, a host session takes the camera over
+ * and scanning resumes when it stops. ESP_ERR_NOT_SUPPORTED without CONFIG_EXAMPLE_SCAN. */
+esp_err_t uvc_app_scan_start(void);
+void uvc_app_scan_stop(void);
+
+/* ========= BUFFER CONFIGURATION ========= */
+esp_err_t uvc_app_set_capture_buffers(uint32_t count, uint32_t hot_count);
+
+/* Replace the negotiated encoder input format, takes effect at the next stream start.
+ * ESP_ERR_NOT_SUPPORTED if the camera or the encoder doesn't take it, e.g. RAW Bayer. */
+esp_err_t uvc_app_set_capture_format(uint32_t pixelformat);
+
+/* ========= H.264 RUNTIME CONTROL ========= */
+esp_err_t uvc_app_h264_set_bitrate(uint32_t bitrate);
+esp_err_t uvc_app_h264_set_qp(uint32_t min_qp, uint32_t max_qp);
+esp_err_t uvc_app_h264_request_keyframe(void);
+esp_err_t uvc_app_h264_set_frame_rate(uint32_t rate);
+esp_err_t uvc_app_h264_set_roi(const struct esp_video_enc_roi *roi);
+
+/* ========= JPEG RUNTIME CONTROL ========= */
+esp_err_t uvc_app_jpeg_set_quality(uint32_t quality);
+esp_err_t uvc_app_jpeg_set_target_size(uint32_t target_size, uint32_t min_quality, uint32_t max_quality);
+
+/* ========= CAPABILITY LOOKUP ========= */
+const uvc_ctrl_info_t *uvc_app_find_ctrl(uint32_t id);
 
 /* ========= INITIALIZATION FUNCTIONS ========= */
 void uvc_app_hw_init(void);
 void uvc_app_debug_init(void);
 
+/* Devices come up in the background with CONFIG_EXAMPLE_PARALLEL_BOOT, wait for EVENT_CAMERA_READY / EVENT_ENCODER_READY */
+#define HW_READY_ALL    (EVENT_CAMERA_READY | EVENT_ENCODER_READY)
+esp_err_t uvc_app_wait_hw_ready(EventBits_t bits, TickType_t timeout);
+
 /* ========= ERROR CHECKING MACROS ========= */
 #define APP_RETURN_ON_ERROR(x, tag, format, ...) do {                         \
         esp_err_t err_rc_ = (x);                                               \
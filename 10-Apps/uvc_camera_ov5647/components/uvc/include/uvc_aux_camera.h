@@ -0,0 +1,78 @@
+/*
+ * UVC Aux Camera - Second capture pipeline on the DVP camera
+ *
+ * With CONFIG_EXAMPLE_AUX_CAMERA the MIPI-CSI camera feeds the UVC stream as
+ * usual, and a DVP camera runs alongside it with its own device, its own
+ * camera buffers and its own capture task. Its frames go to the secondary
+ * encoder (QUEUE_SECONDARY_RAW) instead of the main camera frames, so each
+ * camera owns one hardware encoder and neither pipeline waits for the other.
+ *
+ * The aux pipeline runs while the main one does, it is started and stopped
+ * with the session. A failing aux camera is logged and the UVC stream keeps
+ * running.
+ *
+ * Without CONFIG_EXAMPLE_AUX_CAMERA the calls do nothing.
+ */
+
+#ifndef UVC_AUX_CAMERA_H
+#define UVC_AUX_CAMERA_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters of the aux pipeline, the main pipeline keeps its own in g_app_ctx */
+typedef struct {
+    uint32_t captured;      /* Frames dequeued from the aux camera */
+    uint32_t dropped;       /* Frames the secondary encoder was too busy for */
+    uint32_t lost;          /* Frames the driver dropped, from sequence gaps */
+    uint32_t errors;        /* Failed dequeues */
+} uvc_aux_camera_stats_t;
+
+#if CONFIG_EXAMPLE_AUX_CAMERA
+
+/* Open the aux camera and pick the format the secondary encoder reads, at hardware init */
+esp_err_t uvc_aux_camera_init(void);
+
+/* Stream the aux camera and the secondary encoder, called from video_start_cb() */
+esp_err_t uvc_aux_camera_start(void);
+
+/* Stop both once the pipeline is halted, called from video_stop_cb() */
+void uvc_aux_camera_stop(void);
+
+/* VIDIOC_EXPBUF handle of an aux camera buffer for the secondary encoder INPUT */
+int uvc_aux_camera_dmabuf(int index);
+
+void uvc_aux_camera_get_stats(uvc_aux_camera_stats_t *ret_stats);
+void uvc_aux_camera_reset_stats(void);
+
+#else
+
+static inline esp_err_t uvc_aux_camera_init(void)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t uvc_aux_camera_start(void)
+{
+    return ESP_OK;
+}
+
+static inline void uvc_aux_camera_stop(void)
+{
+}
+
+static inline void uvc_aux_camera_reset_stats(void)
+{
+}
+
+#endif /* CONFIG_EXAMPLE_AUX_CAMERA */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_AUX_CAMERA_H */
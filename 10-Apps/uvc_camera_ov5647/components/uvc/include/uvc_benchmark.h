@@ -0,0 +1,29 @@
+/*
+ * UVC Benchmark - Drive the pipeline without a USB host
+ *
+ * Every run starts the stream through the UVC callbacks, fetches and returns
+ * frames as fast as the pipeline delivers them, and prints one line:
+ *
+ *     BENCH {"format":"mjpeg","width":1280,...}
+ *
+ * A line "BENCH_DONE" follows the last run. tools/benchmark_compare.py
+ * collects the lines and compares them against a baseline.
+ */
+
+#ifndef UVC_BENCHMARK_H
+#define UVC_BENCHMARK_H
+
+#include "usb_device_uvc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Runs every configuration of CONFIG_EXAMPLE_BENCHMARK_*, the callbacks are those handed to uvc_device_config() */
+void uvc_benchmark_run(const uvc_device_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_BENCHMARK_H */
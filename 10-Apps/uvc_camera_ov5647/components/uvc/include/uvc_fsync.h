@@ -0,0 +1,80 @@
+/*
+ * UVC Frame Sync - Sensor exposures aligned across boards by a trigger line
+ *
+ * The board built with CONFIG_EXAMPLE_FSYNC_MASTER drives
+ * CONFIG_EXAMPLE_FSYNC_GPIO with a pulse train at CONFIG_EXAMPLE_FSYNC_RATE
+ * from an MCPWM timer. The line is wired to the FSIN pin of the OV5647 of
+ * every board, the master's own included. uvc_fsync_arm() puts the sensor in
+ * frame sync slave mode before each stream start, the trigger edge then
+ * restarts its frame timing, so all sensors of the array expose together.
+ *
+ * Every board timestamps the trigger edges with a GPIO interrupt, and the
+ * capture task hands it each frame timestamp. A sensor following the trigger
+ * ends its frames at a constant phase after the edge. Frames off that phase
+ * by more than CONFIG_EXAMPLE_FSYNC_TOLERANCE_US are counted as slipped and
+ * logged, the phase is then taken again from the frame.
+ *
+ * Without CONFIG_EXAMPLE_FSYNC the calls do nothing.
+ */
+
+#ifndef UVC_FSYNC_H
+#define UVC_FSYNC_H
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters since boot, the jitter since the last uvc_fsync_get_stats() */
+typedef struct {
+    uint32_t pulses;        /* Trigger edges seen */
+    uint32_t frames;        /* Frames measured against the trigger */
+    uint32_t slipped;       /* Frames off the trigger phase by more than the tolerance */
+    int32_t phase_us;       /* Frame end after the trigger edge */
+    int32_t jitter_us;      /* Largest deviation from that phase */
+} uvc_fsync_stats_t;
+
+#if CONFIG_EXAMPLE_FSYNC
+
+/* Trigger interrupt, and the pulse train on the master, once at init */
+esp_err_t uvc_fsync_init(void);
+
+/* Put the sensor in frame sync slave mode, after its format is set and before STREAMON */
+esp_err_t uvc_fsync_arm(int rate);
+
+/* Capture task, for every dequeued frame */
+void uvc_fsync_frame(int64_t timestamp_us);
+
+void uvc_fsync_get_stats(uvc_fsync_stats_t *ret_stats);
+
+#else
+
+static inline esp_err_t uvc_fsync_init(void)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t uvc_fsync_arm(int rate)
+{
+    return ESP_OK;
+}
+
+static inline void uvc_fsync_frame(int64_t timestamp_us)
+{
+}
+
+static inline void uvc_fsync_get_stats(uvc_fsync_stats_t *ret_stats)
+{
+    memset(ret_stats, 0, sizeof(*ret_stats));
+}
+
+#endif /* CONFIG_EXAMPLE_FSYNC */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_FSYNC_H */
@@ -0,0 +1,71 @@
+/*
+ * UVC Infer - Model input tensors prepared from the captured frames
+ *
+ * The inference task is a capture consumer. The PPA crops, scales and color
+ * converts the camera buffer into a letterboxed RGB888 tensor in internal RAM,
+ * then a word-wide lookup pass quantizes it to int8 in place. The callback set
+ * with uvc_infer_set_callback() runs the model on every tensor, frames captured
+ * in the meantime are dropped.
+ */
+
+#ifndef UVC_INFER_H
+#define UVC_INFER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Input tensor, HWC with 3 channels, RGB or with CONFIG_EXAMPLE_INFER_BGR BGR.
+ *
+ * The frame area crop_x, crop_y, crop_width x crop_height is scaled by
+ * scale_16 / 16 to the tensor position pad_x, pad_y, the rest of the tensor is
+ * padding. A tensor point (tx, ty) is frame point
+ * ((tx - pad_x) * 16 / scale_16 + crop_x, (ty - pad_y) * 16 / scale_16 + crop_y).
+ */
+typedef struct {
+    const int8_t *data;
+    uint16_t width;
+    uint16_t height;
+    uint32_t frame_number;
+    int64_t timestamp;          /* Camera frame end time in us (esp_timer) */
+    uint16_t crop_x;
+    uint16_t crop_y;
+    uint16_t crop_width;
+    uint16_t crop_height;
+    uint16_t pad_x;
+    uint16_t pad_y;
+    uint16_t scale_16;
+} uvc_infer_tensor_t;
+
+/* Called in the inference task, the tensor is valid until it returns */
+typedef void (*uvc_infer_cb_t)(const uvc_infer_tensor_t *tensor, void *ctx);
+
+typedef struct {
+    uint32_t tensors;           /* Tensors handed to the callback */
+    uint32_t frames_dropped;    /* Frames the PPA couldn't convert */
+    uint32_t prep_us;           /* Mean preprocessing time, PPA and quantization */
+    uint32_t infer_us;          /* Mean callback time */
+} uvc_infer_stats_t;
+
+esp_err_t uvc_infer_set_callback(uvc_infer_cb_t cb, void *ctx);
+
+/*
+ * Quantization of the tensor channels, in tensor channel order.
+ *
+ * A pixel value v (0-255) becomes round((v - mean) / std * 2^-exponent), clamped
+ * to int8, e.g. mean 0, std 255, exponent -7 for a [0, 1] input. The default is
+ * mean 128, std 1, exponent 0.
+ */
+esp_err_t uvc_infer_set_quant(const float mean[3], const float std[3], int exponent);
+
+void uvc_infer_get_stats(uvc_infer_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_INFER_H */
@@ -0,0 +1,50 @@
+/*
+ * UVC Latency - Per-stage pipeline latency histograms
+ *
+ * Stages are measured between these points of every frame:
+ * - Camera frame end (driver timestamp) and camera DQBUF
+ * - Camera DQBUF and encoder QBUF
+ * - Encoder QBUF and encoder DQBUF
+ * - Encoder DQBUF and UVC fb_return
+ */
+
+#ifndef UVC_LATENCY_H
+#define UVC_LATENCY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========= LATENCY STAGES ========= */
+typedef enum {
+    LAT_STAGE_DQBUF,        // Frame end -> camera DQBUF (ISP and capture task wake-up)
+    LAT_STAGE_QUEUE,        // Camera DQBUF -> encoder QBUF (raw queue wait)
+    LAT_STAGE_ENCODE,       // Encoder QBUF -> encoder DQBUF
+    LAT_STAGE_USB,          // Encoder DQBUF -> fb_return (encoded queue wait and USB transfer)
+    LAT_STAGE_TOTAL,        // Frame end -> fb_return
+    LAT_STAGE_MAX
+} uvc_latency_stage_t;
+
+/* Percentiles are bucket upper bounds, buckets are within 25% of their value */
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} uvc_latency_summary_t;
+
+/* Lock-free, safe to call from any task on any core */
+void uvc_latency_record(uvc_latency_stage_t stage, int64_t start_us, int64_t end_us);
+
+void uvc_latency_get(uvc_latency_stage_t stage, uvc_latency_summary_t *summary);
+void uvc_latency_dump(const char *tag);
+void uvc_latency_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_LATENCY_H */
@@ -0,0 +1,55 @@
+/*
+ * UVC Motion - Motion detection on ISP statistics and a downscaled luma plane
+ *
+ * The motion task is a capture consumer. Every analysed frame is compared with
+ * a running background model, either the 5x5 AE block grid the ISP pipeline
+ * attaches to the frame metadata, or, with CONFIG_EXAMPLE_MOTION_LUMA, a luma
+ * plane the PPA downscales from the camera buffer. Motion start, updates and
+ * end are posted as SYS_EVENT_MOTION with a uvc_motion_event_t payload.
+ */
+
+#ifndef UVC_MOTION_H
+#define UVC_MOTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What the bounding box was found on */
+typedef enum {
+    MOTION_SOURCE_AE,       /* AE block grid, covers the center 60% of the frame */
+    MOTION_SOURCE_LUMA,     /* Downscaled luma plane, covers the whole frame */
+} uvc_motion_source_t;
+
+/* Payload of SYS_EVENT_MOTION, also the state returned by uvc_motion_get_state() */
+typedef struct {
+    uint32_t frame_number;  /* Camera frame the state was taken from */
+    uint16_t x;             /* Bounding box of the moving blocks, in pixels of the session frame */
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint16_t blocks;        /* Moving blocks in the box */
+    uint8_t source;         /* uvc_motion_source_t */
+    bool active;            /* false in the event which ends the motion */
+} uvc_motion_event_t;
+
+/* Called in the event handler task for every SYS_EVENT_MOTION, e.g. to start a recording */
+typedef void (*uvc_motion_cb_t)(const uvc_motion_event_t *event, void *ctx);
+
+esp_err_t uvc_motion_set_callback(uvc_motion_cb_t cb, void *ctx);
+
+/* Latest state, false if no frame has been analysed in the running session */
+bool uvc_motion_get_state(uvc_motion_event_t *state);
+
+/* Event handler side of SYS_EVENT_MOTION */
+void uvc_motion_dispatch(const uvc_motion_event_t *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_MOTION_H */
@@ -0,0 +1,38 @@
+/*
+ * UVC OSD - Timestamp and logo overlay composited into camera frames
+ *
+ * Every element is an A8 alpha mask drawn in one color. Elements are blended
+ * into the camera buffer in place, before the buffer reaches the encoders, and
+ * only the rectangles they cover are touched.
+ */
+
+#ifndef UVC_OSD_H
+#define UVC_OSD_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "uvc_app_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Build the glyph atlas and set up the blend engine, called by the capture task init */
+esp_err_t uvc_osd_init(void);
+
+/* Composite the enabled elements into a camera frame of the running session, capture task only */
+void uvc_osd_apply(frame_buffer_t *frame);
+
+/*
+ * Draw an A8 logo at x, y in 0xRRGGBB, negative coordinates count from the
+ * right and bottom edges. The mask is read every frame, by the PPA for RGB
+ * frames, so it must be in DMA capable memory and stay valid until the logo
+ * is replaced or cleared. NULL clears the logo.
+ */
+esp_err_t uvc_osd_set_logo(const uint8_t *alpha, uint16_t width, uint16_t height, int x, int y, uint32_t rgb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_OSD_H */
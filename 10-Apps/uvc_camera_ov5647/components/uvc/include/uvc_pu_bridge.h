@@ -0,0 +1,96 @@
+/*
+ * UVC PU Bridge - UVC Processing Unit controls applied to the ISP
+ *
+ * Host requests of the Processing Unit (brightness, contrast, saturation, hue
+ * and the white balance gains) map one to one onto ISP controls of
+ * ESP_VIDEO_ISP1_DEVICE_NAME. uvc_pu_set() only stores the latest value of a
+ * control, so a slider dragged on the host sends many requests and the ISP
+ * sees the last one. The capture task calls uvc_pu_bridge_apply() once per
+ * frame, which hands every changed control to the ISP in one VIDIOC_S_EXT_CTRLS.
+ * With CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT the ISP writes them together at the
+ * next frame end, so no frame is processed with half of a change.
+ *
+ * Without CONFIG_EXAMPLE_UVC_PU_BRIDGE the calls do nothing.
+ */
+
+#ifndef UVC_PU_BRIDGE_H
+#define UVC_PU_BRIDGE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    UVC_PU_BRIGHTNESS = 0,
+    UVC_PU_CONTRAST,
+    UVC_PU_SATURATION,
+    UVC_PU_HUE,
+    UVC_PU_RED_BALANCE,     /* White balance red gain, in 1/V4L2_CID_RED_BALANCE_DEN */
+    UVC_PU_BLUE_BALANCE,    /* White balance blue gain, in 1/V4L2_CID_BLUE_BALANCE_DEN */
+    UVC_PU_CTRL_MAX,
+} uvc_pu_ctrl_t;
+
+/* Range of a control as the ISP reports it, what GET_MIN/GET_MAX/GET_DEF answer */
+typedef struct {
+    int32_t minimum;
+    int32_t maximum;
+    int32_t default_value;
+} uvc_pu_range_t;
+
+/* Counters since boot */
+typedef struct {
+    uint32_t requests;      /* uvc_pu_set() calls */
+    uint32_t coalesced;     /* Requests replaced by a later one before they were applied */
+    uint32_t commits;       /* VIDIOC_S_EXT_CTRLS calls to the ISP */
+    uint32_t failures;      /* Commits the ISP refused */
+} uvc_pu_stats_t;
+
+#if CONFIG_EXAMPLE_UVC_PU_BRIDGE
+
+/* Open the ISP and read the control ranges, after esp_video_init() */
+esp_err_t uvc_pu_bridge_init(void);
+
+/* Set a control from any task, the value is clamped to the ISP range and applied with the next frame */
+esp_err_t uvc_pu_set(uvc_pu_ctrl_t ctrl, int32_t value);
+
+/* Latest value set, the one the ISP has or gets with the next frame */
+esp_err_t uvc_pu_get(uvc_pu_ctrl_t ctrl, int32_t *ret_value);
+
+esp_err_t uvc_pu_get_range(uvc_pu_ctrl_t ctrl, uvc_pu_range_t *ret_range);
+
+/* Capture task, once per frame, returns at once when no control changed */
+void uvc_pu_bridge_apply(void);
+
+void uvc_pu_bridge_get_stats(uvc_pu_stats_t *ret_stats);
+void uvc_pu_bridge_reset_stats(void);
+
+#else
+
+static inline esp_err_t uvc_pu_bridge_init(void)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t uvc_pu_set(uvc_pu_ctrl_t ctrl, int32_t value)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static inline void uvc_pu_bridge_apply(void)
+{
+}
+
+static inline void uvc_pu_bridge_reset_stats(void)
+{
+}
+
+#endif /* CONFIG_EXAMPLE_UVC_PU_BRIDGE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_PU_BRIDGE_H */
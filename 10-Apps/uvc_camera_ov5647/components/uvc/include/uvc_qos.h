@@ -0,0 +1,123 @@
+/*
+ * UVC QoS - Stream quality governor under USB or encoder overload
+ *
+ * The encode task reports the time of every encoding, the fb_return callback
+ * the time from the encoder output to the host returning the buffer. A sched
+ * job compares their means and the drop rate of each window with the frame
+ * period while a session runs, and moves along a ladder of rungs:
+ *
+ *   0                          the configured stream
+ *   1 .. ENCODER_STEPS         encoder budget cut by CONFIG_EXAMPLE_QOS_STEP_PERCENT
+ *                              each, H.264 bitrate, JPEG target size or JPEG quality
+ *   then up to MAX_DECIMATION  every 2nd, 3rd ... camera frame, at the lowest budget
+ *
+ * A rung down takes two overloaded windows in a row, a rung up five windows in
+ * which the stream would have fit the better rung with room to spare, so the
+ * governor doesn't swing between two rungs. Each session starts at rung 0.
+ *
+ * Without CONFIG_EXAMPLE_QOS the calls do nothing.
+ */
+
+#ifndef UVC_QOS_H
+#define UVC_QOS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    UVC_QOS_ENCODE = 0,     /* Encoder QBUF -> encoder DQBUF */
+    UVC_QOS_USB,            /* Encoder DQBUF -> fb_return */
+    UVC_QOS_SOURCE_MAX,
+} uvc_qos_source_t;
+
+/* Counters since boot */
+typedef struct {
+    uint32_t level;         /* Rung of the running session */
+    uint32_t worst_level;   /* Lowest rung reached */
+    uint32_t steps_down;
+    uint32_t steps_up;
+} uvc_qos_stats_t;
+
+#if CONFIG_EXAMPLE_QOS
+
+/* Per source, written by one context each, so the frame paths take no lock */
+extern volatile uint32_t g_uvc_qos_time[UVC_QOS_SOURCE_MAX];
+extern volatile uint32_t g_uvc_qos_count[UVC_QOS_SOURCE_MAX];
+extern volatile uint32_t g_uvc_qos_scale;
+extern volatile uint32_t g_uvc_qos_decimation;
+
+/* Register the governor job, once at init */
+esp_err_t uvc_qos_init(void);
+
+/* Start governing a session running at rate fps, from rung 0 */
+void uvc_qos_arm(int rate);
+
+/* Stop governing, the encoder gets its configured budget back */
+void uvc_qos_disarm(void);
+
+void uvc_qos_get_stats(uvc_qos_stats_t *ret_stats);
+
+static inline void uvc_qos_record(uvc_qos_source_t source, int64_t start_us, int64_t end_us)
+{
+    g_uvc_qos_time[source] += (uint32_t)(end_us - start_us);
+    g_uvc_qos_count[source]++;
+}
+
+/* Encoder budget of the rung, in percent of the configured one */
+static inline uint32_t uvc_qos_scale(void)
+{
+    return g_uvc_qos_scale;
+}
+
+/* Camera frames per frame streamed */
+static inline uint32_t uvc_qos_decimation(void)
+{
+    return g_uvc_qos_decimation;
+}
+
+#else
+
+static inline esp_err_t uvc_qos_init(void)
+{
+    return ESP_OK;
+}
+
+static inline void uvc_qos_arm(int rate)
+{
+}
+
+static inline void uvc_qos_disarm(void)
+{
+}
+
+static inline void uvc_qos_get_stats(uvc_qos_stats_t *ret_stats)
+{
+    memset(ret_stats, 0, sizeof(*ret_stats));
+}
+
+static inline void uvc_qos_record(uvc_qos_source_t source, int64_t start_us, int64_t end_us)
+{
+}
+
+static inline uint32_t uvc_qos_scale(void)
+{
+    return 100;
+}
+
+static inline uint32_t uvc_qos_decimation(void)
+{
+    return 1;
+}
+
+#endif /* CONFIG_EXAMPLE_QOS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_QOS_H */
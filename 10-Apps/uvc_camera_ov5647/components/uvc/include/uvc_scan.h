@@ -0,0 +1,37 @@
+/*
+ * UVC Scan - QR and barcode scanning on the camera luma
+ *
+ * In scan mode, started with uvc_app_scan_start(), the camera runs a small YUV420
+ * frame at a high rate and the scan task decodes the luma of the latest frame,
+ * with no encoder in the path. A host session takes the camera over, scanning
+ * resumes when it stops.
+ */
+
+#ifndef UVC_SCAN_H
+#define UVC_SCAN_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *type;           /* Symbology, e.g. "QR-Code" */
+    const char *data;           /* Decoded payload, NUL terminated */
+    uint32_t frame_number;
+    int64_t timestamp;          /* Camera frame end time in us (esp_timer) */
+    uint32_t latency_us;        /* Frame end to decoded result */
+} uvc_scan_result_t;
+
+/* Called in the scan task for every new code, result is only valid until it returns */
+typedef void (*uvc_scan_cb_t)(const uvc_scan_result_t *result, void *ctx);
+
+esp_err_t uvc_scan_set_callback(uvc_scan_cb_t cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_SCAN_H */
@@ -0,0 +1,58 @@
+/*
+ * UVC Sub Stream - Second UVC video function carrying the secondary encoder
+ *
+ * With CONFIG_EXAMPLE_UVC_SUB_STREAM the device registers the cam 2 function
+ * of usb_device_uvc next to the main one, so a host sees two cameras. The sub
+ * stream sends the secondary encoder output: the other codec of the main
+ * camera frame, or the aux camera with CONFIG_EXAMPLE_AUX_CAMERA.
+ *
+ * Each function has its own callbacks, transfer buffer and encoded frame ring.
+ * The secondary sink copies every frame into a free slot of the sub ring, and
+ * frames beyond the rate the host picked for the sub stream are dropped there,
+ * so the sub stream takes only its share of the USB bandwidth.
+ *
+ * Without CONFIG_EXAMPLE_UVC_SUB_STREAM the calls do nothing.
+ */
+
+#ifndef UVC_SUB_STREAM_H
+#define UVC_SUB_STREAM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t streamed;      /* Frames handed to the host */
+    uint32_t dropped;       /* Frames with no free slot, or larger than a slot */
+    uint32_t paced;         /* Frames above the sub stream rate */
+} uvc_sub_stream_stats_t;
+
+#if CONFIG_EXAMPLE_UVC_SUB_STREAM
+
+/* Configure UVC function index, before uvc_device_init() */
+esp_err_t uvc_sub_stream_config(int index);
+
+void uvc_sub_stream_get_stats(uvc_sub_stream_stats_t *ret_stats);
+void uvc_sub_stream_reset_stats(void);
+
+#else
+
+static inline esp_err_t uvc_sub_stream_config(int index)
+{
+    return ESP_OK;
+}
+
+static inline void uvc_sub_stream_reset_stats(void)
+{
+}
+
+#endif /* CONFIG_EXAMPLE_UVC_SUB_STREAM */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_SUB_STREAM_H */
@@ -0,0 +1,28 @@
+/*
+ * UVC TNR - Temporal noise reduction of the camera frames in low light
+ *
+ * The capture task blends every camera buffer in place with the previous
+ * filtered frame while the sensor gain is high, before the OSD is drawn and
+ * before the buffer reaches the encoders. Moving samples are not blended.
+ */
+
+#ifndef UVC_TNR_H
+#define UVC_TNR_H
+
+#include "uvc_app_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Drop the history of the last session, called by the capture task at stream start */
+void uvc_tnr_start(void);
+
+/* Filter a camera frame of the running session, capture task only */
+void uvc_tnr_apply(frame_buffer_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_TNR_H */
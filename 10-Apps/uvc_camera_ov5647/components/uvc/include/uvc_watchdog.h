@@ -0,0 +1,112 @@
+/*
+ * UVC Watchdog - Progress watchdog of the capture and encode stages
+ *
+ * The capture task feeds the capture stage for every camera frame it dequeues,
+ * the encode task the encode stage for every raw frame it takes. A sched job
+ * checks both while a session runs. A stage without progress for
+ * CONFIG_EXAMPLE_STALL_FRAMES frame periods is posted as SYS_EVENT_STALL with
+ * a uvc_stall_event_t payload, and the event handler restarts the pipeline,
+ * see uvc_app_recover(). A stalled stage soon stalls the other one too, the
+ * stage which stopped first is reported.
+ *
+ * Without CONFIG_EXAMPLE_STALL_WATCHDOG the calls do nothing.
+ */
+
+#ifndef UVC_WATCHDOG_H
+#define UVC_WATCHDOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    UVC_STAGE_CAPTURE = 0,  /* Camera DQBUF */
+    UVC_STAGE_ENCODE,       /* Encoder taking raw frames */
+    UVC_STAGE_MAX,
+} uvc_stage_t;
+
+/* Payload of SYS_EVENT_STALL */
+typedef struct {
+    uint8_t stage;          /* uvc_stage_t */
+    uint8_t attempt;        /* Restart of the session this stall asks for, from 1 */
+    uint16_t run;           /* Pipeline run the stall was seen in, see uvc_watchdog_stall_current() */
+    uint32_t stalled_ms;    /* Time since the stage last made progress */
+} uvc_stall_event_t;
+
+/* Counters since boot */
+typedef struct {
+    uint32_t stalls[UVC_STAGE_MAX];
+    uint32_t recoveries;            /* Restarts the pipeline came back from */
+    uint32_t failures;              /* Restarts which failed, and sessions given up */
+    uint32_t last_recovery_ms;      /* From the stall report to the restarted pipeline */
+} uvc_watchdog_stats_t;
+
+#if CONFIG_EXAMPLE_STALL_WATCHDOG
+
+extern volatile uint32_t g_uvc_watchdog_progress[UVC_STAGE_MAX];
+
+/* Register the check job, once at init */
+esp_err_t uvc_watchdog_init(void);
+
+/* Start watching a pipeline running at rate fps, restarts of the session keep their count */
+void uvc_watchdog_arm(int rate);
+
+/* Stop watching, a stall report not handled yet is dropped */
+void uvc_watchdog_disarm(void);
+
+/* The session ended, the next one starts with all its restarts */
+void uvc_watchdog_reset(void);
+
+/* Whether the stall was posted in the pipeline run that is armed now */
+bool uvc_watchdog_stall_current(const uvc_stall_event_t *stall);
+
+/* Count the outcome of the restart of a stall, returns the ms since the stall was reported */
+uint32_t uvc_watchdog_recovered(bool ok);
+
+void uvc_watchdog_get_stats(uvc_watchdog_stats_t *ret_stats);
+
+const char *uvc_watchdog_stage_name(uvc_stage_t stage);
+
+/* Event handler side of SYS_EVENT_STALL, restarts the session of the stall */
+void uvc_app_recover(const uvc_stall_event_t *stall);
+
+/* Progress of a stage, a plain counter so the frame paths take no lock */
+static inline void uvc_watchdog_feed(uvc_stage_t stage)
+{
+    g_uvc_watchdog_progress[stage]++;
+}
+
+#else
+
+static inline esp_err_t uvc_watchdog_init(void)
+{
+    return ESP_OK;
+}
+
+static inline void uvc_watchdog_arm(int rate)
+{
+}
+
+static inline void uvc_watchdog_disarm(void)
+{
+}
+
+static inline void uvc_watchdog_reset(void)
+{
+}
+
+static inline void uvc_watchdog_feed(uvc_stage_t stage)
+{
+}
+
+#endif /* CONFIG_EXAMPLE_STALL_WATCHDOG */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UVC_WATCHDOG_H */
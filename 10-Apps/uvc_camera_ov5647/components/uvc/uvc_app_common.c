@@ -4,12 +4,23 @@
 
 #include "uvc_app_common.h"
 #include "os_interface.h"
+#include "os_boot.h"
+#include "memstat.h"
 #include "esp_video_init.h"
 #include "esp_video_device.h"
 #include "usb_device_uvc.h"
 #include "uvc_frame_config.h"
+#include "uvc_aux_camera.h"
+#include "uvc_pu_bridge.h"
+#include "esp_timer.h"
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+#include "nvs_flash.h"
+#endif
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include "linux/videodev2.h"
@@ -20,22 +31,38 @@
 
 static const char *TAG = "app_common";
 
+/* Protects frame reference counts, frames are released from several tasks */
+static portMUX_TYPE s_frame_ref_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_camera_frames_held;
+static uint32_t s_pooled_frames_held;
+
 /* ========= GLOBAL APPLICATION CONTEXT ========= */
 app_context_t g_app_ctx = {0};
 
 /* ========= CAMERA/ENCODER CONFIGURATION ========= */
 #if CONFIG_EXAMPLE_CAM_SENSOR_MIPI_CSI
 #define CAM_DEV_PATH        ESP_VIDEO_MIPI_CSI_DEVICE_NAME
+#define CAM_DEV_ID          ESP_VIDEO_MIPI_CSI_DEVICE_ID
 #elif CONFIG_EXAMPLE_CAM_SENSOR_DVP
 #define CAM_DEV_PATH        ESP_VIDEO_DVP_DEVICE_NAME
+#define CAM_DEV_ID          ESP_VIDEO_DVP_DEVICE_ID
+#elif CONFIG_EXAMPLE_CAM_SENSOR_TESTPAT
+#define CAM_DEV_PATH        ESP_VIDEO_TESTPAT_DEVICE_NAME
+#define CAM_DEV_ID          ESP_VIDEO_TESTPAT_DEVICE_ID
 #endif
 
 #if CONFIG_FORMAT_MJPEG_CAM1
 #define ENCODE_DEV_PATH     ESP_VIDEO_JPEG_DEVICE_NAME
+#define ENCODE_DEV_ID       ESP_VIDEO_JPEG_DEVICE_ID
 #define UVC_OUTPUT_FORMAT   V4L2_PIX_FMT_JPEG
+#define SECONDARY_DEV_PATH  ESP_VIDEO_H264_DEVICE_NAME
+#define SECONDARY_FORMAT    V4L2_PIX_FMT_H264
 #elif CONFIG_FORMAT_H264_CAM1
 #define ENCODE_DEV_PATH     ESP_VIDEO_H264_DEVICE_NAME
+#define ENCODE_DEV_ID       ESP_VIDEO_H264_DEVICE_ID
 #define UVC_OUTPUT_FORMAT   V4L2_PIX_FMT_H264
+#define SECONDARY_DEV_PATH  ESP_VIDEO_JPEG_DEVICE_NAME
+#define SECONDARY_FORMAT    V4L2_PIX_FMT_JPEG
 #endif
 
 /* Camera configuration */
@@ -57,7 +84,8 @@ static const esp_video_init_csi_config_t csi_config[] = {
 };
 #endif
 
-#if CONFIG_EXAMPLE_CAM_SENSOR_DVP
+/* The aux camera of CONFIG_EXAMPLE_AUX_CAMERA is the DVP one, next to the MIPI-CSI main camera */
+#if CONFIG_EXAMPLE_CAM_SENSOR_DVP || CONFIG_EXAMPLE_AUX_CAMERA
 static const esp_video_init_dvp_config_t dvp_config[] = {
     {
         .sccb_config = {
@@ -93,7 +121,7 @@ static const esp_video_init_config_t cam_config = {
 #if CONFIG_EXAMPLE_CAM_SENSOR_MIPI_CSI
     .csi = csi_config,
 #endif
-#if CONFIG_EXAMPLE_CAM_SENSOR_DVP
+#if CONFIG_EXAMPLE_CAM_SENSOR_DVP || CONFIG_EXAMPLE_AUX_CAMERA
     .dvp = dvp_config,
 #endif
 };
@@ -102,16 +130,16 @@ static const esp_video_init_config_t cam_config = {
 
 frame_buffer_t *frame_buffer_alloc(size_t capacity)
 {
-    frame_buffer_t *frame = heap_caps_malloc(sizeof(frame_buffer_t), MALLOC_CAP_DEFAULT);
+    frame_buffer_t *frame = memstat_malloc(MEMSTAT_FRAME, sizeof(frame_buffer_t), MALLOC_CAP_DEFAULT);
     if (!frame) {
         ESP_LOGE(TAG, "Failed to allocate frame structure");
         return NULL;
     }
 
-    frame->data = heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+    frame->data = memstat_malloc(MEMSTAT_FRAME, capacity, MALLOC_CAP_SPIRAM);
     if (!frame->data) {
         ESP_LOGE(TAG, "Failed to allocate frame buffer");
-        free(frame);
+        memstat_free(MEMSTAT_FRAME, frame);
         return NULL;
     }
 
@@ -120,6 +148,13 @@ frame_buffer_t *frame_buffer_alloc(size_t capacity)
     frame->timestamp = 0;
     frame->frame_number = 0;
     frame->format = 0;
+    frame->flags = 0;
+    frame->camera_buf_index = -1;
+    frame->is_camera_buffer = false;
+    frame->enc_buf_index = -1;
+    frame->refcount = 0;
+    frame->pool = NULL;
+    frame->camera_dev = NULL;
 
     return frame;
 }
@@ -127,49 +162,122 @@ frame_buffer_t *frame_buffer_alloc(size_t capacity)
 void frame_buffer_free(frame_buffer_t *frame)
 {
     if (frame) {
-        if (frame->data) {
-            free(frame->data);
+        memstat_free(MEMSTAT_FRAME, frame->data);
+        memstat_free(MEMSTAT_FRAME, frame);
+    }
+}
+
+/* Take one more reference of a frame, a camera buffer or pooled frame is not recycled until all are released */
+frame_buffer_t *frame_buffer_ref(frame_buffer_t *frame)
+{
+    if (!frame) {
+        return NULL;
+    }
+
+    portENTER_CRITICAL(&s_frame_ref_lock);
+    if (frame->refcount++ == 0) {
+        if (frame->is_camera_buffer) {
+            s_camera_frames_held++;
+        } else if (frame->pool) {
+            s_pooled_frames_held++;
         }
-        free(frame);
     }
+    portEXIT_CRITICAL(&s_frame_ref_lock);
+
+    return frame;
 }
 
-esp_err_t frame_buffer_resize(frame_buffer_t *frame, size_t new_capacity)
+void frame_buffer_release(frame_buffer_t *frame)
 {
+    bool last;
+    struct v4l2_buffer cam_buf;
+
     if (!frame) {
-        return ESP_ERR_INVALID_ARG;
+        return;
     }
 
-    if (new_capacity == frame->capacity) {
-        return ESP_OK;
+    portENTER_CRITICAL(&s_frame_ref_lock);
+    if (!frame->refcount) {
+        portEXIT_CRITICAL(&s_frame_ref_lock);
+        ESP_LOGW(TAG, "Frame %lu released without reference", frame->frame_number);
+        return;
     }
+    last = --frame->refcount == 0;
+    portEXIT_CRITICAL(&s_frame_ref_lock);
 
-    uint8_t *new_data = heap_caps_realloc(frame->data, new_capacity, MALLOC_CAP_SPIRAM);
-    if (!new_data) {
-        ESP_LOGE(TAG, "Failed to resize frame buffer");
-        return ESP_ERR_NO_MEM;
+    if (!last) {
+        return;
     }
 
-    frame->data = new_data;
-    frame->capacity = new_capacity;
+    /* Last consumer of an encoded frame is done, the encoder may write into it again */
+    if (frame->pool && !frame->is_camera_buffer) {
+        xQueueSend(frame->pool, &frame, 0);
+        portENTER_CRITICAL(&s_frame_ref_lock);
+        s_pooled_frames_held--;
+        portEXIT_CRITICAL(&s_frame_ref_lock);
+        return;
+    }
 
-    return ESP_OK;
+    if (!frame->is_camera_buffer) {
+        return;
+    }
+
+    /* Last holder is gone, let the camera refill the mmap buffer */
+    memset(&cam_buf, 0, sizeof(cam_buf));
+    cam_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    cam_buf.memory = V4L2_MEMORY_MMAP;
+    cam_buf.index = frame->camera_buf_index;
+    if (esp_video_direct_qbuf(frame->camera_dev ? frame->camera_dev : g_app_ctx.uvc->cap_dev, &cam_buf) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to return camera buffer %d", frame->camera_buf_index);
+    }
+
+    portENTER_CRITICAL(&s_frame_ref_lock);
+    s_camera_frames_held--;
+    portEXIT_CRITICAL(&s_frame_ref_lock);
+}
+
+/* Number of camera buffers currently referenced by any task */
+uint32_t frame_buffer_camera_held(void)
+{
+    uint32_t held;
+
+    portENTER_CRITICAL(&s_frame_ref_lock);
+    held = s_camera_frames_held;
+    portEXIT_CRITICAL(&s_frame_ref_lock);
+
+    return held;
+}
+
+/* Number of pooled frames, e.g. encoder buffers, currently referenced by any task */
+uint32_t frame_buffer_pooled_held(void)
+{
+    uint32_t held;
+
+    portENTER_CRITICAL(&s_frame_ref_lock);
+    held = s_pooled_frames_held;
+    portEXIT_CRITICAL(&s_frame_ref_lock);
+
+    return held;
 }
 
 /* ========= EVENT POSTING ========= */
 
-esp_err_t app_post_event(system_event_type_t type, void *data, size_t data_len)
+esp_err_t app_post_event(system_event_type_t type, const void *data, size_t data_len)
 {
     QueueHandle_t event_queue = os_getQueueHandler(QUEUE_SYSTEM_EVENT);
     if (!event_queue) {
         return ESP_ERR_INVALID_STATE;
     }
+    APP_RETURN_ON_FALSE(data_len <= SYS_EVENT_DATA_MAX && (data || !data_len), ESP_ERR_INVALID_ARG, TAG,
+                        "Event payload of %u bytes does not fit", (unsigned)data_len);
 
     system_event_t event = {
         .type = type,
-        .data = data,
         .data_len = data_len
     };
+    if (data_len) {
+        memcpy(event.data, data, data_len);
+    }
 
     if (xQueueSend(event_queue, &event, pdMS_TO_TICKS(100)) != pdTRUE) {
         ESP_LOGW(TAG, "Failed to post event type %d", type);
@@ -179,6 +287,314 @@ esp_err_t app_post_event(system_event_type_t type, void *data, size_t data_len)
     return ESP_OK;
 }
 
+void app_request_shutdown(void)
+{
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_SHUTDOWN);
+
+    /* The event handler blocks on its queue only, the bit alone does not wake it */
+    app_post_event(SYS_EVENT_SHUTDOWN, NULL, 0);
+}
+
+/* ========= PIPELINE CONTROL ========= */
+
+/* Pipeline stages stop within one frame period once EVENT_PIPELINE_RUN is cleared */
+#define PIPELINE_HALT_TIMEOUT_MS    1000
+
+void uvc_pipeline_run(void)
+{
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_PIPELINE_RUN);
+}
+
+esp_err_t uvc_pipeline_halt(void)
+{
+    EventBits_t bits;
+    frame_buffer_t *frame;
+    esp_err_t ret = ESP_OK;
+    EventBits_t idle_bits = EVENT_CAPTURE_IDLE | EVENT_ENCODE_IDLE;
+    QueueHandle_t raw_queue = os_getQueueHandler(QUEUE_RAW_FRAME);
+    QueueHandle_t enc_queue = os_getQueueHandler(QUEUE_ENCODED_FRAME);
+
+    xEventGroupClearBits(g_app_ctx.system_events, EVENT_PIPELINE_RUN);
+
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    idle_bits |= EVENT_SECONDARY_IDLE;
+#endif
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    idle_bits |= EVENT_AUX_CAPTURE_IDLE;
+#endif
+#if CONFIG_EXAMPLE_MOTION
+    idle_bits |= EVENT_MOTION_IDLE;
+#endif
+#if CONFIG_EXAMPLE_INFER
+    idle_bits |= EVENT_INFER_IDLE;
+#endif
+
+    bits = xEventGroupWaitBits(g_app_ctx.system_events, idle_bits,
+                               pdFALSE, pdTRUE, pdMS_TO_TICKS(PIPELINE_HALT_TIMEOUT_MS));
+    if ((bits & idle_bits) != idle_bits) {
+        ESP_LOGW(TAG, "Pipeline stages did not go idle (bits=0x%lx)", bits);
+        ret = ESP_ERR_TIMEOUT;
+    }
+
+    /* Raw frames hold camera buffer references, drop them before STREAMOFF */
+    if (raw_queue) {
+        while (xQueueReceive(raw_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    /* Capture, or the aux capture, may publish after the secondary task drained its queue */
+    raw_queue = os_getQueueHandler(QUEUE_SECONDARY_RAW);
+    if (raw_queue) {
+        while (xQueueReceive(raw_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+#endif
+
+#if CONFIG_EXAMPLE_MOTION
+    raw_queue = os_getQueueHandler(QUEUE_MOTION_RAW);
+    if (raw_queue) {
+        while (xQueueReceive(raw_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+#endif
+
+#if CONFIG_EXAMPLE_INFER
+    raw_queue = os_getQueueHandler(QUEUE_INFER_RAW);
+    if (raw_queue) {
+        while (xQueueReceive(raw_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+#endif
+
+    /* Encoded frames that never reached the host or a sink go back to the free pool */
+    if (enc_queue) {
+        while (xQueueReceive(enc_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+    uvc_encode_drain_sinks();
+
+    /* Fan-out consumers release their frames asynchronously */
+    for (int i = 0; i < PIPELINE_HALT_TIMEOUT_MS && (frame_buffer_camera_held() || frame_buffer_pooled_held());
+            i += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (frame_buffer_camera_held()) {
+        ESP_LOGW(TAG, "%lu camera buffers still held by consumers", frame_buffer_camera_held());
+        ret = ESP_ERR_TIMEOUT;
+    }
+    if (frame_buffer_pooled_held()) {
+        ESP_LOGW(TAG, "%lu encoded frames still held by sinks", frame_buffer_pooled_held());
+        ret = ESP_ERR_TIMEOUT;
+    }
+
+    return ret;
+}
+
+/* ========= BUFFER CONFIGURATION ========= */
+
+/* Takes effect at the next stream start, buffers are requested in video_start_cb */
+esp_err_t uvc_app_set_capture_buffers(uint32_t count, uint32_t hot_count)
+{
+    APP_RETURN_ON_FALSE(g_app_ctx.uvc, ESP_ERR_INVALID_STATE, TAG, "Video hardware not initialized");
+    APP_RETURN_ON_FALSE(count >= 2 && count <= BUFFER_COUNT_MAX, ESP_ERR_INVALID_ARG, TAG,
+                        "Capture buffer count %lu out of range [2, %d]", count, BUFFER_COUNT_MAX);
+    APP_RETURN_ON_FALSE(hot_count <= count, ESP_ERR_INVALID_ARG, TAG,
+                        "Hot buffer count %lu exceeds buffer count %lu", hot_count, count);
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, TAG,
+                        "Stop streaming before changing capture buffers");
+
+    g_app_ctx.uvc->cap_buffer_count = count;
+    g_app_ctx.uvc->cap_hot_count = hot_count;
+
+    ESP_LOGI(TAG, "Capture buffers: %lu (%lu in internal RAM)", count, hot_count);
+
+    return ESP_OK;
+}
+
+/* ========= H.264 RUNTIME CONTROL ========= */
+
+/* The H.264 encoder is the primary one for an H.264 stream, else the secondary one if dual encoding */
+static int h264_encoder_fd(void)
+{
+    if (!g_app_ctx.uvc) {
+        return -1;
+    }
+    if (g_app_ctx.uvc->format == V4L2_PIX_FMT_H264) {
+        return g_app_ctx.uvc->m2m_fd;
+    }
+    if (g_app_ctx.uvc->sec_fd >= 0 && g_app_ctx.uvc->sec_format == V4L2_PIX_FMT_H264) {
+        return g_app_ctx.uvc->sec_fd;
+    }
+
+    return -1;
+}
+
+static esp_err_t set_h264_ctrls(struct v4l2_ext_control *control, uint32_t count)
+{
+    int fd = h264_encoder_fd();
+    struct v4l2_ext_controls controls;
+
+    APP_RETURN_ON_FALSE(fd >= 0, ESP_ERR_NOT_SUPPORTED, TAG, "No H.264 encoder");
+
+    controls.ctrl_class = V4L2_CID_CODEC_CLASS;
+    controls.count      = count;
+    controls.controls   = control;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls) == 0, ESP_FAIL, TAG,
+                        "Failed to set H.264 controls (errno=%d)", errno);
+
+    return ESP_OK;
+}
+
+/* Applied to the running encoder before its next frame, and kept for the next stream start */
+esp_err_t uvc_app_h264_set_bitrate(uint32_t bitrate)
+{
+    struct v4l2_ext_control control[1];
+
+    esp_err_t ret;
+
+    control[0].id       = V4L2_CID_MPEG_VIDEO_BITRATE;
+    control[0].value    = bitrate;
+
+    ret = set_h264_ctrls(control, 1);
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+    if (ret == ESP_OK) {
+        camera_debug_set_h264_target(bitrate, 0);
+    }
+#endif
+
+    return ret;
+}
+
+/* Re-creates the running encoder, which also starts a new GOP */
+esp_err_t uvc_app_h264_set_qp(uint32_t min_qp, uint32_t max_qp)
+{
+    struct v4l2_ext_control control[2];
+
+    APP_RETURN_ON_FALSE(min_qp <= max_qp && max_qp <= 51, ESP_ERR_INVALID_ARG, TAG,
+                        "Invalid QP range %lu-%lu", min_qp, max_qp);
+
+    control[0].id       = V4L2_CID_MPEG_VIDEO_H264_MIN_QP;
+    control[0].value    = min_qp;
+    control[1].id       = V4L2_CID_MPEG_VIDEO_H264_MAX_QP;
+    control[1].value    = max_qp;
+
+    return set_h264_ctrls(control, 2);
+}
+
+/* Next encoded frame is an IDR, so a decoder that lost frames or joined late can resync */
+esp_err_t uvc_app_h264_request_keyframe(void)
+{
+    struct v4l2_ext_control control[1];
+
+    control[0].id       = V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME;
+    control[0].value    = 1;
+
+    return set_h264_ctrls(control, 1);
+}
+
+/* Region map in encoded frame pixels, NULL or count 0 encodes the whole frame evenly again */
+esp_err_t uvc_app_h264_set_roi(const struct esp_video_enc_roi *roi)
+{
+    struct esp_video_enc_roi roi_map = {0};
+    struct v4l2_ext_control control[1];
+
+    if (roi) {
+        APP_RETURN_ON_FALSE(roi->count <= ESP_VIDEO_ENC_ROI_MAX, ESP_ERR_INVALID_ARG, TAG,
+                            "Too many ROI regions %lu", roi->count);
+        roi_map = *roi;
+    }
+
+    control[0].id       = V4L2_CID_MPEG_VIDEO_ESP_ROI;
+    control[0].size     = sizeof(roi_map);
+    control[0].p_u8     = (uint8_t *)&roi_map;
+
+    return set_h264_ctrls(control, 1);
+}
+
+/* Frame interval for rate control and VUI timing, set before STREAMON or applied to the running encoder */
+esp_err_t uvc_app_h264_set_frame_rate(uint32_t rate)
+{
+    int fd = h264_encoder_fd();
+    struct v4l2_streamparm parm;
+
+    if (fd < 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    parm.parm.output.timeperframe.numerator = 1;
+    parm.parm.output.timeperframe.denominator = rate;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_PARM, &parm) == 0, ESP_FAIL, TAG,
+                        "Failed to set H.264 frame rate (errno=%d)", errno);
+
+    return ESP_OK;
+}
+
+/* ========= JPEG RUNTIME CONTROL ========= */
+
+/* The JPEG encoder reads its quality at every frame, so this applies to the next one */
+esp_err_t uvc_app_jpeg_set_quality(uint32_t quality)
+{
+    struct v4l2_ext_controls controls;
+    struct v4l2_ext_control control[1];
+    int fd = -1;
+
+    APP_RETURN_ON_FALSE(quality >= 1 && quality <= 100, ESP_ERR_INVALID_ARG, TAG,
+                        "JPEG quality %lu out of range [1, 100]", quality);
+
+    if (g_app_ctx.uvc && g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG) {
+        fd = g_app_ctx.uvc->m2m_fd;
+    }
+    APP_RETURN_ON_FALSE(fd >= 0, ESP_ERR_NOT_SUPPORTED, TAG, "No JPEG encoder");
+
+    controls.ctrl_class = V4L2_CID_JPEG_CLASS;
+    controls.count      = 1;
+    controls.controls   = control;
+    control[0].id       = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    control[0].value    = quality;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls) == 0, ESP_FAIL, TAG,
+                        "Failed to set JPEG quality (errno=%d)", errno);
+
+    return ESP_OK;
+}
+
+/* The encoder adjusts the quality toward an average frame size between the bounds, 0 keeps it fixed */
+esp_err_t uvc_app_jpeg_set_target_size(uint32_t target_size, uint32_t min_quality, uint32_t max_quality)
+{
+    struct v4l2_ext_controls controls;
+    struct v4l2_ext_control control[3];
+    int fd = -1;
+
+    APP_RETURN_ON_FALSE(min_quality >= 1 && max_quality <= 100 && min_quality <= max_quality, ESP_ERR_INVALID_ARG,
+                        TAG, "JPEG quality bounds [%lu, %lu] invalid", min_quality, max_quality);
+
+    if (g_app_ctx.uvc && g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG) {
+        fd = g_app_ctx.uvc->m2m_fd;
+    }
+    APP_RETURN_ON_FALSE(fd >= 0, ESP_ERR_NOT_SUPPORTED, TAG, "No JPEG encoder");
+
+    controls.ctrl_class = V4L2_CID_JPEG_CLASS;
+    controls.count      = 3;
+    controls.controls   = control;
+    control[0].id       = V4L2_CID_JPEG_ESP_MIN_QUALITY;
+    control[0].value    = min_quality;
+    control[1].id       = V4L2_CID_JPEG_ESP_MAX_QUALITY;
+    control[1].value    = max_quality;
+    control[2].id       = V4L2_CID_JPEG_ESP_TARGET_SIZE;
+    control[2].value    = target_size;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls) == 0, ESP_FAIL, TAG,
+                        "Failed to set JPEG target size (errno=%d)", errno);
+
+    return ESP_OK;
+}
+
 /* ========= HARDWARE INITIALIZATION ========= */
 
 static void print_video_device_info(const struct v4l2_capability *capability)
@@ -202,10 +618,121 @@ static esp_err_t init_capture_video(uvc_t *uvc)
     APP_RETURN_ON_ERROR(ioctl(fd, VIDIOC_QUERYCAP, &capability), TAG, "VIDIOC_QUERYCAP failed");
     print_video_device_info(&capability);
 
+    APP_RETURN_ON_ERROR(esp_video_direct_open(CAM_DEV_ID, &uvc->cap_dev), TAG, "Failed to open camera handle");
+
     uvc->cap_fd = fd;
     return ESP_OK;
 }
 
+/*
+ * Encoder input formats and their cost per pixel, RAW Bayer can't be encoded.
+ * The camera writes every frame to PSRAM and the encoder reads it back, so a
+ * frame moves twice its bits. The encoder time per pixel is relative to YUV
+ * 4:2:0, which codes 6 blocks per 16x16 MCU where 4:2:2 codes 8, and an RGB
+ * input goes through the color converter of the encoder first. These are
+ * estimates, CONFIG_EXAMPLE_CAPTURE_ENCODE_COST replaces them with the encode
+ * times the benchmark measured. On equal cost the first one wins.
+ */
+typedef struct {
+    uint32_t pixelformat;
+    uint8_t bits;           // Bits per pixel
+    bool chroma_420;
+    uint16_t encode_pct;    // Encoder time per pixel, YUV 4:2:0 is 100
+} capture_cost_t;
+
+#if CONFIG_EXAMPLE_DUAL_ENCODE && !CONFIG_EXAMPLE_AUX_CAMERA
+/* H.264 only reads YUV 4:2:0, the JPEG encoder has to share it */
+static const capture_cost_t s_capture_costs[] = {
+    { V4L2_PIX_FMT_YUV420,  12, true,  100 },
+};
+#elif CONFIG_FORMAT_MJPEG_CAM1
+static const capture_cost_t s_capture_costs[] = {
+    { V4L2_PIX_FMT_YUV420,  12, true,  100 },   // Read from ESP32-P4 revision 3.0
+    { V4L2_PIX_FMT_NV12,    12, true,  100 },
+    { V4L2_PIX_FMT_YUV422P, 16, false, 133 },
+    { V4L2_PIX_FMT_YUYV,    16, false, 133 },
+    { V4L2_PIX_FMT_RGB565,  16, false, 150 },
+    { V4L2_PIX_FMT_RGB24,   24, false, 150 },
+};
+#elif CONFIG_FORMAT_H264_CAM1
+static const capture_cost_t s_capture_costs[] = {
+    { V4L2_PIX_FMT_YUV420,  12, true,  100 },
+};
+#endif
+
+/* Controls the application may touch at runtime */
+static const uint32_t s_probe_ctrl_ids[] = {
+    V4L2_CID_HFLIP,
+    V4L2_CID_VFLIP,
+    V4L2_CID_GAIN,
+    V4L2_CID_EXPOSURE,
+    V4L2_CID_EXPOSURE_ABSOLUTE,
+    V4L2_CID_TEST_PATTERN,
+};
+
+static void probe_capture_caps(uvc_t *uvc)
+{
+    uvc_capture_caps_t *caps = &uvc->cap_caps;
+    struct v4l2_format format;
+
+    memset(caps, 0, sizeof(uvc_capture_caps_t));
+
+    for (int i = 0; i < CAP_FORMAT_MAX; i++) {
+        struct v4l2_fmtdesc fmtdesc = {
+            .index = i,
+            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        };
+
+        if (ioctl(uvc->cap_fd, VIDIOC_ENUM_FMT, &fmtdesc) != 0) {
+            break;
+        }
+        caps->formats[caps->format_count++] = fmtdesc.pixelformat;
+        ESP_LOGD(TAG, "  [%d] 0x%08lx (%.4s): %s", i, fmtdesc.pixelformat,
+                 (const char *)&fmtdesc.pixelformat, fmtdesc.description);
+    }
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(uvc->cap_fd, VIDIOC_G_FMT, &format) == 0) {
+        caps->native_width = format.fmt.pix.width;
+        caps->native_height = format.fmt.pix.height;
+    }
+
+    for (int i = 0; i < sizeof(s_probe_ctrl_ids) / sizeof(s_probe_ctrl_ids[0]) && caps->ctrl_count < CAP_CTRL_MAX; i++) {
+        struct v4l2_query_ext_ctrl qctrl = {
+            .id = s_probe_ctrl_ids[i],
+        };
+
+        if (ioctl(uvc->cap_fd, VIDIOC_QUERY_EXT_CTRL, &qctrl) != 0) {
+            continue;
+        }
+
+        uvc_ctrl_info_t *ctrl = &caps->ctrls[caps->ctrl_count++];
+        ctrl->id = qctrl.id;
+        ctrl->minimum = qctrl.minimum;
+        ctrl->maximum = qctrl.maximum;
+        ctrl->default_value = qctrl.default_value;
+        ESP_LOGD(TAG, "  Control 0x%08lx: %s (min=%lld, max=%lld, default=%lld)",
+                 qctrl.id, qctrl.name, qctrl.minimum, qctrl.maximum, qctrl.default_value);
+    }
+
+    ESP_LOGI(TAG, "Camera: %u formats, %u controls, native %lux%lu",
+             caps->format_count, caps->ctrl_count, caps->native_width, caps->native_height);
+}
+
+const uvc_ctrl_info_t *uvc_app_find_ctrl(uint32_t id)
+{
+    const uvc_capture_caps_t *caps = &g_app_ctx.uvc->cap_caps;
+
+    for (int i = 0; i < caps->ctrl_count; i++) {
+        if (caps->ctrls[i].id == id) {
+            return &caps->ctrls[i];
+        }
+    }
+
+    return NULL;
+}
+
 static esp_err_t init_codec_video(uvc_t *uvc)
 {
     int fd;
@@ -249,24 +776,267 @@ static esp_err_t init_codec_video(uvc_t *uvc)
     APP_LOG_ON_ERROR(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls), TAG, "Failed to set H264 max QP");
 #endif
 
-    uvc->format = UVC_OUTPUT_FORMAT;
+    APP_RETURN_ON_ERROR(esp_video_direct_open(ENCODE_DEV_ID, &uvc->m2m_dev), TAG, "Failed to open encoder handle");
+
     uvc->m2m_fd = fd;
 
     return ESP_OK;
 }
 
-void uvc_app_hw_init(void)
+/* Check that an encoder reads the camera format before sharing camera buffers with it */
+bool uvc_app_codec_accepts_input(int fd, uint32_t pixelformat)
 {
-    ESP_LOGI(TAG, "Initializing video hardware...");
+    for (int i = 0; i < CAP_FORMAT_MAX; i++) {
+        struct v4l2_fmtdesc fmtdesc = {
+            .index = i,
+            .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+        };
 
-    /* Allocate UVC context */
-    g_app_ctx.uvc = calloc(1, sizeof(uvc_t));
-    assert(g_app_ctx.uvc);
+        if (ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) != 0) {
+            break;
+        }
+        if (fmtdesc.pixelformat == pixelformat) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Encoder time per pixel of a format, from CONFIG_EXAMPLE_CAPTURE_ENCODE_COST if it lists the format */
+static uint32_t capture_encode_pct(const capture_cost_t *cost)
+{
+    const char *entry = CONFIG_EXAMPLE_CAPTURE_ENCODE_COST;
+
+    /* Entries are "FOURCC:percent", comma separated */
+    while (strlen(entry) > 5) {
+        if (memcmp(entry, &cost->pixelformat, 4) == 0 && entry[4] == ':') {
+            unsigned long pct = strtoul(entry + 5, NULL, 10);
+
+            if (pct) {
+                return pct;
+            }
+        }
+        entry = strchr(entry, ',');
+        if (!entry) {
+            break;
+        }
+        entry++;
+        while (*entry == ' ') {
+            entry++;
+        }
+    }
+
+    return cost->encode_pct;
+}
+
+/* Table entry of a format both the camera and the encoder take, NULL otherwise */
+static const capture_cost_t *capture_candidate(const uvc_t *uvc, uint32_t pixelformat)
+{
+    const capture_cost_t *cost = NULL;
+    bool offered = false;
+
+    for (int i = 0; i < sizeof(s_capture_costs) / sizeof(s_capture_costs[0]); i++) {
+        if (s_capture_costs[i].pixelformat == pixelformat) {
+            cost = &s_capture_costs[i];
+        }
+    }
+    for (int i = 0; i < uvc->cap_caps.format_count; i++) {
+        offered |= uvc->cap_caps.formats[i] == pixelformat;
+    }
+    if (!cost || !offered || !uvc_app_codec_accepts_input(uvc->m2m_fd, pixelformat)) {
+        return NULL;
+    }
+#if CONFIG_EXAMPLE_CAPTURE_FULL_CHROMA
+    if (cost->chroma_420) {
+        return NULL;
+    }
+#endif
+
+    return cost;
+}
+
+/* Bits moved per pixel weighted by the encoder time, in hundredths */
+static uint32_t capture_cost(const capture_cost_t *cost)
+{
+    return 2 * cost->bits * capture_encode_pct(cost);
+}
+
+/* Pick the cheapest format the camera writes and the encoder reads, there is no fallback to another one */
+static esp_err_t negotiate_capture_format(uvc_t *uvc)
+{
+    uvc_capture_caps_t *caps = &uvc->cap_caps;
+    const capture_cost_t *best = NULL;
 
-    /* Initialize video subsystem */
+    for (int i = 0; i < sizeof(s_capture_costs) / sizeof(s_capture_costs[0]); i++) {
+        const capture_cost_t *cost = capture_candidate(uvc, s_capture_costs[i].pixelformat);
+
+        if (!cost) {
+            continue;
+        }
+        ESP_LOGD(TAG, "  Input %.4s: %u bits per pixel moved twice, encoder %lu%%, cost %lu",
+                 (const char *)&cost->pixelformat, cost->bits, capture_encode_pct(cost), capture_cost(cost));
+        if (!best || capture_cost(cost) < capture_cost(best)) {
+            best = cost;
+        }
+    }
+
+    /* The first camera format may be RAW Bayer, which no encoder reads */
+    APP_RETURN_ON_FALSE(best, ESP_ERR_NOT_SUPPORTED, TAG,
+                        "None of the %d camera formats is an input format of %s", caps->format_count,
+                        ENCODE_DEV_PATH);
+
+    caps->capture_fmt = best->pixelformat;
+    ESP_LOGI(TAG, "Encoder input 0x%08lx (%.4s), %u bits per pixel", caps->capture_fmt,
+             (const char *)&caps->capture_fmt, best->bits);
+
+    return ESP_OK;
+}
+
+esp_err_t uvc_app_set_capture_format(uint32_t pixelformat)
+{
+    APP_RETURN_ON_FALSE(g_app_ctx.uvc, ESP_ERR_INVALID_STATE, TAG, "Video hardware not initialized");
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, TAG,
+                        "Stop streaming before changing the capture format");
+    APP_RETURN_ON_FALSE(capture_candidate(g_app_ctx.uvc, pixelformat), ESP_ERR_NOT_SUPPORTED, TAG,
+                        "Capture format %.4s not taken by both the camera and the encoder",
+                        (const char *)&pixelformat);
+
+    g_app_ctx.uvc->cap_caps.capture_fmt = pixelformat;
+    ESP_LOGI(TAG, "Encoder input 0x%08lx (%.4s)", pixelformat, (const char *)&pixelformat);
+
+    return ESP_OK;
+}
+
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+/* A stalled secondary encode fails the frame instead of blocking a pipeline halt */
+#define SECONDARY_DQBUF_TIMEOUT_MS  PIPELINE_HALT_TIMEOUT_MS
+
+/* Open the other hardware encoder, dual encoding stays off if it can't read the camera format */
+static void init_secondary_codec_video(uvc_t *uvc)
+{
+    int fd;
+    uint32_t timeout_ms;
+    struct v4l2_ext_controls controls;
+    struct v4l2_ext_control control[1];
+
+    fd = open(SECONDARY_DEV_PATH, O_RDONLY);
+    if (fd < 0) {
+        ESP_LOGW(TAG, "Failed to open secondary encoder, dual encoding disabled");
+        return;
+    }
+
+#if !CONFIG_EXAMPLE_AUX_CAMERA
+    if (!uvc->cap_caps.capture_fmt || !uvc_app_codec_accepts_input(uvc->m2m_fd, uvc->cap_caps.capture_fmt) ||
+            !uvc_app_codec_accepts_input(fd, uvc->cap_caps.capture_fmt)) {
+        ESP_LOGW(TAG, "Encoders can't share camera format 0x%08lx, dual encoding disabled",
+                 uvc->cap_caps.capture_fmt);
+        close(fd);
+        return;
+    }
+#endif
+
+    controls.count      = 1;
+    controls.controls   = control;
+#if CONFIG_FORMAT_MJPEG_CAM1
+    controls.ctrl_class = V4L2_CID_CODEC_CLASS;
+
+    control[0].id       = V4L2_CID_MPEG_VIDEO_H264_I_PERIOD;
+    control[0].value    = CONFIG_EXAMPLE_DUAL_H264_I_PERIOD;
+    APP_LOG_ON_ERROR(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls), TAG, "Failed to set secondary H264 I-period");
+
+    control[0].id       = V4L2_CID_MPEG_VIDEO_BITRATE;
+    control[0].value    = CONFIG_EXAMPLE_DUAL_H264_BITRATE;
+    APP_LOG_ON_ERROR(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls), TAG, "Failed to set secondary H264 bitrate");
+#elif CONFIG_FORMAT_H264_CAM1
+    controls.ctrl_class = V4L2_CID_JPEG_CLASS;
+
+    control[0].id       = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    control[0].value    = CONFIG_EXAMPLE_DUAL_JPEG_QUALITY;
+    APP_LOG_ON_ERROR(ioctl(fd, VIDIOC_S_EXT_CTRLS, &controls), TAG, "Failed to set secondary JPEG quality");
+#endif
+
+    timeout_ms = SECONDARY_DQBUF_TIMEOUT_MS;
+    APP_LOG_ON_ERROR(ioctl(fd, VIDIOC_S_DQBUF_TIMEOUT, &timeout_ms), TAG, "Failed to set secondary DQBUF timeout");
+
+    uvc->sec_format = SECONDARY_FORMAT;
+    uvc->sec_fd = fd;
+
+    ESP_LOGI(TAG, "Dual encoding enabled, secondary encoder %s", SECONDARY_DEV_PATH);
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+/* The ISP pipeline controller reads its saved state while esp_video_init() starts it */
+static void init_nvs(void)
+{
+    esp_err_t ret = nvs_flash_init();
+
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition is full or newer, erasing it");
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    APP_LOG_ON_ERROR(ret, TAG, "Failed to initialize NVS, the ISP state is not kept");
+}
+#endif
+
+/* Sensor power-up, SCCB probing and device opening, the slow part of the boot */
+static void hw_bring_up(void)
+{
+    int64_t start = esp_timer_get_time();
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+    init_nvs();
+#endif
     ESP_ERROR_CHECK(esp_video_init(&cam_config));
+    os_boot_mark("video_init");
     ESP_ERROR_CHECK(init_capture_video(g_app_ctx.uvc));
+    probe_capture_caps(g_app_ctx.uvc);
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_CAMERA_READY);
+    os_boot_mark("camera_ready");
+
     ESP_ERROR_CHECK(init_codec_video(g_app_ctx.uvc));
+    ESP_ERROR_CHECK(negotiate_capture_format(g_app_ctx.uvc));
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+    init_secondary_codec_video(g_app_ctx.uvc);
+#endif
+    /* The secondary encoder reads the aux camera, its format is picked against it */
+    APP_LOG_ON_ERROR(uvc_aux_camera_init(), TAG, "Aux camera disabled");
+#if CONFIG_EXAMPLE_UVC_PU_BRIDGE
+    APP_LOG_ON_ERROR(uvc_pu_bridge_init(), TAG, "Processing Unit controls disabled");
+#endif
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_ENCODER_READY);
+    os_boot_mark("encoder_ready");
+
+    ESP_LOGI(TAG, "Video hardware initialized in %lld ms", (esp_timer_get_time() - start) / 1000);
+}
+
+#if CONFIG_EXAMPLE_PARALLEL_BOOT
+#define HW_INIT_TASK_STACK      (4 * 1024)
+#define HW_INIT_TASK_PRIORITY   5
+#define HW_INIT_TASK_CORE       (portNUM_PROCESSORS - 1)    /* TinyUSB and the streaming path run on core 0 */
+
+static void hw_init_task(void *arg)
+{
+    hw_bring_up();
+    vTaskDelete(NULL);
+}
+#endif
+
+void uvc_app_hw_init(void)
+{
+    ESP_LOGI(TAG, "Initializing video hardware...");
+
+    /* Allocate UVC context, devices are not open until EVENT_CAMERA_READY / EVENT_ENCODER_READY */
+    g_app_ctx.uvc = calloc(1, sizeof(uvc_t));
+    assert(g_app_ctx.uvc);
+    g_app_ctx.uvc->cap_buffer_count = BUFFER_COUNT;
+    g_app_ctx.uvc->cap_hot_count = CONFIG_EXAMPLE_CAPTURE_HOT_BUFFER_COUNT;
+    g_app_ctx.uvc->format = UVC_OUTPUT_FORMAT;
+    g_app_ctx.uvc->cap_fd = -1;
+    g_app_ctx.uvc->m2m_fd = -1;
+    g_app_ctx.uvc->sec_fd = -1;
 
     /* Create synchronization primitives */
     g_app_ctx.system_events = xEventGroupCreate();
@@ -278,7 +1048,23 @@ void uvc_app_hw_init(void)
     g_app_ctx.encoder_mutex = xSemaphoreCreateMutex();
     assert(g_app_ctx.encoder_mutex);
 
-    ESP_LOGI(TAG, "Video hardware initialized");
+#if CONFIG_EXAMPLE_PARALLEL_BOOT
+    /* The UVC descriptors don't depend on the camera, so USB enumerates while the sensor powers up */
+    if (xTaskCreatePinnedToCore(hw_init_task, "hw_init", HW_INIT_TASK_STACK, NULL,
+                                HW_INIT_TASK_PRIORITY, NULL, HW_INIT_TASK_CORE) == pdPASS) {
+        return;
+    }
+    ESP_LOGW(TAG, "Failed to create hardware init task, initializing in place");
+#endif
+
+    hw_bring_up();
+}
+
+esp_err_t uvc_app_wait_hw_ready(EventBits_t bits, TickType_t timeout)
+{
+    EventBits_t set = xEventGroupWaitBits(g_app_ctx.system_events, bits, pdFALSE, pdTRUE, timeout);
+
+    return (set & bits) == bits ? ESP_OK : ESP_ERR_TIMEOUT;
 }
 
 void uvc_app_debug_init(void)
@@ -295,8 +1081,8 @@ void uvc_app_debug_init(void)
 #ifdef CONFIG_CAMERA_DEBUG_HEX_HEADER
     debug_level |= CAM_DEBUG_HEX_HEADER;
 #endif
-#ifdef CONFIG_CAMERA_DEBUG_HEX_FULL
-    debug_level |= CAM_DEBUG_HEX_FULL;
+#ifdef CONFIG_CAMERA_DEBUG_CAPTURE
+    debug_level |= CAM_DEBUG_CAPTURE;
 #endif
 #ifdef CONFIG_CAMERA_DEBUG_TIMING
     debug_level |= CAM_DEBUG_TIMING;
@@ -305,6 +1091,9 @@ void uvc_app_debug_init(void)
     if (debug_level > 0) {
         ESP_ERROR_CHECK(camera_debug_init(debug_level));
         ESP_LOGI(TAG, "Camera debug enabled with level: 0x%02lX", debug_level);
+#if CONFIG_FORMAT_H264_CAM1
+        camera_debug_set_h264_target(CONFIG_EXAMPLE_H264_BITRATE, 0);
+#endif
     }
 #endif
 }
@@ -0,0 +1,360 @@
+/*
+ * Aux Camera Task
+ *
+ * Responsibilities:
+ * - Own the DVP camera of CONFIG_EXAMPLE_AUX_CAMERA: its device, its camera
+ *   buffers and their VIDIOC_EXPBUF handles, separate from the main camera
+ * - Dequeue its frames while the pipeline is running and hand them to the
+ *   secondary encoder via QUEUE_SECONDARY_RAW, without copying the payload
+ * - Camera buffers are re-queued to the aux camera when the secondary encoder
+ *   calls frame_buffer_release(), see frame_buffer_t.camera_dev
+ * - Count the frames of this pipeline apart from the main one
+ *
+ * The aux camera streams at its native size, in the first format it offers
+ * which the secondary encoder reads.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uvc_app_common.h"
+#include "uvc_aux_camera.h"
+#include "os_interface.h"
+#include "dlog.h"
+#include "esp_video_device.h"
+#include "linux/videodev2.h"
+
+#define AUX_TAG                 "aux_camera"
+#define AUX_DEV_PATH            ESP_VIDEO_DVP_DEVICE_NAME
+#define AUX_DEV_ID              ESP_VIDEO_DVP_DEVICE_ID
+#define AUX_BUFFER_COUNT        CONFIG_EXAMPLE_AUX_CAMERA_BUFFER_COUNT
+
+/* Longest DQBUF wait, the task checks for a halt request in between */
+#define AUX_DQBUF_TIMEOUT_MS    100
+
+/* Task context */
+typedef struct {
+    int fd;                         /* -1 if the aux camera is not available */
+    esp_video_direct_t *dev;        /* Handle for the per-frame buffer calls, which skip VFS */
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;           /* Camera format the secondary encoder reads */
+    bool configured;                /* Format was set on the camera and the secondary encoder */
+    volatile bool streaming;        /* Buffers are queued and the camera streams */
+    uint32_t frame_number;
+    uint32_t last_sequence;         /* V4L2 sequence of the previous aux frame */
+    bool sequence_valid;            /* last_sequence belongs to the current stream */
+    uint8_t *buffer[AUX_BUFFER_COUNT];
+    int dmabuf[AUX_BUFFER_COUNT];   /* Aux buffers exported to the secondary encoder */
+    frame_buffer_t frames[AUX_BUFFER_COUNT];    /* One descriptor per aux mmap buffer */
+    uvc_aux_camera_stats_t stats;
+} aux_camera_ctx_t;
+
+static aux_camera_ctx_t s_aux_ctx = {
+    .fd = -1,
+};
+
+/* ========== Hardware Init ========== */
+
+/* Called from the hardware init after the secondary encoder was probed */
+esp_err_t uvc_aux_camera_init(void)
+{
+    int fd;
+    struct v4l2_format format;
+
+    APP_RETURN_ON_FALSE(g_app_ctx.uvc->sec_fd >= 0, ESP_ERR_NOT_SUPPORTED, AUX_TAG, "No secondary encoder");
+
+    fd = open(AUX_DEV_PATH, O_RDONLY);
+    APP_RETURN_ON_FALSE(fd >= 0, ESP_FAIL, AUX_TAG, "Failed to open aux camera device");
+
+    for (int i = 0; i < CAP_FORMAT_MAX && !s_aux_ctx.pixelformat; i++) {
+        struct v4l2_fmtdesc fmtdesc = {
+            .index = i,
+            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        };
+
+        if (ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) != 0) {
+            break;
+        }
+        if (uvc_app_codec_accepts_input(g_app_ctx.uvc->sec_fd, fmtdesc.pixelformat)) {
+            s_aux_ctx.pixelformat = fmtdesc.pixelformat;
+        }
+    }
+    if (!s_aux_ctx.pixelformat) {
+        ESP_LOGE(AUX_TAG, "Secondary encoder reads no format of the aux camera");
+        close(fd);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd, VIDIOC_G_FMT, &format) != 0 || !format.fmt.pix.width || !format.fmt.pix.height) {
+        ESP_LOGE(AUX_TAG, "Failed to get aux camera format (errno=%d)", errno);
+        close(fd);
+        return ESP_FAIL;
+    }
+    s_aux_ctx.width = format.fmt.pix.width;
+    s_aux_ctx.height = format.fmt.pix.height;
+
+    if (esp_video_direct_open(AUX_DEV_ID, &s_aux_ctx.dev) != ESP_OK) {
+        ESP_LOGE(AUX_TAG, "Failed to open aux camera handle");
+        close(fd);
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < AUX_BUFFER_COUNT; i++) {
+        s_aux_ctx.frames[i].camera_buf_index = i;
+        s_aux_ctx.frames[i].is_camera_buffer = true;
+        s_aux_ctx.frames[i].enc_buf_index = -1;
+        s_aux_ctx.frames[i].camera_dev = s_aux_ctx.dev;
+        s_aux_ctx.frames[i].format = s_aux_ctx.pixelformat;
+    }
+    s_aux_ctx.fd = fd;
+
+    ESP_LOGI(AUX_TAG, "Aux camera %s: %lux%lu (%.4s), %d buffers", AUX_DEV_PATH, s_aux_ctx.width,
+             s_aux_ctx.height, (const char *)&s_aux_ctx.pixelformat, AUX_BUFFER_COUNT);
+
+    return ESP_OK;
+}
+
+/* ========== Stream Control ========== */
+
+static esp_err_t aux_camera_stream_on(void)
+{
+    int type;
+    int fd = s_aux_ctx.fd;
+    struct v4l2_buffer buf;
+    struct v4l2_format format;
+    struct v4l2_requestbuffers req;
+    struct v4l2_exportbuffer expbuf;
+
+    if (!s_aux_ctx.configured) {
+        memset(&format, 0, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.fmt.pix.width = s_aux_ctx.width;
+        format.fmt.pix.height = s_aux_ctx.height;
+        format.fmt.pix.pixelformat = s_aux_ctx.pixelformat;
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_FMT, &format) == 0, ESP_ERR_NOT_SUPPORTED, AUX_TAG,
+                            "Failed to set aux camera format (errno=%d)", errno);
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.count  = AUX_BUFFER_COUNT;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, AUX_TAG,
+                        "Failed to request aux camera buffers (errno=%d)", errno);
+
+    for (int i = 0; i < AUX_BUFFER_COUNT; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index  = i;
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QUERYBUF, &buf) == 0, ESP_FAIL, AUX_TAG,
+                            "Failed to query aux camera buffer %d (errno=%d)", i, errno);
+
+        s_aux_ctx.buffer[i] = (uint8_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                                              buf.m.offset);
+        APP_RETURN_ON_FALSE(s_aux_ctx.buffer[i], ESP_FAIL, AUX_TAG, "Failed to mmap aux camera buffer %d", i);
+
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = i;
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_EXPBUF, &expbuf) == 0, ESP_FAIL, AUX_TAG,
+                            "Failed to export aux camera buffer %d (errno=%d)", i, errno);
+        s_aux_ctx.dmabuf[i] = expbuf.fd;
+
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QBUF, &buf) == 0, ESP_FAIL, AUX_TAG,
+                            "Failed to queue aux camera buffer %d (errno=%d)", i, errno);
+    }
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_STREAMON, &type) == 0, ESP_FAIL, AUX_TAG,
+                        "Failed to start aux camera streaming (errno=%d)", errno);
+
+    return ESP_OK;
+}
+
+static void aux_camera_stream_off(void)
+{
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (ioctl(s_aux_ctx.fd, VIDIOC_STREAMOFF, &type) != 0) {
+        ESP_LOGW(AUX_TAG, "Failed to stop aux camera streaming (errno=%d: %s)", errno, strerror(errno));
+    }
+}
+
+/* Called from video_start_cb() before the pipeline runs, the aux camera doesn't follow the UVC frame */
+esp_err_t uvc_aux_camera_start(void)
+{
+    esp_err_t ret;
+
+    if (s_aux_ctx.fd < 0) {
+        return ESP_OK;
+    }
+
+    ret = aux_camera_stream_on();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = uvc_secondary_start(s_aux_ctx.width, s_aux_ctx.height, s_aux_ctx.pixelformat, !s_aux_ctx.configured);
+    if (ret != ESP_OK) {
+        aux_camera_stream_off();
+        return ret;
+    }
+
+    s_aux_ctx.configured = true;
+    s_aux_ctx.streaming = true;
+
+    return ESP_OK;
+}
+
+/* Called from video_stop_cb() once the pipeline is halted, so every aux buffer was released */
+void uvc_aux_camera_stop(void)
+{
+    if (!s_aux_ctx.streaming) {
+        return;
+    }
+
+    s_aux_ctx.streaming = false;
+    aux_camera_stream_off();
+    uvc_secondary_stop();
+}
+
+int uvc_aux_camera_dmabuf(int index)
+{
+    return s_aux_ctx.dmabuf[index];
+}
+
+void uvc_aux_camera_get_stats(uvc_aux_camera_stats_t *ret_stats)
+{
+    *ret_stats = s_aux_ctx.stats;
+}
+
+void uvc_aux_camera_reset_stats(void)
+{
+    memset(&s_aux_ctx.stats, 0, sizeof(s_aux_ctx.stats));
+}
+
+/* ========== Init Phase ========== */
+void initAuxCaptureTask(void *arg)
+{
+    ESP_LOGI(AUX_TAG, "Initializing aux capture task...");
+
+    /* Nothing is in flight until the pipeline is started */
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_AUX_CAPTURE_IDLE);
+
+    ESP_LOGI(AUX_TAG, "Aux capture task initialized");
+}
+
+/* Dequeue one aux camera frame and pass it to the secondary encoder */
+static void aux_capture_one_frame(QueueHandle_t raw_queue)
+{
+    esp_err_t ret;
+    struct v4l2_buffer cam_buf;
+    frame_buffer_t *frame;
+
+    memset(&cam_buf, 0, sizeof(cam_buf));
+    cam_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    cam_buf.memory = V4L2_MEMORY_MMAP;
+
+    ret = esp_video_direct_dqbuf_timeout(s_aux_ctx.dev, &cam_buf, AUX_DQBUF_TIMEOUT_MS);
+    if (ret == ESP_ERR_TIMEOUT) {
+        return;
+    }
+    if (ret != ESP_OK || cam_buf.index >= AUX_BUFFER_COUNT) {
+        ESP_LOGE(AUX_TAG, "Failed to dequeue aux frame (%s, index %lu)", esp_err_to_name(ret), cam_buf.index);
+        s_aux_ctx.stats.errors++;
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+
+    if (s_aux_ctx.sequence_valid && cam_buf.sequence > s_aux_ctx.last_sequence + 1) {
+        s_aux_ctx.stats.lost += cam_buf.sequence - s_aux_ctx.last_sequence - 1;
+    }
+    s_aux_ctx.last_sequence = cam_buf.sequence;
+    s_aux_ctx.sequence_valid = true;
+
+    frame = &s_aux_ctx.frames[cam_buf.index];
+    frame->dequeue_time = esp_timer_get_time();
+    frame->data = s_aux_ctx.buffer[cam_buf.index];
+    frame->size = cam_buf.bytesused;
+    frame->capacity = cam_buf.length;
+    frame->timestamp = (int64_t)cam_buf.timestamp.tv_sec * 1000000 + cam_buf.timestamp.tv_usec;
+    if (!frame->timestamp) {
+        frame->timestamp = frame->dequeue_time;
+    }
+    frame->frame_number = s_aux_ctx.frame_number++;
+    s_aux_ctx.stats.captured++;
+
+    /* The queue reference is the only one, the buffer goes back to the aux camera if it doesn't fit */
+    frame_buffer_ref(frame);
+    if (xQueueSend(raw_queue, &frame, 0) != pdTRUE) {
+        DLOGD(AUX_TAG, "Secondary queue full, dropping aux frame %lu", frame->frame_number);
+        s_aux_ctx.stats.dropped++;
+        frame_buffer_release(frame);
+    }
+}
+
+/* ========== Main Loop ========== */
+void mainAuxCaptureTask(void *arg)
+{
+    EventBits_t bits;
+    QueueHandle_t raw_queue;
+
+    ESP_LOGI(AUX_TAG, "Aux capture task started on core %d", xPortGetCoreID());
+
+    raw_queue = os_getQueueHandler(QUEUE_SECONDARY_RAW);
+    if (!raw_queue) {
+        ESP_LOGE(AUX_TAG, "Failed to get secondary raw frame queue");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(AUX_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        xEventGroupClearBits(g_app_ctx.system_events, EVENT_AUX_CAPTURE_IDLE);
+
+        /* Buffers are requested again at stream start, which restarts the sequence */
+        s_aux_ctx.sequence_valid = false;
+
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            if (!s_aux_ctx.streaming) {
+                /* Aux camera failed to start, the main pipeline runs without it */
+                vTaskDelay(pdMS_TO_TICKS(AUX_DQBUF_TIMEOUT_MS));
+                continue;
+            }
+            aux_capture_one_frame(raw_queue);
+        }
+
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_AUX_CAPTURE_IDLE);
+    }
+
+exit:
+    ESP_LOGI(AUX_TAG, "Aux capture task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terAuxCaptureTask(void *arg)
+{
+    ESP_LOGI(AUX_TAG, "Terminating aux capture task...");
+    ESP_LOGI(AUX_TAG, "Aux capture task terminated, captured %lu frames", s_aux_ctx.stats.captured);
+}
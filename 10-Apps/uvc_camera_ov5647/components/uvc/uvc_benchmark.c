@@ -0,0 +1,459 @@
+/*
+ * UVC Benchmark
+ *
+ * Responsibilities:
+ * - Stand in for the USB host: start, pull and stop the stream through the UVC callbacks
+ * - Sweep held ISP blocks, camera formats, UVC frames, capture buffer counts and encoder settings
+ * - Print one machine readable result line per run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uvc_app_common.h"
+#include "uvc_benchmark.h"
+#include "uvc_latency.h"
+#include "uvc_frame_config.h"
+#include "linux/videodev2.h"
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+#include "esp_video_init.h"
+#endif
+
+#define BENCH_TAG           "benchmark"
+#define BENCH_LIST_MAX      8       /* Values per list option */
+#define BENCH_TASK_MAX      32      /* Tasks beyond this leave the CPU load unknown */
+#define BENCH_ISP_MAX       10      /* Nothing held and each ISP block */
+
+#if CONFIG_FORMAT_MJPEG_CAM1
+#define BENCH_UVC_FORMAT    UVC_FORMAT_JPEG
+#define BENCH_FORMAT_NAME   "mjpeg"
+#define BENCH_SETTING_NAME  "quality"
+#define BENCH_SETTING_MIN   1
+#define BENCH_SETTING_MAX   100
+#else
+#define BENCH_UVC_FORMAT    UVC_FORMAT_H264
+#define BENCH_FORMAT_NAME   "h264"
+#define BENCH_SETTING_NAME  "bitrate"
+#define BENCH_SETTING_MIN   25000           /* EXAMPLE_H264_BITRATE range */
+#define BENCH_SETTING_MAX   2500000
+#endif
+
+static const char *const s_stage_names[LAT_STAGE_MAX] = {
+    "dqbuf", "queue", "encode", "usb", "total",
+};
+
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+/* Names of CONFIG_EXAMPLE_BENCHMARK_ISP_BLOCKS */
+static const struct {
+    const char *name;
+    uint32_t block;
+} s_isp_blocks[] = {
+    { "bf", ESP_VIDEO_ISP_BLOCK_BF },
+    { "ccm", ESP_VIDEO_ISP_BLOCK_CCM },
+    { "sharpen", ESP_VIDEO_ISP_BLOCK_SHARPEN },
+    { "gamma", ESP_VIDEO_ISP_BLOCK_GAMMA },
+    { "demosaic", ESP_VIDEO_ISP_BLOCK_DEMOSAIC },
+    { "color", ESP_VIDEO_ISP_BLOCK_COLOR },
+    { "lsc", ESP_VIDEO_ISP_BLOCK_LSC },
+    { "ae", ESP_VIDEO_ISP_BLOCK_AE_STATS },
+    { "hist", ESP_VIDEO_ISP_BLOCK_HIST_STATS },
+};
+#endif
+
+/* One run of the sweep */
+typedef struct {
+    uint32_t isp_held;              /* ESP_VIDEO_ISP_BLOCK_XXX held for the run, 0 for none */
+    uint32_t capture_fmt;           /* Camera format the encoder reads */
+    const uvc_frame_info_t *frame;
+    uint32_t buffers;
+    uint32_t setting;               /* JPEG quality or H.264 bitrate */
+} bench_run_t;
+
+/* Measured over the run, after the warm-up frames */
+typedef struct {
+    int64_t duration_us;
+    uint32_t frames;
+    uint32_t timeouts;              /* fb_get returned no frame */
+    uint32_t too_large;             /* Larger than the UVC transfer buffer */
+    uint64_t encoded_bytes;
+    uint32_t dropped;
+    uint32_t oversize;
+    int cpu_load[portNUM_PROCESSORS];   /* Per mille, -1 if unknown */
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    esp_video_isp_load_t isp_load;
+#endif
+} bench_result_t;
+
+/* Task context */
+typedef struct {
+    TaskStatus_t status[BENCH_TASK_MAX];
+    uint32_t idle_start[portNUM_PROCESSORS];
+    uint32_t total_start;
+} bench_ctx_t;
+
+static bench_ctx_t s_bench_ctx;
+
+/* Parse a comma separated option, values outside [min, max] are skipped */
+static int parse_list(const char *text, uint32_t min, uint32_t max, uint32_t *values)
+{
+    int count = 0;
+    char *end;
+
+    while (*text && count < BENCH_LIST_MAX) {
+        unsigned long value = strtoul(text, &end, 10);
+
+        if (end == text) {
+            text++;
+            continue;
+        }
+        if (value >= min && value <= max) {
+            values[count++] = value;
+        } else {
+            ESP_LOGW(BENCH_TAG, "Skipping %lu, out of range [%lu, %lu]", value, min, max);
+        }
+        text = end;
+    }
+
+    return count;
+}
+
+/* Parse a comma separated FOURCC option, returns the count */
+static int parse_formats(const char *text, uint32_t *values)
+{
+    int count = 0;
+
+    while (*text && count < BENCH_LIST_MAX) {
+        if (*text == ',' || *text == ' ') {
+            text++;
+            continue;
+        }
+        if (strlen(text) < 4) {
+            ESP_LOGW(BENCH_TAG, "Skipping \"%s\", not a FOURCC", text);
+            break;
+        }
+        values[count++] = v4l2_fourcc(text[0], text[1], text[2], text[3]);
+        text += 4;
+    }
+
+    return count;
+}
+
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+/* Parse a comma separated ISP block name option, returns the count */
+static int parse_isp_blocks(const char *text, uint32_t *values, int max)
+{
+    int count = 0;
+    size_t len;
+    int i;
+
+    while (*text && count < max) {
+        if (*text == ',' || *text == ' ') {
+            text++;
+            continue;
+        }
+        len = strcspn(text, ", ");
+        for (i = 0; i < sizeof(s_isp_blocks) / sizeof(s_isp_blocks[0]); i++) {
+            if (strlen(s_isp_blocks[i].name) == len && !strncmp(text, s_isp_blocks[i].name, len)) {
+                values[count++] = s_isp_blocks[i].block;
+                break;
+            }
+        }
+        if (i == sizeof(s_isp_blocks) / sizeof(s_isp_blocks[0])) {
+            ESP_LOGW(BENCH_TAG, "Skipping \"%.*s\", not an ISP block", (int)len, text);
+        }
+        text += len;
+    }
+
+    return count;
+}
+
+static const char *isp_block_name(uint32_t block)
+{
+    for (int i = 0; i < sizeof(s_isp_blocks) / sizeof(s_isp_blocks[0]); i++) {
+        if (s_isp_blocks[i].block == block) {
+            return s_isp_blocks[i].name;
+        }
+    }
+
+    return "none";
+}
+#endif
+
+/* Idle run time of every core and the total, false if the task list does not fit */
+static bool sample_idle(uint32_t *idle, uint32_t *total)
+{
+    configRUN_TIME_COUNTER_TYPE run_time;
+    UBaseType_t count = uxTaskGetSystemState(s_bench_ctx.status, BENCH_TASK_MAX, &run_time);
+
+    if (!count) {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (s_bench_ctx.status[i].xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+                idle[core] = s_bench_ctx.status[i].ulRunTimeCounter;
+            }
+        }
+    }
+    *total = run_time;
+
+    return true;
+}
+
+static esp_err_t apply_setting(uint32_t setting)
+{
+#if CONFIG_FORMAT_MJPEG_CAM1
+    return uvc_app_jpeg_set_quality(setting);
+#else
+    return uvc_app_h264_set_bitrate(setting);
+#endif
+}
+
+/* Raw bytes the camera writes and the encoder reads per frame */
+static uint32_t raw_frame_size(const uvc_frame_info_t *frame)
+{
+    uint32_t pixels = frame->width * frame->height;
+
+    switch (g_app_ctx.uvc->cap_caps.capture_fmt) {
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_NV12:
+        return pixels * 3 / 2;
+    case V4L2_PIX_FMT_RGB24:
+        return pixels * 3;
+    default:
+        return pixels * 2;
+    }
+}
+
+static esp_err_t bench_one(const uvc_device_config_t *config, const bench_run_t *run, bench_result_t *result)
+{
+    uint32_t idle_end[portNUM_PROCESSORS] = {0};
+    uint32_t total_end;
+    uint32_t dropped, oversize;
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    esp_video_isp_load_t isp_start, isp_end;
+#endif
+    bool cpu_valid;
+    int64_t start;
+    uvc_fb_t *fb;
+
+    memset(result, 0, sizeof(*result));
+
+    APP_RETURN_ON_ERROR(uvc_app_set_capture_buffers(run->buffers, MIN(g_app_ctx.uvc->cap_hot_count, run->buffers)),
+                        BENCH_TAG, "Failed to set capture buffers");
+    APP_RETURN_ON_ERROR(apply_setting(run->setting), BENCH_TAG, "Failed to apply encoder setting");
+    APP_RETURN_ON_ERROR(config->start_cb(BENCH_UVC_FORMAT, run->frame->width, run->frame->height, run->frame->rate,
+                                         config->cb_ctx),
+                        BENCH_TAG, "Stream start failed");
+
+    for (int i = 0; i < CONFIG_EXAMPLE_BENCHMARK_WARMUP_FRAMES; i++) {
+        fb = config->fb_get_cb(config->cb_ctx);
+        if (fb) {
+            config->fb_return_cb(fb, config->cb_ctx);
+        }
+    }
+
+    uvc_latency_reset();
+    dropped = g_app_ctx.frames_dropped;
+    oversize = g_app_ctx.frames_oversize;
+    memset(s_bench_ctx.idle_start, 0, sizeof(s_bench_ctx.idle_start));
+    cpu_valid = sample_idle(s_bench_ctx.idle_start, &s_bench_ctx.total_start);
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    esp_video_isp_get_load(&isp_start);
+#endif
+    start = esp_timer_get_time();
+
+    while (esp_timer_get_time() - start < CONFIG_EXAMPLE_BENCHMARK_DURATION_MS * 1000LL) {
+        fb = config->fb_get_cb(config->cb_ctx);
+        if (!fb) {
+            result->timeouts++;
+            continue;
+        }
+
+        /* usb_device_uvc copies the frame into its transfer buffer, cost included */
+        if (fb->len <= config->uvc_buffer_size) {
+            memcpy(config->uvc_buffer, fb->buf, fb->len);
+            result->frames++;
+            result->encoded_bytes += fb->len;
+        } else {
+            result->too_large++;
+        }
+        config->fb_return_cb(fb, config->cb_ctx);
+    }
+
+    result->duration_us = esp_timer_get_time() - start;
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    esp_video_isp_get_load(&isp_end);
+    result->isp_load.irqs = isp_end.irqs - isp_start.irqs;
+    result->isp_load.irq_us = isp_end.irq_us - isp_start.irq_us;
+    result->isp_load.ipa_runs = isp_end.ipa_runs - isp_start.ipa_runs;
+    result->isp_load.ipa_us = isp_end.ipa_us - isp_start.ipa_us;
+#endif
+    cpu_valid = sample_idle(idle_end, &total_end) && cpu_valid;
+    result->dropped = g_app_ctx.frames_dropped - dropped;
+    result->oversize = g_app_ctx.frames_oversize - oversize;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t window = total_end - s_bench_ctx.total_start;
+        uint32_t idle = idle_end[core] - s_bench_ctx.idle_start[core];
+
+        result->cpu_load[core] = cpu_valid && window ? 1000 - MIN((uint64_t)idle * 1000 / window, 1000) : -1;
+    }
+
+    config->stop_cb(config->cb_ctx);
+
+    return ESP_OK;
+}
+
+/* One JSON object per line, after a fixed prefix the host tool looks for */
+static void print_result(const bench_run_t *run, const bench_result_t *result)
+{
+    uvc_latency_summary_t summary;
+    double seconds = result->duration_us / 1000000.0;
+    /* Camera write of every raw frame and encoder read of the sent ones, encoder write and copy of the output */
+    double psram_bytes = (double)raw_frame_size(run->frame) * (2 * result->frames + result->dropped) +
+                         (double)result->encoded_bytes * 2;
+
+    printf("BENCH {\"format\":\"%s\",\"capture\":\"%.4s\",\"width\":%d,\"height\":%d,\"rate\":%d,\"buffers\":%lu,\"%s\":%lu,"
+           "\"duration_ms\":%lld,\"frames\":%lu,\"fps\":%.2f,\"timeouts\":%lu,\"dropped\":%lu,"
+           "\"oversize\":%lu,\"too_large\":%lu,\"avg_frame_bytes\":%llu,\"kbps\":%.0f,",
+           BENCH_FORMAT_NAME, (const char *)&run->capture_fmt, run->frame->width, run->frame->height, run->frame->rate,
+           run->buffers, BENCH_SETTING_NAME, run->setting,
+           result->duration_us / 1000, result->frames, result->frames / seconds, result->timeouts,
+           result->dropped, result->oversize, result->too_large,
+           result->frames ? result->encoded_bytes / result->frames : 0, result->encoded_bytes * 8 / 1000.0 / seconds);
+
+    printf("\"latency_us\":{");
+    for (int stage = 0; stage < LAT_STAGE_MAX; stage++) {
+        uvc_latency_get(stage, &summary);
+        printf("%s\"%s\":{\"p50\":%lu,\"p95\":%lu,\"p99\":%lu,\"max\":%lu}", stage ? "," : "",
+               s_stage_names[stage], summary.p50_us, summary.p95_us, summary.p99_us, summary.max_us);
+    }
+
+    printf("},\"cpu_pct\":[");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (result->cpu_load[core] < 0) {
+            printf("%snull", core ? "," : "");
+        } else {
+            printf("%s%.1f", core ? "," : "", result->cpu_load[core] / 10.0);
+        }
+    }
+
+    /* Estimated from the bytes moved, internal RAM camera buffers are counted too */
+    printf("],\"psram_mbps_est\":%.1f", psram_bytes / 1000000.0 / seconds);
+
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    /* Interrupt and image algorithm time in percent of one core */
+    printf(",\"isp\":{\"held\":\"%s\",\"irqs\":%lu,\"irq_pct\":%.2f,\"ipa_runs\":%lu,\"ipa_us\":%lu,\"ipa_pct\":%.2f}",
+           isp_block_name(run->isp_held), result->isp_load.irqs, result->isp_load.irq_us / 10000.0 / seconds,
+           result->isp_load.ipa_runs,
+           result->isp_load.ipa_runs ? result->isp_load.ipa_us / result->isp_load.ipa_runs : 0,
+           result->isp_load.ipa_us / 10000.0 / seconds);
+#endif
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* ========== Benchmark sweep ========== */
+
+/* Every frame, buffer count and setting with the camera format of the run, false on shutdown */
+static bool sweep_format(const uvc_device_config_t *config, bench_run_t *run, const uint32_t *buffers, int buffer_count,
+                         const uint32_t *settings, int setting_count)
+{
+    bench_result_t result;
+
+    for (int i = 0; i < UVC_FRAME_NUM; i++) {
+        run->frame = &UVC_FRAMES_INFO[0][i];
+        if (!run->frame->width || !run->frame->height) {
+            continue;
+        }
+
+        for (int b = 0; b < buffer_count; b++) {
+            for (int s = 0; s < setting_count; s++) {
+                if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN) {
+                    return false;
+                }
+
+                run->buffers = buffers[b];
+                run->setting = settings[s];
+                ESP_LOGI(BENCH_TAG, "Run %.4s %dx%d@%d, %lu buffers, setting %lu, ISP held 0x%lx",
+                         (const char *)&run->capture_fmt, run->frame->width, run->frame->height, run->frame->rate,
+                         run->buffers, run->setting, run->isp_held);
+
+                if (bench_one(config, run, &result) != ESP_OK) {
+                    continue;
+                }
+                print_result(run, &result);
+            }
+        }
+    }
+
+    return true;
+}
+
+void uvc_benchmark_run(const uvc_device_config_t *config)
+{
+    uint32_t buffers[BENCH_LIST_MAX];
+    uint32_t settings[BENCH_LIST_MAX];
+    uint32_t formats[BENCH_LIST_MAX];
+    uint32_t held[BENCH_ISP_MAX] = {0};
+    uint32_t negotiated = g_app_ctx.uvc->cap_caps.capture_fmt;
+    int buffer_count, setting_count, format_count;
+    int held_count = 1;
+    bool running = true;
+    bench_run_t run;
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    uint32_t base_held = esp_video_isp_held_blocks();
+#endif
+
+    buffer_count = parse_list(CONFIG_EXAMPLE_BENCHMARK_BUFFER_COUNTS, 2, BUFFER_COUNT_MAX, buffers);
+    setting_count = parse_list(CONFIG_EXAMPLE_BENCHMARK_SETTINGS, BENCH_SETTING_MIN, BENCH_SETTING_MAX, settings);
+    if (!buffer_count || !setting_count) {
+        ESP_LOGE(BENCH_TAG, "Nothing to run, check the benchmark buffer counts and settings");
+        return;
+    }
+    format_count = parse_formats(CONFIG_EXAMPLE_BENCHMARK_CAPTURE_FORMATS, formats);
+    if (!format_count) {
+        formats[format_count++] = negotiated;
+    }
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    /* The first pass holds nothing more than the profile, the reference of the others */
+    held_count += parse_isp_blocks(CONFIG_EXAMPLE_BENCHMARK_ISP_BLOCKS, &held[1], BENCH_ISP_MAX - 1);
+#endif
+
+    ESP_LOGI(BENCH_TAG, "Benchmark: %d ISP passes x %d camera formats x %d buffer counts x %d settings per frame, "
+             "%d ms each", held_count, format_count, buffer_count, setting_count, CONFIG_EXAMPLE_BENCHMARK_DURATION_MS);
+
+    for (int h = 0; h < held_count && running; h++) {
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+        /* A running ISP pipeline restarts with the blocks held, between runs no frame is lost */
+        if ((held[h] & base_held) || esp_video_isp_hold_blocks(base_held | held[h]) != ESP_OK) {
+            ESP_LOGW(BENCH_TAG, "Skipping ISP block %s, already held or not supported", isp_block_name(held[h]));
+            continue;
+        }
+#endif
+        run.isp_held = held[h];
+
+        for (int f = 0; f < format_count && running; f++) {
+            if (uvc_app_set_capture_format(formats[f]) != ESP_OK) {
+                ESP_LOGW(BENCH_TAG, "Skipping camera format %.4s", (const char *)&formats[f]);
+                continue;
+            }
+            run.capture_fmt = formats[f];
+            running = sweep_format(config, &run, buffers, buffer_count, settings, setting_count);
+        }
+    }
+    uvc_app_set_capture_format(negotiated);
+#if CONFIG_EXAMPLE_BENCHMARK_ISP
+    esp_video_isp_hold_blocks(base_held);
+#endif
+
+    printf("BENCH_DONE\n");
+    fflush(stdout);
+}
@@ -0,0 +1,300 @@
+/*
+ * Capture Task
+ *
+ * Responsibilities:
+ * - Dequeue raw frames from the camera while the pipeline is running
+ * - Hand camera mmap buffers to the encode task via QUEUE_RAW_FRAME, and to
+ *   any registered consumer queue, without copying the payload
+ * - Camera buffers are re-queued when the last holder calls frame_buffer_release()
+ * - Count frames the driver dropped in latest-frame-wins mode from sequence gaps
+ * - Pace frames to the session rate, a faster sensor mode is decimated here, so
+ *   is the session rate while the quality governor asks for it
+ * - Filter noise of low light frames against the previous frame, then composite
+ *   the OSD, into the camera buffer before any consumer sees it
+ * - Feed the stall watchdog for every dequeued frame, DQBUF times out so a
+ *   camera which stopped delivering frames doesn't keep the task from halting
+ * - Measure every frame against the frame sync trigger, see uvc_fsync.h
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uvc_app_common.h"
+#include "uvc_latency.h"
+#include "os_interface.h"
+#include "dlog.h"
+#include "uvc_watchdog.h"
+#include "uvc_qos.h"
+#include "uvc_fsync.h"
+#include "uvc_pu_bridge.h"
+#include "trace.h"
+#include "linux/videodev2.h"
+#if CONFIG_EXAMPLE_OSD
+#include "uvc_osd.h"
+#endif
+#if CONFIG_EXAMPLE_TNR
+#include "uvc_tnr.h"
+#endif
+
+/* Longest DQBUF wait, the capture task checks for a halt request in between */
+#define CAPTURE_DQBUF_TIMEOUT_MS    100
+
+/* Task context */
+typedef struct {
+    uint32_t captured_count;
+    uint32_t frame_number;
+    uint32_t last_sequence;     /* V4L2 sequence of the previous camera frame */
+    bool sequence_valid;        /* last_sequence belongs to the current stream */
+    int64_t frame_period;       /* Frame period of the session rate in us */
+    int64_t pace_period;        /* frame_period with frame pacing, 0 to pass every frame */
+    int64_t pace_due;           /* Capture time the next frame is due at, 0 before the first one */
+    frame_buffer_t raw_frames[BUFFER_COUNT_MAX];   /* One descriptor per camera mmap buffer */
+    QueueHandle_t consumers[CAPTURE_CONSUMER_MAX];  /* Extra raw frame consumers */
+    uint32_t consumer_count;
+} capture_task_ctx_t;
+
+static capture_task_ctx_t s_cap_ctx = {0};
+
+/* ========== Init Phase ========== */
+void initCaptureTask(void *arg)
+{
+    ESP_LOGI(CAM_TAG, "Initializing capture task...");
+
+    /* Consumers may register before the init phase runs */
+    memset(&s_cap_ctx, 0, offsetof(capture_task_ctx_t, consumers));
+    for (int i = 0; i < BUFFER_COUNT_MAX; i++) {
+        s_cap_ctx.raw_frames[i].camera_buf_index = i;
+        s_cap_ctx.raw_frames[i].is_camera_buffer = true;
+    }
+
+#if CONFIG_EXAMPLE_OSD
+    APP_LOG_ON_ERROR(uvc_osd_init(), CAM_TAG, "OSD disabled");
+#endif
+
+    /* Nothing is in flight until the pipeline is started */
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_CAPTURE_IDLE);
+
+    ESP_LOGI(CAM_TAG, "Capture task initialized");
+}
+
+/* Register a queue which receives every captured frame alongside the encoder */
+esp_err_t uvc_capture_add_consumer(QueueHandle_t queue)
+{
+    APP_RETURN_ON_FALSE(queue, ESP_ERR_INVALID_ARG, CAM_TAG, "Invalid consumer queue");
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, CAM_TAG,
+                        "Stop streaming before adding a consumer");
+    APP_RETURN_ON_FALSE(s_cap_ctx.consumer_count < CAPTURE_CONSUMER_MAX, ESP_ERR_NO_MEM, CAM_TAG,
+                        "Too many capture consumers");
+
+    s_cap_ctx.consumers[s_cap_ctx.consumer_count++] = queue;
+
+    return ESP_OK;
+}
+
+/* Hand one more reference of the frame to a queue, the reference is dropped if it is full */
+static bool publish_frame(QueueHandle_t queue, frame_buffer_t *frame)
+{
+    frame_buffer_ref(frame);
+    if (xQueueSend(queue, &frame, 0) != pdTRUE) {
+        frame_buffer_release(frame);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Frames more than a quarter period early are dropped, the due time then
+ * advances by whole periods, so a sensor at 30 fps is paced to 15 fps by
+ * taking every other frame on an even interval. A due time a period or more
+ * behind, e.g. after a sensor stall, restarts at the frame. A decimating
+ * governor rung takes frames at a multiple of the session period.
+ */
+static bool pace_frame(int64_t timestamp)
+{
+    int64_t period = s_cap_ctx.pace_period;
+    uint32_t decimation = uvc_qos_decimation();
+
+    if (decimation > 1) {
+        period = s_cap_ctx.frame_period * decimation;
+    }
+
+    if (!period) {
+        return true;
+    }
+    if (s_cap_ctx.pace_due && timestamp < s_cap_ctx.pace_due - period / 4) {
+        return false;
+    }
+
+    if (s_cap_ctx.pace_due && timestamp - s_cap_ctx.pace_due < period) {
+        s_cap_ctx.pace_due += period;
+    } else {
+        s_cap_ctx.pace_due = timestamp + period;
+    }
+
+    return true;
+}
+
+/* Pace to the rate of the session which is starting */
+static void pace_start(void)
+{
+    s_cap_ctx.pace_due = 0;
+    s_cap_ctx.frame_period = 1000000 / (g_app_ctx.stream_fps > 0 ? g_app_ctx.stream_fps : 30);
+    s_cap_ctx.pace_period = 0;
+#if CONFIG_EXAMPLE_FRAME_PACING
+    if (g_app_ctx.stream_fps > 0) {
+        s_cap_ctx.pace_period = s_cap_ctx.frame_period;
+    }
+#endif
+}
+
+/* Dequeue one camera frame and pass it to the encode stage and consumers */
+static void capture_one_frame(QueueHandle_t raw_queue)
+{
+    esp_err_t ret;
+    struct v4l2_buffer cam_buf;
+    frame_buffer_t *frame;
+
+    memset(&cam_buf, 0, sizeof(cam_buf));
+    cam_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    cam_buf.memory = V4L2_MEMORY_MMAP;
+
+    TRACE_BEGIN(dqbuf_start);
+    ret = esp_video_direct_dqbuf_timeout(g_app_ctx.uvc->cap_dev, &cam_buf, CAPTURE_DQBUF_TIMEOUT_MS);
+    if (ret == ESP_ERR_TIMEOUT) {
+        /* No frame is no error here, the watchdog tells a stall from a slow sensor */
+        return;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(CAM_TAG, "Failed to dequeue camera frame (%s)", esp_err_to_name(ret));
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+
+    if (cam_buf.index >= g_app_ctx.uvc->cap_buffer_count) {
+        ESP_LOGE(CAM_TAG, "Invalid camera buffer index %lu", cam_buf.index);
+        return;
+    }
+    uvc_watchdog_feed(UVC_STAGE_CAPTURE);
+    TRACE_END(TRACE_CAP_DQBUF, dqbuf_start, cam_buf.sequence);
+
+    /* Driver drops stale frames in latest-frame-wins mode, account for them here */
+    if (s_cap_ctx.sequence_valid && cam_buf.sequence > s_cap_ctx.last_sequence + 1) {
+        g_app_ctx.frames_dropped += cam_buf.sequence - s_cap_ctx.last_sequence - 1;
+    }
+    s_cap_ctx.last_sequence = cam_buf.sequence;
+    s_cap_ctx.sequence_valid = true;
+
+    frame = &s_cap_ctx.raw_frames[cam_buf.index];
+    frame->dequeue_time = esp_timer_get_time();
+    frame->data = g_app_ctx.uvc->cap_buffer[cam_buf.index];
+    frame->size = cam_buf.bytesused;
+    frame->capacity = cam_buf.length;
+    /* Driver stamps the frame end, fall back to dequeue time if it didn't */
+    frame->timestamp = (int64_t)cam_buf.timestamp.tv_sec * 1000000 + cam_buf.timestamp.tv_usec;
+    if (!frame->timestamp) {
+        frame->timestamp = frame->dequeue_time;
+    }
+    uvc_latency_record(LAT_STAGE_DQBUF, frame->timestamp, frame->dequeue_time);
+    uvc_fsync_frame(frame->timestamp);
+
+    g_app_ctx.total_frames_captured++;
+    s_cap_ctx.captured_count++;
+
+    /* Sensor runs faster than the session rate, back to the camera without a consumer */
+    if (!pace_frame(frame->timestamp)) {
+        g_app_ctx.frames_paced++;
+        frame_buffer_ref(frame);
+        frame_buffer_release(frame);
+        return;
+    }
+    frame->frame_number = s_cap_ctx.frame_number++;
+
+#if CONFIG_EXAMPLE_TNR
+    /* Before the OSD, so the overlay doesn't enter the filter history */
+    uvc_tnr_apply(frame);
+#endif
+
+#if CONFIG_EXAMPLE_OSD
+    /* In place, the encoders and consumers all get the composited frame */
+    uvc_osd_apply(frame);
+#endif
+
+    /* Own a reference while publishing, so no consumer can re-queue the buffer early */
+    frame_buffer_ref(frame);
+
+    if (!publish_frame(raw_queue, frame)) {
+        /* Encode stage is not keeping up */
+        DLOGD(CAM_TAG, "Raw queue full, dropping frame %lu", frame->frame_number);
+        g_app_ctx.frames_dropped++;
+    }
+
+    for (int i = 0; i < s_cap_ctx.consumer_count; i++) {
+        publish_frame(s_cap_ctx.consumers[i], frame);
+    }
+    os_deadline_record(TASK_CAPTURE, frame->timestamp);
+
+    /* Buffer goes back to the camera here if nobody took it */
+    frame_buffer_release(frame);
+
+    /* After the frame is handed on, host control changes land at the next frame end */
+    uvc_pu_bridge_apply();
+}
+
+/* ========== Main Loop ========== */
+void mainCaptureTask(void *arg)
+{
+    EventBits_t bits;
+    QueueHandle_t raw_queue;
+
+    ESP_LOGI(CAM_TAG, "Capture task started on core %d", xPortGetCoreID());
+
+    raw_queue = os_getQueueHandler(QUEUE_RAW_FRAME);
+    if (!raw_queue) {
+        ESP_LOGE(CAM_TAG, "Failed to get raw frame queue");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(CAM_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        xEventGroupClearBits(g_app_ctx.system_events, EVENT_CAPTURE_IDLE);
+
+        /* Camera buffers are requested again at stream start, which restarts the sequence */
+        s_cap_ctx.sequence_valid = false;
+        pace_start();
+#if CONFIG_EXAMPLE_TNR
+        uvc_tnr_start();
+#endif
+
+        /* DQBUF returns within CAPTURE_DQBUF_TIMEOUT_MS, so a halt request is seen quickly */
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            capture_one_frame(raw_queue);
+        }
+
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_CAPTURE_IDLE);
+    }
+
+exit:
+    ESP_LOGI(CAM_TAG, "Capture task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terCaptureTask(void *arg)
+{
+    ESP_LOGI(CAM_TAG, "Terminating capture task...");
+    ESP_LOGI(CAM_TAG, "Capture task terminated, captured %lu frames", s_cap_ctx.captured_count);
+}
@@ -0,0 +1,702 @@
+/*
+ * Encode Task
+ *
+ * Responsibilities:
+ * - Receive raw camera frames from QUEUE_RAW_FRAME
+ * - Encode them with the M2M hardware encoder (JPEG or H.264)
+ * - Release camera frames as soon as the encoder is done with them
+ * - Publish encoded frames to QUEUE_ENCODED_FRAME for the UVC callbacks, and to
+ *   every sink registered with uvc_encode_add_sink()
+ *
+ * Encoded frames must fit the fixed UVC transfer buffer. The largest frame of
+ * each window is tracked, and for MJPEG the quality backs off when frames get
+ * close to the buffer size and recovers when there is room again. With a JPEG
+ * target bitrate, the encoder adjusts the quality of every frame instead. The
+ * quality governor caps that quality while the stream is overloaded.
+ *
+ * The encoder owns a ring of ENCODED_FRAME_COUNT capture buffers. Each one is
+ * described by a refcounted frame_buffer_t that cycles encode task ->
+ * QUEUE_ENCODED_FRAME and sink queues -> UVC and sinks -> QUEUE_ENCODED_FREE, so
+ * the encoder never waits for the host to return a buffer as long as one
+ * descriptor is free. A frame is encoded once and every consumer reads the same
+ * buffer, it goes back to the free pool when the last one releases it. Only this
+ * task issues ioctls on the encoder capture stream.
+ *
+ * A live sink with a full queue loses its oldest frame, a blocking sink makes the
+ * encoder wait for room. UVC is never behind either of them, its queue holds
+ * every descriptor.
+ *
+ * With static scene detection, a grid of luma samples of every camera frame is
+ * compared with the last encoded one. Unchanged frames are not encoded, MJPEG
+ * streams get the last encoded frame again, H.264 streams just skip the frame.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uvc_app_common.h"
+#include "uvc_latency.h"
+#include "os_interface.h"
+#include "uvc_watchdog.h"
+#include "uvc_qos.h"
+#include "trace.h"
+#include "linux/videodev2.h"
+
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+#include "camera_debug.h"
+#endif
+
+/* Encoded frames per size tracking window */
+#define ENC_SIZE_WINDOW         300
+
+/* JPEG quality adaptation, in percent of the UVC transfer buffer */
+#if CONFIG_FORMAT_MJPEG_CAM1 && !CONFIG_EXAMPLE_JPEG_TARGET_KBPS
+#define ENC_QUALITY_ADAPT       1
+#endif
+#define ENC_SIZE_HIGH_PERCENT   90
+#define ENC_SIZE_LOW_PERCENT    50
+#define ENC_QUALITY_STEP        5
+#define ENC_QUALITY_MIN         30
+
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+/* Static scene detection sample grid */
+#define SCENE_GRID              16
+#define SCENE_SAMPLES           (SCENE_GRID * SCENE_GRID)
+#define SCENE_RUN               4       /* Adjacent pixels averaged per sample */
+#endif
+
+/* Encoded frame consumer besides UVC */
+typedef struct {
+    QueueHandle_t queue;
+    sink_policy_t policy;
+    TickType_t timeout;         /* Longest wait for room of a blocking sink */
+    uint32_t dropped;
+} encode_sink_t;
+
+/* Task context */
+typedef struct {
+    uint32_t encoded_count;
+    uint32_t window_count;
+    uint32_t window_peak;
+#if ENC_QUALITY_ADAPT
+    int quality;
+    int quality_cap;            /* Highest quality the governor allows */
+#endif
+    frame_buffer_t frames[ENCODED_FRAME_COUNT];   /* One descriptor per encoder capture buffer */
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+    uint8_t scene[SCENE_SAMPLES];           /* Samples of the last published frame */
+    uint8_t scene_pending[SCENE_SAMPLES];   /* Samples of the frame being encoded */
+    bool scene_valid;
+    bool scene_pending_valid;
+    uint32_t scene_skipped;                 /* Consecutive frames not encoded */
+    frame_buffer_t *last_out;               /* Last published frame, its data is intact until it is encoded into again */
+#endif
+    encode_sink_t sinks[ENCODED_SINK_MAX];  /* Sinks may register before the init phase runs */
+    uint32_t sink_count;
+} encode_task_ctx_t;
+
+static encode_task_ctx_t s_enc_ctx = {0};
+
+/* ========== Init Phase ========== */
+void initEncodeTask(void *arg)
+{
+    ESP_LOGI(ENC_TAG, "Initializing encode task...");
+
+    memset(&s_enc_ctx, 0, offsetof(encode_task_ctx_t, sinks));
+    for (int i = 0; i < ENCODED_FRAME_COUNT; i++) {
+        s_enc_ctx.frames[i].format = g_app_ctx.uvc->format;
+        s_enc_ctx.frames[i].camera_buf_index = -1;
+        s_enc_ctx.frames[i].enc_buf_index = i;
+    }
+
+#if ENC_QUALITY_ADAPT
+    s_enc_ctx.quality = CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY;
+    s_enc_ctx.quality_cap = CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY;
+#endif
+
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_ENCODE_IDLE);
+
+    ESP_LOGI(ENC_TAG, "Encode task initialized, %d encoder output buffers", ENCODED_FRAME_COUNT);
+}
+
+/* Register a queue which receives every encoded frame alongside UVC */
+esp_err_t uvc_encode_add_sink(QueueHandle_t queue, sink_policy_t policy, uint32_t timeout_ms)
+{
+    encode_sink_t *sink;
+
+    APP_RETURN_ON_FALSE(queue, ESP_ERR_INVALID_ARG, ENC_TAG, "Invalid sink queue");
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, ENC_TAG,
+                        "Stop streaming before adding a sink");
+    APP_RETURN_ON_FALSE(s_enc_ctx.sink_count < ENCODED_SINK_MAX, ESP_ERR_NO_MEM, ENC_TAG,
+                        "Too many encoded frame sinks");
+
+    sink = &s_enc_ctx.sinks[s_enc_ctx.sink_count];
+    sink->queue = queue;
+    sink->policy = policy;
+    sink->timeout = pdMS_TO_TICKS(timeout_ms);
+    sink->dropped = 0;
+    s_enc_ctx.sink_count++;
+
+    return ESP_OK;
+}
+
+/* Release the frames still queued to sinks, called once the encode stage is idle */
+void uvc_encode_drain_sinks(void)
+{
+    frame_buffer_t *frame;
+
+    for (int i = 0; i < s_enc_ctx.sink_count; i++) {
+        while (xQueueReceive(s_enc_ctx.sinks[i].queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+}
+
+/* Encoder buffer operations of one frame, done by a single VIDIOC_BATCH_BUF call */
+enum {
+    ENC_OP_QUEUE_OUT,
+    ENC_OP_QUEUE_IN,
+    ENC_OP_DEQUEUE_OUT,
+    ENC_OP_DEQUEUE_IN,
+    ENC_OP_COUNT
+};
+
+static const char *s_enc_op_names[ENC_OP_COUNT] = {
+    [ENC_OP_QUEUE_OUT]   = "queue encoder output buffer",
+    [ENC_OP_QUEUE_IN]    = "queue encoder input",
+    [ENC_OP_DEQUEUE_OUT] = "dequeue encoder output",
+    [ENC_OP_DEQUEUE_IN]  = "dequeue encoder input",
+};
+
+/* Encode one raw frame into the encoder buffer described by 'out' */
+static esp_err_t encode_one_frame(frame_buffer_t *raw, frame_buffer_t *out)
+{
+    struct esp_video_buffer_batch_op ops[ENC_OP_COUNT];
+    struct esp_video_buffer_batch batch;
+    struct v4l2_buffer *enc_in_buf, *enc_out_buf;
+    int64_t queue_time;
+    esp_err_t ret;
+
+    memset(ops, 0, sizeof(ops));
+
+    /* Hand the free capture buffer to the encoder */
+    enc_out_buf = &ops[ENC_OP_QUEUE_OUT].buf;
+    ops[ENC_OP_QUEUE_OUT].cmd = VIDIOC_QBUF;
+    enc_out_buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    enc_out_buf->memory = V4L2_MEMORY_MMAP;
+    enc_out_buf->index = out->enc_buf_index;
+
+    /* Queue camera frame to encoder INPUT */
+    enc_in_buf = &ops[ENC_OP_QUEUE_IN].buf;
+    ops[ENC_OP_QUEUE_IN].cmd = VIDIOC_QBUF;
+    enc_in_buf->type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    enc_in_buf->memory = V4L2_MEMORY_DMABUF;
+    enc_in_buf->index = 0;
+    enc_in_buf->m.fd = g_app_ctx.uvc->cap_dmabuf[raw->camera_buf_index];
+    enc_in_buf->length = raw->size;
+    enc_in_buf->timestamp.tv_sec = raw->timestamp / 1000000;
+    enc_in_buf->timestamp.tv_usec = raw->timestamp % 1000000;
+
+    /* Dequeue encoded frame from encoder OUTPUT (this triggers encoding), then the input */
+    ops[ENC_OP_DEQUEUE_OUT].cmd = VIDIOC_DQBUF;
+    ops[ENC_OP_DEQUEUE_OUT].buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ops[ENC_OP_DEQUEUE_OUT].buf.memory = V4L2_MEMORY_MMAP;
+    ops[ENC_OP_DEQUEUE_IN].cmd = VIDIOC_DQBUF;
+    ops[ENC_OP_DEQUEUE_IN].buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    ops[ENC_OP_DEQUEUE_IN].buf.memory = V4L2_MEMORY_DMABUF;
+
+    batch.count = ENC_OP_COUNT;
+    batch.done = 0;
+    batch.ops = ops;
+
+    queue_time = esp_timer_get_time();
+    uvc_latency_record(LAT_STAGE_QUEUE, raw->dequeue_time, queue_time);
+    ret = esp_video_direct_batch_buf(g_app_ctx.uvc->m2m_dev, &batch);
+    TRACE_END(TRACE_ENC, queue_time, batch.done > ENC_OP_DEQUEUE_OUT ? ops[ENC_OP_DEQUEUE_OUT].buf.bytesused : 0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(ENC_TAG, "Failed to %s (%s)", s_enc_op_names[MIN(batch.done, ENC_OP_COUNT - 1)],
+                 esp_err_to_name(ret));
+    }
+    if (batch.done <= ENC_OP_DEQUEUE_OUT) {
+        frame_buffer_release(raw);
+        return ESP_FAIL;
+    }
+    /* A failed input dequeue is not critical, encoder output is already available */
+
+    out->dequeue_time = esp_timer_get_time();
+    uvc_latency_record(LAT_STAGE_ENCODE, queue_time, out->dequeue_time);
+    uvc_qos_record(UVC_QOS_ENCODE, queue_time, out->dequeue_time);
+    os_deadline_record(TASK_ENCODE, raw->dequeue_time);
+
+    /* Encoder is done reading the camera buffer, let the camera refill it */
+    enc_out_buf = &ops[ENC_OP_DEQUEUE_OUT].buf;
+    out->timestamp = (int64_t)enc_out_buf->timestamp.tv_sec * 1000000 + enc_out_buf->timestamp.tv_usec;
+    if (!out->timestamp) {
+        out->timestamp = raw->timestamp;
+    }
+    out->frame_number = raw->frame_number;
+    frame_buffer_release(raw);
+
+    if (enc_out_buf->index != out->enc_buf_index) {
+        ESP_LOGW(ENC_TAG, "Encoder returned buffer %lu, expected %d",
+                 enc_out_buf->index, out->enc_buf_index);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if ((enc_out_buf->flags & V4L2_BUF_FLAG_ERROR) || !enc_out_buf->bytesused) {
+        return ESP_FAIL;
+    }
+
+    out->data = g_app_ctx.uvc->m2m_cap_buffer[out->enc_buf_index];
+    out->capacity = g_app_ctx.uvc->m2m_cap_buffer_len;
+    out->size = enc_out_buf->bytesused;
+    out->flags = enc_out_buf->flags & (V4L2_BUF_FLAG_KEYFRAME | V4L2_BUF_FLAG_PFRAME | V4L2_BUF_FLAG_BFRAME);
+
+    return ESP_OK;
+}
+
+#if ENC_QUALITY_ADAPT
+static void set_jpeg_quality(int quality)
+{
+    struct v4l2_ext_controls controls;
+    struct v4l2_ext_control control[1];
+
+    quality = MAX(MIN(quality, s_enc_ctx.quality_cap), ENC_QUALITY_MIN);
+    if (quality == s_enc_ctx.quality) {
+        return;
+    }
+
+    controls.ctrl_class = V4L2_CID_JPEG_CLASS;
+    controls.count      = 1;
+    controls.controls   = control;
+    control[0].id       = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    control[0].value    = quality;
+    if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
+        ESP_LOGW(ENC_TAG, "Failed to set JPEG quality %d", quality);
+        return;
+    }
+
+    ESP_LOGI(ENC_TAG, "JPEG quality %d -> %d", s_enc_ctx.quality, quality);
+    s_enc_ctx.quality = quality;
+}
+
+/* A new governor rung moves the quality by as much as the cap moved, the size adaptation keeps its offset */
+static void follow_quality_cap(void)
+{
+    int cap = CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY * (int)uvc_qos_scale() / 100;
+    int moved = cap - s_enc_ctx.quality_cap;
+
+    if (!moved) {
+        return;
+    }
+    s_enc_ctx.quality_cap = cap;
+    set_jpeg_quality(s_enc_ctx.quality + moved);
+}
+#endif
+
+/* Track encoded sizes against the UVC transfer buffer, returns false if the frame doesn't fit */
+static bool check_encoded_size(const frame_buffer_t *out)
+{
+    uint32_t capacity = g_app_ctx.uvc->uvc_buffer_size;
+    bool fits = !capacity || out->size <= capacity;
+
+    s_enc_ctx.window_peak = MAX(s_enc_ctx.window_peak, out->size);
+    s_enc_ctx.window_count++;
+
+    if (!fits) {
+        g_app_ctx.frames_oversize++;
+        ESP_LOGW(ENC_TAG, "Frame %lu is %u bytes, UVC buffer is %lu", out->frame_number, out->size, capacity);
+#if ENC_QUALITY_ADAPT
+        set_jpeg_quality(s_enc_ctx.quality - ENC_QUALITY_STEP);
+#endif
+    }
+
+    if (s_enc_ctx.window_count >= ENC_SIZE_WINDOW) {
+        g_app_ctx.uvc->enc_peak_size = s_enc_ctx.window_peak;
+#if ENC_QUALITY_ADAPT
+        if (capacity) {
+            if (s_enc_ctx.window_peak > capacity / 100 * ENC_SIZE_HIGH_PERCENT) {
+                set_jpeg_quality(s_enc_ctx.quality - ENC_QUALITY_STEP);
+            } else if (s_enc_ctx.window_peak < capacity / 100 * ENC_SIZE_LOW_PERCENT) {
+                set_jpeg_quality(s_enc_ctx.quality + ENC_QUALITY_STEP);
+            }
+        }
+#endif
+        s_enc_ctx.window_peak = 0;
+        s_enc_ctx.window_count = 0;
+    }
+
+    return fits;
+}
+
+/* An encoded frame didn't reach the host */
+static void drop_encoded_frame(void)
+{
+    g_app_ctx.frames_dropped++;
+#if CONFIG_FORMAT_H264_CAM1
+    /* Following P frames reference the lost one, restart the GOP so the host resyncs */
+    uvc_app_h264_request_keyframe();
+#endif
+}
+
+static void sink_dropped(encode_sink_t *sink)
+{
+    sink->dropped++;
+    g_app_ctx.frames_sink_dropped++;
+#if CONFIG_FORMAT_H264_CAM1
+    /* The sink lost a reference frame, restart the GOP so it resyncs */
+    uvc_app_h264_request_keyframe();
+#endif
+}
+
+/* Hand one more reference of the frame to a sink, its policy decides what a full queue loses */
+static void publish_sink(encode_sink_t *sink, frame_buffer_t *frame)
+{
+    frame_buffer_t *oldest;
+    TickType_t timeout = sink->policy == SINK_POLICY_BLOCK ? sink->timeout : 0;
+
+    frame_buffer_ref(frame);
+    if (xQueueSend(sink->queue, &frame, timeout) == pdTRUE) {
+        return;
+    }
+
+    /* Only this task sends, once the oldest frame is gone there is room */
+    if (sink->policy == SINK_POLICY_DROP_OLDEST) {
+        if (xQueueReceive(sink->queue, &oldest, 0) == pdTRUE) {
+            frame_buffer_release(oldest);
+            sink_dropped(sink);
+        }
+        if (xQueueSend(sink->queue, &frame, 0) == pdTRUE) {
+            return;
+        }
+    }
+
+    frame_buffer_release(frame);
+    sink_dropped(sink);
+}
+
+/* Hand the encoded frame to UVC and every sink, each of them holds its own reference */
+static bool publish_encoded(frame_buffer_t *out, QueueHandle_t enc_queue)
+{
+    bool published;
+
+    /* Own a reference while publishing, so no consumer can recycle the buffer early */
+    frame_buffer_ref(out);
+
+    frame_buffer_ref(out);
+    published = xQueueSend(enc_queue, &out, 0) == pdTRUE;
+    if (!published) {
+        frame_buffer_release(out);
+    }
+    for (int i = 0; i < s_enc_ctx.sink_count; i++) {
+        publish_sink(&s_enc_ctx.sinks[i], out);
+    }
+
+    frame_buffer_release(out);
+
+    return published;
+}
+
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+/* Bytes per pixel and luma byte offset in the first plane, RGB formats use green */
+static bool scene_luma_layout(uint32_t fmt, uint32_t *bpp, uint32_t *offset)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YUV422P:
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_GREY:
+        *bpp = 1;
+        *offset = 0;
+        return true;
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_RGB565:
+        *bpp = 2;
+        *offset = 0;
+        return true;
+    case V4L2_PIX_FMT_RGB24:
+        *bpp = 3;
+        *offset = 1;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint32_t scene_pixel(const uint8_t *p, uint32_t fmt)
+{
+    if (fmt == V4L2_PIX_FMT_RGB565) {
+        return ((p[0] | (p[1] << 8)) >> 3) & 0xfc;
+    }
+
+    return p[0];
+}
+
+/* Sample the luma grid of a camera frame, only the sampled lines are read from memory */
+static bool scene_sample_grid(const frame_buffer_t *raw, uint8_t *grid)
+{
+    uint32_t width = g_app_ctx.stream_width;
+    uint32_t height = g_app_ctx.stream_height;
+    uint32_t fmt = g_app_ctx.uvc->cap_caps.capture_fmt;
+    uint32_t bpp, offset, stride;
+    struct esp_video_buffer_sync sync;
+
+    if (!scene_luma_layout(fmt, &bpp, &offset) || width < SCENE_GRID * SCENE_RUN || height < SCENE_GRID) {
+        return false;
+    }
+    stride = width * bpp;
+    if (stride * height > raw->size) {
+        return false;
+    }
+
+    for (int gy = 0; gy < SCENE_GRID; gy++) {
+        uint32_t line = (2 * gy + 1) * height / (2 * SCENE_GRID);
+        const uint8_t *row = raw->data + line * stride + offset;
+
+        /* Camera DMA wrote the buffer behind the CPU cache */
+        memset(&sync, 0, sizeof(sync));
+        sync.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        sync.index = raw->camera_buf_index;
+        sync.offset = line * stride;
+        sync.size = stride;
+        sync.flags = ESP_VIDEO_BUFFER_SYNC_CPU_READ;
+        if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_SYNC_BUF, &sync) != 0) {
+            return false;
+        }
+
+        for (int gx = 0; gx < SCENE_GRID; gx++) {
+            uint32_t x = (2 * gx + 1) * width / (2 * SCENE_GRID) - SCENE_RUN / 2;
+            uint32_t sum = 0;
+
+            for (int i = 0; i < SCENE_RUN; i++) {
+                sum += scene_pixel(row + (x + i) * bpp, fmt);
+            }
+            grid[gy * SCENE_GRID + gx] = sum / SCENE_RUN;
+        }
+    }
+
+    return true;
+}
+
+/* Mean absolute sample difference against the last published frame */
+static uint32_t scene_difference(const uint8_t *grid)
+{
+    uint32_t sad = 0;
+
+    for (int i = 0; i < SCENE_SAMPLES; i++) {
+        sad += abs((int)grid[i] - (int)s_enc_ctx.scene[i]);
+    }
+
+    return sad / SCENE_SAMPLES;
+}
+
+/* The encoded frame reached the UVC queue, it is the reference for the following frames */
+static void scene_commit(frame_buffer_t *out)
+{
+    memcpy(s_enc_ctx.scene, s_enc_ctx.scene_pending, sizeof(s_enc_ctx.scene));
+    s_enc_ctx.scene_valid = s_enc_ctx.scene_pending_valid;
+    s_enc_ctx.scene_skipped = 0;
+    s_enc_ctx.last_out = out;
+}
+
+#if CONFIG_FORMAT_MJPEG_CAM1
+/* Publish a copy of the last encoded frame for a camera frame which wasn't encoded */
+static void resend_last_frame(const frame_buffer_t *raw, QueueHandle_t enc_queue, QueueHandle_t free_queue)
+{
+    frame_buffer_t *last = s_enc_ctx.last_out;
+    frame_buffer_t *out;
+    struct esp_video_buffer_sync sync;
+
+    if (!last || xQueueReceive(free_queue, &out, 0) != pdTRUE) {
+        return;
+    }
+
+    /* Only this task writes encoder buffers, so the last frame can't change under the copy */
+    if (out != last) {
+        out->data = g_app_ctx.uvc->m2m_cap_buffer[out->enc_buf_index];
+        out->capacity = g_app_ctx.uvc->m2m_cap_buffer_len;
+        out->size = last->size;
+        memcpy(out->data, last->data, last->size);
+
+        /* Written back before the encoder gets the buffer again */
+        memset(&sync, 0, sizeof(sync));
+        sync.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        sync.index = out->enc_buf_index;
+        sync.offset = 0;
+        sync.size = last->size;
+        sync.flags = ESP_VIDEO_BUFFER_SYNC_CPU_WRITE;
+        if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_SYNC_BUF, &sync) != 0) {
+            ESP_LOGW(ENC_TAG, "Failed to sync encoder buffer %d (errno=%d)", out->enc_buf_index, errno);
+            xQueueSend(free_queue, &out, 0);
+            return;
+        }
+    }
+
+    out->timestamp = raw->timestamp;
+    out->dequeue_time = esp_timer_get_time();
+    out->frame_number = raw->frame_number;
+    out->flags = last->flags;
+
+    if (!publish_encoded(out, enc_queue)) {
+        return;
+    }
+    s_enc_ctx.last_out = out;
+}
+#endif
+
+/* Handle a camera frame of an unchanged scene without encoding it, returns false if it must be encoded */
+static bool skip_static_frame(frame_buffer_t *raw, QueueHandle_t enc_queue, QueueHandle_t free_queue)
+{
+    s_enc_ctx.scene_pending_valid = scene_sample_grid(raw, s_enc_ctx.scene_pending);
+
+    /* Encode now and then anyway, so slow changes and encoder setting updates reach the host */
+    if (!s_enc_ctx.scene_pending_valid || !s_enc_ctx.scene_valid ||
+            s_enc_ctx.scene_skipped >= CONFIG_EXAMPLE_STATIC_SCENE_MAX_SKIP ||
+            scene_difference(s_enc_ctx.scene_pending) >= CONFIG_EXAMPLE_STATIC_SCENE_THRESHOLD) {
+        return false;
+    }
+
+    s_enc_ctx.scene_skipped++;
+    g_app_ctx.frames_static++;
+
+#if CONFIG_FORMAT_MJPEG_CAM1
+    /* JPEG frames stand alone, H.264 P frames can't be repeated and the host just sees a longer frame */
+    resend_last_frame(raw, enc_queue, free_queue);
+#endif
+    frame_buffer_release(raw);
+
+    return true;
+}
+#endif
+
+/* ========== Main Loop ========== */
+void mainEncodeTask(void *arg)
+{
+    EventBits_t bits;
+    frame_buffer_t *raw;
+    frame_buffer_t *out;
+    QueueHandle_t raw_queue;
+    QueueHandle_t enc_queue;
+    QueueHandle_t free_queue;
+
+    ESP_LOGI(ENC_TAG, "Encode task started on core %d", xPortGetCoreID());
+
+    raw_queue = os_getQueueHandler(QUEUE_RAW_FRAME);
+    enc_queue = os_getQueueHandler(QUEUE_ENCODED_FRAME);
+    free_queue = os_getQueueHandler(QUEUE_ENCODED_FREE);
+    if (!raw_queue || !enc_queue || !free_queue) {
+        ESP_LOGE(ENC_TAG, "Failed to get frame queues");
+        goto exit;
+    }
+
+    /* Queues exist only after all init phases ran, so fill the free pool here */
+    for (int i = 0; i < ENCODED_FRAME_COUNT; i++) {
+        frame_buffer_t *frame = &s_enc_ctx.frames[i];
+        frame->pool = free_queue;
+        xQueueSend(free_queue, &frame, 0);
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(ENC_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        xEventGroupClearBits(g_app_ctx.system_events, EVENT_ENCODE_IDLE);
+
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+        /* Encoder buffers are requested again at stream start */
+        s_enc_ctx.scene_valid = false;
+        s_enc_ctx.last_out = NULL;
+#endif
+
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            if (xQueueReceive(raw_queue, &raw, pdMS_TO_TICKS(100)) != pdTRUE) {
+                continue;
+            }
+            uvc_watchdog_feed(UVC_STAGE_ENCODE);
+
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+            if (skip_static_frame(raw, enc_queue, free_queue)) {
+                continue;
+            }
+#endif
+
+            /* No free output frame means the host is behind - drop this capture */
+            if (xQueueReceive(free_queue, &out, 0) != pdTRUE) {
+                g_app_ctx.frames_dropped++;
+                frame_buffer_release(raw);
+                continue;
+            }
+
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+            /* Its data is about to be overwritten */
+            if (out == s_enc_ctx.last_out) {
+                s_enc_ctx.last_out = NULL;
+            }
+#endif
+
+#if ENC_QUALITY_ADAPT
+            follow_quality_cap();
+#endif
+
+            if (encode_one_frame(raw, out) != ESP_OK) {
+                xQueueSend(free_queue, &out, 0);
+                continue;
+            }
+
+            if (!check_encoded_size(out)) {
+                drop_encoded_frame();
+                xQueueSend(free_queue, &out, 0);
+                continue;
+            }
+
+            g_app_ctx.total_frames_encoded++;
+            s_enc_ctx.encoded_count++;
+
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+            /* Before the hand-off, consumers may return and recycle the buffer right after */
+            camera_debug_process_frame(out->data, out->size, out->timestamp, out->flags);
+#endif
+
+            /* Sinks may still take it, the last release returns it to the free pool */
+            if (!publish_encoded(out, enc_queue)) {
+                drop_encoded_frame();
+                continue;
+            }
+
+#if CONFIG_EXAMPLE_STATIC_SCENE_SKIP
+            scene_commit(out);
+#endif
+        }
+
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_ENCODE_IDLE);
+    }
+
+exit:
+    ESP_LOGI(ENC_TAG, "Encode task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terEncodeTask(void *arg)
+{
+    ESP_LOGI(ENC_TAG, "Terminating encode task...");
+    for (int i = 0; i < s_enc_ctx.sink_count; i++) {
+        ESP_LOGI(ENC_TAG, "Sink %d dropped %lu frames", i, s_enc_ctx.sinks[i].dropped);
+    }
+    ESP_LOGI(ENC_TAG, "Encode task terminated, encoded %lu frames", s_enc_ctx.encoded_count);
+}
@@ -0,0 +1,262 @@
+/*
+ * UVC Frame Sync - Trigger pulse train, sensor slave mode and phase monitor
+ *
+ * The pulse train comes from an MCPWM timer at 1 MHz, set high at the timer
+ * start and low at a comparator, so no CPU sits in the trigger path. The
+ * trigger edge is also timestamped with esp_timer in a GPIO interrupt; its
+ * latency is a few microseconds, well below the sensor line time the phase
+ * monitor has to resolve.
+ *
+ * The frame phase is taken modulo the trigger period, a frame end may come
+ * before or after the edge of the next frame depending on exposure and
+ * readout time, the phase is constant either way.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#if CONFIG_EXAMPLE_FSYNC_MASTER
+#include "driver/mcpwm_prelude.h"
+#endif
+#include "linux/videodev2.h"
+#include "uvc_app_common.h"
+#include "dlog.h"
+#include "uvc_fsync.h"
+
+#define FSYNC_RESOLUTION_HZ     (1000 * 1000)
+#define FSYNC_PULSE_US          100     /* Trigger high time, FSIN takes the rising edge */
+#define FSYNC_PERIOD_MARGIN     500     /* Trigger period 1/500 short of the frame period, see fsync_period_us() */
+#define FSYNC_SETTLE_FRAMES     4       /* Frames after STREAMON before the sensor follows the trigger */
+
+/* Register bits of one sensor setting, written read-modify-write */
+typedef struct {
+    uint16_t addr;
+    uint8_t mask;
+    uint8_t value;
+} fsync_reg_t;
+
+/* OV5647 frame sync slave: FSIN is an input and its edge restarts the vertical timing */
+static const fsync_reg_t s_fsync_slave_regs[] = {
+    { 0x3002, 0x01, 0x00 },     /* SC_CMMN_PAD_OEN2: FSIN pad output off */
+    { 0x3823, 0x40, 0x40 },     /* TIMING_REG23: external VSYNC enable */
+};
+
+/* Frame sync context */
+typedef struct {
+    portMUX_TYPE lock;          // Guards the trigger time and count, taken by the ISR
+    int64_t last_pulse;
+    uint32_t pulses;
+    int64_t period;             // Trigger period in us
+    bool phase_valid;
+    uint32_t settle;            // Frames left before the phase is measured
+    int64_t phase;              // Frame end after the trigger edge, the reference of the slips
+    int32_t jitter;
+    uint32_t frames;
+    uint32_t slipped;
+#if CONFIG_EXAMPLE_FSYNC_MASTER
+    mcpwm_timer_handle_t timer;
+    mcpwm_oper_handle_t oper;
+    mcpwm_cmpr_handle_t cmpr;
+    mcpwm_gen_handle_t gen;
+#endif
+} uvc_fsync_ctx_t;
+
+static const char *TAG = "uvc_fsync";
+
+static uvc_fsync_ctx_t s_fsync = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/*
+ * The trigger comes a little before the sensor would start its next frame on
+ * its own, so the edge always restarts the frame within the vertical blanking
+ * even with the crystals of the two boards apart.
+ */
+static int64_t fsync_period_us(void)
+{
+    int64_t period = FSYNC_RESOLUTION_HZ / CONFIG_EXAMPLE_FSYNC_RATE;
+
+    return period - period / FSYNC_PERIOD_MARGIN;
+}
+
+static void IRAM_ATTR fsync_trigger_isr(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&s_fsync.lock);
+    s_fsync.last_pulse = now;
+    s_fsync.pulses++;
+    portEXIT_CRITICAL_ISR(&s_fsync.lock);
+}
+
+#if CONFIG_EXAMPLE_FSYNC_MASTER
+static esp_err_t fsync_start_pulses(void)
+{
+    mcpwm_timer_config_t timer_config = {
+        .group_id = 0,
+        .clk_src = MCPWM_TIMER_CLK_SRC_DEFAULT,
+        .resolution_hz = FSYNC_RESOLUTION_HZ,
+        .count_mode = MCPWM_TIMER_COUNT_MODE_UP,
+        .period_ticks = (uint32_t)s_fsync.period,
+    };
+    mcpwm_operator_config_t oper_config = {
+        .group_id = 0,
+    };
+    mcpwm_comparator_config_t cmpr_config = {
+        .flags.update_cmp_on_tez = true,
+    };
+    mcpwm_generator_config_t gen_config = {
+        .gen_gpio_num = CONFIG_EXAMPLE_FSYNC_GPIO,
+    };
+
+    APP_RETURN_ON_ERROR(mcpwm_new_timer(&timer_config, &s_fsync.timer), TAG, "Failed to create the trigger timer");
+    APP_RETURN_ON_ERROR(mcpwm_new_operator(&oper_config, &s_fsync.oper), TAG, "Failed to create the operator");
+    APP_RETURN_ON_ERROR(mcpwm_operator_connect_timer(s_fsync.oper, s_fsync.timer), TAG, "Failed to connect the timer");
+    APP_RETURN_ON_ERROR(mcpwm_new_comparator(s_fsync.oper, &cmpr_config, &s_fsync.cmpr), TAG,
+                        "Failed to create the comparator");
+    APP_RETURN_ON_ERROR(mcpwm_comparator_set_compare_value(s_fsync.cmpr, FSYNC_PULSE_US), TAG,
+                        "Failed to set the pulse width");
+    APP_RETURN_ON_ERROR(mcpwm_new_generator(s_fsync.oper, &gen_config, &s_fsync.gen), TAG,
+                        "Failed to create the generator");
+    APP_RETURN_ON_ERROR(mcpwm_generator_set_action_on_timer_event(s_fsync.gen,
+                        MCPWM_GEN_TIMER_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, MCPWM_TIMER_EVENT_EMPTY,
+                                                     MCPWM_GEN_ACTION_HIGH)), TAG, "Failed to set the rising edge");
+    APP_RETURN_ON_ERROR(mcpwm_generator_set_action_on_compare_event(s_fsync.gen,
+                        MCPWM_GEN_COMPARE_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, s_fsync.cmpr,
+                                                       MCPWM_GEN_ACTION_LOW)), TAG, "Failed to set the falling edge");
+
+    /* The generator took the pin over, keep its input so the master's interrupt sees its own edges */
+    APP_RETURN_ON_ERROR(gpio_input_enable(CONFIG_EXAMPLE_FSYNC_GPIO), TAG, "Failed to loop the trigger back");
+    APP_RETURN_ON_ERROR(mcpwm_timer_enable(s_fsync.timer), TAG, "Failed to enable the trigger timer");
+
+    return mcpwm_timer_start_stop(s_fsync.timer, MCPWM_TIMER_START_NO_STOP);
+}
+#endif
+
+esp_err_t uvc_fsync_init(void)
+{
+    esp_err_t ret;
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << CONFIG_EXAMPLE_FSYNC_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_POSEDGE,
+    };
+
+    s_fsync.period = fsync_period_us();
+
+    APP_RETURN_ON_ERROR(gpio_config(&io_conf), TAG, "Failed to configure the trigger GPIO");
+
+    /* The service may be installed by another driver already */
+    ret = gpio_install_isr_service(0);
+    APP_RETURN_ON_FALSE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE, ret, TAG, "Failed to install GPIO ISR service");
+    APP_RETURN_ON_ERROR(gpio_isr_handler_add(CONFIG_EXAMPLE_FSYNC_GPIO, fsync_trigger_isr, NULL), TAG,
+                        "Failed to add the trigger interrupt");
+
+#if CONFIG_EXAMPLE_FSYNC_MASTER
+    APP_RETURN_ON_ERROR(fsync_start_pulses(), TAG, "Failed to start the trigger");
+    ESP_LOGI(TAG, "Driving the trigger on GPIO%d, period %lld us", CONFIG_EXAMPLE_FSYNC_GPIO, s_fsync.period);
+#else
+    ESP_LOGI(TAG, "Following the trigger on GPIO%d, period %lld us", CONFIG_EXAMPLE_FSYNC_GPIO, s_fsync.period);
+#endif
+
+    return ESP_OK;
+}
+
+static esp_err_t fsync_update_register(int fd, const fsync_reg_t *setting)
+{
+    struct v4l2_dbg_register reg = {
+        .match.type = V4L2_CHIP_MATCH_SUBDEV,
+        .match.addr = 0,
+        .size = 1,
+        .reg = setting->addr,
+    };
+
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_DBG_G_REGISTER, &reg) == 0, ESP_FAIL, TAG,
+                        "Failed to read sensor register 0x%04x", setting->addr);
+    reg.val = (reg.val & ~(uint64_t)setting->mask) | (setting->value & setting->mask);
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_DBG_S_REGISTER, &reg) == 0, ESP_FAIL, TAG,
+                        "Failed to write sensor register 0x%04x", setting->addr);
+
+    return ESP_OK;
+}
+
+esp_err_t uvc_fsync_arm(int rate)
+{
+    if (rate != CONFIG_EXAMPLE_FSYNC_RATE) {
+        ESP_LOGW(TAG, "Session at %d fps, the trigger runs at %d fps", rate, CONFIG_EXAMPLE_FSYNC_RATE);
+    }
+
+    /* A sensor format change pushes the whole register table, so this runs at every stream start */
+    for (size_t i = 0; i < sizeof(s_fsync_slave_regs) / sizeof(s_fsync_slave_regs[0]); i++) {
+        APP_RETURN_ON_ERROR(fsync_update_register(g_app_ctx.uvc->cap_fd, &s_fsync_slave_regs[i]), TAG,
+                            "Failed to enable frame sync slave mode");
+    }
+
+    s_fsync.phase_valid = false;
+    s_fsync.settle = FSYNC_SETTLE_FRAMES;
+
+    return ESP_OK;
+}
+
+void uvc_fsync_frame(int64_t timestamp_us)
+{
+    int64_t pulse;
+    int64_t phase;
+    int64_t deviation;
+
+    portENTER_CRITICAL(&s_fsync.lock);
+    pulse = s_fsync.last_pulse;
+    portEXIT_CRITICAL(&s_fsync.lock);
+
+    if (!pulse) {
+        return;
+    }
+    if (s_fsync.settle) {
+        s_fsync.settle--;
+        return;
+    }
+
+    phase = ((timestamp_us - pulse) % s_fsync.period + s_fsync.period) % s_fsync.period;
+    if (!s_fsync.phase_valid) {
+        s_fsync.phase = phase;
+        s_fsync.phase_valid = true;
+        return;
+    }
+
+    /* Shortest way around the period */
+    deviation = phase - s_fsync.phase;
+    if (deviation >= s_fsync.period / 2) {
+        deviation -= s_fsync.period;
+    } else if (deviation < -s_fsync.period / 2) {
+        deviation += s_fsync.period;
+    }
+
+    s_fsync.frames++;
+    if (llabs(deviation) > s_fsync.jitter) {
+        s_fsync.jitter = llabs(deviation);
+    }
+    if (llabs(deviation) > CONFIG_EXAMPLE_FSYNC_TOLERANCE_US) {
+        s_fsync.slipped++;
+        s_fsync.phase = phase;
+        DLOGW(TAG, "Frame %lld us off the trigger phase", deviation);
+    }
+}
+
+void uvc_fsync_get_stats(uvc_fsync_stats_t *ret_stats)
+{
+    portENTER_CRITICAL(&s_fsync.lock);
+    ret_stats->pulses = s_fsync.pulses;
+    portEXIT_CRITICAL(&s_fsync.lock);
+
+    ret_stats->frames = s_fsync.frames;
+    ret_stats->slipped = s_fsync.slipped;
+    ret_stats->phase_us = s_fsync.phase_valid ? (int32_t)s_fsync.phase : 0;
+    ret_stats->jitter_us = s_fsync.jitter;
+    s_fsync.jitter = 0;
+}
@@ -0,0 +1,410 @@
+/*
+ * Inference Task
+ *
+ * Responsibilities:
+ * - Receive captured frames as a capture consumer (QUEUE_INFER_RAW)
+ * - Crop, scale and color convert the camera buffer with one PPA transaction
+ *   into a letterboxed RGB888 tensor in internal RAM, then release the buffer
+ * - Quantize the tensor to int8 in place and hand it to the model callback
+ *
+ * The scale is a multiple of 1/16, the PPA step. It is the smallest step at
+ * which the frame covers the tensor in one direction, the other direction is
+ * padded and the frame is center cropped by what the step overshoots. The
+ * padding is quantized once per session, the PPA only writes the frame area
+ * and only that area is quantized per frame. Frames captured while the model
+ * runs are dropped by the capture fan-out, the queue holds one.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_cache.h"
+#include "driver/ppa.h"
+#include "linux/videodev2.h"
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "uvc_infer.h"
+#include "os_interface.h"
+
+#define INF_TAG                 "infer"
+
+#define INFER_WIDTH             CONFIG_EXAMPLE_INFER_WIDTH
+#define INFER_HEIGHT            CONFIG_EXAMPLE_INFER_HEIGHT
+#define INFER_CHANNELS          3
+#define INFER_PAD_VALUE         114     /* Pixel value of the padding, the usual letterbox grey */
+
+_Static_assert(INFER_WIDTH % 4 == 0, "Tensor rows must be whole words for the quantization pass");
+
+/* Task context */
+typedef struct {
+    uvc_infer_cb_t cb;
+    void *cb_ctx;
+    uint8_t lut[INFER_CHANNELS][256];           /* Quantized value of every pixel value, int8 bit patterns */
+    bool lut_set;
+
+    ppa_client_handle_t ppa;
+    ppa_srm_color_mode_t in_cm;
+    uint8_t *tensor;
+    size_t tensor_size;                         /* Rounded up to the cache line, as the PPA writes whole lines */
+    uvc_infer_tensor_t geometry;
+    bool session_ok;                            /* The session format can be converted */
+
+    portMUX_TYPE lock;                          /* Guards the statistics, which uvc_infer_get_stats() reads */
+    uint32_t tensors;
+    uint32_t frames_dropped;
+    uint64_t prep_us_total;
+    uint64_t infer_us_total;
+} infer_task_ctx_t;
+
+static infer_task_ctx_t s_inf_ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static void infer_build_lut(const float mean[3], const float std[3], int exponent)
+{
+    float scale = ldexpf(1.0f, -exponent);
+
+    for (int c = 0; c < INFER_CHANNELS; c++) {
+        for (int v = 0; v < 256; v++) {
+            long q = lroundf((v - mean[c]) / std[c] * scale);
+
+            s_inf_ctx.lut[c][v] = (uint8_t)(int8_t)MIN(MAX(q, -128), 127);
+        }
+    }
+}
+
+esp_err_t uvc_infer_set_callback(uvc_infer_cb_t cb, void *ctx)
+{
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, INF_TAG,
+                        "Stop streaming before setting the inference callback");
+
+    s_inf_ctx.cb = cb;
+    s_inf_ctx.cb_ctx = ctx;
+
+    return ESP_OK;
+}
+
+esp_err_t uvc_infer_set_quant(const float mean[3], const float std[3], int exponent)
+{
+    APP_RETURN_ON_FALSE(mean && std, ESP_ERR_INVALID_ARG, INF_TAG, "Invalid quantization");
+    APP_RETURN_ON_FALSE(std[0] != 0.0f && std[1] != 0.0f && std[2] != 0.0f, ESP_ERR_INVALID_ARG, INF_TAG,
+                        "Quantization std can't be 0");
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, INF_TAG,
+                        "Stop streaming before setting the quantization");
+
+    /* The padding is quantized again at the next session start */
+    infer_build_lut(mean, std, exponent);
+    s_inf_ctx.lut_set = true;
+
+    return ESP_OK;
+}
+
+void uvc_infer_get_stats(uvc_infer_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_inf_ctx.lock);
+    stats->tensors = s_inf_ctx.tensors;
+    stats->frames_dropped = s_inf_ctx.frames_dropped;
+    stats->prep_us = s_inf_ctx.tensors ? s_inf_ctx.prep_us_total / s_inf_ctx.tensors : 0;
+    stats->infer_us = s_inf_ctx.tensors ? s_inf_ctx.infer_us_total / s_inf_ctx.tensors : 0;
+    portEXIT_CRITICAL(&s_inf_ctx.lock);
+}
+
+/* ========== Quantization ========== */
+
+/*
+ * Quantize a row of RGB888 pixels in place, row must be word aligned.
+ *
+ * Four pixels are three words, R G B R / G B R G / B R G B, so every byte of a
+ * word has a fixed channel. One load and one store per four channel values.
+ */
+static void infer_quantize_row(uint8_t *row, uint32_t pixels)
+{
+    const uint8_t *c0 = s_inf_ctx.lut[0];
+    const uint8_t *c1 = s_inf_ctx.lut[1];
+    const uint8_t *c2 = s_inf_ctx.lut[2];
+    uint32_t *w = (uint32_t *)row;
+    uint32_t n = pixels / 4;
+
+    for (uint32_t i = 0; i < n; i++, w += 3) {
+        uint32_t w0 = w[0];
+        uint32_t w1 = w[1];
+        uint32_t w2 = w[2];
+
+        w[0] = c0[w0 & 0xff] | (c1[(w0 >> 8) & 0xff] << 8) |
+               (c2[(w0 >> 16) & 0xff] << 16) | ((uint32_t)c0[w0 >> 24] << 24);
+        w[1] = c1[w1 & 0xff] | (c2[(w1 >> 8) & 0xff] << 8) |
+               (c0[(w1 >> 16) & 0xff] << 16) | ((uint32_t)c1[w1 >> 24] << 24);
+        w[2] = c2[w2 & 0xff] | (c0[(w2 >> 8) & 0xff] << 8) |
+               (c1[(w2 >> 16) & 0xff] << 16) | ((uint32_t)c2[w2 >> 24] << 24);
+    }
+
+    for (uint8_t *p = (uint8_t *)w; p < row + pixels * INFER_CHANNELS; p += INFER_CHANNELS) {
+        p[0] = c0[p[0]];
+        p[1] = c1[p[1]];
+        p[2] = c2[p[2]];
+    }
+}
+
+/* ========== Session Setup ========== */
+
+/* Letterbox geometry of the session frame, false if the PPA can't read the camera format */
+static bool infer_setup(void)
+{
+    uvc_infer_tensor_t *g = &s_inf_ctx.geometry;
+    uint32_t width = g_app_ctx.stream_width;
+    uint32_t height = g_app_ctx.stream_height;
+    uint32_t k;
+    uint32_t out_w;
+    uint32_t out_h;
+
+    switch (g_app_ctx.uvc->cap_caps.capture_fmt) {
+    case V4L2_PIX_FMT_RGB565:
+        s_inf_ctx.in_cm = PPA_SRM_COLOR_MODE_RGB565;
+        break;
+    case V4L2_PIX_FMT_RGB24:
+        s_inf_ctx.in_cm = PPA_SRM_COLOR_MODE_RGB888;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        s_inf_ctx.in_cm = PPA_SRM_COLOR_MODE_YUV420;
+        break;
+    default:
+        ESP_LOGW(INF_TAG, "The PPA can't read the camera format, no tensors this session");
+        return false;
+    }
+
+    /* Smallest 1/16 step at which the frame covers the tensor width or height, at most 16x */
+    k = MIN((INFER_WIDTH * 16 + width - 1) / width, (INFER_HEIGHT * 16 + height - 1) / height);
+    k = MIN(MAX(k, 1), 256);
+
+    /* The PPA truncates the scaled size, YUV 4:2:0 blocks start and end on even pixels */
+    g->crop_width = MIN(width, INFER_WIDTH * 16 / k) & ~1;
+    g->crop_height = MIN(height, INFER_HEIGHT * 16 / k) & ~1;
+    g->crop_x = ((width - g->crop_width) / 2) & ~1;
+    g->crop_y = ((height - g->crop_height) / 2) & ~1;
+    out_w = g->crop_width * k / 16;
+    out_h = g->crop_height * k / 16;
+    if (!out_w || !out_h) {
+        ESP_LOGW(INF_TAG, "%dx%d doesn't scale into the tensor", g_app_ctx.stream_width, g_app_ctx.stream_height);
+        return false;
+    }
+
+    /* Frame rows start on a word for the quantization pass */
+    g->pad_x = ((INFER_WIDTH - out_w) / 2) & ~3;
+    g->pad_y = (INFER_HEIGHT - out_h) / 2;
+    g->scale_16 = k;
+    g->width = INFER_WIDTH;
+    g->height = INFER_HEIGHT;
+    g->data = (const int8_t *)s_inf_ctx.tensor;
+
+    /* Padding is never written by the PPA, quantize it once */
+    for (uint8_t *p = s_inf_ctx.tensor; p < s_inf_ctx.tensor + INFER_WIDTH * INFER_HEIGHT * INFER_CHANNELS;
+            p += INFER_CHANNELS) {
+        p[0] = s_inf_ctx.lut[0][INFER_PAD_VALUE];
+        p[1] = s_inf_ctx.lut[1][INFER_PAD_VALUE];
+        p[2] = s_inf_ctx.lut[2][INFER_PAD_VALUE];
+    }
+
+    ESP_LOGI(INF_TAG, "%dx%d+%d+%d of %lux%lu scaled %lu/16 to %lux%lu+%d+%d of the %dx%d tensor",
+             g->crop_width, g->crop_height, g->crop_x, g->crop_y, width, height, k,
+             out_w, out_h, g->pad_x, g->pad_y, INFER_WIDTH, INFER_HEIGHT);
+
+    return true;
+}
+
+/* ========== Frame Processing ========== */
+
+/* Convert one frame and run the callback on it, the frame is always released */
+static void infer_process_frame(frame_buffer_t *frame)
+{
+    uvc_infer_tensor_t tensor = s_inf_ctx.geometry;
+    uint32_t out_w = tensor.crop_width * tensor.scale_16 / 16;
+    uint32_t out_h = tensor.crop_height * tensor.scale_16 / 16;
+    int64_t start = esp_timer_get_time();
+    int64_t prep;
+    ppa_srm_oper_config_t config = {
+        .in = {
+            .buffer = frame->data,
+            .pic_w = g_app_ctx.stream_width,
+            .pic_h = g_app_ctx.stream_height,
+            .block_w = tensor.crop_width,
+            .block_h = tensor.crop_height,
+            .block_offset_x = tensor.crop_x,
+            .block_offset_y = tensor.crop_y,
+            .srm_cm = s_inf_ctx.in_cm,
+        },
+        .out = {
+            .buffer = s_inf_ctx.tensor,
+            .buffer_size = s_inf_ctx.tensor_size,
+            .pic_w = INFER_WIDTH,
+            .pic_h = INFER_HEIGHT,
+            .block_offset_x = tensor.pad_x,
+            .block_offset_y = tensor.pad_y,
+            .srm_cm = PPA_SRM_COLOR_MODE_RGB888,
+        },
+        .rotation_angle = PPA_SRM_ROTATION_ANGLE_0,
+        .scale_x = tensor.scale_16 / 16.0f,
+        .scale_y = tensor.scale_16 / 16.0f,
+#if CONFIG_EXAMPLE_INFER_BGR
+        .rgb_swap = true,
+#endif
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+    esp_err_t ret;
+
+    tensor.frame_number = frame->frame_number;
+    tensor.timestamp = frame->timestamp;
+
+    ret = ppa_do_scale_rotate_mirror(s_inf_ctx.ppa, &config);
+    frame_buffer_release(frame);
+    if (ret != ESP_OK) {
+        ESP_LOGW(INF_TAG, "Failed to convert frame %lu: %s", tensor.frame_number, esp_err_to_name(ret));
+        portENTER_CRITICAL(&s_inf_ctx.lock);
+        s_inf_ctx.frames_dropped++;
+        portEXIT_CRITICAL(&s_inf_ctx.lock);
+        return;
+    }
+
+    for (uint32_t y = tensor.pad_y; y < tensor.pad_y + out_h; y++) {
+        infer_quantize_row(s_inf_ctx.tensor + (y * INFER_WIDTH + tensor.pad_x) * INFER_CHANNELS, out_w);
+    }
+
+    prep = esp_timer_get_time();
+    if (s_inf_ctx.cb) {
+        s_inf_ctx.cb(&tensor, s_inf_ctx.cb_ctx);
+    }
+
+    portENTER_CRITICAL(&s_inf_ctx.lock);
+    s_inf_ctx.tensors++;
+    s_inf_ctx.prep_us_total += prep - start;
+    s_inf_ctx.infer_us_total += esp_timer_get_time() - prep;
+    portEXIT_CRITICAL(&s_inf_ctx.lock);
+}
+
+/* ========== Init Phase ========== */
+void initInferTask(void *arg)
+{
+    static const float mean[INFER_CHANNELS] = {128.0f, 128.0f, 128.0f};
+    static const float std[INFER_CHANNELS] = {1.0f, 1.0f, 1.0f};
+    ppa_client_config_t ppa_config = {
+        .oper_type = PPA_OPERATION_SRM,
+    };
+    size_t align = 1;
+
+    ESP_LOGI(INF_TAG, "Initializing inference task...");
+
+    /* uvc_infer_set_quant() may be called before the init phase */
+    if (!s_inf_ctx.lut_set) {
+        infer_build_lut(mean, std, 0);
+    }
+
+    esp_cache_get_alignment(MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA, &align);
+    align = MAX(align, 4);
+    s_inf_ctx.tensor_size = (INFER_WIDTH * INFER_HEIGHT * INFER_CHANNELS + align - 1) & ~(align - 1);
+    s_inf_ctx.tensor = memstat_aligned_calloc(MEMSTAT_PROC, align, 1, s_inf_ctx.tensor_size,
+                                              MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    if (!s_inf_ctx.tensor) {
+        /* The quantization pass and the model run slower on PSRAM, but still run */
+        esp_cache_get_alignment(MALLOC_CAP_SPIRAM, &align);
+        align = MAX(align, 4);
+        s_inf_ctx.tensor_size = (INFER_WIDTH * INFER_HEIGHT * INFER_CHANNELS + align - 1) & ~(align - 1);
+        s_inf_ctx.tensor = memstat_aligned_calloc(MEMSTAT_PROC, align, 1, s_inf_ctx.tensor_size,
+                                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        ESP_LOGW(INF_TAG, "No internal RAM for the %dx%d tensor, using PSRAM", INFER_WIDTH, INFER_HEIGHT);
+    }
+    if (!s_inf_ctx.tensor) {
+        ESP_LOGE(INF_TAG, "Failed to allocate the %dx%d tensor", INFER_WIDTH, INFER_HEIGHT);
+    }
+
+    if (ppa_register_client(&ppa_config, &s_inf_ctx.ppa) != ESP_OK) {
+        ESP_LOGE(INF_TAG, "Failed to register PPA client");
+        s_inf_ctx.ppa = NULL;
+    }
+
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_INFER_IDLE);
+
+    ESP_LOGI(INF_TAG, "Inference task initialized");
+}
+
+/* ========== Main Loop ========== */
+void mainInferTask(void *arg)
+{
+    EventBits_t bits;
+    frame_buffer_t *frame;
+    QueueHandle_t raw_queue;
+
+    ESP_LOGI(INF_TAG, "Inference task started on core %d", xPortGetCoreID());
+
+    if (!s_inf_ctx.tensor || !s_inf_ctx.ppa) {
+        ESP_LOGE(INF_TAG, "Tensor or PPA missing, no tensors are prepared");
+        goto exit;
+    }
+
+    raw_queue = os_getQueueHandler(QUEUE_INFER_RAW);
+    if (!raw_queue || uvc_capture_add_consumer(raw_queue) != ESP_OK) {
+        ESP_LOGE(INF_TAG, "Failed to register inference raw frame queue");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(INF_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        s_inf_ctx.session_ok = infer_setup();
+
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            if (xQueueReceive(raw_queue, &frame, pdMS_TO_TICKS(100)) != pdTRUE) {
+                continue;
+            }
+
+            /* Only the PPA read holds the camera buffer, the model may outlast a pipeline halt */
+            xEventGroupClearBits(g_app_ctx.system_events, EVENT_INFER_IDLE);
+            if (s_inf_ctx.session_ok) {
+                infer_process_frame(frame);
+            } else {
+                frame_buffer_release(frame);
+            }
+            xEventGroupSetBits(g_app_ctx.system_events, EVENT_INFER_IDLE);
+        }
+
+        /* Captured frames still queued hold camera buffers, give them back before waiting */
+        while (xQueueReceive(raw_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+    }
+
+exit:
+    ESP_LOGI(INF_TAG, "Inference task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terInferTask(void *arg)
+{
+    uvc_infer_stats_t stats;
+
+    ESP_LOGI(INF_TAG, "Terminating inference task...");
+
+    uvc_infer_get_stats(&stats);
+    if (s_inf_ctx.ppa) {
+        ppa_unregister_client(s_inf_ctx.ppa);
+        s_inf_ctx.ppa = NULL;
+    }
+    memstat_free(MEMSTAT_PROC, s_inf_ctx.tensor);
+    s_inf_ctx.tensor = NULL;
+
+    ESP_LOGI(INF_TAG, "Inference task terminated, %lu tensors, %lu dropped, %lu us preprocessing, %lu us inference",
+             stats.tensors, stats.frames_dropped, stats.prep_us, stats.infer_us);
+}
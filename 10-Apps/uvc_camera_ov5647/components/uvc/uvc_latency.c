@@ -0,0 +1,145 @@
+/*
+ * UVC Latency - Per-stage pipeline latency histograms
+ *
+ * Each core owns its own histogram set, so recording never contends across
+ * cores and only needs a relaxed atomic increment against preemption on the
+ * same core. Readers merge the per-core sets.
+ *
+ * Buckets are log-linear with 4 buckets per power of two microseconds, the
+ * last bucket also counts everything above its range.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "uvc_latency.h"
+
+#define LAT_SUB_BITS        2
+#define LAT_SUB_COUNT       (1 << LAT_SUB_BITS)
+#define LAT_BUCKET_COUNT    64      /* Covers up to 131 ms */
+
+typedef struct {
+    uint32_t buckets[LAT_STAGE_MAX][LAT_BUCKET_COUNT];
+} uvc_latency_hist_t;
+
+static uvc_latency_hist_t s_lat_hist[portNUM_PROCESSORS];
+
+static const char *s_stage_names[LAT_STAGE_MAX] = {
+    [LAT_STAGE_DQBUF]  = "dqbuf",
+    [LAT_STAGE_QUEUE]  = "queue",
+    [LAT_STAGE_ENCODE] = "encode",
+    [LAT_STAGE_USB]    = "usb",
+    [LAT_STAGE_TOTAL]  = "total",
+};
+
+static uint32_t latency_to_bucket(uint32_t us)
+{
+    uint32_t msb;
+    uint32_t bucket;
+
+    if (us < LAT_SUB_COUNT) {
+        return us;
+    }
+
+    msb = 31 - __builtin_clz(us);
+    bucket = (msb - LAT_SUB_BITS + 1) * LAT_SUB_COUNT + ((us >> (msb - LAT_SUB_BITS)) & (LAT_SUB_COUNT - 1));
+
+    return bucket < LAT_BUCKET_COUNT ? bucket : LAT_BUCKET_COUNT - 1;
+}
+
+/* Exclusive upper bound of a bucket in us */
+static uint32_t bucket_to_latency(uint32_t bucket)
+{
+    uint32_t shift;
+
+    if (bucket < LAT_SUB_COUNT) {
+        return bucket + 1;
+    }
+
+    shift = bucket / LAT_SUB_COUNT - 1;
+    return ((LAT_SUB_COUNT + bucket % LAT_SUB_COUNT) << shift) + (1 << shift);
+}
+
+void uvc_latency_record(uvc_latency_stage_t stage, int64_t start_us, int64_t end_us)
+{
+    int64_t delta = end_us - start_us;
+    uint32_t bucket;
+
+    if (stage >= LAT_STAGE_MAX || !start_us || delta < 0) {
+        return;
+    }
+
+    bucket = latency_to_bucket(delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta);
+    __atomic_fetch_add(&s_lat_hist[esp_cpu_get_core_id()].buckets[stage][bucket], 1, __ATOMIC_RELAXED);
+}
+
+void uvc_latency_get(uvc_latency_stage_t stage, uvc_latency_summary_t *summary)
+{
+    uint32_t merged[LAT_BUCKET_COUNT];
+    uint32_t count = 0;
+    uint32_t seen = 0;
+
+    memset(summary, 0, sizeof(*summary));
+    if (stage >= LAT_STAGE_MAX) {
+        return;
+    }
+
+    for (int b = 0; b < LAT_BUCKET_COUNT; b++) {
+        merged[b] = 0;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            merged[b] += __atomic_load_n(&s_lat_hist[core].buckets[stage][b], __ATOMIC_RELAXED);
+        }
+        count += merged[b];
+    }
+
+    summary->count = count;
+    if (!count) {
+        return;
+    }
+
+    for (int b = 0; b < LAT_BUCKET_COUNT; b++) {
+        if (!merged[b]) {
+            continue;
+        }
+
+        seen += merged[b];
+        if (!summary->p50_us && seen * 100ULL >= count * 50ULL) {
+            summary->p50_us = bucket_to_latency(b);
+        }
+        if (!summary->p95_us && seen * 100ULL >= count * 95ULL) {
+            summary->p95_us = bucket_to_latency(b);
+        }
+        if (!summary->p99_us && seen * 100ULL >= count * 99ULL) {
+            summary->p99_us = bucket_to_latency(b);
+        }
+        summary->max_us = bucket_to_latency(b);
+    }
+}
+
+void uvc_latency_dump(const char *tag)
+{
+    uvc_latency_summary_t summary;
+
+    for (int stage = 0; stage < LAT_STAGE_MAX; stage++) {
+        uvc_latency_get(stage, &summary);
+        if (!summary.count) {
+            continue;
+        }
+        ESP_LOGI(tag, "Latency %-6s: p50 %5lu us  p95 %5lu us  p99 %5lu us  max %5lu us  (%lu frames)",
+                 s_stage_names[stage], summary.p50_us, summary.p95_us, summary.p99_us,
+                 summary.max_us, summary.count);
+    }
+}
+
+/* Increments racing with the reset may survive it, which is fine for statistics */
+void uvc_latency_reset(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        for (int stage = 0; stage < LAT_STAGE_MAX; stage++) {
+            for (int b = 0; b < LAT_BUCKET_COUNT; b++) {
+                __atomic_store_n(&s_lat_hist[core].buckets[stage][b], 0, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
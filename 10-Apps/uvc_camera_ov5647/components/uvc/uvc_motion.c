@@ -0,0 +1,600 @@
+/*
+ * Motion Task
+ *
+ * Responsibilities:
+ * - Receive captured frames as a capture consumer (QUEUE_MOTION_RAW), at most
+ *   one every CONFIG_EXAMPLE_MOTION_PERIOD_MS
+ * - Compare the AE block grid of the frame metadata, or the luma plane the PPA
+ *   downscales from the camera buffer, with a running background model
+ * - Post SYS_EVENT_MOTION when motion starts, every MOTION_UPDATE_MS while it
+ *   lasts and once it ended CONFIG_EXAMPLE_MOTION_HOLD_MS ago
+ *
+ * The background is kept in 8.8 fixed point and follows the scene by 1/16 of
+ * the difference per analysed frame, moving blocks 8 times slower so a moving
+ * object isn't learned as background. The mean difference of the frame is
+ * taken out before blocks are compared, so exposure changes don't count as
+ * motion. The AE path costs 25 blocks per frame. The luma path costs one PPA
+ * transaction and a pass over a plane 1/64 of the frame with the default
+ * downscale factor, the camera buffer is released right after the PPA read it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "linux/videodev2.h"
+#include "esp_video_ioctl.h"
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "uvc_motion.h"
+#include "os_interface.h"
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+#include "esp_cache.h"
+#include "driver/ppa.h"
+#endif
+
+#define MOT_TAG                 "motion"
+
+#define MOTION_BG_SHIFT         4       /* Background learns 1/16 of the difference per analysed frame */
+#define MOTION_BG_SHIFT_MOVING  7       /* Moving blocks are learned 8 times slower */
+#define MOTION_UPDATE_MS        500     /* Shortest interval between events while the motion lasts */
+
+#define MOTION_AE_W             ESP_VIDEO_FRAME_META_AE_GRID_W
+#define MOTION_AE_H             ESP_VIDEO_FRAME_META_AE_GRID_H
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+#define MOTION_LUMA_BLOCK       8       /* Block edge in pixels of the luma plane */
+#define MOTION_LUMA_SCALE       CONFIG_EXAMPLE_MOTION_LUMA_SCALE
+_Static_assert(16 % MOTION_LUMA_SCALE == 0, "The PPA scales in steps of 1/16");
+#endif
+
+/* Moving blocks, in block coordinates, x1 and y1 exclusive */
+typedef struct {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    int count;
+} motion_box_t;
+
+/* Task context */
+typedef struct {
+    uvc_motion_cb_t cb;
+    void *cb_ctx;
+
+    portMUX_TYPE lock;                          /* Guards state, which uvc_motion_get_state() reads */
+    uvc_motion_event_t state;
+    bool state_valid;
+
+    uint32_t analysed;
+    uint32_t events;
+    int64_t last_run;
+    int64_t last_motion;
+    int64_t last_post;
+
+    int32_t ae_bg[MOTION_AE_H][MOTION_AE_W];    /* 8.8 fixed point */
+    uint8_t ae_moving[MOTION_AE_H][MOTION_AE_W];
+    uint32_t ae_seq;
+    bool ae_primed;
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+    ppa_client_handle_t ppa;
+    ppa_srm_color_mode_t luma_in_cm;
+    uint8_t *plane;                             /* PPA output, YUV 4:2:0 "U Y Y / V Y Y" */
+    size_t plane_size;
+    uint16_t *luma_bg;                          /* 8.8 fixed point, one per plane pixel */
+    uint8_t *luma_moving;                       /* One per block */
+    uint32_t luma_w;
+    uint32_t luma_h;
+    uint32_t luma_off_x;                        /* Input block offset, the plane covers the centered block */
+    uint32_t luma_off_y;
+    bool luma_ok;                               /* The session format can be downscaled */
+    bool luma_primed;
+#endif
+} motion_task_ctx_t;
+
+static motion_task_ctx_t s_mot_ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+esp_err_t uvc_motion_set_callback(uvc_motion_cb_t cb, void *ctx)
+{
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, MOT_TAG,
+                        "Stop streaming before setting the motion callback");
+
+    s_mot_ctx.cb = cb;
+    s_mot_ctx.cb_ctx = ctx;
+
+    return ESP_OK;
+}
+
+bool uvc_motion_get_state(uvc_motion_event_t *state)
+{
+    bool valid;
+
+    portENTER_CRITICAL(&s_mot_ctx.lock);
+    valid = s_mot_ctx.state_valid;
+    *state = s_mot_ctx.state;
+    portEXIT_CRITICAL(&s_mot_ctx.lock);
+
+    return valid;
+}
+
+void uvc_motion_dispatch(const uvc_motion_event_t *event)
+{
+    ESP_LOGI(MOT_TAG, "Motion %s: %ux%u at %u,%u, %u blocks (%s)", event->active ? "active" : "ended",
+             event->width, event->height, event->x, event->y, event->blocks,
+             event->source == MOTION_SOURCE_LUMA ? "luma" : "AE");
+
+    if (s_mot_ctx.cb) {
+        s_mot_ctx.cb(event, s_mot_ctx.cb_ctx);
+    }
+}
+
+static void motion_box_add(motion_box_t *box, int x, int y)
+{
+    if (!box->count) {
+        box->x0 = x;
+        box->y0 = y;
+        box->x1 = x + 1;
+        box->y1 = y + 1;
+    } else {
+        box->x0 = MIN(box->x0, x);
+        box->y0 = MIN(box->y0, y);
+        box->x1 = MAX(box->x1, x + 1);
+        box->y1 = MAX(box->y1, y + 1);
+    }
+    box->count++;
+}
+
+/* ========== AE Grid ========== */
+
+/* Returns false if the frame carries no new AE grid */
+static bool motion_detect_ae(const frame_buffer_t *frame, motion_box_t *box)
+{
+    int32_t diff[MOTION_AE_H][MOTION_AE_W];
+    int32_t mean = 0;
+    struct esp_video_frame_meta meta = {
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .index = frame->camera_buf_index,
+    };
+
+    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_G_FRAME_META, &meta) != 0 ||
+            !(meta.flags & ESP_VIDEO_FRAME_META_AE_GRID)) {
+        return false;
+    }
+    if (s_mot_ctx.ae_primed && meta.ae_seq == s_mot_ctx.ae_seq) {
+        return false;
+    }
+    s_mot_ctx.ae_seq = meta.ae_seq;
+
+    if (!s_mot_ctx.ae_primed) {
+        for (int y = 0; y < MOTION_AE_H; y++) {
+            for (int x = 0; x < MOTION_AE_W; x++) {
+                s_mot_ctx.ae_bg[y][x] = meta.ae_luma[y][x] << 8;
+            }
+        }
+        memset(s_mot_ctx.ae_moving, 0, sizeof(s_mot_ctx.ae_moving));
+        s_mot_ctx.ae_primed = true;
+        return true;
+    }
+
+    for (int y = 0; y < MOTION_AE_H; y++) {
+        for (int x = 0; x < MOTION_AE_W; x++) {
+            diff[y][x] = (meta.ae_luma[y][x] << 8) - s_mot_ctx.ae_bg[y][x];
+            mean += diff[y][x];
+        }
+    }
+    mean /= MOTION_AE_W * MOTION_AE_H;
+
+    for (int y = 0; y < MOTION_AE_H; y++) {
+        for (int x = 0; x < MOTION_AE_W; x++) {
+            bool moving = abs(diff[y][x] - mean) >= (CONFIG_EXAMPLE_MOTION_AE_THRESHOLD << 8);
+
+            if (moving) {
+                motion_box_add(box, x, y);
+            }
+            s_mot_ctx.ae_bg[y][x] += diff[y][x] >> (moving ? MOTION_BG_SHIFT_MOVING : MOTION_BG_SHIFT);
+            s_mot_ctx.ae_moving[y][x] = moving;
+        }
+    }
+
+    return true;
+}
+
+/* The AE windows cover 20% to 80% of the frame in each direction */
+static void motion_ae_box_to_frame(const motion_box_t *box, uvc_motion_event_t *event)
+{
+    uint32_t width = g_app_ctx.stream_width;
+    uint32_t height = g_app_ctx.stream_height;
+
+    event->x = width / 5 + box->x0 * width * 3 / (5 * MOTION_AE_W);
+    event->y = height / 5 + box->y0 * height * 3 / (5 * MOTION_AE_H);
+    event->width = (box->x1 - box->x0) * width * 3 / (5 * MOTION_AE_W);
+    event->height = (box->y1 - box->y0) * height * 3 / (5 * MOTION_AE_H);
+}
+
+/* ========== Luma Plane ========== */
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+static void motion_luma_free(void)
+{
+    memstat_free(MEMSTAT_PROC, s_mot_ctx.plane);
+    memstat_free(MEMSTAT_PROC, s_mot_ctx.luma_bg);
+    memstat_free(MEMSTAT_PROC, s_mot_ctx.luma_moving);
+    s_mot_ctx.plane = NULL;
+    s_mot_ctx.luma_bg = NULL;
+    s_mot_ctx.luma_moving = NULL;
+    s_mot_ctx.luma_w = 0;
+    s_mot_ctx.luma_h = 0;
+}
+
+/* Size the plane for the session frame, only formats the PPA reads are downscaled */
+static void motion_luma_setup(void)
+{
+    uint32_t width = g_app_ctx.stream_width;
+    uint32_t height = g_app_ctx.stream_height;
+    uint32_t luma_w = (width / MOTION_LUMA_SCALE) & ~1;    /* YUV 4:2:0 needs even sizes */
+    uint32_t luma_h = (height / MOTION_LUMA_SCALE) & ~1;
+    size_t align = 1;
+
+    s_mot_ctx.luma_ok = false;
+    s_mot_ctx.luma_primed = false;
+
+    switch (g_app_ctx.uvc->cap_caps.capture_fmt) {
+    case V4L2_PIX_FMT_RGB565:
+        s_mot_ctx.luma_in_cm = PPA_SRM_COLOR_MODE_RGB565;
+        break;
+    case V4L2_PIX_FMT_RGB24:
+        s_mot_ctx.luma_in_cm = PPA_SRM_COLOR_MODE_RGB888;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        s_mot_ctx.luma_in_cm = PPA_SRM_COLOR_MODE_YUV420;
+        break;
+    default:
+        ESP_LOGW(MOT_TAG, "The PPA can't read the camera format, using the AE grid only");
+        return;
+    }
+
+    if (luma_w < MOTION_LUMA_BLOCK || luma_h < MOTION_LUMA_BLOCK) {
+        ESP_LOGW(MOT_TAG, "%dx%d is too small for the luma plane", g_app_ctx.stream_width, g_app_ctx.stream_height);
+        return;
+    }
+
+    if (luma_w != s_mot_ctx.luma_w || luma_h != s_mot_ctx.luma_h) {
+        uint32_t blocks = (luma_w / MOTION_LUMA_BLOCK) * (luma_h / MOTION_LUMA_BLOCK);
+
+        motion_luma_free();
+
+        /* The PPA writes whole cache lines of the plane, the driver invalidates them when it is done */
+        esp_cache_get_alignment(MALLOC_CAP_SPIRAM, &align);
+        align = MAX(align, 4);
+        s_mot_ctx.plane_size = (luma_w * luma_h * 3 / 2 + align - 1) & ~(align - 1);
+        s_mot_ctx.plane = memstat_aligned_calloc(MEMSTAT_PROC, align, 1, s_mot_ctx.plane_size,
+                                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        s_mot_ctx.luma_bg = memstat_calloc(MEMSTAT_PROC, luma_w * luma_h, sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        s_mot_ctx.luma_moving = memstat_calloc(MEMSTAT_PROC, blocks, 1, MALLOC_CAP_8BIT);
+        if (!s_mot_ctx.plane || !s_mot_ctx.luma_bg || !s_mot_ctx.luma_moving) {
+            ESP_LOGE(MOT_TAG, "No memory for the %lux%lu luma plane", luma_w, luma_h);
+            motion_luma_free();
+            return;
+        }
+        s_mot_ctx.luma_w = luma_w;
+        s_mot_ctx.luma_h = luma_h;
+    }
+
+    s_mot_ctx.luma_off_x = (width - luma_w * MOTION_LUMA_SCALE) / 2;
+    s_mot_ctx.luma_off_y = (height - luma_h * MOTION_LUMA_SCALE) / 2;
+    s_mot_ctx.luma_ok = true;
+    ESP_LOGI(MOT_TAG, "Luma plane %lux%lu, %lux%lu blocks", luma_w, luma_h,
+             luma_w / MOTION_LUMA_BLOCK, luma_h / MOTION_LUMA_BLOCK);
+}
+
+/* Downscale the camera buffer into the plane, the buffer may be released once it returns */
+static bool motion_luma_downscale(const frame_buffer_t *frame)
+{
+    ppa_srm_oper_config_t config = {
+        .in = {
+            .buffer = frame->data,
+            .pic_w = g_app_ctx.stream_width,
+            .pic_h = g_app_ctx.stream_height,
+            .block_w = s_mot_ctx.luma_w * MOTION_LUMA_SCALE,
+            .block_h = s_mot_ctx.luma_h * MOTION_LUMA_SCALE,
+            .block_offset_x = s_mot_ctx.luma_off_x,
+            .block_offset_y = s_mot_ctx.luma_off_y,
+            .srm_cm = s_mot_ctx.luma_in_cm,
+        },
+        .out = {
+            .buffer = s_mot_ctx.plane,
+            .buffer_size = s_mot_ctx.plane_size,
+            .pic_w = s_mot_ctx.luma_w,
+            .pic_h = s_mot_ctx.luma_h,
+            .srm_cm = PPA_SRM_COLOR_MODE_YUV420,
+        },
+        .rotation_angle = PPA_SRM_ROTATION_ANGLE_0,
+        .scale_x = 1.0f / MOTION_LUMA_SCALE,
+        .scale_y = 1.0f / MOTION_LUMA_SCALE,
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    if (ppa_do_scale_rotate_mirror(s_mot_ctx.ppa, &config) != ESP_OK) {
+        ESP_LOGW(MOT_TAG, "Failed to downscale frame %lu", frame->frame_number);
+        return false;
+    }
+
+    return true;
+}
+
+/* Luma of a plane pixel, two luma samples follow every chroma sample */
+static inline uint32_t motion_luma_at(const uint8_t *line, uint32_t x)
+{
+    return line[x / 2 * 3 + 1 + (x & 1)];
+}
+
+static void motion_detect_luma(motion_box_t *box)
+{
+    uint32_t w = s_mot_ctx.luma_w;
+    uint32_t bw = w / MOTION_LUMA_BLOCK;
+    uint32_t bh = s_mot_ctx.luma_h / MOTION_LUMA_BLOCK;
+    uint32_t stride = w * 3 / 2;
+    uint16_t *bg = s_mot_ctx.luma_bg;
+    int64_t sum = 0;
+    int32_t mean;
+
+    if (!s_mot_ctx.luma_primed) {
+        for (uint32_t y = 0; y < s_mot_ctx.luma_h; y++) {
+            for (uint32_t x = 0; x < w; x++) {
+                bg[y * w + x] = motion_luma_at(s_mot_ctx.plane + y * stride, x) << 8;
+            }
+        }
+        memset(s_mot_ctx.luma_moving, 0, bw * bh);
+        s_mot_ctx.luma_primed = true;
+        return;
+    }
+
+    /* Mean difference of the blocked area, the exposure part of every block */
+    for (uint32_t y = 0; y < bh * MOTION_LUMA_BLOCK; y++) {
+        const uint8_t *line = s_mot_ctx.plane + y * stride;
+
+        for (uint32_t x = 0; x < bw * MOTION_LUMA_BLOCK; x++) {
+            sum += (int32_t)(motion_luma_at(line, x) << 8) - bg[y * w + x];
+        }
+    }
+    mean = sum / (bw * bh * MOTION_LUMA_BLOCK * MOTION_LUMA_BLOCK);
+
+    for (uint32_t by = 0; by < bh; by++) {
+        for (uint32_t bx = 0; bx < bw; bx++) {
+            uint8_t *moving = &s_mot_ctx.luma_moving[by * bw + bx];
+            int shift = *moving ? MOTION_BG_SHIFT_MOVING : MOTION_BG_SHIFT;
+            uint32_t sad = 0;
+
+            /* The block is learned at the rate of its last state, then compared */
+            for (uint32_t y = by * MOTION_LUMA_BLOCK; y < (by + 1) * MOTION_LUMA_BLOCK; y++) {
+                const uint8_t *line = s_mot_ctx.plane + y * stride;
+
+                for (uint32_t x = bx * MOTION_LUMA_BLOCK; x < (bx + 1) * MOTION_LUMA_BLOCK; x++) {
+                    int32_t diff = (int32_t)(motion_luma_at(line, x) << 8) - bg[y * w + x];
+
+                    sad += abs(diff - mean);
+                    bg[y * w + x] += diff >> shift;
+                }
+            }
+
+            /* Mean absolute difference of the block, in luma steps */
+            *moving = (sad >> 8) >= CONFIG_EXAMPLE_MOTION_LUMA_THRESHOLD * MOTION_LUMA_BLOCK * MOTION_LUMA_BLOCK;
+            if (*moving) {
+                motion_box_add(box, bx, by);
+            }
+        }
+    }
+}
+
+static void motion_luma_box_to_frame(const motion_box_t *box, uvc_motion_event_t *event)
+{
+    uint32_t edge = MOTION_LUMA_BLOCK * MOTION_LUMA_SCALE;
+
+    event->x = s_mot_ctx.luma_off_x + box->x0 * edge;
+    event->y = s_mot_ctx.luma_off_y + box->y0 * edge;
+    event->width = (box->x1 - box->x0) * edge;
+    event->height = (box->y1 - box->y0) * edge;
+}
+#endif
+
+/* ========== Events ========== */
+
+static void motion_post(const uvc_motion_event_t *event, int64_t now)
+{
+    s_mot_ctx.last_post = now;
+    s_mot_ctx.events++;
+    app_post_event(SYS_EVENT_MOTION, event, sizeof(*event));
+}
+
+static void motion_update(uint32_t frame_number, const motion_box_t *box, uvc_motion_source_t source)
+{
+    int64_t now = esp_timer_get_time();
+    uvc_motion_event_t event = s_mot_ctx.state;
+    bool moving = box->count >= CONFIG_EXAMPLE_MOTION_MIN_BLOCKS;
+    bool was_active = s_mot_ctx.state.active;
+
+    event.frame_number = frame_number;
+    if (moving) {
+        event.active = true;
+        event.blocks = box->count;
+        event.source = source;
+#if CONFIG_EXAMPLE_MOTION_LUMA
+        if (source == MOTION_SOURCE_LUMA) {
+            motion_luma_box_to_frame(box, &event);
+        } else
+#endif
+        {
+            motion_ae_box_to_frame(box, &event);
+        }
+        s_mot_ctx.last_motion = now;
+    } else if (was_active && now - s_mot_ctx.last_motion >= (int64_t)CONFIG_EXAMPLE_MOTION_HOLD_MS * 1000) {
+        /* The end event keeps the last box */
+        event.active = false;
+    }
+
+    portENTER_CRITICAL(&s_mot_ctx.lock);
+    s_mot_ctx.state = event;
+    s_mot_ctx.state_valid = true;
+    portEXIT_CRITICAL(&s_mot_ctx.lock);
+
+    if (event.active != was_active ||
+            (moving && now - s_mot_ctx.last_post >= (int64_t)MOTION_UPDATE_MS * 1000)) {
+        motion_post(&event, now);
+    }
+}
+
+/* Analyse one frame, the frame is always released */
+static void motion_process_frame(frame_buffer_t *frame)
+{
+    motion_box_t box = {0};
+    uvc_motion_source_t source = MOTION_SOURCE_AE;
+    uint32_t frame_number = frame->frame_number;
+    bool analysed;
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+    if (s_mot_ctx.luma_ok) {
+        analysed = motion_luma_downscale(frame);
+        frame_buffer_release(frame);
+        if (analysed) {
+            motion_detect_luma(&box);
+            source = MOTION_SOURCE_LUMA;
+        }
+    } else
+#endif
+    {
+        analysed = motion_detect_ae(frame, &box);
+        frame_buffer_release(frame);
+    }
+
+    if (analysed) {
+        s_mot_ctx.analysed++;
+        motion_update(frame_number, &box, source);
+    }
+}
+
+/* ========== Init Phase ========== */
+void initMotionTask(void *arg)
+{
+    ESP_LOGI(MOT_TAG, "Initializing motion task...");
+
+    /* The callback may be set before the init phase runs */
+    s_mot_ctx.analysed = 0;
+    s_mot_ctx.events = 0;
+    s_mot_ctx.state_valid = false;
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+    ppa_client_config_t ppa_config = {
+        .oper_type = PPA_OPERATION_SRM,
+    };
+
+    if (ppa_register_client(&ppa_config, &s_mot_ctx.ppa) != ESP_OK) {
+        ESP_LOGE(MOT_TAG, "Failed to register PPA client, using the AE grid only");
+        s_mot_ctx.ppa = NULL;
+    }
+#endif
+
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_MOTION_IDLE);
+
+    ESP_LOGI(MOT_TAG, "Motion task initialized");
+}
+
+/* ========== Main Loop ========== */
+void mainMotionTask(void *arg)
+{
+    EventBits_t bits;
+    frame_buffer_t *frame;
+    QueueHandle_t raw_queue;
+
+    ESP_LOGI(MOT_TAG, "Motion task started on core %d", xPortGetCoreID());
+
+    raw_queue = os_getQueueHandler(QUEUE_MOTION_RAW);
+    if (!raw_queue || uvc_capture_add_consumer(raw_queue) != ESP_OK) {
+        ESP_LOGE(MOT_TAG, "Failed to register motion raw frame queue");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(MOT_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        xEventGroupClearBits(g_app_ctx.system_events, EVENT_MOTION_IDLE);
+
+        /* Every session starts with a new background, its frame may have changed */
+        s_mot_ctx.ae_primed = false;
+        s_mot_ctx.last_run = 0;
+        memset(&s_mot_ctx.state, 0, sizeof(s_mot_ctx.state));
+#if CONFIG_EXAMPLE_MOTION_LUMA
+        if (s_mot_ctx.ppa) {
+            motion_luma_setup();
+        }
+#endif
+
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            if (xQueueReceive(raw_queue, &frame, pdMS_TO_TICKS(100)) != pdTRUE) {
+                continue;
+            }
+
+            /* Frames in between are given back at once, they never wait behind the analysis */
+            if (esp_timer_get_time() - s_mot_ctx.last_run < (int64_t)CONFIG_EXAMPLE_MOTION_PERIOD_MS * 1000) {
+                frame_buffer_release(frame);
+                continue;
+            }
+            s_mot_ctx.last_run = esp_timer_get_time();
+
+            motion_process_frame(frame);
+        }
+
+        /* Captured frames still queued hold camera buffers, give them back before going idle */
+        while (xQueueReceive(raw_queue, &frame, 0) == pdTRUE) {
+            frame_buffer_release(frame);
+        }
+
+        if (s_mot_ctx.state.active) {
+            s_mot_ctx.state.active = false;
+            motion_post(&s_mot_ctx.state, esp_timer_get_time());
+        }
+        portENTER_CRITICAL(&s_mot_ctx.lock);
+        s_mot_ctx.state_valid = false;
+        portEXIT_CRITICAL(&s_mot_ctx.lock);
+
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_MOTION_IDLE);
+    }
+
+exit:
+    ESP_LOGI(MOT_TAG, "Motion task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terMotionTask(void *arg)
+{
+    ESP_LOGI(MOT_TAG, "Terminating motion task...");
+
+#if CONFIG_EXAMPLE_MOTION_LUMA
+    motion_luma_free();
+    if (s_mot_ctx.ppa) {
+        ppa_unregister_client(s_mot_ctx.ppa);
+        s_mot_ctx.ppa = NULL;
+    }
+#endif
+
+    ESP_LOGI(MOT_TAG, "Motion task terminated, analysed %lu frames, posted %lu events",
+             s_mot_ctx.analysed, s_mot_ctx.events);
+}
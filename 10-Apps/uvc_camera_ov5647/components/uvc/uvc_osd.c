@@ -0,0 +1,438 @@
+/*
+ * UVC OSD - Timestamp and logo overlay composited into camera frames
+ *
+ * The built-in 5x7 font is scaled into an A8 glyph atlas once at init. The
+ * timestamp masks are assembled from the atlas only when the text changes, once
+ * a second. Every frame then only blends the element rectangles:
+ * - RGB565 and RGB888 frames go through the PPA blend engine, the A8 mask is
+ *   the foreground in the element color and the frame is background and output.
+ * - The YUV layouts of the camera can't be read by the PPA blender, their luma
+ *   samples under the element are blended by the CPU, which for a few small
+ *   rectangles costs less than a PPA transaction.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_cache.h"
+#include "esp_timer.h"
+#include "driver/ppa.h"
+#include "linux/videodev2.h"
+#include "esp_video_ioctl.h"
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "uvc_osd.h"
+
+#define OSD_TAG             "osd"
+
+#define OSD_GLYPH_W         5
+#define OSD_GLYPH_H         7
+#define OSD_SCALE           CONFIG_EXAMPLE_OSD_SCALE
+#define OSD_CELL_W          ((OSD_GLYPH_W + 1) * OSD_SCALE)     /* One column of spacing */
+#define OSD_CELL_H          (OSD_GLYPH_H * OSD_SCALE)
+#define OSD_TEXT_MAX        20                                  /* "YYYY-MM-DD HH:MM:SS" */
+#define OSD_OUTLINE         1                                   /* Outline width around the text */
+#define OSD_TEXT_W          (OSD_TEXT_MAX * OSD_CELL_W + 2 * OSD_OUTLINE)
+#define OSD_TEXT_H          (OSD_CELL_H + 2 * OSD_OUTLINE)
+#define OSD_MARGIN          16
+#define OSD_CLOCK_VALID     1577836800                          /* 2020-01-01, earlier times mean an unset clock */
+
+/* Rows of each glyph, bit 4 is the leftmost column */
+static const char s_osd_charset[] = "0123456789:-. ";
+static const uint8_t s_osd_font[][OSD_GLYPH_H] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00},
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00},
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/* Drawn in this order, the outline goes under the text */
+typedef enum {
+    OSD_ELEMENT_OUTLINE,
+    OSD_ELEMENT_TEXT,
+    OSD_ELEMENT_LOGO,
+    OSD_ELEMENT_COUNT
+} osd_element_id_t;
+
+typedef struct {
+    const uint8_t *alpha;   /* A8 mask, width x height */
+    uint16_t width;
+    uint16_t height;
+    int x;                  /* Negative counts from the right and bottom edges */
+    int y;
+    uint32_t rgb;           /* 0xRRGGBB */
+} osd_element_t;
+
+/* Part of an element inside the frame */
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t mask_x;
+    uint32_t mask_y;
+    uint32_t width;
+    uint32_t height;
+} osd_clip_t;
+
+typedef struct {
+    bool initialized;
+    uint8_t *atlas;                 /* One OSD_CELL_W x OSD_CELL_H cell per charset glyph, side by side */
+    uint8_t *text_mask;
+    uint8_t *outline_mask;
+    int64_t text_second;            /* Second the text masks were assembled for */
+    ppa_client_handle_t ppa;
+    size_t frame_align;             /* Cache line of the camera buffers, the PPA output must be a multiple */
+    portMUX_TYPE lock;              /* Guards elements against uvc_osd_set_logo() */
+    osd_element_t elements[OSD_ELEMENT_COUNT];
+} osd_ctx_t;
+
+static osd_ctx_t s_osd_ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+    .text_second = -1,
+};
+
+/* ========== Masks ========== */
+
+static void osd_render_atlas(void)
+{
+    uint32_t atlas_w = (sizeof(s_osd_charset) - 1) * OSD_CELL_W;
+
+    for (int g = 0; g < sizeof(s_osd_charset) - 1; g++) {
+        for (int y = 0; y < OSD_CELL_H; y++) {
+            uint8_t bits = s_osd_font[g][y / OSD_SCALE];
+            uint8_t *row = s_osd_ctx.atlas + y * atlas_w + g * OSD_CELL_W;
+
+            for (int x = 0; x < OSD_GLYPH_W * OSD_SCALE; x++) {
+                row[x] = (bits & (0x10 >> (x / OSD_SCALE))) ? 0xFF : 0;
+            }
+        }
+    }
+}
+
+#if CONFIG_EXAMPLE_OSD_TIMESTAMP
+/* Copy the glyphs of text out of the atlas and grow them by the outline width, the masks are packed to its width */
+static void osd_render_text(const char *text)
+{
+    uint32_t atlas_w = (sizeof(s_osd_charset) - 1) * OSD_CELL_W;
+    uint8_t *text_mask = s_osd_ctx.text_mask;
+    uint8_t *outline_mask = s_osd_ctx.outline_mask;
+    int len = MIN(strlen(text), OSD_TEXT_MAX);
+    int width = len * OSD_CELL_W + 2 * OSD_OUTLINE;
+
+    memset(text_mask, 0, width * OSD_TEXT_H);
+    for (int i = 0; i < len; i++) {
+        const char *c = strchr(s_osd_charset, text[i]);
+        int g = c ? c - s_osd_charset : sizeof(s_osd_charset) - 2;
+
+        for (int y = 0; y < OSD_CELL_H; y++) {
+            memcpy(text_mask + (y + OSD_OUTLINE) * width + OSD_OUTLINE + i * OSD_CELL_W,
+                   s_osd_ctx.atlas + y * atlas_w + g * OSD_CELL_W, OSD_CELL_W);
+        }
+    }
+
+    for (int y = 0; y < OSD_TEXT_H; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t a = 0;
+
+            for (int dy = -OSD_OUTLINE; dy <= OSD_OUTLINE && !a; dy++) {
+                for (int dx = -OSD_OUTLINE; dx <= OSD_OUTLINE && !a; dx++) {
+                    int sx = x + dx;
+                    int sy = y + dy;
+
+                    if (sx >= 0 && sx < width && sy >= 0 && sy < OSD_TEXT_H) {
+                        a = text_mask[sy * width + sx];
+                    }
+                }
+            }
+            outline_mask[y * width + x] = a;
+        }
+    }
+
+    portENTER_CRITICAL(&s_osd_ctx.lock);
+    s_osd_ctx.elements[OSD_ELEMENT_TEXT].width = width;
+    s_osd_ctx.elements[OSD_ELEMENT_OUTLINE].width = width;
+    portEXIT_CRITICAL(&s_osd_ctx.lock);
+}
+
+/* Wall clock time once it is set, e.g. by SNTP, uptime before */
+static void osd_update_text(void)
+{
+    char text[OSD_TEXT_MAX + 1];
+    time_t now = time(NULL);
+    int64_t second;
+    struct tm tm;
+
+    second = now >= OSD_CLOCK_VALID ? now : esp_timer_get_time() / 1000000;
+    if (second == s_osd_ctx.text_second) {
+        return;
+    }
+    s_osd_ctx.text_second = second;
+
+    if (now >= OSD_CLOCK_VALID) {
+        localtime_r(&now, &tm);
+        snprintf(text, sizeof(text), "%04d-%02d-%02d %02d:%02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1,
+                 tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    } else {
+        snprintf(text, sizeof(text), "%02lld:%02lld:%02lld", second / 3600, second / 60 % 60, second % 60);
+    }
+
+    osd_render_text(text);
+}
+#endif
+
+/* ========== Blending ========== */
+
+static bool osd_clip(const osd_element_t *element, uint32_t width, uint32_t height, osd_clip_t *clip)
+{
+    int x = element->x < 0 ? (int)width + element->x - element->width : element->x;
+    int y = element->y < 0 ? (int)height + element->y - element->height : element->y;
+    int x0 = MAX(x, 0);
+    int y0 = MAX(y, 0);
+    int x1 = MIN(x + element->width, (int)width);
+    int y1 = MIN(y + element->height, (int)height);
+
+    if (!element->alpha || x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+
+    clip->x = x0;
+    clip->y = y0;
+    clip->mask_x = x0 - x;
+    clip->mask_y = y0 - y;
+    clip->width = x1 - x0;
+    clip->height = y1 - y0;
+
+    return true;
+}
+
+static esp_err_t osd_blend_ppa(frame_buffer_t *frame, uint32_t fmt, uint32_t width, uint32_t height,
+                               const osd_element_t *element, const osd_clip_t *clip)
+{
+    ppa_blend_color_mode_t cm = fmt == V4L2_PIX_FMT_RGB565 ? PPA_BLEND_COLOR_MODE_RGB565 : PPA_BLEND_COLOR_MODE_RGB888;
+    /* V4L2 RGB24 has red first, PPA RGB888 blue first, blending is per channel so only the color swaps */
+    bool swap = fmt == V4L2_PIX_FMT_RGB24;
+    uint8_t r = element->rgb >> 16;
+    uint8_t g = element->rgb >> 8;
+    uint8_t b = element->rgb;
+    ppa_blend_oper_config_t config = {
+        .in_bg = {
+            .buffer = frame->data,
+            .pic_w = width,
+            .pic_h = height,
+            .block_w = clip->width,
+            .block_h = clip->height,
+            .block_offset_x = clip->x,
+            .block_offset_y = clip->y,
+            .blend_cm = cm,
+        },
+        .in_fg = {
+            .buffer = element->alpha,
+            .pic_w = element->width,
+            .pic_h = element->height,
+            .block_w = clip->width,
+            .block_h = clip->height,
+            .block_offset_x = clip->mask_x,
+            .block_offset_y = clip->mask_y,
+            .blend_cm = PPA_BLEND_COLOR_MODE_A8,
+        },
+        .out = {
+            .buffer = frame->data,
+            .buffer_size = frame->capacity & ~(s_osd_ctx.frame_align - 1),
+            .pic_w = width,
+            .pic_h = height,
+            .block_offset_x = clip->x,
+            .block_offset_y = clip->y,
+            .blend_cm = cm,
+        },
+        .fg_fix_rgb_val = {
+            .b = swap ? r : b,
+            .g = g,
+            .r = swap ? b : r,
+        },
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+
+    return ppa_do_blend(s_osd_ctx.ppa, &config);
+}
+
+/* Byte offset of the luma sample of a pixel, -1 for a layout without one */
+static int32_t osd_luma_offset(uint32_t fmt, uint32_t width, uint32_t x, uint32_t y)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_YUV420:
+        /* U Y Y / V Y Y */
+        return y * width * 3 / 2 + x / 2 * 3 + 1 + (x & 1);
+    case V4L2_PIX_FMT_YUV422P:
+        /* U Y V Y */
+        return (y * width + x) * 2 + 1;
+    case V4L2_PIX_FMT_YUYV:
+        return (y * width + x) * 2;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_GREY:
+        return y * width + x;
+    default:
+        return -1;
+    }
+}
+
+static esp_err_t osd_blend_luma(frame_buffer_t *frame, uint32_t fmt, uint32_t width, uint32_t height,
+                                const osd_element_t *element, const osd_clip_t *clip)
+{
+    uint32_t r = (element->rgb >> 16) & 0xFF;
+    uint32_t g = (element->rgb >> 8) & 0xFF;
+    uint32_t b = element->rgb & 0xFF;
+    /* BT.601 limited range, as the ISP outputs */
+    uint32_t luma = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    int32_t first = osd_luma_offset(fmt, width, 0, clip->y);
+    int32_t end = osd_luma_offset(fmt, width, 0, clip->y + clip->height);
+    struct esp_video_buffer_sync sync;
+
+    if (first < 0 || end > (int32_t)frame->capacity) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /* Camera DMA wrote the lines behind the CPU cache, the encoder import writes them back */
+    memset(&sync, 0, sizeof(sync));
+    sync.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sync.index = frame->camera_buf_index;
+    sync.offset = first;
+    sync.size = end - first;
+    sync.flags = ESP_VIDEO_BUFFER_SYNC_CPU_READ | ESP_VIDEO_BUFFER_SYNC_CPU_WRITE;
+    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_SYNC_BUF, &sync) != 0) {
+        return ESP_FAIL;
+    }
+
+    for (uint32_t y = 0; y < clip->height; y++) {
+        const uint8_t *mask = element->alpha + (clip->mask_y + y) * element->width + clip->mask_x;
+
+        for (uint32_t x = 0; x < clip->width; x++) {
+            uint32_t a = mask[x];
+            uint8_t *p;
+
+            if (!a) {
+                continue;
+            }
+            p = frame->data + osd_luma_offset(fmt, width, clip->x + x, clip->y + y);
+            *p = (*p * (255 - a) + luma * a + 127) / 255;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/* ========== Public API ========== */
+
+esp_err_t uvc_osd_init(void)
+{
+    size_t atlas_size = (sizeof(s_osd_charset) - 1) * OSD_CELL_W * OSD_CELL_H;
+    ppa_client_config_t ppa_config = {
+        .oper_type = PPA_OPERATION_BLEND,
+    };
+
+    if (s_osd_ctx.initialized) {
+        return ESP_OK;
+    }
+
+    /* Masks are PPA input, the driver writes them back from the cache before each blend */
+    s_osd_ctx.atlas = memstat_malloc(MEMSTAT_PROC, atlas_size, MALLOC_CAP_8BIT);
+    s_osd_ctx.text_mask = memstat_calloc(MEMSTAT_PROC, 1, OSD_TEXT_W * OSD_TEXT_H, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    s_osd_ctx.outline_mask = memstat_calloc(MEMSTAT_PROC, 1, OSD_TEXT_W * OSD_TEXT_H, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    APP_RETURN_ON_FALSE(s_osd_ctx.atlas && s_osd_ctx.text_mask && s_osd_ctx.outline_mask, ESP_ERR_NO_MEM,
+                        OSD_TAG, "No memory for OSD masks");
+    APP_RETURN_ON_ERROR(esp_cache_get_alignment(MALLOC_CAP_SPIRAM, &s_osd_ctx.frame_align), OSD_TAG,
+                        "Failed to get cache alignment");
+    s_osd_ctx.frame_align = MAX(s_osd_ctx.frame_align, 1);
+    APP_RETURN_ON_ERROR(ppa_register_client(&ppa_config, &s_osd_ctx.ppa), OSD_TAG, "Failed to register PPA client");
+
+    osd_render_atlas();
+
+#if CONFIG_EXAMPLE_OSD_TIMESTAMP
+    s_osd_ctx.elements[OSD_ELEMENT_OUTLINE] = (osd_element_t) {
+        .alpha = s_osd_ctx.outline_mask,
+        .height = OSD_TEXT_H,
+        .x = OSD_MARGIN - OSD_OUTLINE,
+        .y = OSD_MARGIN - OSD_OUTLINE,
+        .rgb = 0x000000,
+    };
+    s_osd_ctx.elements[OSD_ELEMENT_TEXT] = s_osd_ctx.elements[OSD_ELEMENT_OUTLINE];
+    s_osd_ctx.elements[OSD_ELEMENT_TEXT].alpha = s_osd_ctx.text_mask;
+    s_osd_ctx.elements[OSD_ELEMENT_TEXT].rgb = 0xFFFFFF;
+#endif
+
+    s_osd_ctx.initialized = true;
+    ESP_LOGI(OSD_TAG, "OSD ready, %d x %d glyphs", OSD_CELL_W, OSD_CELL_H);
+
+    return ESP_OK;
+}
+
+esp_err_t uvc_osd_set_logo(const uint8_t *alpha, uint16_t width, uint16_t height, int x, int y, uint32_t rgb)
+{
+    osd_element_t logo = {
+        .alpha = alpha,
+        .width = width,
+        .height = height,
+        .x = x,
+        .y = y,
+        .rgb = rgb,
+    };
+
+    APP_RETURN_ON_FALSE(s_osd_ctx.initialized, ESP_ERR_INVALID_STATE, OSD_TAG, "OSD not initialized");
+    APP_RETURN_ON_FALSE(!alpha || (width && height), ESP_ERR_INVALID_ARG, OSD_TAG, "Empty logo");
+
+    portENTER_CRITICAL(&s_osd_ctx.lock);
+    s_osd_ctx.elements[OSD_ELEMENT_LOGO] = logo;
+    portEXIT_CRITICAL(&s_osd_ctx.lock);
+
+    return ESP_OK;
+}
+
+void uvc_osd_apply(frame_buffer_t *frame)
+{
+    osd_element_t elements[OSD_ELEMENT_COUNT];
+    osd_clip_t clip;
+    uint32_t width = g_app_ctx.stream_width;
+    uint32_t height = g_app_ctx.stream_height;
+    uint32_t fmt = g_app_ctx.uvc->cap_caps.capture_fmt;
+    bool ppa = fmt == V4L2_PIX_FMT_RGB565 || fmt == V4L2_PIX_FMT_RGB24;
+    esp_err_t ret;
+
+    if (!s_osd_ctx.initialized) {
+        return;
+    }
+
+#if CONFIG_EXAMPLE_OSD_TIMESTAMP
+    osd_update_text();
+#endif
+
+    portENTER_CRITICAL(&s_osd_ctx.lock);
+    memcpy(elements, s_osd_ctx.elements, sizeof(elements));
+    portEXIT_CRITICAL(&s_osd_ctx.lock);
+
+    for (int i = 0; i < OSD_ELEMENT_COUNT; i++) {
+        if (!osd_clip(&elements[i], width, height, &clip)) {
+            continue;
+        }
+
+        if (ppa) {
+            ret = osd_blend_ppa(frame, fmt, width, height, &elements[i], &clip);
+        } else {
+            ret = osd_blend_luma(frame, fmt, width, height, &elements[i], &clip);
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGD(OSD_TAG, "Element %d not drawn (%s)", i, esp_err_to_name(ret));
+        }
+    }
+}
@@ -0,0 +1,189 @@
+/*
+ * UVC PU Bridge - Processing Unit controls onto the ISP, see uvc_pu_bridge.h
+ *
+ * uvc_pu_set() runs in whatever task got the host request and only takes the
+ * lock for a store and a bit. The capture task checks the pending mask without
+ * the lock every frame, only a frame after a change pays for the copy and the
+ * ioctl, which is made outside the lock so a setter never waits on the ISP.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "linux/videodev2.h"
+#include "esp_video_device.h"
+#include "uvc_app_common.h"
+#include "uvc_pu_bridge.h"
+
+#define PU_TAG              "uvc_pu"
+
+#define PU_ISP_DEV_PATH     ESP_VIDEO_ISP1_DEVICE_NAME
+
+static const uint32_t s_pu_cids[UVC_PU_CTRL_MAX] = {
+    [UVC_PU_BRIGHTNESS]     = V4L2_CID_BRIGHTNESS,
+    [UVC_PU_CONTRAST]       = V4L2_CID_CONTRAST,
+    [UVC_PU_SATURATION]     = V4L2_CID_SATURATION,
+    [UVC_PU_HUE]            = V4L2_CID_HUE,
+    [UVC_PU_RED_BALANCE]    = V4L2_CID_RED_BALANCE,
+    [UVC_PU_BLUE_BALANCE]   = V4L2_CID_BLUE_BALANCE,
+};
+
+typedef struct {
+    int fd;
+    uint32_t supported;             /* Bit per uvc_pu_ctrl_t the ISP knows */
+    volatile uint32_t pending;      /* Bit per control set since the last commit */
+    portMUX_TYPE lock;              /* Guards values, pending and the request counters */
+    int32_t values[UVC_PU_CTRL_MAX];
+    uvc_pu_range_t ranges[UVC_PU_CTRL_MAX];
+    uvc_pu_stats_t stats;
+} uvc_pu_ctx_t;
+
+static uvc_pu_ctx_t s_pu_ctx = {
+    .fd = -1,
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/* ========== Init ========== */
+
+esp_err_t uvc_pu_bridge_init(void)
+{
+    int fd;
+
+    fd = open(PU_ISP_DEV_PATH, O_RDWR);
+    APP_RETURN_ON_FALSE(fd >= 0, ESP_ERR_NOT_FOUND, PU_TAG, "Failed to open %s", PU_ISP_DEV_PATH);
+
+    for (int i = 0; i < UVC_PU_CTRL_MAX; i++) {
+        struct v4l2_query_ext_ctrl qctrl = {
+            .id = s_pu_cids[i],
+        };
+
+        if (ioctl(fd, VIDIOC_QUERY_EXT_CTRL, &qctrl) != 0) {
+            ESP_LOGW(PU_TAG, "ISP has no control 0x%08lx", s_pu_cids[i]);
+            continue;
+        }
+
+        s_pu_ctx.ranges[i].minimum = qctrl.minimum;
+        s_pu_ctx.ranges[i].maximum = qctrl.maximum;
+        s_pu_ctx.ranges[i].default_value = qctrl.default_value;
+        s_pu_ctx.values[i] = qctrl.default_value;
+        s_pu_ctx.supported |= BIT(i);
+    }
+
+    if (!s_pu_ctx.supported) {
+        close(fd);
+        ESP_LOGE(PU_TAG, "ISP has none of the Processing Unit controls");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_pu_ctx.fd = fd;
+
+    ESP_LOGI(PU_TAG, "Processing Unit controls on %s, mask 0x%02lx", PU_ISP_DEV_PATH, s_pu_ctx.supported);
+
+    return ESP_OK;
+}
+
+/* ========== Host Side ========== */
+
+esp_err_t uvc_pu_set(uvc_pu_ctrl_t ctrl, int32_t value)
+{
+    if (ctrl >= UVC_PU_CTRL_MAX || !(s_pu_ctx.supported & BIT(ctrl))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    value = MAX(value, s_pu_ctx.ranges[ctrl].minimum);
+    value = MIN(value, s_pu_ctx.ranges[ctrl].maximum);
+
+    portENTER_CRITICAL(&s_pu_ctx.lock);
+    if (s_pu_ctx.pending & BIT(ctrl)) {
+        s_pu_ctx.stats.coalesced++;
+    }
+    s_pu_ctx.values[ctrl] = value;
+    s_pu_ctx.pending |= BIT(ctrl);
+    s_pu_ctx.stats.requests++;
+    portEXIT_CRITICAL(&s_pu_ctx.lock);
+
+    return ESP_OK;
+}
+
+esp_err_t uvc_pu_get(uvc_pu_ctrl_t ctrl, int32_t *ret_value)
+{
+    if (ctrl >= UVC_PU_CTRL_MAX || !(s_pu_ctx.supported & BIT(ctrl))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    portENTER_CRITICAL(&s_pu_ctx.lock);
+    *ret_value = s_pu_ctx.values[ctrl];
+    portEXIT_CRITICAL(&s_pu_ctx.lock);
+
+    return ESP_OK;
+}
+
+esp_err_t uvc_pu_get_range(uvc_pu_ctrl_t ctrl, uvc_pu_range_t *ret_range)
+{
+    if (ctrl >= UVC_PU_CTRL_MAX || !(s_pu_ctx.supported & BIT(ctrl))) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    *ret_range = s_pu_ctx.ranges[ctrl];
+
+    return ESP_OK;
+}
+
+/* ========== Frame Side ========== */
+
+void uvc_pu_bridge_apply(void)
+{
+    struct v4l2_ext_control ctrls[UVC_PU_CTRL_MAX];
+    struct v4l2_ext_controls controls;
+    uint32_t pending;
+    int count = 0;
+
+    if (!s_pu_ctx.pending) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_pu_ctx.lock);
+    pending = s_pu_ctx.pending;
+    s_pu_ctx.pending = 0;
+    for (int i = 0; i < UVC_PU_CTRL_MAX; i++) {
+        if (pending & BIT(i)) {
+            memset(&ctrls[count], 0, sizeof(ctrls[count]));
+            ctrls[count].id = s_pu_cids[i];
+            ctrls[count].value = s_pu_ctx.values[i];
+            count++;
+        }
+    }
+    portEXIT_CRITICAL(&s_pu_ctx.lock);
+
+    /* One call, the staged commit writes all of them at the same frame end */
+    memset(&controls, 0, sizeof(controls));
+    controls.ctrl_class = V4L2_CTRL_CLASS_USER;
+    controls.count = count;
+    controls.controls = ctrls;
+
+    s_pu_ctx.stats.commits++;
+    if (ioctl(s_pu_ctx.fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
+        /* Not retried, the next request of the host sets the control again */
+        s_pu_ctx.stats.failures++;
+        ESP_LOGW(PU_TAG, "ISP refused %d controls, mask 0x%02lx", count, pending);
+    }
+}
+
+/* ========== Stats ========== */
+
+void uvc_pu_bridge_get_stats(uvc_pu_stats_t *ret_stats)
+{
+    portENTER_CRITICAL(&s_pu_ctx.lock);
+    *ret_stats = s_pu_ctx.stats;
+    portEXIT_CRITICAL(&s_pu_ctx.lock);
+}
+
+void uvc_pu_bridge_reset_stats(void)
+{
+    portENTER_CRITICAL(&s_pu_ctx.lock);
+    memset(&s_pu_ctx.stats, 0, sizeof(s_pu_ctx.stats));
+    portEXIT_CRITICAL(&s_pu_ctx.lock);
+}
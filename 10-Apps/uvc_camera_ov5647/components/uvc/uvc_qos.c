@@ -0,0 +1,248 @@
+/*
+ * UVC QoS - Stream quality governor under USB or encoder overload
+ *
+ * A host or link which doesn't keep up first shows as fb_return coming later,
+ * then as a full encoded queue and dropped captures. Encoding longer than the
+ * frame period shows the same way from the other side. Both times are means of
+ * the window, one slow frame doesn't move the stream down a rung.
+ *
+ * Whether the stream fits a better rung is judged against that rung's period,
+ * a decimated stream has more time per frame than the one above it would have.
+ * The H.264 bitrate and JPEG target size are set from the job, the JPEG quality
+ * of the size adaptation is owned by the encode task, which follows the scale.
+ */
+
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "uvc_app_common.h"
+#include "os_sched.h"
+#include "uvc_qos.h"
+
+#define QOS_PERIOD_MS           1000
+#define QOS_TOLERANCE_MS        200
+#define QOS_DOWN_WINDOWS        2       /* Overloaded windows in a row before a rung down */
+#define QOS_UP_WINDOWS          5       /* Windows with room in a row before a rung up */
+#define QOS_LOAD_HIGH_PERCENT   90      /* Mean time per frame above this much of the period is overload */
+#define QOS_LOAD_LOW_PERCENT    60      /* ... and below this much of the better rung's period is room */
+#define QOS_MIN_SCALE           10      /* Floor of the encoder budget, whatever the steps add up to */
+
+#define QOS_LEVELS              (CONFIG_EXAMPLE_QOS_ENCODER_STEPS + CONFIG_EXAMPLE_QOS_MAX_DECIMATION)
+
+/* QoS context */
+typedef struct {
+    portMUX_TYPE lock;                      // Guards everything below
+    os_sched_job_id job;
+    bool armed;
+    int rate;
+    int64_t period;                         // Frame period of the session rate in us
+    uint32_t level;
+    uint32_t over;                          // Overloaded windows in a row
+    uint32_t calm;                          // Windows with room in a row
+    uint32_t seen_time[UVC_QOS_SOURCE_MAX]; // Source totals at the last window
+    uint32_t seen_count[UVC_QOS_SOURCE_MAX];
+    uint32_t seen_streamed;
+    uint32_t seen_dropped;
+    uvc_qos_stats_t stats;
+} uvc_qos_ctx_t;
+
+static const char *TAG = "uvc_qos";
+
+volatile uint32_t g_uvc_qos_time[UVC_QOS_SOURCE_MAX];
+volatile uint32_t g_uvc_qos_count[UVC_QOS_SOURCE_MAX];
+volatile uint32_t g_uvc_qos_scale = 100;
+volatile uint32_t g_uvc_qos_decimation = 1;
+
+static uvc_qos_ctx_t s_qos = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+    .job = -1,
+};
+
+static uint32_t qos_level_scale(uint32_t level)
+{
+    int32_t scale = 100 - (int32_t)MIN(level, CONFIG_EXAMPLE_QOS_ENCODER_STEPS) * CONFIG_EXAMPLE_QOS_STEP_PERCENT;
+
+    return MAX(scale, QOS_MIN_SCALE);
+}
+
+static uint32_t qos_level_decimation(uint32_t level)
+{
+    return level > CONFIG_EXAMPLE_QOS_ENCODER_STEPS ? level - CONFIG_EXAMPLE_QOS_ENCODER_STEPS + 1 : 1;
+}
+
+/* Budgets the encoder takes from a control, the JPEG quality follows g_uvc_qos_scale in the encode task */
+static void qos_apply_scale(uint32_t scale, int rate)
+{
+    esp_err_t ret = ESP_OK;
+
+#if CONFIG_FORMAT_H264_CAM1
+    ret = uvc_app_h264_set_bitrate((uint64_t)CONFIG_EXAMPLE_H264_BITRATE * scale / 100);
+#elif CONFIG_FORMAT_MJPEG_CAM1 && CONFIG_EXAMPLE_JPEG_TARGET_KBPS
+    ret = uvc_app_jpeg_set_target_size((uint64_t)CONFIG_EXAMPLE_JPEG_TARGET_KBPS * 1000 / 8 / (rate ? rate : 30) *
+                                       scale / 100,
+                                       CONFIG_EXAMPLE_JPEG_MIN_QUALITY, CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY);
+#endif
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Encoder budget %lu%% not applied (%s)", scale, esp_err_to_name(ret));
+    }
+}
+
+/* Mean time per frame of a source over the window, 0 without frames */
+static uint32_t qos_window_mean(uvc_qos_source_t source)
+{
+    uint32_t time = g_uvc_qos_time[source];
+    uint32_t count = g_uvc_qos_count[source];
+    uint32_t frames = count - s_qos.seen_count[source];
+    uint32_t mean = frames ? (time - s_qos.seen_time[source]) / frames : 0;
+
+    s_qos.seen_time[source] = time;
+    s_qos.seen_count[source] = count;
+
+    return mean;
+}
+
+static void qos_window_start(void)
+{
+    for (int source = 0; source < UVC_QOS_SOURCE_MAX; source++) {
+        s_qos.seen_time[source] = g_uvc_qos_time[source];
+        s_qos.seen_count[source] = g_uvc_qos_count[source];
+    }
+    s_qos.seen_streamed = g_app_ctx.total_frames_streamed;
+    s_qos.seen_dropped = g_app_ctx.frames_dropped;
+    s_qos.over = 0;
+    s_qos.calm = 0;
+}
+
+static void qos_job(void *arg)
+{
+    uint32_t streamed = g_app_ctx.total_frames_streamed;
+    uint32_t dropped = g_app_ctx.frames_dropped;
+    uint32_t encode_us, usb_us, drops, frames;
+    uint32_t old_scale, scale, decimation;
+    int64_t high, low;
+    uint32_t level;
+    int rate;
+
+    portENTER_CRITICAL(&s_qos.lock);
+
+    if (!s_qos.armed) {
+        portEXIT_CRITICAL(&s_qos.lock);
+        return;
+    }
+
+    /* The pipeline counters are zeroed at a resolution change, start the window over */
+    if (streamed < s_qos.seen_streamed || dropped < s_qos.seen_dropped) {
+        qos_window_start();
+        portEXIT_CRITICAL(&s_qos.lock);
+        return;
+    }
+
+    encode_us = qos_window_mean(UVC_QOS_ENCODE);
+    usb_us = qos_window_mean(UVC_QOS_USB);
+    drops = dropped - s_qos.seen_dropped;
+    frames = streamed - s_qos.seen_streamed + drops;
+    s_qos.seen_streamed = streamed;
+    s_qos.seen_dropped = dropped;
+
+    level = s_qos.level;
+    high = s_qos.period * qos_level_decimation(level) * QOS_LOAD_HIGH_PERCENT / 100;
+    low = level ? s_qos.period * qos_level_decimation(level - 1) * QOS_LOAD_LOW_PERCENT / 100 : 0;
+
+    if (!frames) {
+        /* Nothing streamed nor dropped, e.g. the host stopped reading, no verdict */
+    } else if (drops * 100 > frames * CONFIG_EXAMPLE_QOS_DROP_PERCENT || encode_us > high || usb_us > high) {
+        s_qos.calm = 0;
+        if (++s_qos.over >= QOS_DOWN_WINDOWS && level < QOS_LEVELS - 1) {
+            level++;
+        }
+    } else if (level && !drops && encode_us < low && usb_us < low) {
+        s_qos.over = 0;
+        if (++s_qos.calm >= QOS_UP_WINDOWS) {
+            level--;
+        }
+    } else {
+        s_qos.over = 0;
+        s_qos.calm = 0;
+    }
+
+    if (level == s_qos.level) {
+        portEXIT_CRITICAL(&s_qos.lock);
+        return;
+    }
+
+    if (level > s_qos.level) {
+        s_qos.stats.steps_down++;
+        s_qos.stats.worst_level = MAX(s_qos.stats.worst_level, level);
+    } else {
+        s_qos.stats.steps_up++;
+    }
+    s_qos.level = level;
+    s_qos.stats.level = level;
+    s_qos.over = 0;
+    s_qos.calm = 0;
+    old_scale = g_uvc_qos_scale;
+    scale = qos_level_scale(level);
+    decimation = qos_level_decimation(level);
+    g_uvc_qos_scale = scale;
+    g_uvc_qos_decimation = decimation;
+    rate = s_qos.rate;
+
+    portEXIT_CRITICAL(&s_qos.lock);
+
+    ESP_LOGW(TAG, "Rung %lu/%d: encoder %lu%%, 1/%lu of the frames (drops %lu/%lu, encode %lu us, usb %lu us)",
+             level, QOS_LEVELS - 1, scale, decimation, drops, frames, encode_us, usb_us);
+    if (scale != old_scale) {
+        qos_apply_scale(scale, rate);
+    }
+}
+
+esp_err_t uvc_qos_init(void)
+{
+    if (s_qos.job >= 0) {
+        return ESP_OK;
+    }
+
+    return os_sched_register("uvc_qos", qos_job, NULL, QOS_PERIOD_MS, QOS_TOLERANCE_MS, &s_qos.job);
+}
+
+void uvc_qos_arm(int rate)
+{
+    portENTER_CRITICAL(&s_qos.lock);
+    s_qos.rate = rate;
+    s_qos.period = 1000000 / (rate > 0 ? rate : 30);
+    s_qos.level = 0;
+    s_qos.stats.level = 0;
+    g_uvc_qos_scale = 100;
+    g_uvc_qos_decimation = 1;
+    qos_window_start();
+    s_qos.armed = true;
+    portEXIT_CRITICAL(&s_qos.lock);
+}
+
+void uvc_qos_disarm(void)
+{
+    uint32_t scale;
+    int rate;
+
+    portENTER_CRITICAL(&s_qos.lock);
+    s_qos.armed = false;
+    scale = g_uvc_qos_scale;
+    rate = s_qos.rate;
+    s_qos.level = 0;
+    s_qos.stats.level = 0;
+    g_uvc_qos_scale = 100;
+    g_uvc_qos_decimation = 1;
+    portEXIT_CRITICAL(&s_qos.lock);
+
+    /* Encoder controls outlive the session, the next one starts with the configured budget */
+    if (scale != 100) {
+        qos_apply_scale(100, rate);
+    }
+}
+
+void uvc_qos_get_stats(uvc_qos_stats_t *ret_stats)
+{
+    portENTER_CRITICAL(&s_qos.lock);
+    *ret_stats = s_qos.stats;
+    portEXIT_CRITICAL(&s_qos.lock);
+}
@@ -0,0 +1,217 @@
+/*
+ * Scan Task
+ *
+ * Responsibilities:
+ * - Dequeue camera frames while scan mode runs (EVENT_SCAN_RUN), the stream
+ *   task programs the camera for it, see uvc_app_scan_start()
+ * - Pick the luma of each YUV420 frame into a grey image, one word-wide pass,
+ *   and give the camera buffer back right away
+ * - Decode QR codes and barcodes in the grey image and pass new codes to the
+ *   callback set with uvc_scan_set_callback()
+ *
+ * The camera drops its oldest buffer when none is free, so each decode starts
+ * on the newest frame and a slow decode costs frames, not latency. A code that
+ * stays in view is reported once, and again after CONFIG_EXAMPLE_SCAN_REPEAT_MS
+ * out of view.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "linux/videodev2.h"
+#include "esp_video_direct.h"
+#include "esp_video_pixconv.h"
+#include "esp_code_scanner.h"
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "uvc_scan.h"
+#include "os_interface.h"
+
+#define SCN_TAG                 "scan"
+
+#define SCAN_WIDTH              CONFIG_EXAMPLE_SCAN_WIDTH
+#define SCAN_HEIGHT             CONFIG_EXAMPLE_SCAN_HEIGHT
+#define SCAN_DATA_MAX           256     /* Payload kept to suppress repeats, longer codes compare by prefix */
+
+_Static_assert(SCAN_WIDTH % 8 == 0 && SCAN_HEIGHT % 2 == 0, "Scan frame must suit the luma pass");
+
+/* Task context */
+typedef struct {
+    uvc_scan_cb_t cb;
+    void *cb_ctx;
+
+    esp_image_scanner_t *scanner;
+    esp_video_pixconv_func_t to_grey;
+    uint8_t *grey;
+
+    /* Last reported code */
+    char last_data[SCAN_DATA_MAX];
+    int64_t last_time;
+
+    uint32_t frames;
+    uint32_t codes;
+    uint64_t decode_us_total;
+} scan_task_ctx_t;
+
+static scan_task_ctx_t s_scn_ctx = {0};
+
+esp_err_t uvc_scan_set_callback(uvc_scan_cb_t cb, void *ctx)
+{
+    APP_RETURN_ON_FALSE(!(xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SCAN_RUN), ESP_ERR_INVALID_STATE,
+                        SCN_TAG, "Stop scanning before setting the scan callback");
+
+    s_scn_ctx.cb = cb;
+    s_scn_ctx.cb_ctx = ctx;
+
+    return ESP_OK;
+}
+
+/* Report a decoded code unless it is the last one and was reported just now */
+static void scan_report(const esp_code_scanner_symbol_t *symbol, const struct v4l2_buffer *buf, int64_t frame_time)
+{
+    int64_t now = esp_timer_get_time();
+    uvc_scan_result_t result;
+
+    if (!symbol->data) {
+        return;
+    }
+    if (!strncmp(symbol->data, s_scn_ctx.last_data, sizeof(s_scn_ctx.last_data) - 1) &&
+            now - s_scn_ctx.last_time < (int64_t)CONFIG_EXAMPLE_SCAN_REPEAT_MS * 1000) {
+        s_scn_ctx.last_time = now;
+        return;
+    }
+    strlcpy(s_scn_ctx.last_data, symbol->data, sizeof(s_scn_ctx.last_data));
+    s_scn_ctx.last_time = now;
+    s_scn_ctx.codes++;
+
+    result.type = symbol->type_name;
+    result.data = symbol->data;
+    result.frame_number = buf->sequence;
+    result.timestamp = frame_time;
+    result.latency_us = now - frame_time;
+    ESP_LOGI(SCN_TAG, "%s \"%s\", %lu ms after the frame", result.type, result.data, result.latency_us / 1000);
+
+    if (s_scn_ctx.cb) {
+        s_scn_ctx.cb(&result, s_scn_ctx.cb_ctx);
+    }
+}
+
+/* Dequeue the newest frame, take its luma and decode it */
+static void scan_process_frame(void)
+{
+    struct v4l2_buffer buf;
+    int64_t frame_time;
+    int64_t start;
+    int decoded;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (esp_video_direct_dqbuf(g_app_ctx.uvc->cap_dev, &buf) != ESP_OK) {
+        /* The stream task may be stopping the camera */
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+    frame_time = (int64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+
+    /* The camera keeps running on the buffer while the decoder works on the copy */
+    s_scn_ctx.to_grey(g_app_ctx.uvc->cap_buffer[buf.index], s_scn_ctx.grey, SCAN_WIDTH, SCAN_HEIGHT);
+    if (esp_video_direct_qbuf(g_app_ctx.uvc->cap_dev, &buf) != ESP_OK) {
+        ESP_LOGE(SCN_TAG, "Failed to return camera buffer %lu", buf.index);
+    }
+
+    start = esp_timer_get_time();
+    decoded = esp_code_scanner_scan_image(s_scn_ctx.scanner, s_scn_ctx.grey);
+    s_scn_ctx.decode_us_total += esp_timer_get_time() - start;
+    s_scn_ctx.frames++;
+
+    if (decoded > 0) {
+        esp_code_scanner_symbol_t symbol = esp_code_scanner_result(s_scn_ctx.scanner);
+
+        scan_report(&symbol, &buf, frame_time);
+    }
+}
+
+/* ========== Init Phase ========== */
+void initScanTask(void *arg)
+{
+    esp_code_scanner_config_t config = {
+        .mode = ESP_CODE_SCANNER_MODE_FAST,
+        .fmt = ESP_CODE_SCANNER_IMAGE_GRAY,
+        .width = SCAN_WIDTH,
+        .height = SCAN_HEIGHT,
+    };
+
+    ESP_LOGI(SCN_TAG, "Initializing scan task...");
+
+    s_scn_ctx.to_grey = esp_video_pixconv_find(V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_GREY);
+    s_scn_ctx.grey = memstat_aligned_alloc(MEMSTAT_PROC, 4, SCAN_WIDTH * SCAN_HEIGHT, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    s_scn_ctx.scanner = esp_code_scanner_create();
+    if (!s_scn_ctx.grey || !s_scn_ctx.scanner ||
+            esp_code_scanner_set_config(s_scn_ctx.scanner, config) != ESP_OK) {
+        ESP_LOGE(SCN_TAG, "Failed to set up the %dx%d decoder", SCAN_WIDTH, SCAN_HEIGHT);
+    }
+
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_SCAN_IDLE);
+
+    ESP_LOGI(SCN_TAG, "Scan task initialized");
+}
+
+/* ========== Main Loop ========== */
+void mainScanTask(void *arg)
+{
+    EventBits_t bits;
+
+    ESP_LOGI(SCN_TAG, "Scan task started on core %d", xPortGetCoreID());
+
+    if (!s_scn_ctx.grey || !s_scn_ctx.scanner || !s_scn_ctx.to_grey) {
+        ESP_LOGE(SCN_TAG, "Decoder missing, scan mode can't run");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_SCAN_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(SCN_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_SCAN_RUN)) {
+            continue;
+        }
+
+        xEventGroupClearBits(g_app_ctx.system_events, EVENT_SCAN_IDLE);
+        s_scn_ctx.last_data[0] = '\0';
+
+        /* DQBUF returns within one sensor frame period, so a stop request is seen quickly */
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SCAN_RUN) {
+            scan_process_frame();
+        }
+
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_SCAN_IDLE);
+    }
+
+exit:
+    ESP_LOGI(SCN_TAG, "Scan task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terScanTask(void *arg)
+{
+    ESP_LOGI(SCN_TAG, "Terminating scan task...");
+
+    if (s_scn_ctx.scanner) {
+        esp_code_scanner_destroy(s_scn_ctx.scanner);
+        s_scn_ctx.scanner = NULL;
+    }
+    memstat_free(MEMSTAT_PROC, s_scn_ctx.grey);
+    s_scn_ctx.grey = NULL;
+
+    ESP_LOGI(SCN_TAG, "Scan task terminated, %lu frames, %lu codes, %llu us per decode", s_scn_ctx.frames,
+             s_scn_ctx.codes, s_scn_ctx.frames ? s_scn_ctx.decode_us_total / s_scn_ctx.frames : 0);
+}
@@ -0,0 +1,325 @@
+/*
+ * Secondary Encode Task
+ *
+ * Responsibilities:
+ * - Receive every captured frame as a capture consumer (QUEUE_SECONDARY_RAW)
+ * - Encode it with the other hardware encoder (H.264 for an MJPEG stream, JPEG
+ *   for an H.264 stream), importing the same camera buffer as the encode task
+ * - Pass each encoded frame to the sink set by uvc_secondary_set_sink()
+ *
+ * Both encoders run in their own tasks, so the two hardware encodes of a frame
+ * overlap. The camera buffer is re-queued when the slower of them releases it.
+ * The secondary encoder has a single capture buffer, which is reused as soon as
+ * the sink returns.
+ *
+ * With CONFIG_EXAMPLE_AUX_CAMERA the frames come from the aux camera instead,
+ * see uvc_aux_camera.h, and the main camera frames are not encoded twice.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "uvc_app_common.h"
+#include "uvc_aux_camera.h"
+#include "os_interface.h"
+#include "linux/videodev2.h"
+
+#define SEC_TAG     "secondary"
+
+/* Task context */
+typedef struct {
+    uint32_t encoded_count;
+    uvc_secondary_sink_t sink;
+    void *sink_ctx;
+    int width;                  /* Frame of the last start, 0 before the first one */
+    int height;
+    frame_buffer_t frame;       /* Describes the secondary encoder capture buffer */
+} secondary_task_ctx_t;
+
+static secondary_task_ctx_t s_sec_ctx = {0};
+
+esp_err_t uvc_secondary_set_sink(uvc_secondary_sink_t sink, void *ctx)
+{
+    APP_RETURN_ON_FALSE(!g_app_ctx.is_streaming, ESP_ERR_INVALID_STATE, SEC_TAG,
+                        "Stop streaming before setting the secondary sink");
+
+    s_sec_ctx.sink = sink;
+    s_sec_ctx.sink_ctx = ctx;
+
+    return ESP_OK;
+}
+
+/* ========== Stream Control ========== */
+
+/* Called from video_start_cb() after the camera streams, formats are only set when the frame changed */
+esp_err_t uvc_secondary_start(int width, int height, uint32_t capture_fmt, bool reformat)
+{
+    int type;
+    int fd = g_app_ctx.uvc->sec_fd;
+    struct v4l2_buffer buf;
+    struct v4l2_format format;
+    struct v4l2_requestbuffers req;
+
+    if (fd < 0) {
+        return ESP_OK;
+    }
+
+    if (reformat) {
+        memset(&format, 0, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        format.fmt.pix.pixelformat = capture_fmt;
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_FMT, &format) == 0, ESP_ERR_NOT_SUPPORTED, SEC_TAG,
+                            "Secondary encoder doesn't support %dx%d INPUT format (errno=%d)", width, height, errno);
+    }
+
+    /* Camera buffers are imported by their VIDIOC_EXPBUF handle, like the primary encoder does */
+    memset(&req, 0, sizeof(req));
+    req.count  = 1;
+    req.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_DMABUF;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, SEC_TAG,
+                        "Failed to request secondary INPUT buffers (errno=%d)", errno);
+
+    if (reformat) {
+        memset(&format, 0, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        format.fmt.pix.pixelformat = g_app_ctx.uvc->sec_format;
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_FMT, &format) == 0, ESP_FAIL, SEC_TAG,
+                            "Failed to set secondary OUTPUT format (errno=%d)", errno);
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.count  = 1;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, SEC_TAG,
+                        "Failed to request secondary OUTPUT buffer (errno=%d)", errno);
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = 0;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QUERYBUF, &buf) == 0, ESP_FAIL, SEC_TAG,
+                        "Failed to query secondary OUTPUT buffer (errno=%d)", errno);
+
+    g_app_ctx.uvc->sec_cap_buffer = (uint8_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED, fd, buf.m.offset);
+    APP_RETURN_ON_FALSE(g_app_ctx.uvc->sec_cap_buffer, ESP_FAIL, SEC_TAG, "Failed to mmap secondary OUTPUT buffer");
+    g_app_ctx.uvc->sec_cap_buffer_len = buf.length;
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_STREAMON, &type) == 0, ESP_FAIL, SEC_TAG,
+                        "Failed to start secondary capture streaming (errno=%d)", errno);
+
+    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_STREAMON, &type) == 0, ESP_FAIL, SEC_TAG,
+                        "Failed to start secondary output streaming (errno=%d)", errno);
+
+    s_sec_ctx.width = width;
+    s_sec_ctx.height = height;
+    ESP_LOGI(SEC_TAG, "Secondary encoder streaming %dx%d (%.4s)", width, height,
+             (const char *)&g_app_ctx.uvc->sec_format);
+
+    return ESP_OK;
+}
+
+/* Frame the secondary encoder was last started with, 0x0 if never */
+void uvc_secondary_get_frame(int *width, int *height)
+{
+    *width = s_sec_ctx.width;
+    *height = s_sec_ctx.height;
+}
+
+/* Called from video_stop_cb() once the pipeline is halted */
+void uvc_secondary_stop(void)
+{
+    int type;
+    int fd = g_app_ctx.uvc->sec_fd;
+
+    if (fd < 0) {
+        return;
+    }
+
+    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    if (ioctl(fd, VIDIOC_STREAMOFF, &type) != 0) {
+        ESP_LOGW(SEC_TAG, "Failed to stop secondary output streaming (errno=%d: %s)", errno, strerror(errno));
+    }
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd, VIDIOC_STREAMOFF, &type) != 0) {
+        ESP_LOGW(SEC_TAG, "Failed to stop secondary capture streaming (errno=%d: %s)", errno, strerror(errno));
+    }
+}
+
+#if CONFIG_EXAMPLE_DUAL_ENCODE
+/* ========== Init Phase ========== */
+void initSecondaryTask(void *arg)
+{
+    ESP_LOGI(SEC_TAG, "Initializing secondary encode task...");
+
+    /* The sink may be set before the init phase runs */
+    s_sec_ctx.encoded_count = 0;
+    memset(&s_sec_ctx.frame, 0, sizeof(s_sec_ctx.frame));
+    s_sec_ctx.frame.camera_buf_index = -1;
+    s_sec_ctx.frame.enc_buf_index = 0;
+
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_SECONDARY_IDLE);
+
+    ESP_LOGI(SEC_TAG, "Secondary encode task initialized");
+}
+
+/* Encode one raw frame into the secondary capture buffer, the raw frame is always released */
+static esp_err_t encode_secondary_frame(frame_buffer_t *raw)
+{
+    int fd = g_app_ctx.uvc->sec_fd;
+    frame_buffer_t *out = &s_sec_ctx.frame;
+    struct v4l2_buffer enc_in_buf, enc_out_buf;
+
+    memset(&enc_out_buf, 0, sizeof(enc_out_buf));
+    enc_out_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    enc_out_buf.memory = V4L2_MEMORY_MMAP;
+    enc_out_buf.index = 0;
+    if (ioctl(fd, VIDIOC_QBUF, &enc_out_buf) != 0) {
+        ESP_LOGE(SEC_TAG, "Failed to queue secondary output buffer (errno=%d: %s)", errno, strerror(errno));
+        frame_buffer_release(raw);
+        return ESP_FAIL;
+    }
+
+    memset(&enc_in_buf, 0, sizeof(enc_in_buf));
+    enc_in_buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    enc_in_buf.memory = V4L2_MEMORY_DMABUF;
+    enc_in_buf.index = 0;
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    enc_in_buf.m.fd = uvc_aux_camera_dmabuf(raw->camera_buf_index);
+#else
+    enc_in_buf.m.fd = g_app_ctx.uvc->cap_dmabuf[raw->camera_buf_index];
+#endif
+    enc_in_buf.length = raw->size;
+    enc_in_buf.timestamp.tv_sec = raw->timestamp / 1000000;
+    enc_in_buf.timestamp.tv_usec = raw->timestamp % 1000000;
+    if (ioctl(fd, VIDIOC_QBUF, &enc_in_buf) != 0) {
+        ESP_LOGE(SEC_TAG, "Failed to queue secondary input (errno=%d: %s)", errno, strerror(errno));
+        frame_buffer_release(raw);
+        return ESP_FAIL;
+    }
+
+    memset(&enc_out_buf, 0, sizeof(enc_out_buf));
+    enc_out_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    enc_out_buf.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(fd, VIDIOC_DQBUF, &enc_out_buf) != 0) {
+        ESP_LOGE(SEC_TAG, "Failed to dequeue secondary output (errno=%d: %s)", errno, strerror(errno));
+        frame_buffer_release(raw);
+        return ESP_FAIL;
+    }
+
+    out->timestamp = raw->timestamp;
+    out->frame_number = raw->frame_number;
+    os_deadline_record(TASK_SECONDARY_ENCODE, raw->dequeue_time);
+    frame_buffer_release(raw);
+
+    memset(&enc_in_buf, 0, sizeof(enc_in_buf));
+    enc_in_buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    enc_in_buf.memory = V4L2_MEMORY_DMABUF;
+    if (ioctl(fd, VIDIOC_DQBUF, &enc_in_buf) != 0) {
+        ESP_LOGE(SEC_TAG, "Failed to dequeue secondary input (errno=%d: %s)", errno, strerror(errno));
+    }
+
+    if ((enc_out_buf.flags & V4L2_BUF_FLAG_ERROR) || !enc_out_buf.bytesused) {
+        return ESP_FAIL;
+    }
+
+    out->data = g_app_ctx.uvc->sec_cap_buffer;
+    out->capacity = g_app_ctx.uvc->sec_cap_buffer_len;
+    out->size = enc_out_buf.bytesused;
+    out->flags = enc_out_buf.flags & (V4L2_BUF_FLAG_KEYFRAME | V4L2_BUF_FLAG_PFRAME | V4L2_BUF_FLAG_BFRAME);
+
+    return ESP_OK;
+}
+
+/* ========== Main Loop ========== */
+void mainSecondaryTask(void *arg)
+{
+    EventBits_t bits;
+    frame_buffer_t *raw;
+    QueueHandle_t raw_queue;
+
+    ESP_LOGI(SEC_TAG, "Secondary encode task started on core %d", xPortGetCoreID());
+
+    /* The secondary encoder is probed after the primary one */
+    uvc_app_wait_hw_ready(EVENT_ENCODER_READY, portMAX_DELAY);
+    if (g_app_ctx.uvc->sec_fd < 0) {
+        ESP_LOGI(SEC_TAG, "No secondary encoder");
+        goto exit;
+    }
+    s_sec_ctx.frame.format = g_app_ctx.uvc->sec_format;
+
+    raw_queue = os_getQueueHandler(QUEUE_SECONDARY_RAW);
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    /* The aux capture task sends to the queue directly */
+    if (!raw_queue) {
+#else
+    if (!raw_queue || uvc_capture_add_consumer(raw_queue) != ESP_OK) {
+#endif
+        ESP_LOGE(SEC_TAG, "Failed to register secondary raw frame queue");
+        goto exit;
+    }
+
+    while (1) {
+        bits = xEventGroupWaitBits(g_app_ctx.system_events,
+                                   EVENT_PIPELINE_RUN | EVENT_SHUTDOWN,
+                                   pdFALSE, pdFALSE, portMAX_DELAY);
+        if (bits & EVENT_SHUTDOWN) {
+            ESP_LOGI(SEC_TAG, "Shutdown requested");
+            break;
+        }
+        if (!(bits & EVENT_PIPELINE_RUN)) {
+            continue;
+        }
+
+        xEventGroupClearBits(g_app_ctx.system_events, EVENT_SECONDARY_IDLE);
+
+        while (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_PIPELINE_RUN) {
+            if (xQueueReceive(raw_queue, &raw, pdMS_TO_TICKS(100)) != pdTRUE) {
+                continue;
+            }
+
+            if (encode_secondary_frame(raw) != ESP_OK) {
+                continue;
+            }
+
+            g_app_ctx.total_frames_secondary++;
+            s_sec_ctx.encoded_count++;
+
+            if (s_sec_ctx.sink) {
+                s_sec_ctx.sink(&s_sec_ctx.frame, s_sec_ctx.sink_ctx);
+            }
+        }
+
+        /* Captured frames still queued hold camera buffers, give them back before going idle */
+        while (xQueueReceive(raw_queue, &raw, 0) == pdTRUE) {
+            frame_buffer_release(raw);
+        }
+
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_SECONDARY_IDLE);
+    }
+
+exit:
+    ESP_LOGI(SEC_TAG, "Secondary encode task exiting");
+    vTaskDelete(NULL);
+}
+
+/* ========== Terminate Phase ========== */
+void terSecondaryTask(void *arg)
+{
+    ESP_LOGI(SEC_TAG, "Terminating secondary encode task...");
+    ESP_LOGI(SEC_TAG, "Secondary encode task terminated, encoded %lu frames", s_sec_ctx.encoded_count);
+}
+#endif
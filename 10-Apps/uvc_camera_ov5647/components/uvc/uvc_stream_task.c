@@ -2,31 +2,151 @@
  * UVC Stream Task
  *
  * Responsibilities:
- * - Capture raw frames from camera (in UVC callbacks)
- * - Encode frames using hardware encoder
- * - Stream encoded frames via USB UVC to host PC
- * - All processing happens synchronously in video_fb_get_cb()
+ * - Configure camera and encoder streams when the host starts streaming, formats
+ *   are only set again when the host selects a different frame
+ * - Start/halt the capture and encode tasks around each UVC session
+ * - Hand encoded frames from QUEUE_ENCODED_FRAME to USB UVC in video_fb_get_cb()
+ * - Power the pipeline down once no session ran for CONFIG_EXAMPLE_IDLE_POWER_DOWN_MS
+ * - Pause the session for full-resolution JPEG stills, see uvc_app_capture_still()
+ * - Run the camera for the scan task in scan mode, see uvc_app_scan_start()
+ * - Restart a session the stall watchdog found stuck, see uvc_app_recover()
  */
 
 #include <string.h>
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "uvc_app_common.h"
+#include "uvc_latency.h"
 #include "os_interface.h"
+#include "os_boot.h"
+#include "dlog.h"
+#include "memstat.h"
+#include "uvc_watchdog.h"
+#include "uvc_qos.h"
+#include "uvc_fsync.h"
+#include "uvc_aux_camera.h"
+#include "uvc_sub_stream.h"
+#include "trace.h"
 #include "usb_device_uvc.h"
 #include "uvc_frame_config.h"
 #include "linux/videodev2.h"
+#include "esp_video_ioctl.h"
+#include "esp_video_init.h"
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN && CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+#include "tusb.h"
+#endif
+
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+#include "camera_debug.h"
+#endif
+
+#if CONFIG_EXAMPLE_BENCHMARK
+#include "uvc_benchmark.h"
+#endif
+
+/* Maximum time the UVC callback waits for the encode task */
+#define UVC_FRAME_WAIT_MS   200
+
+/* Longest time the first UVC start waits for a camera still powering up */
+#define UVC_HW_READY_WAIT_MS    3000
+
+/* Transfer buffer floor, small frames and H.264 P-frames never need more */
+#define UVC_BUFFER_MIN_SIZE (64 * 1024)
+
+/* Still buffers are carved at this alignment, enough for every DMA and cache line */
+#define STILL_BUFFER_ALIGN  256
+
+/* Scan mode decodes the newest frame, one buffer fills while the other is read */
+#define SCAN_BUFFER_COUNT   2
+
+/* Longest time a scan stop waits for the scan task to give back the camera */
+#define SCAN_IDLE_WAIT_MS   1000
+
+/*
+ * Payload ceiling of the transfer mode picked in the usb_device_uvc Kconfig on a
+ * USB 2.0 high-speed bus. An isochronous endpoint gets one 1024 byte packet per
+ * 125 us microframe, bulk has no reserved bandwidth but reaches about 40 MB/s
+ * when nothing else uses the bus.
+ */
+#if CONFIG_UVC_MODE_BULK_CAM1
+#define UVC_TRANSFER_MODE       "bulk"
+#define UVC_TRANSFER_MAX_BPS    (40 * 1000 * 1000)
+#else
+#define UVC_TRANSFER_MODE       "isochronous"
+#define UVC_TRANSFER_MAX_BPS    (1024 * 8000)
+#endif
 
 /* Task context */
 typedef struct {
     uint32_t streamed_count;
     bool uvc_initialized;
-    uvc_fb_t current_fb;
+    frame_buffer_t *current_frame;  /* Encoded frame currently owned by the host */
+
+    /* Formats currently programmed into camera and encoder */
+    bool configured;
+    int width;
+    int height;
+    int rate;
+    uint32_t capture_fmt;
+
+#if CONFIG_EXAMPLE_BENCHMARK
+    uvc_device_config_t bench_config;   /* Callbacks the benchmark drives in place of the host */
+#endif
+
+    /* Host and local sessions share the pipeline, see uvc_app_stream_start_local() */
+    SemaphoreHandle_t session_lock;
+    bool host_streaming;
+    bool local_streaming;
+    uint32_t local_users;           /* Local session is restarted when the host stops while any are left */
+    int local_width;
+    int local_height;
+    int local_rate;
+
+    /* Wake latency of the last start, reported with its first frame */
+    int64_t start_time;             /* 0 once the first frame was handed to the host */
+    bool start_cold;                /* The start woke the pipeline from power-down */
+
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN
+    esp_timer_handle_t idle_timer;
+    bool powered_down;
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t pm_lock;   /* Held unless powered down, keeps the clocks up for the pipeline */
+#endif
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+    bool pm_booted;                 /* The camera is up, the CPU lock follows the sessions from now on */
+    bool pm_max_held;
+#endif
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+    esp_pm_lock_handle_t awake_lock;    /* Held unless powered down with no USB host, no light sleep */
+    esp_timer_handle_t usb_timer;       /* Checks the USB mount while powered down */
+    bool awake_held;
+    volatile bool usb_mounted;
+#endif
+#endif
+
+#if CONFIG_EXAMPLE_STILL_CAPTURE
+    /* Still memory, allocated by the first still and kept */
+    uint8_t *still_raw;
+    uint32_t still_raw_size;
+    uint8_t *still_jpeg;
+    uint32_t still_jpeg_size;
+#endif
+
+#if CONFIG_EXAMPLE_SCAN
+    /* Scan mode owns the camera like a local session, a host session takes it over */
+    bool scan_streaming;
+    bool scan_wanted;               /* Scan mode is resumed when the host stops */
+#endif
 } uvc_stream_task_ctx_t;
 
 static uvc_stream_task_ctx_t s_uvc_ctx = {0};
@@ -36,17 +156,73 @@ static esp_err_t video_start_cb(uvc_format_t uvc_format, int width, int height,
 static void video_stop_cb(void *cb_ctx);
 static uvc_fb_t *video_fb_get_cb(void *cb_ctx);
 static void video_fb_return_cb(uvc_fb_t *fb, void *cb_ctx);
+static void release_current_frame(void);
+static esp_err_t stream_start(int width, int height, int rate);
+static esp_err_t stream_bring_up(int width, int height, int rate);
+static void stream_stop(void);
+static void stream_idle_init(void);
+static void stream_idle_start(void);
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+static void stream_pm_booted(void);
+#endif
+#if CONFIG_EXAMPLE_SCAN
+static esp_err_t scan_bring_up(void);
+static void scan_pause(void);
+#endif
+
+/* Scan mode holds the camera, the caller holds session_lock */
+static inline bool scan_active(void)
+{
+#if CONFIG_EXAMPLE_SCAN
+    return s_uvc_ctx.scan_streaming;
+#else
+    return false;
+#endif
+}
+
+/* Largest encoded frame expected for one UVC frame, before the safety margin */
+static uint32_t estimate_encoded_size(const uvc_frame_info_t *frame)
+{
+    uint32_t pixels = frame->width * frame->height;
+
+#if CONFIG_FORMAT_MJPEG_CAM1
+    /* YUV 4:2:2 input compresses to roughly 1/16 .. 1/3 depending on quality */
+    uint32_t input_size = pixels * 2;
+    uint32_t divisor = CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY <= 50 ? 16 :
+                       CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY <= 80 ? 8 :
+                       CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY <= 90 ? 5 : 3;
+
+    /* Never above what the JPEG device can output (JPEG_MAX_COMP_RATE) */
+    return MIN(input_size / divisor, input_size * 3 / 4);
+#else
+    /* An I-frame takes about 16 average frames of the bitrate budget */
+    uint32_t rate = frame->rate ? frame->rate : 30;
+    uint32_t i_frame_size = CONFIG_EXAMPLE_H264_BITRATE / 8 / rate * 16;
+
+    return MIN(i_frame_size, pixels * 3 / 2);
+#endif
+}
 
 /* ========== Init Phase ========== */
 void initUvcStreamTask(void *arg)
 {
     int index = 0;
+    uint32_t max_encoded = 0;
     uvc_device_config_t config;
+#if !CONFIG_EXAMPLE_BENCHMARK
+    memstat_snap_st snap;
+#endif
 
     ESP_LOGI(UVC_TAG, "Initializing UVC stream task...");
 
     s_uvc_ctx.streamed_count = 0;
     s_uvc_ctx.uvc_initialized = false;
+    s_uvc_ctx.session_lock = xSemaphoreCreateMutex();
+    assert(s_uvc_ctx.session_lock);
+    stream_idle_init();
+    APP_LOG_ON_ERROR(uvc_watchdog_init(), UVC_TAG, "Failed to register the stall watchdog");
+    APP_LOG_ON_ERROR(uvc_qos_init(), UVC_TAG, "Failed to register the quality governor");
+    APP_LOG_ON_ERROR(uvc_fsync_init(), UVC_TAG, "Frame sync disabled");
 
     /* Configure UVC device */
     config.start_cb     = video_start_cb;
@@ -55,26 +231,57 @@ void initUvcStreamTask(void *arg)
     config.stop_cb      = video_stop_cb;
     config.cb_ctx       = NULL;  // Not used in this implementation
 
-    config.uvc_buffer_size = UVC_FRAMES_INFO[index][0].width * UVC_FRAMES_INFO[index][0].height;
-    config.uvc_buffer = malloc(config.uvc_buffer_size);
-    assert(config.uvc_buffer);
-
     ESP_LOGI(UVC_TAG, "Format List");
     ESP_LOGI(UVC_TAG, "\tFormat(1) = %s", g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG ? "MJPEG" : "H.264");
     ESP_LOGI(UVC_TAG, "Frame List");
-    ESP_LOGI(UVC_TAG, "\tFrame(1) = %d * %d @%dfps",
-             UVC_FRAMES_INFO[index][0].width,
-             UVC_FRAMES_INFO[index][0].height,
-             UVC_FRAMES_INFO[index][0].rate);
+    for (int i = 0; i < UVC_FRAME_NUM; i++) {
+        const uvc_frame_info_t *frame = &UVC_FRAMES_INFO[index][i];
+        uint32_t encoded;
+
+        if (!frame->width || !frame->height) {
+            continue;
+        }
+        ESP_LOGI(UVC_TAG, "\tFrame(%d) = %d * %d @%dfps", i + 1, frame->width, frame->height, frame->rate);
+        encoded = estimate_encoded_size(frame);
+        max_encoded = MAX(max_encoded, encoded);
+
+        /* Frames past the ceiling are late, the host sees a lower frame rate */
+        if ((uint64_t)encoded * frame->rate > UVC_TRANSFER_MAX_BPS) {
+            ESP_LOGW(UVC_TAG, "\tFrame(%d) may need up to %lu KB/s, above the %s transfer limit of %d KB/s",
+                     i + 1, encoded / 1024 * frame->rate, UVC_TRANSFER_MODE, UVC_TRANSFER_MAX_BPS / 1024);
+        }
+    }
+    ESP_LOGI(UVC_TAG, "Transfer mode: %s", UVC_TRANSFER_MODE);
 
-    /* Initialize UVC device */
+    /* The host may select any frame of the list, size the transfer buffer for the largest */
+    config.uvc_buffer_size = max_encoded * (100 + CONFIG_EXAMPLE_UVC_BUFFER_MARGIN) / 100;
+    config.uvc_buffer_size = MAX(config.uvc_buffer_size, UVC_BUFFER_MIN_SIZE);
+    config.uvc_buffer = memstat_malloc(MEMSTAT_UVC, config.uvc_buffer_size, MALLOC_CAP_DEFAULT);
+    assert(config.uvc_buffer);
+    g_app_ctx.uvc->uvc_buffer_size = config.uvc_buffer_size;
+    ESP_LOGI(UVC_TAG, "UVC transfer buffer: %lu bytes", config.uvc_buffer_size);
+
+#if CONFIG_EXAMPLE_BENCHMARK
+    /* No USB device, the benchmark calls the callbacks from the main loop */
+    s_uvc_ctx.bench_config = config;
+#else
+    /* Initialize UVC device, TinyUSB allocates on its own */
+    memstat_snapshot(&snap);
     ESP_ERROR_CHECK(uvc_device_config(index, &config));
+    /* Second function of the composite device, a no-op unless CONFIG_EXAMPLE_UVC_SUB_STREAM */
+    ESP_ERROR_CHECK(uvc_sub_stream_config(index + 1));
     ESP_ERROR_CHECK(uvc_device_init());
+    memstat_claim(MEMSTAT_USB, &snap);
+    os_boot_mark("usb_ready");
+#endif
 
     /* Signal UVC is ready */
     xEventGroupSetBits(g_app_ctx.system_events, EVENT_UVC_READY);
 
     s_uvc_ctx.uvc_initialized = true;
+
+    /* A host that never opens the stream lets the pipeline power down as well */
+    stream_idle_start();
     ESP_LOGI(UVC_TAG, "UVC stream task initialized");
 }
 
@@ -87,19 +294,23 @@ void mainUvcStreamTask(void *arg)
     xEventGroupWaitBits(g_app_ctx.system_events, EVENT_UVC_READY,
                         pdFALSE, pdFALSE, portMAX_DELAY);
 
-    ESP_LOGI(UVC_TAG, "UVC ready - all capture/encode/stream handled in callbacks");
+    ESP_LOGI(UVC_TAG, "UVC ready - capture/encode run in their own tasks");
 
-    /* Main loop - just monitor for shutdown */
-    while (1) {
-        /* Check for shutdown */
-        if (xEventGroupGetBits(g_app_ctx.system_events) & EVENT_SHUTDOWN) {
-            ESP_LOGI(UVC_TAG, "Shutdown requested");
-            break;
-        }
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+    /* Also after a bring-up failure, the lock must not keep the clocks up for nothing */
+    uvc_app_wait_hw_ready(HW_READY_ALL, pdMS_TO_TICKS(UVC_HW_READY_WAIT_MS));
+    stream_pm_booted();
+#endif
 
-        /* All work is done in UVC callbacks (video_fb_get_cb, video_fb_return_cb) */
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
+#if CONFIG_EXAMPLE_BENCHMARK
+    uvc_app_wait_hw_ready(HW_READY_ALL, portMAX_DELAY);
+    uvc_benchmark_run(&s_uvc_ctx.bench_config);
+#endif
+
+    /* Frame hand-off is done in UVC callbacks (video_fb_get_cb, video_fb_return_cb), sleep until shutdown */
+    xEventGroupWaitBits(g_app_ctx.system_events, EVENT_SHUTDOWN,
+                        pdFALSE, pdFALSE, portMAX_DELAY);
+    ESP_LOGI(UVC_TAG, "Shutdown requested");
 
     ESP_LOGI(UVC_TAG, "UVC stream task exiting");
     vTaskDelete(NULL);
@@ -119,145 +330,314 @@ void terUvcStreamTask(void *arg)
     ESP_LOGI(UVC_TAG, "UVC stream task terminated, streamed %lu frames", s_uvc_ctx.streamed_count);
 }
 
+/* ========== Idle Power-Down ========== */
+
+/*
+ * STREAMOFF already leaves the sensor in software standby, closes the H.264
+ * encoder and releases the JPEG engine. The MIPI-CSI controller and ISP are
+ * released CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS later, until then a
+ * start only restarts the sensor stream. The IPA loop blocks without ISP
+ * statistics. Power-down then pauses the monitor and lets power management
+ * lower the clocks, a start undoes both before it touches the hardware.
+ */
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN
+static void stream_idle_timer_cb(void *arg)
+{
+    /* The session lock may be held for a while, leave the esp_timer task at once */
+    app_post_event(SYS_EVENT_POWER_DOWN, NULL, 0);
+}
+#endif
+
+/*
+ * Power management governor
+ *
+ * The CPU frequency lock is held from the start of a session to its end, and
+ * at boot until the camera is up. Between sessions DFS runs the CPU at
+ * CONFIG_EXAMPLE_PM_MIN_FREQ_MHZ. A start takes the lock before it touches
+ * the hardware, so the bring-up runs at full speed and a UVC reopen out of
+ * DFS only waits for the frequency switch.
+ *
+ * The USB controller can't wake the chip from light sleep, so light sleep is
+ * only allowed while powered down with no USB host mounted. A timer wakes the
+ * chip every CONFIG_EXAMPLE_PM_WAKE_MS meanwhile, the USB stack handles an
+ * attach in those wake-ups and the mount then keeps the chip awake.
+ */
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+static void stream_pm_hold(esp_pm_lock_handle_t lock, bool *held, bool hold)
+{
+    if (hold == *held) {
+        return;
+    }
+    if (hold) {
+        esp_pm_lock_acquire(lock);
+    } else {
+        esp_pm_lock_release(lock);
+    }
+    *held = hold;
+}
+
+/* A session starts or the last one ended, the caller holds session_lock */
+static void stream_pm_update(bool busy)
+{
+    stream_pm_hold(s_uvc_ctx.pm_lock, &s_uvc_ctx.pm_max_held, busy || !s_uvc_ctx.pm_booted);
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+    stream_pm_hold(s_uvc_ctx.awake_lock, &s_uvc_ctx.awake_held,
+                   busy || !s_uvc_ctx.powered_down || s_uvc_ctx.usb_mounted);
+#endif
+}
+#endif
+
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+static void stream_usb_timer_cb(void *arg)
+{
+    bool mounted = tud_mounted();
+
+    /* The event handler re-runs the power-down, which updates the sleep lock */
+    if (mounted != s_uvc_ctx.usb_mounted) {
+        s_uvc_ctx.usb_mounted = mounted;
+        app_post_event(SYS_EVENT_POWER_DOWN, NULL, 0);
+    }
+}
+#endif
+
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+/* The camera came up at full speed, DFS may take over once no session runs */
+static void stream_pm_booted(void)
+{
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+    s_uvc_ctx.pm_booted = true;
+    if (!s_uvc_ctx.host_streaming && !s_uvc_ctx.local_streaming && !scan_active()) {
+        stream_pm_update(false);
+    }
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+}
+#endif
+
+static void stream_idle_init(void)
+{
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN
+    const esp_timer_create_args_t timer_args = {
+        .callback = stream_idle_timer_cb,
+        .name = "uvc_idle",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_uvc_ctx.idle_timer));
+#if CONFIG_PM_ENABLE
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "uvc_pipeline", &s_uvc_ctx.pm_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(s_uvc_ctx.pm_lock));
+#endif
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+    s_uvc_ctx.pm_max_held = true;
+#endif
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+    const esp_timer_create_args_t usb_timer_args = {
+        .callback = stream_usb_timer_cb,
+        .name = "uvc_pm_usb",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&usb_timer_args, &s_uvc_ctx.usb_timer));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "uvc_awake", &s_uvc_ctx.awake_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(s_uvc_ctx.awake_lock));
+    s_uvc_ctx.awake_held = true;
+#endif
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_EXAMPLE_PM_MIN_FREQ_MHZ,
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#endif
+    };
+
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+    ESP_LOGI(UVC_TAG, "DFS between %d and %d MHz%s", CONFIG_EXAMPLE_PM_MIN_FREQ_MHZ,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, pm_config.light_sleep_enable ? ", light sleep when powered down" : "");
+#endif
+#endif
+}
+
+/* No session runs any more, the caller holds session_lock */
+static void stream_idle_start(void)
+{
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN
+    esp_timer_stop(s_uvc_ctx.idle_timer);
+    esp_timer_start_once(s_uvc_ctx.idle_timer, (uint64_t)CONFIG_EXAMPLE_IDLE_POWER_DOWN_MS * 1000);
+#endif
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+    stream_pm_update(false);
+#endif
+}
+
+/* A session starts, returns whether it wakes the pipeline from power-down, the caller holds session_lock */
+static bool stream_idle_wake(void)
+{
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN
+    /* Fails if the timer isn't running, e.g. for a takeover */
+    esp_timer_stop(s_uvc_ctx.idle_timer);
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+    stream_pm_update(true);
+#endif
+    if (!s_uvc_ctx.powered_down) {
+        return false;
+    }
+
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+    esp_timer_stop(s_uvc_ctx.usb_timer);
+#endif
+#if CONFIG_PM_ENABLE && !CONFIG_EXAMPLE_PM_GOVERNOR
+    esp_pm_lock_acquire(s_uvc_ctx.pm_lock);
+#endif
+    s_uvc_ctx.powered_down = false;
+    xEventGroupClearBits(g_app_ctx.system_events, EVENT_POWER_DOWN);
+    ESP_LOGI(UVC_TAG, "Waking from power-down");
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void uvc_app_power_down(void)
+{
+#if CONFIG_EXAMPLE_IDLE_POWER_DOWN
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    if (!s_uvc_ctx.host_streaming && !s_uvc_ctx.local_streaming && !scan_active() && !s_uvc_ctx.powered_down) {
+        s_uvc_ctx.powered_down = true;
+        xEventGroupSetBits(g_app_ctx.system_events, EVENT_POWER_DOWN);
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+        s_uvc_ctx.usb_mounted = tud_mounted();
+        esp_timer_start_periodic(s_uvc_ctx.usb_timer, (uint64_t)CONFIG_EXAMPLE_PM_WAKE_MS * 1000);
+#endif
+#if CONFIG_EXAMPLE_PM_GOVERNOR
+        /* Also ends the boot hold if no host came */
+        s_uvc_ctx.pm_booted = true;
+        stream_pm_update(false);
+#elif CONFIG_PM_ENABLE
+        esp_pm_lock_release(s_uvc_ctx.pm_lock);
+#endif
+        ESP_LOGI(UVC_TAG, "No session for %d ms, pipeline powered down", CONFIG_EXAMPLE_IDLE_POWER_DOWN_MS);
+    }
+#if CONFIG_EXAMPLE_PM_LIGHT_SLEEP
+    else if (s_uvc_ctx.powered_down) {
+        /* The USB mount changed while powered down */
+        stream_pm_update(false);
+        ESP_LOGI(UVC_TAG, "USB host %s, light sleep %s", s_uvc_ctx.usb_mounted ? "mounted" : "gone",
+                 s_uvc_ctx.awake_held ? "off" : "on");
+    }
+#endif
+
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+#endif
+}
+
 /* ========== UVC Callbacks ========== */
 
-static esp_err_t video_start_cb(uvc_format_t uvc_format, int width, int height, int rate, void *cb_ctx)
+/* Wake the pipeline if needed, then configure and start it, the caller holds session_lock */
+static esp_err_t stream_start(int width, int height, int rate)
+{
+    bool cold = stream_idle_wake();
+    int64_t start_time = esp_timer_get_time();
+    esp_err_t ret;
+
+    ret = stream_bring_up(width, height, rate);
+    if (ret != ESP_OK) {
+        stream_idle_start();
+        return ret;
+    }
+
+    s_uvc_ctx.start_time = start_time;
+    s_uvc_ctx.start_cold = cold;
+
+    return ESP_OK;
+}
+
+/* Configure and start camera and encoders, the caller holds session_lock */
+static esp_err_t stream_bring_up(int width, int height, int rate)
 {
     int type;
     struct v4l2_buffer buf;
+    struct v4l2_exportbuffer expbuf;
     struct v4l2_format format;
     struct v4l2_requestbuffers req;
-    uint32_t capture_fmt = 0;
+    struct esp_video_buffer_policy policy;
+    struct v4l2_streamparm parm;
+    uint32_t capture_fmt;
+    bool reformat;
+    esp_err_t ret;
 
     ESP_LOGI(UVC_TAG, "UVC start: %dx%d @%dfps", width, height, rate);
 
-    /* Determine capture format
-     * IMPORTANT: OV5647 outputs RAW Bayer (RGBP) by default
-     * We need to explicitly check if ISP-processed formats are available
-     */
-    if (g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG) {
-        /* Try YUV/RGB formats in order - skip RAW Bayer formats */
-        const uint32_t jpeg_input_formats[] = {
-            V4L2_PIX_FMT_YUV422P,   // Preferred: YUV 4:2:2 Planar
-            V4L2_PIX_FMT_YUYV,      // YUV 4:2:2 Packed
-            V4L2_PIX_FMT_NV12,      // YUV 4:2:0 (Y/CbCr)
-            V4L2_PIX_FMT_RGB24,     // RGB888
-            V4L2_PIX_FMT_RGB565,    // RGB565
-        };
-
-        /* List all available formats for debugging */
-        ESP_LOGI(UVC_TAG, "=== Available camera formats ===");
-        for (int i = 0; i < 10; i++) {
-            struct v4l2_fmtdesc fmtdesc = {
-                .index = i,
-                .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-            };
-            if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
-                ESP_LOGI(UVC_TAG, "  [%d] 0x%08x (%c%c%c%c): %s", i, fmtdesc.pixelformat,
-                        (char)(fmtdesc.pixelformat & 0xFF),
-                        (char)((fmtdesc.pixelformat >> 8) & 0xFF),
-                        (char)((fmtdesc.pixelformat >> 16) & 0xFF),
-                        (char)((fmtdesc.pixelformat >> 24) & 0xFF),
-                        fmtdesc.description);
-            } else {
-                break;
-            }
-        }
-
-        /* Try to find a compatible format */
-        for (int i = 0; i < 5; i++) {
-            for (int idx = 0; idx < 10; idx++) {
-                struct v4l2_fmtdesc fmtdesc = {
-                    .index = idx,
-                    .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                };
-
-                if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
-                    if (jpeg_input_formats[i] == fmtdesc.pixelformat) {
-                        capture_fmt = jpeg_input_formats[i];
-                        ESP_LOGI(UVC_TAG, "Selected format: 0x%08x (%s)", capture_fmt, fmtdesc.description);
-                        goto format_found;
-                    }
-                } else {
-                    break;
-                }
-            }
-        }
-
-format_found:
-        if (!capture_fmt) {
-            ESP_LOGW(UVC_TAG, "No preferred YUV/RGB format found, using first available");
-            struct v4l2_fmtdesc fmtdesc = {
-                .index = 0,
-                .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-            };
-            if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
-                capture_fmt = fmtdesc.pixelformat;
-                ESP_LOGI(UVC_TAG, "Using format: 0x%08x (%s)", capture_fmt, fmtdesc.description);
-            } else {
-                ESP_LOGE(UVC_TAG, "No compatible JPEG input format");
-                return ESP_ERR_NOT_SUPPORTED;
-            }
-        }
-    } else {
-        capture_fmt = V4L2_PIX_FMT_YUV420;
+    /* The host may start streaming as soon as it enumerated us, before the camera is up */
+    if (uvc_app_wait_hw_ready(HW_READY_ALL, pdMS_TO_TICKS(UVC_HW_READY_WAIT_MS)) != ESP_OK) {
+        ESP_LOGE(UVC_TAG, "Camera or encoder not ready");
+        return ESP_ERR_TIMEOUT;
     }
 
-    /* Configure camera capture stream */
-    memset(&format, 0, sizeof(format));
-    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    format.fmt.pix.width = width;
-    format.fmt.pix.height = height;
-    format.fmt.pix.pixelformat = capture_fmt;
-    
-    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_S_FMT, &format) != 0) {
-        ESP_LOGE(UVC_TAG, "Camera doesn't support %dx%d resolution (errno=%d: %s)",
-                 width, height, errno, strerror(errno));
+    /* Capture format is chosen once in uvc_app_hw_init() */
+    capture_fmt = g_app_ctx.uvc->cap_caps.capture_fmt;
+    if (!capture_fmt) {
+        ESP_LOGE(UVC_TAG, "No compatible encoder input format");
         return ESP_ERR_NOT_SUPPORTED;
     }
-    ESP_LOGI(UVC_TAG, "Camera format set: %dx%d, format=0x%x (%c%c%c%c)",
-             format.fmt.pix.width, format.fmt.pix.height, format.fmt.pix.pixelformat,
-             (char)(format.fmt.pix.pixelformat & 0xFF),
-             (char)((format.fmt.pix.pixelformat >> 8) & 0xFF),
-             (char)((format.fmt.pix.pixelformat >> 16) & 0xFF),
-             (char)((format.fmt.pix.pixelformat >> 24) & 0xFF));
 
-    /* Configure camera controls for better image quality
-     * Note: These may not be supported by all camera drivers
-     */
-    struct v4l2_control ctrl;
-
-    /* Query and list supported controls */
-    ESP_LOGI(UVC_TAG, "=== Querying camera controls ===");
-    struct v4l2_queryctrl qctrl;
-    memset(&qctrl, 0, sizeof(qctrl));
-    qctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
-    while (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_QUERYCTRL, &qctrl) == 0) {
-        ESP_LOGI(UVC_TAG, "  Control 0x%08x: %s (min=%d, max=%d, default=%d)",
-                 qctrl.id, qctrl.name, qctrl.minimum, qctrl.maximum, qctrl.default_value);
-        qctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
-    }
-
-    /* Try to enable auto white balance */
-    ctrl.id = V4L2_CID_AUTO_WHITE_BALANCE;
-    ctrl.value = 1;
-    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_S_CTRL, &ctrl) == 0) {
-        ESP_LOGI(UVC_TAG, "Auto white balance enabled");
+    /* Formats survive STREAMOFF, so only a different frame needs sensor/ISP/encoder reconfiguration */
+    reformat = !s_uvc_ctx.configured || width != s_uvc_ctx.width || height != s_uvc_ctx.height ||
+               rate != s_uvc_ctx.rate || capture_fmt != s_uvc_ctx.capture_fmt;
+    if (reformat) {
+        s_uvc_ctx.configured = false;
+
+        /* Rate first, the camera picks the cheapest sensor mode of the size below reaching it */
+        memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = rate;
+        if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_S_PARM, &parm) != 0) {
+            ESP_LOGW(UVC_TAG, "Failed to set camera frame rate (errno=%d: %s)", errno, strerror(errno));
+        } else if (parm.parm.capture.timeperframe.numerator &&
+                   parm.parm.capture.timeperframe.denominator > (uint32_t)rate * parm.parm.capture.timeperframe.numerator) {
+            /* The capture task drops the extra frames, see CONFIG_EXAMPLE_FRAME_PACING */
+            ESP_LOGI(UVC_TAG, "Sensor mode runs at %lu/%lu fps for %d fps",
+                     parm.parm.capture.timeperframe.denominator, parm.parm.capture.timeperframe.numerator, rate);
+        }
+
+        /* Configure camera capture stream */
+        memset(&format, 0, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        format.fmt.pix.pixelformat = capture_fmt;
+
+        if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_S_FMT, &format) != 0) {
+            ESP_LOGE(UVC_TAG, "Camera doesn't support %dx%d resolution (errno=%d: %s)",
+                     width, height, errno, strerror(errno));
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        ESP_LOGI(UVC_TAG, "Camera format set: %dx%d, format=0x%x (%c%c%c%c)",
+                 format.fmt.pix.width, format.fmt.pix.height, format.fmt.pix.pixelformat,
+                 (char)(format.fmt.pix.pixelformat & 0xFF),
+                 (char)((format.fmt.pix.pixelformat >> 8) & 0xFF),
+                 (char)((format.fmt.pix.pixelformat >> 16) & 0xFF),
+                 (char)((format.fmt.pix.pixelformat >> 24) & 0xFF));
     } else {
-        ESP_LOGW(UVC_TAG, "Auto white balance not supported");
+        ESP_LOGI(UVC_TAG, "Camera format unchanged, skip reconfiguration");
     }
 
-    /* Try to enable auto exposure */
-    ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-    ctrl.value = V4L2_EXPOSURE_AUTO;
-    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_S_CTRL, &ctrl) == 0) {
-        ESP_LOGI(UVC_TAG, "Auto exposure enabled");
-    } else {
-        ESP_LOGW(UVC_TAG, "Auto exposure not supported");
+    /* First cap_hot_count camera buffers go to internal RAM, the rest use the device default (PSRAM) */
+    memset(&policy, 0, sizeof(policy));
+    policy.type      = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    policy.hot_count = g_app_ctx.uvc->cap_hot_count;
+    policy.hot_caps  = MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT | MALLOC_CAP_CACHE_ALIGNED;
+#if CONFIG_EXAMPLE_CAPTURE_LATEST_FRAME
+    policy.flags     = ESP_VIDEO_BUFFER_FLAG_DROP_OLDEST;
+#endif
+    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_S_BUF_POLICY, &policy) != 0) {
+        ESP_LOGW(UVC_TAG, "Failed to set camera buffer policy (errno=%d: %s)",
+                 errno, strerror(errno));
     }
 
     memset(&req, 0, sizeof(req));
-    req.count  = BUFFER_COUNT;
+    req.count  = g_app_ctx.uvc->cap_buffer_count;
     req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
     
@@ -267,7 +647,7 @@ format_found:
         return ESP_FAIL;
     }
 
-    for (int i = 0; i < BUFFER_COUNT; i++) {
+    for (int i = 0; i < g_app_ctx.uvc->cap_buffer_count; i++) {
         memset(&buf, 0, sizeof(buf));
         buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         buf.memory = V4L2_MEMORY_MMAP;
@@ -288,7 +668,18 @@ format_found:
             ESP_LOGE(UVC_TAG, "Failed to mmap camera buffer %d", i);
             return ESP_FAIL;
         }
-        
+
+        /* Encoder INPUT imports the camera buffer by this handle instead of a raw pointer */
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = i;
+        if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_EXPBUF, &expbuf) != 0) {
+            ESP_LOGE(UVC_TAG, "Failed to export camera buffer %d (errno=%d: %s)",
+                     i, errno, strerror(errno));
+            return ESP_FAIL;
+        }
+        g_app_ctx.uvc->cap_dmabuf[i] = expbuf.fd;
+
         if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_QBUF, &buf) != 0) {
             ESP_LOGE(UVC_TAG, "Failed to queue camera buffer %d (errno=%d: %s)", 
                      i, errno, strerror(errno));
@@ -296,6 +687,9 @@ format_found:
         }
     }
     
+    /* The sensor starts its first frame at a trigger edge */
+    APP_LOG_ON_ERROR(uvc_fsync_arm(rate), UVC_TAG, "Sensor runs without the frame sync trigger");
+
     /* Start camera capture streaming */
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_STREAMON, &type) != 0) {
@@ -306,40 +700,26 @@ format_found:
     ESP_LOGI(UVC_TAG, "Camera capture streaming started");
 
     /* Configure encoder streams */
-    memset(&format, 0, sizeof(format));
-    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    format.fmt.pix.width = width;
-    format.fmt.pix.height = height;
-    format.fmt.pix.pixelformat = capture_fmt;
-    
-    if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_FMT, &format) != 0) {
-        ESP_LOGE(UVC_TAG, "Encoder doesn't support %dx%d INPUT format (errno=%d: %s)", 
-                 width, height, errno, strerror(errno));
-        return ESP_ERR_NOT_SUPPORTED;
-    }
-    ESP_LOGI(UVC_TAG, "Encoder INPUT format set: %dx%d", format.fmt.pix.width, format.fmt.pix.height);
-    
-    /* Calculate output buffer size from format */
-    size_t out_buf_size = format.fmt.pix.sizeimage;
-    if (out_buf_size == 0) {
-        out_buf_size = width * height * 3 / 2;  /* Estimate for YUV */
+    if (reformat) {
+        memset(&format, 0, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        format.fmt.pix.pixelformat = capture_fmt;
+
+        if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_FMT, &format) != 0) {
+            ESP_LOGE(UVC_TAG, "Encoder doesn't support %dx%d INPUT format (errno=%d: %s)", 
+                     width, height, errno, strerror(errno));
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        ESP_LOGI(UVC_TAG, "Encoder INPUT format set: %dx%d", format.fmt.pix.width, format.fmt.pix.height);
     }
-    
-    /* For encoder INPUT buffer, we have two options:
-     * 1. Allocate DMA buffer (limited by internal RAM reserved for DMA ~32KB)
-     * 2. Use PSRAM buffer and let encoder's DMA handle it (may not work)
-     * 
-     * Since internal DMA pool is limited, we'll skip allocating intermediate buffer
-     * and handle errors in encoding task instead.
-     */
-    g_app_ctx.uvc->m2m_out_buffer = NULL;
-    g_app_ctx.uvc->m2m_out_buffer_size = 0;
-    ESP_LOGI(UVC_TAG, "Encoder INPUT buffer strategy: Send PSRAM frame directly (no intermediate buffer)");
 
+    /* Encoder INPUT imports the camera buffer by its VIDIOC_EXPBUF handle, no intermediate copy */
     memset(&req, 0, sizeof(req));
     req.count  = 1;
     req.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    req.memory = V4L2_MEMORY_USERPTR;
+    req.memory = V4L2_MEMORY_DMABUF;
     
     if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_REQBUFS, &req) != 0) {
         ESP_LOGE(UVC_TAG, "Failed to request encoder INPUT buffers (errno=%d: %s)", 
@@ -347,23 +727,40 @@ format_found:
         return ESP_FAIL;
     }
 
-    memset(&format, 0, sizeof(format));
-    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    format.fmt.pix.width = width;
-    format.fmt.pix.height = height;
-    format.fmt.pix.pixelformat = g_app_ctx.uvc->format;
-    
-    if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_FMT, &format) != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to set encoder OUTPUT format (errno=%d: %s)", 
-                 errno, strerror(errno));
-        return ESP_FAIL;
+    if (reformat) {
+        memset(&format, 0, sizeof(format));
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        format.fmt.pix.pixelformat = g_app_ctx.uvc->format;
+
+        if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_FMT, &format) != 0) {
+            ESP_LOGE(UVC_TAG, "Failed to set encoder OUTPUT format (errno=%d: %s)", 
+                     errno, strerror(errno));
+            return ESP_FAIL;
+        }
+        ESP_LOGI(UVC_TAG, "Encoder OUTPUT format set: %dx%d %s", 
+                 format.fmt.pix.width, format.fmt.pix.height,
+                 g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG ? "JPEG" : "H.264");
+
+#if CONFIG_FORMAT_MJPEG_CAM1 && CONFIG_EXAMPLE_JPEG_RESTART_ROWS
+        /* Restart interval counts MCUs, which are 16 pixels wide for YUV input */
+        struct v4l2_ext_controls controls;
+        struct v4l2_ext_control control[1];
+
+        controls.ctrl_class = V4L2_CID_JPEG_CLASS;
+        controls.count      = 1;
+        controls.controls   = control;
+        control[0].id       = V4L2_CID_JPEG_RESTART_INTERVAL;
+        control[0].value    = CONFIG_EXAMPLE_JPEG_RESTART_ROWS * ((width + 15) / 16);
+        if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
+            ESP_LOGW(UVC_TAG, "Failed to set JPEG restart interval, encoding whole frames");
+        }
+#endif
     }
-    ESP_LOGI(UVC_TAG, "Encoder OUTPUT format set: %dx%d %s", 
-             format.fmt.pix.width, format.fmt.pix.height,
-             g_app_ctx.uvc->format == V4L2_PIX_FMT_JPEG ? "JPEG" : "H.264");
 
     memset(&req, 0, sizeof(req));
-    req.count  = 1;
+    req.count  = ENCODED_FRAME_COUNT;
     req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
     
@@ -373,33 +770,47 @@ format_found:
         return ESP_FAIL;
     }
 
-    memset(&buf, 0, sizeof(buf));
-    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    buf.index  = 0;
-    
-    if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_QUERYBUF, &buf) != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to query encoder OUTPUT buffer (errno=%d: %s)", 
-                 errno, strerror(errno));
-        return ESP_FAIL;
+    /* Buffers are queued one at a time by the encode task, right before each encode */
+    for (int i = 0; i < ENCODED_FRAME_COUNT; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index  = i;
+
+        if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_QUERYBUF, &buf) != 0) {
+            ESP_LOGE(UVC_TAG, "Failed to query encoder OUTPUT buffer %d (errno=%d: %s)", 
+                     i, errno, strerror(errno));
+            return ESP_FAIL;
+        }
+
+        g_app_ctx.uvc->m2m_cap_buffer[i] = (uint8_t *)mmap(NULL, buf.length,
+                                                            PROT_READ | PROT_WRITE,
+                                                            MAP_SHARED,
+                                                            g_app_ctx.uvc->m2m_fd,
+                                                            buf.m.offset);
+        if (!g_app_ctx.uvc->m2m_cap_buffer[i]) {
+            ESP_LOGE(UVC_TAG, "Failed to mmap encoder OUTPUT buffer %d", i);
+            return ESP_FAIL;
+        }
+        g_app_ctx.uvc->m2m_cap_buffer_len = buf.length;
     }
+    ESP_LOGD(UVC_TAG, "%d encoder capture buffers mapped, %lu bytes each",
+             ENCODED_FRAME_COUNT, g_app_ctx.uvc->m2m_cap_buffer_len);
 
-    g_app_ctx.uvc->m2m_cap_buffer = (uint8_t *)mmap(NULL, buf.length,
-                                                     PROT_READ | PROT_WRITE,
-                                                     MAP_SHARED,
-                                                     g_app_ctx.uvc->m2m_fd,
-                                                     buf.m.offset);
-    if (!g_app_ctx.uvc->m2m_cap_buffer) {
-        ESP_LOGE(UVC_TAG, "Failed to mmap encoder OUTPUT buffer");
-        return ESP_FAIL;
+    /* H.264 rate control and VUI timing follow the frame rate the host picked */
+    ret = uvc_app_h264_set_frame_rate(rate ? rate : 30);
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGW(UVC_TAG, "H.264 frame rate not set, rate control assumes the default");
     }
-    
-    if (ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_QBUF, &buf) != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to queue initial encoder capture buffer (errno=%d: %s)", 
-                 errno, strerror(errno));
-        return ESP_FAIL;
+
+#if CONFIG_FORMAT_MJPEG_CAM1 && CONFIG_EXAMPLE_JPEG_TARGET_KBPS
+    /* JPEG quality follows the bitrate budget at the frame rate the host picked */
+    ret = uvc_app_jpeg_set_target_size((uint64_t)CONFIG_EXAMPLE_JPEG_TARGET_KBPS * 1000 / 8 / (rate ? rate : 30),
+                                       CONFIG_EXAMPLE_JPEG_MIN_QUALITY, CONFIG_EXAMPLE_JPEG_COMPRESSION_QUALITY);
+    if (ret != ESP_OK) {
+        ESP_LOGW(UVC_TAG, "JPEG target size not set, quality stays fixed");
     }
-    ESP_LOGD(UVC_TAG, "Encoder capture buffer queued at startup");
+#endif
 
     /* Start streaming */
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -418,6 +829,43 @@ format_found:
     }
     ESP_LOGD(UVC_TAG, "Encoder output streaming started");
 
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    /* Secondary encoder follows the aux camera, which doesn't stop the UVC stream if it fails */
+    APP_LOG_ON_ERROR(uvc_aux_camera_start(), UVC_TAG, "Aux camera not streaming");
+#else
+    /* No-op unless dual encoding found a second encoder at init */
+    if (uvc_secondary_start(width, height, capture_fmt, reformat) != ESP_OK) {
+        ESP_LOGE(UVC_TAG, "Failed to start secondary encoder");
+        return ESP_FAIL;
+    }
+#endif
+
+    if (reformat) {
+        /* First configuration is not a change, nor is the restore after a still */
+        bool changed = s_uvc_ctx.width &&
+                       (width != s_uvc_ctx.width || height != s_uvc_ctx.height || rate != s_uvc_ctx.rate);
+
+        s_uvc_ctx.width = width;
+        s_uvc_ctx.height = height;
+        s_uvc_ctx.rate = rate;
+        s_uvc_ctx.capture_fmt = capture_fmt;
+        s_uvc_ctx.configured = true;
+        if (changed) {
+            app_post_event(SYS_EVENT_CHANGE_RESOLUTION, NULL, 0);
+        }
+    }
+    g_app_ctx.stream_width = width;
+    g_app_ctx.stream_height = height;
+    g_app_ctx.stream_fps = rate;
+#ifdef CONFIG_CAMERA_DEBUG_ENABLE
+    camera_debug_set_h264_target(0, rate);
+#endif
+
+    /* Let the capture and encode tasks run */
+    uvc_watchdog_arm(rate);
+    uvc_qos_arm(rate);
+    uvc_pipeline_run();
+
     /* Signal streaming is active */
     app_post_event(SYS_EVENT_START_STREAM, NULL, 0);
     ESP_LOGI(UVC_TAG, "UVC streaming initialized successfully (format: 0x%x, %dx%d @ %d fps)", 
@@ -426,12 +874,18 @@ format_found:
     return ESP_OK;
 }
 
-static void video_stop_cb(void *cb_ctx)
+/* Halt the pipeline and stop camera and encoders, the caller holds session_lock */
+static void stream_pause(void)
 {
     int type;
     int ret;
 
-    ESP_LOGI(UVC_TAG, "UVC stop callback");
+    /* A stall of the pipeline which is going down doesn't matter any more */
+    uvc_watchdog_disarm();
+    uvc_qos_disarm();
+
+    /* Waits for every encoded frame to be released, the host's one included */
+    APP_LOG_ON_ERROR(uvc_pipeline_halt(), UVC_TAG, "Pipeline halt incomplete");
 
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     ret = ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_STREAMOFF, &type);
@@ -457,123 +911,775 @@ static void video_stop_cb(void *cb_ctx)
         ESP_LOGD(UVC_TAG, "Encoder capture streaming stopped");
     }
 
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    uvc_aux_camera_stop();
+#else
+    uvc_secondary_stop();
+#endif
+}
+
+/* End the session, the caller holds session_lock */
+static void stream_stop(void)
+{
+    ESP_LOGI(UVC_TAG, "UVC stop");
+
+    /* The host is done with its frame */
+    release_current_frame();
+    stream_pause();
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+    /* The next boot starts from what this session converged to */
+    APP_LOG_ON_ERROR(esp_video_isp_pipeline_save(), UVC_TAG, "Failed to save the ISP state");
+#endif
+
     /* Signal streaming stopped */
     app_post_event(SYS_EVENT_STOP_STREAM, NULL, 0);
     ESP_LOGI(UVC_TAG, "UVC streaming stopped");
+
+    /* Cancelled by the next start, e.g. right away for a takeover */
+    s_uvc_ctx.start_time = 0;
+    uvc_watchdog_reset();
+    stream_idle_start();
 }
 
-static uvc_fb_t *video_fb_get_cb(void *cb_ctx)
+static esp_err_t video_start_cb(uvc_format_t uvc_format, int width, int height, int rate, void *cb_ctx)
 {
-    struct v4l2_buffer cam_buf, enc_in_buf, enc_out_buf;
-    int ret;
+    esp_err_t ret;
 
-    /* Step 1: Dequeue frame from camera */
-    memset(&cam_buf, 0, sizeof(cam_buf));
-    cam_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    cam_buf.memory = V4L2_MEMORY_MMAP;
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
 
-    ret = ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_DQBUF, &cam_buf);
-    if (ret != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to dequeue camera frame (errno=%d: %s)", errno, strerror(errno));
-        return NULL;
+    /* The host takes over a local session with the frame it picked */
+    if (s_uvc_ctx.local_streaming) {
+        ESP_LOGI(UVC_TAG, "Host takes over the local session");
+        stream_stop();
+        s_uvc_ctx.local_streaming = false;
     }
+#if CONFIG_EXAMPLE_SCAN
+    if (s_uvc_ctx.scan_streaming) {
+        ESP_LOGI(UVC_TAG, "Host takes over scan mode");
+        scan_pause();
+        s_uvc_ctx.scan_streaming = false;
+    }
+#endif
+    ret = stream_start(width, height, rate);
+    s_uvc_ctx.host_streaming = ret == ESP_OK;
 
-    ESP_LOGD(UVC_TAG, "Camera frame captured: index=%d, size=%u bytes",
-             cam_buf.index, cam_buf.bytesused);
+    xSemaphoreGive(s_uvc_ctx.session_lock);
 
-    /* Update statistics */
-    g_app_ctx.total_frames_captured++;
+    return ret;
+}
 
-    /* Step 2: Queue camera frame to encoder INPUT */
-    memset(&enc_in_buf, 0, sizeof(enc_in_buf));
-    enc_in_buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    enc_in_buf.memory = V4L2_MEMORY_USERPTR;
-    enc_in_buf.index = 0;
-    enc_in_buf.m.userptr = (unsigned long)g_app_ctx.uvc->cap_buffer[cam_buf.index];
-    enc_in_buf.length = cam_buf.bytesused;  // Length is the data size for USERPTR mode
+static void video_stop_cb(void *cb_ctx)
+{
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    stream_stop();
+    s_uvc_ctx.host_streaming = false;
+
+#if CONFIG_EXAMPLE_SCAN
+    /* Scan mode comes back first, it stops a local session while it runs */
+    if (s_uvc_ctx.scan_wanted) {
+        ESP_LOGI(UVC_TAG, "Resuming scan mode");
+        stream_idle_wake();
+        s_uvc_ctx.scan_streaming = scan_bring_up() == ESP_OK;
+        if (!s_uvc_ctx.scan_streaming) {
+            stream_idle_start();
+        }
+        xSemaphoreGive(s_uvc_ctx.session_lock);
+        return;
+    }
+#endif
 
-    ret = ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_QBUF, &enc_in_buf);
-    if (ret != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to queue encoder input (errno=%d: %s)", errno, strerror(errno));
+    /* Local users keep streaming once the host is gone */
+    if (s_uvc_ctx.local_users) {
+        ESP_LOGI(UVC_TAG, "Resuming the local session");
+        s_uvc_ctx.local_streaming = stream_start(s_uvc_ctx.local_width, s_uvc_ctx.local_height,
+                                                 s_uvc_ctx.local_rate) == ESP_OK;
+    }
 
-        /* Return camera buffer */
-        ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_QBUF, &cam_buf);
-        return NULL;
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+}
+
+/* ========== Local Sessions ========== */
+
+esp_err_t uvc_app_stream_start_local(int width, int height, int rate)
+{
+    esp_err_t ret = ESP_OK;
+
+    APP_RETURN_ON_FALSE(s_uvc_ctx.uvc_initialized, ESP_ERR_INVALID_STATE, UVC_TAG,
+                        "UVC stream task not initialized");
+
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    /* The first user picks the frame, later ones share its session */
+    if (!s_uvc_ctx.local_users) {
+        s_uvc_ctx.local_width = width;
+        s_uvc_ctx.local_height = height;
+        s_uvc_ctx.local_rate = rate;
     }
 
-    ESP_LOGD(UVC_TAG, "Encoder input queued: addr=%p, length=%u",
-             (void*)enc_in_buf.m.userptr, enc_in_buf.length);
+    /* A host session already feeds every consumer, scan mode starts the session when it stops */
+    if (!s_uvc_ctx.host_streaming && !s_uvc_ctx.local_streaming && !scan_active()) {
+        ESP_LOGI(UVC_TAG, "Local session start");
+        ret = stream_start(s_uvc_ctx.local_width, s_uvc_ctx.local_height, s_uvc_ctx.local_rate);
+        s_uvc_ctx.local_streaming = ret == ESP_OK;
+    }
+    if (ret == ESP_OK) {
+        s_uvc_ctx.local_users++;
+    }
 
-    /* Step 3: Dequeue encoded frame from encoder OUTPUT (this triggers encoding) */
-    memset(&enc_out_buf, 0, sizeof(enc_out_buf));
-    enc_out_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    enc_out_buf.memory = V4L2_MEMORY_MMAP;
+    xSemaphoreGive(s_uvc_ctx.session_lock);
 
-    ret = ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_DQBUF, &enc_out_buf);
-    if (ret != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to dequeue encoder output (errno=%d: %s)", errno, strerror(errno));
+    return ret;
+}
 
-        /* Return camera buffer */
-        ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_QBUF, &cam_buf);
-        return NULL;
+void uvc_app_stream_stop_local(void)
+{
+    if (!s_uvc_ctx.uvc_initialized) {
+        return;
     }
 
-    ESP_LOGD(UVC_TAG, "Encoded frame ready: size=%u bytes", enc_out_buf.bytesused);
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
 
-    /* Step 4: Return camera buffer to camera queue */
-    ret = ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_QBUF, &cam_buf);
-    if (ret != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to return camera buffer (errno=%d: %s)", errno, strerror(errno));
-        /* Continue anyway - encoder output is ready */
+    /* The session ends with its last user */
+    if (s_uvc_ctx.local_users && --s_uvc_ctx.local_users == 0 && s_uvc_ctx.local_streaming) {
+        ESP_LOGI(UVC_TAG, "Local session stop");
+        stream_stop();
+        s_uvc_ctx.local_streaming = false;
     }
 
-    /* Step 5: Dequeue encoder INPUT buffer (now that encoding is done) */
-    memset(&enc_in_buf, 0, sizeof(enc_in_buf));
-    enc_in_buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    enc_in_buf.memory = V4L2_MEMORY_USERPTR;
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+}
 
-    ret = ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_DQBUF, &enc_in_buf);
-    if (ret != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to dequeue encoder input (errno=%d: %s)", errno, strerror(errno));
-        /* Not critical - encoder output is already available */
+static uvc_fb_t *video_fb_get_cb(void *cb_ctx)
+{
+    frame_buffer_t *frame;
+    QueueHandle_t enc_queue = os_getQueueHandler(QUEUE_ENCODED_FRAME);
+    TRACE_BEGIN(get_start);
+
+    if (!enc_queue) {
+        return NULL;
+    }
+
+    /* Encode task keeps this queue filled, we only wait for the next frame */
+    if (xQueueReceive(enc_queue, &frame, pdMS_TO_TICKS(UVC_FRAME_WAIT_MS)) != pdTRUE) {
+        DLOGD(UVC_TAG, "No encoded frame within %d ms", UVC_FRAME_WAIT_MS);
+        return NULL;
     }
 
-    ESP_LOGD(UVC_TAG, "Encoder input buffer returned");
+    s_uvc_ctx.current_frame = frame;
 
-    /* Update statistics */
-    g_app_ctx.total_frames_encoded++;
+    if (s_uvc_ctx.start_time) {
+        ESP_LOGI(UVC_TAG, "First frame %lld ms after the %s start",
+                 (esp_timer_get_time() - s_uvc_ctx.start_time) / 1000, s_uvc_ctx.start_cold ? "cold" : "warm");
+        s_uvc_ctx.start_time = 0;
+        os_boot_done();
+    }
 
-    /* Step 6: Prepare UVC frame buffer */
-    g_app_ctx.uvc->fb.buf = g_app_ctx.uvc->m2m_cap_buffer;
-    g_app_ctx.uvc->fb.len = enc_out_buf.bytesused;
-    g_app_ctx.uvc->fb.timestamp.tv_sec = enc_out_buf.timestamp.tv_sec;
-    g_app_ctx.uvc->fb.timestamp.tv_usec = enc_out_buf.timestamp.tv_usec;
+    /*
+     * usb_device_uvc copies the frame into its transfer buffer and returns it right
+     * away, TinyUSB then copies each payload behind its header into the endpoint
+     * buffer. Neither takes a header/payload list, so the encoder buffer can't be
+     * sent in place, the first copy at least frees it for the next frame early.
+     */
+    g_app_ctx.uvc->fb.buf = frame->data;
+    g_app_ctx.uvc->fb.len = frame->size;
+    g_app_ctx.uvc->fb.timestamp.tv_sec = frame->timestamp / 1000000;
+    g_app_ctx.uvc->fb.timestamp.tv_usec = frame->timestamp % 1000000;
 
     /* Update streaming statistics */
     g_app_ctx.total_frames_streamed++;
     s_uvc_ctx.streamed_count++;
 
-    ESP_LOGD(UVC_TAG, "Returning encoded frame to UVC: %u bytes", g_app_ctx.uvc->fb.len);
+    DLOGD(UVC_TAG, "Returning encoded frame %lu to UVC: %u bytes", frame->frame_number, frame->size);
+    TRACE_END(TRACE_UVC_FB_GET, get_start, frame->size);
 
     return &g_app_ctx.uvc->fb;
 }
 
+/* Drop the host's reference, the frame goes back to the free pool once sinks are done with it too */
+static void release_current_frame(void)
+{
+    frame_buffer_release(s_uvc_ctx.current_frame);
+    s_uvc_ctx.current_frame = NULL;
+}
+
 static void video_fb_return_cb(uvc_fb_t *fb, void *cb_ctx)
 {
-    struct v4l2_buffer enc_out_buf;
-    int ret;
+    TRACE_INSTANT(TRACE_UVC_FB_RETURN, fb->len);
 
-    /* Re-queue encoder output buffer for next frame */
-    memset(&enc_out_buf, 0, sizeof(enc_out_buf));
-    enc_out_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    enc_out_buf.memory = V4L2_MEMORY_MMAP;
-    enc_out_buf.index = 0;
+    if (s_uvc_ctx.current_frame) {
+        int64_t now = esp_timer_get_time();
 
-    ret = ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_QBUF, &enc_out_buf);
-    if (ret != 0) {
-        ESP_LOGE(UVC_TAG, "Failed to re-queue encoder output buffer (errno=%d: %s)",
-                 errno, strerror(errno));
+        uvc_latency_record(LAT_STAGE_USB, s_uvc_ctx.current_frame->dequeue_time, now);
+        uvc_qos_record(UVC_QOS_USB, s_uvc_ctx.current_frame->dequeue_time, now);
+        uvc_latency_record(LAT_STAGE_TOTAL, s_uvc_ctx.current_frame->timestamp, now);
+        /* The hand-off is done when the host returns the buffer */
+        os_deadline_record(TASK_UVC_STREAM, s_uvc_ctx.current_frame->dequeue_time);
+    }
+    release_current_frame();
+    DLOGD(UVC_TAG, "Encoded frame returned to pool");
+}
+
+/* ========== Still Capture ========== */
+
+#if CONFIG_EXAMPLE_STILL_CAPTURE
+/* Bytes of one camera frame of the encoder input formats */
+static uint32_t still_frame_size(uint32_t pixelformat)
+{
+    uint32_t pixels = CONFIG_EXAMPLE_STILL_WIDTH * CONFIG_EXAMPLE_STILL_HEIGHT;
+
+    switch (pixelformat) {
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_NV12:
+        return pixels * 3 / 2;
+    case V4L2_PIX_FMT_RGB24:
+        return pixels * 3;
+    default:
+        return pixels * 2;
+    }
+}
+
+/*
+ * Camera and JPEG buffers of the still are carved from memory kept from the
+ * first still on, so a still never waits for or fails on a large PSRAM block.
+ */
+static esp_err_t still_alloc(uint32_t capture_fmt)
+{
+    uint32_t raw_size = roundup(still_frame_size(capture_fmt), STILL_BUFFER_ALIGN);
+    /* The JPEG device sizes its output for 3/4 of the input */
+    uint32_t jpeg_size = roundup(raw_size * 3 / 4 + STILL_BUFFER_ALIGN, STILL_BUFFER_ALIGN);
+
+    if (s_uvc_ctx.still_raw && s_uvc_ctx.still_raw_size >= raw_size) {
+        return ESP_OK;
+    }
+
+    memstat_free(MEMSTAT_UVC, s_uvc_ctx.still_raw);
+    memstat_free(MEMSTAT_UVC, s_uvc_ctx.still_jpeg);
+    s_uvc_ctx.still_raw = memstat_aligned_alloc(MEMSTAT_UVC, STILL_BUFFER_ALIGN, raw_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+    s_uvc_ctx.still_jpeg = memstat_aligned_alloc(MEMSTAT_UVC, STILL_BUFFER_ALIGN, jpeg_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+    if (!s_uvc_ctx.still_raw || !s_uvc_ctx.still_jpeg) {
+        memstat_free(MEMSTAT_UVC, s_uvc_ctx.still_raw);
+        memstat_free(MEMSTAT_UVC, s_uvc_ctx.still_jpeg);
+        s_uvc_ctx.still_raw = NULL;
+        s_uvc_ctx.still_jpeg = NULL;
+        ESP_LOGE(UVC_TAG, "No PSRAM for the %d x %d still", CONFIG_EXAMPLE_STILL_WIDTH, CONFIG_EXAMPLE_STILL_HEIGHT);
+        return ESP_ERR_NO_MEM;
+    }
+    s_uvc_ctx.still_raw_size = raw_size;
+    s_uvc_ctx.still_jpeg_size = jpeg_size;
+    ESP_LOGI(UVC_TAG, "Still buffers: %lu + %lu bytes", raw_size, jpeg_size);
+
+    return ESP_OK;
+}
+
+/* Place the buffers of the next VIDIOC_REQBUFS of a stream in mem, NULL for the device default */
+static void still_set_policy(int fd, uint32_t type, void *mem, uint32_t mem_size)
+{
+    struct esp_video_buffer_policy policy;
+
+    memset(&policy, 0, sizeof(policy));
+    policy.type     = type;
+    policy.mem      = mem;
+    policy.mem_size = mem_size;
+    if (ioctl(fd, VIDIOC_S_BUF_POLICY, &policy) != 0) {
+        ESP_LOGW(UVC_TAG, "Failed to set still buffer policy (errno=%d: %s)", errno, strerror(errno));
+    }
+}
+
+/* Still quality over one whole-frame pass, returns the streaming quality for the restore */
+static esp_err_t still_set_jpeg_ctrls(int *stream_quality)
+{
+    struct v4l2_ext_controls controls;
+    struct v4l2_ext_control control[3];
+
+    controls.ctrl_class = V4L2_CID_JPEG_CLASS;
+    controls.count      = 1;
+    controls.controls   = control;
+    control[0].id       = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    APP_RETURN_ON_FALSE(ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_G_EXT_CTRLS, &controls) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to get JPEG quality (errno=%d)", errno);
+    *stream_quality = control[0].value;
+
+    /* Rate control and restart intervals are set again by the next stream start */
+    controls.count      = 3;
+    control[0].value    = CONFIG_EXAMPLE_STILL_JPEG_QUALITY;
+    control[1].id       = V4L2_CID_JPEG_ESP_TARGET_SIZE;
+    control[1].value    = 0;
+    control[2].id       = V4L2_CID_JPEG_RESTART_INTERVAL;
+    control[2].value    = 0;
+    APP_RETURN_ON_FALSE(ioctl(g_app_ctx.uvc->m2m_fd, VIDIOC_S_EXT_CTRLS, &controls) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to set still JPEG quality (errno=%d)", errno);
+
+    return ESP_OK;
+}
+
+/* Encode the camera buffer exported as dmabuf and pass the JPEG to cb */
+static esp_err_t still_encode(uint32_t capture_fmt, int dmabuf, const struct v4l2_buffer *raw,
+                              uvc_still_cb_t cb, void *ctx)
+{
+    int type;
+    uint8_t *jpeg;
+    struct v4l2_buffer buf;
+    struct v4l2_format format;
+    struct v4l2_requestbuffers req;
+    frame_buffer_t still;
+    int fd = g_app_ctx.uvc->m2m_fd;
+    int stream_quality;
+    esp_err_t ret = ESP_FAIL;
+
+    APP_RETURN_ON_ERROR(still_set_jpeg_ctrls(&stream_quality), UVC_TAG, "JPEG encoder not set up for the still");
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.width = CONFIG_EXAMPLE_STILL_WIDTH;
+    format.fmt.pix.height = CONFIG_EXAMPLE_STILL_HEIGHT;
+    format.fmt.pix.pixelformat = capture_fmt;
+    if (ioctl(fd, VIDIOC_S_FMT, &format) != 0) {
+        ESP_LOGE(UVC_TAG, "Encoder doesn't support the still INPUT format (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_JPEG;
+    if (ioctl(fd, VIDIOC_S_FMT, &format) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to set the still OUTPUT format (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.count  = 1;
+    req.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_DMABUF;
+    if (ioctl(fd, VIDIOC_REQBUFS, &req) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to request the still INPUT buffer (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    still_set_policy(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, s_uvc_ctx.still_jpeg, s_uvc_ctx.still_jpeg_size);
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(fd, VIDIOC_REQBUFS, &req) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to request the still OUTPUT buffer (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = 0;
+    if (ioctl(fd, VIDIOC_QUERYBUF, &buf) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to query the still OUTPUT buffer (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+    jpeg = (uint8_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+    if (!jpeg) {
+        ESP_LOGE(UVC_TAG, "Failed to mmap the still OUTPUT buffer");
+        goto exit;
+    }
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd, VIDIOC_STREAMON, &type) != 0 || ioctl(fd, VIDIOC_QBUF, &buf) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to start the still OUTPUT (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    if (ioctl(fd, VIDIOC_STREAMON, &type) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to start the still INPUT (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type      = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.memory    = V4L2_MEMORY_DMABUF;
+    buf.index     = 0;
+    buf.m.fd      = dmabuf;
+    buf.length    = raw->bytesused;
+    buf.timestamp = raw->timestamp;
+    if (ioctl(fd, VIDIOC_QBUF, &buf) != 0) {
+        ESP_LOGE(UVC_TAG, "Failed to queue the still frame (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    /* Dequeueing the output runs the encode */
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(fd, VIDIOC_DQBUF, &buf) != 0 || (buf.flags & V4L2_BUF_FLAG_ERROR) || !buf.bytesused) {
+        ESP_LOGE(UVC_TAG, "Failed to encode the still (errno=%d: %s)", errno, strerror(errno));
+        goto exit;
+    }
+
+    memset(&still, 0, sizeof(still));
+    still.data = jpeg;
+    still.size = buf.bytesused;
+    still.capacity = buf.length;
+    still.timestamp = (int64_t)raw->timestamp.tv_sec * 1000000 + raw->timestamp.tv_usec;
+    still.format = V4L2_PIX_FMT_JPEG;
+    still.flags = V4L2_BUF_FLAG_KEYFRAME;
+    still.camera_buf_index = -1;
+    still.enc_buf_index = -1;
+    ESP_LOGI(UVC_TAG, "Still %d x %d: %u bytes at quality %d", CONFIG_EXAMPLE_STILL_WIDTH,
+             CONFIG_EXAMPLE_STILL_HEIGHT, still.size, CONFIG_EXAMPLE_STILL_JPEG_QUALITY);
+    cb(&still, ctx);
+    ret = ESP_OK;
+
+exit:
+    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    ioctl(fd, VIDIOC_STREAMOFF, &type);
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ioctl(fd, VIDIOC_STREAMOFF, &type);
+
+    /* The stream start doesn't set an encoder policy, it must not inherit the still memory */
+    still_set_policy(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, NULL, 0);
+    APP_LOG_ON_ERROR(uvc_app_jpeg_set_quality(stream_quality), UVC_TAG, "Streaming JPEG quality not restored");
+
+    return ret;
+}
+
+/* Switch the camera to the still frame, capture and encode one frame, the pipeline is stopped */
+static esp_err_t still_grab(uvc_still_cb_t cb, void *ctx)
+{
+    int type;
+    struct v4l2_buffer buf;
+    struct v4l2_exportbuffer expbuf;
+    struct v4l2_format format;
+    struct v4l2_requestbuffers req;
+    struct v4l2_streamparm parm;
+    int fd = g_app_ctx.uvc->cap_fd;
+    uint32_t capture_fmt = g_app_ctx.uvc->cap_caps.capture_fmt;
+    esp_err_t ret = ESP_FAIL;
+
+    APP_RETURN_ON_FALSE(capture_fmt, ESP_ERR_NOT_SUPPORTED, UVC_TAG, "No compatible encoder input format");
+    APP_RETURN_ON_ERROR(still_alloc(capture_fmt), UVC_TAG, "Still buffers not allocated");
+
+    /* Programmed over below, the next start sets the streaming frame again */
+    s_uvc_ctx.configured = false;
+
+    /* Any rate, the camera picks the cheapest sensor mode of the still size */
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(fd, VIDIOC_S_PARM, &parm) != 0) {
+        ESP_LOGW(UVC_TAG, "Failed to reset camera frame rate (errno=%d: %s)", errno, strerror(errno));
+    }
+
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = CONFIG_EXAMPLE_STILL_WIDTH;
+    format.fmt.pix.height = CONFIG_EXAMPLE_STILL_HEIGHT;
+    format.fmt.pix.pixelformat = capture_fmt;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_FMT, &format) == 0, ESP_ERR_NOT_SUPPORTED, UVC_TAG,
+                        "Camera has no %d x %d mode (errno=%d: %s)", CONFIG_EXAMPLE_STILL_WIDTH,
+                        CONFIG_EXAMPLE_STILL_HEIGHT, errno, strerror(errno));
+
+    /* One buffer in the still memory, the stream start sets its own policy again */
+    still_set_policy(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, s_uvc_ctx.still_raw, s_uvc_ctx.still_raw_size);
+    memset(&req, 0, sizeof(req));
+    req.count  = 1;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to request the still camera buffer (errno=%d: %s)", errno, strerror(errno));
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = 0;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QUERYBUF, &buf) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to query the still camera buffer (errno=%d: %s)", errno, strerror(errno));
+
+    memset(&expbuf, 0, sizeof(expbuf));
+    expbuf.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expbuf.index = 0;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_EXPBUF, &expbuf) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to export the still camera buffer (errno=%d: %s)", errno, strerror(errno));
+
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QBUF, &buf) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to queue the still camera buffer (errno=%d: %s)", errno, strerror(errno));
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_STREAMON, &type) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to start the still capture (errno=%d: %s)", errno, strerror(errno));
+
+    /* Exposure settles on the new sensor mode over the first frames */
+    for (int i = 0; i <= CONFIG_EXAMPLE_STILL_SKIP_FRAMES; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(fd, VIDIOC_DQBUF, &buf) != 0) {
+            ESP_LOGE(UVC_TAG, "Failed to capture the still (errno=%d: %s)", errno, strerror(errno));
+            goto exit;
+        }
+        if (i < CONFIG_EXAMPLE_STILL_SKIP_FRAMES && ioctl(fd, VIDIOC_QBUF, &buf) != 0) {
+            ESP_LOGE(UVC_TAG, "Failed to requeue the still camera buffer (errno=%d: %s)", errno, strerror(errno));
+            goto exit;
+        }
+    }
+
+    ret = still_encode(capture_fmt, expbuf.fd, &buf, cb, ctx);
+
+exit:
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ioctl(fd, VIDIOC_STREAMOFF, &type);
+
+    return ret;
+}
+#endif
+
+esp_err_t uvc_app_capture_still(uvc_still_cb_t cb, void *ctx)
+{
+#if CONFIG_EXAMPLE_STILL_CAPTURE
+    bool streaming;
+    int64_t pause_time;
+    esp_err_t ret;
+
+    APP_RETURN_ON_FALSE(cb, ESP_ERR_INVALID_ARG, UVC_TAG, "No still callback");
+    APP_RETURN_ON_FALSE(s_uvc_ctx.uvc_initialized, ESP_ERR_INVALID_STATE, UVC_TAG,
+                        "UVC stream task not initialized");
+    APP_RETURN_ON_ERROR(uvc_app_wait_hw_ready(HW_READY_ALL, pdMS_TO_TICKS(UVC_HW_READY_WAIT_MS)), UVC_TAG,
+                        "Camera or encoder not ready");
+
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    /* The session keeps its buffers' formats in s_uvc_ctx, the still only pauses it */
+    streaming = s_uvc_ctx.host_streaming || s_uvc_ctx.local_streaming;
+    pause_time = esp_timer_get_time();
+    if (streaming) {
+        stream_pause();
+    } else if (scan_active()) {
+#if CONFIG_EXAMPLE_SCAN
+        scan_pause();
+#endif
+    } else {
+        stream_idle_wake();
+    }
+
+    ret = still_grab(cb, ctx);
+
+    if (scan_active()) {
+#if CONFIG_EXAMPLE_SCAN
+        s_uvc_ctx.scan_streaming = scan_bring_up() == ESP_OK;
+        if (!s_uvc_ctx.scan_streaming) {
+            ESP_LOGE(UVC_TAG, "Failed to resume scan mode after the still");
+            stream_idle_start();
+        }
+#endif
+    } else if (!streaming) {
+        stream_idle_start();
+    } else if (stream_bring_up(s_uvc_ctx.width, s_uvc_ctx.height, s_uvc_ctx.rate) != ESP_OK) {
+        /* The host is left without frames until it restarts the stream */
+        ESP_LOGE(UVC_TAG, "Failed to resume streaming after the still");
+        s_uvc_ctx.local_streaming = false;
     } else {
-        ESP_LOGD(UVC_TAG, "Encoder output buffer re-queued");
+        ESP_LOGI(UVC_TAG, "Stream paused %lld ms for the still", (esp_timer_get_time() - pause_time) / 1000);
+    }
+
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+
+    return ret;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/* ========== Stall Recovery ========== */
+
+#if CONFIG_EXAMPLE_STALL_WATCHDOG
+void uvc_app_recover(const uvc_stall_event_t *stall)
+{
+    const char *stage = uvc_watchdog_stage_name(stall->stage);
+    uint32_t ms;
+    esp_err_t ret;
+
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    /* The session may have stopped or restarted since the stall was posted */
+    if (!(s_uvc_ctx.host_streaming || s_uvc_ctx.local_streaming) || !uvc_watchdog_stall_current(stall)) {
+        ESP_LOGI(UVC_TAG, "Stall of the %s stage is stale, session restarted meanwhile", stage);
+        xSemaphoreGive(s_uvc_ctx.session_lock);
+        return;
+    }
+
+    /* The first restart restarts the CSI and encoder streams, later ones program the sensor again too */
+    ESP_LOGW(UVC_TAG, "Recovering from a %s stall, attempt %d: %s", stage, stall->attempt,
+             stall->attempt > 1 ? "re-initializing the sensor" : "restarting the streams");
+    stream_pause();
+    if (stall->attempt > 1) {
+        s_uvc_ctx.configured = false;
+    }
+    ret = stream_bring_up(s_uvc_ctx.width, s_uvc_ctx.height, s_uvc_ctx.rate);
+    ms = uvc_watchdog_recovered(ret == ESP_OK);
+    if (ret != ESP_OK) {
+        /* The host is left without frames until it restarts the stream */
+        ESP_LOGE(UVC_TAG, "Failed to restart the stream after a %s stall (%s)", stage, esp_err_to_name(ret));
+        s_uvc_ctx.local_streaming = false;
+    } else {
+        ESP_LOGW(UVC_TAG, "Pipeline restarted %lu ms after the %s stall", ms, stage);
+    }
+
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+}
+#endif
+
+/* ========== Scan Mode ========== */
+
+#if CONFIG_EXAMPLE_SCAN
+/* Program the camera for the scan frame and start it for the scan task, the caller holds session_lock */
+static esp_err_t scan_bring_up(void)
+{
+    int type;
+    struct v4l2_buffer buf;
+    struct v4l2_format format;
+    struct v4l2_requestbuffers req;
+    struct esp_video_buffer_policy policy;
+    struct v4l2_streamparm parm;
+    int fd = g_app_ctx.uvc->cap_fd;
+
+    APP_RETURN_ON_ERROR(uvc_app_wait_hw_ready(EVENT_CAMERA_READY, pdMS_TO_TICKS(UVC_HW_READY_WAIT_MS)), UVC_TAG,
+                        "Camera not ready");
+
+    /* Programmed over below, the next start sets the streaming frame again */
+    s_uvc_ctx.configured = false;
+
+    /* Rate first, the camera picks the cheapest sensor mode of the scan size reaching it */
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = CONFIG_EXAMPLE_SCAN_FPS;
+    if (ioctl(fd, VIDIOC_S_PARM, &parm) != 0) {
+        ESP_LOGW(UVC_TAG, "Failed to set the scan frame rate (errno=%d: %s)", errno, strerror(errno));
     }
+
+    /* The ISP has no Y-only output, YUV420 is the smallest format and its luma is picked word-wide */
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = CONFIG_EXAMPLE_SCAN_WIDTH;
+    format.fmt.pix.height = CONFIG_EXAMPLE_SCAN_HEIGHT;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_S_FMT, &format) == 0, ESP_ERR_NOT_SUPPORTED, UVC_TAG,
+                        "Camera has no %d x %d YUV420 mode (errno=%d: %s)", CONFIG_EXAMPLE_SCAN_WIDTH,
+                        CONFIG_EXAMPLE_SCAN_HEIGHT, errno, strerror(errno));
+
+    /* The decoder always gets the newest frame, into the buffer it let go of last */
+    memset(&policy, 0, sizeof(policy));
+    policy.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    policy.flags = ESP_VIDEO_BUFFER_FLAG_DROP_OLDEST | ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO;
+    if (ioctl(fd, VIDIOC_S_BUF_POLICY, &policy) != 0) {
+        ESP_LOGW(UVC_TAG, "Failed to set scan buffer policy (errno=%d: %s)", errno, strerror(errno));
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.count  = SCAN_BUFFER_COUNT;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_REQBUFS, &req) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to request scan camera buffers (errno=%d: %s)", errno, strerror(errno));
+
+    for (int i = 0; i < SCAN_BUFFER_COUNT; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index  = i;
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QUERYBUF, &buf) == 0, ESP_FAIL, UVC_TAG,
+                            "Failed to query scan camera buffer %d (errno=%d: %s)", i, errno, strerror(errno));
+
+        g_app_ctx.uvc->cap_buffer[i] = (uint8_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                                        fd, buf.m.offset);
+        APP_RETURN_ON_FALSE(g_app_ctx.uvc->cap_buffer[i], ESP_FAIL, UVC_TAG, "Failed to mmap scan camera buffer %d", i);
+
+        APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_QBUF, &buf) == 0, ESP_FAIL, UVC_TAG,
+                            "Failed to queue scan camera buffer %d (errno=%d: %s)", i, errno, strerror(errno));
+    }
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    APP_RETURN_ON_FALSE(ioctl(fd, VIDIOC_STREAMON, &type) == 0, ESP_FAIL, UVC_TAG,
+                        "Failed to start the scan capture (errno=%d: %s)", errno, strerror(errno));
+
+    xEventGroupSetBits(g_app_ctx.system_events, EVENT_SCAN_RUN);
+    ESP_LOGI(UVC_TAG, "Scan mode: %d x %d @%d fps", CONFIG_EXAMPLE_SCAN_WIDTH, CONFIG_EXAMPLE_SCAN_HEIGHT,
+             CONFIG_EXAMPLE_SCAN_FPS);
+
+    return ESP_OK;
+}
+
+/* Stop the scan task and the camera, the caller holds session_lock */
+static void scan_pause(void)
+{
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    EventBits_t bits;
+
+    xEventGroupClearBits(g_app_ctx.system_events, EVENT_SCAN_RUN);
+    bits = xEventGroupWaitBits(g_app_ctx.system_events, EVENT_SCAN_IDLE,
+                               pdFALSE, pdTRUE, pdMS_TO_TICKS(SCAN_IDLE_WAIT_MS));
+    if (!(bits & EVENT_SCAN_IDLE)) {
+        ESP_LOGW(UVC_TAG, "Scan task did not go idle");
+    }
+
+    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_STREAMOFF, &type) != 0) {
+        ESP_LOGW(UVC_TAG, "Failed to stop the scan capture (errno=%d: %s)", errno, strerror(errno));
+    }
+}
+#endif
+
+esp_err_t uvc_app_scan_start(void)
+{
+#if CONFIG_EXAMPLE_SCAN
+    esp_err_t ret = ESP_OK;
+
+    APP_RETURN_ON_FALSE(s_uvc_ctx.uvc_initialized, ESP_ERR_INVALID_STATE, UVC_TAG,
+                        "UVC stream task not initialized");
+
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    s_uvc_ctx.scan_wanted = true;
+
+    /* A host session keeps the camera, scanning starts when it stops */
+    if (!s_uvc_ctx.host_streaming && !s_uvc_ctx.scan_streaming) {
+        if (s_uvc_ctx.local_streaming) {
+            ESP_LOGI(UVC_TAG, "Scan mode pauses the local session");
+            stream_stop();
+            s_uvc_ctx.local_streaming = false;
+        }
+        stream_idle_wake();
+        ret = scan_bring_up();
+        s_uvc_ctx.scan_streaming = ret == ESP_OK;
+        s_uvc_ctx.scan_wanted = ret == ESP_OK;
+        if (ret != ESP_OK) {
+            scan_pause();
+            stream_idle_start();
+        }
+    }
+
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+
+    return ret;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void uvc_app_scan_stop(void)
+{
+#if CONFIG_EXAMPLE_SCAN
+    if (!s_uvc_ctx.uvc_initialized) {
+        return;
+    }
+
+    xSemaphoreTake(s_uvc_ctx.session_lock, portMAX_DELAY);
+
+    s_uvc_ctx.scan_wanted = false;
+    if (s_uvc_ctx.scan_streaming) {
+        ESP_LOGI(UVC_TAG, "Scan mode stop");
+        scan_pause();
+        s_uvc_ctx.scan_streaming = false;
+
+        if (s_uvc_ctx.local_users) {
+            ESP_LOGI(UVC_TAG, "Resuming the local session");
+            s_uvc_ctx.local_streaming = stream_start(s_uvc_ctx.local_width, s_uvc_ctx.local_height,
+                                                     s_uvc_ctx.local_rate) == ESP_OK;
+        } else {
+            stream_idle_start();
+        }
+    }
+
+    xSemaphoreGive(s_uvc_ctx.session_lock);
+#endif
 }
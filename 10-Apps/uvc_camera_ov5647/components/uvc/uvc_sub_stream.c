@@ -0,0 +1,256 @@
+/*
+ * UVC Sub Stream - Second UVC video function, see uvc_sub_stream.h
+ *
+ * The secondary encoder reuses its single capture buffer as soon as its sink
+ * returns, so the sink copies the frame into a slot of the sub ring. The cam 2
+ * task of usb_device_uvc takes the oldest ready slot and gives it back when
+ * the frame was sent, like the main function does with the encoder ring.
+ *
+ * Starting the sub stream starts a local session if no host streams the main
+ * function, the secondary encoder only runs with the pipeline.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "uvc_app_common.h"
+#include "uvc_sub_stream.h"
+#include "memstat.h"
+#include "dlog.h"
+#include "usb_device_uvc.h"
+
+#define SUB_TAG             "uvc_sub"
+
+/* One slot fills while the host reads the other */
+#define SUB_SLOT_COUNT      2
+
+#define SUB_FRAME_WAIT_MS   200
+#define SUB_SLOT_SIZE       (CONFIG_EXAMPLE_UVC_SUB_STREAM_BUFFER_KB * 1024)
+
+typedef struct {
+    frame_buffer_t *slots[SUB_SLOT_COUNT];
+    QueueHandle_t free_queue;       /* Slots the sink may fill */
+    QueueHandle_t ready_queue;      /* Filled slots, oldest first */
+    frame_buffer_t *current;        /* Slot the host is sending */
+    uvc_fb_t fb;
+    volatile bool playing;          /* The host streams the sub function */
+    bool local_session;             /* The start of the sub stream started the pipeline */
+    int64_t pace_period;            /* Frame period of the sub stream rate in us */
+    int64_t pace_due;               /* Frame time the next frame is due at, 0 before the first one */
+    bool need_key;                  /* H.264 frames are skipped until a key frame reached the host */
+    uvc_sub_stream_stats_t stats;
+} uvc_sub_stream_ctx_t;
+
+static uvc_sub_stream_ctx_t s_sub_ctx = {0};
+
+/* ========== Secondary Sink ========== */
+
+/* Same rule as the capture pacing, frames more than a quarter period early are dropped */
+static bool sub_pace_frame(int64_t timestamp)
+{
+    int64_t period = s_sub_ctx.pace_period;
+
+    if (!period) {
+        return true;
+    }
+    if (s_sub_ctx.pace_due && timestamp < s_sub_ctx.pace_due - period / 4) {
+        return false;
+    }
+
+    if (s_sub_ctx.pace_due && timestamp - s_sub_ctx.pace_due < period) {
+        s_sub_ctx.pace_due += period;
+    } else {
+        s_sub_ctx.pace_due = timestamp + period;
+    }
+
+    return true;
+}
+
+/* Runs in the secondary encode task, the frame data is only valid until this returns */
+static void sub_sink(const frame_buffer_t *frame, void *ctx)
+{
+    frame_buffer_t *slot;
+    bool pace = true;
+
+    if (!s_sub_ctx.playing) {
+        return;
+    }
+#if CONFIG_FORMAT_H264_CAM2
+    /* The host can't decode P frames before its first key frame, which then isn't paced */
+    if (s_sub_ctx.need_key && !(frame->flags & V4L2_BUF_FLAG_KEYFRAME)) {
+        s_sub_ctx.stats.paced++;
+        return;
+    }
+    pace = !s_sub_ctx.need_key;
+#endif
+    if (pace && !sub_pace_frame(frame->timestamp)) {
+        s_sub_ctx.stats.paced++;
+        return;
+    }
+    if (frame->size > SUB_SLOT_SIZE || xQueueReceive(s_sub_ctx.free_queue, &slot, 0) != pdTRUE) {
+        DLOGD(SUB_TAG, "Dropping frame %lu of %u bytes", frame->frame_number, frame->size);
+        s_sub_ctx.stats.dropped++;
+#if CONFIG_FORMAT_H264_CAM2
+        /* Later P frames reference the lost one */
+        s_sub_ctx.need_key = true;
+        uvc_app_h264_request_keyframe();
+#endif
+        return;
+    }
+    s_sub_ctx.need_key = false;
+
+    memcpy(slot->data, frame->data, frame->size);
+    slot->size = frame->size;
+    slot->timestamp = frame->timestamp;
+    slot->frame_number = frame->frame_number;
+    slot->flags = frame->flags;
+
+    /* Depth is the slot count, there is always room */
+    xQueueSend(s_sub_ctx.ready_queue, &slot, 0);
+}
+
+/* ========== UVC Callbacks ========== */
+
+/* Every slot back to the free queue, the host doesn't hold one */
+static void sub_reclaim_slots(void)
+{
+    frame_buffer_t *slot;
+
+    while (xQueueReceive(s_sub_ctx.ready_queue, &slot, 0) == pdTRUE) {
+        xQueueSend(s_sub_ctx.free_queue, &slot, 0);
+    }
+    if (s_sub_ctx.current) {
+        xQueueSend(s_sub_ctx.free_queue, &s_sub_ctx.current, 0);
+        s_sub_ctx.current = NULL;
+    }
+}
+
+static esp_err_t sub_start_cb(uvc_format_t uvc_format, int width, int height, int rate, void *cb_ctx)
+{
+    esp_err_t ret;
+    int sec_width;
+    int sec_height;
+
+    /* A host on the main function keeps its own frame, the local session then only waits for it to stop */
+#if CONFIG_EXAMPLE_AUX_CAMERA
+    ret = uvc_app_stream_start_local(CONFIG_UVC_CAM1_FRAMESIZE_WIDTH, CONFIG_UVC_CAM1_FRAMESIZE_HEIGT,
+                                     CONFIG_UVC_CAM1_FRAMERATE);
+#else
+    ret = uvc_app_stream_start_local(width, height, rate);
+#endif
+    APP_RETURN_ON_ERROR(ret, SUB_TAG, "Failed to start the pipeline");
+    s_sub_ctx.local_session = true;
+
+    /* The sub stream can't scale, the host must pick the frame the secondary encoder runs at */
+    uvc_secondary_get_frame(&sec_width, &sec_height);
+    if (sec_width != width || sec_height != height) {
+        ESP_LOGE(SUB_TAG, "Sub stream %dx%d requested, the secondary encoder runs at %dx%d",
+                 width, height, sec_width, sec_height);
+        uvc_app_stream_stop_local();
+        s_sub_ctx.local_session = false;
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    sub_reclaim_slots();
+    s_sub_ctx.pace_due = 0;
+    s_sub_ctx.pace_period = rate > 0 ? 1000000 / rate : 0;
+#if CONFIG_FORMAT_H264_CAM2
+    /* A running secondary encoder is in the middle of its GOP, the host starts at the next frame */
+    s_sub_ctx.need_key = true;
+    APP_LOG_ON_ERROR(uvc_app_h264_request_keyframe(), SUB_TAG, "Failed to request a key frame");
+#endif
+    s_sub_ctx.playing = true;
+
+    ESP_LOGI(SUB_TAG, "Sub stream started (%dx%d @ %d fps)", width, height, rate);
+
+    return ESP_OK;
+}
+
+static void sub_stop_cb(void *cb_ctx)
+{
+    s_sub_ctx.playing = false;
+
+    if (s_sub_ctx.local_session) {
+        uvc_app_stream_stop_local();
+        s_sub_ctx.local_session = false;
+    }
+
+    /* The secondary task is halted with the pipeline, or no longer fills slots */
+    sub_reclaim_slots();
+
+    ESP_LOGI(SUB_TAG, "Sub stream stopped, %lu frames streamed", s_sub_ctx.stats.streamed);
+}
+
+static uvc_fb_t *sub_fb_get_cb(void *cb_ctx)
+{
+    frame_buffer_t *slot;
+
+    if (xQueueReceive(s_sub_ctx.ready_queue, &slot, pdMS_TO_TICKS(SUB_FRAME_WAIT_MS)) != pdTRUE) {
+        DLOGD(SUB_TAG, "No sub frame within %d ms", SUB_FRAME_WAIT_MS);
+        return NULL;
+    }
+
+    s_sub_ctx.current = slot;
+    s_sub_ctx.fb.buf = slot->data;
+    s_sub_ctx.fb.len = slot->size;
+    s_sub_ctx.fb.timestamp.tv_sec = slot->timestamp / 1000000;
+    s_sub_ctx.fb.timestamp.tv_usec = slot->timestamp % 1000000;
+    s_sub_ctx.stats.streamed++;
+
+    return &s_sub_ctx.fb;
+}
+
+static void sub_fb_return_cb(uvc_fb_t *fb, void *cb_ctx)
+{
+    if (s_sub_ctx.current) {
+        xQueueSend(s_sub_ctx.free_queue, &s_sub_ctx.current, 0);
+        s_sub_ctx.current = NULL;
+    }
+}
+
+/* ========== Init ========== */
+
+/* Called from initUvcStreamTask() next to the main function */
+esp_err_t uvc_sub_stream_config(int index)
+{
+    uvc_device_config_t config;
+
+    s_sub_ctx.free_queue = xQueueCreate(SUB_SLOT_COUNT, sizeof(frame_buffer_t *));
+    s_sub_ctx.ready_queue = xQueueCreate(SUB_SLOT_COUNT, sizeof(frame_buffer_t *));
+    APP_RETURN_ON_FALSE(s_sub_ctx.free_queue && s_sub_ctx.ready_queue, ESP_ERR_NO_MEM, SUB_TAG,
+                        "Failed to create sub stream queues");
+
+    for (int i = 0; i < SUB_SLOT_COUNT; i++) {
+        s_sub_ctx.slots[i] = frame_buffer_alloc(SUB_SLOT_SIZE);
+        APP_RETURN_ON_FALSE(s_sub_ctx.slots[i], ESP_ERR_NO_MEM, SUB_TAG, "Failed to allocate sub stream slot");
+        xQueueSend(s_sub_ctx.free_queue, &s_sub_ctx.slots[i], 0);
+    }
+
+    config.start_cb        = sub_start_cb;
+    config.fb_get_cb       = sub_fb_get_cb;
+    config.fb_return_cb    = sub_fb_return_cb;
+    config.stop_cb         = sub_stop_cb;
+    config.cb_ctx          = NULL;
+    config.uvc_buffer_size = SUB_SLOT_SIZE;
+    config.uvc_buffer      = memstat_malloc(MEMSTAT_UVC, SUB_SLOT_SIZE, MALLOC_CAP_DEFAULT);
+    APP_RETURN_ON_FALSE(config.uvc_buffer, ESP_ERR_NO_MEM, SUB_TAG, "Failed to allocate sub stream transfer buffer");
+
+    APP_RETURN_ON_ERROR(uvc_secondary_set_sink(sub_sink, NULL), SUB_TAG, "Failed to set the secondary sink");
+    APP_RETURN_ON_ERROR(uvc_device_config(index, &config), SUB_TAG, "Failed to configure UVC function %d", index);
+
+    ESP_LOGI(SUB_TAG, "Sub stream on UVC function %d, %d KB slots", index, CONFIG_EXAMPLE_UVC_SUB_STREAM_BUFFER_KB);
+
+    return ESP_OK;
+}
+
+void uvc_sub_stream_get_stats(uvc_sub_stream_stats_t *ret_stats)
+{
+    *ret_stats = s_sub_ctx.stats;
+}
+
+void uvc_sub_stream_reset_stats(void)
+{
+    memset(&s_sub_ctx.stats, 0, sizeof(s_sub_ctx.stats));
+}
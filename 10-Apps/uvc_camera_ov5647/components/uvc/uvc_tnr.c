@@ -0,0 +1,180 @@
+/*
+ * UVC TNR - Temporal noise reduction of the camera frames in low light
+ *
+ * Each frame is blended in place with the previous filtered frame, a
+ * recursive filter which keeps 1 - 2^-n of the history. Samples which changed
+ * by more than the motion threshold take the new value, so moving objects
+ * don't leave trails. The filter only runs while the sensor gain of the frame
+ * is high, with some hysteresis, bright scenes have little noise to remove.
+ *
+ * The kernel works on 32-bit words, four samples per load and store, with the
+ * averages and the motion test done per byte lane inside the word, so a frame
+ * costs one streaming pass over the frame and the history in PSRAM.
+ */
+
+#include <string.h>
+#include <sys/ioctl.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "linux/videodev2.h"
+#include "esp_video_ioctl.h"
+#include "memstat.h"
+#include "uvc_app_common.h"
+#include "uvc_tnr.h"
+
+#define TNR_TAG             "tnr"
+
+#define TNR_STRENGTH        CONFIG_EXAMPLE_TNR_STRENGTH
+#define TNR_GAIN_ON         (CONFIG_EXAMPLE_TNR_GAIN_ON / 10.0f)
+#define TNR_GAIN_OFF        (CONFIG_EXAMPLE_TNR_GAIN_OFF / 10.0f)
+/* The motion test compares half differences */
+#define TNR_MOTION_HALF     (CONFIG_EXAMPLE_TNR_MOTION_THRESH / 2)
+
+#define TNR_LANES_LO        0x01010101u
+#define TNR_LANES_HI        0x80808080u
+
+typedef struct {
+    uint32_t *history;              /* Previous filtered frame, PSRAM */
+    uint32_t history_size;
+    bool primed;                    /* history holds the previous frame of this session */
+    bool active;                    /* Gain is above the on threshold, until it drops below the off one */
+    uint32_t frames;
+} tnr_ctx_t;
+
+static tnr_ctx_t s_tnr_ctx = {0};
+
+/* Average of each byte lane, rounded down */
+static inline uint32_t tnr_avg(uint32_t a, uint32_t b)
+{
+    return (a & b) + (((a ^ b) & ~TNR_LANES_LO) >> 1);
+}
+
+/* Lanes at least 0x80 + k, k below 0x80, as 0x80 in each lane */
+static inline uint32_t tnr_at_least(uint32_t v, uint32_t k)
+{
+    return v & ((v & ~TNR_LANES_HI) + (0x80 - k) * TNR_LANES_LO) & TNR_LANES_HI;
+}
+
+/*
+ * Filter one run of words in place and store it as the new history.
+ *
+ * avg(cur, ~prev) is 127.5 plus half the difference in each lane, a lane has
+ * moved when that is at least 128 + k or at most 127 - k.
+ */
+static void tnr_filter(uint32_t *cur, uint32_t *prev, uint32_t words)
+{
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t c = cur[i];
+        uint32_t p = prev[i];
+        uint32_t out = c;
+        uint32_t half = tnr_avg(c, ~p);
+        uint32_t moved = tnr_at_least(half, TNR_MOTION_HALF) | tnr_at_least(~half, TNR_MOTION_HALF);
+
+        for (int n = 0; n < TNR_STRENGTH; n++) {
+            out = tnr_avg(out, p);
+        }
+        /* 0x80 -> 0xFF per moved lane */
+        moved = (moved >> 7) * 0xFF;
+        out ^= (out ^ c) & moved;
+
+        cur[i] = out;
+        prev[i] = out;
+    }
+}
+
+/* Sensor gain of the frame is high enough to filter */
+static bool tnr_gain_high(const frame_buffer_t *frame)
+{
+    struct esp_video_frame_meta meta = {
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .index = frame->camera_buf_index,
+    };
+
+    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_G_FRAME_META, &meta) != 0 ||
+            !(meta.flags & ESP_VIDEO_FRAME_META_GAIN)) {
+        return false;
+    }
+
+    if (!s_tnr_ctx.active && meta.gain >= TNR_GAIN_ON) {
+        ESP_LOGI(TNR_TAG, "Gain %.1f, filtering", meta.gain);
+        s_tnr_ctx.active = true;
+    } else if (s_tnr_ctx.active && meta.gain < TNR_GAIN_OFF) {
+        ESP_LOGI(TNR_TAG, "Gain %.1f, not filtering", meta.gain);
+        s_tnr_ctx.active = false;
+    }
+
+    return s_tnr_ctx.active;
+}
+
+/* ========== Public API ========== */
+
+/* Every byte is a sample in these layouts, RGB565 packs fields across byte boundaries */
+static bool tnr_format_supported(uint32_t fmt)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YUV422P:
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_GREY:
+    case V4L2_PIX_FMT_RGB24:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void uvc_tnr_start(void)
+{
+    s_tnr_ctx.primed = false;
+    s_tnr_ctx.active = false;
+}
+
+void uvc_tnr_apply(frame_buffer_t *frame)
+{
+    uint32_t size = frame->size & ~3u;
+    struct esp_video_buffer_sync sync;
+
+    if (!tnr_format_supported(g_app_ctx.uvc->cap_caps.capture_fmt) || !size) {
+        return;
+    }
+
+    if (!tnr_gain_high(frame)) {
+        /* The history goes stale while the filter is off */
+        s_tnr_ctx.primed = false;
+        return;
+    }
+
+    if (size > s_tnr_ctx.history_size) {
+        memstat_free(MEMSTAT_PROC, s_tnr_ctx.history);
+        s_tnr_ctx.history = memstat_aligned_alloc(MEMSTAT_PROC, 4, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        s_tnr_ctx.history_size = s_tnr_ctx.history ? size : 0;
+        s_tnr_ctx.primed = false;
+        if (!s_tnr_ctx.history) {
+            ESP_LOGE(TNR_TAG, "No memory for a %lu byte history", size);
+            return;
+        }
+    }
+
+    /* Camera DMA wrote the frame behind the CPU cache, the encoder import writes it back */
+    memset(&sync, 0, sizeof(sync));
+    sync.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sync.index = frame->camera_buf_index;
+    sync.size = size;
+    sync.flags = ESP_VIDEO_BUFFER_SYNC_CPU_READ;
+    if (s_tnr_ctx.primed) {
+        sync.flags |= ESP_VIDEO_BUFFER_SYNC_CPU_WRITE;
+    }
+    if (ioctl(g_app_ctx.uvc->cap_fd, VIDIOC_SYNC_BUF, &sync) != 0) {
+        return;
+    }
+
+    if (!s_tnr_ctx.primed) {
+        memcpy(s_tnr_ctx.history, frame->data, size);
+        s_tnr_ctx.primed = true;
+        return;
+    }
+
+    tnr_filter((uint32_t *)frame->data, s_tnr_ctx.history, size / 4);
+    s_tnr_ctx.frames++;
+}
@@ -0,0 +1,214 @@
+/*
+ * UVC Watchdog - Stall detection of the running pipeline
+ *
+ * The frame paths only bump a counter per stage. The check job compares the
+ * counters with the ones it saw last and keeps the time each stage last moved,
+ * so a stall is seen at most one check period late. One stall report is in
+ * flight at a time, the restart disarms and re-arms the watchdog, which starts
+ * a new run and drops reports of the old one.
+ */
+
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uvc_app_common.h"
+#include "os_sched.h"
+#include "uvc_watchdog.h"
+
+#define WATCHDOG_PERIOD_MS      100
+#define WATCHDOG_TOLERANCE_MS   20
+#define WATCHDOG_MIN_LIMIT_MS   200     /* Floor of the stall limit at high frame rates */
+#define WATCHDOG_START_GRACE_MS 500     /* Extra time for the first frame after STREAMON */
+#define WATCHDOG_HEALTHY_MS     5000    /* Run time without a stall which gives a session all its restarts back */
+
+/* Watchdog context */
+typedef struct {
+    portMUX_TYPE lock;                  // Guards everything below
+    os_sched_job_id job;
+    bool armed;
+    bool pending;                       // A stall was posted and not handled yet
+    bool gave_up;                       // Out of restarts, quiet until the session ends
+    uint16_t run;                       // Bumped by every arm
+    uint8_t attempts;                   // Restarts of the session in a row
+    int64_t limit;                      // Stall limit of the run in us
+    int64_t armed_time;
+    int64_t posted_time;
+    uint32_t seen[UVC_STAGE_MAX];       // Progress counters at the last check
+    int64_t moved_time[UVC_STAGE_MAX];  // Time the counters last changed
+    uvc_watchdog_stats_t stats;
+} uvc_watchdog_ctx_t;
+
+static const char *TAG = "uvc_wdt";
+
+volatile uint32_t g_uvc_watchdog_progress[UVC_STAGE_MAX];
+
+static uvc_watchdog_ctx_t s_wdt = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+    .job = -1,
+};
+
+static const char *s_stage_names[UVC_STAGE_MAX] = {
+    [UVC_STAGE_CAPTURE] = "capture",
+    [UVC_STAGE_ENCODE]  = "encode",
+};
+
+const char *uvc_watchdog_stage_name(uvc_stage_t stage)
+{
+    return stage < UVC_STAGE_MAX ? s_stage_names[stage] : "unknown";
+}
+
+static void uvc_watchdog_job(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    uvc_stall_event_t stall;
+    int stalled = -1;
+    bool give_up = false;
+
+    portENTER_CRITICAL(&s_wdt.lock);
+
+    if (!s_wdt.armed || s_wdt.pending || s_wdt.gave_up) {
+        portEXIT_CRITICAL(&s_wdt.lock);
+        return;
+    }
+
+    for (int stage = 0; stage < UVC_STAGE_MAX; stage++) {
+        uint32_t progress = g_uvc_watchdog_progress[stage];
+
+        if (progress != s_wdt.seen[stage]) {
+            s_wdt.seen[stage] = progress;
+            s_wdt.moved_time[stage] = now;
+        }
+    }
+
+    /* One stalled stage soon starves or backs up the other, the one which stopped first is the cause */
+    for (int stage = 0; stage < UVC_STAGE_MAX; stage++) {
+        if (now - s_wdt.moved_time[stage] > s_wdt.limit &&
+                (stalled < 0 || s_wdt.moved_time[stage] < s_wdt.moved_time[stalled])) {
+            stalled = stage;
+        }
+    }
+
+    if (stalled < 0) {
+        if (s_wdt.attempts && now - s_wdt.armed_time > WATCHDOG_HEALTHY_MS * 1000LL) {
+            s_wdt.attempts = 0;
+        }
+        portEXIT_CRITICAL(&s_wdt.lock);
+        return;
+    }
+
+    stall.stage = stalled;
+    stall.run = s_wdt.run;
+    stall.stalled_ms = (now - s_wdt.moved_time[stalled]) / 1000;
+    s_wdt.stats.stalls[stalled]++;
+    if (s_wdt.attempts >= CONFIG_EXAMPLE_STALL_MAX_RESTARTS) {
+        s_wdt.gave_up = true;
+        s_wdt.stats.failures++;
+        give_up = true;
+    } else {
+        stall.attempt = ++s_wdt.attempts;
+        s_wdt.pending = true;
+        s_wdt.posted_time = now;
+    }
+
+    portEXIT_CRITICAL(&s_wdt.lock);
+
+    if (give_up) {
+        ESP_LOGE(TAG, "%s stage stalled for %lu ms after %d restarts, giving up until the session ends",
+                 s_stage_names[stalled], stall.stalled_ms, CONFIG_EXAMPLE_STALL_MAX_RESTARTS);
+        return;
+    }
+
+    ESP_LOGW(TAG, "%s stage stalled for %lu ms", s_stage_names[stalled], stall.stalled_ms);
+    if (app_post_event(SYS_EVENT_STALL, &stall, sizeof(stall)) != ESP_OK) {
+        /* Reported again at the next check */
+        portENTER_CRITICAL(&s_wdt.lock);
+        s_wdt.pending = false;
+        s_wdt.attempts--;
+        portEXIT_CRITICAL(&s_wdt.lock);
+    }
+}
+
+esp_err_t uvc_watchdog_init(void)
+{
+    if (s_wdt.job >= 0) {
+        return ESP_OK;
+    }
+
+    return os_sched_register("uvc_wdt", uvc_watchdog_job, NULL, WATCHDOG_PERIOD_MS, WATCHDOG_TOLERANCE_MS,
+                             &s_wdt.job);
+}
+
+void uvc_watchdog_arm(int rate)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t limit = WATCHDOG_MIN_LIMIT_MS * 1000LL;
+
+    if (rate > 0) {
+        limit = MAX(limit, CONFIG_EXAMPLE_STALL_FRAMES * 1000000LL / rate);
+    }
+
+    portENTER_CRITICAL(&s_wdt.lock);
+    s_wdt.run++;
+    s_wdt.limit = limit;
+    s_wdt.armed_time = now;
+    s_wdt.pending = false;
+    for (int stage = 0; stage < UVC_STAGE_MAX; stage++) {
+        s_wdt.seen[stage] = g_uvc_watchdog_progress[stage];
+        s_wdt.moved_time[stage] = now + WATCHDOG_START_GRACE_MS * 1000LL;
+    }
+    s_wdt.armed = true;
+    portEXIT_CRITICAL(&s_wdt.lock);
+}
+
+void uvc_watchdog_disarm(void)
+{
+    portENTER_CRITICAL(&s_wdt.lock);
+    s_wdt.armed = false;
+    s_wdt.pending = false;
+    portEXIT_CRITICAL(&s_wdt.lock);
+}
+
+void uvc_watchdog_reset(void)
+{
+    portENTER_CRITICAL(&s_wdt.lock);
+    s_wdt.attempts = 0;
+    s_wdt.gave_up = false;
+    portEXIT_CRITICAL(&s_wdt.lock);
+}
+
+bool uvc_watchdog_stall_current(const uvc_stall_event_t *stall)
+{
+    bool current;
+
+    portENTER_CRITICAL(&s_wdt.lock);
+    current = s_wdt.armed && s_wdt.pending && stall->run == s_wdt.run;
+    portEXIT_CRITICAL(&s_wdt.lock);
+
+    return current;
+}
+
+uint32_t uvc_watchdog_recovered(bool ok)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t ms;
+
+    portENTER_CRITICAL(&s_wdt.lock);
+    ms = (now - s_wdt.posted_time) / 1000;
+    if (ok) {
+        s_wdt.stats.recoveries++;
+        s_wdt.stats.last_recovery_ms = ms;
+    } else {
+        s_wdt.stats.failures++;
+    }
+    portEXIT_CRITICAL(&s_wdt.lock);
+
+    return ms;
+}
+
+void uvc_watchdog_get_stats(uvc_watchdog_stats_t *ret_stats)
+{
+    portENTER_CRITICAL(&s_wdt.lock);
+    *ret_stats = s_wdt.stats;
+    portEXIT_CRITICAL(&s_wdt.lock);
+}
@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "hal/isp_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_VIDEO_CALIB_MAGIC       0x424c4143  /*!< "CALB" */
+#define ESP_VIDEO_CALIB_VERSION     1
+
+/**
+ * @brief Calibration entry types.
+ */
+typedef enum esp_video_calib_type {
+    ESP_VIDEO_CALIB_TYPE_LSC    = 1,    /*!< esp_video_calib_lsc_t, ISP lens shading gain tables */
+    ESP_VIDEO_CALIB_TYPE_MESH   = 2,    /*!< esp_video_calib_mesh_t, distortion correction mesh */
+} esp_video_calib_type_t;
+
+/**
+ * @brief Calibration blob header.
+ *
+ * The blob is written to the flash partition as is and used in place through the
+ * flash cache. All fields are little endian, entries follow the header and every
+ * entry is 4-byte aligned. tools/calib_pack.py builds it.
+ */
+typedef struct esp_video_calib_header {
+    uint32_t magic;             /*!< ESP_VIDEO_CALIB_MAGIC */
+    uint16_t version;           /*!< ESP_VIDEO_CALIB_VERSION */
+    uint16_t entry_count;       /*!< Number of esp_video_calib_entry_t after the header */
+    uint32_t size;              /*!< Blob size in bytes, header included */
+    uint32_t reserved;
+} esp_video_calib_header_t;
+
+/**
+ * @brief Calibration blob entry.
+ */
+typedef struct esp_video_calib_entry {
+    uint16_t type;              /*!< esp_video_calib_type_t */
+    uint16_t reserved;
+    uint16_t width;             /*!< Frame width the data was calibrated for */
+    uint16_t height;            /*!< Frame height the data was calibrated for */
+    uint32_t offset;            /*!< Data offset from the blob start */
+    uint32_t size;              /*!< Data size in bytes */
+} esp_video_calib_entry_t;
+
+/**
+ * @brief Lens shading gain tables of one ISP input frame size.
+ *
+ * Grid size is what the ISP expects for the frame size, ((res - 1) / 2 / ISP_LL_LSC_GRID_HEIGHT + 2)
+ * along each side. The ISP reads the tables in place when LSC starts.
+ */
+typedef struct esp_video_calib_lsc {
+    uint16_t grid_width;        /*!< Gain points per row */
+    uint16_t grid_height;       /*!< Gain points per column */
+    isp_lsc_gain_t gain[];      /*!< R, Gr, Gb and B tables one after another, grid_width * grid_height each, row major */
+} esp_video_calib_lsc_t;
+
+/**
+ * @brief Distortion correction mesh of one frame size.
+ *
+ * The output frame is divided into cells of cell_size x cell_size pixels. Each mesh
+ * point holds the source frame position that the output cell corner at that point
+ * shows, positions inside a cell are interpolated bilinearly.
+ */
+typedef struct esp_video_calib_mesh {
+    uint16_t cell_size;         /*!< Cell side in output pixels, a power of 2 */
+    uint16_t cols;              /*!< Cells per row, covering the frame width */
+    uint16_t rows;              /*!< Cells per column, covering the frame height */
+    uint16_t reserved;
+    int16_t point[][2];         /*!< (cols + 1) * (rows + 1) source x, y in 1/16 pixels, row major */
+} esp_video_calib_mesh_t;
+
+/**
+ * @brief Map the calibration partition.
+ *
+ * The partition labeled CONFIG_ESP_VIDEO_CALIB_PARTITION_LABEL is mapped into the
+ * data address space once, its header and entry table are checked but nothing is
+ * copied or converted. esp_video_init() calls it.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_FOUND if there is no calibration partition
+ *      - ESP_ERR_INVALID_VERSION if the partition holds no valid calibration blob
+ *      - Others if mapping failed
+ */
+esp_err_t esp_video_calib_init(void);
+
+/**
+ * @brief Find calibration data of a frame size.
+ *
+ * @param type   Entry type
+ * @param width  Frame width in pixels
+ * @param height Frame height in pixels
+ * @param size   Data size in bytes if found, may be NULL
+ *
+ * @return Data in the mapped partition, valid until reboot, or NULL if not found
+ */
+const void *esp_video_calib_find(esp_video_calib_type_t type, uint32_t width, uint32_t height, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,6 +22,12 @@ extern "C" {
 #define ESP_VIDEO_DVP_DEVICE_ID             2
 #define ESP_VIDEO_DVP_DEVICE_NAME           "/dev/video2"
 
+/**
+ * @brief Test pattern video device, captures generated frames without a camera sensor
+ */
+#define ESP_VIDEO_TESTPAT_DEVICE_ID         3
+#define ESP_VIDEO_TESTPAT_DEVICE_NAME       "/dev/video3"
+
 /**
  * @brief Codec video device
  */
@@ -31,6 +37,24 @@ extern "C" {
 #define ESP_VIDEO_H264_DEVICE_ID            11
 #define ESP_VIDEO_H264_DEVICE_NAME          "/dev/video11"
 
+#define ESP_VIDEO_JPEG_DECODER_DEVICE_ID    13
+#define ESP_VIDEO_JPEG_DECODER_DEVICE_NAME  "/dev/video13"
+
+#define ESP_VIDEO_H264_1_DEVICE_ID          14
+#define ESP_VIDEO_H264_1_DEVICE_NAME        "/dev/video14"
+
+/**
+ * @brief Image process video device
+ */
+#define ESP_VIDEO_PPA_DEVICE_ID             12
+#define ESP_VIDEO_PPA_DEVICE_NAME           "/dev/video12"
+
+#define ESP_VIDEO_SWCONV_DEVICE_ID          15
+#define ESP_VIDEO_SWCONV_DEVICE_NAME        "/dev/video15"
+
+#define ESP_VIDEO_LDC_DEVICE_ID             16
+#define ESP_VIDEO_LDC_DEVICE_NAME           "/dev/video16"
+
 /**
  * @brief ISP video device
  */
@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "linux/videodev2.h"
+#include "esp_video_ioctl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Video device handle opened without VFS.
+ *
+ * A handle is a client of the device like a file opened by open(), both may be used together.
+ * Calls take the same arguments as the ioctl commands and return esp_err_t instead of setting
+ * errno, so in-firmware clients skip the file descriptor lookup and argument marshalling.
+ */
+typedef struct esp_video_direct esp_video_direct_t;
+
+/**
+ * @brief Open a video device.
+ *
+ * @param id     Video device ID, ESP_VIDEO_XXX_DEVICE_ID in esp_video_device.h
+ * @param handle Video device handle pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_open(uint8_t id, esp_video_direct_t **handle);
+
+/**
+ * @brief Close a video device handle.
+ *
+ * @param handle Video device handle
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_close(esp_video_direct_t *handle);
+
+/**
+ * @brief Run any ioctl command of the device.
+ *
+ * @param handle Video device handle
+ * @param cmd    ioctl command, VIDIOC_XXX
+ * @param arg    Command argument
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_ioctl(esp_video_direct_t *handle, int cmd, void *arg);
+
+/**
+ * @brief Queue a buffer, same as VIDIOC_QBUF.
+ *
+ * @param handle Video device handle
+ * @param buf    Video buffer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_qbuf(esp_video_direct_t *handle, struct v4l2_buffer *buf);
+
+/**
+ * @brief Dequeue a buffer, same as VIDIOC_DQBUF.
+ *
+ * @param handle Video device handle
+ * @param buf    Video buffer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_dqbuf(esp_video_direct_t *handle, struct v4l2_buffer *buf);
+
+/**
+ * @brief Dequeue a buffer, waiting at most timeout_ms for one to be done.
+ *
+ * @param handle     Video device handle
+ * @param buf        Video buffer
+ * @param timeout_ms Maximum time to wait in ms
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_TIMEOUT if no buffer was done in time
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_dqbuf_timeout(esp_video_direct_t *handle, struct v4l2_buffer *buf, uint32_t timeout_ms);
+
+/**
+ * @brief Run a batch of buffer operations, same as VIDIOC_BATCH_BUF.
+ *
+ * @param handle Video device handle
+ * @param batch  Buffer batch
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_batch_buf(esp_video_direct_t *handle, struct esp_video_buffer_batch *batch);
+
+/**
+ * @brief Map a buffer of the device, same as mmap() on a file of the device.
+ *
+ * @param handle Video device handle
+ * @param length Buffer length
+ * @param offset Buffer offset returned by VIDIOC_QUERYBUF
+ *
+ * @return
+ *      - Buffer pointer on success
+ *      - NULL if failed
+ */
+void *esp_video_direct_mmap(esp_video_direct_t *handle, size_t length, off_t offset);
+
+#ifdef __cplusplus
+}
+#endif
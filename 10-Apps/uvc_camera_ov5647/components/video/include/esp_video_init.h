@@ -89,6 +89,109 @@ typedef struct esp_video_init_config {
  */
 esp_err_t esp_video_init(const esp_video_init_config_t *config);
 
+/**
+ * @brief Save the last converged ISP state to NVS.
+ *
+ * The ISP pipeline controller keeps the exposure, gain, white balance and CCM of
+ * its last convergence and starts from them after the next esp_video_init(). It
+ * saves them itself at most every CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST_INTERVAL
+ * seconds, call this when the stream stops or before sleeping to save the latest.
+ * NVS must be initialized by the application. Only available with
+ * CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST.
+ *
+ * @return
+ *      - ESP_OK on success or if NVS already holds about the same state
+ *      - ESP_ERR_INVALID_STATE if the ISP pipeline controller is not running
+ *      - Others if writing NVS failed
+ */
+esp_err_t esp_video_isp_pipeline_save(void);
+
+/**
+ * @brief Start recording the image algorithm input to a file.
+ *
+ * Every run of the ISP pipeline controller appends the statistics and sensor state
+ * it passed to the image algorithms and the result, see esp_video_ipa_replay.h for
+ * the layout. An existing file is overwritten. Only available with
+ * CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD.
+ *
+ * @param path File to record to, e.g. on an SD card
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if path is NULL
+ *      - ESP_ERR_INVALID_STATE if the ISP pipeline controller is not running or already records
+ *      - ESP_FAIL if the file can't be created
+ */
+esp_err_t esp_video_isp_pipeline_record_start(const char *path);
+
+/**
+ * @brief Stop recording the image algorithm input and close the file.
+ *
+ * @param frames If not NULL, the number of runs recorded
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if nothing is recorded
+ *      - ESP_FAIL if writing the file failed, what was written before is kept
+ */
+esp_err_t esp_video_isp_pipeline_record_stop(uint32_t *frames);
+
+/**
+ * @brief ISP blocks and statistics engines esp_video_isp_hold_blocks() can keep off.
+ */
+#define ESP_VIDEO_ISP_BLOCK_BF              (1 << 0)    /*!< Bayer filter */
+#define ESP_VIDEO_ISP_BLOCK_CCM             (1 << 1)    /*!< CCM, also the red and blue balance */
+#define ESP_VIDEO_ISP_BLOCK_SHARPEN         (1 << 2)    /*!< Sharpen and its statistics */
+#define ESP_VIDEO_ISP_BLOCK_GAMMA           (1 << 3)    /*!< GAMMA */
+#define ESP_VIDEO_ISP_BLOCK_DEMOSAIC        (1 << 4)    /*!< Demosaic */
+#define ESP_VIDEO_ISP_BLOCK_COLOR           (1 << 5)    /*!< Contrast, saturation, hue and brightness */
+#define ESP_VIDEO_ISP_BLOCK_LSC             (1 << 6)    /*!< Lens shading correction */
+#define ESP_VIDEO_ISP_BLOCK_AE_STATS        (1 << 7)    /*!< AE block statistics */
+#define ESP_VIDEO_ISP_BLOCK_HIST_STATS      (1 << 8)    /*!< Histogram statistics */
+
+/**
+ * @brief ISP load counters since boot. They wrap, the difference of two reads is valid.
+ */
+typedef struct esp_video_isp_load {
+    uint32_t irqs;                  /*!< ISP statistics interrupts */
+    uint32_t irq_us;                /*!< Time spent in them, in microseconds */
+    uint32_t ipa_runs;              /*!< Image algorithm runs of the ISP pipeline controller */
+    uint32_t ipa_us;                /*!< CPU time of those runs, sensor and ISP writes included */
+} esp_video_isp_load_t;
+
+/**
+ * @brief Keep ISP blocks and statistics engines off.
+ *
+ * Held blocks are not started, whatever the application or the image algorithms
+ * set through the ISP controls, their settings are kept for when they are released.
+ * A held statistics engine leaves its part of the ISP statistics buffers out. On a
+ * running ISP the pipeline is restarted, which drops a frame. AWB statistics count
+ * the frames and always run. Only available with CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE.
+ *
+ * @param blocks ESP_VIDEO_ISP_BLOCK_XXX to hold, 0 releases all
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if blocks has an unknown flag
+ *      - Others if restarting the ISP pipeline failed
+ */
+esp_err_t esp_video_isp_hold_blocks(uint32_t blocks);
+
+/**
+ * @brief Get the ISP blocks and statistics engines kept off.
+ *
+ * @return ESP_VIDEO_ISP_BLOCK_XXX flags
+ */
+uint32_t esp_video_isp_held_blocks(void);
+
+/**
+ * @brief Get the ISP load counters. Only available with CONFIG_ESP_VIDEO_ISP_LOAD_STATS.
+ *
+ * @param load Filled with the counters, the image algorithm ones are 0 without the
+ *             ISP pipeline controller
+ */
+void esp_video_isp_get_load(esp_video_isp_load_t *load);
+
 #ifdef __cplusplus
 }
 #endif
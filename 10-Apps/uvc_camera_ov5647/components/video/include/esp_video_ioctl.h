@@ -13,12 +13,174 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Video stream buffer policy flags.
+ */
+#define ESP_VIDEO_BUFFER_FLAG_DROP_OLDEST   (1 << 0)    /*!< VIDIOC_DQBUF returns the newest done buffer, older done buffers are re-queued */
+#define ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO  (1 << 1)    /*!< The driver fills the buffer queued last first, its lines may still be in the CPU cache,
+                                                             not supported by M2M devices, which keep frame order */
+
+/**
+ * @brief Video stream buffer placement policy, takes effect at the next VIDIOC_REQBUFS of the stream.
+ */
+struct esp_video_buffer_policy {
+    uint32_t type;                  /*!< Video stream type, refer to v4l2_buf_type */
+    uint32_t caps;                  /*!< Heap capability of all buffers, 0 means the video device default capability */
+    uint32_t hot_count;             /*!< Number of buffers, from index 0, which are allocated with hot_caps firstly */
+    uint32_t hot_caps;              /*!< Heap capability of hot buffers, e.g. MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA */
+    uint32_t flags;                 /*!< Buffer policy flags, ESP_VIDEO_BUFFER_FLAG_XXX */
+    void *mem;                      /*!< Memory the buffers not placed in hot memory are carved from, e.g. a PSRAM area reserved
+                                         by the linker and aligned to the cache line, it must outlive the buffers. NULL to allocate
+                                         them as one block with caps */
+    uint32_t mem_size;              /*!< Size of mem in bytes */
+};
+
+/**
+ * @brief Video buffer cache synchronization flags.
+ */
+#define ESP_VIDEO_BUFFER_SYNC_CPU_WRITE     (1 << 0)    /*!< CPU wrote the range, it is written back when the buffer is queued again */
+#define ESP_VIDEO_BUFFER_SYNC_CPU_READ      (1 << 1)    /*!< CPU is going to read the range, it is invalidated if DMA wrote the buffer since the last invalidation */
+
+/**
+ * @brief Video buffer cache synchronization of a dequeued buffer range, e.g. an OSD overlay region.
+ *
+ * Buffers are not synchronized by default, only ranges reported by VIDIOC_SYNC_BUF are.
+ */
+struct esp_video_buffer_sync {
+    uint32_t type;                  /*!< Video stream type, refer to v4l2_buf_type */
+    uint32_t index;                 /*!< Video buffer index */
+    uint32_t offset;                /*!< Start offset of the range in the buffer */
+    uint32_t size;                  /*!< Size of the range */
+    uint32_t flags;                 /*!< Synchronization flags, ESP_VIDEO_BUFFER_SYNC_XXX */
+};
+
+/**
+ * @brief Video capture stream subscription, the file becomes a read-only consumer of the stream.
+ *
+ * The subscribed file dequeues every buffer the stream captures while it holds less than "depth"
+ * buffers, and gives a buffer back by VIDIOC_QBUF. It can't set format, request buffers or
+ * start and stop the stream, these are done by the file which owns the stream.
+ */
+struct esp_video_buffer_subscribe {
+    uint32_t type;                  /*!< Video stream type, only V4L2_BUF_TYPE_VIDEO_CAPTURE */
+    uint32_t depth;                 /*!< Maximum number of buffers held by this file, 0 means unsubscribe */
+};
+
+/**
+ * @brief Maximum number of operations of a buffer batch.
+ */
+#define ESP_VIDEO_BUFFER_BATCH_MAX      8
+
+/**
+ * @brief Buffer batch operation.
+ */
+struct esp_video_buffer_batch_op {
+    uint32_t cmd;                   /*!< VIDIOC_QBUF or VIDIOC_DQBUF */
+    struct v4l2_buffer buf;         /*!< Buffer argument of the command */
+};
+
+/**
+ * @brief Buffer operations on the streams of one device, done in order by one VIDIOC_BATCH_BUF call,
+ *        e.g. queueing both M2M buffers and dequeueing the results.
+ *
+ * Operations stop at the first one which fails, its error is returned.
+ */
+struct esp_video_buffer_batch {
+    uint32_t count;                 /*!< Number of operations, up to ESP_VIDEO_BUFFER_BATCH_MAX */
+    uint32_t done;                  /*!< Number of operations which succeeded, set by the driver */
+    struct esp_video_buffer_batch_op *ops; /*!< Operation array */
+};
+
+/**
+ * @brief Frame metadata flags, set for the fields which are valid.
+ */
+#define ESP_VIDEO_FRAME_META_EXPOSURE       (1 << 0)    /*!< exposure_us is valid */
+#define ESP_VIDEO_FRAME_META_GAIN           (1 << 1)    /*!< gain is valid */
+#define ESP_VIDEO_FRAME_META_WB             (1 << 2)    /*!< red_gain and blue_gain are valid */
+#define ESP_VIDEO_FRAME_META_STATS          (1 << 3)    /*!< stats_seq, luma, dark and bright are valid */
+#define ESP_VIDEO_FRAME_META_AE_GRID        (1 << 4)    /*!< ae_seq and ae_luma are valid */
+
+/**
+ * @brief AE block grid of the frame metadata, which covers the center 60% of the frame in each direction.
+ */
+#define ESP_VIDEO_FRAME_META_AE_GRID_W      5
+#define ESP_VIDEO_FRAME_META_AE_GRID_H      5
+
+/**
+ * @brief Metadata of a capture buffer, read by VIDIOC_G_FRAME_META after VIDIOC_DQBUF.
+ *
+ * Exposure, gain and white balance are the settings in effect when the frame was done, the
+ * statistics are those of frame "stats_seq", the latest one the image algorithms processed.
+ * VIDIOC_S_FRAME_META updates the fields given by "flags" for frames done from then on, the
+ * ISP pipeline controller does so whenever it runs. The AE grid is updated for every statistics,
+ * also those the image algorithms skip, e.g. for motion detection.
+ */
+struct esp_video_frame_meta {
+    uint32_t type;                  /*!< Video stream type, only V4L2_BUF_TYPE_VIDEO_CAPTURE */
+    uint32_t index;                 /*!< Video buffer index, VIDIOC_G_FRAME_META only */
+    uint32_t flags;                 /*!< Valid fields, ESP_VIDEO_FRAME_META_XXX */
+    uint32_t sequence;              /*!< Buffer sequence number, same as v4l2_buffer.sequence */
+    int64_t timestamp;              /*!< Frame end time in microseconds, same as v4l2_buffer.timestamp */
+    uint32_t exposure_us;           /*!< Sensor exposure time in microseconds */
+    float gain;                     /*!< Sensor gain, 1.0 is the sensor minimum */
+    float red_gain;                 /*!< ISP red channel white balance gain */
+    float blue_gain;                /*!< ISP blue channel white balance gain */
+    uint32_t stats_seq;             /*!< Frame sequence number of the statistics */
+    uint16_t dark;                  /*!< Per mille of histogram pixels in the lowest segment */
+    uint16_t bright;                /*!< Per mille of histogram pixels in the highest segment */
+    uint8_t luma;                   /*!< Mean AE block luminance, 0 to 255 */
+    uint32_t ae_seq;                /*!< Frame sequence number of the AE grid */
+    uint8_t ae_luma[ESP_VIDEO_FRAME_META_AE_GRID_H][ESP_VIDEO_FRAME_META_AE_GRID_W]; /*!< AE block luminance, row by row */
+};
+
+/**
+ * @brief Maximum number of encoder region-of-interest rectangles.
+ */
+#define ESP_VIDEO_ENC_ROI_MAX           8
+
+/**
+ * @brief Encoder region of interest, in pixels of the encoded frame.
+ *
+ * The encoder works on 16x16 macroblocks, a region covers every macroblock it touches.
+ */
+struct esp_video_enc_roi_region {
+    uint16_t left;                  /*!< Left edge */
+    uint16_t top;                   /*!< Top edge */
+    uint16_t width;                 /*!< Region width */
+    uint16_t height;                /*!< Region height */
+    int8_t qp_offset;               /*!< QP added inside the region, negative spends more bits */
+};
+
+/**
+ * @brief Encoder region-of-interest map, data of control V4L2_CID_MPEG_VIDEO_ESP_ROI.
+ */
+struct esp_video_enc_roi {
+    uint32_t count;                 /*!< Number of valid regions, 0 disables ROI encoding */
+    int8_t background_qp_offset;    /*!< QP added outside all regions, positive saves bits */
+    struct esp_video_enc_roi_region regions[ESP_VIDEO_ENC_ROI_MAX]; /*!< Regions, earlier ones win where they overlap */
+};
+
 #define VIDIOC_S_SENSOR_FMT _IOWR('V',  BASE_VIDIOC_PRIVATE + 1, esp_cam_sensor_format_t)
 #define VIDIOC_G_SENSOR_FMT _IOWR('V',  BASE_VIDIOC_PRIVATE + 2, esp_cam_sensor_format_t)
+#define VIDIOC_S_BUF_POLICY _IOWR('V',  BASE_VIDIOC_PRIVATE + 3, struct esp_video_buffer_policy)
+#define VIDIOC_G_BUF_POLICY _IOWR('V',  BASE_VIDIOC_PRIVATE + 4, struct esp_video_buffer_policy)
+#define VIDIOC_SYNC_BUF     _IOWR('V',  BASE_VIDIOC_PRIVATE + 5, struct esp_video_buffer_sync)
+#define VIDIOC_SUBSCRIBE_BUF _IOWR('V', BASE_VIDIOC_PRIVATE + 6, struct esp_video_buffer_subscribe)
+#define VIDIOC_BATCH_BUF    _IOWR('V',  BASE_VIDIOC_PRIVATE + 7, struct esp_video_buffer_batch)
+#define VIDIOC_G_FRAME_META _IOWR('V',  BASE_VIDIOC_PRIVATE + 8, struct esp_video_frame_meta)
+#define VIDIOC_S_FRAME_META _IOWR('V',  BASE_VIDIOC_PRIVATE + 9, struct esp_video_frame_meta)
+#define VIDIOC_S_DQBUF_TIMEOUT _IOWR('V', BASE_VIDIOC_PRIVATE + 10, uint32_t) /*!< VIDIOC_DQBUF timeout of the file in ms, 0 waits forever */
+#define VIDIOC_G_DQBUF_TIMEOUT _IOWR('V', BASE_VIDIOC_PRIVATE + 11, uint32_t)
 
 #define V4L2_CID_CAMERA_AE_LEVEL        (V4L2_CID_CAMERA_CLASS_BASE + 40)
 #define V4L2_CID_CAMERA_STATS           (V4L2_CID_CAMERA_CLASS_BASE + 41)
 
+#define V4L2_CID_MPEG_VIDEO_ESP_ROI     (V4L2_CID_CODEC_BASE + 0x1f00)    /*!< Region-of-interest map, data type is struct esp_video_enc_roi */
+#define V4L2_CID_JPEG_ESP_ENCODE_TIMEOUT (V4L2_CID_JPEG_CLASS_BASE + 0x1f00) /*!< JPEG encoder timeout per frame in ms, 0 scales the Kconfig timeout with the frame size */
+#define V4L2_CID_JPEG_ESP_TARGET_SIZE  (V4L2_CID_JPEG_CLASS_BASE + 0x1f01) /*!< Average encoded frame size in bytes the quality is adjusted toward, 0 keeps the quality fixed */
+#define V4L2_CID_JPEG_ESP_MIN_QUALITY  (V4L2_CID_JPEG_CLASS_BASE + 0x1f02) /*!< Lowest quality the frame size control may choose */
+#define V4L2_CID_JPEG_ESP_MAX_QUALITY  (V4L2_CID_JPEG_CLASS_BASE + 0x1f03) /*!< Highest quality the frame size control may choose */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_VIDEO_IPA_RECORD_MAGIC      0x52504945  /*!< "EIPR" read as little endian */
+#define ESP_VIDEO_IPA_RECORD_VERSION    1
+#define ESP_VIDEO_IPA_RECORD_NAME_LEN   16
+
+/**
+ * @brief Image algorithm record file header.
+ *
+ * A record is this header followed by one entry per image algorithm run: an
+ * esp_video_ipa_record_frame_t, then the "esp_ipa_stats_t" and "esp_ipa_sensor_t"
+ * passed to esp_ipa_pipeline_process() and the "esp_ipa_metadata_t" it returned.
+ * The structures are written as they are in memory, the sizes let a reader built
+ * against another esp_ipa version or ABI reject the file.
+ */
+typedef struct esp_video_ipa_record_header {
+    uint32_t magic;                                 /*!< ESP_VIDEO_IPA_RECORD_MAGIC */
+    uint16_t version;                               /*!< ESP_VIDEO_IPA_RECORD_VERSION */
+    uint16_t header_size;                           /*!< Size of this header */
+    uint16_t stats_size;                            /*!< Size of "esp_ipa_stats_t" */
+    uint16_t sensor_size;                           /*!< Size of "esp_ipa_sensor_t" */
+    uint16_t metadata_size;                         /*!< Size of "esp_ipa_metadata_t" */
+    uint16_t reserved;
+    char sensor[ESP_VIDEO_IPA_RECORD_NAME_LEN];     /*!< Camera sensor name, selects the IPA configuration */
+} esp_video_ipa_record_header_t;
+
+/**
+ * @brief Image algorithm record entry header.
+ */
+typedef struct esp_video_ipa_record_frame {
+    int64_t time_us;                                /*!< esp_timer time of the run */
+    uint32_t process_us;                            /*!< CPU time of esp_ipa_pipeline_process() on target */
+    uint32_t reserved;
+} esp_video_ipa_record_frame_t;
+
+/**
+ * @brief Image algorithm replay result.
+ *
+ * The output has settled from the first run after which exposure, gain and the
+ * red and blue gains all stay within CONFIG_ESP_VIDEO_IPA_REPLAY_SETTLE_PERMILLE of
+ * their final values, 0 if they never left that band.
+ */
+typedef struct esp_video_ipa_replay_result {
+    uint32_t frames;                                /*!< Image algorithm runs replayed */
+    uint64_t total_us;                              /*!< CPU time of all replayed runs */
+    uint32_t max_us;                                /*!< Slowest replayed run */
+    uint64_t recorded_us;                           /*!< CPU time of the same runs when recorded */
+    uint32_t settled;                               /*!< Run from which the replayed output has settled */
+    uint32_t recorded_settled;                      /*!< Same for the recorded output */
+    uint32_t exposure;                              /*!< Final replayed exposure */
+    float gain;                                     /*!< Final replayed gain */
+    float red_gain;                                 /*!< Final replayed red balance gain */
+    float blue_gain;                                /*!< Final replayed blue balance gain */
+} esp_video_ipa_replay_result_t;
+
+/**
+ * @brief Feed a record of CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD through the image algorithms.
+ *
+ * A new IPA pipeline of the recorded sensor's configuration starts from the sensor
+ * state of the first entry and processes the recorded statistics in order. The
+ * replay is open loop: the sensor state of every run is the recorded one, not what
+ * the replayed algorithms asked for, so it shows how a tuning change reacts to the
+ * same input. Only available with CONFIG_ESP_VIDEO_IPA_REPLAY.
+ *
+ * @param path   Record file
+ * @param out    If not NULL, one CSV line per run is written to it: run, sequence,
+ *               CPU time, then exposure, gain, red and blue gain replayed and recorded
+ * @param result Replay result
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if path or result is NULL
+ *      - ESP_ERR_NOT_FOUND if the file can't be opened or the sensor has no IPA configuration
+ *      - ESP_ERR_INVALID_VERSION if the file is no record or was written by another version or ABI
+ *      - ESP_ERR_INVALID_SIZE if the record has no complete entry
+ *      - ESP_ERR_NO_MEM if out of memory
+ *      - Others if the IPA pipeline failed
+ */
+esp_err_t esp_video_ipa_replay(const char *path, FILE *out, esp_video_ipa_replay_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
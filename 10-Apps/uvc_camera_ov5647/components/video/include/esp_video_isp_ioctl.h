@@ -30,10 +30,15 @@ extern "C" {
 #define V4L2_CID_USER_ESP_ISP_LSC           (V4L2_CID_USER_ESP_ISP_BASE + 0x0006)   /*!< LSC V4L2 controller ID */
 
 /**
- * @brief ESP32XXX ISP image statistics output, data type is "esp_ipa_stats_t"
+ * @brief ESP32XXX ISP image statistics output, data type is "esp_video_isp_stats_t"
  */
 #define V4L2_META_FMT_ESP_ISP_STATS         v4l2_fourcc('E', 'S', 'T', 'A')
 
+/**
+ * @brief ESP32XXX ISP image statistics output, data type is "esp_ipa_stats_t" and "seq" is the frame sequence number
+ */
+#define V4L2_META_FMT_ESP_IPA_STATS         v4l2_fourcc('E', 'I', 'P', 'A')
+
 /**
  * @brief ESP32XXX ISP data precision
  */
@@ -180,6 +185,8 @@ typedef struct esp_video_isp_stats {
     esp_isp_awb_evt_data_t awb;             /*!< ISP white balance statistics */
     esp_isp_hist_evt_data_t hist;           /*!< ISP histogram statistics */
     esp_isp_sharpen_evt_data_t sharpen;     /*!< ISP sharpen statistics */
+
+    uint32_t frame_seq; /*!< Sequence number of the frame, same as the capture buffer sequence of that frame */
 } esp_video_isp_stats_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Convert one frame from one pixel format to another.
+ *
+ * Width must be a multiple of 8 and height a multiple of 2, src and dst 4-byte aligned.
+ * Frames are tightly packed, formats use the layouts of this component, e.g.
+ * V4L2_PIX_FMT_YUV420 is "U Y Y" on even and "V Y Y" on odd lines.
+ *
+ * @param src    Source frame
+ * @param dst    Destination frame
+ * @param width  Source frame width in pixels
+ * @param height Source frame height in pixels
+ */
+typedef void (*esp_video_pixconv_func_t)(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height);
+
+/**
+ * @brief Find the software conversion between two pixel formats.
+ *
+ * Supported conversions:
+ *      - V4L2_PIX_FMT_YUYV    <-> V4L2_PIX_FMT_NV12
+ *      - V4L2_PIX_FMT_YUV422P <-> V4L2_PIX_FMT_YUV420
+ *      - V4L2_PIX_FMT_RGB565  <-> V4L2_PIX_FMT_RGB24
+ *      - V4L2_PIX_FMT_YUV420  ->  V4L2_PIX_FMT_GREY, the luma plane
+ *      - 8-bit Bayer          ->  V4L2_PIX_FMT_GREY, at half width and height for preview
+ *
+ * Kernels work on 32-bit words, several pixels per load and store, so a frame costs
+ * about one pass over PSRAM in each direction.
+ *
+ * @param src_format Source V4L2 pixel format
+ * @param dst_format Destination V4L2 pixel format
+ *
+ * @return Conversion function, or NULL if the conversion isn't supported
+ */
+esp_video_pixconv_func_t esp_video_pixconv_find(uint32_t src_format, uint32_t dst_format);
+
+/**
+ * @brief Get the frame size of a pixel format supported by the software conversions.
+ *
+ * @param format V4L2 pixel format
+ * @param width  Frame width in pixels
+ * @param height Frame height in pixels
+ *
+ * @return Frame size in bytes, or 0 if the format isn't supported
+ */
+uint32_t esp_video_pixconv_frame_size(uint32_t format, uint32_t width, uint32_t height);
+
+#ifdef __cplusplus
+}
+#endif
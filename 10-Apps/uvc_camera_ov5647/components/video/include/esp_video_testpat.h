@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Stream frames of a clip instead of the test pattern.
+ *
+ * The test pattern video device copies one frame per frame period, looping over the clip.
+ * Frames must be in the capture format set by VIDIOC_S_FMT, and the clip must stay valid
+ * until it is replaced. Call with frames NULL to go back to the test pattern.
+ *
+ * @param frames      Frames back to back, e.g. in PSRAM or a partition mapped by esp_partition_mmap()
+ * @param frame_size  Size of one frame in bytes
+ * @param frame_count Number of frames
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the clip is empty
+ *      - ESP_ERR_INVALID_STATE if the device is streaming
+ */
+esp_err_t esp_video_testpat_set_clip(const void *frames, uint32_t frame_size, uint32_t frame_count);
+
+#ifdef __cplusplus
+}
+#endif
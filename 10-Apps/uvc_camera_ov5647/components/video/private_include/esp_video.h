@@ -15,6 +15,7 @@
 #include "linux/videodev2.h"
 #include "esp_video_buffer.h"
 #include "esp_video_internal.h"
+#include "esp_video_ioctl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,11 +38,43 @@ struct esp_video_stream {
     struct v4l2_format format;              /*!< Video stream format */
     struct esp_video_buffer_info buf_info;  /*!< Video stream buffer information */
 
-    esp_video_buffer_list_t queued_list;    /*!< Workqueue buffer elements list */
-    esp_video_buffer_list_t done_list;      /*!< Done buffer elements list */
+    /**
+     * Queued elements are produced by VIDIOC_QBUF and subscriber releases from several tasks,
+     * so producers hold stream_lock. Done elements are produced by the driver. The driver
+     * side of a capture stream, usually an ISR, takes no lock, task side consumers hold
+     * stream_lock. M2M streams hold stream_lock on both sides to move source and destination
+     * elements together.
+     */
+    esp_video_buffer_ring_t queued_ring;    /*!< Elements queued to the driver, the driver takes the oldest first, or the newest with ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO */
+    esp_video_buffer_ring_t done_ring;      /*!< Elements filled by the driver, oldest first */
 
     struct esp_video_buffer *buffer;        /*!< Video stream buffer */
     SemaphoreHandle_t ready_sem;            /*!< Video stream buffer element ready semaphore */
+
+    struct esp_video_buffer_policy buf_policy; /*!< Video stream buffer placement policy */
+    uint32_t sequence;                      /*!< Sequence number of the next done buffer element */
+};
+
+struct esp_video_m2m_async;
+
+#define ESP_VIDEO_POLL_IN       (1 << 0)    /*!< VIDIOC_DQBUF of a capture stream doesn't block */
+#define ESP_VIDEO_POLL_OUT      (1 << 1)    /*!< VIDIOC_DQBUF of an output stream doesn't block */
+
+/**
+ * @brief Video device client object, one for every opened file.
+ */
+struct esp_video_client {
+    bool opened;                            /*!< Client slot is used by an opened file */
+    uint32_t sub_type;                      /*!< Subscribed stream type, 0 if the client is not a subscriber */
+
+    struct esp_video_buffer_element **ring; /*!< Done elements not dequeued by the client yet */
+    uint32_t ring_size;                     /*!< Ring capacity, also the maximum number of held elements */
+    uint32_t ring_head;                     /*!< Index of the oldest element in ring */
+    uint32_t ring_count;                    /*!< Number of elements in ring */
+    SemaphoreHandle_t ready_sem;            /*!< Ring element ready semaphore */
+
+    bool nonblock;                          /*!< VIDIOC_DQBUF returns at once if no element is done, O_NONBLOCK of the file */
+    uint32_t dqbuf_timeout_ms;              /*!< VIDIOC_DQBUF timeout set by VIDIOC_S_DQBUF_TIMEOUT, 0 waits forever */
 };
 
 /**
@@ -60,9 +93,18 @@ struct esp_video {
 
     portMUX_TYPE stream_lock;               /*!< Stream list lock */
     struct esp_video_stream *stream;        /*!< Video device stream, capture-only or output-only device has 1 stream, M2M device has 2 streams */
+    struct esp_video_stream *capture_stream; /*!< Stream of V4L2_BUF_TYPE_VIDEO_CAPTURE, NULL if none, resolved at creation */
+    struct esp_video_stream *output_stream; /*!< Stream of V4L2_BUF_TYPE_VIDEO_OUTPUT, NULL if none, resolved at creation */
+    struct esp_video_stream *meta_stream;   /*!< Stream of V4L2_BUF_TYPE_META_CAPTURE, NULL if none, resolved at creation */
 
     SemaphoreHandle_t mutex;                /*!< Video device mutex lock */
     uint8_t reference;                      /*!< video device open reference count */
+
+    struct esp_video_m2m_async *m2m_async;  /*!< M2M background process task, NULL if data is processed in VIDIOC_DQBUF */
+
+    struct esp_video_client client[CONFIG_ESP_VIDEO_MAX_CLIENTS]; /*!< Opened file clients */
+
+    struct esp_video_frame_meta frame_meta; /*!< Capture settings copied into every done capture element, protected by stream_lock */
 };
 
 /**
@@ -115,6 +157,98 @@ struct esp_video *esp_video_open(const char *name);
  */
 esp_err_t esp_video_close(struct esp_video *video);
 
+/**
+ * @brief Allocate a client slot for an opened file of video device.
+ *
+ * @param video Video object
+ *
+ * @return
+ *      - Client slot index on success
+ *      - -1 if all slots are used
+ */
+int esp_video_client_open(struct esp_video *video);
+
+/**
+ * @brief Free a client slot, the client is unsubscribed firstly.
+ *
+ * @param video Video object
+ * @param index Client slot index
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_client_close(struct esp_video *video, int index);
+
+/**
+ * @brief Get client object by slot index.
+ *
+ * @param video Video object
+ * @param index Client slot index
+ *
+ * @return
+ *      - Client object pointer on success
+ *      - NULL if failed
+ */
+struct esp_video_client *esp_video_get_client(struct esp_video *video, int index);
+
+/**
+ * @brief Get the events a client can handle without blocking, for select().
+ *
+ * A client is readable if VIDIOC_DQBUF of the capture or meta capture stream, or of
+ * its subscriber ring, finds a done element, and writable if VIDIOC_DQBUF of the
+ * output stream does. A M2M device processing data in VIDIOC_DQBUF is ready both
+ * ways once both streams have a queued element. The state is read without a lock,
+ * so this can be called from ISR.
+ *
+ * @param video  Video object
+ * @param client Video client object
+ *
+ * @return ESP_VIDEO_POLL_IN and ESP_VIDEO_POLL_OUT bits of the ready events
+ */
+uint32_t esp_video_client_poll(struct esp_video *video, struct esp_video_client *client);
+
+/**
+ * @brief Subscribe a client to a capture stream, or unsubscribe it if depth is 0.
+ *
+ * @param video  Video object
+ * @param client Client object
+ * @param sub    Subscription description
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_client_subscribe(struct esp_video *video, struct esp_video_client *client,
+                                     const struct esp_video_buffer_subscribe *sub);
+
+/**
+ * @brief Receive a done buffer element of the subscribed stream of a client.
+ *
+ * @param video  Video object
+ * @param client Client object
+ * @param ticks  Wait OS tick
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if failed
+ */
+struct esp_video_buffer_element *esp_video_client_recv_element(struct esp_video *video, struct esp_video_client *client,
+                                                               uint32_t ticks);
+
+/**
+ * @brief Give a buffer element received by a subscribed client back to the stream.
+ *
+ * @param video  Video object
+ * @param client Client object
+ * @param index  Video buffer element index
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_client_release_element_index(struct esp_video *video, struct esp_video_client *client, int index);
+
 /**
  * @brief Start capturing video data stream.
  *
@@ -204,6 +338,30 @@ esp_err_t esp_video_setup_buffer(struct esp_video *video, uint32_t type, uint32_
  */
 esp_err_t esp_video_get_buffer_info(struct esp_video *video, uint32_t type, struct esp_video_buffer_info *info);
 
+/**
+ * @brief Set video stream buffer placement policy, it takes effect when setting up buffer next time.
+ *
+ * @param video  Video object
+ * @param policy Video stream buffer placement policy pointer, policy->type selects the stream
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_buffer_policy(struct esp_video *video, const struct esp_video_buffer_policy *policy);
+
+/**
+ * @brief Get video stream buffer placement policy.
+ *
+ * @param video  Video object
+ * @param policy Video stream buffer placement policy pointer, policy->type selects the stream
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_buffer_policy(struct esp_video *video, struct esp_video_buffer_policy *policy);
+
 /**
  * @brief Get buffer element from buffer queued list.
  *
@@ -332,6 +490,100 @@ esp_err_t esp_video_queue_element_index(struct esp_video *video, uint32_t type,
  */
 esp_err_t esp_video_queue_element_index_buffer(struct esp_video *video, uint32_t type, int index, uint8_t *buffer, uint32_t size);
 
+/**
+ * @brief Synchronize CPU cache of a range of buffer element.
+ *
+ * @param video   Video object
+ * @param sync    Buffer synchronization description
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_sync_element_index(struct esp_video *video, const struct esp_video_buffer_sync *sync);
+
+/**
+ * @brief Get the metadata of a capture buffer element.
+ *
+ * @param video   Video object
+ * @param meta    Frame metadata, type and index select the buffer element
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_element_index_meta(struct esp_video *video, struct esp_video_frame_meta *meta);
+
+/**
+ * @brief Update the capture settings which are copied into buffer elements done from now on.
+ *
+ * @param video   Video object
+ * @param meta    Frame metadata, only fields given by meta->flags are updated
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_frame_meta(struct esp_video *video, const struct esp_video_frame_meta *meta);
+
+/**
+ * @brief Export buffer element as a handle which other video devices can import by
+ *        V4L2_MEMORY_DMABUF.
+ *
+ * @param video   Video object
+ * @param type    Video stream type
+ * @param index   Video buffer element index
+ * @param fd      Exported buffer handle pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_export_element_index(struct esp_video *video, uint32_t type, int index, int *fd);
+
+/**
+ * @brief Put buffer element index into queued list, buffer is imported from the
+ *        buffer element of another video device.
+ *
+ * @param video   Video object
+ * @param type    Video stream type
+ * @param index   Video buffer element index
+ * @param fd      Buffer handle exported by esp_video_export_element_index
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_queue_element_index_dmabuf(struct esp_video *video, uint32_t type, int index, int fd);
+
+/**
+ * @brief Set buffer element timestamp, M2M source stream timestamp is copied to destination stream.
+ *
+ * @param video     Video object
+ * @param type      Video stream type
+ * @param index     Video buffer element index
+ * @param timestamp Timestamp in microseconds
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_element_index_timestamp(struct esp_video *video, uint32_t type, int index, int64_t timestamp);
+
+/**
+ * @brief Set valid data size of a buffer element, e.g. of a compressed image queued to an M2M decoder.
+ *
+ * @param video     Video object
+ * @param type      Video stream type
+ * @param index     Video buffer element index
+ * @param size      Valid data size, 0 if the whole buffer is valid
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_element_index_valid_size(struct esp_video *video, uint32_t type, int index, uint32_t size);
+
 /**
  * @brief Get buffer element payload.
  *
@@ -354,6 +606,15 @@ uint8_t *esp_video_get_element_index_payload(struct esp_video *video, uint32_t t
  */
 struct esp_video *esp_video_device_get_object(const char *name);
 
+/**
+ * @brief Get video object by device ID
+ *
+ * @param id The video device ID
+ *
+ * @return Video object pointer if found by ID
+ */
+struct esp_video *esp_video_device_get_object_by_id(uint8_t id);
+
 /**
  * @brief Get video stream object pointer by stream type.
  *
@@ -364,6 +625,31 @@ struct esp_video *esp_video_device_get_object(const char *name);
  */
 struct esp_video_stream *esp_video_get_stream(struct esp_video *video, enum v4l2_buf_type type);
 
+/**
+ * @brief Get video stream object pointer by stream type, the video object is not checked.
+ *
+ * Streams are resolved when the video object is created, so this is a switch on the type
+ * and safe to be inlined into ISRs.
+ *
+ * @param video  Video object
+ * @param type   Video stream type
+ *
+ * @return Video stream object pointer, NULL if the video object has no stream of this type
+ */
+static inline struct esp_video_stream *esp_video_stream_of(const struct esp_video *video, uint32_t type)
+{
+    switch (type) {
+    case V4L2_BUF_TYPE_VIDEO_CAPTURE:
+        return video->capture_stream;
+    case V4L2_BUF_TYPE_VIDEO_OUTPUT:
+        return video->output_stream;
+    case V4L2_BUF_TYPE_META_CAPTURE:
+        return video->meta_stream;
+    default:
+        return NULL;
+    }
+}
+
 /**
  * @brief Get video buffer type.
  *
@@ -531,6 +817,45 @@ esp_err_t esp_video_query_ext_control(struct esp_video *video, struct v4l2_query
  */
 esp_err_t esp_video_m2m_process(struct esp_video *video, uint32_t src_type, uint32_t dst_type, esp_video_m2m_process_t proc);
 
+/**
+ * @brief Start processing M2M video device data in a background task.
+ *
+ * Queued source and destination element pairs are processed in queueing order
+ * as soon as both are available, VIDIOC_QBUF returns immediately and
+ * VIDIOC_DQBUF waits for the done list.
+ *
+ * @param video       Video object
+ * @param src_type    Video resource stream type
+ * @param dst_type    Video destination stream type
+ * @param proc        Video device process callback function
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_m2m_async_start(struct esp_video *video, uint32_t src_type, uint32_t dst_type, esp_video_m2m_process_t proc);
+
+/**
+ * @brief Stop processing M2M video device data in a background task, the element pair
+ *        being processed is finished first.
+ *
+ * @param video Video object
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_m2m_async_stop(struct esp_video *video);
+
+/**
+ * @brief Wake up the M2M background process task after buffer elements are queued.
+ *
+ * @param video Video object
+ *
+ * @return None
+ */
+void esp_video_m2m_async_trigger(struct esp_video *video);
+
 /**
  * @brief Set format to sensor
  *
@@ -555,6 +880,32 @@ esp_err_t esp_video_set_sensor_format(struct esp_video *video, const esp_cam_sen
  */
 esp_err_t esp_video_get_sensor_format(struct esp_video *video, esp_cam_sensor_format_t *format);
 
+/**
+ * @brief Write a register of the sensor
+ *
+ * @param video Video object
+ * @param reg   Register address, size and value, match selects the sensor
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED if the device has no register access
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_register(struct esp_video *video, const struct v4l2_dbg_register *reg);
+
+/**
+ * @brief Read a register of the sensor
+ *
+ * @param video Video object
+ * @param reg   Register address and size, filled with the value
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED if the device has no register access
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_register(struct esp_video *video, struct v4l2_dbg_register *reg);
+
 /**
  * @brief Query menu value
  *
@@ -567,6 +918,54 @@ esp_err_t esp_video_get_sensor_format(struct esp_video *video, esp_cam_sensor_fo
  */
 esp_err_t esp_video_query_menu(struct esp_video *video, struct v4l2_querymenu *qmenu);
 
+/**
+ * @brief Set video stream parameters, e.g. frame interval.
+ *
+ * @param video Video object
+ * @param parm  Stream parameters, filled with the values applied by the driver
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_parm(struct esp_video *video, struct v4l2_streamparm *parm);
+
+/**
+ * @brief Get video stream parameters.
+ *
+ * @param video Video object
+ * @param parm  Stream parameters buffer pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_parm(struct esp_video *video, struct v4l2_streamparm *parm);
+
+/**
+ * @brief Set video selection rectangle, e.g. crop window.
+ *
+ * @param video Video object
+ * @param sel   Selection, filled with the rectangle applied by the driver
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_selection(struct esp_video *video, struct v4l2_selection *sel);
+
+/**
+ * @brief Get video selection rectangle.
+ *
+ * @param video Video object
+ * @param sel   Selection buffer pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_selection(struct esp_video *video, struct v4l2_selection *sel);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,10 +9,11 @@
 #include "sdkconfig.h"
 #include <stdint.h>
 #include <stddef.h>
-#include <sys/queue.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_video_ioctl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,17 +29,26 @@ extern "C" {
 #define ELEMENT_SET_ALLOCATED(e)            { (e)->free = false; }
 #define ELEMENT_IS_FREE(e)                  ((e)->free == true)
 
-struct esp_video_buffer_element;
+#define ELEMENT_CACHE_DMA_WRITTEN           (1 << 0)    /*!< DMA wrote the buffer after the CPU cache was last invalidated */
 
-/**
- * @brief Video buffer element.
- */
-typedef SLIST_ENTRY(esp_video_buffer_element) esp_video_buffer_node_t;
+#define ELEMENT_SET_DMA_WRITTEN(e)          { (e)->cache_flags |= ELEMENT_CACHE_DMA_WRITTEN; }
+#define ELEMENT_IS_CPU_DIRTY(e)             ((e)->dirty_end > (e)->dirty_start)
+
+#define ESP_VIDEO_BUFFER_RING_SIZE          32          /*!< Element ring capacity and maximum buffer count of a stream, power of 2 */
 
 /**
- * @brief Video buffer list.
+ * @brief Video buffer element index ring, one producer and one consumer.
+ *
+ * Each side only writes its own counter, so a side running in ISR context needs no
+ * critical section. An element is in one ring at most, so a ring never overflows.
+ * A consumer taking the newest element instead writes the producer counter and
+ * shares the producer's lock.
  */
-typedef SLIST_HEAD(esp_video_buffer_list, esp_video_buffer_element) esp_video_buffer_list_t;
+typedef struct esp_video_buffer_ring {
+    uint32_t head;                                    /*!< Consumer counter */
+    uint32_t tail;                                    /*!< Producer counter */
+    uint8_t index[ESP_VIDEO_BUFFER_RING_SIZE];        /*!< Element indexes */
+} esp_video_buffer_ring_t;
 
 
 struct esp_video_buffer;
@@ -52,6 +62,10 @@ struct esp_video_buffer_info {
     uint32_t align_size;                              /*!< Buffer align size in byte, if buffer capability contains of MALLOC_CAP_CACHE_ALIGNED, this value will be unused */
     uint32_t caps;                                    /*!< Buffer capability: refer to esp_heap_caps.h MALLOC_CAP_XXX */
     uint32_t memory_type;                             /*!< Buffer memory type: refer to v4l2_memory in videodev2.h. */
+    uint32_t hot_count;                               /*!< Number of buffers, from index 0, allocated with hot_caps firstly */
+    uint32_t hot_caps;                                /*!< Hot buffer capability, if allocating fails, caps is used instead */
+    uint8_t *region;                                  /*!< Caller memory the buffers not placed in hot memory are carved from, NULL to allocate them */
+    uint32_t region_size;                             /*!< Caller memory size */
 };
 
 /**
@@ -60,12 +74,24 @@ struct esp_video_buffer_info {
 struct esp_video_buffer_element {
     bool free;                                        /*!< Mark if this element is free */
 
-    esp_video_buffer_node_t node;                     /*!< List node */
     struct esp_video_buffer *video_buffer;            /*!< Source buffer object */
-    uint32_t index;                                   /*!< List node index */
+    uint32_t index;                                   /*!< Element index */
     uint8_t *buffer;                                  /*!< Buffer space to fill data */
+    uint32_t caps;                                    /*!< Capability the buffer space was allocated with, 0 if it is carved from the slab, V4L2_MEMORY_MMAP only */
 
     uint32_t valid_size;                              /*!< Valid data size */
+    uint32_t sequence;                                /*!< Stream sequence number when data is done */
+    uint32_t frame_flags;                             /*!< Frame type flags, V4L2_BUF_FLAG_KEYFRAME/PFRAME/BFRAME, M2M destination streams only */
+    int64_t timestamp;                                /*!< Frame end time in microseconds, M2M devices copy it from source to destination */
+    int dmabuf_fd;                                    /*!< Imported buffer handle, V4L2_MEMORY_DMABUF only */
+    uint8_t refcount;                                 /*!< Holders of a done element: stream owner and subscribed clients */
+    uint8_t readers;                                  /*!< Bit mask of subscribed clients holding this element */
+
+    uint32_t cache_flags;                             /*!< Cache state, ELEMENT_CACHE_XXX */
+    uint32_t dirty_start;                             /*!< Start offset of the range CPU wrote and is not written back yet */
+    uint32_t dirty_end;                               /*!< End offset of the range CPU wrote and is not written back yet */
+
+    struct esp_video_frame_meta meta;                 /*!< Capture settings when data was done, capture streams only */
 };
 
 /**
@@ -73,6 +99,10 @@ struct esp_video_buffer_element {
  */
 struct esp_video_buffer {
     struct esp_video_buffer_info info;              /*!< Buffer information */
+    uint8_t *slab;                                  /*!< Contiguous memory of the elements not placed in hot memory, NULL if none */
+    uint32_t slab_size;                             /*!< Slab size in bytes */
+    uint32_t slab_align;                            /*!< Slab and element stride alignment in bytes */
+    bool slab_allocated;                            /*!< Slab is allocated by the buffer instead of carved from info.region */
     struct esp_video_buffer_element element[0];     /*!< Element buffer */
 };
 
@@ -98,6 +128,18 @@ struct esp_video_buffer *esp_video_buffer_create(const struct esp_video_buffer_i
  */
 struct esp_video_buffer *esp_video_buffer_clone(const struct esp_video_buffer *buffer);
 
+/**
+ * @brief Check if video buffer object can be used for a new buffer information.
+ *
+ * @param buffer Video buffer object
+ * @param info   New buffer information pointer
+ *
+ * @return
+ *      - true if the existing buffer elements meet the new buffer information
+ *      - false if the video buffer must be re-created
+ */
+bool esp_video_buffer_is_reusable(const struct esp_video_buffer *buffer, const struct esp_video_buffer_info *info);
+
 /**
  * @brief Destroy video buffer object.
  *
@@ -121,6 +163,46 @@ esp_err_t esp_video_buffer_destroy(struct esp_video_buffer *buffer);
  */
 struct esp_video_buffer_element *esp_video_buffer_get_element_by_buffer(struct esp_video_buffer *buffer, uint8_t *ptr);
 
+/**
+ * @brief Record that CPU wrote a range of the element buffer, the range is written back
+ *        by esp_video_buffer_element_writeback.
+ *
+ * @param element Video buffer element object
+ * @param offset  Start offset of the written range
+ * @param size    Size of the written range
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_buffer_element_mark_dirty(struct esp_video_buffer_element *element, uint32_t offset, uint32_t size);
+
+/**
+ * @brief Write back the CPU written range of the element buffer before DMA accesses it,
+ *        nothing is done if CPU didn't write the buffer.
+ *
+ * @param element Video buffer element object
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_buffer_element_writeback(struct esp_video_buffer_element *element);
+
+/**
+ * @brief Invalidate CPU cache of a range of the element buffer before CPU reads it,
+ *        nothing is done if DMA didn't write the buffer since the last invalidation.
+ *
+ * @param element Video buffer element object
+ * @param offset  Start offset of the range to read
+ * @param size    Size of the range to read
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_buffer_element_invalidate(struct esp_video_buffer_element *element, uint32_t offset, uint32_t size);
+
 /**
  * @brief Get one element buffer total size
  *
@@ -217,6 +299,107 @@ static inline struct esp_video_buffer_element *esp_video_buffer_get_element_by_o
  */
 void esp_video_buffer_reset(struct esp_video_buffer *buffer);
 
+/**
+ * @brief Free the buffer memory kept by the pool for reuse
+ *
+ * @return Number of freed buffers
+ */
+uint32_t esp_video_buffer_pool_flush(void);
+
+/**
+ * @brief Empty an element ring, neither side may use the ring meanwhile
+ *
+ * @param ring Element ring object
+ *
+ * @return None
+ */
+static inline void esp_video_buffer_ring_reset(esp_video_buffer_ring_t *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+/**
+ * @brief Check if an element ring is empty
+ *
+ * @param ring Element ring object
+ *
+ * @return true if the ring holds no element
+ */
+static inline bool esp_video_buffer_ring_is_empty(esp_video_buffer_ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Add an element to the tail of a ring, producer side
+ *
+ * @param ring    Element ring object
+ * @param element Video buffer element object, it must not be in any ring
+ *
+ * @return None
+ */
+static inline void esp_video_buffer_ring_push(esp_video_buffer_ring_t *ring, struct esp_video_buffer_element *element)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    ring->index[tail % ESP_VIDEO_BUFFER_RING_SIZE] = element->index;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Remove the oldest element of a ring, consumer side
+ *
+ * @param ring   Element ring object
+ * @param buffer Video buffer object the elements belong to
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if the ring is empty
+ */
+static inline struct esp_video_buffer_element *esp_video_buffer_ring_pop(esp_video_buffer_ring_t *ring, struct esp_video_buffer *buffer)
+{
+    uint32_t index;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    index = ring->index[head % ESP_VIDEO_BUFFER_RING_SIZE];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return ESP_VIDEO_BUFFER_ELEMENT(buffer, index);
+}
+
+/**
+ * @brief Remove the newest element of a ring, consumer side
+ *
+ * It moves the producer counter back, so the caller must hold the lock the producer
+ * pushes under, and the ring must not be popped from the oldest end meanwhile.
+ *
+ * @param ring   Element ring object
+ * @param buffer Video buffer object the elements belong to
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if the ring is empty
+ */
+static inline struct esp_video_buffer_element *esp_video_buffer_ring_pop_newest(esp_video_buffer_ring_t *ring, struct esp_video_buffer *buffer)
+{
+    uint32_t index;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    index = ring->index[(tail - 1) % ESP_VIDEO_BUFFER_RING_SIZE];
+    __atomic_store_n(&ring->tail, tail - 1, __ATOMIC_RELEASE);
+
+    return ESP_VIDEO_BUFFER_ELEMENT(buffer, index);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <math.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "esp_cam_sensor_types.h"
 #include "driver/jpeg_encode.h"
@@ -24,6 +26,10 @@ extern "C" {
 #define ESP_VIDEO_ISP_DEVICE_LSC    1       /*!< ISP video device enable LSC */
 #endif
 
+#if CONFIG_SOC_ISP_CROP_SUPPORTED
+#define ESP_VIDEO_ISP_DEVICE_CROP   1       /*!< ISP video device crops its output */
+#endif
+
 /**
  * @brief MIPI-CSI state
  */
@@ -36,6 +42,9 @@ typedef struct esp_video_csi_state {
     bool line_sync;                         /*!< true: line has start and end packet; false. line has no start and end packet */
     bool bypass_isp;                        /*!< true: ISP directly output data from input port with processing. false: ISP output processed data by pipeline  */
     color_raw_element_order_t bayer_order;  /*!< Bayer order of raw data */
+    uint32_t in_width;                      /*!< Camera sensor frame width */
+    uint32_t in_height;                     /*!< Camera sensor frame height */
+    struct v4l2_rect crop;                  /*!< ISP output window in sensor frame pixels, zero size for the whole frame */
 } esp_video_csi_state_t;
 
 /**
@@ -64,6 +73,19 @@ esp_err_t esp_video_create_csi_video_device(esp_cam_sensor_device_t *cam_dev);
 esp_err_t esp_video_create_dvp_video_device(esp_cam_sensor_device_t *cam_dev);
 #endif
 
+/**
+ * @brief Create test pattern video device
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+#if CONFIG_ESP_VIDEO_ENABLE_TESTPAT_VIDEO_DEVICE
+esp_err_t esp_video_create_testpat_video_device(void);
+#endif
+
 /**
  * @brief Create H.264 video device
  *
@@ -74,7 +96,7 @@ esp_err_t esp_video_create_dvp_video_device(esp_cam_sensor_device_t *cam_dev);
  *      - Others if failed
  */
 #ifdef CONFIG_ESP_VIDEO_ENABLE_H264_VIDEO_DEVICE
-esp_err_t esp_video_create_h264_video_device(bool hw_codec);
+esp_err_t esp_video_create_h264_video_device(uint8_t id, bool hw_codec);
 #endif
 
 /**
@@ -92,6 +114,58 @@ esp_err_t esp_video_create_h264_video_device(bool hw_codec);
 esp_err_t esp_video_create_jpeg_video_device(jpeg_encoder_handle_t enc_handle);
 #endif
 
+/**
+ * @brief Create JPEG decoder video device
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+#if CONFIG_ESP_VIDEO_ENABLE_HW_JPEG_DECODER_VIDEO_DEVICE
+esp_err_t esp_video_create_jpeg_decoder_video_device(void);
+#endif
+
+/**
+ * @brief Create PPA video device
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+#if CONFIG_ESP_VIDEO_ENABLE_PPA_VIDEO_DEVICE
+esp_err_t esp_video_create_ppa_video_device(void);
+#endif
+
+/**
+ * @brief Create software pixel format converter video device
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+#if CONFIG_ESP_VIDEO_ENABLE_SWCONV_VIDEO_DEVICE
+esp_err_t esp_video_create_swconv_video_device(void);
+#endif
+
+/**
+ * @brief Create lens distortion correction video device
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+#if CONFIG_ESP_VIDEO_ENABLE_LDC_VIDEO_DEVICE
+esp_err_t esp_video_create_ldc_video_device(void);
+#endif
+
 #if CONFIG_ESP_VIDEO_ENABLE_ISP
 /**
  * @brief Start ISP process based on MIPI-CSI state
@@ -140,6 +214,35 @@ esp_err_t esp_video_isp_enum_format(uint32_t index, uint32_t *pixel_format);
 esp_err_t esp_video_isp_check_format(const struct v4l2_format *format);
 
 #if CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
+/**
+ * @brief Check if ISP parameters moved out of the update deadband
+ *
+ * @param cur  Applied parameters
+ * @param next New parameters
+ * @param n    Number of parameters
+ *
+ * @return true if any parameter changed by more than CONFIG_ESP_VIDEO_ISP_PARAM_DEADBAND thousandths
+ */
+static inline bool esp_video_isp_params_changed(const float *cur, const float *next, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (fabsf(next[i] - cur[i]) > CONFIG_ESP_VIDEO_ISP_PARAM_DEADBAND / 1000.0f) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Restart the statistics frame sequence, for a capture stream resumed without restarting ISP
+ *
+ * @param None
+ *
+ * @return None
+ */
+void esp_video_isp_restart_sequence(void);
+
 /**
  * @brief Create ISP video device
  *
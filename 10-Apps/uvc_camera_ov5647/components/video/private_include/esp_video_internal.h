@@ -260,12 +260,13 @@ struct esp_video;
  * @param dst           Destination buffer
  * @param dst_size      Destination buffer maximum size
  * @param dst_out_size  Actual destination data size
+ * @param dst_flags     Destination frame flags, V4L2_BUF_FLAG_KEYFRAME/PFRAME/BFRAME, left 0 if not applicable
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-typedef esp_err_t (*esp_video_m2m_process_t)(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size);
+typedef esp_err_t (*esp_video_m2m_process_t)(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags);
 
 /**
  * @brief Video operations object.
@@ -323,6 +324,30 @@ struct esp_video_ops {
     /*!< Query menu value */
 
     esp_err_t (*query_menu)(struct esp_video *video, struct v4l2_querymenu *qmenu);
+
+    /*!< Set stream parameters, driver writes back the values it applied */
+
+    esp_err_t (*set_parm)(struct esp_video *video, struct v4l2_streamparm *parm);
+
+    /*!< Get stream parameters */
+
+    esp_err_t (*get_parm)(struct esp_video *video, struct v4l2_streamparm *parm);
+
+    /*!< Set selection rectangle, driver writes back the rectangle it applied */
+
+    esp_err_t (*set_selection)(struct esp_video *video, struct v4l2_selection *sel);
+
+    /*!< Get selection rectangle */
+
+    esp_err_t (*get_selection)(struct esp_video *video, struct v4l2_selection *sel);
+
+    /*!< Write a register of the sensor */
+
+    esp_err_t (*set_register)(struct esp_video *video, const struct v4l2_dbg_register *reg);
+
+    /*!< Read a register of the sensor, driver fills in the value */
+
+    esp_err_t (*get_register)(struct esp_video *video, struct v4l2_dbg_register *reg);
 };
 
 #ifdef __cplusplus
@@ -18,6 +18,7 @@ extern "C" {
  * @brief video device ioctl
  *
  * @param video video object
+ * @param client client object of the opened file
  * @param cmd ioctl cmd which is defined in include/linux/videodev2.h
  * @param args the args list of the ioctl cmd
  *
@@ -25,7 +26,76 @@ extern "C" {
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_ioctl(struct esp_video *video, int cmd, va_list args);
+esp_err_t esp_video_ioctl(struct esp_video *video, struct esp_video_client *client, int cmd, va_list args);
+
+/**
+ * @brief video device ioctl with the argument already taken from the args list
+ *
+ * @param video video object
+ * @param client client object of the opened file
+ * @param cmd ioctl cmd which is defined in include/linux/videodev2.h
+ * @param arg the arg of the ioctl cmd
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_ioctl_dispatch(struct esp_video *video, struct esp_video_client *client, int cmd, void *arg);
+
+/**
+ * @brief VIDIOC_QBUF of a client
+ *
+ * @param video video object
+ * @param client client object
+ * @param vbuf video buffer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_ioctl_qbuf(struct esp_video *video, struct esp_video_client *client, struct v4l2_buffer *vbuf);
+
+/**
+ * @brief VIDIOC_DQBUF of a client
+ *
+ * @param video video object
+ * @param client client object
+ * @param vbuf video buffer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_ioctl_dqbuf(struct esp_video *video, struct esp_video_client *client, struct v4l2_buffer *vbuf);
+
+/**
+ * @brief VIDIOC_DQBUF of a client, waiting at most the given time
+ *
+ * @param video video object
+ * @param client client object
+ * @param vbuf video buffer
+ * @param ticks maximum time to wait for a buffer, portMAX_DELAY waits forever
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_TIMEOUT if no buffer was done in time
+ *      - Others if failed
+ */
+esp_err_t esp_video_ioctl_dqbuf_timeout(struct esp_video *video, struct esp_video_client *client, struct v4l2_buffer *vbuf,
+                                        uint32_t ticks);
+
+/**
+ * @brief VIDIOC_BATCH_BUF of a client
+ *
+ * @param video video object
+ * @param client client object
+ * @param batch buffer batch
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_ioctl_batch_buf(struct esp_video *video, struct esp_video_client *client, struct esp_video_buffer_batch *batch);
 
 #ifdef __cplusplus
 }
@@ -21,6 +21,7 @@ typedef struct esp_video_isp_config {
     const char *isp_dev;                /*!< ISP video device name */
     const char *cam_dev;                /*!< Camera interface video device name, such as "/dev/video0"(MIPI-CSI) */
     const esp_ipa_config_t *ipa_config; /*!< IPA configuration */
+    const char *sensor_name;            /*!< Camera sensor name, stored in image algorithm records */
 } esp_video_isp_config_t;
 
 /**
@@ -34,6 +35,16 @@ typedef struct esp_video_isp_config {
  */
 esp_err_t esp_video_isp_pipeline_init(const esp_video_isp_config_t *config);
 
+/**
+ * @brief Get the image algorithm load counters, 0 before the controller runs.
+ *
+ * @param runs    Image algorithm runs since boot
+ * @param time_us CPU time of those runs in microseconds, wraps
+ *
+ * @return None
+ */
+void esp_video_isp_pipeline_get_load(uint32_t *runs, uint32_t *time_us);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_cache.h"
+#include "esp_memory_utils.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Memory placement and cache maintenance of the buffer and queue layer.
+ *
+ * For the linux target, which runs esp_video.c and esp_video_buffer.c on the host with
+ * FreeRTOS-POSIX, heap memory is uncached internal RAM and there is no video VFS.
+ */
+#if CONFIG_IDF_TARGET_LINUX
+
+#define ESP_VIDEO_PORT_HAS_VFS              0
+
+static inline bool esp_video_port_ptr_psram(const void *ptr)
+{
+    return false;
+}
+
+static inline bool esp_video_port_ptr_internal(const void *ptr)
+{
+    return true;
+}
+
+static inline size_t esp_video_port_cache_align(uint32_t caps)
+{
+    return 0;
+}
+
+static inline esp_err_t esp_video_port_writeback(void *ptr, size_t size)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_video_port_invalidate(void *ptr, size_t size)
+{
+    return ESP_OK;
+}
+
+#else
+
+#define ESP_VIDEO_PORT_HAS_VFS              1
+
+static inline bool esp_video_port_ptr_psram(const void *ptr)
+{
+    return esp_ptr_external_ram(ptr);
+}
+
+static inline bool esp_video_port_ptr_internal(const void *ptr)
+{
+    return esp_ptr_internal(ptr);
+}
+
+/* Cache line size of memory with the capability, 0 if the memory is not cached */
+static inline size_t esp_video_port_cache_align(uint32_t caps)
+{
+    size_t align = 0;
+
+    if (esp_cache_get_alignment((caps & MALLOC_CAP_SPIRAM) ? MALLOC_CAP_SPIRAM : (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA),
+                                &align) != ESP_OK) {
+        return 0;
+    }
+
+    return align;
+}
+
+/* Write a cache line aligned range back to memory for DMA to read */
+static inline esp_err_t esp_video_port_writeback(void *ptr, size_t size)
+{
+    return esp_cache_msync(ptr, size, ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+}
+
+/* Drop the cache lines of a cache line aligned range DMA wrote */
+static inline esp_err_t esp_video_port_invalidate(void *ptr, size_t size)
+{
+    return esp_cache_msync(ptr, size, ESP_CACHE_MSYNC_FLAG_DIR_M2C);
+}
+
+#endif /* CONFIG_IDF_TARGET_LINUX */
+
+#ifdef __cplusplus
+}
+#endif
@@ -61,6 +61,18 @@ esp_err_t esp_video_query_ext_ctrls_from_sensor(esp_cam_sensor_device_t *cam_dev
  */
 esp_err_t esp_video_query_menu_from_sensor(esp_cam_sensor_device_t *cam_dev, struct v4l2_querymenu *qmenu);
 
+/**
+ * @brief Check if the format is the one currently programmed into the camera sensor device
+ *
+ * @param cam_dev  Camera sensor device pointer
+ * @param format   Sensor format pointer
+ *
+ * @return
+ *      - true if the sensor runs the same register table already
+ *      - false if the format has to be written
+ */
+bool esp_video_sensor_format_is_current(esp_cam_sensor_device_t *cam_dev, const esp_cam_sensor_format_t *format);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,25 @@ esp_err_t esp_video_vfs_dev_register(const char *name, struct esp_video *video);
  */
 esp_err_t esp_video_vfs_dev_unregister(const char *name);
 
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+/**
+ * @brief Wake up select() calls waiting for files of a video device which became ready.
+ *
+ * Called after a done element is pushed or an element pair is queued to a M2M device
+ * processing data in VIDIOC_DQBUF, it can be called from ISR.
+ *
+ * @param video  Video object
+ * @param wakeup Set to pdTRUE if a higher priority task was woken up, only used in ISR
+ *
+ * @return None
+ */
+void esp_video_vfs_select_notify(struct esp_video *video, BaseType_t *wakeup);
+#else
+static inline void esp_video_vfs_select_notify(struct esp_video *video, BaseType_t *wakeup)
+{
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,11 +7,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/param.h>
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_attr.h"
 #include "esp_check.h"
 
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#endif
+
 #include "esp_ldo_regulator.h"
 #include "esp_cam_ctlr.h"
 #include "esp_cam_ctlr_csi.h"
@@ -19,6 +26,7 @@
 #include "esp_video.h"
 #include "esp_video_sensor.h"
 #include "esp_video_device_internal.h"
+#include "trace.h"
 
 #define CSI_NAME                    "MIPI-CSI"
 
@@ -39,6 +47,13 @@
 #define CSI_DEFAULT_OUT_BPP         16
 #define V4L2_DEFAULT_OUT_COLOR      V4L2_PIX_FMT_RGB565
 
+#define CSI_CROP_ALIGN              2       /* Whole 2x2 Bayer cells */
+#define CSI_CROP_MIN_SIZE           16
+
+/* Frame size the capture stream delivers, the crop window if one is set */
+#define CSI_OUT_WIDTH(s)            ((s)->crop.width ? (s)->crop.width : (s)->in_width)
+#define CSI_OUT_HEIGHT(s)           ((s)->crop.height ? (s)->crop.height : (s)->in_height)
+
 struct csi_video {
     esp_video_csi_state_t state;
 
@@ -46,8 +61,22 @@ struct csi_video {
     esp_ldo_channel_handle_t ldo_handle;
 
     esp_cam_sensor_device_t *cam_dev;
+    uint32_t target_fps;                        /* Frame rate asked by VIDIOC_S_PARM, 0 for any */
 #if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
+    /* Element of the stream the DMA writes, frames are dropped into it while no other is queued */
     struct esp_video_buffer_element *element;
+    bool element_reserved;                      /* Taken at STREAMON, not given to the DMA yet */
+    uint32_t dropped;
+#endif
+
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+    /* Between STREAMOFF and the standby timeout the controller stays enabled and ISP keeps running */
+    SemaphoreHandle_t standby_lock;
+    esp_timer_handle_t standby_timer;
+    bool standby;
+    esp_video_csi_state_t standby_state;        /* State the controller and ISP were started with */
+    esp_cam_ctlr_csi_config_t standby_config;
+    struct v4l2_pix_format standby_pix;
 #endif
 };
 
@@ -215,11 +244,16 @@ static bool IRAM_ATTR csi_video_on_trans_finished(esp_cam_ctlr_handle_t handle,
     struct esp_video *video = (struct esp_video *)user_data;
 
     ESP_LOGD(TAG, "size=%zu", trans->received_size);
+    TRACE_INSTANT(TRACE_CSI_EOF, trans->received_size);
 
 #if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
     if (trans->buffer != csi_video->element->buffer) {
         CAPTURE_VIDEO_DONE_BUF(video, trans->buffer, trans->received_size);
+    } else {
+        /* The frame is dropped, count it so buffer sequences match the ISP statistics frame sequence */
+        csi_video->dropped++;
+        CAPTURE_VIDEO_STREAM(video)->sequence++;
     }
 #else
     CAPTURE_VIDEO_DONE_BUF(video, trans->buffer, trans->received_size);
@@ -233,16 +267,23 @@ static bool IRAM_ATTR csi_video_on_get_new_trans(esp_cam_ctlr_handle_t handle, e
     struct esp_video_buffer_element *element;
     struct esp_video *video = (struct esp_video *)user_data;
 
-    element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
 #if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
 
-    if (!element) {
+    if (csi_video->element_reserved) {
+        csi_video->element_reserved = false;
         element = csi_video->element;
     } else {
-        csi_video->element = element;
+        element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
+        if (!element) {
+            /* Rewrite the frame in flight, it was never done, so no consumer can be reading it */
+            element = csi_video->element;
+        } else {
+            csi_video->element = element;
+        }
     }
 #else
+    element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
     if (!element) {
         return false;
     }
@@ -289,9 +330,17 @@ static esp_err_t init_config(struct esp_video *video)
 
     csi_video->state.line_sync = sensor_format.mipi_info.line_sync_en;
 
+    /* The crop window outlives a new sensor mode of the same frame size going through ISP */
+    if (csi_video->state.bypass_isp || sensor_format.width != csi_video->state.in_width ||
+            sensor_format.height != csi_video->state.in_height) {
+        memset(&csi_video->state.crop, 0, sizeof(csi_video->state.crop));
+    }
+    csi_video->state.in_width = sensor_format.width;
+    csi_video->state.in_height = sensor_format.height;
+
     CAPTURE_VIDEO_SET_FORMAT(video,
-                             sensor_format.width,
-                             sensor_format.height,
+                             CSI_OUT_WIDTH(&csi_video->state),
+                             CSI_OUT_HEIGHT(&csi_video->state),
                              v4l2_format);
 
     uint32_t buf_size = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video) * CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video) * csi_video->state.out_bpp / 8;
@@ -303,6 +352,10 @@ static esp_err_t init_config(struct esp_video *video)
     return ESP_OK;
 }
 
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+static void csi_standby_timer_cb(void *arg);
+#endif
+
 static esp_err_t csi_video_init(struct esp_video *video)
 {
     esp_err_t ret;
@@ -317,35 +370,221 @@ static esp_err_t csi_video_init(struct esp_video *video)
     ESP_GOTO_ON_ERROR(esp_cam_sensor_set_format(csi_video->cam_dev, NULL), fail_0, TAG, "failed to set basic format");
     ESP_GOTO_ON_ERROR(init_config(video), fail_0, TAG, "failed to initialize config");
 
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+    const esp_timer_create_args_t timer_args = {
+        .callback = csi_standby_timer_cb,
+        .arg = csi_video,
+        .name = "csi_standby",
+    };
+
+    csi_video->standby_lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(csi_video->standby_lock, ESP_ERR_NO_MEM, fail_0, TAG, "failed to create standby lock");
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &csi_video->standby_timer), fail_1, TAG, "failed to create standby timer");
+#endif
+
     return ESP_OK;
 
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+fail_1:
+    vSemaphoreDelete(csi_video->standby_lock);
+    csi_video->standby_lock = NULL;
+#endif
 fail_0:
     esp_ldo_release_channel(csi_video->ldo_handle);
     csi_video->ldo_handle = NULL;
     return ret;
 }
 
+static void csi_get_ctlr_config(struct esp_video *video, esp_cam_ctlr_csi_config_t *csi_config)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+
+    /* Cleared as a whole, so configurations can be compared with memcmp */
+    memset(csi_config, 0, sizeof(*csi_config));
+    csi_config->ctlr_id = CSI_CTRL_ID;
+    csi_config->clk_src = CSI_CLK_SRC;
+    csi_config->byte_swap_en = CSI_BYTE_SWAP_EN;
+    csi_config->queue_items = CSI_QUEUE_ITEMS;
+    csi_config->h_res = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video);
+    csi_config->v_res = CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video);
+    csi_config->data_lane_num = csi_video->state.lane_num;
+    csi_config->input_data_color_type = csi_video->state.in_color;
+    csi_config->output_data_color_type = csi_video->state.out_color;
+    csi_config->lane_bit_rate_mbps = csi_video->state.lane_bitrate_mbps;
+#if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
+    csi_config->bk_buffer_dis = true;
+#endif
+}
+
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+/* Stop ISP and free a controller which is enabled but not started, standby_lock must be held */
+static esp_err_t csi_standby_release(struct csi_video *csi_video)
+{
+    esp_timer_stop(csi_video->standby_timer);
+    csi_video->standby = false;
+
+    ESP_RETURN_ON_ERROR(esp_video_isp_stop(&csi_video->standby_state), TAG, "failed to stop ISP");
+    ESP_RETURN_ON_ERROR(esp_cam_ctlr_disable(csi_video->cam_ctrl_handle), TAG, "failed to disable CAM ctlr");
+    ESP_RETURN_ON_ERROR(esp_cam_ctlr_del(csi_video->cam_ctrl_handle), TAG, "failed to delete CAM ctlr");
+    csi_video->cam_ctrl_handle = NULL;
+
+    ESP_LOGD(TAG, "standby released");
+
+    return ESP_OK;
+}
+
+static void csi_standby_timer_cb(void *arg)
+{
+    struct csi_video *csi_video = (struct csi_video *)arg;
+
+    xSemaphoreTake(csi_video->standby_lock, portMAX_DELAY);
+    if (csi_video->standby) {
+        csi_standby_release(csi_video);
+    }
+    xSemaphoreGive(csi_video->standby_lock);
+}
+
+/* The kept controller and ISP fit only the sensor mode and capture format they were started with */
+static bool csi_standby_matches(struct esp_video *video, const esp_cam_ctlr_csi_config_t *csi_config)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    const struct v4l2_pix_format *pix = &STREAM_FORMAT(CAPTURE_VIDEO_STREAM(video))->fmt.pix;
+    const struct v4l2_pix_format *standby_pix = &csi_video->standby_pix;
+
+    return !memcmp(csi_config, &csi_video->standby_config, sizeof(*csi_config)) &&
+           csi_video->state.bypass_isp == csi_video->standby_state.bypass_isp &&
+           csi_video->state.bayer_order == csi_video->standby_state.bayer_order &&
+           csi_video->state.line_sync == csi_video->standby_state.line_sync &&
+           csi_video->state.in_width == csi_video->standby_state.in_width &&
+           csi_video->state.in_height == csi_video->standby_state.in_height &&
+           !memcmp(&csi_video->state.crop, &csi_video->standby_state.crop, sizeof(csi_video->state.crop)) &&
+           pix->width == standby_pix->width &&
+           pix->height == standby_pix->height &&
+           pix->pixelformat == standby_pix->pixelformat &&
+           pix->ycbcr_enc == standby_pix->ycbcr_enc &&
+           pix->quantization == standby_pix->quantization;
+}
+
+/* Restart DMA and sensor stream of the kept controller, ESP_ERR_NOT_FOUND if a cold start is needed */
+static esp_err_t csi_standby_resume(struct esp_video *video, const esp_cam_ctlr_csi_config_t *csi_config)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+
+    xSemaphoreTake(csi_video->standby_lock, portMAX_DELAY);
+
+    if (!csi_video->standby) {
+        goto exit;
+    } else if (!csi_standby_matches(video, csi_config)) {
+        ESP_LOGD(TAG, "format changed in standby");
+        csi_standby_release(csi_video);
+        goto exit;
+    }
+
+    esp_timer_stop(csi_video->standby_timer);
+    csi_video->standby = false;
+
+    ret = esp_cam_ctlr_start(csi_video->cam_ctrl_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to restart CAM ctlr");
+        goto fail;
+    }
+
+#if CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
+    /* Buffer sequences restart at REQBUFS, statistics have to follow */
+    if (!csi_video->state.bypass_isp) {
+        esp_video_isp_restart_sequence();
+    }
+#endif
+
+    int flags = 1;
+    ret = esp_cam_sensor_ioctl(csi_video->cam_dev, ESP_CAM_SENSOR_IOC_S_STREAM, &flags);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to restart sensor stream");
+        esp_cam_ctlr_stop(csi_video->cam_ctrl_handle);
+        goto fail;
+    }
+
+    ESP_LOGD(TAG, "resumed from standby");
+    goto exit;
+
+fail:
+    /* The cold start path brings everything up from scratch */
+    csi_standby_release(csi_video);
+#if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
+    /* The sensor never streamed, so the reserved element was not done */
+    csi_video->element_reserved = true;
+#endif
+    ret = ESP_ERR_NOT_FOUND;
+exit:
+    xSemaphoreGive(csi_video->standby_lock);
+    return ret;
+}
+
+/* Keep the controller enabled and ISP running, the sensor is already in software standby */
+static esp_err_t csi_standby_enter(struct esp_video *video)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+
+    ESP_RETURN_ON_ERROR(esp_cam_ctlr_stop(csi_video->cam_ctrl_handle), TAG, "failed to stop CAM ctlr");
+
+    xSemaphoreTake(csi_video->standby_lock, portMAX_DELAY);
+    csi_get_ctlr_config(video, &csi_video->standby_config);
+    csi_video->standby_state = csi_video->state;
+    csi_video->standby_pix = STREAM_FORMAT(CAPTURE_VIDEO_STREAM(video))->fmt.pix;
+    csi_video->standby = true;
+    esp_timer_start_once(csi_video->standby_timer, CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS * 1000LL);
+    xSemaphoreGive(csi_video->standby_lock);
+
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
+/* Take the element of the first frame, so the DMA always has a buffer of the stream to write */
+static esp_err_t csi_reserve_element(struct esp_video *video)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+
+    csi_video->element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
+    ESP_RETURN_ON_FALSE(csi_video->element, ESP_ERR_INVALID_STATE, TAG, "no buffer queued before stream on");
+    csi_video->element_reserved = true;
+    csi_video->dropped = 0;
+
+    return ESP_OK;
+}
+
+static void csi_unreserve_element(struct esp_video *video)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+
+    if (csi_video->element_reserved) {
+        CAPTURE_VIDEO_QUEUE_ELEMENT(video, csi_video->element);
+        csi_video->element_reserved = false;
+    }
+    csi_video->element = NULL;
+}
+#endif
+
 static esp_err_t csi_video_start(struct esp_video *video, uint32_t type)
 {
     esp_err_t ret;
+    esp_cam_ctlr_csi_config_t csi_config;
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
 
-    esp_cam_ctlr_csi_config_t csi_config = {
-        .ctlr_id = CSI_CTRL_ID,
-        .clk_src = CSI_CLK_SRC,
-        .byte_swap_en = CSI_BYTE_SWAP_EN,
-        .queue_items = CSI_QUEUE_ITEMS,
-        .h_res = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video),
-        .v_res = CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video),
-        .data_lane_num = csi_video->state.lane_num,
-        .input_data_color_type = csi_video->state.in_color,
-        .output_data_color_type = csi_video->state.out_color,
-        .lane_bit_rate_mbps = csi_video->state.lane_bitrate_mbps,
+    csi_get_ctlr_config(video, &csi_config);
+
 #if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
-        .bk_buffer_dis = true,
+    ESP_RETURN_ON_ERROR(csi_reserve_element(video), TAG, "failed to reserve buffer");
+#endif
+
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+    if (csi_standby_resume(video, &csi_config) == ESP_OK) {
+        return ESP_OK;
+    }
 #endif
-    };
-    ESP_RETURN_ON_ERROR(esp_cam_new_csi_ctlr(&csi_config, &csi_video->cam_ctrl_handle), TAG, "failed to new CSI");
+
+    ESP_GOTO_ON_ERROR(esp_cam_new_csi_ctlr(&csi_config, &csi_video->cam_ctrl_handle), exit_reserve, TAG, "failed to new CSI");
 
     esp_cam_ctlr_evt_cbs_t cam_ctrl_cbs = {
         .on_get_new_trans = csi_video_on_get_new_trans,
@@ -375,6 +614,10 @@ exit_1:
 exit_0:
     esp_cam_ctlr_del(csi_video->cam_ctrl_handle);
     csi_video->cam_ctrl_handle = NULL;
+exit_reserve:
+#if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
+    csi_unreserve_element(video);
+#endif
     return ret;
 }
 
@@ -386,6 +629,9 @@ static esp_err_t csi_video_stop(struct esp_video *video, uint32_t type)
     ESP_RETURN_ON_ERROR(esp_cam_sensor_ioctl(csi_video->cam_dev, ESP_CAM_SENSOR_IOC_S_STREAM, &flags),
                         TAG, "failed to stop sensor stream");
 
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+    ESP_RETURN_ON_ERROR(csi_standby_enter(video), TAG, "failed to enter standby");
+#else
     ESP_RETURN_ON_ERROR(esp_video_isp_stop(&csi_video->state), TAG, "failed to stop ISP");
 
     ESP_RETURN_ON_ERROR(esp_cam_ctlr_stop(csi_video->cam_ctrl_handle), TAG, "failed to stop CAM ctlr");
@@ -393,6 +639,14 @@ static esp_err_t csi_video_stop(struct esp_video *video, uint32_t type)
 
     ESP_RETURN_ON_ERROR(esp_cam_ctlr_del(csi_video->cam_ctrl_handle), TAG, "failed to delete CAM ctlr");
     csi_video->cam_ctrl_handle = NULL;
+#endif
+
+#if CONFIG_ESP_VIDEO_DISABLE_MIPI_CSI_DRIVER_BACKUP_BUFFER
+    /* The DMA is stopped, elements are reset together with the stream buffer */
+    ESP_LOGD(TAG, "%" PRIu32 " frames dropped without a queued buffer", csi_video->dropped);
+    csi_video->element_reserved = false;
+    csi_video->element = NULL;
+#endif
 
     return ESP_OK;
 }
@@ -401,6 +655,19 @@ static esp_err_t csi_video_deinit(struct esp_video *video)
 {
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
 
+#if CONFIG_ESP_VIDEO_MIPI_CSI_STANDBY_TIMEOUT_MS > 0
+    xSemaphoreTake(csi_video->standby_lock, portMAX_DELAY);
+    if (csi_video->standby) {
+        csi_standby_release(csi_video);
+    }
+    xSemaphoreGive(csi_video->standby_lock);
+
+    esp_timer_delete(csi_video->standby_timer);
+    csi_video->standby_timer = NULL;
+    vSemaphoreDelete(csi_video->standby_lock);
+    csi_video->standby_lock = NULL;
+#endif
+
     ESP_RETURN_ON_ERROR(esp_ldo_release_channel(csi_video->ldo_handle), TAG, "failed to release LDO");
     csi_video->ldo_handle = NULL;
 
@@ -425,11 +692,103 @@ static esp_err_t csi_video_enum_format(struct esp_video *video, uint32_t type, u
     return ret;
 }
 
+static esp_err_t csi_video_set_sensor_format(struct esp_video *video, const esp_cam_sensor_format_t *format);
+
+/* Total MIPI-CSI bandwidth of a sensor mode, binned and lower clocked modes cost less */
+static uint64_t csi_mode_cost(const esp_cam_sensor_format_t *format)
+{
+    return (uint64_t)format->mipi_info.mipi_clk * format->mipi_info.lane_num;
+}
+
+/* Modes reaching the frame rate win by cost, otherwise the faster one wins */
+static bool csi_mode_is_better(const esp_cam_sensor_format_t *format, const esp_cam_sensor_format_t *best, uint32_t fps)
+{
+    bool reaches = !fps || format->fps >= fps;
+    bool best_reaches = !fps || best->fps >= fps;
+
+    if (reaches != best_reaches) {
+        return reaches;
+    } else if (reaches) {
+        return csi_mode_cost(format) < csi_mode_cost(best);
+    } else {
+        return format->fps > best->fps;
+    }
+}
+
+/**
+ * @brief Switch the sensor to its cheapest width x height mode reaching the target frame rate
+ *
+ * @param video  Video object
+ * @param width  Frame width
+ * @param height Frame height
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_FOUND if the sensor has no mode of this size for the current data path
+ *      - Others if failed
+ */
+static esp_err_t csi_solve_mode(struct esp_video *video, uint32_t width, uint32_t height)
+{
+    esp_cam_sensor_format_array_t array;
+    const esp_cam_sensor_format_t *best = NULL;
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    const esp_cam_sensor_format_t *cur_format = csi_video->cam_dev->cur_format;
+    bool bypass_isp = csi_video->state.bypass_isp;
+
+    ESP_RETURN_ON_ERROR(esp_cam_sensor_query_format(csi_video->cam_dev, &array), TAG, "failed to query sensor formats");
+
+    for (uint32_t i = 0; i < array.count; i++) {
+        const esp_cam_sensor_format_t *format = &array.format_array[i];
+
+        /* RAW modes go through ISP, others straight to memory, keep the data path the capture format was set for */
+        if (format->port != ESP_CAM_SENSOR_MIPI_CSI || format->width != width || format->height != height ||
+                !format->mipi_info.mipi_clk || !format->fps || (format->isp_info != NULL) == bypass_isp ||
+                (bypass_isp && cur_format && format->format != cur_format->format)) {
+            continue;
+        }
+
+        if (!best || csi_mode_is_better(format, best, csi_video->target_fps)) {
+            best = format;
+        }
+    }
+
+    if (!best) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (csi_video->target_fps && best->fps < csi_video->target_fps) {
+        ESP_LOGW(TAG, "no %" PRIu32 "x%" PRIu32 " mode reaches %" PRIu32 " fps, using %u fps",
+                 width, height, csi_video->target_fps, best->fps);
+    }
+    ESP_LOGD(TAG, "sensor mode %s, %u fps, %" PRIu32 " Mbps x %u lanes", best->name ? best->name : "",
+             best->fps, best->mipi_info.mipi_clk / (1000 * 1000), best->mipi_info.lane_num);
+
+    return csi_video_set_sensor_format(video, best);
+}
+
 static esp_err_t csi_video_set_format(struct esp_video *video, const struct v4l2_format *format)
 {
+    esp_err_t ret;
     const struct v4l2_pix_format *pix = &format->fmt.pix;
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
 
+    /* Any size but the crop window's drops the window */
+    if (csi_video->state.crop.width &&
+            (pix->width != csi_video->state.crop.width || pix->height != csi_video->state.crop.height)) {
+        ESP_LOGD(TAG, "crop window dropped for %" PRIu32 "x%" PRIu32, pix->width, pix->height);
+        memset(&csi_video->state.crop, 0, sizeof(csi_video->state.crop));
+        CAPTURE_VIDEO_SET_FORMAT_WIDTH(video, csi_video->state.in_width);
+        CAPTURE_VIDEO_SET_FORMAT_HEIGHT(video, csi_video->state.in_height);
+    }
+
+    /* The size checks below run against the sensor mode picked for the size and frame rate */
+    if (!csi_video->state.crop.width) {
+        ret = csi_solve_mode(video, pix->width, pix->height);
+        if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+            return ret;
+        }
+    }
+
     if (csi_video->state.bypass_isp) {
         if (pix->width != CAPTURE_VIDEO_GET_FORMAT_WIDTH(video) ||
                 pix->height != CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video) ||
@@ -500,6 +859,12 @@ static esp_err_t csi_video_set_sensor_format(struct esp_video *video, const esp_
 {
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
 
+    /* Pushing the whole register table over SCCB again takes tens of milliseconds */
+    if (esp_video_sensor_format_is_current(csi_video->cam_dev, format)) {
+        ESP_LOGD(TAG, "sensor format %s is unchanged", format->name ? format->name : "");
+        return ESP_OK;
+    }
+
     ESP_RETURN_ON_ERROR(esp_cam_sensor_set_format(csi_video->cam_dev, format), TAG, "failed to set customer format");
     ESP_RETURN_ON_ERROR(init_config(video), TAG, "failed to initialize config");
 
@@ -513,6 +878,44 @@ static esp_err_t csi_video_get_sensor_format(struct esp_video *video, esp_cam_se
     return esp_cam_sensor_get_format(csi_video->cam_dev, format);
 }
 
+/* Registers of the sensor, the only sub-device behind the CSI bridge */
+static esp_err_t csi_video_check_register(const struct v4l2_dbg_register *reg)
+{
+    ESP_RETURN_ON_FALSE(reg->match.type == V4L2_CHIP_MATCH_SUBDEV && reg->match.addr == 0, ESP_ERR_NOT_SUPPORTED,
+                        TAG, "only the sensor registers are accessible");
+    ESP_RETURN_ON_FALSE(reg->reg <= UINT32_MAX, ESP_ERR_INVALID_ARG, TAG, "register address out of range");
+
+    return ESP_OK;
+}
+
+static esp_err_t csi_video_set_register(struct esp_video *video, const struct v4l2_dbg_register *reg)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    esp_cam_sensor_reg_val_t reg_val = {
+        .regaddr = (uint32_t)reg->reg,
+        .value = (uint32_t)reg->val,
+    };
+
+    ESP_RETURN_ON_ERROR(csi_video_check_register(reg), TAG, "invalid register");
+
+    return esp_cam_sensor_ioctl(csi_video->cam_dev, ESP_CAM_SENSOR_IOC_S_REG, &reg_val);
+}
+
+static esp_err_t csi_video_get_register(struct esp_video *video, struct v4l2_dbg_register *reg)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    esp_cam_sensor_reg_val_t reg_val = {
+        .regaddr = (uint32_t)reg->reg,
+    };
+
+    ESP_RETURN_ON_ERROR(csi_video_check_register(reg), TAG, "invalid register");
+    ESP_RETURN_ON_ERROR(esp_cam_sensor_ioctl(csi_video->cam_dev, ESP_CAM_SENSOR_IOC_G_REG, &reg_val), TAG,
+                        "failed to read register 0x%lx", reg_val.regaddr);
+    reg->val = reg_val.value;
+
+    return ESP_OK;
+}
+
 static esp_err_t csi_video_query_menu(struct esp_video *video, struct v4l2_querymenu *qmenu)
 {
     struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
@@ -520,6 +923,129 @@ static esp_err_t csi_video_query_menu(struct esp_video *video, struct v4l2_query
     return esp_video_query_menu_from_sensor(csi_video->cam_dev, qmenu);
 }
 
+static esp_err_t csi_video_get_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    const esp_cam_sensor_format_t *cur_format = csi_video->cam_dev->cur_format;
+
+    if (parm->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(&parm->parm.capture, 0, sizeof(parm->parm.capture));
+    parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+    parm->parm.capture.timeperframe.numerator = 1;
+    parm->parm.capture.timeperframe.denominator = cur_format ? cur_format->fps : 0;
+
+    return ESP_OK;
+}
+
+static esp_err_t csi_video_set_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    esp_err_t ret;
+    struct v4l2_format format;
+    const struct v4l2_fract *timeperframe = &parm->parm.capture.timeperframe;
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    const esp_cam_sensor_format_t *cur_format = csi_video->cam_dev->cur_format;
+
+    if (parm->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    ESP_RETURN_ON_FALSE(!CAPTURE_VIDEO_STREAM(video)->started, ESP_ERR_INVALID_STATE, TAG,
+                        "stop streaming before setting frame rate");
+
+    /* Zero asks for the default, any mode of the current size then */
+    if (timeperframe->numerator && timeperframe->denominator) {
+        csi_video->target_fps = (timeperframe->denominator + timeperframe->numerator - 1) / timeperframe->numerator;
+    } else {
+        csi_video->target_fps = 0;
+    }
+
+    format = *STREAM_FORMAT(CAPTURE_VIDEO_STREAM(video));
+    ret = csi_solve_mode(video, csi_video->state.in_width, csi_video->state.in_height);
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+
+    /* A new sensor mode resets the capture format, restore the one the application set */
+    if (csi_video->cam_dev->cur_format != cur_format) {
+        format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        ESP_RETURN_ON_ERROR(esp_video_set_format(video, &format), TAG, "failed to restore capture format");
+    }
+
+    return csi_video_get_parm(video, parm);
+}
+
+static esp_err_t csi_video_get_selection(struct esp_video *video, struct v4l2_selection *sel)
+{
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    const esp_video_csi_state_t *state = &csi_video->state;
+
+    if (sel->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (sel->target == V4L2_SEL_TGT_CROP && state->crop.width) {
+        sel->r = state->crop;
+    } else if (sel->target == V4L2_SEL_TGT_CROP || sel->target == V4L2_SEL_TGT_CROP_DEFAULT ||
+               sel->target == V4L2_SEL_TGT_CROP_BOUNDS) {
+        sel->r.left = 0;
+        sel->r.top = 0;
+        sel->r.width = state->in_width;
+        sel->r.height = state->in_height;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+#if ESP_VIDEO_ISP_DEVICE_CROP
+static esp_err_t csi_video_set_selection(struct esp_video *video, struct v4l2_selection *sel)
+{
+    uint32_t left, top, width, height;
+    struct v4l2_rect *r = &sel->r;
+    struct csi_video *csi_video = VIDEO_PRIV_DATA(struct csi_video *, video);
+    esp_video_csi_state_t *state = &csi_video->state;
+
+    if (sel->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    ESP_RETURN_ON_FALSE(sel->target == V4L2_SEL_TGT_CROP, ESP_ERR_INVALID_ARG, TAG, "only crop target can be set");
+    ESP_RETURN_ON_FALSE(!CAPTURE_VIDEO_STREAM(video)->started, ESP_ERR_INVALID_STATE, TAG,
+                        "stop streaming before setting crop");
+    ESP_RETURN_ON_FALSE(!state->bypass_isp, ESP_ERR_NOT_SUPPORTED, TAG, "crop needs the ISP, sensor format bypasses it");
+
+    /* Round to whole Bayer cells and clamp into the sensor frame */
+    left = MIN((uint32_t)MAX(r->left, 0), state->in_width - CSI_CROP_MIN_SIZE) & ~(CSI_CROP_ALIGN - 1);
+    top = MIN((uint32_t)MAX(r->top, 0), state->in_height - CSI_CROP_MIN_SIZE) & ~(CSI_CROP_ALIGN - 1);
+    width = MIN(MAX(r->width, CSI_CROP_MIN_SIZE), state->in_width - left) & ~(CSI_CROP_ALIGN - 1);
+    height = MIN(MAX(r->height, CSI_CROP_MIN_SIZE), state->in_height - top) & ~(CSI_CROP_ALIGN - 1);
+
+    if (width == state->in_width && height == state->in_height) {
+        memset(&state->crop, 0, sizeof(state->crop));
+    } else {
+        state->crop.left = left;
+        state->crop.top = top;
+        state->crop.width = width;
+        state->crop.height = height;
+    }
+
+    /* Only the window leaves the ISP, capture buffers shrink with it */
+    CAPTURE_VIDEO_SET_FORMAT_WIDTH(video, CSI_OUT_WIDTH(state));
+    CAPTURE_VIDEO_SET_FORMAT_HEIGHT(video, CSI_OUT_HEIGHT(state));
+
+    uint32_t buf_size = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video) * CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video) * state->out_bpp / 8;
+
+    ESP_LOGD(TAG, "crop (%" PRIu32 ", %" PRIu32 ") %" PRIu32 "x%" PRIu32 ", buffer size=%" PRIu32,
+             left, top, width, height, buf_size);
+
+    CAPTURE_VIDEO_SET_BUF_INFO(video, buf_size, CSI_DMA_ALIGN_BYTES, CSI_MEM_CAPS);
+
+    return csi_video_get_selection(video, sel);
+}
+#endif
+
 static const struct esp_video_ops s_csi_video_ops = {
     .init          = csi_video_init,
     .deinit        = csi_video_deinit,
@@ -528,12 +1054,20 @@ static const struct esp_video_ops s_csi_video_ops = {
     .enum_format   = csi_video_enum_format,
     .set_format    = csi_video_set_format,
     .notify        = csi_video_notify,
+    .set_parm      = csi_video_set_parm,
+    .get_parm      = csi_video_get_parm,
+#if ESP_VIDEO_ISP_DEVICE_CROP
+    .set_selection = csi_video_set_selection,
+#endif
+    .get_selection = csi_video_get_selection,
     .set_ext_ctrl  = csi_video_set_ext_ctrl,
     .get_ext_ctrl  = csi_video_get_ext_ctrl,
     .query_ext_ctrl = csi_video_query_ext_ctrl,
     .set_sensor_format = csi_video_set_sensor_format,
     .get_sensor_format = csi_video_get_sensor_format,
     .query_menu    = csi_video_query_menu,
+    .set_register  = csi_video_set_register,
+    .get_register  = csi_video_get_register,
 };
 
 /**
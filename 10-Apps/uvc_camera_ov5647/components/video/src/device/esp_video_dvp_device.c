@@ -9,6 +9,7 @@
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_attr.h"
+#include "esp_check.h"
 
 #include "esp_cam_ctlr_dvp.h"
 
@@ -30,6 +31,12 @@ struct dvp_video {
     esp_cam_ctlr_handle_t cam_ctrl_handle;
 
     esp_cam_sensor_device_t *cam_dev;
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+    /* Element of the stream the DMA writes, frames are dropped into it while no other is queued */
+    struct esp_video_buffer_element *element;
+    bool element_reserved;                      /* Taken at STREAMON, not given to the DMA yet */
+    uint32_t dropped;
+#endif
 };
 
 static const char *TAG = "dvp_video";
@@ -96,7 +103,17 @@ static bool IRAM_ATTR dvp_video_on_trans_finished(esp_cam_ctlr_handle_t handle,
 
     ESP_LOGD(TAG, "size=%zu", trans->received_size);
 
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+    struct dvp_video *dvp_video = VIDEO_PRIV_DATA(struct dvp_video *, video);
+    if (trans->buffer != dvp_video->element->buffer) {
+        CAPTURE_VIDEO_DONE_BUF(video, trans->buffer, trans->received_size);
+    } else {
+        dvp_video->dropped++;
+        CAPTURE_VIDEO_STREAM(video)->sequence++;
+    }
+#else
     CAPTURE_VIDEO_DONE_BUF(video, trans->buffer, trans->received_size);
+#endif
 
     return true;
 }
@@ -106,10 +123,27 @@ static bool IRAM_ATTR dvp_video_on_get_new_trans(esp_cam_ctlr_handle_t handle, e
     struct esp_video_buffer_element *element;
     struct esp_video *video = (struct esp_video *)user_data;
 
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+    struct dvp_video *dvp_video = VIDEO_PRIV_DATA(struct dvp_video *, video);
+
+    if (dvp_video->element_reserved) {
+        dvp_video->element_reserved = false;
+        element = dvp_video->element;
+    } else {
+        element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
+        if (!element) {
+            /* Rewrite the frame in flight, it was never done, so no consumer can be reading it */
+            element = dvp_video->element;
+        } else {
+            dvp_video->element = element;
+        }
+    }
+#else
     element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
     if (!element) {
         return false;
     }
+#endif
 
     trans->buffer = element->buffer;
     trans->buflen = ELEMENT_SIZE(element);
@@ -161,12 +195,42 @@ static esp_err_t dvp_video_init(struct esp_video *video)
     return ESP_OK;
 }
 
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+/* Take the element of the first frame, so the DMA always has a buffer of the stream to write */
+static esp_err_t dvp_reserve_element(struct esp_video *video)
+{
+    struct dvp_video *dvp_video = VIDEO_PRIV_DATA(struct dvp_video *, video);
+
+    dvp_video->element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
+    ESP_RETURN_ON_FALSE(dvp_video->element, ESP_ERR_INVALID_STATE, TAG, "no buffer queued before stream on");
+    dvp_video->element_reserved = true;
+    dvp_video->dropped = 0;
+
+    return ESP_OK;
+}
+
+static void dvp_unreserve_element(struct esp_video *video)
+{
+    struct dvp_video *dvp_video = VIDEO_PRIV_DATA(struct dvp_video *, video);
+
+    if (dvp_video->element_reserved) {
+        CAPTURE_VIDEO_QUEUE_ELEMENT(video, dvp_video->element);
+        dvp_video->element_reserved = false;
+    }
+    dvp_video->element = NULL;
+}
+#endif
+
 static esp_err_t dvp_video_start(struct esp_video *video, uint32_t type)
 {
     esp_err_t ret;
     struct dvp_video *dvp_video = VIDEO_PRIV_DATA(struct dvp_video *, video);
     esp_cam_sensor_device_t *cam_dev = dvp_video->cam_dev;
 
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+    ESP_RETURN_ON_ERROR(dvp_reserve_element(video), TAG, "failed to reserve buffer");
+#endif
+
     esp_cam_ctlr_dvp_config_t dvp_config = {
         .ctlr_id = DVP_CTLR_ID,
         .clk_src = CAM_CLK_SRC_DEFAULT,
@@ -176,11 +240,14 @@ static esp_err_t dvp_video_start(struct esp_video *video, uint32_t type)
         .input_data_color_type = dvp_video->in_color,
         .pin_dont_init = true,
         .pic_format_jpeg = CAPTURE_VIDEO_GET_FORMAT_PIXEL_FORMAT(video) == V4L2_PIX_FMT_JPEG,
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+        .bk_buffer_dis = true,
+#endif
     };
     ret = esp_cam_new_dvp_ctlr(&dvp_config, &dvp_video->cam_ctrl_handle);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "failed to create DVP");
-        return ret;
+        goto exit_reserve;
     }
 
     esp_cam_ctlr_evt_cbs_t cam_ctrl_cbs = {
@@ -221,6 +288,10 @@ exit_1:
 exit_0:
     esp_cam_ctlr_del(dvp_video->cam_ctrl_handle);
     dvp_video->cam_ctrl_handle = NULL;
+exit_reserve:
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+    dvp_unreserve_element(video);
+#endif
     return ret;
 }
 
@@ -257,6 +328,13 @@ static esp_err_t dvp_video_stop(struct esp_video *video, uint32_t type)
 
     dvp_video->cam_ctrl_handle = NULL;
 
+#if CONFIG_ESP_VIDEO_DISABLE_DVP_DRIVER_BACKUP_BUFFER
+    /* The DMA is stopped, elements are reset together with the stream buffer */
+    ESP_LOGD(TAG, "%" PRIu32 " frames dropped without a queued buffer", dvp_video->dropped);
+    dvp_video->element_reserved = false;
+    dvp_video->element = NULL;
+#endif
+
     return ret;
 }
 
@@ -320,6 +398,12 @@ static esp_err_t dvp_video_set_sensor_format(struct esp_video *video, const esp_
 {
     struct dvp_video *dvp_video = VIDEO_PRIV_DATA(struct dvp_video *, video);
 
+    /* Pushing the whole register table over SCCB again takes tens of milliseconds */
+    if (esp_video_sensor_format_is_current(dvp_video->cam_dev, format)) {
+        ESP_LOGD(TAG, "sensor format %s is unchanged", format->name ? format->name : "");
+        return ESP_OK;
+    }
+
     ESP_RETURN_ON_ERROR(esp_cam_sensor_set_format(dvp_video->cam_dev, format), TAG, "failed to set customer format");
     ESP_RETURN_ON_ERROR(init_config(video), TAG, "failed to initialize config");
 
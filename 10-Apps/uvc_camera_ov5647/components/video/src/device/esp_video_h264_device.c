@@ -10,15 +10,22 @@
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_attr.h"
+#include "esp_cache.h"
+#include "memstat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "esp_h264_enc_single_hw.h"
 #include "esp_h264_enc_single_sw.h"
 #include "esp_h264_enc_single.h"
+#include "esp_h264_enc_param_hw.h"
 
 #include "esp_video.h"
+#include "esp_video_ioctl.h"
 #include "esp_video_device_internal.h"
 
 #define H264_NAME                   "H.264"
+#define H264_1_NAME                 "H.264_1"
 
 #define H264_DMA_ALIGN_BYTES        64
 #define H264_MEM_CAPS               (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM | MALLOC_CAP_CACHE_ALIGNED)
@@ -27,6 +34,7 @@
 #define H264_VIDEO_DEVICE_MIN_QP    25
 #define H264_VIDEO_DEVICE_MAX_QP    26
 #define H264_VIDEO_DEVICE_BITRATE   10000000
+#define H264_VIDEO_DEVICE_FPS       30
 
 #define H264_VIDEO_MAX_I_PERIOD     120
 #define H264_VIDEO_MIN_I_PERIOD     1
@@ -40,23 +48,65 @@
 #define H264_VIDEO_MIN_QP           0
 #define H264_VIDEO_QP_STEP          1
 
+/* Control changes made while streaming, applied by the encoder context before the next frame */
+#define H264_PENDING_RATE           (1 << 0)  /* Bitrate, I-period or frame rate, updated on the running encoder */
+#define H264_PENDING_QP             (1 << 1)  /* QP range is fixed at creation, the encoder is re-created */
+#define H264_PENDING_IDR            (1 << 2)  /* Restart the GOP with an IDR frame */
+#define H264_PENDING_ROI            (1 << 3)  /* Region-of-interest map changed */
+
+#define H264_MB_SIZE                16
+
+#if CONFIG_ESP_VIDEO_H264_VUI_TIMING || CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+#define H264_NAL_TYPE_SLICE         1
+#define H264_NAL_TYPE_IDR           5
+#define H264_NAL_TYPE_SPS           7
+#endif
+
+#if CONFIG_ESP_VIDEO_H264_VUI_TIMING
+#define H264_SPS_MAX_SIZE           128     /* Encoder SPS is about 20 bytes, larger ones are left alone */
+#define H264_VUI_MAX_SIZE           24      /* VUI written by h264_sps_write_vui() */
+#endif
+
+#if CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+#define H264_HEADERS_MAX_SIZE       256     /* SPS with VUI and PPS, with their start codes */
+#endif
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(x)   sizeof(x) / sizeof((x)[0])
 #endif
 
 struct h264_video {
     bool hw_codec;
+    bool sw_encoder;                /* Current encoder is the software one */
 
     esp_h264_raw_format_t input_format;
     uint8_t gop;
     uint8_t min_qp;
     uint8_t max_qp;
     uint32_t bitrate;
+    struct v4l2_fract timeperframe; /* Frame interval of the input stream */
+    struct esp_video_enc_roi roi;
+    uint32_t pending;               /* H264_PENDING_* */
     esp_h264_enc_handle_t enc_handle;
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+    uint8_t *sw_frame;              /* I420 copy of the input frame for the software encoder */
+#endif
+#if CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+    uint8_t headers[H264_HEADERS_MAX_SIZE]; /* Parameter sets leading the last IDR frame of the encoder */
+    uint32_t headers_size;          /* 0 until the encoder output an IDR frame */
+#endif
 };
 
 static const char *TAG = "h.264_video";
 
+/*
+ * One hardware encoder serves every H.264 device a frame at a time. Each device keeps its
+ * own encoder handle, which holds its reference frames and rate control state, so taking
+ * turns needs no context switch beyond the lock. Equal-priority waiters get the lock in
+ * FIFO order, so devices encoding at the same rate alternate fairly.
+ */
+static SemaphoreHandle_t s_h264_hw_lock;
+
 static esp_err_t errno_h264_to_std(esp_h264_err_t h264_err)
 {
     switch (h264_err) {
@@ -94,7 +144,643 @@ static esp_err_t h264_get_input_format_from_v4l2(uint32_t v4l2_format, esp_h264_
     return ret;
 }
 
-static esp_err_t h264_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size)
+/* Frame rate used by the encoder rate control, rounded to whole frames per second */
+static uint8_t h264_video_get_fps(const struct h264_video *h264_video)
+{
+    uint32_t fps = (h264_video->timeperframe.denominator + h264_video->timeperframe.numerator / 2) /
+                   h264_video->timeperframe.numerator;
+
+    return MIN(MAX(fps, 1), UINT8_MAX);
+}
+
+#if CONFIG_ESP_VIDEO_H264_VUI_TIMING || CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+/* Offset of the first byte after the next 00 00 01 start code, or size if there is none */
+static uint32_t h264_next_nal(const uint8_t *buf, uint32_t pos, uint32_t size)
+{
+    for (uint32_t i = pos; i + 2 < size; i++) {
+        if (!buf[i] && !buf[i + 1] && buf[i + 2] == 0x01) {
+            return i + 3;
+        }
+    }
+
+    return size;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_H264_VUI_TIMING
+struct h264_bits {
+    uint8_t *buf;
+    uint32_t size;                  /* Buffer size in bytes */
+    uint32_t pos;                   /* Bit position */
+    bool overrun;
+};
+
+static uint32_t h264_read_bits(struct h264_bits *bits, uint8_t n)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (bits->pos >= bits->size * 8) {
+            bits->overrun = true;
+            return 0;
+        }
+        value = (value << 1) | ((bits->buf[bits->pos / 8] >> (7 - bits->pos % 8)) & 1);
+        bits->pos++;
+    }
+
+    return value;
+}
+
+static uint32_t h264_read_ue(struct h264_bits *bits)
+{
+    uint8_t zeros = 0;
+
+    while (!h264_read_bits(bits, 1)) {
+        if (bits->overrun || ++zeros > 31) {
+            bits->overrun = true;
+            return 0;
+        }
+    }
+
+    return (1 << zeros) - 1 + h264_read_bits(bits, zeros);
+}
+
+static void h264_write_bits(struct h264_bits *bits, uint32_t value, uint8_t n)
+{
+    for (int i = n - 1; i >= 0; i--) {
+        if (bits->pos >= bits->size * 8) {
+            bits->overrun = true;
+            return;
+        }
+        if ((value >> i) & 1) {
+            bits->buf[bits->pos / 8] |= 0x80 >> (bits->pos % 8);
+        } else {
+            bits->buf[bits->pos / 8] &= ~(0x80 >> (bits->pos % 8));
+        }
+        bits->pos++;
+    }
+}
+
+static void h264_write_ue(struct h264_bits *bits, uint32_t value)
+{
+    uint8_t len = 32 - __builtin_clz(value + 1);
+
+    h264_write_bits(bits, 0, len - 1);
+    h264_write_bits(bits, value + 1, len);
+}
+
+/* Drop emulation prevention bytes, returns the RBSP size */
+static uint32_t h264_nal_to_rbsp(const uint8_t *nal, uint32_t size, uint8_t *rbsp)
+{
+    uint32_t len = 0;
+    uint8_t zeros = 0;
+
+    for (uint32_t i = 0; i < size; i++) {
+        if (zeros >= 2 && nal[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        zeros = nal[i] ? 0 : zeros + 1;
+        rbsp[len++] = nal[i];
+    }
+
+    return len;
+}
+
+/* Insert emulation prevention bytes, returns the NAL payload size or 0 if it doesn't fit */
+static uint32_t h264_rbsp_to_nal(const uint8_t *rbsp, uint32_t size, uint8_t *nal, uint32_t nal_size)
+{
+    uint32_t len = 0;
+    uint8_t zeros = 0;
+
+    for (uint32_t i = 0; i < size; i++) {
+        if (zeros >= 2 && rbsp[i] <= 0x03) {
+            if (len >= nal_size) {
+                return 0;
+            }
+            nal[len++] = 0x03;
+            zeros = 0;
+        }
+        if (len >= nal_size) {
+            return 0;
+        }
+        zeros = rbsp[i] ? 0 : zeros + 1;
+        nal[len++] = rbsp[i];
+    }
+
+    return len;
+}
+
+/* VUI with timing info and no frame reordering, so the host decoder outputs frames without extra buffering */
+static void h264_sps_write_vui(struct h264_bits *bits, const struct v4l2_fract *timeperframe, uint32_t max_ref_frames)
+{
+    h264_write_bits(bits, 0, 1);        /* aspect_ratio_info_present_flag */
+    h264_write_bits(bits, 0, 1);        /* overscan_info_present_flag */
+    h264_write_bits(bits, 0, 1);        /* video_signal_type_present_flag */
+    h264_write_bits(bits, 0, 1);        /* chroma_loc_info_present_flag */
+
+    /* One frame lasts two ticks */
+    h264_write_bits(bits, 1, 1);        /* timing_info_present_flag */
+    h264_write_bits(bits, timeperframe->numerator, 32);
+    h264_write_bits(bits, timeperframe->denominator * 2, 32);
+    h264_write_bits(bits, 0, 1);        /* fixed_frame_rate_flag, sensor frame rate may drop in low light */
+
+    h264_write_bits(bits, 0, 1);        /* nal_hrd_parameters_present_flag */
+    h264_write_bits(bits, 0, 1);        /* vcl_hrd_parameters_present_flag */
+    h264_write_bits(bits, 0, 1);        /* pic_struct_present_flag */
+
+    h264_write_bits(bits, 1, 1);        /* bitstream_restriction_flag */
+    h264_write_bits(bits, 1, 1);        /* motion_vectors_over_pic_boundaries_flag */
+    h264_write_ue(bits, 2);             /* max_bytes_per_pic_denom */
+    h264_write_ue(bits, 1);             /* max_bits_per_mb_denom */
+    h264_write_ue(bits, 16);            /* log2_max_mv_length_horizontal */
+    h264_write_ue(bits, 16);            /* log2_max_mv_length_vertical */
+    h264_write_ue(bits, 0);             /* max_num_reorder_frames */
+    h264_write_ue(bits, MAX(max_ref_frames, 1)); /* max_dec_frame_buffering */
+}
+
+/* Rewrite an SPS RBSP without VUI to carry one, returns the new RBSP size or 0 to leave the SPS as is */
+static uint32_t h264_sps_add_vui(uint8_t *rbsp, uint32_t size, uint32_t buf_size, const struct v4l2_fract *timeperframe)
+{
+    uint32_t vui_flag_pos;
+    uint32_t profile_idc;
+    uint32_t max_ref_frames;
+    uint32_t poc_type;
+    struct h264_bits bits = {
+        .buf = rbsp,
+        .size = size,
+    };
+
+    /* Syntax of ITU-T H.264 7.3.2.1.1 up to vui_parameters_present_flag */
+    profile_idc = h264_read_bits(&bits, 8);
+    h264_read_bits(&bits, 16);          /* constraint flags, level_idc */
+    h264_read_ue(&bits);                /* seq_parameter_set_id */
+    if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244 ||
+            profile_idc == 44 || profile_idc == 83 || profile_idc == 86 || profile_idc == 118 ||
+            profile_idc == 128 || profile_idc == 138 || profile_idc == 139 || profile_idc == 134 ||
+            profile_idc == 135) {
+        if (h264_read_ue(&bits) == 3) { /* chroma_format_idc */
+            h264_read_bits(&bits, 1);   /* separate_colour_plane_flag */
+        }
+        h264_read_ue(&bits);            /* bit_depth_luma_minus8 */
+        h264_read_ue(&bits);            /* bit_depth_chroma_minus8 */
+        h264_read_bits(&bits, 1);       /* qpprime_y_zero_transform_bypass_flag */
+        if (h264_read_bits(&bits, 1)) { /* seq_scaling_matrix_present_flag */
+            return 0;
+        }
+    }
+    h264_read_ue(&bits);                /* log2_max_frame_num_minus4 */
+    poc_type = h264_read_ue(&bits);
+    if (poc_type == 0) {
+        h264_read_ue(&bits);            /* log2_max_pic_order_cnt_lsb_minus4 */
+    } else if (poc_type == 1) {
+        uint32_t cycle;
+
+        h264_read_bits(&bits, 1);       /* delta_pic_order_always_zero_flag */
+        h264_read_ue(&bits);            /* offset_for_non_ref_pic */
+        h264_read_ue(&bits);            /* offset_for_top_to_bottom_field */
+        cycle = h264_read_ue(&bits);
+        for (uint32_t i = 0; i < cycle && !bits.overrun; i++) {
+            h264_read_ue(&bits);        /* offset_for_ref_frame */
+        }
+    }
+    max_ref_frames = h264_read_ue(&bits);
+    h264_read_bits(&bits, 1);           /* gaps_in_frame_num_value_allowed_flag */
+    h264_read_ue(&bits);                /* pic_width_in_mbs_minus1 */
+    h264_read_ue(&bits);                /* pic_height_in_map_units_minus1 */
+    if (!h264_read_bits(&bits, 1)) {    /* frame_mbs_only_flag */
+        h264_read_bits(&bits, 1);       /* mb_adaptive_frame_field_flag */
+    }
+    h264_read_bits(&bits, 1);           /* direct_8x8_inference_flag */
+    if (h264_read_bits(&bits, 1)) {     /* frame_cropping_flag */
+        for (int i = 0; i < 4; i++) {
+            h264_read_ue(&bits);
+        }
+    }
+
+    vui_flag_pos = bits.pos;
+    if (bits.overrun || h264_read_bits(&bits, 1)) {
+        return 0;
+    }
+
+    /* Everything before the flag is kept, the flag, VUI and trailing bits are written after it */
+    bits.size = buf_size;
+    bits.pos = vui_flag_pos;
+    h264_write_bits(&bits, 1, 1);       /* vui_parameters_present_flag */
+    h264_sps_write_vui(&bits, timeperframe, max_ref_frames);
+    h264_write_bits(&bits, 1, 1);       /* rbsp_stop_one_bit */
+    if (bits.pos % 8) {
+        h264_write_bits(&bits, 0, 8 - bits.pos % 8);
+    }
+
+    return bits.overrun ? 0 : bits.pos / 8;
+}
+
+/* Add VUI timing to the SPS leading an IDR access unit, returns the new frame size */
+static uint32_t h264_video_insert_vui(struct h264_video *h264_video, uint8_t *buf, uint32_t size, uint32_t buf_size)
+{
+    uint8_t rbsp[H264_SPS_MAX_SIZE + H264_VUI_MAX_SIZE];
+    uint8_t nal[sizeof(rbsp) * 3 / 2];
+    uint32_t start;
+    uint32_t end;
+    uint32_t rbsp_size;
+    uint32_t nal_size;
+    int32_t delta;
+
+    /* Only parameter sets precede the first slice, P frames stop at the first NAL */
+    for (start = h264_next_nal(buf, 0, size); start < size; start = h264_next_nal(buf, start, size)) {
+        uint8_t type = buf[start] & 0x1f;
+
+        if (type == H264_NAL_TYPE_SLICE || type == H264_NAL_TYPE_IDR) {
+            return size;
+        } else if (type == H264_NAL_TYPE_SPS) {
+            break;
+        }
+    }
+    if (start >= size) {
+        return size;
+    }
+
+    /* SPS payload follows the NAL header byte, up to the next start code and its leading zero byte */
+    end = h264_next_nal(buf, start, size);
+    if (end < size) {
+        end -= 3;
+        if (end > start && !buf[end - 1]) {
+            end--;
+        }
+    }
+    if (end - start - 1 > H264_SPS_MAX_SIZE) {
+        return size;
+    }
+
+    rbsp_size = h264_nal_to_rbsp(&buf[start + 1], end - start - 1, rbsp);
+    rbsp_size = h264_sps_add_vui(rbsp, rbsp_size, sizeof(rbsp), &h264_video->timeperframe);
+    if (!rbsp_size) {
+        return size;
+    }
+
+    nal_size = h264_rbsp_to_nal(rbsp, rbsp_size, nal, sizeof(nal));
+    delta = (int32_t)nal_size - (int32_t)(end - start - 1);
+    if (!nal_size || size + delta > buf_size) {
+        return size;
+    }
+
+    memmove(&buf[end + delta], &buf[end], size - end);
+    memcpy(&buf[start + 1], nal, nal_size);
+
+    /* Encoder output is read by DMA and after cache invalidation, so the CPU edit is written back */
+    esp_cache_msync(&buf[start], size + delta - start, ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+
+    return size + delta;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+/**
+ * Keep the parameter sets leading a key frame, or put the kept ones in front of a key
+ * frame coming without them, so a decoder can start at every key frame. Returns the new
+ * frame size.
+ */
+static uint32_t h264_video_repeat_headers(struct h264_video *h264_video, uint8_t *buf, uint32_t size, uint32_t buf_size)
+{
+    uint32_t pos;
+    uint32_t end = 0;
+    bool has_sps = false;
+
+    /* Parameter sets end at the start code of the first slice */
+    for (pos = h264_next_nal(buf, 0, size); pos < size; pos = h264_next_nal(buf, pos, size)) {
+        uint8_t type = buf[pos] & 0x1f;
+
+        if (type == H264_NAL_TYPE_SLICE || type == H264_NAL_TYPE_IDR) {
+            end = pos - 3;
+            if (end && !buf[end - 1]) {
+                end--;
+            }
+            break;
+        } else if (type == H264_NAL_TYPE_SPS) {
+            has_sps = true;
+        }
+    }
+    if (pos >= size) {
+        return size;
+    }
+
+    if (has_sps) {
+        if (end <= sizeof(h264_video->headers)) {
+            memcpy(h264_video->headers, buf, end);
+            h264_video->headers_size = end;
+        }
+        return size;
+    }
+
+    if (!h264_video->headers_size || size + h264_video->headers_size > buf_size) {
+        return size;
+    }
+
+    memmove(&buf[h264_video->headers_size], buf, size);
+    memcpy(buf, h264_video->headers, h264_video->headers_size);
+
+    /* Same as the VUI edit, the CPU copy is written back for DMA readers */
+    esp_cache_msync(buf, size + h264_video->headers_size, ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+
+    return size + h264_video->headers_size;
+}
+#endif
+
+/* Program the region-of-interest map into the hardware encoder, count 0 turns ROI off */
+static esp_err_t h264_video_apply_roi(struct h264_video *h264_video)
+{
+    esp_h264_err_t h264_err;
+    esp_h264_enc_param_hw_handle_t param_hd;
+    const struct esp_video_enc_roi *roi = &h264_video->roi;
+    esp_h264_enc_roi_cfg_t roi_cfg = {
+        .roi_mode = roi->count ? ESP_H264_ROI_MODE_DELTA_QP : ESP_H264_ROI_MODE_DISABLE,
+        .none_roi_delta_qp = roi->background_qp_offset,
+    };
+
+    h264_err = esp_h264_enc_hw_get_param_hd(h264_video->enc_handle, &param_hd);
+    if (h264_err == ESP_H264_ERR_OK) {
+        h264_err = esp_h264_enc_hw_cfg_roi(param_hd, roi_cfg);
+    }
+
+    for (int i = 0; i < roi->count && h264_err == ESP_H264_ERR_OK; i++) {
+        const struct esp_video_enc_roi_region *region = &roi->regions[i];
+        esp_h264_enc_roi_reg_t roi_reg = {
+            .x = region->left / H264_MB_SIZE,
+            .y = region->top / H264_MB_SIZE,
+            .len_x = (region->left + region->width + H264_MB_SIZE - 1) / H264_MB_SIZE - region->left / H264_MB_SIZE,
+            .len_y = (region->top + region->height + H264_MB_SIZE - 1) / H264_MB_SIZE - region->top / H264_MB_SIZE,
+            .qp = region->qp_offset,
+        };
+
+        h264_err = esp_h264_enc_hw_set_roi_region(param_hd, roi_reg);
+    }
+
+    if (h264_err != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "failed to configure H.264 ROI");
+        return errno_h264_to_std(h264_err);
+    }
+
+    return ESP_OK;
+}
+
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+/* ISP YUV 4:2:0 has U Y Y per pixel pair in odd lines and V Y Y in even ones, the software encoder takes I420 */
+static void h264_video_to_i420(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    uint8_t *u = dst + width * height;
+    uint8_t *v = u + width * height / 4;
+
+    for (uint32_t line = 0; line + 1 < height; line += 2) {
+        const uint8_t *odd = src + line * width * 3 / 2;
+        const uint8_t *even = odd + width * 3 / 2;
+        uint8_t *y0 = dst + line * width;
+        uint8_t *y1 = y0 + width;
+
+        for (uint32_t x = 0; x < width; x += 2, odd += 3, even += 3) {
+            *u++ = odd[0];
+            y0[x] = odd[1];
+            y0[x + 1] = odd[2];
+            *v++ = even[0];
+            y1[x] = even[1];
+            y1[x + 1] = even[2];
+        }
+    }
+}
+
+static esp_h264_err_t h264_video_new_sw_encoder(struct h264_video *h264_video, const esp_h264_enc_cfg_hw_t *hw_config)
+{
+    esp_h264_err_t h264_err;
+    uint32_t size = hw_config->res.width * hw_config->res.height * 3 / 2;
+    esp_h264_enc_cfg_sw_t config = {
+        .pic_type = ESP_H264_RAW_FMT_I420,
+        .gop = hw_config->gop,
+        .fps = hw_config->fps,
+        .res = hw_config->res,
+        .rc = hw_config->rc,
+    };
+
+    /* Small frames are read for every macroblock, internal RAM is worth it if there is room */
+    h264_video->sw_frame = memstat_malloc(MEMSTAT_VIDEO_DEV, size, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!h264_video->sw_frame) {
+        h264_video->sw_frame = memstat_malloc(MEMSTAT_VIDEO_DEV, size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+        if (!h264_video->sw_frame) {
+            return ESP_H264_ERR_MEM;
+        }
+    }
+
+    h264_err = esp_h264_enc_sw_new(&config, &h264_video->enc_handle);
+    if (h264_err != ESP_H264_ERR_OK) {
+        memstat_free(MEMSTAT_VIDEO_DEV, h264_video->sw_frame);
+        h264_video->sw_frame = NULL;
+        return h264_err;
+    }
+    h264_video->sw_encoder = true;
+
+    ESP_LOGI(TAG, "%" PRIu16 "x%" PRIu16 " is encoded by software", config.res.width, config.res.height);
+
+    return ESP_H264_ERR_OK;
+}
+#endif
+
+static esp_err_t h264_video_open_encoder(struct esp_video *video)
+{
+    esp_h264_err_t h264_err = ESP_H264_ERR_UNSUPPORTED;
+    struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
+    esp_h264_enc_cfg_hw_t config = {
+        .pic_type = h264_video->input_format,
+        .gop = h264_video->gop,
+        .fps = h264_video_get_fps(h264_video),
+        .res = {
+            .width = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video),
+            .height = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video),
+        },
+        .rc = {
+            .bitrate = h264_video->bitrate,
+            .qp_min = h264_video->min_qp,
+            .qp_max = h264_video->max_qp,
+        }
+    };
+
+    esp_err_t ret = ESP_OK;
+    size_t psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    size_t internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+#if CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+    /* Parameter sets of another frame size must not be repeated */
+    h264_video->headers_size = 0;
+#endif
+
+    if (h264_video->hw_codec) {
+        xSemaphoreTakeRecursive(s_h264_hw_lock, portMAX_DELAY);
+        h264_err = esp_h264_enc_hw_new(&config, &h264_video->enc_handle);
+        h264_video->sw_encoder = false;
+    }
+
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+    if ((h264_err != ESP_H264_ERR_OK) &&
+            (!h264_video->hw_codec || (config.res.width * config.res.height <= CONFIG_ESP_VIDEO_H264_SW_MAX_PIXELS))) {
+        h264_err = h264_video_new_sw_encoder(h264_video, &config);
+    }
+#endif
+
+    if (h264_err != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "failed to create H.264 encoder");
+        ret = errno_h264_to_std(h264_err);
+        goto exit;
+    }
+
+    h264_err = esp_h264_enc_open(h264_video->enc_handle);
+    if (h264_err != ESP_H264_ERR_OK) {
+        esp_h264_enc_del(h264_video->enc_handle);
+        h264_video->enc_handle = NULL;
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+        memstat_free(MEMSTAT_VIDEO_DEV, h264_video->sw_frame);
+        h264_video->sw_frame = NULL;
+#endif
+
+        ESP_LOGE(TAG, "failed to open H.264 encoder");
+        ret = errno_h264_to_std(h264_err);
+        goto exit;
+    }
+
+    /*
+     * esp_h264 allocates the reference, reconstructed and motion search buffers itself and
+     * has no option for where, so report them to budget PSRAM bandwidth. Memory other tasks
+     * allocate meanwhile is counted too, the report is an estimate.
+     */
+    ESP_LOGI(TAG, "%" PRIu16 "x%" PRIu16 " encoder working set: %zu bytes PSRAM, %zu bytes internal RAM",
+             config.res.width, config.res.height,
+             psram_free - MIN(psram_free, heap_caps_get_free_size(MALLOC_CAP_SPIRAM)),
+             internal_free - MIN(internal_free, heap_caps_get_free_size(MALLOC_CAP_INTERNAL)));
+
+    /* ROI isn't part of the creation config, a new encoder starts without it */
+    if (h264_video->roi.count && !h264_video->sw_encoder) {
+        ret = h264_video_apply_roi(h264_video);
+    }
+
+exit:
+    if (h264_video->hw_codec) {
+        xSemaphoreGiveRecursive(s_h264_hw_lock);
+    }
+
+    return ret;
+}
+
+static esp_err_t h264_video_close_encoder(struct h264_video *h264_video)
+{
+    esp_h264_err_t h264_err;
+    bool locked = !h264_video->sw_encoder;
+
+    if (locked) {
+        xSemaphoreTakeRecursive(s_h264_hw_lock, portMAX_DELAY);
+    }
+
+    h264_err = esp_h264_enc_close(h264_video->enc_handle);
+    if (h264_err != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "failed to close H.264 encoder");
+        goto exit;
+    }
+
+    h264_err = esp_h264_enc_del(h264_video->enc_handle);
+    if (h264_err != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "failed to delete H.264 encoder");
+        goto exit;
+    }
+    h264_video->enc_handle = NULL;
+
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+    memstat_free(MEMSTAT_VIDEO_DEV, h264_video->sw_frame);
+    h264_video->sw_frame = NULL;
+#endif
+
+exit:
+    if (locked) {
+        xSemaphoreGiveRecursive(s_h264_hw_lock);
+    }
+
+    return errno_h264_to_std(h264_err);
+}
+
+/* Runs in the encoding context, so the encoder is never reconfigured in the middle of a frame */
+static esp_err_t h264_video_apply_pending(struct esp_video *video)
+{
+    esp_err_t ret;
+    esp_h264_err_t h264_err;
+    esp_h264_enc_param_hw_handle_t param_hd;
+    struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
+    uint32_t pending = __atomic_exchange_n(&h264_video->pending, 0, __ATOMIC_ACQ_REL);
+
+    /* The software encoder has no parameter handle, it is re-created for rate changes too */
+    if ((pending & H264_PENDING_QP) || (h264_video->sw_encoder && (pending & H264_PENDING_RATE))) {
+        /* A new encoder starts with an IDR frame and takes every setting */
+        ret = h264_video_close_encoder(h264_video);
+        if (ret == ESP_OK) {
+            ret = h264_video_open_encoder(video);
+        }
+        ESP_LOGD(TAG, "encoder re-created for QP %" PRIu8 "-%" PRIu8, h264_video->min_qp, h264_video->max_qp);
+        return ret;
+    }
+
+    if (pending & H264_PENDING_RATE) {
+        h264_err = esp_h264_enc_hw_get_param_hd(h264_video->enc_handle, &param_hd);
+        if (h264_err == ESP_H264_ERR_OK) {
+            h264_err = esp_h264_enc_set_bitrate(&param_hd->base, h264_video->bitrate);
+        }
+        if (h264_err == ESP_H264_ERR_OK) {
+            h264_err = esp_h264_enc_set_gop(&param_hd->base, h264_video->gop);
+        }
+        if (h264_err == ESP_H264_ERR_OK) {
+            h264_err = esp_h264_enc_set_fps(&param_hd->base, h264_video_get_fps(h264_video));
+        }
+        if (h264_err != ESP_H264_ERR_OK) {
+            ESP_LOGE(TAG, "failed to update H.264 rate control");
+            return errno_h264_to_std(h264_err);
+        }
+    }
+
+    if ((pending & H264_PENDING_ROI) && !h264_video->sw_encoder) {
+        ret = h264_video_apply_roi(h264_video);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    if (pending & H264_PENDING_IDR) {
+        /* Re-opening resets the frame counter, the next frame is coded as IDR */
+        h264_err = esp_h264_enc_close(h264_video->enc_handle);
+        if (h264_err == ESP_H264_ERR_OK) {
+            h264_err = esp_h264_enc_open(h264_video->enc_handle);
+        }
+        if (h264_err != ESP_H264_ERR_OK) {
+            ESP_LOGE(TAG, "failed to force H.264 key frame");
+            return errno_h264_to_std(h264_err);
+        }
+    }
+
+    return ESP_OK;
+}
+
+/* Map the encoder frame type to the V4L2 buffer flags, IDR and I frames are both keyframes */
+static uint32_t h264_video_frame_flags(esp_h264_frame_type_t frame_type)
+{
+    switch (frame_type) {
+    case ESP_H264_FRAME_TYPE_IDR:
+    case ESP_H264_FRAME_TYPE_I:
+        return V4L2_BUF_FLAG_KEYFRAME;
+    case ESP_H264_FRAME_TYPE_P:
+        return V4L2_BUF_FLAG_PFRAME;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * esp_h264_enc_process() returns only after the whole frame is encoded and has no
+ * slice or macroblock-row callback, so the output buffer can't be handed out before
+ * the frame is complete. Sub-frame delivery needs slice output from esp_h264 first.
+ */
+static esp_err_t h264_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags)
 {
     esp_h264_err_t h264_err;
     esp_h264_enc_in_frame_t in_frame = {
@@ -109,14 +795,65 @@ static esp_err_t h264_video_m2m_process(struct esp_video *video, uint8_t *src, u
             .len = dst_size,
         }
     };
+    esp_err_t ret = ESP_OK;
     struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
+    bool locked = !h264_video->sw_encoder;
+
+    if (locked) {
+        xSemaphoreTakeRecursive(s_h264_hw_lock, portMAX_DELAY);
+    }
+
+    if (__atomic_load_n(&h264_video->pending, __ATOMIC_ACQUIRE)) {
+        ret = h264_video_apply_pending(video);
+        if (ret != ESP_OK) {
+            goto exit;
+        }
+    }
+
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+    if (h264_video->sw_encoder) {
+        uint32_t width = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video);
+        uint32_t height = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+
+        h264_video_to_i420(src, h264_video->sw_frame, width, height);
+        in_frame.raw_data.buffer = h264_video->sw_frame;
+        in_frame.raw_data.len = width * height * 3 / 2;
+    } else
+#endif
+    if (!locked) {
+        /* Re-created on the hardware encoder by the pending changes above */
+        xSemaphoreTakeRecursive(s_h264_hw_lock, portMAX_DELAY);
+        locked = true;
+    }
 
     h264_err = esp_h264_enc_process(h264_video->enc_handle, &in_frame, &out_frame);
     if (h264_err == ESP_H264_ERR_OK) {
+#if CONFIG_ESP_VIDEO_H264_SW_ENCODER
+        /* Written by CPU, later readers may invalidate or use DMA */
+        if (h264_video->sw_encoder) {
+            esp_cache_msync(dst, BUF_ALIGN_SIZE(out_frame.length, H264_DMA_ALIGN_BYTES), ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+        }
+#endif
+#if CONFIG_ESP_VIDEO_H264_VUI_TIMING
+        *dst_out_size = h264_video_insert_vui(h264_video, dst, out_frame.length, dst_size);
+#else
         *dst_out_size = out_frame.length;
+#endif
+        *dst_flags = h264_video_frame_flags(out_frame.frame_type);
+#if CONFIG_ESP_VIDEO_H264_REPEAT_HEADERS
+        if (*dst_flags & V4L2_BUF_FLAG_KEYFRAME) {
+            *dst_out_size = h264_video_repeat_headers(h264_video, dst, *dst_out_size, dst_size);
+        }
+#endif
     }
+    ret = errno_h264_to_std(h264_err);
 
-    return errno_h264_to_std(h264_err);
+exit:
+    if (locked) {
+        xSemaphoreGiveRecursive(s_h264_hw_lock);
+    }
+
+    return ret;
 }
 
 static esp_err_t h264_video_init(struct esp_video *video)
@@ -134,7 +871,6 @@ static esp_err_t h264_video_deinit(struct esp_video *video)
 
 static esp_err_t h264_video_start(struct esp_video *video, uint32_t type)
 {
-    esp_h264_err_t h264_err = ESP_H264_ERR_UNSUPPORTED;
     struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
 
     if ((M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video) != M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video)) ||
@@ -144,40 +880,26 @@ static esp_err_t h264_video_start(struct esp_video *video, uint32_t type)
     }
 
     if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
-        esp_h264_enc_cfg_hw_t config = {
-            .pic_type = h264_video->input_format,
-            .gop = h264_video->gop,
-            .fps = h264_video->gop,
-            .res = {
-                .width = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video),
-                .height = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video),
-            },
-            .rc = {
-                .bitrate = h264_video->bitrate,
-                .qp_min = h264_video->min_qp,
-                .qp_max = h264_video->max_qp,
-            }
-        };
-
-        if (h264_video->hw_codec) {
-            h264_err = esp_h264_enc_hw_new(&config, &h264_video->enc_handle);
-        } else {
-            h264_err = ESP_H264_ERR_UNSUPPORTED;
+        esp_err_t ret = h264_video_open_encoder(video);
+        if (ret != ESP_OK) {
+            return ret;
         }
 
-        if (h264_err != ESP_H264_ERR_OK) {
-            ESP_LOGE(TAG, "failed to create H.264 encoder");
-            return errno_h264_to_std(h264_err);
-        }
+        /* Controls set before streaming are already part of the new encoder */
+        __atomic_store_n(&h264_video->pending, 0, __ATOMIC_RELEASE);
 
-        h264_err = esp_h264_enc_open(h264_video->enc_handle);
-        if (h264_err != ESP_H264_ERR_OK) {
-            esp_h264_enc_del(h264_video->enc_handle);
-            h264_video->enc_handle = NULL;
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+        ret = esp_video_m2m_async_start(video,
+                                        V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                        V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                        h264_video_m2m_process);
+        if (ret != ESP_OK) {
+            h264_video_close_encoder(h264_video);
 
-            ESP_LOGE(TAG, "failed to open H.264 encoder");
-            return errno_h264_to_std(h264_err);
+            ESP_LOGE(TAG, "failed to start M2M task");
+            return ret;
         }
+#endif
     }
 
     return ESP_OK;
@@ -185,22 +907,13 @@ static esp_err_t h264_video_start(struct esp_video *video, uint32_t type)
 
 static esp_err_t h264_video_stop(struct esp_video *video, uint32_t type)
 {
-    esp_h264_err_t h264_err;
     struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
 
-    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
-        h264_err = esp_h264_enc_close(h264_video->enc_handle);
-        if (h264_err != ESP_H264_ERR_OK) {
-            ESP_LOGE(TAG, "failed to close H.264 encoder");
-            return errno_h264_to_std(h264_err);
-        }
+    /* Stopping either stream resets both buffer lists, the task must be idle first */
+    esp_video_m2m_async_stop(video);
 
-        h264_err = esp_h264_enc_del(h264_video->enc_handle);
-        if (h264_err != ESP_H264_ERR_OK) {
-            ESP_LOGE(TAG, "failed to delete H.264 encoder");
-            return errno_h264_to_std(h264_err);
-        }
-        h264_video->enc_handle = NULL;
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE && h264_video->enc_handle) {
+        return h264_video_close_encoder(h264_video);
     }
 
     return ESP_OK;
@@ -313,24 +1026,50 @@ static esp_err_t h264_video_notify(struct esp_video *video, enum esp_video_event
 static esp_err_t h264_video_set_ext_ctrl(struct esp_video *video, const struct v4l2_ext_controls *ctrls)
 {
     esp_err_t ret = ESP_OK;
+    uint32_t pending = 0;
     struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
 
     for (int i = 0; i < ctrls->count; i++) {
         struct v4l2_ext_control *ctrl = &ctrls->controls[i];
 
         switch (ctrl->id) {
+        /*
+         * esp_h264 has no intra refresh and can't force macroblocks to intra, only ROI QP
+         * offsets exist, so V4L2_CID_MPEG_VIDEO_INTRA_REFRESH_PERIOD isn't offered and IDR
+         * frames stay the only way to refresh the picture. Spreading an IDR over P frames
+         * needs cyclic intra refresh in esp_h264 first.
+         */
         case V4L2_CID_MPEG_VIDEO_H264_I_PERIOD:
             h264_video->gop = ctrl->value;
+            pending |= H264_PENDING_RATE;
             break;
         case V4L2_CID_MPEG_VIDEO_BITRATE:
             h264_video->bitrate = ctrl->value;
+            pending |= H264_PENDING_RATE;
             break;
         case V4L2_CID_MPEG_VIDEO_H264_MIN_QP:
             h264_video->min_qp = ctrl->value;
+            pending |= H264_PENDING_QP;
             break;
         case V4L2_CID_MPEG_VIDEO_H264_MAX_QP:
             h264_video->max_qp = ctrl->value;
+            pending |= H264_PENDING_QP;
+            break;
+        case V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME:
+            pending |= H264_PENDING_IDR;
             break;
+        case V4L2_CID_MPEG_VIDEO_ESP_ROI: {
+            const struct esp_video_enc_roi *roi = (const struct esp_video_enc_roi *)ctrl->p_u8;
+
+            if (roi->count > ESP_VIDEO_ENC_ROI_MAX) {
+                ret = ESP_ERR_INVALID_ARG;
+                ESP_LOGE(TAG, "ROI count=%" PRIu32 " is invalid", roi->count);
+                break;
+            }
+            h264_video->roi = *roi;
+            pending |= H264_PENDING_ROI;
+            break;
+        }
         default:
             ret = ESP_ERR_NOT_SUPPORTED;
             ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", ctrl->id);
@@ -338,6 +1077,11 @@ static esp_err_t h264_video_set_ext_ctrl(struct esp_video *video, const struct v
         }
     }
 
+    /* Picked up before the next frame, the encoder is re-created at stream start anyway */
+    if (pending && h264_video->enc_handle) {
+        __atomic_fetch_or(&h264_video->pending, pending, __ATOMIC_ACQ_REL);
+    }
+
     return ret;
 }
 
@@ -362,6 +1106,12 @@ static esp_err_t h264_video_get_ext_ctrl(struct esp_video *video, struct v4l2_ex
         case V4L2_CID_MPEG_VIDEO_H264_MAX_QP:
             ctrl->value = h264_video->max_qp;
             break;
+        case V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME:
+            ctrl->value = 0;
+            break;
+        case V4L2_CID_MPEG_VIDEO_ESP_ROI:
+            *(struct esp_video_enc_roi *)ctrl->p_u8 = h264_video->roi;
+            break;
         default:
             ret = ESP_ERR_NOT_SUPPORTED;
             ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", ctrl->id);
@@ -421,6 +1171,26 @@ static esp_err_t h264_video_query_ext_ctrl(struct esp_video *video, struct v4l2_
         qctrl->nr_of_dims = 0;
         qctrl->default_value = H264_VIDEO_DEVICE_MAX_QP;
         break;
+    case V4L2_CID_MPEG_VIDEO_ESP_ROI:
+        qctrl->type = V4L2_CTRL_TYPE_U8;
+        qctrl->maximum = UINT8_MAX;
+        qctrl->minimum = 0;
+        qctrl->step = 1;
+        qctrl->elem_size = sizeof(uint8_t);
+        qctrl->elems = sizeof(struct esp_video_enc_roi);
+        qctrl->nr_of_dims = 1;
+        qctrl->dims[0] = qctrl->elems;
+        qctrl->default_value = 0;
+        break;
+    case V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME:
+        qctrl->type = V4L2_CTRL_TYPE_BUTTON;
+        qctrl->maximum = 0;
+        qctrl->minimum = 0;
+        qctrl->step = 0;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = 0;
+        break;
     default:
         ret = ESP_ERR_NOT_SUPPORTED;
         ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", qctrl->id);
@@ -430,6 +1200,54 @@ static esp_err_t h264_video_query_ext_ctrl(struct esp_video *video, struct v4l2_
     return ret;
 }
 
+static esp_err_t h264_video_set_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    struct v4l2_fract *timeperframe;
+    struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
+
+    if (parm->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        timeperframe = &parm->parm.output.timeperframe;
+        parm->parm.output.capability = V4L2_CAP_TIMEPERFRAME;
+    } else if (parm->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        timeperframe = &parm->parm.capture.timeperframe;
+        parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /* Zero asks for the default, like V4L2 drivers do */
+    if (!timeperframe->numerator || !timeperframe->denominator) {
+        timeperframe->numerator = 1;
+        timeperframe->denominator = H264_VIDEO_DEVICE_FPS;
+    }
+    h264_video->timeperframe = *timeperframe;
+
+    if (h264_video->enc_handle) {
+        __atomic_fetch_or(&h264_video->pending, H264_PENDING_RATE, __ATOMIC_ACQ_REL);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t h264_video_get_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    struct h264_video *h264_video = VIDEO_PRIV_DATA(struct h264_video *, video);
+
+    if (parm->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        memset(&parm->parm.output, 0, sizeof(parm->parm.output));
+        parm->parm.output.capability = V4L2_CAP_TIMEPERFRAME;
+        parm->parm.output.timeperframe = h264_video->timeperframe;
+    } else if (parm->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        memset(&parm->parm.capture, 0, sizeof(parm->parm.capture));
+        parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+        parm->parm.capture.timeperframe = h264_video->timeperframe;
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
 static const struct esp_video_ops s_h264_video_ops = {
     .init           = h264_video_init,
     .deinit         = h264_video_deinit,
@@ -441,27 +1259,41 @@ static const struct esp_video_ops s_h264_video_ops = {
     .set_ext_ctrl   = h264_video_set_ext_ctrl,
     .get_ext_ctrl   = h264_video_get_ext_ctrl,
     .query_ext_ctrl = h264_video_query_ext_ctrl,
+    .set_parm       = h264_video_set_parm,
+    .get_parm       = h264_video_get_parm,
 };
 
 /**
  * @brief Create H.264 video device
  *
- * @param hw_codec true: hardware H.264, false: software H.264(has not supported)
+ * @param id       Video device ID, ESP_VIDEO_H264_DEVICE_ID or ESP_VIDEO_H264_1_DEVICE_ID
+ * @param hw_codec true: hardware H.264, shared with the other H.264 device frame by frame, which
+ *                 falls back to software for small frames if CONFIG_ESP_VIDEO_H264_SW_ENCODER is set;
+ *                 false: software H.264 only, needs CONFIG_ESP_VIDEO_H264_SW_ENCODER
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_create_h264_video_device(bool hw_codec)
+esp_err_t esp_video_create_h264_video_device(uint8_t id, bool hw_codec)
 {
     struct esp_video *video;
     struct h264_video *h264_video;
     uint32_t device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_EXT_PIX_FORMAT | V4L2_CAP_STREAMING;
     uint32_t caps = device_caps | V4L2_CAP_DEVICE_CAPS;
 
+#if !CONFIG_ESP_VIDEO_H264_SW_ENCODER
     if (hw_codec == false) {
         return ESP_ERR_NOT_SUPPORTED;
     }
+#endif
+
+    if (!s_h264_hw_lock) {
+        s_h264_hw_lock = xSemaphoreCreateRecursiveMutex();
+        if (!s_h264_hw_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
 
     h264_video = heap_caps_calloc(1, sizeof(struct h264_video), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
     if (!h264_video) {
@@ -473,8 +1305,11 @@ esp_err_t esp_video_create_h264_video_device(bool hw_codec)
     h264_video->min_qp = H264_VIDEO_DEVICE_MIN_QP;
     h264_video->max_qp = H264_VIDEO_DEVICE_MAX_QP;
     h264_video->bitrate = H264_VIDEO_DEVICE_BITRATE;
+    h264_video->timeperframe.numerator = 1;
+    h264_video->timeperframe.denominator = H264_VIDEO_DEVICE_FPS;
 
-    video = esp_video_create(H264_NAME, ESP_VIDEO_H264_DEVICE_ID, &s_h264_video_ops, h264_video, caps, device_caps);
+    video = esp_video_create(id == ESP_VIDEO_H264_DEVICE_ID ? H264_NAME : H264_1_NAME, id, &s_h264_video_ops,
+                             h264_video, caps, device_caps);
     if (!video) {
         heap_caps_free(h264_video);
         return ESP_FAIL;
@@ -13,7 +13,13 @@
 #include "esp_log.h"
 #include "esp_attr.h"
 #include "esp_check.h"
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+#include "esp_timer.h"
+#endif
 #include "hal/isp_ll.h"
+#if ESP_VIDEO_ISP_DEVICE_CROP
+#include "driver/isp_crop.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -22,6 +28,17 @@
 #include "esp_video_device.h"
 #include "esp_video_isp_ioctl.h"
 #include "esp_video_device_internal.h"
+#include "esp_video_init.h"
+#include "trace.h"
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS && CONFIG_ESP_VIDEO_ENABLE_ISP_PIPELINE_CONTROLLER
+#include "esp_video_pipeline_isp.h"
+#endif
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+#include "esp_ipa.h"
+#endif
+#if CONFIG_ESP_VIDEO_ENABLE_CALIB
+#include "esp_video_calib.h"
+#endif
 
 /**
  * IDF-9706
@@ -75,10 +92,65 @@
 #define ISP_STATS_HIST_FLAG         ESP_VIDEO_ISP_STATS_FLAG_HIST
 #define ISP_STATS_SHARPEN_FLAG      ESP_VIDEO_ISP_STATS_FLAG_SHARPEN
 
-#define ISP_STATS_FLAGS             (ISP_STATS_AE_FLAG | ISP_STATS_AWB_FLAG | ISP_STATS_HIST_FLAG)
+/* Held blocks are not started, whatever the application or the image algorithms ask for */
+#define ISP_HELD(iv, b)             ((iv)->held_blocks & (b))
+
+#define ISP_BLOCKS_ALL              (ESP_VIDEO_ISP_BLOCK_BF | ESP_VIDEO_ISP_BLOCK_CCM | ESP_VIDEO_ISP_BLOCK_SHARPEN |   \
+                                     ESP_VIDEO_ISP_BLOCK_GAMMA | ESP_VIDEO_ISP_BLOCK_DEMOSAIC |                         \
+                                     ESP_VIDEO_ISP_BLOCK_COLOR | ESP_VIDEO_ISP_BLOCK_LSC |                              \
+                                     ESP_VIDEO_ISP_BLOCK_AE_STATS | ESP_VIDEO_ISP_BLOCK_HIST_STATS)
+
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+#define ISP_LOAD_BEGIN(t)           int64_t t = esp_timer_get_time()
+#define ISP_LOAD_END(iv, t)         isp_load_account(iv, t)
+#else
+#define ISP_LOAD_BEGIN(t)
+#define ISP_LOAD_END(iv, t)
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+#define ISP_STATS_META_FMT          V4L2_META_FMT_ESP_IPA_STATS
+typedef esp_ipa_stats_t isp_stats_buf_t;
+#else
+#define ISP_STATS_META_FMT          V4L2_META_FMT_ESP_ISP_STATS
+typedef esp_video_isp_stats_t isp_stats_buf_t;
+#endif
 
 #define ISP_LSC_GET_GRIDS(res)      (((res) - 1) / 2 / ISP_LL_LSC_GRID_HEIGHT + 2)
 
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+#define ISP_SHADOW_CCM              BIT(0)
+#define ISP_SHADOW_SHARPEN          BIT(1)
+#define ISP_SHADOW_GAMMA            BIT(2)
+#define ISP_SHADOW_DEMOSAIC         BIT(3)
+#define ISP_SHADOW_COLOR            BIT(4)
+#define ISP_SHADOW_LSC              BIT(5)
+
+#define ISP_SHADOW_HOLD(iv, h)      isp_shadow_hold(iv, h)
+#define ISP_SHADOW_DROP(iv, b)      isp_shadow_drop(iv, b)
+
+/**
+ * Block configuration staged by the control path. It is written to the ISP
+ * at the next frame boundary, all pending blocks in the same interrupt.
+ */
+struct isp_shadow {
+    uint32_t pending;
+    bool hold;
+
+    esp_isp_ccm_config_t ccm;
+    esp_isp_sharpen_config_t sharpen;
+    isp_gamma_curve_points_t gamma;
+    esp_isp_demosaic_config_t demosaic;
+    esp_isp_color_config_t color;
+#if ESP_VIDEO_ISP_DEVICE_LSC
+    esp_isp_lsc_gain_array_t lsc_gain_array;
+#endif
+};
+#else
+#define ISP_SHADOW_HOLD(iv, h)
+#define ISP_SHADOW_DROP(iv, b)
+#endif
+
 struct isp_video {
     isp_proc_handle_t isp_proc;
 
@@ -147,6 +219,7 @@ struct isp_video {
 
 #if ESP_VIDEO_ISP_DEVICE_LSC
     uint8_t lsc_enable              : 1;
+    uint8_t lsc_user                : 1;    /* Tables set by the application, calibration is not used */
 #endif
 
     /* ISP pipeline state */
@@ -156,19 +229,37 @@ struct isp_video {
     uint8_t sharpen_started         : 1;
     uint8_t gamma_started           : 1;
     uint8_t demosaic_started        : 1;
+    uint8_t color_started           : 1;
 
 #if ESP_VIDEO_ISP_DEVICE_LSC
     uint8_t lsc_started             : 1;
 #endif
 
+    uint32_t held_blocks;           /* ESP_VIDEO_ISP_BLOCK_XXX kept off */
+
     /* Meta capture state */
 
     bool capture_meta;
 
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    /* Staged block configuration */
+
+    struct isp_shadow shadow;
+#endif
+
     /* Statistics data */
 
     uint64_t seq;
-    esp_video_isp_stats_t *stats_buffer;
+    uint32_t frame_seq;
+    uint32_t stats_flags;
+    isp_stats_buf_t *stats_buffer;
+
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+    /* Statistics interrupt load, guarded by spinlock */
+
+    uint32_t irqs;
+    uint32_t irq_us;
+#endif
 #endif
 };
 
@@ -385,72 +476,227 @@ static esp_err_t isp_get_output_frame_type(cam_ctlr_color_t ctlr_color, isp_colo
 }
 
 #if CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
-static esp_err_t IRAM_ATTR isp_stats_done(struct isp_video *isp_video, const void *buffer, uint32_t flags)
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+static void isp_shadow_stage(struct isp_video *isp_video, uint32_t block, void *shadow, const void *config, size_t size)
 {
-    esp_err_t ret = ESP_OK;
-    uint32_t target_flags = ISP_STATS_FLAGS;
+    portENTER_CRITICAL(&isp_video->spinlock);
+    memcpy(shadow, config, size);
+    isp_video->shadow.pending |= block;
+    portEXIT_CRITICAL(&isp_video->spinlock);
+}
 
-    if (!isp_video->capture_meta) {
-        return false;
-    }
+static void isp_shadow_drop(struct isp_video *isp_video, uint32_t block)
+{
+    portENTER_CRITICAL(&isp_video->spinlock);
+    isp_video->shadow.pending &= ~block;
+    portEXIT_CRITICAL(&isp_video->spinlock);
+}
 
+/* While held, staged blocks are not committed, so one control request lands in one frame */
+static void isp_shadow_hold(struct isp_video *isp_video, bool hold)
+{
     portENTER_CRITICAL(&isp_video->spinlock);
-    if (!isp_video->stats_buffer) {
-        struct esp_video_buffer_element *element;
+    isp_video->shadow.hold = hold;
+    portEXIT_CRITICAL(&isp_video->spinlock);
+}
 
-        element = META_VIDEO_GET_QUEUED_ELEMENT(isp_video->video);
-        if (!element) {
-            ret = ESP_ERR_NO_MEM;
-            goto exit;
+/**
+ * Called at the end of every frame. Only the block configure functions are used,
+ * CONFIG_ISP_CTRL_FUNC_IN_IRAM places them in IRAM and allows calling them here.
+ */
+static void IRAM_ATTR isp_shadow_commit(struct isp_video *isp_video)
+{
+    struct isp_shadow *shadow = &isp_video->shadow;
+    uint32_t failed = 0;
+
+    portENTER_CRITICAL_ISR(&isp_video->spinlock);
+    if (!shadow->pending || shadow->hold || !ISP_STARTED(isp_video)) {
+        goto exit;
+    }
+
+    if ((shadow->pending & ISP_SHADOW_CCM) &&
+            esp_isp_ccm_configure(isp_video->isp_proc, &shadow->ccm) != ESP_OK) {
+        failed |= ISP_SHADOW_CCM;
+    }
+    if ((shadow->pending & ISP_SHADOW_SHARPEN) &&
+            esp_isp_sharpen_configure(isp_video->isp_proc, &shadow->sharpen) != ESP_OK) {
+        failed |= ISP_SHADOW_SHARPEN;
+    }
+    if ((shadow->pending & ISP_SHADOW_GAMMA) &&
+            (esp_isp_gamma_configure(isp_video->isp_proc, COLOR_COMPONENT_R, &shadow->gamma) != ESP_OK ||
+             esp_isp_gamma_configure(isp_video->isp_proc, COLOR_COMPONENT_G, &shadow->gamma) != ESP_OK ||
+             esp_isp_gamma_configure(isp_video->isp_proc, COLOR_COMPONENT_B, &shadow->gamma) != ESP_OK)) {
+        failed |= ISP_SHADOW_GAMMA;
+    }
+    if ((shadow->pending & ISP_SHADOW_DEMOSAIC) &&
+            esp_isp_demosaic_configure(isp_video->isp_proc, &shadow->demosaic) != ESP_OK) {
+        failed |= ISP_SHADOW_DEMOSAIC;
+    }
+    if ((shadow->pending & ISP_SHADOW_COLOR) &&
+            esp_isp_color_configure(isp_video->isp_proc, &shadow->color) != ESP_OK) {
+        failed |= ISP_SHADOW_COLOR;
+    }
+#if ESP_VIDEO_ISP_DEVICE_LSC
+    if (shadow->pending & ISP_SHADOW_LSC) {
+        esp_isp_lsc_config_t lsc_config = {
+            .gain_array = &shadow->lsc_gain_array
+        };
+
+        if (esp_isp_lsc_configure(isp_video->isp_proc, &lsc_config) != ESP_OK) {
+            failed |= ISP_SHADOW_LSC;
         }
+    }
+#endif
+    shadow->pending = 0;
 
-        isp_video->stats_buffer = (esp_video_isp_stats_t *)element->buffer;
-        isp_video->stats_buffer->flags = 0;
+exit:
+    portEXIT_CRITICAL_ISR(&isp_video->spinlock);
+
+    if (failed) {
+        ESP_EARLY_LOGE(TAG, "failed to commit staged blocks=%" PRIx32, failed);
     }
+}
+#endif
 
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+/* Write the statistics in the layout esp_ipa_pipeline_process() takes, so the IPA reads the buffer as is */
+static esp_err_t IRAM_ATTR isp_stats_fill(isp_stats_buf_t *stats, const void *buffer, uint32_t flags)
+{
     switch (flags) {
     case ISP_STATS_AWB_FLAG: {
-        const esp_isp_awb_evt_data_t *edata = (const esp_isp_awb_evt_data_t *)buffer;
-        esp_isp_awb_evt_data_t *awb_stats = &isp_video->stats_buffer->awb;
+        const isp_awb_stat_result_t *awb = &((const esp_isp_awb_evt_data_t *)buffer)->awb_result;
 
-        *awb_stats = *edata;
+        stats->awb_stats[0].counted = awb->white_patch_num;
+        stats->awb_stats[0].sum_r = awb->sum_r;
+        stats->awb_stats[0].sum_g = awb->sum_g;
+        stats->awb_stats[0].sum_b = awb->sum_b;
+        stats->flags |= IPA_STATS_FLAGS_AWB;
         break;
     }
     case ISP_STATS_AE_FLAG: {
-        const esp_isp_ae_env_detector_evt_data_t *edata = (const esp_isp_ae_env_detector_evt_data_t *)buffer;
-        esp_isp_ae_env_detector_evt_data_t *ae_stats = &isp_video->stats_buffer->ae;
+        const isp_ae_result_t *ae = &((const esp_isp_ae_env_detector_evt_data_t *)buffer)->ae_result;
 
-        *ae_stats = *edata;
+        for (int i = 0; i < ISP_AE_BLOCK_X_NUM; i++) {
+            for (int j = 0; j < ISP_AE_BLOCK_Y_NUM; j++) {
+                stats->ae_stats[i * ISP_AE_BLOCK_Y_NUM + j].luminance = ae->luminance[i][j];
+            }
+        }
+        stats->flags |= IPA_STATS_FLAGS_AE;
         break;
     }
     case ISP_STATS_HIST_FLAG: {
-        const esp_isp_hist_evt_data_t *edata = (const esp_isp_hist_evt_data_t *)buffer;
-        esp_isp_hist_evt_data_t *hist_stats = &isp_video->stats_buffer->hist;
+        const isp_hist_result_t *hist = &((const esp_isp_hist_evt_data_t *)buffer)->hist_result;
 
-        *hist_stats = *edata;
+        for (int i = 0; i < ISP_HIST_SEGMENT_NUMS; i++) {
+            stats->hist_stats[i].value = hist->hist_value[i];
+        }
+        stats->flags |= IPA_STATS_FLAGS_HIST;
         break;
     }
     case ISP_STATS_SHARPEN_FLAG: {
-        const esp_isp_sharpen_evt_data_t *edata = (const esp_isp_sharpen_evt_data_t *)buffer;
-        esp_isp_sharpen_evt_data_t *sharpen_stats = &isp_video->stats_buffer->sharpen;
+        const esp_isp_sharpen_evt_data_t *sharpen = (const esp_isp_sharpen_evt_data_t *)buffer;
 
-        *sharpen_stats = *edata;
+        stats->sharpen_stats.value = sharpen->high_freq_pixel_max;
+        stats->flags |= IPA_STATS_FLAGS_SHARPEN;
         break;
     }
     default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+#else
+static esp_err_t IRAM_ATTR isp_stats_fill(isp_stats_buf_t *stats, const void *buffer, uint32_t flags)
+{
+    switch (flags) {
+    case ISP_STATS_AWB_FLAG:
+        stats->awb = *(const esp_isp_awb_evt_data_t *)buffer;
+        break;
+    case ISP_STATS_AE_FLAG:
+        stats->ae = *(const esp_isp_ae_env_detector_evt_data_t *)buffer;
+        break;
+    case ISP_STATS_HIST_FLAG:
+        stats->hist = *(const esp_isp_hist_evt_data_t *)buffer;
+        break;
+    case ISP_STATS_SHARPEN_FLAG:
+        stats->sharpen = *(const esp_isp_sharpen_evt_data_t *)buffer;
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->flags |= flags;
+
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+static void IRAM_ATTR isp_load_account(struct isp_video *isp_video, int64_t start)
+{
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    portENTER_CRITICAL(&isp_video->spinlock);
+    isp_video->irqs++;
+    isp_video->irq_us += elapsed;
+    portEXIT_CRITICAL(&isp_video->spinlock);
+}
+#endif
+
+static esp_err_t IRAM_ATTR isp_stats_done(struct isp_video *isp_video, const void *buffer, uint32_t flags)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t target_flags = ISP_STATS_AWB_FLAG;
+
+    if (!isp_video->capture_meta) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&isp_video->spinlock);
+    if (!isp_video->stats_buffer) {
+        struct esp_video_buffer_element *element;
+
+        element = META_VIDEO_GET_QUEUED_ELEMENT(isp_video->video);
+        if (!element) {
+            ret = ESP_ERR_NO_MEM;
+            goto exit;
+        }
+
+        /* Statistics of one frame arrive in several interrupts, the first one claims the buffer */
+        isp_video->stats_buffer = (isp_stats_buf_t *)element->buffer;
+        isp_video->stats_buffer->flags = 0;
+        isp_video->stats_flags = 0;
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+        isp_video->stats_buffer->seq = isp_video->frame_seq;
+#else
+        isp_video->stats_buffer->frame_seq = isp_video->frame_seq;
+#endif
+    }
+
+    ret = isp_stats_fill(isp_video->stats_buffer, buffer, flags);
+    if (ret != ESP_OK) {
         ESP_EARLY_LOGE(TAG, "flags=%" PRIx32 " is not supported", flags);
-        ret = ESP_ERR_INVALID_ARG;
         goto exit;
     }
 
-    isp_video->stats_buffer->flags |= flags;
+    isp_video->stats_flags |= flags;
+    if (isp_video->ae_ctlr) {
+        target_flags |= ISP_STATS_AE_FLAG;
+    }
+    if (isp_video->hist_ctlr) {
+        target_flags |= ISP_STATS_HIST_FLAG;
+    }
     if (isp_video->sharpen_started) {
         target_flags |= ISP_STATS_SHARPEN_FLAG;
     }
-    if ((isp_video->stats_buffer->flags & target_flags) == target_flags) {
+    if ((isp_video->stats_flags & target_flags) == target_flags) {
+#if !CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
         isp_video->stats_buffer->seq = isp_video->seq++;
-        META_VIDEO_DONE_BUF(isp_video->video, isp_video->stats_buffer, sizeof(esp_video_isp_stats_t));
+#endif
+        META_VIDEO_DONE_BUF(isp_video->video, isp_video->stats_buffer, sizeof(isp_stats_buf_t));
         isp_video->stats_buffer = NULL;
+        TRACE_INSTANT(TRACE_ISP_STATS, isp_video->frame_seq);
     }
 
 exit:
@@ -462,8 +708,10 @@ static bool isp_hist_stats_done(isp_hist_ctlr_t hist_ctlr, const esp_isp_hist_ev
 {
     esp_err_t ret;
     struct isp_video *isp_video = (struct isp_video *)user_data;
+    ISP_LOAD_BEGIN(start);
 
     ret = isp_stats_done(isp_video, edata, ISP_STATS_HIST_FLAG);
+    ISP_LOAD_END(isp_video, start);
 
     return ret == ESP_OK ? true : false;
 }
@@ -497,6 +745,10 @@ static esp_err_t isp_start_hist(struct isp_video *isp_video)
         .on_statistics_done = isp_hist_stats_done,
     };
 
+    if (ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_HIST_STATS)) {
+        return ESP_OK;
+    }
+
     ESP_RETURN_ON_ERROR(esp_isp_new_hist_controller(isp_video->isp_proc, &hist_config, &isp_video->hist_ctlr), TAG, "failed to new histogram");
 
     ESP_GOTO_ON_ERROR(esp_isp_hist_register_event_callbacks(isp_video->hist_ctlr, &hist_cb, isp_video), fail_0, TAG, "failed to register histogram callback");
@@ -515,6 +767,10 @@ fail_0:
 
 static esp_err_t isp_stop_hist(struct isp_video *isp_video)
 {
+    if (!isp_video->hist_ctlr) {
+        return ESP_OK;
+    }
+
     ESP_RETURN_ON_ERROR(esp_isp_hist_controller_stop_continuous_statistics(isp_video->hist_ctlr), TAG, "failed to stop histogram");
     ESP_RETURN_ON_ERROR(esp_isp_hist_controller_disable(isp_video->hist_ctlr), TAG, "failed to disable histogram");
     ESP_RETURN_ON_ERROR(esp_isp_del_hist_controller(isp_video->hist_ctlr), TAG, "failed to delete histogram");
@@ -528,9 +784,19 @@ static bool isp_awb_stats_done(isp_awb_ctlr_t awb_ctlr, const esp_isp_awb_evt_da
 {
     esp_err_t ret;
     struct isp_video *isp_video = (struct isp_video *)user_data;
+    ISP_LOAD_BEGIN(start);
+
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    /* AWB statistics complete once per frame, the next frame has not started yet */
+    isp_shadow_commit(isp_video);
+#endif
 
     ret = isp_stats_done(isp_video, edata, ISP_STATS_AWB_FLAG);
 
+    /* Counts every frame, like the capture buffer sequence of the MIPI-CSI device */
+    isp_video->frame_seq++;
+    ISP_LOAD_END(isp_video, start);
+
     return ret == ESP_OK ? true : false;
 }
 
@@ -584,7 +850,7 @@ static esp_err_t isp_stop_awb(struct isp_video *isp_video)
 
 static esp_err_t isp_start_bf(struct isp_video *isp_video)
 {
-    if (isp_video->bf_started) {
+    if (isp_video->bf_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_BF)) {
         return ESP_OK;
     }
 
@@ -655,7 +921,7 @@ static esp_err_t isp_start_ccm(struct isp_video *isp_video)
 {
     esp_isp_ccm_config_t ccm_config;
 
-    if (isp_video->ccm_started) {
+    if (isp_video->ccm_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_CCM)) {
         return ESP_OK;
     }
 
@@ -672,8 +938,14 @@ static esp_err_t isp_reconfig_ccm(struct isp_video *isp_video)
     esp_isp_ccm_config_t ccm_config;
 
     isp_init_ccm_param(isp_video, &ccm_config);
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    if (isp_video->ccm_started) {
+        isp_shadow_stage(isp_video, ISP_SHADOW_CCM, &isp_video->shadow.ccm, &ccm_config, sizeof(ccm_config));
+        return ESP_OK;
+    }
+#endif
     ESP_RETURN_ON_ERROR(esp_isp_ccm_configure(isp_video->isp_proc, &ccm_config), TAG, "failed to configure CCM");
-    if (!isp_video->ccm_started) {
+    if (!isp_video->ccm_started && !ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_CCM)) {
         ESP_RETURN_ON_ERROR(esp_isp_ccm_enable(isp_video->isp_proc), TAG, "failed to enable CCM");
         isp_video->ccm_started = true;
     }
@@ -692,6 +964,7 @@ static esp_err_t isp_stop_ccm(struct isp_video *isp_video)
         return ESP_OK;
     }
 
+    ISP_SHADOW_DROP(isp_video, ISP_SHADOW_CCM);
     ESP_RETURN_ON_ERROR(esp_isp_ccm_disable(isp_video->isp_proc), TAG, "failed to disable CCM");
     isp_video->ccm_started = false;
 
@@ -702,8 +975,10 @@ static bool isp_ae_stats_done(isp_ae_ctlr_t ae_ctlr, const esp_isp_ae_env_detect
 {
     esp_err_t ret;
     struct isp_video *isp_video = (struct isp_video *)user_data;
+    ISP_LOAD_BEGIN(start);
 
     ret = isp_stats_done(isp_video, edata, ISP_STATS_AE_FLAG);
+    ISP_LOAD_END(isp_video, start);
 
     return ret == ESP_OK ? true : false;
 }
@@ -724,6 +999,10 @@ static esp_err_t isp_start_ae(struct isp_video *isp_video)
         .on_env_statistics_done = isp_ae_stats_done,
     };
 
+    if (ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_AE_STATS)) {
+        return ESP_OK;
+    }
+
     ESP_ERROR_CHECK(esp_isp_new_ae_controller(isp_video->isp_proc, &ae_config, &isp_video->ae_ctlr));
 
     ESP_ERROR_CHECK(esp_isp_ae_env_detector_register_event_callbacks(isp_video->ae_ctlr, &cbs, isp_video));
@@ -735,6 +1014,10 @@ static esp_err_t isp_start_ae(struct isp_video *isp_video)
 
 static esp_err_t isp_stop_ae(struct isp_video *isp_video)
 {
+    if (!isp_video->ae_ctlr) {
+        return ESP_OK;
+    }
+
     ESP_ERROR_CHECK(esp_isp_ae_controller_stop_continuous_statistics(isp_video->ae_ctlr));
     ESP_ERROR_CHECK(esp_isp_ae_controller_disable(isp_video->ae_ctlr));
     ESP_ERROR_CHECK(esp_isp_del_ae_controller(isp_video->ae_ctlr));
@@ -747,8 +1030,10 @@ static bool IRAM_ATTR isp_sharpen_stats_done(isp_proc_handle_t proc, const esp_i
 {
     esp_err_t ret;
     struct isp_video *isp_video = (struct isp_video *)user_data;
+    ISP_LOAD_BEGIN(start);
 
     ret = isp_stats_done(isp_video, edata, ISP_STATS_SHARPEN_FLAG);
+    ISP_LOAD_END(isp_video, start);
 
     return ret == ESP_OK ? true : false;
 }
@@ -783,7 +1068,7 @@ static esp_err_t isp_start_sharpen(struct isp_video *isp_video)
 {
     esp_isp_sharpen_config_t sharpen_config;
 
-    if (isp_video->sharpen_started) {
+    if (isp_video->sharpen_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_SHARPEN)) {
         return ESP_OK;
     }
 
@@ -800,8 +1085,14 @@ static esp_err_t isp_reconfig_sharpen(struct isp_video *isp_video)
     esp_isp_sharpen_config_t sharpen_config;
 
     isp_init_sharpen_param(isp_video, &sharpen_config);
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    if (isp_video->sharpen_started) {
+        isp_shadow_stage(isp_video, ISP_SHADOW_SHARPEN, &isp_video->shadow.sharpen, &sharpen_config, sizeof(sharpen_config));
+        return ESP_OK;
+    }
+#endif
     ESP_RETURN_ON_ERROR(esp_isp_sharpen_configure(isp_video->isp_proc, &sharpen_config), TAG, "failed to configure sharpen");
-    if (!isp_video->sharpen_started) {
+    if (!isp_video->sharpen_started && !ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_SHARPEN)) {
         ESP_RETURN_ON_ERROR(esp_isp_sharpen_enable(isp_video->isp_proc), TAG, "failed to enable sharpen");
         isp_video->sharpen_started = true;
     }
@@ -815,6 +1106,7 @@ static esp_err_t isp_stop_sharpen(struct isp_video *isp_video)
         return ESP_OK;
     }
 
+    ISP_SHADOW_DROP(isp_video, ISP_SHADOW_SHARPEN);
     ESP_RETURN_ON_ERROR(esp_isp_sharpen_disable(isp_video->isp_proc), TAG, "failed to disable sharpen");
     isp_video->sharpen_started = false;
 
@@ -834,7 +1126,7 @@ static esp_err_t isp_start_gamma(struct isp_video *isp_video)
 {
     isp_gamma_curve_points_t gamma_config;
 
-    if (isp_video->gamma_started) {
+    if (isp_video->gamma_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_GAMMA)) {
         return ESP_OK;
     }
 
@@ -853,10 +1145,16 @@ static esp_err_t isp_reconfigure_gamma(struct isp_video *isp_video)
     isp_gamma_curve_points_t gamma_config;
 
     isp_init_gamma_param(isp_video, &gamma_config);
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    if (isp_video->gamma_started) {
+        isp_shadow_stage(isp_video, ISP_SHADOW_GAMMA, &isp_video->shadow.gamma, &gamma_config, sizeof(gamma_config));
+        return ESP_OK;
+    }
+#endif
     ESP_RETURN_ON_ERROR(esp_isp_gamma_configure(isp_video->isp_proc, COLOR_COMPONENT_R, &gamma_config), TAG, "failed to configure R GAMMA");
     ESP_RETURN_ON_ERROR(esp_isp_gamma_configure(isp_video->isp_proc, COLOR_COMPONENT_G, &gamma_config), TAG, "failed to configure G GAMMA");
     ESP_RETURN_ON_ERROR(esp_isp_gamma_configure(isp_video->isp_proc, COLOR_COMPONENT_B, &gamma_config), TAG, "failed to configure B GAMMA");
-    if (!isp_video->gamma_started) {
+    if (!isp_video->gamma_started && !ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_GAMMA)) {
         ESP_RETURN_ON_ERROR(esp_isp_gamma_enable(isp_video->isp_proc), TAG, "failed to enable GAMMA");
         isp_video->gamma_started = true;
     }
@@ -870,6 +1168,7 @@ static esp_err_t isp_stop_gamma(struct isp_video *isp_video)
         return ESP_OK;
     }
 
+    ISP_SHADOW_DROP(isp_video, ISP_SHADOW_GAMMA);
     ESP_RETURN_ON_ERROR(esp_isp_gamma_disable(isp_video->isp_proc), TAG, "failed to disable GAMMA");
     isp_video->gamma_started = false;
 
@@ -890,7 +1189,7 @@ static esp_err_t isp_start_demosaic(struct isp_video *isp_video)
 {
     esp_isp_demosaic_config_t demosaic_config;
 
-    if (isp_video->demosaic_started) {
+    if (isp_video->demosaic_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_DEMOSAIC)) {
         return ESP_OK;
     }
 
@@ -907,8 +1206,14 @@ static esp_err_t isp_reconfigure_demosaic(struct isp_video *isp_video)
     esp_isp_demosaic_config_t demosaic_config;
 
     isp_init_demosaic_param(isp_video, &demosaic_config);
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    if (isp_video->demosaic_started) {
+        isp_shadow_stage(isp_video, ISP_SHADOW_DEMOSAIC, &isp_video->shadow.demosaic, &demosaic_config, sizeof(demosaic_config));
+        return ESP_OK;
+    }
+#endif
     ESP_RETURN_ON_ERROR(esp_isp_demosaic_configure(isp_video->isp_proc, &demosaic_config), TAG, "failed to configure demosaic");
-    if (!isp_video->demosaic_started) {
+    if (!isp_video->demosaic_started && !ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_DEMOSAIC)) {
         ESP_RETURN_ON_ERROR(esp_isp_demosaic_enable(isp_video->isp_proc), TAG, "failed to enable demosaic");
         isp_video->demosaic_started = true;
     }
@@ -922,6 +1227,7 @@ static esp_err_t isp_stop_demosaic(struct isp_video *isp_video)
         return ESP_OK;
     }
 
+    ISP_SHADOW_DROP(isp_video, ISP_SHADOW_DEMOSAIC);
     ESP_RETURN_ON_ERROR(esp_isp_demosaic_disable(isp_video->isp_proc), TAG, "failed to disable demosaic");
     isp_video->demosaic_started = false;
 
@@ -930,22 +1236,38 @@ static esp_err_t isp_stop_demosaic(struct isp_video *isp_video)
 
 static esp_err_t isp_start_color(struct isp_video *isp_video)
 {
+    if (isp_video->color_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_COLOR)) {
+        return ESP_OK;
+    }
+
     ESP_RETURN_ON_ERROR(esp_isp_color_configure(isp_video->isp_proc, &isp_video->color_config), TAG, "failed to configure color");
     ESP_RETURN_ON_ERROR(esp_isp_color_enable(isp_video->isp_proc), TAG, "failed to enable color");
+    isp_video->color_started = true;
 
     return ESP_OK;
 }
 
 static esp_err_t isp_reconfigure_color(struct isp_video *isp_video)
 {
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    isp_shadow_stage(isp_video, ISP_SHADOW_COLOR, &isp_video->shadow.color, &isp_video->color_config,
+                     sizeof(isp_video->color_config));
+#else
     ESP_RETURN_ON_ERROR(esp_isp_color_configure(isp_video->isp_proc, &isp_video->color_config), TAG, "failed to configure color");
+#endif
 
     return ESP_OK;
 }
 
 static esp_err_t isp_stop_color(struct isp_video *isp_video)
 {
+    if (!isp_video->color_started) {
+        return ESP_OK;
+    }
+
+    ISP_SHADOW_DROP(isp_video, ISP_SHADOW_COLOR);
     ESP_RETURN_ON_ERROR(esp_isp_color_disable(isp_video->isp_proc), TAG, "failed to disable color");
+    isp_video->color_started = false;
 
     return ESP_OK;
 }
@@ -959,11 +1281,11 @@ static esp_err_t isp_start_lsc(struct isp_video *isp_video)
         .gain_array = &isp_video->lsc_gain_array
     };
 
-    if (isp_video->lsc_started) {
+    if (isp_video->lsc_started || ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_LSC)) {
         return ESP_OK;
     }
 
-    ESP_RETURN_ON_FALSE(isp_video->lsc_gain_size = (w * h), ESP_ERR_INVALID_ARG, TAG, "LSC configuration is invalid");
+    ESP_RETURN_ON_FALSE(isp_video->lsc_gain_size == (w * h), ESP_ERR_INVALID_ARG, TAG, "LSC configuration is invalid");
 
     ESP_RETURN_ON_ERROR(esp_isp_lsc_configure(isp_video->isp_proc, &lsc_config), TAG, "failed to configure LSC");
     ESP_RETURN_ON_ERROR(esp_isp_lsc_enable(isp_video->isp_proc), TAG, "failed to enable LSC");
@@ -980,10 +1302,17 @@ static esp_err_t isp_reconfigure_lsc(struct isp_video *isp_video)
         .gain_array = &isp_video->lsc_gain_array
     };
 
-    ESP_RETURN_ON_FALSE(isp_video->lsc_gain_size = (w * h), ESP_ERR_INVALID_ARG, TAG, "LSC configuration is invalid");
+    ESP_RETURN_ON_FALSE(isp_video->lsc_gain_size == (w * h), ESP_ERR_INVALID_ARG, TAG, "LSC configuration is invalid");
 
+#if CONFIG_ESP_VIDEO_ISP_STAGED_COMMIT
+    if (isp_video->lsc_started) {
+        isp_shadow_stage(isp_video, ISP_SHADOW_LSC, &isp_video->shadow.lsc_gain_array, &isp_video->lsc_gain_array,
+                         sizeof(isp_video->lsc_gain_array));
+        return ESP_OK;
+    }
+#endif
     ESP_RETURN_ON_ERROR(esp_isp_lsc_configure(isp_video->isp_proc, &lsc_config), TAG, "failed to configure LSC");
-    if (!isp_video->lsc_started) {
+    if (!isp_video->lsc_started && !ISP_HELD(isp_video, ESP_VIDEO_ISP_BLOCK_LSC)) {
         ESP_RETURN_ON_ERROR(esp_isp_lsc_enable(isp_video->isp_proc), TAG, "failed to enable LSC");
         isp_video->lsc_started = true;
     }
@@ -997,11 +1326,53 @@ static esp_err_t isp_stop_lsc(struct isp_video *isp_video)
         return ESP_OK;
     }
 
+    ISP_SHADOW_DROP(isp_video, ISP_SHADOW_LSC);
     ESP_RETURN_ON_ERROR(esp_isp_lsc_disable(isp_video->isp_proc), TAG, "failed to disable LSC");
     isp_video->lsc_started = false;
 
     return ESP_OK;
 }
+
+#if CONFIG_ESP_VIDEO_ENABLE_CALIB
+/**
+ * Take the calibrated gain tables of the ISP input frame size, unless the
+ * application set LSC itself. The tables stay in the mapped flash partition,
+ * LSC is off for frame sizes without calibration.
+ */
+static void isp_load_calib_lsc(struct isp_video *isp_video, uint32_t width, uint32_t height)
+{
+    size_t size;
+    size_t grids;
+    const esp_video_calib_lsc_t *lsc;
+    uint32_t grid_w = ISP_LSC_GET_GRIDS(width);
+    uint32_t grid_h = ISP_LSC_GET_GRIDS(height);
+
+    if (isp_video->lsc_user) {
+        return;
+    }
+
+    isp_video->lsc_enable = false;
+    lsc = esp_video_calib_find(ESP_VIDEO_CALIB_TYPE_LSC, width, height, &size);
+    if (!lsc) {
+        return;
+    }
+
+    grids = grid_w * grid_h;
+    if ((lsc->grid_width != grid_w) || (lsc->grid_height != grid_h) ||
+            (size < sizeof(*lsc) + 4 * grids * sizeof(isp_lsc_gain_t))) {
+        ESP_LOGW(TAG, "LSC calibration of %" PRIu32 "x%" PRIu32 " must have %" PRIu32 "x%" PRIu32 " grids",
+                 width, height, grid_w, grid_h);
+        return;
+    }
+
+    isp_video->lsc_gain_size = grids;
+    isp_video->lsc_gain_array.gain_r = (isp_lsc_gain_t *)&lsc->gain[0];
+    isp_video->lsc_gain_array.gain_gr = (isp_lsc_gain_t *)&lsc->gain[grids];
+    isp_video->lsc_gain_array.gain_gb = (isp_lsc_gain_t *)&lsc->gain[2 * grids];
+    isp_video->lsc_gain_array.gain_b = (isp_lsc_gain_t *)&lsc->gain[3 * grids];
+    isp_video->lsc_enable = true;
+}
+#endif
 #endif
 
 static esp_err_t isp_start_pipeline(struct isp_video *isp_video)
@@ -1092,7 +1463,7 @@ static esp_err_t isp_stop_pipeline(struct isp_video *isp_video)
 
 static esp_err_t isp_video_init(struct esp_video *video)
 {
-    uint32_t buf_size = sizeof(esp_video_isp_stats_t);
+    uint32_t buf_size = sizeof(isp_stats_buf_t);
 
     META_VIDEO_SET_BUF_INFO(video, buf_size, ISP_DMA_ALIGN_BYTES, ISP_MEM_CAPS);
 
@@ -1141,7 +1512,7 @@ static esp_err_t isp_video_enum_format(struct esp_video *video, uint32_t type, u
     if (type == V4L2_BUF_TYPE_META_CAPTURE) {
         switch (index) {
         case 0:
-            *pixel_format = V4L2_META_FMT_ESP_ISP_STATS;
+            *pixel_format = ISP_STATS_META_FMT;
             ret = ESP_OK;
             break;
         default:
@@ -1177,6 +1548,7 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
     struct isp_video *isp_video = VIDEO_PRIV_DATA(struct isp_video *, video);
 
     ISP_LOCK(isp_video);
+    ISP_SHADOW_HOLD(isp_video, true);
 
     for (int i = 0; i < ctrls->count; i++) {
         struct v4l2_ext_control *ctrl = &ctrls->controls[i];
@@ -1185,6 +1557,13 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
         case V4L2_CID_USER_ESP_ISP_BF: {
             const esp_video_isp_bf_t *bf = (const esp_video_isp_bf_t *)ctrl->p_u8;
 
+            /* Restarting BF drops a frame, so unchanged values are not applied again */
+            if (bf->enable == isp_video->bf_enable &&
+                    (!bf->enable || (bf->level == isp_video->denoising_level &&
+                                     !memcmp(bf->matrix, isp_video->bf_matrix, sizeof(isp_video->bf_matrix))))) {
+                break;
+            }
+
             isp_video->bf_enable = bf->enable;
             if (bf->enable) {
                 isp_video->denoising_level = bf->level;
@@ -1208,6 +1587,12 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
         case V4L2_CID_USER_ESP_ISP_CCM: {
             const esp_video_isp_ccm_t *ccm = (const esp_video_isp_ccm_t *)ctrl->p_u8;
 
+            if (ccm->enable == isp_video->ccm_enable &&
+                    (!ccm->enable || !esp_video_isp_params_changed(&isp_video->ccm_matrix[0][0], &ccm->matrix[0][0],
+                                                                    ISP_CCM_DIMENSION * ISP_CCM_DIMENSION))) {
+                break;
+            }
+
             isp_video->ccm_enable = ccm->enable;
             if (ccm->enable) {
                 for (int i = 0; i < ISP_CCM_DIMENSION; i++) {
@@ -1226,9 +1611,16 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
             }
             break;
         }
-        case V4L2_CID_RED_BALANCE:
+        case V4L2_CID_RED_BALANCE: {
+            float gain = (float)ctrl->value / V4L2_CID_RED_BALANCE_DEN;
+
+            if ((ctrl->value > 0) == isp_video->red_balance_enable &&
+                    (ctrl->value <= 0 || !esp_video_isp_params_changed(&isp_video->red_balance_gain, &gain, 1))) {
+                break;
+            }
+
             if (ctrl->value > 0) {
-                isp_video->red_balance_gain = (float)ctrl->value / V4L2_CID_RED_BALANCE_DEN;
+                isp_video->red_balance_gain = gain;
                 isp_video->red_balance_enable = true;
             } else {
                 isp_video->red_balance_enable = false;
@@ -1238,9 +1630,17 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
                 ESP_GOTO_ON_ERROR(isp_reconfig_ccm(isp_video), exit, TAG, "failed to reconfigure red balance");
             }
             break;
-        case V4L2_CID_BLUE_BALANCE:
+        }
+        case V4L2_CID_BLUE_BALANCE: {
+            float gain = (float)ctrl->value / V4L2_CID_BLUE_BALANCE_DEN;
+
+            if ((ctrl->value > 0) == isp_video->blue_balance_enable &&
+                    (ctrl->value <= 0 || !esp_video_isp_params_changed(&isp_video->blue_balance_gain, &gain, 1))) {
+                break;
+            }
+
             if (ctrl->value > 0) {
-                isp_video->blue_balance_gain = (float )ctrl->value / V4L2_CID_BLUE_BALANCE_DEN;
+                isp_video->blue_balance_gain = gain;
                 isp_video->blue_balance_enable = true;
             } else {
                 isp_video->blue_balance_enable = false;
@@ -1250,8 +1650,19 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
                 ESP_GOTO_ON_ERROR(isp_reconfig_ccm(isp_video), exit, TAG, "failed to reconfigure blue balance");
             }
             break;
+        }
         case V4L2_CID_USER_ESP_ISP_SHARPEN: {
             const esp_video_isp_sharpen_t *sharpen = (const esp_video_isp_sharpen_t *)ctrl->p_u8;
+            const float coeff[2] = {isp_video->h_coeff, isp_video->m_coeff};
+            const float new_coeff[2] = {sharpen->h_coeff, sharpen->m_coeff};
+
+            if (sharpen->enable == isp_video->sharpen_enable &&
+                    (!sharpen->enable || (sharpen->h_thresh == isp_video->h_thresh &&
+                                          sharpen->l_thresh == isp_video->l_thresh &&
+                                          !esp_video_isp_params_changed(coeff, new_coeff, 2) &&
+                                          !memcmp(sharpen->matrix, isp_video->sharpen_matrix, sizeof(isp_video->sharpen_matrix))))) {
+                break;
+            }
 
             isp_video->sharpen_enable = sharpen->enable;
             if (sharpen->enable) {
@@ -1278,6 +1689,11 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
         case V4L2_CID_USER_ESP_ISP_GAMMA: {
             const esp_video_isp_gamma_t *gamma = (const esp_video_isp_gamma_t *)ctrl->p_u8;
 
+            if (gamma->enable == isp_video->gamma_enable &&
+                    (!gamma->enable || !memcmp(gamma->points, isp_video->gamma_points, sizeof(isp_video->gamma_points)))) {
+                break;
+            }
+
             isp_video->gamma_enable = gamma->enable;
             if (gamma->enable) {
                 for (int i = 0; i < ISP_GAMMA_CURVE_POINTS_NUM; i++) {
@@ -1298,6 +1714,12 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
         case V4L2_CID_USER_ESP_ISP_DEMOSAIC: {
             const esp_video_isp_demosaic_t *demosaic = (const esp_video_isp_demosaic_t *)ctrl->p_u8;
 
+            if (demosaic->enable == isp_video->demosaic_enable &&
+                    (!demosaic->enable ||
+                     !esp_video_isp_params_changed(&isp_video->gradient_ratio, &demosaic->gradient_ratio, 1))) {
+                break;
+            }
+
             isp_video->demosaic_enable = demosaic->enable;
             if (demosaic->enable) {
                 isp_video->gradient_ratio = demosaic->gradient_ratio;
@@ -1314,6 +1736,13 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
         }
         case V4L2_CID_USER_ESP_ISP_WB: {
             esp_video_isp_wb_t *wb = (esp_video_isp_wb_t *)ctrl->p_u8;
+            const float gains[2] = {isp_video->red_balance_gain, isp_video->blue_balance_gain};
+            const float new_gains[2] = {wb->red_gain, wb->blue_gain};
+
+            if (wb->enable == isp_video->red_balance_enable && wb->enable == isp_video->blue_balance_enable &&
+                    (!wb->enable || !esp_video_isp_params_changed(gains, new_gains, 2))) {
+                break;
+            }
 
             isp_video->red_balance_enable = wb->enable;
             isp_video->blue_balance_enable = wb->enable;
@@ -1328,6 +1757,9 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
             break;
         }
         case V4L2_CID_BRIGHTNESS: {
+            if (isp_video->color_config.color_brightness == ctrl->value) {
+                break;
+            }
             isp_video->color_config.color_brightness = ctrl->value;
             if (ISP_STARTED(isp_video)) {
                 ESP_GOTO_ON_ERROR(isp_reconfigure_color(isp_video), exit, TAG, "failed to reconfigure color");
@@ -1335,6 +1767,9 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
             break;
         }
         case V4L2_CID_CONTRAST: {
+            if (isp_video->color_config.color_contrast.val == ctrl->value) {
+                break;
+            }
             isp_video->color_config.color_contrast.val = ctrl->value;
             if (ISP_STARTED(isp_video)) {
                 ESP_GOTO_ON_ERROR(isp_reconfigure_color(isp_video), exit, TAG, "failed to reconfigure color");
@@ -1342,6 +1777,9 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
             break;
         }
         case V4L2_CID_SATURATION: {
+            if (isp_video->color_config.color_saturation.val == ctrl->value) {
+                break;
+            }
             isp_video->color_config.color_saturation.val = ctrl->value;
             if (ISP_STARTED(isp_video)) {
                 ESP_GOTO_ON_ERROR(isp_reconfigure_color(isp_video), exit, TAG, "failed to reconfigure color");
@@ -1349,6 +1787,9 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
             break;
         }
         case V4L2_CID_HUE: {
+            if (isp_video->color_config.color_hue == ctrl->value) {
+                break;
+            }
             isp_video->color_config.color_hue = ctrl->value;
             if (ISP_STARTED(isp_video)) {
                 ESP_GOTO_ON_ERROR(isp_reconfigure_color(isp_video), exit, TAG, "failed to reconfigure color");
@@ -1360,6 +1801,7 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
             const esp_video_isp_lsc_t *lsc = (const esp_video_isp_lsc_t *)ctrl->p_u8;
 
             isp_video->lsc_enable = lsc->enable;
+            isp_video->lsc_user = true;
             if (lsc->enable) {
                 isp_video->lsc_gain_size = lsc->lsc_gain_size;
                 isp_video->lsc_gain_array.gain_r = (isp_lsc_gain_t *)lsc->gain_r;
@@ -1390,6 +1832,7 @@ static esp_err_t isp_video_set_ext_ctrl(struct esp_video *video, const struct v4
     }
 
 exit:
+    ISP_SHADOW_HOLD(isp_video, false);
     ISP_UNLOCK(isp_video);
     return ret;
 }
@@ -1618,6 +2061,95 @@ esp_err_t esp_video_create_isp_video_device(void)
 
     return ESP_OK;
 }
+
+/**
+ * @brief Restart the statistics frame sequence, for a capture stream resumed without restarting ISP
+ *
+ * @param None
+ *
+ * @return None
+ */
+void esp_video_isp_restart_sequence(void)
+{
+    struct isp_video *isp_video = &s_isp_video;
+
+    /* Called before the sensor streams again, no statistics interrupt is pending */
+    ISP_LOCK(isp_video);
+    isp_video->frame_seq = 0;
+    ISP_UNLOCK(isp_video);
+}
+
+/**
+ * @brief Keep ISP blocks and statistics engines off
+ *
+ * @param blocks ESP_VIDEO_ISP_BLOCK_XXX to hold, the others start as configured
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if blocks has an unknown flag
+ *      - Others if restarting the ISP pipeline failed
+ */
+esp_err_t esp_video_isp_hold_blocks(uint32_t blocks)
+{
+    esp_err_t ret = ESP_OK;
+    struct isp_video *isp_video = &s_isp_video;
+
+    ESP_RETURN_ON_FALSE(!(blocks & ~ISP_BLOCKS_ALL), ESP_ERR_INVALID_ARG, TAG, "blocks=%" PRIx32 " is not supported", blocks);
+
+    ISP_LOCK(isp_video);
+
+    if (blocks != isp_video->held_blocks) {
+        /* AWB always runs with the pipeline, it counts the frames */
+        if (isp_video->awb_ctlr) {
+            ESP_GOTO_ON_ERROR(isp_stop_pipeline(isp_video), exit, TAG, "failed to stop ISP pipeline");
+            isp_video->held_blocks = blocks;
+            ESP_GOTO_ON_ERROR(isp_start_pipeline(isp_video), exit, TAG, "failed to start ISP pipeline");
+        } else {
+            isp_video->held_blocks = blocks;
+        }
+    }
+
+exit:
+    ISP_UNLOCK(isp_video);
+    return ret;
+}
+
+/**
+ * @brief Get the ISP blocks and statistics engines kept off
+ *
+ * @param None
+ *
+ * @return ESP_VIDEO_ISP_BLOCK_XXX flags
+ */
+uint32_t esp_video_isp_held_blocks(void)
+{
+    return s_isp_video.held_blocks;
+}
+
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+/**
+ * @brief Get the statistics interrupt and image algorithm load counters
+ *
+ * @param load Counters since boot
+ *
+ * @return None
+ */
+void esp_video_isp_get_load(esp_video_isp_load_t *load)
+{
+    struct isp_video *isp_video = &s_isp_video;
+
+    memset(load, 0, sizeof(*load));
+
+    portENTER_CRITICAL(&isp_video->spinlock);
+    load->irqs = isp_video->irqs;
+    load->irq_us = isp_video->irq_us;
+    portEXIT_CRITICAL(&isp_video->spinlock);
+
+#if CONFIG_ESP_VIDEO_ENABLE_ISP_PIPELINE_CONTROLLER
+    esp_video_isp_pipeline_get_load(&load->ipa_runs, &load->ipa_us);
+#endif
+}
+#endif
 #endif
 
 /**
@@ -1638,8 +2170,9 @@ esp_err_t esp_video_isp_start_by_csi(const esp_video_csi_state_t *state, const s
     isp_color_range_t yuv_range;
     isp_yuv_conv_std_t yuv_std;
     struct isp_video *isp_video = &s_isp_video;
-    uint32_t width = format->fmt.pix.width;
-    uint32_t height = format->fmt.pix.height;
+    /* ISP runs on the whole sensor frame, the crop window only narrows its output */
+    uint32_t width = state->crop.width ? state->in_width : format->fmt.pix.width;
+    uint32_t height = state->crop.height ? state->in_height : format->fmt.pix.height;
 
     if ((format->fmt.pix.quantization == V4L2_QUANTIZATION_DEFAULT) ||
             (format->fmt.pix.quantization == V4L2_QUANTIZATION_FULL_RANGE)) {
@@ -1703,10 +2236,31 @@ esp_err_t esp_video_isp_start_by_csi(const esp_video_csi_state_t *state, const s
         ESP_GOTO_ON_ERROR(esp_isp_register_event_callbacks(isp_video->isp_proc, &cbs, isp_video), fail_1, TAG, "failed to register sharpen callback");
 #endif
 
+#if ESP_VIDEO_ISP_DEVICE_CROP
+        if (state->crop.width) {
+            esp_isp_crop_config_t crop_config = {
+                .window = {
+                    .top_left = {.x = state->crop.left, .y = state->crop.top},
+                    .btm_right = {
+                        .x = state->crop.left + state->crop.width - 1,
+                        .y = state->crop.top + state->crop.height - 1
+                    },
+                },
+            };
+
+            ESP_GOTO_ON_ERROR(esp_isp_crop_configure(isp_video->isp_proc, &crop_config), fail_2, TAG, "failed to configure crop");
+            ESP_GOTO_ON_ERROR(esp_isp_crop_enable(isp_video->isp_proc), fail_2, TAG, "failed to enable crop");
+        }
+#endif
+
         ESP_GOTO_ON_ERROR(esp_isp_enable(isp_video->isp_proc), fail_2, TAG, "failed to enable ISP");
 
 #if CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
-        META_VIDEO_SET_FORMAT(isp_video->video, width, height, V4L2_META_FMT_ESP_ISP_STATS);
+        META_VIDEO_SET_FORMAT(isp_video->video, width, height, ISP_STATS_META_FMT);
+        isp_video->frame_seq = 0;
+#if ESP_VIDEO_ISP_DEVICE_LSC && CONFIG_ESP_VIDEO_ENABLE_CALIB
+        isp_load_calib_lsc(isp_video, width, height);
+#endif
         ESP_GOTO_ON_ERROR(isp_start_pipeline(isp_video), fail_3, TAG, "failed to start ISP pipeline");
 #endif
     }
@@ -1754,6 +2308,12 @@ esp_err_t esp_video_isp_stop(const esp_video_csi_state_t *state)
 
         ESP_GOTO_ON_ERROR(esp_isp_disable(isp_video->isp_proc), exit, TAG, "failed to disable ISP");
 
+#if ESP_VIDEO_ISP_DEVICE_CROP
+        if (state->crop.width) {
+            ESP_GOTO_ON_ERROR(esp_isp_crop_disable(isp_video->isp_proc), exit, TAG, "failed to disable crop");
+        }
+#endif
+
 #if CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
         esp_isp_evt_cbs_t cbs = {0};
         ESP_GOTO_ON_ERROR(esp_isp_register_event_callbacks(isp_video->isp_proc, &cbs, NULL), exit, TAG, "failed to free ISP event");
@@ -0,0 +1,328 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#include "driver/jpeg_decode.h"
+
+#include "esp_video.h"
+#include "esp_video_device_internal.h"
+
+#define JPEG_DEC_NAME                   "JPEG_DEC"
+
+#define JPEG_DEC_DMA_ALIGN_BYTES        64
+#define JPEG_DEC_MEM_CAPS               (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM | MALLOC_CAP_CACHE_ALIGNED)
+
+/* Decoder writes whole MCUs, up to 16x16 pixels for 4:2:0 images */
+#define JPEG_DEC_MCU_SIZE               16
+
+#define JPEG_DEC_TIMEOUT_MS             100
+
+/* Input buffer size if VIDIOC_S_FMT leaves sizeimage 0, in bytes per pixel */
+#define JPEG_DEC_DEF_COMP_RATE          0.75
+
+/* Decoder writes the ISP YUV 4:2:0 layout from chip revision 3.0, like the encoder reads it */
+#if CONFIG_ESP32P4_REV_MIN_FULL >= 300
+#define JPEG_DEC_YUV420_OUTPUT          1
+#endif
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)                   sizeof(x) / sizeof((x)[0])
+#endif
+
+struct jpeg_dec_video {
+    jpeg_decoder_handle_t dec_handle;
+
+    jpeg_decode_cfg_t dec_config;
+    uint8_t out_bpp;
+};
+
+static const char *TAG = "jpeg_dec_video";
+
+static esp_err_t jpeg_dec_get_output_format_from_v4l2(uint32_t v4l2_format, jpeg_decode_cfg_t *dec_config, uint8_t *bpp)
+{
+    esp_err_t ret = ESP_OK;
+
+    switch (v4l2_format) {
+    case V4L2_PIX_FMT_RGB565:
+        /* Little endian pixels, as the LCD frame buffers take them */
+        dec_config->output_format = JPEG_DECODE_OUT_FORMAT_RGB565;
+        dec_config->rgb_order = JPEG_DEC_RGB_ELEMENT_ORDER_BGR;
+        *bpp = 16;
+        break;
+    case V4L2_PIX_FMT_RGB24:
+        dec_config->output_format = JPEG_DECODE_OUT_FORMAT_RGB888;
+        dec_config->rgb_order = JPEG_DEC_RGB_ELEMENT_ORDER_RGB;
+        *bpp = 24;
+        break;
+    case V4L2_PIX_FMT_GREY:
+        dec_config->output_format = JPEG_DECODE_OUT_FORMAT_GRAY;
+        *bpp = 8;
+        break;
+#if JPEG_DEC_YUV420_OUTPUT
+    case V4L2_PIX_FMT_YUV420:
+        dec_config->output_format = JPEG_DECODE_OUT_FORMAT_YUV420;
+        *bpp = 12;
+        break;
+#endif
+    default:
+        ret = ESP_ERR_NOT_SUPPORTED;
+        break;
+    }
+
+    return ret;
+}
+
+static esp_err_t jpeg_dec_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags)
+{
+    esp_err_t ret;
+    jpeg_decode_picture_info_t info;
+    struct jpeg_dec_video *jpeg_dec_video = VIDEO_PRIV_DATA(struct jpeg_dec_video *, video);
+
+    /* Image size is fixed by the formats, another one would overflow or misalign the frame buffer */
+    ret = jpeg_decoder_get_info(src, src_size, &info);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "invalid JPEG image");
+        return ret;
+    }
+
+    if ((info.width != M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video)) ||
+            (info.height != M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video))) {
+        ESP_LOGE(TAG, "image is %" PRIu32 "x%" PRIu32 ", format is %" PRIu32 "x%" PRIu32, info.width, info.height,
+                 M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video), M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video));
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return jpeg_decoder_process(jpeg_dec_video->dec_handle, &jpeg_dec_video->dec_config, src, src_size,
+                                dst, dst_size, dst_out_size);
+}
+
+static esp_err_t jpeg_dec_video_init(struct esp_video *video)
+{
+    esp_err_t ret;
+    struct jpeg_dec_video *jpeg_dec_video = VIDEO_PRIV_DATA(struct jpeg_dec_video *, video);
+    jpeg_decode_engine_cfg_t decode_eng_cfg = {
+        .intr_priority = 0,
+        .timeout_ms = JPEG_DEC_TIMEOUT_MS,
+    };
+
+    ret = jpeg_new_decoder_engine(&decode_eng_cfg, &jpeg_dec_video->dec_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create JPEG decoder");
+        return ret;
+    }
+
+    M2M_VIDEO_SET_CAPTURE_FORMAT(video, 0, 0, 0);
+    M2M_VIDEO_SET_OUTPUT_FORMAT(video, 0, 0, 0);
+
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_dec_video_deinit(struct esp_video *video)
+{
+    esp_err_t ret;
+    struct jpeg_dec_video *jpeg_dec_video = VIDEO_PRIV_DATA(struct jpeg_dec_video *, video);
+
+    ret = jpeg_del_decoder_engine(jpeg_dec_video->dec_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to delete JPEG decoder");
+        return ret;
+    }
+
+    jpeg_dec_video->dec_handle = NULL;
+
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_dec_video_start(struct esp_video *video, uint32_t type)
+{
+    if ((M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video) != M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video)) ||
+            (M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video) != M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video))) {
+        ESP_LOGE(TAG, "width or height is invalid");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+    return esp_video_m2m_async_start(video,
+                                     V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                     V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                     jpeg_dec_video_m2m_process);
+#else
+    return ESP_OK;
+#endif
+}
+
+static esp_err_t jpeg_dec_video_stop(struct esp_video *video, uint32_t type)
+{
+    /* Stopping either stream resets both buffer lists, the task must be idle first */
+    return esp_video_m2m_async_stop(video);
+}
+
+static esp_err_t jpeg_dec_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, uint32_t *pixel_format)
+{
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        static const uint32_t jpeg_dec_capture_format[] = {
+            V4L2_PIX_FMT_RGB565,
+            V4L2_PIX_FMT_RGB24,
+            V4L2_PIX_FMT_GREY,
+#if JPEG_DEC_YUV420_OUTPUT
+            V4L2_PIX_FMT_YUV420,
+#endif
+        };
+
+        if (index >= ARRAY_SIZE(jpeg_dec_capture_format)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        *pixel_format = jpeg_dec_capture_format[index];
+    } else if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        static const uint32_t jpeg_dec_output_format[] = {
+            V4L2_PIX_FMT_JPEG,
+        };
+
+        if (index >= ARRAY_SIZE(jpeg_dec_output_format)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        *pixel_format = jpeg_dec_output_format[index];
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_dec_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    esp_err_t ret;
+    uint32_t buf_size;
+    const struct v4l2_pix_format *pix = &format->fmt.pix;
+    struct jpeg_dec_video *jpeg_dec_video = VIDEO_PRIV_DATA(struct jpeg_dec_video *, video);
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        uint8_t bpp;
+        uint32_t width = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video);
+        uint32_t height = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+
+        /* Lines of the frame are as long as the decoded MCU rows, extra rows only pad the end */
+        if (!pix->width || !pix->height || (pix->width % JPEG_DEC_MCU_SIZE) ||
+                (width && (pix->width != width)) ||
+                (height && (pix->height != height))) {
+            ESP_LOGE(TAG, "width or height is invalid");
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        ret = jpeg_dec_get_output_format_from_v4l2(pix->pixelformat, &jpeg_dec_video->dec_config, &bpp);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "pixel format is invalid");
+            return ret;
+        }
+        jpeg_dec_video->dec_config.conv_std = JPEG_YUV_RGB_CONV_STD_BT601;
+        jpeg_dec_video->out_bpp = bpp;
+
+        buf_size = BUF_ALIGN_SIZE(pix->width * BUF_ALIGN_SIZE(pix->height, JPEG_DEC_MCU_SIZE) * bpp / 8,
+                                  JPEG_DEC_DMA_ALIGN_BYTES);
+
+        ESP_LOGD(TAG, "capture buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_CAPTURE_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+        M2M_VIDEO_SET_CAPTURE_BUF_INFO(video, buf_size, JPEG_DEC_DMA_ALIGN_BYTES, JPEG_DEC_MEM_CAPS);
+    } else if (format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        uint32_t width = M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video);
+        uint32_t height = M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video);
+
+        if ((pix->pixelformat != V4L2_PIX_FMT_JPEG) || !pix->width || !pix->height ||
+                (width && (pix->width != width)) ||
+                (height && (pix->height != height))) {
+            ESP_LOGE(TAG, "pixel format or width or height is invalid");
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        /* Compressed size is up to the image, sizeimage lets the application size the buffers */
+        buf_size = pix->sizeimage;
+        if (!buf_size) {
+            buf_size = (uint32_t)(pix->width * pix->height * JPEG_DEC_DEF_COMP_RATE);
+        }
+        buf_size = BUF_ALIGN_SIZE(buf_size, JPEG_DEC_DMA_ALIGN_BYTES);
+
+        ESP_LOGD(TAG, "output buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_OUTPUT_BUF_INFO(video, buf_size, JPEG_DEC_DMA_ALIGN_BYTES, JPEG_DEC_MEM_CAPS);
+        M2M_VIDEO_SET_OUTPUT_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t jpeg_dec_video_notify(struct esp_video *video, enum esp_video_event event, void *arg)
+{
+    esp_err_t ret;
+
+    if (event == ESP_VIDEO_M2M_TRIGGER) {
+        uint32_t type = *(uint32_t *)arg;
+
+        if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+            ret = esp_video_m2m_process(video,
+                                        V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                        V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                        jpeg_dec_video_m2m_process);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "failed to process M2M device data");
+                return ret;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+static const struct esp_video_ops s_jpeg_dec_video_ops = {
+    .init           = jpeg_dec_video_init,
+    .deinit         = jpeg_dec_video_deinit,
+    .start          = jpeg_dec_video_start,
+    .stop           = jpeg_dec_video_stop,
+    .enum_format    = jpeg_dec_video_enum_format,
+    .set_format     = jpeg_dec_video_set_format,
+    .notify         = jpeg_dec_video_notify,
+};
+
+/**
+ * @brief Create JPEG decoder video device, which decodes JPEG images into RGB, gray or YUV frames
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_create_jpeg_decoder_video_device(void)
+{
+    struct esp_video *video;
+    struct jpeg_dec_video *jpeg_dec_video;
+    uint32_t device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_EXT_PIX_FORMAT | V4L2_CAP_STREAMING;
+    uint32_t caps = device_caps | V4L2_CAP_DEVICE_CAPS;
+
+    jpeg_dec_video = heap_caps_calloc(1, sizeof(struct jpeg_dec_video), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!jpeg_dec_video) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    video = esp_video_create(JPEG_DEC_NAME, ESP_VIDEO_JPEG_DECODER_DEVICE_ID, &s_jpeg_dec_video_ops, jpeg_dec_video,
+                             caps, device_caps);
+    if (!video) {
+        heap_caps_free(jpeg_dec_video);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
@@ -10,6 +10,7 @@
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_attr.h"
+#include "esp_cache.h"
 
 #include "driver/jpeg_encode.h"
 
@@ -30,6 +31,27 @@
 #define JPEG_VIDEO_CHROMA_SUBSAMPLING   JPEG_DOWN_SAMPLING_YUV422
 #define JPEG_VIDEO_COMP_QUALITY         80
 
+#define JPEG_VIDEO_MAX_RESTART_INTERVAL UINT16_MAX
+
+#define JPEG_MARKER_SOF0                0xc0
+#define JPEG_MARKER_RST0                0xd0
+#define JPEG_MARKER_EOI                 0xd9
+#define JPEG_MARKER_SOS                 0xda
+#define JPEG_MARKER_DRI                 0xdd
+#define JPEG_DRI_SIZE                   6
+
+#define JPEG_VIDEO_MAX_TIMEOUT_MS       1000
+
+#define JPEG_RC_AVG_WEIGHT              4       /* Frames the average encoded size roughly spans */
+#define JPEG_RC_SPIKE_STEP              8       /* Quality dropped at once for a frame 1.5 times the target */
+#define JPEG_RC_MAX_STEP                4
+#define JPEG_VIDEO_TIMEOUT_PIXELS       (1280 * 720)    /* Frame size CONFIG_ESP_VIDEO_JPEG_ENCODER_TIMEOUT_MS is given for */
+
+/* Encoder reads the ISP YUV 4:2:0 layout from chip revision 3.0, e.g. to share camera frames with H.264 */
+#if CONFIG_ESP32P4_REV_MIN_FULL >= 300
+#define JPEG_VIDEO_YUV420_INPUT         1
+#endif
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(x)                   sizeof(x) / sizeof((x)[0])
 #endif
@@ -40,7 +62,22 @@ struct jpeg_video {
 
     jpeg_enc_input_format_t src_type;
     jpeg_down_sampling_type_t sub_sample;
+    uint8_t src_bpp;
     uint8_t image_quality;
+    uint16_t restart_interval;      /* MCUs between restart markers, 0 encodes the frame in one pass */
+    uint16_t timeout_ms;            /* V4L2_CID_JPEG_ESP_ENCODE_TIMEOUT, 0 scales the Kconfig timeout */
+    uint16_t engine_timeout_ms;     /* Timeout the encoder engine was created with */
+
+    /* Header layout of an encoded band, the same for every band while the settings are unchanged */
+    uint32_t header_data_offset;    /* Entropy-coded data offset, 0 if not parsed yet */
+    uint32_t header_sof_offset;
+    uint32_t header_sos_offset;
+
+    /* Frame size control */
+    uint32_t rc_target_size;        /* Bytes per frame, 0 if disabled */
+    uint32_t rc_avg_size;           /* 0 until the first frame is encoded */
+    uint8_t rc_min_quality;
+    uint8_t rc_max_quality;
 };
 
 static const char *TAG = "jpeg_video";
@@ -70,6 +107,13 @@ static esp_err_t jpeg_get_input_format_from_v4l2(uint32_t v4l2_format, jpeg_enc_
         *src_bpp = 8;
         *sub_sample = JPEG_DOWN_SAMPLING_GRAY;
         break;
+#if JPEG_VIDEO_YUV420_INPUT
+    case V4L2_PIX_FMT_YUV420:
+        *src_type = JPEG_ENCODE_IN_FORMAT_YUV420;
+        *src_bpp = 12;
+        *sub_sample = JPEG_DOWN_SAMPLING_YUV420;
+        break;
+#endif
     default:
         ret = ESP_ERR_NOT_SUPPORTED;
         break;
@@ -83,7 +127,187 @@ static uint32_t jpeg_capture_size(uint32_t output_size)
     return BUF_ALIGN_SIZE((uint32_t)(output_size * JPEG_MAX_COMP_RATE), JPEG_DMA_ALIGN_BYTES);
 }
 
-static esp_err_t jpeg_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size)
+/* Find SOF0 and SOS of an encoded image, returns the offset of the entropy-coded data */
+static uint32_t jpeg_parse_header(const uint8_t *buf, uint32_t size, uint32_t *sof_offset, uint32_t *sos_offset)
+{
+    uint32_t pos = 2;
+
+    *sof_offset = 0;
+    while (pos + 4 <= size && buf[pos] == 0xff) {
+        uint8_t marker = buf[pos + 1];
+        uint32_t len = (buf[pos + 2] << 8) | buf[pos + 3];
+
+        if (marker == JPEG_MARKER_SOF0) {
+            *sof_offset = pos;
+        } else if (marker == JPEG_MARKER_SOS) {
+            *sos_offset = pos;
+            return *sof_offset && pos + 2 + len < size ? pos + 2 + len : 0;
+        }
+        pos += 2 + len;
+    }
+
+    return 0;
+}
+
+/*
+ * Encode the frame as bands of whole MCU rows, one hardware pass each, and join them
+ * into one JPEG. Every band restarts the DC prediction like a restart interval does, so
+ * the bands' scan data separated by RSTn markers form a valid scan with DRI set to the
+ * MCUs per band. A corrupted transfer then only damages one band of the image.
+ */
+static esp_err_t jpeg_video_encode_strips(struct esp_video *video, jpeg_encode_cfg_t *enc_config,
+                                          const uint8_t *src, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size)
+{
+    esp_err_t ret;
+    size_t align = 0;
+    uint32_t pos = 0;
+    uint32_t mcu_width = 16;
+    uint32_t mcu_height = 8;
+    struct jpeg_video *jpeg_video = VIDEO_PRIV_DATA(struct jpeg_video *, video);
+    uint32_t height = enc_config->height;
+    uint32_t line_size = enc_config->width * jpeg_video->src_bpp / 8;
+
+    if (jpeg_video->sub_sample == JPEG_DOWN_SAMPLING_YUV420) {
+        mcu_height = 16;
+    } else if (jpeg_video->sub_sample == JPEG_DOWN_SAMPLING_YUV444 || jpeg_video->sub_sample == JPEG_DOWN_SAMPLING_GRAY) {
+        mcu_width = 8;
+    }
+
+    uint32_t mcu_cols = (enc_config->width + mcu_width - 1) / mcu_width;
+    uint32_t band_rows = MAX(jpeg_video->restart_interval / mcu_cols, 1);
+    uint32_t band_lines = band_rows * mcu_height;
+    uint32_t interval = band_rows * mcu_cols;
+
+    if (interval > JPEG_VIDEO_MAX_RESTART_INTERVAL) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* Each band lands on its own cache lines, so invalidating it keeps the joined data before it */
+    esp_cache_get_alignment(JPEG_MEM_CAPS, &align);
+    align = MAX(align, JPEG_DMA_ALIGN_BYTES);
+
+    for (uint32_t line = 0, band = 0; line < height; line += band_lines, band++) {
+        uint32_t size;
+        uint32_t offset;
+        uint32_t data_offset;
+        uint32_t sof_offset;
+        uint32_t sos_offset;
+
+        if (band) {
+            dst[pos++] = 0xff;
+            dst[pos++] = JPEG_MARKER_RST0 + ((band - 1) & 7);
+        }
+
+        offset = BUF_ALIGN_SIZE(pos, align);
+        if (offset >= dst_size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        enc_config->height = MIN(band_lines, height - line);
+        ret = jpeg_encoder_process(jpeg_video->enc_handle, enc_config, src + line * line_size,
+                                   enc_config->height * line_size, dst + offset, dst_size - offset, &size);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        /* The driver writes the same header for the same quality, sampling and width, only the height differs */
+        data_offset = jpeg_video->header_data_offset;
+        if (!data_offset) {
+            data_offset = jpeg_parse_header(dst + offset, size, &jpeg_video->header_sof_offset,
+                                            &jpeg_video->header_sos_offset);
+            jpeg_video->header_data_offset = data_offset;
+        }
+        sof_offset = jpeg_video->header_sof_offset;
+        sos_offset = jpeg_video->header_sos_offset;
+        if (!data_offset || size <= data_offset + 2 ||
+                dst[offset + size - 2] != 0xff || dst[offset + size - 1] != JPEG_MARKER_EOI) {
+            ESP_LOGE(TAG, "unexpected JPEG band layout");
+            jpeg_video->header_data_offset = 0;
+            return ESP_FAIL;
+        }
+        size -= 2;
+
+        if (!band) {
+            if (size + JPEG_DRI_SIZE + 2 > dst_size) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+
+            /* First band keeps the headers, with the full image height and DRI before SOS */
+            dst[sof_offset + 5] = height >> 8;
+            dst[sof_offset + 6] = height & 0xff;
+            memmove(dst + sos_offset + JPEG_DRI_SIZE, dst + sos_offset, size - sos_offset);
+            dst[sos_offset + 0] = 0xff;
+            dst[sos_offset + 1] = JPEG_MARKER_DRI;
+            dst[sos_offset + 2] = 0;
+            dst[sos_offset + 3] = 4;
+            dst[sos_offset + 4] = interval >> 8;
+            dst[sos_offset + 5] = interval & 0xff;
+            pos = size + JPEG_DRI_SIZE;
+        } else {
+            memmove(dst + pos, dst + offset + data_offset, size - data_offset);
+            pos += size - data_offset;
+        }
+    }
+
+    if (pos + 2 > dst_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    dst[pos++] = 0xff;
+    dst[pos++] = JPEG_MARKER_EOI;
+
+    /* Joined image was written by CPU, later readers may invalidate or use DMA */
+    ret = esp_cache_msync(dst, BUF_ALIGN_SIZE(pos, align), ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    *dst_out_size = pos;
+
+    return ESP_OK;
+}
+
+static void jpeg_video_set_quality(struct jpeg_video *jpeg_video, uint8_t quality)
+{
+    if (jpeg_video->image_quality != quality) {
+        jpeg_video->image_quality = quality;
+        jpeg_video->header_data_offset = 0;
+    }
+}
+
+/*
+ * Move the quality of the next frame toward the target size. The average of recent
+ * frames is followed in steps proportional to its error, lowering faster than raising,
+ * and a single frame far above the target drops the quality at once before the
+ * average catches up, so a scene change doesn't overflow the bandwidth for long.
+ */
+static void jpeg_video_rate_control(struct jpeg_video *jpeg_video, uint32_t size)
+{
+    uint32_t target = jpeg_video->rc_target_size;
+    int quality = jpeg_video->image_quality;
+
+    if (!target) {
+        return;
+    }
+
+    if (!jpeg_video->rc_avg_size) {
+        jpeg_video->rc_avg_size = size;
+    } else {
+        jpeg_video->rc_avg_size = (jpeg_video->rc_avg_size * (JPEG_RC_AVG_WEIGHT - 1) + size) / JPEG_RC_AVG_WEIGHT;
+    }
+
+    if (size > target + target / 2) {
+        quality -= JPEG_RC_SPIKE_STEP;
+    } else if (jpeg_video->rc_avg_size > target + target / 16) {
+        quality -= MIN(MAX((uint64_t)(jpeg_video->rc_avg_size - target) * 16 / target, 1), JPEG_RC_MAX_STEP);
+    } else if (jpeg_video->rc_avg_size < target - target / 8) {
+        quality++;
+    }
+
+    quality = MAX(MIN(quality, jpeg_video->rc_max_quality), jpeg_video->rc_min_quality);
+    jpeg_video_set_quality(jpeg_video, quality);
+}
+
+static esp_err_t jpeg_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags)
 {
     esp_err_t ret;
     uint32_t jpeg_codeced_size;
@@ -96,34 +320,86 @@ static esp_err_t jpeg_video_m2m_process(struct esp_video *video, uint8_t *src, u
         .height = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video),
     };
 
-    ret = jpeg_encoder_process(jpeg_video->enc_handle,
-                               &enc_config,
-                               src,
-                               src_size,
-                               dst,
-                               dst_size,
-                               &jpeg_codeced_size);
+    if (jpeg_video->restart_interval) {
+        ret = jpeg_video_encode_strips(video, &enc_config, src, dst, dst_size, &jpeg_codeced_size);
+    } else {
+        ret = jpeg_encoder_process(jpeg_video->enc_handle,
+                                   &enc_config,
+                                   src,
+                                   src_size,
+                                   dst,
+                                   dst_size,
+                                   &jpeg_codeced_size);
+    }
     if (ret == ESP_OK) {
         *dst_out_size = jpeg_codeced_size;
+        /* Every JPEG frame is intra coded */
+        *dst_flags = V4L2_BUF_FLAG_KEYFRAME;
+        jpeg_video_rate_control(jpeg_video, jpeg_codeced_size);
+    } else if (ret == ESP_ERR_INVALID_SIZE) {
+        /* Didn't fit the capture buffer, which is the least the frame would have taken */
+        jpeg_video_rate_control(jpeg_video, dst_size);
     }
 
     return ret;
 }
 
+/* Timeout of one frame, the Kconfig one scaled for frames larger than it is given for */
+static uint32_t jpeg_video_frame_timeout(struct esp_video *video)
+{
+    struct jpeg_video *jpeg_video = VIDEO_PRIV_DATA(struct jpeg_video *, video);
+    uint64_t pixels = (uint64_t)M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video) * M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+    uint64_t timeout_ms = CONFIG_ESP_VIDEO_JPEG_ENCODER_TIMEOUT_MS;
+
+    if (jpeg_video->timeout_ms) {
+        return jpeg_video->timeout_ms;
+    }
+
+    if (pixels > JPEG_VIDEO_TIMEOUT_PIXELS) {
+        timeout_ms = (timeout_ms * pixels + JPEG_VIDEO_TIMEOUT_PIXELS - 1) / JPEG_VIDEO_TIMEOUT_PIXELS;
+    }
+
+    return MIN(timeout_ms, JPEG_VIDEO_MAX_TIMEOUT_MS);
+}
+
+/* The driver takes the timeout only when creating the engine, so a new one replaces the old one */
+static esp_err_t jpeg_video_new_engine(struct jpeg_video *jpeg_video, uint32_t timeout_ms)
+{
+    esp_err_t ret;
+    jpeg_encode_engine_cfg_t encode_eng_cfg = {
+        .intr_priority = CONFIG_ESP_VIDEO_JPEG_ENCODER_INTR_PRIORITY,
+        .timeout_ms = timeout_ms,
+    };
+
+    if (jpeg_video->enc_handle) {
+        ret = jpeg_del_encoder_engine(jpeg_video->enc_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to delete JPEG encoder");
+            return ret;
+        }
+        jpeg_video->enc_handle = NULL;
+    }
+
+    ret = jpeg_new_encoder_engine(&encode_eng_cfg, &jpeg_video->enc_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create JPEG encoder");
+        return ret;
+    }
+    jpeg_video->engine_timeout_ms = timeout_ms;
+
+    ESP_LOGD(TAG, "encoder timeout=%" PRIu32 "ms", timeout_ms);
+
+    return ESP_OK;
+}
+
 static esp_err_t jpeg_video_init(struct esp_video *video)
 {
     esp_err_t ret;
     struct jpeg_video *jpeg_video = VIDEO_PRIV_DATA(struct jpeg_video *, video);
 
     if (!jpeg_video->jpeg_inited) {
-        jpeg_encode_engine_cfg_t encode_eng_cfg = {
-            .intr_priority = 0,
-            .timeout_ms = 40,
-        };
-
-        ret = jpeg_new_encoder_engine(&encode_eng_cfg, &jpeg_video->enc_handle);
+        ret = jpeg_video_new_engine(jpeg_video, CONFIG_ESP_VIDEO_JPEG_ENCODER_TIMEOUT_MS);
         if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "failed to create JPEG encoder");
             return ret;
         }
     }
@@ -139,7 +415,7 @@ static esp_err_t jpeg_video_deinit(struct esp_video *video)
     esp_err_t ret;
     struct jpeg_video *jpeg_video = VIDEO_PRIV_DATA(struct jpeg_video *, video);
 
-    if (!jpeg_video->jpeg_inited) {
+    if (!jpeg_video->jpeg_inited && jpeg_video->enc_handle) {
         ret = jpeg_del_encoder_engine(jpeg_video->enc_handle);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "failed to delete JPEG encoder");
@@ -154,17 +430,58 @@ static esp_err_t jpeg_video_deinit(struct esp_video *video)
 
 static esp_err_t jpeg_video_start(struct esp_video *video, uint32_t type)
 {
+    struct jpeg_video *jpeg_video = VIDEO_PRIV_DATA(struct jpeg_video *, video);
+
     if ((M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video) != M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video)) ||
             (M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video) != M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video))) {
         ESP_LOGE(TAG, "width or height is invalid");
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* The first stream to start applies the timeout, before anything is encoded */
+    if (!jpeg_video->jpeg_inited) {
+        uint32_t timeout_ms = video->m2m_async ? jpeg_video->engine_timeout_ms : jpeg_video_frame_timeout(video);
+
+        /* Released at the last STREAMOFF */
+        if (!jpeg_video->enc_handle || timeout_ms != jpeg_video->engine_timeout_ms) {
+            esp_err_t ret = jpeg_video_new_engine(jpeg_video, timeout_ms);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+    return esp_video_m2m_async_start(video,
+                                     V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                     V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                     jpeg_video_m2m_process);
+#else
     return ESP_OK;
+#endif
 }
 
 static esp_err_t jpeg_video_stop(struct esp_video *video, uint32_t type)
 {
+    esp_err_t ret;
+    struct jpeg_video *jpeg_video = VIDEO_PRIV_DATA(struct jpeg_video *, video);
+
+    /* Stopping either stream resets both buffer lists, the task must be idle first */
+    ret = esp_video_m2m_async_stop(video);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* An idle engine keeps the JPEG module clocked, the next start creates a new one like H.264 does */
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE && !jpeg_video->jpeg_inited && jpeg_video->enc_handle) {
+        ret = jpeg_del_encoder_engine(jpeg_video->enc_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to delete JPEG encoder");
+            return ret;
+        }
+        jpeg_video->enc_handle = NULL;
+    }
+
     return ESP_OK;
 }
 
@@ -186,6 +503,9 @@ static esp_err_t jpeg_video_enum_format(struct esp_video *video, uint32_t type,
             V4L2_PIX_FMT_RGB24,
             V4L2_PIX_FMT_YUV422P,
             V4L2_PIX_FMT_GREY,
+#if JPEG_VIDEO_YUV420_INPUT
+            V4L2_PIX_FMT_YUV420,
+#endif
         };
 
         if (index >= ARRAY_SIZE(jpeg_output_format)) {
@@ -243,6 +563,8 @@ static esp_err_t jpeg_video_set_format(struct esp_video *video, const struct v4l
             ESP_LOGE(TAG, "pixel format is invalid");
             return ret;
         }
+        jpeg_video->src_bpp = input_bpp;
+        jpeg_video->header_data_offset = 0;
 
         uint32_t buf_size = pix->width * pix->height * input_bpp / 8;
 
@@ -289,10 +611,41 @@ static esp_err_t jpeg_video_set_ext_ctrl(struct esp_video *video, const struct v
 
         switch (ctrl->id) {
         case V4L2_CID_JPEG_CHROMA_SUBSAMPLING:
-            jpeg_video->sub_sample = ctrl->value;
+            if (jpeg_video->sub_sample != ctrl->value) {
+                jpeg_video->sub_sample = ctrl->value;
+                jpeg_video->header_data_offset = 0;
+            }
             break;
         case V4L2_CID_JPEG_COMPRESSION_QUALITY:
-            jpeg_video->image_quality = ctrl->value;
+            /* With frame size control, the quality the next frame starts from */
+            jpeg_video_set_quality(jpeg_video, ctrl->value);
+            break;
+        case V4L2_CID_JPEG_RESTART_INTERVAL:
+            /* Rounded down to whole MCU rows when encoding, at least one row */
+            jpeg_video->restart_interval = MIN(ctrl->value, JPEG_VIDEO_MAX_RESTART_INTERVAL);
+            break;
+        case V4L2_CID_JPEG_ESP_ENCODE_TIMEOUT:
+            /* Takes effect when the streams start next time */
+            jpeg_video->timeout_ms = MIN(ctrl->value, JPEG_VIDEO_MAX_TIMEOUT_MS);
+            break;
+        case V4L2_CID_JPEG_ESP_TARGET_SIZE:
+            jpeg_video->rc_target_size = ctrl->value;
+            jpeg_video->rc_avg_size = 0;
+            break;
+        case V4L2_CID_JPEG_ESP_MIN_QUALITY:
+            /* The minimum wins if the bounds cross */
+            if (ctrl->value < JPEG_VIDEO_MIN_COMP_QUALITY || ctrl->value > JPEG_VIDEO_MAX_COMP_QUALITY) {
+                ret = ESP_ERR_INVALID_ARG;
+                break;
+            }
+            jpeg_video->rc_min_quality = ctrl->value;
+            break;
+        case V4L2_CID_JPEG_ESP_MAX_QUALITY:
+            if (ctrl->value < JPEG_VIDEO_MIN_COMP_QUALITY || ctrl->value > JPEG_VIDEO_MAX_COMP_QUALITY) {
+                ret = ESP_ERR_INVALID_ARG;
+                break;
+            }
+            jpeg_video->rc_max_quality = ctrl->value;
             break;
         default:
             ret = ESP_ERR_NOT_SUPPORTED;
@@ -319,6 +672,21 @@ static esp_err_t jpeg_video_get_ext_ctrl(struct esp_video *video, struct v4l2_ex
         case V4L2_CID_JPEG_COMPRESSION_QUALITY:
             ctrl->value = jpeg_video->image_quality;
             break;
+        case V4L2_CID_JPEG_RESTART_INTERVAL:
+            ctrl->value = jpeg_video->restart_interval;
+            break;
+        case V4L2_CID_JPEG_ESP_ENCODE_TIMEOUT:
+            ctrl->value = jpeg_video->timeout_ms;
+            break;
+        case V4L2_CID_JPEG_ESP_TARGET_SIZE:
+            ctrl->value = jpeg_video->rc_target_size;
+            break;
+        case V4L2_CID_JPEG_ESP_MIN_QUALITY:
+            ctrl->value = jpeg_video->rc_min_quality;
+            break;
+        case V4L2_CID_JPEG_ESP_MAX_QUALITY:
+            ctrl->value = jpeg_video->rc_max_quality;
+            break;
         default:
             ret = ESP_ERR_NOT_SUPPORTED;
             ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", ctrl->id);
@@ -351,6 +719,44 @@ static esp_err_t jpeg_video_query_ext_ctrl(struct esp_video *video, struct v4l2_
         qctrl->nr_of_dims = 0;
         qctrl->default_value = JPEG_VIDEO_COMP_QUALITY;
         break;
+    case V4L2_CID_JPEG_RESTART_INTERVAL:
+        qctrl->type = V4L2_CTRL_TYPE_INTEGER;
+        qctrl->maximum = JPEG_VIDEO_MAX_RESTART_INTERVAL;
+        qctrl->minimum = 0;
+        qctrl->step = 1;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = 0;
+        break;
+    case V4L2_CID_JPEG_ESP_ENCODE_TIMEOUT:
+        qctrl->type = V4L2_CTRL_TYPE_INTEGER;
+        qctrl->maximum = JPEG_VIDEO_MAX_TIMEOUT_MS;
+        qctrl->minimum = 0;
+        qctrl->step = 1;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = 0;
+        break;
+    case V4L2_CID_JPEG_ESP_TARGET_SIZE:
+        qctrl->type = V4L2_CTRL_TYPE_INTEGER;
+        qctrl->maximum = INT32_MAX;
+        qctrl->minimum = 0;
+        qctrl->step = 1;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = 0;
+        break;
+    case V4L2_CID_JPEG_ESP_MIN_QUALITY:
+    case V4L2_CID_JPEG_ESP_MAX_QUALITY:
+        qctrl->type = V4L2_CTRL_TYPE_INTEGER;
+        qctrl->maximum = JPEG_VIDEO_MAX_COMP_QUALITY;
+        qctrl->minimum = JPEG_VIDEO_MIN_COMP_QUALITY;
+        qctrl->step = JPEG_VIDEO_COMP_QUALITY_STEP;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = qctrl->id == V4L2_CID_JPEG_ESP_MIN_QUALITY ? JPEG_VIDEO_MIN_COMP_QUALITY :
+                               JPEG_VIDEO_MAX_COMP_QUALITY;
+        break;
     default:
         ret = ESP_ERR_NOT_SUPPORTED;
         ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", qctrl->id);
@@ -402,6 +808,8 @@ esp_err_t esp_video_create_jpeg_video_device(jpeg_encoder_handle_t enc_handle)
     }
     jpeg_video->sub_sample = JPEG_VIDEO_CHROMA_SUBSAMPLING;
     jpeg_video->image_quality = JPEG_VIDEO_COMP_QUALITY;
+    jpeg_video->rc_min_quality = JPEG_VIDEO_MIN_COMP_QUALITY;
+    jpeg_video->rc_max_quality = JPEG_VIDEO_MAX_COMP_QUALITY;
 
     video = esp_video_create(JPEG_NAME, ESP_VIDEO_JPEG_DEVICE_ID, &s_jpeg_video_ops, jpeg_video, caps, device_caps);
     if (!video) {
@@ -0,0 +1,435 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_cache.h"
+#include "memstat.h"
+
+#include "esp_video.h"
+#include "esp_video_device_internal.h"
+#include "esp_video_calib.h"
+
+#define LDC_NAME                        "LDC"
+
+#define LDC_BUF_ALIGN_BYTES             64
+#define LDC_MEM_CAPS                    (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM | MALLOC_CAP_CACHE_ALIGNED)
+#define LDC_TILE_MEM_CAPS               (MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL)
+#define LDC_TILE_SIZE                   CONFIG_ESP_VIDEO_LDC_TILE_BUFFER_SIZE
+
+#define LDC_CELL_SIZE_MIN               8
+#define LDC_CELL_SIZE_MAX               128
+
+/* Mesh points are in 1/16 pixels, positions are stepped in 16.16 */
+#define LDC_POINT_TO_FIXED(p)           ((int32_t)(p) * 4096)
+#define LDC_FIXED_HALF                  0x8000
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)                   sizeof(x) / sizeof((x)[0])
+#endif
+
+/**
+ * @brief Source block a mesh cell samples, inclusive and inside the frame.
+ */
+typedef struct ldc_block {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    bool clamp;                         /*!< Some positions of the cell are outside the frame */
+} ldc_block_t;
+
+struct ldc_video {
+    const esp_video_calib_mesh_t *mesh; /*!< In the mapped calibration partition, picked at stream start */
+    uint32_t cell_shift;
+    uint32_t bpp;
+    uint32_t frame_size;
+    uint8_t *tile;                      /*!< Source block of the cell being corrected, internal RAM */
+};
+
+static const char *TAG = "ldc_video";
+
+static const uint32_t s_ldc_format[] = {
+    V4L2_PIX_FMT_RGB565,
+    V4L2_PIX_FMT_RGB24,
+    V4L2_PIX_FMT_GREY,
+};
+
+static uint32_t ldc_bytes_per_pixel(uint32_t v4l2_format)
+{
+    switch (v4l2_format) {
+    case V4L2_PIX_FMT_RGB565:
+        return 2;
+    case V4L2_PIX_FMT_RGB24:
+        return 3;
+    case V4L2_PIX_FMT_GREY:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void ldc_cell_block(const esp_video_calib_mesh_t *mesh, uint32_t col, uint32_t row,
+                           uint32_t width, uint32_t height, ldc_block_t *block)
+{
+    const int16_t (*p)[2] = &mesh->point[row * (mesh->cols + 1) + col];
+    const int16_t (*q)[2] = p + mesh->cols + 1;
+    int min_x = MIN(MIN(p[0][0], p[1][0]), MIN(q[0][0], q[1][0])) >> 4;
+    int max_x = (MAX(MAX(p[0][0], p[1][0]), MAX(q[0][0], q[1][0])) + 15) >> 4;
+    int min_y = MIN(MIN(p[0][1], p[1][1]), MIN(q[0][1], q[1][1])) >> 4;
+    int max_y = (MAX(MAX(p[0][1], p[1][1]), MAX(q[0][1], q[1][1])) + 15) >> 4;
+
+    /* Positions inside the cell are blends of the corners, so they stay in their bounding box */
+    block->clamp = (min_x < 0) || (min_y < 0) || (max_x >= (int)width) || (max_y >= (int)height);
+    block->x0 = MAX(MIN(min_x, (int)width - 1), 0);
+    block->y0 = MAX(MIN(min_y, (int)height - 1), 0);
+    block->x1 = MAX(MIN(max_x, (int)width - 1), block->x0);
+    block->y1 = MAX(MIN(max_y, (int)height - 1), block->y0);
+}
+
+/* Nearest source pixel of each output pixel of one cell line, positions relative to the block */
+static void ldc_remap_line(const struct ldc_video *ldc_video, const ldc_block_t *block, uint8_t *out, uint32_t n,
+                           int32_t x, int32_t y, int32_t dx, int32_t dy)
+{
+    const uint8_t *tile = ldc_video->tile;
+    uint32_t bpp = ldc_video->bpp;
+    int bw = block->x1 - block->x0 + 1;
+    int bh = block->y1 - block->y0 + 1;
+
+    if (block->clamp) {
+        /* Frame edge cells only, outside positions repeat the edge pixels */
+        for (uint32_t i = 0; i < n; i++, x += dx, y += dy) {
+            int sx = MAX(MIN(x >> 16, bw - 1), 0);
+            int sy = MAX(MIN(y >> 16, bh - 1), 0);
+
+            memcpy(out + i * bpp, tile + (sy * bw + sx) * bpp, bpp);
+        }
+        return;
+    }
+
+    if (bpp == 2) {
+        const uint16_t *src = (const uint16_t *)tile;
+        uint16_t *dst = (uint16_t *)out;
+
+        for (uint32_t i = 0; i < n; i++, x += dx, y += dy) {
+            dst[i] = src[(y >> 16) * bw + (x >> 16)];
+        }
+    } else if (bpp == 3) {
+        for (uint32_t i = 0; i < n; i++, x += dx, y += dy) {
+            const uint8_t *s = tile + ((y >> 16) * bw + (x >> 16)) * 3;
+
+            out[i * 3] = s[0];
+            out[i * 3 + 1] = s[1];
+            out[i * 3 + 2] = s[2];
+        }
+    } else {
+        for (uint32_t i = 0; i < n; i++, x += dx, y += dy) {
+            out[i] = tile[(y >> 16) * bw + (x >> 16)];
+        }
+    }
+}
+
+/**
+ * Correct one mesh cell. The source block the cell samples is fetched into
+ * internal RAM in whole lines first, so the scattered reads never reach PSRAM,
+ * and the cell is written out line by line.
+ */
+static void ldc_remap_cell(const struct ldc_video *ldc_video, const uint8_t *src, uint8_t *dst,
+                           uint32_t width, uint32_t height, uint32_t col, uint32_t row)
+{
+    ldc_block_t block;
+    const esp_video_calib_mesh_t *mesh = ldc_video->mesh;
+    uint32_t shift = ldc_video->cell_shift;
+    uint32_t bpp = ldc_video->bpp;
+    uint32_t ox = col << shift;
+    uint32_t oy = row << shift;
+    uint32_t cw = MIN(1U << shift, width - ox);
+    uint32_t ch = MIN(1U << shift, height - oy);
+    const int16_t (*p)[2] = &mesh->point[row * (mesh->cols + 1) + col];
+    const int16_t (*q)[2] = p + mesh->cols + 1;
+    uint32_t line;
+
+    ldc_cell_block(mesh, col, row, width, height, &block);
+
+    line = (block.x1 - block.x0 + 1) * bpp;
+    for (int y = block.y0; y <= block.y1; y++) {
+        memcpy(ldc_video->tile + (y - block.y0) * line, src + (y * width + block.x0) * bpp, line);
+    }
+
+    /* Left and right cell edges, stepped down the cell, rounded to the nearest pixel */
+    int32_t lx = LDC_POINT_TO_FIXED(p[0][0]) - (block.x0 << 16) + LDC_FIXED_HALF;
+    int32_t ly = LDC_POINT_TO_FIXED(p[0][1]) - (block.y0 << 16) + LDC_FIXED_HALF;
+    int32_t rx = LDC_POINT_TO_FIXED(p[1][0]) - (block.x0 << 16) + LDC_FIXED_HALF;
+    int32_t ry = LDC_POINT_TO_FIXED(p[1][1]) - (block.y0 << 16) + LDC_FIXED_HALF;
+    int32_t dlx = LDC_POINT_TO_FIXED(q[0][0] - p[0][0]) >> shift;
+    int32_t dly = LDC_POINT_TO_FIXED(q[0][1] - p[0][1]) >> shift;
+    int32_t drx = LDC_POINT_TO_FIXED(q[1][0] - p[1][0]) >> shift;
+    int32_t dry = LDC_POINT_TO_FIXED(q[1][1] - p[1][1]) >> shift;
+
+    for (uint32_t j = 0; j < ch; j++) {
+        ldc_remap_line(ldc_video, &block, dst + ((oy + j) * width + ox) * bpp, cw,
+                       lx, ly, (rx - lx) >> shift, (ry - ly) >> shift);
+        lx += dlx;
+        ly += dly;
+        rx += drx;
+        ry += dry;
+    }
+}
+
+static esp_err_t ldc_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags)
+{
+    struct ldc_video *ldc_video = VIDEO_PRIV_DATA(struct ldc_video *, video);
+    uint32_t width = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video);
+    uint32_t height = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+
+    if ((src_size < ldc_video->frame_size) || (dst_size < ldc_video->frame_size)) {
+        ESP_LOGE(TAG, "buffer is too small");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* The mesh may have cells past the frame edges, only the cells on the frame are corrected */
+    for (uint32_t row = 0; (row << ldc_video->cell_shift) < height; row++) {
+        for (uint32_t col = 0; (col << ldc_video->cell_shift) < width; col++) {
+            ldc_remap_cell(ldc_video, src, dst, width, height, col, row);
+        }
+    }
+
+    /* The next device, e.g. an encoder, reads the frame by DMA */
+    esp_cache_msync(dst, BUF_ALIGN_SIZE(ldc_video->frame_size, LDC_BUF_ALIGN_BYTES), ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+    *dst_out_size = ldc_video->frame_size;
+
+    return ESP_OK;
+}
+
+static esp_err_t ldc_video_init(struct esp_video *video)
+{
+    M2M_VIDEO_SET_CAPTURE_FORMAT(video, 0, 0, 0);
+    M2M_VIDEO_SET_OUTPUT_FORMAT(video, 0, 0, 0);
+
+    return ESP_OK;
+}
+
+static esp_err_t ldc_video_deinit(struct esp_video *video)
+{
+    struct ldc_video *ldc_video = VIDEO_PRIV_DATA(struct ldc_video *, video);
+
+    memstat_free(MEMSTAT_VIDEO_DEV, ldc_video->tile);
+    ldc_video->tile = NULL;
+
+    return ESP_OK;
+}
+
+static esp_err_t ldc_check_mesh(struct ldc_video *ldc_video, const esp_video_calib_mesh_t *mesh, size_t size,
+                                uint32_t width, uint32_t height)
+{
+    ldc_block_t block;
+    uint32_t shift;
+    uint32_t block_max = 0;
+
+    if ((mesh->cell_size < LDC_CELL_SIZE_MIN) || (mesh->cell_size > LDC_CELL_SIZE_MAX) ||
+            (mesh->cell_size & (mesh->cell_size - 1))) {
+        ESP_LOGE(TAG, "mesh cell size %u is invalid", mesh->cell_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    shift = __builtin_ctz(mesh->cell_size);
+    if (((mesh->cols << shift) < width) || ((mesh->rows << shift) < height) ||
+            (size < sizeof(*mesh) + (mesh->cols + 1) * (mesh->rows + 1) * sizeof(mesh->point[0]))) {
+        ESP_LOGE(TAG, "mesh of %" PRIu32 "x%" PRIu32 " is invalid", width, height);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (uint32_t row = 0; (row << shift) < height; row++) {
+        for (uint32_t col = 0; (col << shift) < width; col++) {
+            ldc_cell_block(mesh, col, row, width, height, &block);
+            block_max = MAX(block_max, (block.x1 - block.x0 + 1) * (block.y1 - block.y0 + 1) * ldc_video->bpp);
+        }
+    }
+
+    if (block_max > LDC_TILE_SIZE) {
+        ESP_LOGE(TAG, "a cell samples %" PRIu32 " bytes, more than the %d byte tile buffer, use smaller cells",
+                 block_max, LDC_TILE_SIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ldc_video->cell_shift = shift;
+
+    return ESP_OK;
+}
+
+static esp_err_t ldc_video_start(struct esp_video *video, uint32_t type)
+{
+    esp_err_t ret;
+    size_t size;
+    const esp_video_calib_mesh_t *mesh;
+    uint32_t in_w = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video);
+    uint32_t in_h = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+    uint32_t in_fmt = M2M_VIDEO_GET_OUTPUT_FORMAT_PIXEL_FORMAT(video);
+    struct ldc_video *ldc_video = VIDEO_PRIV_DATA(struct ldc_video *, video);
+
+    if ((M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video) != in_w) || (M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video) != in_h) ||
+            (M2M_VIDEO_GET_CAPTURE_FORMAT_PIXEL_FORMAT(video) != in_fmt)) {
+        ESP_LOGE(TAG, "capture and output formats must be the same");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mesh = esp_video_calib_find(ESP_VIDEO_CALIB_TYPE_MESH, in_w, in_h, &size);
+    if (!mesh) {
+        ESP_LOGE(TAG, "no distortion mesh of %" PRIu32 "x%" PRIu32 " in the calibration", in_w, in_h);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ldc_video->bpp = ldc_bytes_per_pixel(in_fmt);
+    ret = ldc_check_mesh(ldc_video, mesh, size, in_w, in_h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* Kept until the device is deleted, the next stream start needs it again */
+    if (!ldc_video->tile) {
+        ldc_video->tile = memstat_aligned_alloc(MEMSTAT_VIDEO_DEV, 4, LDC_TILE_SIZE, LDC_TILE_MEM_CAPS);
+        if (!ldc_video->tile) {
+            ESP_LOGE(TAG, "failed to allocate tile buffer");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ldc_video->mesh = mesh;
+    ldc_video->frame_size = in_w * in_h * ldc_video->bpp;
+
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+    return esp_video_m2m_async_start(video,
+                                     V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                     V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                     ldc_video_m2m_process);
+#else
+    return ESP_OK;
+#endif
+}
+
+static esp_err_t ldc_video_stop(struct esp_video *video, uint32_t type)
+{
+    /* Stopping either stream resets both buffer lists, the task must be idle first */
+    return esp_video_m2m_async_stop(video);
+}
+
+static esp_err_t ldc_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, uint32_t *pixel_format)
+{
+    if ((type != V4L2_BUF_TYPE_VIDEO_CAPTURE) && (type != V4L2_BUF_TYPE_VIDEO_OUTPUT)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (index >= ARRAY_SIZE(s_ldc_format)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *pixel_format = s_ldc_format[index];
+
+    return ESP_OK;
+}
+
+static esp_err_t ldc_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    uint32_t buf_size;
+    const struct v4l2_pix_format *pix = &format->fmt.pix;
+    uint32_t bpp = ldc_bytes_per_pixel(pix->pixelformat);
+
+    if (!bpp) {
+        ESP_LOGE(TAG, "pixel format is invalid");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (!pix->width || !pix->height) {
+        ESP_LOGE(TAG, "frame size is invalid");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        /* Whole cache lines are written back after the correction */
+        buf_size = BUF_ALIGN_SIZE(pix->width * pix->height * bpp, LDC_BUF_ALIGN_BYTES);
+
+        ESP_LOGD(TAG, "capture buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_CAPTURE_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+        M2M_VIDEO_SET_CAPTURE_BUF_INFO(video, buf_size, LDC_BUF_ALIGN_BYTES, LDC_MEM_CAPS);
+    } else if (format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        buf_size = pix->width * pix->height * bpp;
+
+        ESP_LOGD(TAG, "output buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_OUTPUT_BUF_INFO(video, buf_size, LDC_BUF_ALIGN_BYTES, LDC_MEM_CAPS);
+        M2M_VIDEO_SET_OUTPUT_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t ldc_video_notify(struct esp_video *video, enum esp_video_event event, void *arg)
+{
+    esp_err_t ret;
+
+    if (event == ESP_VIDEO_M2M_TRIGGER) {
+        uint32_t type = *(uint32_t *)arg;
+
+        if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+            ret = esp_video_m2m_process(video,
+                                        V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                        V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                        ldc_video_m2m_process);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "failed to process M2M device data");
+                return ret;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+static const struct esp_video_ops s_ldc_video_ops = {
+    .init           = ldc_video_init,
+    .deinit         = ldc_video_deinit,
+    .start          = ldc_video_start,
+    .stop           = ldc_video_stop,
+    .enum_format    = ldc_video_enum_format,
+    .set_format     = ldc_video_set_format,
+    .notify         = ldc_video_notify,
+};
+
+/**
+ * @brief Create lens distortion correction video device, which remaps frames by the calibrated mesh
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_create_ldc_video_device(void)
+{
+    struct esp_video *video;
+    struct ldc_video *ldc_video;
+    uint32_t device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_EXT_PIX_FORMAT | V4L2_CAP_STREAMING;
+    uint32_t caps = device_caps | V4L2_CAP_DEVICE_CAPS;
+
+    ldc_video = heap_caps_calloc(1, sizeof(struct ldc_video), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!ldc_video) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    video = esp_video_create(LDC_NAME, ESP_VIDEO_LDC_DEVICE_ID, &s_ldc_video_ops, ldc_video, caps, device_caps);
+    if (!video) {
+        heap_caps_free(ldc_video);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,441 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#include "driver/ppa.h"
+
+#include "esp_video.h"
+#include "esp_video_device_internal.h"
+
+#define PPA_NAME                        "PPA"
+
+#define PPA_DMA_ALIGN_BYTES             64
+#define PPA_MEM_CAPS                    (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM | MALLOC_CAP_CACHE_ALIGNED)
+
+/* Scaling factor has 4 fractional bits */
+#define PPA_SCALE_FRAC_STEPS            16
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)                   sizeof(x) / sizeof((x)[0])
+#endif
+
+struct ppa_video {
+    ppa_client_handle_t srm_handle;
+
+    ppa_srm_color_mode_t in_cm;
+    ppa_srm_color_mode_t out_cm;
+    uint8_t out_bpp;
+
+    int32_t rotate;
+    bool hflip;
+    bool vflip;
+
+    ppa_srm_oper_config_t oper_config;  /*!< Calculated at stream start, only buffers change per frame */
+};
+
+static const char *TAG = "ppa_video";
+
+static esp_err_t ppa_get_color_mode_from_v4l2(uint32_t v4l2_format, ppa_srm_color_mode_t *cm, uint8_t *bpp)
+{
+    esp_err_t ret = ESP_OK;
+
+    switch (v4l2_format) {
+    case V4L2_PIX_FMT_RGB565:
+        *cm = PPA_SRM_COLOR_MODE_RGB565;
+        *bpp = 16;
+        break;
+    case V4L2_PIX_FMT_RGB24:
+        *cm = PPA_SRM_COLOR_MODE_RGB888;
+        *bpp = 24;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        *cm = PPA_SRM_COLOR_MODE_YUV420;
+        *bpp = 12;
+        break;
+    default:
+        ret = ESP_ERR_NOT_SUPPORTED;
+        break;
+    }
+
+    return ret;
+}
+
+static ppa_srm_rotation_angle_t ppa_get_rotation_angle(int32_t rotate)
+{
+    /* V4L2 rotates clockwise, PPA rotates counterclockwise */
+    switch (rotate) {
+    case 90:
+        return PPA_SRM_ROTATION_ANGLE_270;
+    case 180:
+        return PPA_SRM_ROTATION_ANGLE_180;
+    case 270:
+        return PPA_SRM_ROTATION_ANGLE_90;
+    default:
+        return PPA_SRM_ROTATION_ANGLE_0;
+    }
+}
+
+/**
+ * Calculate the PPA scaling factor and the centered input block of one axis, so that
+ * the scaled block exactly fills the output. Only downscaling is supported, the input
+ * is cropped a little when the ratio is not a multiple of 1/16.
+ */
+static esp_err_t ppa_calc_axis(uint32_t in_size, uint32_t out_size, float *scale, uint32_t *block, uint32_t *offset)
+{
+    uint32_t steps;
+
+    if (!out_size || out_size > in_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    steps = (out_size * PPA_SCALE_FRAC_STEPS + in_size - 1) / in_size;
+    *block = MIN(in_size, (out_size * PPA_SCALE_FRAC_STEPS + steps - 1) / steps);
+    *offset = (in_size - *block) / 2;
+    *scale = (float)steps / PPA_SCALE_FRAC_STEPS;
+
+    return ESP_OK;
+}
+
+static esp_err_t ppa_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags)
+{
+    esp_err_t ret;
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+    ppa_srm_oper_config_t *oper_config = &ppa_video->oper_config;
+
+    oper_config->in.buffer = src;
+    oper_config->out.buffer = dst;
+    oper_config->out.buffer_size = dst_size;
+
+    ret = ppa_do_scale_rotate_mirror(ppa_video->srm_handle, oper_config);
+    if (ret == ESP_OK) {
+        *dst_out_size = oper_config->out.pic_w * oper_config->out.pic_h * ppa_video->out_bpp / 8;
+    }
+
+    return ret;
+}
+
+static esp_err_t ppa_video_init(struct esp_video *video)
+{
+    esp_err_t ret;
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+    ppa_client_config_t client_config = {
+        .oper_type = PPA_OPERATION_SRM,
+    };
+
+    ret = ppa_register_client(&client_config, &ppa_video->srm_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to register PPA SRM client");
+        return ret;
+    }
+
+    M2M_VIDEO_SET_CAPTURE_FORMAT(video, 0, 0, 0);
+    M2M_VIDEO_SET_OUTPUT_FORMAT(video, 0, 0, 0);
+
+    return ESP_OK;
+}
+
+static esp_err_t ppa_video_deinit(struct esp_video *video)
+{
+    esp_err_t ret;
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+
+    ret = ppa_unregister_client(ppa_video->srm_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to unregister PPA SRM client");
+        return ret;
+    }
+
+    ppa_video->srm_handle = NULL;
+
+    return ESP_OK;
+}
+
+static esp_err_t ppa_video_start(struct esp_video *video, uint32_t type)
+{
+    esp_err_t ret;
+    uint32_t in_w = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video);
+    uint32_t in_h = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+    uint32_t out_w = M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video);
+    uint32_t out_h = M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video);
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+    ppa_srm_oper_config_t *oper_config = &ppa_video->oper_config;
+    bool swap = ppa_video->rotate == 90 || ppa_video->rotate == 270;
+
+    memset(oper_config, 0, sizeof(ppa_srm_oper_config_t));
+
+    /* Input block is scaled first, then rotated into the output picture */
+    ret = ppa_calc_axis(in_w, swap ? out_h : out_w, &oper_config->scale_x,
+                        &oper_config->in.block_w, &oper_config->in.block_offset_x);
+    if (ret == ESP_OK) {
+        ret = ppa_calc_axis(in_h, swap ? out_w : out_h, &oper_config->scale_y,
+                            &oper_config->in.block_h, &oper_config->in.block_offset_y);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%" PRIu32 "x%" PRIu32 " can't be scaled to %" PRIu32 "x%" PRIu32, in_w, in_h, out_w, out_h);
+        return ret;
+    }
+
+    oper_config->in.pic_w = in_w;
+    oper_config->in.pic_h = in_h;
+    oper_config->in.srm_cm = ppa_video->in_cm;
+    oper_config->out.pic_w = out_w;
+    oper_config->out.pic_h = out_h;
+    oper_config->out.srm_cm = ppa_video->out_cm;
+    oper_config->rotation_angle = ppa_get_rotation_angle(ppa_video->rotate);
+    oper_config->mirror_x = ppa_video->hflip;
+    oper_config->mirror_y = ppa_video->vflip;
+    oper_config->mode = PPA_TRANS_MODE_BLOCKING;
+
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+    return esp_video_m2m_async_start(video,
+                                     V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                     V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                     ppa_video_m2m_process);
+#else
+    return ESP_OK;
+#endif
+}
+
+static esp_err_t ppa_video_stop(struct esp_video *video, uint32_t type)
+{
+    /* Stopping either stream resets both buffer lists, the task must be idle first */
+    return esp_video_m2m_async_stop(video);
+}
+
+static esp_err_t ppa_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, uint32_t *pixel_format)
+{
+    static const uint32_t ppa_format[] = {
+        V4L2_PIX_FMT_RGB565,
+        V4L2_PIX_FMT_RGB24,
+        V4L2_PIX_FMT_YUV420,
+    };
+
+    if ((type != V4L2_BUF_TYPE_VIDEO_CAPTURE) && (type != V4L2_BUF_TYPE_VIDEO_OUTPUT)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (index >= ARRAY_SIZE(ppa_format)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *pixel_format = ppa_format[index];
+
+    return ESP_OK;
+}
+
+static esp_err_t ppa_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    esp_err_t ret;
+    uint8_t bpp;
+    uint32_t buf_size;
+    const struct v4l2_pix_format *pix = &format->fmt.pix;
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+
+    if (!pix->width || !pix->height) {
+        ESP_LOGE(TAG, "width or height is invalid");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        ret = ppa_get_color_mode_from_v4l2(pix->pixelformat, &ppa_video->out_cm, &bpp);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "pixel format is invalid");
+            return ret;
+        }
+
+        /* PPA writes whole cache lines of the output picture */
+        buf_size = BUF_ALIGN_SIZE(pix->width * pix->height * bpp / 8, PPA_DMA_ALIGN_BYTES);
+        ppa_video->out_bpp = bpp;
+
+        ESP_LOGD(TAG, "capture buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_CAPTURE_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+        M2M_VIDEO_SET_CAPTURE_BUF_INFO(video, buf_size, PPA_DMA_ALIGN_BYTES, PPA_MEM_CAPS);
+    } else if (format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        ret = ppa_get_color_mode_from_v4l2(pix->pixelformat, &ppa_video->in_cm, &bpp);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "pixel format is invalid");
+            return ret;
+        }
+
+        buf_size = pix->width * pix->height * bpp / 8;
+
+        ESP_LOGD(TAG, "output buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_OUTPUT_BUF_INFO(video, buf_size, PPA_DMA_ALIGN_BYTES, PPA_MEM_CAPS);
+        M2M_VIDEO_SET_OUTPUT_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t ppa_video_notify(struct esp_video *video, enum esp_video_event event, void *arg)
+{
+    esp_err_t ret;
+
+    if (event == ESP_VIDEO_M2M_TRIGGER) {
+        uint32_t type = *(uint32_t *)arg;
+
+        if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+            ret = esp_video_m2m_process(video,
+                                        V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                        V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                        ppa_video_m2m_process);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "failed to process M2M device data");
+                return ret;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t ppa_video_set_ext_ctrl(struct esp_video *video, const struct v4l2_ext_controls *ctrls)
+{
+    esp_err_t ret = ESP_OK;
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+
+    /* Geometry is calculated at stream start, so controls take effect at the next VIDIOC_STREAMON */
+    for (int i = 0; i < ctrls->count; i++) {
+        struct v4l2_ext_control *ctrl = &ctrls->controls[i];
+
+        switch (ctrl->id) {
+        case V4L2_CID_HFLIP:
+            ppa_video->hflip = !!ctrl->value;
+            break;
+        case V4L2_CID_VFLIP:
+            ppa_video->vflip = !!ctrl->value;
+            break;
+        case V4L2_CID_ROTATE:
+            if ((ctrl->value != 0) && (ctrl->value != 90) && (ctrl->value != 180) && (ctrl->value != 270)) {
+                ESP_LOGE(TAG, "rotate=%" PRId32 " is invalid", ctrl->value);
+                ret = ESP_ERR_INVALID_ARG;
+                break;
+            }
+            ppa_video->rotate = ctrl->value;
+            break;
+        default:
+            ret = ESP_ERR_NOT_SUPPORTED;
+            ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", ctrl->id);
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static esp_err_t ppa_video_get_ext_ctrl(struct esp_video *video, struct v4l2_ext_controls *ctrls)
+{
+    esp_err_t ret = ESP_OK;
+    struct ppa_video *ppa_video = VIDEO_PRIV_DATA(struct ppa_video *, video);
+
+    for (int i = 0; i < ctrls->count; i++) {
+        struct v4l2_ext_control *ctrl = &ctrls->controls[i];
+
+        switch (ctrl->id) {
+        case V4L2_CID_HFLIP:
+            ctrl->value = ppa_video->hflip;
+            break;
+        case V4L2_CID_VFLIP:
+            ctrl->value = ppa_video->vflip;
+            break;
+        case V4L2_CID_ROTATE:
+            ctrl->value = ppa_video->rotate;
+            break;
+        default:
+            ret = ESP_ERR_NOT_SUPPORTED;
+            ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", ctrl->id);
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static esp_err_t ppa_video_query_ext_ctrl(struct esp_video *video, struct v4l2_query_ext_ctrl *qctrl)
+{
+    esp_err_t ret = ESP_OK;
+
+    switch (qctrl->id) {
+    case V4L2_CID_HFLIP:
+    case V4L2_CID_VFLIP:
+        qctrl->type = V4L2_CTRL_TYPE_BOOLEAN;
+        qctrl->maximum = 1;
+        qctrl->minimum = 0;
+        qctrl->step = 1;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = 0;
+        break;
+    case V4L2_CID_ROTATE:
+        qctrl->type = V4L2_CTRL_TYPE_INTEGER;
+        qctrl->maximum = 270;
+        qctrl->minimum = 0;
+        qctrl->step = 90;
+        qctrl->elems = 1;
+        qctrl->nr_of_dims = 0;
+        qctrl->default_value = 0;
+        break;
+    default:
+        ret = ESP_ERR_NOT_SUPPORTED;
+        ESP_LOGE(TAG, "id=%" PRIx32 " is not supported", qctrl->id);
+        break;
+    }
+
+    return ret;
+}
+
+static const struct esp_video_ops s_ppa_video_ops = {
+    .init           = ppa_video_init,
+    .deinit         = ppa_video_deinit,
+    .start          = ppa_video_start,
+    .stop           = ppa_video_stop,
+    .enum_format    = ppa_video_enum_format,
+    .set_format     = ppa_video_set_format,
+    .notify         = ppa_video_notify,
+    .set_ext_ctrl   = ppa_video_set_ext_ctrl,
+    .get_ext_ctrl   = ppa_video_get_ext_ctrl,
+    .query_ext_ctrl = ppa_video_query_ext_ctrl,
+};
+
+/**
+ * @brief Create PPA video device, which scales, rotates, mirrors and converts color of frames
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_create_ppa_video_device(void)
+{
+    struct esp_video *video;
+    struct ppa_video *ppa_video;
+    uint32_t device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_EXT_PIX_FORMAT | V4L2_CAP_STREAMING;
+    uint32_t caps = device_caps | V4L2_CAP_DEVICE_CAPS;
+
+    ppa_video = heap_caps_calloc(1, sizeof(struct ppa_video), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!ppa_video) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    video = esp_video_create(PPA_NAME, ESP_VIDEO_PPA_DEVICE_ID, &s_ppa_video_ops, ppa_video, caps, device_caps);
+    if (!video) {
+        heap_caps_free(ppa_video);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,279 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_cache.h"
+
+#include "esp_video.h"
+#include "esp_video_device_internal.h"
+#include "esp_video_pixconv.h"
+
+#define SWCONV_NAME                     "SWCONV"
+
+#define SWCONV_BUF_ALIGN_BYTES          64
+#define SWCONV_MEM_CAPS                 (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM | MALLOC_CAP_CACHE_ALIGNED)
+
+/* Kernels work on 8 pixels of a line pair at a time */
+#define SWCONV_WIDTH_ALIGN              8
+#define SWCONV_HEIGHT_ALIGN             2
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)                   sizeof(x) / sizeof((x)[0])
+#endif
+
+struct swconv_video {
+    esp_video_pixconv_func_t conv;      /*!< Chosen at stream start from the two formats */
+    uint32_t in_size;
+    uint32_t out_size;
+};
+
+static const char *TAG = "swconv_video";
+
+static const uint32_t s_swconv_output_format[] = {
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_YUV422P,
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_RGB565,
+    V4L2_PIX_FMT_RGB24,
+    V4L2_PIX_FMT_SBGGR8,
+    V4L2_PIX_FMT_SGBRG8,
+    V4L2_PIX_FMT_SGRBG8,
+    V4L2_PIX_FMT_SRGGB8,
+};
+
+static const uint32_t s_swconv_capture_format[] = {
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_YUV422P,
+    V4L2_PIX_FMT_RGB24,
+    V4L2_PIX_FMT_RGB565,
+    V4L2_PIX_FMT_GREY,
+};
+
+static bool swconv_is_bayer(uint32_t v4l2_format)
+{
+    return v4l2_format == V4L2_PIX_FMT_SBGGR8 || v4l2_format == V4L2_PIX_FMT_SGBRG8 ||
+           v4l2_format == V4L2_PIX_FMT_SGRBG8 || v4l2_format == V4L2_PIX_FMT_SRGGB8;
+}
+
+static bool swconv_has_format(const uint32_t *formats, size_t count, uint32_t v4l2_format)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (formats[i] == v4l2_format) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static esp_err_t swconv_video_m2m_process(struct esp_video *video, uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size, uint32_t *dst_out_size, uint32_t *dst_flags)
+{
+    struct swconv_video *swconv_video = VIDEO_PRIV_DATA(struct swconv_video *, video);
+
+    if ((src_size < swconv_video->in_size) || (dst_size < swconv_video->out_size)) {
+        ESP_LOGE(TAG, "buffer is too small");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    swconv_video->conv(src, dst, M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video), M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video));
+
+    /* The next device, e.g. an encoder, reads the frame by DMA */
+    esp_cache_msync(dst, BUF_ALIGN_SIZE(swconv_video->out_size, SWCONV_BUF_ALIGN_BYTES), ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+    *dst_out_size = swconv_video->out_size;
+
+    return ESP_OK;
+}
+
+static esp_err_t swconv_video_init(struct esp_video *video)
+{
+    M2M_VIDEO_SET_CAPTURE_FORMAT(video, 0, 0, 0);
+    M2M_VIDEO_SET_OUTPUT_FORMAT(video, 0, 0, 0);
+
+    return ESP_OK;
+}
+
+static esp_err_t swconv_video_deinit(struct esp_video *video)
+{
+    return ESP_OK;
+}
+
+static esp_err_t swconv_video_start(struct esp_video *video, uint32_t type)
+{
+    uint32_t in_w = M2M_VIDEO_GET_OUTPUT_FORMAT_WIDTH(video);
+    uint32_t in_h = M2M_VIDEO_GET_OUTPUT_FORMAT_HEIGHT(video);
+    uint32_t in_fmt = M2M_VIDEO_GET_OUTPUT_FORMAT_PIXEL_FORMAT(video);
+    uint32_t out_w = M2M_VIDEO_GET_CAPTURE_FORMAT_WIDTH(video);
+    uint32_t out_h = M2M_VIDEO_GET_CAPTURE_FORMAT_HEIGHT(video);
+    uint32_t out_fmt = M2M_VIDEO_GET_CAPTURE_FORMAT_PIXEL_FORMAT(video);
+    struct swconv_video *swconv_video = VIDEO_PRIV_DATA(struct swconv_video *, video);
+    /* Bayer is previewed at half size, one gray pixel per 2x2 quad */
+    uint32_t shift = swconv_is_bayer(in_fmt) ? 1 : 0;
+
+    swconv_video->conv = esp_video_pixconv_find(in_fmt, out_fmt);
+    if (!swconv_video->conv) {
+        ESP_LOGE(TAG, "can't convert %.4s to %.4s", (const char *)&in_fmt, (const char *)&out_fmt);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if ((out_w != in_w >> shift) || (out_h != in_h >> shift)) {
+        ESP_LOGE(TAG, "%" PRIu32 "x%" PRIu32 " can't be converted to %" PRIu32 "x%" PRIu32, in_w, in_h, out_w, out_h);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    swconv_video->in_size = esp_video_pixconv_frame_size(in_fmt, in_w, in_h);
+    swconv_video->out_size = esp_video_pixconv_frame_size(out_fmt, out_w, out_h);
+
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+    return esp_video_m2m_async_start(video,
+                                     V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                     V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                     swconv_video_m2m_process);
+#else
+    return ESP_OK;
+#endif
+}
+
+static esp_err_t swconv_video_stop(struct esp_video *video, uint32_t type)
+{
+    /* Stopping either stream resets both buffer lists, the task must be idle first */
+    return esp_video_m2m_async_stop(video);
+}
+
+static esp_err_t swconv_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, uint32_t *pixel_format)
+{
+    const uint32_t *formats;
+    size_t count;
+
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        formats = s_swconv_capture_format;
+        count = ARRAY_SIZE(s_swconv_capture_format);
+    } else if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        formats = s_swconv_output_format;
+        count = ARRAY_SIZE(s_swconv_output_format);
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (index >= count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *pixel_format = formats[index];
+
+    return ESP_OK;
+}
+
+static esp_err_t swconv_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    uint32_t buf_size;
+    const struct v4l2_pix_format *pix = &format->fmt.pix;
+
+    if (!pix->width || !pix->height || (pix->width % SWCONV_WIDTH_ALIGN) || (pix->height % SWCONV_HEIGHT_ALIGN)) {
+        ESP_LOGE(TAG, "width must be a multiple of %d and height of %d", SWCONV_WIDTH_ALIGN, SWCONV_HEIGHT_ALIGN);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        if (!swconv_has_format(s_swconv_capture_format, ARRAY_SIZE(s_swconv_capture_format), pix->pixelformat)) {
+            ESP_LOGE(TAG, "pixel format is invalid");
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        /* Whole cache lines are written back after the conversion */
+        buf_size = BUF_ALIGN_SIZE(esp_video_pixconv_frame_size(pix->pixelformat, pix->width, pix->height),
+                                  SWCONV_BUF_ALIGN_BYTES);
+
+        ESP_LOGD(TAG, "capture buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_CAPTURE_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+        M2M_VIDEO_SET_CAPTURE_BUF_INFO(video, buf_size, SWCONV_BUF_ALIGN_BYTES, SWCONV_MEM_CAPS);
+    } else if (format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        if (!swconv_has_format(s_swconv_output_format, ARRAY_SIZE(s_swconv_output_format), pix->pixelformat)) {
+            ESP_LOGE(TAG, "pixel format is invalid");
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        buf_size = esp_video_pixconv_frame_size(pix->pixelformat, pix->width, pix->height);
+
+        ESP_LOGD(TAG, "output buffer size=%" PRIu32, buf_size);
+
+        M2M_VIDEO_SET_OUTPUT_BUF_INFO(video, buf_size, SWCONV_BUF_ALIGN_BYTES, SWCONV_MEM_CAPS);
+        M2M_VIDEO_SET_OUTPUT_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t swconv_video_notify(struct esp_video *video, enum esp_video_event event, void *arg)
+{
+    esp_err_t ret;
+
+    if (event == ESP_VIDEO_M2M_TRIGGER) {
+        uint32_t type = *(uint32_t *)arg;
+
+        if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+            ret = esp_video_m2m_process(video,
+                                        V4L2_BUF_TYPE_VIDEO_OUTPUT,
+                                        V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                                        swconv_video_m2m_process);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "failed to process M2M device data");
+                return ret;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+static const struct esp_video_ops s_swconv_video_ops = {
+    .init           = swconv_video_init,
+    .deinit         = swconv_video_deinit,
+    .start          = swconv_video_start,
+    .stop           = swconv_video_stop,
+    .enum_format    = swconv_video_enum_format,
+    .set_format     = swconv_video_set_format,
+    .notify         = swconv_video_notify,
+};
+
+/**
+ * @brief Create software pixel format converter video device, for format pairs the ISP and PPA don't convert
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_create_swconv_video_device(void)
+{
+    struct esp_video *video;
+    struct swconv_video *swconv_video;
+    uint32_t device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_EXT_PIX_FORMAT | V4L2_CAP_STREAMING;
+    uint32_t caps = device_caps | V4L2_CAP_DEVICE_CAPS;
+
+    swconv_video = heap_caps_calloc(1, sizeof(struct swconv_video), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!swconv_video) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    video = esp_video_create(SWCONV_NAME, ESP_VIDEO_SWCONV_DEVICE_ID, &s_swconv_video_ops, swconv_video, caps, device_caps);
+    if (!video) {
+        heap_caps_free(swconv_video);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
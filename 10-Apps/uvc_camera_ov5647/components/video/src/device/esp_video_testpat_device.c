@@ -0,0 +1,573 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_cache.h"
+#include "memstat.h"
+
+#include "esp_video.h"
+#include "esp_video_testpat.h"
+#include "esp_video_device_internal.h"
+
+#define TESTPAT_NAME                "TESTPAT"
+
+#define TESTPAT_ALIGN_BYTES         64
+#define TESTPAT_MEM_CAPS            (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM | MALLOC_CAP_CACHE_ALIGNED)
+
+#define TESTPAT_MIN_SIZE            16
+#define TESTPAT_MAX_SIZE            4096
+
+#if CONFIG_ESP_VIDEO_TESTPAT_COLOR_BARS
+#define TESTPAT_BANK_FRAMES         1
+#else
+#define TESTPAT_BANK_FRAMES         CONFIG_ESP_VIDEO_TESTPAT_FRAME_COUNT
+#endif
+
+#if CONFIG_ESP_VIDEO_TESTPAT_TASK_CORE < 0
+#define TESTPAT_TASK_CORE           tskNO_AFFINITY
+#else
+#define TESTPAT_TASK_CORE           CONFIG_ESP_VIDEO_TESTPAT_TASK_CORE
+#endif
+
+struct testpat_rgb {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+struct testpat_video {
+    uint32_t bpp;
+
+    struct v4l2_fract timeperframe;
+
+    uint8_t *bank[TESTPAT_BANK_FRAMES];     /* Pre-rendered frames, only the first bank_count are valid */
+    uint32_t bank_count;
+    uint32_t frame_index;
+
+    TaskHandle_t task;
+    SemaphoreHandle_t exit_sem;
+    esp_timer_handle_t timer;
+    volatile bool running;
+
+    uint32_t frames;
+    uint32_t skipped;                       /* Periods without a queued buffer */
+};
+
+/* Set by esp_video_testpat_set_clip(), replaces the pattern when frames is not NULL */
+static struct {
+    const uint8_t *frames;
+    uint32_t frame_size;
+    uint32_t frame_count;
+} s_clip;
+
+static struct testpat_video *s_testpat_video;
+
+static const char *TAG = "testpat_video";
+
+static const uint32_t s_testpat_formats[] = {
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_YUV422P,
+    V4L2_PIX_FMT_RGB565,
+    V4L2_PIX_FMT_RGB24,
+    V4L2_PIX_FMT_GREY,
+};
+
+/* 75% color bars: white, yellow, cyan, green, magenta, red, blue, black */
+static const struct testpat_rgb s_testpat_bars[] = {
+    {191, 191, 191}, {191, 191, 0}, {0, 191, 191}, {0, 191, 0},
+    {191, 0, 191}, {191, 0, 0}, {0, 0, 191}, {0, 0, 0},
+};
+
+static esp_err_t testpat_get_bpp(uint32_t pixel_format, uint32_t *bpp)
+{
+    switch (pixel_format) {
+    case V4L2_PIX_FMT_YUV420:
+        *bpp = 12;
+        break;
+    case V4L2_PIX_FMT_YUV422P:
+    case V4L2_PIX_FMT_RGB565:
+        *bpp = 16;
+        break;
+    case V4L2_PIX_FMT_RGB24:
+        *bpp = 24;
+        break;
+    case V4L2_PIX_FMT_GREY:
+        *bpp = 8;
+        break;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+/* BT.601 limited range */
+static inline uint8_t testpat_y(const struct testpat_rgb *c)
+{
+    return (uint8_t)(((66 * c->r + 129 * c->g + 25 * c->b + 128) >> 8) + 16);
+}
+
+static inline uint8_t testpat_u(const struct testpat_rgb *c)
+{
+    return (uint8_t)(((-38 * c->r - 74 * c->g + 112 * c->b + 128) >> 8) + 128);
+}
+
+static inline uint8_t testpat_v(const struct testpat_rgb *c)
+{
+    return (uint8_t)(((112 * c->r - 94 * c->g - 18 * c->b + 128) >> 8) + 128);
+}
+
+/* Color of a pixel, frame selects the position of the moving elements or the noise seed */
+static void testpat_pixel(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t frame,
+                          struct testpat_rgb *c)
+{
+#if CONFIG_ESP_VIDEO_TESTPAT_NOISE
+    uint32_t seed = (y * width + x) * 2654435761u ^ (frame + 1) * 2246822519u;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    c->r = seed;
+    c->g = seed >> 8;
+    c->b = seed >> 16;
+#else
+    uint32_t bar_count = sizeof(s_testpat_bars) / sizeof(s_testpat_bars[0]);
+#if CONFIG_ESP_VIDEO_TESTPAT_MOVING_BARS
+    /* Bars scroll by a full width and a box falls by a full height over the bank, so the loop is seamless */
+    uint32_t box = height / 8;
+    uint32_t box_x = width / 2 - box / 2;
+    uint32_t box_y = (uint64_t)frame * height / TESTPAT_BANK_FRAMES;
+
+    if (x >= box_x && x < box_x + box && (y + height - box_y) % height < box) {
+        c->r = c->g = c->b = ((x - box_x) / 8 + y / 8) & 1 ? 235 : 16;
+        return;
+    }
+    x = (x + (uint64_t)frame * width / TESTPAT_BANK_FRAMES) % width;
+#endif
+    *c = s_testpat_bars[(uint64_t)x * bar_count / width];
+#endif
+}
+
+/* Writes one frame in the capture format, two lines at a time for the 4:2:0 layout */
+static void testpat_render(uint8_t *buf, uint32_t pixel_format, uint32_t width, uint32_t height, uint32_t frame)
+{
+    struct testpat_rgb c[4];
+
+    for (uint32_t y = 0; y < height; y += 2) {
+        for (uint32_t x = 0; x < width; x += 2) {
+            testpat_pixel(x, y, width, height, frame, &c[0]);
+            testpat_pixel(x + 1, y, width, height, frame, &c[1]);
+            testpat_pixel(x, y + 1, width, height, frame, &c[2]);
+            testpat_pixel(x + 1, y + 1, width, height, frame, &c[3]);
+
+            for (int row = 0; row < 2; row++) {
+                const struct testpat_rgb *p = &c[row * 2];
+                uint32_t line = y + row;
+                uint8_t *out;
+
+                switch (pixel_format) {
+                case V4L2_PIX_FMT_YUV420:
+                    /* Odd lines carry U, even lines carry V: U Y Y / V Y Y */
+                    out = buf + line * width * 3 / 2 + x / 2 * 3;
+                    out[0] = row ? testpat_v(&c[0]) : testpat_u(&c[0]);
+                    out[1] = testpat_y(&p[0]);
+                    out[2] = testpat_y(&p[1]);
+                    break;
+                case V4L2_PIX_FMT_YUV422P:
+                    out = buf + (line * width + x) * 2;
+                    out[0] = testpat_u(&p[0]);
+                    out[1] = testpat_y(&p[0]);
+                    out[2] = testpat_v(&p[0]);
+                    out[3] = testpat_y(&p[1]);
+                    break;
+                case V4L2_PIX_FMT_RGB565:
+                    out = buf + (line * width + x) * 2;
+                    for (int i = 0; i < 2; i++) {
+                        uint16_t rgb = ((p[i].r >> 3) << 11) | ((p[i].g >> 2) << 5) | (p[i].b >> 3);
+
+                        out[i * 2] = rgb;
+                        out[i * 2 + 1] = rgb >> 8;
+                    }
+                    break;
+                case V4L2_PIX_FMT_RGB24:
+                    out = buf + (line * width + x) * 3;
+                    for (int i = 0; i < 2; i++) {
+                        out[i * 3] = p[i].r;
+                        out[i * 3 + 1] = p[i].g;
+                        out[i * 3 + 2] = p[i].b;
+                    }
+                    break;
+                default:
+                    out = buf + line * width + x;
+                    out[0] = testpat_y(&p[0]);
+                    out[1] = testpat_y(&p[1]);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void testpat_free_bank(struct testpat_video *testpat_video)
+{
+    for (int i = 0; i < testpat_video->bank_count; i++) {
+        memstat_free(MEMSTAT_VIDEO_DEV, testpat_video->bank[i]);
+        testpat_video->bank[i] = NULL;
+    }
+    testpat_video->bank_count = 0;
+}
+
+/* Renders the bank once per stream start, so frame generation is a copy. Fewer frames are used if PSRAM runs short */
+static esp_err_t testpat_render_bank(struct esp_video *video)
+{
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+    uint32_t width = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video);
+    uint32_t height = CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video);
+    uint32_t pixel_format = CAPTURE_VIDEO_GET_FORMAT_PIXEL_FORMAT(video);
+    uint32_t size = width * height * testpat_video->bpp / 8;
+    int64_t start = esp_timer_get_time();
+
+    for (int i = 0; i < TESTPAT_BANK_FRAMES; i++) {
+        testpat_video->bank[i] = memstat_aligned_alloc(MEMSTAT_VIDEO_DEV, TESTPAT_ALIGN_BYTES, size, TESTPAT_MEM_CAPS);
+        if (!testpat_video->bank[i]) {
+            break;
+        }
+        testpat_video->bank_count++;
+    }
+
+    if (!testpat_video->bank_count) {
+        ESP_LOGE(TAG, "failed to allocate pattern frame of %" PRIu32 " bytes", size);
+        return ESP_ERR_NO_MEM;
+    } else if (testpat_video->bank_count < TESTPAT_BANK_FRAMES) {
+        ESP_LOGW(TAG, "only %" PRIu32 " of %d pattern frames fit in memory", testpat_video->bank_count, TESTPAT_BANK_FRAMES);
+    }
+
+    for (int i = 0; i < testpat_video->bank_count; i++) {
+        testpat_render(testpat_video->bank[i], pixel_format, width, height,
+                       (uint64_t)i * TESTPAT_BANK_FRAMES / testpat_video->bank_count);
+    }
+
+    ESP_LOGD(TAG, "rendered %" PRIu32 " frames in %lld ms", testpat_video->bank_count, (esp_timer_get_time() - start) / 1000);
+
+    return ESP_OK;
+}
+
+static void testpat_video_timer_cb(void *arg)
+{
+    struct testpat_video *testpat_video = (struct testpat_video *)arg;
+
+    xTaskNotifyGive(testpat_video->task);
+}
+
+/* Stands in for the sensor and the DMA: fills one queued buffer every frame period */
+static void testpat_video_task(void *arg)
+{
+    struct esp_video *video = (struct esp_video *)arg;
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+    struct esp_video_buffer_element *element;
+    const uint8_t *src;
+    uint32_t size;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!testpat_video->running) {
+            break;
+        }
+
+        element = CAPTURE_VIDEO_GET_QUEUED_ELEMENT(video);
+        if (!element) {
+            testpat_video->skipped++;
+            continue;
+        }
+
+        if (s_clip.frames) {
+            size = s_clip.frame_size;
+            src = s_clip.frames + (testpat_video->frame_index % s_clip.frame_count) * size;
+        } else {
+            size = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video) * CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video) * testpat_video->bpp / 8;
+            src = testpat_video->bank[testpat_video->frame_index % testpat_video->bank_count];
+        }
+        testpat_video->frame_index++;
+
+        memcpy(element->buffer, src, size);
+
+        /* Done buffers are treated as DMA written and invalidated before the CPU reads them */
+        esp_cache_msync(element->buffer, size, ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+
+        CAPTURE_VIDEO_DONE_BUF(video, element->buffer, size);
+        testpat_video->frames++;
+    }
+
+    xSemaphoreGive(testpat_video->exit_sem);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t testpat_video_init(struct esp_video *video)
+{
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+
+    ESP_RETURN_ON_ERROR(testpat_get_bpp(s_testpat_formats[0], &testpat_video->bpp), TAG, "failed to get bpp");
+
+    CAPTURE_VIDEO_SET_FORMAT(video,
+                             CONFIG_ESP_VIDEO_TESTPAT_WIDTH,
+                             CONFIG_ESP_VIDEO_TESTPAT_HEIGHT,
+                             s_testpat_formats[0]);
+
+    CAPTURE_VIDEO_SET_BUF_INFO(video, CONFIG_ESP_VIDEO_TESTPAT_WIDTH * CONFIG_ESP_VIDEO_TESTPAT_HEIGHT * testpat_video->bpp / 8,
+                               TESTPAT_ALIGN_BYTES, TESTPAT_MEM_CAPS);
+
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_deinit(struct esp_video *video)
+{
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_start(struct esp_video *video, uint32_t type)
+{
+    esp_err_t ret;
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+    uint32_t size = CAPTURE_VIDEO_GET_FORMAT_WIDTH(video) * CAPTURE_VIDEO_GET_FORMAT_HEIGHT(video) * testpat_video->bpp / 8;
+    uint64_t period_us = 1000000ULL * testpat_video->timeperframe.numerator / testpat_video->timeperframe.denominator;
+
+    if (s_clip.frames) {
+        if (s_clip.frame_size != size) {
+            ESP_LOGE(TAG, "clip frame size %" PRIu32 " does not match format size %" PRIu32, s_clip.frame_size, size);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    } else {
+        ESP_RETURN_ON_ERROR(testpat_render_bank(video), TAG, "failed to render pattern");
+    }
+
+    testpat_video->frame_index = 0;
+    testpat_video->frames = 0;
+    testpat_video->skipped = 0;
+    testpat_video->running = true;
+
+    if (xTaskCreatePinnedToCore(testpat_video_task, "testpat", CONFIG_ESP_VIDEO_TESTPAT_TASK_STACK_SIZE, video,
+                                CONFIG_ESP_VIDEO_TESTPAT_TASK_PRIORITY, &testpat_video->task, TESTPAT_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "failed to create task");
+        ret = ESP_ERR_NO_MEM;
+        goto exit_0;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = testpat_video_timer_cb,
+        .arg = testpat_video,
+        .name = "testpat",
+    };
+    ret = esp_timer_create(&timer_args, &testpat_video->timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create timer");
+        goto exit_1;
+    }
+
+    ret = esp_timer_start_periodic(testpat_video->timer, period_us);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to start timer");
+        goto exit_2;
+    }
+
+    ESP_LOGI(TAG, "streaming %s at %" PRIu32 "/%" PRIu32 " s per frame",
+             s_clip.frames ? "clip" : "pattern", testpat_video->timeperframe.numerator,
+             testpat_video->timeperframe.denominator);
+
+    return ESP_OK;
+
+exit_2:
+    esp_timer_delete(testpat_video->timer);
+    testpat_video->timer = NULL;
+exit_1:
+    testpat_video->running = false;
+    xTaskNotifyGive(testpat_video->task);
+    xSemaphoreTake(testpat_video->exit_sem, portMAX_DELAY);
+    testpat_video->task = NULL;
+exit_0:
+    testpat_free_bank(testpat_video);
+    return ret;
+}
+
+static esp_err_t testpat_video_stop(struct esp_video *video, uint32_t type)
+{
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+
+    esp_timer_stop(testpat_video->timer);
+    esp_timer_delete(testpat_video->timer);
+    testpat_video->timer = NULL;
+
+    /* The task must not touch a buffer after this returns */
+    testpat_video->running = false;
+    xTaskNotifyGive(testpat_video->task);
+    xSemaphoreTake(testpat_video->exit_sem, portMAX_DELAY);
+    testpat_video->task = NULL;
+
+    testpat_free_bank(testpat_video);
+
+    ESP_LOGI(TAG, "stopped after %" PRIu32 " frames, %" PRIu32 " periods without a free buffer",
+             testpat_video->frames, testpat_video->skipped);
+
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, uint32_t *pixel_format)
+{
+    if (index >= sizeof(s_testpat_formats) / sizeof(s_testpat_formats[0])) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *pixel_format = s_testpat_formats[index];
+
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    uint32_t bpp;
+    const struct v4l2_pix_format *pix = &format->fmt.pix;
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+
+    if (testpat_get_bpp(pix->pixelformat, &bpp) != ESP_OK ||
+            pix->width < TESTPAT_MIN_SIZE || pix->width > TESTPAT_MAX_SIZE || (pix->width & 1) ||
+            pix->height < TESTPAT_MIN_SIZE || pix->height > TESTPAT_MAX_SIZE || (pix->height & 1)) {
+        ESP_LOGE(TAG, "format is not supported");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    testpat_video->bpp = bpp;
+    CAPTURE_VIDEO_SET_FORMAT(video, pix->width, pix->height, pix->pixelformat);
+    CAPTURE_VIDEO_SET_BUF_INFO(video, pix->width * pix->height * bpp / 8, TESTPAT_ALIGN_BYTES, TESTPAT_MEM_CAPS);
+
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_notify(struct esp_video *video, enum esp_video_event event, void *arg)
+{
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_set_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    struct v4l2_fract *timeperframe = &parm->parm.capture.timeperframe;
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+
+    if (parm->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /* Zero asks for the default, like V4L2 drivers do */
+    if (!timeperframe->numerator || !timeperframe->denominator) {
+        timeperframe->numerator = 1;
+        timeperframe->denominator = CONFIG_ESP_VIDEO_TESTPAT_FPS;
+    }
+    parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+
+    /* Applied at the next stream start */
+    testpat_video->timeperframe = *timeperframe;
+
+    return ESP_OK;
+}
+
+static esp_err_t testpat_video_get_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    struct testpat_video *testpat_video = VIDEO_PRIV_DATA(struct testpat_video *, video);
+
+    if (parm->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(&parm->parm.capture, 0, sizeof(parm->parm.capture));
+    parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+    parm->parm.capture.timeperframe = testpat_video->timeperframe;
+
+    return ESP_OK;
+}
+
+static const struct esp_video_ops s_testpat_video_ops = {
+    .init          = testpat_video_init,
+    .deinit        = testpat_video_deinit,
+    .start         = testpat_video_start,
+    .stop          = testpat_video_stop,
+    .enum_format   = testpat_video_enum_format,
+    .set_format    = testpat_video_set_format,
+    .notify        = testpat_video_notify,
+    .set_parm      = testpat_video_set_parm,
+    .get_parm      = testpat_video_get_parm,
+};
+
+/**
+ * @brief Stream frames of a clip instead of the test pattern
+ *
+ * @param frames      Frames back to back in the capture format
+ * @param frame_size  Size of one frame in bytes
+ * @param frame_count Number of frames
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_testpat_set_clip(const void *frames, uint32_t frame_size, uint32_t frame_count)
+{
+    ESP_RETURN_ON_FALSE(!frames || (frame_size && frame_count), ESP_ERR_INVALID_ARG, TAG, "clip is empty");
+    ESP_RETURN_ON_FALSE(!s_testpat_video || !s_testpat_video->running, ESP_ERR_INVALID_STATE, TAG,
+                        "clip can't be changed while streaming");
+
+    s_clip.frames = frames;
+    s_clip.frame_size = frame_size;
+    s_clip.frame_count = frame_count;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Create test pattern video device
+ *
+ * @param None
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_create_testpat_video_device(void)
+{
+    struct esp_video *video;
+    struct testpat_video *testpat_video;
+    uint32_t device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_EXT_PIX_FORMAT | V4L2_CAP_STREAMING;
+    uint32_t caps = device_caps | V4L2_CAP_DEVICE_CAPS;
+
+    testpat_video = heap_caps_calloc(1, sizeof(struct testpat_video), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!testpat_video) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    testpat_video->exit_sem = xSemaphoreCreateBinary();
+    if (!testpat_video->exit_sem) {
+        heap_caps_free(testpat_video);
+        return ESP_ERR_NO_MEM;
+    }
+
+    testpat_video->timeperframe.numerator = 1;
+    testpat_video->timeperframe.denominator = CONFIG_ESP_VIDEO_TESTPAT_FPS;
+
+    video = esp_video_create(TESTPAT_NAME, ESP_VIDEO_TESTPAT_DEVICE_ID, &s_testpat_video_ops, testpat_video, caps, device_caps);
+    if (!video) {
+        vSemaphoreDelete(testpat_video->exit_sem);
+        heap_caps_free(testpat_video);
+        return ESP_FAIL;
+    }
+
+    s_testpat_video = testpat_video;
+
+    return ESP_OK;
+}
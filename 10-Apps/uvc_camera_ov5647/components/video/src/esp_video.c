@@ -7,18 +7,35 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/lock.h>
+#include <sys/param.h>
 #include "esp_log.h"
 #include "esp_check.h"
-#include "esp_memory_utils.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_video.h"
+#include "esp_video_port.h"
+#if ESP_VIDEO_PORT_HAS_VFS
 #include "esp_video_vfs.h"
+#else
+static inline void esp_video_vfs_select_notify(struct esp_video *video, BaseType_t *wakeup)
+{
+}
+#endif
 #include "esp_cam_sensor.h"
 
 #include "freertos/portmacro.h"
 
 #define ALLOC_RAM_ATTR (MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL)
 
+#define VIDEO_BUFFER_HOT_CAPS (MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_CACHE_ALIGNED)
+
+/* Exported buffer handle: flag | video device ID | stream type | element index */
+#define DMABUF_FD_FLAG          0x40000000
+#define DMABUF_FD(id, t, i)     (DMABUF_FD_FLAG | ((id) << 16) | (((t) & 0xff) << 8) | ((i) & 0xff))
+#define DMABUF_FD_ID(fd)        (((fd) >> 16) & 0xff)
+#define DMABUF_FD_TYPE(fd)      (((fd) >> 8) & 0xff)
+#define DMABUF_FD_INDEX(fd)     ((fd) & 0xff)
+
 #if CONFIG_ESP_VIDEO_CHECK_PARAMETERS
 #define CHECK_VIDEO_OBJ(v)                                  \
 {                                                           \
@@ -33,6 +50,19 @@
 #define CHECK_PARAM(...)
 #endif
 
+/**
+ * @brief M2M background process object.
+ */
+struct esp_video_m2m_async {
+    struct esp_video *video;
+    TaskHandle_t task;
+    SemaphoreHandle_t exit_sem;
+    esp_video_m2m_process_t proc;
+    uint32_t src_type;
+    uint32_t dst_type;
+    volatile bool exit;
+};
+
 struct esp_video_format_desc_map {
     uint32_t pixel_format;
     char desc_string[30];
@@ -186,29 +216,7 @@ esp_err_t esp_video_set_priv_data(struct esp_video *video, void *priv)
  */
 struct esp_video_stream *IRAM_ATTR esp_video_get_stream(struct esp_video *video, enum v4l2_buf_type type)
 {
-    struct esp_video_stream *stream = NULL;
-
-    if (video->caps & V4L2_CAP_VIDEO_CAPTURE) {
-        if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
-            stream = video->stream;
-        }
-    } else if (video->caps & V4L2_CAP_VIDEO_OUTPUT) {
-        if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
-            stream = video->stream;
-        }
-    } else if (video->caps & V4L2_CAP_VIDEO_M2M) {
-        if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
-            stream = &video->stream[0];
-        } else if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
-            stream = &video->stream[1];
-        }
-    } else if (video->caps & V4L2_CAP_META_CAPTURE) {
-        if (type == V4L2_BUF_TYPE_META_CAPTURE) {
-            stream = &video->stream[0];
-        }
-    }
-
-    return stream;
+    return esp_video_stream_of(video, type);
 }
 
 /**
@@ -235,6 +243,29 @@ struct esp_video *esp_video_device_get_object(const char *name)
     return NULL;
 }
 
+/**
+ * @brief Get video object by device ID
+ *
+ * @param id The video device ID
+ *
+ * @return Video object pointer if found by ID
+ */
+struct esp_video *esp_video_device_get_object_by_id(uint8_t id)
+{
+    struct esp_video *video;
+
+    _lock_acquire(&s_video_lock);
+    SLIST_FOREACH(video, &s_video_list, node) {
+        if (video->id == id) {
+            _lock_release(&s_video_lock);
+            return video;
+        }
+    }
+
+    _lock_release(&s_video_lock);
+    return NULL;
+}
+
 #if CONFIG_ESP_VIDEO_CHECK_PARAMETERS
 /**
  * @brief Check if video is valid
@@ -273,6 +304,50 @@ static esp_err_t esp_video_check_video_obj(struct esp_video *video)
 }
 #endif
 
+/* Register /dev/videoN of the video object, the host build has no VFS and opens by name only */
+static esp_err_t esp_video_vfs_register(struct esp_video *video)
+{
+#if ESP_VIDEO_PORT_HAS_VFS
+    esp_err_t ret;
+    char vfs_name[8];
+
+    ret = snprintf(vfs_name, sizeof(vfs_name), "video%d", video->id);
+    if (ret <= 0) {
+        ESP_LOGE(TAG, "Failed to register video VFS dev");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = esp_video_vfs_dev_register(vfs_name, video);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register video VFS dev name=%s", vfs_name);
+        return ret;
+    }
+#endif
+
+    return ESP_OK;
+}
+
+static esp_err_t esp_video_vfs_unregister(struct esp_video *video)
+{
+#if ESP_VIDEO_PORT_HAS_VFS
+    esp_err_t ret;
+    char vfs_name[8];
+
+    ret = snprintf(vfs_name, sizeof(vfs_name), "video%d", video->id);
+    if (ret <= 0) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = esp_video_vfs_dev_unregister(vfs_name);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to unregister video VFS dev name=%s", vfs_name);
+        return ret;
+    }
+#endif
+
+    return ESP_OK;
+}
+
 /**
  * @brief Create video object.
  *
@@ -294,7 +369,6 @@ struct esp_video *esp_video_create(const char *name, uint8_t id, const struct es
     struct esp_video *video;
     uint32_t size;
     int stream_count;
-    char vfs_name[8];
 
     CHECK_PARAM(name && ops, NULL, TAG, "name or ops is null");
     CHECK_PARAM(ops->set_format, NULL, TAG, "set_format is null");
@@ -335,6 +409,23 @@ struct esp_video *esp_video_create(const char *name, uint8_t id, const struct es
         goto exit_1;
     }
 
+    for (int i = 0; i < stream_count; i++) {
+        video->stream[i].buf_policy.hot_count = CONFIG_ESP_VIDEO_BUFFER_HOT_COUNT;
+        video->stream[i].buf_policy.hot_caps = VIDEO_BUFFER_HOT_CAPS;
+    }
+
+    /* Resolved once, stream lookups in ISRs don't test the capabilities again */
+    if (caps & V4L2_CAP_VIDEO_CAPTURE) {
+        video->capture_stream = video->stream;
+    } else if (caps & V4L2_CAP_VIDEO_OUTPUT) {
+        video->output_stream = video->stream;
+    } else if (caps & V4L2_CAP_VIDEO_M2M) {
+        video->capture_stream = &video->stream[0];
+        video->output_stream = &video->stream[1];
+    } else if (caps & V4L2_CAP_META_CAPTURE) {
+        video->meta_stream = video->stream;
+    }
+
     video->mutex = xSemaphoreCreateMutex();
     if (!video->mutex) {
         ESP_LOGE(TAG, "Failed to create mutex");
@@ -350,15 +441,8 @@ struct esp_video *esp_video_create(const char *name, uint8_t id, const struct es
     video->device_caps = device_caps;
     SLIST_INSERT_HEAD(&s_video_list, video, node);
 
-    ret = snprintf(vfs_name, sizeof(vfs_name), "video%d", id);
-    if (ret <= 0) {
-        ESP_LOGE(TAG, "Failed to register video VFS dev");
-        goto exit_3;
-    }
-
-    ret = esp_video_vfs_dev_register(vfs_name, video);
+    ret = esp_video_vfs_register(video);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register video VFS dev name=%s", vfs_name);
         goto exit_3;
     }
 
@@ -389,19 +473,12 @@ exit_0:
 esp_err_t esp_video_destroy(struct esp_video *video)
 {
     esp_err_t ret;
-    char vfs_name[8];
 
     CHECK_VIDEO_OBJ(video);
 
-    ret = snprintf(vfs_name, sizeof(vfs_name), "video%d", video->id);
-    if (ret <= 0) {
-        return ESP_ERR_NO_MEM;
-    }
-
-    ret = esp_video_vfs_dev_unregister(vfs_name);
-    if (ret <= 0) {
-        ESP_LOGE(TAG, "Failed to unregister video VFS dev name=%s", vfs_name);
-        return ESP_ERR_NO_MEM;
+    ret = esp_video_vfs_unregister(video);
+    if (ret != ESP_OK) {
+        return ret;
     }
 
     _lock_acquire(&s_video_lock);
@@ -467,8 +544,8 @@ struct esp_video *esp_video_open(const char *name)
                 struct esp_video_stream *stream = &video->stream[i];
 
                 stream->buffer = NULL;
-                SLIST_INIT(&stream->queued_list);
-                SLIST_INIT(&stream->done_list);
+                esp_video_buffer_ring_reset(&stream->queued_ring);
+                esp_video_buffer_ring_reset(&stream->done_ring);
             }
         }
     } else {
@@ -534,199 +611,505 @@ exit_0:
 }
 
 /**
- * @brief Start capturing video data stream.
+ * @brief Allocate a client slot for an opened file of video device.
  *
  * @param video Video object
- * @param type  Video stream type
  *
  * @return
- *      - ESP_OK on success
- *      - Others if failed
+ *      - Client slot index on success
+ *      - -1 if all slots are used
  */
-esp_err_t esp_video_start_capture(struct esp_video *video, uint32_t type)
+int esp_video_client_open(struct esp_video *video)
 {
-    esp_err_t ret;
-    struct esp_video_stream *stream;
-
-    CHECK_VIDEO_OBJ(video);
-
-    stream = esp_video_get_stream(video, type);
-    if (!stream) {
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    if (stream->started) {
-        return ESP_ERR_INVALID_STATE;
-    }
+    int index = -1;
 
-    if (video->ops->start) {
-        ret = video->ops->start(video, type);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "video->ops->start=%x", ret);
-            return ret;
+    xSemaphoreTake(video->mutex, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_ESP_VIDEO_MAX_CLIENTS; i++) {
+        if (!video->client[i].opened) {
+            memset(&video->client[i], 0, sizeof(struct esp_video_client));
+            video->client[i].opened = true;
+            index = i;
+            break;
         }
-    } else {
-        ESP_LOGD(TAG, "video->ops->start=NULL");
-        return ESP_ERR_NOT_SUPPORTED;
     }
+    xSemaphoreGive(video->mutex);
 
-    stream->started = true;
+    if (index < 0) {
+        ESP_LOGE(TAG, "video=%s has no free client slot", video->dev_name);
+    }
 
-    return ESP_OK;
+    return index;
 }
 
 /**
- * @brief Stop capturing video data stream.
+ * @brief Free a client slot, the client is unsubscribed firstly.
  *
  * @param video Video object
- * @param type  Video stream type
+ * @param index Client slot index
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_stop_capture(struct esp_video *video, uint32_t type)
+esp_err_t esp_video_client_close(struct esp_video *video, int index)
 {
-    esp_err_t ret;
-    struct esp_video_stream *stream;
-
-    CHECK_VIDEO_OBJ(video);
+    struct esp_video_client *client;
+    const struct esp_video_buffer_subscribe sub = {0};
 
-    stream = esp_video_get_stream(video, type);
-    if (!stream) {
+    client = esp_video_get_client(video, index);
+    if (!client) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (!stream->started) {
-        return ESP_ERR_INVALID_STATE;
+    if (client->sub_type) {
+        esp_video_client_subscribe(video, client, &sub);
     }
 
-    if (video->ops->stop) {
-        ret = video->ops->stop(video, type);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "video->ops->stop=%x", ret);
-            return ret;
-        } else {
-            int stream_count = video->caps & V4L2_CAP_VIDEO_M2M ? 2 : 1;
-
-            for (int i = 0; i < stream_count; i++) {
-                struct esp_video_stream *stream = &video->stream[i];
-
-                do {
-                    ret = xSemaphoreTake(stream->ready_sem, 0);
-                } while (ret == pdTRUE);
+    xSemaphoreTake(video->mutex, portMAX_DELAY);
+    client->opened = false;
+    xSemaphoreGive(video->mutex);
 
-                SLIST_INIT(&stream->queued_list);
-                SLIST_INIT(&stream->done_list);
+    return ESP_OK;
+}
 
-                esp_video_buffer_reset(stream->buffer);
-            }
-        }
-    } else {
-        ESP_LOGD(TAG, "video->ops->stop=NULL");
-        return ESP_ERR_NOT_SUPPORTED;
+/**
+ * @brief Get client object by slot index.
+ *
+ * @param video Video object
+ * @param index Client slot index
+ *
+ * @return
+ *      - Client object pointer on success
+ *      - NULL if failed
+ */
+struct esp_video_client *esp_video_get_client(struct esp_video *video, int index)
+{
+    if (index < 0 || index >= CONFIG_ESP_VIDEO_MAX_CLIENTS || !video->client[index].opened) {
+        return NULL;
     }
 
-    stream->started = false;
+    return &video->client[index];
+}
 
-    return ESP_OK;
+/* A done element is waiting, ready_sem is given once per element pushed to the done ring */
+static inline bool IRAM_ATTR esp_video_stream_has_done(struct esp_video_stream *stream)
+{
+    return stream && stream->ready_sem && uxSemaphoreGetCountFromISR(stream->ready_sem) > 0;
 }
 
 /**
- * @brief Enumerate video format description.
+ * @brief Get the events a client can handle without blocking, for select().
  *
  * @param video  Video object
- * @param type   Video stream type
- * @param index  Pixel format index
- * @param desc   Pixel format enum buffer pointer
+ * @param client Video client object
  *
- * @return
- *      - ESP_OK on success
- *      - Others if failed
+ * @return ESP_VIDEO_POLL_IN and ESP_VIDEO_POLL_OUT bits of the ready events
  */
-esp_err_t esp_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, struct esp_video_format_desc *desc)
+uint32_t IRAM_ATTR esp_video_client_poll(struct esp_video *video, struct esp_video_client *client)
 {
-    esp_err_t ret;
-    struct esp_video_stream *stream;
+    uint32_t events = 0;
 
-    CHECK_VIDEO_OBJ(video);
-    CHECK_PARAM(desc, ESP_ERR_INVALID_ARG, TAG, "desc=NULL");
+    if (client->sub_type) {
+        return client->ring_count ? ESP_VIDEO_POLL_IN : 0;
+    }
 
-    stream = esp_video_get_stream(video, type);
-    if (!stream) {
-        return ESP_ERR_INVALID_ARG;
+    if (esp_video_stream_has_done(video->capture_stream) || esp_video_stream_has_done(video->meta_stream)) {
+        events |= ESP_VIDEO_POLL_IN;
+    }
+    if (esp_video_stream_has_done(video->output_stream)) {
+        events |= ESP_VIDEO_POLL_OUT;
     }
 
-    if (video->ops->enum_format) {
-        ret = video->ops->enum_format(video, type, index, &desc->pixel_format);
-        if (ret != ESP_OK) {
-            return ret;
-        } else {
-            ret = esp_video_get_format_desc(desc->pixel_format, desc->description);
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "failed to get format description");
-                return ret;
-            }
-        }
-    } else {
-        ESP_LOGD(TAG, "video->ops->enum_format=NULL");
-        return ESP_ERR_NOT_SUPPORTED;
+    /* VIDIOC_DQBUF runs the codec itself, it only needs an element pair to process */
+    if ((video->device_caps & V4L2_CAP_VIDEO_M2M) && !video->m2m_async &&
+            video->capture_stream && video->output_stream &&
+            !esp_video_buffer_ring_is_empty(&video->capture_stream->queued_ring) &&
+            !esp_video_buffer_ring_is_empty(&video->output_stream->queued_ring)) {
+        events |= ESP_VIDEO_POLL_IN | ESP_VIDEO_POLL_OUT;
     }
 
-    return ESP_OK;
+    return events;
 }
 
-/**
- * @brief Get video format information.
- *
- * @param video  Video object
- * @param format V4L2 format object
- *
- * @return
- *      - ESP_OK on success
- *      - Others if failed
- */
-esp_err_t esp_video_get_format(struct esp_video *video, struct v4l2_format *format)
+/* Give back all elements the client holds, the client must be removed from publishing already */
+static void esp_video_client_release_all(struct esp_video *video, struct esp_video_client *client, uint32_t type)
 {
+    uint8_t mask = 1 << (client - video->client);
     struct esp_video_stream *stream;
 
-    CHECK_VIDEO_OBJ(video);
-    CHECK_PARAM(format, ESP_ERR_INVALID_ARG, TAG, "format=NULL");
-
-    stream = esp_video_get_stream(video, format->type);
-    if (!stream) {
-        return ESP_ERR_INVALID_ARG;
+    stream = esp_video_get_stream(video, type);
+    if (!stream || !stream->buffer) {
+        return;
     }
 
-    memcpy(format, &stream->format, sizeof(struct v4l2_format));
+    for (int i = 0; i < stream->buffer->info.count; i++) {
+        struct esp_video_buffer_element *element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, i);
+        bool held;
 
-    return ESP_OK;
+        portENTER_CRITICAL_SAFE(&video->stream_lock);
+        held = element->readers & mask;
+        element->readers &= ~mask;
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+        if (held) {
+            esp_video_queue_element(video, type, element);
+        }
+    }
 }
 
 /**
- * @brief Set video format information.
+ * @brief Subscribe a client to a capture stream, or unsubscribe it if depth is 0.
  *
  * @param video  Video object
- * @param format V4L2 format object
+ * @param client Client object
+ * @param sub    Subscription description
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+esp_err_t esp_video_client_subscribe(struct esp_video *video, struct esp_video_client *client,
+                                     const struct esp_video_buffer_subscribe *sub)
 {
-    esp_err_t ret;
-    struct esp_video_stream *stream;
+    uint32_t type;
+    SemaphoreHandle_t ready_sem;
+    struct esp_video_buffer_element **ring;
 
     CHECK_VIDEO_OBJ(video);
-    CHECK_PARAM(format, ESP_ERR_INVALID_ARG, TAG, "format=NULL");
 
-    stream = esp_video_get_stream(video, format->type);
-    if (!stream) {
-        return ESP_ERR_INVALID_ARG;
-    }
+    if (!sub->depth) {
+        type = client->sub_type;
+        if (!type) {
+            return ESP_ERR_INVALID_STATE;
+        }
 
-    ret = video->ops->set_format(video, format);
+        portENTER_CRITICAL_SAFE(&video->stream_lock);
+        client->sub_type = 0;
+        client->ring_count = 0;
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+        esp_video_client_release_all(video, client, type);
+
+        vSemaphoreDelete(client->ready_sem);
+        heap_caps_free(client->ring);
+        client->ready_sem = NULL;
+        client->ring = NULL;
+
+        return ESP_OK;
+    }
+
+    if (sub->type != V4L2_BUF_TYPE_VIDEO_CAPTURE || (video->caps & V4L2_CAP_VIDEO_M2M)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (client->sub_type) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (sub->depth > UINT8_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ring = heap_caps_calloc(sub->depth, sizeof(struct esp_video_buffer_element *), ALLOC_RAM_ATTR);
+    if (!ring) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ready_sem = xSemaphoreCreateCounting(sub->depth, 0);
+    if (!ready_sem) {
+        heap_caps_free(ring);
+        return ESP_ERR_NO_MEM;
+    }
+
+    client->ring = ring;
+    client->ring_size = sub->depth;
+    client->ring_head = 0;
+    client->ring_count = 0;
+    client->ready_sem = ready_sem;
+
+    /* Done elements are published to the client from now on */
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    client->sub_type = sub->type;
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Receive a done buffer element of the subscribed stream of a client.
+ *
+ * @param video  Video object
+ * @param client Client object
+ * @param ticks  Wait OS tick
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if failed
+ */
+struct esp_video_buffer_element *esp_video_client_recv_element(struct esp_video *video, struct esp_video_client *client,
+                                                               uint32_t ticks)
+{
+    struct esp_video_buffer_element *element = NULL;
+
+    if (xSemaphoreTake(client->ready_sem, (TickType_t)ticks) != pdTRUE) {
+        return NULL;
+    }
+
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    if (client->ring_count) {
+        element = client->ring[client->ring_head];
+        client->ring_head = (client->ring_head + 1) % client->ring_size;
+        client->ring_count--;
+    }
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    return element;
+}
+
+/**
+ * @brief Give a buffer element received by a subscribed client back to the stream.
+ *
+ * @param video  Video object
+ * @param client Client object
+ * @param index  Video buffer element index
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_client_release_element_index(struct esp_video *video, struct esp_video_client *client, int index)
+{
+    uint8_t mask = 1 << (client - video->client);
+    struct esp_video_stream *stream;
+    struct esp_video_buffer_element *element;
+
+    stream = esp_video_get_stream(video, client->sub_type);
+    if (!stream || !stream->buffer || index >= stream->buffer->info.count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index);
+
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    if (!(element->readers & mask)) {
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    element->readers &= ~mask;
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    return esp_video_queue_element(video, client->sub_type, element);
+}
+
+/**
+ * @brief Start capturing video data stream.
+ *
+ * @param video Video object
+ * @param type  Video stream type
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_start_capture(struct esp_video *video, uint32_t type)
+{
+    esp_err_t ret;
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (stream->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (video->ops->start) {
+        ret = video->ops->start(video, type);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "video->ops->start=%x", ret);
+            return ret;
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->start=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    stream->started = true;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Stop capturing video data stream.
+ *
+ * @param video Video object
+ * @param type  Video stream type
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_stop_capture(struct esp_video *video, uint32_t type)
+{
+    esp_err_t ret;
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!stream->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (video->ops->stop) {
+        ret = video->ops->stop(video, type);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "video->ops->stop=%x", ret);
+            return ret;
+        } else {
+            int stream_count = video->caps & V4L2_CAP_VIDEO_M2M ? 2 : 1;
+
+            for (int i = 0; i < stream_count; i++) {
+                struct esp_video_stream *stream = &video->stream[i];
+
+                do {
+                    ret = xSemaphoreTake(stream->ready_sem, 0);
+                } while (ret == pdTRUE);
+
+                esp_video_buffer_ring_reset(&stream->queued_ring);
+                esp_video_buffer_ring_reset(&stream->done_ring);
+
+                esp_video_buffer_reset(stream->buffer);
+            }
+
+            /* Elements held by subscribers are reset together with the stream buffer */
+            for (int i = 0; i < CONFIG_ESP_VIDEO_MAX_CLIENTS; i++) {
+                struct esp_video_client *client = &video->client[i];
+
+                if (client->sub_type == type) {
+                    portENTER_CRITICAL_SAFE(&video->stream_lock);
+                    client->ring_count = 0;
+                    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+                    do {
+                        ret = xSemaphoreTake(client->ready_sem, 0);
+                    } while (ret == pdTRUE);
+                }
+            }
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->stop=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    stream->started = false;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Enumerate video format description.
+ *
+ * @param video  Video object
+ * @param type   Video stream type
+ * @param index  Pixel format index
+ * @param desc   Pixel format enum buffer pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, struct esp_video_format_desc *desc)
+{
+    esp_err_t ret;
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+    CHECK_PARAM(desc, ESP_ERR_INVALID_ARG, TAG, "desc=NULL");
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (video->ops->enum_format) {
+        ret = video->ops->enum_format(video, type, index, &desc->pixel_format);
+        if (ret != ESP_OK) {
+            return ret;
+        } else {
+            ret = esp_video_get_format_desc(desc->pixel_format, desc->description);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "failed to get format description");
+                return ret;
+            }
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->enum_format=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Get video format information.
+ *
+ * @param video  Video object
+ * @param format V4L2 format object
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_format(struct esp_video *video, struct v4l2_format *format)
+{
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+    CHECK_PARAM(format, ESP_ERR_INVALID_ARG, TAG, "format=NULL");
+
+    stream = esp_video_get_stream(video, format->type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(format, &stream->format, sizeof(struct v4l2_format));
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Set video format information.
+ *
+ * @param video  Video object
+ * @param format V4L2 format object
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    esp_err_t ret;
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+    CHECK_PARAM(format, ESP_ERR_INVALID_ARG, TAG, "format=NULL");
+
+    stream = esp_video_get_stream(video, format->type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ret = video->ops->set_format(video, format);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "video->ops->set_format=%x", ret);
         return ret;
@@ -738,21 +1121,121 @@ esp_err_t esp_video_set_format(struct esp_video *video, const struct v4l2_format
 }
 
 /**
- * @brief Setup video buffer.
+ * @brief Setup video buffer.
+ *
+ * @param video Video object
+ * @param type  Video stream type
+ * @param memory_type Video buffer memory type, refer to v4l2_memory in videodev2.h
+ * @param count Video buffer count
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_setup_buffer(struct esp_video *video, uint32_t type, uint32_t memory_type, uint32_t count)
+{
+    struct esp_video_stream *stream;
+    struct esp_video_buffer_info *info;
+    struct esp_video_buffer_info alloc_info;
+
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* buffer_size is configured when setting format */
+
+    info = &stream->buf_info;
+    if (!info->size || !info->align_size || !info->caps) {
+        ESP_LOGE(TAG, "Failed to check buffer information: size=%" PRIu32 " align=%" PRIu32 " cap=%" PRIx32,
+                 info->size, info->align_size, info->caps);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Element rings hold every element of the stream */
+    if (count > ESP_VIDEO_BUFFER_RING_SIZE) {
+        ESP_LOGE(TAG, "Buffer count=%" PRIu32 " is larger than %d", count, ESP_VIDEO_BUFFER_RING_SIZE);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Semaphore of the same count is kept, only emptied below */
+    if (stream->ready_sem && (info->count != count)) {
+        vSemaphoreDelete(stream->ready_sem);
+        stream->ready_sem = NULL;
+    }
+
+    info->count = count;
+    info->memory_type = memory_type;
+    stream->sequence = 0;
+
+    /* Placement policy only affects allocation, device buffer information is kept as it is */
+    memcpy(&alloc_info, info, sizeof(struct esp_video_buffer_info));
+    if (stream->buf_policy.caps) {
+        alloc_info.caps = stream->buf_policy.caps;
+    }
+    alloc_info.hot_count = MIN(stream->buf_policy.hot_count, count);
+    alloc_info.hot_caps = stream->buf_policy.hot_caps;
+    alloc_info.region = stream->buf_policy.mem;
+    alloc_info.region_size = stream->buf_policy.mem_size;
+
+    if (stream->ready_sem) {
+        while (xSemaphoreTake(stream->ready_sem, 0) == pdTRUE) {
+        }
+    } else {
+        stream->ready_sem = xSemaphoreCreateCounting(info->count, 0);
+        if (!stream->ready_sem) {
+            ESP_LOGE(TAG, "Failed to create done_sem for video stream");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    /**
+     * Buffers allocated for a format which is the same or larger are kept, so switching
+     * between resolutions doesn't free and allocate frame buffers every time.
+     */
+    if (stream->buffer) {
+        if (esp_video_buffer_is_reusable(stream->buffer, &alloc_info)) {
+            portENTER_CRITICAL_SAFE(&video->stream_lock);
+            esp_video_buffer_ring_reset(&stream->queued_ring);
+            esp_video_buffer_ring_reset(&stream->done_ring);
+            portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+            esp_video_buffer_reset(stream->buffer);
+            ESP_LOGD(TAG, "Reuse %" PRIu32 " buffers of %" PRIu32 " bytes", count, stream->buffer->info.size);
+            return ESP_OK;
+        }
+
+        esp_video_buffer_destroy(stream->buffer);
+        stream->buffer = NULL;
+    }
+
+    stream->buffer = esp_video_buffer_create(&alloc_info);
+    if (!stream->buffer) {
+        vSemaphoreDelete(stream->ready_sem);
+        stream->ready_sem = NULL;
+        ESP_LOGE(TAG, "Failed to create buffer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Get video buffer count.
  *
  * @param video Video object
  * @param type  Video stream type
- * @param memory_type Video buffer memory type, refer to v4l2_memory in videodev2.h
- * @param count Video buffer count
+ * @param attr  Video stream buffer information pointer
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_setup_buffer(struct esp_video *video, uint32_t type, uint32_t memory_type, uint32_t count)
+esp_err_t esp_video_get_buffer_info(struct esp_video *video, uint32_t type, struct esp_video_buffer_info *info)
 {
     struct esp_video_stream *stream;
-    struct esp_video_buffer_info *info;
 
     CHECK_VIDEO_OBJ(video);
 
@@ -761,270 +1244,621 @@ esp_err_t esp_video_setup_buffer(struct esp_video *video, uint32_t type, uint32_
         return ESP_ERR_INVALID_ARG;
     }
 
-    /* buffer_size is configured when setting format */
+    memcpy(info, &stream->buf_info, sizeof(struct esp_video_buffer_info));
 
-    info = &stream->buf_info;
-    if (!info->size || !info->align_size || !info->caps) {
-        ESP_LOGE(TAG, "Failed to check buffer information: size=%" PRIu32 " align=%" PRIu32 " cap=%" PRIx32,
-                 info->size, info->align_size, info->caps);
+    return ESP_OK;
+}
+
+/**
+ * @brief Set video stream buffer placement policy, it takes effect when setting up buffer next time.
+ *
+ * @param video  Video object
+ * @param policy Video stream buffer placement policy pointer, policy->type selects the stream
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_buffer_policy(struct esp_video *video, const struct esp_video_buffer_policy *policy)
+{
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, policy->type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (stream->started) {
+        ESP_LOGE(TAG, "stream is started, stop it before changing buffer policy");
         return ESP_ERR_INVALID_STATE;
     }
 
-    info->count = count;
-    info->memory_type = memory_type;
+    if (policy->hot_count && !policy->hot_caps) {
+        ESP_LOGE(TAG, "hot buffer capability is 0");
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    if (stream->ready_sem) {
-        vSemaphoreDelete(stream->ready_sem);
-        stream->ready_sem = NULL;
+    if (policy->mem && !policy->mem_size) {
+        ESP_LOGE(TAG, "buffer memory size is 0");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    if (stream->buffer) {
-        esp_video_buffer_destroy(stream->buffer);
-        stream->buffer = NULL;
+    /* Dropping one side of an M2M buffer pair breaks input and output pairing */
+    if ((policy->flags & ESP_VIDEO_BUFFER_FLAG_DROP_OLDEST) && (video->caps & V4L2_CAP_VIDEO_M2M)) {
+        ESP_LOGE(TAG, "M2M device doesn't support dropping oldest buffer");
+        return ESP_ERR_NOT_SUPPORTED;
     }
 
-    stream->ready_sem = xSemaphoreCreateCounting(info->count, 0);
-    if (!stream->ready_sem) {
-        ESP_LOGE(TAG, "Failed to create done_sem for video stream");
-        return ESP_ERR_NO_MEM;
+    /* M2M buffer pairs are processed in the order they are queued */
+    if ((policy->flags & ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO) && (video->caps & V4L2_CAP_VIDEO_M2M)) {
+        ESP_LOGE(TAG, "M2M device doesn't support LIFO buffer recycling");
+        return ESP_ERR_NOT_SUPPORTED;
     }
 
-    stream->buffer = esp_video_buffer_create(info);
-    if (!stream->buffer) {
-        vSemaphoreDelete(stream->ready_sem);
-        stream->ready_sem = NULL;
-        ESP_LOGE(TAG, "Failed to create buffer");
-        return ESP_ERR_NO_MEM;
+    memcpy(&stream->buf_policy, policy, sizeof(struct esp_video_buffer_policy));
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Get video stream buffer placement policy.
+ *
+ * @param video  Video object
+ * @param policy Video stream buffer placement policy pointer, policy->type selects the stream
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_buffer_policy(struct esp_video *video, struct esp_video_buffer_policy *policy)
+{
+    uint32_t type = policy->type;
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
     }
 
+    memcpy(policy, &stream->buf_policy, sizeof(struct esp_video_buffer_policy));
+    policy->type = type;
+
     return ESP_OK;
 }
 
 /**
- * @brief Get video buffer count.
+ * @brief Get buffer element from buffer queued list.
+ *
+ * @param video Video object
+ * @param type  Video stream type
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if failed
+ */
+struct esp_video_buffer_element *IRAM_ATTR esp_video_get_queued_element(struct esp_video *video, uint32_t type)
+{
+    struct esp_video_stream *stream;
+    struct esp_video_buffer_element *element = NULL;
+
+    stream = esp_video_stream_of(video, type);
+    if (!stream) {
+        return NULL;
+    }
+
+    if (stream->buf_policy.flags & ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO) {
+        /* The newest element is where esp_video_queue_element() pushes, so its lock is shared */
+        portENTER_CRITICAL_SAFE(&video->stream_lock);
+        element = esp_video_buffer_ring_pop_newest(&stream->queued_ring, stream->buffer);
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+    } else {
+        /* The driver is the only consumer, so no lock is taken in the ISR */
+        element = esp_video_buffer_ring_pop(&stream->queued_ring, stream->buffer);
+    }
+    if (element) {
+        ELEMENT_SET_FREE(element);
+    }
+
+    return element;
+}
+
+/**
+ * @brief Get buffer element's payload from buffer queued list.
+ *
+ * @param video Video object
+ * @param type  Video stream type
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if failed
+ */
+uint8_t *IRAM_ATTR esp_video_get_queued_buffer(struct esp_video *video, uint32_t type)
+{
+    struct esp_video_buffer_element *element;
+
+    element = esp_video_get_queued_element(video, type);
+    if (!element) {
+        return NULL;
+    }
+
+    return element->buffer;
+}
+
+/**
+ * @brief Get buffer element from buffer done list.
+ *
+ * @param video Video object
+ * @param type  Video stream type
+ *
+ * @return
+ *      - Video buffer element object pointer on success
+ *      - NULL if failed
+ */
+struct esp_video_buffer_element *esp_video_get_done_element(struct esp_video *video, uint32_t type)
+{
+    struct esp_video_stream *stream;
+    struct esp_video_buffer_element *element = NULL;
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream) {
+        return NULL;
+    }
+
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    element = esp_video_buffer_ring_pop(&stream->done_ring, stream->buffer);
+    if (element) {
+        ELEMENT_SET_FREE(element);
+    }
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    return element;
+}
+
+/* Hand a done element to every subscribed client with free ring space, must be called in stream lock */
+static uint8_t IRAM_ATTR esp_video_publish_element(struct esp_video *video, uint32_t type, struct esp_video_buffer_element *element)
+{
+    uint8_t readers = 0;
+
+    for (int i = 0; i < CONFIG_ESP_VIDEO_MAX_CLIENTS; i++) {
+        struct esp_video_client *client = &video->client[i];
+
+        /* A slow client misses frames, it never blocks the driver or other clients */
+        if (client->sub_type != type || client->ring_count >= client->ring_size) {
+            continue;
+        }
+
+        client->ring[(client->ring_head + client->ring_count) % client->ring_size] = element;
+        client->ring_count++;
+        element->readers |= 1 << i;
+        element->refcount++;
+        readers |= 1 << i;
+    }
+
+    return readers;
+}
+
+/* Lock free check, publishing re-checks the subscription in stream lock */
+static bool IRAM_ATTR esp_video_has_subscriber(struct esp_video *video, uint32_t type)
+{
+    for (int i = 0; i < CONFIG_ESP_VIDEO_MAX_CLIENTS; i++) {
+        if (__atomic_load_n(&video->client[i].sub_type, __ATOMIC_ACQUIRE) == type) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void IRAM_ATTR esp_video_give_ready_sem(SemaphoreHandle_t sem, BaseType_t *wakeup)
+{
+    if (xPortInIsrContext()) {
+        xSemaphoreGiveFromISR(sem, wakeup);
+    } else {
+        xSemaphoreGive(sem);
+    }
+}
+
+/* Finish an element of a stream already looked up, the element must be taken from the queued list */
+static esp_err_t IRAM_ATTR esp_video_finish_element(struct esp_video *video, struct esp_video_stream *stream,
+                                                    uint32_t type, struct esp_video_buffer_element *element)
+{
+    uint8_t readers;
+    BaseType_t wakeup = pdFALSE;
+
+    /* The driver owns the element and is the only producer, so no lock is needed to finish it */
+    if (!ELEMENT_IS_FREE(element)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ELEMENT_SET_ALLOCATED(element);
+    element->sequence = stream->sequence++;
+    if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        ELEMENT_SET_DMA_WRITTEN(element);
+
+        /* Settings changed after this belong to later frames */
+        portENTER_CRITICAL_SAFE(&video->stream_lock);
+        element->meta = video->frame_meta;
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+        element->meta.sequence = element->sequence;
+        element->meta.timestamp = element->timestamp;
+    }
+    element->refcount = 1;
+    element->readers = 0;
+
+    /* Client rings are shared with tasks, the lock is only taken if somebody subscribed */
+    readers = 0;
+    if (esp_video_has_subscriber(video, type)) {
+        portENTER_CRITICAL_SAFE(&video->stream_lock);
+        readers = esp_video_publish_element(video, type, element);
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+    }
+
+    esp_video_buffer_ring_push(&stream->done_ring, element);
+
+    esp_video_give_ready_sem(stream->ready_sem, &wakeup);
+    for (int i = 0; readers; i++) {
+        if (readers & (1 << i)) {
+            esp_video_give_ready_sem(video->client[i].ready_sem, &wakeup);
+            readers &= ~(1 << i);
+        }
+    }
+    esp_video_vfs_select_notify(video, &wakeup);
+
+    if (xPortInIsrContext() && wakeup == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Put element into done lost and give semaphore.
+ *
+ * @param video   Video object
+ * @param type    Video stream type
+ * @param element Video buffer element object get by "esp_video_get_queued_element"
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t IRAM_ATTR esp_video_done_element(struct esp_video *video, uint32_t type, struct esp_video_buffer_element *element)
+{
+    struct esp_video_stream *stream;
+
+    stream = esp_video_stream_of(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return esp_video_finish_element(video, stream, type, element);
+}
+
+/**
+ * @brief Process a video buffer element's payload which receives data done.
+ *
+ * @param video  Video object
+ * @param type   Video stream type
+ * @param buffer Video buffer element's payload
+ * @param n      Video buffer element's payload valid data size
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t IRAM_ATTR esp_video_done_buffer(struct esp_video *video, uint32_t type, uint8_t *buffer, uint32_t n)
+{
+    esp_err_t ret;
+    struct esp_video_stream *stream;
+    struct esp_video_buffer_element *element;
+
+    stream = esp_video_stream_of(video, type);
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    element = esp_video_buffer_get_element_by_buffer(stream->buffer, buffer);
+    if (element) {
+        /* Capture devices call this from the frame end callback, so this is the frame end time */
+        element->timestamp = esp_timer_get_time();
+        element->valid_size = n;
+        ret = esp_video_finish_element(video, stream, type, element);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Put buffer element into queued list.
  *
- * @param video Video object
- * @param type  Video stream type
- * @param attr  Video stream buffer information pointer
+ * @param video   Video object
+ * @param type    Video stream type
+ * @param element Video buffer element
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_get_buffer_info(struct esp_video *video, uint32_t type, struct esp_video_buffer_info *info)
+esp_err_t esp_video_queue_element(struct esp_video *video, uint32_t type, struct esp_video_buffer_element *element)
 {
+    uint32_t val = type;
     struct esp_video_stream *stream;
 
-    CHECK_VIDEO_OBJ(video);
-
     stream = esp_video_get_stream(video, type);
     if (!stream) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    memcpy(info, &stream->buf_info, sizeof(struct esp_video_buffer_info));
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    /* Element goes back to the driver when the last of the owner and subscribed clients gives it */
+    if (element->refcount > 1) {
+        element->refcount--;
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+        return ESP_OK;
+    }
+
+    if (!ELEMENT_IS_FREE(element)) {
+        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    element->refcount = 0;
+    ELEMENT_SET_ALLOCATED(element);
+    esp_video_buffer_ring_push(&stream->queued_ring, element);
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    if (video->ops->notify) {
+        video->ops->notify(video, ESP_VIDEO_BUFFER_VALID, &val);
+    }
 
     return ESP_OK;
 }
 
 /**
- * @brief Get buffer element from buffer queued list.
+ * @brief Set buffer element timestamp, M2M source stream timestamp is copied to destination stream.
  *
- * @param video Video object
- * @param type  Video stream type
+ * @param video     Video object
+ * @param type      Video stream type
+ * @param index     Video buffer element index
+ * @param timestamp Timestamp in microseconds
  *
  * @return
- *      - Video buffer element object pointer on success
- *      - NULL if failed
+ *      - ESP_OK on success
+ *      - Others if failed
  */
-struct esp_video_buffer_element *IRAM_ATTR esp_video_get_queued_element(struct esp_video *video, uint32_t type)
+esp_err_t esp_video_set_element_index_timestamp(struct esp_video *video, uint32_t type, int index, int64_t timestamp)
 {
     struct esp_video_stream *stream;
-    struct esp_video_buffer_element *element = NULL;
 
     stream = esp_video_get_stream(video, type);
-    if (!stream) {
-        return NULL;
+    if (!stream || !stream->buffer || index >= stream->buffer->info.count) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    portENTER_CRITICAL_SAFE(&video->stream_lock);
-    if (!SLIST_EMPTY(&stream->queued_list)) {
-        element = SLIST_FIRST(&stream->queued_list);
-        SLIST_REMOVE(&stream->queued_list, element, esp_video_buffer_element, node);
-        ELEMENT_SET_FREE(element);
-    }
-    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+    ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index)->timestamp = timestamp;
 
-    return element;
+    return ESP_OK;
 }
 
 /**
- * @brief Get buffer element's payload from buffer queued list.
+ * @brief Set valid data size of a buffer element, e.g. of a compressed image queued to an M2M decoder.
  *
- * @param video Video object
- * @param type  Video stream type
+ * @param video     Video object
+ * @param type      Video stream type
+ * @param index     Video buffer element index
+ * @param size      Valid data size, 0 if the whole buffer is valid
  *
  * @return
- *      - Video buffer element object pointer on success
- *      - NULL if failed
+ *      - ESP_OK on success
+ *      - Others if failed
  */
-uint8_t *IRAM_ATTR esp_video_get_queued_buffer(struct esp_video *video, uint32_t type)
+esp_err_t esp_video_set_element_index_valid_size(struct esp_video *video, uint32_t type, int index, uint32_t size)
 {
-    struct esp_video_buffer_element *element;
+    struct esp_video_stream *stream;
 
-    element = esp_video_get_queued_element(video, type);
-    if (!element) {
-        return NULL;
+    stream = esp_video_get_stream(video, type);
+    if (!stream || !stream->buffer || index >= stream->buffer->info.count || size > stream->buffer->info.size) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    return element->buffer;
+    ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index)->valid_size = size;
+
+    return ESP_OK;
 }
 
 /**
- * @brief Get buffer element from buffer done list.
+ * @brief Put buffer element index into queued list.
  *
- * @param video Video object
- * @param type  Video stream type
+ * @param video   Video object
+ * @param type    Video stream type
+ * @param index   Video buffer element index
  *
  * @return
- *      - Video buffer element object pointer on success
- *      - NULL if failed
+ *      - ESP_OK on success
+ *      - Others if failed
  */
-struct esp_video_buffer_element *esp_video_get_done_element(struct esp_video *video, uint32_t type)
+esp_err_t esp_video_queue_element_index(struct esp_video *video, uint32_t type, int index)
 {
+    esp_err_t ret;
     struct esp_video_stream *stream;
-    struct esp_video_buffer_element *element = NULL;
+    struct esp_video_buffer_element *element;
 
     stream = esp_video_get_stream(video, type);
     if (!stream) {
-        return NULL;
+        return ESP_ERR_INVALID_ARG;
     }
 
-    portENTER_CRITICAL_SAFE(&video->stream_lock);
-    if (!SLIST_EMPTY(&stream->done_list)) {
-        element = SLIST_FIRST(&stream->done_list);
-        SLIST_REMOVE(&stream->done_list, element, esp_video_buffer_element, node);
-        ELEMENT_SET_FREE(element);
+    element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index);
+
+    /* Only what CPU wrote since the last hand-off is written back */
+    ret = esp_video_buffer_element_writeback(element);
+    if (ret != ESP_OK) {
+        return ret;
     }
-    portEXIT_CRITICAL_SAFE(&video->stream_lock);
 
-    return element;
+    ret = esp_video_queue_element(video, type, element);
+
+    return ret;
 }
 
 /**
- * @brief Put element into done lost and give semaphore.
+ * @brief Synchronize CPU cache of a range of buffer element.
  *
  * @param video   Video object
- * @param type    Video stream type
- * @param element Video buffer element object get by "esp_video_get_queued_element"
+ * @param sync    Buffer synchronization description
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t IRAM_ATTR esp_video_done_element(struct esp_video *video, uint32_t type, struct esp_video_buffer_element *element)
+esp_err_t esp_video_sync_element_index(struct esp_video *video, const struct esp_video_buffer_sync *sync)
 {
+    esp_err_t ret = ESP_OK;
     struct esp_video_stream *stream;
+    struct esp_video_buffer_element *element;
 
-    stream = esp_video_get_stream(video, type);
-    if (!stream) {
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, sync->type);
+    if (!stream || !stream->buffer || (sync->index >= stream->buffer->info.count)) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    portENTER_CRITICAL_SAFE(&video->stream_lock);
-    if (!ELEMENT_IS_FREE(element)) {
-        portEXIT_CRITICAL_SAFE(&video->stream_lock);
+    if (!(sync->flags & (ESP_VIDEO_BUFFER_SYNC_CPU_WRITE | ESP_VIDEO_BUFFER_SYNC_CPU_READ))) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    ELEMENT_SET_ALLOCATED(element);
-    SLIST_INSERT_HEAD(&stream->done_list, element, node);
-    portEXIT_CRITICAL_SAFE(&video->stream_lock);
-
-    if (xPortInIsrContext()) {
-        BaseType_t wakeup = pdFALSE;
+    /* The driver owns queued and done elements */
+    element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, sync->index);
+    if (!ELEMENT_IS_FREE(element)) {
+        return ESP_ERR_INVALID_STATE;
+    }
 
-        xSemaphoreGiveFromISR(stream->ready_sem, &wakeup);
-        if (wakeup == pdTRUE) {
-            portYIELD_FROM_ISR();
+    if (sync->flags & ESP_VIDEO_BUFFER_SYNC_CPU_READ) {
+        ret = esp_video_buffer_element_invalidate(element, sync->offset, sync->size);
+        if (ret != ESP_OK) {
+            return ret;
         }
-    } else {
-        xSemaphoreGive(stream->ready_sem);
     }
 
-    return ESP_OK;
+    if (sync->flags & ESP_VIDEO_BUFFER_SYNC_CPU_WRITE) {
+        ret = esp_video_buffer_element_mark_dirty(element, sync->offset, sync->size);
+    }
+
+    return ret;
 }
 
 /**
- * @brief Process a video buffer element's payload which receives data done.
+ * @brief Get the metadata of a capture buffer element.
  *
- * @param video  Video object
- * @param type   Video stream type
- * @param buffer Video buffer element's payload
- * @param n      Video buffer element's payload valid data size
+ * @param video   Video object
+ * @param meta    Frame metadata, type and index select the buffer element
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t IRAM_ATTR esp_video_done_buffer(struct esp_video *video, uint32_t type, uint8_t *buffer, uint32_t n)
+esp_err_t esp_video_get_element_index_meta(struct esp_video *video, struct esp_video_frame_meta *meta)
 {
-    esp_err_t ret;
+    uint32_t type = meta->type;
+    uint32_t index = meta->index;
     struct esp_video_stream *stream;
     struct esp_video_buffer_element *element;
 
-    stream = esp_video_get_stream(video, type);
-    if (!stream) {
+    CHECK_VIDEO_OBJ(video);
+
+    if (type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    element = esp_video_buffer_get_element_by_buffer(stream->buffer, buffer);
-    if (element) {
-        element->valid_size = n;
-        ret = esp_video_done_element(video, type, element);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    } else {
+    stream = esp_video_get_stream(video, type);
+    if (!stream || !stream->buffer || (index >= stream->buffer->info.count)) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Written when the element is done, the application reads it while it holds the buffer */
+    element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index);
+    *meta = element->meta;
+    meta->type = type;
+    meta->index = index;
+
     return ESP_OK;
 }
 
 /**
- * @brief Put buffer element into queued list.
+ * @brief Update the capture settings which are copied into buffer elements done from now on.
  *
  * @param video   Video object
- * @param type    Video stream type
- * @param element Video buffer element
+ * @param meta    Frame metadata, only fields given by meta->flags are updated
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_queue_element(struct esp_video *video, uint32_t type, struct esp_video_buffer_element *element)
+esp_err_t esp_video_set_frame_meta(struct esp_video *video, const struct esp_video_frame_meta *meta)
 {
-    uint32_t val = type;
-    struct esp_video_stream *stream;
+    struct esp_video_frame_meta *cur;
 
-    stream = esp_video_get_stream(video, type);
-    if (!stream) {
+    CHECK_VIDEO_OBJ(video);
+
+    if (meta->type != V4L2_BUF_TYPE_VIDEO_CAPTURE || !esp_video_get_stream(video, meta->type)) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    cur = &video->frame_meta;
+
     portENTER_CRITICAL_SAFE(&video->stream_lock);
-    if (!ELEMENT_IS_FREE(element)) {
-        portEXIT_CRITICAL_SAFE(&video->stream_lock);
-        return ESP_ERR_INVALID_ARG;
+    if (meta->flags & ESP_VIDEO_FRAME_META_EXPOSURE) {
+        cur->exposure_us = meta->exposure_us;
     }
-
-    ELEMENT_SET_ALLOCATED(element);
-    SLIST_INSERT_HEAD(&stream->queued_list, element, node);
+    if (meta->flags & ESP_VIDEO_FRAME_META_GAIN) {
+        cur->gain = meta->gain;
+    }
+    if (meta->flags & ESP_VIDEO_FRAME_META_WB) {
+        cur->red_gain = meta->red_gain;
+        cur->blue_gain = meta->blue_gain;
+    }
+    if (meta->flags & ESP_VIDEO_FRAME_META_STATS) {
+        cur->stats_seq = meta->stats_seq;
+        cur->luma = meta->luma;
+        cur->dark = meta->dark;
+        cur->bright = meta->bright;
+    }
+    if (meta->flags & ESP_VIDEO_FRAME_META_AE_GRID) {
+        cur->ae_seq = meta->ae_seq;
+        memcpy(cur->ae_luma, meta->ae_luma, sizeof(cur->ae_luma));
+    }
+    cur->flags |= meta->flags;
     portEXIT_CRITICAL_SAFE(&video->stream_lock);
 
-    if (video->ops->notify) {
-        video->ops->notify(video, ESP_VIDEO_BUFFER_VALID, &val);
+    return ESP_OK;
+}
+
+/* Check that a buffer not allocated by this stream fits its alignment, size and memory placement */
+static esp_err_t esp_video_check_import_buffer(const struct esp_video_buffer_info *info, uint8_t *buffer, uint32_t size)
+{
+    if ((((uintptr_t)buffer) % info->align_size) ||
+            (size < info->size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (info->caps & MALLOC_CAP_SPIRAM) {
+        if (!esp_video_port_ptr_psram(buffer)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    } else if (info->caps & MALLOC_CAP_INTERNAL) {
+        if (!esp_video_port_ptr_internal(buffer)) {
+            return ESP_ERR_INVALID_ARG;
+        }
     }
 
     return ESP_OK;
@@ -1036,15 +1870,18 @@ esp_err_t esp_video_queue_element(struct esp_video *video, uint32_t type, struct
  * @param video   Video object
  * @param type    Video stream type
  * @param index   Video buffer element index
+ * @param buffer  Receive buffer pointer from user space
+ * @param size    Receive buffer size
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_queue_element_index(struct esp_video *video, uint32_t type, int index)
+esp_err_t esp_video_queue_element_index_buffer(struct esp_video *video, uint32_t type, int index, uint8_t *buffer, uint32_t size)
 {
     esp_err_t ret;
     struct esp_video_stream *stream;
+    struct esp_video_buffer_info *info;
     struct esp_video_buffer_element *element;
 
     stream = esp_video_get_stream(video, type);
@@ -1053,6 +1890,19 @@ esp_err_t esp_video_queue_element_index(struct esp_video *video, uint32_t type,
     }
 
     element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index);
+    info = &stream->buffer->info;
+
+    if (info->memory_type != V4L2_MEMORY_USERPTR) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ret = esp_video_check_import_buffer(info, buffer, size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    element->buffer = buffer;
+    element->valid_size = size;
 
     ret = esp_video_queue_element(video, type, element);
 
@@ -1060,51 +1910,113 @@ esp_err_t esp_video_queue_element_index(struct esp_video *video, uint32_t type,
 }
 
 /**
- * @brief Put buffer element index into queued list.
+ * @brief Export buffer element as a handle which other video devices can import by
+ *        V4L2_MEMORY_DMABUF.
  *
  * @param video   Video object
  * @param type    Video stream type
  * @param index   Video buffer element index
- * @param buffer  Receive buffer pointer from user space
- * @param size    Receive buffer size
+ * @param fd      Exported buffer handle pointer
  *
  * @return
  *      - ESP_OK on success
  *      - Others if failed
  */
-esp_err_t esp_video_queue_element_index_buffer(struct esp_video *video, uint32_t type, int index, uint8_t *buffer, uint32_t size)
+esp_err_t esp_video_export_element_index(struct esp_video *video, uint32_t type, int index, int *fd)
+{
+    struct esp_video_stream *stream;
+
+    CHECK_VIDEO_OBJ(video);
+
+    stream = esp_video_get_stream(video, type);
+    if (!stream || !stream->buffer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Only buffers allocated by the driver have a known alignment and placement */
+    if ((stream->buffer->info.memory_type != V4L2_MEMORY_MMAP) ||
+            (index < 0) || (index >= stream->buffer->info.count) || (index > 0xff)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *fd = DMABUF_FD(video->id, type, index);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Put buffer element index into queued list, buffer is imported from the
+ *        buffer element of another video device.
+ *
+ * @param video   Video object
+ * @param type    Video stream type
+ * @param index   Video buffer element index
+ * @param fd      Buffer handle exported by esp_video_export_element_index
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_queue_element_index_dmabuf(struct esp_video *video, uint32_t type, int index, int fd)
 {
     esp_err_t ret;
+    struct esp_video *exporter = NULL;
+    struct esp_video *it;
     struct esp_video_stream *stream;
-    struct esp_video_buffer_info *info;
+    struct esp_video_stream *src_stream;
     struct esp_video_buffer_element *element;
+    struct esp_video_buffer_element *src_element;
 
     stream = esp_video_get_stream(video, type);
     if (!stream) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index);
-    info = &stream->buffer->info;
-
-    if ((info->memory_type != V4L2_MEMORY_USERPTR) ||
-            (((uintptr_t)buffer) % info->align_size) ||
-            (size < info->size)) {
+    if (!stream->buffer || (stream->buffer->info.memory_type != V4L2_MEMORY_DMABUF) || !(fd & DMABUF_FD_FLAG)) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (info->caps & MALLOC_CAP_SPIRAM) {
-        if (!esp_ptr_external_ram(buffer)) {
-            return ESP_ERR_INVALID_ARG;
-        }
-    } else if (info->caps & MALLOC_CAP_INTERNAL) {
-        if (!esp_ptr_internal(buffer)) {
-            return ESP_ERR_INVALID_ARG;
+    _lock_acquire(&s_video_lock);
+    SLIST_FOREACH(it, &s_video_list, node) {
+        if (it->id == DMABUF_FD_ID(fd)) {
+            exporter = it;
+            break;
         }
     }
+    _lock_release(&s_video_lock);
+
+    if (!exporter) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    src_stream = esp_video_get_stream(exporter, DMABUF_FD_TYPE(fd));
+    if (!src_stream || !src_stream->buffer ||
+            (src_stream->buffer->info.memory_type != V4L2_MEMORY_MMAP) ||
+            (DMABUF_FD_INDEX(fd) >= src_stream->buffer->info.count)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Exporter must not write the buffer while this device reads it */
+    src_element = ESP_VIDEO_BUFFER_ELEMENT(src_stream->buffer, DMABUF_FD_INDEX(fd));
+    if (!ELEMENT_IS_FREE(src_element)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ret = esp_video_check_import_buffer(&stream->buffer->info, src_element->buffer, src_stream->buffer->info.size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* Cache state belongs to the exporter element, a DMA-to-DMA hand-off normally needs no sync */
+    ret = esp_video_buffer_element_writeback(src_element);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    element->buffer = buffer;
-    element->valid_size = size;
+    element = ESP_VIDEO_BUFFER_ELEMENT(stream->buffer, index);
+    element->buffer = src_element->buffer;
+    element->valid_size = src_element->valid_size;
+    element->dmabuf_fd = fd;
 
     ret = esp_video_queue_element(video, type, element);
 
@@ -1159,7 +2071,7 @@ struct esp_video_buffer_element *esp_video_recv_element(struct esp_video *video,
         return NULL;
     }
 
-    if (video->device_caps & V4L2_CAP_VIDEO_M2M) {
+    if ((video->device_caps & V4L2_CAP_VIDEO_M2M) && !video->m2m_async) {
         uint32_t val = type;
 
         /**
@@ -1180,6 +2092,31 @@ struct esp_video_buffer_element *esp_video_recv_element(struct esp_video *video,
 
     element = esp_video_get_done_element(video, type);
 
+    if (element && (stream->buf_policy.flags & ESP_VIDEO_BUFFER_FLAG_DROP_OLDEST)) {
+        struct esp_video_buffer_element *old_element;
+
+        /**
+         * Keep the newest done element and give older ones back to the driver, the
+         * receiver finds out how many frames are dropped by the sequence number gap.
+         */
+
+        while (xSemaphoreTake(stream->ready_sem, 0) == pdTRUE) {
+            old_element = esp_video_get_done_element(video, type);
+            if (!old_element) {
+                break;
+            }
+
+            if ((int32_t)(old_element->sequence - element->sequence) > 0) {
+                struct esp_video_buffer_element *tmp = element;
+
+                element = old_element;
+                old_element = tmp;
+            }
+
+            esp_video_queue_element(video, type, old_element);
+        }
+    }
+
     return element;
 }
 
@@ -1218,10 +2155,10 @@ esp_err_t esp_video_queue_m2m_elements(struct esp_video *video,
     portENTER_CRITICAL_SAFE(&video->stream_lock);
     if (ELEMENT_IS_FREE(src_element) && ELEMENT_IS_FREE(dst_element)) {
         ELEMENT_SET_ALLOCATED(src_element);
-        SLIST_INSERT_HEAD(&stream[0]->queued_list, src_element, node);
+        esp_video_buffer_ring_push(&stream[0]->queued_ring, src_element);
 
         ELEMENT_SET_ALLOCATED(dst_element);
-        SLIST_INSERT_HEAD(&stream[1]->queued_list, dst_element, node);
+        esp_video_buffer_ring_push(&stream[1]->queued_ring, dst_element);
 
         ret = ESP_OK;
     } else {
@@ -1268,10 +2205,11 @@ esp_err_t esp_video_done_m2m_elements(struct esp_video *video,
     portENTER_CRITICAL_SAFE(&video->stream_lock);
     if (ELEMENT_IS_FREE(src_element) && ELEMENT_IS_FREE(dst_element)) {
         ELEMENT_SET_ALLOCATED(src_element);
-        SLIST_INSERT_HEAD(&stream[0]->done_list, src_element, node);
+        esp_video_buffer_ring_push(&stream[0]->done_ring, src_element);
 
         ELEMENT_SET_ALLOCATED(dst_element);
-        SLIST_INSERT_HEAD(&stream[1]->done_list, dst_element, node);
+        ELEMENT_SET_DMA_WRITTEN(dst_element);
+        esp_video_buffer_ring_push(&stream[1]->done_ring, dst_element);
 
         ret = ESP_OK;
     } else {
@@ -1289,12 +2227,14 @@ esp_err_t esp_video_done_m2m_elements(struct esp_video *video,
             }
 
             xSemaphoreGiveFromISR(stream[1]->ready_sem, &wakeup);
+            esp_video_vfs_select_notify(video, &wakeup);
             if (wakeup == pdTRUE) {
                 portYIELD_FROM_ISR();
             }
         } else {
             xSemaphoreGive(stream[0]->ready_sem);
             xSemaphoreGive(stream[1]->ready_sem);
+            esp_video_vfs_select_notify(video, NULL);
         }
     }
 
@@ -1334,13 +2274,13 @@ esp_err_t esp_video_get_m2m_queued_elements(struct esp_video *video,
     }
 
     portENTER_CRITICAL_SAFE(&video->stream_lock);
-    if (!SLIST_EMPTY(&stream[0]->queued_list) && !SLIST_EMPTY(&stream[1]->queued_list)) {
-        *src_element = SLIST_FIRST(&stream[0]->queued_list);
-        SLIST_REMOVE(&stream[0]->queued_list, *src_element, esp_video_buffer_element, node);
+    if (!esp_video_buffer_ring_is_empty(&stream[0]->queued_ring) &&
+            !esp_video_buffer_ring_is_empty(&stream[1]->queued_ring)) {
+        /* Rings are FIFO, so the oldest pair is processed first and frame order is kept */
+        *src_element = esp_video_buffer_ring_pop(&stream[0]->queued_ring, stream[0]->buffer);
         ELEMENT_SET_FREE(*src_element);
 
-        *dst_element = SLIST_FIRST(&stream[1]->queued_list);
-        SLIST_REMOVE(&stream[1]->queued_list, *dst_element, esp_video_buffer_element, node);
+        *dst_element = esp_video_buffer_ring_pop(&stream[1]->queued_ring, stream[1]->buffer);
         ELEMENT_SET_FREE(*dst_element);
 
         ret = ESP_OK;
@@ -1510,6 +2450,40 @@ esp_err_t esp_video_query_ext_control(struct esp_video *video, struct v4l2_query
     return ESP_OK;
 }
 
+/* Process one source and destination element pair and put them into the done lists */
+static esp_err_t esp_video_m2m_process_elements(struct esp_video *video,
+        uint32_t src_type,
+        struct esp_video_buffer_element *src_element,
+        uint32_t dst_type,
+        struct esp_video_buffer_element *dst_element,
+        esp_video_m2m_process_t proc)
+{
+    esp_err_t ret;
+    uint32_t dst_out_size;
+    uint32_t dst_flags = 0;
+    /* Compressed sources fill only part of the buffer, raw frames may leave the size 0 */
+    uint32_t src_size = src_element->valid_size ? MIN(src_element->valid_size, ELEMENT_SIZE(src_element)) :
+                        ELEMENT_SIZE(src_element);
+
+    ret = proc(video, ELEMENT_BUFFER(src_element), src_size,
+               ELEMENT_BUFFER(dst_element), ELEMENT_SIZE(dst_element), &dst_out_size, &dst_flags);
+    if (ret != ESP_OK) {
+        dst_element->valid_size = 0;
+        dst_element->frame_flags = 0;
+    } else {
+        dst_element->valid_size = dst_out_size;
+        dst_element->frame_flags = dst_flags;
+    }
+    dst_element->timestamp = src_element->timestamp;
+    ret = esp_video_done_m2m_elements(video, src_type, src_element, dst_type, dst_element);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to put elements back into done list");
+        return ret;
+    }
+
+    return ESP_OK;
+}
+
 /**
  * @brief M2M video device process data
  *
@@ -1525,7 +2499,6 @@ esp_err_t esp_video_query_ext_control(struct esp_video *video, struct v4l2_query
 esp_err_t esp_video_m2m_process(struct esp_video *video, uint32_t src_type, uint32_t dst_type, esp_video_m2m_process_t proc)
 {
     esp_err_t ret;
-    uint32_t dst_out_size;
     struct esp_video_buffer_element *dst_element;
     struct esp_video_buffer_element *src_element;
 
@@ -1539,22 +2512,168 @@ esp_err_t esp_video_m2m_process(struct esp_video *video, uint32_t src_type, uint
         return ret;
     }
 
-    ret = proc(video, ELEMENT_BUFFER(src_element), ELEMENT_SIZE(src_element),
-               ELEMENT_BUFFER(dst_element), ELEMENT_SIZE(dst_element), &dst_out_size);
-    if (ret != ESP_OK) {
-        dst_element->valid_size = 0;
-    } else {
-        dst_element->valid_size = dst_out_size;
+    return esp_video_m2m_process_elements(video, src_type, src_element, dst_type, dst_element, proc);
+}
+
+#if CONFIG_ESP_VIDEO_M2M_ASYNC
+static void esp_video_m2m_async_task(void *arg)
+{
+    struct esp_video_m2m_async *async = (struct esp_video_m2m_async *)arg;
+    struct esp_video_buffer_element *dst_element;
+    struct esp_video_buffer_element *src_element;
+
+    while (!async->exit) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* One wake-up may stand for several queued pairs */
+        while (!async->exit &&
+                esp_video_get_m2m_queued_elements(async->video,
+                        async->src_type,
+                        &src_element,
+                        async->dst_type,
+                        &dst_element) == ESP_OK) {
+            if (esp_video_m2m_process_elements(async->video, async->src_type, src_element,
+                                               async->dst_type, dst_element, async->proc) != ESP_OK) {
+                ESP_LOGE(TAG, "failed to process M2M device data");
+            }
+        }
     }
-    ret = esp_video_done_m2m_elements(video, src_type, src_element, dst_type, dst_element);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "failed to put elements back into done list");
-        return ret;
+
+    xSemaphoreGive(async->exit_sem);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Start processing M2M video device data in a background task.
+ *
+ * @param video       Video object
+ * @param src_type    Video resource stream type
+ * @param dst_type    Video destination stream type
+ * @param proc        Video device process callback function
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_m2m_async_start(struct esp_video *video, uint32_t src_type, uint32_t dst_type, esp_video_m2m_process_t proc)
+{
+    BaseType_t os_ret;
+    struct esp_video_m2m_async *async;
+
+    CHECK_VIDEO_OBJ(video);
+
+    if (!(video->caps & V4L2_CAP_VIDEO_M2M) || !proc) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Both streams start the device, the first one creates the task */
+    if (video->m2m_async) {
+        return ESP_OK;
+    }
+
+    async = heap_caps_calloc(1, sizeof(struct esp_video_m2m_async), ALLOC_RAM_ATTR);
+    if (!async) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    async->exit_sem = xSemaphoreCreateBinary();
+    if (!async->exit_sem) {
+        heap_caps_free(async);
+        return ESP_ERR_NO_MEM;
+    }
+
+    async->video = video;
+    async->proc = proc;
+    async->src_type = src_type;
+    async->dst_type = dst_type;
+
+    os_ret = xTaskCreatePinnedToCore(esp_video_m2m_async_task, "video_m2m", CONFIG_ESP_VIDEO_M2M_TASK_STACK_SIZE,
+                                     async, CONFIG_ESP_VIDEO_M2M_TASK_PRIORITY, &async->task,
+                                     CONFIG_ESP_VIDEO_M2M_TASK_CORE >= 0 ? CONFIG_ESP_VIDEO_M2M_TASK_CORE : tskNO_AFFINITY);
+    if (os_ret != pdPASS) {
+        vSemaphoreDelete(async->exit_sem);
+        heap_caps_free(async);
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    video->m2m_async = async;
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    /* Elements may be queued before streaming starts */
+    esp_video_m2m_async_trigger(video);
+
+    return ESP_OK;
+}
+#else
+esp_err_t esp_video_m2m_async_start(struct esp_video *video, uint32_t src_type, uint32_t dst_type, esp_video_m2m_process_t proc)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+/**
+ * @brief Stop processing M2M video device data in a background task, the element pair
+ *        being processed is finished first.
+ *
+ * @param video Video object
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_m2m_async_stop(struct esp_video *video)
+{
+    struct esp_video_m2m_async *async;
+
+    CHECK_VIDEO_OBJ(video);
+
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    async = video->m2m_async;
+    video->m2m_async = NULL;
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    if (!async) {
+        return ESP_OK;
     }
 
+    async->exit = true;
+    xTaskNotifyGive(async->task);
+    xSemaphoreTake(async->exit_sem, portMAX_DELAY);
+
+    vSemaphoreDelete(async->exit_sem);
+    heap_caps_free(async);
+
     return ESP_OK;
 }
 
+/**
+ * @brief Wake up the M2M background process task after buffer elements are queued.
+ *
+ * @param video Video object
+ *
+ * @return None
+ */
+void esp_video_m2m_async_trigger(struct esp_video *video)
+{
+    BaseType_t wakeup = pdFALSE;
+
+    /* The ISR variant doesn't yield, so it is safe inside the stream lock */
+    portENTER_CRITICAL_SAFE(&video->stream_lock);
+    if (video->m2m_async) {
+        vTaskNotifyGiveFromISR(video->m2m_async->task, &wakeup);
+    }
+    portEXIT_CRITICAL_SAFE(&video->stream_lock);
+
+    if (wakeup == pdTRUE) {
+        if (xPortInIsrContext()) {
+            portYIELD_FROM_ISR();
+        } else {
+            portYIELD();
+        }
+    }
+}
+
 /**
  * @brief Set format to sensor
  *
@@ -1615,6 +2734,52 @@ esp_err_t esp_video_get_sensor_format(struct esp_video *video, esp_cam_sensor_fo
     return ESP_OK;
 }
 
+/**
+ * @brief Write a register of the sensor
+ *
+ * @param video Video object
+ * @param reg   Register address, size and value, match selects the sensor
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED if the device has no register access
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_register(struct esp_video *video, const struct v4l2_dbg_register *reg)
+{
+    CHECK_VIDEO_OBJ(video);
+
+    if (!video->ops->set_register) {
+        ESP_LOGD(TAG, "video->ops->set_register=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return video->ops->set_register(video, reg);
+}
+
+/**
+ * @brief Read a register of the sensor
+ *
+ * @param video Video object
+ * @param reg   Register address and size, filled with the value
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED if the device has no register access
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_register(struct esp_video *video, struct v4l2_dbg_register *reg)
+{
+    CHECK_VIDEO_OBJ(video);
+
+    if (!video->ops->get_register) {
+        ESP_LOGD(TAG, "video->ops->get_register=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return video->ops->get_register(video, reg);
+}
+
 /**
  * @brief Query menu value
  *
@@ -1644,3 +2809,123 @@ esp_err_t esp_video_query_menu(struct esp_video *video, struct v4l2_querymenu *q
 
     return ESP_OK;
 }
+
+/**
+ * @brief Set video stream parameters, e.g. frame interval.
+ *
+ * @param video Video object
+ * @param parm  Stream parameters, filled with the values applied by the driver
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    esp_err_t ret;
+
+    CHECK_VIDEO_OBJ(video);
+
+    if (video->ops->set_parm) {
+        ret = video->ops->set_parm(video, parm);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "video->ops->set_parm=%x", ret);
+            return ret;
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->set_parm=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Get video stream parameters.
+ *
+ * @param video Video object
+ * @param parm  Stream parameters buffer pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    esp_err_t ret;
+
+    CHECK_VIDEO_OBJ(video);
+
+    if (video->ops->get_parm) {
+        ret = video->ops->get_parm(video, parm);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "video->ops->get_parm=%x", ret);
+            return ret;
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->get_parm=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Set video selection rectangle, e.g. crop window.
+ *
+ * @param video Video object
+ * @param sel   Selection, filled with the rectangle applied by the driver
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_set_selection(struct esp_video *video, struct v4l2_selection *sel)
+{
+    esp_err_t ret;
+
+    CHECK_VIDEO_OBJ(video);
+
+    if (video->ops->set_selection) {
+        ret = video->ops->set_selection(video, sel);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "video->ops->set_selection=%x", ret);
+            return ret;
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->set_selection=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Get video selection rectangle.
+ *
+ * @param video Video object
+ * @param sel   Selection buffer pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_get_selection(struct esp_video *video, struct v4l2_selection *sel)
+{
+    esp_err_t ret;
+
+    CHECK_VIDEO_OBJ(video);
+
+    if (video->ops->get_selection) {
+        ret = video->ops->get_selection(video, sel);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "video->ops->get_selection=%x", ret);
+            return ret;
+        }
+    } else {
+        ESP_LOGD(TAG, "video->ops->get_selection=NULL");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ESP_OK;
+}
@@ -6,16 +6,189 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include <sys/lock.h>
+#include <sys/param.h>
 #include "linux/videodev2.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "memstat.h"
 #include "esp_video_buffer.h"
+#include "esp_video_port.h"
 
 #define ESP_VIDEO_BUFFER_ALIGN(s, a)      (((s) + ((a) - 1)) & (~((a) - 1)))
 
 static const char *TAG = "esp_video_buffer";
 
+#if CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE > 0
+/* Buffer memory of a destroyed video buffer, kept for the next one of the same kind */
+struct esp_video_buffer_pool_block {
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t align_size;
+    uint32_t caps;
+};
+
+static _lock_t s_pool_lock;
+static struct esp_video_buffer_pool_block s_pool[CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE];
+#endif
+
+/**
+ * @brief Free the buffer memory kept by the pool for reuse
+ *
+ * @return Number of freed buffers
+ */
+uint32_t esp_video_buffer_pool_flush(void)
+{
+    uint32_t count = 0;
+
+#if CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE > 0
+    _lock_acquire(&s_pool_lock);
+    for (int i = 0; i < CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE; i++) {
+        if (s_pool[i].buffer) {
+            memstat_free(MEMSTAT_VIDEO_BUF, s_pool[i].buffer);
+            s_pool[i].buffer = NULL;
+            count++;
+        }
+    }
+    _lock_release(&s_pool_lock);
+#endif
+
+    return count;
+}
+
+static uint8_t *esp_video_buffer_alloc(uint32_t size, uint32_t align_size, uint32_t caps)
+{
+    uint8_t *buffer = NULL;
+
+#if CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE > 0
+    _lock_acquire(&s_pool_lock);
+    for (int i = 0; i < CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE; i++) {
+        struct esp_video_buffer_pool_block *block = &s_pool[i];
+
+        if (block->buffer && (block->size == size) && (block->align_size == align_size) && (block->caps == caps)) {
+            buffer = block->buffer;
+            block->buffer = NULL;
+            break;
+        }
+    }
+    _lock_release(&s_pool_lock);
+
+    if (buffer) {
+        return buffer;
+    }
+#endif
+
+    buffer = memstat_aligned_alloc(MEMSTAT_VIDEO_BUF, align_size, size, caps);
+#if CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE > 0
+    /* Blocks kept for other kinds of buffer may be what the heap is short of */
+    if (!buffer && esp_video_buffer_pool_flush()) {
+        buffer = memstat_aligned_alloc(MEMSTAT_VIDEO_BUF, align_size, size, caps);
+    }
+#endif
+
+    return buffer;
+}
+
+static void esp_video_buffer_free(uint8_t *buffer, uint32_t size, uint32_t align_size, uint32_t caps)
+{
+#if CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE > 0
+    _lock_acquire(&s_pool_lock);
+    for (int i = 0; i < CONFIG_ESP_VIDEO_BUFFER_POOL_SIZE; i++) {
+        struct esp_video_buffer_pool_block *block = &s_pool[i];
+
+        if (!block->buffer) {
+            block->buffer = buffer;
+            block->size = size;
+            block->align_size = align_size;
+            block->caps = caps;
+            buffer = NULL;
+            break;
+        }
+    }
+    _lock_release(&s_pool_lock);
+#endif
+
+    /* Pool is full */
+    if (buffer) {
+        memstat_free(MEMSTAT_VIDEO_BUF, buffer);
+    }
+}
+
+/**
+ * Elements without memory yet share one block, so a stream costs one allocation and its frames
+ * sit next to each other. If the heap has no block that large, elements are allocated one by one.
+ */
+static esp_err_t esp_video_buffer_carve_slab(struct esp_video_buffer *buffer)
+{
+    uint8_t *ptr;
+    uint32_t stride;
+    uint32_t align;
+    uint32_t count = 0;
+    const struct esp_video_buffer_info *info = &buffer->info;
+    uint32_t caps = info->region ? (esp_video_port_ptr_psram(info->region) ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) : info->caps;
+
+    for (int i = 0; i < info->count; i++) {
+        if (!buffer->element[i].buffer) {
+            count++;
+        }
+    }
+
+    if (!count) {
+        return ESP_OK;
+    }
+
+    /* Neighbouring frames must not share a cache line */
+    align = MAX(info->align_size, esp_video_port_cache_align(caps));
+    stride = ESP_VIDEO_BUFFER_ALIGN(info->size, align);
+
+    if (info->region) {
+        if (((uintptr_t)info->region & (align - 1)) || ((uint64_t)stride * count > info->region_size)) {
+            ESP_LOGE(TAG, "Memory %p of %" PRIu32 " bytes can't hold %" PRIu32 " buffers of %" PRIu32 " bytes aligned to %" PRIu32,
+                     info->region, info->region_size, count, stride, align);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        ptr = info->region;
+    } else {
+        ptr = esp_video_buffer_alloc(stride * count, align, info->caps);
+        if (!ptr) {
+            ESP_LOGD(TAG, "No block of %" PRIu32 " bytes, allocate buffers one by one", stride * count);
+
+            for (int i = 0; i < info->count; i++) {
+                struct esp_video_buffer_element *element = &buffer->element[i];
+
+                if (!element->buffer) {
+                    element->buffer = esp_video_buffer_alloc(info->size, info->align_size, info->caps);
+                    if (!element->buffer) {
+                        return ESP_ERR_NO_MEM;
+                    }
+                    element->caps = info->caps;
+                }
+            }
+
+            return ESP_OK;
+        }
+
+        buffer->slab_allocated = true;
+    }
+
+    buffer->slab = ptr;
+    buffer->slab_size = stride * count;
+    buffer->slab_align = align;
+
+    for (int i = 0; i < info->count; i++) {
+        struct esp_video_buffer_element *element = &buffer->element[i];
+
+        if (!element->buffer) {
+            element->buffer = ptr;
+            ptr += stride;
+        }
+    }
+
+    return ESP_OK;
+}
+
 /**
  * @brief Create video buffer object.
  *
@@ -31,47 +204,43 @@ struct esp_video_buffer *esp_video_buffer_create(const struct esp_video_buffer_i
     struct esp_video_buffer *buffer;
 
     size = sizeof(struct esp_video_buffer) + sizeof(struct esp_video_buffer_element) * info->count;
-    buffer = heap_caps_calloc(1, size, info->caps);
+    buffer = memstat_calloc(MEMSTAT_VIDEO_BUF, 1, size, info->caps);
     if (!buffer) {
         ESP_LOGE(TAG, "Failed to malloc for video buffer");
         return NULL;
     }
 
+    memcpy(&buffer->info, info, sizeof(struct esp_video_buffer_info));
+
     for (int i = 0; i < info->count; i++) {
         struct esp_video_buffer_element *element = &buffer->element[i];
 
-        if (info->memory_type == V4L2_MEMORY_MMAP) {
-            element->buffer = heap_caps_aligned_alloc(info->align_size, info->size, info->caps);
+        element->index = i;
+        element->video_buffer = buffer;
+        element->buffer = NULL;
+        ELEMENT_SET_FREE(element);
+    }
+
+    if (info->memory_type == V4L2_MEMORY_MMAP) {
+        /* Hot buffers are blocks of their own memory, the others are carved from the slab */
+        for (int i = 0; (i < info->hot_count) && info->hot_caps; i++) {
+            struct esp_video_buffer_element *element = &buffer->element[i];
+
+            element->buffer = esp_video_buffer_alloc(info->size, info->align_size, info->hot_caps);
             if (element->buffer) {
-                element->index = i;
-                element->video_buffer = buffer;
-                ELEMENT_SET_FREE(element);
+                element->caps = info->hot_caps;
             } else {
-                goto exit_0;
+                ESP_LOGD(TAG, "No hot memory for buffer %d, use default caps", i);
             }
-        } else {
-            element->index = i;
-            element->video_buffer = buffer;
-            element->buffer = NULL;
-            ELEMENT_SET_FREE(element);
         }
-    }
-
-    memcpy(&buffer->info, info, sizeof(struct esp_video_buffer_info));
-
-    return buffer;
-
-exit_0:
-    for (int i = 0; i < info->count; i++) {
-        struct esp_video_buffer_element *element = &buffer->element[i];
 
-        if (element->buffer) {
-            heap_caps_free(element->buffer);
+        if (esp_video_buffer_carve_slab(buffer) != ESP_OK) {
+            esp_video_buffer_destroy(buffer);
+            return NULL;
         }
     }
 
-    heap_caps_free(buffer);
-    return NULL;
+    return buffer;
 }
 
 /**
@@ -85,11 +254,51 @@ exit_0:
  */
 struct esp_video_buffer *esp_video_buffer_clone(const struct esp_video_buffer *buffer)
 {
+    struct esp_video_buffer_info info;
+
     if (!buffer) {
         return NULL;
     }
 
-    return esp_video_buffer_create(&buffer->info);
+    /* Caller memory holds the one buffer it was given to */
+    memcpy(&info, &buffer->info, sizeof(struct esp_video_buffer_info));
+    info.region = NULL;
+    info.region_size = 0;
+
+    return esp_video_buffer_create(&info);
+}
+
+/**
+ * @brief Check if video buffer object can be used for a new buffer information.
+ *
+ * @param buffer Video buffer object
+ * @param info   New buffer information pointer
+ *
+ * @return
+ *      - true if the existing buffer elements meet the new buffer information
+ *      - false if the video buffer must be re-created
+ */
+bool esp_video_buffer_is_reusable(const struct esp_video_buffer *buffer, const struct esp_video_buffer_info *info)
+{
+    const struct esp_video_buffer_info *cur = &buffer->info;
+
+    if ((cur->count != info->count) || (cur->memory_type != info->memory_type)) {
+        return false;
+    }
+
+    if (info->memory_type == V4L2_MEMORY_MMAP) {
+        if ((cur->size < info->size) ||
+                (cur->align_size != info->align_size) ||
+                (cur->caps != info->caps) ||
+                (cur->hot_count != info->hot_count) ||
+                (cur->hot_caps != info->hot_caps) ||
+                (cur->region != info->region) ||
+                (cur->region_size != info->region_size)) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 /**
@@ -105,11 +314,19 @@ esp_err_t esp_video_buffer_destroy(struct esp_video_buffer *buffer)
 {
     if (buffer->info.memory_type == V4L2_MEMORY_MMAP) {
         for (int i = 0; i < buffer->info.count; i++) {
-            heap_caps_free(buffer->element[i].buffer);
+            struct esp_video_buffer_element *element = &buffer->element[i];
+
+            if (element->buffer && element->caps) {
+                esp_video_buffer_free(element->buffer, buffer->info.size, buffer->info.align_size, element->caps);
+            }
+        }
+
+        if (buffer->slab_allocated) {
+            esp_video_buffer_free(buffer->slab, buffer->slab_size, buffer->slab_align, buffer->info.caps);
         }
     }
 
-    heap_caps_free(buffer);
+    memstat_free(MEMSTAT_VIDEO_BUF, buffer);
 
     return ESP_OK;
 }
@@ -148,5 +365,140 @@ void esp_video_buffer_reset(struct esp_video_buffer *buffer)
     for (int i = 0; i < buffer->info.count; i++) {
         ELEMENT_SET_FREE(&buffer->element[i]);
         buffer->element[i].valid_size = 0;
+        buffer->element[i].frame_flags = 0;
+        buffer->element[i].refcount = 0;
+        buffer->element[i].readers = 0;
     }
 }
+
+/* Cache line size of the element buffer memory, 0 if the memory is not cached */
+static size_t esp_video_buffer_element_cache_align(const struct esp_video_buffer_element *element)
+{
+    return esp_video_port_cache_align(esp_video_port_ptr_psram(element->buffer) ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+}
+
+/**
+ * @brief Record that CPU wrote a range of the element buffer, the range is written back
+ *        by esp_video_buffer_element_writeback.
+ *
+ * @param element Video buffer element object
+ * @param offset  Start offset of the written range
+ * @param size    Size of the written range
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_buffer_element_mark_dirty(struct esp_video_buffer_element *element, uint32_t offset, uint32_t size)
+{
+    uint32_t buf_size = element->video_buffer->info.size;
+
+    if (!element->buffer || !size || (offset >= buf_size) || (size > buf_size - offset)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Several overlays in one frame are merged into one range */
+    if (ELEMENT_IS_CPU_DIRTY(element)) {
+        element->dirty_start = MIN(element->dirty_start, offset);
+        element->dirty_end = MAX(element->dirty_end, offset + size);
+    } else {
+        element->dirty_start = offset;
+        element->dirty_end = offset + size;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Write back the CPU written range of the element buffer before DMA accesses it,
+ *        nothing is done if CPU didn't write the buffer.
+ *
+ * @param element Video buffer element object
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_buffer_element_writeback(struct esp_video_buffer_element *element)
+{
+    esp_err_t ret;
+    size_t align;
+    uint32_t start;
+    uint32_t end;
+
+    if (!ELEMENT_IS_CPU_DIRTY(element)) {
+        return ESP_OK;
+    }
+
+    align = esp_video_buffer_element_cache_align(element);
+    if (align) {
+        start = element->dirty_start & ~(align - 1);
+        end = ESP_VIDEO_BUFFER_ALIGN(element->dirty_end, align);
+
+        ret = esp_video_port_writeback(element->buffer + start, end - start);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to write back buffer %" PRIu32 " range [%" PRIu32 ", %" PRIu32 ")",
+                     element->index, start, end);
+            return ret;
+        }
+    }
+
+    element->dirty_start = 0;
+    element->dirty_end = 0;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Invalidate CPU cache of a range of the element buffer before CPU reads it,
+ *        nothing is done if DMA didn't write the buffer since the last invalidation.
+ *
+ * @param element Video buffer element object
+ * @param offset  Start offset of the range to read
+ * @param size    Size of the range to read
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_buffer_element_invalidate(struct esp_video_buffer_element *element, uint32_t offset, uint32_t size)
+{
+    esp_err_t ret;
+    size_t align;
+    uint32_t start;
+    uint32_t end;
+    uint32_t buf_size = element->video_buffer->info.size;
+
+    if (!element->buffer || !size || (offset >= buf_size) || (size > buf_size - offset)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!(element->cache_flags & ELEMENT_CACHE_DMA_WRITTEN)) {
+        return ESP_OK;
+    }
+
+    align = esp_video_buffer_element_cache_align(element);
+    if (align) {
+        /* Lines partly outside of the range are invalidated too, only whole driver buffers are safe */
+        if (element->video_buffer->info.memory_type != V4L2_MEMORY_MMAP) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        start = offset & ~(align - 1);
+        end = ESP_VIDEO_BUFFER_ALIGN(offset + size, align);
+
+        ret = esp_video_port_invalidate(element->buffer + start, end - start);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to invalidate buffer %" PRIu32 " range [%" PRIu32 ", %" PRIu32 ")",
+                     element->index, start, end);
+            return ret;
+        }
+    }
+
+    /* A partial read leaves the rest of the buffer stale */
+    if (!offset && size == buf_size) {
+        element->cache_flags &= ~ELEMENT_CACHE_DMA_WRITTEN;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,108 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_partition.h"
+
+#include "esp_video_calib.h"
+
+#define CALIB_ALIGN                 4
+
+static const char *TAG = "esp_video_calib";
+
+static const esp_video_calib_header_t *s_calib;
+
+static bool calib_check(const esp_video_calib_header_t *header, size_t part_size)
+{
+    const esp_video_calib_entry_t *entry = (const esp_video_calib_entry_t *)(header + 1);
+
+    if ((header->magic != ESP_VIDEO_CALIB_MAGIC) || (header->version != ESP_VIDEO_CALIB_VERSION) ||
+            (header->size > part_size) ||
+            (sizeof(*header) + header->entry_count * sizeof(*entry) > header->size)) {
+        return false;
+    }
+
+    for (int i = 0; i < header->entry_count; i++) {
+        if ((entry[i].offset % CALIB_ALIGN) || (entry[i].offset > header->size) ||
+                (entry[i].size > header->size - entry[i].offset)) {
+            ESP_LOGE(TAG, "entry %d is out of the blob", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Map the calibration partition.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_calib_init(void)
+{
+    esp_err_t ret;
+    const void *ptr;
+    esp_partition_mmap_handle_t handle;
+    const esp_partition_t *part;
+
+    if (s_calib) {
+        return ESP_OK;
+    }
+
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                    CONFIG_ESP_VIDEO_CALIB_PARTITION_LABEL);
+    ESP_RETURN_ON_FALSE(part, ESP_ERR_NOT_FOUND, TAG, "no partition \"%s\"", CONFIG_ESP_VIDEO_CALIB_PARTITION_LABEL);
+
+    /* Mapped for good, the ISP and the correction device read the tables in place */
+    ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to map partition \"%s\"", part->label);
+
+    if (!calib_check(ptr, part->size)) {
+        ESP_LOGW(TAG, "partition \"%s\" holds no calibration", part->label);
+        esp_partition_munmap(handle);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    s_calib = ptr;
+    ESP_LOGI(TAG, "%u calibration entries in \"%s\"", s_calib->entry_count, part->label);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Find calibration data of a frame size.
+ *
+ * @param type   Entry type
+ * @param width  Frame width in pixels
+ * @param height Frame height in pixels
+ * @param size   Data size in bytes if found, may be NULL
+ *
+ * @return Data in the mapped partition, or NULL if not found
+ */
+const void *esp_video_calib_find(esp_video_calib_type_t type, uint32_t width, uint32_t height, size_t *size)
+{
+    const esp_video_calib_entry_t *entry;
+
+    if (!s_calib) {
+        return NULL;
+    }
+
+    entry = (const esp_video_calib_entry_t *)(s_calib + 1);
+    for (int i = 0; i < s_calib->entry_count; i++) {
+        if ((entry[i].type == type) && (entry[i].width == width) && (entry[i].height == height)) {
+            if (size) {
+                *size = entry[i].size;
+            }
+            return (const uint8_t *)s_calib + entry[i].offset;
+        }
+    }
+
+    return NULL;
+}
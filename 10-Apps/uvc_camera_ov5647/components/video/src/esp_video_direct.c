@@ -0,0 +1,206 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_video_direct.h"
+#include "esp_video_vfs.h"
+#include "esp_video_ioctl_internal.h"
+
+/**
+ * @brief Video device handle object.
+ */
+struct esp_video_direct {
+    struct esp_video *video;                /*!< Video object */
+    struct esp_video_client *client;        /*!< Client slot of this handle */
+    int index;                              /*!< Client slot index */
+};
+
+static const char *TAG = "video_direct";
+
+/**
+ * @brief Open a video device.
+ *
+ * @param id     Video device ID, ESP_VIDEO_XXX_DEVICE_ID in esp_video_device.h
+ * @param handle Video device handle pointer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_open(uint8_t id, esp_video_direct_t **handle)
+{
+    int index;
+    struct esp_video *video;
+    esp_video_direct_t *direct;
+
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    video = esp_video_device_get_object_by_id(id);
+    if (!video) {
+        ESP_LOGE(TAG, "Not find video id=%d", id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    direct = heap_caps_calloc(1, sizeof(esp_video_direct_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (!direct) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Same as opening a file of the device */
+    if (!esp_video_open(video->dev_name)) {
+        heap_caps_free(direct);
+        return ESP_FAIL;
+    }
+
+    index = esp_video_client_open(video);
+    if (index < 0) {
+        esp_video_close(video);
+        heap_caps_free(direct);
+        return ESP_ERR_NO_MEM;
+    }
+
+    direct->video = video;
+    direct->index = index;
+    direct->client = esp_video_get_client(video, index);
+    *handle = direct;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Close a video device handle.
+ *
+ * @param handle Video device handle
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_close(esp_video_direct_t *handle)
+{
+    esp_err_t ret;
+
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ret = esp_video_client_close(handle->video, handle->index);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = esp_video_close(handle->video);
+    heap_caps_free(handle);
+
+    return ret;
+}
+
+/**
+ * @brief Run any ioctl command of the device.
+ *
+ * @param handle Video device handle
+ * @param cmd    ioctl command, VIDIOC_XXX
+ * @param arg    Command argument
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_ioctl(esp_video_direct_t *handle, int cmd, void *arg)
+{
+    return esp_video_ioctl_dispatch(handle->video, handle->client, cmd, arg);
+}
+
+/**
+ * @brief Queue a buffer, same as VIDIOC_QBUF.
+ *
+ * @param handle Video device handle
+ * @param buf    Video buffer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_qbuf(esp_video_direct_t *handle, struct v4l2_buffer *buf)
+{
+    return esp_video_ioctl_qbuf(handle->video, handle->client, buf);
+}
+
+/**
+ * @brief Dequeue a buffer, same as VIDIOC_DQBUF.
+ *
+ * @param handle Video device handle
+ * @param buf    Video buffer
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_dqbuf(esp_video_direct_t *handle, struct v4l2_buffer *buf)
+{
+    return esp_video_ioctl_dqbuf(handle->video, handle->client, buf);
+}
+
+/**
+ * @brief Dequeue a buffer, waiting at most timeout_ms for one to be done.
+ *
+ * @param handle     Video device handle
+ * @param buf        Video buffer
+ * @param timeout_ms Maximum time to wait in ms
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_TIMEOUT if no buffer was done in time
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_dqbuf_timeout(esp_video_direct_t *handle, struct v4l2_buffer *buf, uint32_t timeout_ms)
+{
+    return esp_video_ioctl_dqbuf_timeout(handle->video, handle->client, buf, pdMS_TO_TICKS(timeout_ms));
+}
+
+/**
+ * @brief Run a batch of buffer operations, same as VIDIOC_BATCH_BUF.
+ *
+ * @param handle Video device handle
+ * @param batch  Buffer batch
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Others if failed
+ */
+esp_err_t esp_video_direct_batch_buf(esp_video_direct_t *handle, struct esp_video_buffer_batch *batch)
+{
+    return esp_video_ioctl_batch_buf(handle->video, handle->client, batch);
+}
+
+/**
+ * @brief Map a buffer of the device, same as mmap() on a file of the device.
+ *
+ * @param handle Video device handle
+ * @param length Buffer length
+ * @param offset Buffer offset returned by VIDIOC_QUERYBUF
+ *
+ * @return
+ *      - Buffer pointer on success
+ *      - NULL if failed
+ */
+void *esp_video_direct_mmap(esp_video_direct_t *handle, size_t length, off_t offset)
+{
+    struct esp_video_ioctl_mmap ioctl_mmap = {
+        .length = length,
+        .offset = offset,
+    };
+
+    if (esp_video_ioctl_dispatch(handle->video, handle->client, VIDIOC_MMAP, &ioctl_mmap) != ESP_OK) {
+        return NULL;
+    }
+
+    return ioctl_mmap.mapped_ptr;
+}
@@ -19,6 +19,9 @@
 #if CONFIG_ESP_VIDEO_ENABLE_ISP_PIPELINE_CONTROLLER
 #include "esp_video_pipeline_isp.h"
 #endif
+#if CONFIG_ESP_VIDEO_ENABLE_CALIB
+#include "esp_video_calib.h"
+#endif
 
 #define SCCB_NUM_MAX                I2C_NUM_MAX
 
@@ -203,6 +206,14 @@ esp_err_t esp_video_init(const esp_video_init_config_t *config)
         return ESP_ERR_INVALID_ARG;
     }
 
+#if CONFIG_ESP_VIDEO_ENABLE_CALIB
+    /* Devices then run uncalibrated, it's not fatal */
+    ret = esp_video_calib_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "lens calibration is not available");
+    }
+#endif
+
 #if CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
     ret = esp_video_create_isp_video_device();
     if (ret != ESP_OK) {
@@ -248,7 +259,8 @@ esp_err_t esp_video_init(const esp_video_init_config_t *config)
                     esp_video_isp_config_t isp_config = {
                         .cam_dev = ESP_VIDEO_MIPI_CSI_DEVICE_NAME,
                         .isp_dev = ESP_VIDEO_ISP1_DEVICE_NAME,
-                        .ipa_config = ipa_config
+                        .ipa_config = ipa_config,
+                        .sensor_name = cam_dev->name
                     };
 
                     ESP_LOGI(TAG, "Initializing ISP pipeline controller for %s...", cam_dev->name);
@@ -313,12 +325,28 @@ esp_err_t esp_video_init(const esp_video_init_config_t *config)
 #endif
     }
 
+#if CONFIG_ESP_VIDEO_ENABLE_TESTPAT_VIDEO_DEVICE
+    ret = esp_video_create_testpat_video_device();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create test pattern video device");
+        return ret;
+    }
+#endif
+
 #if CONFIG_ESP_VIDEO_ENABLE_HW_H264_VIDEO_DEVICE
-    ret = esp_video_create_h264_video_device(true);
+    ret = esp_video_create_h264_video_device(ESP_VIDEO_H264_DEVICE_ID, true);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "failed to create hardware H.264 video device");
         return ret;
     }
+
+#if CONFIG_ESP_VIDEO_ENABLE_SECOND_H264_VIDEO_DEVICE
+    ret = esp_video_create_h264_video_device(ESP_VIDEO_H264_1_DEVICE_ID, true);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create second H.264 video device");
+        return ret;
+    }
+#endif
 #endif
 
 #if CONFIG_ESP_VIDEO_ENABLE_HW_JPEG_VIDEO_DEVICE
@@ -335,5 +363,37 @@ esp_err_t esp_video_init(const esp_video_init_config_t *config)
     }
 #endif
 
+#if CONFIG_ESP_VIDEO_ENABLE_HW_JPEG_DECODER_VIDEO_DEVICE
+    ret = esp_video_create_jpeg_decoder_video_device();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create hardware JPEG decoder video device");
+        return ret;
+    }
+#endif
+
+#if CONFIG_ESP_VIDEO_ENABLE_PPA_VIDEO_DEVICE
+    ret = esp_video_create_ppa_video_device();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create PPA video device");
+        return ret;
+    }
+#endif
+
+#if CONFIG_ESP_VIDEO_ENABLE_SWCONV_VIDEO_DEVICE
+    ret = esp_video_create_swconv_video_device();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create software pixel format converter video device");
+        return ret;
+    }
+#endif
+
+#if CONFIG_ESP_VIDEO_ENABLE_LDC_VIDEO_DEVICE
+    ret = esp_video_create_ldc_video_device();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "failed to create lens distortion correction video device");
+        return ret;
+    }
+#endif
+
     return ESP_OK;
 }
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/lock.h>
+#include <sys/param.h>
 #include "esp_heap_caps.h"
 #include "esp_video.h"
 #include "esp_video_vfs.h"
@@ -83,7 +84,8 @@ static esp_err_t esp_video_ioctl_reqbufs(struct esp_video *video, struct v4l2_re
     esp_err_t ret;
 
     if ((req_bufs->memory != V4L2_MEMORY_MMAP) &&
-            (req_bufs->memory != V4L2_MEMORY_USERPTR) ) {
+            (req_bufs->memory != V4L2_MEMORY_USERPTR) &&
+            (req_bufs->memory != V4L2_MEMORY_DMABUF)) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -120,6 +122,11 @@ static esp_err_t esp_video_ioctl_querybuf(struct esp_video *video, struct v4l2_b
     return ESP_OK;
 }
 
+static esp_err_t esp_video_ioctl_expbuf(struct esp_video *video, struct v4l2_exportbuffer *expbuf)
+{
+    return esp_video_export_element_index(video, expbuf->type, expbuf->index, &expbuf->fd);
+}
+
 static esp_err_t esp_video_ioctl_mmap(struct esp_video *video, struct esp_video_ioctl_mmap *ioctl_mmap)
 {
     esp_err_t ret;
@@ -143,7 +150,7 @@ static esp_err_t esp_video_ioctl_mmap(struct esp_video *video, struct esp_video_
     return ESP_OK;
 }
 
-static esp_err_t esp_video_ioctl_qbuf(struct esp_video *video, struct v4l2_buffer *vbuf)
+esp_err_t esp_video_ioctl_qbuf(struct esp_video *video, struct esp_video_client *client, struct v4l2_buffer *vbuf)
 {
     esp_err_t ret;
     struct esp_video_buffer_info info;
@@ -157,25 +164,57 @@ static esp_err_t esp_video_ioctl_qbuf(struct esp_video *video, struct v4l2_buffe
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Subscribed client only gives the buffer back, the owner queues it to the driver */
+    if (client->sub_type == vbuf->type) {
+        return esp_video_client_release_element_index(video, client, vbuf->index);
+    }
+
     if (info.memory_type == V4L2_MEMORY_USERPTR) {
         if (!vbuf->m.userptr) {
             return ESP_ERR_INVALID_ARG;
         }
     }
 
+    /* M2M input timestamp is copied to the output buffer which is encoded from it */
+    if (vbuf->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        int64_t timestamp = (int64_t)vbuf->timestamp.tv_sec * 1000000 + vbuf->timestamp.tv_usec;
+
+        ret = esp_video_set_element_index_timestamp(video, vbuf->type, vbuf->index, timestamp);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        /* Imported buffers carry the size of the exporting element, user pointers their length */
+        if (info.memory_type == V4L2_MEMORY_MMAP) {
+            ret = esp_video_set_element_index_valid_size(video, vbuf->type, vbuf->index, vbuf->bytesused);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+
     if (info.memory_type == V4L2_MEMORY_MMAP) {
         ret = esp_video_queue_element_index(video, vbuf->type, vbuf->index);
+    } else if (info.memory_type == V4L2_MEMORY_DMABUF) {
+        ret = esp_video_queue_element_index_dmabuf(video, vbuf->type, vbuf->index, vbuf->m.fd);
     } else {
         ret = esp_video_queue_element_index_buffer(video, vbuf->type, vbuf->index, (uint8_t *)vbuf->m.userptr, vbuf->length);
     }
 
+    if (ret == ESP_OK && video->m2m_async) {
+        esp_video_m2m_async_trigger(video);
+    } else if (ret == ESP_OK && (video->device_caps & V4L2_CAP_VIDEO_M2M)) {
+        /* VIDIOC_DQBUF processes the pair, a select() waiting for it can go on */
+        esp_video_vfs_select_notify(video, NULL);
+    }
+
     return ret;
 }
 
-static esp_err_t esp_video_ioctl_dqbuf(struct esp_video *video, struct v4l2_buffer *vbuf)
+esp_err_t esp_video_ioctl_dqbuf_timeout(struct esp_video *video, struct esp_video_client *client, struct v4l2_buffer *vbuf,
+                                        uint32_t ticks)
 {
     esp_err_t ret;
-    uint32_t ticks = portMAX_DELAY;
     struct esp_video_buffer_info info;
     struct esp_video_buffer_element *element;
 
@@ -188,20 +227,35 @@ static esp_err_t esp_video_ioctl_dqbuf(struct esp_video *video, struct v4l2_buff
         return ESP_ERR_INVALID_ARG;
     }
 
-    element = esp_video_recv_element(video, vbuf->type, ticks);
+    if (client->sub_type == vbuf->type) {
+        element = esp_video_client_recv_element(video, client, ticks);
+    } else {
+        element = esp_video_recv_element(video, vbuf->type, ticks);
+    }
     if (!element) {
-        return ESP_FAIL;
+        return ticks == portMAX_DELAY ? ESP_FAIL : ESP_ERR_TIMEOUT;
     }
 
-    vbuf->flags     = 0;
+    vbuf->flags     = element->frame_flags;
     vbuf->index     = element->index;
     vbuf->bytesused = element->valid_size;
+    vbuf->sequence  = element->sequence;
+    vbuf->field     = V4L2_FIELD_NONE;
+    vbuf->timestamp.tv_sec  = element->timestamp / 1000000;
+    vbuf->timestamp.tv_usec = element->timestamp % 1000000;
     if (!vbuf->bytesused) {
         vbuf->flags |= V4L2_BUF_FLAG_ERROR;
     } else {
         vbuf->flags |= V4L2_BUF_FLAG_DONE;
     }
-    if (vbuf->memory != V4L2_MEMORY_USERPTR) {
+    if (video->caps & V4L2_CAP_VIDEO_M2M) {
+        vbuf->flags |= V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    } else {
+        vbuf->flags |= V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC | V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
+    }
+    if (vbuf->memory == V4L2_MEMORY_DMABUF) {
+        vbuf->m.fd = element->dmabuf_fd;
+    } else if (vbuf->memory != V4L2_MEMORY_USERPTR) {
         vbuf->m.userptr = (unsigned long)element->buffer;
         vbuf->flags |= V4L2_BUF_FLAG_MAPPED;
     }
@@ -209,6 +263,51 @@ static esp_err_t esp_video_ioctl_dqbuf(struct esp_video *video, struct v4l2_buff
     return ESP_OK;
 }
 
+esp_err_t esp_video_ioctl_dqbuf(struct esp_video *video, struct esp_video_client *client, struct v4l2_buffer *vbuf)
+{
+    uint32_t ticks;
+
+    /* O_NONBLOCK files only take done elements, the others wait up to their own timeout */
+    if (client->nonblock) {
+        ticks = 0;
+    } else if (client->dqbuf_timeout_ms) {
+        ticks = MAX(pdMS_TO_TICKS(client->dqbuf_timeout_ms), 1);
+    } else {
+        ticks = portMAX_DELAY;
+    }
+
+    return esp_video_ioctl_dqbuf_timeout(video, client, vbuf, ticks);
+}
+
+esp_err_t esp_video_ioctl_batch_buf(struct esp_video *video, struct esp_video_client *client, struct esp_video_buffer_batch *batch)
+{
+    esp_err_t ret = ESP_OK;
+
+    batch->done = 0;
+    if (!batch->ops || !batch->count || batch->count > ESP_VIDEO_BUFFER_BATCH_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < batch->count; i++) {
+        struct esp_video_buffer_batch_op *op = &batch->ops[i];
+
+        if (op->cmd == VIDIOC_QBUF) {
+            ret = esp_video_ioctl_qbuf(video, client, &op->buf);
+        } else if (op->cmd == VIDIOC_DQBUF) {
+            ret = esp_video_ioctl_dqbuf(video, client, &op->buf);
+        } else {
+            ret = ESP_ERR_INVALID_ARG;
+        }
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        batch->done++;
+    }
+
+    return ret;
+}
+
 static inline esp_err_t esp_video_ioctl_set_ext_ctrls(struct esp_video *video, const struct v4l2_ext_controls *controls)
 {
     return esp_video_set_ext_controls(video, controls);
@@ -234,29 +333,125 @@ static inline esp_err_t esp_video_ioctl_get_sensor_format(struct esp_video *vide
     return esp_video_get_sensor_format(video, format);
 }
 
+static inline esp_err_t esp_video_ioctl_set_buf_policy(struct esp_video *video, const struct esp_video_buffer_policy *policy)
+{
+    return esp_video_set_buffer_policy(video, policy);
+}
+
+static inline esp_err_t esp_video_ioctl_get_buf_policy(struct esp_video *video, struct esp_video_buffer_policy *policy)
+{
+    return esp_video_get_buffer_policy(video, policy);
+}
+
+static inline esp_err_t esp_video_ioctl_sync_buf(struct esp_video *video, const struct esp_video_buffer_sync *sync)
+{
+    return esp_video_sync_element_index(video, sync);
+}
+
+static inline esp_err_t esp_video_ioctl_g_frame_meta(struct esp_video *video, struct esp_video_frame_meta *meta)
+{
+    return esp_video_get_element_index_meta(video, meta);
+}
+
+static inline esp_err_t esp_video_ioctl_s_frame_meta(struct esp_video *video, const struct esp_video_frame_meta *meta)
+{
+    return esp_video_set_frame_meta(video, meta);
+}
+
+static inline esp_err_t esp_video_ioctl_subscribe_buf(struct esp_video *video, struct esp_video_client *client,
+                                                       const struct esp_video_buffer_subscribe *sub)
+{
+    return esp_video_client_subscribe(video, client, sub);
+}
+
+static inline esp_err_t esp_video_ioctl_s_dqbuf_timeout(struct esp_video_client *client, const uint32_t *timeout_ms)
+{
+    client->dqbuf_timeout_ms = *timeout_ms;
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_video_ioctl_g_dqbuf_timeout(struct esp_video_client *client, uint32_t *timeout_ms)
+{
+    *timeout_ms = client->dqbuf_timeout_ms;
+    return ESP_OK;
+}
+
 static inline esp_err_t esp_video_ioctl_query_menu(struct esp_video *video, struct v4l2_querymenu *qmenu)
 {
     return esp_video_query_menu(video, qmenu);
 }
 
-esp_err_t esp_video_ioctl(struct esp_video *video, int cmd, va_list args)
+static inline esp_err_t esp_video_ioctl_s_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    return esp_video_set_parm(video, parm);
+}
+
+static inline esp_err_t esp_video_ioctl_g_parm(struct esp_video *video, struct v4l2_streamparm *parm)
+{
+    return esp_video_get_parm(video, parm);
+}
+
+static inline esp_err_t esp_video_ioctl_s_selection(struct esp_video *video, struct v4l2_selection *sel)
+{
+    return esp_video_set_selection(video, sel);
+}
+
+static inline esp_err_t esp_video_ioctl_g_selection(struct esp_video *video, struct v4l2_selection *sel)
+{
+    return esp_video_get_selection(video, sel);
+}
+
+static inline esp_err_t esp_video_ioctl_s_register(struct esp_video *video, const struct v4l2_dbg_register *reg)
+{
+    return esp_video_set_register(video, reg);
+}
+
+static inline esp_err_t esp_video_ioctl_g_register(struct esp_video *video, struct v4l2_dbg_register *reg)
+{
+    return esp_video_get_register(video, reg);
+}
+
+esp_err_t esp_video_ioctl(struct esp_video *video, struct esp_video_client *client, int cmd, va_list args)
+{
+    return esp_video_ioctl_dispatch(video, client, cmd, va_arg(args, void *));
+}
+
+esp_err_t esp_video_ioctl_dispatch(struct esp_video *video, struct esp_video_client *client, int cmd, void *arg_ptr)
 {
     esp_err_t ret = ESP_OK;
-    void *arg_ptr;
 
     assert(video);
+    assert(client);
 
-    arg_ptr = va_arg(args, void *);
     if (!arg_ptr) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Subscribed client shares the stream of its owner, so it can't change the stream */
+    if (client->sub_type) {
+        switch (cmd) {
+        case VIDIOC_S_FMT:
+        case VIDIOC_STREAMON:
+        case VIDIOC_STREAMOFF:
+        case VIDIOC_REQBUFS:
+        case VIDIOC_S_BUF_POLICY:
+        case VIDIOC_S_PARM:
+        case VIDIOC_S_SELECTION:
+            return ESP_ERR_INVALID_STATE;
+        default:
+            break;
+        }
+    }
+
     switch (cmd) {
     case VIDIOC_QBUF:
-        ret = esp_video_ioctl_qbuf(video, (struct v4l2_buffer *)arg_ptr);
+        ret = esp_video_ioctl_qbuf(video, client, (struct v4l2_buffer *)arg_ptr);
         break;
     case VIDIOC_DQBUF:
-        ret = esp_video_ioctl_dqbuf(video, (struct v4l2_buffer *)arg_ptr);
+        ret = esp_video_ioctl_dqbuf(video, client, (struct v4l2_buffer *)arg_ptr);
+        break;
+    case VIDIOC_BATCH_BUF:
+        ret = esp_video_ioctl_batch_buf(video, client, (struct esp_video_buffer_batch *)arg_ptr);
         break;
     case VIDIOC_QUERYCAP:
         ret = esp_video_ioctl_querycap(video, (struct v4l2_capability *)arg_ptr);
@@ -279,6 +474,9 @@ esp_err_t esp_video_ioctl(struct esp_video *video, int cmd, va_list args)
     case VIDIOC_REQBUFS:
         ret = esp_video_ioctl_reqbufs(video, (struct v4l2_requestbuffers *)arg_ptr);
         break;
+    case VIDIOC_EXPBUF:
+        ret = esp_video_ioctl_expbuf(video, (struct v4l2_exportbuffer *)arg_ptr);
+        break;
     case VIDIOC_QUERYBUF:
         ret = esp_video_ioctl_querybuf(video, (struct v4l2_buffer *)arg_ptr);
         break;
@@ -300,9 +498,51 @@ esp_err_t esp_video_ioctl(struct esp_video *video, int cmd, va_list args)
     case VIDIOC_G_SENSOR_FMT:
         ret = esp_video_ioctl_get_sensor_format(video, (esp_cam_sensor_format_t *)arg_ptr);
         break;
+    case VIDIOC_S_BUF_POLICY:
+        ret = esp_video_ioctl_set_buf_policy(video, (const struct esp_video_buffer_policy *)arg_ptr);
+        break;
+    case VIDIOC_G_BUF_POLICY:
+        ret = esp_video_ioctl_get_buf_policy(video, (struct esp_video_buffer_policy *)arg_ptr);
+        break;
+    case VIDIOC_SYNC_BUF:
+        ret = esp_video_ioctl_sync_buf(video, (const struct esp_video_buffer_sync *)arg_ptr);
+        break;
+    case VIDIOC_G_FRAME_META:
+        ret = esp_video_ioctl_g_frame_meta(video, (struct esp_video_frame_meta *)arg_ptr);
+        break;
+    case VIDIOC_S_FRAME_META:
+        ret = esp_video_ioctl_s_frame_meta(video, (const struct esp_video_frame_meta *)arg_ptr);
+        break;
+    case VIDIOC_SUBSCRIBE_BUF:
+        ret = esp_video_ioctl_subscribe_buf(video, client, (const struct esp_video_buffer_subscribe *)arg_ptr);
+        break;
+    case VIDIOC_S_DQBUF_TIMEOUT:
+        ret = esp_video_ioctl_s_dqbuf_timeout(client, (const uint32_t *)arg_ptr);
+        break;
+    case VIDIOC_G_DQBUF_TIMEOUT:
+        ret = esp_video_ioctl_g_dqbuf_timeout(client, (uint32_t *)arg_ptr);
+        break;
     case VIDIOC_QUERYMENU:
         ret = esp_video_ioctl_query_menu(video, (struct v4l2_querymenu *)arg_ptr);
         break;
+    case VIDIOC_S_PARM:
+        ret = esp_video_ioctl_s_parm(video, (struct v4l2_streamparm *)arg_ptr);
+        break;
+    case VIDIOC_G_PARM:
+        ret = esp_video_ioctl_g_parm(video, (struct v4l2_streamparm *)arg_ptr);
+        break;
+    case VIDIOC_S_SELECTION:
+        ret = esp_video_ioctl_s_selection(video, (struct v4l2_selection *)arg_ptr);
+        break;
+    case VIDIOC_G_SELECTION:
+        ret = esp_video_ioctl_g_selection(video, (struct v4l2_selection *)arg_ptr);
+        break;
+    case VIDIOC_DBG_S_REGISTER:
+        ret = esp_video_ioctl_s_register(video, (const struct v4l2_dbg_register *)arg_ptr);
+        break;
+    case VIDIOC_DBG_G_REGISTER:
+        ret = esp_video_ioctl_g_register(video, (struct v4l2_dbg_register *)arg_ptr);
+        break;
     default:
         ret = ESP_ERR_INVALID_ARG;
         break;
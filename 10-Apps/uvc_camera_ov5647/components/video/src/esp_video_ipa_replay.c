@@ -0,0 +1,213 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_ipa.h"
+#include "esp_video_ipa_replay.h"
+
+#define REPLAY_VALUES               4       /* Exposure, gain, red and blue gain */
+
+/* Output of the image algorithms the convergence is judged on */
+typedef struct replay_output {
+    float value[REPLAY_VALUES];
+} replay_output_t;
+
+/* One record entry, kept off the stack of the calling task */
+typedef struct replay_entry {
+    esp_video_ipa_record_frame_t frame;
+    esp_ipa_stats_t stats;
+    esp_ipa_sensor_t sensor;
+    esp_ipa_metadata_t recorded;
+    esp_ipa_metadata_t metadata;
+} replay_entry_t;
+
+static const char *TAG = "IPA_REPLAY";
+
+/**
+ * @brief Update the output with the values an image algorithm run set.
+ *
+ * @param output   Output of the runs so far, values not set keep the ones before
+ * @param metadata Image algorithm result
+ *
+ * @return None
+ */
+static void replay_output_update(replay_output_t *output, const esp_ipa_metadata_t *metadata)
+{
+    if (metadata->flags & IPA_METADATA_FLAGS_ET) {
+        output->value[0] = metadata->exposure;
+    }
+    if (metadata->flags & IPA_METADATA_FLAGS_GN) {
+        output->value[1] = metadata->gain;
+    }
+    if (metadata->flags & IPA_METADATA_FLAGS_RG) {
+        output->value[2] = metadata->red_gain;
+    }
+    if (metadata->flags & IPA_METADATA_FLAGS_BG) {
+        output->value[3] = metadata->blue_gain;
+    }
+}
+
+/**
+ * @brief Find the run from which the output stays within the settle band of its final value.
+ *
+ * @param outputs Output after every run
+ * @param count   Number of runs
+ *
+ * @return The first settled run, 0 if the output never left the band
+ */
+static uint32_t replay_settled(const replay_output_t *outputs, uint32_t count)
+{
+    const replay_output_t *last = &outputs[count - 1];
+
+    for (uint32_t i = count; i > 0; i--) {
+        for (int v = 0; v < REPLAY_VALUES; v++) {
+            float band = fabsf(last->value[v]) * CONFIG_ESP_VIDEO_IPA_REPLAY_SETTLE_PERMILLE / 1000.0f;
+
+            if (fabsf(outputs[i - 1].value[v] - last->value[v]) > band) {
+                return i;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read the next entry of a record.
+ *
+ * @param file  Record file
+ * @param entry Entry to fill
+ *
+ * @return true if the whole entry was read
+ */
+static bool replay_read_entry(FILE *file, replay_entry_t *entry)
+{
+    return fread(&entry->frame, sizeof(entry->frame), 1, file) == 1 &&
+           fread(&entry->stats, sizeof(entry->stats), 1, file) == 1 &&
+           fread(&entry->sensor, sizeof(entry->sensor), 1, file) == 1 &&
+           fread(&entry->recorded, sizeof(entry->recorded), 1, file) == 1;
+}
+
+esp_err_t esp_video_ipa_replay(const char *path, FILE *out, esp_video_ipa_replay_result_t *result)
+{
+    esp_err_t ret = ESP_OK;
+    FILE *file;
+    long size;
+    uint32_t count;
+    uint32_t us;
+    int64_t start;
+    esp_video_ipa_record_header_t header;
+    const esp_ipa_config_t *ipa_config;
+    esp_ipa_pipeline_handle_t pipeline;
+    replay_entry_t *entry;
+    replay_output_t *outputs;
+    replay_output_t replayed = {0};
+    replay_output_t recorded = {0};
+    const size_t entry_size = sizeof(esp_video_ipa_record_frame_t) + sizeof(esp_ipa_stats_t) +
+                              sizeof(esp_ipa_sensor_t) + sizeof(esp_ipa_metadata_t);
+
+    ESP_RETURN_ON_FALSE(path && result, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(result, 0, sizeof(*result));
+
+    file = fopen(path, "rb");
+    ESP_RETURN_ON_FALSE(file, ESP_ERR_NOT_FOUND, TAG, "failed to open %s", path);
+
+    ESP_GOTO_ON_FALSE(fread(&header, sizeof(header), 1, file) == 1 &&
+                      header.magic == ESP_VIDEO_IPA_RECORD_MAGIC &&
+                      header.version == ESP_VIDEO_IPA_RECORD_VERSION &&
+                      header.header_size == sizeof(header) &&
+                      header.stats_size == sizeof(esp_ipa_stats_t) &&
+                      header.sensor_size == sizeof(esp_ipa_sensor_t) &&
+                      header.metadata_size == sizeof(esp_ipa_metadata_t),
+                      ESP_ERR_INVALID_VERSION, fail_0, TAG, "%s is no image algorithm record of this build", path);
+
+    header.sensor[ESP_VIDEO_IPA_RECORD_NAME_LEN - 1] = '\0';
+    ipa_config = esp_ipa_pipeline_get_config(header.sensor);
+    ESP_GOTO_ON_FALSE(ipa_config, ESP_ERR_NOT_FOUND, fail_0, TAG, "no IPA configuration for sensor %s", header.sensor);
+
+    /* A last entry cut short, e.g. by a power loss while recording, is left out */
+    ESP_GOTO_ON_FALSE(fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= (long)sizeof(header) &&
+                      fseek(file, sizeof(header), SEEK_SET) == 0,
+                      ESP_FAIL, fail_0, TAG, "failed to read %s", path);
+    count = (size - sizeof(header)) / entry_size;
+    ESP_GOTO_ON_FALSE(count, ESP_ERR_INVALID_SIZE, fail_0, TAG, "%s has no image algorithm runs", path);
+
+    entry = malloc(sizeof(replay_entry_t));
+    outputs = malloc(2 * count * sizeof(replay_output_t));
+    ESP_GOTO_ON_FALSE(entry && outputs, ESP_ERR_NO_MEM, fail_1, TAG, "failed to malloc replay of %" PRIu32 " runs", count);
+
+    ESP_GOTO_ON_ERROR(esp_ipa_pipeline_create(ipa_config, &pipeline), fail_1, TAG, "failed to create IPA pipeline");
+
+    if (out) {
+        fprintf(out, "run,seq,us,exposure,gain,red_gain,blue_gain,"
+                "rec_exposure,rec_gain,rec_red_gain,rec_blue_gain\n");
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        ESP_GOTO_ON_FALSE(replay_read_entry(file, entry), ESP_FAIL, fail_2, TAG, "failed to read %s", path);
+
+        if (!i) {
+            /* The algorithms start from their defaults, as after esp_video_init() */
+            memset(&entry->metadata, 0, sizeof(entry->metadata));
+            ESP_GOTO_ON_ERROR(esp_ipa_pipeline_init(pipeline, &entry->sensor, &entry->metadata),
+                              fail_2, TAG, "failed to initialize IPA pipeline");
+            replay_output_update(&replayed, &entry->metadata);
+        }
+
+        /* Cleared as in the ISP task, so both runs see the same input */
+        memset(&entry->metadata, 0, sizeof(entry->metadata));
+        start = esp_timer_get_time();
+        ret = esp_ipa_pipeline_process(pipeline, &entry->stats, &entry->sensor, &entry->metadata);
+        us = (uint32_t)(esp_timer_get_time() - start);
+        ESP_GOTO_ON_ERROR(ret, fail_2, TAG, "failed to process run %" PRIu32, i);
+
+        result->total_us += us;
+        result->max_us = us > result->max_us ? us : result->max_us;
+        result->recorded_us += entry->frame.process_us;
+
+        replay_output_update(&replayed, &entry->metadata);
+        replay_output_update(&recorded, &entry->recorded);
+        outputs[i] = replayed;
+        outputs[count + i] = recorded;
+
+        if (out) {
+            fprintf(out, "%" PRIu32 ",%" PRIu64 ",%" PRIu32 ",%.0f,%.3f,%.3f,%.3f,%.0f,%.3f,%.3f,%.3f\n",
+                    i, (uint64_t)entry->stats.seq, us,
+                    replayed.value[0], replayed.value[1], replayed.value[2], replayed.value[3],
+                    recorded.value[0], recorded.value[1], recorded.value[2], recorded.value[3]);
+        }
+    }
+
+    result->frames = count;
+    result->settled = replay_settled(outputs, count);
+    result->recorded_settled = replay_settled(&outputs[count], count);
+    result->exposure = (uint32_t)replayed.value[0];
+    result->gain = replayed.value[1];
+    result->red_gain = replayed.value[2];
+    result->blue_gain = replayed.value[3];
+
+    ESP_LOGI(TAG, "%s, sensor %s: %" PRIu32 " runs, mean %" PRIu32 " us (recorded %" PRIu32 " us), max %" PRIu32
+             " us, settled at run %" PRIu32 " (recorded %" PRIu32 ")", path, header.sensor, count,
+             (uint32_t)(result->total_us / count), (uint32_t)(result->recorded_us / count), result->max_us,
+             result->settled, result->recorded_settled);
+
+fail_2:
+    esp_ipa_pipeline_destroy(pipeline);
+fail_1:
+    free(outputs);
+    free(entry);
+fail_0:
+    fclose(file);
+    return ret;
+}
@@ -9,6 +9,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -20,23 +21,94 @@
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST || CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+#include "freertos/semphr.h"
+#endif
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+#include "nvs.h"
+#endif
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST || CONFIG_ESP_VIDEO_ISP_LOAD_STATS || CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+#include "esp_timer.h"
+#endif
 
 #include "linux/videodev2.h"
 #include "esp_video_pipeline_isp.h"
+#include "esp_video_device_internal.h"
 #include "esp_video_ioctl.h"
 #include "esp_video_isp_ioctl.h"
+#include "esp_video_init.h"
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+#include "esp_video_ipa_replay.h"
+#endif
 #include "esp_ipa.h"
 #include "esp_cam_sensor.h"
+#include "dlog.h"
+#include "trace.h"
 
-#define ISP_METADATA_BUFFER_COUNT   2
+#define ISP_METADATA_BUFFER_COUNT   CONFIG_ESP_VIDEO_ISP_PIPELINE_STATS_BUFFER_COUNT
 #define ISP_TASK_PRIORITY           11
 #define ISP_TASK_STACK_SIZE         4096
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_TASK_CORE >= 0
+#define ISP_TASK_CORE               CONFIG_ESP_VIDEO_ISP_PIPELINE_TASK_CORE
+#else
+#define ISP_TASK_CORE               tskNO_AFFINITY
+#endif
 
 #define UNUSED(x)                   (void)(x)
 
+#define FAST_AE_SETTLE_FRAMES       2       /* Sensor exposure takes effect this many frames after writing */
+#define FAST_AE_RATIO_MAX           8.0f    /* Largest exposure change of one jump */
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+#define ISP_PERSIST_NAMESPACE       "esp_video"
+#define ISP_PERSIST_KEY             "isp_state"
+#define ISP_PERSIST_VERSION         1
+#define ISP_PERSIST_INTERVAL_US     (CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST_INTERVAL * 1000000LL)
+
+/* Only what is written back as is, the other parameters follow from these or don't depend on the scene */
+#define ISP_PERSIST_FLAGS           (IPA_METADATA_FLAGS_ET | IPA_METADATA_FLAGS_GN | IPA_METADATA_FLAGS_RG | \
+                                     IPA_METADATA_FLAGS_BG | IPA_METADATA_FLAGS_CCM)
+
+/* NVS blob, a different size or version is ignored */
+typedef struct isp_persist_state {
+    uint32_t version;
+    uint32_t flags;                         /* IPA_METADATA_FLAGS_* of the valid fields */
+    uint32_t exposure;
+    float gain;
+    float red_gain;
+    float blue_gain;
+    float ccm[ISP_CCM_DIMENSION][ISP_CCM_DIMENSION];
+} isp_persist_state_t;
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+#define ISP_RECORD_BUFFER_SIZE      (16 * 1024)     /* The card sees a few large writes instead of one per run */
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+typedef esp_ipa_stats_t isp_stats_buf_t;
+#else
+typedef esp_video_isp_stats_t isp_stats_buf_t;
+#endif
+
+/* Set when the value was written before and the new one is the same, so the write can be skipped */
+#define METADATA_UNCHANGED(isp, m, flag, field) \
+    (((isp)->applied.flags & (flag)) && !memcmp(&(m)->field, &(isp)->applied.field, sizeof((m)->field)))
+
+/* Set when a float parameter never written before or moved out of the deadband */
+#define METADATA_PARAMS_CHANGED(isp, m, flag, field, n)                                     \
+    (!((isp)->applied.flags & (flag)) ||                                                    \
+     esp_video_isp_params_changed((const float *)&(isp)->applied.field, (const float *)&(m)->field, n))
+
+#define METADATA_APPLIED(isp, m, flag, field)   \
+    do {                                        \
+        (isp)->applied.field = (m)->field;      \
+        (isp)->applied.flags |= (flag);         \
+    } while (0)
+
 typedef struct esp_video_isp {
     int isp_fd;
-    esp_video_isp_stats_t *isp_stats[ISP_METADATA_BUFFER_COUNT];
+    isp_stats_buf_t *isp_stats[ISP_METADATA_BUFFER_COUNT];
 
     int cam_fd;
 
@@ -50,10 +122,54 @@ typedef struct esp_video_isp {
         uint8_t stats       : 1;
         uint8_t awb         : 1;
     } sensor_attr;
+
+    esp_ipa_metadata_t applied;             /* Values last written to the ISP and the sensor */
+
+    struct {
+        uint32_t pending;                   /* Statistics received since the last run */
+        uint32_t stable_runs;               /* Consecutive runs which changed nothing */
+        int32_t luma;                       /* Mean AE luminance at the last run */
+    } sched;
+
+    struct {
+        uint32_t frames;                    /* Statistics left in fast start AE, 0 after handing over */
+        uint32_t settle;                    /* Statistics to skip until the last jump takes effect */
+        uint32_t last_seq;                  /* Frame sequence of the last statistics */
+    } fast_ae;
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+    struct {
+        SemaphoreHandle_t lock;             /* Guards the states, saves also run in the application task */
+        isp_persist_state_t converged;      /* Applied values at the last convergence */
+        isp_persist_state_t saved;          /* What NVS holds */
+        int64_t save_time;                  /* Time of the last save by the ISP task, 0 if none */
+    } persist;
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+    struct {
+        uint32_t runs;                      /* Image algorithm runs since boot */
+        uint32_t time_us;                   /* Their CPU time, wraps */
+    } load;
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+    struct {
+        SemaphoreHandle_t lock;             /* Guards the file, started and stopped by the application task */
+        FILE *file;                         /* NULL while not recording */
+        uint32_t frames;                    /* Runs written to the file */
+        bool failed;                        /* A write failed, the rest of the runs is dropped */
+        char sensor[ESP_VIDEO_IPA_RECORD_NAME_LEN];
+    } record;
+#endif
 } esp_video_isp_t;
 
 static const char *TAG = "ISP";
 
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST || CONFIG_ESP_VIDEO_ISP_LOAD_STATS || CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+static esp_video_isp_t *s_isp;
+#endif
+
 /**
  * @brief Print ISP statistics data
  *
@@ -63,7 +179,7 @@ static const char *TAG = "ISP";
  */
 static void print_stats_info(const esp_ipa_stats_t *stats)
 {
-#if LOG_LOCAL_LEVEL >= ESP_LOG_DEBUG
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PRINT_STATS && LOG_LOCAL_LEVEL >= ESP_LOG_DEBUG
     ESP_LOGD(TAG, "");
     ESP_LOGD(TAG, "Sequence: %llu", stats->seq);
 
@@ -177,12 +293,20 @@ static void print_dev_info(int fd)
 #endif
 }
 
-static void config_white_balance(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_white_balance(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
-    bool rc = metadata->flags & IPA_METADATA_FLAGS_RG;
-    bool bg = metadata->flags & IPA_METADATA_FLAGS_BG;
+    bool rc = (metadata->flags & IPA_METADATA_FLAGS_RG) &&
+              METADATA_PARAMS_CHANGED(isp, metadata, IPA_METADATA_FLAGS_RG, red_gain, 1);
+    bool bg = (metadata->flags & IPA_METADATA_FLAGS_BG) &&
+              METADATA_PARAMS_CHANGED(isp, metadata, IPA_METADATA_FLAGS_BG, blue_gain, 1);
+
+    /* Both gains are written together if both are given and one changed */
+    if (rc || bg) {
+        rc = metadata->flags & IPA_METADATA_FLAGS_RG;
+        bg = metadata->flags & IPA_METADATA_FLAGS_BG;
+    }
 
     if (rc && bg) {
         esp_video_isp_wb_t wb = {
@@ -198,7 +322,10 @@ static void config_white_balance(esp_video_isp_t *isp, esp_ipa_metadata_t *metad
         control[0].p_u8     = (uint8_t *)&wb;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set white balance");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_RG, red_gain);
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_BG, blue_gain);
     } else if (rc) {
         controls.ctrl_class = V4L2_CTRL_CLASS_USER;
         controls.count      = 1;
@@ -207,7 +334,9 @@ static void config_white_balance(esp_video_isp_t *isp, esp_ipa_metadata_t *metad
         control[0].value    = metadata->red_gain * V4L2_CID_RED_BALANCE_DEN;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set red balance");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_RG, red_gain);
     } else if (bg) {
         controls.ctrl_class = V4L2_CTRL_CLASS_USER;
         controls.count      = 1;
@@ -216,16 +345,23 @@ static void config_white_balance(esp_video_isp_t *isp, esp_ipa_metadata_t *metad
         control[0].value    = metadata->blue_gain * V4L2_CID_BLUE_BALANCE_DEN;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set blue balance");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_BG, blue_gain);
     }
+
+    return rc || bg;
 }
 
-static void config_exposure_time(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_exposure_time(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
 
-    if (metadata->flags & IPA_METADATA_FLAGS_ET) {
+    /* The sensor takes 100 us units, a change below that would write the same registers */
+    if ((metadata->flags & IPA_METADATA_FLAGS_ET) &&
+            (!(isp->applied.flags & IPA_METADATA_FLAGS_ET) ||
+             (int32_t)metadata->exposure / 100 != (int32_t)isp->applied.exposure / 100)) {
         controls.ctrl_class = V4L2_CID_CAMERA_CLASS;
         controls.count      = 1;
         controls.controls   = control;
@@ -233,13 +369,17 @@ static void config_exposure_time(esp_video_isp_t *isp, esp_ipa_metadata_t *metad
         control[0].value    = (int32_t)metadata->exposure / 100;
         if (ioctl(isp->cam_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set exposure time");
-        } else {
-            isp->sensor.cur_exposure = metadata->exposure;
+            return false;
         }
+        isp->sensor.cur_exposure = metadata->exposure;
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_ET, exposure);
+        return true;
     }
+
+    return false;
 }
 
-static void config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     esp_err_t ret;
     int fd = isp->cam_fd;
@@ -248,7 +388,8 @@ static void config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
 
-    if (metadata->flags & IPA_METADATA_FLAGS_GN) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_GN) &&
+            !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_GN, gain)) {
         int32_t gain_value = 0;
         int32_t index = -1;
         int32_t target_gain = 0;
@@ -258,7 +399,7 @@ static void config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata
         ret = ioctl(fd, VIDIOC_QUERY_EXT_CTRL, &qctrl);
         if (ret) {
             ESP_LOGE(TAG, "failed to query gain");
-            return;
+            return false;
         }
 
         for (int32_t i = qctrl.minimum; i < qctrl.maximum; i++) {
@@ -270,7 +411,7 @@ static void config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata
             ret = ioctl(fd, VIDIOC_QUERYMENU, &qmenu);
             if (ret) {
                 ESP_LOGE(TAG, "failed to query gain min menu");
-                return;
+                return false;
             }
             gain0 = qmenu.value;
 
@@ -284,7 +425,7 @@ static void config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata
             ret = ioctl(fd, VIDIOC_QUERYMENU, &qmenu);
             if (ret) {
                 ESP_LOGE(TAG, "failed to query gain min menu");
-                return;
+                return false;
             }
             gain1 = qmenu.value;
 
@@ -312,22 +453,26 @@ static void config_pixel_gain(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata
             control[0].value    = index;
             if (ioctl(isp->cam_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
                 ESP_LOGE(TAG, "failed to set pixel gain");
-            } else {
-                isp->sensor.cur_gain = (float)target_gain / base_gain;
+                return false;
             }
+            isp->sensor.cur_gain = (float)target_gain / base_gain;
+            METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_GN, gain);
+            return true;
         } else {
             ESP_LOGE(TAG, "failed to find %0.4f", metadata->gain);
         }
     }
+
+    return false;
 }
 
-static void config_bayer_filter(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_bayer_filter(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
     esp_video_isp_bf_t bf;
 
-    if (metadata->flags & IPA_METADATA_FLAGS_BF) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_BF) && !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_BF, bf)) {
         bf.enable = true;
         bf.level = metadata->bf.level;
         for (int i = 0; i < ISP_BF_TEMPLATE_X_NUMS; i++) {
@@ -343,17 +488,23 @@ static void config_bayer_filter(esp_video_isp_t *isp, esp_ipa_metadata_t *metada
         control[0].p_u8     = (uint8_t *)&bf;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set bayer filter");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_BF, bf);
+        return true;
     }
+
+    return false;
 }
 
-static void config_demosaic(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_demosaic(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
     esp_video_isp_demosaic_t demosaic;
 
-    if (metadata->flags & IPA_METADATA_FLAGS_DM) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_DM) &&
+            METADATA_PARAMS_CHANGED(isp, metadata, IPA_METADATA_FLAGS_DM, demosaic.gradient_ratio, 1)) {
         demosaic.enable = true;
         demosaic.gradient_ratio = metadata->demosaic.gradient_ratio;
 
@@ -364,17 +515,27 @@ static void config_demosaic(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].p_u8     = (uint8_t *)&demosaic;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set demosaic");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_DM, demosaic);
+        return true;
     }
+
+    return false;
 }
 
-static void config_sharpen(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_sharpen(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
     esp_video_isp_sharpen_t sharpen;
 
-    if (metadata->flags & IPA_METADATA_FLAGS_SH) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_SH) &&
+            (METADATA_PARAMS_CHANGED(isp, metadata, IPA_METADATA_FLAGS_SH, sharpen.h_coeff, 1) ||
+             METADATA_PARAMS_CHANGED(isp, metadata, IPA_METADATA_FLAGS_SH, sharpen.m_coeff, 1) ||
+             metadata->sharpen.h_thresh != isp->applied.sharpen.h_thresh ||
+             metadata->sharpen.l_thresh != isp->applied.sharpen.l_thresh ||
+             memcmp(metadata->sharpen.matrix, isp->applied.sharpen.matrix, sizeof(metadata->sharpen.matrix)))) {
         sharpen.enable = true;
         sharpen.h_thresh = metadata->sharpen.h_thresh;
         sharpen.l_thresh = metadata->sharpen.l_thresh;
@@ -393,17 +554,22 @@ static void config_sharpen(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].p_u8     = (uint8_t *)&sharpen;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set sharpen");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_SH, sharpen);
+        return true;
     }
+
+    return false;
 }
 
-static void config_gamma(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_gamma(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
     esp_video_isp_gamma_t gamma;
 
-    if (metadata->flags & IPA_METADATA_FLAGS_GAMMA) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_GAMMA) && !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_GAMMA, gamma)) {
         gamma.enable = true;
         for (int i = 0; i < ISP_GAMMA_CURVE_POINTS_NUM; i++) {
             gamma.points[i].x = metadata->gamma.x[i];
@@ -417,17 +583,23 @@ static void config_gamma(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].p_u8     = (uint8_t *)&gamma;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set GAMMA");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_GAMMA, gamma);
+        return true;
     }
+
+    return false;
 }
 
-static void config_ccm(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_ccm(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
     esp_video_isp_ccm_t ccm;
 
-    if (metadata->flags & IPA_METADATA_FLAGS_CCM) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_CCM) &&
+            METADATA_PARAMS_CHANGED(isp, metadata, IPA_METADATA_FLAGS_CCM, ccm.matrix, ISP_CCM_DIMENSION * ISP_CCM_DIMENSION)) {
         ccm.enable = true;
         for (int i = 0; i < ISP_CCM_DIMENSION; i++) {
             for (int j = 0; j < ISP_CCM_DIMENSION; j++) {
@@ -442,16 +614,22 @@ static void config_ccm(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].p_u8     = (uint8_t *)&ccm;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set CCM");
+            return false;
         }
+        METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_CCM, ccm);
+        return true;
     }
+
+    return false;
 }
 
-static void config_color(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+static bool config_color(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
     struct v4l2_ext_controls controls;
     struct v4l2_ext_control control[1];
+    bool changed = false;
 
-    if (metadata->flags & IPA_METADATA_FLAGS_BR) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_BR) && !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_BR, brightness)) {
         controls.ctrl_class = V4L2_CID_USER_CLASS;
         controls.count      = 1;
         controls.controls   = control;
@@ -459,10 +637,13 @@ static void config_color(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].value    = metadata->brightness;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set brightness");
+        } else {
+            METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_BR, brightness);
+            changed = true;
         }
     }
 
-    if (metadata->flags & IPA_METADATA_FLAGS_CN) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_CN) && !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_CN, contrast)) {
         controls.ctrl_class = V4L2_CID_USER_CLASS;
         controls.count      = 1;
         controls.controls   = control;
@@ -470,10 +651,13 @@ static void config_color(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].value    = metadata->contrast;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set contrast");
+        } else {
+            METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_CN, contrast);
+            changed = true;
         }
     }
 
-    if (metadata->flags & IPA_METADATA_FLAGS_ST) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_ST) && !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_ST, saturation)) {
         controls.ctrl_class = V4L2_CID_USER_CLASS;
         controls.count      = 1;
         controls.controls   = control;
@@ -481,10 +665,13 @@ static void config_color(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].value    = metadata->saturation;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set saturation");
+        } else {
+            METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_ST, saturation);
+            changed = true;
         }
     }
 
-    if (metadata->flags & IPA_METADATA_FLAGS_HUE) {
+    if ((metadata->flags & IPA_METADATA_FLAGS_HUE) && !METADATA_UNCHANGED(isp, metadata, IPA_METADATA_FLAGS_HUE, hue)) {
         controls.ctrl_class = V4L2_CID_USER_CLASS;
         controls.count      = 1;
         controls.controls   = control;
@@ -492,35 +679,46 @@ static void config_color(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
         control[0].value    = metadata->hue;
         if (ioctl(isp->isp_fd, VIDIOC_S_EXT_CTRLS, &controls) != 0) {
             ESP_LOGE(TAG, "failed to set hue");
+        } else {
+            METADATA_APPLIED(isp, metadata, IPA_METADATA_FLAGS_HUE, hue);
+            changed = true;
         }
     }
+
+    return changed;
 }
 
-static void config_isp_and_camera(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+/* Writes only what changed since the last run, returns false if nothing did */
+static bool config_isp_and_camera(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
 {
+    bool changed = false;
+
     if (!isp->sensor_attr.awb) {
-        config_white_balance(isp, metadata);
+        changed |= config_white_balance(isp, metadata);
     }
 
-    config_bayer_filter(isp, metadata);
-    config_demosaic(isp, metadata);
-    config_sharpen(isp, metadata);
-    config_gamma(isp, metadata);
-    config_ccm(isp, metadata);
-    config_color(isp, metadata);
+    changed |= config_bayer_filter(isp, metadata);
+    changed |= config_demosaic(isp, metadata);
+    changed |= config_sharpen(isp, metadata);
+    changed |= config_gamma(isp, metadata);
+    changed |= config_ccm(isp, metadata);
+    changed |= config_color(isp, metadata);
 
     if (isp->sensor_attr.exposure) {
-        config_exposure_time(isp, metadata);
+        changed |= config_exposure_time(isp, metadata);
     }
     if (isp->sensor_attr.gain) {
-        config_pixel_gain(isp, metadata);
+        changed |= config_pixel_gain(isp, metadata);
     }
+
+    return changed;
 }
 
+#if !CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
 static void isp_stats_to_ipa_stats(esp_video_isp_stats_t *isp_stat, esp_ipa_stats_t *ipa_stats)
 {
     ipa_stats->flags = 0;
-    ipa_stats->seq = isp_stat->seq;
+    ipa_stats->seq = isp_stat->frame_seq;
 
     if (isp_stat->flags & ESP_VIDEO_ISP_STATS_FLAG_AE) {
         esp_ipa_stats_ae_t *ipa_ae = &ipa_stats->ae_stats[0];
@@ -563,6 +761,7 @@ static void isp_stats_to_ipa_stats(esp_video_isp_stats_t *isp_stat, esp_ipa_stat
         ipa_stats->flags |= IPA_STATS_FLAGS_SHARPEN;
     }
 }
+#endif
 
 static void get_sensor_state(esp_video_isp_t *isp, int index)
 {
@@ -570,7 +769,11 @@ static void get_sensor_state(esp_video_isp_t *isp, int index)
     struct v4l2_format format;
 
     if (isp->sensor_attr.awb) {
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+        isp->isp_stats[index]->flags &= ~IPA_STATS_FLAGS_AWB;
+#else
         isp->isp_stats[index]->flags &= ~ESP_VIDEO_ISP_STATS_FLAG_AWB;
+#endif
     }
 
     memset(&format, 0, sizeof(struct v4l2_format));
@@ -600,10 +803,17 @@ static void get_sensor_state(esp_video_isp_t *isp, int index)
                 }
 
                 if (sensor_stats.flags & ESP_CAM_SENSOR_STATS_FLAG_WB_GAIN) {
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+                    esp_ipa_stats_awb_t *awb = &isp->isp_stats[index]->awb_stats[0];
+
+                    isp->isp_stats[index]->flags |= IPA_STATS_FLAGS_AWB;
+                    awb->counted = 1;
+#else
                     isp_awb_stat_result_t *awb = &isp->isp_stats[index]->awb.awb_result;
 
                     isp->isp_stats[index]->flags |= ESP_VIDEO_ISP_STATS_FLAG_AWB;
                     awb->white_patch_num = 1;
+#endif
                     awb->sum_r = sensor_stats.wb_avg.red_avg;
                     awb->sum_g = sensor_stats.wb_avg.green_avg;
                     awb->sum_b = sensor_stats.wb_avg.blue_avg;
@@ -615,12 +825,465 @@ static void get_sensor_state(esp_video_isp_t *isp, int index)
     }
 }
 
+/* Mean of the AE blocks, -1 if the statistics have no AE result */
+static int32_t isp_stats_luma(const isp_stats_buf_t *isp_stat)
+{
+    uint32_t sum = 0;
+
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+    if (!(isp_stat->flags & IPA_STATS_FLAGS_AE)) {
+        return -1;
+    }
+
+    for (int i = 0; i < ISP_AE_BLOCK_X_NUM * ISP_AE_BLOCK_Y_NUM; i++) {
+        sum += isp_stat->ae_stats[i].luminance;
+    }
+#else
+    if (!(isp_stat->flags & ESP_VIDEO_ISP_STATS_FLAG_AE)) {
+        return -1;
+    }
+
+    for (int i = 0; i < ISP_AE_BLOCK_X_NUM; i++) {
+        for (int j = 0; j < ISP_AE_BLOCK_Y_NUM; j++) {
+            sum += isp_stat->ae.ae_result.luminance[i][j];
+        }
+    }
+#endif
+
+    return sum / (ISP_AE_BLOCK_X_NUM * ISP_AE_BLOCK_Y_NUM);
+}
+
+static uint32_t isp_stats_frame_seq(const isp_stats_buf_t *isp_stat)
+{
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+    return isp_stat->seq;
+#else
+    return isp_stat->frame_seq;
+#endif
+}
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_FRAMES > 0
+
+/* Mean Y of the histogram, every segment counted at its center, -1 if the statistics have no histogram */
+static int32_t isp_stats_hist_luma(const isp_stats_buf_t *isp_stat)
+{
+    uint64_t sum = 0;
+    uint32_t total = 0;
+    uint32_t segment = 256 / ISP_HIST_SEGMENT_NUMS;
+
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+    if (!(isp_stat->flags & IPA_STATS_FLAGS_HIST)) {
+        return -1;
+    }
+
+    for (int i = 0; i < ISP_HIST_SEGMENT_NUMS; i++) {
+        uint32_t count = isp_stat->hist_stats[i].value;
+#else
+    if (!(isp_stat->flags & ESP_VIDEO_ISP_STATS_FLAG_HIST)) {
+        return -1;
+    }
+
+    for (int i = 0; i < ISP_HIST_SEGMENT_NUMS; i++) {
+        uint32_t count = isp_stat->hist.hist_result.hist_value[i];
+#endif
+
+        sum += (uint64_t)count * (i * segment + segment / 2);
+        total += count;
+    }
+
+    return total ? sum / total : -1;
+}
+
+/**
+ * @brief Fast start AE
+ *
+ * For the first CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_FRAMES statistics of a stream, the exposure
+ * and gain jump to what the histogram mean asks for to reach CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_TARGET,
+ * instead of the small steps of the image algorithms. It hands over once the mean is within 1/8
+ * of the target or the frames are used up.
+ *
+ * @param isp      ISP pipeline object
+ * @param isp_stat ISP statistics
+ *
+ * @return true if the statistics were used here and the image algorithms skip them
+ */
+static bool isp_fast_ae_run(esp_video_isp_t *isp, const isp_stats_buf_t *isp_stat)
+{
+    int32_t luma;
+    float ratio;
+    float total;
+    bool changed;
+    esp_ipa_metadata_t metadata;
+    uint32_t seq = isp_stats_frame_seq(isp_stat);
+
+    /* The frame sequence starts from 0 with every stream */
+    if (seq < isp->fast_ae.last_seq) {
+        isp->fast_ae.frames = CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_FRAMES;
+        isp->fast_ae.settle = 0;
+    }
+    isp->fast_ae.last_seq = seq;
+
+    if (!isp->fast_ae.frames || !isp->sensor_attr.exposure) {
+        return false;
+    }
+
+    isp->fast_ae.frames--;
+    if (isp->fast_ae.settle) {
+        isp->fast_ae.settle--;
+        return true;
+    }
+
+    luma = isp_stats_hist_luma(isp_stat);
+    if (luma < 0 || abs(luma - CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_TARGET) <= CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_TARGET / 8) {
+        DLOGD(TAG, "fast AE done, luminance %" PRIi32, luma);
+        isp->fast_ae.frames = 0;
+        return false;
+    }
+
+    ratio = (float)CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_TARGET / MAX(luma, 1);
+    ratio = MIN(MAX(ratio, 1.0f / FAST_AE_RATIO_MAX), FAST_AE_RATIO_MAX);
+    total = isp->sensor.cur_exposure * (isp->sensor_attr.gain ? isp->sensor.cur_gain : 1.0f) * ratio;
+
+    /* Exposure first, gain only makes up for what the longest exposure can't reach */
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.flags = IPA_METADATA_FLAGS_ET;
+    metadata.exposure = MIN(MAX(total, isp->sensor.min_exposure), isp->sensor.max_exposure);
+    if (isp->sensor_attr.gain) {
+        metadata.flags |= IPA_METADATA_FLAGS_GN;
+        metadata.gain = MIN(MAX(total / metadata.exposure, isp->sensor.min_gain), isp->sensor.max_gain);
+    }
+
+    DLOGD(TAG, "fast AE: luminance %" PRIi32 ", exposure %" PRIu32 " us, gain %0.2f",
+             luma, metadata.exposure, metadata.gain);
+    changed = config_exposure_time(isp, &metadata);
+    if (isp->sensor_attr.gain) {
+        changed |= config_pixel_gain(isp, &metadata);
+    }
+    if (!changed) {
+        /* Limits reached, nothing more to gain from jumping */
+        isp->fast_ae.frames = 0;
+        return false;
+    }
+
+    isp->fast_ae.settle = FAST_AE_SETTLE_FRAMES;
+    isp->sched.stable_runs = 0;
+
+    return true;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+/* Exposure in sensor units, the float parameters out of the ISP update deadband */
+static bool isp_persist_changed(const isp_persist_state_t *saved, const isp_persist_state_t *state)
+{
+    return (saved->flags != state->flags) ||
+           ((state->flags & IPA_METADATA_FLAGS_ET) && saved->exposure / 100 != state->exposure / 100) ||
+           esp_video_isp_params_changed(&saved->gain, &state->gain, 3) ||
+           ((state->flags & IPA_METADATA_FLAGS_CCM) &&
+            esp_video_isp_params_changed(&saved->ccm[0][0], &state->ccm[0][0], ISP_CCM_DIMENSION * ISP_CCM_DIMENSION));
+}
+
+/* Write the last converged state to NVS unless it holds about the same, the caller holds the lock */
+static esp_err_t isp_persist_save(esp_video_isp_t *isp)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+
+    if (!isp->persist.converged.flags || !isp_persist_changed(&isp->persist.saved, &isp->persist.converged)) {
+        return ESP_OK;
+    }
+
+    ret = nvs_open(ISP_PERSIST_NAMESPACE, NVS_READWRITE, &handle);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to open NVS namespace %s", ISP_PERSIST_NAMESPACE);
+    ret = nvs_set_blob(handle, ISP_PERSIST_KEY, &isp->persist.converged, sizeof(isp_persist_state_t));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    ESP_RETURN_ON_ERROR(ret, TAG, "failed to save ISP state");
+
+    isp->persist.saved = isp->persist.converged;
+    ESP_LOGD(TAG, "state saved: exposure %" PRIu32 " us, gain %0.2f, red %0.3f, blue %0.3f",
+             isp->persist.saved.exposure, isp->persist.saved.gain,
+             isp->persist.saved.red_gain, isp->persist.saved.blue_gain);
+
+    return ESP_OK;
+}
+
+/* Keep the applied values of a converged run, saved at most every CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST_INTERVAL */
+static void isp_persist_converged(esp_video_isp_t *isp)
+{
+    int64_t now = esp_timer_get_time();
+    isp_persist_state_t *state = &isp->persist.converged;
+
+    xSemaphoreTake(isp->persist.lock, portMAX_DELAY);
+
+    memset(state, 0, sizeof(isp_persist_state_t));
+    state->version = ISP_PERSIST_VERSION;
+    state->flags = isp->applied.flags & ISP_PERSIST_FLAGS;
+    state->exposure = isp->applied.exposure;
+    state->gain = isp->applied.gain;
+    state->red_gain = isp->applied.red_gain;
+    state->blue_gain = isp->applied.blue_gain;
+    memcpy(state->ccm, isp->applied.ccm.matrix, sizeof(state->ccm));
+
+    if (!isp->persist.save_time || now - isp->persist.save_time >= ISP_PERSIST_INTERVAL_US) {
+        if (isp_persist_save(isp) == ESP_OK) {
+            isp->persist.save_time = now;
+        }
+    }
+
+    xSemaphoreGive(isp->persist.lock);
+}
+
+/**
+ * @brief Seed the initial IPA output with the saved state
+ *
+ * Exposure and gain are clamped to the current sensor limits, the sensor
+ * format may have changed since the save.
+ *
+ * @param isp      ISP pipeline object
+ * @param metadata Initial IPA output, the saved fields replace the defaults
+ *
+ * @return None
+ */
+static void isp_persist_load(esp_video_isp_t *isp, esp_ipa_metadata_t *metadata)
+{
+    esp_err_t ret;
+    nvs_handle_t handle;
+    isp_persist_state_t state;
+    size_t size = sizeof(state);
+
+    ret = nvs_open(ISP_PERSIST_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK) {
+        /* ESP_ERR_NVS_NOT_FOUND until the first save */
+        ESP_LOGD(TAG, "no saved state: %s", esp_err_to_name(ret));
+        return;
+    }
+    ret = nvs_get_blob(handle, ISP_PERSIST_KEY, &state, &size);
+    nvs_close(handle);
+    if ((ret != ESP_OK) || (size != sizeof(state)) || (state.version != ISP_PERSIST_VERSION)) {
+        ESP_LOGD(TAG, "no usable saved state");
+        return;
+    }
+
+    isp->persist.saved = state;
+
+    state.flags &= ISP_PERSIST_FLAGS;
+    if (!isp->sensor_attr.exposure) {
+        state.flags &= ~IPA_METADATA_FLAGS_ET;
+    }
+    if (!isp->sensor_attr.gain) {
+        state.flags &= ~IPA_METADATA_FLAGS_GN;
+    }
+
+    if (state.flags & IPA_METADATA_FLAGS_ET) {
+        metadata->exposure = MIN(MAX(state.exposure, isp->sensor.min_exposure), isp->sensor.max_exposure);
+    }
+    if (state.flags & IPA_METADATA_FLAGS_GN) {
+        metadata->gain = MIN(MAX(state.gain, isp->sensor.min_gain), isp->sensor.max_gain);
+    }
+    if (state.flags & IPA_METADATA_FLAGS_RG) {
+        metadata->red_gain = state.red_gain;
+    }
+    if (state.flags & IPA_METADATA_FLAGS_BG) {
+        metadata->blue_gain = state.blue_gain;
+    }
+    if (state.flags & IPA_METADATA_FLAGS_CCM) {
+        memcpy(metadata->ccm.matrix, state.ccm, sizeof(state.ccm));
+    }
+    metadata->flags |= state.flags;
+
+    ESP_LOGI(TAG, "starting from saved state: exposure %" PRIu32 " us, gain %0.2f, red %0.3f, blue %0.3f",
+             metadata->exposure, metadata->gain, metadata->red_gain, metadata->blue_gain);
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+/**
+ * @brief Append an image algorithm run to the record.
+ *
+ * Called before the statistics buffer goes back to the ISP. The lock is only
+ * held long while a record is started or stopped, the run is dropped then.
+ *
+ * @param isp        ISP pipeline object
+ * @param stats      Statistics passed to the image algorithms
+ * @param sensor     Sensor state passed to the image algorithms
+ * @param metadata   Image algorithm result
+ * @param process_us CPU time of the image algorithms
+ *
+ * @return None
+ */
+static void isp_record_run(esp_video_isp_t *isp, const esp_ipa_stats_t *stats, const esp_ipa_sensor_t *sensor,
+                           const esp_ipa_metadata_t *metadata, uint32_t process_us)
+{
+    esp_video_ipa_record_frame_t frame = {
+        .time_us = esp_timer_get_time(),
+        .process_us = process_us,
+    };
+
+    if (xSemaphoreTake(isp->record.lock, 0) != pdTRUE) {
+        return;
+    }
+
+    if (isp->record.file && !isp->record.failed) {
+        if (fwrite(&frame, sizeof(frame), 1, isp->record.file) != 1 ||
+                fwrite(stats, sizeof(*stats), 1, isp->record.file) != 1 ||
+                fwrite(sensor, sizeof(*sensor), 1, isp->record.file) != 1 ||
+                fwrite(metadata, sizeof(*metadata), 1, isp->record.file) != 1) {
+            DLOGE(TAG, "failed to record image algorithm input");
+            isp->record.failed = true;
+        } else {
+            isp->record.frames++;
+        }
+    }
+
+    xSemaphoreGive(isp->record.lock);
+}
+#endif
+
+/**
+ * @brief Decide if the image algorithms run on these statistics
+ *
+ * While adjusting they run every CONFIG_ESP_VIDEO_ISP_PIPELINE_DECIMATION statistics. After
+ * CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_RUNS runs changed nothing, the interval grows to
+ * CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_DECIMATION until the scene luminance moves.
+ *
+ * @param isp  ISP pipeline object
+ * @param luma Mean AE luminance of the statistics, -1 if unknown
+ *
+ * @return true to run the image algorithms
+ */
+static bool isp_schedule_run(esp_video_isp_t *isp, int32_t luma)
+{
+    bool converged = isp->sched.stable_runs >= CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_RUNS;
+    uint32_t interval = converged ? CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_DECIMATION :
+                        CONFIG_ESP_VIDEO_ISP_PIPELINE_DECIMATION;
+
+    isp->sched.pending++;
+
+    if (converged && luma >= 0 && isp->sched.luma >= 0 &&
+            abs(luma - isp->sched.luma) > CONFIG_ESP_VIDEO_ISP_PIPELINE_WAKE_LUMA_DELTA) {
+        DLOGD(TAG, "luminance %" PRIi32 " -> %" PRIi32 ", adjusting", isp->sched.luma, luma);
+        isp->sched.stable_runs = 0;
+    } else if (isp->sched.pending < interval) {
+        return false;
+    }
+
+    isp->sched.pending = 0;
+    isp->sched.luma = luma;
+
+    return true;
+}
+
+static void isp_schedule_done(esp_video_isp_t *isp, bool changed)
+{
+    if (changed) {
+        isp->sched.stable_runs = 0;
+    } else if (isp->sched.stable_runs < CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_RUNS) {
+        if (++isp->sched.stable_runs == CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_RUNS) {
+            DLOGD(TAG, "converged, running every %d statistics", CONFIG_ESP_VIDEO_ISP_PIPELINE_CONVERGED_DECIMATION);
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+            isp_persist_converged(isp);
+#endif
+        }
+    }
+}
+
+/* Statistics part of the frame metadata, taken before the statistics buffer is given back */
+static void isp_frame_meta_stats(const esp_ipa_stats_t *stats, int32_t luma, struct esp_video_frame_meta *meta)
+{
+    uint32_t total = 0;
+
+    memset(meta, 0, sizeof(*meta));
+    meta->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    meta->stats_seq = stats->seq;
+    if (luma < 0 || !(stats->flags & IPA_STATS_FLAGS_HIST)) {
+        return;
+    }
+
+    for (int i = 0; i < ISP_HIST_SEGMENT_NUMS; i++) {
+        total += stats->hist_stats[i].value;
+    }
+    if (total) {
+        meta->dark = (uint64_t)stats->hist_stats[0].value * 1000 / total;
+        meta->bright = (uint64_t)stats->hist_stats[ISP_HIST_SEGMENT_NUMS - 1].value * 1000 / total;
+    }
+    meta->luma = luma;
+    meta->flags |= ESP_VIDEO_FRAME_META_STATS;
+}
+
+_Static_assert(ISP_AE_BLOCK_X_NUM == ESP_VIDEO_FRAME_META_AE_GRID_H && ISP_AE_BLOCK_Y_NUM == ESP_VIDEO_FRAME_META_AE_GRID_W,
+               "AE grid of the frame metadata doesn't match the ISP");
+
+/* AE blocks of every statistics go to the capture device, also when the image algorithms skip them */
+static void isp_frame_meta_ae_grid(esp_video_isp_t *isp, const isp_stats_buf_t *isp_stat)
+{
+    struct esp_video_frame_meta meta;
+
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+    if (!(isp_stat->flags & IPA_STATS_FLAGS_AE)) {
+        return;
+    }
+#else
+    if (!(isp_stat->flags & ESP_VIDEO_ISP_STATS_FLAG_AE)) {
+        return;
+    }
+#endif
+
+    memset(&meta, 0, sizeof(meta));
+    meta.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    meta.flags = ESP_VIDEO_FRAME_META_AE_GRID;
+    meta.ae_seq = isp_stats_frame_seq(isp_stat);
+    /* Blocks are in raster order, like print_stats_info() shows them */
+    for (int i = 0; i < ISP_AE_BLOCK_X_NUM; i++) {
+        for (int j = 0; j < ISP_AE_BLOCK_Y_NUM; j++) {
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+            meta.ae_luma[i][j] = MIN(isp_stat->ae_stats[i * ISP_AE_BLOCK_Y_NUM + j].luminance, 255);
+#else
+            meta.ae_luma[i][j] = MIN(isp_stat->ae.ae_result.luminance[i][j], 255);
+#endif
+        }
+    }
+
+    if (ioctl(isp->cam_fd, VIDIOC_S_FRAME_META, &meta) != 0) {
+        DLOGD(TAG, "failed to set frame AE grid");
+    }
+}
+
+/* Hand the settings in effect to the capture device, which attaches them to the frames it captures */
+static void isp_frame_meta_update(esp_video_isp_t *isp, struct esp_video_frame_meta *meta)
+{
+    if (isp->sensor_attr.exposure) {
+        meta->exposure_us = isp->sensor.cur_exposure;
+        meta->flags |= ESP_VIDEO_FRAME_META_EXPOSURE;
+    }
+    if (isp->sensor_attr.gain) {
+        meta->gain = isp->sensor.cur_gain;
+        meta->flags |= ESP_VIDEO_FRAME_META_GAIN;
+    }
+    if ((isp->applied.flags & IPA_METADATA_FLAGS_RG) && (isp->applied.flags & IPA_METADATA_FLAGS_BG)) {
+        meta->red_gain = isp->applied.red_gain;
+        meta->blue_gain = isp->applied.blue_gain;
+        meta->flags |= ESP_VIDEO_FRAME_META_WB;
+    }
+
+    if (ioctl(isp->cam_fd, VIDIOC_S_FRAME_META, meta) != 0) {
+        DLOGD(TAG, "failed to set frame metadata");
+    }
+}
+
 static void isp_task(void *p)
 {
     esp_err_t ret;
+    int32_t luma;
     struct v4l2_buffer buf;
+    const esp_ipa_stats_t *stats;
+#if !CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
     esp_ipa_stats_t ipa_stats;
+#endif
     esp_ipa_metadata_t metadata;
+    struct esp_video_frame_meta frame_meta;
     esp_video_isp_t *isp = (esp_video_isp_t *)p;
 
     while (1) {
@@ -628,26 +1291,84 @@ static void isp_task(void *p)
         buf.type   = V4L2_BUF_TYPE_META_CAPTURE;
         buf.memory = V4L2_MEMORY_MMAP;
         if (ioctl(isp->isp_fd, VIDIOC_DQBUF, &buf) != 0) {
-            ESP_LOGE(TAG, "failed to receive video frame");
+            DLOGE(TAG, "failed to receive video frame");
             continue;
         }
 
+        isp_frame_meta_ae_grid(isp, isp->isp_stats[buf.index]);
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_FRAMES > 0
+        if (isp_fast_ae_run(isp, isp->isp_stats[buf.index])) {
+            if (ioctl(isp->isp_fd, VIDIOC_QBUF, &buf) != 0) {
+                DLOGE(TAG, "failed to queue video frame");
+            }
+
+            memset(&frame_meta, 0, sizeof(frame_meta));
+            frame_meta.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            isp_frame_meta_update(isp, &frame_meta);
+            continue;
+        }
+#endif
+
+        /* Skipped statistics cost no sensor access */
+        luma = isp_stats_luma(isp->isp_stats[buf.index]);
+        if (!isp_schedule_run(isp, luma)) {
+            if (ioctl(isp->isp_fd, VIDIOC_QBUF, &buf) != 0) {
+                DLOGE(TAG, "failed to queue video frame");
+            }
+            continue;
+        }
+
+        TRACE_BEGIN(ipa_start);
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+        int64_t run_start = esp_timer_get_time();
+#endif
         get_sensor_state(isp, buf.index);
 
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+        /* The buffer is already in IPA layout, it is held until the algorithms are done with it */
+        stats = isp->isp_stats[buf.index];
+#else
         isp_stats_to_ipa_stats(isp->isp_stats[buf.index], &ipa_stats);
         if (ioctl(isp->isp_fd, VIDIOC_QBUF, &buf) != 0) {
-            ESP_LOGE(TAG, "failed to queue video frame");
+            DLOGE(TAG, "failed to queue video frame");
         }
-        print_stats_info(&ipa_stats);
-
-        metadata.flags = 0;
-        ret = esp_ipa_pipeline_process(isp->ipa_pipeline, &ipa_stats, &isp->sensor, &metadata);
+        stats = &ipa_stats;
+#endif
+        print_stats_info(stats);
+        isp_frame_meta_stats(stats, luma, &frame_meta);
+
+        /* Cleared so unchanged values compare equal including padding */
+        memset(&metadata, 0, sizeof(metadata));
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+        /* The input as the algorithms saw it, they may update the sensor state */
+        esp_ipa_sensor_t record_sensor = isp->sensor;
+        int64_t process_start = esp_timer_get_time();
+#endif
+        ret = esp_ipa_pipeline_process(isp->ipa_pipeline, stats, &isp->sensor, &metadata);
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+        /* Checked again under the lock */
+        if (ret == ESP_OK && isp->record.file) {
+            isp_record_run(isp, stats, &record_sensor, &metadata, (uint32_t)(esp_timer_get_time() - process_start));
+        }
+#endif
+#if CONFIG_ESP_VIDEO_ISP_STATS_IPA_LAYOUT
+        if (ioctl(isp->isp_fd, VIDIOC_QBUF, &buf) != 0) {
+            DLOGE(TAG, "failed to queue video frame");
+        }
+#endif
         if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "failed to process image algorithm");
+            DLOGE(TAG, "failed to process image algorithm");
             continue;
         }
 
-        config_isp_and_camera(isp, &metadata);
+        isp_schedule_done(isp, config_isp_and_camera(isp, &metadata));
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+        isp->load.time_us += (uint32_t)(esp_timer_get_time() - run_start);
+        isp->load.runs++;
+#endif
+        TRACE_END(TRACE_IPA, ipa_start, buf.index);
+        isp_frame_meta_update(isp, &frame_meta);
     }
 
     vTaskDelete(NULL);
@@ -802,8 +1523,8 @@ static esp_err_t init_isp_dev(const esp_video_isp_config_t *config, esp_video_is
         ret = ioctl(fd, VIDIOC_QUERYBUF, &buf);
         ESP_GOTO_ON_FALSE(ret == 0, ESP_FAIL, fail_0, TAG, "failed to query buffer");
 
-        isp->isp_stats[i] = (esp_video_isp_stats_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
-                            MAP_SHARED, fd, buf.m.offset);
+        isp->isp_stats[i] = (isp_stats_buf_t *)mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED, fd, buf.m.offset);
         ESP_GOTO_ON_FALSE(isp->isp_stats[i] != NULL, ESP_FAIL, fail_0, TAG, "failed to map buffer");
 
         ret = ioctl(fd, VIDIOC_QBUF, &buf);
@@ -856,16 +1577,50 @@ esp_err_t esp_video_isp_pipeline_init(const esp_video_isp_config_t *config)
     ESP_GOTO_ON_ERROR(init_cam_dev(config, isp), fail_1, TAG, "failed to initialize camera device");
     ESP_GOTO_ON_ERROR(init_isp_dev(config, isp), fail_2, TAG, "failed to initialize ISP device");
 
-    metadata.flags = 0;
+    memset(&metadata, 0, sizeof(metadata));
+    isp->sched.luma = -1;
+    isp->fast_ae.frames = CONFIG_ESP_VIDEO_ISP_PIPELINE_FAST_AE_FRAMES;
     ESP_GOTO_ON_ERROR(esp_ipa_pipeline_init(isp->ipa_pipeline, &isp->sensor, &metadata),
                       fail_3, TAG, "failed to initialize IPA pipeline");
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+    isp->persist.lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(isp->persist.lock, ESP_ERR_NO_MEM, fail_3, TAG, "failed to create state lock");
+    /* The IPA algorithms start from their defaults, the first frames from the saved state */
+    isp_persist_load(isp, &metadata);
+#endif
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+    isp->record.lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(isp->record.lock, ESP_ERR_NO_MEM, fail_4, TAG, "failed to create record lock");
+    if (config->sensor_name) {
+        strncpy(isp->record.sensor, config->sensor_name, sizeof(isp->record.sensor) - 1);
+    }
+#endif
     config_isp_and_camera(isp, &metadata);
 
-    ESP_GOTO_ON_FALSE(xTaskCreate(isp_task, "isp_task", ISP_TASK_STACK_SIZE, isp, ISP_TASK_PRIORITY, NULL) == pdPASS,
-                      ESP_ERR_NO_MEM, fail_3, TAG, "failed to create ISP task");
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_HOLD_HIST
+    /* Nothing of the controller reads the histogram, and the image algorithms are configured not to */
+    ESP_GOTO_ON_ERROR(esp_video_isp_hold_blocks(esp_video_isp_held_blocks() | ESP_VIDEO_ISP_BLOCK_HIST_STATS),
+                      fail_5, TAG, "failed to hold histogram statistics");
+#endif
+
+    ESP_GOTO_ON_FALSE(xTaskCreatePinnedToCore(isp_task, "isp_task", ISP_TASK_STACK_SIZE, isp,
+                                              ISP_TASK_PRIORITY, NULL, ISP_TASK_CORE) == pdPASS,
+                      ESP_ERR_NO_MEM, fail_5, TAG, "failed to create ISP task");
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST || CONFIG_ESP_VIDEO_ISP_LOAD_STATS || CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+    s_isp = isp;
+#endif
 
     return ESP_OK;
 
+fail_5:
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+    vSemaphoreDelete(isp->record.lock);
+#endif
+fail_4:
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+    vSemaphoreDelete(isp->persist.lock);
+#endif
 fail_3:
     close(isp->isp_fd);
 fail_2:
@@ -876,3 +1631,131 @@ fail_0:
     free(isp);
     return ret;
 }
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_PERSIST
+/**
+ * @brief Save the last converged ISP state to NVS.
+ *
+ * @return
+ *      - ESP_OK on success or if NVS already holds about the same state
+ *      - ESP_ERR_INVALID_STATE if the ISP pipeline controller is not running
+ *      - Others if writing NVS failed
+ */
+esp_err_t esp_video_isp_pipeline_save(void)
+{
+    esp_err_t ret;
+    esp_video_isp_t *isp = s_isp;
+
+    ESP_RETURN_ON_FALSE(isp, ESP_ERR_INVALID_STATE, TAG, "ISP pipeline controller is not running");
+
+    xSemaphoreTake(isp->persist.lock, portMAX_DELAY);
+    ret = isp_persist_save(isp);
+    xSemaphoreGive(isp->persist.lock);
+
+    return ret;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_LOAD_STATS
+/**
+ * @brief Get the image algorithm load counters, 0 before the controller runs.
+ *
+ * @param runs    Image algorithm runs since boot
+ * @param time_us CPU time of those runs in microseconds, wraps
+ *
+ * @return None
+ */
+void esp_video_isp_pipeline_get_load(uint32_t *runs, uint32_t *time_us)
+{
+    esp_video_isp_t *isp = s_isp;
+
+    /* Written by the ISP task only, 32 bit reads are whole */
+    *runs = isp ? isp->load.runs : 0;
+    *time_us = isp ? isp->load.time_us : 0;
+}
+#endif
+
+#if CONFIG_ESP_VIDEO_ISP_PIPELINE_RECORD
+/**
+ * @brief Start recording the image algorithm input to a file.
+ *
+ * @param path File to record to
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if path is NULL
+ *      - ESP_ERR_INVALID_STATE if the ISP pipeline controller is not running or already records
+ *      - ESP_FAIL if the file can't be created
+ */
+esp_err_t esp_video_isp_pipeline_record_start(const char *path)
+{
+    esp_err_t ret = ESP_OK;
+    FILE *file;
+    esp_video_isp_t *isp = s_isp;
+    esp_video_ipa_record_header_t header = {
+        .magic = ESP_VIDEO_IPA_RECORD_MAGIC,
+        .version = ESP_VIDEO_IPA_RECORD_VERSION,
+        .header_size = sizeof(esp_video_ipa_record_header_t),
+        .stats_size = sizeof(esp_ipa_stats_t),
+        .sensor_size = sizeof(esp_ipa_sensor_t),
+        .metadata_size = sizeof(esp_ipa_metadata_t),
+    };
+
+    ESP_RETURN_ON_FALSE(path, ESP_ERR_INVALID_ARG, TAG, "invalid path");
+    ESP_RETURN_ON_FALSE(isp, ESP_ERR_INVALID_STATE, TAG, "ISP pipeline controller is not running");
+    memcpy(header.sensor, isp->record.sensor, sizeof(header.sensor));
+
+    xSemaphoreTake(isp->record.lock, portMAX_DELAY);
+    ESP_GOTO_ON_FALSE(!isp->record.file, ESP_ERR_INVALID_STATE, exit, TAG, "already recording");
+
+    file = fopen(path, "wb");
+    ESP_GOTO_ON_FALSE(file, ESP_FAIL, exit, TAG, "failed to create %s", path);
+    setvbuf(file, NULL, _IOFBF, ISP_RECORD_BUFFER_SIZE);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        ESP_GOTO_ON_FALSE(false, ESP_FAIL, exit, TAG, "failed to write %s", path);
+    }
+
+    isp->record.frames = 0;
+    isp->record.failed = false;
+    isp->record.file = file;
+
+exit:
+    xSemaphoreGive(isp->record.lock);
+    return ret;
+}
+
+/**
+ * @brief Stop recording the image algorithm input and close the file.
+ *
+ * @param frames If not NULL, the number of runs recorded
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if nothing is recorded
+ *      - ESP_FAIL if writing the file failed
+ */
+esp_err_t esp_video_isp_pipeline_record_stop(uint32_t *frames)
+{
+    esp_err_t ret = ESP_OK;
+    esp_video_isp_t *isp = s_isp;
+
+    ESP_RETURN_ON_FALSE(isp, ESP_ERR_INVALID_STATE, TAG, "ISP pipeline controller is not running");
+
+    xSemaphoreTake(isp->record.lock, portMAX_DELAY);
+    ESP_GOTO_ON_FALSE(isp->record.file, ESP_ERR_INVALID_STATE, exit, TAG, "not recording");
+
+    if (fclose(isp->record.file) != 0 || isp->record.failed) {
+        ESP_LOGE(TAG, "failed to write the image algorithm record");
+        ret = ESP_FAIL;
+    }
+    isp->record.file = NULL;
+    if (frames) {
+        *frames = isp->record.frames;
+    }
+
+exit:
+    xSemaphoreGive(isp->record.lock);
+    return ret;
+}
+#endif
@@ -0,0 +1,305 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "linux/videodev2.h"
+#include "esp_video_pixconv.h"
+
+/*
+ * Kernels load and store whole 32-bit words and work on the bytes of a word in parallel,
+ * PSRAM is read and written a word at a time instead of a byte at a time. Chroma averages
+ * are done on two 16-bit lanes of one word, sums of two or four bytes can't overflow a lane.
+ */
+
+/* Average of two bytes in each 16-bit lane, rounded */
+#define PIXCONV_LANE_AVG2(a, b)         ((((a) + (b) + 0x00010001) >> 1) & 0x00ff00ff)
+
+/* Average of four bytes in each 16-bit lane, rounded */
+#define PIXCONV_LANE_AVG4(s)            ((((s) + 0x00020002) >> 2) & 0x00ff00ff)
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)                   sizeof(x) / sizeof((x)[0])
+#endif
+
+typedef struct pixconv_entry {
+    uint32_t src_format;
+    uint32_t dst_format;
+    esp_video_pixconv_func_t func;
+} pixconv_entry_t;
+
+/* Bytes 0 and 2 of a word, as a halfword */
+static inline uint32_t pixconv_even_bytes(uint32_t w)
+{
+    return (w & 0xff) | ((w >> 8) & 0xff00);
+}
+
+/* Bytes 0 and 1 of a halfword, spread to bytes 0 and 2 of a word */
+static inline uint32_t pixconv_spread_bytes(uint32_t h)
+{
+    return (h & 0xff) | ((h & 0xff00) << 8);
+}
+
+/* Four 3-byte groups, in the low 24 bits of each value, into three words */
+static inline void pixconv_pack3x4(uint32_t *dst, uint32_t t0, uint32_t t1, uint32_t t2, uint32_t t3)
+{
+    dst[0] = t0 | (t1 << 24);
+    dst[1] = (t1 >> 8) | (t2 << 16);
+    dst[2] = (t2 >> 16) | (t3 << 8);
+}
+
+/* Three words into four 3-byte groups */
+static inline void pixconv_unpack3x4(const uint32_t *src, uint32_t *t)
+{
+    t[0] = src[0] & 0xffffff;
+    t[1] = (src[0] >> 24) | ((src[1] & 0xffff) << 8);
+    t[2] = (src[1] >> 16) | ((src[2] & 0xff) << 16);
+    t[3] = src[2] >> 8;
+}
+
+/* 4 pixel words "Y U Y V", 2 words per line for 4 pixels */
+static void pixconv_yuyv_to_nv12(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    uint8_t *dst_uv = dst + width * height;
+
+    for (uint32_t y = 0; y < height; y += 2) {
+        const uint32_t *r0 = (const uint32_t *)(src + y * width * 2);
+        const uint32_t *r1 = (const uint32_t *)(src + (y + 1) * width * 2);
+        uint32_t *y0 = (uint32_t *)(dst + y * width);
+        uint32_t *y1 = (uint32_t *)(dst + (y + 1) * width);
+        uint32_t *uv = (uint32_t *)(dst_uv + y / 2 * width);
+
+        for (uint32_t x = 0; x < width / 4; x++) {
+            uint32_t a0 = r0[2 * x];
+            uint32_t a1 = r0[2 * x + 1];
+            uint32_t b0 = r1[2 * x];
+            uint32_t b1 = r1[2 * x + 1];
+            uint32_t c0 = PIXCONV_LANE_AVG2((a0 >> 8) & 0x00ff00ff, (b0 >> 8) & 0x00ff00ff);
+            uint32_t c1 = PIXCONV_LANE_AVG2((a1 >> 8) & 0x00ff00ff, (b1 >> 8) & 0x00ff00ff);
+
+            y0[x] = pixconv_even_bytes(a0) | (pixconv_even_bytes(a1) << 16);
+            y1[x] = pixconv_even_bytes(b0) | (pixconv_even_bytes(b1) << 16);
+            uv[x] = pixconv_even_bytes(c0) | (pixconv_even_bytes(c1) << 16);
+        }
+    }
+}
+
+static void pixconv_nv12_to_yuyv(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    const uint8_t *src_uv = src + width * height;
+
+    for (uint32_t y = 0; y < height; y += 2) {
+        const uint32_t *y0 = (const uint32_t *)(src + y * width);
+        const uint32_t *y1 = (const uint32_t *)(src + (y + 1) * width);
+        const uint32_t *uv = (const uint32_t *)(src_uv + y / 2 * width);
+        uint32_t *r0 = (uint32_t *)(dst + y * width * 2);
+        uint32_t *r1 = (uint32_t *)(dst + (y + 1) * width * 2);
+
+        /* Both lines of a pair share the chroma line */
+        for (uint32_t x = 0; x < width / 4; x++) {
+            uint32_t c_lo = pixconv_spread_bytes(uv[x]) << 8;
+            uint32_t c_hi = pixconv_spread_bytes(uv[x] >> 16) << 8;
+            uint32_t a = y0[x];
+            uint32_t b = y1[x];
+
+            r0[2 * x] = pixconv_spread_bytes(a) | c_lo;
+            r0[2 * x + 1] = pixconv_spread_bytes(a >> 16) | c_hi;
+            r1[2 * x] = pixconv_spread_bytes(b) | c_lo;
+            r1[2 * x + 1] = pixconv_spread_bytes(b >> 16) | c_hi;
+        }
+    }
+}
+
+/* 2 pixel words "U Y V Y" in, "U Y Y" and "V Y Y" lines out, 4 words per line in and 3 out for 8 pixels */
+static void pixconv_yuv422p_to_yuv420(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; y += 2) {
+        const uint32_t *r0 = (const uint32_t *)(src + y * width * 2);
+        const uint32_t *r1 = (const uint32_t *)(src + (y + 1) * width * 2);
+        uint32_t *d0 = (uint32_t *)(dst + y * width * 3 / 2);
+        uint32_t *d1 = (uint32_t *)(dst + (y + 1) * width * 3 / 2);
+
+        for (uint32_t x = 0; x < width / 8; x++) {
+            uint32_t t0[4];
+            uint32_t t1[4];
+
+            for (int i = 0; i < 4; i++) {
+                uint32_t a = r0[4 * x + i];
+                uint32_t b = r1[4 * x + i];
+                uint32_t c = PIXCONV_LANE_AVG2(a & 0x00ff00ff, b & 0x00ff00ff);
+
+                t0[i] = (c & 0xff) | (pixconv_even_bytes(a >> 8) << 8);
+                t1[i] = (c >> 16) | (pixconv_even_bytes(b >> 8) << 8);
+            }
+
+            pixconv_pack3x4(&d0[3 * x], t0[0], t0[1], t0[2], t0[3]);
+            pixconv_pack3x4(&d1[3 * x], t1[0], t1[1], t1[2], t1[3]);
+        }
+    }
+}
+
+static void pixconv_yuv420_to_yuv422p(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; y += 2) {
+        const uint32_t *s0 = (const uint32_t *)(src + y * width * 3 / 2);
+        const uint32_t *s1 = (const uint32_t *)(src + (y + 1) * width * 3 / 2);
+        uint32_t *r0 = (uint32_t *)(dst + y * width * 2);
+        uint32_t *r1 = (uint32_t *)(dst + (y + 1) * width * 2);
+
+        for (uint32_t x = 0; x < width / 8; x++) {
+            uint32_t t0[4];
+            uint32_t t1[4];
+
+            pixconv_unpack3x4(&s0[3 * x], t0);
+            pixconv_unpack3x4(&s1[3 * x], t1);
+
+            /* U from the even line and V from the odd line go to both lines */
+            for (int i = 0; i < 4; i++) {
+                uint32_t c = (t0[i] & 0xff) | ((t1[i] & 0xff) << 16);
+
+                r0[4 * x + i] = c | (pixconv_spread_bytes(t0[i] >> 8) << 8);
+                r1[4 * x + i] = c | (pixconv_spread_bytes(t1[i] >> 8) << 8);
+            }
+        }
+    }
+}
+
+/* RGB565 is little endian, RGB24 has red first, 2 words in and 3 out for 4 pixels */
+static void pixconv_rgb565_to_rgb24(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+    uint32_t n = width * height / 4;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t t[4];
+
+        for (int j = 0; j < 4; j++) {
+            uint32_t p = (s[2 * i + j / 2] >> ((j & 1) * 16)) & 0xffff;
+            uint32_t r = (p >> 11) & 0x1f;
+            uint32_t g = (p >> 5) & 0x3f;
+            uint32_t b = p & 0x1f;
+
+            /* Replicate the high bits into the low ones, so full scale stays full scale */
+            t[j] = ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16);
+        }
+
+        pixconv_pack3x4(&d[3 * i], t[0], t[1], t[2], t[3]);
+    }
+}
+
+static void pixconv_rgb24_to_rgb565(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+    uint32_t n = width * height / 4;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t t[4];
+        uint32_t p[4];
+
+        pixconv_unpack3x4(&s[3 * i], t);
+        for (int j = 0; j < 4; j++) {
+            p[j] = ((t[j] & 0xf8) << 8) | ((t[j] >> 5) & 0x07e0) | ((t[j] >> 19) & 0x1f);
+        }
+
+        d[2 * i] = p[0] | (p[1] << 16);
+        d[2 * i + 1] = p[2] | (p[3] << 16);
+    }
+}
+
+/*
+ * Every 2x2 Bayer quad has two green, one red and one blue sample whatever the order,
+ * so its average is (R + 2G + B) / 4, close enough to luma for a preview.
+ */
+static void pixconv_bayer8_to_grey(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; y += 2) {
+        const uint32_t *r0 = (const uint32_t *)(src + y * width);
+        const uint32_t *r1 = (const uint32_t *)(src + (y + 1) * width);
+        uint32_t *d = (uint32_t *)(dst + y / 2 * width / 2);
+
+        for (uint32_t x = 0; x < width / 8; x++) {
+            uint32_t a0 = r0[2 * x];
+            uint32_t a1 = r0[2 * x + 1];
+            uint32_t b0 = r1[2 * x];
+            uint32_t b1 = r1[2 * x + 1];
+            uint32_t s0 = (a0 & 0x00ff00ff) + ((a0 >> 8) & 0x00ff00ff) + (b0 & 0x00ff00ff) + ((b0 >> 8) & 0x00ff00ff);
+            uint32_t s1 = (a1 & 0x00ff00ff) + ((a1 >> 8) & 0x00ff00ff) + (b1 & 0x00ff00ff) + ((b1 >> 8) & 0x00ff00ff);
+
+            d[x] = pixconv_even_bytes(PIXCONV_LANE_AVG4(s0)) | (pixconv_even_bytes(PIXCONV_LANE_AVG4(s1)) << 16);
+        }
+    }
+}
+
+/*
+ * Both line types of YUV420 are "C Y Y" groups, so the luma of the frame is every byte
+ * but each third one. Three words hold eight luma samples, which make two words.
+ */
+static void pixconv_yuv420_to_grey(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+    uint32_t n = width * height / 8;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t w0 = s[3 * i];
+        uint32_t w1 = s[3 * i + 1];
+        uint32_t w2 = s[3 * i + 2];
+
+        d[2 * i] = ((w0 >> 8) & 0xffff) | (w1 << 16);
+        d[2 * i + 1] = (w1 >> 24) | ((w2 & 0xff) << 8) | (w2 & 0xffff0000);
+    }
+}
+
+static const pixconv_entry_t s_pixconv_table[] = {
+    { V4L2_PIX_FMT_YUYV,    V4L2_PIX_FMT_NV12,    pixconv_yuyv_to_nv12 },
+    { V4L2_PIX_FMT_NV12,    V4L2_PIX_FMT_YUYV,    pixconv_nv12_to_yuyv },
+    { V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV420,  pixconv_yuv422p_to_yuv420 },
+    { V4L2_PIX_FMT_YUV420,  V4L2_PIX_FMT_YUV422P, pixconv_yuv420_to_yuv422p },
+    { V4L2_PIX_FMT_RGB565,  V4L2_PIX_FMT_RGB24,   pixconv_rgb565_to_rgb24 },
+    { V4L2_PIX_FMT_RGB24,   V4L2_PIX_FMT_RGB565,  pixconv_rgb24_to_rgb565 },
+    { V4L2_PIX_FMT_YUV420,  V4L2_PIX_FMT_GREY,    pixconv_yuv420_to_grey },
+    { V4L2_PIX_FMT_SBGGR8,  V4L2_PIX_FMT_GREY,    pixconv_bayer8_to_grey },
+    { V4L2_PIX_FMT_SGBRG8,  V4L2_PIX_FMT_GREY,    pixconv_bayer8_to_grey },
+    { V4L2_PIX_FMT_SGRBG8,  V4L2_PIX_FMT_GREY,    pixconv_bayer8_to_grey },
+    { V4L2_PIX_FMT_SRGGB8,  V4L2_PIX_FMT_GREY,    pixconv_bayer8_to_grey },
+};
+
+esp_video_pixconv_func_t esp_video_pixconv_find(uint32_t src_format, uint32_t dst_format)
+{
+    for (int i = 0; i < ARRAY_SIZE(s_pixconv_table); i++) {
+        if ((s_pixconv_table[i].src_format == src_format) && (s_pixconv_table[i].dst_format == dst_format)) {
+            return s_pixconv_table[i].func;
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t esp_video_pixconv_frame_size(uint32_t format, uint32_t width, uint32_t height)
+{
+    switch (format) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_YUV422P:
+    case V4L2_PIX_FMT_RGB565:
+        return width * height * 2;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_YUV420:
+        return width * height * 3 / 2;
+    case V4L2_PIX_FMT_RGB24:
+        return width * height * 3;
+    case V4L2_PIX_FMT_GREY:
+    case V4L2_PIX_FMT_SBGGR8:
+    case V4L2_PIX_FMT_SGBRG8:
+    case V4L2_PIX_FMT_SGRBG8:
+    case V4L2_PIX_FMT_SRGGB8:
+        return width * height;
+    default:
+        return 0;
+    }
+}
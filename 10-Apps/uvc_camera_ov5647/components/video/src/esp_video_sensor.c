@@ -456,3 +456,32 @@ esp_err_t esp_video_query_menu_from_sensor(esp_cam_sensor_device_t *cam_dev, str
 
     return ESP_OK;
 }
+
+/**
+ * @brief Check if the format is the one currently programmed into the camera sensor device
+ *
+ * @param cam_dev  Camera sensor device pointer
+ * @param format   Sensor format pointer
+ *
+ * @return
+ *      - true if the sensor runs the same register table already
+ *      - false if the format has to be written
+ */
+bool esp_video_sensor_format_is_current(esp_cam_sensor_device_t *cam_dev, const esp_cam_sensor_format_t *format)
+{
+    const esp_cam_sensor_format_t *cur_format = cam_dev->cur_format;
+
+    if (!cur_format) {
+        return false;
+    } else if (cur_format == format) {
+        return true;
+    }
+
+    /* A copy of the driver's format table entry still points at the same register table */
+    return cur_format->regs == format->regs &&
+           cur_format->regs_size == format->regs_size &&
+           cur_format->format == format->format &&
+           cur_format->width == format->width &&
+           cur_format->height == format->height &&
+           cur_format->fps == format->fps;
+}
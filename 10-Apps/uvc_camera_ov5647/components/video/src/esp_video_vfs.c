@@ -13,6 +13,7 @@
 #include <sys/lock.h>
 #include <sys/errno.h>
 #include <sys/param.h>
+#include <sys/select.h>
 #include "linux/videodev2.h"
 #include "esp_log.h"
 #include "esp_vfs.h"
@@ -20,6 +21,49 @@
 #include "esp_video_vfs.h"
 #include "esp_video_ioctl_internal.h"
 
+/**
+ * Local file descriptors index s_vfs_file over all video devices, they are told apart
+ * in select() this way since start_select() gets no context pointer. They are bits of
+ * fd_set, so there are at most FD_SETSIZE.
+ */
+#define ESP_VIDEO_VFS_FILE_MAX      32
+
+/* Concurrent select() calls waiting for video files */
+#define ESP_VIDEO_VFS_SELECT_MAX    8
+
+_Static_assert(ESP_VIDEO_VFS_FILE_MAX <= FD_SETSIZE, "video local file descriptors must fit in fd_set");
+
+/**
+ * @brief Opened video file object.
+ */
+struct esp_video_vfs_file {
+    struct esp_video *video;                /*!< Video object, NULL if the entry is free */
+    int slot;                               /*!< Client slot index of the opened file */
+};
+
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+/**
+ * @brief select() call waiting for video files.
+ */
+struct esp_video_vfs_select {
+    bool used;                              /*!< Entry is used by a select() call */
+    bool triggered;                         /*!< Select semaphore is given already */
+    int nfds;                               /*!< Highest local file descriptor plus 1 */
+    fd_set readfds;                         /*!< Files waited for to be readable */
+    fd_set writefds;                        /*!< Files waited for to be writable */
+    fd_set *readfds_ready;                  /*!< Caller set ready readable files are added to */
+    fd_set *writefds_ready;                 /*!< Caller set ready writable files are added to */
+    esp_vfs_select_sem_t sem;               /*!< Select semaphore */
+};
+
+static struct esp_video_vfs_select s_vfs_select[ESP_VIDEO_VFS_SELECT_MAX];
+static volatile uint32_t s_vfs_select_count;
+#endif
+
+/* Protects files and select() entries, select() entries are also checked from ISR */
+static portMUX_TYPE s_vfs_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct esp_video_vfs_file s_vfs_file[ESP_VIDEO_VFS_FILE_MAX];
+
 static int esp_err_to_errno(esp_err_t err)
 {
     switch (err) {
@@ -53,6 +97,8 @@ static int esp_err_to_errno(esp_err_t err)
 
 static int esp_video_vfs_open(void *ctx, const char *path, int flags, int mode)
 {
+    int fd;
+    int slot;
     struct esp_video *video = (struct esp_video *)ctx;
 
     /* Open video here to initialize software resource and hardware */
@@ -63,7 +109,46 @@ static int esp_video_vfs_open(void *ctx, const char *path, int flags, int mode)
         return -1;
     }
 
-    return video->id;
+    /* Every opened file has a client slot, so they are told apart */
+    slot = esp_video_client_open(video);
+    if (slot < 0) {
+        esp_video_close(video);
+        errno = EMFILE;
+        return -1;
+    }
+
+    fd = -1;
+    portENTER_CRITICAL(&s_vfs_lock);
+    for (int i = 0; i < ESP_VIDEO_VFS_FILE_MAX; i++) {
+        if (!s_vfs_file[i].video) {
+            s_vfs_file[i].video = video;
+            s_vfs_file[i].slot = slot;
+            fd = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_vfs_lock);
+
+    if (fd < 0) {
+        esp_video_client_close(video, slot);
+        esp_video_close(video);
+        errno = ENFILE;
+        return -1;
+    }
+
+    esp_video_get_client(video, slot)->nonblock = (flags & O_NONBLOCK) != 0;
+
+    return fd;
+}
+
+/* Client slot of a local file descriptor, -1 if the file isn't an opened file of the video device */
+static int esp_video_vfs_get_slot(struct esp_video *video, int fd)
+{
+    if (fd < 0 || fd >= ESP_VIDEO_VFS_FILE_MAX || s_vfs_file[fd].video != video) {
+        return -1;
+    }
+
+    return s_vfs_file[fd].slot;
 }
 
 static ssize_t esp_video_vfs_write(void *ctx, int fd, const void *data, size_t size)
@@ -110,6 +195,15 @@ static int esp_video_vfs_close(void *ctx, int fd)
     assert(fd >= 0);
     assert(video);
 
+    ret = esp_video_client_close(video, esp_video_vfs_get_slot(video, fd));
+    if (ret != ESP_OK) {
+        return esp_err_to_errno(ret);
+    }
+
+    portENTER_CRITICAL(&s_vfs_lock);
+    s_vfs_file[fd].video = NULL;
+    portEXIT_CRITICAL(&s_vfs_lock);
+
     ret = esp_video_close(video);
 
     return esp_err_to_errno(ret);
@@ -118,14 +212,25 @@ static int esp_video_vfs_close(void *ctx, int fd)
 static int esp_video_vfs_fcntl(void *ctx, int fd, int cmd, int arg)
 {
     int ret;
+    struct esp_video_client *client;
     struct esp_video *video = (struct esp_video *)ctx;
 
     assert(fd >= 0);
     assert(video);
 
+    client = esp_video_get_client(video, esp_video_vfs_get_slot(video, fd));
+    if (!client) {
+        errno = EBADF;
+        return -1;
+    }
+
     switch (cmd) {
     case F_GETFL:
-        ret = O_RDONLY;
+        ret = O_RDONLY | (client->nonblock ? O_NONBLOCK : 0);
+        break;
+    case F_SETFL:
+        client->nonblock = (arg & O_NONBLOCK) != 0;
+        ret = 0;
         break;
     default:
         ret = -1;
@@ -149,16 +254,161 @@ static int esp_video_vfs_fsync(void *ctx, int fd)
 static int esp_video_vfs_ioctl(void *ctx, int fd, int cmd, va_list args)
 {
     esp_err_t ret;
+    struct esp_video_client *client;
     struct esp_video *video = (struct esp_video *)ctx;
 
     assert(fd >= 0);
     assert(video);
 
-    ret = esp_video_ioctl(video, cmd, args);
+    client = esp_video_get_client(video, esp_video_vfs_get_slot(video, fd));
+    if (!client) {
+        errno = EBADF;
+        return -1;
+    }
+
+    ret = esp_video_ioctl(video, client, cmd, args);
+    if (ret == ESP_ERR_TIMEOUT && client->nonblock && (cmd == VIDIOC_DQBUF || cmd == VIDIOC_BATCH_BUF)) {
+        errno = EAGAIN;
+        return -1;
+    }
 
     return esp_err_to_errno(ret);
 }
 
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+/**
+ * Add the ready files of a select() entry to the caller sets, only files of the video
+ * device if it isn't NULL. The lock must be held. Returns true if the select semaphore
+ * is to be given, which is done once.
+ */
+static bool IRAM_ATTR esp_video_vfs_select_check(struct esp_video_vfs_select *sel, struct esp_video *video)
+{
+    bool ready = false;
+
+    for (int fd = 0; fd < sel->nfds; fd++) {
+        uint32_t events;
+        bool rd = FD_ISSET(fd, &sel->readfds);
+        bool wr = FD_ISSET(fd, &sel->writefds);
+        struct esp_video_vfs_file *file = &s_vfs_file[fd];
+
+        if ((!rd && !wr) || !file->video || (video && file->video != video)) {
+            continue;
+        }
+
+        events = esp_video_client_poll(file->video, &file->video->client[file->slot]);
+        if (rd && (events & ESP_VIDEO_POLL_IN)) {
+            FD_SET(fd, sel->readfds_ready);
+            ready = true;
+        }
+        if (wr && (events & ESP_VIDEO_POLL_OUT)) {
+            FD_SET(fd, sel->writefds_ready);
+            ready = true;
+        }
+    }
+
+    if (!ready || sel->triggered) {
+        return false;
+    }
+
+    sel->triggered = true;
+
+    return true;
+}
+
+static esp_err_t esp_video_vfs_start_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+                                            esp_vfs_select_sem_t sem, void **end_select_args)
+{
+    BaseType_t woken = pdFALSE;
+    struct esp_video_vfs_select *sel = NULL;
+
+    portENTER_CRITICAL(&s_vfs_lock);
+    for (int i = 0; i < ESP_VIDEO_VFS_SELECT_MAX; i++) {
+        if (!s_vfs_select[i].used) {
+            sel = &s_vfs_select[i];
+            break;
+        }
+    }
+    if (!sel) {
+        portEXIT_CRITICAL(&s_vfs_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The caller sets return the ready files, the waited ones are kept here */
+    sel->used = true;
+    sel->triggered = false;
+    sel->nfds = MIN(nfds, ESP_VIDEO_VFS_FILE_MAX);
+    sel->readfds = *readfds;
+    sel->writefds = *writefds;
+    sel->readfds_ready = readfds;
+    sel->writefds_ready = writefds;
+    sel->sem = sem;
+    FD_ZERO(readfds);
+    FD_ZERO(writefds);
+    FD_ZERO(exceptfds);
+    s_vfs_select_count++;
+
+    /* The semaphore of a returned select() call is gone, so it is given in the lock */
+    if (esp_video_vfs_select_check(sel, NULL)) {
+        esp_vfs_select_triggered_isr(sel->sem, &woken);
+    }
+    portEXIT_CRITICAL(&s_vfs_lock);
+
+    if (woken == pdTRUE) {
+        portYIELD();
+    }
+
+    *end_select_args = sel;
+
+    return ESP_OK;
+}
+
+static esp_err_t esp_video_vfs_end_select(void *end_select_args)
+{
+    struct esp_video_vfs_select *sel = (struct esp_video_vfs_select *)end_select_args;
+
+    portENTER_CRITICAL(&s_vfs_lock);
+    sel->used = false;
+    s_vfs_select_count--;
+    portEXIT_CRITICAL(&s_vfs_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Wake up select() calls waiting for files of a video device which became ready.
+ *
+ * @param video  Video object
+ * @param wakeup Set to pdTRUE if a higher priority task was woken up, only used in ISR
+ *
+ * @return None
+ */
+void IRAM_ATTR esp_video_vfs_select_notify(struct esp_video *video, BaseType_t *wakeup)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (!s_vfs_select_count) {
+        return;
+    }
+
+    /* The ISR variant doesn't block, so it is also used from tasks in the lock */
+    portENTER_CRITICAL_SAFE(&s_vfs_lock);
+    for (int i = 0; i < ESP_VIDEO_VFS_SELECT_MAX; i++) {
+        if (s_vfs_select[i].used && esp_video_vfs_select_check(&s_vfs_select[i], video)) {
+            esp_vfs_select_triggered_isr(s_vfs_select[i].sem, &woken);
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&s_vfs_lock);
+
+    if (woken == pdTRUE) {
+        if (xPortInIsrContext()) {
+            *wakeup = pdTRUE;
+        } else {
+            portYIELD();
+        }
+    }
+}
+#endif
+
 static const esp_vfs_t s_esp_video_vfs = {
     .flags   = ESP_VFS_FLAG_CONTEXT_PTR,
     .open_p  = esp_video_vfs_open,
@@ -168,7 +418,11 @@ static const esp_vfs_t s_esp_video_vfs = {
     .fcntl_p = esp_video_vfs_fcntl,
     .fsync_p = esp_video_vfs_fsync,
     .fstat_p = esp_video_vfs_fstat,
-    .ioctl_p = esp_video_vfs_ioctl
+    .ioctl_p = esp_video_vfs_ioctl,
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+    .start_select = esp_video_vfs_start_select,
+    .end_select   = esp_video_vfs_end_select,
+#endif
 };
 
 /**
@@ -0,0 +1,663 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: ESPRESSIF MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "unity.h"
+
+#include "esp_video.h"
+
+#define MOCK_NAME               "MOCK"
+#define MOCK_ID                 0
+#define MOCK_WIDTH              64
+#define MOCK_HEIGHT             48
+#define MOCK_BUF_SIZE           (MOCK_WIDTH * MOCK_HEIGHT * 2)
+#define MOCK_ALIGN_BYTES        64
+#define MOCK_MEM_CAPS           (MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL)
+
+#define TEST_BUFFER_COUNT       4
+#define TEST_FRAMES             20000
+#define TEST_SUB_DEPTH          2
+#define TEST_TASK_STACK         4096
+#define TEST_TASK_PRIORITY      (tskIDLE_PRIORITY + 1)
+#define TEST_RECV_TICKS         pdMS_TO_TICKS(1000)
+#define TEST_READER_TICKS       pdMS_TO_TICKS(10)
+#define TEST_OWNER_TASKS        2
+#define TEST_RING_ELEMENTS      8
+#define TEST_RING_TRANSFERS     200000
+
+#define CAPTURE                 V4L2_BUF_TYPE_VIDEO_CAPTURE
+
+/* Time of one successful call of a queue operation */
+struct op_stats {
+    const char *name;
+    uint32_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+struct test_ctx {
+    struct esp_video *video;
+    struct esp_video_client *client;
+    uint8_t client_mask;
+
+    SemaphoreHandle_t driver_done;
+    SemaphoreHandle_t reader_done;
+    bool reader_stop;                       /* Accessed with __atomic, set once the owner got every frame */
+
+    uint32_t errors;                        /* Failures seen by the tasks, Unity asserts only in the test task */
+    uint32_t reader_frames;
+    uint32_t owner_frames;                  /* Frames received by all owner tasks, accessed with __atomic */
+    bool track_state;                       /* Check every hand-off, only if the stream owner is the last holder */
+    uint8_t state[TEST_BUFFER_COUNT];       /* Holder of each element, ELEMENT_AT_XXX */
+
+    struct op_stats get_queued;
+    struct op_stats done;
+    struct op_stats recv;
+    struct op_stats queue;
+    struct op_stats client_recv;
+    struct op_stats client_release;
+};
+
+/* One of several owner tasks receiving from the same stream */
+struct owner_ctx {
+    struct test_ctx *test;
+    SemaphoreHandle_t done;
+    struct op_stats recv;
+    struct op_stats queue;
+};
+
+/* Holder of an element, every hand-off must find the element at the holder before it */
+enum {
+    ELEMENT_AT_QUEUED = 0,
+    ELEMENT_AT_DRIVER,
+    ELEMENT_AT_DONE,
+};
+
+/* Two element rings passing elements back and forth, each ring has one producer and one consumer */
+struct ring_ctx {
+    struct esp_video_buffer *buffer;
+    esp_video_buffer_ring_t fwd_ring;       /* Producer task to consumer task */
+    esp_video_buffer_ring_t ret_ring;       /* Consumer task back to producer task */
+    SemaphoreHandle_t producer_done;
+
+    uint32_t errors;                        /* Written by the consumer task only */
+
+    struct op_stats push;
+    struct op_stats pop;
+    struct op_stats ret_push;
+    struct op_stats ret_pop;
+};
+
+static struct {
+    uint32_t valid_events;
+} s_mock;
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void op_stats_add(struct op_stats *stats, uint64_t start_ns)
+{
+    uint64_t ns = now_ns() - start_ns;
+
+    stats->count++;
+    stats->total_ns += ns;
+    if (ns > stats->max_ns) {
+        stats->max_ns = ns;
+    }
+}
+
+static inline void test_error(struct test_ctx *ctx)
+{
+    __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+}
+
+/* Move an element from one holder to the next, a wrong holder means two sides own it */
+static inline void test_element_move(struct test_ctx *ctx, struct esp_video_buffer_element *element,
+                                     uint8_t from, uint8_t to)
+{
+    uint8_t expected = from;
+
+    if (!ctx->track_state) {
+        return;
+    }
+
+    if (!__atomic_compare_exchange_n(&ctx->state[element->index], &expected, to, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        test_error(ctx);
+        __atomic_store_n(&ctx->state[element->index], to, __ATOMIC_RELEASE);
+    }
+}
+
+static void op_stats_report(const struct op_stats *stats)
+{
+    if (!stats->count) {
+        return;
+    }
+
+    printf("%-40s %8" PRIu32 " ops %8" PRIu64 " ns/op %10" PRIu64 " ns max\n",
+           stats->name, stats->count, stats->total_ns / stats->count, stats->max_ns);
+}
+
+static esp_err_t mock_video_init(struct esp_video *video)
+{
+    CAPTURE_VIDEO_SET_FORMAT(video, MOCK_WIDTH, MOCK_HEIGHT, V4L2_PIX_FMT_RGB565);
+    CAPTURE_VIDEO_SET_BUF_INFO(video, MOCK_BUF_SIZE, MOCK_ALIGN_BYTES, MOCK_MEM_CAPS);
+
+    return ESP_OK;
+}
+
+static esp_err_t mock_video_deinit(struct esp_video *video)
+{
+    return ESP_OK;
+}
+
+static esp_err_t mock_video_start(struct esp_video *video, uint32_t type)
+{
+    return ESP_OK;
+}
+
+static esp_err_t mock_video_stop(struct esp_video *video, uint32_t type)
+{
+    return ESP_OK;
+}
+
+static esp_err_t mock_video_enum_format(struct esp_video *video, uint32_t type, uint32_t index, uint32_t *pixel_format)
+{
+    if (index > 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    *pixel_format = V4L2_PIX_FMT_RGB565;
+
+    return ESP_OK;
+}
+
+static esp_err_t mock_video_set_format(struct esp_video *video, const struct v4l2_format *format)
+{
+    return ESP_OK;
+}
+
+static esp_err_t mock_video_notify(struct esp_video *video, enum esp_video_event event, void *arg)
+{
+    if (event == ESP_VIDEO_BUFFER_VALID) {
+        __atomic_fetch_add(&s_mock.valid_events, 1, __ATOMIC_RELAXED);
+    }
+
+    return ESP_OK;
+}
+
+static const struct esp_video_ops s_mock_video_ops = {
+    .init         = mock_video_init,
+    .deinit       = mock_video_deinit,
+    .start        = mock_video_start,
+    .stop         = mock_video_stop,
+    .enum_format  = mock_video_enum_format,
+    .set_format   = mock_video_set_format,
+    .notify       = mock_video_notify,
+};
+
+static void test_ctx_init(struct test_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(struct test_ctx));
+
+    ctx->get_queued.name = "esp_video_get_queued_element";
+    ctx->done.name = "esp_video_done_element";
+    ctx->recv.name = "esp_video_recv_element";
+    ctx->queue.name = "esp_video_queue_element";
+    ctx->client_recv.name = "esp_video_client_recv_element";
+    ctx->client_release.name = "esp_video_client_release_element_index";
+
+    ctx->driver_done = xSemaphoreCreateBinary();
+    ctx->reader_done = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(ctx->driver_done);
+    TEST_ASSERT_NOT_NULL(ctx->reader_done);
+}
+
+static void test_ctx_deinit(struct test_ctx *ctx)
+{
+    vSemaphoreDelete(ctx->driver_done);
+    vSemaphoreDelete(ctx->reader_done);
+}
+
+/* Create and open the mock device, every element is queued to the driver and the stream is started */
+static struct esp_video *mock_video_setup(uint32_t flags)
+{
+    struct esp_video *video;
+    const struct esp_video_buffer_policy policy = {
+        .type = CAPTURE,
+        .flags = flags,
+    };
+
+    memset(&s_mock, 0, sizeof(s_mock));
+
+    video = esp_video_create(MOCK_NAME, MOCK_ID, &s_mock_video_ops, &s_mock,
+                             V4L2_CAP_VIDEO_CAPTURE, V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING);
+    TEST_ASSERT_NOT_NULL(video);
+    TEST_ASSERT_EQUAL_PTR(video, esp_video_open(MOCK_NAME));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_set_buffer_policy(video, &policy));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_setup_buffer(video, CAPTURE, V4L2_MEMORY_MMAP, TEST_BUFFER_COUNT));
+    for (int i = 0; i < TEST_BUFFER_COUNT; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_video_queue_element_index(video, CAPTURE, i));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_start_capture(video, CAPTURE));
+
+    return video;
+}
+
+static void mock_video_teardown(struct esp_video *video)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_stop_capture(video, CAPTURE));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_close(video));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_destroy(video));
+}
+
+/* Every element must be back in the queued ring once all holders gave it */
+static void check_all_queued(struct esp_video *video)
+{
+    uint32_t count = 0;
+
+    while (esp_video_get_queued_element(video, CAPTURE)) {
+        count++;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(TEST_BUFFER_COUNT, count);
+}
+
+/* Driver side: pops the queued ring and pushes the done ring, like the frame end ISR of a capture device */
+static void mock_driver_task(void *arg)
+{
+    struct test_ctx *ctx = (struct test_ctx *)arg;
+
+    for (uint32_t i = 0; i < TEST_FRAMES;) {
+        struct esp_video_buffer_element *element;
+        uint64_t start;
+
+        start = now_ns();
+        element = esp_video_get_queued_element(ctx->video, CAPTURE);
+        if (!element) {
+            taskYIELD();
+            continue;
+        }
+        op_stats_add(&ctx->get_queued, start);
+
+        test_element_move(ctx, element, ELEMENT_AT_QUEUED, ELEMENT_AT_DRIVER);
+        element->valid_size = MOCK_BUF_SIZE;
+        test_element_move(ctx, element, ELEMENT_AT_DRIVER, ELEMENT_AT_DONE);
+
+        start = now_ns();
+        if (esp_video_done_element(ctx->video, CAPTURE, element) != ESP_OK) {
+            test_error(ctx);
+        }
+        op_stats_add(&ctx->done, start);
+
+        i++;
+    }
+
+    xSemaphoreGive(ctx->driver_done);
+    vTaskDelete(NULL);
+}
+
+/* Subscriber side: receives done elements from its client ring and gives them back */
+static void mock_reader_task(void *arg)
+{
+    struct test_ctx *ctx = (struct test_ctx *)arg;
+    uint32_t last_sequence = 0;
+
+    while (!__atomic_load_n(&ctx->reader_stop, __ATOMIC_ACQUIRE)) {
+        struct esp_video_buffer_element *element;
+        uint64_t start;
+
+        start = now_ns();
+        element = esp_video_client_recv_element(ctx->video, ctx->client, TEST_READER_TICKS);
+        if (!element) {
+            continue;
+        }
+        op_stats_add(&ctx->client_recv, start);
+
+        /* A slow reader misses frames, but never gets one twice or out of order */
+        if (!(element->readers & ctx->client_mask) ||
+                (ctx->reader_frames && (int32_t)(element->sequence - last_sequence) <= 0)) {
+            test_error(ctx);
+        }
+        last_sequence = element->sequence;
+        ctx->reader_frames++;
+
+        start = now_ns();
+        if (esp_video_client_release_element_index(ctx->video, ctx->client, element->index) != ESP_OK) {
+            test_error(ctx);
+        }
+        op_stats_add(&ctx->client_release, start);
+    }
+
+    xSemaphoreGive(ctx->reader_done);
+    vTaskDelete(NULL);
+}
+
+/* Stream owner side: receives every done element in order and queues it back */
+static void run_owner(struct test_ctx *ctx)
+{
+    for (uint32_t i = 0; i < TEST_FRAMES; i++) {
+        struct esp_video_buffer_element *element;
+        uint64_t start;
+
+        start = now_ns();
+        element = esp_video_recv_element(ctx->video, CAPTURE, TEST_RECV_TICKS);
+        TEST_ASSERT_NOT_NULL_MESSAGE(element, "driver task stalled");
+        op_stats_add(&ctx->recv, start);
+
+        TEST_ASSERT_EQUAL_UINT32(i, element->sequence);
+        TEST_ASSERT_EQUAL_UINT32(MOCK_BUF_SIZE, element->valid_size);
+        test_element_move(ctx, element, ELEMENT_AT_DONE, ELEMENT_AT_QUEUED);
+
+        start = now_ns();
+        TEST_ASSERT_EQUAL(ESP_OK, esp_video_queue_element(ctx->video, CAPTURE, element));
+        op_stats_add(&ctx->queue, start);
+    }
+
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(ctx->driver_done, TEST_RECV_TICKS));
+}
+
+static void test_queue_rings(void)
+{
+    struct test_ctx ctx;
+
+    test_ctx_init(&ctx);
+    ctx.track_state = true;
+    ctx.video = mock_video_setup(0);
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(mock_driver_task, "mock_driver", TEST_TASK_STACK, &ctx, TEST_TASK_PRIORITY, NULL));
+    run_owner(&ctx);
+
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.errors);
+    /* The initial queueing and every frame given back */
+    TEST_ASSERT_EQUAL_UINT32(TEST_BUFFER_COUNT + TEST_FRAMES, s_mock.valid_events);
+    check_all_queued(ctx.video);
+
+    op_stats_report(&ctx.get_queued);
+    op_stats_report(&ctx.done);
+    op_stats_report(&ctx.recv);
+    op_stats_report(&ctx.queue);
+
+    mock_video_teardown(ctx.video);
+    test_ctx_deinit(&ctx);
+}
+
+static void test_subscriber_refcount(void)
+{
+    int index;
+    struct test_ctx ctx;
+    const struct esp_video_buffer_subscribe sub = {
+        .type = CAPTURE,
+        .depth = TEST_SUB_DEPTH,
+    };
+
+    test_ctx_init(&ctx);
+    ctx.video = mock_video_setup(0);
+
+    index = esp_video_client_open(ctx.video);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, index);
+    ctx.client = esp_video_get_client(ctx.video, index);
+    ctx.client_mask = 1 << index;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_client_subscribe(ctx.video, ctx.client, &sub));
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(mock_reader_task, "mock_reader", TEST_TASK_STACK, &ctx, TEST_TASK_PRIORITY, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(mock_driver_task, "mock_driver", TEST_TASK_STACK, &ctx, TEST_TASK_PRIORITY, NULL));
+    run_owner(&ctx);
+
+    __atomic_store_n(&ctx.reader_stop, true, __ATOMIC_RELEASE);
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(ctx.reader_done, TEST_RECV_TICKS));
+
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.errors);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, ctx.reader_frames);
+    printf("subscriber received %" PRIu32 " of %d frames\n", ctx.reader_frames, TEST_FRAMES);
+
+    /* Elements left in the client ring go back with the unsubscribe */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_client_close(ctx.video, index));
+    for (int i = 0; i < TEST_BUFFER_COUNT; i++) {
+        struct esp_video_buffer_element *element = ESP_VIDEO_BUFFER_ELEMENT(esp_video_stream_of(ctx.video, CAPTURE)->buffer, i);
+
+        TEST_ASSERT_EQUAL_UINT8(0, element->readers);
+    }
+    check_all_queued(ctx.video);
+
+    op_stats_report(&ctx.get_queued);
+    op_stats_report(&ctx.done);
+    op_stats_report(&ctx.recv);
+    op_stats_report(&ctx.queue);
+    op_stats_report(&ctx.client_recv);
+    op_stats_report(&ctx.client_release);
+
+    mock_video_teardown(ctx.video);
+    test_ctx_deinit(&ctx);
+}
+
+/* One of several stream owners: receives done elements and queues them back, until all frames are taken */
+static void mock_owner_task(void *arg)
+{
+    struct owner_ctx *owner = (struct owner_ctx *)arg;
+    struct test_ctx *ctx = owner->test;
+    uint32_t last_sequence = 0;
+    bool first = true;
+
+    while (__atomic_load_n(&ctx->owner_frames, __ATOMIC_ACQUIRE) < TEST_FRAMES) {
+        struct esp_video_buffer_element *element;
+        uint64_t start;
+
+        start = now_ns();
+        element = esp_video_recv_element(ctx->video, CAPTURE, TEST_READER_TICKS);
+        if (!element) {
+            continue;
+        }
+        op_stats_add(&owner->recv, start);
+
+        /* Owners share the done ring, each one still sees its frames in order */
+        if (!first && (int32_t)(element->sequence - last_sequence) <= 0) {
+            test_error(ctx);
+        }
+        first = false;
+        last_sequence = element->sequence;
+        test_element_move(ctx, element, ELEMENT_AT_DONE, ELEMENT_AT_QUEUED);
+        __atomic_fetch_add(&ctx->owner_frames, 1, __ATOMIC_ACQ_REL);
+
+        start = now_ns();
+        if (esp_video_queue_element(ctx->video, CAPTURE, element) != ESP_OK) {
+            test_error(ctx);
+        }
+        op_stats_add(&owner->queue, start);
+    }
+
+    xSemaphoreGive(owner->done);
+    vTaskDelete(NULL);
+}
+
+/*
+ * With ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO the driver takes the newest queued element, moving
+ * the producer counter of the queued ring back under stream_lock, while two owner tasks push
+ * to the same end under the same lock and pop the done ring.
+ */
+static void test_lifo_recycle_stress(void)
+{
+    struct test_ctx ctx;
+    struct owner_ctx owners[TEST_OWNER_TASKS];
+
+    test_ctx_init(&ctx);
+    ctx.track_state = true;
+    ctx.video = mock_video_setup(ESP_VIDEO_BUFFER_FLAG_RECYCLE_LIFO);
+
+    for (int i = 0; i < TEST_OWNER_TASKS; i++) {
+        memset(&owners[i], 0, sizeof(struct owner_ctx));
+        owners[i].test = &ctx;
+        owners[i].recv.name = "esp_video_recv_element";
+        owners[i].queue.name = "esp_video_queue_element";
+        owners[i].done = xSemaphoreCreateBinary();
+        TEST_ASSERT_NOT_NULL(owners[i].done);
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(mock_owner_task, "mock_owner", TEST_TASK_STACK, &owners[i], TEST_TASK_PRIORITY, NULL));
+    }
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(mock_driver_task, "mock_driver", TEST_TASK_STACK, &ctx, TEST_TASK_PRIORITY, NULL));
+
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(ctx.driver_done, pdMS_TO_TICKS(60000)));
+    for (int i = 0; i < TEST_OWNER_TASKS; i++) {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(owners[i].done, TEST_RECV_TICKS));
+        vSemaphoreDelete(owners[i].done);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.errors);
+    TEST_ASSERT_EQUAL_UINT32(TEST_FRAMES, ctx.owner_frames);
+    check_all_queued(ctx.video);
+
+    op_stats_report(&ctx.get_queued);
+    op_stats_report(&ctx.done);
+    for (int i = 0; i < TEST_OWNER_TASKS; i++) {
+        printf("owner %d:\n", i);
+        op_stats_report(&owners[i].recv);
+        op_stats_report(&owners[i].queue);
+    }
+
+    mock_video_teardown(ctx.video);
+    test_ctx_deinit(&ctx);
+}
+
+/* Producer side, like a capture ISR: no lock, takes elements back from ret_ring and numbers them */
+static void ring_producer_task(void *arg)
+{
+    struct ring_ctx *ctx = (struct ring_ctx *)arg;
+
+    for (uint32_t i = 0; i < TEST_RING_TRANSFERS;) {
+        struct esp_video_buffer_element *element;
+        uint64_t start;
+
+        start = now_ns();
+        element = esp_video_buffer_ring_pop(&ctx->ret_ring, ctx->buffer);
+        if (!element) {
+            taskYIELD();
+            continue;
+        }
+        op_stats_add(&ctx->ret_pop, start);
+
+        element->sequence = i++;
+
+        start = now_ns();
+        esp_video_buffer_ring_push(&ctx->fwd_ring, element);
+        op_stats_add(&ctx->push, start);
+    }
+
+    xSemaphoreGive(ctx->producer_done);
+    vTaskDelete(NULL);
+}
+
+/*
+ * The lock free side of a ring: a producer task standing in for the driver ISR and the
+ * consumer in the test task, each ring written by one side per counter. Every element is
+ * seen once and in order, or a counter or index store is visible too early.
+ */
+static void test_ring_spsc_stress(void)
+{
+    struct ring_ctx ctx;
+    const struct esp_video_buffer_info info = {
+        .count = TEST_RING_ELEMENTS,
+        .size = MOCK_BUF_SIZE,
+        .align_size = MOCK_ALIGN_BYTES,
+        .caps = MOCK_MEM_CAPS,
+        .memory_type = V4L2_MEMORY_USERPTR,
+    };
+
+    memset(&ctx, 0, sizeof(struct ring_ctx));
+    ctx.push.name = "esp_video_buffer_ring_push";
+    ctx.pop.name = "esp_video_buffer_ring_pop";
+    ctx.ret_push.name = "esp_video_buffer_ring_push (return)";
+    ctx.ret_pop.name = "esp_video_buffer_ring_pop (return)";
+    ctx.producer_done = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(ctx.producer_done);
+
+    ctx.buffer = esp_video_buffer_create(&info);
+    TEST_ASSERT_NOT_NULL(ctx.buffer);
+    esp_video_buffer_ring_reset(&ctx.fwd_ring);
+    esp_video_buffer_ring_reset(&ctx.ret_ring);
+    for (int i = 0; i < TEST_RING_ELEMENTS; i++) {
+        esp_video_buffer_ring_push(&ctx.ret_ring, ESP_VIDEO_BUFFER_ELEMENT(ctx.buffer, i));
+    }
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(ring_producer_task, "ring_producer", TEST_TASK_STACK, &ctx, TEST_TASK_PRIORITY, NULL));
+
+    for (uint32_t i = 0; i < TEST_RING_TRANSFERS;) {
+        struct esp_video_buffer_element *element;
+        uint64_t start;
+
+        start = now_ns();
+        element = esp_video_buffer_ring_pop(&ctx.fwd_ring, ctx.buffer);
+        if (!element) {
+            taskYIELD();
+            continue;
+        }
+        op_stats_add(&ctx.pop, start);
+
+        if (element->sequence != i++) {
+            ctx.errors++;
+        }
+
+        start = now_ns();
+        esp_video_buffer_ring_push(&ctx.ret_ring, element);
+        op_stats_add(&ctx.ret_push, start);
+    }
+
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(ctx.producer_done, TEST_RECV_TICKS));
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.errors);
+    TEST_ASSERT_TRUE(esp_video_buffer_ring_is_empty(&ctx.fwd_ring));
+
+    /* All elements are back, each one once */
+    uint32_t seen = 0;
+    struct esp_video_buffer_element *element;
+
+    while ((element = esp_video_buffer_ring_pop(&ctx.ret_ring, ctx.buffer))) {
+        TEST_ASSERT_FALSE(seen & (1 << element->index));
+        seen |= 1 << element->index;
+    }
+    TEST_ASSERT_EQUAL_UINT32((1 << TEST_RING_ELEMENTS) - 1, seen);
+
+    op_stats_report(&ctx.push);
+    op_stats_report(&ctx.pop);
+    op_stats_report(&ctx.ret_push);
+    op_stats_report(&ctx.ret_pop);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_video_buffer_destroy(ctx.buffer));
+    vSemaphoreDelete(ctx.producer_done);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    int failures;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_rings);
+    RUN_TEST(test_subscriber_refcount);
+    RUN_TEST(test_lifo_recycle_stress);
+    RUN_TEST(test_ring_spsc_stress);
+    failures = UNITY_END();
+
+    exit(failures);
+}
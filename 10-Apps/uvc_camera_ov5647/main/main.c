@@ -11,6 +11,7 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "os_interface.h"
+#include "os_boot.h"
 #include "uvc_app_common.h"
 
 #ifdef DEBUG_MENLEAK
@@ -39,6 +40,9 @@ static void monitor_heap(void)
 
 void app_main(void)
 {
+    /* Before the first log line, with CONFIG_EXAMPLE_FAST_BOOT they are buffered until the first frame */
+    os_boot_start();
+
     ESP_LOGI(APP_TAG, "========================================");
     ESP_LOGI(APP_TAG, "  UVC Camera Application");
     ESP_LOGI(APP_TAG, "  Architecture: Reference Pattern");
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""
+Collect the pipeline benchmark results (CONFIG_EXAMPLE_BENCHMARK) and compare
+them against a baseline.
+
+Reads the console from a serial port (needs pyserial) or a captured log until
+the BENCH_DONE line, optionally saves the runs as JSON, and reports every run
+whose FPS dropped or whose total p95 latency grew beyond the threshold. The
+exit status is 1 if any run regressed, so it can gate an IDF or component
+upgrade.
+
+    benchmark_compare.py /dev/ttyUSB0 --save results.json
+    benchmark_compare.py --file console.log --baseline results.json --threshold 5
+
+With several camera formats in the sweep (CONFIG_EXAMPLE_BENCHMARK_CAPTURE_FORMATS),
+--encode-cost prints their encode time relative to YUV 4:2:0 as the value of
+CONFIG_EXAMPLE_CAPTURE_ENCODE_COST.
+
+With the ISP sweep (CONFIG_EXAMPLE_BENCHMARK_ISP), every run shows the ISP
+interrupt and image algorithm load, a run with a held block is the cost of that
+block when compared with the same run holding none.
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = 'BENCH '
+DONE = 'BENCH_DONE'
+REFERENCE_CAPTURE = 'YU12'     # YUV 4:2:0, the 100 of CONFIG_EXAMPLE_CAPTURE_ENCODE_COST
+
+
+def runs(lines):
+    """Yield every result object until the sweep ends"""
+    for line in lines:
+        line = line.strip()
+        if line == DONE:
+            return
+        start = line.find(PREFIX + '{')
+        if start < 0:
+            continue
+        try:
+            yield json.loads(line[start + len(PREFIX):])
+        except ValueError:
+            # Console text of another task interleaved with the line
+            print('skipping garbled line: %s' % line, file=sys.stderr)
+
+
+def run_key(run):
+    setting = run.get('quality', run.get('bitrate'))
+    key = '%s/%s %dx%d@%d buf=%d set=%d' % (run['format'], run.get('capture', '?'), run['width'], run['height'],
+                                            run['rate'], run['buffers'], setting)
+    if 'isp' in run:
+        key += ' isp-%s' % run['isp']['held']
+    return key
+
+
+def encode_cost(results):
+    """Mean encode p50 of every camera format relative to the reference one, over the runs both have"""
+    groups = {}
+    for run in results:
+        config = (run['width'], run['height'], run['rate'], run['buffers'], run.get('quality', run.get('bitrate')))
+        groups.setdefault(config, {})[run.get('capture')] = run['latency_us']['encode']['p50']
+
+    ratios = {}
+    for group in groups.values():
+        ref = group.get(REFERENCE_CAPTURE)
+        if not ref:
+            continue
+        for capture, p50 in group.items():
+            ratios.setdefault(capture, []).append(p50 * 100.0 / ref)
+
+    return ','.join('%s:%d' % (capture, round(sum(values) / len(values))) for capture, values in sorted(ratios.items()))
+
+
+def serial_lines(port):
+    import serial
+    with serial.Serial(port, 115200, timeout=None) as link:
+        while True:
+            yield link.readline().decode('utf-8', 'replace')
+
+
+def compare(results, baseline, threshold):
+    """Print a line per run present in both, return the number of regressions"""
+    regressions = 0
+    base = {run_key(run): run for run in baseline}
+
+    for run in results:
+        key = run_key(run)
+        ref = base.get(key)
+        if not ref:
+            print('%-40s new' % key)
+            continue
+
+        fps_change = (run['fps'] - ref['fps']) * 100 / ref['fps'] if ref['fps'] else 0
+        p95 = run['latency_us']['total']['p95']
+        ref_p95 = ref['latency_us']['total']['p95']
+        p95_change = (p95 - ref_p95) * 100 / ref_p95 if ref_p95 else 0
+
+        regressed = fps_change < -threshold or p95_change > threshold
+        regressions += regressed
+        print('%-40s fps %6.2f (%+5.1f%%)  p95 %6dus (%+5.1f%%)%s' %
+              (key, run['fps'], fps_change, p95, p95_change, '  REGRESSION' if regressed else ''))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', nargs='?', help='serial port of the console')
+    parser.add_argument('--file', help='read a captured console log instead of a port')
+    parser.add_argument('--save', help='write the collected runs to this JSON file')
+    parser.add_argument('--baseline', help='JSON file saved by an earlier run')
+    parser.add_argument('--threshold', type=float, default=5.0, help='allowed change in percent (default 5)')
+    parser.add_argument('--encode-cost', action='store_true',
+                        help='print CONFIG_EXAMPLE_CAPTURE_ENCODE_COST from the camera formats of the sweep')
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, errors='replace') as log:
+            results = list(runs(log))
+    elif args.port:
+        try:
+            results = list(runs(serial_lines(args.port)))
+        except KeyboardInterrupt:
+            return 1
+    else:
+        parser.error('a port or --file is required')
+
+    if not results:
+        print('no benchmark results found', file=sys.stderr)
+        return 1
+
+    if args.save:
+        with open(args.save, 'w') as out:
+            json.dump(results, out, indent=1)
+
+    if args.encode_cost:
+        cost = encode_cost(results)
+        if not cost:
+            print('no %s runs to compare the camera formats with' % REFERENCE_CAPTURE, file=sys.stderr)
+            return 1
+        print('CONFIG_EXAMPLE_CAPTURE_ENCODE_COST="%s"' % cost)
+        return 0
+
+    if not args.baseline:
+        for run in results:
+            isp = run.get('isp')
+            print('%-40s fps %6.2f  p95 %6dus  cpu %s  psram %.1f MB/s%s' %
+                  (run_key(run), run['fps'], run['latency_us']['total']['p95'], run['cpu_pct'],
+                   run['psram_mbps_est'],
+                   '  isp irq %.2f%%  ipa %.2f%% (%dus/run)' % (isp['irq_pct'], isp['ipa_pct'], isp['ipa_us'])
+                   if isp else ''))
+        return 0
+
+    with open(args.baseline) as ref:
+        baseline = json.load(ref)
+
+    return 1 if compare(results, baseline, args.threshold) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Build the lens calibration blob of the video component (CONFIG_ESP_VIDEO_ENABLE_CALIB).
+
+The blob holds ISP lens shading gain tables and distortion correction meshes,
+one entry per frame size. Layout is defined in
+components/video/include/esp_video_calib.h, the firmware uses it in place.
+
+LSC tables come from a JSON file per ISP input frame size:
+
+    {"width": 1920, "height": 1080, "r": [...], "gr": [...], "gb": [...], "b": [...]}
+
+with one gain per grid point, row major. Meshes are computed from the camera
+intrinsics and the OpenCV distortion coefficients of the frame size:
+
+    calib_pack.py calib.bin --lsc lsc_1920x1080.json \\
+        --mesh 1280x720 --intrinsics FX FY CX CY --dist K1 K2 P1 P2 K3
+
+Flash it to the "calib" partition of partitions_calib.csv:
+
+    parttool.py write_partition --partition-name calib --input calib.bin
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = 0x424C4143
+VERSION = 1
+TYPE_LSC = 1
+TYPE_MESH = 2
+
+HEADER = struct.Struct('<IHHII')
+ENTRY = struct.Struct('<HHHHII')
+LSC_GRID_HEIGHT = 32        # ISP_LL_LSC_GRID_HEIGHT
+GAIN_MAX = 0x3FF            # isp_lsc_gain_t, 2 integer and 8 fraction bits
+
+
+def lsc_grids(res):
+    """Gain points along one side, as ISP_LSC_GET_GRIDS() in esp_video_isp_device.c"""
+    return (res - 1) // 2 // LSC_GRID_HEIGHT + 2
+
+
+def pack_lsc(path):
+    with open(path) as f:
+        lsc = json.load(f)
+    width, height = lsc['width'], lsc['height']
+    grid_w, grid_h = lsc_grids(width), lsc_grids(height)
+    data = struct.pack('<HH', grid_w, grid_h)
+    for channel in ('r', 'gr', 'gb', 'b'):
+        gains = lsc[channel]
+        if len(gains) != grid_w * grid_h:
+            sys.exit(f'{path}: {channel} needs {grid_w}x{grid_h} gains for {width}x{height}')
+        data += struct.pack(f'<{len(gains)}I', *(min(max(round(g * 256), 0), GAIN_MAX) for g in gains))
+    return TYPE_LSC, width, height, data
+
+
+def pack_mesh(size, cell, intrinsics, dist, zoom):
+    """Source position of every cell corner, the distortion model applied to the corrected frame"""
+    width, height = (int(v) for v in size.lower().split('x'))
+    fx, fy, cx, cy = intrinsics
+    k1, k2, p1, p2, k3 = dist
+    cols = (width + cell - 1) // cell
+    rows = (height + cell - 1) // cell
+    data = struct.pack('<HHHH', cell, cols, rows, 0)
+    for row in range(rows + 1):
+        for col in range(cols + 1):
+            x = (col * cell - cx) / (fx * zoom)
+            y = (row * cell - cy) / (fy * zoom)
+            r2 = x * x + y * y
+            radial = 1 + k1 * r2 + k2 * r2 * r2 + k3 * r2 * r2 * r2
+            xd = x * radial + 2 * p1 * x * y + p2 * (r2 + 2 * x * x)
+            yd = y * radial + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y
+            sx = min(max(round((fx * xd + cx) * 16), -32768), 32767)
+            sy = min(max(round((fy * yd + cy) * 16), -32768), 32767)
+            data += struct.pack('<hh', sx, sy)
+    return TYPE_MESH, width, height, data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('output', help='calibration blob to write')
+    parser.add_argument('--lsc', action='append', default=[], help='LSC gain table JSON, repeatable')
+    parser.add_argument('--mesh', action='append', default=[], metavar='WxH',
+                        help='frame size to build a distortion mesh for, repeatable')
+    parser.add_argument('--intrinsics', nargs=4, type=float, metavar=('FX', 'FY', 'CX', 'CY'),
+                        help='camera matrix at the mesh frame size')
+    parser.add_argument('--dist', nargs=5, type=float, default=[0] * 5, metavar=('K1', 'K2', 'P1', 'P2', 'K3'),
+                        help='OpenCV distortion coefficients')
+    parser.add_argument('--cell', type=int, default=32, help='mesh cell size, a power of 2 from 8 to 128')
+    parser.add_argument('--zoom', type=float, default=1.0,
+                        help='magnification of the corrected frame, above 1 crops the curved edges')
+    args = parser.parse_args()
+
+    if args.mesh and not args.intrinsics:
+        parser.error('--mesh needs --intrinsics')
+    if args.cell < 8 or args.cell > 128 or args.cell & (args.cell - 1):
+        parser.error('--cell must be a power of 2 from 8 to 128')
+
+    entries = [pack_lsc(path) for path in args.lsc]
+    entries += [pack_mesh(size, args.cell, args.intrinsics, args.dist, args.zoom) for size in args.mesh]
+
+    offset = HEADER.size + ENTRY.size * len(entries)
+    table = b''
+    body = b''
+    for etype, width, height, data in entries:
+        table += ENTRY.pack(etype, 0, width, height, offset + len(body), len(data))
+        body += data + b'\0' * (-len(data) % 4)
+
+    blob = HEADER.pack(MAGIC, VERSION, len(entries), offset + len(body), 0) + table + body
+    with open(args.output, 'wb') as f:
+        f.write(blob)
+    print(f'{args.output}: {len(entries)} entries, {len(blob)} bytes')
+
+
+if __name__ == '__main__':
+    main()
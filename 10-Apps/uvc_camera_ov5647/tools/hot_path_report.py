@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""
+Report where the hot set of the per-frame path (CONFIG_ESP_VIDEO_HOT_PATH_IN_IRAM)
+landed in a build and how many bytes it takes.
+
+Reads the mapping entries of the linker fragments and looks up the sections of
+every function in the linker map of the build. A function without a section was
+inlined into its caller or not linked, one in a flash section wasn't placed,
+e.g. the option is off.
+
+    hot_path_report.py build/uvc_camera_ov5647.map
+    hot_path_report.py --fragment components/uvc/linker.lf build/uvc_camera_ov5647.map
+"""
+
+import argparse
+import os
+import re
+import sys
+
+APP_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+FRAGMENTS = [os.path.join(APP_DIR, 'components', 'video', 'linker.lf'),
+             os.path.join(APP_DIR, 'components', 'uvc', 'linker.lf')]
+
+ENTRY = re.compile(r'^\s+(\w+):(\w+)\s+\((\w+)\)\s*$')
+ARCHIVE = re.compile(r'^archive:\s*(\S+)')
+# ' .text.name  0xaddr  0xsize  path/libx.a(obj.c.obj)', the name may be alone on its line
+INPUT = re.compile(r'^ (\.\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+))?\s*$')
+CONT = re.compile(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)\s*$')
+OUTPUT = re.compile(r'^(\.\S+)')
+PREFIXES = ('.text.', '.literal.', '.rodata.', '.srodata.')
+
+
+def fragment_entries(path):
+    """Yield (archive, object, function) of every mapping entry"""
+    archive = None
+    with open(path) as lf:
+        for line in lf:
+            line = line.split('#', 1)[0].rstrip()
+            match = ARCHIVE.match(line)
+            if match:
+                archive = match.group(1)
+                continue
+            match = ENTRY.match(line)
+            if match and archive:
+                yield archive, match.group(1), match.group(2)
+
+
+def symbol_of(section):
+    """Function a per-function section belongs to, .rodata.fn.str1.4 included"""
+    for prefix in PREFIXES:
+        if section.startswith(prefix):
+            return section[len(prefix):].split('.', 1)[0]
+    return None
+
+
+def map_sections(path):
+    """Yield (output section, input section, size, object path) of the memory map"""
+    with open(path, errors='replace') as mapfile:
+        lines = iter(mapfile)
+        for line in lines:
+            if line.startswith('Linker script and memory map'):
+                break
+
+        output = None
+        pending = None
+        for line in lines:
+            line = line.rstrip('\n')
+            if pending:
+                match = CONT.match(line)
+                if match:
+                    yield output, pending, int(match.group(2), 16), match.group(3)
+                pending = None
+                continue
+            match = OUTPUT.match(line)
+            if match:
+                output = match.group(1)
+                continue
+            match = INPUT.match(line)
+            if match:
+                if match.group(2) is None:
+                    pending = match.group(1)
+                else:
+                    yield output, match.group(1), int(match.group(3), 16), match.group(4)
+
+
+def region(output):
+    if 'iram' in output or 'dram' in output or 'tcm' in output:
+        return 'internal'
+    if 'flash' in output:
+        return 'flash'
+    return output
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('map', help='linker map of the build, build/<project>.map')
+    parser.add_argument('--fragment', action='append', help='linker fragment to read, repeatable, '
+                        'default the ones of the video and uvc components')
+    args = parser.parse_args()
+
+    wanted = {}
+    for path in args.fragment or FRAGMENTS:
+        for archive, obj, func in fragment_entries(path):
+            wanted[(archive, obj, func)] = {}
+
+    if not wanted:
+        print('no mapping entries found', file=sys.stderr)
+        return 1
+
+    for output, section, size, path in map_sections(args.map):
+        func = symbol_of(section)
+        match = re.search(r'(lib\w+\.a)\((\w+)\.c\.obj\)$', path)
+        if not func or not match or not size:
+            continue
+        key = (match.group(1), match.group(2), func)
+        if key in wanted:
+            where = wanted[key]
+            where[region(output)] = where.get(region(output), 0) + size
+
+    totals = {}
+    absent = 0
+    print('%-14s %-24s %-40s %9s %9s' % ('archive', 'object', 'function', 'internal', 'flash'))
+    for (archive, obj, func), where in sorted(wanted.items()):
+        if not where:
+            absent += 1
+            print('%-14s %-24s %-40s %19s' % (archive, obj, func, 'no section'))
+            continue
+        for name, size in where.items():
+            totals[name] = totals.get(name, 0) + size
+        print('%-14s %-24s %-40s %9d %9d' % (archive, obj, func, where.get('internal', 0), where.get('flash', 0)))
+
+    print('\n%d functions, %d inlined or not linked' % (len(wanted), absent))
+    print('internal RAM: %d bytes' % totals.get('internal', 0))
+    print('flash: %d bytes' % totals.get('flash', 0))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
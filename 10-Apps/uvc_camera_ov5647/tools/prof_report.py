@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Collect a PC sampling profile dumped to the console (CONFIG_PROF_ENABLE) and
+print the functions with the most samples, resolved from the ELF of the build.
+
+Reads the console from a serial port (needs pyserial) or a captured log until
+the PROF_DONE line. The dump is requested with SYS_EVENT_DUMP_PROFILE, the PCs
+are resolved with addr2line of the toolchain.
+
+    prof_report.py /dev/ttyACM0 build/uvc_camera_ov5647.elf
+    prof_report.py --file console.log --top 40 build/uvc_camera_ov5647.elf
+"""
+
+import argparse
+import json
+import subprocess
+import sys
+
+PREFIX = 'PROF '
+DONE = 'PROF_DONE'
+
+
+def records(lines):
+    """Yield every profile record until the dump ends"""
+    for line in lines:
+        line = line.strip()
+        if line == DONE:
+            return
+        start = line.find(PREFIX + '{')
+        if start < 0:
+            continue
+        try:
+            yield json.loads(line[start + len(PREFIX):])
+        except ValueError:
+            # Console text of another task interleaved with the line
+            print('skipping garbled line: %s' % line, file=sys.stderr)
+
+
+def serial_lines(port):
+    import serial
+    with serial.Serial(port, 115200, timeout=None) as link:
+        while True:
+            yield link.readline().decode('utf-8', 'replace')
+
+
+def resolve(addr2line, elf, pcs):
+    """Function name of every PC, '??' for addresses outside of the ELF"""
+    query = ''.join('0x%08x\n' % pc for pc in pcs)
+    result = subprocess.run([addr2line, '-f', '-e', elf], input=query, capture_output=True, text=True,
+                            check=True)
+    lines = result.stdout.splitlines()
+    # Two lines per address, the function and its file:line
+    return {pc: lines[2 * i] for i, pc in enumerate(pcs)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', nargs='?', help='serial port of the console')
+    parser.add_argument('elf', help='ELF of the build which was profiled')
+    parser.add_argument('--file', help='read a captured console log instead of a port')
+    parser.add_argument('--top', type=int, default=20, help='functions to print (default 20)')
+    parser.add_argument('--addr2line', default='riscv32-esp-elf-addr2line', help='addr2line of the toolchain')
+    args = parser.parse_args()
+
+    if args.file:
+        if args.port:
+            parser.error('give either a port or --file')
+        with open(args.file, errors='replace') as log:
+            dump = list(records(log))
+    elif args.port:
+        try:
+            dump = list(records(serial_lines(args.port)))
+        except KeyboardInterrupt:
+            return 1
+    else:
+        parser.error('a port or --file is required')
+
+    cores = {rec['core']: rec for rec in dump if 'samples' in rec}
+    samples = [rec for rec in dump if 'pc' in rec]
+    total = sum(core['samples'] for core in cores.values())
+    if not total:
+        print('no profile samples found', file=sys.stderr)
+        return 1
+
+    names = resolve(args.addr2line, args.elf, sorted({rec['pc'] for rec in samples}))
+    ncores = max(cores) + 1
+    functions = {}
+    for rec in samples:
+        counts = functions.setdefault(names[rec['pc']], [0] * ncores)
+        counts[rec['core']] += rec['n']
+
+    for core, rec in sorted(cores.items()):
+        print('core %d: %d samples at %d Hz, %.1f%% in ISRs, %d dropped' %
+              (core, rec['samples'], rec['hz'], rec['isr'] * 100.0 / max(rec['samples'], 1), rec['dropped']))
+    print()
+    print('%7s  %s  %s' % ('total', '  '.join('core%-3d' % core for core in range(ncores)), 'function'))
+    ranked = sorted(functions.items(), key=lambda item: sum(item[1]), reverse=True)
+    for name, counts in ranked[:args.top]:
+        print('%6.1f%%  %s  %s' % (sum(counts) * 100.0 / total,
+                                   '  '.join('%6.1f%%' % (n * 100.0 / total) for n in counts), name))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+Decode the binary telemetry stream of the UVC camera (CONFIG_EXAMPLE_TELEMETRY).
+
+Reads from a serial port (needs pyserial) or from a captured file, and prints
+one line per status record. Record layout is defined in
+components/os/include/os_telemetry.h.
+
+    telemetry_decode.py /dev/ttyACM0
+    telemetry_decode.py --file capture.bin
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x4D54
+VERSION = 1
+TYPE_STATUS = 1
+TYPE_PACING = 2
+RECORD_MAX = 256          # TELEMETRY_RECORD_MAX in telemetry_task.c
+
+HEADER = struct.Struct('<HBBHH')
+LATENCY_STAGES = ('dqbuf', 'queue', 'encode', 'usb', 'total')
+STATUS = struct.Struct('<14I4B2H' + '5I' * len(LATENCY_STAGES))
+PACING = struct.Struct('<I5I5I2I')
+CPU_UNKNOWN = 0xFFFF
+
+
+def crc16_le(data):
+    """CRC-16/X-25, as computed by esp_rom_crc16_le(0, data, len)"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc ^ 0xFFFF
+
+
+def records(stream):
+    """Yield (type, payload) of every valid record, skipping console text in between"""
+    buf = bytearray()
+    magic = struct.pack('<H', MAGIC)
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            return
+        buf += chunk
+        while True:
+            start = buf.find(magic)
+            if start < 0:
+                del buf[:-1]
+                break
+            del buf[:start]
+            if len(buf) < HEADER.size:
+                break
+            _, version, rtype, length, crc = HEADER.unpack_from(buf)
+            if version != VERSION or HEADER.size + length > RECORD_MAX:
+                # False match in console text, resync on the next byte
+                del buf[:1]
+                continue
+            if len(buf) < HEADER.size + length:
+                break
+            payload = bytes(buf[HEADER.size:HEADER.size + length])
+            if crc16_le(payload) != crc:
+                del buf[:1]
+                continue
+            del buf[:HEADER.size + length]
+            yield rtype, payload
+
+
+def format_status(payload):
+    fields = STATUS.unpack_from(payload)
+    (seq, uptime_ms, captured, encoded, streamed, secondary, dropped, oversize, static,
+     peak, uvc_size, free_heap, min_heap, free_psram) = fields[:14]
+    streaming, raw_q, enc_q, free_pool = fields[14:18]
+    cpu = fields[18:20]
+    lat = fields[20:]
+
+    cpu_text = ' '.join('-' if load == CPU_UNKNOWN else '%.1f%%' % (load / 10) for load in cpu)
+    lat_text = ' '.join('%s=%d/%d/%dus' % (name, lat[i * 5 + 1], lat[i * 5 + 3], lat[i * 5 + 4])
+                        for i, name in enumerate(LATENCY_STAGES) if lat[i * 5])
+
+    return ('#%d t=%.1fs %s cap=%d enc=%d usb=%d sec=%d drop=%d(%d big) static=%d '
+            'peak=%d/%d q=%d/%d/%d heap=%d(min %d) psram=%d cpu=%s %s' %
+            (seq, uptime_ms / 1000, 'ON ' if streaming else 'off', captured, encoded, streamed,
+             secondary, dropped, oversize, static, peak, uvc_size, raw_q, enc_q, free_pool,
+             free_heap, min_heap, free_psram, cpu_text, lat_text))
+
+
+def format_pacing(payload):
+    fields = PACING.unpack_from(payload)
+    seq = fields[0]
+    windows = (fields[1:6], fields[6:11])
+    longest_stall, stalls = fields[11:]
+
+    win_text = ' '.join('%s=%.2ffps/%dkbps gap=%d+-%d(max %d)us' %
+                        (name, w[0] / 100, w[1], w[2], w[3], w[4])
+                        for name, w in zip(('1s', '10s'), windows))
+
+    return '#%d pacing %s stalls=%d longest=%dus' % (seq, win_text, stalls, longest_stall)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', nargs='?', help='serial port of the USB Serial/JTAG interface')
+    parser.add_argument('--file', help='decode a captured stream instead of a port')
+    args = parser.parse_args()
+
+    if args.file:
+        stream = open(args.file, 'rb')
+    elif args.port:
+        import serial
+        stream = serial.Serial(args.port, timeout=None)
+    else:
+        parser.error('a port or --file is required')
+
+    try:
+        for rtype, payload in records(stream):
+            if rtype == TYPE_STATUS and len(payload) >= STATUS.size:
+                print(format_status(payload), flush=True)
+            elif rtype == TYPE_PACING and len(payload) >= PACING.size:
+                print(format_pacing(payload), flush=True)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Collect a pipeline trace dumped to the console (CONFIG_TRACE_ENABLE) and save
+it as a Chrome trace JSON file for Perfetto (ui.perfetto.dev) or
+chrome://tracing.
+
+Reads the console from a serial port (needs pyserial) or a captured log until
+the TRACE_DONE line. The dump is requested with SYS_EVENT_DUMP_TRACE without a
+payload. A dump to a file, e.g. on the SD card, is already in this format.
+
+    trace_extract.py /dev/ttyACM0 trace.json
+    trace_extract.py --file console.log trace.json
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = 'TRACE '
+DONE = 'TRACE_DONE'
+
+
+def events(lines):
+    """Yield every trace event until the dump ends"""
+    for line in lines:
+        line = line.strip()
+        if line == DONE:
+            return
+        start = line.find(PREFIX + '{')
+        if start < 0:
+            continue
+        try:
+            yield json.loads(line[start + len(PREFIX):])
+        except ValueError:
+            # Console text of another task interleaved with the line
+            print('skipping garbled line: %s' % line, file=sys.stderr)
+
+
+def serial_lines(port):
+    import serial
+    with serial.Serial(port, 115200, timeout=None) as link:
+        while True:
+            yield link.readline().decode('utf-8', 'replace')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', nargs='?', help='serial port of the console')
+    parser.add_argument('output', help='Chrome trace JSON file to write')
+    parser.add_argument('--file', help='read a captured console log instead of a port')
+    args = parser.parse_args()
+
+    if args.file:
+        if args.port:
+            parser.error('give either a port or --file')
+        with open(args.file, errors='replace') as log:
+            trace = list(events(log))
+    elif args.port:
+        try:
+            trace = list(events(serial_lines(args.port)))
+        except KeyboardInterrupt:
+            return 1
+    else:
+        parser.error('a port or --file is required')
+
+    if not trace:
+        print('no trace events found', file=sys.stderr)
+        return 1
+
+    with open(args.output, 'w') as out:
+        json.dump({'displayTimeUnit': 'ms', 'traceEvents': trace}, out)
+    print('%d events written to %s' % (len(trace), args.output))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())